@@ -0,0 +1,263 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "mvector.hh"
+#include "ray.hh"
+#include <cassert>
+#include <limits>
+#include <ostream>
+
+#ifndef AABB_HH
+#define AABB_HH
+
+/**
+ * Represents an axis-aligned bounding box as a pair of corner points. A newly
+ * constructed box is empty (its minimum corner is larger than its maximum
+ * corner) so that it can be grown with @c extend. These boxes are the
+ * building blocks of the acceleration structures in the scene.
+ *
+ * @tparam vec_T The type of the vector components. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double,
+ *   float, or int.
+ * @tparam dim The number of dimensions, which is likely 2 or 3.
+ */
+template<typename vec_T, int dim>
+class aabb {
+private:
+
+	/**
+	 * Corner with the smallest coordinates.
+	 */
+	mvector<vec_T, dim> lo;
+
+	/**
+	 * Corner with the largest coordinates.
+	 */
+	mvector<vec_T, dim> hi;
+
+public:
+
+	/**
+	 * Constructs an empty box.
+	 */
+	aabb() {
+		for (int i = 0; i < dim; i++) {
+			lo[i] = std::numeric_limits<vec_T>::max();
+			hi[i] = -std::numeric_limits<vec_T>::max();
+		}
+	}
+
+	/**
+	 * Constructs the box with the given corners.
+	 *
+	 * @param minCorner Corner with the smallest coordinates.
+	 * @param maxCorner Corner with the largest coordinates.
+	 */
+	aabb(const mvector<vec_T, dim> &minCorner,
+			const mvector<vec_T, dim> &maxCorner) :
+				lo(minCorner), hi(maxCorner) {
+		for (int i = 0; i < dim; i++)
+			assert(lo[i] <= hi[i]);
+	}
+
+	/**
+	 * Gets the corner with the smallest coordinates.
+	 *
+	 * @return Minimum corner.
+	 */
+	const mvector<vec_T, dim>& getMin() const {
+		return lo;
+	}
+
+	/**
+	 * Gets the corner with the largest coordinates.
+	 *
+	 * @return Maximum corner.
+	 */
+	const mvector<vec_T, dim>& getMax() const {
+		return hi;
+	}
+
+	/**
+	 * Checks if this box contains no points at all.
+	 *
+	 * @return @c true if the box is empty.
+	 */
+	bool isEmpty() const {
+		for (int i = 0; i < dim; i++)
+			if (lo[i] > hi[i])
+				return true;
+		return false;
+	}
+
+	/**
+	 * Grows this box so that it contains the given point.
+	 *
+	 * @param pt
+	 */
+	void extend(const mvector<vec_T, dim> &pt) {
+		for (int i = 0; i < dim; i++) {
+			if (pt[i] < lo[i])
+				lo[i] = pt[i];
+			if (pt[i] > hi[i])
+				hi[i] = pt[i];
+		}
+	}
+
+	/**
+	 * Grows this box so that it contains the given box.
+	 *
+	 * @param other
+	 */
+	void extend(const aabb<vec_T, dim> &other) {
+		if (other.isEmpty())
+			return;
+		extend(other.getMin());
+		extend(other.getMax());
+	}
+
+	/**
+	 * Gets the center of this box.
+	 *
+	 * @return Centroid.
+	 */
+	mvector<vec_T, dim> centroid() const {
+		mvector<vec_T, dim> c;
+		for (int i = 0; i < dim; i++)
+			c[i] = (lo[i] + hi[i]) / 2;
+		return c;
+	}
+
+	/**
+	 * Gets the extent of this box along each axis.
+	 *
+	 * @return Maximum corner minus minimum corner.
+	 */
+	mvector<vec_T, dim> diagonal() const {
+		return hi - lo;
+	}
+
+	/**
+	 * Gets the index of the axis along which this box is longest.
+	 *
+	 * @return Axis index.
+	 */
+	int longestAxis() const {
+		mvector<vec_T, dim> d = diagonal();
+		int axis = 0;
+		for (int i = 1; i < dim; i++)
+			if (d[i] > d[axis])
+				axis = i;
+		return axis;
+	}
+
+	/**
+	 * Gets the surface area of this box, which is what the surface area
+	 * heuristic uses to estimate traversal cost. In 2D this is the perimeter.
+	 * An empty box has zero area.
+	 *
+	 * @return Surface area.
+	 */
+	vec_T surfaceArea() const {
+		if (isEmpty())
+			return 0;
+		mvector<vec_T, dim> d = diagonal();
+		if (dim == 2)
+			return 2 * (d[0] + d[1]);
+		vec_T area = 0;
+		for (int i = 0; i < dim; i++)
+			for (int j = i + 1; j < dim; j++)
+				area += d[i] * d[j];
+		return 2 * area;
+	}
+
+	/**
+	 * Slab test against the given ray. Only the part of the ray between
+	 * @c tmin and @c tmax is considered.
+	 *
+	 * @param r The ray.
+	 * @param invDir Component-wise reciprocal of the ray's direction.
+	 * @param tmin Start of the ray interval.
+	 * @param tmax End of the ray interval.
+	 * @param[out] tnear The time at which the ray enters this box.
+	 *
+	 * @return @c true if the ray interval overlaps this box.
+	 */
+	template<typename time_T>
+	bool intersect(const ray<vec_T, time_T, dim> &r,
+			const mvector<vec_T, dim> &invDir,
+			time_T tmin, time_T tmax, time_T &tnear) const {
+		const mvector<vec_T, dim> &P = r.getOrig();
+		for (int i = 0; i < dim; i++) {
+			time_T t0 = (time_T) ((lo[i] - P[i]) * invDir[i]);
+			time_T t1 = (time_T) ((hi[i] - P[i]) * invDir[i]);
+			if (t0 > t1) {
+				time_T tmp = t0;
+				t0 = t1;
+				t1 = tmp;
+			}
+			// Written so that NaNs from 0 * inf leave the interval alone.
+			if (t0 > tmin)
+				tmin = t0;
+			if (t1 < tmax)
+				tmax = t1;
+			if (tmin > tmax)
+				return false;
+		}
+		tnear = tmin;
+		return true;
+	}
+
+	/**
+	 * Intersects a prepared ray with this box over the query's interval like
+	 * the other @c intersect , but with the near and far sides picked by the
+	 * signs of the direction.
+	 *
+	 * @param q The prepared ray.
+	 * @param[out] tnear The time at which the ray enters this box.
+	 *
+	 * @return @c true if the ray interval overlaps this box.
+	 */
+	template<typename time_T>
+	bool intersect(const rayquery<vec_T, time_T, dim> &q,
+			time_T &tnear) const {
+		vec_T l[dim], h[dim];
+		for (int i = 0; i < dim; i++) {
+			l[i] = lo[i];
+			h[i] = hi[i];
+		}
+		return q.slabs(l, h, q.getTMax(), tnear);
+	}
+
+	/**
+	 * Prints this box in the format [min, max].
+	 *
+	 * @param os The output stream to which to print.
+	 */
+	void printHelper(std::ostream &os) const {
+		os << "[" << lo << ", " << hi << "]";
+	}
+};
+
+/**
+ * Output operator overload for printing boxes.
+ *
+ * @param os The output stream to which to print.
+ * @param box The box.
+ *
+ * @return Reference to the given output stream for operator chaining.
+ */
+template<typename vec_T, int dim>
+std::ostream & operator<<(std::ostream &os, const aabb<vec_T, dim> &box) {
+	box.printHelper(os);
+	return os;
+}
+
+typedef aabb<double, 3> aabb3d;
+typedef aabb<float, 3> aabb3f;
+typedef aabb<double, 2> aabb2d;
+typedef aabb<float, 2> aabb2f;
+
+#endif // AABB_HH
@@ -0,0 +1,243 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "shape.hh"
+#include "ray.hh"
+#include "boost/shared_ptr.hpp"
+#include <vector>
+#include <ostream>
+
+#ifndef ACCELERATOR_HH
+#define ACCELERATOR_HH
+
+/**
+ * Abstract base class for spatial acceleration structures that answer ray
+ * queries over a fixed collection of shapes. The structure is built once from
+ * the bounded shapes of a scene and refers back to them by their index in that
+ * collection. The scene keeps ownership of the shapes, so they must outlive
+ * the structure, and tests unbounded shapes itself.
+ *
+ * @tparam vec_T The type of the vector components. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double,
+ *   float, or int.
+ * @tparam time_T The type of the time. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double or
+ *   float, but int would likely work.
+ * @tparam color_T The type of the @c rgbcolor. Many arithmetic
+ *   and relational operators must be supported, including real number ones.
+ *   The type will likely be double or float.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class accelerator {
+public:
+
+	/**
+	 * Boost shared pointer typedef for shapes.
+	 */
+	typedef boost::shared_ptr<shape<vec_T, color_T, time_T, dim> > sp_shape;
+
+	/**
+	 * Does nothing here but might need to be defined in subclasses.
+	 */
+	virtual ~accelerator() { }
+
+	/**
+	 * (Re)builds this structure over the given shapes, discarding whatever
+	 * was built before.
+	 *
+	 * @param shapes The shapes, all of which must have bounds. Indices into
+	 *   this collection are what the query functions return.
+	 */
+	virtual void build(const std::vector<sp_shape> &shapes) = 0;
+
+	/**
+	 * Like @c build , but with the bounds of the shapes already gathered,
+	 * as by a @c buildpipeline . This base class version ignores them;
+	 * structures that gather bounds themselves override it to skip that.
+	 *
+	 * @param shapes The shapes, all of which must have bounds.
+	 * @param boxes The bounds of each of @c shapes .
+	 */
+	virtual void buildFromBounds(const std::vector<sp_shape> &shapes,
+			const std::vector<aabb<vec_T, dim> > &boxes) {
+		build(shapes);
+	}
+
+	/**
+	 * Updates this structure after the shapes it was built over have moved or
+	 * changed size, keeping its topology. The shapes must be the same ones in
+	 * the same order. Queries stay correct after a refit, though they may get
+	 * slower the further the shapes have moved from where they were at the
+	 * last @c build . Structures that can't refit return @c false and need a
+	 * @c build instead.
+	 *
+	 * @return @c true if the structure was refit.
+	 */
+	virtual bool refit() {
+		return false;
+	}
+
+	/**
+	 * Adds a shape after the ones this structure holds, without building it
+	 * again, so its index is the number of shapes there were. Structures
+	 * that can't add shapes return @c false , changing nothing, and need a
+	 * @c build over all of them instead.
+	 *
+	 * @param s The shape, which must have bounds and outlive this structure.
+	 *
+	 * @return @c true if the shape was added.
+	 */
+	virtual bool insertShape(const sp_shape &s) {
+		return false;
+	}
+
+	/**
+	 * Removes a shape without building this structure again. The shapes
+	 * after it move down one index. Structures that can't remove shapes
+	 * return @c false , changing nothing, and need a @c build instead.
+	 *
+	 * @param index Index of the shape.
+	 *
+	 * @return @c true if the shape was removed.
+	 */
+	virtual bool removeShape(int index) {
+		return false;
+	}
+
+	/**
+	 * Updates this structure after one shape moved or changed size.
+	 * Structures that can't update one shape return @c false and need a
+	 * @c refit or @c build instead.
+	 *
+	 * @param index Index of the shape.
+	 *
+	 * @return @c true if the structure was updated.
+	 */
+	virtual bool updateShape(int index) {
+		return false;
+	}
+
+	/**
+	 * Finds the closest shape that the given ray hits at a time greater than
+	 * zero.
+	 *
+	 * @param r The ray.
+	 * @param[out] tIntersect The time of the hit or @c RAY_MISS .
+	 *
+	 * @return Index of the shape that was hit or -1 if there was no hit.
+	 */
+	virtual int closestHit(const ray<vec_T, time_T, dim> &r,
+			time_T &tIntersect) const = 0;
+
+	/**
+	 * Checks if the given ray hits any shape at a time greater than zero and
+	 * less than @c tmax . Unlike @c closestHit this can stop at the first hit
+	 * it finds, which is all that shadow rays need.
+	 *
+	 * @param r The ray.
+	 * @param tmax Hits at or beyond this time are ignored.
+	 *
+	 * @return Index of some shape that blocks the ray before @c tmax , not
+	 *   necessarily the closest, or -1 if there is none.
+	 */
+	virtual int anyHit(const ray<vec_T, time_T, dim> &r, time_T tmax) const = 0;
+
+	/**
+	 * Finds the closest hits of a batch of rays, as if by calling
+	 * @c closestHit on each one. Structures that can trace coherent rays
+	 * together, like camera rays for neighboring pixels, override this.
+	 *
+	 * @param rays The rays.
+	 * @param count Number of rays.
+	 * @param[out] hits Receives the index of the shape each ray hit or -1.
+	 * @param[out] tIntersect Receives the time of each hit or @c RAY_MISS .
+	 */
+	virtual void closestHits(const ray<vec_T, time_T, dim> *rays, int count,
+			int *hits, time_T *tIntersect) const {
+		for (int i = 0; i < count; i++)
+			hits[i] = closestHit(rays[i], tIntersect[i]);
+	}
+
+	/**
+	 * Checks which of a batch of rays hit any shape before their own
+	 * @c tmax , as if by calling @c anyHit on each one. Structures that
+	 * can trace coherent rays together, like the shadow rays of
+	 * neighboring pixels toward one light, override this.
+	 *
+	 * @param rays The rays.
+	 * @param count Number of rays.
+	 * @param tmax Hits of each ray at or beyond its time are ignored.
+	 * @param[out] hits Receives the index of some shape that blocks each
+	 *   ray, not necessarily the closest, or -1.
+	 */
+	virtual void anyHits(const ray<vec_T, time_T, dim> *rays, int count,
+			const time_T *tmax, int *hits) const {
+		for (int i = 0; i < count; i++)
+			hits[i] = anyHit(rays[i], tmax[i]);
+	}
+
+	/**
+	 * Writes the built structure to the given stream so that @c read can
+	 * restore it without building it again. Structures that can't be saved
+	 * return @c false and write nothing.
+	 *
+	 * @param os The output stream, which should be opened in binary mode.
+	 *
+	 * @return @c true if the structure was written.
+	 */
+	virtual bool write(std::ostream &os) const {
+		return false;
+	}
+
+	/**
+	 * Replaces this structure with one written by @c write into memory,
+	 * such as a mapped file. The shapes must be the ones it was built over,
+	 * in the same order. Nothing changes if the bytes don't hold a valid
+	 * structure over them, in which case it still needs a @c build .
+	 *
+	 * @param bytes The first byte written by @c write .
+	 * @param size Number of bytes from @c bytes that may be read.
+	 * @param shapes The shapes, which must outlive this structure.
+	 *
+	 * @return @c true if the structure was read.
+	 */
+	virtual bool read(const char *bytes, size_t size,
+			const std::vector<sp_shape> &shapes) {
+		return false;
+	}
+
+	/**
+	 * Gets the number of bytes this structure takes for its nodes and shape
+	 * lists, not counting the shapes themselves.
+	 *
+	 * @return Memory footprint in bytes.
+	 */
+	virtual size_t getMemoryUsage() const = 0;
+
+	/**
+	 * Prints a short description of this structure.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	virtual void printHelper(std::ostream &os) const = 0;
+};
+
+/**
+ * Output operator overload for printing acceleration structures.
+ *
+ * @param os The output stream.
+ * @param acc The structure to write to @c os.
+ *
+ * @return The same output stream for operator chaining.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+std::ostream & operator<<(std::ostream &os,
+		const accelerator<vec_T, color_T, time_T, dim> &acc) {
+	acc.printHelper(os);
+	return os;
+}
+
+#endif // ACCELERATOR_HH
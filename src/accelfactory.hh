@@ -0,0 +1,57 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "accelerator.hh"
+#include "bvh.hh"
+#include "dynamicbvh.hh"
+#include "grid.hh"
+#include "lazybvh.hh"
+#include "motion.hh"
+#include "qbvh.hh"
+#include "boost/shared_ptr.hpp"
+#include <string>
+
+#ifndef ACCELFACTORY_HH
+#define ACCELFACTORY_HH
+
+/**
+ * Makes an acceleration structure by the name the driver's @c --accel
+ * option and @c rtsettings::accel give it.
+ *
+ * @param name bvh, qbvh8, qbvh16, grid, lazy, dynamic or motion; anything
+ *   else is the linear scan.
+ * @param builder How trees are built.
+ * @param threads Number of threads to build with.
+ *
+ * @return The structure, or a null pointer for the linear scan.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+boost::shared_ptr<accelerator<vec_T, color_T, time_T, 3> >
+makeNamedAccelerator(const std::string &name, bvhBuilder builder,
+		int threads) {
+	typedef boost::shared_ptr<accelerator<vec_T, color_T, time_T, 3> >
+		sp_accel;
+	if (name == "bvh")
+		return sp_accel(new bvh<vec_T, color_T, time_T, 3>(builder,
+				threads));
+	if (name == "qbvh8")
+		return sp_accel(new qbvh<vec_T, color_T, time_T, 3>(builder,
+				threads));
+	if (name == "qbvh16")
+		return sp_accel(new qbvh<vec_T, color_T, time_T, 3,
+				unsigned short>(builder, threads));
+	if (name == "grid")
+		return sp_accel(new grid<vec_T, color_T, time_T, 3>());
+	if (name == "lazy")
+		return sp_accel(new lazybvh<vec_T, color_T, time_T, 3>(
+				LAZYBVH_EAGER_DEPTH, threads));
+	if (name == "dynamic")
+		return sp_accel(new dynamicbvh<vec_T, color_T, time_T, 3>());
+	if (name == "motion")
+		return sp_accel(new motionbvh<vec_T, color_T, time_T, 3>());
+	return sp_accel();
+}
+
+#endif // ACCELFACTORY_HH
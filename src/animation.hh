@@ -0,0 +1,341 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "sceneobj.hh"
+#include "sphere.hh"
+#include "cylinder.hh"
+#include "light.hh"
+#include "camera.hh"
+#include "mvector.hh"
+#include "scenerecord.hh"
+#include "boost/shared_ptr.hpp"
+#include <cassert>
+#include <vector>
+#include <ostream>
+
+#ifndef ANIMATION_HH
+#define ANIMATION_HH
+
+/**
+ * Keyframed positions of the objects of a scene. Every animated object has
+ * a track of keys, each a frame and where the object is at that frame; the
+ * position the object was made with is its key at frame 0. Between keys
+ * the object moves in a straight line at a steady speed, and after the
+ * last key it stays where that key puts it. Spheres and cylinders move
+ * their centers, point lights and spotlights their positions, and cameras
+ * their positions while they keep looking at the same point.
+ *
+ * Moving shapes changes their bounds and moving lights changes the light
+ * tree, so @c scene::refit must be called after @c setFrame .
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+class animation {
+public:
+	typedef boost::shared_ptr<sceneobj<vec_T, color_T, time_T, 3> > sp_object;
+	typedef boost::shared_ptr<camera<vec_T, time_T, 3> > sp_camera;
+
+private:
+
+	/**
+	 * Where an object is at a frame.
+	 */
+	struct keyframe {
+		/** The frame. */
+		vec_T frame;
+		/** The position. */
+		mvector<vec_T, 3> pos;
+	};
+
+	/**
+	 * The keys of one object, in order of their frames.
+	 */
+	struct track {
+		/** The @c sceneRecordKind of the object. */
+		int kind;
+		/** The shape or light, unless the object is a camera. */
+		sp_object obj;
+		/** The camera, if the object is one. */
+		sp_camera cam;
+		/** The point the camera looks at. */
+		mvector<vec_T, 3> lookAt;
+		/** The up direction of the camera. */
+		mvector<vec_T, 3> up;
+		/** The keys, starting with the one at frame 0. */
+		std::vector<keyframe> keys;
+	};
+
+	/**
+	 * The tracks in the order their objects were first keyed.
+	 */
+	std::vector<track> tracks;
+
+	/**
+	 * Number of tracks that move shapes.
+	 */
+	int shapeTracks;
+
+	/**
+	 * Gets where an object is now.
+	 *
+	 * @param t The track of the object.
+	 *
+	 * @return The center or position.
+	 */
+	static mvector<vec_T, 3> positionOf(const track &t) {
+		switch (t.kind) {
+		case RECORD_SPHERE:
+			return static_cast<const sphere<vec_T, color_T, time_T, 3> *>(
+					t.obj.get())->getCenter();
+		case RECORD_CYLINDER:
+			return static_cast<const cylinder<vec_T, color_T, time_T> *>(
+					t.obj.get())->getCenter();
+		case RECORD_CAMERA:
+			return t.cam->getPosition();
+		default:
+			return static_cast<const light<vec_T, color_T, time_T, 3> *>(
+					t.obj.get())->getPos();
+		}
+	}
+
+	/**
+	 * Moves an object.
+	 *
+	 * @param t The track of the object.
+	 * @param pos The new center or position.
+	 */
+	static void moveTo(const track &t, const mvector<vec_T, 3> &pos) {
+		switch (t.kind) {
+		case RECORD_SPHERE:
+			static_cast<sphere<vec_T, color_T, time_T, 3> *>(
+					t.obj.get())->setCenter(pos);
+			break;
+		case RECORD_CYLINDER:
+			static_cast<cylinder<vec_T, color_T, time_T> *>(
+					t.obj.get())->setCenter(pos);
+			break;
+		case RECORD_CAMERA:
+			*t.cam = camera<vec_T, time_T, 3>(pos, t.lookAt, t.up);
+			break;
+		default:
+			static_cast<light<vec_T, color_T, time_T, 3> *>(
+					t.obj.get())->setPos(pos);
+			break;
+		}
+	}
+
+	/**
+	 * Adds a key to the track of an object, starting the track if the
+	 * object isn't the last one keyed.
+	 *
+	 * @param t The track the object would start.
+	 * @param frame The frame of the key.
+	 * @param pos Where the object is at that frame.
+	 *
+	 * @return @c false if the frame isn't after the object's last key.
+	 */
+	bool addKey(const track &t, vec_T frame, const mvector<vec_T, 3> &pos) {
+		if (tracks.empty() || tracks.back().obj != t.obj ||
+				tracks.back().cam != t.cam) {
+			tracks.push_back(t);
+			keyframe first = { 0, positionOf(t) };
+			tracks.back().keys.push_back(first);
+			if (t.kind == RECORD_SPHERE || t.kind == RECORD_CYLINDER)
+				shapeTracks++;
+		}
+		std::vector<keyframe> &keys = tracks.back().keys;
+		if (!(frame > keys.back().frame))
+			return false;
+		keyframe k = { frame, pos };
+		keys.push_back(k);
+		return true;
+	}
+
+public:
+
+	/**
+	 * Makes an animation with nothing keyed.
+	 */
+	animation() : shapeTracks(0) { }
+
+	/**
+	 * Tells if an object of the given kind can be keyed.
+	 *
+	 * @param kind The @c sceneRecordKind .
+	 *
+	 * @return @c true for spheres, cylinders, point lights, spotlights and
+	 *   cameras.
+	 */
+	static bool canAnimate(int kind) {
+		return kind == RECORD_SPHERE || kind == RECORD_CYLINDER ||
+				kind == RECORD_LIGHT || kind == RECORD_SPOTLIGHT ||
+				kind == RECORD_CAMERA;
+	}
+
+	/**
+	 * Adds a key for a shape or light. Keys of an object must come
+	 * together, in order of their frames.
+	 *
+	 * @param kind The @c sceneRecordKind of the object, for which
+	 *   @c canAnimate is true.
+	 * @param obj The object.
+	 * @param frame The frame of the key, after the object's last key.
+	 * @param pos Where the object is at that frame.
+	 *
+	 * @return @c false if the frame isn't after the object's last key.
+	 */
+	bool addKey(int kind, const sp_object &obj, vec_T frame,
+			const mvector<vec_T, 3> &pos) {
+		assert(canAnimate(kind) && kind != RECORD_CAMERA);
+		track t;
+		t.kind = kind;
+		t.obj = obj;
+		return addKey(t, frame, pos);
+	}
+
+	/**
+	 * Adds a key for a camera, which keeps looking at the same point as it
+	 * moves. Keys of a camera must come together, in order of their frames.
+	 *
+	 * @param cam The camera.
+	 * @param lookAt The point the camera looks at.
+	 * @param up The up direction of the camera.
+	 * @param frame The frame of the key, after the camera's last key.
+	 * @param pos Where the camera is at that frame.
+	 *
+	 * @return @c false if the frame isn't after the camera's last key.
+	 */
+	bool addCameraKey(const sp_camera &cam, const mvector<vec_T, 3> &lookAt,
+			const mvector<vec_T, 3> &up, vec_T frame,
+			const mvector<vec_T, 3> &pos) {
+		track t;
+		t.kind = RECORD_CAMERA;
+		t.cam = cam;
+		t.lookAt = lookAt;
+		t.up = up;
+		return addKey(t, frame, pos);
+	}
+
+	/**
+	 * Moves every keyed object to where it is at a frame. Frames between
+	 * keys, including fractional ones, are interpolated.
+	 *
+	 * @param frame The frame.
+	 */
+	void setFrame(vec_T frame) {
+		for (size_t i = 0; i < tracks.size(); i++) {
+			const std::vector<keyframe> &keys = tracks[i].keys;
+			size_t k = 0;
+			while (k + 1 < keys.size() && keys[k + 1].frame <= frame)
+				k++;
+			if (k + 1 == keys.size() || frame <= keys[k].frame) {
+				moveTo(tracks[i], keys[k].pos);
+				continue;
+			}
+			vec_T s = (frame - keys[k].frame) /
+					(keys[k + 1].frame - keys[k].frame);
+			moveTo(tracks[i], keys[k].pos +
+					(keys[k + 1].pos - keys[k].pos) * s);
+		}
+	}
+
+	/**
+	 * Tells if anything is keyed.
+	 *
+	 * @return @c true if there's at least one track.
+	 */
+	bool empty() const {
+		return tracks.empty();
+	}
+
+	/**
+	 * Tells if any shapes are keyed, so the acceleration structure has to be
+	 * refit between frames.
+	 *
+	 * @return @c true if a sphere or cylinder is keyed.
+	 */
+	bool movesShapes() const {
+		return shapeTracks > 0;
+	}
+
+	/**
+	 * Gets the number of keyed objects.
+	 *
+	 * @return The number of tracks.
+	 */
+	int getTrackCount() const {
+		return (int) tracks.size();
+	}
+
+	/**
+	 * Gets where a keyed object is now, which is where the last
+	 * @c setFrame put it.
+	 *
+	 * @param i Number of the track, in the order the objects were keyed.
+	 *
+	 * @return The center or position.
+	 */
+	mvector<vec_T, 3> getTrackPosition(int i) const {
+		assert(i >= 0 && i < (int) tracks.size());
+		return positionOf(tracks[i]);
+	}
+
+	/**
+	 * Gets what kind of object is keyed.
+	 *
+	 * @param i Number of the track, in the order the objects were keyed.
+	 *
+	 * @return The @c sceneRecordKind of the object.
+	 */
+	int getTrackKind(int i) const {
+		assert(i >= 0 && i < (int) tracks.size());
+		return tracks[i].kind;
+	}
+
+	/**
+	 * Gets the keyed object.
+	 *
+	 * @param i Number of the track, in the order the objects were keyed.
+	 *
+	 * @return The shape or light, or null for the camera.
+	 */
+	const sp_object &getTrackObject(int i) const {
+		assert(i >= 0 && i < (int) tracks.size());
+		return tracks[i].obj;
+	}
+
+	/**
+	 * Gets the frame of the last key of any object, after which nothing
+	 * moves.
+	 *
+	 * @return The frame, or 0 if nothing is keyed.
+	 */
+	vec_T getLastFrame() const {
+		vec_T last = 0;
+		for (size_t i = 0; i < tracks.size(); i++)
+			if (tracks[i].keys.back().frame > last)
+				last = tracks[i].keys.back().frame;
+		return last;
+	}
+
+	/**
+	 * Print helper function.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printHelper(std::ostream &os) const {
+		os << "[animation. tracks: " << tracks.size() << ", last frame: " <<
+				getLastFrame() << "]";
+	}
+};
+
+typedef animation<double, double, double> animation3d;
+typedef animation<double, double, float> animation3ddf;
+typedef animation<float, float, float> animation3f;
+
+#endif // ANIMATION_HH
@@ -0,0 +1,88 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "gbuffer.hh"
+#include "rgbcolor.hh"
+#include "mvector.hh"
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#ifndef AOV_HH
+#define AOV_HH
+
+/**
+ * The arbitrary output variables a render can write besides its colors,
+ * each as an image of its own for compositing.
+ */
+enum aovKind {
+	/** Distance from the camera to the point each pixel shows. */
+	AOV_DEPTH,
+	/** Normal of the surface each pixel shows, in world space. */
+	AOV_NORMAL,
+	/** Index among the scene's shapes of the shape each pixel shows. */
+	AOV_ID
+};
+
+/**
+ * Makes the image of an arbitrary output variable of a render from its
+ * G-buffer. Pixels that show no shape are black either way.
+ *
+ * The values are kept as they are for formats of float pixels: the depth
+ * in every channel, the x, y and z of the normal as red, green and blue,
+ * and the index of the shape plus 1, which floats hold exactly, in every
+ * channel. For 8 bit formats they're mapped from 0 to 1 instead: the depth
+ * over the largest depth of the image, each component of the normal as
+ * half of it plus a half, and each shape to a color hashed from its index.
+ *
+ * @param gb The G-buffer of the render.
+ * @param kind Which variable.
+ * @param displayable Whether to map the values from 0 to 1.
+ * @param[out] image Receives the variable of every pixel, row by row.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+void makeAOV(const gbuffer<vec_T, color_T, time_T, dim> &gb, aovKind kind,
+		bool displayable, std::vector<rgbcolor<color_T> > &image) {
+	assert(dim >= 3);
+	int n = gb.getWidth() * gb.getHeight();
+	image.assign(n, rgbcolor<color_T>());
+	color_T farthest = 0;
+	for (int i = 0; i < n; i++) {
+		const hitrecord<vec_T, color_T, time_T, dim> &hit = gb.getHit(i);
+		if (hit.obj == 0)
+			continue;
+		if (kind == AOV_DEPTH) {
+			color_T d = (color_T) (hit.point - gb.getRay(i).getOrig()).mag();
+			farthest = std::max(farthest, d);
+			image[i] = rgbcolor<color_T>::unchecked(d, d, d);
+		}
+		else if (kind == AOV_NORMAL) {
+			color_T c[3];
+			for (int a = 0; a < 3; a++)
+				c[a] = (color_T) hit.normal[a];
+			if (displayable)
+				for (int a = 0; a < 3; a++)
+					c[a] = c[a] / 2 + (color_T) 0.5;
+			image[i] = rgbcolor<color_T>::unchecked(c[0], c[1], c[2]);
+		}
+		else if (displayable) {
+			// Neighboring indices get colors far apart.
+			unsigned int h = (unsigned int) (hit.id + 1) * 2654435761u;
+			image[i] = rgbcolor<color_T>::unchecked(
+					(color_T) ((h >> 24) & 255) / 255,
+					(color_T) ((h >> 16) & 255) / 255,
+					(color_T) ((h >> 8) & 255) / 255);
+		}
+		else {
+			color_T id = (color_T) (hit.id + 1);
+			image[i] = rgbcolor<color_T>::unchecked(id, id, id);
+		}
+	}
+	if (kind == AOV_DEPTH && displayable && farthest > 0)
+		for (int i = 0; i < n; i++)
+			image[i] *= 1 / farthest;
+}
+
+#endif // AOV_HH
@@ -6,17 +6,27 @@
 #include "sceneobj.hh"
 #include "ray.hh"
 #include "mvector.hh"
+#include "arena.hh"
 #include "boost/shared_ptr.hpp"
+#include "boost/make_shared.hpp"
 #include "rgbcolor.hh"
 #include "light.hh"
 #include "spotlight.hh"
+#include "sampler.hh"
 #include <math.h>
+#include <string.h>
 #include <vector>
 #include <ostream>
 
 #ifndef AREALIGHT_HH
 #define AREALIGHT_HH
 
+/**
+ * How far under a whole number the ratio of an area light's size to its
+ * spacing may be and still count as it, for the rows of its grid.
+ */
+#define AREA_LIGHT_GRID_SLACK 1e-6
+
 /**
  * Approximates a rectangular area light as a collection of point lights. The
  * lights are positioned on a finite plane with local uv coordinates; the u and
@@ -27,6 +37,12 @@
  * is passed to the constructor, but that the color of each individual light
  * will be that color divided by N, where N is the number of lights in this
  * area light. Recall that N is computed from the dimensions and spacing.
+ * The point lights are only generated when @c getLights is first called.
+ *
+ * Instead of using the point lights, a renderer can also sample positions
+ * on the light's rectangle for every shading point with @c getSamplePos , so
+ * that the work per shading point depends on the number of samples rather
+ * than on the size of the light.
  *
  * @tparam vec_T The type of the vector components. Many arithmetic and
  *   relational operators must be supported. The type will likely be double,
@@ -79,15 +95,23 @@ private:
 	 */
 	mvector<vec_T, dim> uhat;
 
+	/**
+	 * Number of positions a renderer should sample on this light per shading
+	 * point, or 0 to leave it to the renderer.
+	 */
+	int samples;
+
 	/**
 	 * Collection of all the point lights that constitute this area light.
+	 * Empty until @c getLights first needs it.
 	 */
-	std::vector<boost::shared_ptr<light<vec_T, color_T, time_T, dim> > > lights;
+	mutable std::vector<boost::shared_ptr<light<vec_T, color_T, time_T, dim> > >
+		lights;
 
 	/**
 	 * Helper function for the constructors that assumes that all the instance
-	 * variables have been initialized except @c uhat , @c vhat , and
-	 * @c lights, all of which are initialized by this function.
+	 * variables have been initialized except @c uhat and @c vhat , which are
+	 * initialized by this function.
 	 *
 	 * @param upDirection Used to compute v-hat and u-hat.
 	 */
@@ -101,28 +125,46 @@ private:
 		// and uhat then normalizing.
 		vhat = norm % uhat;
 		vhat = vhat.norm();
+	}
+
+	/**
+	 * Generates the point lights of this area light into @c lights . They
+	 * are made in an @c arena of their own, so they sit next to each other
+	 * in a few blocks instead of one heap allocation each; the arena goes
+	 * away with the last of them.
+	 */
+	void makeLights() const {
+		// The grid is laid out in double whatever vec_T is, so float
+		// scenes get the same number of lights as double ones; a ratio of
+		// size to spacing a hair under a whole number still gets the row
+		// at the far edge, as summing the spacing in double gives it.
+		double w = width, h = height;
+		double du = verticalSpacing, dv = horizontalSpacing;
+		int rows = static_cast<int> (h / du + AREA_LIGHT_GRID_SLACK) + 1;
+		int cols = static_cast<int> (w / dv + AREA_LIGHT_GRID_SLACK) + 1;
 
 		// Compute number of lights.
-		int numlights = static_cast<int> (width / horizontalSpacing) *
-				static_cast<int> (height / verticalSpacing);
+		int numlights = static_cast<int> (w / dv) * static_cast<int> (h / du);
+		arenaallocator<light<vec_T, color_T, time_T, dim> > alloc(
+				sp_arena(new arena()));
 
 		// Loop over the rows of the lights.
-		for(vec_T u = -height / 2; u <= height / 2; u += verticalSpacing) {
+		double u = -h / 2;
+		for (int i = 0; i < rows; i++, u += du) {
 
-			for(vec_T v = -width / 2; v <= width / 2; v += horizontalSpacing) {
+			double v = -w / 2;
+			for (int j = 0; j < cols; j++, v += dv) {
 
 				// Compute world coordinates from the local uv coordinates.
-				mvector<vec_T, dim> worldpos = uhat * u + vhat * v +
-						this->getPos();
+				mvector<vec_T, dim> worldpos = uhat * (vec_T) u +
+						vhat * (vec_T) v + this->getPos();
 
 				// Construct a point light at the world coordinates with a color
 				// scaled so that the combination of all the lights in the area
 				// light look like the color passed to the constructor.
-				boost::shared_ptr<light<vec_T, color_T, time_T, dim> >
-					currLight_sp(
-							new light<vec_T, color_T, time_T, dim>(
-									this->getColor() / numlights, worldpos));
-				lights.push_back(currLight_sp);
+				lights.push_back(boost::allocate_shared<
+						light<vec_T, color_T, time_T, dim> >(alloc,
+								this->getColor() / numlights, worldpos));
 			}
 		}
 	}
@@ -135,7 +177,7 @@ public:
 	 *
 	 * @warning Assertion is triggered if dimension isn't three.
 	 */
-	arealight() : light<vec_T, color_T, time_T, dim>() {
+	arealight() : light<vec_T, color_T, time_T, dim>(), samples(0) {
 		// color is set to 0.7, 0.7, 0.7, but change position from origin
 		this->setPos(mvector<vec_T, 3>(0.0, 1.0, 0.0));
 		assert(dim == 3);
@@ -173,7 +215,7 @@ public:
 				norm(surfaceNormal.norm()),
 				horizontalSpacing(horizontalSpacing),
 				verticalSpacing(verticalSpacing),
-				width(width), height(height) {
+				width(width), height(height), samples(0) {
 
 		// After the initializer list ends we still need to deal with
 		// vhat, uhat, and the lights collection.
@@ -202,18 +244,11 @@ public:
 		this->setHeight(rhs.getHeight());
 		this->setUhat(rhs.getUhat());
 		this->setVhat(rhs.getVhat());
+		this->setSampleCount(rhs.getSampleCount());
 
-		// Deep copy lights from rhs to this object's lighs collection.
+		// This object's lights are generated again from the copied fields
+		// when they're needed.
 		lights.clear();
-		typename std::vector<boost::shared_ptr<
-			light<vec_T, color_T, time_T, dim> > >::const_iterator iter;
-		for(iter = lights.begin(); iter < lights.end(); iter++) {
-			boost::shared_ptr<light<vec_T, color_T, time_T, dim> >
-								currLight_sp(
-										new light<vec_T, color_T, time_T, dim>(
-												**iter));
-			lights.push_back(currLight_sp);
-		}
 		return *this;
 	}
 
@@ -234,7 +269,7 @@ public:
 		os << "    {" << std::endl;
 		typename std::vector<boost::shared_ptr<
 			light<vec_T, color_T, time_T, dim> > >::const_iterator iter;
-		for(iter = lights.begin(); iter < lights.end(); iter++) {
+		for(iter = getLights().begin(); iter < getLights().end(); iter++) {
 			os << "    " << **iter << std::endl;
 		}
 		os << "    }" << std::endl << "]";
@@ -283,9 +318,107 @@ public:
 	 */
 	const std::vector<boost::shared_ptr<light<vec_T, color_T, time_T, dim> > >&
 	getLights() const {
+		if (lights.empty())
+			makeLights();
 		return lights;
 	}
 
+	/**
+	 * Getter for the number of samples per shading point.
+	 *
+	 * @return Sample count, or 0 if the renderer picks it.
+	 */
+	int getSampleCount() const {
+		return samples;
+	}
+
+	/**
+	 * Setter for the number of samples per shading point.
+	 *
+	 * @param samples Sample count, or 0 to let the renderer pick it.
+	 */
+	void setSampleCount(int samples) {
+		assert(samples >= 0);
+		this->samples = samples;
+	}
+
+	/**
+	 * Gets the number of samples per shading point.
+	 *
+	 * @param defaultCount Used if this light doesn't set its own count.
+	 *
+	 * @return Sample count.
+	 */
+	int getSampleCount(int defaultCount) const {
+		return samples > 0 ? samples : defaultCount;
+	}
+
+	/**
+	 * Samples a position on this light with @c getSamplePos . The light's
+	 * color is split evenly between the @c n samples.
+	 *
+	 * @param X The shading point.
+	 * @param i Index of the sample.
+	 * @param n Number of samples.
+	 * @param[out] s Receives the sample.
+	 *
+	 * @return @c true .
+	 */
+	bool sample(const mvector<vec_T, dim> &X, int i, int n,
+			lightsample<vec_T, color_T, dim> &s) const {
+		s.pos = getSamplePos(i, n, X);
+		s.dir = s.pos - X;
+		s.dist = s.dir.mag();
+		s.dir = s.dir.norm();
+		s.color = this->getColor() / n;
+		return true;
+	}
+
+	/**
+	 * Gets the box around this light's rectangle.
+	 *
+	 * @param[out] box Receives the box.
+	 */
+	void getBounds(aabb<vec_T, dim> &box) const {
+		box = aabb<vec_T, dim>();
+		for (int a = -1; a <= 1; a += 2)
+			for (int b = -1; b <= 1; b += 2)
+				box.extend(uhat * (a * height / 2) + vhat * (b * width / 2) +
+						this->getPos());
+	}
+
+	/**
+	 * Area lights span more than a point, so they can't be clustered.
+	 *
+	 * @return @c false .
+	 */
+	bool canCluster() const {
+		return false;
+	}
+
+	/**
+	 * Gets sample @c i of @c n positions on this light's rectangle for the
+	 * given shading point. The samples are points of a two dimensional
+	 * Sobol sequence, Owen scrambled by a hash of the shading point, so each
+	 * shading point sees a differently scrambled set that's stratified as
+	 * well as a net is when @c n is a power of two, and renders don't
+	 * depend on the order pixels are shaded in.
+	 *
+	 * @param i Index of the sample, less than @c n .
+	 * @param n Number of samples.
+	 * @param shadingPt The point being lit.
+	 *
+	 * @return A position on the light.
+	 */
+	mvector<vec_T, dim> getSamplePos(int i, int n,
+			const mvector<vec_T, dim> &shadingPt) const {
+		assert(i >= 0 && i < n);
+		double su, sv;
+		scrambledSobol2D((unsigned int) i, hashVector(shadingPt), su, sv);
+		return uhat * (vec_T) ((su - 0.5) * height) +
+				vhat * (vec_T) ((sv - 0.5) * width) + this->getPos();
+	}
+
 	/**
 	 * Getter for the surface Normal.
 	 *
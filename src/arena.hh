@@ -0,0 +1,276 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "hugepages.hh"
+#include "boost/shared_ptr.hpp"
+#include "boost/noncopyable.hpp"
+#include "boost/type_traits/alignment_of.hpp"
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#ifndef ARENA_HH
+#define ARENA_HH
+
+/**
+ * Default size in bytes of the blocks an @c arena gets from the heap.
+ */
+#define ARENA_BLOCK_SIZE 65536
+
+/**
+ * A monotonic allocator: memory is handed out from a few large blocks, one
+ * after the other, and is only given back, all at once, when the arena is
+ * destroyed. Objects that are made together, like the shapes and lights of a
+ * scene, end up next to each other, and making them costs a pointer bump
+ * instead of a trip to the heap. It isn't thread safe, so fill it from one
+ * thread. @c arenaallocator puts objects managed by Boost shared pointers,
+ * control blocks included, into an arena. Arenas made while
+ * @c hugepages are on take their blocks from huge pages.
+ */
+class arena : private boost::noncopyable {
+private:
+
+	/**
+	 * The blocks, oldest first. Only the last one is allocated from; the
+	 * others are full or hold a single large allocation.
+	 */
+	std::vector<char *> blocks;
+
+	/**
+	 * Bytes @c hugepages::map mapped for each block, or 0 for blocks from
+	 * the heap.
+	 */
+	std::vector<size_t> mapped;
+
+	/**
+	 * Whether blocks are taken from huge pages.
+	 */
+	bool huge;
+
+	/**
+	 * Size of the blocks allocations are packed into.
+	 */
+	size_t blockSize;
+
+	/**
+	 * Bytes of the last block handed out, including alignment padding.
+	 */
+	size_t used;
+
+	/**
+	 * Bytes handed out by all the blocks, without padding.
+	 */
+	size_t bytes;
+
+public:
+
+	/**
+	 * Constructs an empty arena. No memory is taken until the first
+	 * allocation.
+	 *
+	 * @param blockSize Size of the blocks to get from the heap. Larger
+	 *        allocations get a block of their own. With huge pages on,
+	 *        blocks are at least a huge page.
+	 */
+	explicit arena(size_t blockSize = ARENA_BLOCK_SIZE) :
+			huge(hugepages::isEnabled()), blockSize(blockSize), used(0),
+			bytes(0) {
+		assert(blockSize > 0);
+		if (huge && this->blockSize < HUGE_PAGE_SIZE)
+			this->blockSize = HUGE_PAGE_SIZE;
+	}
+
+	/**
+	 * Frees all the blocks. Objects in them must have been destroyed.
+	 */
+	~arena() {
+		for (size_t i = 0; i < blocks.size(); i++)
+			if (mapped[i] > 0)
+				hugepages::unmap(blocks[i], mapped[i]);
+			else
+				::operator delete(blocks[i]);
+	}
+
+	/**
+	 * Hands out memory for an object.
+	 *
+	 * @param size Number of bytes.
+	 * @param align Required alignment, a power of 2.
+	 *
+	 * @return The memory, which stays valid as long as the arena.
+	 */
+	void* allocate(size_t size, size_t align) {
+		assert(align > 0 && (align & (align - 1)) == 0);
+		if (size + align > blockSize) {
+			// Too large for a block; give it its own and keep filling the
+			// last one.
+			size_t length = size + align;
+			char *big = newBlock(length);
+			blocks.insert(blocks.empty() ? blocks.end() : blocks.end() - 1,
+					big);
+			mapped.insert(mapped.empty() ? mapped.end() : mapped.end() - 1,
+					length);
+			bytes += size;
+			return big + (align - (size_t) big % align) % align;
+		}
+		size_t pad = 0;
+		if (!blocks.empty()) {
+			size_t addr = (size_t) (blocks.back() + used);
+			pad = (align - addr % align) % align;
+		}
+		if (blocks.empty() || used + pad + size > blockSize) {
+			size_t length = blockSize;
+			blocks.push_back(newBlock(length));
+			mapped.push_back(length);
+			used = 0;
+			size_t addr = (size_t) blocks.back();
+			pad = (align - addr % align) % align;
+		}
+		void *p = blocks.back() + used + pad;
+		used += pad + size;
+		bytes += size;
+		return p;
+	}
+
+	/**
+	 * Gets the number of blocks taken from the heap.
+	 *
+	 * @return Block count.
+	 */
+	int getBlockCount() const {
+		return (int) blocks.size();
+	}
+
+	/**
+	 * Gets the number of bytes handed out.
+	 *
+	 * @return Bytes allocated, not counting alignment padding.
+	 */
+	size_t getBytesAllocated() const {
+		return bytes;
+	}
+
+private:
+
+	/**
+	 * Gets a block, from huge pages if this arena takes them and they can
+	 * be had, else from the heap.
+	 *
+	 * @param[in,out] length The bytes wanted; receives the bytes mapped,
+	 *   or 0 if the block is from the heap.
+	 *
+	 * @return The block.
+	 */
+	char* newBlock(size_t &length) {
+		void *p = huge ? hugepages::map(length) : 0;
+		if (p == 0) {
+			p = ::operator new(length);
+			length = 0;
+		}
+		return static_cast<char *>(p);
+	}
+};
+
+typedef boost::shared_ptr<arena> sp_arena;
+
+/**
+ * A standard allocator that takes memory from an @c arena and never gives it
+ * back, for use with @c boost::allocate_shared . Every copy of the allocator,
+ * including the one a shared pointer's control block keeps, holds on to the
+ * arena, so the arena lives until the last object in it is gone.
+ *
+ * @tparam T The type of the objects allocated.
+ */
+template<typename T>
+class arenaallocator {
+private:
+
+	/**
+	 * The arena memory comes from.
+	 */
+	sp_arena pool;
+
+public:
+
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	/**
+	 * The same allocator for another type.
+	 */
+	template<typename U>
+	struct rebind {
+		typedef arenaallocator<U> other;
+	};
+
+	/**
+	 * Constructs an allocator that uses the given arena.
+	 *
+	 * @param pool The arena.
+	 */
+	explicit arenaallocator(const sp_arena &pool) : pool(pool) {
+		assert(pool != 0);
+	}
+
+	/**
+	 * Constructs an allocator that uses the same arena as another one.
+	 */
+	template<typename U>
+	arenaallocator(const arenaallocator<U> &other) :
+			pool(other.getArena()) { }
+
+	/**
+	 * Gets the arena.
+	 *
+	 * @return The arena.
+	 */
+	const sp_arena& getArena() const {
+		return pool;
+	}
+
+	/**
+	 * Allocates room for @c n objects.
+	 */
+	T* allocate(size_t n) {
+		return static_cast<T *>(pool->allocate(n * sizeof(T),
+				boost::alignment_of<T>::value));
+	}
+
+	/**
+	 * Does nothing; the memory goes back when the arena is destroyed.
+	 */
+	void deallocate(T *p, size_t n) { }
+
+	/**
+	 * The largest number of objects @c allocate could make room for.
+	 */
+	size_t max_size() const {
+		return (size_t) -1 / sizeof(T);
+	}
+
+	/**
+	 * Allocators are equal if they use the same arena.
+	 */
+	template<typename U>
+	bool operator==(const arenaallocator<U> &rhs) const {
+		return pool == rhs.getArena();
+	}
+
+	/**
+	 * Negation of @c operator== .
+	 */
+	template<typename U>
+	bool operator!=(const arenaallocator<U> &rhs) const {
+		return pool != rhs.getArena();
+	}
+};
+
+#endif // ARENA_HH
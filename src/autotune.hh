@@ -0,0 +1,513 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "scene.hh"
+#include "shape.hh"
+#include "light.hh"
+#include "aabb.hh"
+#include "mvector.hh"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifndef AUTOTUNE_HH
+#define AUTOTUNE_HH
+
+/**
+ * Number of bins of the reflectivity histogram of @c scenestats , which
+ * split 0 to 1 evenly; shapes that don't reflect at all go in the first.
+ */
+#define AUTOTUNE_REFLECT_BINS 4
+
+/**
+ * Cells along each axis of the grid over the scene's bounded shapes whose
+ * occupied cells measure how evenly they're spread.
+ */
+#define AUTOTUNE_GRID_RES 16
+
+/**
+ * Scenes with at most this many shapes also try the linear scan.
+ */
+#define AUTOTUNE_LINEAR_SHAPES 8
+
+/**
+ * Scenes whose shapes fill at least this fraction of the cells they could
+ * also try the uniform grid.
+ */
+#define AUTOTUNE_UNIFORM_OCCUPANCY 0.5
+
+/**
+ * Float is only tried when the largest coordinate of the scene is at most
+ * this many times the size of its smallest shape, so a float's rounding
+ * stays well under the smallest detail.
+ */
+#define AUTOTUNE_FLOAT_RANGE 1e4
+
+/**
+ * Scenes with at least this many point lights, counting those of area
+ * lights, trace shadow rays to only @c AUTOTUNE_LIGHT_PICKS of them.
+ */
+#define AUTOTUNE_PICK_LIGHTS 16
+
+/**
+ * Light samples picked per point in scenes with many lights.
+ */
+#define AUTOTUNE_LIGHT_PICKS 4
+
+/**
+ * Scenes with at least this many point lights shade lightcuts instead.
+ */
+#define AUTOTUNE_CUT_LIGHTS 256
+
+/**
+ * Error allowed each cluster of a lightcut.
+ */
+#define AUTOTUNE_CUT_ERROR 0.02
+
+/**
+ * Throughput below which reflections stop in scenes with mirrors, which
+ * keeps what the last of them would add under half an 8 bit level.
+ */
+#define AUTOTUNE_MIN_THROUGHPUT 0.002
+
+/**
+ * About how many pixels a probe render has.
+ */
+#define AUTOTUNE_PROBE_PIXELS 4096
+
+/**
+ * How many times a probe is rendered, the fastest of which counts, so the
+ * first one's cold caches and the noise of the clock count less.
+ */
+#define AUTOTUNE_PROBE_REPEATS 3
+
+/**
+ * How much faster a setting that costs more to try, such as float over
+ * double, must be estimated to be before it's picked.
+ */
+#define AUTOTUNE_MARGIN 0.95
+
+/**
+ * Most 8 bit levels a channel of the probe of a setting may differ from
+ * that of the exact probe, as @c --check allows by default, for the
+ * setting to be picked.
+ */
+#define AUTOTUNE_TOLERANCE 1
+
+/**
+ * What a quick look at a finalized scene finds, for @c autotuner to pick
+ * render settings from.
+ */
+struct scenestats {
+	/** Shapes in the scene. */
+	size_t shapes;
+	/** Shapes with a bounding box. */
+	size_t bounded;
+	/** Shapes whose box changes while the shutter is open. */
+	size_t moving;
+	/** Lights shaded, with the point lights of area lights not sampled. */
+	size_t lights;
+	/** Lights as they were added. */
+	size_t sourceLights;
+	/** Shapes by reflectivity, @c AUTOTUNE_REFLECT_BINS bins from 0. */
+	size_t reflectivity[AUTOTUNE_REFLECT_BINS];
+	/** Largest coordinate of the box around the bounded shapes. */
+	double magnitude;
+	/** Longest side of the smallest box of a shape, or 0 if none. */
+	double smallest;
+	/** Fraction of the cells of the grid that could be occupied that are. */
+	double occupancy;
+
+	scenestats() : shapes(0), bounded(0), moving(0), lights(0),
+			sourceLights(0), magnitude(0), smallest(0), occupancy(0) {
+		for (int i = 0; i < AUTOTUNE_REFLECT_BINS; i++)
+			reflectivity[i] = 0;
+	}
+
+	/**
+	 * Counts the shapes that reflect at all.
+	 *
+	 * @return Shapes with a reflectivity above 0.
+	 */
+	size_t getReflective() const {
+		return shapes - reflectivity[0];
+	}
+
+	/**
+	 * Prints the statistics on a line.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void print(std::ostream &os) const {
+		os << "auto: " << shapes << " shapes, " << bounded << " bounded, " <<
+				moving << " moving, occupancy " << occupancy << ", " <<
+				lights << " lights of " << sourceLights <<
+				", reflectivity";
+		for (int i = 0; i < AUTOTUNE_REFLECT_BINS; i++)
+			os << " " << reflectivity[i];
+		os << std::endl;
+	}
+};
+
+/**
+ * Finds the statistics of a finalized scene. A shape's reflectivity goes
+ * in the bin of the histogram it falls in, with 0 alone in the first; the
+ * centers of the bounded shapes are put in a grid of
+ * @c AUTOTUNE_GRID_RES cells along each axis of the box around them, and
+ * the occupancy is how many cells they fall in over how many they could,
+ * which is low when they're clustered.
+ *
+ * @param sc The scene.
+ * @param[out] stats Receives the statistics.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+void gatherSceneStats(const scene<vec_T, color_T, time_T, 3> &sc,
+		scenestats &stats) {
+	typedef mvector<vec_T, 3> vec_t;
+	stats = scenestats();
+	const std::vector<boost::shared_ptr<shape<vec_T, color_T, time_T, 3> > >
+			&shapes = sc.getShapes();
+	stats.shapes = shapes.size();
+	stats.lights = sc.getLights().size();
+	stats.sourceLights = sc.getSourceLights().size();
+	aabb<vec_T, 3> all;
+	std::vector<vec_t> centers;
+	for (size_t i = 0; i < shapes.size(); i++) {
+		float refl = shapes[i]->getReflectivity();
+		int bin = refl <= 0 ? 0 : std::min(AUTOTUNE_REFLECT_BINS - 1,
+				1 + (int) (refl * (AUTOTUNE_REFLECT_BINS - 1)));
+		stats.reflectivity[bin]++;
+		aabb<vec_T, 3> open, close;
+		if (!shapes[i]->getMotionBounds(open, close))
+			continue;
+		stats.bounded++;
+		for (int k = 0; k < 3; k++)
+			if (open.getMin()[k] != close.getMin()[k] ||
+					open.getMax()[k] != close.getMax()[k]) {
+				stats.moving++;
+				break;
+			}
+		open.extend(close);
+		all.extend(open);
+		centers.push_back(open.centroid());
+		vec_t d = open.diagonal();
+		double side = std::max((double) d[0], std::max((double) d[1],
+				(double) d[2]));
+		if (stats.bounded == 1 || side < stats.smallest)
+			stats.smallest = side;
+	}
+	if (centers.empty())
+		return;
+	std::set<long> cells;
+	vec_t d = all.diagonal();
+	for (int k = 0; k < 3; k++)
+		stats.magnitude = std::max(stats.magnitude, std::max(
+				std::fabs((double) all.getMin()[k]),
+				std::fabs((double) all.getMax()[k])));
+	for (size_t i = 0; i < centers.size(); i++) {
+		long cell = 0;
+		for (int k = 0; k < 3; k++) {
+			int c = d[k] > 0 ? (int) ((centers[i][k] - all.getMin()[k]) /
+					d[k] * AUTOTUNE_GRID_RES) : 0;
+			cell = cell * AUTOTUNE_GRID_RES +
+					std::min(AUTOTUNE_GRID_RES - 1, std::max(0, c));
+		}
+		cells.insert(cell);
+	}
+	long possible = std::min((long) centers.size(),
+			(long) AUTOTUNE_GRID_RES * AUTOTUNE_GRID_RES * AUTOTUNE_GRID_RES);
+	stats.occupancy = (double) cells.size() / possible;
+}
+
+/**
+ * Picks render settings for the driver's @c --auto from the statistics of
+ * a scene and timed probe renders, so a scene renders about as fast as it
+ * would with flags tuned by hand. The statistics decide the light sampling
+ * and reflection cutoff outright, and which accelerators and precisions
+ * are worth a probe; each setting tried is then given the seconds its
+ * probe took to build and render, and the fastest for the whole image is
+ * the one that's kept. Settings may only change the speed, not the image:
+ * one whose probe differs from the exact probe, rendered in double with
+ * the options given, by more than @c AUTOTUNE_TOLERANCE levels is never
+ * picked.
+ */
+class autotuner {
+private:
+
+	/**
+	 * The statistics.
+	 */
+	scenestats stats;
+
+	/**
+	 * The settings tried, in order.
+	 */
+	std::vector<std::string> names;
+
+	/**
+	 * Seconds each took to build.
+	 */
+	std::vector<double> build;
+
+	/**
+	 * Seconds each took to render per pixel.
+	 */
+	std::vector<double> perPixel;
+
+	/**
+	 * Most levels a channel of the probe of each differed from
+	 * @c reference by.
+	 */
+	std::vector<int> off;
+
+	/**
+	 * The 8 bit channels of the exact probe, or none.
+	 */
+	std::vector<unsigned char> reference;
+
+public:
+
+	/**
+	 * Makes a tuner for a scene.
+	 *
+	 * @param stats What @c gatherSceneStats found.
+	 */
+	autotuner(const scenestats &stats) : stats(stats) { }
+
+	/**
+	 * Gets the statistics.
+	 *
+	 * @return The statistics.
+	 */
+	const scenestats& getStats() const {
+		return stats;
+	}
+
+	/**
+	 * Lists the accelerators worth trying: the BVH and the 8 wide one
+	 * always, the linear scan for very few shapes, the grid for evenly
+	 * spread ones and the motion BVH for any that move.
+	 *
+	 * @param[out] accels Receives their @c --accel names.
+	 */
+	void getAccelerators(std::vector<std::string> &accels) const {
+		accels.clear();
+		if (stats.shapes <= AUTOTUNE_LINEAR_SHAPES)
+			accels.push_back("linear");
+		accels.push_back("bvh");
+		accels.push_back("qbvh8");
+		if (stats.bounded > AUTOTUNE_LINEAR_SHAPES &&
+				stats.occupancy >= AUTOTUNE_UNIFORM_OCCUPANCY)
+			accels.push_back("grid");
+		if (stats.moving > 0)
+			accels.push_back("motion");
+	}
+
+	/**
+	 * Sets the probe that those of the settings tried are held to.
+	 *
+	 * @param levels Its 8 bit channels, row by row.
+	 */
+	void setReference(const std::vector<unsigned char> &levels) {
+		reference = levels;
+	}
+
+	/**
+	 * Measures how far a probe is from the exact one.
+	 *
+	 * @param levels Its 8 bit channels, row by row.
+	 *
+	 * @return The most levels a channel differs by, 0 without a reference
+	 *   and @c QUANTIZE_MAX if the sizes differ.
+	 */
+	int getDifference(const std::vector<unsigned char> &levels) const {
+		if (reference.empty())
+			return 0;
+		if (levels.size() != reference.size())
+			return QUANTIZE_MAX;
+		int most = 0;
+		for (size_t i = 0; i < levels.size(); i++)
+			most = std::max(most, std::abs((int) levels[i] -
+					(int) reference[i]));
+		return most;
+	}
+
+	/**
+	 * Tells if a probe is close enough to the exact one for its setting to
+	 * be picked.
+	 *
+	 * @param levels Its 8 bit channels, row by row.
+	 *
+	 * @return Whether no channel is more than @c AUTOTUNE_TOLERANCE
+	 *   levels off.
+	 */
+	bool isFaithful(const std::vector<unsigned char> &levels) const {
+		return getDifference(levels) <= AUTOTUNE_TOLERANCE;
+	}
+
+	/**
+	 * Tells if floats are precise enough to be worth a probe.
+	 *
+	 * @return Whether the scene's coordinates span few enough of its
+	 *   smallest shapes.
+	 */
+	bool isFloatSafe() const {
+		return stats.bounded > 0 && stats.smallest > 0 &&
+				stats.magnitude <= AUTOTUNE_FLOAT_RANGE * stats.smallest;
+	}
+
+	/**
+	 * Picks how to sample the lights: every light for a few, picks of
+	 * @c AUTOTUNE_LIGHT_PICKS for many and lightcuts for very many.
+	 *
+	 * @param[out] picks Receives the @c --light-picks count, or 0.
+	 * @param[out] cutError Receives the @c --lightcuts error, or 0.
+	 */
+	void getLightSampling(int &picks, double &cutError) const {
+		picks = 0;
+		cutError = 0;
+		if (stats.lights >= AUTOTUNE_CUT_LIGHTS)
+			cutError = AUTOTUNE_CUT_ERROR;
+		else if (stats.lights >= AUTOTUNE_PICK_LIGHTS)
+			picks = AUTOTUNE_LIGHT_PICKS;
+	}
+
+	/**
+	 * Picks the throughput below which reflections stop: 0 unless the top
+	 * bin of the histogram has shapes, whose reflections go deep enough to
+	 * be worth cutting.
+	 *
+	 * @return The @c --min-throughput .
+	 */
+	double getMinThroughput() const {
+		return stats.reflectivity[AUTOTUNE_REFLECT_BINS - 1] > 0 ?
+				AUTOTUNE_MIN_THROUGHPUT : 0;
+	}
+
+	/**
+	 * Gets the size of the probe render of an image: its aspect with about
+	 * @c AUTOTUNE_PROBE_PIXELS pixels, or the image itself if it's smaller.
+	 *
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param[out] probeWidth Receives the width of the probe.
+	 * @param[out] probeHeight Receives the height of the probe.
+	 */
+	static void getProbeSize(int width, int height, int &probeWidth,
+			int &probeHeight) {
+		assert(width > 0 && height > 0);
+		double scale = std::sqrt((double) AUTOTUNE_PROBE_PIXELS /
+				((double) width * height));
+		if (scale >= 1) {
+			probeWidth = width;
+			probeHeight = height;
+			return;
+		}
+		probeWidth = std::max(1, (int) (width * scale + 0.5));
+		probeHeight = std::max(1, (int) (height * scale + 0.5));
+	}
+
+	/**
+	 * Records the probe of a setting.
+	 *
+	 * @param name The setting.
+	 * @param buildSeconds Seconds it took to build the scene.
+	 * @param renderSeconds Seconds it took to render the probe.
+	 * @param pixels Pixels in the probe.
+	 */
+	void addTrial(const std::string &name, double buildSeconds,
+			double renderSeconds, long pixels) {
+		assert(pixels > 0);
+		names.push_back(name);
+		build.push_back(buildSeconds);
+		perPixel.push_back(renderSeconds / pixels);
+		off.push_back(0);
+	}
+
+	/**
+	 * Records the probe of a setting along with its image, which must be
+	 * close enough to the exact one for the setting to be picked.
+	 *
+	 * @param name The setting.
+	 * @param buildSeconds Seconds it took to build the scene.
+	 * @param renderSeconds Seconds it took to render the probe.
+	 * @param pixels Pixels in the probe.
+	 * @param levels The 8 bit channels of the probe, row by row.
+	 */
+	void addTrial(const std::string &name, double buildSeconds,
+			double renderSeconds, long pixels,
+			const std::vector<unsigned char> &levels) {
+		addTrial(name, buildSeconds, renderSeconds, pixels);
+		off.back() = getDifference(levels);
+	}
+
+	/**
+	 * Estimates how long a setting tried would take to build the scene and
+	 * render an image.
+	 *
+	 * @param trial Index of the setting, in the order tried.
+	 * @param pixels Pixels in the image.
+	 *
+	 * @return The seconds.
+	 */
+	double estimate(int trial, long pixels) const {
+		assert(trial >= 0 && trial < (int) names.size());
+		return build[trial] + perPixel[trial] * pixels;
+	}
+
+	/**
+	 * Picks the setting tried that's estimated fastest for an image, of
+	 * those whose probes were close enough to the exact one. A later one
+	 * must beat the earlier ones by @c AUTOTUNE_MARGIN , so the first,
+	 * safest ones win ties and noise.
+	 *
+	 * @param pixels Pixels in the image.
+	 *
+	 * @return Its name, or an empty one if none was tried or close enough.
+	 */
+	std::string getFastest(long pixels) const {
+		int best = -1;
+		for (int i = 0; i < (int) names.size(); i++)
+			if (off[i] <= AUTOTUNE_TOLERANCE && (best < 0 ||
+					estimate(i, pixels) <
+					AUTOTUNE_MARGIN * estimate(best, pixels)))
+				best = i;
+		return best < 0 ? std::string() : names[best];
+	}
+
+	/**
+	 * Forgets the settings tried, to try others.
+	 */
+	void clearTrials() {
+		names.clear();
+		build.clear();
+		perPixel.clear();
+		off.clear();
+	}
+
+	/**
+	 * Prints the settings tried and their estimates for an image, and how
+	 * far off the probes of those that can't be picked were.
+	 *
+	 * @param os The output stream to which to write.
+	 * @param pixels Pixels in the image.
+	 */
+	void printTrials(std::ostream &os, long pixels) const {
+		os << "auto:";
+		for (int i = 0; i < (int) names.size(); i++) {
+			os << " " << names[i] << " " << estimate(i, pixels) << " s";
+			if (off[i] > AUTOTUNE_TOLERANCE)
+				os << " (" << off[i] << " levels off)";
+		}
+		os << std::endl;
+	}
+};
+
+#endif // AUTOTUNE_HH
@@ -0,0 +1,332 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef BENCHSCENES_HH
+#define BENCHSCENES_HH
+
+/**
+ * A scene of the benchmark suite of @c rt @c --bench : its name and either
+ * the description itself or the file it's read from.
+ */
+struct benchscene {
+
+	/**
+	 * Name of the scene in the results.
+	 */
+	std::string name;
+
+	/**
+	 * The scene description file, or empty if @c text holds the scene.
+	 */
+	std::string file;
+
+	/**
+	 * The scene description, if it's made rather than read.
+	 */
+	std::string text;
+};
+
+/**
+ * Makes a scene of a grid of small spheres on a plane, lit by two lights,
+ * that tests the acceleration structure.
+ *
+ * @param side Number of spheres along each side of the grid.
+ *
+ * @return The scene description.
+ */
+inline std::string manySpheresScene(int side) {
+	std::ostringstream os;
+	os << "light (0.7, 0.7, 0.7) <-10.0, 10.0, 5.0>\n"
+			"light (0.5, 0.5, 0.5) <10.0, 10.0, 5.0>\n";
+	double spacing = 8.0 / side;
+	for (int i = 0; i < side; i++)
+		for (int j = 0; j < side; j++)
+			os << "sphere (" << (i % 3) * 0.4 + 0.2 << ", " <<
+					(j % 4) * 0.25 + 0.2 << ", 0.6) " << spacing * 0.4 <<
+					" <" << (i - side / 2.0) * spacing << ", " <<
+					spacing * 0.4 << ", " << -(j * spacing) << "> 0.2\n";
+	os << "plane (0.9, 0.9, 0.9) 0 <0.0, 1.0, 0.0> 0.15\n"
+			"camera <0.0, 2.5, 2.0> <0.0, 0.0, -4.0> <0.0, 1.0, 0.0>\n"
+			"end\n";
+	return os.str();
+}
+
+/**
+ * Makes a scene of a few spheres lit by a ring of point lights, that tests
+ * shading and shadow rays.
+ *
+ * @param lights Number of lights.
+ *
+ * @return The scene description.
+ */
+inline std::string manyLightsScene(int lights) {
+	std::ostringstream os;
+	for (int i = 0; i < lights; i++) {
+		double a = 6.283185307179586 * i / lights;
+		os << "light (" << 1.5 / lights << ", " << 1.5 / lights << ", " <<
+				1.5 / lights << ") <" << 8 * std::cos(a) << ", " <<
+				4 + 2 * std::sin(3 * a) << ", " << 8 * std::sin(a) << ">\n";
+	}
+	os << "sphere (1, 0, 0) 0.8 <-1.7, 0.8, 1.0> 0.3\n"
+			"sphere (0, 0, 1) 0.8 <1.7, 0.8, 1.5> 0.3\n"
+			"sphere (0, 1, 0) 0.6 <0.0, 0.6, -1.0> 0.3\n"
+			"plane (0.9, 0.9, 0.9) 0 <0.0, 1.0, 0.0> 0.15\n"
+			"camera <-3.0, 2.0, 5.0> <0.0, 0.0, 0.0> <0.0, 1.0, 0.0>\n"
+			"end\n";
+	return os.str();
+}
+
+/**
+ * Makes a scene of spheres between two facing mirrors, whose rays reflect
+ * as deep as the reflection limit lets them.
+ *
+ * @return The scene description.
+ */
+inline std::string mirrorHallScene() {
+	return "light (0.7, 0.7, 0.7) <0.0, 6.0, 4.0>\n"
+			"light (0.4, 0.4, 0.4) <1.0, 3.0, -4.0>\n"
+			"plane (0.9, 0.9, 0.9) 3 <1.0, 0.0, 0.0> 0.95\n"
+			"plane (0.9, 0.9, 0.9) 3 <-1.0, 0.0, 0.0> 0.95\n"
+			"plane (0.8, 0.8, 0.8) 0 <0.0, 1.0, 0.0> 0.3\n"
+			"sphere (1, 0, 0) 0.6 <-1.0, 0.6, 0.0> 0.8\n"
+			"sphere (0, 0, 1) 0.6 <1.0, 0.6, -1.5> 0.8\n"
+			"sphere (1, 1, 0) 0.4 <0.0, 1.6, -3.0> 0.8\n"
+			"camera <0.5, 1.5, 6.0> <0.0, 1.0, 0.0> <0.0, 1.0, 0.0>\n"
+			"end\n";
+}
+
+/**
+ * Makes a scene lit by a large area light, whose many samples test soft
+ * shadows.
+ *
+ * @param spacing Distance between the samples of the light.
+ *
+ * @return The scene description.
+ */
+inline std::string areaLightScene(double spacing) {
+	std::ostringstream os;
+	os << "arealight (0.9, 0.9, 0.9) <0.0, 3.0, 1.0> <0, -1, 0> <1, 0, 0> " <<
+			spacing << " " << spacing << " 1.5 1.5\n"
+			"sphere (1, 0, 0) 0.5 <-1.2, 0.5, 0.0> 0.5\n"
+			"sphere (0, 0, 1) 0.5 <1.2, 0.5, 1.0> 0.5\n"
+			"cylinder (0, 1, 0) 0.3 <0.0, 0.0, -0.5> <0.0, 1.0, 0.0> 1.2 0.2\n"
+			"plane (0.9, 0.9, 0.9) 0 <0.0, 1.0, 0.0> 0.15\n"
+			"camera <-3.0, 2.0, 5.0> <-0.3, 0.5, 0.0> <0.0, 1.0, 0.0>\n"
+			"end\n";
+	return os.str();
+}
+
+/**
+ * The random numbers of @c generateScene : a 64 bit xorshift generator,
+ * so a seed makes the same scene on every platform, unlike @c rand .
+ */
+class scenerandom {
+private:
+
+	/**
+	 * The state, never 0.
+	 */
+	unsigned long long state;
+
+public:
+
+	/**
+	 * Starts the numbers of a seed.
+	 *
+	 * @param seed The seed; every seed, 0 too, gives its own numbers.
+	 */
+	explicit scenerandom(unsigned long long seed) :
+			state(seed * 0x9e3779b97f4a7c15ULL + 0x2545f4914f6cdd1dULL) {
+		if (state == 0)
+			state = 1;
+	}
+
+	/**
+	 * Gets the next number.
+	 *
+	 * @return A number from 0 up to but not including 1.
+	 */
+	double next() {
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		// The top 53 bits, which a double holds exactly.
+		return ((state * 0x2545f4914f6cdd1dULL) >> 11) *
+				(1.0 / 9007199254740992.0);
+	}
+
+	/**
+	 * Gets the next number in a range.
+	 *
+	 * @param lo The smallest number.
+	 * @param hi The end of the range.
+	 *
+	 * @return A number from @c lo up to but not including @c hi .
+	 */
+	double next(double lo, double hi) {
+		return lo + (hi - lo) * next();
+	}
+};
+
+/**
+ * What @c generateScene makes.
+ */
+struct sceneparams {
+	/** Number of spheres. */
+	int spheres;
+	/** Number of cylinders. */
+	int cylinders;
+	/** Number of point lights. */
+	int lights;
+	/** Number of area lights. */
+	int areaLights;
+	/** Number of clusters the shapes are gathered in, or 0 to spread them
+	 * evenly over the whole region. */
+	int clusters;
+	/** Radius of a cluster as a fraction of the size of the region. */
+	double clusterRadius;
+	/** Largest reflectivity of a shape; each gets one from 0 to this. */
+	double reflectivity;
+	/** Half the width of the region the shapes are in. */
+	double size;
+	/** Seed of the random numbers. */
+	unsigned long long seed;
+
+	/**
+	 * Makes the parameters of a scene of 1000 spheres lit by 4 lights.
+	 */
+	sceneparams() : spheres(1000), cylinders(0), lights(4), areaLights(0),
+			clusters(0), clusterRadius(0.1), reflectivity(0.5), size(10),
+			seed(1) { }
+};
+
+/**
+ * Makes a random scene for stress tests: shapes on a plane in a square
+ * region, if asked in clusters, with lights above them and a camera
+ * looking down on them from outside. Shapes have random colors and sizes
+ * that shrink as there are more of them, so scenes of any size look alike.
+ * The lights share a total brightness of 1.2, so adding lights only adds
+ * work. The same parameters always make the same description.
+ *
+ * @param p What to make.
+ *
+ * @return The scene description, in the grammar of @c example.dat .
+ */
+inline std::string generateScene(const sceneparams &p) {
+	std::ostringstream os;
+	scenerandom rnd(p.seed);
+	double s = p.size;
+	int emitters = p.lights + p.areaLights;
+	double share = emitters > 0 ? 1.2 / emitters : 0;
+	os << "# " << p.spheres << " spheres, " << p.cylinders << " cylinders, "
+			<< p.lights << " lights and " << p.areaLights << " area lights,"
+			" seed " << p.seed << "\n";
+	for (int i = 0; i < p.lights; i++)
+		os << "light (" << share << ", " << share << ", " << share << ") <"
+				<< rnd.next(-s, s) << ", " << rnd.next(1.5 * s, 2.5 * s) <<
+				", " << rnd.next(-s, s) << ">\n";
+	for (int i = 0; i < p.areaLights; i++) {
+		double width = rnd.next(0.2 * s, 0.4 * s);
+		os << "arealight (" << share << ", " << share << ", " << share <<
+				") <" << rnd.next(-s, s) << ", " << rnd.next(1.5 * s, 2.5 * s)
+				<< ", " << rnd.next(-s, s) << "> <0, -1, 0> <1, 0, 0> " <<
+				width / 4 << " " << width / 4 << " " << width << " " << width <<
+				"\n";
+	}
+
+	std::vector<double> cx, cz;
+	for (int i = 0; i < p.clusters; i++) {
+		cx.push_back(rnd.next(-s, s));
+		cz.push_back(rnd.next(-s, s));
+	}
+	int shapes = p.spheres + p.cylinders;
+	double radius = shapes > 0 ? 0.5 * s / std::pow((double) shapes,
+			1.0 / 3) : 0;
+	double spread = p.clusterRadius * s;
+	for (int i = 0; i < shapes; i++) {
+		double x, z;
+		if (p.clusters > 0) {
+			int c = (int) (rnd.next() * p.clusters);
+			// The sum of three uniform numbers is close to a normal one.
+			x = cx[c] + spread * (rnd.next(-1, 1) + rnd.next(-1, 1) +
+					rnd.next(-1, 1));
+			z = cz[c] + spread * (rnd.next(-1, 1) + rnd.next(-1, 1) +
+					rnd.next(-1, 1));
+		}
+		else {
+			x = rnd.next(-s, s);
+			z = rnd.next(-s, s);
+		}
+		double r = radius * rnd.next(0.5, 1);
+		double y = r + rnd.next(0, s);
+		os << (i < p.spheres ? "sphere (" : "cylinder (") << rnd.next() <<
+				", " << rnd.next() << ", " << rnd.next() << ") " << r << " <"
+				<< x << ", " << y << ", " << z << ">";
+		if (i >= p.spheres)
+			os << " <" << rnd.next(-1, 1) << ", 1, " << rnd.next(-1, 1) <<
+					"> " << 4 * r;
+		os << " " << rnd.next(0, p.reflectivity) << "\n";
+	}
+	os << "plane (0.9, 0.9, 0.9) 0 <0.0, 1.0, 0.0> " <<
+			std::min(0.15, p.reflectivity) << "\n"
+			"camera <0.0, " << 1.2 * s << ", " << 2.2 * s << "> <0.0, 0.0, "
+			"0.0> <0.0, 1.0, 0.0>\nend\n";
+	return os.str();
+}
+
+/**
+ * Gets the scenes of the benchmark suite: the example scenes, read from
+ * the given directory, then the made ones.
+ *
+ * @param dir Directory of @c example.dat to @c example3.dat , ending in a
+ *   slash, or empty for the current one.
+ * @param[out] scenes Receives the scenes.
+ */
+inline void getBenchScenes(const std::string &dir,
+		std::vector<benchscene> &scenes) {
+	static const char *examples[] = { "example", "example2", "example3" };
+	scenes.clear();
+	for (int i = 0; i < 3; i++) {
+		benchscene b;
+		b.name = examples[i];
+		b.file = dir + examples[i] + ".dat";
+		scenes.push_back(b);
+	}
+	benchscene b;
+	b.name = "many-spheres";
+	b.text = manySpheresScene(64);
+	scenes.push_back(b);
+	b.name = "many-lights";
+	b.text = manyLightsScene(32);
+	scenes.push_back(b);
+	b.name = "mirror-hall";
+	b.text = mirrorHallScene();
+	scenes.push_back(b);
+	b.name = "area-light";
+	b.text = areaLightScene(0.1);
+	scenes.push_back(b);
+}
+
+/**
+ * Gets the thread counts a benchmark scales over: the powers of 2 below the
+ * largest, then the largest.
+ *
+ * @param maxThreads The largest count, at least 1.
+ * @param[out] counts Receives the counts, smallest first.
+ */
+inline void getBenchThreadCounts(int maxThreads, std::vector<int> &counts) {
+	counts.clear();
+	for (int n = 1; n < maxThreads; n *= 2)
+		counts.push_back(n);
+	counts.push_back(maxThreads);
+}
+
+#endif // BENCHSCENES_HH
@@ -0,0 +1,245 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "boost/noncopyable.hpp"
+#include "boost/shared_ptr.hpp"
+#include "boost/thread/thread.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include <cassert>
+#include <vector>
+
+#ifndef BUILDPIPELINE_HH
+#define BUILDPIPELINE_HH
+
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class shape;
+
+template<typename vec_T, int dim>
+class aabb;
+
+/**
+ * Number of shapes a @c buildpipeline hands its workers at a time.
+ */
+#define BUILD_PIPELINE_BATCH 4096
+
+/**
+ * Gets the bounds of shapes on worker threads while more shapes are still
+ * being made, so the bounds are ready when the scene is finalized instead
+ * of being gathered then. Shapes are pushed in the order they're added to
+ * the scene and handed to the workers in batches of
+ * @c BUILD_PIPELINE_BATCH ; @c finish waits for the workers and returns
+ * the bounds in the same order.
+ *
+ * A shape must not change from when it's pushed until @c finish returns.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ * @tparam dim The number of dimensions.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class buildpipeline : private boost::noncopyable {
+private:
+
+	typedef shape<vec_T, color_T, time_T, dim> shape_t;
+
+	/**
+	 * Consecutive shapes pushed and their bounds, once a worker has been.
+	 */
+	struct batch {
+		/** The shapes, which the scene owns. */
+		std::vector<const shape_t *> shapes;
+		/** The box of each bounded shape. */
+		std::vector<aabb<vec_T, dim> > boxes;
+		/** Whether each shape is bounded. */
+		std::vector<char> bounded;
+	};
+
+	/**
+	 * Functor of the worker threads.
+	 */
+	struct runner {
+		buildpipeline *pipe;
+
+		void operator()() const {
+			pipe->run();
+		}
+	};
+
+	/**
+	 * The batches handed to the workers, in order.
+	 */
+	std::vector<boost::shared_ptr<batch> > handed;
+
+	/**
+	 * Index in @c handed of the next batch a worker takes.
+	 */
+	size_t next;
+
+	/**
+	 * The batch being filled by @c push .
+	 */
+	boost::shared_ptr<batch> filling;
+
+	/**
+	 * Number of shapes pushed.
+	 */
+	int count;
+
+	/**
+	 * Whether @c finish has been called, so the workers quit once the
+	 * batches run out.
+	 */
+	bool closing;
+
+	/**
+	 * Guards @c handed , @c next and @c closing .
+	 */
+	boost::mutex lock;
+
+	/**
+	 * Signaled when a batch is handed over or when closing.
+	 */
+	boost::condition_variable changed;
+
+	/**
+	 * The workers.
+	 */
+	boost::thread_group workers;
+
+	/**
+	 * Gets the bounds of the shapes of a batch.
+	 *
+	 * @param b The batch.
+	 */
+	static void bound(batch &b) {
+		size_t n = b.shapes.size();
+		b.boxes.resize(n);
+		b.bounded.resize(n);
+		for (size_t i = 0; i < n; i++)
+			b.bounded[i] = b.shapes[i]->getBounds(b.boxes[i]);
+	}
+
+	/**
+	 * Body of the worker threads: bounds batches until closing and out of
+	 * batches.
+	 */
+	void run() {
+		boost::unique_lock<boost::mutex> guard(lock);
+		for (;;) {
+			while (next == handed.size() && !closing)
+				changed.wait(guard);
+			if (next == handed.size())
+				return;
+			boost::shared_ptr<batch> b = handed[next++];
+			guard.unlock();
+			bound(*b);
+			guard.lock();
+		}
+	}
+
+	/**
+	 * Hands the batch being filled to the workers and starts another.
+	 */
+	void hand() {
+		boost::lock_guard<boost::mutex> guard(lock);
+		handed.push_back(filling);
+		filling.reset(new batch());
+		filling->shapes.reserve(BUILD_PIPELINE_BATCH);
+		changed.notify_one();
+	}
+
+public:
+
+	/**
+	 * Starts the workers.
+	 *
+	 * @param numThreads Number of worker threads, at least 1.
+	 */
+	explicit buildpipeline(int numThreads) : next(0), filling(new batch()),
+			count(0), closing(false) {
+		assert(numThreads > 0);
+		filling->shapes.reserve(BUILD_PIPELINE_BATCH);
+		runner r;
+		r.pipe = this;
+		for (int i = 0; i < numThreads; i++)
+			workers.create_thread(r);
+	}
+
+	/**
+	 * Stops the workers, dropping the bounds.
+	 */
+	~buildpipeline() {
+		{
+			boost::lock_guard<boost::mutex> guard(lock);
+			closing = true;
+			changed.notify_all();
+		}
+		workers.join_all();
+	}
+
+	/**
+	 * Queues a shape to be bounded. Called from one thread only.
+	 *
+	 * @param s The shape, which must outlive this pipeline.
+	 */
+	void push(const shape_t *s) {
+		assert(!closing);
+		filling->shapes.push_back(s);
+		count++;
+		if ((int) filling->shapes.size() == BUILD_PIPELINE_BATCH)
+			hand();
+	}
+
+	/**
+	 * Bounds the shapes of the last batch on this thread and helps the
+	 * workers with the batches they haven't taken, then stops them.
+	 * Nothing can be pushed afterwards.
+	 *
+	 * @param[out] boxes Receives the box of every shape pushed, in order.
+	 *   Those of unbounded shapes are left empty.
+	 * @param[out] bounded Receives whether every shape is bounded.
+	 */
+	void finish(std::vector<aabb<vec_T, dim> > &boxes,
+			std::vector<char> &bounded) {
+		bound(*filling);
+		{
+			boost::lock_guard<boost::mutex> guard(lock);
+			closing = true;
+			changed.notify_all();
+		}
+		run();
+		workers.join_all();
+		handed.push_back(filling);
+		boxes.clear();
+		bounded.clear();
+		boxes.reserve(count);
+		bounded.reserve(count);
+		for (size_t i = 0; i < handed.size(); i++) {
+			boxes.insert(boxes.end(), handed[i]->boxes.begin(),
+					handed[i]->boxes.end());
+			bounded.insert(bounded.end(), handed[i]->bounded.begin(),
+					handed[i]->bounded.end());
+		}
+		handed.clear();
+		filling.reset(new batch());
+	}
+
+	/**
+	 * Gets the number of shapes pushed.
+	 *
+	 * @return The count.
+	 */
+	int getCount() const {
+		return count;
+	}
+};
+
+typedef buildpipeline<double, double, double, 3> buildpipeline3d;
+typedef buildpipeline<double, double, float, 3> buildpipeline3ddf;
+typedef buildpipeline<float, float, float, 3> buildpipeline3f;
+
+#endif // BUILDPIPELINE_HH
@@ -0,0 +1,1330 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "accelerator.hh"
+#include "aabb.hh"
+#include "shape.hh"
+#include "ray.hh"
+#include "mvector.hh"
+#include "parallel.hh"
+#include "spherepack.hh"
+#include "hugepages.hh"
+#include "boost/shared_ptr.hpp"
+#include "boost/atomic.hpp"
+#include "boost/scoped_array.hpp"
+#include <algorithm>
+#include <utility>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include <istream>
+#include <ostream>
+
+#ifndef BVH_HH
+#define BVH_HH
+
+/**
+ * Number of candidate split planes per axis in the binned SAH build.
+ */
+#define BVH_SAH_BINS 12
+
+/**
+ * Largest number of shapes the build will put into one leaf.
+ */
+#define BVH_MAX_LEAF 4
+
+/**
+ * Relative cost of visiting an interior node compared to testing one shape.
+ */
+#define BVH_TRAVERSAL_COST 0.5
+
+/**
+ * Deepest tree the traversal stack can handle.
+ */
+#define BVH_MAX_DEPTH 64
+
+/**
+ * Bits of a Morton code used by the linear BVH builder. They are split evenly
+ * between the axes, so in 3D each centroid coordinate is quantized to 10 bits.
+ */
+#define BVH_MORTON_BITS 30
+
+/**
+ * Number of rays traced together by packet traversal. At most 32, since the
+ * active rays of a packet are kept as bits of an unsigned int.
+ */
+#define BVH_PACKET_WIDTH 8
+
+/**
+ * First word of a tree written by @c bvh::write , "BVH1" in ASCII.
+ */
+#define BVH_FILE_MAGIC 0x31485642
+
+/**
+ * The algorithms that can build a @c bvh .
+ */
+enum bvhBuilder {
+	/**
+	 * Top-down binned surface area heuristic build. Slower to build but gives
+	 * the fastest trees to trace.
+	 */
+	BVH_BUILD_SAH,
+
+	/**
+	 * Linear BVH: shape centroids are sorted along a Morton curve and the
+	 * tree is emitted from the sorted codes with every node built
+	 * independently (Karras 2012). Builds much faster, in parallel, at the cost
+	 * of a somewhat worse tree.
+	 */
+	BVH_BUILD_LBVH
+};
+
+/**
+ * A bounding volume hierarchy over the bounded shapes of a scene. The tree
+ * is built either top-down by binning shape centroids along each axis and
+ * picking the split with the lowest surface area heuristic (SAH) cost, or as a
+ * linear BVH from Morton codes; see @c bvhBuilder . Every shape must have
+ * bounds; the scene keeps unbounded shapes like infinite planes out of the
+ * hierarchy.
+ *
+ * @tparam vec_T The type of the vector components. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double,
+ *   float, or int.
+ * @tparam time_T The type of the time. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double or
+ *   float, but int would likely work.
+ * @tparam color_T The type of the @c rgbcolor. Many arithmetic
+ *   and relational operators must be supported, including real number ones.
+ *   The type will likely be double or float.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class bvh : public accelerator<vec_T, color_T, time_T, dim> {
+	/**
+	 * The compressed wide hierarchy is collapsed from this one.
+	 */
+	template<typename, typename, typename, int, typename>
+	friend class qbvh;
+
+	/**
+	 * The lazy hierarchy builds its subtrees the same way.
+	 */
+	template<typename, typename, typename, int>
+	friend class lazybvh;
+
+	/**
+	 * The dynamic hierarchy builds and rebuilds its tree the same way.
+	 */
+	template<typename, typename, typename, int>
+	friend class dynamicbvh;
+
+	/**
+	 * The motion hierarchy splits its shapes the same way.
+	 */
+	template<typename, typename, typename, int>
+	friend class motionbvh;
+
+public:
+
+	/**
+	 * Boost shared pointer typedef for shapes.
+	 */
+	typedef typename accelerator<vec_T, color_T, time_T, dim>::sp_shape
+		sp_shape;
+
+private:
+
+	/**
+	 * A node of the tree while it's being built. Interior nodes have two
+	 * children and leaves refer to a contiguous range of @c primIndices .
+	 */
+	struct node {
+		/** Box around everything below this node. */
+		aabb<vec_T, dim> box;
+		/** Index of the left child, or -1 for leaves. */
+		int left;
+		/** Index of the right child, or -1 for leaves. */
+		int right;
+		/** First entry of @c primIndices in this leaf. */
+		int start;
+		/** Number of shapes in this leaf, 0 for interior nodes. */
+		int count;
+	};
+
+	/**
+	 * A node of the finished tree as it's traversed and stored on disk. In 3D
+	 * it takes 32 bytes, so two fit in a cache line. Nodes are laid out depth
+	 * first, which puts the left child of an interior node right after it and
+	 * leaves only the right child to be stored. The bounds are rounded
+	 * outwards to floats, so they can only grow.
+	 */
+	struct flatnode {
+		/** Lower corner of the box around everything below this node. */
+		float lo[dim];
+		/** Upper corner of the box around everything below this node. */
+		float hi[dim];
+		/**
+		 * Index of the right child for interior nodes; first entry of
+		 * @c leafPrims for leaves.
+		 */
+		int offset;
+		/** Number of shapes in this leaf, 0 for interior nodes. */
+		int count;
+	};
+
+	/**
+	 * Per-shape data only needed while building.
+	 */
+	struct buildprim {
+		/** Bounds of the shape. */
+		aabb<vec_T, dim> box;
+		/** Center of @c box . */
+		mvector<vec_T, dim> centroid;
+	};
+
+	/**
+	 * Raw pointers to the shapes passed to @c build . The scene owns them.
+	 */
+	std::vector<const shape<vec_T, color_T, time_T, dim> *> prims;
+
+	/**
+	 * Indices into @c prims ordered so that every leaf owns a contiguous
+	 * range. During the build these are in build order; afterwards they are
+	 * in the order of the leaves in @c flatNodes .
+	 */
+	std::vector<int> primIndices;
+
+	/**
+	 * The shapes of @c primIndices , so leaves can reach them without going
+	 * through @c prims .
+	 */
+	std::vector<const shape<vec_T, color_T, time_T, dim> *> leafPrims;
+
+	/**
+	 * @c leafPrims again with the spheres packed for batch tests. Its slots
+	 * are the positions in @c leafPrims .
+	 */
+	spherepack<vec_T, color_T, time_T, dim> leafPack;
+
+	/**
+	 * The tree while it's being built. Element 0 is the root.
+	 */
+	std::vector<node> nodes;
+
+	/**
+	 * The finished tree in depth-first order. Element 0 is the root.
+	 */
+	std::vector<flatnode> flatNodes;
+
+	/**
+	 * Build-time data parallel to @c prims .
+	 */
+	std::vector<buildprim> buildPrims;
+
+	/**
+	 * Which algorithm @c build uses.
+	 */
+	bvhBuilder builder;
+
+	/**
+	 * Number of threads @c build may use.
+	 */
+	int numThreads;
+
+	/**
+	 * Build step that gathers bounds and centroids of a range of shapes.
+	 */
+	struct boundsStep {
+		const std::vector<sp_shape> *shapes;
+		std::vector<buildprim> *bp;
+
+		void operator()(int lo, int hi) const {
+			for (int i = lo; i < hi; i++) {
+				bool bounded = (*shapes)[i]->getBounds((*bp)[i].box);
+				assert(bounded);
+				(*bp)[i].centroid = (*bp)[i].box.centroid();
+			}
+		}
+	};
+
+	/**
+	 * Morton codes paired with the index of their shape, sorted by code.
+	 */
+	typedef std::vector<std::pair<unsigned int, int> > mortonList;
+
+	/**
+	 * LBVH step that computes the Morton codes of a range of shapes.
+	 */
+	struct mortonStep {
+		const std::vector<buildprim> *bp;
+		mortonList *codes;
+		aabb<vec_T, dim> cbox;
+
+		void operator()(int lo, int hi) const {
+			const int bits = BVH_MORTON_BITS / dim;
+			const double scale = (double) ((1u << bits) - 1);
+			mvector<vec_T, dim> d = cbox.diagonal();
+			for (int i = lo; i < hi; i++) {
+				unsigned int q[dim];
+				for (int a = 0; a < dim; a++) {
+					double x = d[a] > 0 ? ((*bp)[i].centroid[a] -
+							cbox.getMin()[a]) / d[a] : 0;
+					q[a] = (unsigned int) (x * scale);
+				}
+				// Interleave the bits so that nearby codes mean nearby
+				// centroids.
+				unsigned int code = 0;
+				for (int b = 0; b < bits; b++)
+					for (int a = 0; a < dim; a++)
+						code |= ((q[a] >> b) & 1u) << (b * dim + a);
+				(*codes)[i] = std::make_pair(code, i);
+			}
+		}
+	};
+
+	/**
+	 * The length of the common prefix of the sorted keys @c i and @c j ,
+	 * or -1 if @c j is out of range. Equal codes are told apart by their
+	 * position, as if the position were appended to the code.
+	 */
+	static int delta(const mortonList &codes, int i, int j) {
+		if (j < 0 || j >= (int) codes.size())
+			return -1;
+		unsigned int a = codes[i].first, b = codes[j].first;
+		if (a == b)
+			return 32 + __builtin_clz((unsigned int) (i ^ j));
+		return __builtin_clz(a ^ b);
+	}
+
+	/**
+	 * LBVH step that emits a range of interior nodes. Interior node @c i of
+	 * @c n-1 is found from the sorted codes alone, which is what makes the
+	 * nodes independent. Leaves come after all interior nodes.
+	 */
+	struct emitStep {
+		const mortonList *codes;
+		std::vector<node> *nodes;
+		std::vector<int> *parents;
+
+		void operator()(int lo, int hi) const {
+			const mortonList &k = *codes;
+			int n = (int) k.size();
+			for (int i = lo; i < hi; i++) {
+				// Direction of the range and its far end.
+				int d = delta(k, i, i + 1) - delta(k, i, i - 1) > 0 ? 1 : -1;
+				int dmin = delta(k, i, i - d);
+				int lmax = 2;
+				while (delta(k, i, i + lmax * d) > dmin)
+					lmax *= 2;
+				int l = 0;
+				for (int t = lmax / 2; t >= 1; t /= 2)
+					if (delta(k, i, i + (l + t) * d) > dmin)
+						l += t;
+				int j = i + l * d;
+
+				// Binary search for where the range splits.
+				int dnode = delta(k, i, j);
+				int s = 0;
+				int t = l;
+				do {
+					t = (t + 1) / 2;
+					if (delta(k, i, i + (s + t) * d) > dnode)
+						s += t;
+				} while (t > 1);
+				int gamma = i + s * d + std::min(d, 0);
+
+				int left = std::min(i, j) == gamma ? n - 1 + gamma : gamma;
+				int right = std::max(i, j) == gamma + 1 ?
+						n - 1 + gamma + 1 : gamma + 1;
+				(*nodes)[i].left = left;
+				(*nodes)[i].right = right;
+				(*nodes)[i].start = 0;
+				(*nodes)[i].count = 0;
+				(*parents)[left] = i;
+				(*parents)[right] = i;
+			}
+		}
+	};
+
+	/**
+	 * LBVH step that fills in a range of leaves and then walks up towards
+	 * the root. Of the two children of a node, the one that arrives second
+	 * computes the node's box, so every box is computed exactly once and only
+	 * after both children are done.
+	 */
+	struct refitStep {
+		const mortonList *codes;
+		const std::vector<buildprim> *bp;
+		std::vector<node> *nodes;
+		const std::vector<int> *parents;
+		boost::atomic<int> *visits;
+
+		void operator()(int lo, int hi) const {
+			int n = (int) codes->size();
+			for (int k = lo; k < hi; k++) {
+				int idx = n - 1 + k;
+				node &leaf = (*nodes)[idx];
+				leaf.box = (*bp)[(*codes)[k].second].box;
+				leaf.left = -1;
+				leaf.right = -1;
+				leaf.start = k;
+				leaf.count = 1;
+				int p = (*parents)[idx];
+				while (p >= 0 && visits[p].fetch_add(1) == 1) {
+					node &parent = (*nodes)[p];
+					parent.box = (*nodes)[parent.left].box;
+					parent.box.extend((*nodes)[parent.right].box);
+					p = (*parents)[p];
+				}
+			}
+		}
+	};
+
+	/**
+	 * Builds the tree as a linear BVH. Every step runs on @c numThreads
+	 * threads.
+	 */
+	void buildLinear() {
+		int n = (int) primIndices.size();
+		if (n == 1) {
+			nodes.resize(1);
+			nodes[0].box = buildPrims[0].box;
+			makeLeaf(0, 0, 1);
+			return;
+		}
+
+		aabb<vec_T, dim> cbox;
+		for (int i = 0; i < n; i++)
+			cbox.extend(buildPrims[i].centroid);
+
+		mortonList codes(n);
+		mortonStep ms;
+		ms.bp = &buildPrims;
+		ms.codes = &codes;
+		ms.cbox = cbox;
+		parallelFor(0, n, numThreads, ms);
+		parallelSort(codes, numThreads);
+		for (int i = 0; i < n; i++)
+			primIndices[i] = codes[i].second;
+
+		nodes.resize(2 * n - 1);
+		std::vector<int> parents(2 * n - 1, -1);
+		emitStep es;
+		es.codes = &codes;
+		es.nodes = &nodes;
+		es.parents = &parents;
+		parallelFor(0, n - 1, numThreads, es);
+
+		boost::scoped_array<boost::atomic<int> > visits(
+				new boost::atomic<int>[n - 1]);
+		for (int i = 0; i < n - 1; i++)
+			visits[i] = 0;
+		refitStep rs;
+		rs.codes = &codes;
+		rs.bp = &buildPrims;
+		rs.nodes = &nodes;
+		rs.parents = &parents;
+		rs.visits = visits.get();
+		parallelFor(0, n, numThreads, rs);
+	}
+
+	/**
+	 * Functor used to partition shapes by which side of a split plane their
+	 * centroid falls on.
+	 */
+	struct binPredicate {
+		const std::vector<buildprim> *bp;
+		int axis;
+		int splitBin;
+		vec_T cmin;
+		vec_T scale;
+
+		bool operator()(int i) const {
+			return binOf((*bp)[i].centroid[axis], cmin, scale) < splitBin;
+		}
+	};
+
+	/**
+	 * Maps a centroid coordinate to its bin.
+	 */
+	static int binOf(vec_T c, vec_T cmin, vec_T scale) {
+		int b = (int) ((c - cmin) * scale);
+		if (b < 0)
+			b = 0;
+		if (b >= BVH_SAH_BINS)
+			b = BVH_SAH_BINS - 1;
+		return b;
+	}
+
+	/**
+	 * Turns the given node into a leaf over the given range.
+	 */
+	void makeLeaf(int nodeIdx, int start, int end) {
+		nodes[nodeIdx].left = -1;
+		nodes[nodeIdx].right = -1;
+		nodes[nodeIdx].start = start;
+		nodes[nodeIdx].count = end - start;
+	}
+
+	/**
+	 * Picks where to split the shapes in @c indices[start, end) by the SAH
+	 * and partitions them there.
+	 *
+	 * @param bp Build data of the shapes.
+	 * @param indices The shapes, reordered in place.
+	 * @param start First entry of the range.
+	 * @param end One past the last entry of the range.
+	 * @param depth Depth of the node over the range; the root is at depth
+	 *   0.
+	 * @param[out] box Receives the box around the shapes of the range.
+	 *
+	 * @return The first entry right of the split, or -1 if the range
+	 *   should be a leaf.
+	 */
+	static int splitRange(const std::vector<buildprim> &bp,
+			std::vector<int> &indices, int start, int end, int depth,
+			aabb<vec_T, dim> &box) {
+		aabb<vec_T, dim> cbox;
+		box = aabb<vec_T, dim>();
+		for (int i = start; i < end; i++) {
+			box.extend(bp[indices[i]].box);
+			cbox.extend(bp[indices[i]].centroid);
+		}
+
+		// Leaves at the depth limit can get big but the traversal stack stays
+		// bounded.
+		int n = end - start;
+		if (n == 1 || depth >= BVH_MAX_DEPTH - 2)
+			return -1;
+
+		// Evaluate the SAH for every bin boundary along every axis.
+		vec_T parentArea = box.surfaceArea();
+		double bestCost = std::numeric_limits<double>::max();
+		int bestAxis = -1, bestSplit = -1;
+		for (int axis = 0; axis < dim; axis++) {
+			vec_T cmin = cbox.getMin()[axis];
+			vec_T extent = cbox.getMax()[axis] - cmin;
+			if (extent <= 0)
+				continue;
+			vec_T scale = BVH_SAH_BINS / extent;
+
+			aabb<vec_T, dim> binBoxes[BVH_SAH_BINS];
+			int binCounts[BVH_SAH_BINS] = { 0 };
+			for (int i = start; i < end; i++) {
+				const buildprim &p = bp[indices[i]];
+				int b = binOf(p.centroid[axis], cmin, scale);
+				binCounts[b]++;
+				binBoxes[b].extend(p.box);
+			}
+
+			// Sweep from the right to get the area and count of everything
+			// right of each boundary, then sweep from the left to finish.
+			vec_T rightArea[BVH_SAH_BINS];
+			int rightCount[BVH_SAH_BINS];
+			aabb<vec_T, dim> acc;
+			int cnt = 0;
+			for (int b = BVH_SAH_BINS - 1; b > 0; b--) {
+				acc.extend(binBoxes[b]);
+				cnt += binCounts[b];
+				rightArea[b] = acc.surfaceArea();
+				rightCount[b] = cnt;
+			}
+			acc = aabb<vec_T, dim>();
+			cnt = 0;
+			for (int b = 1; b < BVH_SAH_BINS; b++) {
+				acc.extend(binBoxes[b - 1]);
+				cnt += binCounts[b - 1];
+				if (cnt == 0 || rightCount[b] == 0)
+					continue;
+				double cost = BVH_TRAVERSAL_COST +
+						(acc.surfaceArea() * cnt +
+						rightArea[b] * rightCount[b]) /
+						(parentArea > 0 ? parentArea : 1);
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = b;
+				}
+			}
+		}
+
+		int mid;
+		if (bestAxis < 0) {
+			// All centroids coincide so no plane separates them. Split the
+			// range in half if it's too big for a leaf.
+			if (n <= BVH_MAX_LEAF)
+				return -1;
+			mid = start + n / 2;
+		}
+		else {
+			if (bestCost >= n && n <= BVH_MAX_LEAF)
+				return -1;
+			binPredicate pred;
+			pred.bp = &bp;
+			pred.axis = bestAxis;
+			pred.splitBin = bestSplit;
+			pred.cmin = cbox.getMin()[bestAxis];
+			pred.scale = BVH_SAH_BINS /
+					(cbox.getMax()[bestAxis] - cbox.getMin()[bestAxis]);
+			mid = (int) (std::partition(indices.begin() + start,
+					indices.begin() + end, pred) - indices.begin());
+			if (mid == start || mid == end)
+				mid = start + n / 2;
+		}
+		return mid;
+	}
+
+	/**
+	 * Recursively builds the subtree for the shapes in
+	 * @c primIndices[start, end) .
+	 *
+	 * @param depth Depth of the new node; the root is at depth 0.
+	 *
+	 * @return Index of the subtree's root node.
+	 */
+	int buildRecursive(int start, int end, int depth) {
+		int nodeIdx = (int) nodes.size();
+		nodes.push_back(node());
+		aabb<vec_T, dim> box;
+		int mid = splitRange(buildPrims, primIndices, start, end, depth, box);
+		nodes[nodeIdx].box = box;
+		if (mid < 0) {
+			makeLeaf(nodeIdx, start, end);
+			return nodeIdx;
+		}
+
+		int left = buildRecursive(start, mid, depth + 1);
+		int right = buildRecursive(mid, end, depth + 1);
+		nodes[nodeIdx].left = left;
+		nodes[nodeIdx].right = right;
+		nodes[nodeIdx].start = 0;
+		nodes[nodeIdx].count = 0;
+		return nodeIdx;
+	}
+
+	/**
+	 * Rounds towards negative infinity to a float.
+	 */
+	static float roundDown(vec_T v) {
+		float f = (float) v;
+		if ((vec_T) f > v)
+			f = nextafterf(f, -std::numeric_limits<float>::max());
+		return f;
+	}
+
+	/**
+	 * Rounds towards positive infinity to a float.
+	 */
+	static float roundUp(vec_T v) {
+		float f = (float) v;
+		if ((vec_T) f < v)
+			f = nextafterf(f, std::numeric_limits<float>::max());
+		return f;
+	}
+
+	/**
+	 * Appends the subtree of build node @c b to @c flatNodes in depth-first
+	 * order and the shapes of its leaves to @c leafOrder .
+	 *
+	 * @return Index of the subtree's root in @c flatNodes .
+	 */
+	int flatten(int b, std::vector<int> &leafOrder) {
+		const node &n = nodes[b];
+		int idx = (int) flatNodes.size();
+		flatNodes.push_back(flatnode());
+		for (int i = 0; i < dim; i++) {
+			flatNodes[idx].lo[i] = roundDown(n.box.getMin()[i]);
+			flatNodes[idx].hi[i] = roundUp(n.box.getMax()[i]);
+		}
+		if (n.count > 0) {
+			flatNodes[idx].offset = (int) leafOrder.size();
+			flatNodes[idx].count = n.count;
+			for (int i = n.start; i < n.start + n.count; i++)
+				leafOrder.push_back(primIndices[i]);
+			return idx;
+		}
+		flatten(n.left, leafOrder);
+		int right = flatten(n.right, leafOrder);
+		flatNodes[idx].offset = right;
+		flatNodes[idx].count = 0;
+		return idx;
+	}
+
+	/**
+	 * Fills @c leafPrims from @c primIndices .
+	 */
+	void gatherLeafPrims() {
+		leafPrims.resize(primIndices.size());
+		leafPack.clear();
+		for (size_t i = 0; i < primIndices.size(); i++) {
+			leafPrims[i] = prims[primIndices[i]];
+			leafPack.add(leafPrims[i]);
+		}
+	}
+
+	/**
+	 * Replaces this tree with one read by @c read from the header, nodes
+	 * and leaf shape indices written by @c write , after checking that the
+	 * traversal can safely walk it. Nothing changes if it can't.
+	 *
+	 * @param header The header.
+	 * @param fn The nodes.
+	 * @param pi The leaf shape indices.
+	 * @param shapes The shapes, which must outlive this hierarchy.
+	 *
+	 * @return @c true if the tree was valid.
+	 */
+	bool adopt(const int *header, const flatnode *fn, const int *pi,
+			const std::vector<sp_shape> &shapes) {
+		int numNodes = header[3], numPrims = header[4];
+		if (header[0] != BVH_FILE_MAGIC || header[1] != dim ||
+				header[2] != (int) sizeof(flatnode) || numNodes < 0 ||
+				numPrims != (int) shapes.size() ||
+				(numNodes == 0) != (numPrims == 0))
+			return false;
+
+		// Reject anything the traversal can't safely walk. Children always
+		// come after their parent, so one pass finds every node's depth.
+		std::vector<int> depth(numNodes, 0);
+		for (int i = 0; i < numNodes; i++) {
+			const flatnode &n = fn[i];
+			if (n.count > 0) {
+				if (n.offset < 0 || n.count > numPrims - n.offset)
+					return false;
+				continue;
+			}
+			if (n.count < 0 || i + 1 >= numNodes || n.offset <= i + 1 ||
+					n.offset >= numNodes || depth[i] + 2 >= BVH_MAX_DEPTH)
+				return false;
+			depth[i + 1] = depth[n.offset] = depth[i] + 1;
+		}
+		for (int i = 0; i < numPrims; i++)
+			if (pi[i] < 0 || pi[i] >= numPrims)
+				return false;
+
+		prims.clear();
+		for (int i = 0; i < numPrims; i++)
+			prims.push_back(shapes[i].get());
+		hugepages::reserve(flatNodes, numNodes);
+		flatNodes.assign(fn, fn + numNodes);
+		primIndices.assign(pi, pi + numPrims);
+		gatherLeafPrims();
+		return true;
+	}
+
+	/**
+	 * Intersects the given ray with the box of a node with
+	 * @c rayquery::slabs .
+	 *
+	 * @param n The node.
+	 * @param q The prepared ray.
+	 * @param tmax Upper end of the time interval; the lower end is the
+	 *   query's.
+	 * @param[out] tnear Time at which the ray enters the box, if there's a
+	 *   hit.
+	 *
+	 * @return @c true if the ray passes through the box before @c tmax .
+	 */
+	static bool hitBox(const flatnode &n,
+			const rayquery<vec_T, time_T, dim> &q, time_T tmax,
+			time_T &tnear) {
+		return q.slabs(n.lo, n.hi, tmax, tnear);
+	}
+
+	/**
+	 * Tests the shapes of a leaf and records the closest one if it's closer
+	 * than the closest hit so far. @c tBest must be @c RAY_MISS while
+	 * @c best is -1.
+	 */
+	void testLeaf(const flatnode &n, const ray<vec_T, time_T, dim> &r,
+			time_T &tBest, int &best) const {
+		int i = leafPack.closestHit(r, n.offset, n.offset + n.count, tBest);
+		if (i >= 0)
+			best = primIndices[i];
+	}
+
+	/**
+	 * Traces one packet of at most @c BVH_PACKET_WIDTH rays for
+	 * @c closestHits .
+	 */
+	void closestHitPacket(const ray<vec_T, time_T, dim> *rays, int count,
+			int *best, time_T *tBest) const {
+		assert(count > 0 && count <= BVH_PACKET_WIDTH);
+		for (int k = 0; k < count; k++) {
+			best[k] = -1;
+			tBest[k] = RAY_MISS;
+		}
+		if (flatNodes.empty())
+			return;
+
+		rayquery<vec_T, time_T, dim> queries[BVH_PACKET_WIDTH];
+		for (int k = 0; k < count; k++)
+			queries[k] = rayquery<vec_T, time_T, dim>(rays[k]);
+
+		const time_T tmax = std::numeric_limits<time_T>::max();
+		unsigned int all = count == 32 ? ~0u : (1u << count) - 1;
+		int stack[BVH_MAX_DEPTH];
+		unsigned int masks[BVH_MAX_DEPTH];
+		int sp = 0;
+		stack[sp] = 0;
+		masks[sp++] = all;
+		while (sp > 0) {
+			--sp;
+			int idx = stack[sp];
+			const flatnode &n = flatNodes[idx];
+
+			// Mask off the rays that miss this node or already have a hit
+			// closer than it.
+			unsigned int mask = 0;
+			time_T tnear;
+			for (int k = 0; k < count; k++) {
+				if ((masks[sp] >> k & 1) && hitBox(n, queries[k],
+						best[k] < 0 ? tmax : tBest[k], tnear))
+					mask |= 1u << k;
+			}
+			if (mask == 0)
+				continue;
+
+			if (n.count > 0) {
+				int slots[BVH_PACKET_WIDTH];
+				leafPack.closestHits(rays, count, mask, n.offset,
+						n.offset + n.count, tBest, slots);
+				for (int k = 0; k < count; k++)
+					if ((mask >> k & 1) && slots[k] >= 0)
+						best[k] = primIndices[slots[k]];
+				continue;
+			}
+
+			// Pick the child that comes first along the axis on which the
+			// children are furthest apart.
+			const flatnode &l = flatNodes[idx + 1], &r = flatNodes[n.offset];
+			int axis = 0;
+			float sep = -1;
+			for (int i = 0; i < dim; i++) {
+				float d = fabs((l.lo[i] + l.hi[i]) - (r.lo[i] + r.hi[i]));
+				if (d > sep) {
+					sep = d;
+					axis = i;
+				}
+			}
+			int first = 0;
+			while (!(mask >> first & 1))
+				first++;
+			bool leftFirst = (l.lo[axis] + l.hi[axis] <=
+					r.lo[axis] + r.hi[axis]) ==
+					(rays[first].getDir()[axis] >= 0);
+			assert(sp + 2 <= BVH_MAX_DEPTH);
+			stack[sp] = leftFirst ? n.offset : idx + 1;
+			masks[sp++] = mask;
+			stack[sp] = leftFirst ? idx + 1 : n.offset;
+			masks[sp++] = mask;
+		}
+	}
+
+	/**
+	 * Traces one packet of at most @c BVH_PACKET_WIDTH rays for
+	 * @c anyHits .
+	 */
+	void anyHitPacket(const ray<vec_T, time_T, dim> *rays, int count,
+			const time_T *tmax, int *hits) const {
+		assert(count > 0 && count <= BVH_PACKET_WIDTH);
+		for (int k = 0; k < count; k++)
+			hits[k] = -1;
+		if (flatNodes.empty())
+			return;
+
+		// The box around the segments of the rays up to their tmax, which
+		// is small when they all end at one light. Rays without an end
+		// leave it unbounded.
+		rayquery<vec_T, time_T, dim> queries[BVH_PACKET_WIDTH];
+		vec_T lo[dim], hi[dim];
+		bool bounded = true;
+		for (int i = 0; i < dim; i++) {
+			lo[i] = std::numeric_limits<vec_T>::max();
+			hi[i] = -std::numeric_limits<vec_T>::max();
+		}
+		for (int k = 0; k < count; k++) {
+			queries[k] = rayquery<vec_T, time_T, dim>(rays[k], 0, tmax[k]);
+			if (!(tmax[k] < std::numeric_limits<time_T>::max()))
+				bounded = false;
+			for (int i = 0; i < dim; i++) {
+				vec_T o = rays[k].getOrig()[i];
+				vec_T e = o + rays[k].getDir()[i] * (vec_T) tmax[k];
+				lo[i] = std::min(lo[i], std::min(o, e));
+				hi[i] = std::max(hi[i], std::max(o, e));
+			}
+		}
+		for (int i = 0; bounded && i < dim; i++) {
+			// Make up for the rounding of the ends.
+			vec_T pad = (vec_T) ((fabs(lo[i]) + fabs(hi[i])) * 1e-6);
+			lo[i] -= pad;
+			hi[i] += pad;
+		}
+
+		unsigned int alive = count == 32 ? ~0u : (1u << count) - 1;
+		int stack[BVH_MAX_DEPTH];
+		unsigned int masks[BVH_MAX_DEPTH];
+		int sp = 0;
+		stack[sp] = 0;
+		masks[sp++] = alive;
+		time_T tnear;
+		while (sp > 0 && alive != 0) {
+			--sp;
+			int idx = stack[sp];
+			const flatnode &n = flatNodes[idx];
+			if (bounded && !overlaps(n, lo, hi))
+				continue;
+
+			// Mask off the rays that miss this node or are blocked already.
+			unsigned int mask = 0;
+			for (int k = 0; k < count; k++)
+				if ((masks[sp] & alive) >> k & 1 &&
+						hitBox(n, queries[k], tmax[k], tnear))
+					mask |= 1u << k;
+			if (mask == 0)
+				continue;
+
+			if (n.count > 0) {
+				for (int k = 0; k < count; k++) {
+					if (!(mask >> k & 1))
+						continue;
+					int i = leafPack.anyHit(rays[k], n.offset,
+							n.offset + n.count, tmax[k]);
+					if (i >= 0) {
+						hits[k] = primIndices[i];
+						alive &= ~(1u << k);
+					}
+				}
+				continue;
+			}
+			assert(sp + 2 <= BVH_MAX_DEPTH);
+			stack[sp] = n.offset;
+			masks[sp++] = mask;
+			stack[sp] = idx + 1;
+			masks[sp++] = mask;
+		}
+	}
+
+	/**
+	 * Tells whether a node's box and a box of the same space overlap.
+	 */
+	static bool overlaps(const flatnode &n, const vec_T *lo, const vec_T *hi) {
+		for (int i = 0; i < dim; i++)
+			if (n.lo[i] > hi[i] || n.hi[i] < lo[i])
+				return false;
+		return true;
+	}
+
+	/**
+	 * Clears what was built before and takes the shapes of a new build,
+	 * leaving room in @c buildPrims for their bounds.
+	 *
+	 * @param shapes The shapes.
+	 */
+	void startBuild(const std::vector<sp_shape> &shapes) {
+		prims.clear();
+		primIndices.clear();
+		leafPrims.clear();
+		nodes.clear();
+		flatNodes.clear();
+		buildPrims.clear();
+
+		int n = (int) shapes.size();
+		buildPrims.resize(n);
+		for (int i = 0; i < n; i++) {
+			prims.push_back(shapes[i].get());
+			primIndices.push_back(i);
+		}
+	}
+
+	/**
+	 * Builds the tree once @c buildPrims holds the bounds of the shapes,
+	 * then flattens it and drops what only the build needed.
+	 */
+	void finishBuild() {
+		int n = (int) prims.size();
+		if (n > 0) {
+			if (builder == BVH_BUILD_LBVH) {
+				buildLinear();
+			}
+			else {
+				nodes.reserve(2 * n);
+				buildRecursive(0, n, 0);
+			}
+			std::vector<int> leafOrder;
+			leafOrder.reserve(n);
+			hugepages::reserve(flatNodes, nodes.size());
+			flatten(0, leafOrder);
+			primIndices.swap(leafOrder);
+			gatherLeafPrims();
+		}
+		std::vector<buildprim>().swap(buildPrims);
+		std::vector<node>().swap(nodes);
+	}
+
+public:
+
+	/**
+	 * Constructs an empty hierarchy. Call @c build before querying it.
+	 *
+	 * @param builder The build algorithm. The SAH build is the default.
+	 * @param numThreads Number of threads the build may use. Only the
+	 *   linear BVH build and gathering of shape bounds run in parallel.
+	 */
+	bvh(bvhBuilder builder = BVH_BUILD_SAH, int numThreads = 1) :
+			builder(builder), numThreads(numThreads) {
+		assert(numThreads > 0);
+	}
+
+	/**
+	 * Builds the hierarchy over the given shapes with the algorithm chosen
+	 * at construction.
+	 *
+	 * @param shapes The shapes, which must outlive this hierarchy.
+	 */
+	void build(const std::vector<sp_shape> &shapes) {
+		startBuild(shapes);
+		boundsStep bs;
+		bs.shapes = &shapes;
+		bs.bp = &buildPrims;
+		parallelFor(0, (int) shapes.size(), numThreads, bs);
+		finishBuild();
+	}
+
+	/**
+	 * Builds the hierarchy like @c build , but from bounds already
+	 * gathered instead of asking the shapes.
+	 *
+	 * @param shapes The shapes, which must outlive this hierarchy.
+	 * @param boxes The bounds of each of @c shapes .
+	 */
+	void buildFromBounds(const std::vector<sp_shape> &shapes,
+			const std::vector<aabb<vec_T, dim> > &boxes) {
+		assert(boxes.size() == shapes.size());
+		startBuild(shapes);
+		for (size_t i = 0; i < shapes.size(); i++) {
+			buildPrims[i].box = boxes[i];
+			buildPrims[i].centroid = boxes[i].centroid();
+		}
+		finishBuild();
+	}
+
+	/**
+	 * Recomputes the bounds of every node from the current bounds of the
+	 * shapes, bottom up, without changing the tree. Children always come
+	 * after their parent in @c flatNodes , so one backwards pass over the
+	 * nodes is enough.
+	 *
+	 * @return @c true .
+	 */
+	bool refit() {
+		for (int idx = (int) flatNodes.size() - 1; idx >= 0; idx--) {
+			flatnode &n = flatNodes[idx];
+			if (n.count > 0) {
+				aabb<vec_T, dim> box, b;
+				for (int i = n.offset; i < n.offset + n.count; i++) {
+					bool bounded = leafPrims[i]->getBounds(b);
+					assert(bounded);
+					box.extend(b);
+				}
+				for (int i = 0; i < dim; i++) {
+					n.lo[i] = roundDown(box.getMin()[i]);
+					n.hi[i] = roundUp(box.getMax()[i]);
+				}
+				continue;
+			}
+			const flatnode &l = flatNodes[idx + 1], &r = flatNodes[n.offset];
+			for (int i = 0; i < dim; i++) {
+				n.lo[i] = std::min(l.lo[i], r.lo[i]);
+				n.hi[i] = std::max(l.hi[i], r.hi[i]);
+			}
+		}
+		leafPack.update();
+		return true;
+	}
+
+	/**
+	 * Gets the build algorithm.
+	 *
+	 * @return The builder.
+	 */
+	bvhBuilder getBuilder() const {
+		return builder;
+	}
+
+	/**
+	 * Finds the closest shape hit by the given ray by walking the tree front
+	 * to back and pruning subtrees that start beyond the closest hit so far.
+	 *
+	 * @param r The ray.
+	 * @param[out] tIntersect The time of the hit or @c RAY_MISS .
+	 *
+	 * @return Index of the shape that was hit or -1 if there was no hit.
+	 */
+	int closestHit(const ray<vec_T, time_T, dim> &r,
+			time_T &tIntersect) const {
+		int best = -1;
+		time_T tBest = RAY_MISS;
+
+		if (!flatNodes.empty()) {
+			rayquery<vec_T, time_T, dim> q(r);
+
+			time_T tnear;
+			time_T tmax = q.getTMax();
+			int stack[BVH_MAX_DEPTH];
+			int sp = 0;
+			if (hitBox(flatNodes[0], q, tmax, tnear))
+				stack[sp++] = 0;
+			while (sp > 0) {
+				int idx = stack[--sp];
+				const flatnode &n = flatNodes[idx];
+				time_T limit = best < 0 ? tmax : tBest;
+				if (n.count > 0) {
+					testLeaf(n, r, tBest, best);
+					continue;
+				}
+				int left = idx + 1, right = n.offset;
+				time_T tl, tr;
+				bool hitl = hitBox(flatNodes[left], q, limit, tl);
+				bool hitr = hitBox(flatNodes[right], q, limit, tr);
+				assert(sp + 2 <= BVH_MAX_DEPTH);
+				// Push the farther child first so the nearer one is popped
+				// and visited first.
+				if (hitl && hitr) {
+					if (tl < tr) {
+						stack[sp++] = right;
+						stack[sp++] = left;
+					}
+					else {
+						stack[sp++] = left;
+						stack[sp++] = right;
+					}
+				}
+				else if (hitl) {
+					stack[sp++] = left;
+				}
+				else if (hitr) {
+					stack[sp++] = right;
+				}
+			}
+		}
+
+		tIntersect = tBest;
+		return best;
+	}
+
+	/**
+	 * Checks if any shape blocks the given ray before @c tmax . Children are
+	 * visited in no particular order and the walk stops at the first hit.
+	 *
+	 * @param r The ray.
+	 * @param tmax Hits at or beyond this time are ignored.
+	 *
+	 * @return Index of a shape that blocks the ray before @c tmax or -1.
+	 */
+	int anyHit(const ray<vec_T, time_T, dim> &r, time_T tmax) const {
+		if (flatNodes.empty())
+			return -1;
+
+		rayquery<vec_T, time_T, dim> q(r, 0, tmax);
+
+		time_T tnear;
+		int stack[BVH_MAX_DEPTH];
+		int sp = 0;
+		stack[sp++] = 0;
+		while (sp > 0) {
+			int idx = stack[--sp];
+			const flatnode &n = flatNodes[idx];
+			if (!hitBox(n, q, tmax, tnear))
+				continue;
+			if (n.count > 0) {
+				int i = leafPack.anyHit(r, n.offset, n.offset + n.count, tmax);
+				if (i >= 0)
+					return primIndices[i];
+				continue;
+			}
+			assert(sp + 2 <= BVH_MAX_DEPTH);
+			stack[sp++] = n.offset;
+			stack[sp++] = idx + 1;
+		}
+		return -1;
+	}
+
+	/**
+	 * Finds the closest hits of a batch of rays by walking the tree with up
+	 * to @c BVH_PACKET_WIDTH rays at a time. Each node is fetched once per
+	 * packet and its box tested against every ray that's still active at
+	 * it; rays that miss are masked off for the node's subtree. Children are
+	 * visited nearest first along the direction of the first active ray,
+	 * and the shapes of a leaf are tested against all its active rays with
+	 * @c spherepack::closestHits . The results are the same as calling
+	 * @c closestHit on every ray.
+	 *
+	 * @param rays The rays.
+	 * @param count Number of rays.
+	 * @param[out] hits Receives the index of the shape each ray hit or -1.
+	 * @param[out] tIntersect Receives the time of each hit or @c RAY_MISS .
+	 */
+	void closestHits(const ray<vec_T, time_T, dim> *rays, int count,
+			int *hits, time_T *tIntersect) const {
+		for (int i = 0; i < count; i += BVH_PACKET_WIDTH)
+			closestHitPacket(rays + i, std::min(count - i, BVH_PACKET_WIDTH),
+					hits + i, tIntersect + i);
+	}
+
+	/**
+	 * Checks which of a batch of rays are blocked by walking the tree with
+	 * up to @c BVH_PACKET_WIDTH rays at a time, as @c closestHits does, but
+	 * with any-hit semantics: a ray drops out of its packet at the first
+	 * shape that blocks it, and the packet stops once all are blocked. The
+	 * packet is also bounded by the box around the rays' segments up to
+	 * their @c tmax , and a node outside of it is skipped without testing
+	 * any ray. For shadow rays toward one light from neighboring points
+	 * that box is a tight bound of the frustum they span. Each ray is
+	 * reported blocked exactly when @c anyHit finds it blocked.
+	 *
+	 * @param rays The rays.
+	 * @param count Number of rays.
+	 * @param tmax Hits of each ray at or beyond its time are ignored.
+	 * @param[out] hits Receives the index of some shape that blocks each
+	 *   ray, not necessarily the closest, or -1.
+	 */
+	void anyHits(const ray<vec_T, time_T, dim> *rays, int count,
+			const time_T *tmax, int *hits) const {
+		if (flatNodes.size() <= 1) {
+			// A lone leaf has nothing for a packet to skip.
+			for (int i = 0; i < count; i++)
+				hits[i] = anyHit(rays[i], tmax[i]);
+			return;
+		}
+		for (int i = 0; i < count; i += BVH_PACKET_WIDTH)
+			anyHitPacket(rays + i, std::min(count - i, BVH_PACKET_WIDTH),
+					tmax + i, hits + i);
+	}
+
+	/**
+	 * Writes the built tree to the given stream in a raw binary format: a
+	 * small header followed by the nodes and leaf shape indices exactly as
+	 * they are laid out in memory. The format uses native byte order and the
+	 * sizes of this template instantiation, so it's meant for caching on the
+	 * machine that wrote it.
+	 *
+	 * @param os The output stream, which should be opened in binary mode.
+	 *
+	 * @return @c true if everything was written.
+	 */
+	bool write(std::ostream &os) const {
+		int header[5] = { BVH_FILE_MAGIC, dim, (int) sizeof(flatnode),
+				(int) flatNodes.size(), (int) primIndices.size() };
+		os.write((const char *) header, sizeof(header));
+		if (!flatNodes.empty())
+			os.write((const char *) &flatNodes[0],
+					flatNodes.size() * sizeof(flatnode));
+		if (!primIndices.empty())
+			os.write((const char *) &primIndices[0],
+					primIndices.size() * sizeof(int));
+		return os.good();
+	}
+
+	/**
+	 * Replaces this tree with one read by @c write . The shapes must be the
+	 * ones the tree was built over, in the same order. Nothing changes if the
+	 * stream doesn't hold a valid tree over that many shapes.
+	 *
+	 * @param is The input stream, which should be opened in binary mode.
+	 * @param shapes The shapes, which must outlive this hierarchy.
+	 *
+	 * @return @c true if a tree was read.
+	 */
+	bool read(std::istream &is, const std::vector<sp_shape> &shapes) {
+		int header[5];
+		if (!is.read((char *) header, sizeof(header)))
+			return false;
+		int numNodes = header[3], numPrims = header[4];
+		if (numNodes < 0 || numPrims < 0 ||
+				numPrims != (int) shapes.size())
+			return false;
+
+		std::vector<flatnode> fn(numNodes);
+		std::vector<int> pi(numPrims);
+		if (numNodes > 0 && !is.read((char *) &fn[0],
+				numNodes * sizeof(flatnode)))
+			return false;
+		if (numPrims > 0 && !is.read((char *) &pi[0], numPrims * sizeof(int)))
+			return false;
+		return adopt(header, numNodes > 0 ? &fn[0] : 0,
+				numPrims > 0 ? &pi[0] : 0, shapes);
+	}
+
+	/**
+	 * Replaces this tree with one written by @c write into memory, for
+	 * example a mapped file. The bytes are copied, so they needn't outlive
+	 * the tree, but they must be aligned for ints. Nothing changes if they
+	 * don't hold a valid tree over that many shapes.
+	 *
+	 * @param bytes The first byte written by @c write .
+	 * @param size Number of bytes from @c bytes that may be read.
+	 * @param shapes The shapes, which must outlive this hierarchy.
+	 *
+	 * @return @c true if a tree was read.
+	 */
+	bool read(const char *bytes, size_t size,
+			const std::vector<sp_shape> &shapes) {
+		int header[5];
+		if (size < sizeof(header))
+			return false;
+		memcpy(header, bytes, sizeof(header));
+		int numNodes = header[3], numPrims = header[4];
+		if (numNodes < 0 || numPrims < 0 ||
+				size - sizeof(header) < numNodes * sizeof(flatnode) +
+				numPrims * sizeof(int))
+			return false;
+		const char *p = bytes + sizeof(header);
+		return adopt(header, (const flatnode *) p,
+				(const int *) (p + numNodes * sizeof(flatnode)), shapes);
+	}
+
+	/**
+	 * Gets the number of nodes in the tree.
+	 *
+	 * @return Node count.
+	 */
+	int getNodeCount() const {
+		return (int) flatNodes.size();
+	}
+
+	/**
+	 * Gets the number of bytes taken by the nodes and the shape lists.
+	 *
+	 * @return Memory footprint in bytes.
+	 */
+	size_t getMemoryUsage() const {
+		return flatNodes.size() * sizeof(flatnode) + primIndices.size() *
+				sizeof(int) + (prims.size() + leafPrims.size()) *
+				sizeof(prims[0]) + leafPack.getMemoryUsage();
+	}
+
+	/**
+	 * Prints the size of this hierarchy.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printHelper(std::ostream &os) const {
+		os << "[bvh. builder: " <<
+				(builder == BVH_BUILD_LBVH ? "lbvh" : "sah") << ", nodes: " <<
+				flatNodes.size() << ", shapes: " << primIndices.size() << "]";
+	}
+};
+
+typedef bvh<double, double, double, 3> bvh3d;
+typedef bvh<double, double, float, 3> bvh3ddf;
+typedef bvh<float, float, float, 3> bvh3f;
+typedef boost::shared_ptr<bvh3d> sp_bvh3d;
+typedef boost::shared_ptr<bvh3ddf> sp_bvh3ddf;
+typedef boost::shared_ptr<bvh3f> sp_bvh3f;
+
+#endif // BVH_HH
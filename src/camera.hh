@@ -66,6 +66,32 @@ private:
 	 */
 	vec_T dist;
 
+	/**
+	 * Computes the part of the direction through the pixels of row @c y
+	 * that doesn't depend on the column, for the tile functions.
+	 */
+	mvector<vec_T, dim> rowBase(int y, int height) const {
+		assert(y >= 0);
+		assert(height > 0);
+		return dist * dir +
+				((vec_T) 0.5 - (vec_T) y / (vec_T) (height - 1)) * up;
+	}
+
+	/**
+	 * Computes the part of the direction through the pixels of columns
+	 * [x0, x0 + w) that depends on the column, for the tile functions.
+	 */
+	void tileColumns(int x0, int w, int width, int height,
+			std::vector<mvector<vec_T, dim> > &cols) const {
+		assert(x0 >= 0 && w >= 0);
+		assert(width > 0);
+		assert(height > 0);
+		vec_T centerx = ((vec_T) width) / height / 2;
+		cols.resize(w);
+		for (int x = 0; x < w; x++)
+			cols[x] = ((vec_T) (x0 + x) / (vec_T) (height - 1) - centerx) *
+					right;
+	}
 
 public:
 
@@ -109,13 +135,161 @@ public:
 		assert(height > 0);
 		vec_T centerx = ((vec_T) width) / height / 2;
 	    mvector<vec_T, dim> pixelDir = dist * dir +
-	    		(0.5 - (vec_T) y / (vec_T) (height - 1)) * up +
+	    		((vec_T) 0.5 - (vec_T) y / (vec_T) (height - 1)) * up +
 				((vec_T) x / (vec_T) (height - 1) - centerx) * right;
 
 	    ray<vec_T, time_T, dim> pixelRay(pos, pixelDir);
 	    return pixelRay;
 	}
 
+	/**
+	 * Like @c getRayForPixel , but through any point of the image, in
+	 * pixel units, e.g. for several samples per pixel. Pixel centers are
+	 * at whole coordinates, where this gives the same ray as
+	 * @c getRayForPixel .
+	 *
+	 * @param x x coordinate of the point. Increases to right.
+	 * @param y y coordinate of the point. Increases to @e bottom.
+	 * @param width Width of the image in pixels.
+	 * @param height Height of the image in pixels.
+	 *
+	 * @return Ray from the camera's position through the given point.
+	 */
+	ray<vec_T, time_T, dim> getRayForPoint(vec_T x, vec_T y,
+			int width, int height) const {
+		assert(width > 0);
+		assert(height > 0);
+		vec_T centerx = ((vec_T) width) / height / 2;
+		mvector<vec_T, dim> pointDir = dist * dir +
+				((vec_T) 0.5 - y / (vec_T) (height - 1)) * up +
+				(x / (vec_T) (height - 1) - centerx) * right;
+		return ray<vec_T, time_T, dim>(pos, pointDir);
+	}
+
+	/**
+	 * Generates the rays of a tile of pixels, the same ones
+	 * @c getRayForPixel would, without working out the same terms over and
+	 * over: the part of the pixel direction that depends on the column is
+	 * computed once per column of the tile and the part that depends on the
+	 * row once per row, then each pixel adds the two. The sums are formed in
+	 * the order @c getRayForPixel forms them, so the rays are identical.
+	 *
+	 * @param x0 x coordinate of the top left pixel of the tile.
+	 * @param y0 y coordinate of the top left pixel of the tile.
+	 * @param w Width of the tile in pixels.
+	 * @param h Height of the tile in pixels.
+	 * @param width Width of the image in pixels.
+	 * @param height Height of the image in pixels.
+	 * @param[out] out Receives the @c w * @c h rays, row by row.
+	 */
+	void getRaysForTile(int x0, int y0, int w, int h, int width, int height,
+			ray<vec_T, time_T, dim> *out) const {
+		std::vector<mvector<vec_T, dim> > cols;
+		tileColumns(x0, w, width, height, cols);
+		for (int y = 0; y < h; y++) {
+			mvector<vec_T, dim> rowDir = rowBase(y0 + y, height);
+			for (int x = 0; x < w; x++)
+				*out++ = ray<vec_T, time_T, dim>(pos, rowDir + cols[x]);
+		}
+	}
+
+	/**
+	 * Like @c getRaysForTile , but writes the normalized directions into
+	 * structure of arrays buffers, one per axis, e.g. for a ray packet. All
+	 * the rays start at @c getPosition .
+	 *
+	 * @param x0 x coordinate of the top left pixel of the tile.
+	 * @param y0 y coordinate of the top left pixel of the tile.
+	 * @param w Width of the tile in pixels.
+	 * @param h Height of the tile in pixels.
+	 * @param width Width of the image in pixels.
+	 * @param height Height of the image in pixels.
+	 * @param[out] dirs Arrays that receive the @c w * @c h components along
+	 *   each axis, row by row.
+	 */
+	void getDirsForTile(int x0, int y0, int w, int h, int width, int height,
+			vec_T *const *dirs) const {
+		std::vector<mvector<vec_T, dim> > cols;
+		tileColumns(x0, w, width, height, cols);
+		int k = 0;
+		for (int y = 0; y < h; y++) {
+			mvector<vec_T, dim> rowDir = rowBase(y0 + y, height);
+			for (int x = 0; x < w; x++, k++) {
+				mvector<vec_T, dim> d = (rowDir + cols[x]).norm();
+				for (int a = 0; a < dim; a++)
+					dirs[a][k] = d[a];
+			}
+		}
+	}
+
+	/**
+	 * Finds where a point shows up in an image, the inverse of
+	 * @c getRayForPoint : the ray through the pixel coordinates passes
+	 * through the point. Computed in @c double whatever @c vec_T is.
+	 *
+	 * @param p The point.
+	 * @param width Width of the image in pixels.
+	 * @param height Height of the image in pixels.
+	 * @param[out] x Receives the x coordinate, in pixels from the left.
+	 * @param[out] y Receives the y coordinate, in pixels from the top.
+	 *
+	 * @return @c false if the point isn't in front of the camera, so it
+	 *   has no place in the image.
+	 */
+	bool projectPoint(const mvector<double, dim> &p, int width, int height,
+			double &x, double &y) const {
+		double z = 0, a = 0, b = 0;
+		for (int i = 0; i < dim; i++) {
+			double v = p[i] - (double) pos[i];
+			z += v * (double) dir[i];
+			a += v * (double) up[i];
+			b += v * (double) right[i];
+		}
+		if (!(z > 0))
+			return false;
+		double scale = (double) dist / z;
+		y = (0.5 - a * scale) * (height - 1);
+		x = (b * scale + (double) width / height / 2) * (height - 1);
+		return true;
+	}
+
+	/**
+	 * Getter for the position.
+	 *
+	 * @return Center of the camera.
+	 */
+	const mvector<vec_T, dim>& getPosition() const {
+		return pos;
+	}
+
+	/**
+	 * Getter for the direction.
+	 *
+	 * @return Unit vector the camera is aimed along.
+	 */
+	const mvector<vec_T, dim>& getDirection() const {
+		return dir;
+	}
+
+	/**
+	 * Getter for the up direction.
+	 *
+	 * @return Unit vector that's up in the image, at right angles to the
+	 *   direction.
+	 */
+	const mvector<vec_T, dim>& getUp() const {
+		return up;
+	}
+
+	/**
+	 * Getter for the field of view.
+	 *
+	 * @return Field of view in radians.
+	 */
+	vec_T getFieldOfView() const {
+		return fov;
+	}
+
 	/**
 	 * Prints camera attributes to the given output stream.
 	 *
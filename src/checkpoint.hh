@@ -0,0 +1,305 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "rgbcolor.hh"
+#include "boost/cstdint.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef CHECKPOINT_HH
+#define CHECKPOINT_HH
+
+/**
+ * First line of a checkpoint file, with its version.
+ */
+#define CHECKPOINT_MAGIC "rtcheckpoint 1\n"
+
+/**
+ * Side of the tiles of a checkpointed render in pixels. With anti-aliasing
+ * every tile traces a one pixel border as well, which costs less the
+ * bigger the tiles are, and a stop waits for the tiles under way, which
+ * takes longer the bigger they are.
+ */
+#define CHECKPOINT_TILE_SIZE 32
+
+/**
+ * Tiles per render thread a checkpointed render renders between chances to
+ * save and to stop, which bounds how long a stop waits.
+ */
+#define CHECKPOINT_TILES_PER_THREAD 2
+
+/**
+ * The tiles of an image that are done so far, for saving a long render to
+ * a checkpoint file now and then and carrying on from it after the render
+ * was stopped. The image is split in square tiles like
+ * @c scene::renderTiles renders them, and the file keeps which tiles are
+ * done with their colors as doubles, so a resumed render comes out exactly
+ * like one that ran through. It also keeps a key, a hash of everything the
+ * image depends on, so a checkpoint of another scene or other settings
+ * isn't taken for this one. Numbers are written by their bytes, so files
+ * are only meant to be read on machines of the same byte order.
+ *
+ * The file is the magic line, then the key, the width, height and tile
+ * size, the number of tiles done, and for each of those its number
+ * followed by its pixels row by row, three doubles each.
+ *
+ * @tparam color_T The type of the @c rgbcolor.
+ */
+template<typename color_T>
+class checkpoint {
+private:
+
+	/**
+	 * Hash of everything the image depends on.
+	 */
+	boost::uint64_t key;
+
+	/**
+	 * Size of the image in pixels.
+	 */
+	int width, height;
+
+	/**
+	 * Side of the tiles in pixels.
+	 */
+	int tileSize;
+
+	/**
+	 * Number of tiles across the image.
+	 */
+	int tilesX;
+
+	/**
+	 * Whether each tile is done, row by row.
+	 */
+	std::vector<char> done;
+
+	/**
+	 * Number of tiles done.
+	 */
+	int doneCount;
+
+	/**
+	 * Gets the rectangle of a tile.
+	 *
+	 * @param tile Number of the tile.
+	 * @param[out] x0 Left column.
+	 * @param[out] y0 Top row.
+	 * @param[out] x1 Column just right of it.
+	 * @param[out] y1 Row just below it.
+	 */
+	void tileRect(int tile, int &x0, int &y0, int &x1, int &y1) const {
+		x0 = tile % tilesX * tileSize;
+		y0 = tile / tilesX * tileSize;
+		x1 = std::min(width, x0 + tileSize);
+		y1 = std::min(height, y0 + tileSize);
+	}
+
+	/**
+	 * Appends the bytes of a value to a string.
+	 */
+	template<typename T>
+	static void put(std::string &bytes, T v) {
+		bytes.append(reinterpret_cast<const char *>(&v), sizeof(v));
+	}
+
+	/**
+	 * Reads the bytes of a value from a buffer.
+	 *
+	 * @param[in,out] p The next byte, which is moved past the value.
+	 * @param end One past the last byte.
+	 * @param[out] v Receives the value.
+	 *
+	 * @return @c false if the buffer ends first.
+	 */
+	template<typename T>
+	static bool get(const char *&p, const char *end, T &v) {
+		if ((size_t) (end - p) < sizeof(v))
+			return false;
+		memcpy(&v, p, sizeof(v));
+		p += sizeof(v);
+		return true;
+	}
+
+public:
+
+	/**
+	 * Starts a checkpoint with no tiles done.
+	 *
+	 * @param key Hash of everything the image depends on.
+	 * @param width Width of the image in pixels.
+	 * @param height Height of the image in pixels.
+	 * @param tileSize Side of the tiles in pixels.
+	 */
+	checkpoint(boost::uint64_t key, int width, int height, int tileSize) :
+			key(key), width(width), height(height), tileSize(tileSize),
+			tilesX((width + tileSize - 1) / tileSize), doneCount(0) {
+		assert(width > 0 && height > 0 && tileSize > 0);
+		done.assign((size_t) tilesX *
+				((height + tileSize - 1) / tileSize), 0);
+	}
+
+	/**
+	 * Gets the number of tiles of the image.
+	 *
+	 * @return The count.
+	 */
+	int getTileCount() const {
+		return (int) done.size();
+	}
+
+	/**
+	 * Gets the number of tiles done.
+	 *
+	 * @return The count.
+	 */
+	int getDoneCount() const {
+		return doneCount;
+	}
+
+	/**
+	 * Checks if a tile is done.
+	 *
+	 * @param tile Number of the tile, counting row by row.
+	 *
+	 * @return Whether it's done.
+	 */
+	bool isDone(int tile) const {
+		return done[tile] != 0;
+	}
+
+	/**
+	 * Marks a tile done, once its pixels are in the image.
+	 *
+	 * @param tile Number of the tile, counting row by row.
+	 */
+	void markDone(int tile) {
+		if (!done[tile])
+			doneCount++;
+		done[tile] = 1;
+	}
+
+	/**
+	 * Gets the tiles that aren't done.
+	 *
+	 * @param[out] tiles Receives their numbers in order.
+	 */
+	void getTilesLeft(std::vector<int> &tiles) const {
+		tiles.clear();
+		for (int i = 0; i < (int) done.size(); i++)
+			if (!done[i])
+				tiles.push_back(i);
+	}
+
+	/**
+	 * Writes the tiles done and their pixels as the contents of a
+	 * checkpoint file.
+	 *
+	 * @param image The image, row by row.
+	 *
+	 * @return The bytes of the file.
+	 */
+	std::string encode(const std::vector<rgbcolor<color_T> > &image) const {
+		assert(image.size() == (size_t) width * height);
+		std::string bytes(CHECKPOINT_MAGIC);
+		bytes.reserve(bytes.size() + 28 + (size_t) doneCount *
+				(4 + tileSize * tileSize * 3 * sizeof(double)));
+		put(bytes, key);
+		put(bytes, (boost::int32_t) width);
+		put(bytes, (boost::int32_t) height);
+		put(bytes, (boost::int32_t) tileSize);
+		put(bytes, (boost::int32_t) doneCount);
+		for (int t = 0; t < (int) done.size(); t++) {
+			if (!done[t])
+				continue;
+			put(bytes, (boost::int32_t) t);
+			int x0, y0, x1, y1;
+			tileRect(t, x0, y0, x1, y1);
+			for (int y = y0; y < y1; y++) {
+				for (int x = x0; x < x1; x++) {
+					const rgbcolor<color_T> &c = image[(size_t) y * width + x];
+					put(bytes, (double) c.getR());
+					put(bytes, (double) c.getG());
+					put(bytes, (double) c.getB());
+				}
+			}
+		}
+		return bytes;
+	}
+
+	/**
+	 * Reads a checkpoint file written by @c encode for the same key, size
+	 * and tiles, marking its tiles done and putting their pixels in the
+	 * image. Nothing is changed if it can't be read.
+	 *
+	 * @param data The first byte of the file.
+	 * @param size Number of bytes.
+	 * @param[in,out] image The image, row by row, which is already sized.
+	 * @param[out] error Receives what's wrong with the file, if anything.
+	 *
+	 * @return @c false if it isn't a checkpoint of this image.
+	 */
+	bool decode(const char *data, size_t size,
+			std::vector<rgbcolor<color_T> > &image, std::string &error) {
+		assert(image.size() == (size_t) width * height);
+		const char *p = data, *end = data + size;
+		size_t magic = strlen(CHECKPOINT_MAGIC);
+		boost::uint64_t k;
+		boost::int32_t w, h, ts, n;
+		if (size < magic || memcmp(data, CHECKPOINT_MAGIC, magic) != 0) {
+			error = "not a checkpoint file.";
+			return false;
+		}
+		p += magic;
+		if (!get(p, end, k) || !get(p, end, w) || !get(p, end, h) ||
+				!get(p, end, ts) || !get(p, end, n)) {
+			error = "the checkpoint is cut short.";
+			return false;
+		}
+		if (k != key || w != width || h != height || ts != tileSize) {
+			error = "the checkpoint is of another scene, size or settings.";
+			return false;
+		}
+		if (n < 0 || n > (int) done.size()) {
+			error = "the checkpoint is damaged.";
+			return false;
+		}
+		// Read into copies, so a file cut short changes nothing.
+		std::vector<rgbcolor<color_T> > pixels(image);
+		std::vector<char> flags(done);
+		for (int i = 0; i < n; i++) {
+			boost::int32_t t;
+			if (!get(p, end, t) || t < 0 || t >= (int) done.size()) {
+				error = "the checkpoint is damaged.";
+				return false;
+			}
+			flags[t] = 1;
+			int x0, y0, x1, y1;
+			tileRect(t, x0, y0, x1, y1);
+			for (int y = y0; y < y1; y++) {
+				for (int x = x0; x < x1; x++) {
+					double r, g, b;
+					if (!get(p, end, r) || !get(p, end, g) ||
+							!get(p, end, b)) {
+						error = "the checkpoint is cut short.";
+						return false;
+					}
+					pixels[(size_t) y * width + x] =
+							rgbcolor<color_T>::unchecked((color_T) r,
+							(color_T) g, (color_T) b);
+				}
+			}
+		}
+		image.swap(pixels);
+		done.swap(flags);
+		doneCount = (int) std::count(done.begin(), done.end(), 1);
+		return true;
+	}
+};
+
+#endif // CHECKPOINT_HH
@@ -0,0 +1,626 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "shape.hh"
+#include "rgbcolor.hh"
+#include "mvector.hh"
+#include "ray.hh"
+#include "aabb.hh"
+#include "hitrecord.hh"
+#include "boost/cstdint.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <ostream>
+#include <vector>
+
+#ifndef COMPACTSPHERES_HH
+#define COMPACTSPHERES_HH
+
+/**
+ * Most spheres a leaf of a @c compactspheres hierarchy holds.
+ */
+#define COMPACT_SPHERES_LEAF 4
+
+/**
+ * Deepest @c compactspheres hierarchy the traversal stack can handle.
+ */
+#define COMPACT_SPHERES_MAX_DEPTH 64
+
+/**
+ * Most materials a @c compactspheres indexes with 16 bits; more take 32.
+ */
+#define COMPACT_SPHERES_NARROW 65536
+
+/**
+ * A sphere of a @c compactspheres : its center and radius in floats, 16
+ * bytes in all.
+ */
+struct compactsphere {
+	/** The center. */
+	float center[3];
+	/** The radius. */
+	float radius;
+};
+
+/**
+ * A color and reflectivity shared by spheres of a @c compactspheres , which
+ * their hit records point at since that's all shading reads of a shape.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+class spherematerial : public shape<vec_T, color_T, time_T, 3> {
+public:
+
+	/**
+	 * Makes a material.
+	 *
+	 * @param color The color.
+	 * @param reflectivity Reflectivity between 0 and 1.
+	 */
+	spherematerial(const rgbcolor<color_T> &color, float reflectivity) :
+			shape<vec_T, color_T, time_T, 3>(color, reflectivity) { }
+
+	/**
+	 * Never hits anything; rays are traced through the spheres.
+	 *
+	 * @param r The ray.
+	 *
+	 * @return @c RAY_MISS .
+	 */
+	time_T intersection(const ray<vec_T, time_T, 3> &r) const {
+		return RAY_MISS;
+	}
+
+	/**
+	 * Gets a normal pointing up, since the sphere isn't known here; hits
+	 * get theirs in @c compactspheres::completeHit .
+	 *
+	 * @param surfacePt The point at which to get a surface normal.
+	 *
+	 * @return The up vector.
+	 */
+	mvector<vec_T, 3> surfaceNorm(const mvector<vec_T, 3> &surfacePt) const {
+		mvector<vec_T, 3> up;
+		up[2] = 1;
+		return up;
+	}
+
+	/**
+	 * Print helper function.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printHelper(std::ostream &os) const {
+		os << "[sphere material. color: " << this->getColor() <<
+				", reflectivity: " << this->getReflectivity() << "]";
+	}
+};
+
+/**
+ * Many spheres stored as one shape, for scenes of so many spheres that
+ * the memory of a @c sphere each, with its color, vtable and the count
+ * block of its shared pointer, matters. A sphere takes 16 bytes of floats
+ * here and a 16 bit index into a table of the distinct colors and
+ * reflectivities, or a 32 bit one if there are more than
+ * @c COMPACT_SPHERES_NARROW of those. The shape keeps its own bounding
+ * volume hierarchy over the spheres, like a @c trianglemesh , so the
+ * scene's holds just one box.
+ *
+ * Spheres are tested with the arithmetic of @c sphere in @c vec_T , so one
+ * whose center and radius are floats renders as its @c sphere would;
+ * others are rounded to the nearest floats. Add the spheres, then call
+ * @c build once before rendering.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+class compactspheres : public shape<vec_T, color_T, time_T, 3> {
+private:
+
+	typedef spherematerial<vec_T, color_T, time_T> material_t;
+
+	/**
+	 * A node of the hierarchy, laid out like those of @c trianglemesh :
+	 * depth first, with bounds rounded outwards to floats.
+	 */
+	struct spherenode {
+		/** Lower corner of the box around everything below this node. */
+		float lo[3];
+		/** Upper corner of the box around everything below this node. */
+		float hi[3];
+		/**
+		 * Index of the right child for interior nodes; first sphere for
+		 * leaves.
+		 */
+		int offset;
+		/** Number of spheres in this leaf, 0 for interior nodes. */
+		int count;
+	};
+
+	/**
+	 * A color and reflectivity, to find the material of a new sphere.
+	 */
+	struct materialkey {
+		color_T c[3];
+		float reflectivity;
+
+		bool operator<(const materialkey &other) const {
+			for (int i = 0; i < 3; i++)
+				if (c[i] != other.c[i])
+					return c[i] < other.c[i];
+			return reflectivity < other.reflectivity;
+		}
+	};
+
+	/**
+	 * Orders indices of spheres by their centers along an axis.
+	 */
+	struct centerless {
+		const std::vector<compactsphere> *spheres;
+		int axis;
+
+		bool operator()(int a, int b) const {
+			return (*spheres)[a].center[axis] < (*spheres)[b].center[axis];
+		}
+	};
+
+	/**
+	 * The spheres, in the order of the leaves once built.
+	 */
+	std::vector<compactsphere> spheres;
+
+	/**
+	 * The material of every sphere if there are at most
+	 * @c COMPACT_SPHERES_NARROW materials.
+	 */
+	std::vector<boost::uint16_t> narrowMaterials;
+
+	/**
+	 * The material of every sphere otherwise.
+	 */
+	std::vector<boost::uint32_t> wideMaterials;
+
+	/**
+	 * The distinct colors and reflectivities.
+	 */
+	std::vector<material_t> materials;
+
+	/**
+	 * Index in @c materials of every color and reflectivity so far.
+	 */
+	std::map<materialkey, boost::uint32_t> materialIndex;
+
+	/**
+	 * The hierarchy. Element 0 is the root.
+	 */
+	std::vector<spherenode> nodes;
+
+	/**
+	 * Box around all spheres.
+	 */
+	aabb<vec_T, 3> bounds;
+
+	/**
+	 * Rounds towards negative infinity to a float.
+	 */
+	static float roundDown(vec_T v) {
+		float f = (float) v;
+		if ((vec_T) f > v)
+			f = nextafterf(f, -std::numeric_limits<float>::max());
+		return f;
+	}
+
+	/**
+	 * Rounds towards positive infinity to a float.
+	 */
+	static float roundUp(vec_T v) {
+		float f = (float) v;
+		if ((vec_T) f < v)
+			f = nextafterf(f, std::numeric_limits<float>::max());
+		return f;
+	}
+
+	/**
+	 * Gets the center of a sphere.
+	 */
+	mvector<vec_T, 3> centerOf(int i) const {
+		mvector<vec_T, 3> c;
+		for (int a = 0; a < 3; a++)
+			c[a] = (vec_T) spheres[i].center[a];
+		return c;
+	}
+
+	/**
+	 * Gets the material index of a sphere.
+	 */
+	boost::uint32_t materialOf(int i) const {
+		return narrowMaterials.empty() ? wideMaterials[i] :
+				narrowMaterials[i];
+	}
+
+	/**
+	 * Tests a ray against a sphere as @c sphere::intersection does.
+	 *
+	 * @param i Index of the sphere.
+	 * @param r The ray.
+	 *
+	 * @return The time at which the ray enters the sphere, or @c RAY_MISS .
+	 */
+	time_T intersectSphere(int i, const ray<vec_T, time_T, 3> &r) const {
+		vec_T rad = (vec_T) spheres[i].radius;
+		vec_T radSq = rad * rad;
+		const mvector<vec_T, 3> &P = r.getOrig();
+		const mvector<vec_T, 3> &D = r.getDir();
+		if (r.isNormalized()) {
+			vec_T b = 0, c = -radSq;
+			for (int a = 0; a < 3; a++) {
+				vec_T w = P[a] - (vec_T) spheres[i].center[a];
+				b += w * D[a];
+				c += w * w;
+			}
+			vec_T disc = b * b - c;
+			if (disc < 0)
+				return RAY_MISS;
+			time_T t = disc == 0 ? (time_T) -b : (time_T) (-b - sqrt(disc));
+			return t < 0 ? RAY_MISS : t;
+		}
+		mvector<vec_T, 3> C = centerOf(i);
+		vec_T a = D * D;
+		vec_T b = 2 * (P * D - D * C);
+		vec_T c = P * P + C * C - 2 * (P * C) - radSq;
+		vec_T disc = b * b - 4 * a * c;
+		if (disc < 0)
+			return RAY_MISS;
+		if (disc == 0) {
+			time_T t = (time_T) (-b / (2 * a));
+			return t < 0 ? RAY_MISS : t;
+		}
+		vec_T sq = sqrt(disc);
+		time_T t = std::min((time_T) ((-b + sq) / (2 * a)),
+				(time_T) ((-b - sq) / (2 * a)));
+		return t < 0 ? RAY_MISS : t;
+	}
+
+	/**
+	 * Appends the subtree for the spheres in @c order[start, end) to
+	 * @c nodes in depth-first order, splitting them at the median of their
+	 * centers along the longest axis of the centers' box.
+	 *
+	 * @param order Sphere indices, which are partitioned in place.
+	 * @param depth Depth of the new node; the root is at depth 0.
+	 */
+	void build(std::vector<int> &order, int start, int end, int depth) {
+		int nodeIdx = (int) nodes.size();
+		nodes.push_back(spherenode());
+		float cmin[3], cmax[3];
+		for (int a = 0; a < 3; a++) {
+			nodes[nodeIdx].lo[a] = cmin[a] = std::numeric_limits<float>::max();
+			nodes[nodeIdx].hi[a] = cmax[a] =
+					-std::numeric_limits<float>::max();
+		}
+		for (int i = start; i < end; i++) {
+			const compactsphere &s = spheres[order[i]];
+			for (int a = 0; a < 3; a++) {
+				vec_T c = (vec_T) s.center[a], rad = (vec_T) s.radius;
+				nodes[nodeIdx].lo[a] = std::min(nodes[nodeIdx].lo[a],
+						roundDown(c - rad));
+				nodes[nodeIdx].hi[a] = std::max(nodes[nodeIdx].hi[a],
+						roundUp(c + rad));
+				cmin[a] = std::min(cmin[a], s.center[a]);
+				cmax[a] = std::max(cmax[a], s.center[a]);
+			}
+		}
+		int n = end - start;
+		if (n <= COMPACT_SPHERES_LEAF ||
+				depth >= COMPACT_SPHERES_MAX_DEPTH - 2) {
+			nodes[nodeIdx].offset = start;
+			nodes[nodeIdx].count = n;
+			return;
+		}
+		centerless less;
+		less.spheres = &spheres;
+		less.axis = 0;
+		for (int a = 1; a < 3; a++)
+			if (cmax[a] - cmin[a] > cmax[less.axis] - cmin[less.axis])
+				less.axis = a;
+		int mid = start + n / 2;
+		std::nth_element(order.begin() + start, order.begin() + mid,
+				order.begin() + end, less);
+		build(order, start, mid, depth + 1);
+		int right = (int) nodes.size();
+		build(order, mid, end, depth + 1);
+		nodes[nodeIdx].offset = right;
+		nodes[nodeIdx].count = 0;
+	}
+
+	/**
+	 * Finds the closest sphere hit by a ray, walking the hierarchy near
+	 * child first like @c trianglemesh .
+	 *
+	 * @param r The ray.
+	 * @param[out] tBest Receives the time of the hit or @c RAY_MISS .
+	 *
+	 * @return Index of the sphere or -1.
+	 */
+	int closestSphere(const ray<vec_T, time_T, 3> &r, time_T &tBest) const {
+		int best = -1;
+		tBest = RAY_MISS;
+		if (nodes.empty())
+			return -1;
+		rayquery<vec_T, time_T, 3> q(r);
+		time_T tmax = q.getTMax(), tnear;
+		int stack[COMPACT_SPHERES_MAX_DEPTH];
+		int sp = 0;
+		if (q.slabsConservative(nodes[0].lo, nodes[0].hi, tmax, tnear))
+			stack[sp++] = 0;
+		while (sp > 0) {
+			int idx = stack[--sp];
+			const spherenode &n = nodes[idx];
+			time_T limit = best < 0 ? tmax : tBest;
+			if (n.count > 0) {
+				for (int i = n.offset; i < n.offset + n.count; i++) {
+					time_T t = intersectSphere(i, r);
+					if (t >= 0 && t < limit) {
+						best = i;
+						tBest = limit = t;
+					}
+				}
+				continue;
+			}
+			int left = idx + 1, right = n.offset;
+			time_T tl, tr;
+			bool hitl = q.slabsConservative(nodes[left].lo, nodes[left].hi,
+					limit, tl);
+			bool hitr = q.slabsConservative(nodes[right].lo, nodes[right].hi,
+					limit, tr);
+			assert(sp + 2 <= COMPACT_SPHERES_MAX_DEPTH);
+			if (hitl && hitr) {
+				if (tl < tr) {
+					stack[sp++] = right;
+					stack[sp++] = left;
+				}
+				else {
+					stack[sp++] = left;
+					stack[sp++] = right;
+				}
+			}
+			else if (hitl) {
+				stack[sp++] = left;
+			}
+			else if (hitr) {
+				stack[sp++] = right;
+			}
+		}
+		return best;
+	}
+
+public:
+
+	/**
+	 * Constructs an empty set of spheres.
+	 */
+	compactspheres() : shape<vec_T, color_T, time_T, 3>() { }
+
+	/**
+	 * Adds a sphere, before @c build .
+	 *
+	 * @param color Color.
+	 * @param radius Radius, which is positive.
+	 * @param center Center.
+	 * @param reflectivity Reflectivity between 0 and 1.
+	 */
+	void add(const rgbcolor<color_T> &color, vec_T radius,
+			const mvector<vec_T, 3> &center, float reflectivity = 0) {
+		assert(radius > 0 && nodes.empty());
+		compactsphere s;
+		for (int a = 0; a < 3; a++)
+			s.center[a] = (float) center[a];
+		s.radius = (float) radius;
+		spheres.push_back(s);
+		materialkey key;
+		key.c[0] = color.getR();
+		key.c[1] = color.getG();
+		key.c[2] = color.getB();
+		key.reflectivity = reflectivity;
+		typename std::map<materialkey, boost::uint32_t>::iterator it =
+				materialIndex.find(key);
+		if (it == materialIndex.end()) {
+			it = materialIndex.insert(std::make_pair(key,
+					(boost::uint32_t) materials.size())).first;
+			materials.push_back(material_t(color, reflectivity));
+		}
+		wideMaterials.push_back(it->second);
+	}
+
+	/**
+	 * Builds the hierarchy over the spheres and narrows the material
+	 * indices to 16 bits if they fit. It's called once, after the last
+	 * @c add ; hit records point at the materials from then on.
+	 */
+	void build() {
+		assert(nodes.empty());
+		int n = (int) spheres.size();
+		std::vector<int> order(n);
+		for (int i = 0; i < n; i++)
+			order[i] = i;
+		nodes.clear();
+		nodes.reserve(2 * n / COMPACT_SPHERES_LEAF + 1);
+		if (n > 0)
+			build(order, 0, n, 0);
+		std::vector<spherenode>(nodes).swap(nodes);
+
+		// Put the spheres and their materials in the order of the leaves.
+		std::vector<compactsphere> sorted(n);
+		std::vector<boost::uint32_t> sortedMaterials(n);
+		bounds = aabb<vec_T, 3>();
+		for (int i = 0; i < n; i++) {
+			sorted[i] = spheres[order[i]];
+			sortedMaterials[i] = wideMaterials[order[i]];
+			mvector<vec_T, 3> lo, hi;
+			for (int a = 0; a < 3; a++) {
+				lo[a] = (vec_T) sorted[i].center[a] - sorted[i].radius;
+				hi[a] = (vec_T) sorted[i].center[a] + sorted[i].radius;
+			}
+			bounds.extend(aabb<vec_T, 3>(lo, hi));
+		}
+		spheres.swap(sorted);
+		if (materials.size() <= COMPACT_SPHERES_NARROW) {
+			narrowMaterials.assign(sortedMaterials.begin(),
+					sortedMaterials.end());
+			std::vector<boost::uint32_t>().swap(wideMaterials);
+		}
+		else {
+			wideMaterials.swap(sortedMaterials);
+		}
+		std::map<materialkey, boost::uint32_t>().swap(materialIndex);
+	}
+
+	/**
+	 * Gets the number of spheres.
+	 *
+	 * @return Sphere count.
+	 */
+	int getSphereCount() const {
+		return (int) spheres.size();
+	}
+
+	/**
+	 * Gets the number of distinct colors and reflectivities.
+	 *
+	 * @return Material count.
+	 */
+	int getMaterialCount() const {
+		return (int) materials.size();
+	}
+
+	/**
+	 * Gets the size of the material index of a built set of spheres.
+	 *
+	 * @return 2 or 4 bytes.
+	 */
+	int getIndexBytes() const {
+		return wideMaterials.empty() ? 2 : 4;
+	}
+
+	/**
+	 * Gets the number of nodes of the hierarchy.
+	 *
+	 * @return Node count.
+	 */
+	int getNodeCount() const {
+		return (int) nodes.size();
+	}
+
+	/**
+	 * Gets the memory taken by the spheres, their materials and the
+	 * hierarchy.
+	 *
+	 * @return Size in bytes.
+	 */
+	size_t getMemoryUsage() const {
+		return spheres.capacity() * sizeof(compactsphere) +
+				narrowMaterials.capacity() * sizeof(boost::uint16_t) +
+				wideMaterials.capacity() * sizeof(boost::uint32_t) +
+				materials.capacity() * sizeof(material_t) +
+				nodes.capacity() * sizeof(spherenode);
+	}
+
+	/**
+	 * Gets the earliest time at which the given ray enters a sphere.
+	 *
+	 * @param r The ray.
+	 *
+	 * @return The time of the closest hit or @c RAY_MISS .
+	 */
+	time_T intersection(const ray<vec_T, time_T, 3> &r) const {
+		time_T t;
+		closestSphere(r, t);
+		return t;
+	}
+
+	/**
+	 * Fills in a hit record for a hit found by @c intersection with the
+	 * normal of the sphere that was hit, computed as @c sphere does, and
+	 * its material.
+	 *
+	 * @param r The ray.
+	 * @param[in,out] rec The record, whose @c t is the time of the hit.
+	 */
+	void completeHit(const ray<vec_T, time_T, 3> &r,
+			hitrecord<vec_T, color_T, time_T, 3> &rec) const {
+		time_T t;
+		int i = closestSphere(r, t);
+		rec.point = r.getPointAtT(rec.t);
+		if (i < 0) {
+			rec.normal = surfaceNorm(rec.point);
+			rec.obj = this;
+			return;
+		}
+		rec.normal = (rec.point - centerOf(i)) / (vec_T) spheres[i].radius;
+		rec.obj = &materials[materialOf(i)];
+	}
+
+	/**
+	 * Gets the normal of the sphere whose surface passes nearest the given
+	 * point. This looks at every sphere; shading goes through
+	 * @c completeHit , which knows the ray.
+	 *
+	 * @param surfacePt The point at which to get a surface normal.
+	 *
+	 * @return The surface normal.
+	 */
+	mvector<vec_T, 3> surfaceNorm(const mvector<vec_T, 3> &surfacePt) const {
+		int best = -1;
+		vec_T bestDist = std::numeric_limits<vec_T>::max();
+		for (int i = 0; i < (int) spheres.size(); i++) {
+			vec_T d = std::abs((surfacePt - centerOf(i)).mag() -
+					(vec_T) spheres[i].radius);
+			if (d < bestDist) {
+				bestDist = d;
+				best = i;
+			}
+		}
+		mvector<vec_T, 3> up;
+		up[2] = 1;
+		return best < 0 ? up : (surfacePt - centerOf(best)).norm();
+	}
+
+	/**
+	 * Gets the box around all spheres.
+	 *
+	 * @param[out] box Receives the bounding box.
+	 *
+	 * @return @c true if there are spheres.
+	 */
+	bool getBounds(aabb<vec_T, 3> &box) const {
+		box = bounds;
+		return !spheres.empty();
+	}
+
+	/**
+	 * Partially overrides the @c shape @c printHelper. Prints the numbers
+	 * of spheres and materials.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printHelper(std::ostream &os) const {
+		os << "[compact spheres. spheres: " << spheres.size() <<
+				", materials: " << materials.size() << "]";
+	}
+};
+
+typedef compactspheres<double, double, double> compactspheresd;
+typedef compactspheres<double, double, float> compactspheresddf;
+typedef compactspheres<float, float, float> compactspheresf;
+
+#endif // COMPACTSPHERES_HH
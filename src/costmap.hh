@@ -0,0 +1,141 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "raystats.hh"
+#include "rgbcolor.hh"
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#ifndef COSTMAP_HH
+#define COSTMAP_HH
+
+/**
+ * Defined when the time stamp counter can be read with @c __rdtsc .
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#define COSTMAP_RDTSC 1
+#include <x86intrin.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <time.h>
+#endif
+
+/**
+ * What a cost map of a render counts per pixel; see @c scene::setCostMap .
+ */
+enum costMeasure {
+	/** CPU cycles, or nanoseconds where there's no cycle counter. */
+	COST_CYCLES,
+	/** Ray-shape intersection tests, which are only counted with
+	 * @c RT_STATS ; see @c raystats . */
+	COST_TESTS
+};
+
+/**
+ * Reads the counter a cost map is measured with. Only differences of two
+ * readings on the same thread mean anything.
+ *
+ * @param measure What to count.
+ *
+ * @return The reading.
+ */
+inline unsigned long long readCost(costMeasure measure) {
+	if (measure == COST_TESTS) {
+		const raystats &s = raystats::local();
+		unsigned long long sum = 0;
+		for (int i = 0; i < RAYSTATS_SHAPE_KINDS; i++)
+			sum += s.tests[i];
+		return sum;
+	}
+#if defined(COSTMAP_RDTSC)
+	return __rdtsc();
+#elif defined(__unix__) || defined(__APPLE__)
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else
+	return 0;
+#endif
+}
+
+/**
+ * Gets the false color of a cost as a fraction of the largest one: black
+ * for nothing, then through blue, cyan, green and yellow to red.
+ *
+ * @param f The fraction, from 0 to 1.
+ *
+ * @return The color.
+ */
+inline rgbcolord heatColor(double f) {
+	static const double ramp[6][3] = { { 0, 0, 0 }, { 0, 0, 1 }, { 0, 1, 1 },
+			{ 0, 1, 0 }, { 1, 1, 0 }, { 1, 0, 0 } };
+	f = std::max(0.0, std::min(1.0, f)) * 5;
+	int i = std::min(4, (int) f);
+	double u = f - i;
+	return rgbcolord(ramp[i][0] + (ramp[i + 1][0] - ramp[i][0]) * u,
+			ramp[i][1] + (ramp[i + 1][1] - ramp[i][1]) * u,
+			ramp[i][2] + (ramp[i + 1][2] - ramp[i][2]) * u);
+}
+
+/**
+ * Part of the pixels of a cost map above the cost @c heatmapImage shows as
+ * red, so that the few pixels some interrupt or page fault slowed down
+ * don't leave the rest of the map dark.
+ */
+#define HEATMAP_CLIP_FRACTION 0.005
+
+/**
+ * Turns a cost map into a false color image with @c heatColor , scaled so
+ * that all but the costliest @c HEATMAP_CLIP_FRACTION of the pixels are
+ * below red.
+ *
+ * @param cost The cost of every pixel.
+ * @param[out] image Receives the colors, one per pixel.
+ */
+template<typename color_T>
+void heatmapImage(const std::vector<double> &cost,
+		std::vector<rgbcolor<color_T> > &image) {
+	double top = 0;
+	if (!cost.empty()) {
+		std::vector<double> sorted(cost);
+		size_t k = (size_t) ((1 - HEATMAP_CLIP_FRACTION) *
+				(sorted.size() - 1));
+		std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+		top = sorted[k];
+		if (!(top > 0))
+			top = *std::max_element(cost.begin(), cost.end());
+	}
+	image.resize(cost.size());
+	for (size_t i = 0; i < cost.size(); i++) {
+		rgbcolord c = heatColor(top > 0 ? cost[i] / top : 0);
+		image[i] = rgbcolor<color_T>::unchecked((color_T) c.getR(),
+				(color_T) c.getG(), (color_T) c.getB());
+	}
+}
+
+/**
+ * Gets the share of the total cost taken by the costliest pixels, e.g. to
+ * tell that a tenth of the image takes most of the time.
+ *
+ * @param cost The cost of every pixel.
+ * @param fraction Fraction of the pixels to add up, costliest first.
+ *
+ * @return Their share of the total, from 0 to 1, or 0 if it costs nothing.
+ */
+inline double costliestShare(const std::vector<double> &cost,
+		double fraction) {
+	std::vector<double> sorted(cost);
+	std::sort(sorted.begin(), sorted.end(), std::greater<double>());
+	double total = 0, top = 0;
+	size_t n = (size_t) (fraction * sorted.size() + 0.5);
+	for (size_t i = 0; i < sorted.size(); i++) {
+		total += sorted[i];
+		if (i < n)
+			top += sorted[i];
+	}
+	return total > 0 ? top / total : 0;
+}
+
+#endif // COSTMAP_HH
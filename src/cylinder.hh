@@ -6,7 +6,6 @@
 #include <cmath>
 #include <cassert>
 #include "shape.hh"
-#include "sphere.hh"
 #include "sceneobj.hh"
 #include "mvector.hh"
 #include "ray.hh"
@@ -59,6 +58,25 @@ private:
 	 */
 	vec_T height;
 
+	/**
+	 * Square of @c radius , cached for @c intersection .
+	 */
+	vec_T radiusSq;
+
+	/**
+	 * Square of half of @c height , cached for @c intersection .
+	 */
+	vec_T halfHeightSq;
+
+	/**
+	 * Recomputes the cached values from the radius and height. Must be
+	 * called whenever either changes.
+	 */
+	void updateCache() {
+		radiusSq = radius * radius;
+		halfHeightSq = height * height / 4;
+	}
+
 public:
 
 	/**
@@ -69,11 +87,12 @@ public:
 	cylinder() : shape<vec_T, color_T, time_T, CDIM>() {
 		mvector<vec_T, CDIM> v;
 		assert(CDIM == 3);
-		mvector<vec_T, CDIM> u(0, 1, 0);
+		mvector<vec_T, CDIM> u((vec_T) 0, (vec_T) 1, (vec_T) 0);
 		center = v;
 		radius = 1;
 		axis = u;
 		height = 1;
+		updateCache();
 	}
 
 	/**
@@ -103,6 +122,7 @@ public:
 		assert(CDIM == 3);
 		assert(height > 0);
 		assert(radius > 0);
+		updateCache();
 	}
 
 	/**
@@ -118,6 +138,7 @@ public:
 		this->center = other.getCenter();
 		this->axis = other.getAxis();
 		this->height = other.getHeight();
+		updateCache();
 	}
 
 	/**
@@ -135,6 +156,7 @@ public:
 		this->center = rhs.getCenter();
 		this->axis = rhs.getAxis();
 		this->height = rhs.getHeight();
+		updateCache();
 		return *this;
 	}
 
@@ -156,7 +178,7 @@ public:
 	 */
 	void setAxis(const mvector<vec_T, CDIM>& axis)
 	{
-		this->axis = axis.nom();
+		this->axis = axis.norm();
 	}
 
 	/**
@@ -195,6 +217,7 @@ public:
 	void setHeight(vec_T height) {
 		assert(height > 0);
 		this->height = height;
+		updateCache();
 	}
 
 	/**
@@ -214,11 +237,24 @@ public:
 	void setRadius(vec_T radius) {
 		assert(radius > 0);
 		this->radius = radius;
+		updateCache();
 	}
 
 	/**
 	 * Gets the earliest time at which at intersection happens between
 	 * the given ray and this cylinder. Returns @c RAY_MISS if there's no hit.
+	 * The cylinder is an open tube, so the ends aren't capped.
+	 *
+	 * With @f$ \mathbf{w} = \mathbf{p} - \mathbf{c} @f$ and the unit axis
+	 * @f$ \mathbf{a} @f$, the parts of @f$ \mathbf{w} @f$ and the direction
+	 * @f$ \mathbf{d} @f$ perpendicular to the axis give the quadratic
+	 * @f$ A t^2 + B t + C = 0 @f$ for the infinite cylinder, where
+	 * @f$ A = \mathbf{d} \cdot \mathbf{d} - (\mathbf{d} \cdot
+	 * \mathbf{a})^2 @f$, @f$ B / 2 = \mathbf{w} \cdot \mathbf{d} -
+	 * (\mathbf{w} \cdot \mathbf{a}) (\mathbf{d} \cdot \mathbf{a}) @f$ and
+	 * @f$ C = \mathbf{w} \cdot \mathbf{w} - (\mathbf{w} \cdot
+	 * \mathbf{a})^2 - r^2 @f$. A root counts if it's positive and its
+	 * point is within half the height of the center along the axis.
 	 *
 	 * @param r The ray.
 	 *
@@ -226,51 +262,72 @@ public:
 	 * cylinder.
 	 */
 	time_T intersection(const ray<vec_T, time_T, CDIM> &r) const {
-
-		mvector<vec_T, CDIM> cpar = center.proj(axis);
-		mvector<vec_T, CDIM> cperp = center - cpar;
-
-		mvector<vec_T, CDIM> P = r.getOrig();
-		mvector<vec_T, CDIM> D = r.getDir();
-
-		mvector<vec_T, CDIM> ppar = P.proj(axis);
-		mvector<vec_T, CDIM> pperp = P - ppar;
-
-		mvector<vec_T, CDIM> dpar = D.proj(axis);
-		mvector<vec_T, CDIM> dperp = D - dpar;
-
-		sphere<vec_T, color_T, time_T, CDIM> fakesphere(
-				this->getColor(),
-				radius,
-				cperp,
-				this->getReflectivity());
-
-		ray<vec_T, time_T, CDIM> ray(pperp, dperp, false);
-		time_T t1, t2;
-
-		// t1 and t2 will receive the first and second intersection points
-		// on the sphere
-		fakesphere.getIntersections(ray, t1, t2);
-
-		mvector<vec_T, CDIM> tmp, val1 = ppar + dpar * t1 - cpar;
-		mvector<vec_T, CDIM> val2 = ppar + dpar * t2 - cpar;
-		if(val1.magsq() > val2.magsq()) {
-			tmp = val1;
-			val1 = val2;
-			val2 = tmp;
+		const mvector<vec_T, CDIM> &P = r.getOrig();
+		const mvector<vec_T, CDIM> &D = r.getDir();
+		vec_T w[CDIM];
+		vec_T wa = 0, da = 0, ww = 0, wd = 0, dd = 0;
+		for (int i = 0; i < CDIM; i++) {
+			w[i] = P[i] - center[i];
+			wa += w[i] * axis[i];
+			da += D[i] * axis[i];
+			ww += w[i] * w[i];
+			wd += w[i] * D[i];
+			dd += D[i] * D[i];
 		}
-		// now val1 is the smallest
-		if(val1.magsq() >= height * height / 4 &&
-				val2.magsq() >= height * height / 4) {
+
+		// Rays parallel to the axis never cross the side.
+		vec_T A = dd - da * da;
+		if (A <= 0)
 			return RAY_MISS;
+		vec_T halfB = wd - wa * da;
+		vec_T C = ww - wa * wa - radiusSq;
+		vec_T disc = halfB * halfB - A * C;
+		if (disc < 0)
+			return RAY_MISS;
+
+		vec_T sq = sqrt(disc);
+		time_T t1 = (time_T) ((-halfB - sq) / A);
+		time_T t2 = (time_T) ((-halfB + sq) / A);
+		if (t1 > 0) {
+			vec_T s = wa + da * t1;
+			if (s * s < halfHeightSq)
+				return t1;
 		}
-		else {
-			return t1;
+		if (t2 > 0) {
+			vec_T s = wa + da * t2;
+			if (s * s < halfHeightSq)
+				return t2;
 		}
-
 		return RAY_MISS;
 	}
 
+	/**
+	 * Intersects a packet of rays with this cylinder; see
+	 * @c shape::intersections .
+	 */
+	void intersections(const ray<vec_T, time_T, CDIM> *rays, int count,
+			unsigned int mask, time_T *t) const {
+		for (int k = 0; k < count; k++)
+			if (mask >> k & 1)
+				t[k] = cylinder::intersection(rays[k]);
+	}
+
+	/**
+	 * Fills in a hit record. The normal is the hit point's offset from the
+	 * axis over the radius, found from the same dot products as in
+	 * @c intersection .
+	 *
+	 * @param r The ray.
+	 * @param[in,out] rec The record, whose @c t is the time of the hit.
+	 */
+	void completeHit(const ray<vec_T, time_T, CDIM> &r,
+			hitrecord<vec_T, color_T, time_T, CDIM> &rec) const {
+		rec.point = r.getPointAtT(rec.t);
+		mvector<vec_T, CDIM> w = rec.point - center;
+		rec.normal = (w - axis * (w * axis)) / radius;
+		rec.obj = this;
+	}
+
 	/**
 	 * Returns the surface normal to this cyulinder at the point @c surfacePt.
 	 *
@@ -285,6 +342,26 @@ public:
 		return vperp.norm();
 	}
 
+	/**
+	 * Gets the tightest axis-aligned box around this cylinder. Along axis
+	 * @f$ i @f$ the half extent is @f$ |a_i| \frac{h}{2} + r \sqrt{1 - a_i^2}
+	 * @f$ where @f$ \mathbf{a} @f$ is the unit long axis.
+	 *
+	 * @param[out] box Receives the bounding box.
+	 *
+	 * @return Always @c true since cylinders are bounded.
+	 */
+	bool getBounds(aabb<vec_T, CDIM> &box) const {
+		mvector<vec_T, CDIM> extent;
+		for (int i = 0; i < CDIM; i++) {
+			vec_T a = axis[i];
+			vec_T s = 1 - a * a;
+			extent[i] = fabs(a) * height / 2 + radius * sqrt(s > 0 ? s : 0);
+		}
+		box = aabb<vec_T, CDIM>(center - extent, center + extent);
+		return true;
+	}
+
 	/**
 	 * Partially overrides the @c shape @c printHelper. Calls the base classe's
 	 * @c printHelper then prints more info about this object, specifically
@@ -0,0 +1,336 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "gbuffer.hh"
+#include "rgbcolor.hh"
+#include "parallel.hh"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#ifndef DENOISER_HH
+#define DENOISER_HH
+
+/**
+ * Gets the luminance of a color, which the weights of the denoiser compare.
+ *
+ * @param c The color.
+ *
+ * @return Its luminance, from 0 to 1.
+ */
+template<typename color_T>
+inline color_T denoiseLuminance(const rgbcolor<color_T> &c) {
+	return (color_T) 0.2126 * c.getR() + (color_T) 0.7152 * c.getG() +
+			(color_T) 0.0722 * c.getB();
+}
+
+/**
+ * Checks whether two pixels show the same shape, the only ones the
+ * denoiser mixes.
+ *
+ * @param a The hit of one pixel.
+ * @param b The hit of the other.
+ *
+ * @return Whether both hit the same shape or both missed.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+inline bool denoiseSameShape(const hitrecord<vec_T, color_T, time_T, dim> &a,
+		const hitrecord<vec_T, color_T, time_T, dim> &b) {
+	return a.obj == b.obj && a.id == b.id;
+}
+
+/**
+ * Estimates the variance of the luminance of the rows of an image for
+ * @c denoiser::filter from the 5 by 5 pixels around each pixel that show
+ * the same shape.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+struct denoiseVarianceEstimator {
+	/** The guides: every pixel's hit. */
+	const gbuffer<vec_T, color_T, time_T, dim> *gb;
+	/** The luminance of every pixel. */
+	const std::vector<color_T> *lum;
+	/** Receives the variance of every pixel. */
+	std::vector<color_T> *var;
+
+	/*
+	 * Gets the difference between the luminance of a pixel and the mean of
+	 * that of its four neighbors on the same shape, or 0 without any.
+	 */
+	color_T residual(int x, int y, bool &found) const {
+		static const int dx[4] = { -1, 1, 0, 0 }, dy[4] = { 0, 0, -1, 1 };
+		int width = gb->getWidth(), height = gb->getHeight();
+		int p = y * width + x;
+		color_T sum = 0;
+		int n = 0;
+		for (int k = 0; k < 4; k++) {
+			int qx = x + dx[k], qy = y + dy[k];
+			if (qx < 0 || qx >= width || qy < 0 || qy >= height)
+				continue;
+			int q = qy * width + qx;
+			if (!denoiseSameShape(gb->getHit(p), gb->getHit(q)))
+				continue;
+			sum += (*lum)[q];
+			n++;
+		}
+		found = n > 0;
+		return found ? (*lum)[p] - sum / n : 0;
+	}
+
+	void operator()(int lo, int hi) const {
+		int width = gb->getWidth(), height = gb->getHeight();
+		for (int y = lo; y < hi; y++) {
+			for (int x = 0; x < width; x++) {
+				int p = y * width + x;
+				color_T sq = 0;
+				int n = 0;
+				for (int qy = std::max(0, y - 1);
+						qy <= std::min(height - 1, y + 1); qy++) {
+					for (int qx = std::max(0, x - 1);
+							qx <= std::min(width - 1, x + 1); qx++) {
+						if (!denoiseSameShape(gb->getHit(p),
+								gb->getHit(qy * width + qx)))
+							continue;
+						bool found;
+						color_T d = residual(qx, qy, found);
+						if (found) {
+							sq += d * d;
+							n++;
+						}
+					}
+				}
+				// The difference from the mean of four neighbors with
+				// independent noise has 5 / 4 of their variance.
+				(*var)[p] = n > 0 ? sq / n * (color_T) 0.8 : 0;
+			}
+		}
+	}
+};
+
+/**
+ * Filters the rows of one pass of @c denoiser::filter with a 5 by 5
+ * B3-spline kernel whose taps are @c step pixels apart, and works out the
+ * variance of the result.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+struct atrousRowFilter {
+	/** The guides: every pixel's hit. */
+	const gbuffer<vec_T, color_T, time_T, dim> *gb;
+	/** The colors before this pass. */
+	const std::vector<rgbcolor<color_T> > *in;
+	/** The variance of the luminance before this pass. */
+	const std::vector<color_T> *inVar;
+	/** Receives the colors after this pass. */
+	std::vector<rgbcolor<color_T> > *out;
+	/** Receives the variance of the luminance after this pass. */
+	std::vector<color_T> *outVar;
+	/** Distance between taps in pixels. */
+	int step;
+	/** Standard deviations of luminance difference that weigh 1 / e. */
+	color_T colorSigma;
+	/** Exponent of the cosine between normals. */
+	vec_T normalPower;
+	/** Sine of the angle off the tangent plane that weighs 1 / e. */
+	vec_T planeSigma;
+
+	void operator()(int lo, int hi) const {
+		static const color_T kernel[5] = { 1 / (color_T) 16,
+				1 / (color_T) 4, 3 / (color_T) 8, 1 / (color_T) 4,
+				1 / (color_T) 16 };
+		int width = gb->getWidth(), height = gb->getHeight();
+		for (int y = lo; y < hi; y++) {
+			for (int x = 0; x < width; x++) {
+				int p = y * width + x;
+				const hitrecord<vec_T, color_T, time_T, dim> &hp =
+						gb->getHit(p);
+				color_T lp = denoiseLuminance((*in)[p]);
+				color_T scale = colorSigma * std::sqrt((*inVar)[p]) +
+						(color_T) 1e-6;
+				color_T r = 0, g = 0, b = 0, sum = 0, var = 0;
+				for (int j = -2; j <= 2; j++) {
+					int qy = y + j * step;
+					if (qy < 0 || qy >= height)
+						continue;
+					for (int i = -2; i <= 2; i++) {
+						int qx = x + i * step;
+						if (qx < 0 || qx >= width)
+							continue;
+						int q = qy * width + qx;
+						const hitrecord<vec_T, color_T, time_T, dim> &hq =
+								gb->getHit(q);
+						// Nothing is mixed across the edges of shapes.
+						if (!denoiseSameShape(hp, hq))
+							continue;
+						const rgbcolor<color_T> &cq = (*in)[q];
+						color_T w = kernel[i + 2] * kernel[j + 2] *
+								std::exp(-std::abs(denoiseLuminance(cq) - lp) /
+								scale);
+						if (hp.obj != 0 && q != p) {
+							vec_T cosine = hp.normal * hq.normal;
+							if (cosine <= 0)
+								continue;
+							// How far the other point is off this one's
+							// tangent plane, as the sine of the angle to it.
+							mvector<vec_T, dim> d = hq.point - hp.point;
+							vec_T len = d.mag();
+							vec_T off = len > 0 ? std::abs(d * hp.normal) /
+									len : 0;
+							w *= (color_T) (std::pow(cosine, normalPower) *
+									std::exp(-off / planeSigma));
+						}
+						r += w * cq.getR();
+						g += w * cq.getG();
+						b += w * cq.getB();
+						sum += w;
+						var += w * w * (*inVar)[q];
+					}
+				}
+				// The average of colors can round past 1.
+				(*out)[p] = rgbcolor<color_T>(std::min((color_T) 1, r / sum),
+						std::min((color_T) 1, g / sum),
+						std::min((color_T) 1, b / sum));
+				(*outVar)[p] = var / (sum * sum);
+			}
+		}
+	}
+};
+
+/**
+ * Removes the noise of few samples per pixel, like that of sampled area
+ * lights, from a rendered image with an edge-avoiding à-trous wavelet
+ * filter (Dammertz et al., "Edge-Avoiding À-Trous Wavelet Transform for
+ * fast Global Illumination Filtering", 2010). Each pass blurs with a 5 by 5
+ * B3-spline kernel whose taps are twice as far apart as in the pass
+ * before, so a few passes cover a wide footprint with 25 taps per pixel
+ * each. The G-buffer of the image guides the weights: pixels of other
+ * shapes get none, and those of the same shape less the more their normals
+ * differ and the farther their points are off each other's tangent planes,
+ * so edges, creases and steps in depth stay sharp. As in spatiotemporal
+ * variance-guided filtering (Schied et al., 2017), the weight on luminance
+ * differences is scaled by the standard deviation of the luminance around
+ * each pixel, estimated from its neighbors on the same shape and carried
+ * through the passes, so noisy pixels are smoothed and clean ones, like
+ * smooth shading and reflections, are left alone. Rows are shared out among
+ * threads. Note that there are some convenient typedefs in this file.
+ *
+ * @tparam vec_T The type of the vector components. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double,
+ *   float, or int.
+ * @tparam time_T The type of the time. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double or
+ *   float, but int would likely work.
+ * @tparam color_T The type of the @c rgbcolor. Many arithmetic
+ *   and relational operators must be supported, including real number ones.
+ *   The type will likely be double or float.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class denoiser {
+private:
+
+	/**
+	 * Number of passes; the last one's taps are @c 2^(passes-1) pixels
+	 * apart.
+	 */
+	int passes;
+
+	/**
+	 * Luminance difference, in standard deviations of the luminance around
+	 * a pixel, that weighs 1 / e.
+	 */
+	color_T sigmaColor;
+
+	/**
+	 * Exponent of the cosine between the normals of two pixels.
+	 */
+	vec_T sigmaNormal;
+
+	/**
+	 * Sine of the angle between the tangent plane at the point of a pixel
+	 * and the way to the point of another that weighs 1 / e.
+	 */
+	vec_T sigmaPlane;
+
+public:
+
+	/**
+	 * Constructs a denoiser.
+	 *
+	 * @param passes Number of passes, 0 to leave images alone.
+	 * @param sigmaColor Luminance difference, in standard deviations of the
+	 *   luminance around a pixel, that weighs 1 / e; larger removes more
+	 *   noise and more detail.
+	 * @param sigmaNormal Exponent of the cosine between normals; larger
+	 *   keeps creases sharper.
+	 * @param sigmaPlane Sine of the angle off the tangent plane at a
+	 *   pixel's point at which another pixel's point weighs 1 / e; smaller
+	 *   keeps surfaces at different depths apart better.
+	 */
+	denoiser(int passes = 5, color_T sigmaColor = 4,
+			vec_T sigmaNormal = 128, vec_T sigmaPlane = 0.1) :
+				passes(passes), sigmaColor(sigmaColor),
+				sigmaNormal(sigmaNormal), sigmaPlane(sigmaPlane) {
+		assert(passes >= 0 && sigmaColor > 0);
+		assert(sigmaNormal >= 0 && sigmaPlane > 0);
+	}
+
+	/**
+	 * Getter for the number of passes.
+	 *
+	 * @return Pass count.
+	 */
+	int getPasses() const {
+		return passes;
+	}
+
+	/**
+	 * Filters an image.
+	 *
+	 * @param gb The G-buffer of the image, whose hits guide the filter.
+	 * @param[in,out] image The image, row by row, the size of @c gb .
+	 * @param numThreads Number of threads to filter on.
+	 */
+	void filter(const gbuffer<vec_T, color_T, time_T, dim> &gb,
+			std::vector<rgbcolor<color_T> > &image,
+			int numThreads = 1) const {
+		assert(image.size() == (size_t) gb.getWidth() * gb.getHeight());
+		if (passes == 0 || image.empty())
+			return;
+		numThreads = std::max(1, numThreads);
+		std::vector<color_T> lum(image.size()), var(image.size()),
+				otherVar(image.size());
+		for (size_t i = 0; i < image.size(); i++)
+			lum[i] = denoiseLuminance(image[i]);
+		denoiseVarianceEstimator<vec_T, color_T, time_T, dim> estimator;
+		estimator.gb = &gb;
+		estimator.lum = &lum;
+		estimator.var = &var;
+		parallelFor(0, gb.getHeight(), numThreads, estimator);
+
+		std::vector<rgbcolor<color_T> > other(image.size());
+		atrousRowFilter<vec_T, color_T, time_T, dim> f;
+		f.gb = &gb;
+		f.colorSigma = sigmaColor;
+		f.normalPower = sigmaNormal;
+		f.planeSigma = sigmaPlane;
+		for (int i = 0; i < passes; i++) {
+			f.in = i % 2 == 0 ? &image : &other;
+			f.inVar = i % 2 == 0 ? &var : &otherVar;
+			f.out = i % 2 == 0 ? &other : &image;
+			f.outVar = i % 2 == 0 ? &otherVar : &var;
+			f.step = 1 << i;
+			parallelFor(0, gb.getHeight(), numThreads, f);
+		}
+		if (passes % 2 == 1)
+			image.swap(other);
+	}
+};
+
+typedef denoiser<double, double, double, 3> denoiser3d;
+typedef denoiser<double, double, float, 3> denoiser3ddf;
+typedef denoiser<float, float, float, 3> denoiser3f;
+
+#endif // DENOISER_HH
@@ -0,0 +1,376 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "aabb.hh"
+#include "camera.hh"
+#include "mvector.hh"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#ifndef DIRTYREGION_HH
+#define DIRTYREGION_HH
+
+/**
+ * Number of boxes past which @c scene::findDirtyTiles gives up on bounding
+ * an edit and re-renders everything.
+ */
+#define DIRTY_MAX_BOXES 4096
+
+/**
+ * Pixels of margin around the projection of a box, for the half pixel the
+ * samples of a pixel reach out and rounding.
+ */
+#define DIRTY_MARGIN 2
+
+/**
+ * Gets a corner of a box.
+ *
+ * @tparam dim The number of dimensions.
+ *
+ * @param box The box.
+ * @param i Index of the corner, whose bit @c a picks the high side along
+ *   axis @c a .
+ *
+ * @return The corner.
+ */
+template<int dim>
+mvector<double, dim> boxCorner(const aabb<double, dim> &box, int i) {
+	mvector<double, dim> c;
+	for (int a = 0; a < dim; a++)
+		c[a] = (i >> a) & 1 ? box.getMax()[a] : box.getMin()[a];
+	return c;
+}
+
+/**
+ * Copies a box into doubles and grows it by a little more than the
+ * rounding error of its coordinates, so whatever touches the box in
+ * @c vec_T touches the copy.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam dim The number of dimensions.
+ *
+ * @param box The box, which mustn't be empty.
+ *
+ * @return The grown copy.
+ */
+template<typename vec_T, int dim>
+aabb<double, dim> paddedBox(const aabb<vec_T, dim> &box) {
+	double eps = 16 * (double) std::numeric_limits<vec_T>::epsilon();
+	mvector<double, dim> lo, hi;
+	for (int a = 0; a < dim; a++) {
+		double l = (double) box.getMin()[a], h = (double) box.getMax()[a];
+		double pad = eps * (1 + std::max(std::abs(l), std::abs(h)));
+		lo[a] = l - pad;
+		hi[a] = h + pad;
+	}
+	return aabb<double, dim>(lo, hi);
+}
+
+/**
+ * Bounds the box @f$(1 - \lambda) L + \lambda q@f$ sweeps for points
+ * @c L of a light's box, @c q of another box and @f$\lambda@f$ from 1 to
+ * @c scale : the part of the other box's shadow up to @c scale times as
+ * far from the light as the box. The map is linear in each of its
+ * arguments, so its corners bound it.
+ *
+ * @tparam dim The number of dimensions.
+ *
+ * @param lightBox Box around the light.
+ * @param box The box that casts the shadow.
+ * @param scale Largest @f$\lambda@f$, at least 1.
+ *
+ * @return The bounds.
+ */
+template<int dim>
+aabb<double, dim> sweepShadow(const aabb<double, dim> &lightBox,
+		const aabb<double, dim> &box, double scale) {
+	aabb<double, dim> out = box;
+	for (int i = 0; i < 1 << dim; i++) {
+		mvector<double, dim> l = boxCorner(lightBox, i);
+		for (int j = 0; j < 1 << dim; j++) {
+			mvector<double, dim> q = boxCorner(box, j);
+			out.extend(l + (q - l) * scale);
+		}
+	}
+	return out;
+}
+
+/**
+ * Bounds the points of a world box that a box may shade from a light:
+ * those whose segment to some point of the light passes through the box.
+ * A shadow point at most @c maxdist from the light is at most that many
+ * times the closest distance from the light to the box farther from the
+ * light than its point in the box, which bounds the sweep.
+ *
+ * @tparam dim The number of dimensions.
+ *
+ * @param lightBox Box around the light, degenerate for a point light.
+ * @param box The box that casts the shadow.
+ * @param world Box around everything the shadow can fall on.
+ * @param[out] out Receives the bounds.
+ *
+ * @return @c false if the light touches the box, so the shadow can't be
+ *   bounded.
+ */
+template<int dim>
+bool boundShadow(const aabb<double, dim> &lightBox,
+		const aabb<double, dim> &box, const aabb<double, dim> &world,
+		aabb<double, dim> &out) {
+	double nearSq = 0, farSq = 0;
+	for (int a = 0; a < dim; a++) {
+		double gap = std::max(0.0, std::max(box.getMin()[a] -
+				lightBox.getMax()[a], lightBox.getMin()[a] - box.getMax()[a]));
+		nearSq += gap * gap;
+		double reach = std::max(std::abs(world.getMax()[a] -
+				lightBox.getMin()[a]), std::abs(lightBox.getMax()[a] -
+				world.getMin()[a]));
+		farSq += reach * reach;
+	}
+	if (!(nearSq > 0))
+		return false;
+	aabb<double, dim> swept = sweepShadow(lightBox, box,
+			std::max(1.0, std::sqrt(farSq / nearSq)));
+	mvector<double, dim> lo, hi;
+	for (int a = 0; a < dim; a++) {
+		lo[a] = std::max(swept.getMin()[a], world.getMin()[a]);
+		hi[a] = std::min(swept.getMax()[a], world.getMax()[a]);
+		if (lo[a] > hi[a])
+			hi[a] = lo[a];
+	}
+	out = box;
+	out.extend(aabb<double, dim>(lo, hi));
+	return true;
+}
+
+/**
+ * Bounds the shadow a box may cast from a light on the infinite plane of
+ * points @c x with @f$n \cdot x + d = 0@f$. A point of the plane whose
+ * segment to the light passes through a point of the box is
+ * @f$\lambda = s_L / (s_L - s_q)@f$ times as far from the light, where
+ * @c s are the signed distances to the plane, which bounds the sweep.
+ *
+ * @tparam dim The number of dimensions.
+ *
+ * @param lightBox Box around the light.
+ * @param box The box that casts the shadow.
+ * @param normal Unit normal of the plane.
+ * @param d Offset of the plane.
+ * @param[out] out Receives the bounds, or an empty box if the box can't
+ *   shade the plane.
+ *
+ * @return @c false if the shadow is unbounded: the light touches the
+ *   plane or the box reaches as far from the plane as the light.
+ */
+template<int dim>
+bool boundPlaneShadow(const aabb<double, dim> &lightBox,
+		const aabb<double, dim> &box, const mvector<double, dim> &normal,
+		double d, aabb<double, dim> &out) {
+	double lightMin = std::numeric_limits<double>::max(), lightMax = -lightMin;
+	for (int i = 0; i < 1 << dim; i++) {
+		double s = boxCorner(lightBox, i) * normal + d;
+		lightMin = std::min(lightMin, s);
+		lightMax = std::max(lightMax, s);
+	}
+	out = aabb<double, dim>();
+	if (lightMin <= 0 && lightMax >= 0)
+		return false;
+	double side = lightMin > 0 ? 1 : -1, lightNear = side > 0 ? lightMin :
+			-lightMax, boxFar = -std::numeric_limits<double>::max();
+	for (int i = 0; i < 1 << dim; i++)
+		boxFar = std::max(boxFar, side * (boxCorner(box, i) * normal + d));
+	if (boxFar <= 0)
+		return true;
+	if (boxFar >= lightNear)
+		return false;
+	out = sweepShadow(lightBox, box, lightNear / (lightNear - boxFar));
+	return true;
+}
+
+/**
+ * Bounds the mirror image of a box in the plane of points @c x with
+ * @f$n \cdot x + d = 0@f$: where the camera sees what's in the box
+ * reflected by the plane.
+ *
+ * @tparam dim The number of dimensions.
+ *
+ * @param box The box.
+ * @param normal Unit normal of the plane.
+ * @param d Offset of the plane.
+ *
+ * @return The bounds of the image.
+ */
+template<int dim>
+aabb<double, dim> mirrorBox(const aabb<double, dim> &box,
+		const mvector<double, dim> &normal, double d) {
+	aabb<double, dim> out;
+	for (int i = 0; i < 1 << dim; i++) {
+		mvector<double, dim> c = boxCorner(box, i);
+		out.extend(c - normal * (2 * (c * normal + d)));
+	}
+	return out;
+}
+
+/**
+ * The square tiles of an image that need to be rendered again, marked by
+ * the screen rectangles of boxes. Tiles are numbered row by row, as
+ * @c scene::renderTiles takes them.
+ */
+class dirtytiles {
+private:
+
+	/**
+	 * Width of the image in pixels.
+	 */
+	int width;
+
+	/**
+	 * Height of the image in pixels.
+	 */
+	int height;
+
+	/**
+	 * Side of a tile in pixels.
+	 */
+	int tileSize;
+
+	/**
+	 * Number of tiles across the image.
+	 */
+	int tilesPerRow;
+
+	/**
+	 * One flag per tile.
+	 */
+	std::vector<char> marked;
+
+public:
+
+	/**
+	 * Makes a grid of unmarked tiles over an image.
+	 *
+	 * @param width Width of the image in pixels.
+	 * @param height Height of the image in pixels.
+	 * @param tileSize Side of a tile in pixels.
+	 */
+	dirtytiles(int width, int height, int tileSize) : width(width),
+			height(height), tileSize(tileSize),
+			tilesPerRow((width + tileSize - 1) / tileSize),
+			marked((size_t) tilesPerRow *
+				((height + tileSize - 1) / tileSize), 0) {
+		assert(tileSize > 0);
+	}
+
+	/**
+	 * Marks every tile.
+	 */
+	void markAll() {
+		std::fill(marked.begin(), marked.end(), 1);
+	}
+
+	/**
+	 * Marks the tiles of the pixels from @c (x0, y0) to @c (x1, y1) ,
+	 * inclusive, clipped to the image.
+	 *
+	 * @param x0 Left column.
+	 * @param y0 Top row.
+	 * @param x1 Right column.
+	 * @param y1 Bottom row.
+	 */
+	void markPixels(int x0, int y0, int x1, int y1) {
+		x0 = std::max(x0, 0);
+		y0 = std::max(y0, 0);
+		x1 = std::min(x1, width - 1);
+		y1 = std::min(y1, height - 1);
+		for (int ty = y0 / tileSize; y0 <= y1 && ty <= y1 / tileSize; ty++)
+			for (int tx = x0 / tileSize; x0 <= x1 && tx <= x1 / tileSize;
+					tx++)
+				marked[ty * tilesPerRow + tx] = 1;
+	}
+
+	/**
+	 * Marks the tiles the camera may see a box in, with a margin of
+	 * @c margin pixels, or all of them if some of the box isn't in front
+	 * of the camera.
+	 *
+	 * @tparam vec_T The type of the vector components.
+	 * @tparam time_T The type of the time.
+	 * @tparam dim The number of dimensions.
+	 *
+	 * @param cam The camera.
+	 * @param box The box.
+	 * @param margin Pixels to add on every side.
+	 */
+	template<typename vec_T, typename time_T, int dim>
+	void markBox(const camera<vec_T, time_T, dim> &cam,
+			const aabb<double, dim> &box, int margin) {
+		if (box.isEmpty())
+			return;
+		double x0 = std::numeric_limits<double>::max(), y0 = x0;
+		double x1 = -x0, y1 = -x0;
+		for (int i = 0; i < 1 << dim; i++) {
+			double x, y;
+			if (!cam.projectPoint(boxCorner(box, i), width, height, x, y)) {
+				markAll();
+				return;
+			}
+			x0 = std::min(x0, x);
+			y0 = std::min(y0, y);
+			x1 = std::max(x1, x);
+			y1 = std::max(y1, y);
+		}
+		// Tiles off the screen are skipped without overflowing an int.
+		double limit = 2.0 * (width + height + margin);
+		if (x1 < -limit || y1 < -limit || x0 > limit || y0 > limit)
+			return;
+		markPixels((int) std::floor(std::max(x0, -limit)) - margin,
+				(int) std::floor(std::max(y0, -limit)) - margin,
+				(int) std::ceil(std::min(x1, limit)) + margin,
+				(int) std::ceil(std::min(y1, limit)) + margin);
+	}
+
+	/**
+	 * Tells if every tile is marked.
+	 *
+	 * @return @c true if no tile is unmarked.
+	 */
+	bool isAll() const {
+		return std::find(marked.begin(), marked.end(), 0) == marked.end();
+	}
+
+	/**
+	 * Gets the marked tiles.
+	 *
+	 * @param[out] tiles Receives their numbers in order.
+	 */
+	void getTiles(std::vector<int> &tiles) const {
+		tiles.clear();
+		for (size_t i = 0; i < marked.size(); i++)
+			if (marked[i])
+				tiles.push_back((int) i);
+	}
+
+	/**
+	 * Gets the number of tiles across the image.
+	 *
+	 * @return The number of columns of tiles.
+	 */
+	int getTilesPerRow() const {
+		return tilesPerRow;
+	}
+
+	/**
+	 * Gets the number of tiles.
+	 *
+	 * @return Marked or not.
+	 */
+	int getTileCount() const {
+		return (int) marked.size();
+	}
+};
+
+#endif // DIRTYREGION_HH
@@ -14,180 +14,1000 @@
 #include "shape.hh"
 #include "mvector.hh"
 #include "spotlight.hh"
+#include "bvh.hh"
+#include "grid.hh"
+#include "lazybvh.hh"
+#include "qbvh.hh"
+#include "accelfactory.hh"
+#include "rendercontext.hh"
+#include "simd.hh"
+#include "arena.hh"
+#include "framebuffer.hh"
+#include "previewstream.hh"
+#include "memoryreport.hh"
+#include "autotune.hh"
+#include "mappedfile.hh"
+#include "sceneparser.hh"
+#include "scenefile.hh"
+#include "lazygeometry.hh"
+#include "outofcore.hh"
+#include "rendercommand.hh"
+#include "viewcommand.hh"
+#include "scenediff.hh"
+#include "animation.hh"
+#include "netchannel.hh"
+#include "tilelease.hh"
+#include "framecache.hh"
+#include "costmap.hh"
+#include "shapeprofile.hh"
+#include "benchscenes.hh"
+#include "phasetimes.hh"
+#include "timebudget.hh"
+#include "checkpoint.hh"
+#include "rasterimage.hh"
+#include "writequeue.hh"
+#include "resample.hh"
+#include "aov.hh"
+#include "hugepages.hh"
+#include "processpool.hh"
+#include "metrics.hh"
+#include "renderscheduler.hh"
+#include "boost/scoped_ptr.hpp"
 #include "boost/shared_ptr.hpp"
+#include "boost/make_shared.hpp"
+#include "boost/thread.hpp"
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include <deque>
+#include <iomanip>
 #include <iostream>
+#include <fstream>
+#include <map>
 #include <string>
 #include <sstream>
-#include <map>
+#include <vector>
+#include <signal.h>
+#include <sys/stat.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 using namespace std;
 
 /**
- * A function pointer for @c sceneobj input handlers. Functions with this
- * signature will take input streams and construct @c sceneobj objects
- * from them. Note that lights and shapes, including spheres and planes, are
- * @c sceneobj derived classes but camera is not.
+ * The scalar types of a render, picked with the @c --precision option.
+ */
+enum precision {
+	/** Double vectors, colors and times, i.e. @c scene3d . */
+	PRECISION_DOUBLE,
+	/** Float vectors, colors and times, i.e. @c scene3f . */
+	PRECISION_FLOAT,
+	/** Double vectors and colors with float times, i.e. @c scene3ddf . */
+	PRECISION_FLOAT_TIME
+};
+
+/**
+ * The kinds of image file the driver writes, picked with @c --format or by
+ * the extension of the @c -o file.
+ */
+enum imageFormat {
+	/** PPM, plain or raw as @c renderoptions::format says. */
+	IMAGE_PPM,
+	/** 8 bit PNG. */
+	IMAGE_PNG,
+	/** PFM, 32 bit floats that keep the unclamped colors. */
+	IMAGE_PFM,
+	/** OpenEXR with half floats that keep the unclamped colors. */
+	IMAGE_EXR
+};
+
+/**
+ * Everything the command line sets besides the image size and the
+ * instruction set, which is set process-wide as soon as it's parsed.
+ */
+struct renderoptions {
+	bool shadowsOn;
+	string accelType;
+	bvhBuilder builder;
+	bool shadowCache;
+	bool rasterPrimary;
+	bool tileFrustums;
+	bool printStats;
+	bool wavefront;
+	bool sortRays;
+	bool shadowPackets;
+	int maxReflect;
+	double minThroughput;
+	double lightCutoff;
+	int rouletteDepth;
+	double clusterRatio;
+	double cutError;
+	int lightPicks;
+	int areaSamples;
+	int adaptiveShadows;
+	bool pixelVisibility;
+	int shadowMapRes;
+	double shadowMapBias;
+	int threads;
+	bool pinThreads;
+	bool progressive;
+	bool stream;
+	bool mapOutput;
+	pixelStorage storage;
+	int stripRows;
+	int aaSamples;
+	double aaThreshold;
+	int pixelSamples;
+	int denoisePasses;
+	samplerKind sampler;
+	ppmFormat format;
+	imageFormat image;
+	double exposure;
+	string outFile;
+	string sceneFile;
+	string cameraName;
+	bool allCameras;
+	int writeQueue;
+	int procs;
+	vector<pair<int, int> > thumbnails;
+	resampleFilter thumbnailFilter;
+	vector<aovKind> aovs;
+	int firstFrame;
+	int lastFrame;
+	bool crop;
+	int cropX0;
+	int cropY0;
+	int cropX1;
+	int cropY1;
+	int farmPort;
+	int previewPort;
+	int metricsPort;
+	double leaseTimeout;
+	int leaseSize;
+	string frameCache;
+	bool reuseTiles;
+	int reproject;
+	string bvhCache;
+	int chunkSize;
+	double outOfCore;
+	bool compactSpheres;
+	bool pipelinedLoad;
+	bool memReport;
+	bool hugePages;
+	bool autoTune;
+	double timeBudget;
+	bool view;
+	bool watch;
+	string checkpointFile;
+	double checkpointInterval;
+	bool resume;
+	string heatmapFile;
+	costMeasure heatmapCost;
+	string statsJson;
+	string traceFile;
+	bool perfCounters;
+	int profileTop;
+	string profileJson;
+	string checkDir;
+	double checkTolerance;
+	double maxSlowdown;
+	bool updateGolden;
+	bool updateBaseline;
+};
+
+/**
+ * Gets the size of the images the options write: that of the @c --crop
+ * window if there is one, else the whole image.
+ *
+ * @param opts The command line options.
+ * @param width The width of the whole image in pixels.
+ * @param height The height of the whole image in pixels.
+ * @param[out] outWidth Receives the width of the written images.
+ * @param[out] outHeight Receives the height of the written images.
+ */
+void outputSize(const renderoptions &opts, int width, int height,
+		int &outWidth, int &outHeight) {
+	outWidth = opts.crop ? opts.cropX1 - opts.cropX0 : width;
+	outHeight = opts.crop ? opts.cropY1 - opts.cropY0 : height;
+}
+
+/**
+ * Picks the kind of image file to write by the extension of its name.
+ *
+ * @param file The file name.
+ * @param otherwise The kind for other extensions.
+ *
+ * @return PNG, PFM or OpenEXR for names ending in .png, .pfm or .exr, in
+ *   either case, else @c otherwise .
+ */
+imageFormat imageFormatOf(const string &file, imageFormat otherwise) {
+	string ext = file.size() >= 4 ? file.substr(file.size() - 4) : "";
+	if (ext == ".png" || ext == ".PNG")
+		return IMAGE_PNG;
+	if (ext == ".pfm" || ext == ".PFM")
+		return IMAGE_PFM;
+	if (ext == ".exr" || ext == ".EXR")
+		return IMAGE_EXR;
+	return otherwise;
+}
+
+/**
+ * Writes an image in the format the options pick. The 8 bit formats are
+ * quantized with the exposure of the options; the float ones keep the
+ * colors as they are.
+ *
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam scene_T The scene type, for its @c writePPM and @c writePNG .
+ *
+ * @param opts The command line options.
+ * @param image The colors of the pixels, row by row.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param os The output stream.
+ */
+template<typename color_T, typename scene_T>
+void writeImage(const renderoptions &opts,
+		const vector<rgbcolor<color_T> > &image, int width, int height,
+		ostream &os) {
+	color_T exposure = (color_T) opts.exposure;
+	switch (opts.image) {
+	case IMAGE_PNG:
+		scene_T::writePNG(image, width, height, os, opts.threads, exposure);
+		break;
+	case IMAGE_PFM:
+		framebuffer<color_T>::writePFM(image, width, height, os);
+		break;
+	case IMAGE_EXR:
+		framebuffer<color_T>::writeEXR(image, width, height, os);
+		break;
+	default:
+		scene_T::writePPM(image, width, height, os, opts.format, exposure);
+		break;
+	}
+}
+
+/**
+ * Gets the name of a file written next to an image file, such as a
+ * @c --thumbnail : that of the image file with a label before its
+ * extension, as in image.64x40.png or image.depth.png .
+ *
+ * @param file The name of the image file.
+ * @param label The label.
+ *
+ * @return The name of the other file.
+ */
+string sideFileName(const string &file, const string &label) {
+	size_t slash = file.find_last_of('/');
+	size_t dot = file.find_last_of('.');
+	if (dot == string::npos || (slash != string::npos && dot < slash))
+		return file + "." + label;
+	return file.substr(0, dot) + "." + label + file.substr(dot);
+}
+
+/**
+ * Writes the @c --thumbnail and @c --mip-levels images of an image, each
+ * resampled from the whole image and written next to its file in the same
+ * format.
+ *
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam scene_T The scene type, for @c writeImage .
+ *
+ * @param opts The command line options.
+ * @param image The colors of the pixels, row by row.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param file The name of the image's file.
+ *
+ * @return @c false if a thumbnail couldn't be written.
+ */
+template<typename color_T, typename scene_T>
+bool writeThumbnails(const renderoptions &opts,
+		const vector<rgbcolor<color_T> > &image, int width, int height,
+		const string &file) {
+	resampler<color_T> filter(opts.thumbnailFilter);
+	vector<rgbcolor<color_T> > thumbnail;
+	bool ok = true;
+	for (size_t i = 0; i < opts.thumbnails.size(); i++) {
+		int w = opts.thumbnails[i].first, h = opts.thumbnails[i].second;
+		filter.resample(image, width, height, thumbnail, w, h,
+				opts.threads);
+		ostringstream size;
+		size << w << "x" << h;
+		string name = sideFileName(file, size.str());
+		ofstream out(name.c_str(), ios::out | ios::binary);
+		if (out)
+			writeImage<color_T, scene_T>(opts, thumbnail, w, h, out);
+		out.close();
+		if (out.fail()) {
+			cerr << "ERROR: can't write \"" << name << "\"." << endl;
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+/**
+ * Gets the name of an arbitrary output variable, as @c --aov takes it and
+ * as its files are labeled.
+ *
+ * @param kind The variable.
+ *
+ * @return Its name.
+ */
+const char *aovName(aovKind kind) {
+	switch (kind) {
+	case AOV_DEPTH:
+		return "depth";
+	case AOV_NORMAL:
+		return "normal";
+	default:
+		return "id";
+	}
+}
+
+/**
+ * Writes the @c --aov images of a render, each next to the image's file in
+ * the same format but without the exposure.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ *
+ * @param opts The command line options.
+ * @param gb The G-buffer of the render.
+ * @param file The name of the image's file.
+ *
+ * @return @c false if an image couldn't be written.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+bool writeAOVs(const renderoptions &opts,
+		const gbuffer<vec_T, color_T, time_T, 3> &gb, const string &file) {
+	renderoptions plain = opts;
+	plain.exposure = 1;
+	bool displayable = opts.image != IMAGE_PFM && opts.image != IMAGE_EXR;
+	vector<rgbcolor<color_T> > image;
+	bool ok = true;
+	for (size_t i = 0; i < opts.aovs.size(); i++) {
+		makeAOV(gb, opts.aovs[i], displayable, image);
+		string name = sideFileName(file, aovName(opts.aovs[i]));
+		ofstream out(name.c_str(), ios::out | ios::binary);
+		if (out)
+			writeImage<color_T, scene<vec_T, color_T, time_T, 3> >(plain,
+					image, gb.getWidth(), gb.getHeight(), out);
+		out.close();
+		if (out.fail()) {
+			cerr << "ERROR: can't write \"" << name << "\"." << endl;
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+/**
+ * Writes the thumbnails and arbitrary output variables of a single render
+ * on the thread of a @c writequeue , while the image itself is encoded and
+ * written.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+struct sideImageWriter {
+	/** The command line options. */
+	const renderoptions *opts;
+	/** The colors of the pixels, which mustn't change until it's done. */
+	const vector<rgbcolor<color_T> > *image;
+	/** The width of the image in pixels. */
+	int width;
+	/** The height of the image in pixels. */
+	int height;
+	/** The G-buffer of the render, if there are @c --aov images. */
+	const gbuffer<vec_T, color_T, time_T, 3> *guides;
+	/** The name of the image's file. */
+	string file;
+
+	bool operator()() const {
+		bool ok = writeThumbnails<color_T, scene<vec_T, color_T, time_T,
+				3> >(*opts, *image, width, height, file);
+		if (guides && !writeAOVs(*opts, *guides, file))
+			ok = false;
+		return ok;
+	}
+};
+
+/**
+ * Sink for @c scene::renderProgressive that writes every pass as an image of
+ * its own: one after the other to @c cout , or over the last one in the
+ * output file, so a viewer watching it sees the image refine.
+ *
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam scene_T The scene type, for @c writeImage .
+ */
+template<typename color_T, typename scene_T>
+struct passWriter {
+	/** The command line options. */
+	const renderoptions *opts;
+	/** Where to push the passes as well, or 0. */
+	previewstream<color_T> *preview;
+
+	void operator()(const vector<rgbcolor<color_T> > &image, int width,
+			int height, int block) const {
+		if (preview)
+			preview->sendPass(image, block);
+		if (opts->outFile.empty()) {
+			writeImage<color_T, scene_T>(*opts, image, width, height, cout);
+			return;
+		}
+		ofstream file(opts->outFile.c_str(), ios::out | ios::binary);
+		writeImage<color_T, scene_T>(*opts, image, width, height, file);
+	}
+};
+
+/**
+ * Writer for @c scene::renderStreaming that writes every band as PPM
+ * pixels, after the header, and flushes them right away so whatever reads
+ * the image sees the rows as they're done.
+ *
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam scene_T The scene type, for its @c writePPMPixels .
+ */
+template<typename color_T, typename scene_T>
+struct bandWriter {
+	/** The command line options. */
+	const renderoptions *opts;
+	/** The output stream. */
+	ostream *os;
+	/** Where to push the bands as well, or 0. */
+	previewstream<color_T> *preview;
+
+	void operator()(const tilebuffer<color_T> &band) const {
+		scene_T::writePPMPixels(band.pixels, *os, opts->format,
+				(color_T) opts->exposure);
+		os->flush();
+		if (preview)
+			preview->sendTile(band);
+	}
+};
+
+/**
+ * Waits for the WebSocket client of @c --preview , such as a browser
+ * preview, to connect and opens the WebSocket.
+ *
+ * @param port The port to listen on.
+ * @param[out] channel Receives the connection.
+ *
+ * @return @c false if the port can't be listened on or the client didn't
+ *   open a WebSocket.
+ */
+bool openPreview(int port, netchannel &channel) {
+	netlistener listener;
+	if (!listener.listen(port)) {
+		cerr << "ERROR: can't listen on port " << port << "." << endl;
+		return false;
+	}
+	cerr << "preview: waiting for a WebSocket client on port " <<
+			listener.getPort() << endl;
+	while (!listener.accept(channel, 1000))
+		;
+	string error;
+	if (!acceptWebSocket(channel, error)) {
+		cerr << "ERROR: preview: " << error << "." << endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Writer for @c scene::renderStrips that writes every strip as PPM pixels
+ * or OpenEXR rows, after the header, and flushes them right away.
+ *
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam scene_T The scene type, for its @c writePPMPixels .
+ */
+template<typename color_T, typename scene_T>
+struct stripWriter {
+	/** The command line options. */
+	const renderoptions *opts;
+	/** The output stream. */
+	ostream *os;
+	/** Where to push the strips as well, or 0. */
+	previewstream<color_T> *preview;
+
+	void operator()(const tilebuffer<color_T> &strip) const {
+		if (preview)
+			preview->sendTile(strip);
+		if (opts->image != IMAGE_EXR) {
+			scene_T::writePPMPixels(strip.pixels, *os, opts->format,
+					(color_T) opts->exposure);
+			os->flush();
+			return;
+		}
+		const color_T *c = reinterpret_cast<const color_T *>(
+				&strip.pixels[0]);
+		vector<unsigned short> halves((size_t) strip.width * 3);
+		string row;
+		for (int y = 0; y < strip.height; y++) {
+			for (size_t i = 0; i < halves.size(); i++)
+				halves[i] = floatToHalf((float) *c++);
+			row.clear();
+			framebuffer<color_T>::appendEXRRow(row, strip.y0 + y,
+					&halves[0], strip.width);
+			os->write(row.data(), row.size());
+		}
+		os->flush();
+	}
+};
+
+/**
+ * Sink for @c scene::renderBands that writes every band right into its
+ * place in a mapped P6 or PFM file, on the thread that rendered it.
+ *
+ * @tparam color_T The type of the @c rgbcolor.
  */
-typedef sp_shape3d (*sceneObjInputFunction)(istream&);
+template<typename color_T>
+struct mappedWriter {
+	/** The first byte after the header of the file. */
+	char *pixels;
+	/** The width of the image in pixels. */
+	int width;
+	/** The height of the image in pixels. */
+	int height;
+	/** Whether the file is PFM rather than P6. */
+	bool pfm;
+	/** What to multiply the colors by before quantizing for P6. */
+	color_T exposure;
+
+	void operator()(const tilebuffer<color_T> &band) const {
+		if (!pfm) {
+			framebuffer<color_T>::quantize(&band.pixels[0],
+					band.pixels.size(), reinterpret_cast<unsigned char *>(
+					pixels) + (size_t) band.y0 * width * 3, exposure);
+			return;
+		}
+		// PFM rows go from the bottom up, and the header leaves them
+		// unaligned.
+		vector<float> row((size_t) width * 3);
+		for (int y = 0; y < band.height; y++) {
+			framebuffer<color_T>::toPFMRow(&band.pixels[(size_t) y * width],
+					width, &row[0]);
+			memcpy(pixels + (size_t) (height - 1 - band.y0 - y) * width * 12,
+					&row[0], row.size() * sizeof(float));
+		}
+	}
+};
 
 /**
- * Reads sphere data from the given input stream then outputs a Boost shared
- * pointer to a sphere constructed from that data. Format must be
- * @code color radius center reflectivity @endcode
- * where @c color is in the format (r, g, b), @c radius is just a double,
- * @c center is in the format <x, y, z>, and @c reflectivity is just a float
- * between 0 and 1, inclusive. All fields are required.
+ * Renders a scene straight into the mapped output file of the options, a
+ * P6 or PFM image, with @c scene::renderBands .
  *
- * @param is The input stream from which to read.
+ * @param opts The command line options.
+ * @param sc The scene.
+ * @param cam The camera in the scene.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param ctx Render context to trace with.
  *
- * @returns A Boost shared pointer to the sphere.
+ * @return @c false if the file couldn't be made.
  */
-sp_shape3d readSphere(istream &is) {
-	rgbcolord color;
-	float reflectivity;
-	double rad;
-	vector3d vec;
-	cin >> color >> rad >> vec >> reflectivity;
-	sp_shape3d x(new sphere3d(color, rad, vec, reflectivity));
-	return x;
+template<typename vec_T, typename color_T, typename time_T>
+bool renderMapped(const renderoptions &opts,
+		const scene<vec_T, color_T, time_T, 3> &sc,
+		const camera<vec_T, time_T, 3> &cam, int width, int height,
+		rendercontext<vec_T, color_T, time_T, 3> &ctx) {
+	bool pfm = opts.image == IMAGE_PFM;
+	ostringstream header;
+	if (pfm)
+		header << framebuffer<color_T>::pfmHeader(width, height);
+	else
+		sc.writePPMHeader(width, height, header, PPM_P6);
+	string head = header.str();
+	mappedfile mapped;
+	if (!mapped.open(opts.outFile, head.size() +
+			(size_t) width * height * (pfm ? 12 : 3))) {
+		cerr << "ERROR: can't map \"" << opts.outFile << "\"." << endl;
+		return false;
+	}
+	memcpy(mapped.data(), head.data(), head.size());
+	mappedWriter<color_T> writer;
+	writer.pixels = mapped.data() + head.size();
+	writer.width = width;
+	writer.height = height;
+	writer.pfm = pfm;
+	writer.exposure = (color_T) opts.exposure;
+	sc.renderBands(cam, width, height, writer, &ctx);
+	return true;
 }
 
 /**
- * Reads cylinder data from the given input stream then outputs a Boost shared
- * pointer to a cylinder constructed from that data. Format must be
- * @code color radius center axis height reflectivity @endcode
- * where @c color is in the format (r, g, b), @c radius is just a double,
- * @c center is in the format <x, y, z>, @c axis is the orientation of the long
- * axis of the cylinder, @c height is the height of the cylinder, and
- * @c reflectivity is just a float between 0 and 1, inclusive. All fields are
- * required.
+ * Sink for @c scene::renderBands that puts every band into its rows of a
+ * compact framebuffer, on the thread that rendered it.
  *
- * @param is The input stream from which to read.
+ * @tparam color_T The type of the @c rgbcolor.
+ */
+template<typename color_T>
+struct compactWriter {
+	/** The image. */
+	compactframebuffer<color_T> *image;
+
+	void operator()(const tilebuffer<color_T> &band) const {
+		image->putRows(band.y0, &band.pixels[0], band.height);
+	}
+};
+
+/**
+ * Renders a scene into a compact framebuffer with the pixel storage of the
+ * options, with @c scene::renderBands , then writes it in the format the
+ * options pick as @c writeImage would.
  *
- * @returns A Boost shared pointer to the sphere.
+ * @param opts The command line options.
+ * @param sc The scene.
+ * @param cam The camera in the scene.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param out The output stream.
+ * @param ctx Render context to trace with.
+ * @param times Phase timer, moved to writing once the image is done; 0 for
+ *   none.
  */
-sp_shape3d readCylinder(istream &is) {
-	rgbcolord color;
-	float reflectivity;
-	double radius, height;
-	vector3d vec1, vec2;
-	cin >> color >> radius >> vec1 >> vec2 >> height >> reflectivity;
-	sp_shape3d x(
-			new cylinderd(color, radius, vec1, height, vec2, reflectivity));
-	return x;
+template<typename vec_T, typename color_T, typename time_T>
+void renderCompact(const renderoptions &opts,
+		const scene<vec_T, color_T, time_T, 3> &sc,
+		const camera<vec_T, time_T, 3> &cam, int width, int height,
+		ostream &out, rendercontext<vec_T, color_T, time_T, 3> &ctx,
+		phasetimes *times) {
+	typedef scene<vec_T, color_T, time_T, 3> scene_t;
+	compactframebuffer<color_T> image(width, height, opts.storage);
+	compactWriter<color_T> writer;
+	writer.image = &image;
+	sc.renderBands(cam, width, height, writer, &ctx);
+	if (times)
+		times->start(PHASE_WRITE);
+	if (opts.image == IMAGE_PFM) {
+		image.writePFM(out);
+		return;
+	}
+	if (opts.image == IMAGE_EXR) {
+		image.writeEXR(out);
+		return;
+	}
+	vector<unsigned char> rgb;
+	image.quantize(rgb, (color_T) opts.exposure);
+	if (opts.image == IMAGE_PNG) {
+		encodePNG(rgb, width, height, out, opts.threads);
+		return;
+	}
+	scene_t::writePPMHeader(width, height, out, opts.format);
+	scene_t::writePPMBytes(rgb, out, opts.format);
 }
 
 /**
- * Reads plane data from the given input stream then outputs a Boost shared
- * pointer to a plane constructed from that data. Format must be
- * @code color distance_from_origin surface_normal @endcode
- * where @c color is in the format (r, g, b), @c distance_from_origin is
- * a double, and @c surface_normal is a vector in the format <x, y, z>.
+ * Reads everything left in a file, so the scene description can be
+ * tokenized straight from memory.
  *
- * @param is The input stream from which to read.
+ * @param f The file.
+ * @param[out] text Receives the bytes.
  *
- * @returns A Boost shared pointer to the plane.
+ * @return @c false if reading failed.
  */
-sp_shape3d readPlane(istream &is) {
-	rgbcolord color;
-	float reflectivity;
-	double dist;
-	vector3d vec;
-	cin >> color >> dist >> vec >> reflectivity;
-	sp_shape3d x(new infplaned(color, dist, vec, reflectivity));
-	return x;
+bool readAll(FILE *f, vector<char> &text) {
+	char buf[1 << 16];
+	size_t n;
+	text.clear();
+	while ((n = fread(buf, 1, sizeof buf, f)) > 0)
+		text.insert(text.end(), buf, buf + n);
+	return !ferror(f);
 }
 
 /**
- * Reads point light data from the given input stream then outputs a Boost
- * shared pointer to a light constructed from that data. Format must be
- * @code color position @endcode
- * where @c color is in the format (r, g, b) and @c position is
- * a vector in the format <x, y, z>.
+ * Makes the acceleration structure the options pick.
  *
- * @param is The input stream from which to read.
+ * @param opts The command line options.
  *
- * @returns A Boost shared pointer to the light.
+ * @return The structure, or a null pointer for the linear scan.
  */
-sp_lightd readLight(istream &is) {
-	rgbcolord color;
-	vector3d vec;
-	cin >> color >> vec;
-	sp_lightd x(new lightd(color, vec));
-	return x;
+template<typename vec_T, typename color_T, typename time_T>
+boost::shared_ptr<accelerator<vec_T, color_T, time_T, 3> > makeAccelerator(
+		const renderoptions &opts) {
+	return makeNamedAccelerator<vec_T, color_T, time_T>(opts.accelType,
+			opts.builder, opts.threads);
 }
 
 /**
- * Reads spotlight data from the given input stream then outputs a Boost shared
- * pointer to a spot light constructed from that data. Format must be
- * @code color position look_at_position angle @endcode
- * where @c color is in the format (r, g, b), @c position is
- * a vector in the format <x, y, z>, @c look_at_position is also a vector, and
- * @c angle is a float describing the cone angle.
+ * Gets the bytes of the scene: those of the @c --scene file, which is
+ * mapped, or everything on @c stdin . With @c --auto the bytes of
+ * @c stdin are kept after the first read and given to the second. Prints
+ * an error if they can't be read.
+ *
+ * @param opts The command line options.
+ * @param[out] file Receives the mapping of the @c --scene file.
+ * @param[out] text Receives the bytes of @c stdin .
+ * @param[out] begin Receives the first byte.
+ * @param[out] end Receives one past the last byte.
  *
- * @param is The input stream from which to read.
+ * @return @c false if the bytes couldn't be read.
+ */
+bool readSceneBytes(const renderoptions &opts, mappedfile &file,
+		vector<char> &text, const char *&begin, const char *&end) {
+	// With --auto the probes read stdin first, and the render gets it here.
+	static vector<char> keptStdin;
+	if (!opts.sceneFile.empty()) {
+		if (!file.openRead(opts.sceneFile)) {
+			cerr << "ERROR: can't read \"" << opts.sceneFile << "\"." <<
+					endl;
+			return false;
+		}
+		begin = file.data();
+		end = begin + file.size();
+		return true;
+	}
+	if (!keptStdin.empty()) {
+		text.swap(keptStdin);
+		keptStdin.clear();
+	}
+	else if (!readAll(stdin, text)) {
+		cerr << "ERROR: can't read the scene description." << endl;
+		return false;
+	}
+	else if (opts.autoTune) {
+		keptStdin = text;
+	}
+	begin = text.empty() ? 0 : &text[0];
+	end = begin + text.size();
+	return true;
+}
+
+/**
+ * Finalizes a parsed scene. With a @c --bvh-cache directory and the BVH,
+ * the tree is kept there by a hash of the shapes, the types and the
+ * builder: one already there is mapped and read instead of built, and a
+ * tree that had to be built is written there for the next run. Lights and
+ * cameras don't change the hash, so relit scenes reuse the tree.
  *
- * @returns A Boost shared pointer to the light.
+ * @param opts The command line options.
+ * @param sc The scene, with its objects added.
+ * @param desc The parsed scene description.
  */
-sp_spotlightd readSpotLight(istream &is) {
-	rgbcolord color;
-	vector3d pos, lookat;
-	float angle;
-	cin >> color >> pos >> lookat >> angle;
-	assert(!(pos[0] == lookat[0] &&
-			lookat[1] == lookat[1] && pos[2] == lookat[2]));
-	sp_spotlightd x(new spotlightd(color, pos, (lookat - pos).norm(), angle));
-	return x;
+template<typename vec_T, typename color_T, typename time_T>
+void finalizeCached(const renderoptions &opts,
+		scene<vec_T, color_T, time_T, 3> &sc, const scenedescription &desc) {
+	if (opts.bvhCache.empty() || opts.accelType != "bvh") {
+		sc.finalize();
+		return;
+	}
+	scenehash hash;
+	hash.add(string("bvh 1"));
+	hash.add((double) sizeof(vec_T));
+	hash.add((double) sizeof(time_T));
+	hash.add((double) opts.builder);
+	if (opts.compactSpheres)
+		hash.add(string("compact spheres"));
+	hashSceneShapes(hash, desc.records.empty() ? 0 : &desc.records[0],
+			desc.records.size(), desc.paths);
+	string name = opts.bvhCache + "/" + hash.toString() + ".bvh";
+	mappedfile cached;
+	bool mapped = cached.openRead(name);
+	bool read = sc.finalize(mapped ? cached.data() : 0,
+			mapped ? cached.size() : 0);
+	if (!read) {
+		ostringstream tree;
+		if (sc.writeAccelerator(tree) &&
+				!writeFileAtomically(name, tree.str()))
+			cerr << "WARNING: can't write \"" << name << "\"." << endl;
+	}
+	rendermetrics::total().addBvhCache(read);
+	if (opts.printStats)
+		cerr << "bvh cache: " << (read ? "read " : "wrote ") << name << endl;
 }
 
 /**
- * Reads area light data from the given input stream then outputs a Boost
- * shared pointer to an area light constructed from that data. Format must be
- * @code color center surface_normal up_direction horizontal_spacing
- * vertical_spacing width height @endcode
- * where @c color is in the format (r, g, b), @c center is
- * a vector in the format <x, y, z>, @c surface_normal is also a vector,
- * @c up_direction is a vector pointing along the v axis, @c horizontal_spacing
- * is a double, @c vertical_spacing is a double, @c width is a double, and
- * @c height is a double.
+ * Adds the objects of the bytes of a scene to the given scene, then
+ * finalizes it. A scene compiled with @c --compile is used in place and
+ * its tree is read instead of built if the options pick the BVH and
+ * builder it was built with, or with @c --out-of-core and chunks, its
+ * chunks are loaded only as rays reach them; anything else is parsed as a scene
+ * description on the @c -j threads, with files relative to the
+ * @c --scene file's directory. With @c --compact-spheres the spheres are
+ * gathered into a @c compactspheres , whose tree is built anew. With
+ * @c --pipelined-load the bounds of the shapes are gathered on worker
+ * threads as the shapes are made. The camera is the one @c --camera
+ * names, or else the last one. Prints an error if the scene can't be
+ * read.
  *
- * @param is The input stream from which to read.
+ * @param opts The command line options.
+ * @param begin The first byte of the scene.
+ * @param end One past the last byte, which must stay valid as long as the
+ *   scene.
+ * @param sc The scene, with its accelerator set.
+ * @param[out] cam Receives the camera.
+ * @param[out] cameras If not null, receives every camera in order.
+ * @param[out] anim If not null, receives the keys of the objects.
+ * @param[out] digest If not null, the objects are added to it with
+ *   @c hashSceneRecords .
+ * @param times If not null, @c PHASE_BUILD is started on it before the
+ *   scene is finalized.
  *
- * @returns A Boost shared pointer to the area light.
+ * @return @c false if the scene couldn't be read or doesn't have the
+ *         camera.
  */
-sp_arealightd readAreaLight(istream &is) {
-	rgbcolord color;
-	vector3d center, normal, upDir;
-	double hspace, vspace, width, height;
-	cin >> color >> center >> normal >> upDir >> hspace >> vspace >> width
-		>> height;
-	sp_arealightd x(new arealightd(
-			color, center, normal, upDir, hspace, vspace, width, height));
-	return x;
+template<typename vec_T, typename color_T, typename time_T>
+bool loadSceneBytes(const renderoptions &opts, const char *begin,
+		const char *end, scene<vec_T, color_T, time_T, 3> &sc,
+		boost::shared_ptr<camera<vec_T, time_T, 3> > &cam,
+		vector<scenecamera<vec_T, time_T> > *cameras = 0,
+		animation<vec_T, color_T, time_T> *anim = 0,
+		scenehash *digest = 0, phasetimes *times = 0) {
+	vector<scenecamera<vec_T, time_T> > all;
+	string error;
+	if (scenefile::isSceneFile(begin, end - begin)) {
+		scenefile compiled;
+		vector<string> paths;
+		bool ok = compiled.open<vec_T, color_T, time_T>(begin, end - begin,
+				error);
+		bool outOfCore = ok && opts.outOfCore > 0 &&
+				compiled.getChunkCount() > 0;
+		if (ok) {
+			compiled.getPaths(paths);
+			if (opts.pipelinedLoad && !outOfCore)
+				sc.beginPipelinedBuild(std::max(1, opts.threads - 1));
+			ok = outOfCore ? addOutOfCoreScene(sc, compiled,
+					(size_t) (opts.outOfCore * 1048576), cam, error, &all,
+					anim) : addSceneRecords(sc, compiled.getRecords(),
+					compiled.getRecordCount(), paths, cam, error, &all, anim,
+					opts.compactSpheres);
+			if (digest)
+				hashSceneRecords(*digest, compiled.getRecords(),
+						compiled.getRecordCount(), paths);
+		}
+		if (!ok) {
+			cerr << "ERROR: " << error << endl;
+			return false;
+		}
+		bool sameTree = !outOfCore && !opts.compactSpheres &&
+				opts.accelType == "bvh" &&
+				compiled.getTreeBuilder() == (int) opts.builder;
+		if (times)
+			times->start(PHASE_BUILD);
+		sc.finalize(sameTree ? compiled.getTree() : 0,
+				sameTree ? compiled.getTreeSize() : 0);
+	}
+	else {
+		scenedescription desc;
+		if (opts.pipelinedLoad)
+			sc.beginPipelinedBuild(std::max(1, opts.threads - 1));
+		if (!parseSceneParallel<vec_T, color_T>(begin, end,
+				sceneDirectory(opts.sceneFile), opts.threads, desc, error) ||
+				!addSceneRecords(sc, desc.records.empty() ? 0 :
+				&desc.records[0], desc.records.size(), desc.paths, cam,
+				error, &all, anim, opts.compactSpheres)) {
+			cerr << "ERROR: " << error << endl;
+			return false;
+		}
+		if (digest)
+			hashSceneRecords(*digest, desc.records.empty() ? 0 :
+					&desc.records[0], desc.records.size(), desc.paths);
+		if (times)
+			times->start(PHASE_BUILD);
+		finalizeCached(opts, sc, desc);
+	}
+	if (!cam) {
+		cerr << "ERROR: the scene description has no camera." << endl;
+		return false;
+	}
+	if (!opts.cameraName.empty()) {
+		cam.reset();
+		for (size_t i = 0; i < all.size(); i++)
+			if (all[i].name == opts.cameraName)
+				cam = all[i].cam;
+		if (!cam) {
+			cerr << "ERROR: the scene description has no camera named \"" <<
+					opts.cameraName << "\"." << endl;
+			return false;
+		}
+	}
+	if (cameras)
+		cameras->swap(all);
+	return true;
 }
 
 /**
- * Reads camera data from the given input stream then outputs a @c camerad
- * object constructed from that data. Format must be
- * @code position look_at_position up_direction @endcode where
- * @c position , @c look_at_position , and @c up_direction are
- * vector in the format <x, y, z>.
+ * Reads the scene with @c readSceneBytes and adds its objects to the given
+ * scene with @c loadSceneBytes . A compiled scene is used in place from its
+ * mapping, which stays mapped as long as the scene if it's loaded out of
+ * core.
  *
- * @param is The input stream from which to read.
+ * @param opts The command line options.
+ * @param sc The scene, with its accelerator set.
+ * @param[out] cam Receives the camera.
+ * @param[out] cameras If not null, receives every camera in order.
+ * @param[out] anim If not null, receives the keys of the objects.
+ * @param[out] digest If not null, the objects are added to it.
+ * @param times If not null, times the build; see @c loadSceneBytes .
  *
- * @returns A camera object.
+ * @return @c false if the scene couldn't be read or doesn't have the
+ *         camera.
  */
-sp_camerad readCamera(istream &is) {
-	vector3d vec1;
-	vector3d vec2;
-	vector3d vec3;
-	cin >> vec1 >> vec2 >> vec3;
-	sp_camerad x(new camerad(vec1, vec2, vec3));
-	return x;
+template<typename vec_T, typename color_T, typename time_T>
+bool loadScene(const renderoptions &opts, scene<vec_T, color_T, time_T, 3> &sc,
+		boost::shared_ptr<camera<vec_T, time_T, 3> > &cam,
+		vector<scenecamera<vec_T, time_T> > *cameras = 0,
+		animation<vec_T, color_T, time_T> *anim = 0,
+		scenehash *digest = 0, phasetimes *times = 0) {
+	boost::shared_ptr<mappedfile> file(new mappedfile());
+	boost::shared_ptr<vector<char> > text(new vector<char>());
+	const char *begin, *end;
+	if (!readSceneBytes(opts, *file, *text, begin, end) ||
+			!loadSceneBytes(opts, begin, end, sc, cam, cameras, anim, digest,
+			times))
+		return false;
+	// Chunks loaded out of core are read from the bytes as rays reach them.
+	boost::shared_ptr<chunkaccel<vec_T, color_T, time_T> > chunked =
+			boost::dynamic_pointer_cast<chunkaccel<vec_T, color_T, time_T> >(
+			sc.getAccelerator());
+	if (chunked) {
+		chunked->getStore()->keep(file);
+		chunked->getStore()->keep(text);
+	}
+	return true;
 }
 
-map<string, sceneObjInputFunction> readerFuncs;
+/**
+ * Reads a scene description and writes it as a compiled scene, which
+ * @c loadScene maps and uses without parsing. Unless the options pick the
+ * linear scan or a structure that can't be saved, the BVH is built and
+ * stored too. With @c --chunk-size the spheres and cylinders are grouped
+ * into chunks for @c --out-of-core .
+ *
+ * @param opts The command line options.
+ * @param outFile Name of the compiled scene.
+ *
+ * @return The exit status of the program.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+int compileScene(const renderoptions &opts, const string &outFile) {
+	mappedfile file;
+	vector<char> text;
+	const char *begin, *end;
+	if (!readSceneBytes(opts, file, text, begin, end))
+		return 1;
+	if (scenefile::isSceneFile(begin, end - begin)) {
+		cerr << "ERROR: \"" << opts.sceneFile << "\" is already compiled." <<
+				endl;
+		return 1;
+	}
+	scenedescription desc;
+	string error;
+	if (!parseSceneParallel<vec_T, color_T>(begin, end,
+			sceneDirectory(opts.sceneFile), opts.threads, desc, error)) {
+		cerr << "ERROR: " << error << endl;
+		return 1;
+	}
+	vector<scenechunk> chunks;
+	if (opts.chunkSize > 0)
+		chunkSceneRecords<vec_T, color_T, time_T>(desc, opts.chunkSize,
+				chunks);
+
+	// Build the scene once to check the records and get the tree.
+	scene<vec_T, color_T, time_T, 3> sc(opts.shadowsOn);
+	sc.setAccelerator(makeAccelerator<vec_T, color_T, time_T>(opts));
+	boost::shared_ptr<camera<vec_T, time_T, 3> > cam;
+	if (!addSceneRecords(sc, desc.records.empty() ? 0 : &desc.records[0],
+			desc.records.size(), desc.paths, cam, error)) {
+		cerr << "ERROR: " << error << endl;
+		return 1;
+	}
+	sc.finalize();
+	ostringstream tree;
+	if (!sc.writeAccelerator(tree))
+		tree.str("");
+
+	ofstream out(outFile.c_str(), ios::out | ios::binary);
+	if (!out || !writeSceneFile<vec_T, color_T, time_T>(out, desc,
+			opts.builder, tree.str(), chunks)) {
+		cerr << "ERROR: can't write \"" << outFile << "\"." << endl;
+		return 1;
+	}
+	return 0;
+}
 
 /**
  * Prints usage message to stdout.
@@ -196,106 +1016,4860 @@ map<string, sceneObjInputFunction> readerFuncs;
  */
 void usage(char *progname) {
 	cout << "---> Usage: " << progname
-			<< ": <width in pixels> <height in pixels> -s" << endl;
-	cout << "---> -s is for shadows and must be the last argument." << endl;
+			<< ": <width in pixels> <height in pixels> [options]" << endl
+			<< "            " << progname
+			<< " --compile <scene.dat> <scene.rtb> [options]" << endl
+			<< "            " << progname
+			<< " --serve <scene> [options]" << endl
+			<< "            " << progname
+			<< " --work <host>:<port> [-j <n>] [--pin-threads] [--stats]"
+			<< endl
+			<< "            " << progname
+			<< " --bench [options]" << endl
+			<< "            " << progname
+			<< " --check <golden dir> [options]" << endl
+			<< "            " << progname
+			<< " --generate [--spheres <n>] [--cylinders <n>] [--lights <n>]"
+			<< endl
+			<< "              [--area-lights <n>] [--clusters <n>]"
+			<< " [--cluster-radius <f>]" << endl
+			<< "              [--reflectivity <r>] [--size <s>] [--seed <n>]"
+			<< " [-o <file>]" << endl;
+	cout << "---> Options:" << endl
+			<< "       -s                    turn shadows on" << endl
+			<< "       --scene <file>        read the scene from file instead"
+			<< " of stdin; scenes" << endl
+			<< "                             made with --compile are mapped and"
+			<< " used as they are" << endl
+			<< "       --camera <name>       render from the camera with that"
+			<< " name instead of" << endl
+			<< "                             the last one" << endl
+			<< "       --cameras             render from every camera, each to"
+			<< " the -o file with" << endl
+			<< "                             %c replaced by its name or number;"
+			<< " not with" << endl
+			<< "                             --progressive, --stream or --mmap"
+			<< endl
+			<< "       --frames <a>:<b>      render frames a to b of the keyed"
+			<< " objects, each to" << endl
+			<< "                             the -o file with %f replaced by"
+			<< " its 4 digit number;" << endl
+			<< "                             not with --cameras, --progressive,"
+			<< " --stream or --mmap" << endl
+			<< "       --frame-cache <dir>   keep the frames in dir by a hash of"
+			<< " all they depend" << endl
+			<< "                             on and copy those already there;"
+			<< " rt processes" << endl
+			<< "                             sharing dir split the frames"
+			<< " between them" << endl
+			<< "       --reuse-tiles         with --frames, copy the tiles"
+			<< " nothing keyed changed" << endl
+			<< "                             from the frame rendered before;"
+			<< " not with --crop" << endl
+			<< "                             or --wavefront" << endl
+			<< "       --reproject <n>       with --frames and --wavefront,"
+			<< " take the camera hits" << endl
+			<< "                             of the frame before where they"
+			<< " line up, an" << endl
+			<< "                             approximation, and trace every"
+			<< " nth frame whole;" << endl
+			<< "                             not with --frame-cache" << endl
+			<< "       --bvh-cache <dir>     keep built BVHs in dir by a hash of"
+			<< " the shapes and map" << endl
+			<< "                             one already there instead of"
+			<< " building it" << endl
+			<< "       --pipelined-load      gather the bounds of the shapes"
+			<< " on worker threads" << endl
+			<< "                             while the rest of the scene is"
+			<< " read" << endl
+			<< "       --chunk-size <n>      with --compile, group the spheres"
+			<< " and cylinders into" << endl
+			<< "                             chunks of up to n that are close"
+			<< " together" << endl
+			<< "       --out-of-core <MB>    load the chunks of a compiled"
+			<< " scene only as rays" << endl
+			<< "                             reach them, keeping about MB"
+			<< " megabytes of them" << endl
+			<< "       --compact-spheres     keep the spheres nothing moves as"
+			<< " 16 bytes of floats" << endl
+			<< "                             and an index of their color and"
+			<< " reflectivity each," << endl
+			<< "                             with a hierarchy of their own"
+			<< endl
+			<< "       --mem-report          print the bytes the shapes by"
+			<< " type, the accelerator," << endl
+			<< "                             the lights and the framebuffer"
+			<< " take to stderr before" << endl
+			<< "                             rendering" << endl
+			<< "       --huge-pages          back the scene's arena, the BVH"
+			<< " nodes and the image" << endl
+			<< "                             with 2 MB pages where the system"
+			<< " gives them, and say" << endl
+			<< "                             which it did with --stats" << endl
+			<< "       --auto                pick --accel, --simd, --precision,"
+			<< " the light sampling" << endl
+			<< "                             and --min-throughput from the"
+			<< " scene's statistics and" << endl
+			<< "                             timed probe renders of about 64 x"
+			<< " 64 pixels, in place" << endl
+			<< "                             of those given, keeping only"
+			<< " settings whose probe is" << endl
+			<< "                             within 1 level of the exact one,"
+			<< " and print them to" << endl
+			<< "                             stderr" << endl
+			<< "       --procs <n>           render the bands of the image in n"
+			<< " worker processes that" << endl
+			<< "                             share the scene and the image,"
+			<< " each with -j threads;" << endl
+			<< "                             bands of workers that die are"
+			<< " rendered again; only" << endl
+			<< "                             for single whole images without"
+			<< " --wavefront," << endl
+			<< "                             --denoise, --stats, --heatmap or"
+			<< " --profile-shapes" << endl
+			<< "       --write-queue <n>     with --frames or --cameras, write"
+			<< " up to n images on" << endl
+			<< "                             a writer thread while the next"
+			<< " ones render, holding" << endl
+			<< "                             n + 1 images (default 1)" << endl
+			<< "       --thumbnail <w>x<h>   also write the image scaled down to"
+			<< " w x h pixels, to" << endl
+			<< "                             the -o name with .<w>x<h> before"
+			<< " its extension; may" << endl
+			<< "                             be repeated; not with"
+			<< " --progressive, --stream," << endl
+			<< "                             --mmap, --strips, --pixel-storage,"
+			<< " --crop," << endl
+			<< "                             --coordinate, --time-budget,"
+			<< endl
+			<< "                             --checkpoint or --frame-cache"
+			<< endl
+			<< "       --mip-levels <n>      also write the image at n halvings"
+			<< " of its size, like" << endl
+			<< "                             --thumbnail" << endl
+			<< "       --thumbnail-filter <box|lanczos>" << endl
+			<< "                             filter to scale down with"
+			<< " (default: box)" << endl
+			<< "       --aov <depth|normal|id>" << endl
+			<< "                             also write the depth, normal or"
+			<< " shape index of each" << endl
+			<< "                             pixel to the -o name with"
+			<< " .depth, .normal or .id" << endl
+			<< "                             before its extension, raw for"
+			<< " PFM and OpenEXR and" << endl
+			<< "                             mapped to colors otherwise; may"
+			<< " be repeated; not" << endl
+			<< "                             where --thumbnail isn't, nor with"
+			<< " --crop, --frames" << endl
+			<< "                             or --cameras" << endl
+			<< "       --crop <x0> <y0> <x1> <y1>" << endl
+			<< "                             render only columns x0 to x1 - 1"
+			<< " and rows y0 to" << endl
+			<< "                             y1 - 1, with the rays of the whole"
+			<< " image, as an image" << endl
+			<< "                             of that size for rt-merge; not"
+			<< " with --progressive," << endl
+			<< "                             --stream, --mmap or --wavefront"
+			<< endl
+			<< "       --coordinate <port>   render on the --work processes"
+			<< " that connect to" << endl
+			<< "                             port, which are sent the scene"
+			<< " and options; not" << endl
+			<< "                             with --crop, --cameras, --frames,"
+			<< " --progressive," << endl
+			<< "                             --stream, --mmap or --wavefront"
+			<< endl
+			<< "       --lease-size <n>      lease workers tiles of n x n"
+			<< " pixels (default: 64)" << endl
+			<< "       --lease-timeout <s>   lease a tile to another worker"
+			<< " too once one holds" << endl
+			<< "                             it s seconds, or take over a"
+			<< " --frame-cache frame" << endl
+			<< "                             whose claim wasn't touched for s"
+			<< " seconds; 0 for" << endl
+			<< "                             never (default: 60)" << endl
+			<< "       --metrics-port <port> with --serve, serve the jobs,"
+			<< " samples, phase, tile" << endl
+			<< "                             and job times, memory and cache"
+			<< " hits to Prometheus" << endl
+			<< "                             at http://host:port/metrics;"
+			<< " RT_STATS builds add" << endl
+			<< "                             the rays" << endl
+			<< "       -j <n>                parse, build and render on n"
+			<< " threads (default: one" << endl
+			<< "                             per hardware thread); the image"
+			<< " doesn't depend on n" << endl
+			<< "       --pin-threads         keep each render thread on one"
+			<< " core it may run on" << endl
+			<< "                             (Linux); scratch memory it first"
+			<< " writes lands on that" << endl
+			<< "                             core's NUMA node only by"
+			<< " first-touch placement, and" << endl
+			<< "                             the scene isn't replicated per"
+			<< " socket; --stats counts" << endl
+			<< "                             the threads that failed" << endl
+			<< "       --accel linear|bvh|qbvh8|qbvh16|grid|lazy|dynamic|motion"
+			<< endl
+			<< "                             acceleration structure for ray"
+			<< " queries (default bvh);" << endl
+			<< "                             qbvh8 and qbvh16 are 4-wide"
+			<< " bvhs with child boxes" << endl
+			<< "                             quantized to 8 or 16 bits; lazy"
+			<< " is a SAH bvh whose" << endl
+			<< "                             deeper subtrees are built when a"
+			<< " ray first enters them;" << endl
+			<< "                             dynamic is a bvh that shapes can"
+			<< " be added to, moved" << endl
+			<< "                             in and removed from without a"
+			<< " rebuild; motion" << endl
+			<< "                             interpolates its boxes to each"
+			<< " ray's time for" << endl
+			<< "                             shapes that move while the"
+			<< " shutter is open" << endl
+			<< "       --bvh-builder sah|lbvh" << endl
+			<< "                             how the bvh is built: SAH for the"
+			<< " best tree (default)," << endl
+			<< "                             parallel linear BVH for the"
+			<< " fastest build;" << endl
+			<< "                             also used by qbvh8 and qbvh16"
+			<< endl
+			<< "       --shadow-cache        try the last blocker of each"
+			<< " light first for shadow rays" << endl
+			<< "       --raster-primary      find what each pixel sees by"
+			<< " binning the shapes by" << endl
+			<< "                             their screen rectangles instead"
+			<< " of tracing camera" << endl
+			<< "                             rays; same image, faster for a"
+			<< " few big shapes" << endl
+			<< "       --tile-frustums       like --raster-primary, but also"
+			<< " cull the shapes of" << endl
+			<< "                             each 8 x 8 pixel tile by the"
+			<< " tile's view frustum" << endl
+			<< "       --area-light-samples <n>" << endl
+			<< "                             sample n points on each area"
+			<< " light per shading" << endl
+			<< "                             point instead of using its grid"
+			<< " of point lights" << endl
+			<< "       --adaptive-shadows <n>" << endl
+			<< "                             trace the shadow rays of only n"
+			<< " of those samples" << endl
+			<< "                             unless they disagree, e.g. 4"
+			<< " (default 0, all)" << endl
+			<< "       --pixel-visibility    with --aa or --samples of 3 or"
+			<< " more, trace only the" << endl
+			<< "                             shadow rays of a pixel's corner"
+			<< " samples when all its" << endl
+			<< "                             samples see one shape, and reuse"
+			<< " them where they agree" << endl
+			<< "       --shadow-map <n>      look shadows of point lights and"
+			<< " spotlights up in" << endl
+			<< "                             n x n cube shadow maps instead of"
+			<< " tracing them, for" << endl
+			<< "                             previews (default 0, off)" << endl
+			<< "       --shadow-map-bias <b> distance past the closest surface"
+			<< " a point must be" << endl
+			<< "                             to be in shadow (default 0.02)"
+			<< endl
+			<< "       --light-cluster <ratio>" << endl
+			<< "                             shade far away groups of point"
+			<< " lights, e.g. of area" << endl
+			<< "                             lights, as one light when their"
+			<< " size is less than" << endl
+			<< "                             ratio times their distance"
+			<< " (default 0, exact)" << endl
+			<< "       --lightcuts <e>       shade a cut through the light"
+			<< " tree per point, whose" << endl
+			<< "                             clusters may each be off by e"
+			<< " of the total, e.g." << endl
+			<< "                             0.02, instead of --light-cluster"
+			<< " (default 0, off)" << endl
+			<< "       --light-picks <n>     trace shadow rays to only n light"
+			<< " samples per point," << endl
+			<< "                             picked by how much they would"
+			<< " add, e.g. 4 (default" << endl
+			<< "                             0, all)" << endl
+			<< "       --max-reflect <n>     follow at most n reflections"
+			<< " (default 10)" << endl
+			<< "       --min-throughput <t>  stop following reflections once"
+			<< " the product of" << endl
+			<< "                             reflectivities is below t, e.g."
+			<< " 0.002 (default 0)" << endl
+			<< "       --light-cutoff <c>    with shadows, skip the shadow rays"
+			<< " of lights that" << endl
+			<< "                             could add less than c to a"
+			<< " pixel, e.g. 0.0039 (default 0)" << endl
+			<< "       --roulette <d>        after d reflections, end paths"
+			<< " at random by" << endl
+			<< "                             Russian roulette so a high"
+			<< " --max-reflect is cheap" << endl
+			<< "       --wavefront           shade in stages over queues of"
+			<< " shadow and reflection" << endl
+			<< "                             rays instead of recursively per"
+			<< " pixel" << endl
+			<< "       --aa <n>              anti-alias edges: pixels that see"
+			<< " another shape or" << endl
+			<< "                             color than a neighbor get n x n"
+			<< " samples (default 1, off)" << endl
+			<< "       --aa-threshold <t>    color difference between"
+			<< " neighbors, per channel from" << endl
+			<< "                             0 to 1, that counts as an edge"
+			<< " (default 0.1)" << endl
+			<< "       --samples <n>         n x n stratified, jittered samples"
+			<< " per pixel, traced" << endl
+			<< "                             together (default 1), at"
+			<< " stratified times of" << endl
+			<< "                             the shutter interval, which blurs"
+			<< " shapes that move;" << endl
+			<< "                             not with --wavefront or"
+			<< " --progressive" << endl
+			<< "       --denoise <n>         filter the image in n passes of an"
+			<< " edge-avoiding" << endl
+			<< "                             wavelet guided by the shapes'"
+			<< " normals and depths," << endl
+			<< "                             e.g. 5, so fewer --samples or"
+			<< " area light samples" << endl
+			<< "                             do; whole images only, not with"
+			<< " --crop, --progressive," << endl
+			<< "                             --stream, --coordinate,"
+			<< " --reuse-tiles" << endl
+			<< "                             (default 0, off)" << endl
+			<< "       --sampler random|sobol|bluenoise"
+			<< endl
+			<< "                             where --samples come from:"
+			<< " independent hashes," << endl
+			<< "                             scrambled Sobol points per pixel,"
+			<< " or one Sobol" << endl
+			<< "                             sequence shifted per pixel by"
+			<< " blue noise (default" << endl
+			<< "                             sobol)" << endl
+			<< "       -o <file>             write the image to file instead of"
+			<< " stdout; PNG, PFM" << endl
+			<< "                             or EXR if its name ends in .png,"
+			<< " .pfm or .exr" << endl
+			<< "       --heatmap <file>      also write a false color image of"
+			<< " what each pixel" << endl
+			<< "                             cost, from black through blue"
+			<< " and green to red;" << endl
+			<< "                             PNG, PFM or EXR by the name's"
+			<< " extension, else PPM" << endl
+			<< "       --heatmap-cost cycles|tests" << endl
+			<< "                             count CPU cycles (default) or"
+			<< " intersection tests," << endl
+			<< "                             which need a build with RT_STATS"
+			<< endl
+			<< "       --format p3|p6|png|pfm|exr" << endl
+			<< "                             plain (default) or raw binary PPM,"
+			<< " PNG compressed on" << endl
+			<< "                             the -j threads, or float PFM or"
+			<< " half float OpenEXR," << endl
+			<< "                             which keep colors brighter than"
+			<< " white" << endl
+			<< "       --exposure <e>        scale colors by e before"
+			<< " quantizing to 8 bits" << endl
+			<< "                             (default 1)" << endl
+			<< "       --time-budget <ms>    write the image within ms of"
+			<< " starting: a probe at a" << endl
+			<< "                             quarter of the size picks the"
+			<< " best quality that fits," << endl
+			<< "                             up to the --samples, --aa,"
+			<< " --max-reflect and" << endl
+			<< "                             --area-light-samples given, and"
+			<< " better passes follow" << endl
+			<< "                             while they still fit; not with"
+			<< " --progressive, --stream," << endl
+			<< "                             --mmap, --crop, --frames or"
+			<< " --cameras" << endl
+			<< "       --checkpoint <file>   save the tiles done to file every"
+			<< " --checkpoint-interval" << endl
+			<< "                             <s> seconds (default 60) and on"
+			<< " SIGTERM or SIGINT, which" << endl
+			<< "                             stop the render; the file is"
+			<< " removed once the image" << endl
+			<< "                             is written. Not with"
+			<< " --progressive, --stream, --mmap," << endl
+			<< "                             --wavefront, --crop, --frames or"
+			<< " --cameras" << endl
+			<< "       --resume              with --checkpoint, carry on from"
+			<< " the tiles in its file," << endl
+			<< "                             which must be of the same scene,"
+			<< " size and settings" << endl
+			<< "       --view                keep the scene loaded and render"
+			<< " it progressively" << endl
+			<< "                             again whenever a camera command"
+			<< " on stdin moves the" << endl
+			<< "                             view; see below" << endl
+			<< "       --watch <file>        render the scene file"
+			<< " progressively and again" << endl
+			<< "                             whenever it changes, editing only"
+			<< " the shapes and" << endl
+			<< "                             lights that changed in the loaded"
+			<< " scene, until" << endl
+			<< "                             SIGINT; passes are written as"
+			<< " with --view" << endl
+			<< "       --progressive         write a coarse image first, then"
+			<< " ones of twice the" << endl
+			<< "                             resolution up to the full image,"
+			<< " one after the other" << endl
+			<< "       --stream              write PPM rows as soon as they and"
+			<< " the ones above are" << endl
+			<< "                             done, holding only a few bands of"
+			<< " the image at once;" << endl
+			<< "                             PPM only, not with --aa, --samples"
+			<< " or --wavefront" << endl
+			<< "       --mmap                with -o and --format p6 or pfm,"
+			<< " size the file up front" << endl
+			<< "                             and have the render threads write"
+			<< " pixels right into" << endl
+			<< "                             it; not with --aa or --samples"
+			<< endl
+			<< "       --pixel-storage <s>   render into full precision colors"
+			<< " (default), or" << endl
+			<< "                             half or fixed16 16 bit channels in"
+			<< " a quarter of the" << endl
+			<< "                             memory of doubles; not with --aa,"
+			<< " --samples," << endl
+			<< "                             --wavefront, --denoise or the"
+			<< " other ways of rendering" << endl
+			<< "       --strips <rows>       render strips of about rows rows"
+			<< " one after the other," << endl
+			<< "                             each with just the shapes its"
+			<< " camera rays may hit," << endl
+			<< "                             and write each as it's done, for"
+			<< " images too big to" << endl
+			<< "                             hold; PPM or EXR only, with the"
+			<< " limits of" << endl
+			<< "                             --pixel-storage" << endl
+			<< "       --preview <port>      with --progressive, --stream or"
+			<< " --strips, wait for a" << endl
+			<< "                             WebSocket client on port and push"
+			<< " it every pass, band" << endl
+			<< "                             or strip as a PNG with its place"
+			<< " in the image" << endl
+			<< "       --sort-rays           with --wavefront, trace shadow and"
+			<< " reflection rays" << endl
+			<< "                             sorted by direction octant and"
+			<< " origin Morton code" << endl
+			<< "       --shadow-packets      with --wavefront, trace the shadow"
+			<< " rays toward each" << endl
+			<< "                             light in packets of 8 bounded by"
+			<< " the box around them" << endl
+			<< "       --simd scalar|sse2|avx2|avx512" << endl
+			<< "                             widest instruction set for batch"
+			<< " intersection tests" << endl
+			<< "                             (default: the widest this CPU"
+			<< " supports)" << endl
+			<< "       --precision double|float|float-time" << endl
+			<< "                             scalar types of the render:"
+			<< " double (default), float," << endl
+			<< "                             or double geometry and colors"
+			<< " with float ray and hit" << endl
+			<< "                             times" << endl
+			<< "       --stats               print render statistics, the"
+			<< " memory taken by the" << endl
+			<< "                             acceleration structure, the"
+			<< " instruction set, the" << endl
+			<< "                             precision and the thread count"
+			<< " to stderr; a build" << endl
+			<< "                             with RT_STATS defined (make srt)"
+			<< " also counts rays," << endl
+			<< "                             intersection tests and hits"
+			<< endl
+			<< "       --stats-json <file>   write the wall and CPU time of"
+			<< " parsing, building," << endl
+			<< "                             rendering and writing, the peak"
+			<< " memory and, with" << endl
+			<< "                             RT_STATS, the ray counts to file"
+			<< " as JSON; not with" << endl
+			<< "                             --cameras, --frames, --serve,"
+			<< " --coordinate or --bench" << endl
+			<< "       --trace <file>        write a timeline of every band"
+			<< " and tile each thread" << endl
+			<< "                             renders, every tile written and"
+			<< " every phase to file" << endl
+			<< "                             in the Chrome tracing format of"
+			<< " Perfetto; not with" << endl
+			<< "                             the options --stats-json isn't"
+			<< " with" << endl
+			<< "       --perf-counters       count cycles, instructions, L1 and"
+			<< " last level cache" << endl
+			<< "                             misses and branch mispredictions"
+			<< " with Linux" << endl
+			<< "                             perf_event_open, per phase in the"
+			<< " --stats-json file" << endl
+			<< "                             and per band and tile in the"
+			<< " --trace file" << endl
+			<< "       --profile-shapes <n>  print the n shapes and lights that"
+			<< " took the most" << endl
+			<< "                             cycles to shade, with their hits"
+			<< " and light samples;" << endl
+			<< "                             a build with RT_STATS also counts"
+			<< " the intersection" << endl
+			<< "                             tests of each shape" << endl
+			<< "       --profile-json <file> write the same profile, of the"
+			<< " --profile-shapes" << endl
+			<< "                             count or else 10 of each, to file"
+			<< " as JSON; neither" << endl
+			<< "                             with the options --stats-json"
+			<< " isn't with, --view" << endl
+			<< "                             or --watch" << endl;
 	cout << "---> It's intended for scene descriptions to be sent in with"
 			<< " redirection like: " << endl
 			<< "       " << progname << " 640 480 < inputfile.dat" << endl;
-	cout << "---> See example.dat for the scene description format."
-			<< endl;
+	cout << "---> See example.dat for the scene description format. With"
+			<< " --compile, the" << endl
+			<< "     scene is written in a binary format with its BVH, for the"
+			<< " --precision," << endl
+			<< "     --accel and --bvh-builder given, which renders from"
+			<< " --scene without" << endl
+			<< "     parsing or building. \"include <file>\" reads another"
+			<< " description in" << endl
+			<< "     place, and \"geometry <file> <lower> <upper>\" stands"
+			<< " for the spheres and" << endl
+			<< "     cylinders of a file inside that box, read only once a ray"
+			<< " reaches it." << endl
+			<< "     \"mesh <color> <file> <reflectivity>\" reads triangles"
+			<< " from a binary PLY" << endl
+			<< "     or OBJ file. Files are relative to the --scene file's"
+			<< " directory." << endl
+			<< "---> With --serve, the scene is loaded once and rendered for"
+			<< " every line on" << endl
+			<< "     stdin of the form \"render <width> <height> <file>"
+			<< " [samples <n>]" << endl
+			<< "     [camera <position> <look_at> <up>] [priority <p>]"
+			<< " [deadline <ms>]\", until" << endl
+			<< "     \"quit\". \"ready\" is printed once it's loaded and"
+			<< " \"ok <file>\" or" << endl
+			<< "     \"error <message>\" for each line. The renders share"
+			<< " the -j threads a tile" << endl
+			<< "     at a time: those of the highest priority (default: 0)"
+			<< " first, then those" << endl
+			<< "     due soonest, the deadline counting from when the line"
+			<< " is read, then all" << endl
+			<< "     in turn. Images are written as they're done, except"
+			<< " with --wavefront or" << endl
+			<< "     --denoise, which render one line after the other."
+			<< endl
+			<< "---> With --view, every pass replaces the -o file in one go,"
+			<< " for a viewer that" << endl
+			<< "     reloads it, or goes to stdout after the last one, e.g."
+			<< " into" << endl
+			<< "     \"ffplay -f image2pipe -vcodec ppm -\" with --format p6."
+			<< " Each stdin line" << endl
+			<< "     is \"move <right> <up> <forward>\", \"turn <yaw>"
+			<< " <pitch>\" or \"orbit <yaw>" << endl
+			<< "     <pitch>\" in degrees, \"zoom <factor>\", \"camera"
+			<< " <position> <look_at> <up>\"," << endl
+			<< "     \"reset\" or \"quit\", and stops the render under way."
+			<< " Pass times go to" << endl
+			<< "     stderr." << endl
+			<< "---> With --work, the scene and options are taken from the"
+			<< " --coordinate render" << endl
+			<< "     at host:port, and the tiles it leases are rendered on n"
+			<< " threads until the" << endl
+			<< "     image is done. Files the scene reads must be at the same"
+			<< " path on every" << endl
+			<< "     worker." << endl
+			<< "---> With --bench, the example scenes in the current directory"
+			<< " and made ones" << endl
+			<< "     with many spheres, many lights, facing mirrors and an area"
+			<< " light are" << endl
+			<< "     rendered at 320x200 on 1, 2, 4, ... up to -j threads with"
+			<< " the options" << endl
+			<< "     given, and a CSV line of the parse, build and render times,"
+			<< " rays per" << endl
+			<< "     second and speedup is written per scene and thread count."
+			<< " Rays are only" << endl
+			<< "     counted by a build with RT_STATS (make bench)." << endl
+			<< "---> With --check, the example scenes are rendered at the size"
+			<< " of their golden" << endl
+			<< "     images <name>.ppm in the directory, and it fails if a"
+			<< " channel differs by" << endl
+			<< "     more than --tolerance <levels> (default 1). With RT_STATS"
+			<< " it also fails if" << endl
+			<< "     rays per second are more than --max-slowdown <f> (default"
+			<< " 0.2) below" << endl
+			<< "     baseline.csv there. --update-golden and --update-baseline"
+			<< " write them" << endl
+			<< "     instead (make check, make check-baseline)." << endl
+			<< "---> With --generate, a random scene description is written:"
+			<< " n spheres" << endl
+			<< "     (default 1000) and cylinders on a plane in a region of"
+			<< " half width s" << endl
+			<< "     (default 10), in n clusters of radius f times s if asked,"
+			<< " with" << endl
+			<< "     reflectivities up to r (default 0.5), lit by n point"
+			<< " lights (default 4)" << endl
+			<< "     and area lights. The same seed (default 1) always makes"
+			<< " the same scene;" << endl
+			<< "     --compile turns it into the binary format." << endl;
 }
 
 /**
- * This program takes a scene description from @c cin (it's advised to redirect
- * the scene description from a file like @c example.dat) then renders a scene
- * of the given width and height to PPM formatted image. Shadows can be turned
- * on with the flag -s, but it must be the last argument to the program. The
- * output is written to cout so it's advised to pipe the output to @c pnmtopng ,
- * which converts PPM images to PNG, then to redirect its output to a file like
- * @c img.png. For example, @code rt 640 480 -s < example.dat | pnmtopng >
- * img.png @endcode
+ * Prints an error for each geometry file of a rendered scene that couldn't
+ * be read and, for the statistics, how many were read.
+ *
+ * @param sc The scene.
+ * @param printStats Whether to print the counts.
+ *
+ * @return Number of files that couldn't be read.
  */
-int main(int argc, char **argv) {
+template<typename vec_T, typename color_T, typename time_T>
+int reportGeometry(const scene<vec_T, color_T, time_T, 3> &sc,
+		bool printStats) {
+	typedef lazygeometry<vec_T, color_T, time_T, 3> lazygeometry_t;
+	int total = 0, loaded = 0, failed = 0;
+	for (size_t i = 0; i < sc.getShapes().size(); i++) {
+		const lazygeometry_t *g = dynamic_cast<const lazygeometry_t *>(
+				sc.getShapes()[i].get());
+		if (g == 0)
+			continue;
+		total++;
+		if (g->getState() == lazygeometry_t::GEOMETRY_LOADED)
+			loaded++;
+		else if (g->getState() == lazygeometry_t::GEOMETRY_FAILED) {
+			cerr << "ERROR: " << g->getError() << endl;
+			failed++;
+		}
+	}
+	if (printStats && total > 0)
+		cerr << "geometry files: " << loaded << " of " << total <<
+				" loaded" << endl;
+	return failed;
+}
 
-	if (argc != 4 && argc != 3) {
-		usage(argv[0]);
-		return 1;
+/**
+ * Applies the render settings of the options to a scene and gives it the
+ * acceleration structure they pick.
+ *
+ * @param opts The command line options.
+ * @param sc The scene, before anything is added to it.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+void configureScene(const renderoptions &opts,
+		scene<vec_T, color_T, time_T, 3> &sc) {
+	sc.setShadowCache(opts.shadowCache);
+	sc.setRasterPrimary(opts.rasterPrimary);
+	sc.setTileFrustums(opts.tileFrustums);
+	sc.setSortSecondaryRays(opts.sortRays);
+	sc.setShadowPackets(opts.shadowPackets);
+	sc.setRenderThreads(opts.threads);
+	sc.setPinThreads(opts.pinThreads);
+	sc.setSupersampling(opts.aaSamples, opts.aaThreshold);
+	sc.setPixelSamples(opts.pixelSamples);
+	sc.setDenoisePasses(opts.denoisePasses);
+	sc.setSampler(opts.sampler);
+	sc.setReflectionLimits(opts.maxReflect, opts.minThroughput);
+	sc.setLightCutoff(opts.lightCutoff);
+	sc.setRussianRoulette(opts.rouletteDepth);
+	sc.setLightClusterRatio(opts.clusterRatio);
+	sc.setLightCutError(opts.cutError);
+	sc.setLightPicks(opts.lightPicks);
+	if (opts.areaSamples > 0)
+		sc.setAreaLightMode(AREA_LIGHT_SAMPLED, opts.areaSamples);
+	sc.setAdaptiveShadows(opts.adaptiveShadows);
+	sc.setPixelVisibility(opts.pixelVisibility);
+	sc.setShadowMaps(opts.shadowMapRes, opts.shadowMapBias);
+	sc.setAccelerator(makeAccelerator<vec_T, color_T, time_T>(opts));
+}
+
+/**
+ * Renders a whole image, in stages if the options pick @c --wavefront , or
+ * just the @c --crop window of it.
+ *
+ * @param opts The command line options.
+ * @param sc The scene.
+ * @param cam The camera in the scene.
+ * @param width The width of the whole image in pixels.
+ * @param height The height of the whole image in pixels.
+ * @param[out] image Receives the colors of the pixels, row by row, of the
+ *   size @c outputSize gives.
+ * @param ctx Render context to trace with.
+ * @param[out] guides If not 0, receives the G-buffer of the whole image;
+ *   not with @c --crop .
+ */
+template<typename vec_T, typename color_T, typename time_T>
+void renderPixels(const renderoptions &opts,
+		const scene<vec_T, color_T, time_T, 3> &sc,
+		const camera<vec_T, time_T, 3> &cam, int width, int height,
+		vector<rgbcolor<color_T> > &image,
+		rendercontext<vec_T, color_T, time_T, 3> &ctx,
+		gbuffer<vec_T, color_T, time_T, 3> *guides = 0) {
+	if (opts.crop) {
+		sc.renderCrop(cam, width, height, opts.cropX0, opts.cropY0,
+				opts.cropX1, opts.cropY1, image, &ctx);
+		return;
 	}
-	int width = atoi(argv[1]);
-	int height = atoi(argv[2]);
-	bool shadowsOn = false;
-	if(argc == 4) {
-		stringstream ss;
-		ss << argv[3];
-		if(ss.str() == "-s") {
-			shadowsOn = true;
-		}
-		else {
-			usage(argv[0]);
-			return 1;
-		}
+	hugepages::reserve(image, (size_t) width * height);
+	if (opts.wavefront) {
+		gbuffer<vec_T, color_T, time_T, 3> own;
+		gbuffer<vec_T, color_T, time_T, 3> &gb = guides ? *guides : own;
+		sc.renderGBuffer(cam, width, height, gb);
+		sc.shadeWavefront(gb, image, &ctx);
+		sc.supersample(cam, gb, image, &ctx);
+		if (opts.denoisePasses > 0)
+			denoiser<vec_T, color_T, time_T, 3>(opts.denoisePasses).filter(gb,
+					image, opts.threads);
+		return;
 	}
+	image.assign((size_t) width * height, rgbcolor<color_T>());
+	sc.renderImage(cam, width, height, image, &ctx, guides);
+}
+
+/**
+ * Renders an image with @c renderPixels and writes it in the format the
+ * options pick, along with its @c --thumbnail and @c --aov images, which
+ * are made and written on a @c writequeue while the image is. The latter
+ * come from the G-buffer the image was shaded from.
+ *
+ * @param opts The command line options.
+ * @param sc The scene.
+ * @param cam The camera in the scene.
+ * @param width The width of the whole image in pixels.
+ * @param height The height of the whole image in pixels.
+ * @param out The output stream.
+ * @param ctx Render context to trace with.
+ * @param times If not null, @c PHASE_WRITE is started on it once the
+ *   image is rendered.
+ *
+ * @return @c false if a thumbnail or AOV image couldn't be written.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+bool renderFrame(const renderoptions &opts,
+		const scene<vec_T, color_T, time_T, 3> &sc,
+		const camera<vec_T, time_T, 3> &cam, int width, int height,
+		ostream &out, rendercontext<vec_T, color_T, time_T, 3> &ctx,
+		phasetimes *times = 0) {
+	typedef sideImageWriter<vec_T, color_T, time_T> writer_t;
 
-	/* Make the string-readerFunction mappings. */
-	readerFuncs["sphere"] = readSphere;
-	readerFuncs["plane"] = readPlane;
-	readerFuncs["cylinder"] = readCylinder;
+	vector<rgbcolor<color_T> > image;
+	gbuffer<vec_T, color_T, time_T, 3> guides;
+	bool aovs = !opts.aovs.empty();
+	renderPixels(opts, sc, cam, width, height, image, ctx,
+			aovs ? &guides : 0);
+	if (times)
+		times->start(PHASE_WRITE);
+	int outWidth, outHeight;
+	outputSize(opts, width, height, outWidth, outHeight);
+	boost::scoped_ptr<writequeue<writer_t> > sideImages;
+	if (!opts.thumbnails.empty() || aovs) {
+		sideImages.reset(new writequeue<writer_t>(1));
+		writer_t writer;
+		writer.opts = &opts;
+		writer.image = &image;
+		writer.width = outWidth;
+		writer.height = outHeight;
+		writer.guides = aovs ? &guides : 0;
+		writer.file = opts.outFile;
+		sideImages->push(writer);
+	}
+	writeImage<color_T, scene<vec_T, color_T, time_T, 3> >(opts, image,
+			outWidth, outHeight, out);
+	return !sideImages || sideImages->finish();
+}
 
-	scene3d scene(shadowsOn);
-	sp_camerad cam;
-	string type;
+/**
+ * Job of the workers of @c renderForked : renders a band of
+ * @c RENDER_TILE_SIZE rows with @c scene::renderCrop , which renders it
+ * exactly as @c renderImage would, into its rows of the shared image.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+struct forkedBandRenderer {
+	/** The scene. */
+	const scene<vec_T, color_T, time_T, 3> *sc;
+	/** The camera in the scene. */
+	const camera<vec_T, time_T, 3> *cam;
+	/** The width of the image in pixels. */
+	int width;
+	/** The height of the image in pixels. */
+	int height;
 
-	while (cin >> type) {
+	void operator()(int band, char *pixels) const {
+		int y0 = band * RENDER_TILE_SIZE;
+		int y1 = min(height, y0 + RENDER_TILE_SIZE);
+		vector<rgbcolor<color_T> > rows;
+		sc->renderCrop(*cam, width, height, 0, y0, width, y1, rows);
+		memcpy(pixels + (size_t) y0 * width * sizeof(rgbcolor<color_T>),
+				&rows[0], rows.size() * sizeof(rgbcolor<color_T>));
+	}
+};
 
-		// If the type is mapped to a shape reader function...
-		if (readerFuncs.find(type) != readerFuncs.end()) {
-			sp_shape3d shape;
-			shape = readerFuncs[type](cin);
-			scene.addShape(shape);
-		}
-		// Otherwise if it's a light...
-		else if (type == "light") {
-			sp_lightd light;
-			light = readLight(cin);
-			scene.addPointLight(light);
-		}
-		// Otherwise if it's a spot light...
-		else if (type == "spotlight") {
-			sp_spotlightd slight;
-			slight = readSpotLight(cin);
-			scene.addSpotLight(slight);
+/**
+ * Renders an image for @c --procs and writes it in the format the options
+ * pick. The scene, loaded and built once, is shared copy-on-write with
+ * that many worker processes of a @c processpool , which render its bands
+ * into an image mapped shared by all of them. A worker that dies only
+ * loses the band it was on, which the next round of workers renders.
+ *
+ * @param opts The command line options.
+ * @param sc The scene.
+ * @param cam The camera in the scene.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param out The output stream.
+ * @param times If not null, @c PHASE_WRITE is started on it once the
+ *   image is rendered.
+ *
+ * @return @c false if the image couldn't be mapped or the workers didn't
+ *   finish it.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+bool renderForked(const renderoptions &opts,
+		const scene<vec_T, color_T, time_T, 3> &sc,
+		const camera<vec_T, time_T, 3> &cam, int width, int height,
+		ostream &out, phasetimes *times = 0) {
+	int bands = (height + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+	size_t bytes = (size_t) width * height * sizeof(rgbcolor<color_T>);
+	processpool pool;
+	if (!pool.open(bands, bytes)) {
+		cerr << "ERROR: can't map the image for --procs." << endl;
+		return false;
+	}
+	forkedBandRenderer<vec_T, color_T, time_T> job;
+	job.sc = &sc;
+	job.cam = &cam;
+	job.width = width;
+	job.height = height;
+	vector<string> deaths;
+	bool done = pool.run(opts.procs, job, deaths);
+	for (size_t i = 0; i < deaths.size(); i++)
+		cerr << "WARNING: " << deaths[i] << "." << endl;
+	if (!done) {
+		cerr << "ERROR: the workers didn't finish the image." << endl;
+		return false;
+	}
+	if (times)
+		times->start(PHASE_WRITE);
+	vector<rgbcolor<color_T> > image((size_t) width * height);
+	memcpy(&image[0], pool.getResults(), bytes);
+	writeImage<color_T, scene<vec_T, color_T, time_T, 3> >(opts, image,
+			width, height, out);
+	return true;
+}
+
+/**
+ * Adds the options that change the pixels or bytes of an image to a hash
+ * of a frame, along with its size and precision.
+ *
+ * @param opts The command line options.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param precisionName Name of the precision.
+ * @param hash The hash.
+ */
+void hashRenderSettings(const renderoptions &opts, int width, int height,
+		const char *precisionName, scenehash &hash) {
+	hash.add(string(precisionName));
+	hash.add(opts.cameraName);
+	const double values[] = { (double) width, (double) height,
+			(double) opts.shadowsOn, (double) opts.maxReflect,
+			opts.minThroughput, opts.lightCutoff, (double) opts.rouletteDepth,
+			opts.clusterRatio, opts.cutError, (double) opts.lightPicks,
+			(double) opts.areaSamples,
+			(double) opts.adaptiveShadows, (double) opts.pixelVisibility,
+			(double) opts.shadowMapRes,
+			opts.shadowMapBias, (double) opts.aaSamples, opts.aaThreshold,
+			(double) opts.pixelSamples, (double) opts.denoisePasses,
+			(double) opts.sampler,
+			(double) opts.format,
+			(double) opts.image, opts.exposure, (double) opts.crop,
+			(double) opts.cropX0, (double) opts.cropY0, (double) opts.cropX1,
+			(double) opts.cropY1 };
+	for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+		hash.add(values[i]);
+}
+
+/**
+ * Set when SIGTERM or SIGINT comes in during @c renderCheckpointed .
+ */
+static volatile sig_atomic_t stopRequested = 0;
+
+/**
+ * Signal handler of @c renderCheckpointed : asks the render to stop.
+ *
+ * @param sig The signal.
+ */
+extern "C" void requestStop(int sig) {
+	stopRequested = 1;
+}
+
+/**
+ * Renders an image for @c --checkpoint and writes it like @c renderFrame .
+ * The tiles left are rendered @c CHECKPOINT_TILES_PER_THREAD per thread at
+ * a time with @c scene::renderTiles , which renders them exactly as
+ * @c renderImage would, and after a batch the tiles done are saved to the
+ * checkpoint file if @c --checkpoint-interval seconds went by since the
+ * last save. With @c --resume the tiles of the file are taken first.
+ * SIGTERM or SIGINT stops the render after the batch under way, with a
+ * last save. The file is removed once the image is written.
+ *
+ * @param opts The command line options.
+ * @param sc The scene.
+ * @param cam The camera in the scene.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param out The output stream.
+ * @param ctx Render context to trace with.
+ * @param key Hash of the scene and settings, which the file must match.
+ * @param times If not null, @c PHASE_WRITE is started on it once the
+ *   image is rendered.
+ *
+ * @return @c false if the file couldn't be read or written, or the render
+ *   was stopped.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+bool renderCheckpointed(const renderoptions &opts,
+		const scene<vec_T, color_T, time_T, 3> &sc,
+		const camera<vec_T, time_T, 3> &cam, int width, int height,
+		ostream &out, rendercontext<vec_T, color_T, time_T, 3> &ctx,
+		const scenehash &key, phasetimes *times = 0) {
+	const string &file = opts.checkpointFile;
+	checkpoint<color_T> saved(key.get(), width, height,
+			CHECKPOINT_TILE_SIZE);
+	vector<rgbcolor<color_T> > image((size_t) width * height);
+	if (opts.resume && fileExists(file)) {
+		ifstream in(file.c_str(), ios::in | ios::binary);
+		ostringstream bytes;
+		bytes << in.rdbuf();
+		string data = bytes.str(), error = "it can't be read.";
+		if (!in || !saved.decode(data.data(), data.size(), image, error)) {
+			cerr << "ERROR: can't resume from \"" << file << "\": " <<
+					error << endl;
+			return false;
 		}
-		// Otherwise if it's an area light...
-		else if (type == "arealight") {
-			sp_arealightd alight;
-			alight = readAreaLight(cin);
-			scene.addAreaLight(alight);
+		if (opts.printStats)
+			cerr << "checkpoint: resumed with " << saved.getDoneCount() <<
+					" of " << saved.getTileCount() << " tiles done" << endl;
+	}
+
+	stopRequested = 0;
+	signal(SIGTERM, requestStop);
+	signal(SIGINT, requestStop);
+	vector<int> left;
+	saved.getTilesLeft(left);
+	size_t batch = (size_t) max(1, opts.threads * CHECKPOINT_TILES_PER_THREAD);
+	boost::posix_time::ptime last =
+			boost::posix_time::microsec_clock::universal_time();
+	bool written = true;
+	for (size_t i = 0; i < left.size() && !stopRequested && written;
+			i += batch) {
+		vector<int> tiles(left.begin() + i,
+				left.begin() + min(i + batch, left.size()));
+		sc.renderTiles(cam, width, height, tiles, image, &ctx,
+				CHECKPOINT_TILE_SIZE);
+		for (size_t k = 0; k < tiles.size(); k++)
+			saved.markDone(tiles[k]);
+		boost::posix_time::ptime now =
+				boost::posix_time::microsec_clock::universal_time();
+		if ((now - last).total_milliseconds() >=
+				opts.checkpointInterval * 1000 && !stopRequested) {
+			written = writeFileAtomically(file, saved.encode(image));
+			last = now;
 		}
-		// Otherwise if the type is camera...
-		else if (type == "camera") {
-			cam = readCamera(cin);
+	}
+	bool done = saved.getDoneCount() == saved.getTileCount();
+	if (written && !done)
+		written = writeFileAtomically(file, saved.encode(image));
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGINT, SIG_DFL);
+	if (!written) {
+		cerr << "ERROR: can't write \"" << file << "\"." << endl;
+		return false;
+	}
+	if (!done) {
+		cerr << "stopped with " << saved.getDoneCount() << " of " <<
+				saved.getTileCount() << " tiles done, saved to \"" << file <<
+				"\"; run again with --resume to finish." << endl;
+		return false;
+	}
+
+	if (times)
+		times->start(PHASE_WRITE);
+	writeImage<color_T, scene<vec_T, color_T, time_T, 3> >(opts, image,
+			width, height, out);
+	out.flush();
+	if (out)
+		remove(file.c_str());
+	return true;
+}
+
+/**
+ * Puts the settings of a quality level of a @c --time-budget into a scene.
+ *
+ * @param opts The command line options.
+ * @param sc The scene.
+ * @param q The level.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+void applyQuality(const renderoptions &opts,
+		scene<vec_T, color_T, time_T, 3> &sc, const qualitylevel &q) {
+	sc.setPixelSamples(q.pixelSamples);
+	sc.setSupersampling(q.aaSamples, opts.aaThreshold);
+	sc.setReflectionLimits(q.maxReflect, opts.minThroughput);
+	if (q.areaSamples > 0)
+		sc.setAreaLightMode(AREA_LIGHT_SAMPLED, q.areaSamples);
+}
+
+/**
+ * Renders an image within a @c --time-budget and writes it. The cheapest
+ * level of the budget is first rendered at a fraction of the size as a
+ * probe to measure the scene. Then the best level whose estimate fits in
+ * the time left is probed too if it hasn't been, which may rule it out,
+ * and once one that fits has been measured it's rendered at full size;
+ * better ones follow while they still fit. The image written is that of
+ * the last pass that finished, or the best probe blown up if not even the
+ * cheapest level fits.
+ *
+ * @param opts The command line options.
+ * @param sc The scene.
+ * @param cam The camera in the scene.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param out The output stream.
+ * @param ctx Render context to trace with.
+ * @param budget The budget, whose clock started with the render.
+ * @param times If not null, @c PHASE_WRITE is started on it once the
+ *   image is rendered.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+void renderBudgeted(const renderoptions &opts,
+		scene<vec_T, color_T, time_T, 3> &sc,
+		const camera<vec_T, time_T, 3> &cam, int width, int height,
+		ostream &out, rendercontext<vec_T, color_T, time_T, 3> &ctx,
+		timebudget &budget, phasetimes *times = 0) {
+	const vector<qualitylevel> &levels = budget.getLevels();
+	int pw = max(1, width / TIMEBUDGET_PROBE_SCALE);
+	int ph = max(1, height / TIMEBUDGET_PROBE_SCALE);
+	long pixels = (long) width * height;
+	vector<rgbcolor<color_T> > probe, image, pass;
+	int probed = -1, done = -1, passes = 0;
+	for (int next = 0; next >= 0; next = budget.pickLevel(done + 1, pixels,
+			budget.getElapsed())) {
+		bool full = budget.isMeasured(next);
+		applyQuality(opts, sc, levels[next]);
+		double began = budget.getElapsed();
+		renderPixels(opts, sc, cam, full ? width : pw, full ? height : ph,
+				pass, ctx);
+		budget.measure(next, full ? pixels : (long) pw * ph,
+				budget.getElapsed() - began);
+		if (!full) {
+			if (next > probed) {
+				probe.swap(pass);
+				probed = next;
+			}
+			continue;
 		}
-		// Otherwise if we see the scene description's end...
-		else if (type == "end") {
+		image.swap(pass);
+		done = next;
+		passes++;
+		if (done + 1 == (int) levels.size())
 			break;
-		}
-		// Otherwise if the "type" is a comment start character...
-		// Note that comments must begin with a # AND a space, like "# ",
-		// and that the "# " must be at the beginning of the line.
-		else if (type == "#") {
-			string throwaway;
-			getline(cin, throwaway);
-		}
-		// Otherwise we have an unrecognized type, which is an error.
-		else {
-			cerr << "ERROR: \"" << type << "\" is not a recognized scene " <<
-					"description type." << endl;
-			return 1;
-		}
 	}
+	if (done < 0) {
+		image.resize((size_t) pixels);
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++)
+				image[(size_t) y * width + x] =
+						probe[(size_t) (y * ph / height) * pw + x * pw / width];
+	}
+	if (opts.printStats) {
+		cerr << "time budget: ";
+		if (done < 0)
+			cerr << "the probe, " << levels[probed];
+		else
+			cerr << "level " << done + 1 << " of " << levels.size() << ", " <<
+					levels[done] << ", " << passes <<
+					(passes == 1 ? " pass" : " passes");
+		cerr << ", " << (int) (budget.getElapsed() * 1000) << " of " <<
+				(int) (budget.getBudget() * 1000) << " ms" << endl;
+	}
+	if (times)
+		times->start(PHASE_WRITE);
+	writeImage<color_T, scene<vec_T, color_T, time_T, 3> >(opts, image,
+			width, height, out);
+}
 
-	/* Render width x height image of this scene. */
-	scene.renderPPM(*cam, width, height, cout);
+/**
+ * Prints the statistics of a render for @c --stats .
+ *
+ * @param opts The command line options.
+ * @param sc The scene.
+ * @param ctx Render context that was traced with.
+ * @param precisionName Name of the precision.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+void printRenderStats(const renderoptions &opts,
+		const scene<vec_T, color_T, time_T, 3> &sc,
+		const rendercontext<vec_T, color_T, time_T, 3> &ctx,
+		const char *precisionName) {
+	cerr << "simd: " << simdLevelName(activeSimdLevel()) << endl;
+	cerr << "precision: " << precisionName << endl;
+	cerr << "threads: " << opts.threads << endl;
+	if (opts.pinThreads)
+		threadpin::printStats(cerr);
+	if (sc.getAccelerator() != 0)
+		cerr << "accelerator: " << *sc.getAccelerator() << ", " <<
+				sc.getAccelerator()->getMemoryUsage() << " bytes" << endl;
+	ctx.printStats(cerr);
+	sc.printWavefrontPools(cerr);
+	if (hugepages::isEnabled())
+		hugepages::printStats(cerr);
+#ifdef RT_STATS
+	raystats::total().print(cerr);
+#endif
+}
 
-	return 0;
+/**
+ * Prints the memory the scene and the image of a render take for
+ * @c --mem-report : the shapes by type, the accelerator, the lights and
+ * the framebuffer the options render into, which is a strip of the image
+ * with @c --strips and the whole image otherwise.
+ *
+ * @param opts The command line options.
+ * @param sc The scene, finalized.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+void reportMemory(const renderoptions &opts,
+		const scene<vec_T, color_T, time_T, 3> &sc, int width, int height) {
+	memoryreport report;
+	scenememory<vec_T, color_T, time_T>().addScene(report, sc);
+	int rows = height;
+	if (opts.stripRows > 0)
+		rows = min(height, (opts.stripRows + RENDER_TILE_SIZE - 1) /
+				RENDER_TILE_SIZE * RENDER_TILE_SIZE);
+	size_t pixel = opts.storage == PIXELS_FULL ? sizeof(rgbcolor<color_T>) :
+			3 * sizeof(unsigned short);
+	report.add("framebuffer", 1, (size_t) width * rows * pixel);
+	report.print(cerr);
+}
+
+/**
+ * Writes the cost map of a render for @c --heatmap as a false color
+ * image, in the format the extension of its name picks or else as raw PPM.
+ *
+ * @param opts The command line options.
+ * @param cost The cost of every pixel.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ *
+ * @return @c false if the file couldn't be written.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+bool writeHeatmap(const renderoptions &opts, const vector<double> &cost,
+		int width, int height) {
+	renderoptions heat = opts;
+	heat.image = imageFormatOf(opts.heatmapFile, IMAGE_PPM);
+	heat.format = PPM_P6;
+	heat.exposure = 1;
+	vector<rgbcolor<color_T> > image;
+	heatmapImage(cost, image);
+	ofstream file(opts.heatmapFile.c_str(), ios::out | ios::binary);
+	if (file)
+		writeImage<color_T, scene<vec_T, color_T, time_T, 3> >(heat, image,
+				width, height, file);
+	file.close();
+	if (!file) {
+		cerr << "ERROR: can't write \"" << opts.heatmapFile << "\"." << endl;
+		return false;
+	}
+	if (opts.printStats)
+		cerr << "heatmap: the costliest 10% of pixels take " <<
+				100 * costliestShare(cost, 0.1) << "% of the " <<
+				(opts.heatmapCost == COST_TESTS ? "tests" : "cycles") << endl;
+	return true;
+}
+
+/**
+ * Writes the phase times of a render to the @c --stats-json file, with the
+ * image size, thread count and precision, and the ray counts of a build
+ * with @c RT_STATS .
+ *
+ * @param opts The command line options.
+ * @param times The times, with no phase running.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param precisionName Name of the precision.
+ *
+ * @return @c false if the file couldn't be written.
+ */
+bool writeStatsJson(const renderoptions &opts, const phasetimes &times,
+		int width, int height, const char *precisionName) {
+	ostringstream fields;
+	fields << "\"width\": " << width << ", \"height\": " << height <<
+			", \"threads\": " << opts.threads << ", \"precision\": \"" <<
+			precisionName << "\"";
+	ofstream file(opts.statsJson.c_str(), ios::out | ios::binary);
+#ifdef RT_STATS
+	raystats rays = raystats::total();
+	times.writeJson(file, fields.str(), &rays);
+#else
+	times.writeJson(file, fields.str(), 0);
+#endif
+	file.close();
+	if (!file) {
+		cerr << "ERROR: can't write \"" << opts.statsJson << "\"." << endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Number of shapes and of lights in the @c --profile-json file without
+ * @c --profile-shapes .
+ */
+#define PROFILE_DEFAULT_TOP 10
+
+/**
+ * Prints the costliest shapes and lights of a render for
+ * @c --profile-shapes and writes them to the @c --profile-json file, and
+ * stops profiling.
+ *
+ * @param opts The command line options.
+ * @param sc The scene that was rendered.
+ *
+ * @return @c false if the file couldn't be written.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+bool reportShapeProfile(const renderoptions &opts,
+		const scene<vec_T, color_T, time_T, 3> &sc) {
+	shapeprofile::setEnabled(false);
+	vector<profilerow> shapeRows, lightRows;
+	sc.getProfileRows(shapeprofile::total(), shapeRows, lightRows);
+#ifdef RT_STATS
+	bool tests = true;
+#else
+	bool tests = false;
+#endif
+	if (opts.profileTop > 0) {
+		printProfileRows(cerr, shapeRows, opts.profileTop, false);
+		printProfileRows(cerr, lightRows, opts.profileTop, true);
+		if (!tests)
+			cerr << "(intersection tests are only counted by a build with"
+					" RT_STATS, like srt)" << endl;
+	}
+	if (opts.profileJson.empty())
+		return true;
+	int top = opts.profileTop > 0 ? opts.profileTop : PROFILE_DEFAULT_TOP;
+	ofstream file(opts.profileJson.c_str(), ios::out | ios::binary);
+	file << "{\"tests_counted\": " << (tests ? "true" : "false") <<
+			", \"shapes\": ";
+	writeProfileJson(file, shapeRows, top, false);
+	file << ", \"lights\": ";
+	writeProfileJson(file, lightRows, top, true);
+	file << "}" << endl;
+	file.close();
+	if (!file) {
+		cerr << "ERROR: can't write \"" << opts.profileJson << "\"." << endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Writes the timeline of a render to the @c --trace file.
+ *
+ * @param opts The command line options.
+ * @param trace The timeline, to which no spans are being added.
+ *
+ * @return @c false if the file couldn't be written.
+ */
+bool writeTrace(const renderoptions &opts, const tracelog &trace) {
+	ofstream file(opts.traceFile.c_str(), ios::out | ios::binary);
+	trace.writeJson(file);
+	file.close();
+	if (!file) {
+		cerr << "ERROR: can't write \"" << opts.traceFile << "\"." << endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Reads the scene description with @c loadScene then renders it to @c cout
+ * or the @c -o file with
+ * the given scalar types, which @c main picks by the @c --precision option.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ *
+ * @param opts The command line options.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param precisionName Name of the precision for the statistics.
+ *
+ * @return The exit status of the program.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+int renderScene(const renderoptions &opts, int width, int height,
+		const char *precisionName) {
+	typedef scene<vec_T, color_T, time_T, 3> scene_t;
+
+	boost::scoped_ptr<timebudget> budget;
+	if (opts.timeBudget > 0) {
+		// The clock starts before the scene is read, since the image is
+		// due that long after the request.
+		qualitylevel best = { opts.pixelSamples, opts.aaSamples,
+				opts.maxReflect, opts.areaSamples };
+		budget.reset(new timebudget(opts.timeBudget / 1000, best));
+	}
+	phasetimes times;
+	tracelog trace;
+	if (!opts.traceFile.empty())
+		times.setTraceLog(&trace);
+	boost::scoped_ptr<perfcounters> counters;
+	if (opts.perfCounters) {
+		// Opened first, so they count every thread the render starts.
+		counters.reset(new perfcounters(true));
+		if (!counters->anyCounting())
+			cerr << "WARNING: no hardware performance counters can be read"
+					" here." << endl;
+		times.setCounters(counters.get());
+		trace.setCountTasks(true);
+	}
+	times.start(PHASE_PARSE);
+	scene_t scene(opts.shadowsOn);
+	configureScene(opts, scene);
+	if (!opts.traceFile.empty())
+		scene.setTraceLog(&trace);
+	boost::shared_ptr<camera<vec_T, time_T, 3> > cam;
+	scenehash key;
+	bool checkpointing = !opts.checkpointFile.empty();
+	if (!loadScene<vec_T, color_T, time_T>(opts, scene, cam, 0, 0,
+			checkpointing ? &key : 0, &times))
+		return 1;
+	if (checkpointing)
+		hashRenderSettings(opts, width, height, precisionName, key);
+	if (opts.memReport)
+		reportMemory(opts, scene, width, height);
+	netchannel previewChannel;
+	boost::scoped_ptr<previewstream<color_T> > preview;
+	if (opts.previewPort >= 0) {
+		if (!openPreview(opts.previewPort, previewChannel))
+			return 1;
+		preview.reset(new previewstream<color_T>(&previewChannel, width,
+				height, (color_T) opts.exposure));
+	}
+	times.start(PHASE_RENDER);
+
+	/* Render width x height image of this scene. */
+	ofstream file;
+	if (!opts.outFile.empty() && !opts.mapOutput) {
+		file.open(opts.outFile.c_str(), ios::out | ios::binary);
+		if (!file) {
+			cerr << "ERROR: can't write \"" << opts.outFile << "\"." <<
+					endl;
+			return 1;
+		}
+	}
+	ostream &out = opts.outFile.empty() ? cout : file;
+	rendercontext<vec_T, color_T, time_T, 3> ctx;
+	vector<double> cost;
+	if (!opts.heatmapFile.empty())
+		scene.setCostMap(&cost, opts.heatmapCost);
+	bool profiling = opts.profileTop > 0 || !opts.profileJson.empty();
+	if (profiling) {
+		shapeprofile::reset();
+		shapeprofile::setEnabled(true);
+	}
+	if (opts.mapOutput) {
+		if (!renderMapped(opts, scene, *cam, width, height, ctx))
+			return 1;
+	}
+	else if (opts.storage != PIXELS_FULL) {
+		renderCompact(opts, scene, *cam, width, height, out, ctx, &times);
+	}
+	else if (opts.stripRows > 0) {
+		if (opts.image == IMAGE_EXR)
+			out << framebuffer<color_T>::exrHeader(width, height);
+		else
+			scene_t::writePPMHeader(width, height, out, opts.format);
+		stripWriter<color_T, scene_t> writer;
+		writer.opts = &opts;
+		writer.os = &out;
+		writer.preview = preview.get();
+		scene.renderStrips(*cam, width, height, opts.stripRows, writer,
+				&ctx);
+	}
+	else if (opts.stream) {
+		scene_t::writePPMHeader(width, height, out, opts.format);
+		bandWriter<color_T, scene_t> writer;
+		writer.opts = &opts;
+		writer.os = &out;
+		writer.preview = preview.get();
+		scene.renderStreaming(*cam, width, height, writer, &ctx);
+	}
+	else if (opts.progressive) {
+		file.close();
+		passWriter<color_T, scene_t> writer;
+		writer.opts = &opts;
+		writer.preview = preview.get();
+		scene.renderProgressive(*cam, width, height, writer, &ctx);
+	}
+	else if (checkpointing) {
+		if (!renderCheckpointed(opts, scene, *cam, width, height, out, ctx,
+				key, &times))
+			return 1;
+	}
+	else if (budget) {
+		renderBudgeted(opts, scene, *cam, width, height, out, ctx, *budget,
+				&times);
+	}
+	else if (opts.procs > 0) {
+		if (!renderForked(opts, scene, *cam, width, height, out, &times))
+			return 1;
+	}
+	else if (!renderFrame(opts, scene, *cam, width, height, out, ctx,
+			&times)) {
+		return 1;
+	}
+	times.start(PHASE_WRITE);
+	out.flush();
+	if (preview)
+		preview->sendDone();
+	if (!opts.heatmapFile.empty() &&
+			!writeHeatmap<vec_T, color_T, time_T>(opts, cost, width, height))
+		return 1;
+	if (profiling && !reportShapeProfile(opts, scene))
+		return 1;
+	times.stop();
+	if (!opts.statsJson.empty() && !writeStatsJson(opts, times, width,
+			height, precisionName))
+		return 1;
+	if (!opts.traceFile.empty() && !writeTrace(opts, trace))
+		return 1;
+	int failed = reportGeometry(scene, opts.printStats);
+	if (opts.printStats)
+		printRenderStats(opts, scene, ctx, precisionName);
+
+	return failed > 0 ? 1 : 0;
+}
+
+/**
+ * Replaces every occurrence of a field such as %c in an @c -o name.
+ *
+ * @param pattern The @c -o name.
+ * @param field The field.
+ * @param value What replaces it.
+ *
+ * @return The file name.
+ */
+string fillFileName(const string &pattern, const string &field,
+		const string &value) {
+	string file = pattern;
+	for (size_t at = file.find(field); at != string::npos;
+			at = file.find(field, at + value.size()))
+		file.replace(at, field.size(), value);
+	return file;
+}
+
+/**
+ * Names the file a camera of @c --cameras renders to: the @c -o name with
+ * every %c replaced by the name of the camera, or by its number counting
+ * from 1 if it has none.
+ *
+ * @param pattern The @c -o name.
+ * @param name The name of the camera.
+ * @param index Index of the camera in the scene.
+ *
+ * @return The file name.
+ */
+string cameraFileName(const string &pattern, const string &name,
+		size_t index) {
+	ostringstream label;
+	if (name.empty())
+		label << index + 1;
+	else
+		label << name;
+	return fillFileName(pattern, "%c", label.str());
+}
+
+/**
+ * Names the file a frame of @c --frames renders to: the @c -o name with
+ * every %f replaced by the frame number, padded with zeros to four digits.
+ *
+ * @param pattern The @c -o name.
+ * @param frame The frame.
+ *
+ * @return The file name.
+ */
+string frameFileName(const string &pattern, int frame) {
+	ostringstream label;
+	label << setw(4) << setfill('0') << frame;
+	return fillFileName(pattern, "%f", label.str());
+}
+
+/**
+ * Reads the range of frames @c --frames takes, "first:last".
+ *
+ * @param arg The argument.
+ * @param[out] first Receives the first frame.
+ * @param[out] last Receives the last frame, no less than the first.
+ *
+ * @return @c false if the argument isn't a range of frames from 0 on.
+ */
+bool parseFrameRange(const string &arg, int &first, int &last) {
+	size_t colon = arg.find(':');
+	if (colon == string::npos || colon == 0 || colon + 1 == arg.size() ||
+			arg.find_first_not_of("0123456789:") != string::npos ||
+			arg.find(':', colon + 1) != string::npos)
+		return false;
+	first = atoi(arg.substr(0, colon).c_str());
+	last = atoi(arg.substr(colon + 1).c_str());
+	return first <= last;
+}
+
+/**
+ * Reads the size @c --thumbnail takes, "widthxheight".
+ *
+ * @param arg The argument.
+ * @param[out] width Receives the width.
+ * @param[out] height Receives the height.
+ *
+ * @return @c false if the argument isn't a size of at least 1 x 1.
+ */
+bool parseThumbnailSize(const string &arg, int &width, int &height) {
+	size_t x = arg.find('x');
+	if (x == string::npos || x == 0 || x + 1 == arg.size() ||
+			arg.find_first_not_of("0123456789x") != string::npos ||
+			arg.find('x', x + 1) != string::npos)
+		return false;
+	width = atoi(arg.substr(0, x).c_str());
+	height = atoi(arg.substr(x + 1).c_str());
+	return width > 0 && height > 0;
+}
+
+/**
+ * Adds a thumbnail size to the options, unless it's there already.
+ *
+ * @param[in,out] opts The options.
+ * @param width The width of the thumbnail in pixels.
+ * @param height The height of the thumbnail in pixels.
+ */
+void addThumbnail(renderoptions &opts, int width, int height) {
+	pair<int, int> size(width, height);
+	if (find(opts.thumbnails.begin(), opts.thumbnails.end(), size) ==
+			opts.thumbnails.end())
+		opts.thumbnails.push_back(size);
+}
+
+/**
+ * Writes one frame of @c --frames or camera of @c --cameras , and its
+ * thumbnails, on the thread of a @c writequeue , so the next frames can
+ * render while it's encoded.
+ * With a @c --frame-cache the file is then copied into the cache and the
+ * claim on the frame given up.
+ *
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam scene_T The scene type, for @c writeImage .
+ */
+template<typename color_T, typename scene_T>
+struct frameWriter {
+	/** The command line options. */
+	const renderoptions *opts;
+	/** The colors of the pixels, which mustn't change until it's done. */
+	const vector<rgbcolor<color_T> > *image;
+	/** The width of the image in pixels. */
+	int width;
+	/** The height of the image in pixels. */
+	int height;
+	/** Where to write the image. */
+	string file;
+	/** Where to copy it in the cache, or empty for no cache. */
+	string cacheFile;
+	/** The claims, if there's a cache. */
+	frameclaims *claims;
+	/** The lock file of the claim on the frame. */
+	string claimFile;
+
+	bool operator()() const {
+		ofstream out(file.c_str(), ios::out | ios::binary);
+		if (out)
+			writeImage<color_T, scene_T>(*opts, *image, width, height, out);
+		out.close();
+		bool ok = !out.fail();
+		if (!ok)
+			cerr << "ERROR: can't write \"" << file << "\"." << endl;
+		if (ok && !opts->thumbnails.empty())
+			ok = writeThumbnails<color_T, scene_T>(*opts, *image, width,
+					height, file);
+		if (ok && !cacheFile.empty() && !copyFile(file, cacheFile))
+			cerr << "WARNING: can't write \"" << cacheFile << "\"." << endl;
+		if (claims)
+			claims->release(claimFile);
+		return ok;
+	}
+};
+
+/**
+ * Prints the statistics of the @c writequeue of @c --frames or
+ * @c --cameras for @c --stats .
+ *
+ * @param queue The queue, after @c writequeue::finish .
+ */
+template<typename job_T>
+void printWriterStats(writequeue<job_T> &queue) {
+	cerr << "writer: " << queue.getWritten() << " images, rendering " <<
+			"waited for it " << queue.getStalls() << " times (queue depth " <<
+			queue.getDepth() << ")" << endl;
+}
+
+/**
+ * Gets the name of a frame in the @c --frame-cache : the hash of the
+ * scene and settings with where the keyed objects are at the frame,
+ * with the extension of the @c -o file.
+ *
+ * @param opts The command line options.
+ * @param settings The hash of the scene with @c hashSceneRecords and of
+ *   the settings with @c hashRenderSettings .
+ * @param anim The keys of the objects, set to the frame.
+ *
+ * @return The file name.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+string frameCacheName(const renderoptions &opts, const scenehash &settings,
+		const animation<vec_T, color_T, time_T> &anim) {
+	scenehash hash = settings;
+	for (int i = 0; i < anim.getTrackCount(); i++) {
+		mvector<vec_T, 3> pos = anim.getTrackPosition(i);
+		for (int k = 0; k < 3; k++)
+			hash.add((double) pos[k]);
+	}
+	size_t dot = opts.outFile.rfind('.');
+	size_t slash = opts.outFile.rfind('/');
+	string ext = dot == string::npos || (slash != string::npos &&
+			dot < slash) ? "" : opts.outFile.substr(dot);
+	return opts.frameCache + "/" + hash.toString() + ext;
+}
+
+/**
+ * Notes for @c scene::findDirtyTiles what an @c animation moved since the
+ * frame last rendered: the boxes a keyed shape left and entered, or the
+ * whole image once a light or the camera moved.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ *
+ * @param sc The scene.
+ * @param anim The keys, set to the frame about to be rendered.
+ * @param[in,out] last Where each keyed object was at the frame last
+ *   rendered, which is set to where it is now.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+void noteAnimationEdits(scene<vec_T, color_T, time_T, 3> &sc,
+		const animation<vec_T, color_T, time_T> &anim,
+		vector<mvector<vec_T, 3> > &last) {
+	for (int i = 0; i < anim.getTrackCount(); i++) {
+		mvector<vec_T, 3> now = anim.getTrackPosition(i);
+		mvector<vec_T, 3> back = last[i] - now;
+		last[i] = now;
+		if (back.magsq() == 0)
+			continue;
+		int kind = anim.getTrackKind(i);
+		aabb<vec_T, 3> after;
+		if ((kind != RECORD_SPHERE && kind != RECORD_CYLINDER) ||
+				!static_cast<const shape<vec_T, color_T, time_T, 3> *>(
+				anim.getTrackObject(i).get())->getBounds(after)) {
+			sc.noteEditAll();
+			continue;
+		}
+		sc.noteShapeMoved(aabb<vec_T, 3>(after.getMin() + back,
+				after.getMax() + back), after);
+	}
+}
+
+/**
+ * Tells if an @c animation moved a keyed shape since the frame last
+ * rendered, for @c --reproject , which needs the same shapes.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ *
+ * @param anim The keys, set to the frame about to be rendered.
+ * @param[in,out] last Where each keyed object was at the frame last
+ *   rendered, or empty before the first, which is set to where it is now.
+ *
+ * @return @c true if a shape moved or nothing was rendered yet.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+bool shapesMoved(const animation<vec_T, color_T, time_T> &anim,
+		vector<mvector<vec_T, 3> > &last) {
+	bool moved = last.empty();
+	last.resize(anim.getTrackCount());
+	for (int i = 0; i < anim.getTrackCount(); i++) {
+		mvector<vec_T, 3> now = anim.getTrackPosition(i);
+		int kind = anim.getTrackKind(i);
+		if ((kind == RECORD_SPHERE || kind == RECORD_CYLINDER) &&
+				(last[i] - now).magsq() != 0)
+			moved = true;
+		last[i] = now;
+	}
+	return moved;
+}
+
+/**
+ * Loads the scene once and renders the frames of its @c animation that
+ * @c --frames picks, each to its own file as @c frameFileName names it.
+ * Between frames the keyed objects are moved and the acceleration
+ * structure is refit instead of rebuilt, and frames are written on a
+ * @c writequeue of @c --write-queue frames while the next ones render.
+ *
+ * With a @c --frame-cache directory, every frame is also kept there by a
+ * hash of the scene, the settings and where the keyed objects are at the
+ * frame, and a frame found there is copied instead of rendered, so editing
+ * a key only renders the frames it changes again. The directory is also
+ * the work list of the nodes of a farm that render the same frames: a
+ * node claims each frame in it before rendering, skips frames other nodes
+ * hold until it has done the rest, and then takes them from the cache once
+ * they're done, or over if their node stopped touching its claim for
+ * @c --lease-timeout seconds.
+ *
+ * With @c --reuse-tiles a frame starts as a copy of the frame rendered
+ * before it, and only the tiles @c noteAnimationEdits says the keyed
+ * objects that moved may have changed are rendered again, so frames where
+ * little moves cost little.
+ *
+ * With @c --reproject the frames are rendered in stages as by
+ * @c --wavefront , and while no keyed shape moves, most camera hits of a
+ * frame are reprojected from the G-buffer of the frame before with
+ * @c scene::reprojectGBuffer ; every @c --reproject th frame, and every
+ * frame a shape moved in, is traced whole.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ *
+ * @param opts The command line options.
+ * @param width The width of the images in pixels.
+ * @param height The height of the images in pixels.
+ * @param precisionName Name of the precision for the statistics.
+ *
+ * @return The exit status of the program.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+int renderFrames(const renderoptions &opts, int width, int height,
+		const char *precisionName) {
+	typedef scene<vec_T, color_T, time_T, 3> scene_t;
+
+	scene_t scene(opts.shadowsOn);
+	configureScene(opts, scene);
+	boost::shared_ptr<camera<vec_T, time_T, 3> > cam;
+	vector<scenecamera<vec_T, time_T> > cameras;
+	animation<vec_T, color_T, time_T> anim;
+	scenehash settings;
+	bool caching = !opts.frameCache.empty();
+	if (!loadScene(opts, scene, cam, &cameras, &anim,
+			caching ? &settings : 0))
+		return 1;
+	hashRenderSettings(opts, width, height, precisionName, settings);
+
+	frameclaims claims(opts.leaseTimeout);
+	rendercontext<vec_T, color_T, time_T, 3> ctx;
+	// One image per frame the queue may hold, and one to render into.
+	vector<vector<rgbcolor<color_T> > > images(opts.writeQueue + 1);
+	int slot = 0, rendered = 0, cached = 0;
+	// With --reuse-tiles, the slot of the frame rendered last and where the
+	// keyed objects were in it.
+	int lastSlot = -1;
+	vector<mvector<vec_T, 3> > lastPositions;
+	long tilesReused = 0, tilesTotal = 0;
+	// With --reproject, the G-buffers of this frame and the one before,
+	// and how many frames in a row were reprojected.
+	gbuffer<vec_T, color_T, time_T, 3> gbs[2];
+	int gbSlot = 0, reprojectedRun = 0;
+	long pixelsReprojected = 0, pixelsTotal = 0;
+	int tileCount = ((width + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE) *
+			((height + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE);
+	writequeue<frameWriter<color_T, scene_t> > queue(opts.writeQueue);
+	vector<int> frames;
+	for (int frame = opts.firstFrame; frame <= opts.lastFrame; frame++)
+		frames.push_back(frame);
+	while (!frames.empty()) {
+		vector<int> held;
+		bool progress = false;
+		for (size_t i = 0; i < frames.size(); i++) {
+			int frame = frames[i];
+			anim.setFrame((vec_T) frame);
+			string file = frameFileName(opts.outFile, frame);
+			string cacheFile = caching ?
+					frameCacheName(opts, settings, anim) : "";
+			string claimFile = cacheFile + ".lock";
+			if (caching && !fileExists(cacheFile) && !claims.claim(claimFile)) {
+				held.push_back(frame);
+				continue;
+			}
+			progress = true;
+			if (caching && fileExists(cacheFile)) {
+				claims.release(claimFile);
+				if (!copyFile(cacheFile, file)) {
+					queue.finish();
+					cerr << "ERROR: can't write \"" << file << "\"." << endl;
+					return 1;
+				}
+				cached++;
+				continue;
+			}
+
+			// The queue is done with the frame that last used the slot.
+			vector<rgbcolor<color_T> > &image = images[slot];
+			int imageSlot = slot;
+			slot = (slot + 1) % (int) images.size();
+			if (!anim.empty())
+				scene.refit();
+			if (opts.reuseTiles && lastSlot >= 0) {
+				// The queue only reads the last frame, so it can be copied.
+				noteAnimationEdits(scene, anim, lastPositions);
+				image = images[lastSlot];
+				tilesReused += tileCount - scene.renderEdits(*cam, width,
+						height, image, &ctx);
+			}
+			else if (opts.reproject > 0) {
+				gbuffer<vec_T, color_T, time_T, 3> &gb = gbs[gbSlot];
+				const gbuffer<vec_T, color_T, time_T, 3> &before =
+						gbs[1 - gbSlot];
+				gbSlot = 1 - gbSlot;
+				if (!shapesMoved(anim, lastPositions) &&
+						reprojectedRun + 1 < opts.reproject) {
+					pixelsReprojected += scene.reprojectGBuffer(*cam, width,
+							height, before, gb);
+					reprojectedRun++;
+				}
+				else {
+					scene.renderGBuffer(*cam, width, height, gb);
+					reprojectedRun = 0;
+				}
+				pixelsTotal += (long) width * height;
+				scene.shadeWavefront(gb, image, &ctx);
+				scene.supersample(*cam, gb, image, &ctx);
+			}
+			else {
+				renderPixels(opts, scene, *cam, width, height, image, ctx);
+				lastPositions.clear();
+				for (int t = 0; t < anim.getTrackCount(); t++)
+					lastPositions.push_back(anim.getTrackPosition(t));
+			}
+			lastSlot = imageSlot;
+			tilesTotal += tileCount;
+			rendered++;
+			frameWriter<color_T, scene_t> writer;
+			writer.opts = &opts;
+			writer.image = &image;
+			outputSize(opts, width, height, writer.width, writer.height);
+			writer.file = file;
+			writer.cacheFile = cacheFile;
+			writer.claims = caching ? &claims : 0;
+			writer.claimFile = claimFile;
+			if (!queue.push(writer)) {
+				queue.finish();
+				return 1;
+			}
+		}
+		frames.swap(held);
+		// Everything left is held by other nodes; give them time.
+		if (!progress)
+			boost::this_thread::sleep(boost::posix_time::seconds(1));
+	}
+	if (!queue.finish())
+		return 1;
+	int failed = reportGeometry(scene, opts.printStats);
+	if (opts.printStats) {
+		printRenderStats(opts, scene, ctx, precisionName);
+		printWriterStats(queue);
+		if (caching)
+			cerr << "frames: " << rendered << " rendered, " << cached <<
+					" from the cache" << endl;
+		if (opts.reuseTiles)
+			cerr << "reuse: " << tilesReused << " of " << tilesTotal <<
+					" tiles copied from the frame before" << endl;
+		if (opts.reproject > 0)
+			cerr << "reprojection: " << pixelsReprojected << " of " <<
+					pixelsTotal << " camera hits from the frame before" <<
+					endl;
+	}
+
+	return failed > 0 ? 1 : 0;
+}
+
+/**
+ * Loads the scene once and renders it from every one of its cameras, each
+ * to its own file as @c cameraFileName names it. The objects, the
+ * acceleration structure and the render threads are shared by all the
+ * images, so each camera only costs its render, and images are written on
+ * a @c writequeue while the next ones render.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ *
+ * @param opts The command line options.
+ * @param width The width of the images in pixels.
+ * @param height The height of the images in pixels.
+ * @param precisionName Name of the precision for the statistics.
+ *
+ * @return The exit status of the program.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+int renderCameras(const renderoptions &opts, int width, int height,
+		const char *precisionName) {
+	typedef scene<vec_T, color_T, time_T, 3> scene_t;
+
+	scene_t scene(opts.shadowsOn);
+	configureScene(opts, scene);
+	boost::shared_ptr<camera<vec_T, time_T, 3> > cam;
+	vector<scenecamera<vec_T, time_T> > cameras;
+	if (!loadScene(opts, scene, cam, &cameras))
+		return 1;
+
+	rendercontext<vec_T, color_T, time_T, 3> ctx;
+	vector<vector<rgbcolor<color_T> > > images(opts.writeQueue + 1);
+	writequeue<frameWriter<color_T, scene_t> > queue(opts.writeQueue);
+	for (size_t i = 0; i < cameras.size(); i++) {
+		vector<rgbcolor<color_T> > &image = images[i % images.size()];
+		renderPixels(opts, scene, *cameras[i].cam, width, height, image,
+				ctx);
+		frameWriter<color_T, scene_t> writer;
+		writer.opts = &opts;
+		writer.image = &image;
+		outputSize(opts, width, height, writer.width, writer.height);
+		writer.file = cameraFileName(opts.outFile, cameras[i].name, i);
+		writer.claims = 0;
+		if (!queue.push(writer)) {
+			queue.finish();
+			return 1;
+		}
+	}
+	if (!queue.finish())
+		return 1;
+	int failed = reportGeometry(scene, opts.printStats);
+	if (opts.printStats) {
+		printRenderStats(opts, scene, ctx, precisionName);
+		printWriterStats(queue);
+	}
+
+	return failed > 0 ? 1 : 0;
+}
+
+/**
+ * Lines read from @c stdin for @c serveScene and @c viewScene , handed
+ * from the thread that reads them to the one that renders.
+ */
+struct viewinput {
+	/** Lines read and not yet taken. */
+	deque<string> lines;
+	/** When the oldest of @c lines came in. */
+	boost::posix_time::ptime since;
+	/** Whether @c stdin has ended. */
+	bool closed;
+	/** Set with every line that comes in, to stop the render under way. */
+	boost::atomic<bool> cancel;
+	/** Guards everything above but @c cancel . */
+	boost::mutex lock;
+	/** Signaled when a line comes in or @c stdin ends. */
+	boost::condition_variable changed;
+};
+
+/**
+ * Functor of the thread of @c serveScene and @c viewScene that reads
+ * @c stdin .
+ */
+struct viewReader {
+	/** Where the lines go. */
+	viewinput *input;
+
+	void operator()() const {
+		string line;
+		while (getline(cin, line)) {
+			boost::lock_guard<boost::mutex> guard(input->lock);
+			if (input->lines.empty())
+				input->since =
+						boost::posix_time::microsec_clock::universal_time();
+			input->lines.push_back(line);
+			input->cancel.store(true);
+			input->changed.notify_all();
+		}
+		boost::lock_guard<boost::mutex> guard(input->lock);
+		input->closed = true;
+		input->changed.notify_all();
+	}
+};
+
+/**
+ * Writes the replies of @c serveScene to @c stdout a line at a time, from
+ * whichever of its threads has one.
+ */
+struct servereplies {
+	/** Keeps the lines of the threads apart. */
+	boost::mutex lock;
+
+	/**
+	 * Writes a line.
+	 *
+	 * @param line The line, without its newline.
+	 */
+	void send(const string &line) {
+		boost::lock_guard<boost::mutex> guard(lock);
+		cout << line << endl;
+	}
+};
+
+/**
+ * A command of @c serveScene handed to its @c renderscheduler , kept until
+ * its image is written.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+struct servedjob {
+	/** The command line options, with the file and format of the image. */
+	renderoptions opts;
+	/** The camera of the command. */
+	camera<vec_T, time_T, 3> view;
+	/** The width of the image in pixels. */
+	int width;
+	/** The height of the image in pixels. */
+	int height;
+	/** Samples per pixel along each axis. */
+	int samples;
+	/** The file of the image, opened when the command came in. */
+	ofstream file;
+	/** The image, filled in by the scheduler. */
+	vector<rgbcolor<color_T> > image;
+	/** Receives the counters of the render. */
+	rendercontext<vec_T, color_T, time_T, 3> ctx;
+	/** Receives the seconds each tile took. */
+	vector<double> tileSeconds;
+	/** When it was submitted. */
+	boost::posix_time::ptime submitted;
+
+	explicit servedjob(const camera<vec_T, time_T, 3> &view) : view(view) { }
+};
+
+/**
+ * Functor of the thread of @c serveScene that writes the images of the
+ * jobs of its @c renderscheduler as they're done, in whatever order that
+ * is, and replies for them.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+struct servedJobWriter {
+	/** The jobs. */
+	typedef servedjob<vec_T, color_T, time_T> job_t;
+
+	/** The scheduler, which is closed once no more jobs will come. */
+	renderscheduler<vec_T, color_T, time_T> *pool;
+	/** The jobs submitted to it and not written yet, by number. */
+	map<int, boost::shared_ptr<job_t> > *jobs;
+	/** Guards @c jobs . */
+	boost::mutex *jobsLock;
+	/** The scene. */
+	const scene<vec_T, color_T, time_T, 3> *sc;
+	/** Name of the precision for the statistics. */
+	const char *precisionName;
+	/** Where the replies go. */
+	servereplies *replies;
+
+	void operator()() const {
+		typedef scene<vec_T, color_T, time_T, 3> scene_t;
+		rendermetrics &metrics = rendermetrics::total();
+		int id;
+		while ((id = pool->waitAny()) >= 0) {
+			boost::shared_ptr<job_t> job;
+			{
+				// The job is put in once it's submitted, which may be
+				// after it's done.
+				boost::lock_guard<boost::mutex> guard(*jobsLock);
+				job = (*jobs)[id];
+				jobs->erase(id);
+			}
+			phasetimes times;
+			times.start(PHASE_WRITE);
+			writeImage<color_T, scene_t>(job->opts, job->image, job->width,
+					job->height, job->file);
+			job->file.close();
+			times.stop();
+			int failed = reportGeometry(*sc, job->opts.printStats);
+			if (job->opts.printStats)
+				printRenderStats(job->opts, *sc, job->ctx, precisionName);
+
+			double rendering = 0;
+			for (size_t i = 0; i < job->tileSeconds.size(); i++) {
+				metrics.addTile(job->tileSeconds[i]);
+				rendering += job->tileSeconds[i];
+			}
+			metrics.addPhase(PHASE_RENDER, rendering);
+			metrics.addPhase(PHASE_WRITE, times.getWallSeconds(PHASE_WRITE));
+			metrics.addShadowCache(job->ctx.getShadowCacheTests(),
+					job->ctx.getShadowCacheHits());
+			boost::posix_time::time_duration took =
+					boost::posix_time::microsec_clock::universal_time() -
+					job->submitted;
+			metrics.finishJob(job->file && failed == 0,
+					took.total_microseconds() * 1e-6,
+					(unsigned long long) job->width * job->height *
+					job->samples);
+
+			ostringstream reply;
+			if (!job->file)
+				reply << "error can't write \"" << job->opts.outFile << "\".";
+			else if (failed > 0)
+				reply << "error " << failed
+						<< " geometry files couldn't be read.";
+			else
+				reply << "ok " << job->opts.outFile;
+			replies->send(reply.str());
+		}
+	}
+};
+
+/**
+ * Loads the @c --scene file once, then renders it for every command of the
+ * @c rendercommand protocol on @c stdin until "quit" or the end of the
+ * input. The objects and the acceleration structure are kept between
+ * renders, as are geometry files once they're read, so each command only
+ * costs its render. Every command gets one line on @c stdout : "ok file"
+ * once the image is written, or "error" and what went wrong. Commands are
+ * read on a thread of their own, so the ones waiting can be counted.
+ *
+ * Renders are handed to a @c renderscheduler with @c --threads threads as
+ * their commands come in, so a preview of a higher priority takes over
+ * the threads from a long render at the end of the tiles they're on, and
+ * the long render carries on from there once the preview is done. Their
+ * images are written, and their replies sent, in the order they're done
+ * in. Only with @c --wavefront or @c --denoise , which need whole images
+ * at once, are the commands rendered one after the other with
+ * @c renderFrame instead. Once "quit" comes in,
+ * the renders under way are finished first.
+ *
+ * Every job is counted in @c rendermetrics::total , and with
+ * @c --metrics-port a @c metricsserver serves the counts over HTTP to
+ * Prometheus; the tiles are timed by the scheduler, or one after the
+ * other the render of each job is traced into a @c tracelog for them.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ *
+ * @param opts The command line options.
+ * @param precisionName Name of the precision for the statistics.
+ *
+ * @return The exit status of the program.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+int serveScene(const renderoptions &opts, const char *precisionName) {
+	typedef scene<vec_T, color_T, time_T, 3> scene_t;
+	typedef renderscheduler<vec_T, color_T, time_T> scheduler_t;
+	typedef servedjob<vec_T, color_T, time_T> job_t;
+
+	rendermetrics &metrics = rendermetrics::total();
+	metricsserver server;
+	if (opts.metricsPort >= 0) {
+		if (!server.start(opts.metricsPort, metrics)) {
+			cerr << "ERROR: can't listen on port " << opts.metricsPort << "."
+					<< endl;
+			return 1;
+		}
+		cerr << "metrics: serving on port " << server.getPort() << endl;
+	}
+
+	scene_t scene(opts.shadowsOn);
+	configureScene(opts, scene);
+	boost::shared_ptr<camera<vec_T, time_T, 3> > cam;
+	phasetimes loadTimes;
+	loadTimes.start(PHASE_PARSE);
+	if (!loadScene<vec_T, color_T, time_T>(opts, scene, cam, 0, 0, 0,
+			&loadTimes))
+		return 1;
+	loadTimes.stop();
+	metrics.addPhase(PHASE_PARSE, loadTimes.getWallSeconds(PHASE_PARSE));
+	metrics.addPhase(PHASE_BUILD, loadTimes.getWallSeconds(PHASE_BUILD));
+	metrics.setAcceleratorBytes(scene.getAccelerator() != 0 ?
+			scene.getAccelerator()->getMemoryUsage() : 0);
+	cout << "ready" << endl;
+
+	// The reader may still be waiting for a line after "quit", so it's
+	// left the input it fills unless it's done.
+	viewinput *input = new viewinput();
+	input->closed = false;
+	input->cancel.store(false);
+	viewReader reader;
+	reader.input = input;
+	boost::thread readerThread(reader);
+
+	bool scheduled = !opts.wavefront && opts.denoisePasses == 0;
+	servereplies replies;
+	scheduler_t pool(scheduled ? opts.threads : 0);
+	map<int, boost::shared_ptr<job_t> > jobs;
+	boost::mutex jobsLock;
+	servedJobWriter<vec_T, color_T, time_T> writer = { &pool, &jobs,
+			&jobsLock, &scene, precisionName, &replies };
+	boost::thread writerThread(writer);
+	string line;
+	while (true) {
+		{
+			boost::unique_lock<boost::mutex> guard(input->lock);
+			while (input->lines.empty() && !input->closed)
+				input->changed.wait(guard);
+			if (input->lines.empty())
+				break;
+			line = input->lines.front();
+			input->lines.pop_front();
+			metrics.setQueued((int) input->lines.size());
+		}
+		boost::posix_time::ptime now =
+				boost::posix_time::microsec_clock::universal_time();
+		rendercommand cmd;
+		string error;
+		if (!parseRenderCommand(line, cmd, error)) {
+			replies.send("error " + error);
+			continue;
+		}
+		if (cmd.kind == COMMAND_QUIT)
+			break;
+		if (cmd.kind != COMMAND_RENDER)
+			continue;
+		if (opts.wavefront && cmd.samples > 1) {
+			replies.send("error samples can't be used with --wavefront.");
+			continue;
+		}
+
+		camera<vec_T, time_T, 3> view = *cam;
+		if (cmd.hasCamera) {
+			mvector<vec_T, 3> pos, lookat, up;
+			for (int i = 0; i < 3; i++) {
+				pos[i] = (vec_T) cmd.position[i];
+				lookat[i] = (vec_T) cmd.lookat[i];
+				up[i] = (vec_T) cmd.up[i];
+			}
+			view = camera<vec_T, time_T, 3>(pos, lookat, up);
+		}
+		renderoptions frameOpts = opts;
+		frameOpts.outFile = cmd.file;
+		frameOpts.image = imageFormatOf(cmd.file, IMAGE_PPM);
+		int samples = cmd.samples > 0 ? cmd.samples : opts.pixelSamples;
+
+		if (scheduled) {
+			boost::shared_ptr<job_t> job(new job_t(view));
+			job->opts = frameOpts;
+			job->width = cmd.width;
+			job->height = cmd.height;
+			job->samples = samples;
+			job->file.open(cmd.file.c_str(), ios::out | ios::binary);
+			if (!job->file) {
+				replies.send("error can't write \"" + cmd.file + "\".");
+				continue;
+			}
+			job->submitted = now;
+			typename scheduler_t::settings asked;
+			asked.priority = cmd.priority;
+			if (cmd.deadline > 0)
+				asked.deadline = now +
+						boost::posix_time::milliseconds(cmd.deadline);
+			asked.samples = samples;
+			asked.ctx = &job->ctx;
+			asked.tileSeconds = &job->tileSeconds;
+			metrics.startJob();
+			boost::lock_guard<boost::mutex> guard(jobsLock);
+			jobs[pool.submit(scene, job->view, cmd.width, cmd.height,
+					job->image, asked)] = job;
+			continue;
+		}
+
+		scene.setPixelSamples(samples);
+		ofstream file(cmd.file.c_str(), ios::out | ios::binary);
+		if (!file) {
+			replies.send("error can't write \"" + cmd.file + "\".");
+			continue;
+		}
+		metrics.startJob();
+		tracelog tiles;
+		if (opts.metricsPort >= 0)
+			scene.setTraceLog(&tiles);
+		rendercontext<vec_T, color_T, time_T, 3> ctx;
+		phasetimes times;
+		times.start(PHASE_RENDER);
+		renderFrame(frameOpts, scene, view, cmd.width, cmd.height, file,
+				ctx, &times);
+		file.close();
+		times.stop();
+		scene.setTraceLog(0);
+		int failed = reportGeometry(scene, opts.printStats);
+		if (opts.printStats)
+			printRenderStats(opts, scene, ctx, precisionName);
+
+		const vector<traceevent> &spans = tiles.getEvents();
+		for (size_t i = 0; i < spans.size(); i++)
+			if (spans[i].lane >= TRACE_WORKER_LANE)
+				metrics.addTile((spans[i].end - spans[i].begin) * 1e-6);
+		metrics.addPhase(PHASE_RENDER, times.getWallSeconds(PHASE_RENDER));
+		metrics.addPhase(PHASE_WRITE, times.getWallSeconds(PHASE_WRITE));
+		metrics.addShadowCache(ctx.getShadowCacheTests(),
+				ctx.getShadowCacheHits());
+		metrics.finishJob(file && failed == 0,
+				times.getWallSeconds(PHASE_RENDER) +
+				times.getWallSeconds(PHASE_WRITE),
+				(unsigned long long) cmd.width * cmd.height *
+				max(samples, 1));
+
+		ostringstream reply;
+		if (!file)
+			reply << "error can't write \"" << cmd.file << "\".";
+		else if (failed > 0)
+			reply << "error " << failed << " geometry files couldn't be read.";
+		else
+			reply << "ok " << cmd.file;
+		replies.send(reply.str());
+	}
+	pool.close();
+	writerThread.join();
+	bool closed;
+	{
+		boost::lock_guard<boost::mutex> guard(input->lock);
+		closed = input->closed;
+	}
+	if (closed) {
+		readerThread.join();
+		delete input;
+	}
+	else
+		readerThread.detach();
+	return 0;
+}
+
+/**
+ * Sink for @c scene::renderProgressive in @c viewScene that writes every
+ * pass like @c passWriter , but replaces the output file in one go so a
+ * viewer reloading it never reads half an image, and reports on
+ * @c stderr how long after the view changed each pass was done.
+ *
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam scene_T The scene type, for @c writeImage .
+ */
+template<typename color_T, typename scene_T>
+struct viewWriter {
+	/** The command line options. */
+	const renderoptions *opts;
+	/** Number of the view being rendered. */
+	int view;
+	/** When it was asked for. */
+	boost::posix_time::ptime since;
+	/** Whether an image couldn't be written. */
+	bool failed;
+
+	void operator()(const vector<rgbcolor<color_T> > &image, int width,
+			int height, int block) {
+		if (opts->outFile.empty()) {
+			writeImage<color_T, scene_T>(*opts, image, width, height, cout);
+			cout.flush();
+		}
+		else {
+			ostringstream bytes;
+			writeImage<color_T, scene_T>(*opts, image, width, height, bytes);
+			failed = failed || !writeFileAtomically(opts->outFile,
+					bytes.str());
+		}
+		cerr << "view " << view << " pass " << block << " " <<
+				(boost::posix_time::microsec_clock::universal_time() -
+				since).total_milliseconds() << " ms" << endl;
+	}
+};
+
+/**
+ * Keeps a scene loaded and renders it progressively over and over as the
+ * camera is moved by @c viewcommand lines on @c stdin , for @c --view .
+ * Every pass goes to the output file, or to @c stdout one image after the
+ * other, and a line coming in stops the render under way at the end of the
+ * rows being traced, so the next view starts from a coarse pass right away.
+ * Only the camera changes between views; the scene, its accelerator and
+ * the render context stay as they are. The camera orbits and zooms toward
+ * the point in the middle of the first image, or a point 10 units ahead if
+ * nothing's there.
+ *
+ * @param opts The command line options.
+ * @param width The width of the images in pixels.
+ * @param height The height of the images in pixels.
+ * @param precisionName Name of the precision for the statistics.
+ *
+ * @return The exit status of the program.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+int viewScene(const renderoptions &opts, int width, int height,
+		const char *precisionName) {
+	typedef scene<vec_T, color_T, time_T, 3> scene_t;
+
+	scene_t scene(opts.shadowsOn);
+	configureScene(opts, scene);
+	boost::shared_ptr<camera<vec_T, time_T, 3> > cam;
+	if (!loadScene(opts, scene, cam))
+		return 1;
+	mvector<double, 3> pos, dir, up;
+	for (int i = 0; i < 3; i++) {
+		pos[i] = (double) cam->getPosition()[i];
+		dir[i] = (double) cam->getDirection()[i];
+		up[i] = (double) cam->getUp()[i];
+	}
+	ray<vec_T, time_T, 3> center = cam->getRayForPixel(width / 2,
+			height / 2, width, height);
+	time_T t;
+	double focus = 10;
+	if (scene.findClosestShape(center, t)) {
+		mvector<double, 3> d;
+		for (int i = 0; i < 3; i++)
+			d[i] = (double) center.getDir()[i];
+		focus = (double) t * (d * dir);
+	}
+	viewstate state(pos, pos + focus * dir, up);
+	cerr << "ready" << endl;
+
+	viewinput input;
+	input.closed = false;
+	input.cancel.store(false);
+	viewReader reader;
+	reader.input = &input;
+	boost::thread readerThread(reader);
+	viewWriter<color_T, scene_t> writer;
+	writer.opts = &opts;
+	writer.view = 0;
+	writer.failed = false;
+	rendercontext<vec_T, color_T, time_T, 3> ctx;
+	bool dirty = true, quit = false;
+	while (!quit && !writer.failed) {
+		deque<string> lines;
+		{
+			boost::unique_lock<boost::mutex> guard(input.lock);
+			while (!dirty && input.lines.empty() && !input.closed)
+				input.changed.wait(guard);
+			if (!dirty && input.lines.empty())
+				break;
+			lines.swap(input.lines);
+			writer.since = lines.empty() ?
+					boost::posix_time::microsec_clock::universal_time() :
+					input.since;
+			input.cancel.store(false);
+		}
+		for (size_t i = 0; i < lines.size() && !quit; i++) {
+			viewcommand cmd;
+			string error;
+			if (!parseViewCommand(lines[i], cmd, error))
+				cerr << "error " << error << endl;
+			else if (cmd.kind == VIEW_QUIT)
+				quit = true;
+			else if (state.apply(cmd))
+				dirty = true;
+		}
+		if (quit || !dirty)
+			continue;
+
+		mvector<vec_T, 3> p, l, u;
+		for (int i = 0; i < 3; i++) {
+			p[i] = (vec_T) state.getPosition()[i];
+			l[i] = (vec_T) state.getLookat()[i];
+			u[i] = (vec_T) state.getUp()[i];
+		}
+		camera<vec_T, time_T, 3> view(p, l, u, cam->getFieldOfView());
+		writer.view++;
+		if (scene.renderProgressive(view, width, height, writer, &ctx,
+				RENDER_PROGRESSIVE_BLOCK, &input.cancel)) {
+			dirty = false;
+			cerr << "view " << writer.view << " done" << endl;
+		}
+	}
+	// The reader may be waiting for a line that never comes.
+	readerThread.detach();
+	if (writer.failed) {
+		cerr << "ERROR: can't write \"" << opts.outFile << "\"." << endl;
+		return 1;
+	}
+	if (opts.printStats)
+		printRenderStats(opts, scene, ctx, precisionName);
+	return 0;
+}
+
+/**
+ * Milliseconds between checks of the file @c --watch watches.
+ */
+#define WATCH_POLL_MS 100
+
+/**
+ * What the thread of @c watchScene that watches the scene file tells the
+ * rendering thread.
+ */
+struct watchinput {
+	/** Whether the file changed since the rendering thread last looked. */
+	bool changed;
+	/** Whether SIGTERM or SIGINT came in. */
+	bool stopped;
+	/** Set when either of the above is, to stop the render under way. */
+	boost::atomic<bool> cancel;
+	/** Guards everything above but @c cancel . */
+	boost::mutex lock;
+	/** Signaled when the file changes or the program is to stop. */
+	boost::condition_variable signal;
+};
+
+/**
+ * Functor of the thread of @c watchScene that polls the scene file every
+ * @c WATCH_POLL_MS milliseconds and reports when its modification time,
+ * size or inode changes, the last for editors that save by renaming a
+ * new file over the old one. It stops once @c stopRequested is set.
+ */
+struct fileWatcher {
+	/** The file. */
+	string path;
+	/** Where the changes go. */
+	watchinput *input;
+
+	/*
+	 * Gets what tells versions of the file apart, or zeros if it's gone.
+	 */
+	void version(long long v[4]) const {
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0) {
+			v[0] = v[1] = v[2] = v[3] = 0;
+			return;
+		}
+		v[0] = (long long) st.st_mtim.tv_sec;
+		v[1] = (long long) st.st_mtim.tv_nsec;
+		v[2] = (long long) st.st_size;
+		v[3] = (long long) st.st_ino;
+	}
+
+	void operator()() const {
+		long long last[4], now[4];
+		version(last);
+		while (!stopRequested) {
+			boost::this_thread::sleep(boost::posix_time::milliseconds(
+					WATCH_POLL_MS));
+			version(now);
+			if (equal(now, now + 4, last))
+				continue;
+			copy(now, now + 4, last);
+			boost::lock_guard<boost::mutex> guard(input->lock);
+			input->changed = true;
+			input->cancel.store(true);
+			input->signal.notify_all();
+		}
+		boost::lock_guard<boost::mutex> guard(input->lock);
+		input->stopped = true;
+		input->cancel.store(true);
+		input->signal.notify_all();
+	}
+};
+
+/**
+ * Reads and parses the scene description @c --watch watches. The file is
+ * read rather than mapped, since an editor may be writing it.
+ *
+ * @param opts The command line options.
+ * @param[out] desc Receives the objects.
+ * @param[out] error Receives what's wrong, if anything.
+ *
+ * @return @c false if the file can't be read or parsed.
+ */
+template<typename vec_T, typename color_T>
+bool readWatchedScene(const renderoptions &opts, scenedescription &desc,
+		string &error) {
+	FILE *f = fopen(opts.sceneFile.c_str(), "rb");
+	vector<char> text;
+	bool read = f != 0 && readAll(f, text);
+	if (f != 0)
+		fclose(f);
+	if (!read) {
+		error = "can't read \"" + opts.sceneFile + "\".";
+		return false;
+	}
+	const char *begin = text.empty() ? 0 : &text[0];
+	if (scenefile::isSceneFile(begin, text.size())) {
+		error = "compiled scenes can't be watched.";
+		return false;
+	}
+	return parseSceneParallel<vec_T, color_T>(begin, begin + text.size(),
+			sceneDirectory(opts.sceneFile), opts.threads, desc, error);
+}
+
+/**
+ * Finds the camera @c --camera names, or else the last one, of a
+ * description for @c --watch . Only the cameras are made, so the camera of
+ * an edited description can be found without making its scene.
+ *
+ * @param opts The command line options.
+ * @param desc The description.
+ * @param[out] cam Receives the camera.
+ * @param[out] error Receives what's wrong, if anything.
+ *
+ * @return @c false if a camera is invalid or there's no such camera.
+ */
+template<typename vec_T, typename time_T>
+bool findWatchedCamera(const renderoptions &opts,
+		const scenedescription &desc,
+		boost::shared_ptr<camera<vec_T, time_T, 3> > &cam, string &error) {
+	cam.reset();
+	for (size_t i = 0; i < desc.records.size(); i++) {
+		const scenerecord &rec = desc.records[i];
+		if (rec.kind != RECORD_CAMERA)
+			continue;
+		if (!isValidSceneRecord(rec, desc.paths.size())) {
+			error = invalidSceneRecordError(rec, i);
+			return false;
+		}
+		scenerecordfields f = { rec.values };
+		double nameIndex = f.number<double>();
+		if (!opts.cameraName.empty() && (nameIndex < 0 ||
+				desc.paths[(size_t) nameIndex] != opts.cameraName))
+			continue;
+		mvector<vec_T, 3> pos = f.vector<vec_T>();
+		mvector<vec_T, 3> lookat = f.vector<vec_T>();
+		cam.reset(new camera<vec_T, time_T, 3>(pos, lookat,
+				f.vector<vec_T>()));
+	}
+	if (!cam)
+		error = opts.cameraName.empty() ?
+				"the scene description has no camera." :
+				"the scene description has no camera named \"" +
+				opts.cameraName + "\".";
+	return (bool) cam;
+}
+
+/**
+ * Makes the scene of a description for @c --watch and finalizes it.
+ *
+ * @param opts The command line options.
+ * @param desc The description.
+ * @param[out] sc Receives the scene.
+ * @param[out] error Receives what's wrong, if anything.
+ *
+ * @return @c false if the objects can't be made.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+bool makeWatchedScene(const renderoptions &opts,
+		const scenedescription &desc,
+		boost::shared_ptr<scene<vec_T, color_T, time_T, 3> > &sc,
+		string &error) {
+	sc.reset(new scene<vec_T, color_T, time_T, 3>(opts.shadowsOn));
+	configureScene(opts, *sc);
+	boost::shared_ptr<camera<vec_T, time_T, 3> > last;
+	if (!addSceneRecords(*sc, desc.records.empty() ? 0 : &desc.records[0],
+			desc.records.size(), desc.paths, last, error))
+		return false;
+	sc->finalize();
+	return true;
+}
+
+/**
+ * Sets every shape of a description made into a scene on its own to the
+ * shape of the scene of the same index.
+ *
+ * @param desc The description.
+ * @param[out] ids Receives the index in @c scene::getShapes of each shape.
+ */
+inline void resetWatchedShapes(const scenedescription &desc,
+		vector<int> &ids) {
+	vector<sceneshaperecord> shapes;
+	findSceneShapes(desc, shapes);
+	ids.resize(shapes.size());
+	for (size_t i = 0; i < ids.size(); i++)
+		ids[i] = (int) i;
+}
+
+/**
+ * Keeps a scene loaded and renders it progressively again whenever its
+ * file changes, for @c --watch . The changed file is parsed and compared
+ * with the description the scene was made from by
+ * @c diffSceneDescriptions , and only the shapes and lights that changed
+ * are edited in the scene with @c applySceneDiff , so with
+ * @c --accel @c dynamic the tree isn't even rebuilt. Changes that can't be
+ * made in place, like adding a light, make the scene again. A change
+ * stops the render under way like a command of @c --view does, and a file
+ * that doesn't parse, like one saved half way, is reported and skipped.
+ * Passes are written like those of @c --view , and SIGTERM or SIGINT ends
+ * the program.
+ *
+ * @param opts The command line options.
+ * @param width The width of the images in pixels.
+ * @param height The height of the images in pixels.
+ * @param precisionName Name of the precision for the statistics.
+ *
+ * @return The exit status of the program.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+int watchScene(const renderoptions &opts, int width, int height,
+		const char *precisionName) {
+	typedef scene<vec_T, color_T, time_T, 3> scene_t;
+	typedef camera<vec_T, time_T, 3> camera_t;
+
+	scenedescription desc;
+	boost::shared_ptr<scene_t> sc;
+	boost::shared_ptr<camera_t> cam;
+	string error;
+	if (!readWatchedScene<vec_T, color_T>(opts, desc, error) ||
+			!findWatchedCamera(opts, desc, cam, error) ||
+			!makeWatchedScene(opts, desc, sc, error)) {
+		cerr << "ERROR: " << error << endl;
+		return 1;
+	}
+	// Where each shape of the description is in the scene.
+	vector<int> ids;
+	resetWatchedShapes(desc, ids);
+	cerr << "ready" << endl;
+
+	signal(SIGTERM, requestStop);
+	signal(SIGINT, requestStop);
+	watchinput input;
+	input.changed = false;
+	input.stopped = false;
+	input.cancel.store(false);
+	fileWatcher watcher;
+	watcher.path = opts.sceneFile;
+	watcher.input = &input;
+	boost::thread watcherThread(watcher);
+	viewWriter<color_T, scene_t> writer;
+	writer.opts = &opts;
+	writer.view = 0;
+	writer.failed = false;
+	// The shadow cache may point at shapes an edit removes.
+	boost::scoped_ptr<rendercontext<vec_T, color_T, time_T, 3> > ctx(
+			new rendercontext<vec_T, color_T, time_T, 3>());
+	bool dirty = true, stale = false;
+	while (!writer.failed) {
+		bool reload = false;
+		{
+			boost::unique_lock<boost::mutex> guard(input.lock);
+			while (!dirty && !input.changed && !input.stopped)
+				input.signal.wait(guard);
+			if (input.stopped)
+				break;
+			reload = input.changed;
+			input.changed = false;
+			input.cancel.store(false);
+		}
+		writer.since = boost::posix_time::microsec_clock::universal_time();
+		if (reload) {
+			scenedescription next;
+			boost::shared_ptr<camera_t> picked;
+			if (!readWatchedScene<vec_T, color_T>(opts, next, error) ||
+					!findWatchedCamera(opts, next, picked, error)) {
+				cerr << "error " << error << endl;
+				continue;
+			}
+			scenediff diff;
+			bool diffed = !stale && diffSceneDescriptions(desc, next, diff);
+			if (diffed && applySceneDiff(*sc, next, diff, ids, error)) {
+				cerr << "reload " << diff.count() << " edits" << endl;
+			}
+			else {
+				// A scene edited half way is only good for making again.
+				stale = stale || diffed;
+				boost::shared_ptr<scene_t> made;
+				if (!makeWatchedScene(opts, next, made, error)) {
+					cerr << "error " << error << endl;
+					continue;
+				}
+				sc = made;
+				stale = false;
+				resetWatchedShapes(next, ids);
+				cerr << "reload scene" << endl;
+			}
+			sc->clearEdits();
+			cam = picked;
+			desc.records.swap(next.records);
+			desc.paths.swap(next.paths);
+			ctx.reset(new rendercontext<vec_T, color_T, time_T, 3>());
+			dirty = true;
+		}
+		writer.view++;
+		if (sc->renderProgressive(*cam, width, height, writer, ctx.get(),
+				RENDER_PROGRESSIVE_BLOCK, &input.cancel)) {
+			dirty = false;
+			cerr << "view " << writer.view << " done" << endl;
+		}
+	}
+	watcherThread.join();
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGINT, SIG_DFL);
+	if (writer.failed) {
+		cerr << "ERROR: can't write \"" << opts.outFile << "\"." << endl;
+		return 1;
+	}
+	if (opts.printStats)
+		printRenderStats(opts, *sc, *ctx, precisionName);
+	return 0;
+}
+
+/**
+ * Sets the options to what they are when the command line doesn't give
+ * them.
+ *
+ * @param[out] opts The options.
+ */
+void setDefaultOptions(renderoptions &opts) {
+	opts.shadowsOn = false;
+	opts.accelType = "bvh";
+	opts.builder = BVH_BUILD_SAH;
+	opts.shadowCache = false;
+	opts.rasterPrimary = false;
+	opts.tileFrustums = false;
+	opts.printStats = false;
+	opts.wavefront = false;
+	opts.sortRays = false;
+	opts.shadowPackets = false;
+	opts.maxReflect = MAX_REFLECT;
+	opts.minThroughput = 0;
+	opts.lightCutoff = 0;
+	opts.rouletteDepth = -1;
+	opts.clusterRatio = 0;
+	opts.cutError = 0;
+	opts.lightPicks = 0;
+	opts.areaSamples = 0;
+	opts.adaptiveShadows = 0;
+	opts.pixelVisibility = false;
+	opts.shadowMapRes = 0;
+	opts.shadowMapBias = 0.02;
+	opts.threads = hardwareThreads();
+	opts.pinThreads = false;
+	opts.progressive = false;
+	opts.stream = false;
+	opts.mapOutput = false;
+	opts.storage = PIXELS_FULL;
+	opts.stripRows = 0;
+	opts.aaSamples = 1;
+	opts.aaThreshold = 0.1;
+	opts.pixelSamples = 1;
+	opts.denoisePasses = 0;
+	opts.sampler = SAMPLER_SOBOL;
+	opts.format = PPM_P3;
+	opts.image = IMAGE_PPM;
+	opts.exposure = 1;
+	opts.allCameras = false;
+	opts.writeQueue = 1;
+	opts.procs = 0;
+	opts.thumbnailFilter = RESAMPLE_BOX;
+	opts.firstFrame = 0;
+	opts.lastFrame = -1;
+	opts.crop = false;
+	opts.cropX0 = opts.cropY0 = opts.cropX1 = opts.cropY1 = 0;
+	opts.farmPort = -1;
+	opts.previewPort = -1;
+	opts.metricsPort = -1;
+	opts.reuseTiles = false;
+	opts.reproject = 0;
+	opts.leaseTimeout = 60;
+	opts.leaseSize = 64;
+	opts.heatmapCost = COST_CYCLES;
+	opts.checkTolerance = 1;
+	opts.maxSlowdown = 0.2;
+	opts.updateGolden = false;
+	opts.updateBaseline = false;
+	opts.perfCounters = false;
+	opts.profileTop = 0;
+	opts.chunkSize = 0;
+	opts.outOfCore = 0;
+	opts.compactSpheres = false;
+	opts.pipelinedLoad = false;
+	opts.memReport = false;
+	opts.hugePages = false;
+	opts.autoTune = false;
+	opts.timeBudget = 0;
+	opts.view = false;
+	opts.watch = false;
+	opts.checkpointInterval = 60;
+	opts.resume = false;
+}
+
+/**
+ * Reads the options of a command line into the given options, leaving
+ * the ones it doesn't give as they were. The instruction set picked with
+ * @c --simd is set as soon as it's read.
+ *
+ * @param argc Number of arguments.
+ * @param argv The arguments.
+ * @param first The first argument that is an option.
+ * @param compile Whether this is a @c --compile command line.
+ * @param serve Whether this is a @c --serve command line.
+ * @param width The width of the image in pixels, for @c --crop .
+ * @param height The height of the image in pixels, for @c --crop .
+ * @param[in,out] opts The options.
+ * @param[out] prec Receives the precision if it's given.
+ *
+ * @return @c false if an option is unknown or malformed.
+ */
+bool parseOptions(int argc, char **argv, int first, bool compile, bool serve,
+		int width, int height, renderoptions &opts, precision &prec) {
+	for (int i = first; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "-s") {
+			opts.shadowsOn = true;
+		}
+		else if (arg == "--scene" && i + 1 < argc && !compile && !serve) {
+			opts.sceneFile = argv[++i];
+		}
+		else if (arg == "--camera" && i + 1 < argc) {
+			opts.cameraName = argv[++i];
+		}
+		else if (arg == "--cameras" && !compile && !serve) {
+			opts.allCameras = true;
+		}
+		else if (arg == "--procs" && i + 1 < argc) {
+			opts.procs = atoi(argv[++i]);
+			if (opts.procs < 1) {
+				return false;
+			}
+		}
+		else if (arg == "--write-queue" && i + 1 < argc) {
+			opts.writeQueue = atoi(argv[++i]);
+			if (opts.writeQueue < 1) {
+				return false;
+			}
+		}
+		else if (arg == "--thumbnail" && i + 1 < argc && !compile &&
+				!serve) {
+			int w, h;
+			if (!parseThumbnailSize(argv[++i], w, h) || w > width ||
+					h > height) {
+				return false;
+			}
+			addThumbnail(opts, w, h);
+		}
+		else if (arg == "--mip-levels" && i + 1 < argc && !compile &&
+				!serve) {
+			int levels = atoi(argv[++i]);
+			if (levels < 1) {
+				return false;
+			}
+			int w = width, h = height;
+			for (int k = 0; k < levels && (w > 1 || h > 1); k++) {
+				w = max(1, w / 2);
+				h = max(1, h / 2);
+				addThumbnail(opts, w, h);
+			}
+		}
+		else if (arg == "--aov" && i + 1 < argc && !compile && !serve) {
+			string a = argv[++i];
+			aovKind kind;
+			if (a == "depth") {
+				kind = AOV_DEPTH;
+			}
+			else if (a == "normal") {
+				kind = AOV_NORMAL;
+			}
+			else if (a == "id") {
+				kind = AOV_ID;
+			}
+			else {
+				return false;
+			}
+			if (find(opts.aovs.begin(), opts.aovs.end(), kind) ==
+					opts.aovs.end())
+				opts.aovs.push_back(kind);
+		}
+		else if (arg == "--thumbnail-filter" && i + 1 < argc) {
+			string f = argv[++i];
+			if (f == "box") {
+				opts.thumbnailFilter = RESAMPLE_BOX;
+			}
+			else if (f == "lanczos") {
+				opts.thumbnailFilter = RESAMPLE_LANCZOS;
+			}
+			else {
+				return false;
+			}
+		}
+		else if (arg == "--frames" && i + 1 < argc && !compile && !serve) {
+			if (!parseFrameRange(argv[++i], opts.firstFrame,
+					opts.lastFrame)) {
+				return false;
+			}
+		}
+		else if (arg == "--crop" && i + 4 < argc && !compile && !serve) {
+			opts.crop = true;
+			opts.cropX0 = atoi(argv[++i]);
+			opts.cropY0 = atoi(argv[++i]);
+			opts.cropX1 = atoi(argv[++i]);
+			opts.cropY1 = atoi(argv[++i]);
+			if (opts.cropX0 < 0 || opts.cropX0 >= opts.cropX1 ||
+					opts.cropX1 > width || opts.cropY0 < 0 ||
+					opts.cropY0 >= opts.cropY1 || opts.cropY1 > height) {
+				return false;
+			}
+		}
+		else if (arg == "--coordinate" && i + 1 < argc && !compile &&
+				!serve) {
+			opts.farmPort = atoi(argv[++i]);
+			if (opts.farmPort < 0 || opts.farmPort > 65535) {
+				return false;
+			}
+		}
+		else if (arg == "--metrics-port" && i + 1 < argc && serve) {
+			opts.metricsPort = atoi(argv[++i]);
+			if (opts.metricsPort < 0 || opts.metricsPort > 65535) {
+				return false;
+			}
+		}
+		else if (arg == "--preview" && i + 1 < argc && !compile &&
+				!serve) {
+			opts.previewPort = atoi(argv[++i]);
+			if (opts.previewPort < 0 || opts.previewPort > 65535) {
+				return false;
+			}
+		}
+		else if (arg == "--frame-cache" && i + 1 < argc && !compile &&
+				!serve) {
+			opts.frameCache = argv[++i];
+		}
+		else if (arg == "--reuse-tiles" && !compile && !serve) {
+			opts.reuseTiles = true;
+		}
+		else if (arg == "--reproject" && i + 1 < argc && !compile &&
+				!serve) {
+			opts.reproject = atoi(argv[++i]);
+			if (opts.reproject < 1) {
+				return false;
+			}
+		}
+		else if (arg == "--bvh-cache" && i + 1 < argc && !compile) {
+			opts.bvhCache = argv[++i];
+		}
+		else if (arg == "--chunk-size" && i + 1 < argc && compile) {
+			opts.chunkSize = atoi(argv[++i]);
+			if (opts.chunkSize <= 0) {
+				return false;
+			}
+		}
+		else if (arg == "--out-of-core" && i + 1 < argc && !compile) {
+			opts.outOfCore = atof(argv[++i]);
+			if (opts.outOfCore <= 0) {
+				return false;
+			}
+		}
+		else if (arg == "--compact-spheres") {
+			opts.compactSpheres = true;
+		}
+		else if (arg == "--pipelined-load") {
+			opts.pipelinedLoad = true;
+		}
+		else if (arg == "--mem-report") {
+			opts.memReport = true;
+		}
+		else if (arg == "--huge-pages") {
+			opts.hugePages = true;
+		}
+		else if (arg == "--auto") {
+			opts.autoTune = true;
+		}
+		else if (arg == "--lease-timeout" && i + 1 < argc) {
+			opts.leaseTimeout = atof(argv[++i]);
+			if (opts.leaseTimeout < 0) {
+				return false;
+			}
+		}
+		else if (arg == "--lease-size" && i + 1 < argc) {
+			opts.leaseSize = atoi(argv[++i]);
+			if (opts.leaseSize <= 0) {
+				return false;
+			}
+		}
+		else if (arg == "-j" && i + 1 < argc) {
+			opts.threads = atoi(argv[++i]);
+			if (opts.threads <= 0) {
+				return false;
+			}
+		}
+		else if (arg == "--aa" && i + 1 < argc) {
+			opts.aaSamples = atoi(argv[++i]);
+			if (opts.aaSamples <= 0) {
+				return false;
+			}
+		}
+		else if (arg == "--samples" && i + 1 < argc) {
+			opts.pixelSamples = atoi(argv[++i]);
+			if (opts.pixelSamples <= 0) {
+				return false;
+			}
+		}
+		else if (arg == "--denoise" && i + 1 < argc) {
+			opts.denoisePasses = atoi(argv[++i]);
+			if (opts.denoisePasses < 0) {
+				return false;
+			}
+		}
+		else if (arg == "--sampler" && i + 1 < argc) {
+			string k = argv[++i];
+			if (k == "random") {
+				opts.sampler = SAMPLER_RANDOM;
+			}
+			else if (k == "sobol") {
+				opts.sampler = SAMPLER_SOBOL;
+			}
+			else if (k == "bluenoise") {
+				opts.sampler = SAMPLER_BLUE_NOISE;
+			}
+			else {
+				return false;
+			}
+		}
+		else if (arg == "--aa-threshold" && i + 1 < argc) {
+			opts.aaThreshold = atof(argv[++i]);
+			if (opts.aaThreshold < 0) {
+				return false;
+			}
+		}
+		else if (arg == "--format" && i + 1 < argc) {
+			string f = argv[++i];
+			if (f == "p3") {
+				opts.image = IMAGE_PPM;
+				opts.format = PPM_P3;
+			}
+			else if (f == "p6") {
+				opts.image = IMAGE_PPM;
+				opts.format = PPM_P6;
+			}
+			else if (f == "png") {
+				opts.image = IMAGE_PNG;
+			}
+			else if (f == "pfm") {
+				opts.image = IMAGE_PFM;
+			}
+			else if (f == "exr") {
+				opts.image = IMAGE_EXR;
+			}
+			else {
+				return false;
+			}
+		}
+		else if (arg == "-o" && i + 1 < argc) {
+			opts.outFile = argv[++i];
+			opts.image = imageFormatOf(opts.outFile, opts.image);
+		}
+		else if (arg == "--heatmap" && i + 1 < argc) {
+			opts.heatmapFile = argv[++i];
+		}
+		else if (arg == "--heatmap-cost" && i + 1 < argc) {
+			string c = argv[++i];
+			if (c == "cycles")
+				opts.heatmapCost = COST_CYCLES;
+			else if (c == "tests")
+				opts.heatmapCost = COST_TESTS;
+			else
+				return false;
+		}
+		else if (arg == "--exposure" && i + 1 < argc) {
+			opts.exposure = atof(argv[++i]);
+			if (opts.exposure <= 0) {
+				return false;
+			}
+		}
+		else if (arg == "--time-budget" && i + 1 < argc) {
+			opts.timeBudget = atof(argv[++i]);
+			if (opts.timeBudget <= 0) {
+				return false;
+			}
+		}
+		else if (arg == "--checkpoint" && i + 1 < argc && !compile &&
+				!serve) {
+			opts.checkpointFile = argv[++i];
+		}
+		else if (arg == "--checkpoint-interval" && i + 1 < argc) {
+			opts.checkpointInterval = atof(argv[++i]);
+			if (opts.checkpointInterval <= 0) {
+				return false;
+			}
+		}
+		else if (arg == "--resume" && !compile && !serve) {
+			opts.resume = true;
+		}
+		else if (arg == "--view" && !compile && !serve) {
+			opts.view = true;
+		}
+		else if (arg == "--watch" && i + 1 < argc && !compile && !serve) {
+			opts.watch = true;
+			opts.sceneFile = argv[++i];
+		}
+		else if (arg == "--progressive") {
+			opts.progressive = true;
+		}
+		else if (arg == "--stream") {
+			opts.stream = true;
+		}
+		else if (arg == "--mmap") {
+			opts.mapOutput = true;
+		}
+		else if (arg == "--strips" && i + 1 < argc) {
+			opts.stripRows = atoi(argv[++i]);
+			if (opts.stripRows <= 0) {
+				return false;
+			}
+		}
+		else if (arg == "--pixel-storage" && i + 1 < argc) {
+			if (!parsePixelStorage(argv[++i], opts.storage)) {
+				return false;
+			}
+		}
+		else if (arg == "--pin-threads") {
+			opts.pinThreads = true;
+		}
+		else if (arg == "--accel" && i + 1 < argc) {
+			opts.accelType = argv[++i];
+			if (opts.accelType != "linear" && opts.accelType != "bvh" &&
+					opts.accelType != "qbvh8" && opts.accelType != "qbvh16" &&
+					opts.accelType != "grid" && opts.accelType != "lazy" &&
+					opts.accelType != "dynamic" &&
+					opts.accelType != "motion") {
+				return false;
+			}
+		}
+		else if (arg == "--bvh-builder" && i + 1 < argc) {
+			string b = argv[++i];
+			if (b == "sah") {
+				opts.builder = BVH_BUILD_SAH;
+			}
+			else if (b == "lbvh") {
+				opts.builder = BVH_BUILD_LBVH;
+			}
+			else {
+				return false;
+			}
+		}
+		else if (arg == "--shadow-cache") {
+			opts.shadowCache = true;
+		}
+		else if (arg == "--raster-primary") {
+			opts.rasterPrimary = true;
+		}
+		else if (arg == "--tile-frustums") {
+			opts.tileFrustums = true;
+		}
+		else if (arg == "--area-light-samples" && i + 1 < argc) {
+			opts.areaSamples = atoi(argv[++i]);
+			if (opts.areaSamples <= 0) {
+				return false;
+			}
+		}
+		else if (arg == "--adaptive-shadows" && i + 1 < argc) {
+			opts.adaptiveShadows = atoi(argv[++i]);
+			if (opts.adaptiveShadows < 0) {
+				return false;
+			}
+		}
+		else if (arg == "--pixel-visibility") {
+			opts.pixelVisibility = true;
+		}
+		else if (arg == "--shadow-map" && i + 1 < argc) {
+			opts.shadowMapRes = atoi(argv[++i]);
+			if (opts.shadowMapRes < 0) {
+				return false;
+			}
+		}
+		else if (arg == "--shadow-map-bias" && i + 1 < argc) {
+			opts.shadowMapBias = atof(argv[++i]);
+			if (opts.shadowMapBias < 0) {
+				return false;
+			}
+		}
+		else if (arg == "--light-cluster" && i + 1 < argc) {
+			opts.clusterRatio = atof(argv[++i]);
+			if (opts.clusterRatio < 0) {
+				return false;
+			}
+		}
+		else if (arg == "--lightcuts" && i + 1 < argc) {
+			opts.cutError = atof(argv[++i]);
+			if (opts.cutError < 0) {
+				return false;
+			}
+		}
+		else if (arg == "--light-picks" && i + 1 < argc) {
+			opts.lightPicks = atoi(argv[++i]);
+			if (opts.lightPicks < 0) {
+				return false;
+			}
+		}
+		else if (arg == "--wavefront") {
+			opts.wavefront = true;
+		}
+		else if (arg == "--max-reflect" && i + 1 < argc) {
+			opts.maxReflect = atoi(argv[++i]);
+			if (opts.maxReflect < 0) {
+				return false;
+			}
+		}
+		else if (arg == "--min-throughput" && i + 1 < argc) {
+			opts.minThroughput = atof(argv[++i]);
+			if (opts.minThroughput < 0) {
+				return false;
+			}
+		}
+		else if (arg == "--light-cutoff" && i + 1 < argc) {
+			opts.lightCutoff = atof(argv[++i]);
+			if (opts.lightCutoff < 0) {
+				return false;
+			}
+		}
+		else if (arg == "--roulette" && i + 1 < argc) {
+			opts.rouletteDepth = atoi(argv[++i]);
+			if (opts.rouletteDepth < 0) {
+				return false;
+			}
+		}
+		else if (arg == "--sort-rays") {
+			opts.sortRays = true;
+		}
+		else if (arg == "--shadow-packets") {
+			opts.shadowPackets = true;
+		}
+		else if (arg == "--simd" && i + 1 < argc) {
+			simdLevel level;
+			if (!parseSimdLevel(argv[++i], level)) {
+				return false;
+			}
+			setSimdLevel(level);
+		}
+		else if (arg == "--precision" && i + 1 < argc) {
+			string p = argv[++i];
+			if (p == "double") {
+				prec = PRECISION_DOUBLE;
+			}
+			else if (p == "float") {
+				prec = PRECISION_FLOAT;
+			}
+			else if (p == "float-time") {
+				prec = PRECISION_FLOAT_TIME;
+			}
+			else {
+				return false;
+			}
+		}
+		else if (arg == "--stats") {
+			opts.printStats = true;
+		}
+		else if (arg == "--stats-json" && i + 1 < argc) {
+			opts.statsJson = argv[++i];
+		}
+		else if (arg == "--trace" && i + 1 < argc) {
+			opts.traceFile = argv[++i];
+		}
+		else if (arg == "--perf-counters") {
+			opts.perfCounters = true;
+		}
+		else if (arg == "--profile-shapes" && i + 1 < argc) {
+			opts.profileTop = atoi(argv[++i]);
+			if (opts.profileTop < 1)
+				return false;
+		}
+		else if (arg == "--profile-json" && i + 1 < argc) {
+			opts.profileJson = argv[++i];
+		}
+		else if (arg == "--tolerance" && i + 1 < argc) {
+			opts.checkTolerance = atof(argv[++i]);
+			if (opts.checkTolerance < 0)
+				return false;
+		}
+		else if (arg == "--max-slowdown" && i + 1 < argc) {
+			opts.maxSlowdown = atof(argv[++i]);
+			if (opts.maxSlowdown < 0 || opts.maxSlowdown >= 1)
+				return false;
+		}
+		else if (arg == "--update-golden") {
+			opts.updateGolden = true;
+		}
+		else if (arg == "--update-baseline") {
+			opts.updateBaseline = true;
+		}
+		else {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Gets the options of a @c --coordinate command line that its workers
+ * render with: all but those that only concern the coordinator itself,
+ * which are where the scene and image are, and those of the workers' own
+ * command lines.
+ *
+ * @param argc Number of arguments.
+ * @param argv The arguments.
+ * @param first The first argument that is an option.
+ *
+ * @return The options.
+ */
+vector<string> workerArguments(int argc, char **argv, int first) {
+	vector<string> args;
+	for (int i = first; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "--coordinate" || arg == "--scene" || arg == "-o" ||
+				arg == "-j" || arg == "--lease-timeout" ||
+				arg == "--lease-size")
+			i++;
+		else if (arg != "--pin-threads" && arg != "--stats")
+			args.push_back(arg);
+	}
+	return args;
+}
+
+/**
+ * Types of the messages between a @c --coordinate render and its
+ * @c --work workers. A worker connects and is sent the job; it answers
+ * that it's ready or that it failed, then gets a tile, sends back its
+ * pixels and gets the next tile, until it's told the image is done.
+ */
+enum farmMessage {
+	/**
+	 * Coordinator to worker: the image size, the precision, the
+	 * @c --scene name, the options and the bytes of the scene.
+	 */
+	FARM_JOB = 1,
+	/** Worker to coordinator: the scene is loaded. */
+	FARM_READY,
+	/** Worker to coordinator: the scene couldn't be loaded. */
+	FARM_FAILED,
+	/** Coordinator to worker: the number and window of a tile to render. */
+	FARM_TILE,
+	/** Worker to coordinator: the number of a tile and its pixels. */
+	FARM_RESULT,
+	/** Coordinator to worker: every tile is finished. */
+	FARM_DONE
+};
+
+/**
+ * What the threads of a @c --coordinate render share: the leases of the
+ * tiles, the image they're put together in and the connected workers.
+ *
+ * @tparam color_T The type of the @c rgbcolor.
+ */
+template<typename color_T>
+struct farmstate {
+	/** The width of the image in pixels. */
+	int width;
+	/** The height of the image in pixels. */
+	int height;
+	/** The width and height of the tiles in pixels. */
+	int tileSize;
+	/** Number of tiles in a row of the image. */
+	int tilesPerRow;
+	/** The leases of the tiles. */
+	tileleases *leases;
+	/** The payload of the @c FARM_JOB message. */
+	const vector<char> *job;
+	/** The colors of the image's pixels, row by row. */
+	vector<rgbcolor<color_T> > image;
+	/** The connection of each worker that connected. */
+	vector<boost::shared_ptr<netchannel> > channels;
+	/** Whether a worker couldn't load the scene. */
+	bool failed;
+	/** Guards @c image and @c failed . */
+	boost::mutex lock;
+
+	/**
+	 * Gets the window of a tile of the image.
+	 *
+	 * @param tile Number of the tile, counting row by row.
+	 * @param[out] x0 Receives the left column.
+	 * @param[out] y0 Receives the top row.
+	 * @param[out] x1 Receives the column just right of the tile.
+	 * @param[out] y1 Receives the row just below the tile.
+	 */
+	void getWindow(int tile, int &x0, int &y0, int &x1, int &y1) const {
+		x0 = tile % tilesPerRow * tileSize;
+		y0 = tile / tilesPerRow * tileSize;
+		x1 = min(x0 + tileSize, width);
+		y1 = min(y0 + tileSize, height);
+	}
+};
+
+/**
+ * Thread of a @c --coordinate render that serves one worker: it sends the
+ * job and leases the worker one tile after another, putting the pixels
+ * that come back into the image. If the connection breaks, the worker's
+ * tile goes back to be leased to others.
+ *
+ * @tparam color_T The type of the @c rgbcolor.
+ */
+template<typename color_T>
+struct farmConnection {
+	/** The shared state. */
+	farmstate<color_T> *state;
+	/** The connection to the worker. */
+	netchannel *channel;
+	/** Number of the worker. */
+	int worker;
+
+	/**
+	 * Serves the worker until the image is done or the worker goes away.
+	 */
+	void operator()() {
+		if (!channel->send(FARM_JOB, *state->job) || !serve())
+			state->leases->release(worker);
+		channel->shutdown();
+	}
+
+private:
+
+	/**
+	 * Answers the worker's messages with tiles.
+	 *
+	 * @return @c false if the worker went away, failed or sent a bad
+	 *   message.
+	 */
+	bool serve() {
+		boost::uint32_t type;
+		vector<char> payload;
+		for (;;) {
+			if (!channel->receive(type, payload))
+				return false;
+			if (type == FARM_FAILED) {
+				boost::lock_guard<boost::mutex> guard(state->lock);
+				state->failed = true;
+				return false;
+			}
+			if (type == FARM_RESULT && !storeResult(payload))
+				return false;
+			if (type != FARM_READY && type != FARM_RESULT)
+				return false;
+			int tile = state->leases->lease(worker);
+			if (tile < 0)
+				return channel->send(FARM_DONE);
+			int x0, y0, x1, y1;
+			state->getWindow(tile, x0, y0, x1, y1);
+			netwriter out;
+			out.putInt(tile);
+			out.putInt(x0);
+			out.putInt(y0);
+			out.putInt(x1);
+			out.putInt(y1);
+			if (!channel->send(FARM_TILE, out.getBytes()))
+				return false;
+		}
+	}
+
+	/**
+	 * Puts the pixels of a finished tile into the image, unless another
+	 * worker finished it first.
+	 *
+	 * @param payload The payload of the @c FARM_RESULT message.
+	 *
+	 * @return @c false if it isn't a whole tile of the image.
+	 */
+	bool storeResult(const vector<char> &payload) {
+		netreader in(payload);
+		int tile = (int) in.getInt();
+		if (!in.ok() || tile < 0 || tile >= state->leases->size())
+			return false;
+		int x0, y0, x1, y1;
+		state->getWindow(tile, x0, y0, x1, y1);
+		vector<rgbcolor<color_T> > pixels((size_t) (x1 - x0) * (y1 - y0));
+		for (size_t i = 0; i < pixels.size(); i++) {
+			color_T r = (color_T) in.getDouble();
+			color_T g = (color_T) in.getDouble();
+			color_T b = (color_T) in.getDouble();
+			// Shaded colors may be above 1 before they're quantized.
+			pixels[i] = rgbcolor<color_T>::unchecked(r, g, b);
+		}
+		if (!in.ok())
+			return false;
+		if (state->leases->isDone(tile))
+			return true;
+		{
+			boost::lock_guard<boost::mutex> guard(state->lock);
+			for (int y = y0; y < y1; y++)
+				copy(pixels.begin() + (size_t) (y - y0) * (x1 - x0),
+						pixels.begin() + (size_t) (y - y0 + 1) * (x1 - x0),
+						state->image.begin() + (size_t) y * state->width + x0);
+		}
+		state->leases->complete(tile);
+		return true;
+	}
+};
+
+/**
+ * Renders an image on the workers that connect to the @c --coordinate
+ * port, each of them an @c rt @c --work process, and writes it to
+ * @c cout or the @c -o file. The workers are sent the scene as it's read,
+ * so a scene compiled with @c --compile is neither parsed nor built on
+ * them, and the options, then lease tiles of @c --lease-size pixels one at
+ * a time until every tile is back. Workers may come and go while the
+ * image renders: the tiles of a worker whose connection breaks, and those
+ * a worker holds longer than @c --lease-timeout , are leased to others.
+ * The image is exactly the one @c rt renders by itself.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ *
+ * @param opts The command line options.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param prec The precision, for the workers.
+ * @param args The options the workers render with.
+ *
+ * @return The exit status of the program.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+int coordinateRender(const renderoptions &opts, int width, int height,
+		precision prec, const vector<string> &args) {
+	typedef scene<vec_T, color_T, time_T, 3> scene_t;
+
+	mappedfile file;
+	vector<char> text;
+	const char *begin, *end;
+	if (!readSceneBytes(opts, file, text, begin, end))
+		return 1;
+	netlistener listener;
+	if (!listener.listen(opts.farmPort)) {
+		cerr << "ERROR: can't listen on port " << opts.farmPort << "." <<
+				endl;
+		return 1;
+	}
+	ofstream out;
+	if (!opts.outFile.empty()) {
+		out.open(opts.outFile.c_str(), ios::out | ios::binary);
+		if (!out) {
+			cerr << "ERROR: can't write \"" << opts.outFile << "\"." <<
+					endl;
+			return 1;
+		}
+	}
+
+	netwriter job;
+	job.putInt(width);
+	job.putInt(height);
+	job.putInt(prec);
+	job.putString(opts.sceneFile);
+	job.putInt(args.size());
+	for (size_t i = 0; i < args.size(); i++)
+		job.putString(args[i]);
+	job.putBytes(begin, end - begin);
+
+	farmstate<color_T> state;
+	state.width = width;
+	state.height = height;
+	state.tileSize = opts.leaseSize;
+	state.tilesPerRow = (width + opts.leaseSize - 1) / opts.leaseSize;
+	tileleases leases(state.tilesPerRow *
+			((height + opts.leaseSize - 1) / opts.leaseSize),
+			opts.leaseTimeout);
+	state.leases = &leases;
+	state.job = &job.getBytes();
+	state.image.assign((size_t) width * height, rgbcolor<color_T>());
+	state.failed = false;
+
+	boost::thread_group threads;
+	bool failed = false;
+	while (!leases.finished() && !failed) {
+		boost::shared_ptr<netchannel> channel(new netchannel());
+		if (listener.accept(*channel, 100)) {
+			farmConnection<color_T> conn;
+			conn.state = &state;
+			conn.channel = channel.get();
+			conn.worker = (int) state.channels.size();
+			state.channels.push_back(channel);
+			threads.create_thread(conn);
+		}
+		boost::lock_guard<boost::mutex> guard(state.lock);
+		failed = state.failed;
+	}
+	// Wakes connections waiting on tiles or on workers that stopped
+	// answering.
+	leases.cancel();
+	for (size_t i = 0; i < state.channels.size(); i++)
+		state.channels[i]->shutdown();
+	threads.join_all();
+	if (failed) {
+		cerr << "ERROR: a worker couldn't load the scene." << endl;
+		return 1;
+	}
+	if (opts.printStats)
+		cerr << "workers: " << state.channels.size() << endl;
+
+	writeImage<color_T, scene_t>(opts, state.image, width, height,
+			opts.outFile.empty() ? cout : out);
+	out.close();
+	if (!opts.outFile.empty() && !out) {
+		cerr << "ERROR: can't write \"" << opts.outFile << "\"." << endl;
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Renders the tiles a coordinator leases for a job it sent, once the
+ * scene is loaded with the given scalar types.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ *
+ * @param opts The options of the job.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param begin The first byte of the scene.
+ * @param end One past the last byte of the scene.
+ * @param channel The connection to the coordinator.
+ *
+ * @return The exit status of the program.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+int workOnJob(const renderoptions &opts, int width, int height,
+		const char *begin, const char *end, netchannel &channel) {
+	scene<vec_T, color_T, time_T, 3> sc(opts.shadowsOn);
+	configureScene(opts, sc);
+	boost::shared_ptr<camera<vec_T, time_T, 3> > cam;
+	if (!loadSceneBytes(opts, begin, end, sc, cam)) {
+		channel.send(FARM_FAILED);
+		return 1;
+	}
+	if (!channel.send(FARM_READY)) {
+		cerr << "ERROR: lost the connection to the coordinator." << endl;
+		return 1;
+	}
+
+	rendercontext<vec_T, color_T, time_T, 3> ctx;
+	boost::uint32_t type = 0;
+	vector<char> payload;
+	vector<rgbcolor<color_T> > pixels;
+	while (channel.receive(type, payload) && type == FARM_TILE) {
+		netreader in(payload);
+		boost::uint32_t tile = in.getInt();
+		int x0 = (int) in.getInt(), y0 = (int) in.getInt();
+		int x1 = (int) in.getInt(), y1 = (int) in.getInt();
+		if (!in.ok() || x0 < 0 || x0 >= x1 || x1 > width || y0 < 0 ||
+				y0 >= y1 || y1 > height)
+			break;
+		sc.renderCrop(*cam, width, height, x0, y0, x1, y1, pixels, &ctx);
+		netwriter out;
+		out.putInt(tile);
+		for (size_t i = 0; i < pixels.size(); i++) {
+			out.putDouble(pixels[i].getR());
+			out.putDouble(pixels[i].getG());
+			out.putDouble(pixels[i].getB());
+		}
+		if (!channel.send(FARM_RESULT, out.getBytes()))
+			break;
+	}
+	int failed = reportGeometry(sc, opts.printStats);
+	if (opts.printStats)
+		ctx.printStats(cerr);
+#ifdef RT_STATS
+	if (opts.printStats)
+		raystats::total().print(cerr);
+#endif
+	if (type != FARM_DONE) {
+		cerr << "ERROR: lost the connection to the coordinator." << endl;
+		return 1;
+	}
+	return failed > 0 ? 1 : 0;
+}
+
+/**
+ * Connects to a @c --coordinate render as a worker, loads the scene it
+ * sends and renders the tiles it leases until the image is done.
+ *
+ * @param address The coordinator's host and port as host:port.
+ * @param threads Number of threads to render each tile on.
+ * @param pinThreads Whether to pin the threads to hardware threads.
+ * @param printStats Whether to print statistics when done.
+ *
+ * @return The exit status of the program.
+ */
+int workForCoordinator(const string &address, int threads, bool pinThreads,
+		bool printStats) {
+	size_t colon = address.rfind(':');
+	int port = colon == string::npos ? 0 : atoi(address.c_str() + colon + 1);
+	netchannel channel;
+	if (port <= 0 || !channel.connect(address.substr(0, colon), port)) {
+		cerr << "ERROR: can't connect to \"" << address << "\"." << endl;
+		return 1;
+	}
+	boost::uint32_t type;
+	vector<char> payload;
+	if (!channel.receive(type, payload) || type != FARM_JOB) {
+		cerr << "ERROR: \"" << address << "\" didn't send a job." << endl;
+		return 1;
+	}
+
+	netreader in(payload);
+	int width = (int) in.getInt(), height = (int) in.getInt();
+	precision prec = (precision) in.getInt();
+	renderoptions opts;
+	setDefaultOptions(opts);
+	opts.sceneFile = in.getString();
+	vector<string> args(in.getInt());
+	for (size_t i = 0; i < args.size() && in.ok(); i++)
+		args[i] = in.getString();
+	const char *scene;
+	size_t size;
+	in.getBytes(scene, size);
+	vector<char *> argv(1, (char *) "rt");
+	for (size_t i = 0; i < args.size(); i++)
+		argv.push_back(const_cast<char *>(args[i].c_str()));
+	if (!in.ok() || width <= 0 || height <= 0 ||
+			!parseOptions((int) argv.size(), &argv[0], 1, false, false, width,
+					height, opts, prec)) {
+		cerr << "ERROR: \"" << address << "\" sent a malformed job." << endl;
+		channel.send(FARM_FAILED);
+		return 1;
+	}
+	opts.threads = threads;
+	opts.pinThreads = pinThreads;
+	opts.printStats = printStats;
+
+	if (prec == PRECISION_FLOAT)
+		return workOnJob<float, float, float>(opts, width, height, scene,
+				scene + size, channel);
+	if (prec == PRECISION_FLOAT_TIME)
+		return workOnJob<double, double, float>(opts, width, height, scene,
+				scene + size, channel);
+	return workOnJob<double, double, double>(opts, width, height, scene,
+			scene + size, channel);
+}
+
+/**
+ * Width of the images of @c --bench .
+ */
+#define BENCH_WIDTH 320
+
+/**
+ * Height of the images of @c --bench .
+ */
+#define BENCH_HEIGHT 200
+
+/**
+ * Number of times @c --bench runs every measurement, keeping the fastest.
+ */
+#define BENCH_REPEATS 3
+
+/**
+ * Gets the seconds since a time.
+ *
+ * @param start The time.
+ *
+ * @return The seconds.
+ */
+double secondsSince(const boost::posix_time::ptime &start) {
+	return (boost::posix_time::microsec_clock::universal_time() -
+			start).total_microseconds() * 1e-6;
+}
+
+/**
+ * The fastest times of the runs of a scene by @c benchRender .
+ */
+struct benchtimes {
+	/** Seconds spent parsing the scene and adding its objects. */
+	double parse;
+	/** Seconds spent finalizing the scene. */
+	double build;
+	/** Seconds spent rendering it. */
+	double render;
+	/** The counts of the fastest render, all 0 without @c RT_STATS . */
+	raystats rays;
+
+	benchtimes() : parse(0), build(0), render(0) { }
+
+	/**
+	 * Gets the number of rays of the fastest render.
+	 *
+	 * @return Closest hit and shadow rays.
+	 */
+	unsigned long long getRays() const {
+		return rays.closestRays + rays.shadowRays;
+	}
+};
+
+/**
+ * Gets the description of a scene of the benchmark suite, reading it if
+ * it's in a file. Prints an error if it can't be read.
+ *
+ * @param b The scene.
+ * @param[out] text Receives the description.
+ *
+ * @return @c false if it couldn't be read or is empty.
+ */
+bool readBenchScene(const benchscene &b, vector<char> &text) {
+	text.assign(b.text.begin(), b.text.end());
+	if (!b.file.empty()) {
+		FILE *f = fopen(b.file.c_str(), "rb");
+		bool ok = f != 0 && readAll(f, text);
+		if (f != 0)
+			fclose(f);
+		if (!ok || text.empty()) {
+			cerr << "ERROR: can't read \"" << b.file << "\"." << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Parses, builds and renders a scene of the benchmark suite
+ * @c BENCH_REPEATS times, timing each phase. Prints an error if the scene
+ * isn't valid.
+ *
+ * @param run The options to render with.
+ * @param b The scene.
+ * @param text Its description, from @c readBenchScene .
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param[out] best Receives the fastest time of each phase.
+ * @param[out] image Receives the image of the last run.
+ *
+ * @return @c false if the scene couldn't be parsed or has no camera.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+bool benchRender(const renderoptions &run, const benchscene &b,
+		const vector<char> &text, int width, int height, benchtimes &best,
+		vector<rgbcolor<color_T> > &image) {
+	for (int k = 0; k < BENCH_REPEATS; k++) {
+		scene<vec_T, color_T, time_T, 3> sc(run.shadowsOn);
+		configureScene(run, sc);
+		boost::shared_ptr<camera<vec_T, time_T, 3> > cam;
+		scenedescription desc;
+		string error;
+		boost::posix_time::ptime start =
+				boost::posix_time::microsec_clock::universal_time();
+		if (!parseSceneParallel<vec_T, color_T>(&text[0],
+				&text[0] + text.size(), sceneDirectory(b.file), run.threads,
+				desc, error) || !addSceneRecords(sc, desc.records.empty() ?
+				0 : &desc.records[0], desc.records.size(), desc.paths, cam,
+				error)) {
+			cerr << "ERROR: " << b.name << ": " << error << endl;
+			return false;
+		}
+		if (!cam) {
+			cerr << "ERROR: " << b.name << ": the scene description has no"
+					" camera." << endl;
+			return false;
+		}
+		double parsed = secondsSince(start);
+		start = boost::posix_time::microsec_clock::universal_time();
+		sc.finalize();
+		double built = secondsSince(start);
+		rendercontext<vec_T, color_T, time_T, 3> ctx;
+		raystats::reset();
+		start = boost::posix_time::microsec_clock::universal_time();
+		renderPixels(run, sc, *cam, width, height, image, ctx);
+		double rendered = secondsSince(start);
+		if (k == 0 || parsed < best.parse)
+			best.parse = parsed;
+		if (k == 0 || built < best.build)
+			best.build = built;
+		if (k == 0 || rendered < best.render) {
+			best.render = rendered;
+			best.rays = raystats::total();
+		}
+	}
+	return true;
+}
+
+/**
+ * Runs the benchmark suite of @c getBenchScenes for @c --bench : renders
+ * every scene at @c BENCH_WIDTH x @c BENCH_HEIGHT on each count of threads
+ * of @c getBenchThreadCounts up to @c -j , with the other options as
+ * given, and writes a CSV line to @c cout per scene and count. Each line
+ * has the seconds spent parsing the scene, building its acceleration
+ * structure and rendering it, the fastest of @c BENCH_REPEATS runs, and
+ * the speedup of the render over the one on fewest threads. The rays
+ * traced and rays per second are only counted in a build with
+ * @c RT_STATS , and left empty otherwise.
+ *
+ * @param opts The command line options.
+ * @param precisionName Name of the precision for the results.
+ *
+ * @return The exit status of the program.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+int runBenchmarks(const renderoptions &opts, const char *precisionName) {
+	vector<benchscene> scenes;
+	getBenchScenes("", scenes);
+	vector<int> counts;
+	getBenchThreadCounts(opts.threads, counts);
+	cout << "scene,precision,accel,width,height,threads,parse_s,build_s,"
+			"render_s,rays,rays_per_s,speedup" << endl;
+	for (size_t i = 0; i < scenes.size(); i++) {
+		const benchscene &b = scenes[i];
+		vector<char> text;
+		if (!readBenchScene(b, text))
+			return 1;
+		double serial = 0;
+		for (size_t j = 0; j < counts.size(); j++) {
+			renderoptions run = opts;
+			run.threads = counts[j];
+			run.sceneFile = b.file;
+			benchtimes best;
+			vector<rgbcolor<color_T> > image;
+			if (!benchRender<vec_T, color_T, time_T>(run, b, text,
+					BENCH_WIDTH, BENCH_HEIGHT, best, image))
+				return 1;
+			if (j == 0)
+				serial = best.render;
+			cout << b.name << "," << precisionName << "," << run.accelType <<
+					"," << BENCH_WIDTH << "," << BENCH_HEIGHT << "," <<
+					run.threads << "," << best.parse << "," << best.build <<
+					"," << best.render << ",";
+#ifdef RT_STATS
+			unsigned long long traced = best.getRays();
+			cout << traced << "," << (best.render > 0 ? traced / best.render :
+					0);
+#else
+			cout << ",";
+#endif
+			cout << "," << (best.render > 0 ? serial / best.render : 0) <<
+					endl;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Width of the golden images written by @c --check @c --update-golden .
+ */
+#define CHECK_WIDTH 160
+
+/**
+ * Height of the golden images written by @c --check @c --update-golden .
+ */
+#define CHECK_HEIGHT 100
+
+/**
+ * Reads the rays per second of the scenes in a baseline of @c --check :
+ * a header line, then a line of the form @c scene,rays_per_s per scene.
+ *
+ * @param path The baseline file.
+ * @param[out] rates Receives the rays per second by scene.
+ *
+ * @return @c false if there's no such file.
+ */
+bool readCheckBaseline(const string &path, map<string, double> &rates) {
+	ifstream in(path.c_str());
+	if (!in)
+		return false;
+	string line;
+	getline(in, line);
+	while (getline(in, line)) {
+		size_t comma = line.find(',');
+		if (comma != string::npos)
+			rates[line.substr(0, comma)] = atof(line.c_str() + comma + 1);
+	}
+	return true;
+}
+
+/**
+ * Runs the regression gate for @c --check : renders each example scene of
+ * @c getBenchScenes with the given options at the size of its golden image
+ * in the @c --check directory, and fails if a channel of a pixel differs by
+ * more than @c --tolerance 8 bit levels. In a build with @c RT_STATS it
+ * also fails if a scene traces rays more than @c --max-slowdown slower
+ * than the rays per second written to @c baseline.csv there, the fastest of
+ * @c BENCH_REPEATS renders. With @c --update-golden the golden images are
+ * written at @c CHECK_WIDTH x @c CHECK_HEIGHT instead of compared, and with
+ * @c --update-baseline the baseline is written instead of compared.
+ * Prints a line per scene to @c cout .
+ *
+ * @param opts The command line options.
+ *
+ * @return The exit status of the program: 1 if a check failed.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+int runChecks(const renderoptions &opts) {
+	typedef scene<vec_T, color_T, time_T, 3> scene_t;
+	vector<benchscene> scenes;
+	getBenchScenes("", scenes);
+	string baselineFile = opts.checkDir + "/baseline.csv";
+#ifdef RT_STATS
+	map<string, double> baseline;
+	bool haveBaseline = readCheckBaseline(baselineFile, baseline);
+#endif
+	ostringstream rates;
+	rates << "scene,rays_per_s" << endl;
+	int failed = 0;
+	for (size_t i = 0; i < scenes.size(); i++) {
+		const benchscene &b = scenes[i];
+		if (b.file.empty())
+			continue;
+		vector<char> text;
+		if (!readBenchScene(b, text))
+			return 1;
+		string goldenFile = opts.checkDir + "/" + b.name + ".ppm";
+		string error;
+		rasterimage golden;
+		int width = CHECK_WIDTH, height = CHECK_HEIGHT;
+		if (!opts.updateGolden) {
+			ifstream in(goldenFile.c_str(), ios::in | ios::binary);
+			if (!in || !readRasterImage(in, golden, error)) {
+				cerr << "ERROR: can't read \"" << goldenFile << "\"" <<
+						(in ? ": " + error : ".") << endl;
+				return 1;
+			}
+			width = golden.width;
+			height = golden.height;
+		}
+
+		renderoptions run = opts;
+		run.sceneFile = b.file;
+		run.image = IMAGE_PPM;
+		run.format = PPM_P6;
+		benchtimes best;
+		vector<rgbcolor<color_T> > image;
+		if (!benchRender<vec_T, color_T, time_T>(run, b, text, width, height,
+				best, image))
+			return 1;
+		ostringstream encoded;
+		writeImage<color_T, scene_t>(run, image, width, height, encoded);
+		cout << b.name << ": ";
+		if (opts.updateGolden) {
+			ofstream out(goldenFile.c_str(), ios::out | ios::binary);
+			out << encoded.str();
+			out.close();
+			if (!out) {
+				cerr << "ERROR: can't write \"" << goldenFile << "\"." << endl;
+				return 1;
+			}
+			cout << "wrote " << goldenFile;
+		}
+		else {
+			istringstream is(encoded.str());
+			rasterimage rendered;
+			double maxDiff = 0;
+			size_t differing = 0;
+			readRasterImage(is, rendered, error);
+			if (!compareRasterImages(rendered, golden, opts.checkTolerance,
+					maxDiff, differing, error)) {
+				cerr << "ERROR: " << b.name << ": " << error << endl;
+				return 1;
+			}
+			cout << (differing > 0 ? "IMAGE FAILED" : "image ok") <<
+					" (largest difference " << maxDiff << ", " << differing <<
+					" pixels beyond " << opts.checkTolerance << ")";
+			if (differing > 0)
+				failed++;
+		}
+#ifdef RT_STATS
+		double rate = best.render > 0 ? best.getRays() / best.render : 0;
+		rates << b.name << "," << rate << endl;
+		cout << ", " << rate << " rays/s";
+		if (!opts.updateBaseline && baseline.count(b.name) > 0) {
+			double slowdown = 1 - rate / baseline[b.name];
+			cout << " vs " << baseline[b.name] << " (" << -100 * slowdown <<
+					"%)";
+			if (slowdown > opts.maxSlowdown) {
+				cout << " SPEED FAILED";
+				failed++;
+			}
+		}
+#endif
+		cout << endl;
+	}
+#ifdef RT_STATS
+	if (opts.updateBaseline) {
+		ofstream out(baselineFile.c_str());
+		out << rates.str();
+		out.close();
+		if (!out) {
+			cerr << "ERROR: can't write \"" << baselineFile << "\"." << endl;
+			return 1;
+		}
+		cout << "wrote " << baselineFile << endl;
+	}
+	else if (!haveBaseline) {
+		cout << "no " << baselineFile << " to compare speed with; write it"
+				" with --update-baseline (make check-baseline)" << endl;
+	}
+#else
+	cout << "rays aren't counted without RT_STATS, so speed isn't checked"
+			" (make check)" << endl;
+#endif
+	cout << (failed > 0 ? "FAILED" : "passed") << endl;
+	return failed > 0 ? 1 : 0;
+}
+
+/**
+ * Loads a scene from its bytes with the given options and renders a probe
+ * of it for @c --auto , at the size @c autotuner::getProbeSize gives, into
+ * memory @c AUTOTUNE_PROBE_REPEATS times, of which the fastest counts.
+ *
+ * @param probe The options to render with.
+ * @param begin The first byte of the scene.
+ * @param end One past the last byte.
+ * @param width The width of the whole image in pixels.
+ * @param height The height of the whole image in pixels.
+ * @param name Name of the setting tried, for @c autotuner::addTrial .
+ * @param tuner If not null, the build and render are timed and added to it
+ *   as a trial, along with the probe to hold to its reference.
+ * @param stats If not null, receives the statistics of the scene.
+ * @param levels If not null, receives the 8 bit channels of the probe.
+ *
+ * @return @c false if the scene couldn't be loaded.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+bool probeRender(const renderoptions &probe, const char *begin,
+		const char *end, int width, int height, const string &name,
+		autotuner *tuner, scenestats *stats = 0,
+		vector<unsigned char> *levels = 0) {
+	scene<vec_T, color_T, time_T, 3> sc(probe.shadowsOn);
+	configureScene(probe, sc);
+	boost::shared_ptr<camera<vec_T, time_T, 3> > cam;
+	phasetimes times;
+	times.start(PHASE_PARSE);
+	if (!loadSceneBytes<vec_T, color_T, time_T>(probe, begin, end, sc, cam,
+			0, 0, 0, &times))
+		return false;
+	if (stats)
+		gatherSceneStats(sc, *stats);
+	int probeWidth, probeHeight;
+	autotuner::getProbeSize(width, height, probeWidth, probeHeight);
+	times.stop();
+	rendercontext<vec_T, color_T, time_T, 3> ctx;
+	vector<rgbcolor<color_T> > image;
+	double best = 0;
+	for (int k = 0; k < AUTOTUNE_PROBE_REPEATS; k++) {
+		boost::posix_time::ptime start =
+				boost::posix_time::microsec_clock::universal_time();
+		renderPixels(probe, sc, *cam, probeWidth, probeHeight, image, ctx);
+		double rendered = secondsSince(start);
+		if (k == 0 || rendered < best)
+			best = rendered;
+	}
+	vector<unsigned char> quantized(3 * image.size());
+	for (size_t i = 0; i < image.size(); i++) {
+		color_T rgb[3] = {image[i].getR(), image[i].getG(),
+				image[i].getB()};
+		quantizeScalar(rgb, 3, (color_T) COLORMAX, &quantized[3 * i]);
+	}
+	if (tuner)
+		tuner->addTrial(name, times.getWallSeconds(PHASE_BUILD), best,
+				(long) probeWidth * probeHeight, quantized);
+	if (levels)
+		levels->swap(quantized);
+	return true;
+}
+
+/**
+ * Picks the render settings for @c --auto . The scene is loaded once and
+ * probed exactly, in double with the options given, for its
+ * @c scenestats and the probe every setting is held to. The light
+ * sampling and the reflection cutoff the @c autotuner suggests are kept
+ * only if their probe is within @c AUTOTUNE_TOLERANCE levels of it; then
+ * the scene is loaded and probed with each accelerator the tuner lists,
+ * with each instruction set up to the widest this CPU supports and, if
+ * the tuner finds floats precise enough, in float as well as double,
+ * keeping at each step the one estimated fastest for the whole image,
+ * builds included, of those whose probes are as close. The tile size and
+ * the packet width of the render are fixed when it's compiled, so the
+ * instruction set is what's picked for the width of the batch tests. The
+ * settings are printed to @c stderr as the options that give them, and
+ * with @c --stats so are the statistics and the estimates.
+ *
+ * @param opts The command line options, which receive the settings.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param[out] prec Receives the precision.
+ *
+ * @return @c false if the scene couldn't be read or loaded.
+ */
+bool autoTune(renderoptions &opts, int width, int height, precision &prec) {
+	mappedfile file;
+	vector<char> text;
+	const char *begin, *end;
+	if (!readSceneBytes(opts, file, text, begin, end))
+		return false;
+	renderoptions probe = opts;
+	probe.crop = false;
+	probe.printStats = false;
+	probe.bvhCache.clear();
+	probe.accelType = "bvh";
+	scenestats stats;
+	vector<unsigned char> exact;
+	if (!probeRender<double, double, double>(probe, begin, end, width,
+			height, "", 0, &stats, &exact))
+		return false;
+	autotuner tuner(stats);
+	tuner.setReference(exact);
+	renderoptions sampled = probe;
+	tuner.getLightSampling(sampled.lightPicks, sampled.cutError);
+	vector<unsigned char> levels;
+	if ((sampled.lightPicks != probe.lightPicks ||
+			sampled.cutError != probe.cutError) &&
+			probeRender<double, double, double>(sampled, begin, end,
+			width, height, "", 0, 0, &levels) && tuner.isFaithful(levels)) {
+		probe.lightPicks = sampled.lightPicks;
+		probe.cutError = sampled.cutError;
+	}
+	sampled = probe;
+	sampled.minThroughput = tuner.getMinThroughput();
+	if (sampled.minThroughput != probe.minThroughput &&
+			probeRender<double, double, double>(sampled, begin, end,
+			width, height, "", 0, 0, &levels) && tuner.isFaithful(levels))
+		probe.minThroughput = sampled.minThroughput;
+	long pixels = (long) width * height;
+
+	vector<string> accels;
+	tuner.getAccelerators(accels);
+	for (size_t i = 0; i < accels.size(); i++) {
+		probe.accelType = accels[i];
+		probeRender<double, double, double>(probe, begin, end, width,
+				height, accels[i], &tuner);
+	}
+	string fastest = tuner.getFastest(pixels);
+	probe.accelType = fastest.empty() ? "bvh" : fastest;
+	if (opts.printStats) {
+		stats.print(cerr);
+		tuner.printTrials(cerr, pixels);
+	}
+
+	simdLevel exactLevel = activeSimdLevel(), widest = detectSimdLevel();
+	setSimdLevel(widest);
+	if (widest > SIMD_SSE2) {
+		tuner.clearTrials();
+		for (int l = widest; l >= SIMD_SSE2; l--) {
+			setSimdLevel((simdLevel) l);
+			probeRender<double, double, double>(probe, begin, end, width,
+					height, simdLevelName((simdLevel) l), &tuner);
+		}
+		simdLevel level = exactLevel;
+		parseSimdLevel(tuner.getFastest(pixels), level);
+		setSimdLevel(level);
+		if (opts.printStats)
+			tuner.printTrials(cerr, pixels);
+	}
+
+	prec = PRECISION_DOUBLE;
+	if (tuner.isFloatSafe()) {
+		tuner.clearTrials();
+		probeRender<double, double, double>(probe, begin, end, width,
+				height, "double", &tuner);
+		probeRender<float, float, float>(probe, begin, end, width, height,
+				"float", &tuner);
+		if (tuner.getFastest(pixels) == "float")
+			prec = PRECISION_FLOAT;
+		if (opts.printStats)
+			tuner.printTrials(cerr, pixels);
+	}
+
+	opts.accelType = probe.accelType;
+	opts.lightPicks = probe.lightPicks;
+	opts.cutError = probe.cutError;
+	opts.minThroughput = probe.minThroughput;
+	cerr << "auto: --accel " << opts.accelType << " --simd " <<
+			simdLevelName(activeSimdLevel()) << " --precision " <<
+			(prec == PRECISION_FLOAT ? "float" : "double") <<
+			" --light-picks " << opts.lightPicks << " --lightcuts " <<
+			opts.cutError << " --min-throughput " << opts.minThroughput <<
+			endl;
+	return true;
+}
+
+/**
+ * Writes a random scene made by @c generateScene for @c --generate , with
+ * the parameters of the command line.
+ *
+ * @param argc Number of arguments.
+ * @param argv The arguments, the parameters from the third.
+ *
+ * @return The exit status of the program.
+ */
+int writeGeneratedScene(int argc, char **argv) {
+	sceneparams p;
+	string outFile;
+	for (int i = 2; i < argc; i++) {
+		string arg = argv[i];
+		if (i + 1 >= argc) {
+			usage(argv[0]);
+			return 1;
+		}
+		const char *value = argv[++i];
+		if (arg == "--spheres")
+			p.spheres = atoi(value);
+		else if (arg == "--cylinders")
+			p.cylinders = atoi(value);
+		else if (arg == "--lights")
+			p.lights = atoi(value);
+		else if (arg == "--area-lights")
+			p.areaLights = atoi(value);
+		else if (arg == "--clusters")
+			p.clusters = atoi(value);
+		else if (arg == "--cluster-radius")
+			p.clusterRadius = atof(value);
+		else if (arg == "--reflectivity")
+			p.reflectivity = atof(value);
+		else if (arg == "--size")
+			p.size = atof(value);
+		else if (arg == "--seed")
+			p.seed = strtoull(value, 0, 10);
+		else if (arg == "-o")
+			outFile = value;
+		else
+			p.spheres = -1;
+		if (p.spheres < 0 || p.cylinders < 0 || p.lights < 0 ||
+				p.areaLights < 0 || p.clusters < 0 || p.clusterRadius < 0 ||
+				p.reflectivity < 0 || p.reflectivity > 1 || !(p.size > 0)) {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	string text = generateScene(p);
+	if (outFile.empty()) {
+		cout << text;
+		return 0;
+	}
+	ofstream file(outFile.c_str(), ios::out | ios::binary);
+	file << text;
+	file.close();
+	if (!file) {
+		cerr << "ERROR: can't write \"" << outFile << "\"." << endl;
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * This program takes a scene description from @c cin (it's advised to redirect
+ * the scene description from a file like @c example.dat) then renders a scene
+ * of the given width and height to PPM formatted image. Shadows can be turned
+ * on with the flag -s and the acceleration structure can be picked with
+ * @c --accel ; options follow the image dimensions in any order. The
+ * output is written to cout unless a file is given with @c -o , which writes
+ * PNG, PFM or OpenEXR if the file name ends in .png, .pfm or .exr. For
+ * example, @code rt 640 480 -s -o img.png < example.dat @endcode
+ * Scenes rendered many times can be compiled once with
+ * @code rt --compile example.dat example.rtb @endcode
+ * and then rendered with @code rt 640 480 -s --scene example.rtb @endcode
+ * which maps the file and uses its objects and BVH without parsing or
+ * building. A scene rendered from many views can be loaded once with
+ * @code rt --serve example.dat -s @endcode which reads render commands
+ * from @c stdin ; see @c serveScene . A scene with several cameras is
+ * rendered from all of them at once with
+ * @code rt 640 480 -s --cameras -o view-%c.png < example.dat @endcode
+ * and the frames of an animated scene are rendered one after the other,
+ * moving the keyed objects in between, with
+ * @code rt 640 480 -s --frames 0:99 -o frame-%f.png < example.dat @endcode
+ * and with @c --frame-cache on a shared directory, any number of machines
+ * running the same command split the frames between them, and running it
+ * again after an edit only renders the frames that changed.
+ * A large image can be split among machines that each render a window of
+ * it, say @code rt 640 480 -s --crop 0 0 320 480 -o left.ppm < example.dat
+ * @endcode and the windows put together with @c rt-merge . The same split
+ * is made on the fly, with tiles leased to whichever machine asks next, by
+ * @code rt 640 480 -s --coordinate 7000 --scene example.rtb -o img.png
+ * @endcode and @code rt --work coordinator:7000 @endcode on each machine.
+ * The benchmark suite, which @c make @c bench runs, is run with
+ * @code rt --bench -s @endcode from the directory of the example scenes,
+ * and the regression gate of @c make @c check with
+ * @code rt --check test/golden -s @endcode from the same directory.
+ * Scenes of any size for stress tests are written by, e.g.,
+ * @code rt --generate --spheres 100000 --lights 16 --seed 3 -o big.dat
+ * @endcode
+ */
+int main(int argc, char **argv) {
+
+	bool compile = argc > 1 && string(argv[1]) == "--compile";
+	bool serve = argc > 1 && string(argv[1]) == "--serve";
+	bool bench = argc > 1 && string(argv[1]) == "--bench";
+	bool check = argc > 2 && string(argv[1]) == "--check";
+	if (argc > 1 && string(argv[1]) == "--generate")
+		return writeGeneratedScene(argc, argv);
+	if (argc > 2 && string(argv[1]) == "--work") {
+		int threads = hardwareThreads();
+		bool pinThreads = false, printStats = false;
+		for (int i = 3; i < argc; i++) {
+			string arg = argv[i];
+			if (arg == "-j" && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+				threads = atoi(argv[++i]);
+			}
+			else if (arg == "--pin-threads") {
+				pinThreads = true;
+			}
+			else if (arg == "--stats") {
+				printStats = true;
+			}
+			else {
+				usage(argv[0]);
+				return 1;
+			}
+		}
+		return workForCoordinator(argv[2], threads, pinThreads, printStats);
+	}
+	if (argc < (compile ? 4 : bench ? 2 : 3)) {
+		usage(argv[0]);
+		return 1;
+	}
+	renderoptions opts;
+	int width = 0, height = 0;
+	string compiledFile;
+	if (compile) {
+		opts.sceneFile = argv[2];
+		compiledFile = argv[3];
+	}
+	else if (serve) {
+		opts.sceneFile = argv[2];
+	}
+	else if (bench) {
+		width = BENCH_WIDTH;
+		height = BENCH_HEIGHT;
+	}
+	else if (check) {
+		opts.checkDir = argv[2];
+	}
+	else {
+		width = atoi(argv[1]);
+		height = atoi(argv[2]);
+		if (width <= 0 || height <= 0) {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	setDefaultOptions(opts);
+	precision prec = PRECISION_DOUBLE;
+	if (!parseOptions(argc, argv, compile ? 4 : bench ? 2 : 3, compile,
+			serve, width, height, opts, prec) ||
+			(!check && (opts.updateGolden || opts.updateBaseline))) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (serve && (opts.progressive || opts.stream || opts.mapOutput ||
+			!opts.outFile.empty())) {
+		// Every command names its own file, written in one piece.
+		usage(argv[0]);
+		return 1;
+	}
+	if (opts.allCameras && (opts.progressive || opts.stream ||
+			opts.mapOutput || !opts.cameraName.empty() ||
+			opts.outFile.find("%c") == string::npos)) {
+		// Every camera needs a file of its own, written in one piece.
+		usage(argv[0]);
+		return 1;
+	}
+	if (opts.lastFrame >= 0 && (opts.progressive || opts.stream ||
+			opts.mapOutput || opts.allCameras ||
+			opts.outFile.find("%f") == string::npos)) {
+		// Every frame needs a file of its own, written in one piece.
+		usage(argv[0]);
+		return 1;
+	}
+	if (!opts.heatmapFile.empty() && (opts.progressive || opts.stream ||
+			opts.mapOutput || opts.wavefront || opts.allCameras ||
+			opts.lastFrame >= 0 || opts.crop || opts.farmPort >= 0 ||
+			serve)) {
+		// The cost map is filled in by renderImage.
+		usage(argv[0]);
+		return 1;
+	}
+	if (opts.timeBudget > 0 && (opts.progressive || opts.stream ||
+			opts.mapOutput || opts.allCameras || opts.lastFrame >= 0 ||
+			opts.crop || opts.farmPort >= 0 ||
+			!opts.heatmapFile.empty() || serve || bench || check)) {
+		// The passes render whole images of one camera in memory.
+		usage(argv[0]);
+		return 1;
+	}
+	if (!opts.checkpointFile.empty() && (opts.progressive || opts.stream ||
+			opts.mapOutput || opts.wavefront || opts.allCameras ||
+			opts.lastFrame >= 0 || opts.crop || opts.farmPort >= 0 ||
+			!opts.heatmapFile.empty() ||
+			opts.timeBudget > 0 || opts.view || opts.watch || bench ||
+			check)) {
+		// Checkpoints are of the tiles of a single renderTiles image.
+		usage(argv[0]);
+		return 1;
+	}
+	if (opts.resume && opts.checkpointFile.empty()) {
+		usage(argv[0]);
+		return 1;
+	}
+	if ((opts.view || opts.watch) && ((opts.view && opts.watch) ||
+			opts.progressive || opts.stream || opts.mapOutput ||
+			opts.allCameras || opts.lastFrame >= 0 || opts.crop ||
+			opts.farmPort >= 0 ||
+			!opts.heatmapFile.empty() || opts.timeBudget > 0 ||
+			!opts.statsJson.empty() || !opts.traceFile.empty() || bench ||
+			check)) {
+		// Views are rendered progressively, one camera or version of the
+		// scene at a time, until the next command or change.
+		usage(argv[0]);
+		return 1;
+	}
+	if (opts.perfCounters && opts.statsJson.empty() &&
+			opts.traceFile.empty()) {
+		// The counts go to the --stats-json and --trace files.
+		usage(argv[0]);
+		return 1;
+	}
+	if ((!opts.statsJson.empty() || !opts.traceFile.empty()) &&
+			(opts.allCameras || opts.lastFrame >= 0 || opts.farmPort >= 0 ||
+			serve || bench || check || compile)) {
+		// Only the phases of a single render are timed.
+		usage(argv[0]);
+		return 1;
+	}
+	if ((opts.profileTop > 0 || !opts.profileJson.empty()) &&
+			(opts.allCameras || opts.lastFrame >= 0 || opts.farmPort >= 0 ||
+			opts.view || opts.watch || serve || bench ||
+			check || compile)) {
+		// The profile is of the shapes and lights of a single render on
+		// the host.
+		usage(argv[0]);
+		return 1;
+	}
+	if ((bench || check) && (opts.progressive || opts.stream ||
+			opts.mapOutput || opts.allCameras || opts.lastFrame >= 0 ||
+			opts.crop || opts.farmPort >= 0 ||
+			!opts.heatmapFile.empty() || !opts.outFile.empty() ||
+			!opts.sceneFile.empty() || !opts.cameraName.empty())) {
+		// The suites render their own scenes to memory.
+		usage(argv[0]);
+		return 1;
+	}
+#ifndef RT_STATS
+	if (opts.updateBaseline) {
+		cerr << "ERROR: --update-baseline needs a build with RT_STATS"
+				" (make check-baseline)." << endl;
+		return 1;
+	}
+	if (opts.heatmapCost == COST_TESTS) {
+		cerr << "ERROR: --heatmap-cost tests needs a build with RT_STATS"
+				" (make srt)." << endl;
+		return 1;
+	}
+#endif
+	if (opts.farmPort >= 0 && (opts.progressive || opts.stream ||
+			opts.mapOutput || opts.wavefront || opts.allCameras ||
+			opts.lastFrame >= 0 || opts.crop)) {
+		// The workers send back whole tiles of one image.
+		usage(argv[0]);
+		return 1;
+	}
+	if (!opts.frameCache.empty() && opts.lastFrame < 0) {
+		// Only frames are cached.
+		usage(argv[0]);
+		return 1;
+	}
+	if (opts.reuseTiles && (opts.lastFrame < 0 || opts.crop ||
+			opts.wavefront)) {
+		// Tiles are reused from whole frames renderImage made.
+		usage(argv[0]);
+		return 1;
+	}
+	if (opts.reproject > 0 && (opts.lastFrame < 0 || !opts.wavefront ||
+			!opts.frameCache.empty())) {
+		// Reprojected frames depend on the frames before them.
+		usage(argv[0]);
+		return 1;
+	}
+	if (opts.denoisePasses > 0 && (opts.crop || opts.progressive ||
+			opts.stream || opts.farmPort >= 0 || opts.reuseTiles)) {
+		// The filter needs the whole image and its G-buffer at once.
+		usage(argv[0]);
+		return 1;
+	}
+	if (opts.storage != PIXELS_FULL && (opts.progressive || opts.stream ||
+			opts.mapOutput || opts.wavefront || opts.allCameras ||
+			opts.lastFrame >= 0 || opts.crop || opts.farmPort >= 0 ||
+			!opts.heatmapFile.empty() ||
+			opts.timeBudget > 0 || !opts.checkpointFile.empty() ||
+			opts.view || opts.watch || opts.aaSamples > 1 ||
+			opts.pixelSamples > 1 || opts.denoisePasses > 0 || serve ||
+			bench || check || compile)) {
+		// Compact images are put together from the bands of renderBands.
+		usage(argv[0]);
+		return 1;
+	}
+	if (opts.stripRows > 0 && (opts.progressive || opts.stream ||
+			opts.mapOutput || opts.wavefront || opts.allCameras ||
+			opts.lastFrame >= 0 || opts.crop || opts.farmPort >= 0 ||
+			!opts.heatmapFile.empty() ||
+			opts.timeBudget > 0 || !opts.checkpointFile.empty() ||
+			opts.view || opts.watch || opts.aaSamples > 1 ||
+			opts.pixelSamples > 1 || opts.denoisePasses > 0 ||
+			opts.storage != PIXELS_FULL || serve || bench || check ||
+			compile || !(opts.image == IMAGE_PPM ||
+			opts.image == IMAGE_EXR))) {
+		// Strips are written top down as they're done, which only PPM and
+		// OpenEXR rows can be.
+		usage(argv[0]);
+		return 1;
+	}
+	if (opts.previewPort >= 0 && (!(opts.progressive || opts.stream ||
+			opts.stripRows > 0) || opts.allCameras || opts.lastFrame >= 0 ||
+			opts.farmPort >= 0 || opts.view || opts.watch || serve ||
+			bench || check || compile)) {
+		// Only passes, bands and strips are pushed, as they're done.
+		usage(argv[0]);
+		return 1;
+	}
+	if (opts.compactSpheres && (opts.outOfCore > 0 ||
+			opts.view || opts.watch || serve || bench || check || compile)) {
+		// The spheres are gathered as a scene description is loaded, for
+		// the host to render, and views edit shapes by their index.
+		usage(argv[0]);
+		return 1;
+	}
+	if (opts.memReport && (opts.allCameras || opts.lastFrame >= 0 ||
+			opts.farmPort >= 0 || opts.view || opts.watch || serve ||
+			bench || check || compile)) {
+		// The report is of a single render.
+		usage(argv[0]);
+		return 1;
+	}
+	if (opts.autoTune && (opts.allCameras || opts.lastFrame >= 0 ||
+			opts.farmPort >= 0 || opts.outOfCore > 0 ||
+			opts.view || opts.watch || serve || bench || check || compile)) {
+		// The probes are of the one camera of a single render on the host.
+		usage(argv[0]);
+		return 1;
+	}
+	if (opts.crop && (opts.progressive || opts.stream || opts.mapOutput ||
+			opts.wavefront)) {
+		// Crops are rendered tile by tile like renderImage does.
+		usage(argv[0]);
+		return 1;
+	}
+	if (!opts.thumbnails.empty() && (opts.outFile.empty() ||
+			opts.progressive || opts.stream || opts.mapOutput ||
+			opts.storage != PIXELS_FULL || opts.stripRows > 0 || opts.crop ||
+			opts.farmPort >= 0 || opts.timeBudget > 0 ||
+			!opts.checkpointFile.empty() || !opts.frameCache.empty() ||
+			opts.view || opts.watch || serve || bench || check ||
+			compile)) {
+		// Thumbnails are scaled from whole images in memory and named
+		// after their files.
+		usage(argv[0]);
+		return 1;
+	}
+	if (!opts.aovs.empty() && (opts.outFile.empty() || opts.progressive ||
+			opts.stream || opts.mapOutput || opts.storage != PIXELS_FULL ||
+			opts.stripRows > 0 || opts.crop || opts.allCameras ||
+			opts.lastFrame >= 0 || opts.farmPort >= 0 ||
+			opts.timeBudget > 0 || !opts.checkpointFile.empty() ||
+			!opts.frameCache.empty() || opts.view || opts.watch || serve ||
+			bench || check || compile)) {
+		// The variables come from the G-buffer of a single whole render
+		// and are named after its file.
+		usage(argv[0]);
+		return 1;
+	}
+	if (opts.procs > 0 && (opts.progressive || opts.stream ||
+			opts.mapOutput || opts.storage != PIXELS_FULL ||
+			opts.stripRows > 0 || opts.crop || opts.wavefront ||
+			opts.denoisePasses > 0 || !opts.thumbnails.empty() ||
+			!opts.aovs.empty() || opts.allCameras || opts.lastFrame >= 0 ||
+			opts.farmPort >= 0 || opts.timeBudget > 0 ||
+			!opts.checkpointFile.empty() || !opts.frameCache.empty() ||
+			!opts.heatmapFile.empty() || opts.profileTop > 0 ||
+			!opts.profileJson.empty() || opts.previewPort >= 0 ||
+			opts.printStats || opts.view || opts.watch || serve || bench ||
+			check || compile)) {
+		// The workers render bands of one whole image, and what they
+		// count dies with them.
+		usage(argv[0]);
+		return 1;
+	}
+	if (opts.stream && opts.image != IMAGE_PPM) {
+		// Only PPM can be written a band at a time.
+		usage(argv[0]);
+		return 1;
+	}
+	if (opts.mapOutput && (opts.outFile.empty() ||
+			!(opts.image == IMAGE_PFM ||
+			(opts.image == IMAGE_PPM && opts.format == PPM_P6)))) {
+		// Only formats with headers of a known size can be mapped.
+		usage(argv[0]);
+		return 1;
+	}
+	hugepages::setEnabled(opts.hugePages);
+	if (opts.autoTune && !autoTune(opts, width, height, prec))
+		return 1;
+
+	if (compile) {
+		if (prec == PRECISION_FLOAT)
+			return compileScene<float, float, float>(opts, compiledFile);
+		if (prec == PRECISION_FLOAT_TIME)
+			return compileScene<double, double, float>(opts, compiledFile);
+		return compileScene<double, double, double>(opts, compiledFile);
+	}
+	if (opts.farmPort >= 0) {
+		vector<string> args = workerArguments(argc, argv, 3);
+		if (prec == PRECISION_FLOAT)
+			return coordinateRender<float, float, float>(opts, width, height,
+					prec, args);
+		if (prec == PRECISION_FLOAT_TIME)
+			return coordinateRender<double, double, float>(opts, width,
+					height, prec, args);
+		return coordinateRender<double, double, double>(opts, width, height,
+				prec, args);
+	}
+	if (check) {
+		if (prec == PRECISION_FLOAT)
+			return runChecks<float, float, float>(opts);
+		if (prec == PRECISION_FLOAT_TIME)
+			return runChecks<double, double, float>(opts);
+		return runChecks<double, double, double>(opts);
+	}
+	if (bench) {
+		if (prec == PRECISION_FLOAT)
+			return runBenchmarks<float, float, float>(opts, "float");
+		if (prec == PRECISION_FLOAT_TIME)
+			return runBenchmarks<double, double, float>(opts, "float-time");
+		return runBenchmarks<double, double, double>(opts, "double");
+	}
+	if (serve) {
+		if (prec == PRECISION_FLOAT)
+			return serveScene<float, float, float>(opts, "float");
+		if (prec == PRECISION_FLOAT_TIME)
+			return serveScene<double, double, float>(opts, "float-time");
+		return serveScene<double, double, double>(opts, "double");
+	}
+	if (opts.watch) {
+		if (prec == PRECISION_FLOAT)
+			return watchScene<float, float, float>(opts, width, height,
+					"float");
+		if (prec == PRECISION_FLOAT_TIME)
+			return watchScene<double, double, float>(opts, width, height,
+					"float-time");
+		return watchScene<double, double, double>(opts, width, height,
+				"double");
+	}
+	if (opts.view) {
+		if (prec == PRECISION_FLOAT)
+			return viewScene<float, float, float>(opts, width, height,
+					"float");
+		if (prec == PRECISION_FLOAT_TIME)
+			return viewScene<double, double, float>(opts, width, height,
+					"float-time");
+		return viewScene<double, double, double>(opts, width, height,
+				"double");
+	}
+	if (opts.lastFrame >= 0) {
+		if (prec == PRECISION_FLOAT)
+			return renderFrames<float, float, float>(opts, width, height,
+					"float");
+		if (prec == PRECISION_FLOAT_TIME)
+			return renderFrames<double, double, float>(opts, width, height,
+					"float-time");
+		return renderFrames<double, double, double>(opts, width, height,
+				"double");
+	}
+	if (opts.allCameras) {
+		if (prec == PRECISION_FLOAT)
+			return renderCameras<float, float, float>(opts, width, height,
+					"float");
+		if (prec == PRECISION_FLOAT_TIME)
+			return renderCameras<double, double, float>(opts, width, height,
+					"float-time");
+		return renderCameras<double, double, double>(opts, width, height,
+				"double");
+	}
+	if (prec == PRECISION_FLOAT)
+		return renderScene<float, float, float>(opts, width, height, "float");
+	if (prec == PRECISION_FLOAT_TIME)
+		return renderScene<double, double, float>(opts, width, height,
+				"float-time");
+	return renderScene<double, double, double>(opts, width, height, "double");
 }
@@ -0,0 +1,1062 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "accelerator.hh"
+#include "bvh.hh"
+#include "aabb.hh"
+#include "shape.hh"
+#include "shapekind.hh"
+#include "ray.hh"
+#include "boost/shared_ptr.hpp"
+#include "boost/scoped_ptr.hpp"
+#include "boost/atomic.hpp"
+#include "boost/bind.hpp"
+#include "boost/noncopyable.hpp"
+#include "boost/thread.hpp"
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <limits>
+#include <map>
+#include <queue>
+#include <utility>
+#include <vector>
+#include <ostream>
+
+#ifndef DYNAMICBVH_HH
+#define DYNAMICBVH_HH
+
+/**
+ * Height a @c dynamicbvh may reach before it's rebuilt on the spot, which
+ * bounds the stacks of its walks.
+ */
+#define DYNAMICBVH_MAX_DEPTH 96
+
+/**
+ * How much worse than right after a full build the SAH cost of a
+ * @c dynamicbvh gets before it's rebuilt by default.
+ */
+#define DYNAMICBVH_REBUILD_RATIO 1.3
+
+/**
+ * Number of shapes from which a @c dynamicbvh rebuilds on a thread of its
+ * own by default. Smaller trees are rebuilt faster than a thread starts.
+ */
+#define DYNAMICBVH_BACKGROUND_MIN 4096
+
+/**
+ * A bounding volume hierarchy with one shape per leaf that shapes can be
+ * added to, removed from and moved in without building it again, for
+ * editors that make many small changes to big scenes. A shape is added by
+ * finding the node that's the cheapest sibling for it by the SAH, with a
+ * branch and bound search, and the nodes above it are then refit and
+ * rotated where swapping a child with a grandchild shrinks them. A removed
+ * shape's leaf is taken out and the nodes above it refit, and a moved one
+ * is taken out and added again.
+ *
+ * Edits leave a worse tree than a full build would, so the SAH cost of the
+ * tree, the area of its interior nodes over that of its root, is kept up
+ * to date and compared with what it was after the last full build. Once
+ * it's @c rebuildRatio times that, the tree is built again, by the binned
+ * SAH of @c bvh , from a copy of the bounds on a thread of its own, and
+ * queries go on using the old tree meanwhile. The next edit after the
+ * rebuild is done swaps in the new tree, after catching it up with the
+ * edits made since the copy.
+ *
+ * Queries may run on several threads at once, but edits must not overlap
+ * them or each other. The tree can't be saved or read.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class dynamicbvh : public accelerator<vec_T, color_T, time_T, dim>,
+		private boost::noncopyable {
+public:
+
+	/**
+	 * Boost shared pointer typedef for shapes.
+	 */
+	typedef typename accelerator<vec_T, color_T, time_T, dim>::sp_shape
+		sp_shape;
+
+private:
+
+	typedef bvh<vec_T, color_T, time_T, dim> bvh_T;
+
+	typedef shape<vec_T, color_T, time_T, dim> shape_T;
+
+	/**
+	 * Build data of a shape, as for a @c bvh .
+	 */
+	typedef typename bvh_T::buildprim buildprim;
+
+	/**
+	 * A node of the tree. Its bounds are rounded outwards to floats like
+	 * those of a @c bvh . Nodes not in the tree are kept in a free list
+	 * linked through @c parent .
+	 */
+	struct dnode {
+		/** Lower corner of the box around everything below this node. */
+		float lo[dim];
+		/** Upper corner of the box around everything below this node. */
+		float hi[dim];
+		/** Index of the parent, or -1 for the root. */
+		int parent;
+		/** Index of the left child, or -1 for leaves. */
+		int left;
+		/** Index of the right child, or -1 for leaves. */
+		int right;
+		/** Index of the shape of a leaf, or -1 for interior nodes. */
+		int shape;
+		/** Number of nodes on the longest path down to a leaf; 0 for
+		 * leaves. */
+		int height;
+
+		bool isLeaf() const {
+			return left < 0;
+		}
+	};
+
+	/**
+	 * A full build under way on a thread of its own, over a copy of the
+	 * bounds, and the edits made since the copy.
+	 */
+	struct rebuild : private boost::noncopyable {
+		/** Bounds of the shapes when the copy was made. */
+		std::vector<buildprim> bp;
+		/** The shapes when the copy was made; leaves of @c nodes refer to
+		 * them by index. */
+		std::vector<const shape_T *> prims;
+		/** The new tree. */
+		std::vector<dnode> nodes;
+		/** Index of the root of @c nodes , or -1 if it's empty. */
+		int root;
+		/** Set once @c nodes is built. */
+		boost::atomic<bool> done;
+		/** Shapes added or moved since the copy. */
+		std::vector<const shape_T *> touched;
+		/** Whether every shape may have moved since the copy. */
+		bool touchedAll;
+		/** The thread that builds it. */
+		boost::scoped_ptr<boost::thread> worker;
+
+		rebuild() : root(-1), done(false), touchedAll(false) { }
+
+		void run() {
+			root = buildTree(bp, nodes);
+			done.store(true, boost::memory_order_release);
+		}
+	};
+
+	/**
+	 * Raw pointers to the shapes in the order of their indices. The scene
+	 * owns them.
+	 */
+	std::vector<const shape_T *> prims;
+
+	/**
+	 * The @c shapeKind of each of @c prims .
+	 */
+	std::vector<shapeKind> primKinds;
+
+	/**
+	 * The leaf of each of @c prims .
+	 */
+	std::vector<int> leafOf;
+
+	/**
+	 * The nodes, in no particular order, including free ones.
+	 */
+	std::vector<dnode> nodes;
+
+	/**
+	 * Index of the root, or -1 if there are no shapes.
+	 */
+	int root;
+
+	/**
+	 * First node of the free list, or -1.
+	 */
+	int freeList;
+
+	/**
+	 * Sum of the surface areas of the interior nodes.
+	 */
+	double interiorArea;
+
+	/**
+	 * SAH cost of the tree right after the last full build.
+	 */
+	double builtCost;
+
+	/**
+	 * Ratio to @c builtCost at which the tree is rebuilt, or 0 to never
+	 * rebuild it for its cost.
+	 */
+	double rebuildRatio;
+
+	/**
+	 * Number of shapes from which rebuilds run on a thread of their own.
+	 */
+	int backgroundMin;
+
+	/**
+	 * Number of full builds since the last @c build , including that one.
+	 */
+	int rebuildCount;
+
+	/**
+	 * The rebuild under way, or null.
+	 */
+	boost::scoped_ptr<rebuild> pending;
+
+	/**
+	 * Gets the surface area of a node's box.
+	 */
+	static double area(const dnode &n) {
+		double d[dim];
+		for (int i = 0; i < dim; i++)
+			d[i] = (double) n.hi[i] - n.lo[i];
+		if (dim == 2)
+			return 2 * (d[0] + d[1]);
+		double a = 0;
+		for (int i = 0; i < dim; i++)
+			for (int j = i + 1; j < dim; j++)
+				a += d[i] * d[j];
+		return 2 * a;
+	}
+
+	/**
+	 * Gets the surface area of the box around two nodes' boxes.
+	 */
+	static double unionArea(const dnode &a, const dnode &b) {
+		dnode u;
+		for (int i = 0; i < dim; i++) {
+			u.lo[i] = std::min(a.lo[i], b.lo[i]);
+			u.hi[i] = std::max(a.hi[i], b.hi[i]);
+		}
+		return area(u);
+	}
+
+	/**
+	 * Sets the box of a node to the bounds of a shape, rounded outwards.
+	 */
+	static void setBox(dnode &n, const aabb<vec_T, dim> &box) {
+		for (int i = 0; i < dim; i++) {
+			n.lo[i] = bvh_T::roundDown(box.getMin()[i]);
+			n.hi[i] = bvh_T::roundUp(box.getMax()[i]);
+		}
+	}
+
+	/**
+	 * Appends the tree over the shapes in @c indices[start, end) to the
+	 * given nodes, split by the binned SAH of @c bvh down to one shape per
+	 * leaf. Ranges the SAH would leave in one leaf are split in half.
+	 *
+	 * @return Index of the range's node in @c out .
+	 */
+	static int grow(const std::vector<buildprim> &bp,
+			std::vector<int> &indices, int start, int end, int depth,
+			int parent, std::vector<dnode> &out) {
+		int idx = (int) out.size();
+		out.push_back(dnode());
+		aabb<vec_T, dim> box;
+		int mid = bvh_T::splitRange(bp, indices, start, end, depth, box);
+		setBox(out[idx], box);
+		out[idx].parent = parent;
+		if (end - start == 1) {
+			out[idx].left = out[idx].right = -1;
+			out[idx].shape = indices[start];
+			out[idx].height = 0;
+			return idx;
+		}
+		if (mid < 0)
+			mid = start + (end - start) / 2;
+		int left = grow(bp, indices, start, mid, depth + 1, idx, out);
+		int right = grow(bp, indices, mid, end, depth + 1, idx, out);
+		out[idx].left = left;
+		out[idx].right = right;
+		out[idx].shape = -1;
+		out[idx].height = 1 + std::max(out[left].height, out[right].height);
+		return idx;
+	}
+
+	/**
+	 * Builds a tree over the given bounds from scratch.
+	 *
+	 * @param bp Bounds of the shapes.
+	 * @param[out] out Receives the nodes, with no free ones.
+	 *
+	 * @return Index of the root, or -1 if there are no shapes.
+	 */
+	static int buildTree(const std::vector<buildprim> &bp,
+			std::vector<dnode> &out) {
+		out.clear();
+		if (bp.empty())
+			return -1;
+		std::vector<int> indices(bp.size());
+		for (size_t i = 0; i < bp.size(); i++)
+			indices[i] = (int) i;
+		out.reserve(2 * bp.size() - 1);
+		return grow(bp, indices, 0, (int) bp.size(), 0, -1, out);
+	}
+
+	/**
+	 * Gathers the bounds of the shapes as they are now.
+	 */
+	void gatherBounds(std::vector<buildprim> &bp) const {
+		bp.resize(prims.size());
+		for (size_t i = 0; i < prims.size(); i++) {
+			bool bounded = prims[i]->getBounds(bp[i].box);
+			assert(bounded);
+			bp[i].centroid = bp[i].box.centroid();
+		}
+	}
+
+	/**
+	 * Adds up the areas of the interior nodes again.
+	 */
+	void sumInteriorArea() {
+		interiorArea = 0;
+		if (root < 0)
+			return;
+		std::vector<int> stack(1, root);
+		while (!stack.empty()) {
+			const dnode &n = nodes[stack.back()];
+			stack.pop_back();
+			if (n.isLeaf())
+				continue;
+			interiorArea += area(n);
+			stack.push_back(n.left);
+			stack.push_back(n.right);
+		}
+	}
+
+	/**
+	 * Makes the tree over the given nodes current and takes its cost as
+	 * what later edits are compared with.
+	 */
+	void adoptTree(std::vector<dnode> &built, int builtRoot) {
+		nodes.swap(built);
+		root = builtRoot;
+		freeList = -1;
+		sumInteriorArea();
+		builtCost = getCost();
+		rebuildCount++;
+	}
+
+	/**
+	 * Builds the tree again from scratch on this thread, dropping any
+	 * rebuild under way.
+	 */
+	void rebuildNow() {
+		cancelRebuild();
+		std::vector<buildprim> bp;
+		gatherBounds(bp);
+		std::vector<dnode> built;
+		int r = buildTree(bp, built);
+		adoptTree(built, r);
+		leafOf.assign(prims.size(), -1);
+		for (int i = 0; i < (int) nodes.size(); i++)
+			if (nodes[i].isLeaf())
+				leafOf[nodes[i].shape] = i;
+	}
+
+	/**
+	 * Starts a full build over a copy of the bounds on a thread of its own.
+	 */
+	void startRebuild() {
+		assert(!pending);
+		pending.reset(new rebuild());
+		pending->prims = prims;
+		gatherBounds(pending->bp);
+		pending->worker.reset(new boost::thread(
+				boost::bind(&rebuild::run, pending.get())));
+	}
+
+	/**
+	 * Waits for the rebuild under way, if any, and throws it away.
+	 */
+	void cancelRebuild() {
+		if (pending) {
+			pending->worker->join();
+			pending.reset();
+		}
+	}
+
+	/**
+	 * Swaps in the tree of the rebuild under way once it's built, first
+	 * catching it up with the edits made since its copy: leaves of shapes
+	 * removed since are taken out, shapes moved since are moved, and shapes
+	 * added since are added. A shape that's in the scene more than once
+	 * can't be told apart from its copies this way, so then the tree is
+	 * built again on this thread, as it is if catching up made it too
+	 * tall.
+	 *
+	 * @param wait Whether to wait for the rebuild if it isn't done.
+	 */
+	void finishRebuild(bool wait) {
+		if (!pending || (!wait &&
+				!pending->done.load(boost::memory_order_acquire)))
+			return;
+		pending->worker->join();
+		boost::scoped_ptr<rebuild> rb;
+		rb.swap(pending);
+
+		std::map<const shape_T *, int> index;
+		for (int i = 0; i < (int) prims.size(); i++) {
+			if (!index.insert(std::make_pair(prims[i], i)).second) {
+				rebuildNow();
+				return;
+			}
+		}
+		adoptTree(rb->nodes, rb->root);
+		leafOf.assign(prims.size(), -1);
+		std::vector<int> gone;
+		for (int i = 0; i < (int) nodes.size(); i++) {
+			dnode &n = nodes[i];
+			if (!n.isLeaf())
+				continue;
+			typename std::map<const shape_T *, int>::const_iterator it =
+					index.find(rb->prims[n.shape]);
+			if (it == index.end()) {
+				gone.push_back(i);
+			}
+			else if (leafOf[it->second] >= 0) {
+				rebuildNow();
+				return;
+			}
+			else {
+				n.shape = it->second;
+				leafOf[it->second] = i;
+			}
+		}
+		for (size_t i = 0; i < gone.size(); i++) {
+			detachLeaf(gone[i]);
+			freeNode(gone[i]);
+		}
+		if (rb->touchedAll) {
+			refitAll();
+		}
+		else {
+			for (size_t i = 0; i < rb->touched.size(); i++) {
+				typename std::map<const shape_T *, int>::const_iterator it =
+						index.find(rb->touched[i]);
+				if (it != index.end() && leafOf[it->second] >= 0)
+					moveLeaf(it->second);
+			}
+		}
+		for (int i = 0; i < (int) prims.size(); i++)
+			if (leafOf[i] < 0)
+				addLeaf(i);
+		if (root >= 0 && nodes[root].height >= DYNAMICBVH_MAX_DEPTH - 1)
+			rebuildNow();
+	}
+
+	/**
+	 * Rebuilds the tree if edits made it too tall or too costly: on the
+	 * spot if it's too tall for the walks or small, and otherwise on a
+	 * thread of its own.
+	 */
+	void checkQuality() {
+		if (root < 0)
+			return;
+		if (nodes[root].height >= DYNAMICBVH_MAX_DEPTH - 1) {
+			rebuildNow();
+			return;
+		}
+		if (pending || rebuildRatio <= 0 || getCostRatio() < rebuildRatio)
+			return;
+		if ((int) prims.size() < backgroundMin)
+			rebuildNow();
+		else
+			startRebuild();
+	}
+
+	/**
+	 * Takes a node off the free list, or makes a new one.
+	 */
+	int allocNode() {
+		if (freeList < 0) {
+			nodes.push_back(dnode());
+			return (int) nodes.size() - 1;
+		}
+		int idx = freeList;
+		freeList = nodes[idx].parent;
+		return idx;
+	}
+
+	/**
+	 * Puts a node that's out of the tree on the free list.
+	 */
+	void freeNode(int idx) {
+		nodes[idx].parent = freeList;
+		nodes[idx].left = nodes[idx].right = -1;
+		nodes[idx].shape = -1;
+		freeList = idx;
+	}
+
+	/**
+	 * Recomputes the box and height of an interior node from its children,
+	 * keeping @c interiorArea up to date.
+	 */
+	void fit(int idx) {
+		dnode &n = nodes[idx];
+		const dnode &l = nodes[n.left], &r = nodes[n.right];
+		interiorArea -= area(n);
+		for (int i = 0; i < dim; i++) {
+			n.lo[i] = std::min(l.lo[i], r.lo[i]);
+			n.hi[i] = std::max(l.hi[i], r.hi[i]);
+		}
+		n.height = 1 + std::max(l.height, r.height);
+		interiorArea += area(n);
+	}
+
+	/**
+	 * Swaps a child of a node with a grandchild under its other child if
+	 * that shrinks the other child the most, as in tree rotations for BVHs
+	 * by Kopta et al. The node's own box stays the same.
+	 *
+	 * @param a The node, whose children are fit.
+	 */
+	void rotate(int a) {
+		dnode &A = nodes[a];
+		int b = A.left, c = A.right;
+		// The child to swap, the grandchild to swap it with, and what that
+		// takes off the area of the grandchild's parent.
+		int bestChild = -1, bestGrand = -1;
+		double bestGain = 0;
+		for (int side = 0; side < 2; side++) {
+			int child = side == 0 ? b : c, other = side == 0 ? c : b;
+			const dnode &O = nodes[other];
+			if (O.isLeaf())
+				continue;
+			double before = area(O);
+			// Swapping the child with one grandchild leaves the other
+			// grandchild with it under the other child.
+			double gainL = before - unionArea(nodes[child], nodes[O.right]);
+			double gainR = before - unionArea(nodes[child], nodes[O.left]);
+			if (gainL > bestGain) {
+				bestGain = gainL;
+				bestChild = child;
+				bestGrand = O.left;
+			}
+			if (gainR > bestGain) {
+				bestGain = gainR;
+				bestChild = child;
+				bestGrand = O.right;
+			}
+		}
+		if (bestChild < 0)
+			return;
+		int other = bestChild == b ? c : b;
+		dnode &O = nodes[other];
+		if (O.left == bestGrand)
+			O.left = bestChild;
+		else
+			O.right = bestChild;
+		if (A.left == bestChild)
+			A.left = bestGrand;
+		else
+			A.right = bestGrand;
+		nodes[bestChild].parent = other;
+		nodes[bestGrand].parent = a;
+		fit(other);
+		fit(a);
+	}
+
+	/**
+	 * Finds the node that a new leaf is cheapest to add as the sibling of
+	 * by the SAH: the area of the new parent plus how much every node above
+	 * it grows. The search goes down from the root, cheapest bound first,
+	 * and skips subtrees that can't beat the best node so far, as in
+	 * Bittner et al.'s insertion.
+	 */
+	int findSibling(const dnode &leaf) const {
+		typedef std::pair<double, int> entry;
+		std::priority_queue<entry, std::vector<entry>,
+				std::greater<entry> > queue;
+		double leafArea = area(leaf);
+		int best = root;
+		double bestCost = unionArea(nodes[root], leaf);
+		// Entries are keyed by what the nodes above them grow by.
+		queue.push(entry(0.0, root));
+		while (!queue.empty()) {
+			entry e = queue.top();
+			queue.pop();
+			if (e.first + leafArea >= bestCost)
+				break;
+			const dnode &n = nodes[e.second];
+			double merged = unionArea(n, leaf);
+			double cost = merged + e.first;
+			if (cost < bestCost) {
+				bestCost = cost;
+				best = e.second;
+			}
+			if (n.isLeaf())
+				continue;
+			double inherited = e.first + merged - area(n);
+			if (inherited + leafArea < bestCost) {
+				queue.push(entry(inherited, n.left));
+				queue.push(entry(inherited, n.right));
+			}
+		}
+		return best;
+	}
+
+	/**
+	 * Puts a leaf that's out of the tree back in: next to the cheapest
+	 * sibling, with the nodes above refit and rotated.
+	 */
+	void insertLeaf(int leaf) {
+		if (root < 0) {
+			root = leaf;
+			nodes[leaf].parent = -1;
+			return;
+		}
+		int sibling = findSibling(nodes[leaf]);
+		int oldParent = nodes[sibling].parent;
+		int p = allocNode();
+		dnode &P = nodes[p];
+		P.parent = oldParent;
+		P.left = sibling;
+		P.right = leaf;
+		P.shape = -1;
+		for (int i = 0; i < dim; i++)
+			P.lo[i] = P.hi[i] = 0;
+		nodes[sibling].parent = p;
+		nodes[leaf].parent = p;
+		if (oldParent < 0)
+			root = p;
+		else if (nodes[oldParent].left == sibling)
+			nodes[oldParent].left = p;
+		else
+			nodes[oldParent].right = p;
+		for (int a = p; a >= 0; a = nodes[a].parent) {
+			fit(a);
+			rotate(a);
+		}
+	}
+
+	/**
+	 * Takes a leaf out of the tree, putting its sibling in place of its
+	 * parent and refitting the nodes above. The leaf isn't freed.
+	 */
+	void detachLeaf(int leaf) {
+		int p = nodes[leaf].parent;
+		if (p < 0) {
+			root = -1;
+			return;
+		}
+		int sibling = nodes[p].left == leaf ? nodes[p].right : nodes[p].left;
+		int g = nodes[p].parent;
+		nodes[sibling].parent = g;
+		if (g < 0)
+			root = sibling;
+		else if (nodes[g].left == p)
+			nodes[g].left = sibling;
+		else
+			nodes[g].right = sibling;
+		interiorArea -= area(nodes[p]);
+		freeNode(p);
+		for (int a = g; a >= 0; a = nodes[a].parent)
+			fit(a);
+	}
+
+	/**
+	 * Adds a leaf for a shape that has none.
+	 */
+	void addLeaf(int i) {
+		int leaf = allocNode();
+		dnode &n = nodes[leaf];
+		aabb<vec_T, dim> box;
+		bool bounded = prims[i]->getBounds(box);
+		assert(bounded);
+		setBox(n, box);
+		n.left = n.right = -1;
+		n.shape = i;
+		n.height = 0;
+		leafOf[i] = leaf;
+		insertLeaf(leaf);
+	}
+
+	/**
+	 * Moves the leaf of a shape to where the shape is now.
+	 */
+	void moveLeaf(int i) {
+		int leaf = leafOf[i];
+		aabb<vec_T, dim> box;
+		bool bounded = prims[i]->getBounds(box);
+		assert(bounded);
+		detachLeaf(leaf);
+		setBox(nodes[leaf], box);
+		insertLeaf(leaf);
+	}
+
+	/**
+	 * Recomputes every box from the shapes, keeping the tree.
+	 */
+	void refitAll() {
+		if (root < 0)
+			return;
+		// Gather the nodes top down, so parents come before children, and
+		// fit them in reverse.
+		std::vector<int> order(1, root);
+		for (size_t k = 0; k < order.size(); k++) {
+			const dnode &n = nodes[order[k]];
+			if (!n.isLeaf()) {
+				order.push_back(n.left);
+				order.push_back(n.right);
+			}
+		}
+		for (int k = (int) order.size() - 1; k >= 0; k--) {
+			dnode &n = nodes[order[k]];
+			if (n.isLeaf()) {
+				aabb<vec_T, dim> box;
+				bool bounded = prims[n.shape]->getBounds(box);
+				assert(bounded);
+				setBox(n, box);
+			}
+			else {
+				fit(order[k]);
+			}
+		}
+		sumInteriorArea();
+	}
+
+	/**
+	 * Intersects the ray with the shape @c prims[i] .
+	 */
+	time_T intersectPrim(int i, const ray<vec_T, time_T, dim> &r) const {
+		return shapedispatch<vec_T, color_T, time_T, dim>::intersection(
+				primKinds[i], prims[i], r);
+	}
+
+public:
+
+	/**
+	 * Constructs an empty hierarchy. Call @c build before querying it.
+	 *
+	 * @param rebuildRatio How many times its cost after a full build the
+	 *   SAH cost of the tree may get before it's rebuilt, or 0 to only
+	 *   rebuild it in @c build .
+	 * @param backgroundMin Number of shapes from which rebuilds run on a
+	 *   thread of their own; smaller trees are rebuilt by the edit that
+	 *   finds them too costly.
+	 */
+	dynamicbvh(double rebuildRatio = DYNAMICBVH_REBUILD_RATIO,
+			int backgroundMin = DYNAMICBVH_BACKGROUND_MIN) : root(-1),
+			freeList(-1), interiorArea(0), builtCost(0),
+			rebuildRatio(rebuildRatio), backgroundMin(backgroundMin),
+			rebuildCount(0) {
+		assert(rebuildRatio == 0 || rebuildRatio >= 1);
+	}
+
+	/**
+	 * Waits for the rebuild under way, if any.
+	 */
+	~dynamicbvh() {
+		cancelRebuild();
+	}
+
+	/**
+	 * Builds the tree over the given shapes from scratch, discarding
+	 * whatever was built before.
+	 *
+	 * @param shapes The shapes, which must outlive this hierarchy.
+	 */
+	void build(const std::vector<sp_shape> &shapes) {
+		cancelRebuild();
+		prims.clear();
+		primKinds.clear();
+		for (size_t i = 0; i < shapes.size(); i++) {
+			prims.push_back(shapes[i].get());
+			primKinds.push_back(shapedispatch<vec_T, color_T, time_T, dim>::
+					kindOf(prims.back()));
+		}
+		rebuildCount = 0;
+		rebuildNow();
+	}
+
+	/**
+	 * Recomputes the bounds of every node from the current bounds of the
+	 * shapes without changing the tree, then rebuilds it if that made it
+	 * too costly.
+	 *
+	 * @return @c true .
+	 */
+	bool refit() {
+		finishRebuild(false);
+		if (pending)
+			pending->touchedAll = true;
+		refitAll();
+		checkQuality();
+		return true;
+	}
+
+	/**
+	 * Adds a shape after the others, so its index is the number of shapes
+	 * there were.
+	 *
+	 * @param s The shape, which must have bounds and outlive this
+	 *   hierarchy.
+	 *
+	 * @return @c true .
+	 */
+	bool insertShape(const sp_shape &s) {
+		finishRebuild(false);
+		prims.push_back(s.get());
+		primKinds.push_back(shapedispatch<vec_T, color_T, time_T, dim>::
+				kindOf(s.get()));
+		leafOf.push_back(-1);
+		if (pending)
+			pending->touched.push_back(s.get());
+		addLeaf((int) prims.size() - 1);
+		checkQuality();
+		return true;
+	}
+
+	/**
+	 * Removes a shape. The shapes after it move down one index.
+	 *
+	 * @param index Index of the shape.
+	 *
+	 * @return @c true .
+	 */
+	bool removeShape(int index) {
+		assert(index >= 0 && index < (int) prims.size());
+		finishRebuild(false);
+		int leaf = leafOf[index];
+		detachLeaf(leaf);
+		freeNode(leaf);
+		prims.erase(prims.begin() + index);
+		primKinds.erase(primKinds.begin() + index);
+		leafOf.erase(leafOf.begin() + index);
+		for (int i = index; i < (int) leafOf.size(); i++)
+			nodes[leafOf[i]].shape = i;
+		checkQuality();
+		return true;
+	}
+
+	/**
+	 * Moves a shape's leaf to where the shape is now, after it moved or
+	 * changed size.
+	 *
+	 * @param index Index of the shape.
+	 *
+	 * @return @c true .
+	 */
+	bool updateShape(int index) {
+		assert(index >= 0 && index < (int) prims.size());
+		finishRebuild(false);
+		if (pending)
+			pending->touched.push_back(prims[index]);
+		moveLeaf(index);
+		checkQuality();
+		return true;
+	}
+
+	/**
+	 * Waits for the rebuild under way, if any, and swaps it in.
+	 */
+	void waitForRebuild() {
+		finishRebuild(true);
+	}
+
+	/**
+	 * Checks if a rebuild is under way or waiting to be swapped in.
+	 *
+	 * @return @c true if there is one.
+	 */
+	bool isRebuilding() const {
+		return pending.get() != 0;
+	}
+
+	/**
+	 * Gets the number of full builds since the last @c build , counting
+	 * that one.
+	 *
+	 * @return Number of builds.
+	 */
+	int getRebuildCount() const {
+		return rebuildCount;
+	}
+
+	/**
+	 * Gets the SAH cost of the tree: the summed areas of its interior nodes
+	 * over the area of its root, which is what a ray that hits the root
+	 * expects to visit.
+	 *
+	 * @return The cost, 0 with fewer than two shapes.
+	 */
+	double getCost() const {
+		if (root < 0 || nodes[root].isLeaf())
+			return 0;
+		double rootArea = area(nodes[root]);
+		return rootArea > 0 ? interiorArea / rootArea : 0;
+	}
+
+	/**
+	 * Gets how many times its cost after the last full build the cost of
+	 * the tree is, which edits push up.
+	 *
+	 * @return The ratio, 1 if there was nothing to cost.
+	 */
+	double getCostRatio() const {
+		double cost = getCost();
+		return builtCost > 0 && cost > 0 ? cost / builtCost : 1;
+	}
+
+	/**
+	 * Gets the height of the tree.
+	 *
+	 * @return Nodes on the longest path from the root to a leaf, not
+	 *   counting the root; -1 if there are no shapes.
+	 */
+	int getHeight() const {
+		return root < 0 ? -1 : nodes[root].height;
+	}
+
+	/**
+	 * Finds the closest shape hit by the given ray by walking the tree
+	 * front to back.
+	 *
+	 * @param r The ray.
+	 * @param[out] tIntersect The time of the hit or @c RAY_MISS .
+	 *
+	 * @return Index of the shape that was hit or -1 if there was no hit.
+	 */
+	int closestHit(const ray<vec_T, time_T, dim> &r,
+			time_T &tIntersect) const {
+		int best = -1;
+		time_T tBest = RAY_MISS;
+
+		if (root >= 0) {
+			rayquery<vec_T, time_T, dim> q(r);
+			time_T tnear;
+			time_T tmax = q.getTMax();
+			int stack[DYNAMICBVH_MAX_DEPTH + 1];
+			int sp = 0;
+			if (q.slabs(nodes[root].lo, nodes[root].hi, tmax, tnear))
+				stack[sp++] = root;
+			while (sp > 0) {
+				const dnode &n = nodes[stack[--sp]];
+				if (n.isLeaf()) {
+					time_T t = intersectPrim(n.shape, r);
+					if (t != RAY_MISS && t > 0 && (best < 0 || t < tBest)) {
+						tBest = t;
+						best = n.shape;
+					}
+					continue;
+				}
+				time_T limit = best < 0 ? tmax : tBest;
+				const dnode &left = nodes[n.left], &right = nodes[n.right];
+				time_T tl, tr;
+				bool hitl = q.slabs(left.lo, left.hi, limit, tl);
+				bool hitr = q.slabs(right.lo, right.hi, limit, tr);
+				assert(sp + 2 <= DYNAMICBVH_MAX_DEPTH + 1);
+				// Push the farther child first so the nearer one is popped
+				// and visited first.
+				if (hitl && hitr) {
+					if (tl < tr) {
+						stack[sp++] = n.right;
+						stack[sp++] = n.left;
+					}
+					else {
+						stack[sp++] = n.left;
+						stack[sp++] = n.right;
+					}
+				}
+				else if (hitl) {
+					stack[sp++] = n.left;
+				}
+				else if (hitr) {
+					stack[sp++] = n.right;
+				}
+			}
+		}
+
+		tIntersect = tBest;
+		return best;
+	}
+
+	/**
+	 * Checks if any shape blocks the given ray before @c tmax . The walk
+	 * stops at the first hit.
+	 *
+	 * @param r The ray.
+	 * @param tmax Hits at or beyond this time are ignored.
+	 *
+	 * @return Index of a shape that blocks the ray before @c tmax or -1.
+	 */
+	int anyHit(const ray<vec_T, time_T, dim> &r, time_T tmax) const {
+		if (root < 0)
+			return -1;
+
+		rayquery<vec_T, time_T, dim> q(r, 0, tmax);
+		time_T tnear;
+		int stack[DYNAMICBVH_MAX_DEPTH + 1];
+		int sp = 0;
+		stack[sp++] = root;
+		while (sp > 0) {
+			const dnode &n = nodes[stack[--sp]];
+			if (!q.slabs(n.lo, n.hi, tmax, tnear))
+				continue;
+			if (n.isLeaf()) {
+				time_T t = intersectPrim(n.shape, r);
+				if (t != RAY_MISS && t > 0 && t < tmax)
+					return n.shape;
+				continue;
+			}
+			assert(sp + 2 <= DYNAMICBVH_MAX_DEPTH + 1);
+			stack[sp++] = n.right;
+			stack[sp++] = n.left;
+		}
+		return -1;
+	}
+
+	/**
+	 * Gets the number of nodes in the tree.
+	 *
+	 * @return Node count.
+	 */
+	int getNodeCount() const {
+		return prims.empty() ? 0 : 2 * (int) prims.size() - 1;
+	}
+
+	/**
+	 * Gets the number of bytes taken by the nodes, free ones included, and
+	 * the shape lists.
+	 *
+	 * @return Memory footprint in bytes.
+	 */
+	size_t getMemoryUsage() const {
+		return nodes.size() * sizeof(dnode) + prims.size() *
+				(sizeof(prims[0]) + sizeof(primKinds[0]) + sizeof(int));
+	}
+
+	/**
+	 * Prints the size and cost of this hierarchy.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printHelper(std::ostream &os) const {
+		os << "[dynamic bvh. nodes: " << getNodeCount() << ", height: " <<
+				getHeight() << ", cost: " << getCostRatio() <<
+				" of the last build's, shapes: " << prims.size() << "]";
+	}
+};
+
+typedef dynamicbvh<double, double, double, 3> dynamicbvh3d;
+typedef dynamicbvh<double, double, float, 3> dynamicbvh3ddf;
+typedef dynamicbvh<float, float, float, 3> dynamicbvh3f;
+typedef boost::shared_ptr<dynamicbvh3d> sp_dynamicbvh3d;
+typedef boost::shared_ptr<dynamicbvh3ddf> sp_dynamicbvh3ddf;
+typedef boost::shared_ptr<dynamicbvh3f> sp_dynamicbvh3f;
+
+#endif // DYNAMICBVH_HH
@@ -0,0 +1,102 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include <cmath>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#ifndef FASTMATH_HH
+#define FASTMATH_HH
+
+/**
+ * Largest relative error of @c approxRsqrt , from the hardware estimate's
+ * 1.5 * 2^-12 after one Newton step, plus the rounding of the float it's
+ * done in.
+ */
+#define FASTMATH_RSQRT_ERROR 5e-7
+
+/**
+ * Largest absolute error of @c approxAcos and @c approxAsin , in radians.
+ */
+#define FASTMATH_ACOS_ERROR 3e-8
+
+/**
+ * Approximates the reciprocal of a square root: the hardware's 12 bit
+ * estimate, refined by one Newton step, so a division and a square root
+ * become a few multiplies. Its relative error is at most
+ * @c FASTMATH_RSQRT_ERROR for normal float inputs. The raytracer only uses
+ * it in builds with @c RT_FAST_MATH defined.
+ *
+ * @param x A positive number.
+ *
+ * @return About @f$\frac{1}{\sqrt{x}}@f$.
+ */
+inline float approxRsqrt(float x) {
+#ifdef __SSE__
+	float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+	return y * (1.5f - 0.5f * x * y * y);
+#else
+	return 1 / std::sqrt(x);
+#endif
+}
+
+/**
+ * Like the float version, and to the same relative error, for doubles
+ * within float range.
+ */
+inline double approxRsqrt(double x) {
+#ifdef __SSE__
+	double y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss((float) x)));
+	return y * (1.5 - 0.5 * x * y * y);
+#else
+	return 1 / std::sqrt(x);
+#endif
+}
+
+/**
+ * Any other type just takes the square root.
+ */
+template<typename T>
+inline T approxRsqrt(T x) {
+	return 1 / std::sqrt(x);
+}
+
+/**
+ * Approximates the arc cosine with the polynomial of Abramowitz and Stegun
+ * 4.4.46, so its absolute error is at most @c FASTMATH_ACOS_ERROR .
+ *
+ * @param x A number in [-1, 1].
+ *
+ * @return About @f$\arccos x@f$, in [0, @f$\pi@f$].
+ */
+inline double approxAcos(double x) {
+	double a = std::fabs(x);
+	double p = -0.0012624911;
+	p = p * a + 0.0066700901;
+	p = p * a - 0.0170881256;
+	p = p * a + 0.0308918810;
+	p = p * a - 0.0501743046;
+	p = p * a + 0.0889789874;
+	p = p * a - 0.2145988016;
+	p = p * a + 1.5707963050;
+	double r = std::sqrt(1 - a) * p;
+	return x < 0 ? M_PI - r : r;
+}
+
+/**
+ * Approximates the arc sine as @f$\frac{\pi}{2} - \arccos x@f$, to the
+ * error of @c approxAcos .
+ *
+ * @param x A number in [-1, 1].
+ *
+ * @return About @f$\arcsin x@f$, in [@f$-\frac{\pi}{2}@f$,
+ *   @f$\frac{\pi}{2}@f$].
+ */
+inline double approxAsin(double x) {
+	return M_PI / 2 - approxAcos(x);
+}
+
+#endif // FASTMATH_HH
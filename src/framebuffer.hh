@@ -0,0 +1,935 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "rgbcolor.hh"
+#include "simd.hh"
+#include "hugepages.hh"
+#include "boost/type_traits/is_same.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef FRAMEBUFFER_HH
+#define FRAMEBUFFER_HH
+
+/**
+ * Largest value of a channel of an 8 bit image.
+ */
+#define QUANTIZE_MAX 255
+
+/**
+ * Quantizes color channels one at a time: each is multiplied by the scale,
+ * clamped to 0 through @c QUANTIZE_MAX and truncated. This is the kernel of
+ * @c SIMD_SCALAR and of types without SIMD kernels; see @c quantizelanes .
+ *
+ * @param in The channels.
+ * @param n Number of channels.
+ * @param scale What to multiply them by.
+ * @param[out] out Receives the quantized channels.
+ */
+template<typename T>
+void quantizeScalar(const T *in, size_t n, T scale, unsigned char *out) {
+	for (size_t i = 0; i < n; i++) {
+		T v = in[i] * scale;
+		v = v < 0 ? 0 : v;
+		v = v > QUANTIZE_MAX ? QUANTIZE_MAX : v;
+		out[i] = (unsigned char) (int) v;
+	}
+}
+
+/**
+ * Picks the quantization kernel for a channel type by instruction set;
+ * this is the generic version, which only has the scalar kernel.
+ *
+ * @tparam T The type of the channels.
+ */
+template<typename T>
+struct quantizelanes {
+
+	/**
+	 * Quantizes channels as @c quantizeScalar does, to exactly the same
+	 * values whatever the instruction set.
+	 *
+	 * @param level The instruction set to use.
+	 * @param in The channels.
+	 * @param n Number of channels.
+	 * @param scale What to multiply them by.
+	 * @param[out] out Receives the quantized channels.
+	 */
+	static void quantize(simdLevel level, const T *in, size_t n, T scale,
+			unsigned char *out) {
+		quantizeScalar(in, n, scale, out);
+	}
+};
+
+#ifdef SIMD_DISPATCH
+
+/**
+ * @c quantizelanes for floats, 8 channels at a time with SSE2.
+ */
+template<>
+struct quantizelanes<float> {
+	static void quantize(simdLevel level, const float *in, size_t n,
+			float scale, unsigned char *out) {
+		size_t i = 0;
+		if (level >= SIMD_SSE2) {
+			const __m128 s = _mm_set1_ps(scale), zero = _mm_setzero_ps(),
+					top = _mm_set1_ps(QUANTIZE_MAX);
+			for (; i + 8 <= n; i += 8) {
+				__m128 a = _mm_min_ps(_mm_max_ps(
+						_mm_mul_ps(_mm_loadu_ps(in + i), s), zero), top);
+				__m128 b = _mm_min_ps(_mm_max_ps(
+						_mm_mul_ps(_mm_loadu_ps(in + i + 4), s), zero), top);
+				__m128i w = _mm_packs_epi32(_mm_cvttps_epi32(a),
+						_mm_cvttps_epi32(b));
+				_mm_storel_epi64(reinterpret_cast<__m128i *>(out + i),
+						_mm_packus_epi16(w, w));
+			}
+		}
+		quantizeScalar(in + i, n - i, scale, out + i);
+	}
+};
+
+/**
+ * @c quantizelanes for doubles, 8 channels at a time with SSE2.
+ */
+template<>
+struct quantizelanes<double> {
+	/** Clamps and truncates 2 scaled channels to the low 2 ints. */
+	static __m128i convert(const double *in, __m128d s) {
+		const __m128d zero = _mm_setzero_pd(), top = _mm_set1_pd(QUANTIZE_MAX);
+		return _mm_cvttpd_epi32(_mm_min_pd(_mm_max_pd(
+				_mm_mul_pd(_mm_loadu_pd(in), s), zero), top));
+	}
+
+	static void quantize(simdLevel level, const double *in, size_t n,
+			double scale, unsigned char *out) {
+		size_t i = 0;
+		if (level >= SIMD_SSE2) {
+			const __m128d s = _mm_set1_pd(scale);
+			for (; i + 8 <= n; i += 8) {
+				__m128i a = _mm_unpacklo_epi64(convert(in + i, s),
+						convert(in + i + 2, s));
+				__m128i b = _mm_unpacklo_epi64(convert(in + i + 4, s),
+						convert(in + i + 6, s));
+				__m128i w = _mm_packs_epi32(a, b);
+				_mm_storel_epi64(reinterpret_cast<__m128i *>(out + i),
+						_mm_packus_epi16(w, w));
+			}
+		}
+		quantizeScalar(in + i, n - i, scale, out + i);
+	}
+};
+
+#endif // SIMD_DISPATCH
+
+/**
+ * Converts a float to the nearest half precision float, ties to even, as
+ * stored in OpenEXR files. Values too large for a half become infinity.
+ *
+ * @param f The float.
+ *
+ * @return The bits of the half.
+ */
+inline unsigned short floatToHalf(float f) {
+	unsigned int x;
+	std::memcpy(&x, &f, 4);
+	unsigned int sign = (x >> 16) & 0x8000;
+	unsigned int absx = x & 0x7fffffff;
+	if (absx >= 0x7f800000) // infinity or NaN
+		return (unsigned short) (sign | 0x7c00 |
+				(absx > 0x7f800000 ? 0x200 : 0));
+	if (absx >= 0x477ff000) // rounds to more than the largest half
+		return (unsigned short) (sign | 0x7c00);
+	if (absx < 0x38800000) {
+		// A subnormal half, or zero: shift the mantissa, with its implicit
+		// bit, into place and round.
+		if (absx < 0x33000000)
+			return (unsigned short) sign;
+		unsigned int e = absx >> 23;
+		unsigned int m = (absx & 0x7fffff) | 0x800000;
+		unsigned int shift = 126 - e;
+		unsigned int h = m >> shift;
+		unsigned int rest = m & ((1u << shift) - 1), half = 1u << (shift - 1);
+		if (rest > half || (rest == half && (h & 1)))
+			h++;
+		return (unsigned short) (sign | h);
+	}
+	// A normal half: rebias the exponent and round the mantissa, which may
+	// carry into the exponent.
+	unsigned int h = ((absx - 0x38000000) >> 13);
+	unsigned int rest = absx & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (h & 1)))
+		h++;
+	return (unsigned short) (sign | h);
+}
+
+/**
+ * Converts a half precision float to a float, exactly. Every step is exact
+ * in float arithmetic, so @c compactlanes gets the same bits with SSE2,
+ * and subnormal halves don't go through subnormal floats, which fast math
+ * may flush to zero.
+ *
+ * @param h The bits of the half.
+ *
+ * @return The float.
+ */
+inline float halfToFloat(unsigned short h) {
+	unsigned int x = (unsigned int) (h & 0x7fff) << 13;
+	unsigned int e = x & 0x0f800000;
+	x += 0x38000000; // rebias the exponent from 15 to 127
+	float f;
+	if (e == 0x0f800000) { // infinity or NaN
+		x += 0x38000000;
+		std::memcpy(&f, &x, 4);
+	}
+	else if (e == 0) { // zero or subnormal: let float subtraction normalize
+		x += 0x00800000;
+		unsigned int magic = 0x38800000;
+		float m;
+		std::memcpy(&f, &x, 4);
+		std::memcpy(&m, &magic, 4);
+		f -= m;
+	}
+	else
+		std::memcpy(&f, &x, 4);
+	std::memcpy(&x, &f, 4);
+	x |= (unsigned int) (h & 0x8000) << 16;
+	std::memcpy(&f, &x, 4);
+	return f;
+}
+
+/**
+ * How a framebuffer stores the color channels of its pixels. The compact
+ * ones take 6 bytes a pixel rather than 12 for floats or 24 for doubles;
+ * see @c compactframebuffer .
+ */
+enum pixelStorage {
+	/** An @c rgbcolor per pixel, as @c framebuffer keeps them. */
+	PIXELS_FULL,
+	/** Half precision floats, as OpenEXR stores them. */
+	PIXELS_HALF,
+	/**
+	 * Unsigned 16 bit fixed point with @c FIXED16_ONE steps to 1, which
+	 * covers 0 up to 16; more is clamped, and less is 0.
+	 */
+	PIXELS_FIXED16
+};
+
+/**
+ * The @c PIXELS_FIXED16 value of a channel of 1.
+ */
+#define FIXED16_ONE 4096
+
+/**
+ * Gets the name of a pixel storage as used by the driver's
+ * @c --pixel-storage option.
+ *
+ * @param storage The storage.
+ *
+ * @return The name.
+ */
+inline const char* pixelStorageName(pixelStorage storage) {
+	switch (storage) {
+	case PIXELS_HALF:
+		return "half";
+	case PIXELS_FIXED16:
+		return "fixed16";
+	default:
+		return "full";
+	}
+}
+
+/**
+ * Looks up a pixel storage by the name @c pixelStorageName gives it.
+ *
+ * @param name The name.
+ * @param[out] storage Receives the storage.
+ *
+ * @return @c false if the name isn't known.
+ */
+inline bool parsePixelStorage(const std::string &name,
+		pixelStorage &storage) {
+	for (int s = PIXELS_FULL; s <= PIXELS_FIXED16; s++) {
+		if (name == pixelStorageName((pixelStorage) s)) {
+			storage = (pixelStorage) s;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Converts a float to the nearest @c PIXELS_FIXED16 value.
+ *
+ * @param f The float.
+ *
+ * @return The fixed point value, 0 for NaN.
+ */
+inline unsigned short floatToFixed16(float f) {
+	float v = f * FIXED16_ONE + 0.5f;
+	if (!(v > 0))
+		return 0;
+	return v >= 65535 ? 65535 : (unsigned short) (unsigned int) v;
+}
+
+/**
+ * Converts a @c PIXELS_FIXED16 value to a float, exactly.
+ *
+ * @param v The fixed point value.
+ *
+ * @return The float.
+ */
+inline float fixed16ToFloat(unsigned short v) {
+	return (float) v * (1.0f / FIXED16_ONE);
+}
+
+/**
+ * Quantizes compact channels one at a time: each is converted to a float,
+ * then quantized as by @c quantizeScalar . This is the kernel of
+ * @c SIMD_SCALAR ; see @c compactlanes .
+ *
+ * @param storage @c PIXELS_HALF or @c PIXELS_FIXED16 .
+ * @param in The channels.
+ * @param n Number of channels.
+ * @param scale What to multiply them by.
+ * @param[out] out Receives the quantized channels.
+ */
+inline void quantizeCompactScalar(pixelStorage storage,
+		const unsigned short *in, size_t n, float scale,
+		unsigned char *out) {
+	for (size_t i = 0; i < n; i++) {
+		float v = (storage == PIXELS_HALF ? halfToFloat(in[i]) :
+				fixed16ToFloat(in[i])) * scale;
+		v = v < 0 ? 0 : v;
+		v = v > QUANTIZE_MAX ? QUANTIZE_MAX : v;
+		out[i] = (unsigned char) (int) v;
+	}
+}
+
+/**
+ * Picks the kernel that quantizes compact channels by instruction set.
+ * Channels are decoded and quantized in one pass, so no float copy of the
+ * image is made.
+ */
+struct compactlanes {
+
+#ifdef SIMD_DISPATCH
+	/** Converts the halves in the low 16 bits of 4 ints to floats. */
+	static __m128 halves(__m128i h) {
+		const __m128i exponent = _mm_set1_epi32(0x0f800000),
+				rebias = _mm_set1_epi32(0x38000000);
+		__m128i x = _mm_slli_epi32(_mm_and_si128(h,
+				_mm_set1_epi32(0x7fff)), 13);
+		__m128i e = _mm_and_si128(x, exponent);
+		x = _mm_add_epi32(x, rebias);
+		x = _mm_add_epi32(x, _mm_and_si128(_mm_cmpeq_epi32(e, exponent),
+				rebias));
+		__m128i tiny = _mm_cmpeq_epi32(e, _mm_setzero_si128());
+		__m128 sub = _mm_sub_ps(_mm_castsi128_ps(_mm_add_epi32(x,
+				_mm_set1_epi32(0x00800000))), _mm_castsi128_ps(
+				_mm_set1_epi32(0x38800000)));
+		__m128 f = _mm_or_ps(_mm_and_ps(_mm_castsi128_ps(tiny), sub),
+				_mm_andnot_ps(_mm_castsi128_ps(tiny), _mm_castsi128_ps(x)));
+		return _mm_or_ps(f, _mm_castsi128_ps(_mm_slli_epi32(
+				_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16)));
+	}
+
+	/** Converts the low 16 bits of 4 ints from the storage to floats. */
+	static __m128 decode(pixelStorage storage, __m128i v) {
+		if (storage == PIXELS_HALF)
+			return halves(v);
+		return _mm_mul_ps(_mm_cvtepi32_ps(v),
+				_mm_set1_ps(1.0f / FIXED16_ONE));
+	}
+#endif // SIMD_DISPATCH
+
+	/**
+	 * Quantizes channels as @c quantizeCompactScalar does, to exactly the
+	 * same values whatever the instruction set; 8 channels at a time with
+	 * SSE2.
+	 *
+	 * @param level The instruction set to use.
+	 * @param storage @c PIXELS_HALF or @c PIXELS_FIXED16 .
+	 * @param in The channels.
+	 * @param n Number of channels.
+	 * @param scale What to multiply them by.
+	 * @param[out] out Receives the quantized channels.
+	 */
+	static void quantize(simdLevel level, pixelStorage storage,
+			const unsigned short *in, size_t n, float scale,
+			unsigned char *out) {
+		size_t i = 0;
+#ifdef SIMD_DISPATCH
+		if (level >= SIMD_SSE2) {
+			const __m128 s = _mm_set1_ps(scale), zero = _mm_setzero_ps(),
+					top = _mm_set1_ps(QUANTIZE_MAX);
+			const __m128i none = _mm_setzero_si128();
+			for (; i + 8 <= n; i += 8) {
+				__m128i v = _mm_loadu_si128(
+						reinterpret_cast<const __m128i *>(in + i));
+				__m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(decode(storage,
+						_mm_unpacklo_epi16(v, none)), s), zero), top);
+				__m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(decode(storage,
+						_mm_unpackhi_epi16(v, none)), s), zero), top);
+				__m128i w = _mm_packs_epi32(_mm_cvttps_epi32(a),
+						_mm_cvttps_epi32(b));
+				_mm_storel_epi64(reinterpret_cast<__m128i *>(out + i),
+						_mm_packus_epi16(w, w));
+			}
+		}
+#endif // SIMD_DISPATCH
+		quantizeCompactScalar(storage, in + i, n - i, scale, out + i);
+	}
+};
+
+/**
+ * The colors of a rendered image, row by row from the top, as the
+ * unclamped @c rgbcolor values shading produced. Keeping them lets the
+ * image be written as floats, to PFM or OpenEXR, and be quantized to 8 bits
+ * with any exposure without rendering again. Renders write into
+ * @c getPixels directly.
+ *
+ * @tparam color_T The type of the @c rgbcolor.
+ */
+template<typename color_T>
+class framebuffer {
+private:
+
+	/**
+	 * Width in pixels.
+	 */
+	int width;
+
+	/**
+	 * Height in pixels.
+	 */
+	int height;
+
+	/**
+	 * The colors of the pixels, row by row.
+	 */
+	std::vector<rgbcolor<color_T> > pixels;
+
+	/**
+	 * Gets the channels of some colors as one array, red, green and blue
+	 * of each color in turn, which is how @c rgbcolor lays them out.
+	 *
+	 * @param image The colors, at least one.
+	 *
+	 * @return The first channel.
+	 */
+	static const color_T* channels(
+			const std::vector<rgbcolor<color_T> > &image) {
+		assert(sizeof(rgbcolor<color_T>) == 3 * sizeof(color_T));
+		return reinterpret_cast<const color_T *>(&image[0]);
+	}
+
+	/**
+	 * Appends a number to a byte string in little-endian byte order.
+	 *
+	 * @param out The string.
+	 * @param v The number.
+	 * @param bytes Number of bytes of the number to write.
+	 */
+	static void appendLE(std::string &out, unsigned long long v, int bytes) {
+		for (int i = 0; i < bytes; i++)
+			out += (char) ((v >> (8 * i)) & 0xff);
+	}
+
+	/**
+	 * Appends an OpenEXR header attribute.
+	 *
+	 * @param out The header.
+	 * @param name The attribute name.
+	 * @param type The attribute type name.
+	 * @param value The value, already in file byte order.
+	 */
+	static void appendAttribute(std::string &out, const char *name,
+			const char *type, const std::string &value) {
+		out += name;
+		out += '\0';
+		out += type;
+		out += '\0';
+		appendLE(out, value.size(), 4);
+		out += value;
+	}
+
+public:
+
+	/**
+	 * Constructs a black image of the given size.
+	 *
+	 * @param width Width in pixels.
+	 * @param height Height in pixels.
+	 */
+	framebuffer(int width = 0, int height = 0) : width(width),
+			height(height) {
+		assert(width >= 0 && height >= 0);
+		hugepages::reserve(pixels, (size_t) width * height);
+		pixels.resize((size_t) width * height);
+	}
+
+	/**
+	 * Gets the width.
+	 *
+	 * @return Width in pixels.
+	 */
+	int getWidth() const {
+		return width;
+	}
+
+	/**
+	 * Gets the height.
+	 *
+	 * @return Height in pixels.
+	 */
+	int getHeight() const {
+		return height;
+	}
+
+	/**
+	 * Gets the colors of the pixels, row by row, for a render to write
+	 * into. It must keep the size at width times height.
+	 *
+	 * @return The colors.
+	 */
+	std::vector<rgbcolor<color_T> >& getPixels() {
+		return pixels;
+	}
+
+	/**
+	 * Gets the colors of the pixels, row by row.
+	 *
+	 * @return The colors.
+	 */
+	const std::vector<rgbcolor<color_T> >& getPixels() const {
+		return pixels;
+	}
+
+	/**
+	 * Quantizes the image to 8 bits per channel for PPM and PNG, in one
+	 * pass over all the channels with the widest kernel
+	 * @c activeSimdLevel allows. With an exposure of 1 a channel of 1 or
+	 * more becomes @c QUANTIZE_MAX .
+	 *
+	 * @param[out] rgb Receives the red, green and blue of every pixel.
+	 * @param exposure What to multiply the colors by first.
+	 */
+	void quantize(std::vector<unsigned char> &rgb,
+			color_T exposure = 1) const {
+		quantize(pixels, rgb, exposure);
+	}
+
+	/**
+	 * The pass of @c quantize , for colors that aren't in a framebuffer.
+	 *
+	 * @param image The colors of the pixels.
+	 * @param[out] rgb Receives the red, green and blue of every pixel.
+	 * @param exposure What to multiply the colors by first.
+	 */
+	static void quantize(const std::vector<rgbcolor<color_T> > &image,
+			std::vector<unsigned char> &rgb, color_T exposure = 1) {
+		rgb.resize(image.size() * 3);
+		if (!image.empty())
+			quantize(&image[0], image.size(), &rgb[0], exposure);
+	}
+
+	/**
+	 * The pass of @c quantize , into memory of the caller's, like a mapped
+	 * file.
+	 *
+	 * @param colors The colors.
+	 * @param n Number of colors.
+	 * @param[out] rgb Receives the red, green and blue of every color,
+	 *   @c 3 * @c n bytes.
+	 * @param exposure What to multiply the colors by first.
+	 */
+	static void quantize(const rgbcolor<color_T> *colors, size_t n,
+			unsigned char *rgb, color_T exposure = 1) {
+		assert(sizeof(rgbcolor<color_T>) == 3 * sizeof(color_T));
+		quantizelanes<color_T>::quantize(activeSimdLevel(),
+				reinterpret_cast<const color_T *>(colors), 3 * n,
+				exposure * QUANTIZE_MAX, rgb);
+	}
+
+	/**
+	 * Makes the header of a color PFM with floats in this machine's byte
+	 * order, which the sign of the scale tells.
+	 *
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 *
+	 * @return The header.
+	 */
+	static std::string pfmHeader(int width, int height) {
+		unsigned int one = 1;
+		bool little = *reinterpret_cast<unsigned char *>(&one) == 1;
+		std::ostringstream os;
+		os << "PF\n" << width << " " << height << "\n" <<
+				(little ? "-1.0" : "1.0") << "\n";
+		return os.str();
+	}
+
+	/**
+	 * Converts a row of colors to the floats of a PFM row.
+	 *
+	 * @param colors The colors of the row.
+	 * @param width Number of colors.
+	 * @param[out] out Receives @c 3 * @c width floats.
+	 */
+	static void toPFMRow(const rgbcolor<color_T> *colors, int width,
+			float *out) {
+		assert(sizeof(rgbcolor<color_T>) == 3 * sizeof(color_T));
+		const color_T *c = reinterpret_cast<const color_T *>(colors);
+		std::copy(c, c + 3 * (size_t) width, out);
+	}
+
+	/**
+	 * Writes the image as a color PFM, 32 bit floats in this machine's
+	 * byte order, which the sign of the scale in the header tells.
+	 * Float images are written straight from the framebuffer; others are
+	 * converted a row at a time.
+	 *
+	 * @param os The output stream, which should be in binary mode.
+	 */
+	void writePFM(std::ostream &os) const {
+		writePFM(pixels, width, height, os);
+	}
+
+	/**
+	 * The writer of @c writePFM , for colors that aren't in a framebuffer.
+	 *
+	 * @param image The colors of the pixels, row by row.
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param os The output stream, which should be in binary mode.
+	 */
+	static void writePFM(const std::vector<rgbcolor<color_T> > &image,
+			int width, int height, std::ostream &os) {
+		assert(image.size() == (size_t) width * height && !image.empty());
+		os << pfmHeader(width, height);
+		// PFM rows go from the bottom up.
+		size_t rowChannels = (size_t) width * 3;
+		std::vector<float> row;
+		for (int y = height - 1; y >= 0; y--) {
+			const color_T *c = channels(image) + y * rowChannels;
+			if (boost::is_same<color_T, float>::value) {
+				os.write(reinterpret_cast<const char *>(c),
+						rowChannels * sizeof(float));
+				continue;
+			}
+			row.resize(rowChannels);
+			toPFMRow(&image[(size_t) y * width], width, &row[0]);
+			os.write(reinterpret_cast<const char *>(&row[0]),
+					rowChannels * sizeof(float));
+		}
+		os.flush();
+	}
+
+	/**
+	 * Writes the image as a scanline OpenEXR file with half float R, G and
+	 * B channels and no compression. Each row is converted to halves on
+	 * its own, so no copy of the whole image is made.
+	 *
+	 * @param os The output stream, which should be in binary mode.
+	 */
+	void writeEXR(std::ostream &os) const {
+		writeEXR(pixels, width, height, os);
+	}
+
+	/**
+	 * Makes the header of a scanline OpenEXR file with half float R, G and
+	 * B channels and no compression, followed by the offsets of its rows.
+	 * Each row is then its number, its size and the channels of the row one
+	 * after the other, blue first; see @c writeEXR .
+	 *
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 *
+	 * @return The header and the row offsets.
+	 */
+	static std::string exrHeader(int width, int height) {
+		std::string header;
+		appendLE(header, 20000630, 4); // magic number
+		appendLE(header, 2, 4); // version 2, single part scanline
+
+		std::string chlist;
+		const char *names[] = {"B", "G", "R"}; // in alphabetical order
+		for (int i = 0; i < 3; i++) {
+			chlist += names[i];
+			chlist += '\0';
+			appendLE(chlist, 1, 4); // half
+			appendLE(chlist, 0, 4); // not linear, reserved
+			appendLE(chlist, 1, 4); // x sampling
+			appendLE(chlist, 1, 4); // y sampling
+		}
+		chlist += '\0';
+		appendAttribute(header, "channels", "chlist", chlist);
+		appendAttribute(header, "compression", "compression",
+				std::string(1, '\0'));
+		std::string box;
+		appendLE(box, 0, 4);
+		appendLE(box, 0, 4);
+		appendLE(box, width - 1, 4);
+		appendLE(box, height - 1, 4);
+		appendAttribute(header, "dataWindow", "box2i", box);
+		appendAttribute(header, "displayWindow", "box2i", box);
+		appendAttribute(header, "lineOrder", "lineOrder",
+				std::string(1, '\0'));
+		std::string one;
+		appendLE(one, 0x3f800000, 4);
+		appendAttribute(header, "pixelAspectRatio", "float", one);
+		appendAttribute(header, "screenWindowCenter", "v2f",
+				std::string(8, '\0'));
+		appendAttribute(header, "screenWindowWidth", "float", one);
+		header += '\0';
+
+		// One offset per row.
+		unsigned long long rowBytes = (unsigned long long) width * 3 * 2;
+		unsigned long long first = header.size() + (size_t) height * 8;
+		for (int y = 0; y < height; y++)
+			appendLE(header, first + y * (rowBytes + 8), 8);
+		return header;
+	}
+
+	/**
+	 * Appends a row of an OpenEXR file made by @c exrHeader .
+	 *
+	 * @param out The bytes of the file.
+	 * @param y Number of the row.
+	 * @param halves The half floats of the row: red, green and blue of
+	 *   every pixel in turn.
+	 * @param width The width of the image in pixels.
+	 */
+	static void appendEXRRow(std::string &out, int y,
+			const unsigned short *halves, int width) {
+		appendLE(out, y, 4);
+		appendLE(out, (unsigned long long) width * 3 * 2, 4);
+		for (int ch = 2; ch >= 0; ch--)
+			for (int x = 0; x < width; x++)
+				appendLE(out, halves[3 * x + ch], 2);
+	}
+
+	/**
+	 * The writer of @c writeEXR , for colors that aren't in a framebuffer.
+	 *
+	 * @param image The colors of the pixels, row by row.
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param os The output stream, which should be in binary mode.
+	 */
+	static void writeEXR(const std::vector<rgbcolor<color_T> > &image,
+			int width, int height, std::ostream &os) {
+		assert(image.size() == (size_t) width * height && !image.empty());
+		std::string header = exrHeader(width, height);
+		os.write(header.data(), header.size());
+
+		std::string row;
+		std::vector<unsigned short> halves((size_t) width * 3);
+		for (int y = 0; y < height; y++) {
+			const color_T *c = channels(image) + (size_t) y * width * 3;
+			for (size_t i = 0; i < halves.size(); i++)
+				halves[i] = floatToHalf((float) c[i]);
+			row.clear();
+			appendEXRRow(row, y, &halves[0], width);
+			os.write(row.data(), row.size());
+		}
+		os.flush();
+	}
+};
+
+/**
+ * A framebuffer that keeps its pixels in 16 bits a channel, as halves or
+ * fixed point, for images whose colors in full precision would take too
+ * much memory. Renders put whole rows into it as they finish; they're
+ * converted to 8 bits by one SIMD pass, or back to floats a row at a time
+ * for PFM and OpenEXR.
+ *
+ * @tparam color_T The type of the @c rgbcolor put in and got out.
+ */
+template<typename color_T>
+class compactframebuffer {
+private:
+
+	/**
+	 * Width in pixels.
+	 */
+	int width;
+
+	/**
+	 * Height in pixels.
+	 */
+	int height;
+
+	/**
+	 * How the channels are stored.
+	 */
+	pixelStorage storage;
+
+	/**
+	 * The channels of the pixels, row by row, red, green and blue of each
+	 * pixel in turn.
+	 */
+	std::vector<unsigned short> channels;
+
+public:
+
+	/**
+	 * Constructs a black image of the given size.
+	 *
+	 * @param width Width in pixels.
+	 * @param height Height in pixels.
+	 * @param storage @c PIXELS_HALF or @c PIXELS_FIXED16 .
+	 */
+	compactframebuffer(int width = 0, int height = 0,
+			pixelStorage storage = PIXELS_HALF) : width(width),
+			height(height), storage(storage),
+			channels((size_t) width * height * 3) {
+		assert(width >= 0 && height >= 0 && storage != PIXELS_FULL);
+	}
+
+	/**
+	 * Gets the width.
+	 *
+	 * @return Width in pixels.
+	 */
+	int getWidth() const {
+		return width;
+	}
+
+	/**
+	 * Gets the height.
+	 *
+	 * @return Height in pixels.
+	 */
+	int getHeight() const {
+		return height;
+	}
+
+	/**
+	 * Gets how the channels are stored.
+	 *
+	 * @return The storage.
+	 */
+	pixelStorage getStorage() const {
+		return storage;
+	}
+
+	/**
+	 * Gets the memory the pixels take.
+	 *
+	 * @return Bytes.
+	 */
+	size_t getMemoryUsage() const {
+		return channels.capacity() * sizeof(unsigned short);
+	}
+
+	/**
+	 * Stores whole rows of colors, replacing what was there. Different
+	 * rows may be put from different threads at once.
+	 *
+	 * @param y0 The first row.
+	 * @param colors The colors of the rows, row by row.
+	 * @param rows Number of rows.
+	 */
+	void putRows(int y0, const rgbcolor<color_T> *colors, int rows) {
+		assert(y0 >= 0 && rows >= 0 && y0 + rows <= height);
+		assert(sizeof(rgbcolor<color_T>) == 3 * sizeof(color_T));
+		const color_T *c = reinterpret_cast<const color_T *>(colors);
+		unsigned short *out = &channels[(size_t) y0 * width * 3];
+		size_t n = (size_t) rows * width * 3;
+		if (storage == PIXELS_HALF)
+			for (size_t i = 0; i < n; i++)
+				out[i] = floatToHalf((float) c[i]);
+		else
+			for (size_t i = 0; i < n; i++)
+				out[i] = floatToFixed16((float) c[i]);
+	}
+
+	/**
+	 * Gets the colors of a row.
+	 *
+	 * @param y The row.
+	 * @param[out] out Receives @c width colors.
+	 */
+	void getRow(int y, rgbcolor<color_T> *out) const {
+		assert(y >= 0 && y < height);
+		color_T *c = reinterpret_cast<color_T *>(out);
+		const unsigned short *in = &channels[(size_t) y * width * 3];
+		for (size_t i = 0; i < (size_t) width * 3; i++)
+			c[i] = (color_T) (storage == PIXELS_HALF ? halfToFloat(in[i]) :
+					fixed16ToFloat(in[i]));
+	}
+
+	/**
+	 * Quantizes the image to 8 bits per channel for PPM and PNG, as
+	 * @c framebuffer::quantize does, decoding the channels on the way with
+	 * the widest kernel @c activeSimdLevel allows.
+	 *
+	 * @param[out] rgb Receives the red, green and blue of every pixel.
+	 * @param exposure What to multiply the colors by first.
+	 */
+	void quantize(std::vector<unsigned char> &rgb,
+			color_T exposure = 1) const {
+		rgb.resize(channels.size());
+		if (!channels.empty())
+			compactlanes::quantize(activeSimdLevel(), storage, &channels[0],
+					channels.size(), (float) (exposure * QUANTIZE_MAX),
+					&rgb[0]);
+	}
+
+	/**
+	 * Writes the image as a color PFM, as @c framebuffer::writePFM does,
+	 * decoding a row at a time.
+	 *
+	 * @param os The output stream, which should be in binary mode.
+	 */
+	void writePFM(std::ostream &os) const {
+		assert(!channels.empty());
+		os << framebuffer<color_T>::pfmHeader(width, height);
+		std::vector<rgbcolor<color_T> > colors(width);
+		std::vector<float> row((size_t) width * 3);
+		for (int y = height - 1; y >= 0; y--) {
+			getRow(y, &colors[0]);
+			framebuffer<color_T>::toPFMRow(&colors[0], width, &row[0]);
+			os.write(reinterpret_cast<const char *>(&row[0]),
+					row.size() * sizeof(float));
+		}
+		os.flush();
+	}
+
+	/**
+	 * Writes the image as OpenEXR, as @c framebuffer::writeEXR does. Halves
+	 * are written as they're stored.
+	 *
+	 * @param os The output stream, which should be in binary mode.
+	 */
+	void writeEXR(std::ostream &os) const {
+		assert(!channels.empty());
+		std::string header = framebuffer<color_T>::exrHeader(width, height);
+		os.write(header.data(), header.size());
+		std::string row;
+		std::vector<unsigned short> halves((size_t) width * 3);
+		for (int y = 0; y < height; y++) {
+			const unsigned short *in = &channels[(size_t) y * width * 3];
+			if (storage == PIXELS_FIXED16) {
+				for (size_t i = 0; i < halves.size(); i++)
+					halves[i] = floatToHalf(fixed16ToFloat(in[i]));
+				in = &halves[0];
+			}
+			row.clear();
+			framebuffer<color_T>::appendEXRRow(row, y, in, width);
+			os.write(row.data(), row.size());
+		}
+		os.flush();
+	}
+};
+
+#endif // FRAMEBUFFER_HH
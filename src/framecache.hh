@@ -0,0 +1,382 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "scenerecord.hh"
+#include "boost/cstdint.hpp"
+#include "boost/noncopyable.hpp"
+#include "boost/scoped_ptr.hpp"
+#include "boost/thread.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifndef FRAMECACHE_HH
+#define FRAMECACHE_HH
+
+/**
+ * Defined when frames can be claimed with POSIX exclusive creation.
+ */
+#if defined(__unix__) || defined(__APPLE__)
+#define FRAMECACHE_POSIX 1
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+/**
+ * A 64 bit FNV-1a hash of everything that decides how a frame looks, so a
+ * frame rendered once can be found again by it in a @c --frame-cache .
+ * Numbers are hashed by their bytes, so it's only meant to be compared on
+ * machines of the same byte order.
+ */
+class scenehash {
+private:
+
+	/**
+	 * The hash of the bytes so far.
+	 */
+	boost::uint64_t h;
+
+public:
+
+	/**
+	 * Starts the hash of nothing.
+	 */
+	scenehash() : h(0xcbf29ce484222325ULL) { }
+
+	/**
+	 * Adds bytes to the hash.
+	 *
+	 * @param data The first byte.
+	 * @param size Number of bytes.
+	 */
+	void add(const void *data, size_t size) {
+		const unsigned char *p = static_cast<const unsigned char *>(data);
+		for (size_t i = 0; i < size; i++) {
+			h ^= p[i];
+			h *= 0x100000001b3ULL;
+		}
+	}
+
+	/**
+	 * Adds a number to the hash.
+	 *
+	 * @param v The number.
+	 */
+	void add(double v) {
+		add(&v, sizeof(v));
+	}
+
+	/**
+	 * Adds a string to the hash, with its length so that strings one after
+	 * the other can't run together.
+	 *
+	 * @param s The string.
+	 */
+	void add(const std::string &s) {
+		add((double) s.size());
+		add(s.data(), s.size());
+	}
+
+	/**
+	 * Gets the hash.
+	 *
+	 * @return The hash of everything added.
+	 */
+	boost::uint64_t get() const {
+		return h;
+	}
+
+	/**
+	 * Gets the hash written as 16 hex digits, for file names.
+	 *
+	 * @return The digits.
+	 */
+	std::string toString() const {
+		char digits[17];
+		snprintf(digits, sizeof(digits), "%016llx", (unsigned long long) h);
+		return digits;
+	}
+};
+
+/**
+ * Gets the field of a record that an @c animation key moves: the first
+ * vector of its @c sceneRecordLayout .
+ *
+ * @param kind The @c sceneRecordKind .
+ *
+ * @return Index of the field's first value, or -1 if the kind has no
+ *   vector.
+ */
+inline int animatedField(int kind) {
+	int at = 0;
+	for (const char *f = sceneRecordLayout(kind); *f != '\0'; f++) {
+		if (*f == 'V')
+			return at;
+		at += *f == 'C' ? 3 : 1;
+	}
+	return -1;
+}
+
+/**
+ * Adds the objects of a scene to a hash, leaving out their keys and where
+ * keyed objects start, which the positions of the keyed objects at a frame
+ * stand for; see @c animation::getTrackPosition . So editing a key only
+ * changes the hash of the frames it moves something in. The files the
+ * scene names are hashed by their names, sizes and times of change rather
+ * than their bytes.
+ *
+ * @param hash The hash.
+ * @param records The objects.
+ * @param count Number of objects.
+ * @param paths The files and names the objects refer to.
+ */
+inline void hashSceneRecords(scenehash &hash, const scenerecord *records,
+		size_t count, const std::vector<std::string> &paths) {
+	for (size_t i = 0; i < count; i++) {
+		if (records[i].kind == RECORD_KEY)
+			continue;
+		scenerecord r = records[i];
+		r.line = 0;
+		int field = animatedField(r.kind);
+		if (i + 1 < count && records[i + 1].kind == RECORD_KEY && field >= 0)
+			for (int k = 0; k < 3; k++)
+				r.values[field + k] = 0;
+		hash.add(&r, sizeof(r));
+	}
+	for (size_t i = 0; i < paths.size(); i++) {
+		hash.add(paths[i]);
+#ifdef FRAMECACHE_POSIX
+		struct stat st;
+		if (stat(paths[i].c_str(), &st) == 0) {
+			hash.add((double) st.st_size);
+			hash.add((double) st.st_mtime);
+		}
+#endif
+	}
+}
+
+/**
+ * Adds the shapes of a scene to a hash exactly as they are, for finding a
+ * tree built over the same shapes again: unlike @c hashSceneRecords ,
+ * keyed shapes are hashed where they start, and lights, cameras and keys,
+ * which the tree doesn't depend on, are left out. The files the scene
+ * names are hashed by their names, sizes and times of change.
+ *
+ * @param hash The hash.
+ * @param records The objects.
+ * @param count Number of objects.
+ * @param paths The files the objects name.
+ */
+inline void hashSceneShapes(scenehash &hash, const scenerecord *records,
+		size_t count, const std::vector<std::string> &paths) {
+	for (size_t i = 0; i < count; i++) {
+		int kind = records[i].kind;
+		if (kind == RECORD_LIGHT || kind == RECORD_SPOTLIGHT ||
+				kind == RECORD_AREALIGHT || kind == RECORD_CAMERA ||
+				kind == RECORD_KEY)
+			continue;
+		scenerecord r = records[i];
+		r.line = 0;
+		hash.add(&r, sizeof(r));
+	}
+	for (size_t i = 0; i < paths.size(); i++) {
+		hash.add(paths[i]);
+#ifdef FRAMECACHE_POSIX
+		struct stat st;
+		if (stat(paths[i].c_str(), &st) == 0) {
+			hash.add((double) st.st_size);
+			hash.add((double) st.st_mtime);
+		}
+#endif
+	}
+}
+
+/**
+ * Tells if a file exists.
+ *
+ * @param path The file name.
+ *
+ * @return Whether it can be opened for reading.
+ */
+inline bool fileExists(const std::string &path) {
+	std::ifstream f(path.c_str(), std::ios::in | std::ios::binary);
+	return f.good();
+}
+
+/**
+ * Copies a file, writing the copy under another name first and renaming
+ * it into place, so that someone reading the copy never sees part of it.
+ *
+ * @param from The file to copy.
+ * @param to The name of the copy.
+ *
+ * @return @c false if the file couldn't be read or the copy written.
+ */
+inline bool copyFile(const std::string &from, const std::string &to) {
+	std::ifstream in(from.c_str(), std::ios::in | std::ios::binary);
+	if (!in)
+		return false;
+	std::string partial = to + ".part";
+	std::ofstream out(partial.c_str(), std::ios::out | std::ios::binary);
+	out << in.rdbuf();
+	out.close();
+	if (!out || in.bad() || rename(partial.c_str(), to.c_str()) != 0) {
+		remove(partial.c_str());
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Writes bytes to a file under another name first and renames it into
+ * place, like @c copyFile , so that someone reading it never sees part of
+ * it.
+ *
+ * @param path The file name.
+ * @param bytes The contents.
+ *
+ * @return @c false if the file couldn't be written.
+ */
+inline bool writeFileAtomically(const std::string &path,
+		const std::string &bytes) {
+	std::string partial = path + ".part";
+	std::ofstream out(partial.c_str(), std::ios::out | std::ios::binary);
+	out.write(bytes.data(), bytes.size());
+	out.close();
+	if (!out || rename(partial.c_str(), path.c_str()) != 0) {
+		remove(partial.c_str());
+		return false;
+	}
+	return true;
+}
+
+/**
+ * The frames a node has claimed in a shared @c --frame-cache directory,
+ * each by a lock file that only one node can create. While a frame is
+ * claimed a thread touches its lock file regularly; a lock file nobody
+ * touched for the stale time belongs to a node that went away, and is
+ * taken over. Two nodes may then both render the frame, which only costs
+ * time since they render the same image.
+ */
+class frameclaims : private boost::noncopyable {
+private:
+
+	/**
+	 * Seconds after which an untouched lock file is stale.
+	 */
+	double staleSeconds;
+
+	/**
+	 * The lock files this node holds.
+	 */
+	std::set<std::string> held;
+
+	/**
+	 * Guards @c held .
+	 */
+	boost::mutex lock;
+
+	/**
+	 * The thread that touches the lock files, once one is held.
+	 */
+	boost::scoped_ptr<boost::thread> keeper;
+
+	/**
+	 * Touches the held lock files until interrupted.
+	 */
+	struct touchLoop {
+		frameclaims *claims;
+
+		void operator()() {
+			long ms = std::max(1000L, (long) (claims->staleSeconds * 250));
+			for (;;) {
+				boost::this_thread::sleep(boost::posix_time::milliseconds(ms));
+				boost::lock_guard<boost::mutex> guard(claims->lock);
+#ifdef FRAMECACHE_POSIX
+				for (std::set<std::string>::const_iterator i =
+						claims->held.begin(); i != claims->held.end(); ++i)
+					utime(i->c_str(), 0);
+#endif
+			}
+		}
+	};
+
+public:
+
+	/**
+	 * Makes a node that holds no claims.
+	 *
+	 * @param staleSeconds Seconds after which a lock file nobody touched
+	 *   is taken over, or 0 for never.
+	 */
+	explicit frameclaims(double staleSeconds) : staleSeconds(staleSeconds) { }
+
+	/**
+	 * Stops touching lock files and removes those still held.
+	 */
+	~frameclaims() {
+		if (keeper) {
+			keeper->interrupt();
+			keeper->join();
+		}
+		for (std::set<std::string>::const_iterator i = held.begin();
+				i != held.end(); ++i)
+			remove(i->c_str());
+	}
+
+	/**
+	 * Claims a frame by creating its lock file, taking it over if it's
+	 * stale.
+	 *
+	 * @param path The lock file.
+	 *
+	 * @return @c false if another node holds it.
+	 */
+	bool claim(const std::string &path) {
+#ifdef FRAMECACHE_POSIX
+		for (int attempt = 0; attempt < 2; attempt++) {
+			int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+			if (fd >= 0) {
+				close(fd);
+				break;
+			}
+			struct stat st;
+			if (attempt > 0 || staleSeconds <= 0 ||
+					stat(path.c_str(), &st) != 0 ||
+					difftime(time(0), st.st_mtime) < staleSeconds)
+				return false;
+			remove(path.c_str());
+		}
+#endif
+		boost::lock_guard<boost::mutex> guard(lock);
+		held.insert(path);
+		if (!keeper) {
+			touchLoop loop = { this };
+			keeper.reset(new boost::thread(loop));
+		}
+		return true;
+	}
+
+	/**
+	 * Gives up a claim, removing its lock file.
+	 *
+	 * @param path The lock file.
+	 */
+	void release(const std::string &path) {
+		boost::lock_guard<boost::mutex> guard(lock);
+		if (held.erase(path) > 0)
+			remove(path.c_str());
+	}
+};
+
+#endif // FRAMECACHE_HH
@@ -0,0 +1,142 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "ray.hh"
+#include "hitrecord.hh"
+#include <cassert>
+#include <vector>
+
+#ifndef GBUFFER_HH
+#define GBUFFER_HH
+
+/**
+ * The result of the visibility pass of a render: for every pixel, the camera
+ * ray and the record of its closest hit, which holds the hit shape's id, the
+ * time, the point and the normal. @c scene::renderGBuffer fills it in and
+ * @c scene::shadeGBuffer turns it into colors, so an image can be shaded
+ * again, e.g. after its lights changed, without tracing the camera rays
+ * again. The shapes the records point to must outlive the buffer. Pixels
+ * are stored row by row. Note that there are some convenient typedefs in this
+ * file.
+ *
+ * @tparam vec_T The type of the vector components. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double,
+ *   float, or int.
+ * @tparam time_T The type of the time. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double or
+ *   float, but int would likely work.
+ * @tparam color_T The type of the @c rgbcolor. Many arithmetic
+ *   and relational operators must be supported, including real number ones.
+ *   The type will likely be double or float.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class gbuffer {
+private:
+
+	/**
+	 * Width of the image in pixels.
+	 */
+	int width;
+
+	/**
+	 * Height of the image in pixels.
+	 */
+	int height;
+
+	/**
+	 * The camera ray of every pixel.
+	 */
+	std::vector<ray<vec_T, time_T, dim> > rays;
+
+	/**
+	 * The closest hit of every pixel's camera ray.
+	 */
+	std::vector<hitrecord<vec_T, color_T, time_T, dim> > hits;
+
+public:
+
+	/**
+	 * Constructs an empty buffer.
+	 */
+	gbuffer() : width(0), height(0) { }
+
+	/**
+	 * Resizes the buffer to the given image size. All pixels become misses.
+	 *
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 */
+	void resize(int width, int height) {
+		assert(width >= 0 && height >= 0);
+		this->width = width;
+		this->height = height;
+		rays.assign((size_t) width * height, ray<vec_T, time_T, dim>());
+		hits.assign((size_t) width * height,
+				hitrecord<vec_T, color_T, time_T, dim>());
+	}
+
+	/**
+	 * Getter for the width.
+	 *
+	 * @return Width in pixels.
+	 */
+	int getWidth() const {
+		return width;
+	}
+
+	/**
+	 * Getter for the height.
+	 *
+	 * @return Height in pixels.
+	 */
+	int getHeight() const {
+		return height;
+	}
+
+	/**
+	 * Gets the camera ray of the pixel with the given index, which is
+	 * @c y * width + x .
+	 *
+	 * @param i Index of the pixel.
+	 *
+	 * @return The ray.
+	 */
+	ray<vec_T, time_T, dim>& getRay(int i) {
+		return rays[i];
+	}
+
+	/**
+	 * Const version of @c getRay .
+	 */
+	const ray<vec_T, time_T, dim>& getRay(int i) const {
+		return rays[i];
+	}
+
+	/**
+	 * Gets the hit of the pixel with the given index, which is
+	 * @c y * width + x .
+	 *
+	 * @param i Index of the pixel.
+	 *
+	 * @return The hit record, whose @c obj is 0 for a miss.
+	 */
+	hitrecord<vec_T, color_T, time_T, dim>& getHit(int i) {
+		return hits[i];
+	}
+
+	/**
+	 * Const version of @c getHit .
+	 */
+	const hitrecord<vec_T, color_T, time_T, dim>& getHit(int i) const {
+		return hits[i];
+	}
+};
+
+typedef gbuffer<double, double, double, 3> gbuffer3d;
+typedef gbuffer<double, double, float, 3> gbuffer3ddf;
+typedef gbuffer<float, float, float, 3> gbuffer3f;
+
+#endif // GBUFFER_HH
@@ -0,0 +1,447 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "accelerator.hh"
+#include "aabb.hh"
+#include "shape.hh"
+#include "shapekind.hh"
+#include "ray.hh"
+#include "mvector.hh"
+#include "boost/shared_ptr.hpp"
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <ostream>
+
+#ifndef GRID_HH
+#define GRID_HH
+
+/**
+ * Target number of grid cells per shape. The resolution along each axis is
+ * picked so that the cells are roughly cubes and there are about this many of
+ * them per shape.
+ */
+#define GRID_DENSITY 3
+
+/**
+ * Largest number of cells along any one axis.
+ */
+#define GRID_MAX_RES 512
+
+/**
+ * A uniform grid over the bounded shapes of a scene. Each cell lists the
+ * shapes whose bounding boxes overlap it, and rays walk the cells they pass
+ * through in order with the 3D-DDA of Amanatides and Woo. For evenly spread
+ * shapes of similar size this is cheaper to build and to traverse than a
+ * @c bvh ; for clustered scenes the tree is better.
+ *
+ * @tparam vec_T The type of the vector components. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double,
+ *   float, or int.
+ * @tparam time_T The type of the time. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double or
+ *   float, but int would likely work.
+ * @tparam color_T The type of the @c rgbcolor. Many arithmetic
+ *   and relational operators must be supported, including real number ones.
+ *   The type will likely be double or float.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class grid : public accelerator<vec_T, color_T, time_T, dim> {
+public:
+
+	/**
+	 * Boost shared pointer typedef for shapes.
+	 */
+	typedef typename accelerator<vec_T, color_T, time_T, dim>::sp_shape
+		sp_shape;
+
+private:
+
+	/**
+	 * Raw pointers to the shapes passed to @c build . The scene owns them.
+	 */
+	std::vector<const shape<vec_T, color_T, time_T, dim> *> prims;
+
+	/**
+	 * The @c shapeKind of each of @c prims .
+	 */
+	std::vector<shapeKind> primKinds;
+
+	/**
+	 * Box around all the shapes, slightly padded.
+	 */
+	aabb<vec_T, dim> bounds;
+
+	/**
+	 * Number of cells along each axis.
+	 */
+	int res[dim];
+
+	/**
+	 * Size of a cell along each axis.
+	 */
+	vec_T cellSize[dim];
+
+	/**
+	 * Entry @c i is the first element of @c cellPrims for cell @c i ; entry
+	 * @c i+1 is one past its last. There is one more entry than cells.
+	 */
+	std::vector<int> cellStart;
+
+	/**
+	 * Shape indices of all cells, stored back to back.
+	 */
+	std::vector<int> cellPrims;
+
+	/**
+	 * Intersects the ray with the shape @c prims[i] .
+	 */
+	time_T intersectPrim(int i, const ray<vec_T, time_T, dim> &r) const {
+		return shapedispatch<vec_T, color_T, time_T, dim>::intersection(
+				primKinds[i], prims[i], r);
+	}
+
+	/**
+	 * Gets the linear index of the cell with the given coordinates. The x
+	 * axis varies fastest.
+	 */
+	int cellIndex(const int cell[dim]) const {
+		int idx = 0;
+		for (int i = dim - 1; i >= 0; i--)
+			idx = idx * res[i] + cell[i];
+		return idx;
+	}
+
+	/**
+	 * Gets the coordinate of the cell containing the given coordinate along
+	 * the given axis, clamped to the grid.
+	 */
+	int cellCoord(vec_T x, int axis) const {
+		int c = (int) ((x - bounds.getMin()[axis]) / cellSize[axis]);
+		if (c < 0)
+			c = 0;
+		if (c >= res[axis])
+			c = res[axis] - 1;
+		return c;
+	}
+
+	/**
+	 * Calls @c visit(cellIndex) for every cell overlapping the given box.
+	 * Used twice while building, once to count and once to fill.
+	 */
+	template<typename visitor>
+	void forEachCell(const aabb<vec_T, dim> &box, visitor &visit) const {
+		int lo[dim], hi[dim], cell[dim];
+		for (int i = 0; i < dim; i++) {
+			lo[i] = cellCoord(box.getMin()[i], i);
+			hi[i] = cellCoord(box.getMax()[i], i);
+			cell[i] = lo[i];
+		}
+		while (true) {
+			visit(cellIndex(cell));
+			// Step to the next cell like an odometer.
+			int i = 0;
+			while (i < dim && cell[i] == hi[i]) {
+				cell[i] = lo[i];
+				i++;
+			}
+			if (i == dim)
+				break;
+			cell[i]++;
+		}
+	}
+
+	/**
+	 * Build visitor that counts shapes per cell.
+	 */
+	struct countVisitor {
+		std::vector<int> *counts;
+		void operator()(int cell) {
+			(*counts)[cell + 1]++;
+		}
+	};
+
+	/**
+	 * Build visitor that writes a shape's index into each of its cells.
+	 */
+	struct fillVisitor {
+		std::vector<int> *fill;
+		std::vector<int> *out;
+		int prim;
+		void operator()(int cell) {
+			(*out)[(*fill)[cell]++] = prim;
+		}
+	};
+
+	/**
+	 * State of the walk of a ray through the grid.
+	 */
+	struct walker {
+		int cell[dim];
+		int step[dim];
+		time_T tNext[dim];
+		time_T tDelta[dim];
+	};
+
+	/**
+	 * Sets up the walk of the given ray. Returns false if the ray misses the
+	 * grid altogether.
+	 */
+	bool startWalk(const ray<vec_T, time_T, dim> &r, walker &w,
+			time_T &tEnter) const {
+		if (cellStart.empty())
+			return false;
+		rayquery<vec_T, time_T, dim> q(r);
+		if (!bounds.intersect(q, tEnter))
+			return false;
+		const mvector<vec_T, dim> &invDir = q.getInvDir();
+
+		const mvector<vec_T, dim> &P = r.getOrig();
+		const mvector<vec_T, dim> &D = r.getDir();
+		for (int i = 0; i < dim; i++) {
+			w.cell[i] = cellCoord(P[i] + D[i] * tEnter, i);
+			vec_T cellLo = bounds.getMin()[i] + w.cell[i] * cellSize[i];
+			if (D[i] > 0) {
+				w.step[i] = 1;
+				w.tNext[i] = (time_T) ((cellLo + cellSize[i] - P[i]) *
+						invDir[i]);
+				w.tDelta[i] = (time_T) (cellSize[i] * invDir[i]);
+			}
+			else if (D[i] < 0) {
+				w.step[i] = -1;
+				w.tNext[i] = (time_T) ((cellLo - P[i]) * invDir[i]);
+				w.tDelta[i] = (time_T) (-cellSize[i] * invDir[i]);
+			}
+			else {
+				w.step[i] = 0;
+				w.tNext[i] = std::numeric_limits<time_T>::max();
+				w.tDelta[i] = 0;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Moves the walk into the next cell along the ray. Returns false once
+	 * the ray leaves the grid. The out-parameter receives the time at which
+	 * the ray leaves the current cell.
+	 */
+	bool advance(walker &w, time_T &tExit) const {
+		int axis = 0;
+		for (int i = 1; i < dim; i++)
+			if (w.tNext[i] < w.tNext[axis])
+				axis = i;
+		tExit = w.tNext[axis];
+		w.cell[axis] += w.step[axis];
+		if (w.cell[axis] < 0 || w.cell[axis] >= res[axis])
+			return false;
+		w.tNext[axis] += w.tDelta[axis];
+		return true;
+	}
+
+	/**
+	 * Gets the time at which the ray leaves the current cell.
+	 */
+	static time_T cellExit(const walker &w) {
+		time_T t = w.tNext[0];
+		for (int i = 1; i < dim; i++)
+			if (w.tNext[i] < t)
+				t = w.tNext[i];
+		return t;
+	}
+
+public:
+
+	/**
+	 * Constructs an empty grid. Call @c build before querying it.
+	 */
+	grid() {
+		for (int i = 0; i < dim; i++) {
+			res[i] = 0;
+			cellSize[i] = 0;
+		}
+	}
+
+	/**
+	 * Builds the grid over the given shapes. The cells are sized to be
+	 * roughly cubes with about @c GRID_DENSITY cells per shape.
+	 *
+	 * @param shapes The shapes, which must outlive this grid.
+	 */
+	void build(const std::vector<sp_shape> &shapes) {
+		prims.clear();
+		primKinds.clear();
+		cellStart.clear();
+		cellPrims.clear();
+		bounds = aabb<vec_T, dim>();
+		if (shapes.empty())
+			return;
+
+		std::vector<aabb<vec_T, dim> > boxes(shapes.size());
+		for (size_t i = 0; i < shapes.size(); i++) {
+			prims.push_back(shapes[i].get());
+			primKinds.push_back(shapedispatch<vec_T, color_T, time_T, dim>::
+					kindOf(prims.back()));
+			bool bounded = shapes[i]->getBounds(boxes[i]);
+			assert(bounded);
+			bounds.extend(boxes[i]);
+		}
+
+		// Pad the bounds so that flat scenes still have volume and shapes
+		// on the boundary don't fall outside because of rounding.
+		mvector<vec_T, dim> d = bounds.diagonal();
+		vec_T maxExtent = d[bounds.longestAxis()];
+		vec_T pad = maxExtent > 0 ? maxExtent * (vec_T) 1e-4 : (vec_T) 1e-4;
+		mvector<vec_T, dim> padding;
+		for (int i = 0; i < dim; i++)
+			padding[i] = pad;
+		bounds = aabb<vec_T, dim>(bounds.getMin() - padding,
+				bounds.getMax() + padding);
+		d = bounds.diagonal();
+
+		double volume = 1;
+		for (int i = 0; i < dim; i++)
+			volume *= d[i];
+		double cellsPerUnit = pow(GRID_DENSITY * shapes.size() / volume,
+				1.0 / dim);
+		int numCells = 1;
+		for (int i = 0; i < dim; i++) {
+			res[i] = (int) (d[i] * cellsPerUnit);
+			if (res[i] < 1)
+				res[i] = 1;
+			if (res[i] > GRID_MAX_RES)
+				res[i] = GRID_MAX_RES;
+			cellSize[i] = d[i] / res[i];
+			numCells *= res[i];
+		}
+
+		// Count the shapes in each cell, turn the counts into offsets, then
+		// drop each shape into its cells.
+		cellStart.assign(numCells + 1, 0);
+		countVisitor cv;
+		cv.counts = &cellStart;
+		for (size_t i = 0; i < boxes.size(); i++)
+			forEachCell(boxes[i], cv);
+		for (int i = 0; i < numCells; i++)
+			cellStart[i + 1] += cellStart[i];
+
+		cellPrims.resize(cellStart[numCells]);
+		std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+		fillVisitor fv;
+		fv.fill = &fill;
+		fv.out = &cellPrims;
+		for (size_t i = 0; i < boxes.size(); i++) {
+			fv.prim = (int) i;
+			forEachCell(boxes[i], fv);
+		}
+	}
+
+	/**
+	 * Finds the closest shape hit by the given ray by walking the cells it
+	 * passes through in order. The walk stops in the first cell that
+	 * contains a hit no farther than the cell's far side, since nothing in a
+	 * later cell can be closer.
+	 *
+	 * @param r The ray.
+	 * @param[out] tIntersect The time of the hit or @c RAY_MISS .
+	 *
+	 * @return Index of the shape that was hit or -1 if there was no hit.
+	 */
+	int closestHit(const ray<vec_T, time_T, dim> &r,
+			time_T &tIntersect) const {
+		int best = -1;
+		time_T tBest = RAY_MISS;
+		walker w;
+		time_T tEnter, tExit;
+		if (startWalk(r, w, tEnter)) {
+			do {
+				tExit = cellExit(w);
+				int c = cellIndex(w.cell);
+				for (int i = cellStart[c]; i < cellStart[c + 1]; i++) {
+					time_T t = intersectPrim(cellPrims[i], r);
+					if (t != RAY_MISS && t > 0 && (best < 0 || t < tBest)) {
+						tBest = t;
+						best = cellPrims[i];
+					}
+				}
+				if (best >= 0 && tBest <= tExit)
+					break;
+			} while (advance(w, tExit));
+		}
+		tIntersect = tBest;
+		return best;
+	}
+
+	/**
+	 * Checks if any shape blocks the given ray before @c tmax by walking
+	 * the cells up to @c tmax and stopping at the first hit.
+	 *
+	 * @param r The ray.
+	 * @param tmax Hits at or beyond this time are ignored.
+	 *
+	 * @return Index of a shape that blocks the ray before @c tmax or -1.
+	 */
+	int anyHit(const ray<vec_T, time_T, dim> &r, time_T tmax) const {
+		walker w;
+		time_T tEnter, tExit;
+		if (!startWalk(r, w, tEnter) || tEnter >= tmax)
+			return -1;
+		do {
+			int c = cellIndex(w.cell);
+			for (int i = cellStart[c]; i < cellStart[c + 1]; i++) {
+				time_T t = intersectPrim(cellPrims[i], r);
+				if (t != RAY_MISS && t > 0 && t < tmax)
+					return cellPrims[i];
+			}
+		} while (advance(w, tExit) && tExit < tmax);
+		return -1;
+	}
+
+	/**
+	 * Gets the number of cells along the given axis.
+	 *
+	 * @param axis
+	 *
+	 * @return Resolution along @c axis .
+	 */
+	int getResolution(int axis) const {
+		assert(axis >= 0 && axis < dim);
+		return res[axis];
+	}
+
+	/**
+	 * Gets the number of bytes taken by the cell lists.
+	 *
+	 * @return Memory footprint in bytes.
+	 */
+	size_t getMemoryUsage() const {
+		return (cellStart.size() + cellPrims.size()) * sizeof(int) +
+				prims.size() * (sizeof(prims[0]) + sizeof(primKinds[0]));
+	}
+
+	/**
+	 * Prints the resolution and size of this grid.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printHelper(std::ostream &os) const {
+		os << "[grid. resolution: ";
+		for (int i = 0; i < dim; i++)
+			os << (i > 0 ? " x " : "") << res[i];
+		os << ", shapes: " << prims.size() << ", cell entries: " <<
+				cellPrims.size() << "]";
+	}
+};
+
+typedef grid<double, double, double, 3> grid3d;
+typedef grid<double, double, float, 3> grid3ddf;
+typedef grid<float, float, float, 3> grid3f;
+typedef boost::shared_ptr<grid3d> sp_grid3d;
+typedef boost::shared_ptr<grid3ddf> sp_grid3ddf;
+typedef boost::shared_ptr<grid3f> sp_grid3f;
+
+#endif // GRID_HH
@@ -0,0 +1,79 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "sceneobj.hh"
+#include "mvector.hh"
+
+#ifndef HITRECORD_HH
+#define HITRECORD_HH
+
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class shape;
+
+/**
+ * Everything shading needs to know about where a ray hit a shape, filled in
+ * once by @c shape::completeHit so that the point and normal aren't worked
+ * out again from the time alone. Note that there are some convenient
+ * typedefs in this file.
+ *
+ * @tparam vec_T The type of the vector components. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double,
+ *   float, or int.
+ * @tparam time_T The type of the time. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double or
+ *   float, but int would likely work.
+ * @tparam color_T The type of the @c rgbcolor. Many arithmetic
+ *   and relational operators must be supported, including real number ones.
+ *   The type will likely be double or float.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+struct hitrecord {
+
+	/**
+	 * Time of the hit.
+	 */
+	time_T t;
+
+	/**
+	 * Point where the ray hit.
+	 */
+	mvector<vec_T, dim> point;
+
+	/**
+	 * Surface normal at @c point .
+	 */
+	mvector<vec_T, dim> normal;
+
+	/**
+	 * The shape whose color and reflectivity apply at @c point . For
+	 * instances this is the shape within the instance that was hit. It's 0
+	 * if the ray hit nothing.
+	 */
+	const shape<vec_T, color_T, time_T, dim> *obj;
+
+	/**
+	 * Index of the hit shape among the scene's shapes, or -1. For instances
+	 * it's the index of the instance.
+	 */
+	int id;
+
+	/**
+	 * When in the shutter interval the ray was traced, which the rays
+	 * traced from the hit, like shadow rays, are traced at too.
+	 */
+	float shutter;
+
+	/**
+	 * Constructs a record of a miss.
+	 */
+	hitrecord() : t(RAY_MISS), obj(0), id(-1), shutter(0) { }
+};
+
+typedef hitrecord<double, double, double, 3> hitrecord3d;
+typedef hitrecord<double, double, float, 3> hitrecord3ddf;
+typedef hitrecord<float, float, float, 3> hitrecord3f;
+
+#endif // HITRECORD_HH
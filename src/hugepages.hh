@@ -0,0 +1,218 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "boost/atomic.hpp"
+#include <cstddef>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef HUGEPAGES_HH
+#define HUGEPAGES_HH
+
+/**
+ * Defined when memory can be mapped from huge pages or advised to be.
+ */
+#if defined(__linux__)
+#define HUGEPAGES_LINUX 1
+#include <sys/mman.h>
+#endif
+
+/**
+ * Size in bytes of the huge pages asked for.
+ */
+#define HUGE_PAGE_SIZE 2097152
+
+/**
+ * Backs the large arrays that rays walk all over, like the nodes of a BVH,
+ * the blocks of the scene's @c arena and the pixels of a framebuffer, with
+ * 2 MB pages when @c setEnabled turned that on, so incoherent traversal
+ * misses the TLB less. Blocks of an arena are mapped from the pages
+ * reserved for @c MAP_HUGETLB if the system has free ones, and otherwise
+ * at a huge page boundary and advised like arrays are: with
+ * @c MADV_HUGEPAGE , so the kernel backs them with transparent huge pages
+ * if it can. Either way failing falls back to ordinary pages. What was
+ * obtained is counted for @c printStats .
+ */
+class hugepages {
+public:
+
+	/**
+	 * Tells whether huge pages are asked for.
+	 *
+	 * @return @c true if they are.
+	 */
+	static bool isEnabled() {
+		return enabled();
+	}
+
+	/**
+	 * Turns asking for huge pages on or off, for what's allocated after.
+	 *
+	 * @param on Whether to ask for them.
+	 */
+	static void setEnabled(bool on) {
+		enabled() = on;
+	}
+
+	/**
+	 * Maps memory for a block from huge pages, reserved ones first.
+	 *
+	 * @param[in,out] length The bytes wanted; receives the bytes mapped,
+	 *   a multiple of @c HUGE_PAGE_SIZE .
+	 *
+	 * @return The block, aligned to a huge page, or 0 if huge pages are
+	 *   off or nothing could be mapped. Give it back with @c unmap .
+	 */
+	static void* map(size_t &length) {
+#ifdef HUGEPAGES_LINUX
+		if (!isEnabled())
+			return 0;
+		length = (length + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE *
+				HUGE_PAGE_SIZE;
+#ifdef MAP_HUGETLB
+		void *p = mmap(0, length, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED) {
+			counter(RESERVED) += length;
+			return p;
+		}
+#endif
+		// Map a huge page more than needed and trim it to a boundary, so
+		// all of the block can be backed by transparent huge pages.
+		void *q = mmap(0, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (q == MAP_FAILED)
+			return 0;
+		char *c = static_cast<char *>(q);
+		size_t head = (HUGE_PAGE_SIZE - (size_t) c % HUGE_PAGE_SIZE) %
+				HUGE_PAGE_SIZE;
+		if (head > 0)
+			munmap(c, head);
+		munmap(c + head + length, HUGE_PAGE_SIZE - head);
+		advise(c + head, length);
+		return c + head;
+#else
+		return 0;
+#endif
+	}
+
+	/**
+	 * Gives back a block @c map made.
+	 *
+	 * @param p The block.
+	 * @param length The bytes @c map mapped.
+	 */
+	static void unmap(void *p, size_t length) {
+#ifdef HUGEPAGES_LINUX
+		munmap(p, length);
+#endif
+	}
+
+	/**
+	 * Makes room in an array for a number of elements, advising the huge
+	 * pages of it to be backed by transparent huge pages before anything
+	 * touches them. Arrays under a huge page, and all of them when huge
+	 * pages are off, are only reserved.
+	 *
+	 * @param v The array, which mustn't have the room yet for it to count.
+	 * @param n Number of elements.
+	 */
+	template<typename T>
+	static void reserve(std::vector<T> &v, size_t n) {
+		if (n <= v.capacity())
+			return;
+		v.reserve(n);
+		if (isEnabled() && n * sizeof(T) >= HUGE_PAGE_SIZE)
+			advise(v.data(), v.capacity() * sizeof(T));
+	}
+
+	/**
+	 * Prints what huge pages were obtained for @c --stats : the bytes of
+	 * reserved pages mapped, the bytes advised, and the bytes of
+	 * transparent huge pages the process has, which the kernel may give
+	 * the advised bytes or not.
+	 *
+	 * @param os The output stream.
+	 */
+	static void printStats(std::ostream &os) {
+		os << "huge pages: " << counter(RESERVED) / 1048576 <<
+				" MB reserved, " << counter(ADVISED) / 1048576 <<
+				" MB advised";
+		size_t anon = transparentBytes();
+		if (anon != (size_t) -1)
+			os << ", " << anon / 1048576 << " MB transparent in use";
+		os << std::endl;
+	}
+
+private:
+
+	/**
+	 * The counts of @c counter .
+	 */
+	enum count {
+		/** Bytes mapped from pages reserved for @c MAP_HUGETLB . */
+		RESERVED,
+		/** Bytes advised with @c MADV_HUGEPAGE . */
+		ADVISED
+	};
+
+	/**
+	 * Advises the huge pages that lie wholly in a range of memory to be
+	 * backed by transparent huge pages.
+	 *
+	 * @param p The memory.
+	 * @param bytes Its size.
+	 */
+	static void advise(void *p, size_t bytes) {
+#if defined(HUGEPAGES_LINUX) && defined(MADV_HUGEPAGE)
+		size_t begin = ((size_t) p + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE *
+				HUGE_PAGE_SIZE;
+		size_t end = ((size_t) p + bytes) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+		if (begin < end && madvise((void *) begin, end - begin,
+				MADV_HUGEPAGE) == 0)
+			counter(ADVISED) += end - begin;
+#endif
+	}
+
+	/**
+	 * Reads the bytes of transparent huge pages of this process.
+	 *
+	 * @return The bytes, or -1 if the kernel doesn't tell.
+	 */
+	static size_t transparentBytes() {
+		std::ifstream in("/proc/self/smaps_rollup");
+		std::string line;
+		while (std::getline(in, line))
+			if (line.compare(0, 14, "AnonHugePages:") == 0) {
+				std::istringstream kb(line.substr(14));
+				size_t n = 0;
+				if (kb >> n)
+					return n * 1024;
+			}
+		return (size_t) -1;
+	}
+
+	/**
+	 * Gets the flag behind @c isEnabled .
+	 */
+	static bool& enabled() {
+		static bool on = false;
+		return on;
+	}
+
+	/**
+	 * Gets a count of what was obtained, which threads building at the
+	 * same time may add to.
+	 */
+	static boost::atomic<size_t>& counter(count which) {
+		static boost::atomic<size_t> counts[2];
+		return counts[which];
+	}
+};
+
+#endif // HUGEPAGES_HH
@@ -41,6 +41,30 @@ private:
 	 */
 	mvector<vec_T, dim> surfNorm;
 
+	/**
+	 * Index of the only component of @c surfNorm that isn't zero, or -1 if
+	 * there's more than one, so that planes perpendicular to an axis, like
+	 * floors and walls, are intersected with one component of the ray
+	 * instead of dot products.
+	 */
+	int axis;
+
+	/**
+	 * Finds @c axis for the surface normal.
+	 */
+	void findAxis() {
+		axis = -1;
+		for (int i = 0; i < dim; i++) {
+			if (surfNorm[i] == 0)
+				continue;
+			if (axis >= 0) {
+				axis = -1;
+				return;
+			}
+			axis = i;
+		}
+	}
+
 public:
 
 	/**
@@ -55,6 +79,7 @@ public:
 		mvector<vec_T, dim> v;
 		v[dim - 1] = 1;
 		surfNorm = v;
+		axis = dim - 1;
 	}
 
 	/**
@@ -77,6 +102,7 @@ public:
 				shape<vec_T, color_T, time_T, dim>(color, reflectivity),
 				dist(distFromOrig), surfNorm(surfaceNormal.norm()) {
 		assert(distFromOrig >= 0);
+		findAxis();
 	}
 
 	/**
@@ -89,6 +115,7 @@ public:
 					other.getColor(), other.getReflectivity()) {
 		dist = other.getDist();
 		surfNorm = other.getSurfNorm();
+		axis = other.axis;
 	}
 
 	/**
@@ -106,6 +133,7 @@ public:
 		this->setReflectivity(rhs.getReflectivity());
 		dist = rhs.getDist();
 		surfNorm = rhs.getSurfNorm();
+		axis = rhs.axis;
 		return *this;
 	}
 
@@ -131,13 +159,28 @@ public:
 	 * intersection time is given by @f[ t = -\frac{ \mathbf{p} \cdot \mathbf{n}
 	 * + d }{ \mathbf{d} \cdot \mathbf{n}} @f]. If there is no intersection or
 	 * if the intersection time is negative this function returns @c
-	 * RAY_MISS .
+	 * RAY_MISS . When the plane is perpendicular to an axis the dot products
+	 * are just the products of that component, which gives the same time. A
+	 * ray that leaves this plane misses it without a test; see
+	 * @c ray::setExcluded .
      *
      * @param r The ray to intersect with this plane.
      *
      * @return Intersection time or @c RAY_MISS .
 	 */
 	time_T intersection(const ray<vec_T, time_T, dim> &r) const {
+		if (r.getExcluded() == this)
+			return RAY_MISS;
+		if (axis >= 0) {
+			vec_T n = surfNorm[axis];
+			vec_T denom = r.getDir()[axis] * n;
+			if (denom == 0)
+				return RAY_MISS;
+			time_T t = (time_T) (-(r.getOrig()[axis] * n + dist) / denom);
+			if (t < 0)
+				return RAY_MISS;
+			return t;
+		}
 		vec_T denom = r.getDir() * surfNorm;
 		if (denom == 0)
 			return RAY_MISS;
@@ -147,6 +190,17 @@ public:
 		return t;
 	}
 
+	/**
+	 * Intersects a packet of rays with this plane; see
+	 * @c shape::intersections .
+	 */
+	void intersections(const ray<vec_T, time_T, dim> *rays, int count,
+			unsigned int mask, time_T *t) const {
+		for (int k = 0; k < count; k++)
+			if (mask >> k & 1)
+				t[k] = infplane::intersection(rays[k]);
+	}
+
 	/**
 	 * Returns the surface normal of this plane, which is the same at all
 	 * points on the plane. This function doesn't check if the given point
@@ -0,0 +1,415 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "shape.hh"
+#include "bvh.hh"
+#include "aabb.hh"
+#include "ray.hh"
+#include "mvector.hh"
+#include "boost/shared_ptr.hpp"
+#include <cassert>
+#include <cmath>
+#include <vector>
+#include <ostream>
+
+#ifndef INSTANCE_HH
+#define INSTANCE_HH
+
+/**
+ * A group of shapes with its own BVH that any number of @c instance shapes
+ * can place into a scene. The shapes are stored and the tree is built only
+ * once no matter how many instances there are. All shapes must be bounded.
+ *
+ * @tparam vec_T The type of the vector components. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double,
+ *   float, or int.
+ * @tparam time_T The type of the time. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double or
+ *   float, but int would likely work.
+ * @tparam color_T The type of the @c rgbcolor. Many arithmetic
+ *   and relational operators must be supported, including real number ones.
+ *   The type will likely be double or float.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class assembly {
+public:
+
+	/**
+	 * Boost shared pointer typedef for shapes.
+	 */
+	typedef boost::shared_ptr<shape<vec_T, color_T, time_T, dim> > sp_shape;
+
+private:
+
+	/**
+	 * The shapes of this assembly in its own coordinates.
+	 */
+	std::vector<sp_shape> shapes;
+
+	/**
+	 * Hierarchy over @c shapes .
+	 */
+	bvh<vec_T, color_T, time_T, dim> tree;
+
+	/**
+	 * Box around all of @c shapes .
+	 */
+	aabb<vec_T, dim> bounds;
+
+	/**
+	 * True if @c tree has been built over the current @c shapes .
+	 */
+	bool built;
+
+public:
+
+	/**
+	 * Constructs an empty assembly.
+	 */
+	assembly() : built(false) { }
+
+	/**
+	 * Adds a shape to this assembly. Call @c finalize once all shapes have
+	 * been added.
+	 *
+	 * @param obj Boost shared pointer to a bounded shape.
+	 */
+	void addShape(const sp_shape &obj) {
+		assert(obj != 0);
+		aabb<vec_T, dim> box;
+		bool bounded = obj->getBounds(box);
+		assert(bounded);
+		shapes.push_back(obj);
+		bounds.extend(box);
+		built = false;
+	}
+
+	/**
+	 * Builds the hierarchy over the shapes of this assembly.
+	 */
+	void finalize() {
+		tree.build(shapes);
+		built = true;
+	}
+
+	/**
+	 * Gets the shapes of this assembly.
+	 *
+	 * @return The shapes.
+	 */
+	const std::vector<sp_shape>& getShapes() const {
+		return shapes;
+	}
+
+	/**
+	 * Gets the number of bytes this assembly takes for its list of shapes
+	 * and its hierarchy, not counting the shapes themselves.
+	 *
+	 * @return Memory footprint in bytes.
+	 */
+	size_t getMemoryUsage() const {
+		return shapes.capacity() * sizeof(sp_shape) + tree.getMemoryUsage();
+	}
+
+	/**
+	 * Gets the box around all shapes of this assembly.
+	 *
+	 * @return The box, which is empty if there are no shapes.
+	 */
+	const aabb<vec_T, dim>& getBounds() const {
+		return bounds;
+	}
+
+	/**
+	 * Finds the closest shape of this assembly hit by the given ray, which
+	 * must be in the assembly's coordinates.
+	 *
+	 * @param r The ray.
+	 * @param[out] tIntersect The time of the hit or @c RAY_MISS .
+	 *
+	 * @return The shape that was hit or 0.
+	 */
+	const shape<vec_T, color_T, time_T, dim> * closestHit(
+			const ray<vec_T, time_T, dim> &r, time_T &tIntersect) const {
+		assert(built);
+		int idx = tree.closestHit(r, tIntersect);
+		return idx >= 0 ? shapes[idx].get() : 0;
+	}
+
+	/**
+	 * Like @c closestHit but gives the index of the shape.
+	 *
+	 * @param r The ray.
+	 * @param[out] tIntersect The time of the hit or @c RAY_MISS .
+	 *
+	 * @return Index in @c getShapes of the shape that was hit or -1.
+	 */
+	int closestHitIndex(const ray<vec_T, time_T, dim> &r,
+			time_T &tIntersect) const {
+		assert(built);
+		return tree.closestHit(r, tIntersect);
+	}
+};
+
+/**
+ * A shape that places an @c assembly into a scene with a rotation, a uniform
+ * scale and a translation, in that order. Rays are transformed into the
+ * assembly's coordinates and traced through its hierarchy, so a scene can
+ * hold many copies of an assembly for the memory of one. The scene's own
+ * hierarchy over its bounded shapes becomes the top level over the
+ * instances. Note that there are some convenient typedefs in this file.
+ *
+ * Since the transform only rotates and scales uniformly, hit times in the
+ * assembly's coordinates are the world times divided by the scale.
+ *
+ * @tparam vec_T The type of the vector components. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double,
+ *   float, or int.
+ * @tparam time_T The type of the time. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double or
+ *   float, but int would likely work.
+ * @tparam color_T The type of the @c rgbcolor. Many arithmetic
+ *   and relational operators must be supported, including real number ones.
+ *   The type will likely be double or float.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class instance : public shape<vec_T, color_T, time_T, dim> {
+public:
+
+	/**
+	 * Boost shared pointer typedef for assemblies.
+	 */
+	typedef boost::shared_ptr<assembly<vec_T, color_T, time_T, dim> >
+		sp_assembly;
+
+private:
+
+	/**
+	 * The placed assembly, which is shared with other instances.
+	 */
+	sp_assembly assem;
+
+	/**
+	 * Rows of the rotation matrix, which is orthonormal.
+	 */
+	mvector<vec_T, dim> rot[dim];
+
+	/**
+	 * Uniform scale factor.
+	 */
+	vec_T scale;
+
+	/**
+	 * Translation.
+	 */
+	mvector<vec_T, dim> offset;
+
+	/**
+	 * Rotates the given vector from the assembly's orientation into the
+	 * world's.
+	 */
+	mvector<vec_T, dim> rotate(const mvector<vec_T, dim> &v) const {
+		mvector<vec_T, dim> w;
+		for (int i = 0; i < dim; i++)
+			w[i] = rot[i] * v;
+		return w;
+	}
+
+	/**
+	 * Rotates the given vector from the world's orientation into the
+	 * assembly's, which is the inverse of @c rotate .
+	 */
+	mvector<vec_T, dim> unrotate(const mvector<vec_T, dim> &v) const {
+		mvector<vec_T, dim> w;
+		for (int i = 0; i < dim; i++)
+			w += rot[i] * v[i];
+		return w;
+	}
+
+	/**
+	 * Transforms the given world ray into the assembly's coordinates. The
+	 * direction stays normalized, and the time in the shutter interval
+	 * stays the same.
+	 */
+	ray<vec_T, time_T, dim> toLocal(const ray<vec_T, time_T, dim> &r) const {
+		ray<vec_T, time_T, dim> local(unrotate(r.getOrig() - offset) / scale,
+				unrotate(r.getDir()), false);
+		local.setShutter(r.getShutter());
+		return local;
+	}
+
+public:
+
+	/**
+	 * Places the given assembly without rotating it.
+	 *
+	 * @param theAssembly The assembly, which must be finalized before it's
+	 *   traced.
+	 * @param theOffset Translation.
+	 * @param theScale Uniform scale factor.
+	 */
+	instance(sp_assembly theAssembly, const mvector<vec_T, dim> &theOffset,
+			vec_T theScale = 1) :
+			shape<vec_T, color_T, time_T, dim>(),
+			assem(theAssembly),
+			scale(theScale),
+			offset(theOffset) {
+		assert(assem != 0);
+		assert(scale > 0);
+		for (int i = 0; i < dim; i++) {
+			rot[i] = mvector<vec_T, dim>();
+			rot[i][i] = 1;
+		}
+	}
+
+	/**
+	 * Sets the rotation to the given angle around the given axis. Only
+	 * available in 3D.
+	 *
+	 * @param axis Axis of rotation, which doesn't need to be normalized.
+	 * @param angle Angle in radians, counterclockwise when looking down the
+	 *   axis towards the origin.
+	 */
+	void setRotation(const mvector<vec_T, dim> &axis, vec_T angle) {
+		assert(dim == 3);
+		mvector<vec_T, dim> k = axis.norm();
+		vec_T c = cos(angle), s = sin(angle);
+		// Rodrigues' formula, row by row.
+		for (int i = 0; i < dim; i++) {
+			for (int j = 0; j < dim; j++)
+				rot[i][j] = (1 - c) * k[i] * k[j];
+			rot[i][i] += c;
+		}
+		rot[0][1] -= s * k[2];
+		rot[0][2] += s * k[1];
+		rot[1][0] += s * k[2];
+		rot[1][2] -= s * k[0];
+		rot[2][0] -= s * k[1];
+		rot[2][1] += s * k[0];
+	}
+
+	/**
+	 * Gets the placed assembly.
+	 *
+	 * @return The assembly.
+	 */
+	const sp_assembly& getAssembly() const {
+		return assem;
+	}
+
+	/**
+	 * Gets the earliest time at which the given ray hits a shape of the
+	 * assembly, or @c RAY_MISS .
+	 *
+	 * @param r The ray.
+	 *
+	 * @return The time of the closest hit.
+	 */
+	time_T intersection(const ray<vec_T, time_T, dim> &r) const {
+		time_T t;
+		if (assem->closestHit(toLocal(r), t) == 0)
+			return RAY_MISS;
+		return (time_T) (t * scale);
+	}
+
+	/**
+	 * Fills in a hit record for a hit found by @c intersection with the
+	 * shape of the assembly that was hit and its normal in world
+	 * coordinates.
+	 *
+	 * @param r The ray.
+	 * @param[in,out] rec The record, whose @c t is the time of the hit.
+	 */
+	void completeHit(const ray<vec_T, time_T, dim> &r,
+			hitrecord<vec_T, color_T, time_T, dim> &rec) const {
+		ray<vec_T, time_T, dim> local = toLocal(r);
+		hitrecord<vec_T, color_T, time_T, dim> localRec;
+		const shape<vec_T, color_T, time_T, dim> *hit =
+				assem->closestHit(local, localRec.t);
+		if (hit == 0) {
+			shape<vec_T, color_T, time_T, dim>::completeHit(r, rec);
+			return;
+		}
+		hit->completeHit(local, localRec);
+		rec.point = r.getPointAtT(rec.t);
+		rec.normal = rotate(localRec.normal);
+		rec.obj = localRec.obj;
+	}
+
+	/**
+	 * Gets the surface normal at the given point on the first shape of the
+	 * assembly whose box contains it. Shading goes through @c completeHit ,
+	 * which knows the ray and doesn't have to guess.
+	 *
+	 * @param surfacePt The point at which to get a surface normal.
+	 *
+	 * @return The surface normal.
+	 */
+	mvector<vec_T, dim> surfaceNorm(
+			const mvector<vec_T, dim> &surfacePt) const {
+		mvector<vec_T, dim> localPt = unrotate(surfacePt - offset) / scale;
+		const std::vector<typename assembly<vec_T, color_T, time_T,
+				dim>::sp_shape> &shapes = assem->getShapes();
+		for (size_t i = 0; i < shapes.size(); i++) {
+			aabb<vec_T, dim> box;
+			shapes[i]->getBounds(box);
+			bool inside = true;
+			for (int j = 0; j < dim; j++)
+				inside = inside && localPt[j] >= box.getMin()[j] &&
+						localPt[j] <= box.getMax()[j];
+			if (inside)
+				return rotate(shapes[i]->surfaceNorm(localPt));
+		}
+		mvector<vec_T, dim> up;
+		up[dim - 1] = 1;
+		return up;
+	}
+
+	/**
+	 * Gets the box around the transformed corners of the assembly's box.
+	 *
+	 * @param[out] box Receives the bounding box.
+	 *
+	 * @return @c true unless the assembly is empty.
+	 */
+	bool getBounds(aabb<vec_T, dim> &box) const {
+		const aabb<vec_T, dim> &local = assem->getBounds();
+		if (local.isEmpty())
+			return false;
+		box = aabb<vec_T, dim>();
+		for (int c = 0; c < (1 << dim); c++) {
+			mvector<vec_T, dim> corner;
+			for (int i = 0; i < dim; i++)
+				corner[i] = (c >> i) & 1 ? local.getMax()[i] :
+						local.getMin()[i];
+			box.extend(rotate(corner) * scale + offset);
+		}
+		return true;
+	}
+
+	/**
+	 * Print helper function.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printHelper(std::ostream &os) const {
+		os << "[instance. offset: " << offset << ", scale: " << scale <<
+				", shapes: " << assem->getShapes().size() << "]";
+	}
+};
+
+typedef assembly<double, double, double, 3> assembly3d;
+typedef assembly<double, double, float, 3> assembly3ddf;
+typedef assembly<float, float, float, 3> assembly3f;
+typedef boost::shared_ptr<assembly3d> sp_assembly3d;
+typedef boost::shared_ptr<assembly3ddf> sp_assembly3ddf;
+typedef boost::shared_ptr<assembly3f> sp_assembly3f;
+typedef instance<double, double, double, 3> instance3d;
+typedef instance<double, double, float, 3> instance3ddf;
+typedef instance<float, float, float, 3> instance3f;
+
+#endif // INSTANCE_HH
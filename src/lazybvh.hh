@@ -0,0 +1,487 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "accelerator.hh"
+#include "bvh.hh"
+#include "aabb.hh"
+#include "shape.hh"
+#include "shapekind.hh"
+#include "ray.hh"
+#include "parallel.hh"
+#include "boost/shared_ptr.hpp"
+#include "boost/atomic.hpp"
+#include "boost/noncopyable.hpp"
+#include "boost/scoped_array.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/locks.hpp"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <vector>
+#include <ostream>
+
+#ifndef LAZYBVH_HH
+#define LAZYBVH_HH
+
+/**
+ * Depth down to which a @c lazybvh is built up front by default. Below it
+ * are at most 2 to this power subtrees built on demand.
+ */
+#define LAZYBVH_EAGER_DEPTH 8
+
+/**
+ * A bounding volume hierarchy whose top levels are built up front, by the
+ * binned SAH of @c bvh , and whose deeper subtrees are only built the first
+ * time a ray enters them. For one view of a huge scene, most of which is
+ * hidden or off screen, the shapes no ray gets near cost just their bounds.
+ * Queries may build subtrees from several threads at once: each one is
+ * built under a lock of its own by the first thread to need it and
+ * published with an atomic pointer, so the others only ever wait for the
+ * subtree they're entering. The results are the same as with a @c bvh
+ * built with the SAH.
+ *
+ * The tree can't be refit, saved or read, since parts of it may not exist.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class lazybvh : public accelerator<vec_T, color_T, time_T, dim>,
+		private boost::noncopyable {
+public:
+
+	/**
+	 * Boost shared pointer typedef for shapes.
+	 */
+	typedef typename accelerator<vec_T, color_T, time_T, dim>::sp_shape
+		sp_shape;
+
+private:
+
+	typedef bvh<vec_T, color_T, time_T, dim> bvh_T;
+
+	/**
+	 * Build data of a shape, as for a @c bvh .
+	 */
+	typedef typename bvh_T::buildprim buildprim;
+
+	/**
+	 * A node as a @c bvh lays it out, except that the @c offset of an
+	 * interior node is how many nodes after it its right child comes, so
+	 * that a subtree can be walked without knowing which array it's in, and
+	 * that a @c count of -1 marks a subtree not built yet, whose number is
+	 * the @c offset .
+	 */
+	typedef typename bvh_T::flatnode flatnode;
+
+	/**
+	 * A subtree built on demand. Its nodes are laid out depth first from
+	 * its root; its leaves refer to @c primIndices like those of the top.
+	 */
+	struct subtree : private boost::noncopyable {
+		/** Entries of @c primIndices the subtree covers. */
+		int start, end;
+		/** Depth of its root in the whole tree. */
+		int depth;
+		/** The nodes once built, or null. */
+		boost::atomic<std::vector<flatnode> *> nodes;
+		/** Held while building the nodes. */
+		boost::mutex lock;
+
+		subtree() : start(0), end(0), depth(0), nodes(0) { }
+
+		~subtree() {
+			delete nodes.load(boost::memory_order_relaxed);
+		}
+	};
+
+	/**
+	 * Raw pointers to the shapes passed to @c build . The scene owns them.
+	 */
+	std::vector<const shape<vec_T, color_T, time_T, dim> *> prims;
+
+	/**
+	 * The @c shapeKind of each of @c prims .
+	 */
+	std::vector<shapeKind> primKinds;
+
+	/**
+	 * Build data parallel to @c prims , kept for building subtrees.
+	 */
+	std::vector<buildprim> buildPrims;
+
+	/**
+	 * Indices into @c prims ordered so that every leaf owns a contiguous
+	 * range. The ranges of subtrees not built yet are reordered by whoever
+	 * builds them, which nothing else reads until then.
+	 */
+	mutable std::vector<int> primIndices;
+
+	/**
+	 * The nodes built up front, depth first from the root.
+	 */
+	std::vector<flatnode> top;
+
+	/**
+	 * The subtrees below the top, by number.
+	 */
+	boost::scoped_array<subtree> subtrees;
+
+	/**
+	 * Number of @c subtrees .
+	 */
+	int subtreeCount;
+
+	/**
+	 * Number of subtrees built so far.
+	 */
+	mutable boost::atomic<int> builtCount;
+
+	/**
+	 * Depth down to which the tree is built up front.
+	 */
+	int eagerDepth;
+
+	/**
+	 * Number of threads @c build may use to gather bounds.
+	 */
+	int numThreads;
+
+	/**
+	 * Appends the tree over @c primIndices[start, end) to the given nodes
+	 * depth first, leaving the ranges at @c lazyDepth with more shapes than
+	 * fit in a leaf to be built later. Subtrees found are described in
+	 * @c ranges as their start, end and depth.
+	 *
+	 * @param out The nodes.
+	 * @param start First entry of the range.
+	 * @param end One past the last entry of the range.
+	 * @param depth Depth of the node over the range in the whole tree.
+	 * @param lazyDepth Depth at which to stop, or -1 to build it all.
+	 * @param ranges Receives the subtrees left to build, unless
+	 *   @c lazyDepth is -1.
+	 *
+	 * @return Index of the range's node in @c out .
+	 */
+	int grow(std::vector<flatnode> &out, int start, int end, int depth,
+			int lazyDepth, std::vector<int> *ranges) const {
+		int idx = (int) out.size();
+		out.push_back(flatnode());
+		aabb<vec_T, dim> box;
+		int mid;
+		if (depth == lazyDepth && end - start > BVH_MAX_LEAF) {
+			for (int i = start; i < end; i++)
+				box.extend(buildPrims[primIndices[i]].box);
+			mid = -2;
+		}
+		else {
+			mid = bvh_T::splitRange(buildPrims, primIndices, start, end,
+					depth, box);
+		}
+		for (int i = 0; i < dim; i++) {
+			out[idx].lo[i] = bvh_T::roundDown(box.getMin()[i]);
+			out[idx].hi[i] = bvh_T::roundUp(box.getMax()[i]);
+		}
+		if (mid == -2) {
+			out[idx].offset = (int) ranges->size() / 3;
+			out[idx].count = -1;
+			ranges->push_back(start);
+			ranges->push_back(end);
+			ranges->push_back(depth);
+		}
+		else if (mid < 0) {
+			out[idx].offset = start;
+			out[idx].count = end - start;
+		}
+		else {
+			grow(out, start, mid, depth + 1, lazyDepth, ranges);
+			int right = grow(out, mid, end, depth + 1, lazyDepth, ranges);
+			out[idx].offset = right - idx;
+			out[idx].count = 0;
+		}
+		return idx;
+	}
+
+	/**
+	 * Gets the root of a subtree, building the subtree first if no thread
+	 * has yet.
+	 *
+	 * @param s Number of the subtree.
+	 *
+	 * @return The root.
+	 */
+	const flatnode* expand(int s) const {
+		subtree &st = subtrees[s];
+		std::vector<flatnode> *nodes =
+				st.nodes.load(boost::memory_order_acquire);
+		if (nodes)
+			return &(*nodes)[0];
+		boost::lock_guard<boost::mutex> guard(st.lock);
+		nodes = st.nodes.load(boost::memory_order_relaxed);
+		if (!nodes) {
+			nodes = new std::vector<flatnode>();
+			grow(*nodes, st.start, st.end, st.depth, -1, 0);
+			st.nodes.store(nodes, boost::memory_order_release);
+			builtCount++;
+		}
+		return &(*nodes)[0];
+	}
+
+	/**
+	 * Gets the node a ray visits in place of the given one: the root of
+	 * the subtree it stands for if it's one not built yet, or else itself.
+	 */
+	const flatnode* resolve(const flatnode *n) const {
+		while (n->count < 0)
+			n = expand(n->offset);
+		return n;
+	}
+
+	/**
+	 * Intersects the ray with the shape @c prims[i] .
+	 */
+	time_T intersectPrim(int i, const ray<vec_T, time_T, dim> &r) const {
+		return shapedispatch<vec_T, color_T, time_T, dim>::intersection(
+				primKinds[i], prims[i], r);
+	}
+
+	/**
+	 * Discards the tree and the shapes.
+	 */
+	void clear() {
+		prims.clear();
+		primKinds.clear();
+		buildPrims.clear();
+		primIndices.clear();
+		top.clear();
+		subtrees.reset();
+		subtreeCount = 0;
+		builtCount = 0;
+	}
+
+public:
+
+	/**
+	 * Constructs an empty hierarchy. Call @c build before querying it.
+	 *
+	 * @param eagerDepth Depth down to which the tree is built up front; 0
+	 *   builds just the root.
+	 * @param numThreads Number of threads @c build may use to gather the
+	 *   bounds of the shapes.
+	 */
+	lazybvh(int eagerDepth = LAZYBVH_EAGER_DEPTH, int numThreads = 1) :
+			subtreeCount(0), builtCount(0), eagerDepth(eagerDepth),
+			numThreads(numThreads) {
+		assert(eagerDepth >= 0 && numThreads > 0);
+	}
+
+	/**
+	 * Gathers the bounds of the shapes and builds the top of the tree over
+	 * them, discarding whatever was built before.
+	 *
+	 * @param shapes The shapes, which must outlive this hierarchy.
+	 */
+	void build(const std::vector<sp_shape> &shapes) {
+		clear();
+		int n = (int) shapes.size();
+		buildPrims.resize(n);
+		for (int i = 0; i < n; i++) {
+			prims.push_back(shapes[i].get());
+			primKinds.push_back(shapedispatch<vec_T, color_T, time_T, dim>::
+					kindOf(prims.back()));
+			primIndices.push_back(i);
+		}
+		typename bvh_T::boundsStep bs;
+		bs.shapes = &shapes;
+		bs.bp = &buildPrims;
+		parallelFor(0, n, numThreads, bs);
+		if (n == 0)
+			return;
+
+		std::vector<int> ranges;
+		grow(top, 0, n, 0, std::min(eagerDepth, BVH_MAX_DEPTH - 2), &ranges);
+		subtreeCount = (int) ranges.size() / 3;
+		subtrees.reset(new subtree[subtreeCount]);
+		for (int s = 0; s < subtreeCount; s++) {
+			subtrees[s].start = ranges[3 * s];
+			subtrees[s].end = ranges[3 * s + 1];
+			subtrees[s].depth = ranges[3 * s + 2];
+		}
+	}
+
+	/**
+	 * Finds the closest shape hit by the given ray by walking the tree front
+	 * to back, building the subtrees it enters.
+	 *
+	 * @param r The ray.
+	 * @param[out] tIntersect The time of the hit or @c RAY_MISS .
+	 *
+	 * @return Index of the shape that was hit or -1 if there was no hit.
+	 */
+	int closestHit(const ray<vec_T, time_T, dim> &r,
+			time_T &tIntersect) const {
+		int best = -1;
+		time_T tBest = RAY_MISS;
+
+		if (!top.empty()) {
+			rayquery<vec_T, time_T, dim> q(r);
+			time_T tnear;
+			time_T tmax = q.getTMax();
+			const flatnode *stack[BVH_MAX_DEPTH];
+			int sp = 0;
+			if (q.slabs(top[0].lo, top[0].hi, tmax, tnear))
+				stack[sp++] = &top[0];
+			while (sp > 0) {
+				const flatnode *n = resolve(stack[--sp]);
+				time_T limit = best < 0 ? tmax : tBest;
+				if (n->count > 0) {
+					for (int i = n->offset; i < n->offset + n->count; i++) {
+						int p = primIndices[i];
+						time_T t = intersectPrim(p, r);
+						if (t != RAY_MISS && t > 0 && (best < 0 || t < tBest)) {
+							tBest = t;
+							best = p;
+						}
+					}
+					continue;
+				}
+				const flatnode *left = n + 1, *right = n + n->offset;
+				time_T tl, tr;
+				bool hitl = q.slabs(left->lo, left->hi, limit, tl);
+				bool hitr = q.slabs(right->lo, right->hi, limit, tr);
+				assert(sp + 2 <= BVH_MAX_DEPTH);
+				// Push the farther child first so the nearer one is popped
+				// and visited first.
+				if (hitl && hitr) {
+					if (tl < tr) {
+						stack[sp++] = right;
+						stack[sp++] = left;
+					}
+					else {
+						stack[sp++] = left;
+						stack[sp++] = right;
+					}
+				}
+				else if (hitl) {
+					stack[sp++] = left;
+				}
+				else if (hitr) {
+					stack[sp++] = right;
+				}
+			}
+		}
+
+		tIntersect = tBest;
+		return best;
+	}
+
+	/**
+	 * Checks if any shape blocks the given ray before @c tmax , building the
+	 * subtrees it enters. The walk stops at the first hit.
+	 *
+	 * @param r The ray.
+	 * @param tmax Hits at or beyond this time are ignored.
+	 *
+	 * @return Index of a shape that blocks the ray before @c tmax or -1.
+	 */
+	int anyHit(const ray<vec_T, time_T, dim> &r, time_T tmax) const {
+		if (top.empty())
+			return -1;
+
+		rayquery<vec_T, time_T, dim> q(r, 0, tmax);
+		time_T tnear;
+		const flatnode *stack[BVH_MAX_DEPTH];
+		int sp = 0;
+		stack[sp++] = &top[0];
+		while (sp > 0) {
+			const flatnode *n = stack[--sp];
+			if (!q.slabs(n->lo, n->hi, tmax, tnear))
+				continue;
+			n = resolve(n);
+			if (n->count > 0) {
+				for (int i = n->offset; i < n->offset + n->count; i++) {
+					int p = primIndices[i];
+					time_T t = intersectPrim(p, r);
+					if (t != RAY_MISS && t > 0 && t < tmax)
+						return p;
+				}
+				continue;
+			}
+			assert(sp + 2 <= BVH_MAX_DEPTH);
+			stack[sp++] = n + n->offset;
+			stack[sp++] = n + 1;
+		}
+		return -1;
+	}
+
+	/**
+	 * Gets the number of subtrees below the top.
+	 *
+	 * @return Subtree count.
+	 */
+	int getSubtreeCount() const {
+		return subtreeCount;
+	}
+
+	/**
+	 * Gets the number of subtrees built so far.
+	 *
+	 * @return Count of built subtrees.
+	 */
+	int getBuiltCount() const {
+		return builtCount;
+	}
+
+	/**
+	 * Gets the number of nodes built so far.
+	 *
+	 * @return Node count.
+	 */
+	int getNodeCount() const {
+		size_t count = top.size();
+		for (int s = 0; s < subtreeCount; s++) {
+			const std::vector<flatnode> *nodes =
+					subtrees[s].nodes.load(boost::memory_order_acquire);
+			if (nodes)
+				count += nodes->size();
+		}
+		return (int) count;
+	}
+
+	/**
+	 * Gets the number of bytes taken by the nodes built so far, the shape
+	 * lists and the bounds kept for building the rest.
+	 *
+	 * @return Memory footprint in bytes.
+	 */
+	size_t getMemoryUsage() const {
+		return getNodeCount() * sizeof(flatnode) + subtreeCount *
+				sizeof(subtree) + primIndices.size() * sizeof(int) +
+				prims.size() * (sizeof(prims[0]) + sizeof(primKinds[0]) +
+				sizeof(buildprim));
+	}
+
+	/**
+	 * Prints the size of this hierarchy.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printHelper(std::ostream &os) const {
+		os << "[lazy bvh. nodes: " << getNodeCount() << ", subtrees: " <<
+				getBuiltCount() << " of " << subtreeCount << " built, shapes: "
+				<< prims.size() << "]";
+	}
+};
+
+typedef lazybvh<double, double, double, 3> lazybvh3d;
+typedef lazybvh<double, double, float, 3> lazybvh3ddf;
+typedef lazybvh<float, float, float, 3> lazybvh3f;
+typedef boost::shared_ptr<lazybvh3d> sp_lazybvh3d;
+typedef boost::shared_ptr<lazybvh3ddf> sp_lazybvh3ddf;
+typedef boost::shared_ptr<lazybvh3f> sp_lazybvh3f;
+
+#endif // LAZYBVH_HH
@@ -0,0 +1,311 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "shape.hh"
+#include "instance.hh"
+#include "aabb.hh"
+#include "ray.hh"
+#include "hitrecord.hh"
+#include "mvector.hh"
+#include "boost/shared_ptr.hpp"
+#include "boost/atomic.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/locks.hpp"
+#include <cassert>
+#include <string>
+#include <vector>
+#include <ostream>
+
+#ifndef LAZYGEOMETRY_HH
+#define LAZYGEOMETRY_HH
+
+/**
+ * Where a @c lazygeometry gets its shapes from, such as a file.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class geometrysource {
+public:
+
+	/**
+	 * Does nothing here but might need to be defined in subclasses.
+	 */
+	virtual ~geometrysource() { }
+
+	/**
+	 * Adds the shapes to an empty assembly, which is finalized afterwards.
+	 * It's called at most once, but from whichever thread first needs the
+	 * shapes.
+	 *
+	 * @param assem The assembly.
+	 * @param[out] error Receives what went wrong, if anything.
+	 *
+	 * @return @c false if the shapes couldn't be had.
+	 */
+	virtual bool load(assembly<vec_T, color_T, time_T, dim> &assem,
+			std::string &error) const = 0;
+
+	/**
+	 * Prints a short description of this source.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	virtual void printHelper(std::ostream &os) const = 0;
+};
+
+/**
+ * A shape standing for a group of shapes that are only loaded, and their
+ * hierarchy only built, when a ray first gets into a box given up front
+ * around them. The scene's hierarchy holds just the box, so parts of a
+ * large scene that no ray reaches cost neither the time to load them nor
+ * the memory. Rays from any number of threads may arrive first; one loads
+ * the shapes while the others wait. A source that fails leaves the shape
+ * empty, and @c getError says why.
+ *
+ * The shapes must fit inside the box, which is all the scene knows about
+ * them; parts outside it may be missed. They keep their own coordinates,
+ * and hits are reported on them as for an @c instance .
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class lazygeometry : public shape<vec_T, color_T, time_T, dim> {
+public:
+
+	/**
+	 * Boost shared pointer typedef for sources.
+	 */
+	typedef boost::shared_ptr<geometrysource<vec_T, color_T, time_T, dim> >
+		sp_source;
+
+	/**
+	 * Boost shared pointer typedef for assemblies.
+	 */
+	typedef boost::shared_ptr<assembly<vec_T, color_T, time_T, dim> >
+		sp_assembly;
+
+	/**
+	 * Boost shared pointer typedef for shapes.
+	 */
+	typedef typename assembly<vec_T, color_T, time_T, dim>::sp_shape sp_shape;
+
+	/**
+	 * What a @c lazygeometry has done with its source.
+	 */
+	enum loadState {
+		/** The source hasn't been asked yet. */
+		GEOMETRY_UNLOADED,
+		/** The shapes are loaded and their hierarchy built. */
+		GEOMETRY_LOADED,
+		/** The source failed. */
+		GEOMETRY_FAILED
+	};
+
+private:
+
+	/**
+	 * Where the shapes come from.
+	 */
+	sp_source source;
+
+	/**
+	 * The box around the shapes given up front.
+	 */
+	aabb<vec_T, dim> box;
+
+	/**
+	 * The @c loadState , read without @c loadLock once it isn't
+	 * @c GEOMETRY_UNLOADED .
+	 */
+	mutable boost::atomic<int> state;
+
+	/**
+	 * Held while the source loads, so rays that arrive meanwhile wait.
+	 */
+	mutable boost::mutex loadLock;
+
+	/**
+	 * The shapes once they're loaded.
+	 */
+	mutable sp_assembly assem;
+
+	/**
+	 * Why the source failed.
+	 */
+	mutable std::string error;
+
+	/**
+	 * Loads the shapes if no thread has yet.
+	 *
+	 * @return The shapes, or 0 if the source failed.
+	 */
+	const assembly<vec_T, color_T, time_T, dim>* shapes() const {
+		int s = state.load(boost::memory_order_acquire);
+		if (s == GEOMETRY_UNLOADED) {
+			boost::lock_guard<boost::mutex> guard(loadLock);
+			s = state.load(boost::memory_order_relaxed);
+			if (s == GEOMETRY_UNLOADED) {
+				sp_assembly a(new assembly<vec_T, color_T, time_T, dim>());
+				if (source->load(*a, error)) {
+					a->finalize();
+					assem = a;
+					s = GEOMETRY_LOADED;
+				}
+				else {
+					s = GEOMETRY_FAILED;
+				}
+				state.store(s, boost::memory_order_release);
+			}
+		}
+		return s == GEOMETRY_LOADED ? assem.get() : 0;
+	}
+
+public:
+
+	/**
+	 * Constructs the shape without loading anything.
+	 *
+	 * @param theSource Where the shapes come from.
+	 * @param theBox A box around all the shapes.
+	 */
+	lazygeometry(const sp_source &theSource,
+			const aabb<vec_T, dim> &theBox) :
+			shape<vec_T, color_T, time_T, dim>(), source(theSource),
+			box(theBox), state(GEOMETRY_UNLOADED) {
+		assert(source != 0);
+		assert(!box.isEmpty());
+	}
+
+	/**
+	 * Tells what has been done with the source so far.
+	 *
+	 * @return The @c loadState .
+	 */
+	loadState getState() const {
+		return (loadState) state.load(boost::memory_order_acquire);
+	}
+
+	/**
+	 * Gets why the source failed.
+	 *
+	 * @return The message, which is empty unless the state is
+	 *   @c GEOMETRY_FAILED .
+	 */
+	std::string getError() const {
+		return getState() == GEOMETRY_FAILED ? error : std::string();
+	}
+
+	/**
+	 * Gets the source.
+	 *
+	 * @return The source.
+	 */
+	const sp_source& getSource() const {
+		return source;
+	}
+
+	/**
+	 * Gets the earliest time at which the given ray hits one of the shapes,
+	 * loading them first if needed.
+	 *
+	 * @param r The ray.
+	 *
+	 * @return The time of the closest hit or @c RAY_MISS .
+	 */
+	time_T intersection(const ray<vec_T, time_T, dim> &r) const {
+		const assembly<vec_T, color_T, time_T, dim> *a = shapes();
+		time_T t;
+		if (a == 0 || a->closestHit(r, t) == 0)
+			return RAY_MISS;
+		return t;
+	}
+
+	/**
+	 * Fills in a hit record for a hit found by @c intersection with the
+	 * shape that was hit.
+	 *
+	 * @param r The ray.
+	 * @param[in,out] rec The record, whose @c t is the time of the hit.
+	 */
+	void completeHit(const ray<vec_T, time_T, dim> &r,
+			hitrecord<vec_T, color_T, time_T, dim> &rec) const {
+		const assembly<vec_T, color_T, time_T, dim> *a = shapes();
+		time_T t;
+		const shape<vec_T, color_T, time_T, dim> *hit =
+				a != 0 ? a->closestHit(r, t) : 0;
+		if (hit == 0) {
+			shape<vec_T, color_T, time_T, dim>::completeHit(r, rec);
+			return;
+		}
+		hit->completeHit(r, rec);
+	}
+
+	/**
+	 * Gets the surface normal at the given point on the first shape whose
+	 * box contains it. Shading goes through @c completeHit , which knows
+	 * the ray and doesn't have to guess.
+	 *
+	 * @param surfacePt The point at which to get a surface normal.
+	 *
+	 * @return The surface normal.
+	 */
+	mvector<vec_T, dim> surfaceNorm(
+			const mvector<vec_T, dim> &surfacePt) const {
+		const assembly<vec_T, color_T, time_T, dim> *a = shapes();
+		if (a != 0) {
+			const std::vector<sp_shape> &list = a->getShapes();
+			for (size_t i = 0; i < list.size(); i++) {
+				aabb<vec_T, dim> b;
+				list[i]->getBounds(b);
+				bool inside = true;
+				for (int j = 0; j < dim; j++)
+					inside = inside && surfacePt[j] >= b.getMin()[j] &&
+							surfacePt[j] <= b.getMax()[j];
+				if (inside)
+					return list[i]->surfaceNorm(surfacePt);
+			}
+		}
+		mvector<vec_T, dim> up;
+		up[dim - 1] = 1;
+		return up;
+	}
+
+	/**
+	 * Gets the box given up front, without loading anything.
+	 *
+	 * @param[out] theBox Receives the bounding box.
+	 *
+	 * @return @c true .
+	 */
+	bool getBounds(aabb<vec_T, dim> &theBox) const {
+		theBox = box;
+		return true;
+	}
+
+	/**
+	 * Print helper function.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printHelper(std::ostream &os) const {
+		static const char *states[] = { "unloaded", "loaded", "failed" };
+		os << "[lazy geometry. source: ";
+		source->printHelper(os);
+		os << ", " << states[getState()] << "]";
+	}
+};
+
+typedef lazygeometry<double, double, double, 3> lazygeometry3d;
+typedef lazygeometry<double, double, float, 3> lazygeometry3ddf;
+typedef lazygeometry<float, float, float, 3> lazygeometry3f;
+
+#endif // LAZYGEOMETRY_HH
@@ -6,15 +6,81 @@
 #include "sceneobj.hh"
 #include "ray.hh"
 #include "mvector.hh"
+#include "boost/atomic.hpp"
 #include "boost/shared_ptr.hpp"
 #include "rgbcolor.hh"
+#include "aabb.hh"
 #include <ostream>
 
 #ifndef LIGHT_HH
 #define LIGHT_HH
 
 /**
- * Represents a light as a position and a color.
+ * What one sample of a light contributes to a shading point; see
+ * @c light::sample .
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, int dim>
+struct lightsample {
+
+	/**
+	 * Position the light arrives from.
+	 */
+	mvector<vec_T, dim> pos;
+
+	/**
+	 * Unit vector from the shading point towards @c pos .
+	 */
+	mvector<vec_T, dim> dir;
+
+	/**
+	 * Distance from the shading point to @c pos .
+	 */
+	vec_T dist;
+
+	/**
+	 * Color the sample adds, before the surface's color and the cosine
+	 * factor.
+	 */
+	rgbcolor<color_T> color;
+};
+
+/**
+ * A light sample that light picking may choose to shade, with what it would
+ * add if it weren't blocked; see @c scene::setLightPicks .
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, int dim>
+struct lightcandidate {
+
+	/**
+	 * The sample.
+	 */
+	lightsample<vec_T, color_T, dim> sample;
+
+	/**
+	 * Shadow cache slot of its light.
+	 */
+	int slot;
+
+	/**
+	 * Sum over the channels of its color times the surface's color and the
+	 * cosine factor, more than 0.
+	 */
+	color_T estimate;
+};
+
+/**
+ * Represents a light as a position and a color. This is also the interface
+ * through which a scene shades with every kind of light: a light is
+ * sampled one or more times per shading point with @c sample , and each
+ * sample says where the light comes from and with which color.
  *
  * @tparam vec_T The type of the vector components. Many arithmetic and
  *   relational operators must be supported. The type will likely be double,
@@ -98,6 +164,96 @@ public:
 	 */
 	void setPos(const mvector<vec_T, dim> &other) {
 		pos = other;
+		getEditCounter()++;
+	}
+
+	/**
+	 * Sets the color of this light, like @c sceneobj::setColor , and counts
+	 * the edit for @c getEditCount .
+	 *
+	 * @param color Color.
+	 */
+	void setColor(const rgbcolor<color_T> &color) {
+		sceneobj<vec_T, color_T, time_T, dim>::setColor(color);
+		getEditCounter()++;
+	}
+
+	/**
+	 * Gets the number of times the position or color of any light has been
+	 * set through the setters of this class, so that copies of them, like
+	 * the arrays of a @c lightpack , can tell when they're out of date.
+	 *
+	 * @return The count so far.
+	 */
+	static unsigned getEditCount() {
+		return getEditCounter().load();
+	}
+
+	/**
+	 * Gets the number of samples to take of this light per shading point.
+	 * Point lights need only one.
+	 *
+	 * @param defaultCount The renderer's count for lights that don't have
+	 *   their own.
+	 *
+	 * @return Sample count.
+	 */
+	virtual int getSampleCount(int defaultCount) const {
+		return 1;
+	}
+
+	/**
+	 * Samples this light for the given shading point.
+	 *
+	 * @param X The shading point.
+	 * @param i Index of the sample.
+	 * @param n Number of samples, as returned by @c getSampleCount .
+	 * @param[out] s Receives the sample.
+	 *
+	 * @return @c false if this light doesn't reach @c X at all.
+	 */
+	virtual bool sample(const mvector<vec_T, dim> &X, int i, int n,
+			lightsample<vec_T, color_T, dim> &s) const {
+		s.pos = pos;
+		s.dir = pos - X;
+		s.dist = s.dir.mag();
+		s.dir = s.dir.norm();
+		s.color = this->getColor();
+		return true;
+	}
+
+	/**
+	 * Gets the box around every position this light can be sampled at.
+	 *
+	 * @param[out] box Receives the box.
+	 */
+	virtual void getBounds(aabb<vec_T, dim> &box) const {
+		box = aabb<vec_T, dim>();
+		box.extend(pos);
+	}
+
+	/**
+	 * Checks if this light may light some point in the given box, for
+	 * culling lights for whole screen tiles at once. It must only return
+	 * @c false if @c sample would reject every point in the box. Point lights
+	 * light everything in front of them, so they can't rule out any box.
+	 *
+	 * @param box Box around the shading points.
+	 *
+	 * @return @c false if none of the points can be lit.
+	 */
+	virtual bool mayLight(const aabb<vec_T, dim> &box) const {
+		return true;
+	}
+
+	/**
+	 * Checks if this light only depends on its position and color, so that
+	 * a group of such lights far away can be shaded as one.
+	 *
+	 * @return @c true for plain point lights.
+	 */
+	virtual bool canCluster() const {
+		return true;
 	}
 
 	/**
@@ -109,6 +265,17 @@ public:
 		sceneobj<vec_T, color_T, time_T, dim>::printHelper(os);
 		os << " ---> [light. position: " << pos << "]";
 	}
+
+private:
+
+	/**
+	 * Gets the counter behind @c getEditCount , shared by all lights of
+	 * this type.
+	 */
+	static boost::atomic<unsigned>& getEditCounter() {
+		static boost::atomic<unsigned> edits(0);
+		return edits;
+	}
 };
 
 typedef light<double, double, double, 3> lightd;
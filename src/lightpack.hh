@@ -0,0 +1,492 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "light.hh"
+#include "simd.hh"
+#include <cassert>
+#include <cmath>
+#include <typeinfo>
+#include <vector>
+
+#ifndef LIGHTPACK_HH
+#define LIGHTPACK_HH
+
+/**
+ * Works out the direction, distance and facing of one light of a
+ * @c lightpack for a shading point, with the arithmetic of @c light::sample
+ * and of the cosine factor of @c scene::prepareShadowRay . This is the
+ * kernel of @c SIMD_SCALAR and of types without SIMD kernels; see
+ * @c lightlanes .
+ *
+ * @param pos The arrays of the light coordinates, one per axis.
+ * @param i Index of the light.
+ * @param X The shading point.
+ * @param N The unit normal at the shading point.
+ * @param[out] dist Receives the distance to the light.
+ * @param[out] dir The arrays that receive the components of the unit
+ *   vector towards the light, one per axis.
+ *
+ * @return 1 unless the light is behind the surface.
+ */
+template<typename vec_T, int dim>
+int facingScalar(const vec_T *const *pos, int i, const vec_T *X,
+		const vec_T *N, vec_T *dist, vec_T *const *dir) {
+	vec_T w[dim], magSq = 0, LdotN = 0;
+	for (int a = 0; a < dim; a++) {
+		w[a] = pos[a][i] - X[a];
+		magSq += w[a] * w[a];
+	}
+	dist[0] = sqrt(magSq);
+	for (int a = 0; a < dim; a++) {
+		dir[a][0] = w[a] / dist[0];
+		LdotN += dir[a][0] * N[a];
+	}
+	return !(LdotN <= 0) ? 1 : 0;
+}
+
+/**
+ * Batch light tests for @c lightpack , in the instruction set picked at run
+ * time by @c activeSimdLevel . Each kernel works out a group of consecutive
+ * lights at once and does exactly the arithmetic of @c facingScalar in
+ * every lane, so the samples are bit for bit those of @c light::sample .
+ * This generic version only has the scalar kernel; there are
+ * specializations for doubles and floats.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam dim The number of dimensions.
+ */
+template<typename vec_T, int dim>
+struct lightlanes {
+
+	/**
+	 * Largest group any kernel works out at once. The arrays of a pack need
+	 * this many slots minus one of padding.
+	 */
+	static const int maxWidth = 1;
+
+	/**
+	 * Works out the lights of the group that starts at @c i , as
+	 * @c facingScalar does for one.
+	 *
+	 * @param level The instruction set to use.
+	 * @param pos The arrays of the light coordinates, one per axis.
+	 * @param i Index of the first light of the group.
+	 * @param X The shading point.
+	 * @param N The unit normal at the shading point.
+	 * @param[out] dist Receives the distance to each light of the group.
+	 * @param[out] dir The arrays that receive the components of the unit
+	 *   vector towards each light of the group, one per axis.
+	 * @param[out] width Receives the width of the kernel.
+	 *
+	 * @return The bit mask of the lights that aren't behind the surface.
+	 */
+	static int facing(simdLevel level, const vec_T *const *pos, int i,
+			const vec_T *X, const vec_T *N, vec_T *dist, vec_T *const *dir,
+			int &width) {
+		width = 1;
+		return facingScalar<vec_T, dim>(pos, i, X, N, dist, dir);
+	}
+};
+
+#ifdef SIMD_DISPATCH
+
+/**
+ * @c lightlanes for doubles, 2, 4 or 8 lights at a time with SSE2, AVX2 or
+ * AVX-512.
+ */
+template<int dim>
+struct lightlanes<double, dim> {
+	static const int maxWidth = 8;
+
+	/** The SSE2 kernel of @c facing . */
+	static int facing128(const double *const *pos, int i, const double *X,
+			const double *N, double *dist, double *const *dir) {
+		__m128d w[dim], magSq = _mm_setzero_pd(), LdotN = _mm_setzero_pd();
+		for (int a = 0; a < dim; a++) {
+			w[a] = _mm_sub_pd(_mm_loadu_pd(pos[a] + i), _mm_set1_pd(X[a]));
+			magSq = _mm_add_pd(magSq, _mm_mul_pd(w[a], w[a]));
+		}
+		__m128d d = _mm_sqrt_pd(magSq);
+		_mm_storeu_pd(dist, d);
+		for (int a = 0; a < dim; a++) {
+			__m128d u = _mm_div_pd(w[a], d);
+			_mm_storeu_pd(dir[a], u);
+			LdotN = _mm_add_pd(LdotN, _mm_mul_pd(u, _mm_set1_pd(N[a])));
+		}
+		return _mm_movemask_pd(_mm_cmpnle_pd(LdotN, _mm_setzero_pd()));
+	}
+
+	/** The AVX2 kernel of @c facing . */
+	__attribute__((target("avx2")))
+	static int facing256(const double *const *pos, int i, const double *X,
+			const double *N, double *dist, double *const *dir) {
+		__m256d w[dim], magSq = _mm256_setzero_pd(),
+				LdotN = _mm256_setzero_pd();
+		for (int a = 0; a < dim; a++) {
+			w[a] = _mm256_sub_pd(_mm256_loadu_pd(pos[a] + i),
+					_mm256_set1_pd(X[a]));
+			magSq = _mm256_add_pd(magSq, _mm256_mul_pd(w[a], w[a]));
+		}
+		__m256d d = _mm256_sqrt_pd(magSq);
+		_mm256_storeu_pd(dist, d);
+		for (int a = 0; a < dim; a++) {
+			__m256d u = _mm256_div_pd(w[a], d);
+			_mm256_storeu_pd(dir[a], u);
+			LdotN = _mm256_add_pd(LdotN, _mm256_mul_pd(u,
+					_mm256_set1_pd(N[a])));
+		}
+		return _mm256_movemask_pd(_mm256_cmp_pd(LdotN, _mm256_setzero_pd(),
+				_CMP_NLE_UQ));
+	}
+
+	/** The AVX-512 kernel of @c facing . */
+	__attribute__((target("avx512f")))
+	static int facing512(const double *const *pos, int i, const double *X,
+			const double *N, double *dist, double *const *dir) {
+		__m512d w[dim], magSq = _mm512_setzero_pd(),
+				LdotN = _mm512_setzero_pd();
+		for (int a = 0; a < dim; a++) {
+			w[a] = _mm512_sub_pd(_mm512_loadu_pd(pos[a] + i),
+					_mm512_set1_pd(X[a]));
+			magSq = _mm512_add_pd(magSq, _mm512_mul_pd(w[a], w[a]));
+		}
+		__m512d d = _mm512_sqrt_pd(magSq);
+		_mm512_storeu_pd(dist, d);
+		for (int a = 0; a < dim; a++) {
+			__m512d u = _mm512_div_pd(w[a], d);
+			_mm512_storeu_pd(dir[a], u);
+			LdotN = _mm512_add_pd(LdotN, _mm512_mul_pd(u,
+					_mm512_set1_pd(N[a])));
+		}
+		return _mm512_cmp_pd_mask(LdotN, _mm512_setzero_pd(), _CMP_NLE_UQ);
+	}
+
+	/** Runs the kernel of the given level; see @c lightlanes::facing . */
+	static int facing(simdLevel level, const double *const *pos, int i,
+			const double *X, const double *N, double *dist,
+			double *const *dir, int &width) {
+		switch (level) {
+		case SIMD_AVX512:
+			width = 8;
+			return facing512(pos, i, X, N, dist, dir);
+		case SIMD_AVX2:
+			width = 4;
+			return facing256(pos, i, X, N, dist, dir);
+		case SIMD_SSE2:
+			width = 2;
+			return facing128(pos, i, X, N, dist, dir);
+		default:
+			width = 1;
+			return facingScalar<double, dim>(pos, i, X, N, dist, dir);
+		}
+	}
+};
+
+/**
+ * @c lightlanes for floats, 4, 8 or 16 lights at a time with SSE2, AVX2 or
+ * AVX-512.
+ */
+template<int dim>
+struct lightlanes<float, dim> {
+	static const int maxWidth = 16;
+
+	/** The SSE2 kernel of @c facing . */
+	static int facing128(const float *const *pos, int i, const float *X,
+			const float *N, float *dist, float *const *dir) {
+		__m128 w[dim], magSq = _mm_setzero_ps(), LdotN = _mm_setzero_ps();
+		for (int a = 0; a < dim; a++) {
+			w[a] = _mm_sub_ps(_mm_loadu_ps(pos[a] + i), _mm_set1_ps(X[a]));
+			magSq = _mm_add_ps(magSq, _mm_mul_ps(w[a], w[a]));
+		}
+		__m128 d = _mm_sqrt_ps(magSq);
+		_mm_storeu_ps(dist, d);
+		for (int a = 0; a < dim; a++) {
+			__m128 u = _mm_div_ps(w[a], d);
+			_mm_storeu_ps(dir[a], u);
+			LdotN = _mm_add_ps(LdotN, _mm_mul_ps(u, _mm_set1_ps(N[a])));
+		}
+		return _mm_movemask_ps(_mm_cmpnle_ps(LdotN, _mm_setzero_ps()));
+	}
+
+	/** The AVX2 kernel of @c facing . */
+	__attribute__((target("avx2")))
+	static int facing256(const float *const *pos, int i, const float *X,
+			const float *N, float *dist, float *const *dir) {
+		__m256 w[dim], magSq = _mm256_setzero_ps(),
+				LdotN = _mm256_setzero_ps();
+		for (int a = 0; a < dim; a++) {
+			w[a] = _mm256_sub_ps(_mm256_loadu_ps(pos[a] + i),
+					_mm256_set1_ps(X[a]));
+			magSq = _mm256_add_ps(magSq, _mm256_mul_ps(w[a], w[a]));
+		}
+		__m256 d = _mm256_sqrt_ps(magSq);
+		_mm256_storeu_ps(dist, d);
+		for (int a = 0; a < dim; a++) {
+			__m256 u = _mm256_div_ps(w[a], d);
+			_mm256_storeu_ps(dir[a], u);
+			LdotN = _mm256_add_ps(LdotN, _mm256_mul_ps(u,
+					_mm256_set1_ps(N[a])));
+		}
+		return _mm256_movemask_ps(_mm256_cmp_ps(LdotN, _mm256_setzero_ps(),
+				_CMP_NLE_UQ));
+	}
+
+	/** The AVX-512 kernel of @c facing . */
+	__attribute__((target("avx512f")))
+	static int facing512(const float *const *pos, int i, const float *X,
+			const float *N, float *dist, float *const *dir) {
+		__m512 w[dim], magSq = _mm512_setzero_ps(),
+				LdotN = _mm512_setzero_ps();
+		for (int a = 0; a < dim; a++) {
+			w[a] = _mm512_sub_ps(_mm512_loadu_ps(pos[a] + i),
+					_mm512_set1_ps(X[a]));
+			magSq = _mm512_add_ps(magSq, _mm512_mul_ps(w[a], w[a]));
+		}
+		__m512 d = _mm512_sqrt_ps(magSq);
+		_mm512_storeu_ps(dist, d);
+		for (int a = 0; a < dim; a++) {
+			__m512 u = _mm512_div_ps(w[a], d);
+			_mm512_storeu_ps(dir[a], u);
+			LdotN = _mm512_add_ps(LdotN, _mm512_mul_ps(u,
+					_mm512_set1_ps(N[a])));
+		}
+		return _mm512_cmp_ps_mask(LdotN, _mm512_setzero_ps(), _CMP_NLE_UQ);
+	}
+
+	/** Runs the kernel of the given level; see @c lightlanes::facing . */
+	static int facing(simdLevel level, const float *const *pos, int i,
+			const float *X, const float *N, float *dist, float *const *dir,
+			int &width) {
+		switch (level) {
+		case SIMD_AVX512:
+			width = 16;
+			return facing512(pos, i, X, N, dist, dir);
+		case SIMD_AVX2:
+			width = 8;
+			return facing256(pos, i, X, N, dist, dir);
+		case SIMD_SSE2:
+			width = 4;
+			return facing128(pos, i, X, N, dist, dir);
+		default:
+			width = 1;
+			return facingScalar<float, dim>(pos, i, X, N, dist, dir);
+		}
+	}
+};
+
+#endif // SIMD_DISPATCH
+
+/**
+ * The lights of a scene with the point lights among them stored as a
+ * structure of arrays: one array per axis of positions and one per
+ * channel of colors, so that the directions towards several lights and
+ * which of them face a shading point can be worked out at once with
+ * @c lightlanes , before any shadow ray is traced. Every light gets a slot,
+ * in the order it was added, so slots are the indices of the scene's
+ * lights. Only lights that are exactly @c light s are packed; slots of
+ * spotlights, sampled area lights and other subclasses are sampled on their
+ * own by the caller. The pack is a copy of the lights as they were when
+ * they were added; @c isCurrent tells if any light has been edited since.
+ * Note that there are some convenient typedefs in this file.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class lightpack {
+public:
+
+	typedef lightlanes<vec_T, dim> lanes;
+
+	/**
+	 * What @c facing works out for a group of lights, to be turned into
+	 * samples with @c getSample .
+	 */
+	struct group {
+		/** Distance to each light of the group. */
+		vec_T dist[lanes::maxWidth];
+		/** Unit vectors towards the lights, one array per axis. */
+		vec_T dir[dim][lanes::maxWidth];
+	};
+
+private:
+
+	/**
+	 * Positions of the slots, one array per axis. The arrays have
+	 * @c lanes::maxWidth - 1 slots of padding at the end so the last slots
+	 * can be loaded a whole lane group at a time.
+	 */
+	std::vector<vec_T> pos[dim];
+
+	/**
+	 * Red, green and blue of the slots.
+	 */
+	std::vector<color_T> color[3];
+
+	/**
+	 * Whether each slot holds a packed point light.
+	 */
+	std::vector<char> packed;
+
+	/**
+	 * Number of packed slots.
+	 */
+	int packedCount;
+
+	/**
+	 * The @c light::getEditCount of the lights as the pack holds them.
+	 */
+	unsigned edits;
+
+public:
+
+	/**
+	 * Constructs an empty pack.
+	 */
+	lightpack() : packedCount(0),
+			edits(light<vec_T, color_T, time_T, dim>::getEditCount()) {
+		for (int a = 0; a < dim; a++)
+			pos[a].assign(lanes::maxWidth - 1, 0);
+	}
+
+	/**
+	 * Removes all slots.
+	 */
+	void clear() {
+		*this = lightpack<vec_T, color_T, time_T, dim>();
+	}
+
+	/**
+	 * Adds a slot for the given light, with its position and color as they
+	 * are now.
+	 *
+	 * @param l The light.
+	 */
+	void add(const light<vec_T, color_T, time_T, dim> *l) {
+		bool point = typeid(*l) == typeid(light<vec_T, color_T, time_T, dim>);
+		// Move the padding out of the way.
+		for (int a = 0; a < dim; a++) {
+			pos[a].resize(size());
+			pos[a].push_back(point ? l->getPos()[a] : 0);
+			pos[a].resize(size() + lanes::maxWidth, 0);
+		}
+		const rgbcolor<color_T> &c = l->getColor();
+		color[0].push_back(c.getR());
+		color[1].push_back(c.getG());
+		color[2].push_back(c.getB());
+		packed.push_back(point ? 1 : 0);
+		packedCount += point ? 1 : 0;
+	}
+
+	/**
+	 * Gets the number of slots.
+	 *
+	 * @return Slot count.
+	 */
+	int size() const {
+		return (int) packed.size();
+	}
+
+	/**
+	 * Gets the number of slots that hold point lights.
+	 *
+	 * @return Point light count.
+	 */
+	int getPackedCount() const {
+		return packedCount;
+	}
+
+	/**
+	 * Checks if no light has been moved or recolored since the pack was
+	 * made, so its slots still hold the positions and colors of the lights.
+	 *
+	 * @return @c false if the pack should be made again.
+	 */
+	bool isCurrent() const {
+		return edits == light<vec_T, color_T, time_T, dim>::getEditCount();
+	}
+
+	/**
+	 * Checks whether the given slot holds a packed point light.
+	 *
+	 * @param i The slot.
+	 *
+	 * @return @c true for point lights.
+	 */
+	bool isPacked(int i) const {
+		return packed[i] != 0;
+	}
+
+	/**
+	 * Works out the direction and distance of the group of lights that
+	 * starts at slot @c i to a shading point and which of them are in
+	 * front of the surface there. Slots past the end and unpacked slots
+	 * hold nothing meaningful and must be ignored.
+	 *
+	 * @param level The instruction set to use.
+	 * @param i The first slot of the group.
+	 * @param X The shading point.
+	 * @param N The unit normal at the shading point.
+	 * @param[out] g Receives the directions and distances.
+	 * @param[out] width Receives the number of slots in the group.
+	 *
+	 * @return The bit mask of the slots whose lights aren't behind the
+	 *   surface.
+	 */
+	int facing(simdLevel level, int i, const mvector<vec_T, dim> &X,
+			const mvector<vec_T, dim> &N, group &g, int &width) const {
+		assert(i >= 0 && i < size());
+		vec_T P[dim], D[dim];
+		const vec_T *p[dim];
+		vec_T *dir[dim];
+		for (int a = 0; a < dim; a++) {
+			P[a] = X[a];
+			D[a] = N[a];
+			p[a] = &pos[a][0];
+			dir[a] = g.dir[a];
+		}
+		return lanes::facing(level, p, i, P, D, g.dist, dir, width);
+	}
+
+	/**
+	 * Makes the sample of a packed point light from what @c facing worked
+	 * out, the same as the light's own @c sample would.
+	 *
+	 * @param i The slot.
+	 * @param g The group worked out by @c facing .
+	 * @param k The lane of the slot in the group.
+	 * @param[out] s Receives the sample.
+	 */
+	void getSample(int i, const group &g, int k,
+			lightsample<vec_T, color_T, dim> &s) const {
+		assert(isPacked(i) && k >= 0 && k < lanes::maxWidth);
+		for (int a = 0; a < dim; a++) {
+			s.pos[a] = pos[a][i];
+			s.dir[a] = g.dir[a][k];
+		}
+		s.dist = g.dist[k];
+		s.color = rgbcolor<color_T>::unchecked(color[0][i], color[1][i],
+				color[2][i]);
+	}
+
+	/**
+	 * Gets the number of bytes taken by the slots, not counting the few of
+	 * padding.
+	 *
+	 * @return Memory footprint in bytes.
+	 */
+	size_t getMemoryUsage() const {
+		return packed.size() * (dim * sizeof(vec_T) + 3 * sizeof(color_T) +
+				sizeof(char));
+	}
+};
+
+typedef lightpack<double, double, double, 3> lightpack3d;
+typedef lightpack<double, double, float, 3> lightpack3ddf;
+typedef lightpack<float, float, float, 3> lightpack3f;
+
+#endif // LIGHTPACK_HH
@@ -0,0 +1,510 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "aabb.hh"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+#include <ostream>
+
+#ifndef LIGHTTREE_HH
+#define LIGHTTREE_HH
+
+/**
+ * Largest number of lights the build will put into one leaf.
+ */
+#define LIGHTTREE_MAX_LEAF 4
+
+/**
+ * Deepest tree the traversal stack can handle. Median splits keep the tree
+ * balanced, so this covers any number of lights that fits in an int.
+ */
+#define LIGHTTREE_MAX_DEPTH 64
+
+/**
+ * Largest number of lights and clusters @c lighttree::cut refines a cut
+ * into, whatever its error.
+ */
+#define LIGHTTREE_MAX_CUT 1000
+
+/**
+ * A hierarchy over the bounds of a scene's lights, used while shading to
+ * skip lights that can't contribute. Lights only light the side of a surface
+ * they are on, so every subtree whose box lies entirely behind the
+ * tangent plane of the shading point is skipped at once. Optionally, a
+ * subtree whose box is small compared to its distance is treated as one
+ * cluster light at a representative position with the summed color of its
+ * lights, as in lightcuts (Walter et al. 2005); see @c collect and, for
+ * clusters picked by an error bound instead, @c cut . Lights are
+ * referred to by their index in the collection the tree was built over.
+ * Note that there are some convenient typedefs in this file.
+ *
+ * @tparam vec_T The type of the vector components. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double,
+ *   float, or int.
+ * @tparam time_T The type of the time. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double or
+ *   float, but int would likely work.
+ * @tparam color_T The type of the @c rgbcolor. Many arithmetic
+ *   and relational operators must be supported, including real number ones.
+ *   The type will likely be double or float.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class lighttree {
+private:
+
+	/**
+	 * A node of the tree. Nodes are laid out depth first, so the left child
+	 * of an interior node comes right after it.
+	 */
+	struct node {
+		/** Lower corner of the box around the lights below this node. */
+		mvector<vec_T, dim> lo;
+		/** Upper corner of the box around the lights below this node. */
+		mvector<vec_T, dim> hi;
+		/** Summed color of the lights below this node. */
+		rgbcolor<color_T> color;
+		/** Position of the representative light of the cluster. */
+		mvector<vec_T, dim> repPos;
+		/** Index of the representative light of the cluster. */
+		int rep;
+		/** Whether all lights below this node may be clustered. */
+		bool clusterable;
+		/** First entry of @c order below this node. */
+		int first;
+		/** Number of lights below this node. */
+		int num;
+		/**
+		 * Index of the right child for interior nodes; first entry of
+		 * @c order for leaves.
+		 */
+		int offset;
+		/** Number of lights in this leaf, 0 for interior nodes. */
+		int count;
+	};
+
+	/**
+	 * Functor that orders lights along one axis of the centers of their
+	 * boxes.
+	 */
+	struct axisLess {
+		const std::vector<mvector<vec_T, dim> > *pos;
+		int axis;
+
+		bool operator()(int a, int b) const {
+			return (*pos)[a][axis] < (*pos)[b][axis];
+		}
+	};
+
+	/**
+	 * A cluster of a cut being refined, ordered by its error bound so that
+	 * the worst one is at the top of a heap.
+	 */
+	struct cutEntry {
+		/** Upper bound of what the cluster's lights can add. */
+		color_T bound;
+		/** What the cluster is estimated to add. */
+		color_T estimate;
+		/** The node of the cluster. */
+		int node;
+
+		bool operator<(const cutEntry &other) const {
+			return bound < other.bound;
+		}
+	};
+
+	/**
+	 * The tree in depth-first order. Element 0 is the root.
+	 */
+	std::vector<node> nodes;
+
+	/**
+	 * Light indices ordered so that every leaf owns a contiguous range.
+	 */
+	std::vector<int> order;
+
+	/**
+	 * Sum of the color components, used to compare brightness.
+	 */
+	static color_T power(const rgbcolor<color_T> &c) {
+		return c.getR() + c.getG() + c.getB();
+	}
+
+	/**
+	 * Recursively builds the subtree over @c order[start, end) .
+	 *
+	 * @return Index of the subtree's root.
+	 */
+	int buildRecursive(const std::vector<aabb<vec_T, dim> > &boxes,
+			const std::vector<mvector<vec_T, dim> > &pos,
+			const std::vector<rgbcolor<color_T> > &colors,
+			const std::vector<bool> &canCluster, int start, int end,
+			int depth) {
+		int idx = (int) nodes.size();
+		nodes.push_back(node());
+		node n;
+		n.lo = boxes[order[start]].getMin();
+		n.hi = boxes[order[start]].getMax();
+		n.rep = order[start];
+		n.clusterable = true;
+		n.first = start;
+		n.num = end - start;
+		for (int i = start; i < end; i++) {
+			int l = order[i];
+			for (int a = 0; a < dim; a++) {
+				n.lo[a] = std::min(n.lo[a], boxes[l].getMin()[a]);
+				n.hi[a] = std::max(n.hi[a], boxes[l].getMax()[a]);
+			}
+			n.color += colors[l];
+			n.clusterable = n.clusterable && canCluster[l];
+		}
+
+		if (end - start <= LIGHTTREE_MAX_LEAF ||
+				depth >= LIGHTTREE_MAX_DEPTH - 2) {
+			for (int i = start; i < end; i++)
+				if (power(colors[order[i]]) > power(colors[n.rep]))
+					n.rep = order[i];
+			n.repPos = pos[n.rep];
+			n.offset = start;
+			n.count = end - start;
+			nodes[idx] = n;
+			return idx;
+		}
+
+		// Split at the median center along the longest axis.
+		axisLess less;
+		less.pos = &pos;
+		less.axis = 0;
+		for (int a = 1; a < dim; a++)
+			if (n.hi[a] - n.lo[a] > n.hi[less.axis] - n.lo[less.axis])
+				less.axis = a;
+		int mid = start + (end - start) / 2;
+		std::nth_element(order.begin() + start, order.begin() + mid,
+				order.begin() + end, less);
+
+		int left = buildRecursive(boxes, pos, colors, canCluster, start, mid,
+				depth + 1);
+		int right = buildRecursive(boxes, pos, colors, canCluster, mid, end,
+				depth + 1);
+		// The brighter child's representative stands for both.
+		n.rep = power(nodes[left].color) >= power(nodes[right].color) ?
+				nodes[left].rep : nodes[right].rep;
+		n.repPos = pos[n.rep];
+		n.offset = right;
+		n.count = 0;
+		nodes[idx] = n;
+		return idx;
+	}
+
+	/**
+	 * Works out what the lights below a node can add to a shading point,
+	 * as the summed power of their colors times the cosine factor. The
+	 * estimate takes the cosine at the representative light; the bound
+	 * takes the largest the box allows, from the farthest the box reaches
+	 * in front of the plane and its distance from @c X .
+	 *
+	 * @param n The node.
+	 * @param X The shading point.
+	 * @param N The unit normal at @c X .
+	 * @param[out] estimate Receives the estimate.
+	 * @param[out] bound Receives the bound.
+	 *
+	 * @return @c false if the box is entirely behind the plane.
+	 */
+	static bool cutBounds(const node &n, const mvector<vec_T, dim> &X,
+			const mvector<vec_T, dim> &N, color_T &estimate, color_T &bound) {
+		vec_T maxDot = 0, distSq = 0;
+		for (int a = 0; a < dim; a++) {
+			maxDot += std::max((n.lo[a] - X[a]) * N[a],
+					(n.hi[a] - X[a]) * N[a]);
+			vec_T d = std::max(n.lo[a] - X[a],
+					std::max((vec_T) 0, X[a] - n.hi[a]));
+			distSq += d * d;
+		}
+		if (maxDot < 0)
+			return false;
+		color_T p = power(n.color);
+		vec_T dist = sqrt(distSq);
+		bound = dist > 0 && maxDot < dist ? p * (color_T) (maxDot / dist) : p;
+		mvector<vec_T, dim> v = n.repPos - X;
+		vec_T len = v.mag();
+		estimate = len > 0 ? p * (color_T) std::max((vec_T) 0, v * N / len) :
+				p;
+		return true;
+	}
+
+	/**
+	 * Adds a node to a cut that's being refined. Nodes entirely behind the
+	 * plane are dropped. Lights that may not be clustered, and clusters of
+	 * a single light, are added to @c lights right away, opening the nodes
+	 * above them as needed; any other node goes on the heap.
+	 *
+	 * @param idx The node.
+	 * @param X The shading point.
+	 * @param N The unit normal at @c X .
+	 * @param[in,out] heap The clusters of the cut, as a heap.
+	 * @param[in,out] total The estimate of the whole cut.
+	 * @param[in,out] lights The lights of the cut.
+	 */
+	void addToCut(int idx, const mvector<vec_T, dim> &X,
+			const mvector<vec_T, dim> &N, std::vector<cutEntry> &heap,
+			color_T &total, std::vector<int> &lights) const {
+		int stack[LIGHTTREE_MAX_DEPTH];
+		int sp = 0;
+		stack[sp++] = idx;
+		while (sp > 0) {
+			const node &n = nodes[stack[--sp]];
+			cutEntry e;
+			e.node = stack[sp];
+			if (!cutBounds(n, X, N, e.estimate, e.bound))
+				continue;
+			if (!n.clusterable && n.count == 0) {
+				assert(sp + 2 <= LIGHTTREE_MAX_DEPTH);
+				stack[sp++] = n.offset;
+				stack[sp++] = e.node + 1;
+				continue;
+			}
+			total += e.estimate;
+			if (!n.clusterable || n.num == 1) {
+				lights.insert(lights.end(), order.begin() + n.first,
+						order.begin() + n.first + n.num);
+				continue;
+			}
+			heap.push_back(e);
+			std::push_heap(heap.begin(), heap.end());
+		}
+	}
+
+public:
+
+	/**
+	 * Builds the tree over the given lights, discarding whatever was built
+	 * before.
+	 *
+	 * @param boxes Boxes around every position each light lights from,
+	 *   which for point lights are just their positions.
+	 * @param colors Colors of the lights.
+	 * @param canCluster Whether each light may be merged into a cluster, in
+	 *   which case its box must be a point. Lights whose contribution depends
+	 *   on more than their position and color, like spotlights, can't be.
+	 */
+	void build(const std::vector<aabb<vec_T, dim> > &boxes,
+			const std::vector<rgbcolor<color_T> > &colors,
+			const std::vector<bool> &canCluster) {
+		assert(boxes.size() == colors.size() &&
+				boxes.size() == canCluster.size());
+		nodes.clear();
+		order.resize(boxes.size());
+		std::vector<mvector<vec_T, dim> > pos(boxes.size());
+		for (int i = 0; i < (int) order.size(); i++) {
+			order[i] = i;
+			pos[i] = boxes[i].centroid();
+		}
+		if (!order.empty())
+			buildRecursive(boxes, pos, colors, canCluster, 0,
+					(int) order.size(), 0);
+	}
+
+	/**
+	 * Finds the lights that may light the given point. Subtrees whose box
+	 * lies entirely behind the plane through @c X with normal @c N are
+	 * skipped. If @c clusterRatio is positive, then a subtree of clusterable
+	 * lights that lies entirely in front of the plane, and whose box diagonal
+	 * is less than @c clusterRatio times its distance from @c X , is
+	 * reported as a cluster instead of its lights, trading accuracy for
+	 * speed.
+	 *
+	 * @param X The shading point.
+	 * @param N The surface normal at @c X .
+	 * @param clusterRatio Largest ratio of box size to distance at which
+	 *   lights are clustered, or 0 to never cluster.
+	 * @param[out] lights Receives the indices of the lights, in no
+	 *   particular order, or all of them if none were ruled out. Anything in
+	 *   it is discarded.
+	 * @param[out] clusters Receives the nodes to be shaded as cluster lights;
+	 *   see @c getClusterPos and @c getClusterColor . Anything in it is
+	 *   discarded.
+	 */
+	void collect(const mvector<vec_T, dim> &X, const mvector<vec_T, dim> &N,
+			vec_T clusterRatio, std::vector<int> &lights,
+			std::vector<int> &clusters) const {
+		lights.clear();
+		clusters.clear();
+		if (nodes.empty())
+			return;
+
+		int stack[LIGHTTREE_MAX_DEPTH];
+		int sp = 0;
+		stack[sp++] = 0;
+		while (sp > 0) {
+			int idx = stack[--sp];
+			const node &n = nodes[idx];
+
+			// Range of (p - X) . N over the box.
+			vec_T maxDot = 0, minDot = 0, distSq = 0, diagSq = 0;
+			for (int a = 0; a < dim; a++) {
+				vec_T dlo = (n.lo[a] - X[a]) * N[a];
+				vec_T dhi = (n.hi[a] - X[a]) * N[a];
+				maxDot += std::max(dlo, dhi);
+				minDot += std::min(dlo, dhi);
+				vec_T d = std::max(n.lo[a] - X[a],
+						std::max((vec_T) 0, X[a] - n.hi[a]));
+				distSq += d * d;
+				diagSq += (n.hi[a] - n.lo[a]) * (n.hi[a] - n.lo[a]);
+			}
+			if (maxDot < 0)
+				continue;
+			if (clusterRatio > 0 && n.clusterable && minDot > 0 &&
+					diagSq < clusterRatio * clusterRatio * distSq) {
+				clusters.push_back(idx);
+				continue;
+			}
+			// Without clustering, every light below a node that's entirely in
+			// front is a candidate.
+			if (n.count > 0 || (minDot > 0 && clusterRatio <= 0)) {
+				lights.insert(lights.end(), order.begin() + n.first,
+						order.begin() + n.first + n.num);
+				continue;
+			}
+			assert(sp + 2 <= LIGHTTREE_MAX_DEPTH);
+			stack[sp++] = n.offset;
+			stack[sp++] = idx + 1;
+		}
+	}
+
+	/**
+	 * Finds a lightcut for the given point: lights to shade on their own and
+	 * clusters to shade as one light each, which between them account for
+	 * every light that isn't entirely behind the plane through @c X with
+	 * normal @c N . Starting from the root, the cluster with the largest
+	 * error bound is split until every cluster's bound is at most
+	 * @c relError times the estimate of the whole cut, or the cut holds
+	 * @c LIGHTTREE_MAX_CUT entries. Bright and nearby groups are so split
+	 * down to their lights while dim and far away ones stay clustered, and
+	 * the size of the cut grows much more slowly than the number of lights.
+	 * The bounds leave out the surface color and visibility, which only
+	 * make a cluster add less.
+	 *
+	 * @param X The shading point.
+	 * @param N The unit normal at @c X .
+	 * @param relError Largest error bound of a cluster relative to the
+	 *   whole cut, e.g. 0.02.
+	 * @param[out] lights Receives the indices of the lights, in no
+	 *   particular order. Anything in it is discarded.
+	 * @param[out] clusters Receives the nodes to be shaded as cluster lights,
+	 *   as for @c collect . Anything in it is discarded.
+	 */
+	void cut(const mvector<vec_T, dim> &X, const mvector<vec_T, dim> &N,
+			vec_T relError, std::vector<int> &lights,
+			std::vector<int> &clusters) const {
+		lights.clear();
+		clusters.clear();
+		if (nodes.empty())
+			return;
+
+		std::vector<cutEntry> heap;
+		color_T total = 0;
+		addToCut(0, X, N, heap, total, lights);
+		while (!heap.empty() &&
+				(int) (lights.size() + heap.size()) < LIGHTTREE_MAX_CUT &&
+				heap.front().bound > (color_T) relError * total) {
+			cutEntry e = heap.front();
+			std::pop_heap(heap.begin(), heap.end());
+			heap.pop_back();
+			const node &n = nodes[e.node];
+			if (n.count > 0) {
+				// A leaf is split into its lights.
+				lights.insert(lights.end(), order.begin() + n.first,
+						order.begin() + n.first + n.num);
+				continue;
+			}
+			total -= e.estimate;
+			addToCut(e.node + 1, X, N, heap, total, lights);
+			addToCut(n.offset, X, N, heap, total, lights);
+		}
+		for (size_t i = 0; i < heap.size(); i++)
+			clusters.push_back(heap[i].node);
+	}
+
+	/**
+	 * Gets the position of the representative light of a cluster.
+	 *
+	 * @param cluster A node reported by @c collect .
+	 *
+	 * @return The position.
+	 */
+	const mvector<vec_T, dim>& getClusterPos(int cluster) const {
+		return nodes[cluster].repPos;
+	}
+
+	/**
+	 * Gets the index of the representative light of a cluster.
+	 *
+	 * @param cluster A node reported by @c collect .
+	 *
+	 * @return Index of the light.
+	 */
+	int getClusterRep(int cluster) const {
+		return nodes[cluster].rep;
+	}
+
+	/**
+	 * Gets the summed color of the lights of a cluster.
+	 *
+	 * @param cluster A node reported by @c collect .
+	 *
+	 * @return The color.
+	 */
+	const rgbcolor<color_T>& getClusterColor(int cluster) const {
+		return nodes[cluster].color;
+	}
+
+	/**
+	 * Gets the number of lights the tree was built over.
+	 *
+	 * @return Light count.
+	 */
+	int getLightCount() const {
+		return (int) order.size();
+	}
+
+	/**
+	 * Gets the number of nodes in the tree.
+	 *
+	 * @return Node count.
+	 */
+	int getNodeCount() const {
+		return (int) nodes.size();
+	}
+
+	/**
+	 * Gets the number of bytes taken by the nodes and the light order.
+	 *
+	 * @return Memory footprint in bytes.
+	 */
+	size_t getMemoryUsage() const {
+		return nodes.capacity() * sizeof(node) + order.capacity() * sizeof(int);
+	}
+
+	/**
+	 * Prints the size of this tree.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printHelper(std::ostream &os) const {
+		os << "[light tree. nodes: " << nodes.size() << ", lights: " <<
+				order.size() << "]";
+	}
+};
+
+typedef lighttree<double, double, double, 3> lighttree3d;
+typedef lighttree<double, double, float, 3> lighttree3ddf;
+typedef lighttree<float, float, float, 3> lighttree3f;
+
+#endif // LIGHTTREE_HH
@@ -0,0 +1,166 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "boost/noncopyable.hpp"
+#include <cassert>
+#include <cstddef>
+#include <string>
+
+#ifndef MAPPEDFILE_HH
+#define MAPPEDFILE_HH
+
+/**
+ * Defined when files can be mapped into memory with POSIX @c mmap .
+ */
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPPEDFILE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+/**
+ * A file of a fixed size mapped into memory for writing, so that threads
+ * can fill in their parts of it directly and the operating system writes
+ * the pages back in its own time. Whatever was written before a crash is
+ * in the file. Existing files can also be mapped for reading, so their
+ * contents are used where the page cache already has them instead of
+ * being copied. Without @c mmap , opening always fails.
+ */
+class mappedfile : private boost::noncopyable {
+private:
+
+	/**
+	 * The mapping, or 0 if no file is open.
+	 */
+	char *bytes;
+
+	/**
+	 * Size of the file in bytes.
+	 */
+	size_t length;
+
+public:
+
+	/**
+	 * Constructs an object with no file open.
+	 */
+	mappedfile() : bytes(0), length(0) { }
+
+	/**
+	 * Unmaps the file, which writes it back.
+	 */
+	~mappedfile() {
+		close();
+	}
+
+	/**
+	 * Creates or truncates a file, sizes it and maps all of it.
+	 *
+	 * @param path The file name.
+	 * @param size Size of the file in bytes, more than 0.
+	 *
+	 * @return @c false if the file couldn't be made or mapped.
+	 */
+	bool open(const std::string &path, size_t size) {
+		assert(size > 0);
+		close();
+#ifdef MAPPEDFILE_MMAP
+		int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+			return false;
+		if (ftruncate(fd, (off_t) size) != 0) {
+			::close(fd);
+			return false;
+		}
+		void *p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		// The mapping keeps the file open.
+		::close(fd);
+		if (p == MAP_FAILED)
+			return false;
+		bytes = static_cast<char *>(p);
+		length = size;
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	/**
+	 * Maps all of an existing file for reading only; writing to its bytes
+	 * is an error.
+	 *
+	 * @param path The file name.
+	 *
+	 * @return @c false if the file couldn't be opened or mapped or is
+	 *   empty.
+	 */
+	bool openRead(const std::string &path) {
+		close();
+#ifdef MAPPEDFILE_MMAP
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+			::close(fd);
+			return false;
+		}
+		size_t size = (size_t) st.st_size;
+		void *p = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED)
+			return false;
+		bytes = static_cast<char *>(p);
+		length = size;
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	/**
+	 * Unmaps the file, if one is open.
+	 */
+	void close() {
+#ifdef MAPPEDFILE_MMAP
+		if (bytes != 0)
+			munmap(bytes, length);
+#endif
+		bytes = 0;
+		length = 0;
+	}
+
+	/**
+	 * Gets the mapped bytes of the file.
+	 *
+	 * @return The first byte, or 0 if no file is open.
+	 */
+	char* data() {
+		return bytes;
+	}
+
+	/**
+	 * Gets the mapped bytes of the file.
+	 *
+	 * @return The first byte, or 0 if no file is open.
+	 */
+	const char* data() const {
+		return bytes;
+	}
+
+	/**
+	 * Gets the size of the file.
+	 *
+	 * @return Size in bytes, or 0 if no file is open.
+	 */
+	size_t size() const {
+		return length;
+	}
+};
+
+#endif // MAPPEDFILE_HH
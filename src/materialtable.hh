@@ -0,0 +1,155 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "rgbcolor.hh"
+#include "boost/cstdint.hpp"
+#include "boost/functional/hash.hpp"
+#include "boost/unordered_map.hpp"
+#include <cassert>
+#include <utility>
+#include <vector>
+
+#ifndef MATERIALTABLE_HH
+#define MATERIALTABLE_HH
+
+/**
+ * What shading reads of a surface: its color and reflectivity.
+ *
+ * @tparam color_T The type of the @c rgbcolor.
+ */
+template<typename color_T>
+struct material {
+	/** The color. */
+	rgbcolor<color_T> color;
+	/** Reflectivity between 0 and 1. */
+	float reflectivity;
+};
+
+/**
+ * The distinct materials of a scene, each stored once. Shapes hold an
+ * index into the table, so shading reads colors and reflectivities from
+ * one small array instead of from shapes scattered over the heap, and
+ * hits can be grouped by material.
+ *
+ * @tparam color_T The type of the @c rgbcolor.
+ */
+template<typename color_T>
+class materialtable {
+private:
+
+	/**
+	 * A color and reflectivity, to find the material of a new shape.
+	 */
+	struct materialkey {
+		color_T c[3];
+		float reflectivity;
+
+		bool operator==(const materialkey &other) const {
+			return c[0] == other.c[0] && c[1] == other.c[1] &&
+					c[2] == other.c[2] && reflectivity == other.reflectivity;
+		}
+	};
+
+	/**
+	 * Hashes a @c materialkey . A scene of a million shapes may have as
+	 * many materials, and hashing them is several times faster than
+	 * keeping them sorted.
+	 */
+	struct materialhash {
+		size_t operator()(const materialkey &k) const {
+			size_t h = 0;
+			for (int i = 0; i < 3; i++)
+				boost::hash_combine(h, k.c[i]);
+			boost::hash_combine(h, k.reflectivity);
+			return h;
+		}
+	};
+
+	typedef boost::unordered_map<materialkey, boost::uint32_t, materialhash>
+			indexmap;
+
+	/**
+	 * The distinct materials, in the order they were first added.
+	 */
+	std::vector<material<color_T> > materials;
+
+	/**
+	 * Index in @c materials of every color and reflectivity so far.
+	 */
+	indexmap materialIndex;
+
+public:
+
+	/**
+	 * Gets the index of the material of the given color and reflectivity,
+	 * adding it if the table doesn't have it yet.
+	 *
+	 * @param color The color.
+	 * @param reflectivity Reflectivity between 0 and 1.
+	 *
+	 * @return Index of the material.
+	 */
+	int add(const rgbcolor<color_T> &color, float reflectivity) {
+		materialkey key;
+		key.c[0] = color.getR();
+		key.c[1] = color.getG();
+		key.c[2] = color.getB();
+		key.reflectivity = reflectivity;
+		typename indexmap::iterator it = materialIndex.find(key);
+		if (it == materialIndex.end()) {
+			it = materialIndex.insert(std::make_pair(key,
+					(boost::uint32_t) materials.size())).first;
+			material<color_T> m;
+			m.color = color;
+			m.reflectivity = reflectivity;
+			materials.push_back(m);
+		}
+		return (int) it->second;
+	}
+
+	/**
+	 * Gets a material.
+	 *
+	 * @param i Index of the material, as returned by @c add .
+	 *
+	 * @return The material.
+	 */
+	const material<color_T>& operator[](int i) const {
+		assert(i >= 0 && i < (int) materials.size());
+		return materials[i];
+	}
+
+	/**
+	 * Gets the number of distinct materials.
+	 *
+	 * @return Material count.
+	 */
+	int size() const {
+		return (int) materials.size();
+	}
+
+	/**
+	 * Forgets all materials, so indices handed out before are invalid.
+	 */
+	void clear() {
+		materials.clear();
+		materialIndex.clear();
+	}
+
+	/**
+	 * Gets the memory taken by the materials and the index used to
+	 * deduplicate them.
+	 *
+	 * @return Size in bytes.
+	 */
+	size_t getMemoryUsage() const {
+		return materials.capacity() * sizeof(material<color_T>) +
+				materialIndex.bucket_count() * sizeof(void *) +
+				materialIndex.size() * (sizeof(materialkey) +
+				sizeof(boost::uint32_t) + 2 * sizeof(void *));
+	}
+};
+
+#endif // MATERIALTABLE_HH
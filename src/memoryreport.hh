@@ -0,0 +1,270 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "scene.hh"
+#include "sceneobj.hh"
+#include "shape.hh"
+#include "sphere.hh"
+#include "infplane.hh"
+#include "cylinder.hh"
+#include "trianglemesh.hh"
+#include "compactspheres.hh"
+#include "instance.hh"
+#include "motion.hh"
+#include "light.hh"
+#include "spotlight.hh"
+#include "arealight.hh"
+#include "arena.hh"
+#include "boost/make_shared.hpp"
+#include <ostream>
+#include <set>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#ifndef MEMORYREPORT_HH
+#define MEMORYREPORT_HH
+
+/**
+ * A line of a @c memoryreport : what takes memory, how many of it there
+ * are and the bytes they take together.
+ */
+struct memoryrow {
+	/** What takes the memory, e.g. "spheres". */
+	std::string what;
+	/** How many there are. */
+	size_t count;
+	/** Bytes they take together. */
+	size_t bytes;
+};
+
+/**
+ * The memory a render takes, broken down by what takes it, for
+ * @c --mem-report . Rows keep the order they were first added in, and
+ * adding to a row that's there already adds up.
+ */
+class memoryreport {
+private:
+
+	/**
+	 * The rows.
+	 */
+	std::vector<memoryrow> rows;
+
+public:
+
+	/**
+	 * Adds to a row, making it if it's new.
+	 *
+	 * @param what What takes the memory.
+	 * @param count How many more there are.
+	 * @param bytes Bytes they take together.
+	 */
+	void add(const std::string &what, size_t count, size_t bytes) {
+		for (size_t i = 0; i < rows.size(); i++)
+			if (rows[i].what == what) {
+				rows[i].count += count;
+				rows[i].bytes += bytes;
+				return;
+			}
+		memoryrow row = { what, count, bytes };
+		rows.push_back(row);
+	}
+
+	/**
+	 * Gets the rows.
+	 *
+	 * @return The rows in the order they were made.
+	 */
+	const std::vector<memoryrow>& getRows() const {
+		return rows;
+	}
+
+	/**
+	 * Gets the bytes of all rows.
+	 *
+	 * @return Total bytes.
+	 */
+	size_t getTotal() const {
+		size_t bytes = 0;
+		for (size_t i = 0; i < rows.size(); i++)
+			bytes += rows[i].bytes;
+		return bytes;
+	}
+
+	/**
+	 * Prints a line per row with its count, bytes and bytes of each, then
+	 * the total.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void print(std::ostream &os) const {
+		for (size_t i = 0; i < rows.size(); i++) {
+			os << "memory: " << rows[i].what << ": " << rows[i].count << ", " <<
+					rows[i].bytes << " bytes";
+			if (rows[i].count > 1)
+				os << " (" << (rows[i].bytes + rows[i].count / 2) /
+						rows[i].count << " each)";
+			os << std::endl;
+		}
+		os << "memory: total: " << getTotal() << " bytes (" <<
+				getTotal() / 1048576.0 << " MB)" << std::endl;
+	}
+};
+
+/**
+ * Works out the memory the shapes and lights of a scene take by their
+ * classes for a @c memoryreport . An object takes its size and the count
+ * block its shared pointer keeps with it in the scene's arena, which is
+ * measured once; what it holds on the heap is added for the classes that
+ * say, and buffers and assemblies shared by several objects are counted
+ * once. Classes not known here are counted at the size of a @c shape ,
+ * which is less than they take.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+class scenememory {
+private:
+
+	typedef shape<vec_T, color_T, time_T, 3> shape_t;
+	typedef sphere<vec_T, color_T, time_T, 3> sphere_t;
+	typedef infplane<vec_T, color_T, time_T, 3> infplane_t;
+	typedef cylinder<vec_T, color_T, time_T> cylinder_t;
+	typedef trianglemesh<vec_T, color_T, time_T> trianglemesh_t;
+	typedef compactspheres<vec_T, color_T, time_T> compact_t;
+	typedef instance<vec_T, color_T, time_T, 3> instance_t;
+	typedef motionshape<vec_T, color_T, time_T, 3> motion_t;
+	typedef light<vec_T, color_T, time_T, 3> light_t;
+	typedef spotlight<vec_T, color_T, time_T, 3> spotlight_t;
+	typedef arealight<vec_T, color_T, time_T, 3> arealight_t;
+	typedef sceneobj<vec_T, color_T, time_T, 3> sceneobj_t;
+
+	/**
+	 * Bytes an object takes in an arena besides its own size.
+	 */
+	size_t overhead;
+
+	/**
+	 * The buffers and assemblies counted so far.
+	 */
+	std::set<const void *> seen;
+
+public:
+
+	/**
+	 * Measures the count block of an object in an arena.
+	 */
+	scenememory() {
+		sp_arena probe(new arena());
+		boost::shared_ptr<sceneobj_t> obj = boost::allocate_shared<sceneobj_t>(
+				arenaallocator<sceneobj_t>(probe));
+		overhead = probe->getBytesAllocated() - sizeof(sceneobj_t);
+	}
+
+	/**
+	 * Adds a shape to its row.
+	 *
+	 * @param report The report.
+	 * @param s The shape.
+	 */
+	void addShape(memoryreport &report, const shape_t *s) {
+		const std::type_info &type = typeid(*s);
+		if (type == typeid(sphere_t)) {
+			report.add("spheres", 1, sizeof(sphere_t) + overhead);
+		}
+		else if (type == typeid(infplane_t)) {
+			report.add("planes", 1, sizeof(infplane_t) + overhead);
+		}
+		else if (type == typeid(cylinder_t)) {
+			report.add("cylinders", 1, sizeof(cylinder_t) + overhead);
+		}
+		else if (type == typeid(compact_t)) {
+			const compact_t *c = static_cast<const compact_t *>(s);
+			report.add("compact spheres", c->getSphereCount(),
+					sizeof(compact_t) + overhead + c->getMemoryUsage());
+		}
+		else if (type == typeid(trianglemesh_t)) {
+			const trianglemesh_t *m = static_cast<const trianglemesh_t *>(s);
+			report.add("meshes", 1, sizeof(trianglemesh_t) + overhead +
+					m->getMemoryUsage());
+			if (seen.insert(m->getBuffers().get()).second)
+				report.add("mesh buffers", 1,
+						m->getBuffers()->getMemoryUsage());
+		}
+		else if (type == typeid(motion_t)) {
+			report.add("moving shapes", 1, sizeof(motion_t) + overhead);
+			addShape(report,
+					static_cast<const motion_t *>(s)->getInner().get());
+		}
+		else if (type == typeid(instance_t)) {
+			const instance_t *inst = static_cast<const instance_t *>(s);
+			report.add("instances", 1, sizeof(instance_t) + overhead);
+			if (!seen.insert(inst->getAssembly().get()).second)
+				return;
+			report.add("assemblies", 1, inst->getAssembly()->getMemoryUsage());
+			for (size_t i = 0; i < inst->getAssembly()->getShapes().size(); i++)
+				addShape(report, inst->getAssembly()->getShapes()[i].get());
+		}
+		else {
+			report.add("other shapes", 1, sizeof(shape_t) + overhead);
+		}
+	}
+
+	/**
+	 * Adds a light, as it was added to the scene, to its row. An area
+	 * light's grid of point lights is counted with it.
+	 *
+	 * @param report The report.
+	 * @param l The light.
+	 */
+	void addLight(memoryreport &report, const light_t *l) {
+		const std::type_info &type = typeid(*l);
+		if (type == typeid(arealight_t)) {
+			const arealight_t *area = static_cast<const arealight_t *>(l);
+			report.add("area lights", 1, sizeof(arealight_t) + overhead +
+					area->getLights().capacity() *
+					sizeof(area->getLights()[0]) + area->getLights().size() *
+					(sizeof(light_t) + overhead));
+		}
+		else if (type == typeid(spotlight_t)) {
+			report.add("spot lights", 1, sizeof(spotlight_t) + overhead);
+		}
+		else if (type == typeid(light_t)) {
+			report.add("point lights", 1, sizeof(light_t) + overhead);
+		}
+		else {
+			report.add("other lights", 1, sizeof(light_t) + overhead);
+		}
+	}
+
+	/**
+	 * Adds the shapes, the accelerator and the lights of a finalized scene,
+	 * and the scene's lists of them.
+	 *
+	 * @param report The report.
+	 * @param sc The scene.
+	 */
+	void addScene(memoryreport &report,
+			const scene<vec_T, color_T, time_T, 3> &sc) {
+		for (size_t i = 0; i < sc.getShapes().size(); i++)
+			addShape(report, sc.getShapes()[i].get());
+		report.add("shape lists", sc.getShapes().size(),
+				sc.getShapeListMemoryUsage());
+		if (sc.getAccelerator() != 0)
+			report.add("accelerator", 1,
+					sc.getAccelerator()->getMemoryUsage());
+		for (size_t i = 0; i < sc.getSourceLights().size(); i++)
+			addLight(report, sc.getSourceLights()[i].get());
+		report.add("light lists", sc.getLights().size(),
+				sc.getLightListMemoryUsage());
+		report.add("materials", sc.getMaterials().size(),
+				sc.getMaterials().getMemoryUsage());
+	}
+};
+
+#endif // MEMORYREPORT_HH
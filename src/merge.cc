@@ -0,0 +1,109 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "rasterimage.hh"
+#include "parallel.hh"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <stdlib.h>
+
+using namespace std;
+
+/**
+ * Prints usage message to stdout.
+ *
+ * @param progname Name of this program.
+ */
+void usage(char *progname) {
+	cout << "---> Usage: " << progname << " <width in pixels> <height in"
+			<< " pixels> <output file>" << endl
+			<< "            <x0> <y0> <crop file> [<x0> <y0> <crop file>"
+			<< " ...]" << endl;
+	cout << "---> Puts together the crops \"rt <width> <height> --crop <x0>"
+			<< " <y0> <x1> <y1>\"" << endl
+			<< "     rendered of one image, placing each with its top left"
+			<< " pixel at (x0, y0)." << endl
+			<< "     The crops must be PPM, written as P3 or P6, or PFM, and"
+			<< " cover the image." << endl
+			<< "     The image is written in the format of the first crop,"
+			<< " or as PNG if the" << endl
+			<< "     output file's name ends in .png, and has exactly the"
+			<< " pixels rt renders" << endl
+			<< "     for the whole image." << endl;
+}
+
+/**
+ * Merges the crops of an image rendered with @c rt @c --crop into the
+ * whole image, e.g. @code
+ * rt 16384 8192 -s --crop 0 0 8192 8192 --format p6 -o a.ppm < scene.dat
+ * rt 16384 8192 -s --crop 8192 0 16384 8192 --format p6 -o b.ppm < scene.dat
+ * rt-merge 16384 8192 still.png 0 0 a.ppm 8192 0 b.ppm @endcode
+ * on as many machines as there are crops. 8 bit crops keep their values,
+ * so the merged image is the file @c rt writes for the whole image.
+ */
+int main(int argc, char **argv) {
+	if (argc < 7 || (argc - 4) % 3 != 0) {
+		usage(argv[0]);
+		return 1;
+	}
+	int width = atoi(argv[1]), height = atoi(argv[2]);
+	if (width <= 0 || height <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+	string outFile = argv[3];
+	string ext = outFile.size() >= 4 ? outFile.substr(outFile.size() - 4) : "";
+	bool png = ext == ".png" || ext == ".PNG";
+
+	rasterimage merged;
+	vector<char> covered((size_t) width * height, 0);
+	for (int i = 4; i < argc; i += 3) {
+		int x0 = atoi(argv[i]), y0 = atoi(argv[i + 1]);
+		ifstream file(argv[i + 2], ios::in | ios::binary);
+		rasterimage crop;
+		string error;
+		if (!file) {
+			cerr << "ERROR: can't read \"" << argv[i + 2] << "\"." << endl;
+			return 1;
+		}
+		if (!readRasterImage(file, crop, error)) {
+			cerr << "ERROR: \"" << argv[i + 2] << "\": " << error << endl;
+			return 1;
+		}
+		if (i == 4)
+			merged = rasterimage(width, height, crop.isFloat, crop.raw);
+		if (!pasteRasterImage(merged, crop, x0, y0, error)) {
+			cerr << "ERROR: \"" << argv[i + 2] << "\": " << error << endl;
+			return 1;
+		}
+		for (int y = y0; y < y0 + crop.height; y++)
+			fill(covered.begin() + (size_t) y * width + x0,
+					covered.begin() + (size_t) y * width + x0 + crop.width, 1);
+	}
+	vector<char>::iterator gap = find(covered.begin(), covered.end(), 0);
+	if (gap != covered.end()) {
+		size_t k = gap - covered.begin();
+		cerr << "ERROR: no crop covers pixel (" << k % width << ", " <<
+				k / width << ")." << endl;
+		return 1;
+	}
+	if (png && merged.isFloat) {
+		cerr << "ERROR: PFM crops can't be written as PNG." << endl;
+		return 1;
+	}
+
+	ofstream out(outFile.c_str(), ios::out | ios::binary);
+	if (out)
+		writeRasterImage(merged, out, png, hardwareThreads());
+	out.close();
+	if (!out) {
+		cerr << "ERROR: can't write \"" << outFile << "\"." << endl;
+		return 1;
+	}
+	return 0;
+}
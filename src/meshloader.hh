@@ -0,0 +1,496 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "trianglemesh.hh"
+#include "mappedfile.hh"
+#include "boost/shared_ptr.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef MESHLOADER_HH
+#define MESHLOADER_HH
+
+/**
+ * The scalar types of PLY properties.
+ */
+enum plyType {
+	PLY_INT8,
+	PLY_UINT8,
+	PLY_INT16,
+	PLY_UINT16,
+	PLY_INT32,
+	PLY_UINT32,
+	PLY_FLOAT32,
+	PLY_FLOAT64,
+	/** Not a type. */
+	PLY_NONE
+};
+
+/**
+ * Finds a PLY type by any of its names.
+ *
+ * @param name The name, like "float" or "float32".
+ *
+ * @return The type, or @c PLY_NONE .
+ */
+inline plyType findPlyType(const std::string &name) {
+	static const char *names[] = { "char", "uchar", "short", "ushort", "int",
+			"uint", "float", "double", "int8", "uint8", "int16", "uint16",
+			"int32", "uint32", "float32", "float64" };
+	for (int i = 0; i < 16; i++)
+		if (name == names[i])
+			return (plyType) (i % 8);
+	return PLY_NONE;
+}
+
+/**
+ * Gets the size of a PLY type.
+ *
+ * @param type The type.
+ *
+ * @return Size in bytes.
+ */
+inline int plyTypeSize(plyType type) {
+	static const int sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+	return sizes[type];
+}
+
+/**
+ * Reinterprets bytes of this machine's byte order as a number.
+ *
+ * @tparam T The type of the number.
+ *
+ * @param b The bytes.
+ *
+ * @return The number.
+ */
+template<typename T>
+double plyValue(const char *b) {
+	T v;
+	memcpy(&v, b, sizeof(v));
+	return v;
+}
+
+/**
+ * Reads a PLY scalar of the file's byte order.
+ *
+ * @param p The first byte.
+ * @param type The type.
+ * @param swap Whether the file's byte order is the other one from this
+ *   machine's.
+ *
+ * @return The value.
+ */
+inline double readPlyScalar(const char *p, plyType type, bool swap) {
+	char b[8];
+	int n = plyTypeSize(type);
+	for (int i = 0; i < n; i++)
+		b[i] = swap ? p[n - 1 - i] : p[i];
+	switch (type) {
+	case PLY_INT8:
+		return plyValue<signed char>(b);
+	case PLY_UINT8:
+		return plyValue<unsigned char>(b);
+	case PLY_INT16:
+		return plyValue<short>(b);
+	case PLY_UINT16:
+		return plyValue<unsigned short>(b);
+	case PLY_INT32:
+		return plyValue<int>(b);
+	case PLY_UINT32:
+		return plyValue<unsigned int>(b);
+	case PLY_FLOAT32:
+		return plyValue<float>(b);
+	default:
+		return plyValue<double>(b);
+	}
+}
+
+/**
+ * A property of a PLY element: a scalar, or a list of scalars after their
+ * count.
+ */
+struct plyproperty {
+	/** The name. */
+	std::string name;
+	/** The type of the scalar or of the list's items. */
+	plyType type;
+	/** The type of the list's count, or @c PLY_NONE for scalars. */
+	plyType countType;
+};
+
+/**
+ * An element of a PLY file, like its vertices or faces.
+ */
+struct plyelement {
+	/** The name. */
+	std::string name;
+	/** Number of records. */
+	long long count;
+	/** The properties of each record in order. */
+	std::vector<plyproperty> properties;
+
+	/**
+	 * Gets the size of a record if it has no lists.
+	 *
+	 * @return Size in bytes, or -1 if the size varies.
+	 */
+	int recordSize() const {
+		int size = 0;
+		for (size_t i = 0; i < properties.size(); i++) {
+			if (properties[i].countType != PLY_NONE)
+				return -1;
+			size += plyTypeSize(properties[i].type);
+		}
+		return size;
+	}
+};
+
+/**
+ * Tells if this machine stores the low byte of a word first.
+ *
+ * @return @c true on little-endian machines.
+ */
+inline bool isLittleEndian() {
+	int one = 1;
+	char first;
+	memcpy(&first, &one, 1);
+	return first == 1;
+}
+
+/**
+ * Reads the vertices and triangles of a binary PLY file, with any byte
+ * order, from its mapping. Vertices are the x, y and z properties of the
+ * "vertex" element and polygons the "vertex_indices" or "vertex_index"
+ * lists of the "face" element, split into fans of triangles; other
+ * elements and properties are skipped. If the vertices are nothing but x,
+ * y and z of @c vec_T in this machine's byte order, and aligned for it,
+ * the buffers use them in place from the mapping.
+ *
+ * @tparam vec_T The type of the vector components.
+ *
+ * @param file The mapping, which the buffers may keep open.
+ * @param[out] buffers Receives the vertices and triangles.
+ * @param[out] error Receives what's wrong with the file, if anything.
+ *
+ * @return @c false if the file is malformed.
+ */
+template<typename vec_T>
+bool readPly(const boost::shared_ptr<mappedfile> &file,
+		meshbuffers<vec_T> &buffers, std::string &error) {
+	const char *begin = file->data(), *end = begin + file->size();
+	const char *headerEnd = 0;
+	static const char marker[] = "end_header";
+	for (const char *p = begin; p + sizeof(marker) <= end; p++)
+		if (memcmp(p, marker, sizeof(marker) - 1) == 0 &&
+				(p == begin || p[-1] == '\n') &&
+				(p[sizeof(marker) - 1] == '\n' ||
+				p[sizeof(marker) - 1] == '\r')) {
+			headerEnd = p;
+			break;
+		}
+	if (headerEnd == 0) {
+		error = "the PLY header has no end_header line.";
+		return false;
+	}
+
+	std::istringstream header(std::string(begin, headerEnd));
+	std::string line, format;
+	std::vector<plyelement> elements;
+	while (std::getline(header, line)) {
+		std::istringstream words(line);
+		std::string word;
+		words >> word;
+		if (word == "format") {
+			words >> format;
+		}
+		else if (word == "element") {
+			elements.push_back(plyelement());
+			words >> elements.back().name >> elements.back().count;
+			if (!words || elements.back().count < 0) {
+				error = "the PLY header has a malformed element.";
+				return false;
+			}
+		}
+		else if (word == "property") {
+			plyproperty prop;
+			std::string type;
+			words >> type;
+			prop.countType = PLY_NONE;
+			if (type == "list") {
+				std::string countType;
+				words >> countType >> type;
+				prop.countType = findPlyType(countType);
+			}
+			prop.type = findPlyType(type);
+			words >> prop.name;
+			if (!words || elements.empty() || prop.type == PLY_NONE ||
+					(type == "list" && prop.countType == PLY_NONE)) {
+				error = "the PLY header has a malformed property.";
+				return false;
+			}
+			elements.back().properties.push_back(prop);
+		}
+	}
+	bool swap;
+	if (format == "binary_little_endian")
+		swap = !isLittleEndian();
+	else if (format == "binary_big_endian")
+		swap = isLittleEndian();
+	else {
+		error = "only binary PLY files are supported.";
+		return false;
+	}
+
+	const char *p = headerEnd + sizeof(marker) - 1;
+	if (*p == '\r')
+		p++;
+	p++;
+	std::vector<vec_T> coords;
+	std::vector<int> tris;
+	bool haveVertices = false;
+	for (size_t e = 0; e < elements.size(); e++) {
+		const plyelement &el = elements[e];
+		int size = el.recordSize();
+		if (el.name == "vertex") {
+			int offsets[3] = { -1, -1, -1 };
+			plyType types[3] = { PLY_NONE, PLY_NONE, PLY_NONE };
+			int offset = 0;
+			for (size_t i = 0; i < el.properties.size(); i++) {
+				const plyproperty &prop = el.properties[i];
+				int axis = prop.name == "x" ? 0 : prop.name == "y" ? 1 :
+						prop.name == "z" ? 2 : -1;
+				if (axis >= 0) {
+					offsets[axis] = offset;
+					types[axis] = prop.type;
+				}
+				offset += plyTypeSize(prop.type);
+			}
+			if (size < 0 || offsets[0] < 0 || offsets[1] < 0 ||
+					offsets[2] < 0) {
+				error = "PLY vertices must have x, y and z and no lists.";
+				return false;
+			}
+			if (el.count > (end - p) / std::max(size, 1)) {
+				error = "the PLY file is truncated.";
+				return false;
+			}
+			plyType own = sizeof(vec_T) == 4 ? PLY_FLOAT32 : PLY_FLOAT64;
+			if (!swap && size == 3 * (int) sizeof(vec_T) &&
+					offsets[0] == 0 && offsets[1] == (int) sizeof(vec_T) &&
+					offsets[2] == 2 * (int) sizeof(vec_T) && types[0] == own &&
+					types[1] == own && types[2] == own &&
+					(p - begin) % sizeof(vec_T) == 0)
+				buffers.mapVertices(file, (const vec_T *) p,
+						(size_t) el.count);
+			else {
+				coords.resize(3 * (size_t) el.count);
+				for (long long i = 0; i < el.count; i++)
+					for (int k = 0; k < 3; k++)
+						coords[3 * i + k] = (vec_T) readPlyScalar(
+								p + i * size + offsets[k], types[k], swap);
+				buffers.setVertices(coords);
+			}
+			haveVertices = true;
+			p += el.count * size;
+			continue;
+		}
+
+		// Records of other elements are walked property by property.
+		for (long long i = 0; i < el.count; i++)
+			for (size_t k = 0; k < el.properties.size(); k++) {
+				const plyproperty &prop = el.properties[k];
+				if (prop.countType == PLY_NONE) {
+					p += plyTypeSize(prop.type);
+					if (p > end) {
+						error = "the PLY file is truncated.";
+						return false;
+					}
+					continue;
+				}
+				if (end - p < plyTypeSize(prop.countType)) {
+					error = "the PLY file is truncated.";
+					return false;
+				}
+				double n = readPlyScalar(p, prop.countType, swap);
+				p += plyTypeSize(prop.countType);
+				int itemSize = plyTypeSize(prop.type);
+				if (!(n >= 0) || n > (double) ((end - p) / itemSize)) {
+					error = "the PLY file is truncated.";
+					return false;
+				}
+				if (el.name == "face" && (prop.name == "vertex_indices" ||
+						prop.name == "vertex_index"))
+					for (int j = 2; j < (int) n; j++) {
+						tris.push_back((int) readPlyScalar(p, prop.type, swap));
+						tris.push_back((int) readPlyScalar(p +
+								(j - 1) * itemSize, prop.type, swap));
+						tris.push_back((int) readPlyScalar(p + j * itemSize,
+								prop.type, swap));
+					}
+				p += (long long) n * itemSize;
+			}
+	}
+	if (!haveVertices) {
+		error = "the PLY file has no vertex element.";
+		return false;
+	}
+	buffers.setIndices(tris);
+	return true;
+}
+
+/**
+ * Reads the next word of a line of an OBJ file.
+ *
+ * @param[in,out] p The position, moved past the word.
+ * @param end One past the end of the line.
+ * @param[out] word Receives the word.
+ *
+ * @return @c false if there are no more words.
+ */
+inline bool readObjWord(const char *&p, const char *end, std::string &word) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		p++;
+	const char *s = p;
+	while (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+		p++;
+	word.assign(s, p);
+	return p > s;
+}
+
+/**
+ * Reads the vertices and faces of a Wavefront OBJ file: "v" lines give
+ * vertices and "f" lines polygons, split into fans of triangles, whose
+ * vertices are given by 1-based index, or negative index from the last
+ * vertex, optionally followed by texture and normal indices after slashes,
+ * which are ignored. All other lines are ignored too.
+ *
+ * @tparam vec_T The type of the vector components.
+ *
+ * @param begin The first character.
+ * @param end One past the last character.
+ * @param[out] buffers Receives the vertices and triangles.
+ * @param[out] error Receives what's wrong with the file, if anything.
+ *
+ * @return @c false if the file is malformed.
+ */
+template<typename vec_T>
+bool readObj(const char *begin, const char *end, meshbuffers<vec_T> &buffers,
+		std::string &error) {
+	std::vector<vec_T> coords;
+	std::vector<int> tris;
+	std::vector<int> face;
+	std::string word;
+	int line = 1;
+	for (const char *p = begin; p < end; line++) {
+		const char *eol = (const char *) memchr(p, '\n', end - p);
+		if (eol == 0)
+			eol = end;
+		const char *q = p;
+		p = eol + 1;
+		if (!readObjWord(q, eol, word))
+			continue;
+		std::ostringstream os;
+		if (word == "v") {
+			for (int k = 0; k < 3; k++) {
+				char *stop;
+				if (!readObjWord(q, eol, word)) {
+					os << "the vertex on line " << line << " is malformed.";
+					error = os.str();
+					return false;
+				}
+				coords.push_back((vec_T) strtod(word.c_str(), &stop));
+				if (*stop != 0) {
+					os << "the vertex on line " << line << " is malformed.";
+					error = os.str();
+					return false;
+				}
+			}
+		}
+		else if (word == "f") {
+			face.clear();
+			int vertices = (int) (coords.size() / 3);
+			bool malformed = false;
+			while (!malformed && readObjWord(q, eol, word) &&
+					word[0] != '#') {
+				char *stop;
+				long i = strtol(word.c_str(), &stop, 10);
+				malformed = stop == word.c_str() ||
+						(*stop != 0 && *stop != '/');
+				i = i < 0 ? vertices + i : i - 1;
+				if (!malformed && (i < 0 || i >= vertices)) {
+					os << "the face on line " << line <<
+							" refers to a missing vertex.";
+					error = os.str();
+					return false;
+				}
+				face.push_back((int) i);
+			}
+			if (malformed || face.size() < 3) {
+				os << "the face on line " << line << " is malformed.";
+				error = os.str();
+				return false;
+			}
+			for (size_t j = 2; j < face.size(); j++) {
+				tris.push_back(face[0]);
+				tris.push_back(face[j - 1]);
+				tris.push_back(face[j]);
+			}
+		}
+	}
+	buffers.setVertices(coords);
+	buffers.setIndices(tris);
+	return true;
+}
+
+/**
+ * Reads a triangle mesh from a binary PLY file, told by its first line, or
+ * else a Wavefront OBJ file, mapping it with a @c mappedfile ; see
+ * @c readPly and @c readObj .
+ *
+ * @tparam vec_T The type of the vector components.
+ *
+ * @param path The file.
+ * @param[out] buffers Receives the vertices and triangles.
+ * @param[out] error Receives what's wrong with the file, if anything.
+ *
+ * @return @c false if the file can't be read, is malformed, has no
+ *   triangles or refers to missing vertices.
+ */
+template<typename vec_T>
+bool loadMesh(const std::string &path,
+		boost::shared_ptr<const meshbuffers<vec_T> > &buffers,
+		std::string &error) {
+	boost::shared_ptr<mappedfile> file(new mappedfile());
+	if (!file->openRead(path)) {
+		error = "could not read mesh " + path + ".";
+		return false;
+	}
+	boost::shared_ptr<meshbuffers<vec_T> > mesh(new meshbuffers<vec_T>());
+	const char *begin = file->data();
+	bool ply = file->size() >= 4 && memcmp(begin, "ply", 3) == 0 &&
+			(begin[3] == '\n' || begin[3] == '\r');
+	if (!(ply ? readPly(file, *mesh, error) :
+			readObj(begin, begin + file->size(), *mesh, error))) {
+		error = "in " + path + ": " + error;
+		return false;
+	}
+	if (mesh->getTriangleCount() == 0) {
+		error = "the mesh " + path + " has no triangles.";
+		return false;
+	}
+	if (!mesh->isValid()) {
+		error = "the mesh " + path + " refers to missing vertices.";
+		return false;
+	}
+	buffers = mesh;
+	return true;
+}
+
+#endif // MESHLOADER_HH
@@ -0,0 +1,572 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "netchannel.hh"
+#include "phasetimes.hh"
+#include "raystats.hh"
+#include "boost/atomic.hpp"
+#include "boost/noncopyable.hpp"
+#include "boost/scoped_ptr.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/thread.hpp"
+#include <cassert>
+#include <cstddef>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef METRICS_HH
+#define METRICS_HH
+
+/**
+ * Defined when the resident memory of the process is read from
+ * @c /proc/self/statm .
+ */
+#if defined(__linux__)
+#define METRICS_PROC 1
+#include <unistd.h>
+#endif
+
+/**
+ * Longest HTTP request head @c metricsserver reads before giving up on the
+ * client.
+ */
+#define METRICS_MAX_REQUEST 8192
+
+/**
+ * Milliseconds @c metricsserver waits for a connection before checking
+ * whether it's been stopped.
+ */
+#define METRICS_POLL_MS 200
+
+/**
+ * Milliseconds @c metricsserver gives a client by default to send its
+ * request and take the reply before it's dropped, so one that connects and
+ * sends nothing can't hold up the scrapes after it.
+ */
+#define METRICS_TIMEOUT_MS 5000
+
+/**
+ * Counts of a histogram of durations, cumulative per bucket as Prometheus
+ * exposes them, with fixed upper bounds and an implied last one of
+ * infinity.
+ */
+class metricshistogram {
+private:
+
+	/**
+	 * Upper bounds of the buckets in seconds, in increasing order.
+	 */
+	std::vector<double> bounds;
+
+	/**
+	 * Number of durations in each bucket, the last being past every bound.
+	 */
+	std::vector<unsigned long long> counts;
+
+	/**
+	 * Sum of the durations.
+	 */
+	double sum;
+
+public:
+
+	/**
+	 * Makes an empty histogram.
+	 *
+	 * @param upper The upper bounds of the buckets in seconds, in
+	 *   increasing order.
+	 * @param n Number of bounds.
+	 */
+	metricshistogram(const double *upper, int n) :
+			bounds(upper, upper + n), counts(n + 1, 0), sum(0) { }
+
+	/**
+	 * Adds a duration.
+	 *
+	 * @param seconds The duration.
+	 */
+	void add(double seconds) {
+		size_t b = 0;
+		while (b < bounds.size() && seconds > bounds[b])
+			b++;
+		counts[b]++;
+		sum += seconds;
+	}
+
+	/**
+	 * Writes the histogram in the Prometheus text format.
+	 *
+	 * @param os The output stream.
+	 * @param name Name of the metric.
+	 * @param help What it measures.
+	 */
+	void write(std::ostream &os, const char *name, const char *help) const {
+		os << "# HELP " << name << " " << help << "\n# TYPE " << name <<
+				" histogram\n";
+		unsigned long long total = 0;
+		for (size_t b = 0; b < counts.size(); b++) {
+			total += counts[b];
+			os << name << "_bucket{le=\"";
+			if (b < bounds.size())
+				os << bounds[b];
+			else
+				os << "+Inf";
+			os << "\"} " << total << "\n";
+		}
+		os << name << "_sum " << sum << "\n" << name << "_count " << total <<
+				"\n";
+	}
+};
+
+/**
+ * Live counts of a long running render process such as @c --serve , for
+ * capacity planning and alerts on throughput: jobs done, under way and
+ * waiting, the camera samples traced and, in builds with @c RT_STATS , the
+ * rays, the time spent in each @c renderPhase , how long tiles and jobs
+ * took, the memory held and how often the shadow cache and the BVH cache
+ * were hit. @c write exposes them in the Prometheus text format, which
+ * @c metricsserver serves over HTTP. Counts may be added from any thread.
+ */
+class rendermetrics : private boost::noncopyable {
+private:
+
+	/**
+	 * Guards everything below.
+	 */
+	mutable boost::mutex lock;
+
+	/**
+	 * Jobs that finished, and those of them that failed.
+	 */
+	unsigned long long jobs, failedJobs;
+
+	/**
+	 * Jobs under way and jobs waiting to start.
+	 */
+	int activeJobs, queuedJobs;
+
+	/**
+	 * Camera samples traced.
+	 */
+	unsigned long long samples;
+
+	/**
+	 * Wall seconds of each phase.
+	 */
+	double phaseSeconds[PHASE_COUNT];
+
+	/**
+	 * How long each tile or band and each job took.
+	 */
+	metricshistogram tiles, jobTimes;
+
+	/**
+	 * Tests and hits of the shadow cache.
+	 */
+	unsigned long long shadowCacheTests, shadowCacheHits;
+
+	/**
+	 * Trees read from the BVH cache, and trees that had to be built.
+	 */
+	unsigned long long bvhCacheHits, bvhCacheMisses;
+
+	/**
+	 * Bytes of the acceleration structure.
+	 */
+	size_t accelBytes;
+
+	/**
+	 * Upper bounds of the buckets of @c tiles .
+	 */
+	static const double* tileBounds() {
+		static const double b[] = { 0.001, 0.0025, 0.005, 0.01, 0.025,
+				0.05, 0.1, 0.25, 0.5, 1, 2.5 };
+		return b;
+	}
+
+	/**
+	 * Upper bounds of the buckets of @c jobTimes .
+	 */
+	static const double* jobBounds() {
+		static const double b[] = { 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60,
+				120, 300 };
+		return b;
+	}
+
+	/**
+	 * Writes the header and the value of a metric of one value.
+	 */
+	static void writeOne(std::ostream &os, const char *name,
+			const char *type, const char *help, double value) {
+		os << "# HELP " << name << " " << help << "\n# TYPE " << name << " " <<
+				type << "\n" << name << " " << value << "\n";
+	}
+
+	/**
+	 * Reads the bytes of memory the process has resident now.
+	 *
+	 * @return The bytes, or -1 if the system doesn't tell.
+	 */
+	static double residentBytes() {
+#ifdef METRICS_PROC
+		std::ifstream in("/proc/self/statm");
+		double pages, resident;
+		if (in >> pages >> resident)
+			return resident * sysconf(_SC_PAGESIZE);
+#endif
+		return -1;
+	}
+
+public:
+
+	/**
+	 * Makes counts that are all 0.
+	 */
+	rendermetrics() : jobs(0), failedJobs(0), activeJobs(0), queuedJobs(0),
+			samples(0), tiles(tileBounds(), 11), jobTimes(jobBounds(), 11),
+			shadowCacheTests(0), shadowCacheHits(0), bvhCacheHits(0),
+			bvhCacheMisses(0), accelBytes(0) {
+		for (int i = 0; i < PHASE_COUNT; i++)
+			phaseSeconds[i] = 0;
+	}
+
+	/**
+	 * Gets the counts of the process, which loading a scene adds its BVH
+	 * cache lookup to.
+	 *
+	 * @return The counts.
+	 */
+	static rendermetrics& total() {
+		static rendermetrics all;
+		return all;
+	}
+
+	/**
+	 * Notes the number of jobs waiting to start.
+	 *
+	 * @param n The number.
+	 */
+	void setQueued(int n) {
+		boost::mutex::scoped_lock guard(lock);
+		queuedJobs = n;
+	}
+
+	/**
+	 * Notes that a job started.
+	 */
+	void startJob() {
+		boost::mutex::scoped_lock guard(lock);
+		activeJobs++;
+	}
+
+	/**
+	 * Notes that a job started with @c startJob finished.
+	 *
+	 * @param ok Whether it succeeded.
+	 * @param seconds How long it took.
+	 * @param traced Camera samples it traced.
+	 */
+	void finishJob(bool ok, double seconds, unsigned long long traced) {
+		boost::mutex::scoped_lock guard(lock);
+		activeJobs--;
+		jobs++;
+		if (!ok)
+			failedJobs++;
+		jobTimes.add(seconds);
+		samples += traced;
+	}
+
+	/**
+	 * Adds the wall time of a run of a phase.
+	 *
+	 * @param phase The phase.
+	 * @param seconds Its wall time.
+	 */
+	void addPhase(renderPhase phase, double seconds) {
+		boost::mutex::scoped_lock guard(lock);
+		phaseSeconds[phase] += seconds;
+	}
+
+	/**
+	 * Adds how long a tile or band took to render.
+	 *
+	 * @param seconds The time.
+	 */
+	void addTile(double seconds) {
+		boost::mutex::scoped_lock guard(lock);
+		tiles.add(seconds);
+	}
+
+	/**
+	 * Adds shadow cache tests and hits.
+	 *
+	 * @param tests The tests.
+	 * @param hits The hits among them.
+	 */
+	void addShadowCache(unsigned long long tests, unsigned long long hits) {
+		boost::mutex::scoped_lock guard(lock);
+		shadowCacheTests += tests;
+		shadowCacheHits += hits;
+	}
+
+	/**
+	 * Adds a lookup of the BVH cache.
+	 *
+	 * @param hit Whether the tree was read from it rather than built.
+	 */
+	void addBvhCache(bool hit) {
+		boost::mutex::scoped_lock guard(lock);
+		if (hit)
+			bvhCacheHits++;
+		else
+			bvhCacheMisses++;
+	}
+
+	/**
+	 * Notes the bytes of the acceleration structure.
+	 *
+	 * @param bytes The bytes.
+	 */
+	void setAcceleratorBytes(size_t bytes) {
+		boost::mutex::scoped_lock guard(lock);
+		accelBytes = bytes;
+	}
+
+	/**
+	 * Writes the counts in the Prometheus text format, version 0.0.4.
+	 *
+	 * @param os The output stream.
+	 */
+	void write(std::ostream &os) const {
+		boost::mutex::scoped_lock guard(lock);
+		// Enough digits for byte and sample counts to come out whole.
+		std::streamsize digits = os.precision(15);
+		writeOne(os, "rt_jobs_total", "counter", "Render jobs finished.",
+				(double) jobs);
+		writeOne(os, "rt_jobs_failed_total", "counter",
+				"Render jobs that failed.", (double) failedJobs);
+		writeOne(os, "rt_jobs_active", "gauge", "Render jobs under way.",
+				activeJobs);
+		writeOne(os, "rt_jobs_queued", "gauge",
+				"Render jobs waiting to start.", queuedJobs);
+		writeOne(os, "rt_samples_total", "counter",
+				"Camera samples traced.", (double) samples);
+#ifdef RT_STATS
+		raystats rays = raystats::total();
+		os << "# HELP rt_rays_total Rays traced.\n"
+				"# TYPE rt_rays_total counter\n"
+				"rt_rays_total{kind=\"camera\"} " << rays.getPrimaryRays() <<
+				"\nrt_rays_total{kind=\"shadow\"} " << rays.shadowRays <<
+				"\nrt_rays_total{kind=\"reflection\"} " <<
+				rays.reflectionRays << "\n";
+#endif
+		os << "# HELP rt_phase_seconds_total Wall time spent in each phase."
+				"\n# TYPE rt_phase_seconds_total counter\n";
+		for (int i = 0; i < PHASE_COUNT; i++)
+			os << "rt_phase_seconds_total{phase=\"" <<
+					phaseName((renderPhase) i) << "\"} " <<
+					phaseSeconds[i] << "\n";
+		tiles.write(os, "rt_tile_seconds",
+				"Time to render a tile or band.");
+		jobTimes.write(os, "rt_job_seconds", "Time to finish a render job.");
+		writeOne(os, "rt_shadow_cache_tests_total", "counter",
+				"Shadow rays tested against the shadow cache.",
+				(double) shadowCacheTests);
+		writeOne(os, "rt_shadow_cache_hits_total", "counter",
+				"Shadow rays the shadow cache found blocked.",
+				(double) shadowCacheHits);
+		writeOne(os, "rt_bvh_cache_hits_total", "counter",
+				"Trees read from the BVH cache.", (double) bvhCacheHits);
+		writeOne(os, "rt_bvh_cache_misses_total", "counter",
+				"Trees built and written to the BVH cache.",
+				(double) bvhCacheMisses);
+		writeOne(os, "rt_accelerator_bytes", "gauge",
+				"Bytes of the acceleration structure.", (double) accelBytes);
+		double resident = residentBytes();
+		if (resident >= 0)
+			writeOne(os, "process_resident_memory_bytes", "gauge",
+					"Resident memory in bytes.", resident);
+		writeOne(os, "rt_peak_memory_bytes", "gauge",
+				"Most resident memory held at once.",
+				(double) peakMemoryBytes());
+		os.precision(digits);
+	}
+};
+
+/**
+ * Serves the counts of a @c rendermetrics over HTTP on a thread of its
+ * own: a GET of /metrics is answered with them in the Prometheus text
+ * format and anything else with 404, one connection at a time. A client
+ * that doesn't send its request of at most @c METRICS_MAX_REQUEST bytes
+ * in time, or take the reply, is dropped.
+ */
+class metricsserver : private boost::noncopyable {
+private:
+
+	/**
+	 * The port connections are accepted on.
+	 */
+	netlistener listener;
+
+	/**
+	 * The counts served.
+	 */
+	const rendermetrics *metrics;
+
+	/**
+	 * Set by @c stop .
+	 */
+	boost::atomic<bool> stopping;
+
+	/**
+	 * Milliseconds a client has for its request and the reply.
+	 */
+	int timeoutMs;
+
+	/**
+	 * The connection being answered, or 0, for @c stop to shut down.
+	 */
+	netchannel *active;
+
+	/**
+	 * Guards @c active .
+	 */
+	boost::mutex lock;
+
+	/**
+	 * The thread that answers, if started.
+	 */
+	boost::scoped_ptr<boost::thread> thread;
+
+	/**
+	 * Answers connections until @c stop .
+	 */
+	void serve() {
+		while (!stopping.load()) {
+			netchannel channel;
+			if (!listener.accept(channel, METRICS_POLL_MS))
+				continue;
+			channel.setTimeout(timeoutMs);
+			{
+				boost::lock_guard<boost::mutex> guard(lock);
+				if (stopping.load())
+					return;
+				active = &channel;
+			}
+			answer(channel);
+			boost::lock_guard<boost::mutex> guard(lock);
+			active = 0;
+		}
+	}
+
+	/**
+	 * Reads the head of a request and answers it, unless the client takes
+	 * longer than @c timeoutMs in all to send it.
+	 */
+	void answer(netchannel &channel) const {
+		boost::posix_time::ptime deadline =
+				boost::posix_time::microsec_clock::universal_time() +
+				boost::posix_time::milliseconds(timeoutMs);
+		std::string request;
+		char buffer[512];
+		while (request.find("\r\n\r\n") == std::string::npos) {
+			size_t room = METRICS_MAX_REQUEST - request.size();
+			if (room == 0 || boost::posix_time::microsec_clock::
+					universal_time() > deadline)
+				return;
+			size_t n = channel.receiveSome(buffer,
+					room < sizeof(buffer) ? room : sizeof(buffer));
+			if (n == 0)
+				return;
+			request.append(buffer, n);
+		}
+		std::string reply;
+		if (request.compare(0, 13, "GET /metrics ") == 0 ||
+				request.compare(0, 13, "GET /metrics?") == 0) {
+			std::ostringstream body;
+			metrics->write(body);
+			std::ostringstream head;
+			head << "HTTP/1.1 200 OK\r\n"
+					"Content-Type: text/plain; version=0.0.4\r\n"
+					"Content-Length: " << body.str().size() << "\r\n"
+					"Connection: close\r\n\r\n";
+			reply = head.str() + body.str();
+		}
+		else
+			reply = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n"
+					"Connection: close\r\n\r\n";
+		channel.sendAll(reply.data(), reply.size());
+	}
+
+public:
+
+	/**
+	 * Makes a server that isn't serving.
+	 */
+	metricsserver() : metrics(0), stopping(false),
+			timeoutMs(METRICS_TIMEOUT_MS), active(0) { }
+
+	/**
+	 * Stops serving.
+	 */
+	~metricsserver() {
+		stop();
+	}
+
+	/**
+	 * Starts serving counts on a port.
+	 *
+	 * @param port The port, or 0 for any free one; see @c getPort .
+	 * @param counts The counts, which must outlive the serving.
+	 * @param timeout Milliseconds a client has to send its request and
+	 *   take the reply.
+	 *
+	 * @return @c false if the port can't be listened on.
+	 */
+	bool start(int port, const rendermetrics &counts,
+			int timeout = METRICS_TIMEOUT_MS) {
+		assert(timeout > 0);
+		stop();
+		if (!listener.listen(port))
+			return false;
+		metrics = &counts;
+		timeoutMs = timeout;
+		stopping.store(false);
+		thread.reset(new boost::thread(&metricsserver::serve, this));
+		return true;
+	}
+
+	/**
+	 * Gets the port being served on.
+	 *
+	 * @return The port, or 0 if not serving.
+	 */
+	int getPort() const {
+		return listener.getPort();
+	}
+
+	/**
+	 * Stops serving, cutting off the connection being answered, if any.
+	 */
+	void stop() {
+		if (thread) {
+			{
+				boost::lock_guard<boost::mutex> guard(lock);
+				stopping.store(true);
+				if (active != 0)
+					active->shutdown();
+			}
+			listener.shutdown();
+			thread->join();
+			thread.reset();
+		}
+		listener.close();
+	}
+};
+
+#endif // METRICS_HH
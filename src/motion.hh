@@ -0,0 +1,620 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "accelerator.hh"
+#include "bvh.hh"
+#include "aabb.hh"
+#include "shape.hh"
+#include "shapekind.hh"
+#include "hitrecord.hh"
+#include "mvector.hh"
+#include "ray.hh"
+#include "boost/shared_ptr.hpp"
+#include "boost/noncopyable.hpp"
+#include <cassert>
+#include <limits>
+#include <vector>
+#include <ostream>
+
+#ifndef MOTION_HH
+#define MOTION_HH
+
+/**
+ * A shape that moves in a straight line while the shutter is open: at time
+ * @c s of the shutter interval, from 0 to 1, it's the shape it's made
+ * with moved by @c s times its motion. Rays are intersected with it at
+ * their own @c ray::getShutter , so averaging samples at many times blurs
+ * it along its path. Any shape can be moved; hit records name the shape
+ * within, whose color and reflectivity shade the hit, as with instances.
+ *
+ * Its box from @c getBounds holds the whole path, so every accelerator
+ * finds its hits; @c motionbvh uses the boxes at the ends of the interval
+ * instead, which are much smaller for shapes that move far.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class motionshape : public shape<vec_T, color_T, time_T, dim> {
+public:
+
+	/**
+	 * Boost shared pointer typedef for shapes.
+	 */
+	typedef boost::shared_ptr<shape<vec_T, color_T, time_T, dim> > sp_shape;
+
+private:
+
+	/**
+	 * The shape where it is when the shutter opens.
+	 */
+	sp_shape inner;
+
+	/**
+	 * The @c shapeKind of @c inner .
+	 */
+	shapeKind innerKind;
+
+	/**
+	 * How far the shape moves by the time the shutter closes.
+	 */
+	mvector<vec_T, dim> motion;
+
+	/**
+	 * Gets the given ray in the frame of @c inner , which is the world moved
+	 * back by as far as the shape has moved at the ray's time.
+	 */
+	ray<vec_T, time_T, dim> toInner(const ray<vec_T, time_T, dim> &r) const {
+		return r.translated(-(motion * (vec_T) r.getShutter()));
+	}
+
+public:
+
+	/**
+	 * Moves the given shape.
+	 *
+	 * @param theInner The shape where it is when the shutter opens.
+	 * @param theMotion How far it moves by the time the shutter closes.
+	 */
+	motionshape(const sp_shape &theInner,
+			const mvector<vec_T, dim> &theMotion) :
+			shape<vec_T, color_T, time_T, dim>(theInner->getColor(),
+					theInner->getReflectivity()),
+			inner(theInner),
+			innerKind(shapedispatch<vec_T, color_T, time_T, dim>::kindOf(
+					theInner.get())),
+			motion(theMotion) { }
+
+	/**
+	 * Gets the shape that moves, where it is when the shutter opens.
+	 *
+	 * @return The shape.
+	 */
+	const sp_shape& getInner() const {
+		return inner;
+	}
+
+	/**
+	 * Gets how far the shape moves while the shutter is open.
+	 *
+	 * @return The motion.
+	 */
+	const mvector<vec_T, dim>& getMotion() const {
+		return motion;
+	}
+
+	/**
+	 * Intersects the given ray with the shape where it is at the ray's
+	 * time.
+	 *
+	 * @param r The ray.
+	 *
+	 * @return The time of the first hit or @c RAY_MISS .
+	 */
+	time_T intersection(const ray<vec_T, time_T, dim> &r) const {
+		return shapedispatch<vec_T, color_T, time_T, dim>::intersection(
+				innerKind, inner.get(), toInner(r));
+	}
+
+	/**
+	 * Fills in a hit record with the shape within, moved back to where the
+	 * ray hit it.
+	 *
+	 * @param r The ray.
+	 * @param[in,out] rec The record, whose @c t is the time of the hit.
+	 */
+	void completeHit(const ray<vec_T, time_T, dim> &r,
+			hitrecord<vec_T, color_T, time_T, dim> &rec) const {
+		inner->completeHit(toInner(r), rec);
+		rec.point += motion * (vec_T) r.getShutter();
+	}
+
+	/**
+	 * Gets the surface normal at a point of the shape where it is when the
+	 * shutter opens, since the point doesn't say when it was hit;
+	 * @c completeHit knows and is what shading uses.
+	 *
+	 * @param surfacePt The point.
+	 *
+	 * @return The surface normal.
+	 */
+	mvector<vec_T, dim> surfaceNorm(
+			const mvector<vec_T, dim> &surfacePt) const {
+		return inner->surfaceNorm(surfacePt);
+	}
+
+	/**
+	 * Gets the box around the shape's whole path.
+	 *
+	 * @param[out] box Receives the box if the shape is bounded.
+	 *
+	 * @return @c true if the shape is bounded.
+	 */
+	bool getBounds(aabb<vec_T, dim> &box) const {
+		aabb<vec_T, dim> open, close;
+		if (!getMotionBounds(open, close))
+			return false;
+		box = open;
+		box.extend(close);
+		return true;
+	}
+
+	/**
+	 * Gets the shape's box when the shutter opens and that box moved by the
+	 * motion.
+	 *
+	 * @param[out] open Receives the box when the shutter opens.
+	 * @param[out] close Receives the box when it closes.
+	 *
+	 * @return @c true if the shape is bounded.
+	 */
+	bool getMotionBounds(aabb<vec_T, dim> &open,
+			aabb<vec_T, dim> &close) const {
+		if (!inner->getBounds(open))
+			return false;
+		close = aabb<vec_T, dim>(open.getMin() + motion,
+				open.getMax() + motion);
+		return true;
+	}
+
+	/**
+	 * Print helper function.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printHelper(std::ostream &os) const {
+		os << "[moving by " << motion << ": ";
+		inner->printHelper(os);
+		os << "]";
+	}
+};
+
+/**
+ * A bounding volume hierarchy for shapes that move while the shutter is
+ * open. Each node keeps two boxes, around its shapes when the shutter
+ * opens and when it closes, and a ray tests the box whose corners are
+ * interpolated between them at the ray's own time. A @c bvh bounds each
+ * moving shape by its whole path instead, so a shape that moves far makes
+ * every node above it large for every ray; here a node is only as large as
+ * its shapes are at any one time.
+ *
+ * The tree is split by the binned SAH of @c bvh over the boxes at the
+ * middle of the interval. Boxes are interpolated as the shapes move, in a
+ * straight line, so a node's interpolated box holds its shapes at every
+ * time. Without moving shapes it finds the same hits as a @c bvh .
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class motionbvh : public accelerator<vec_T, color_T, time_T, dim>,
+		private boost::noncopyable {
+public:
+
+	/**
+	 * Boost shared pointer typedef for shapes.
+	 */
+	typedef typename accelerator<vec_T, color_T, time_T, dim>::sp_shape
+		sp_shape;
+
+private:
+
+	typedef bvh<vec_T, color_T, time_T, dim> bvh_T;
+
+	/**
+	 * Build data of a shape, as for a @c bvh , with the box at the middle of
+	 * the interval.
+	 */
+	typedef typename bvh_T::buildprim buildprim;
+
+	/**
+	 * A node, laid out depth first: an interior node's left child follows
+	 * it and its right child is @c offset nodes after it, and a leaf has
+	 * @c count shapes from @c primIndices[offset] .
+	 */
+	struct motionnode {
+		/** Corners of the box when the shutter opens. */
+		vec_T lo0[dim], hi0[dim];
+		/** Corners of the box when it closes. */
+		vec_T lo1[dim], hi1[dim];
+		/** Distance to the right child, or first shape of a leaf. */
+		int offset;
+		/** Number of shapes of a leaf, or 0. */
+		int count;
+	};
+
+	/**
+	 * The shapes passed to @c build . The scene owns them.
+	 */
+	std::vector<const shape<vec_T, color_T, time_T, dim> *> prims;
+
+	/**
+	 * The @c shapeKind of each of @c prims .
+	 */
+	std::vector<shapeKind> primKinds;
+
+	/**
+	 * Indices into @c prims in the order of the leaves.
+	 */
+	std::vector<int> primIndices;
+
+	/**
+	 * The nodes, depth first from the root.
+	 */
+	std::vector<motionnode> nodes;
+
+	/**
+	 * Number of @c prims whose boxes differ at the ends of the interval.
+	 */
+	int movingCount;
+
+	/**
+	 * Box of the given node at the given time.
+	 */
+	static void boxAt(const motionnode &n, vec_T s, vec_T *lo, vec_T *hi) {
+		for (int i = 0; i < dim; i++) {
+			lo[i] = n.lo0[i] + (n.lo1[i] - n.lo0[i]) * s;
+			hi[i] = n.hi0[i] + (n.hi1[i] - n.hi0[i]) * s;
+		}
+	}
+
+	/**
+	 * Sets the boxes of a node to those around the shapes of
+	 * @c primIndices[start, end) .
+	 */
+	void fitNode(motionnode &n, int start, int end) {
+		aabb<vec_T, dim> open, close;
+		for (int i = start; i < end; i++) {
+			aabb<vec_T, dim> o, c;
+			bool bounded = prims[primIndices[i]]->getMotionBounds(o, c);
+			assert(bounded);
+			open.extend(o);
+			close.extend(c);
+		}
+		for (int i = 0; i < dim; i++) {
+			n.lo0[i] = open.getMin()[i];
+			n.hi0[i] = open.getMax()[i];
+			n.lo1[i] = close.getMin()[i];
+			n.hi1[i] = close.getMax()[i];
+		}
+	}
+
+	/**
+	 * Appends the tree over @c primIndices[start, end) depth first.
+	 *
+	 * @return Index of the range's node.
+	 */
+	int grow(const std::vector<buildprim> &bp, int start, int end,
+			int depth) {
+		int idx = (int) nodes.size();
+		nodes.push_back(motionnode());
+		aabb<vec_T, dim> box;
+		int mid = depth >= BVH_MAX_DEPTH - 2 ? -1 :
+				bvh_T::splitRange(bp, primIndices, start, end, depth, box);
+		if (mid < 0) {
+			nodes[idx].offset = start;
+			nodes[idx].count = end - start;
+		}
+		else {
+			grow(bp, start, mid, depth + 1);
+			int right = grow(bp, mid, end, depth + 1);
+			nodes[idx].offset = right - idx;
+			nodes[idx].count = 0;
+		}
+		return idx;
+	}
+
+	/**
+	 * Refits the subtree of the given node to its shapes.
+	 *
+	 * @return One past the last node of the subtree.
+	 */
+	int refitNode(int idx) {
+		motionnode &n = nodes[idx];
+		if (n.count > 0) {
+			fitNode(n, n.offset, n.offset + n.count);
+			return idx + 1;
+		}
+		int right = idx + n.offset;
+		refitNode(idx + 1);
+		int end = refitNode(right);
+		const motionnode &l = nodes[idx + 1], &r = nodes[right];
+		for (int i = 0; i < dim; i++) {
+			n.lo0[i] = std::min(l.lo0[i], r.lo0[i]);
+			n.hi0[i] = std::max(l.hi0[i], r.hi0[i]);
+			n.lo1[i] = std::min(l.lo1[i], r.lo1[i]);
+			n.hi1[i] = std::max(l.hi1[i], r.hi1[i]);
+		}
+		return end;
+	}
+
+	/**
+	 * Counts the shapes that move and recomputes @c movingCount .
+	 */
+	void countMoving() {
+		movingCount = 0;
+		for (size_t i = 0; i < prims.size(); i++) {
+			aabb<vec_T, dim> o, c;
+			prims[i]->getMotionBounds(o, c);
+			for (int a = 0; a < dim; a++) {
+				if (o.getMin()[a] != c.getMin()[a] ||
+						o.getMax()[a] != c.getMax()[a]) {
+					movingCount++;
+					break;
+				}
+			}
+		}
+	}
+
+	/**
+	 * Intersects the ray with the shape @c prims[i] .
+	 */
+	time_T intersectPrim(int i, const ray<vec_T, time_T, dim> &r) const {
+		return shapedispatch<vec_T, color_T, time_T, dim>::intersection(
+				primKinds[i], prims[i], r);
+	}
+
+	/**
+	 * Tests a ray against the box of a node at the ray's time.
+	 */
+	static bool enter(const rayquery<vec_T, time_T, dim> &q, vec_T s,
+			const motionnode &n, time_T limit, time_T &tnear) {
+		vec_T lo[dim], hi[dim];
+		boxAt(n, s, lo, hi);
+		return q.slabs(lo, hi, limit, tnear);
+	}
+
+public:
+
+	/**
+	 * Constructs an empty hierarchy. Call @c build before querying it.
+	 */
+	motionbvh() : movingCount(0) { }
+
+	/**
+	 * Builds the tree over the given shapes, discarding the old one.
+	 *
+	 * @param shapes The shapes, which must be bounded and outlive this
+	 *   hierarchy.
+	 */
+	void build(const std::vector<sp_shape> &shapes) {
+		int n = (int) shapes.size();
+		prims.clear();
+		primKinds.clear();
+		primIndices.clear();
+		nodes.clear();
+		std::vector<buildprim> bp(n);
+		for (int i = 0; i < n; i++) {
+			prims.push_back(shapes[i].get());
+			primKinds.push_back(shapedispatch<vec_T, color_T, time_T, dim>::
+					kindOf(prims.back()));
+			primIndices.push_back(i);
+			aabb<vec_T, dim> o, c;
+			bool bounded = prims[i]->getMotionBounds(o, c);
+			assert(bounded);
+			bp[i].box = aabb<vec_T, dim>((o.getMin() + c.getMin()) /
+					(vec_T) 2, (o.getMax() + c.getMax()) / (vec_T) 2);
+			bp[i].centroid = bp[i].box.centroid();
+		}
+		countMoving();
+		if (n == 0)
+			return;
+		grow(bp, 0, n, 0);
+		refitNode(0);
+	}
+
+	/**
+	 * Refits the boxes of the nodes to where the shapes are now, keeping
+	 * the tree.
+	 *
+	 * @return @c true .
+	 */
+	bool refit() {
+		countMoving();
+		if (!nodes.empty())
+			refitNode(0);
+		return true;
+	}
+
+	/**
+	 * Finds the closest shape hit by the given ray, at its time, by walking
+	 * the tree front to back.
+	 *
+	 * @param r The ray.
+	 * @param[out] tIntersect The time of the hit or @c RAY_MISS .
+	 *
+	 * @return Index of the shape that was hit or -1 if there was no hit.
+	 */
+	int closestHit(const ray<vec_T, time_T, dim> &r,
+			time_T &tIntersect) const {
+		int best = -1;
+		time_T tBest = RAY_MISS;
+		tIntersect = RAY_MISS;
+		if (nodes.empty())
+			return -1;
+
+		rayquery<vec_T, time_T, dim> q(r);
+		vec_T s = (vec_T) r.getShutter();
+		time_T tnear;
+		time_T tmax = q.getTMax();
+		const motionnode *stack[BVH_MAX_DEPTH];
+		int sp = 0;
+		if (enter(q, s, nodes[0], tmax, tnear))
+			stack[sp++] = &nodes[0];
+		while (sp > 0) {
+			const motionnode *n = stack[--sp];
+			time_T limit = best < 0 ? tmax : tBest;
+			if (n->count > 0) {
+				for (int i = n->offset; i < n->offset + n->count; i++) {
+					int p = primIndices[i];
+					time_T t = intersectPrim(p, r);
+					if (t != RAY_MISS && t > 0 && (best < 0 || t < tBest)) {
+						tBest = t;
+						best = p;
+					}
+				}
+				continue;
+			}
+			const motionnode *left = n + 1, *right = n + n->offset;
+			time_T tl, tr;
+			bool hitl = enter(q, s, *left, limit, tl);
+			bool hitr = enter(q, s, *right, limit, tr);
+			assert(sp + 2 <= BVH_MAX_DEPTH);
+			// Push the farther child first so the nearer one is visited
+			// first.
+			if (hitl && hitr) {
+				if (tl < tr) {
+					stack[sp++] = right;
+					stack[sp++] = left;
+				}
+				else {
+					stack[sp++] = left;
+					stack[sp++] = right;
+				}
+			}
+			else if (hitl) {
+				stack[sp++] = left;
+			}
+			else if (hitr) {
+				stack[sp++] = right;
+			}
+		}
+		tIntersect = tBest;
+		return best;
+	}
+
+	/**
+	 * Checks if any shape blocks the given ray, at its time, before
+	 * @c tmax . The walk stops at the first hit.
+	 *
+	 * @param r The ray.
+	 * @param tmax Hits at or beyond this time are ignored.
+	 *
+	 * @return Index of a shape that blocks the ray before @c tmax or -1.
+	 */
+	int anyHit(const ray<vec_T, time_T, dim> &r, time_T tmax) const {
+		if (nodes.empty())
+			return -1;
+		rayquery<vec_T, time_T, dim> q(r, 0, tmax);
+		vec_T s = (vec_T) r.getShutter();
+		time_T tnear;
+		const motionnode *stack[BVH_MAX_DEPTH];
+		int sp = 0;
+		stack[sp++] = &nodes[0];
+		while (sp > 0) {
+			const motionnode *n = stack[--sp];
+			if (!enter(q, s, *n, tmax, tnear))
+				continue;
+			if (n->count > 0) {
+				for (int i = n->offset; i < n->offset + n->count; i++) {
+					int p = primIndices[i];
+					time_T t = intersectPrim(p, r);
+					if (t != RAY_MISS && t > 0 && t < tmax)
+						return p;
+				}
+				continue;
+			}
+			assert(sp + 2 <= BVH_MAX_DEPTH);
+			stack[sp++] = n + n->offset;
+			stack[sp++] = n + 1;
+		}
+		return -1;
+	}
+
+	/**
+	 * Gets the surface area of the root's box at a time of the shutter
+	 * interval, which is how likely a ray is to enter the tree then.
+	 *
+	 * @param s The time, from 0 to 1.
+	 *
+	 * @return The area, or 0 without shapes.
+	 */
+	vec_T getRootAreaAt(vec_T s) const {
+		if (nodes.empty())
+			return 0;
+		vec_T lo[dim], hi[dim];
+		boxAt(nodes[0], s, lo, hi);
+		return aabb<vec_T, dim>(mvector<vec_T, dim>(lo),
+				mvector<vec_T, dim>(hi)).surfaceArea();
+	}
+
+	/**
+	 * Gets the number of nodes.
+	 *
+	 * @return Node count.
+	 */
+	int getNodeCount() const {
+		return (int) nodes.size();
+	}
+
+	/**
+	 * Gets the number of shapes that move while the shutter is open.
+	 *
+	 * @return Moving shape count.
+	 */
+	int getMovingCount() const {
+		return movingCount;
+	}
+
+	/**
+	 * Gets the number of bytes taken by the nodes and the shape lists.
+	 *
+	 * @return Memory footprint in bytes.
+	 */
+	size_t getMemoryUsage() const {
+		return nodes.capacity() * sizeof(motionnode) + primIndices.capacity() *
+				sizeof(int) + prims.capacity() * (sizeof(prims[0]) +
+				sizeof(primKinds[0]));
+	}
+
+	/**
+	 * Prints the size of this hierarchy.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printHelper(std::ostream &os) const {
+		os << "[motion bvh. nodes: " << nodes.size() << ", shapes: " <<
+				prims.size() << ", moving: " << movingCount << "]";
+	}
+};
+
+typedef motionshape<double, double, double, 3> motionshape3d;
+typedef motionshape<double, double, float, 3> motionshape3ddf;
+typedef motionshape<float, float, float, 3> motionshape3f;
+typedef boost::shared_ptr<motionshape3d> sp_motionshape3d;
+typedef boost::shared_ptr<motionshape3ddf> sp_motionshape3ddf;
+typedef boost::shared_ptr<motionshape3f> sp_motionshape3f;
+typedef motionbvh<double, double, double, 3> motionbvh3d;
+typedef motionbvh<double, double, float, 3> motionbvh3ddf;
+typedef motionbvh<float, float, float, 3> motionbvh3f;
+typedef boost::shared_ptr<motionbvh3d> sp_motionbvh3d;
+typedef boost::shared_ptr<motionbvh3ddf> sp_motionbvh3ddf;
+typedef boost::shared_ptr<motionbvh3f> sp_motionbvh3f;
+
+#endif // MOTION_HH
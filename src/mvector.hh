@@ -6,10 +6,225 @@
 #include <iostream>
 #include <cassert>
 #include <cmath>
+#include <cstring>
+#include "fastmath.hh"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
 
 #ifndef MVECTOR_HH
 #define MVECTOR_HH
 
+/**
+ * The arithmetic behind @c mvector , done one component at a time. Vectors
+ * are passed as pointers to their component arrays, which hold @c lanes
+ * components each. The specializations for 3D vectors of doubles and floats
+ * below pad to 4 lanes and use SSE or AVX; they give bit for bit the same
+ * results as this version, including the order of the sums in @c dot .
+ *
+ * @tparam T The type of the vector components.
+ * @tparam size The number of dimensions.
+ */
+template<typename T, int size>
+struct mvectorsimd {
+
+	/**
+	 * Number of components stored per vector.
+	 */
+	static const int lanes = size;
+
+	/**
+	 * Alignment of the components in bytes.
+	 */
+	static const int align = sizeof(T);
+
+	static void add(T *r, const T *a, const T *b) {
+		for (int i = 0; i < size; i++)
+			r[i] = a[i] + b[i];
+	}
+
+	static void sub(T *r, const T *a, const T *b) {
+		for (int i = 0; i < size; i++)
+			r[i] = a[i] - b[i];
+	}
+
+	static void mul(T *r, const T *a, T s) {
+		for (int i = 0; i < size; i++)
+			r[i] = a[i] * s;
+	}
+
+	static void div(T *r, const T *a, T s) {
+		for (int i = 0; i < size; i++)
+			r[i] = a[i] / s;
+	}
+
+	static T dot(const T *a, const T *b) {
+		T result = 0;
+		for (int i = 0; i < size; i++)
+			result += b[i] * a[i];
+		return result;
+	}
+
+	static void cross(T *r, const T *a, const T *b) {
+		r[0] = a[1] * b[2] - a[2] * b[1];
+		r[1] = -a[0] * b[2] + a[2] * b[0];
+		r[2] = a[0] * b[1] - a[1] * b[0];
+	}
+};
+
+#ifdef __SSE2__
+
+/**
+ * @c mvectorsimd for 3D vectors of doubles, padded to 4 lanes. The padding
+ * lane holds no meaningful value. Products are summed in the same order as
+ * the generic version, starting from +0, so dot products match exactly.
+ */
+template<>
+struct mvectorsimd<double, 3> {
+	static const int lanes = 4;
+#ifdef __AVX__
+	static const int align = 32;
+
+	static void add(double *r, const double *a, const double *b) {
+		_mm256_store_pd(r, _mm256_add_pd(_mm256_load_pd(a),
+				_mm256_load_pd(b)));
+	}
+
+	static void sub(double *r, const double *a, const double *b) {
+		_mm256_store_pd(r, _mm256_sub_pd(_mm256_load_pd(a),
+				_mm256_load_pd(b)));
+	}
+
+	static void mul(double *r, const double *a, double s) {
+		_mm256_store_pd(r, _mm256_mul_pd(_mm256_load_pd(a),
+				_mm256_set1_pd(s)));
+	}
+
+	static void div(double *r, const double *a, double s) {
+		_mm256_store_pd(r, _mm256_div_pd(_mm256_load_pd(a),
+				_mm256_set1_pd(s)));
+	}
+
+	static double dot(const double *a, const double *b) {
+		__m256d p = _mm256_mul_pd(_mm256_load_pd(b), _mm256_load_pd(a));
+		__m128d lo = _mm256_castpd256_pd128(p);
+		__m128d s = _mm_add_sd(_mm_setzero_pd(), lo);
+		s = _mm_add_sd(s, _mm_unpackhi_pd(lo, lo));
+		s = _mm_add_sd(s, _mm256_extractf128_pd(p, 1));
+		return _mm_cvtsd_f64(s);
+	}
+
+#ifdef __AVX2__
+	static void cross(double *r, const double *a, const double *b) {
+		__m256d va = _mm256_load_pd(a), vb = _mm256_load_pd(b);
+		// (y, z, x, w) and (z, x, y, w) of each.
+		__m256d a1 = _mm256_permute4x64_pd(va, _MM_SHUFFLE(3, 0, 2, 1));
+		__m256d a2 = _mm256_permute4x64_pd(va, _MM_SHUFFLE(3, 1, 0, 2));
+		__m256d b1 = _mm256_permute4x64_pd(vb, _MM_SHUFFLE(3, 0, 2, 1));
+		__m256d b2 = _mm256_permute4x64_pd(vb, _MM_SHUFFLE(3, 1, 0, 2));
+		_mm256_store_pd(r, _mm256_sub_pd(_mm256_mul_pd(a1, b2),
+				_mm256_mul_pd(a2, b1)));
+	}
+#else
+	static void cross(double *r, const double *a, const double *b) {
+		r[0] = a[1] * b[2] - a[2] * b[1];
+		r[1] = -a[0] * b[2] + a[2] * b[0];
+		r[2] = a[0] * b[1] - a[1] * b[0];
+	}
+#endif
+#else
+	static const int align = 16;
+
+	static void add(double *r, const double *a, const double *b) {
+		_mm_store_pd(r, _mm_add_pd(_mm_load_pd(a), _mm_load_pd(b)));
+		_mm_store_pd(r + 2, _mm_add_pd(_mm_load_pd(a + 2),
+				_mm_load_pd(b + 2)));
+	}
+
+	static void sub(double *r, const double *a, const double *b) {
+		_mm_store_pd(r, _mm_sub_pd(_mm_load_pd(a), _mm_load_pd(b)));
+		_mm_store_pd(r + 2, _mm_sub_pd(_mm_load_pd(a + 2),
+				_mm_load_pd(b + 2)));
+	}
+
+	static void mul(double *r, const double *a, double s) {
+		__m128d vs = _mm_set1_pd(s);
+		_mm_store_pd(r, _mm_mul_pd(_mm_load_pd(a), vs));
+		_mm_store_pd(r + 2, _mm_mul_pd(_mm_load_pd(a + 2), vs));
+	}
+
+	static void div(double *r, const double *a, double s) {
+		__m128d vs = _mm_set1_pd(s);
+		_mm_store_pd(r, _mm_div_pd(_mm_load_pd(a), vs));
+		_mm_store_pd(r + 2, _mm_div_pd(_mm_load_pd(a + 2), vs));
+	}
+
+	static double dot(const double *a, const double *b) {
+		__m128d lo = _mm_mul_pd(_mm_load_pd(b), _mm_load_pd(a));
+		__m128d hi = _mm_mul_sd(_mm_load_sd(b + 2), _mm_load_sd(a + 2));
+		__m128d s = _mm_add_sd(_mm_setzero_pd(), lo);
+		s = _mm_add_sd(s, _mm_unpackhi_pd(lo, lo));
+		s = _mm_add_sd(s, hi);
+		return _mm_cvtsd_f64(s);
+	}
+
+	static void cross(double *r, const double *a, const double *b) {
+		r[0] = a[1] * b[2] - a[2] * b[1];
+		r[1] = -a[0] * b[2] + a[2] * b[0];
+		r[2] = a[0] * b[1] - a[1] * b[0];
+	}
+#endif
+};
+
+/**
+ * @c mvectorsimd for 3D vectors of floats, padded to 4 lanes, one SSE
+ * register. The padding lane holds no meaningful value.
+ */
+template<>
+struct mvectorsimd<float, 3> {
+	static const int lanes = 4;
+	static const int align = 16;
+
+	static void add(float *r, const float *a, const float *b) {
+		_mm_store_ps(r, _mm_add_ps(_mm_load_ps(a), _mm_load_ps(b)));
+	}
+
+	static void sub(float *r, const float *a, const float *b) {
+		_mm_store_ps(r, _mm_sub_ps(_mm_load_ps(a), _mm_load_ps(b)));
+	}
+
+	static void mul(float *r, const float *a, float s) {
+		_mm_store_ps(r, _mm_mul_ps(_mm_load_ps(a), _mm_set1_ps(s)));
+	}
+
+	static void div(float *r, const float *a, float s) {
+		_mm_store_ps(r, _mm_div_ps(_mm_load_ps(a), _mm_set1_ps(s)));
+	}
+
+	static float dot(const float *a, const float *b) {
+		__m128 p = _mm_mul_ps(_mm_load_ps(b), _mm_load_ps(a));
+		__m128 s = _mm_add_ss(_mm_setzero_ps(), p);
+		s = _mm_add_ss(s, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1)));
+		s = _mm_add_ss(s, _mm_movehl_ps(p, p));
+		return _mm_cvtss_f32(s);
+	}
+
+	static void cross(float *r, const float *a, const float *b) {
+		__m128 va = _mm_load_ps(a), vb = _mm_load_ps(b);
+		// (y, z, x, w) and (z, x, y, w) of each.
+		__m128 a1 = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 a2 = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 1, 0, 2));
+		__m128 b1 = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 b2 = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 1, 0, 2));
+		_mm_store_ps(r, _mm_sub_ps(_mm_mul_ps(a1, b2), _mm_mul_ps(a2, b1)));
+	}
+};
+
+#endif // __SSE2__
+
 /**
  * Represents math vectors of given size and type. Basic vector
  * operations such as vector addition, scalar multiplication, dot products,
@@ -24,11 +239,13 @@
 template<typename T, int size>
 class mvector {
 private:
+	typedef mvectorsimd<T, size> simd;
+
 	/**
 	 *  Contains vector data. The i-th component of the vector corresponds
-	 *  to v[i-1].
+	 *  to v[i-1]. It may be padded for @c mvectorsimd .
 	 */
-	T v[size];
+	alignas(simd::align) T v[simd::lanes];
 
 public:
 
@@ -37,7 +254,7 @@ public:
 	 */
 	mvector () {
 		assert(size > 0);
-		for (int i = 0; i < size; i++)
+		for (int i = 0; i < simd::lanes; i++)
 			v[i] = 0;
 	}
 
@@ -53,6 +270,8 @@ public:
 		assert(size > 0);
 		for (int i = 0; i < size; i++)
 			v[i] = arr[i];
+		for (int i = size; i < simd::lanes; i++)
+			v[i] = 0;
 	}
 
 	/**
@@ -81,6 +300,8 @@ public:
 		v[0] = x;
 		v[1] = y;
 		v[2] = z;
+		for (int i = 3; i < simd::lanes; i++)
+			v[i] = 0;
 	}
 
 	/**
@@ -109,6 +330,8 @@ public:
 		v[0] = x;
 		v[1] = y;
 		v[2] = z;
+		for (int i = 3; i < simd::lanes; i++)
+			v[i] = 0;
 	}
 
 	/**
@@ -119,8 +342,8 @@ public:
 	mvector (const mvector<T, size> &other) {
 		assert (size > 0);
 		assert (other.dim() == size);
-		for (int i = 0; i < size; i++)
-			v[i] = other[i];
+		for (int i = 0; i < simd::lanes; i++)
+			v[i] = other.v[i];
 	}
 
 	/**
@@ -131,8 +354,7 @@ public:
 	 * @return Reference to this vector for operator chaining.
 	 */
 	mvector<T, size> & operator+=(const mvector<T, size> &rhs) {
-		for (int i = 0; i < size; i++)
-			v[i] += rhs[i];
+		simd::add(v, v, rhs.v);
 		return *this;
 	}
 
@@ -145,8 +367,7 @@ public:
 	 * @return Reference to this vector for operator chaining.
 	 */
 	mvector<T, size> & operator-=(const mvector<T, size> &rhs) {
-		for (int i = 0; i < size; i++)
-			v[i] -= rhs[i];
+		simd::sub(v, v, rhs.v);
 		return *this;
 	}
 
@@ -159,8 +380,7 @@ public:
 	 * @return Reference to this vector for operator chaining.
 	 */
 	mvector<T, size> & operator*=(T scalar) {
-		for (int i = 0; i < size; i++)
-			v[i] *= scalar;
+		simd::mul(v, v, scalar);
 		return *this;
 	}
 
@@ -174,8 +394,7 @@ public:
 	 */
 	mvector<T, size> & operator/=(T scalar) {
 		assert(scalar != 0);
-		for (int i = 0; i < size; i++)
-			v[i] /= scalar;
+		simd::div(v, v, scalar);
 		return *this;
 	}
 
@@ -187,9 +406,8 @@ public:
 	 * @return The sum as a const value.
 	 */
 	const mvector<T, size> operator+(const mvector<T, size> &rhs) const {
-		mvector tmp = *this;
-		for (int i = 0; i < size; i++)
-			tmp[i] += rhs[i];
+		mvector tmp;
+		simd::add(tmp.v, v, rhs.v);
 		return tmp;
 	}
 
@@ -201,9 +419,8 @@ public:
 	 * @return The difference as a const value.
 	 */
 	const mvector<T, size> operator-(const mvector<T, size> &rhs) const {
-		mvector tmp = *this;
-		for (int i = 0; i < size; i++)
-			tmp[i] -= rhs[i];
+		mvector tmp;
+		simd::sub(tmp.v, v, rhs.v);
 		return tmp;
 	}
 
@@ -216,9 +433,8 @@ public:
 	 */
 	const mvector<T, size> operator/(T scalar) const {
 		assert(scalar != 0);
-		mvector tmp = *this;
-		for (int i = 0; i < size; i++)
-			tmp[i] /= scalar;
+		mvector tmp;
+		simd::div(tmp.v, v, scalar);
 		return tmp;
 	}
 
@@ -230,9 +446,8 @@ public:
 	 * @warning This is not a mutator.
 	 */
 	const mvector<T, size> operator-() const {
-		mvector tmp = *this;
-		for (int i = 0; i < size; i++)
-			tmp[i] *= -1;
+		mvector tmp;
+		simd::mul(tmp.v, v, -1);
 		return tmp;
 	}
 
@@ -244,10 +459,7 @@ public:
 	 * @return Dot product.
 	 */
 	T operator*(const mvector<T, size> &rhs) const {
-		T result = 0;
-		for (int i = 0; i < size; i++)
-			result += rhs[i] * v[i];
-		return result;
+		return simd::dot(v, rhs.v);
 	}
 
 	/**
@@ -262,9 +474,7 @@ public:
 		assert(size == 3);
 		assert(rhs.dim() == 3);
 		mvector tmp;
-		tmp[0] = v[1] * rhs[2] - v[2] * rhs[1];
-		tmp[1] = -v[0] * rhs[2] + v[2] * rhs[0];
-		tmp[2] = v[0] * rhs[1] - v[1] * rhs[0];
+		simd::cross(tmp.v, v, rhs.v);
 		return tmp;
 	}
 
@@ -311,15 +521,20 @@ public:
     T mag() const { return sqrt(magsq()); }
 
     /**
-     * Gets a normalized version of this vector as a brand-new value.
+     * Gets a normalized version of this vector as a brand-new value. In
+     * builds with @c RT_FAST_MATH defined it multiplies by @c approxRsqrt
+     * of the squared magnitude instead of dividing by the magnitude, so
+     * the length comes out within @c FASTMATH_RSQRT_ERROR of 1.
      *
      * @return Normalized vector.
      */
     mvector<T, size> norm() const {
-    	mvector vec(*this);
-    	T magnitude = mag();
-    	for (int i = 0; i < size; i++)
-    		vec[i] /= magnitude;
+    	mvector vec;
+#ifdef RT_FAST_MATH
+    	simd::mul(vec.v, v, approxRsqrt(magsq()));
+#else
+    	simd::div(vec.v, v, mag());
+#endif
     	return vec;
     }
 
@@ -373,8 +588,7 @@ public:
 template<typename T, int size>
 const mvector<T, size> operator*(const mvector<T, size> &lhs, T scalar) {
 	mvector<T, size> tmp = lhs;
-	for (int i = 0; i < lhs.dim(); i++)
-		tmp[i] *= scalar;
+	tmp *= scalar;
 	return tmp;
 }
 
@@ -389,8 +603,7 @@ const mvector<T, size> operator*(const mvector<T, size> &lhs, T scalar) {
 template<typename T, int size>
 const mvector<T, size> operator*(T scalar, const mvector<T, size> &rhs) {
 	mvector<T, size> tmp = rhs;
-	for (int i = 0; i < rhs.dim(); i++)
-		tmp[i] *= scalar;
+	tmp *= scalar;
 	return tmp;
 }
 
@@ -464,6 +677,36 @@ std::istream & operator>>(std::istream& is, mvector<T, size> &v) {
 	return is;
 }
 
+/**
+ * Hashes the bytes of a vector with FNV-1a followed by a final mix, for
+ * randomness that's a fixed function of a point, so that renders don't
+ * depend on the order points are shaded in.
+ *
+ * @param v The vector.
+ * @param seed Mixed in first, so that one point can give several unrelated
+ *   hashes.
+ *
+ * @return The hash.
+ */
+template<typename T, int size>
+unsigned int hashVector(const mvector<T, size> &v, unsigned int seed = 0) {
+	unsigned int h = 2166136261u;
+	if (seed != 0)
+		for (int s = 0; s < 4; s++)
+			h = (h ^ ((seed >> (8 * s)) & 0xffu)) * 16777619u;
+	for (int a = 0; a < size; a++) {
+		T x = v[a];
+		unsigned char bytes[sizeof(T)];
+		memcpy(bytes, &x, sizeof(T));
+		for (size_t b = 0; b < sizeof(T); b++)
+			h = (h ^ bytes[b]) * 16777619u;
+	}
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	return h;
+}
+
 typedef mvector<double, 3> vector3d;
 typedef mvector<float, 3> vector3f;
 typedef mvector<double, 2> vector2d;
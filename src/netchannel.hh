@@ -0,0 +1,628 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "boost/cstdint.hpp"
+#include "boost/noncopyable.hpp"
+#include <cstddef>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef NETCHANNEL_HH
+#define NETCHANNEL_HH
+
+/**
+ * Defined when there are POSIX sockets to send messages over.
+ */
+#if defined(__unix__) || defined(__APPLE__)
+#define NETCHANNEL_SOCKETS 1
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Largest payload a message may have by default, so that a bad header
+ * can't make the receiver allocate without bound.
+ */
+#define NET_MAX_PAYLOAD ((boost::uint64_t) 1 << 34)
+
+/**
+ * The payload of a message, built up from numbers and strings that are
+ * written in network byte order so machines of either byte order can read
+ * them back with @c netreader .
+ */
+class netwriter {
+private:
+
+	/**
+	 * The bytes written so far.
+	 */
+	std::vector<char> bytes;
+
+public:
+
+	/**
+	 * Appends a 32 bit number.
+	 *
+	 * @param v The number.
+	 */
+	void putInt(boost::uint32_t v) {
+		for (int s = 24; s >= 0; s -= 8)
+			bytes.push_back((char) ((v >> s) & 0xff));
+	}
+
+	/**
+	 * Appends a 64 bit number.
+	 *
+	 * @param v The number.
+	 */
+	void putLong(boost::uint64_t v) {
+		putInt((boost::uint32_t) (v >> 32));
+		putInt((boost::uint32_t) v);
+	}
+
+	/**
+	 * Appends a double by its bits, so it's read back exactly.
+	 *
+	 * @param v The number.
+	 */
+	void putDouble(double v) {
+		boost::uint64_t bits;
+		memcpy(&bits, &v, sizeof(bits));
+		putLong(bits);
+	}
+
+	/**
+	 * Appends bytes with their count in front.
+	 *
+	 * @param data The first byte.
+	 * @param size Number of bytes.
+	 */
+	void putBytes(const char *data, size_t size) {
+		putLong(size);
+		bytes.insert(bytes.end(), data, data + size);
+	}
+
+	/**
+	 * Appends a string with its length in front.
+	 *
+	 * @param s The string.
+	 */
+	void putString(const std::string &s) {
+		putBytes(s.data(), s.size());
+	}
+
+	/**
+	 * Gets the bytes written.
+	 *
+	 * @return The payload.
+	 */
+	const std::vector<char>& getBytes() const {
+		return bytes;
+	}
+};
+
+/**
+ * Reads back the numbers and strings of a payload written with
+ * @c netwriter . Every read fails once the payload runs out, so a short
+ * message is found at the end by checking @c ok .
+ */
+class netreader {
+private:
+
+	/**
+	 * The next byte.
+	 */
+	const char *next;
+
+	/**
+	 * One past the last byte.
+	 */
+	const char *end;
+
+	/**
+	 * Whether every read so far had its bytes.
+	 */
+	bool good;
+
+public:
+
+	/**
+	 * Starts reading a payload.
+	 *
+	 * @param payload The payload, which must outlive the reader.
+	 */
+	explicit netreader(const std::vector<char> &payload) :
+			next(payload.empty() ? 0 : &payload[0]),
+			end(next + payload.size()), good(true) { }
+
+	/**
+	 * Reads a 32 bit number.
+	 *
+	 * @return The number, or 0 if the payload ran out.
+	 */
+	boost::uint32_t getInt() {
+		if (end - next < 4) {
+			good = false;
+			return 0;
+		}
+		boost::uint32_t v = 0;
+		for (int i = 0; i < 4; i++)
+			v = (v << 8) | (unsigned char) *next++;
+		return v;
+	}
+
+	/**
+	 * Reads a 64 bit number.
+	 *
+	 * @return The number, or 0 if the payload ran out.
+	 */
+	boost::uint64_t getLong() {
+		boost::uint64_t high = getInt();
+		return (high << 32) | getInt();
+	}
+
+	/**
+	 * Reads a double.
+	 *
+	 * @return The number, or 0 if the payload ran out.
+	 */
+	double getDouble() {
+		boost::uint64_t bits = getLong();
+		double v;
+		memcpy(&v, &bits, sizeof(v));
+		return good ? v : 0;
+	}
+
+	/**
+	 * Reads bytes written with their count in front.
+	 *
+	 * @param[out] data Receives where the bytes are in the payload.
+	 * @param[out] size Receives the number of bytes.
+	 *
+	 * @return @c false if the payload ran out.
+	 */
+	bool getBytes(const char *&data, size_t &size) {
+		boost::uint64_t n = getLong();
+		if (!good || n > (boost::uint64_t) (end - next)) {
+			good = false;
+			return false;
+		}
+		data = next;
+		size = (size_t) n;
+		next += n;
+		return true;
+	}
+
+	/**
+	 * Reads a string written with its length in front.
+	 *
+	 * @return The string, or an empty one if the payload ran out.
+	 */
+	std::string getString() {
+		const char *data;
+		size_t size;
+		return getBytes(data, size) ? std::string(data, size) :
+				std::string();
+	}
+
+	/**
+	 * Tells if every read had its bytes.
+	 *
+	 * @return @c false if the payload ran out.
+	 */
+	bool ok() const {
+		return good;
+	}
+};
+
+/**
+ * One end of a TCP connection that carries whole messages, each a 32 bit
+ * type and a payload of bytes. Either end may send and receive, but only
+ * one thread may send and one receive at a time; @c shutdown may be called
+ * from any thread to make the other end and a waiting @c receive see the
+ * connection closed. Without sockets, connecting always fails.
+ */
+class netchannel : private boost::noncopyable {
+private:
+
+	/**
+	 * The socket, or -1 if the channel isn't open.
+	 */
+	int fd;
+
+public:
+
+	/**
+	 * Makes a channel that isn't open.
+	 */
+	netchannel() : fd(-1) { }
+
+	/**
+	 * Closes the channel.
+	 */
+	~netchannel() {
+		close();
+	}
+
+	/**
+	 * Connects to a listening @c netlistener . Any open connection is
+	 * closed first.
+	 *
+	 * @param host Name or address of the machine.
+	 * @param port The port.
+	 *
+	 * @return @c false if it couldn't connect.
+	 */
+	bool connect(const std::string &host, int port) {
+		close();
+#ifdef NETCHANNEL_SOCKETS
+		std::ostringstream service;
+		service << port;
+		addrinfo hints, *found = 0;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		if (getaddrinfo(host.c_str(), service.str().c_str(), &hints,
+				&found) != 0)
+			return false;
+		for (addrinfo *a = found; a != 0 && fd < 0; a = a->ai_next) {
+			fd = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+			if (fd >= 0 && ::connect(fd, a->ai_addr, a->ai_addrlen) != 0)
+				close();
+		}
+		freeaddrinfo(found);
+		if (fd >= 0)
+			configure();
+		return fd >= 0;
+#else
+		(void) host;
+		(void) port;
+		return false;
+#endif
+	}
+
+	/**
+	 * Takes over an accepted socket. Any open connection is closed first.
+	 *
+	 * @param socket The socket.
+	 */
+	void adopt(int socket) {
+		close();
+		fd = socket;
+		configure();
+	}
+
+	/**
+	 * Tells if the channel is open.
+	 *
+	 * @return Whether it's open.
+	 */
+	bool isOpen() const {
+		return fd >= 0;
+	}
+
+	/**
+	 * Sends a message, waiting until all of it is handed to the system.
+	 *
+	 * @param type The type of the message.
+	 * @param payload The payload.
+	 *
+	 * @return @c false if the connection is closed or broken.
+	 */
+	bool send(boost::uint32_t type, const std::vector<char> &payload) {
+		netwriter header;
+		header.putInt(type);
+		header.putLong(payload.size());
+		return sendAll(&header.getBytes()[0], header.getBytes().size()) &&
+				(payload.empty() || sendAll(&payload[0], payload.size()));
+	}
+
+	/**
+	 * Sends a message without a payload.
+	 *
+	 * @param type The type of the message.
+	 *
+	 * @return @c false if the connection is closed or broken.
+	 */
+	bool send(boost::uint32_t type) {
+		return send(type, std::vector<char>());
+	}
+
+	/**
+	 * Waits for the next message.
+	 *
+	 * @param[out] type Receives the type of the message.
+	 * @param[out] payload Receives the payload.
+	 * @param maxSize Largest payload to accept.
+	 *
+	 * @return @c false if the connection is closed or broken or the
+	 *   payload is too big.
+	 */
+	bool receive(boost::uint32_t &type, std::vector<char> &payload,
+			boost::uint64_t maxSize = NET_MAX_PAYLOAD) {
+		std::vector<char> header(12);
+		if (!receiveAll(&header[0], header.size()))
+			return false;
+		netreader in(header);
+		type = in.getInt();
+		boost::uint64_t size = in.getLong();
+		if (size > maxSize)
+			return false;
+		payload.resize((size_t) size);
+		return size == 0 || receiveAll(&payload[0], payload.size());
+	}
+
+	/**
+	 * Stops sending and receiving in both directions, waking a thread
+	 * waiting in @c receive , but keeps the socket until @c close .
+	 */
+	void shutdown() {
+#ifdef NETCHANNEL_SOCKETS
+		if (fd >= 0)
+			::shutdown(fd, SHUT_RDWR);
+#endif
+	}
+
+	/**
+	 * Closes the connection if it's open.
+	 */
+	void close() {
+#ifdef NETCHANNEL_SOCKETS
+		if (fd >= 0)
+			::close(fd);
+#endif
+		fd = -1;
+	}
+
+	/**
+	 * Gives up on a send or receive that waits longer than a time, which
+	 * then fails as if the connection broke.
+	 *
+	 * @param ms The time in milliseconds, or 0 to wait for ever.
+	 */
+	void setTimeout(int ms) {
+#ifdef NETCHANNEL_SOCKETS
+		if (fd < 0)
+			return;
+		timeval tv;
+		tv.tv_sec = ms / 1000;
+		tv.tv_usec = ms % 1000 * 1000;
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+#else
+		(void) ms;
+#endif
+	}
+
+	/**
+	 * Sends bytes until all are sent, without a message around them, for
+	 * protocols of their own on the connection like WebSocket.
+	 *
+	 * @param data The first byte.
+	 * @param size Number of bytes.
+	 *
+	 * @return @c false if the connection is closed or broken.
+	 */
+	bool sendAll(const char *data, size_t size) {
+#ifdef NETCHANNEL_SOCKETS
+#ifdef MSG_NOSIGNAL
+		const int flags = MSG_NOSIGNAL;
+#else
+		const int flags = 0;
+#endif
+		while (fd >= 0 && size > 0) {
+			ssize_t n = ::send(fd, data, size, flags);
+			if (n <= 0)
+				return false;
+			data += n;
+			size -= n;
+		}
+		return size == 0;
+#else
+		(void) data;
+		return size == 0;
+#endif
+	}
+
+	/**
+	 * Receives bytes until all have come, without a message around them.
+	 *
+	 * @param data Where to put them.
+	 * @param size Number of bytes.
+	 *
+	 * @return @c false if the connection is closed or broken first.
+	 */
+	bool receiveAll(char *data, size_t size) {
+#ifdef NETCHANNEL_SOCKETS
+		while (fd >= 0 && size > 0) {
+			ssize_t n = ::recv(fd, data, size, 0);
+			if (n <= 0)
+				return false;
+			data += n;
+			size -= n;
+		}
+		return size == 0;
+#else
+		(void) data;
+		return size == 0;
+#endif
+	}
+
+	/**
+	 * Receives the bytes that have come, waiting for at least one, for
+	 * protocols whose messages have no length in front, like HTTP.
+	 *
+	 * @param data Where to put them.
+	 * @param size Most bytes to receive.
+	 *
+	 * @return The number of bytes received, or 0 if the connection is
+	 *   closed or broken or the wait timed out.
+	 */
+	size_t receiveSome(char *data, size_t size) {
+#ifdef NETCHANNEL_SOCKETS
+		if (fd < 0 || size == 0)
+			return 0;
+		ssize_t n = ::recv(fd, data, size, 0);
+		return n > 0 ? (size_t) n : 0;
+#else
+		(void) data;
+		(void) size;
+		return 0;
+#endif
+	}
+
+private:
+
+	/**
+	 * Sends small messages such as lease requests at once rather than
+	 * waiting to fill a packet.
+	 */
+	void configure() {
+#ifdef NETCHANNEL_SOCKETS
+		int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+#ifdef SO_NOSIGPIPE
+		setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+#endif
+	}
+};
+
+/**
+ * A TCP port that @c netchannel connections are accepted on.
+ */
+class netlistener : private boost::noncopyable {
+private:
+
+	/**
+	 * The listening socket, or -1.
+	 */
+	int fd;
+
+public:
+
+	/**
+	 * Makes a listener that isn't listening.
+	 */
+	netlistener() : fd(-1) { }
+
+	/**
+	 * Stops listening.
+	 */
+	~netlistener() {
+		close();
+	}
+
+	/**
+	 * Listens on a port of every address of the machine.
+	 *
+	 * @param port The port, or 0 for any free one; see @c getPort .
+	 *
+	 * @return @c false if the port can't be listened on.
+	 */
+	bool listen(int port) {
+		close();
+#ifdef NETCHANNEL_SOCKETS
+		fd = ::socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+			return false;
+		int on = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		addr.sin_port = htons((unsigned short) port);
+		if (::bind(fd, (sockaddr *) &addr, sizeof(addr)) != 0 ||
+				::listen(fd, 64) != 0) {
+			close();
+			return false;
+		}
+		return true;
+#else
+		(void) port;
+		return false;
+#endif
+	}
+
+	/**
+	 * Gets the port being listened on.
+	 *
+	 * @return The port, or 0 if not listening.
+	 */
+	int getPort() const {
+#ifdef NETCHANNEL_SOCKETS
+		sockaddr_in addr;
+		socklen_t size = sizeof(addr);
+		if (fd < 0 || getsockname(fd, (sockaddr *) &addr, &size) != 0)
+			return 0;
+		return ntohs(addr.sin_port);
+#else
+		return 0;
+#endif
+	}
+
+	/**
+	 * Waits a while for the next connection.
+	 *
+	 * @param[out] channel Receives the connection.
+	 * @param ms Longest time to wait in milliseconds.
+	 *
+	 * @return @c false if nobody connected in time.
+	 */
+	bool accept(netchannel &channel, int ms) {
+#ifdef NETCHANNEL_SOCKETS
+		if (fd < 0)
+			return false;
+		pollfd p;
+		p.fd = fd;
+		p.events = POLLIN;
+		p.revents = 0;
+		if (poll(&p, 1, ms) <= 0)
+			return false;
+		int socket = ::accept(fd, 0, 0);
+		if (socket < 0)
+			return false;
+		channel.adopt(socket);
+		return true;
+#else
+		(void) channel;
+		(void) ms;
+		return false;
+#endif
+	}
+
+	/**
+	 * Wakes a thread waiting in @c accept , which fails from then on, but
+	 * keeps the socket until @c close .
+	 */
+	void shutdown() {
+#ifdef NETCHANNEL_SOCKETS
+		if (fd >= 0)
+			::shutdown(fd, SHUT_RDWR);
+#endif
+	}
+
+	/**
+	 * Stops listening if it is.
+	 */
+	void close() {
+#ifdef NETCHANNEL_SOCKETS
+		if (fd >= 0)
+			::close(fd);
+#endif
+		fd = -1;
+	}
+};
+
+#endif // NETCHANNEL_HH
@@ -0,0 +1,1436 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "accelerator.hh"
+#include "bvh.hh"
+#include "instance.hh"
+#include "shape.hh"
+#include "aabb.hh"
+#include "ray.hh"
+#include "hitrecord.hh"
+#include "arena.hh"
+#include "mappedfile.hh"
+#include "scenerecord.hh"
+#include "scenefile.hh"
+#include "sceneparser.hh"
+#include "boost/shared_ptr.hpp"
+#include "boost/noncopyable.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/locks.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/thread/tss.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <ostream>
+
+#ifndef OUTOFCORE_HH
+#define OUTOFCORE_HH
+
+/**
+ * Default number of records per chunk for @c chunkSceneRecords , which
+ * makes chunks of a few hundred kilobytes of records.
+ */
+#define OUTOFCORE_CHUNK_RECORDS 4096
+
+/**
+ * Orders indices of boxes by the centers of the boxes along an axis.
+ *
+ * @tparam vec_T The type of the vector components.
+ */
+template<typename vec_T>
+struct chunkcenterless {
+	/** The boxes. */
+	const std::vector<aabb<vec_T, 3> > *boxes;
+	/** The axis. */
+	int axis;
+
+	chunkcenterless(const std::vector<aabb<vec_T, 3> > &boxes, int axis) :
+			boxes(&boxes), axis(axis) { }
+
+	bool operator()(int a, int b) const {
+		const aabb<vec_T, 3> &x = (*boxes)[a], &y = (*boxes)[b];
+		return x.getMin()[axis] + x.getMax()[axis] <
+				y.getMin()[axis] + y.getMax()[axis];
+	}
+};
+
+/**
+ * Orders the spheres and cylinders of a scene description into chunks of
+ * shapes that are close together, for scenes too large to keep in memory
+ * whole. The shapes are split in half at the median of their centers along
+ * the longest axis of the centers' box until a half has at most
+ * @c maxRecords of them. Shapes that a key or move record moves stay
+ * where they are, as do all other records, in their order; the chunked
+ * shapes come after them in the order of the chunks, so the chunks follow
+ * each other and end with the last record, as @c writeSceneFile needs.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ *
+ * @param[in,out] desc The valid objects, which are reordered.
+ * @param maxRecords Most records per chunk, at least 1.
+ * @param[out] chunks Receives the chunks, or none if there's nothing to
+ *   chunk.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+void chunkSceneRecords(scenedescription &desc, int maxRecords,
+		std::vector<scenechunk> &chunks) {
+	assert(maxRecords >= 1);
+	chunks.clear();
+	std::vector<scenerecord> &records = desc.records;
+	std::vector<scenerecord> others;
+	std::vector<scenerecord> movable;
+	std::vector<aabb<vec_T, 3> > boxes;
+	sp_arena pool(new arena());
+	for (size_t i = 0; i < records.size(); i++) {
+		const scenerecord &rec = records[i];
+		bool keyed = i + 1 < records.size() &&
+				(records[i + 1].kind == RECORD_KEY ||
+				records[i + 1].kind == RECORD_MOVE);
+		if ((rec.kind != RECORD_SPHERE && rec.kind != RECORD_CYLINDER) ||
+				keyed || !isValidSceneRecord(rec, desc.paths.size())) {
+			others.push_back(rec);
+			continue;
+		}
+		boost::shared_ptr<shape<vec_T, color_T, time_T, 3> > obj;
+		std::string error;
+		makeSceneShape(rec, desc.paths, pool, obj, error);
+		aabb<vec_T, 3> box;
+		obj->getBounds(box);
+		movable.push_back(rec);
+		boxes.push_back(box);
+	}
+	if (movable.empty())
+		return;
+
+	// Split index ranges by the median center, like a tree whose leaves
+	// are the chunks, from left to right.
+	std::vector<int> order(movable.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = (int) i;
+	std::vector<std::pair<int, int> > stack;
+	stack.push_back(std::make_pair(0, (int) order.size()));
+	records.swap(others);
+	while (!stack.empty()) {
+		int start = stack.back().first, end = stack.back().second;
+		stack.pop_back();
+		aabb<vec_T, 3> centers;
+		for (int i = start; i < end; i++)
+			centers.extend((boxes[order[i]].getMin() +
+					boxes[order[i]].getMax()) / 2);
+		int axis = 0;
+		for (int a = 1; a < 3; a++)
+			if (centers.getMax()[a] - centers.getMin()[a] >
+					centers.getMax()[axis] - centers.getMin()[axis])
+				axis = a;
+		if (end - start <= maxRecords ||
+				!(centers.getMax()[axis] > centers.getMin()[axis])) {
+			scenechunk c;
+			aabb<vec_T, 3> box;
+			for (int i = start; i < end; i++) {
+				records.push_back(movable[order[i]]);
+				box.extend(boxes[order[i]]);
+			}
+			for (int a = 0; a < 3; a++) {
+				c.lo[a] = (double) box.getMin()[a];
+				c.hi[a] = (double) box.getMax()[a];
+			}
+			c.count = end - start;
+			c.first = (long long) records.size() - c.count;
+			chunks.push_back(c);
+			continue;
+		}
+		int mid = start + (end - start) / 2;
+		std::vector<int>::iterator b = order.begin();
+		std::nth_element(b + start, b + mid, b + end,
+				chunkcenterless<vec_T>(boxes, axis));
+		// The right half goes on the stack first so the left one is next.
+		stack.push_back(std::make_pair(mid, end));
+		stack.push_back(std::make_pair(start, mid));
+	}
+}
+
+/**
+ * What a hit record keeps of a shape of a chunk: its color and
+ * reflectivity, which is all shading reads of it. These stay in memory
+ * once the chunk has been loaded, so records never point at a shape that
+ * was let go with its chunk, at a few dozen bytes per shape instead of
+ * the shape, its record and its part of the chunk's hierarchy.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+class chunksurface : public shape<vec_T, color_T, time_T, 3> {
+public:
+
+	/**
+	 * Keeps the color and reflectivity of a shape.
+	 *
+	 * @param s The shape.
+	 */
+	explicit chunksurface(const shape<vec_T, color_T, time_T, 3> &s) :
+			shape<vec_T, color_T, time_T, 3>(s.getColor(),
+			s.getReflectivity()) { }
+
+	/**
+	 * Never hits anything; rays are traced through the chunk's shapes.
+	 *
+	 * @param r The ray.
+	 *
+	 * @return @c RAY_MISS .
+	 */
+	time_T intersection(const ray<vec_T, time_T, 3> &r) const {
+		return RAY_MISS;
+	}
+
+	/**
+	 * Gets a normal pointing up, since the shape isn't known here; hits
+	 * get theirs from the shape in @c geometrychunk::completeHit .
+	 *
+	 * @param surfacePt The point at which to get a surface normal.
+	 *
+	 * @return The up vector.
+	 */
+	mvector<vec_T, 3> surfaceNorm(const mvector<vec_T, 3> &surfacePt) const {
+		mvector<vec_T, 3> up;
+		up[2] = 1;
+		return up;
+	}
+
+	/**
+	 * Print helper function.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printHelper(std::ostream &os) const {
+		os << "[chunk surface. color: " << this->getColor() <<
+				", reflectivity: " << this->getReflectivity() << "]";
+	}
+};
+
+/**
+ * The chunks of a compiled scene written with @c chunkSceneRecords , loaded
+ * into memory as rays reach them and let go again, least recently used
+ * first, once those loaded take more than a budget. A loaded chunk is an
+ * @c assembly of the shapes of its records with a hierarchy of its own;
+ * whoever holds one keeps it, so a chunk let go while a ray is in it is
+ * only freed once the ray is done. The records are read from the compiled
+ * scene where they are, so in a mapping only the pages of chunks that are
+ * loaded need to be in memory, and the operating system is told when they
+ * will be needed and when they won't. What hit records need of the shapes
+ * of a chunk, a @c chunksurface each, is kept from its first load on.
+ *
+ * Any number of threads may ask for chunks at once; one loads a chunk
+ * while the others that want it wait.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+class chunkstore : private boost::noncopyable {
+public:
+
+	/**
+	 * The shapes of a chunk.
+	 */
+	typedef assembly<vec_T, color_T, time_T, 3> assembly_t;
+
+	/**
+	 * Boost shared pointer typedef for loaded chunks.
+	 */
+	typedef boost::shared_ptr<const assembly_t> sp_assembly;
+
+	/**
+	 * What hit records keep of the shapes of the chunks.
+	 */
+	typedef chunksurface<vec_T, color_T, time_T> surface_t;
+
+	/**
+	 * The rays the chunks are traced with.
+	 */
+	typedef ray<vec_T, time_T, 3> ray_t;
+
+	/**
+	 * The hit records of those rays.
+	 */
+	typedef hitrecord<vec_T, color_T, time_T, 3> hitrecord_t;
+
+	/**
+	 * The hits a thread found in chunks for its last rays, so completing
+	 * them doesn't load the chunks again.
+	 */
+	struct hitmemo {
+		/** The first ray, where the caller keeps them. */
+		const ray_t *rays;
+		/** Copies of the rays, to tell them from others put in their
+		 * place. */
+		std::vector<ray_t> copies;
+		/** The completed hit of each ray, or one with no object. */
+		std::vector<hitrecord_t> recs;
+		/** The chunk each ray hit, or -1. */
+		std::vector<int> chunks;
+	};
+
+private:
+
+	/**
+	 * A chunk and whether it's loaded.
+	 */
+	struct slot {
+		/** Box around its shapes. */
+		aabb<vec_T, 3> box;
+		/** Its first record. */
+		const scenerecord *records;
+		/** Number of records. */
+		size_t count;
+		/** The shapes while it's loaded, else 0. */
+		sp_assembly shapes;
+		/** Bytes the shapes took when they were loaded. */
+		size_t bytes;
+		/** When it was last asked for, for letting go of the least
+		 * recently used one. */
+		unsigned long long lastUse;
+		/** Whether a thread is loading it. */
+		bool loading;
+		/** The colors of its shapes from the first time it was loaded
+		 * on, in the order of the shapes. */
+		std::vector<surface_t> surfaces;
+	};
+
+	/**
+	 * The chunks.
+	 */
+	std::vector<slot> slots;
+
+	/**
+	 * The files records name.
+	 */
+	std::vector<std::string> paths;
+
+	/**
+	 * What's kept alive with this store, such as the memory the records
+	 * are in.
+	 */
+	std::vector<boost::shared_ptr<void> > owners;
+
+	/**
+	 * Most bytes the loaded chunks may take, though the one being asked for
+	 * is always kept.
+	 */
+	size_t budget;
+
+	/**
+	 * Bytes the loaded chunks take.
+	 */
+	size_t resident;
+
+	/**
+	 * Most bytes the loaded chunks took at once.
+	 */
+	size_t peak;
+
+	/**
+	 * Bytes the colors of the shapes of chunks that were ever loaded
+	 * take.
+	 */
+	size_t surfaceBytes;
+
+	/**
+	 * Number of times a chunk was loaded.
+	 */
+	unsigned long long loads;
+
+	/**
+	 * Number of times a chunk was let go.
+	 */
+	unsigned long long evictions;
+
+	/**
+	 * Counts the uses of chunks.
+	 */
+	unsigned long long clock;
+
+	/**
+	 * Guards all of the above but the boxes and records.
+	 */
+	mutable boost::mutex lock;
+
+	/**
+	 * Signaled when a chunk is loaded.
+	 */
+	boost::condition_variable loaded;
+
+	/**
+	 * The hits of each thread's last rays.
+	 */
+	boost::thread_specific_ptr<hitmemo> memos;
+
+	/**
+	 * Tells the operating system whether the records of a chunk will be
+	 * read soon. Only the pages that hold nothing but its records are let
+	 * go, since the neighbors' may still be needed.
+	 *
+	 * @param s The chunk.
+	 * @param willNeed @c true if they will be, @c false if they won't.
+	 */
+	static void adviseRecords(const slot &s, bool willNeed) {
+#ifdef MAPPEDFILE_MMAP
+		size_t page = (size_t) sysconf(_SC_PAGESIZE);
+		size_t begin = (size_t) s.records;
+		size_t end = begin + s.count * sizeof(scenerecord);
+		begin = willNeed ? begin / page * page :
+				(begin + page - 1) / page * page;
+		end = willNeed ? (end + page - 1) / page * page : end / page * page;
+		if (begin < end)
+			posix_madvise((void *) begin, end - begin, willNeed ?
+					POSIX_MADV_WILLNEED : POSIX_MADV_DONTNEED);
+#endif
+	}
+
+	/**
+	 * Lets go of the least recently used chunks but one until the loaded
+	 * ones fit the budget. The lock must be held.
+	 *
+	 * @param keep The chunk to keep.
+	 */
+	void evict(int keep) {
+		while (resident > budget) {
+			int lru = -1;
+			for (size_t i = 0; i < slots.size(); i++)
+				if ((int) i != keep && slots[i].shapes != 0 && (lru < 0 ||
+						slots[i].lastUse < slots[lru].lastUse))
+					lru = (int) i;
+			if (lru < 0)
+				return;
+			slot &s = slots[lru];
+			s.shapes.reset();
+			resident -= s.bytes;
+			s.bytes = 0;
+			evictions++;
+			adviseRecords(s, false);
+		}
+	}
+
+public:
+
+	/**
+	 * Sets up the chunks of a compiled scene without loading any.
+	 *
+	 * @param compiled The open compiled scene, whose records must be valid
+	 *   spheres and cylinders where there are chunks and which must outlive
+	 *   this store.
+	 * @param budget Most bytes the loaded chunks may take.
+	 */
+	chunkstore(const scenefile &compiled, size_t budget) : budget(budget),
+			resident(0), peak(0), surfaceBytes(0), loads(0), evictions(0),
+			clock(0) {
+		compiled.getPaths(paths);
+		const scenechunk *chunks = compiled.getChunks();
+		slots.resize(compiled.getChunkCount());
+		for (size_t i = 0; i < slots.size(); i++) {
+			slot &s = slots[i];
+			mvector<vec_T, 3> lo, hi;
+			for (int a = 0; a < 3; a++) {
+				lo[a] = (vec_T) chunks[i].lo[a];
+				hi[a] = (vec_T) chunks[i].hi[a];
+			}
+			s.box = aabb<vec_T, 3>(lo, hi);
+			s.records = compiled.getRecords() + chunks[i].first;
+			s.count = (size_t) chunks[i].count;
+			s.bytes = 0;
+			s.lastUse = 0;
+			s.loading = false;
+		}
+	}
+
+	/**
+	 * Keeps something alive as long as this store, such as the mapping of
+	 * the compiled scene when no one else holds it.
+	 *
+	 * @param owner The thing to keep.
+	 */
+	void keep(const boost::shared_ptr<void> &owner) {
+		boost::lock_guard<boost::mutex> guard(lock);
+		owners.push_back(owner);
+	}
+
+	/**
+	 * Checks that the records of the chunks of a compiled scene can be
+	 * loaded by a store, which reads all of them once.
+	 *
+	 * @param compiled The open compiled scene.
+	 * @param[out] error Receives what's wrong, if anything.
+	 *
+	 * @return @c false if a record of a chunk isn't a valid sphere or
+	 *   cylinder.
+	 */
+	static bool checkChunks(const scenefile &compiled, std::string &error) {
+		if (compiled.getChunkCount() == 0)
+			return true;
+		const scenerecord *records = compiled.getRecords();
+		std::vector<std::string> names;
+		compiled.getPaths(names);
+		for (size_t i = (size_t) compiled.getChunks()[0].first;
+				i < compiled.getRecordCount(); i++) {
+			if (!isValidSceneRecord(records[i], names.size())) {
+				error = invalidSceneRecordError(records[i], i);
+				return false;
+			}
+			if (records[i].kind != RECORD_SPHERE &&
+					records[i].kind != RECORD_CYLINDER) {
+				std::ostringstream os;
+				os << "the " << sceneRecordName(records[i].kind) <<
+						" on line " << records[i].line <<
+						" can't be in a chunk.";
+				error = os.str();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Gets the shapes of a chunk, loading it first if it isn't loaded.
+	 * Loading may let go of others.
+	 *
+	 * @param c Index of the chunk.
+	 *
+	 * @return The shapes, which stay loaded as long as they're held.
+	 */
+	sp_assembly acquire(int c) {
+		assert(c >= 0 && c < (int) slots.size());
+		boost::unique_lock<boost::mutex> guard(lock);
+		slot &s = slots[c];
+		while (s.loading)
+			loaded.wait(guard);
+		s.lastUse = ++clock;
+		if (s.shapes != 0)
+			return s.shapes;
+		s.loading = true;
+		guard.unlock();
+
+		boost::shared_ptr<assembly_t> a(new assembly_t());
+		sp_arena pool(new arena());
+		std::string error;
+		for (size_t i = 0; i < s.count; i++) {
+			typename assembly_t::sp_shape obj;
+			makeSceneShape(s.records[i], paths, pool, obj, error);
+			a->addShape(obj);
+		}
+		a->finalize();
+		size_t bytes = pool->getBytesAllocated() + a->getMemoryUsage();
+		// Only loaders touch the colors, one at a time.
+		std::vector<surface_t> surfaces;
+		if (s.surfaces.empty())
+			for (size_t i = 0; i < a->getShapes().size(); i++)
+				surfaces.push_back(surface_t(*a->getShapes()[i]));
+
+		guard.lock();
+		if (!surfaces.empty()) {
+			s.surfaces.swap(surfaces);
+			surfaceBytes += s.surfaces.capacity() * sizeof(surface_t);
+		}
+		s.shapes = a;
+		s.bytes = bytes;
+		s.loading = false;
+		resident += bytes;
+		peak = std::max(peak, resident);
+		loads++;
+		evict(c);
+		loaded.notify_all();
+		return s.shapes;
+	}
+
+	/**
+	 * Gets what hit records keep of a shape of a chunk that has been
+	 * loaded by the caller, which stays valid as long as this store.
+	 *
+	 * @param c Index of the chunk.
+	 * @param i Index of the shape among those of the chunk.
+	 *
+	 * @return Its color and reflectivity.
+	 */
+	const surface_t& getSurface(int c, int i) const {
+		assert(i >= 0 && i < (int) slots[c].surfaces.size());
+		return slots[c].surfaces[i];
+	}
+
+	/**
+	 * Starts remembering the hits of the calling thread's rays in place of
+	 * those it remembered before.
+	 *
+	 * @param rays The rays, where they'll be when their hits are
+	 *   completed.
+	 * @param count Number of rays.
+	 *
+	 * @return The memo to fill in, with no hits.
+	 */
+	hitmemo& remember(const ray_t *rays, int count) {
+		hitmemo *m = memos.get();
+		if (m == 0) {
+			m = new hitmemo();
+			memos.reset(m);
+		}
+		m->rays = rays;
+		m->copies.assign(rays, rays + count);
+		m->recs.assign(count, hitrecord_t());
+		m->chunks.assign(count, -1);
+		return *m;
+	}
+
+	/**
+	 * Fills in a hit record from the calling thread's memo, if it has the
+	 * hit of the ray in the chunk at the record's time.
+	 *
+	 * @param r The ray.
+	 * @param c Index of the chunk.
+	 * @param[in,out] rec The record, whose @c t is the time of the hit.
+	 *
+	 * @return @c false if the hit isn't remembered.
+	 */
+	bool recall(const ray_t &r, int c, hitrecord_t &rec) const {
+		const hitmemo *m = memos.get();
+		if (m == 0 || &r < m->rays || &r >= m->rays + m->copies.size())
+			return false;
+		size_t i = &r - m->rays;
+		const hitrecord_t &hit = m->recs[i];
+		const ray_t &copy = m->copies[i];
+		if (m->chunks[i] != c || hit.t != rec.t)
+			return false;
+		for (int a = 0; a < 3; a++)
+			if (copy.getOrig()[a] != r.getOrig()[a] ||
+					copy.getDir()[a] != r.getDir()[a])
+				return false;
+		rec.point = hit.point;
+		rec.normal = hit.normal;
+		rec.obj = hit.obj;
+		return true;
+	}
+
+	/**
+	 * Tells the operating system that a chunk will be loaded soon, so its
+	 * records can be read in while other chunks are traced.
+	 *
+	 * @param c Index of the chunk.
+	 */
+	void prefetch(int c) {
+		assert(c >= 0 && c < (int) slots.size());
+		if (!isLoaded(c))
+			adviseRecords(slots[c], true);
+	}
+
+	/**
+	 * Checks if a chunk is loaded.
+	 *
+	 * @param c Index of the chunk.
+	 *
+	 * @return @c true if its shapes are in memory.
+	 */
+	bool isLoaded(int c) const {
+		boost::lock_guard<boost::mutex> guard(lock);
+		return slots[c].shapes != 0;
+	}
+
+	/**
+	 * Gets the number of chunks.
+	 *
+	 * @return Chunk count.
+	 */
+	int getChunkCount() const {
+		return (int) slots.size();
+	}
+
+	/**
+	 * Gets the box around the shapes of a chunk, without loading it.
+	 *
+	 * @param c Index of the chunk.
+	 *
+	 * @return The box.
+	 */
+	const aabb<vec_T, 3>& getBox(int c) const {
+		return slots[c].box;
+	}
+
+	/**
+	 * Gets the budget.
+	 *
+	 * @return Most bytes the loaded chunks may take.
+	 */
+	size_t getBudget() const {
+		return budget;
+	}
+
+	/**
+	 * Gets the bytes the loaded chunks take.
+	 *
+	 * @return Bytes in memory.
+	 */
+	size_t getResidentBytes() const {
+		boost::lock_guard<boost::mutex> guard(lock);
+		return resident;
+	}
+
+	/**
+	 * Gets the most bytes the loaded chunks took at once.
+	 *
+	 * @return Peak bytes in memory.
+	 */
+	size_t getPeakBytes() const {
+		boost::lock_guard<boost::mutex> guard(lock);
+		return peak;
+	}
+
+	/**
+	 * Gets the bytes the colors of the shapes of chunks that were ever
+	 * loaded take, which aren't let go with the chunks.
+	 *
+	 * @return Bytes in memory.
+	 */
+	size_t getSurfaceBytes() const {
+		boost::lock_guard<boost::mutex> guard(lock);
+		return surfaceBytes;
+	}
+
+	/**
+	 * Gets the number of times a chunk was loaded.
+	 *
+	 * @return Load count.
+	 */
+	unsigned long long getLoadCount() const {
+		boost::lock_guard<boost::mutex> guard(lock);
+		return loads;
+	}
+
+	/**
+	 * Gets the number of times a chunk was let go.
+	 *
+	 * @return Eviction count.
+	 */
+	unsigned long long getEvictionCount() const {
+		boost::lock_guard<boost::mutex> guard(lock);
+		return evictions;
+	}
+};
+
+/**
+ * A shape standing for a chunk of a @c chunkstore in a scene, so the
+ * scene's hierarchy holds just the chunk's box. Rays that reach it load
+ * the chunk, as for a @c lazygeometry , but a @c chunkaccel traces the
+ * chunks itself, in batches; hits are completed here.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+class geometrychunk : public shape<vec_T, color_T, time_T, 3> {
+public:
+
+	/**
+	 * Boost shared pointer typedef for stores.
+	 */
+	typedef boost::shared_ptr<chunkstore<vec_T, color_T, time_T> > sp_store;
+
+private:
+
+	/**
+	 * The store of the chunk.
+	 */
+	sp_store store;
+
+	/**
+	 * Index of the chunk.
+	 */
+	int chunk;
+
+public:
+
+	/**
+	 * Constructs the shape without loading anything.
+	 *
+	 * @param theStore The store of the chunk.
+	 * @param theChunk Index of the chunk.
+	 */
+	geometrychunk(const sp_store &theStore, int theChunk) :
+			shape<vec_T, color_T, time_T, 3>(), store(theStore),
+			chunk(theChunk) {
+		assert(store != 0);
+		assert(chunk >= 0 && chunk < store->getChunkCount());
+	}
+
+	/**
+	 * Gets the store.
+	 *
+	 * @return The store of the chunk.
+	 */
+	const sp_store& getStore() const {
+		return store;
+	}
+
+	/**
+	 * Gets the chunk.
+	 *
+	 * @return Index of the chunk in its store.
+	 */
+	int getChunk() const {
+		return chunk;
+	}
+
+	/**
+	 * Gets the earliest time at which the given ray hits a shape of the
+	 * chunk, loading it first if needed.
+	 *
+	 * @param r The ray.
+	 *
+	 * @return The time of the closest hit or @c RAY_MISS .
+	 */
+	time_T intersection(const ray<vec_T, time_T, 3> &r) const {
+		time_T t;
+		if (store->acquire(chunk)->closestHit(r, t) == 0)
+			return RAY_MISS;
+		return t;
+	}
+
+	/**
+	 * Fills in a hit record for a hit found by @c intersection with the
+	 * shape that was hit, but with the record's object the shape's
+	 * @c chunksurface , which outlives the chunk. Hits a @c chunkaccel
+	 * just found on this thread are completed without the chunk.
+	 *
+	 * @param r The ray.
+	 * @param[in,out] rec The record, whose @c t is the time of the hit.
+	 */
+	void completeHit(const ray<vec_T, time_T, 3> &r,
+			hitrecord<vec_T, color_T, time_T, 3> &rec) const {
+		if (store->recall(r, chunk, rec))
+			return;
+		typename chunkstore<vec_T, color_T, time_T>::sp_assembly a =
+				store->acquire(chunk);
+		time_T t;
+		int hit = a->closestHitIndex(r, t);
+		if (hit < 0) {
+			shape<vec_T, color_T, time_T, 3>::completeHit(r, rec);
+			return;
+		}
+		a->getShapes()[hit]->completeHit(r, rec);
+		rec.obj = &store->getSurface(chunk, hit);
+	}
+
+	/**
+	 * Gets the surface normal at the given point on the first shape of the
+	 * chunk whose box contains it. Shading goes through @c completeHit ,
+	 * which knows the ray and doesn't have to guess.
+	 *
+	 * @param surfacePt The point at which to get a surface normal.
+	 *
+	 * @return The surface normal.
+	 */
+	mvector<vec_T, 3> surfaceNorm(const mvector<vec_T, 3> &surfacePt) const {
+		typename chunkstore<vec_T, color_T, time_T>::sp_assembly a =
+				store->acquire(chunk);
+		const std::vector<typename assembly<vec_T, color_T, time_T,
+				3>::sp_shape> &list = a->getShapes();
+		for (size_t i = 0; i < list.size(); i++) {
+			aabb<vec_T, 3> b;
+			list[i]->getBounds(b);
+			bool inside = true;
+			for (int j = 0; j < 3; j++)
+				inside = inside && surfacePt[j] >= b.getMin()[j] &&
+						surfacePt[j] <= b.getMax()[j];
+			if (inside)
+				return list[i]->surfaceNorm(surfacePt);
+		}
+		mvector<vec_T, 3> up;
+		up[2] = 1;
+		return up;
+	}
+
+	/**
+	 * Gets the box of the chunk, without loading anything.
+	 *
+	 * @param[out] theBox Receives the bounding box.
+	 *
+	 * @return @c true .
+	 */
+	bool getBounds(aabb<vec_T, 3> &theBox) const {
+		theBox = store->getBox(chunk);
+		return true;
+	}
+
+	/**
+	 * Print helper function.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printHelper(std::ostream &os) const {
+		os << "[geometry chunk " << chunk << ", " <<
+				(store->isLoaded(chunk) ? "loaded" : "unloaded") << "]";
+	}
+};
+
+/**
+ * An acceleration structure for scenes whose shapes are mostly in the
+ * chunks of a @c chunkstore : the @c geometrychunk shapes among those it's
+ * built over are traced here, the others by an accelerator of the usual
+ * kind. A ray goes through the chunks whose boxes it enters, nearest first,
+ * until the next one starts beyond the closest hit so far.
+ *
+ * A batch of rays, like the wavefront of a frame, is instead queued by
+ * chunk: every ray waits at the next chunk it enters, and the queues are
+ * traced one chunk at a time, those whose chunk is loaded first and then
+ * the longest, while the records of the next chunk are read in. Loading a
+ * chunk is then paid for once per batch instead of once per ray, which is
+ * what keeps a scene larger than memory from thrashing.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+class chunkaccel : public accelerator<vec_T, color_T, time_T, 3> {
+public:
+
+	/**
+	 * Boost shared pointer typedef for shapes.
+	 */
+	typedef typename accelerator<vec_T, color_T, time_T, 3>::sp_shape sp_shape;
+
+	/**
+	 * Boost shared pointer typedef for the accelerator of the other shapes.
+	 */
+	typedef boost::shared_ptr<accelerator<vec_T, color_T, time_T, 3> >
+		sp_accelerator;
+
+	/**
+	 * Boost shared pointer typedef for stores.
+	 */
+	typedef boost::shared_ptr<chunkstore<vec_T, color_T, time_T> > sp_store;
+
+private:
+
+	/**
+	 * A chunk a ray enters and when.
+	 */
+	typedef std::pair<time_T, int> entry;
+
+	/**
+	 * A node of the hierarchy over the boxes of the chunks.
+	 */
+	struct cnode {
+		/** Box around the chunks below. */
+		aabb<vec_T, 3> box;
+		/** The second child, the first being the next node, or -1 for a
+		 * leaf. */
+		int right;
+		/** Index in @c chunkIds of the chunk of a leaf. */
+		int slot;
+	};
+
+	/**
+	 * The accelerator of the shapes that aren't chunks.
+	 */
+	sp_accelerator inner;
+
+	/**
+	 * The store of the chunks.
+	 */
+	sp_store store;
+
+	/**
+	 * Index of each shape of @c inner among the shapes this is built over.
+	 */
+	std::vector<int> innerIds;
+
+	/**
+	 * Index of each chunk among the shapes this is built over.
+	 */
+	std::vector<int> chunkIds;
+
+	/**
+	 * Index of each chunk in @c store .
+	 */
+	std::vector<int> chunks;
+
+	/**
+	 * Box of each chunk.
+	 */
+	std::vector<aabb<vec_T, 3> > boxes;
+
+	/**
+	 * The hierarchy over the chunks, root first, or empty if there are
+	 * none.
+	 */
+	std::vector<cnode> nodes;
+
+	/**
+	 * Builds the nodes over some chunks, split at the median center along
+	 * the longest axis.
+	 *
+	 * @param order Indices into @c chunks .
+	 * @param start The first.
+	 * @param end One past the last.
+	 */
+	void buildNodes(std::vector<int> &order, int start, int end) {
+		int n = (int) nodes.size();
+		nodes.push_back(cnode());
+		aabb<vec_T, 3> box, centers;
+		for (int i = start; i < end; i++) {
+			const aabb<vec_T, 3> &b = boxes[order[i]];
+			box.extend(b);
+			centers.extend((b.getMin() + b.getMax()) / 2);
+		}
+		nodes[n].box = box;
+		nodes[n].right = -1;
+		nodes[n].slot = order[start];
+		if (end - start == 1)
+			return;
+		int axis = 0;
+		for (int a = 1; a < 3; a++)
+			if (centers.getMax()[a] - centers.getMin()[a] >
+					centers.getMax()[axis] - centers.getMin()[axis])
+				axis = a;
+		int mid = start + (end - start) / 2;
+		std::vector<int>::iterator b = order.begin();
+		std::nth_element(b + start, b + mid, b + end,
+				chunkcenterless<vec_T>(boxes, axis));
+		buildNodes(order, start, mid);
+		int right = (int) nodes.size();
+		buildNodes(order, mid, end);
+		nodes[n].right = right;
+	}
+
+	/**
+	 * Finds the chunks a ray enters before the given time, nearest first.
+	 *
+	 * @param q The prepared ray.
+	 * @param tmax Chunks entered at or after this time are left out.
+	 * @param[out] entered Receives when the ray enters each chunk and its
+	 *   index in @c chunkIds , in order.
+	 */
+	void enterChunks(const rayquery<vec_T, time_T, 3> &q, time_T tmax,
+			std::vector<entry> &entered) const {
+		entered.clear();
+		if (nodes.empty())
+			return;
+		int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			const cnode &n = nodes[stack[--top]];
+			vec_T lo[3], hi[3];
+			for (int i = 0; i < 3; i++) {
+				lo[i] = n.box.getMin()[i];
+				hi[i] = n.box.getMax()[i];
+			}
+			time_T tnear;
+			if (!q.slabs(lo, hi, tmax, tnear))
+				continue;
+			if (n.right < 0) {
+				entered.push_back(entry(tnear, n.slot));
+				continue;
+			}
+			stack[top++] = n.right;
+			stack[top++] = (int) (&n - &nodes[0]) + 1;
+		}
+		std::sort(entered.begin(), entered.end());
+	}
+
+	/**
+	 * Traces a ray through the chunk it enters, keeping the hit if it's
+	 * closer than the one so far and completing it while the chunk is
+	 * loaded.
+	 *
+	 * @param a The shapes of the chunk.
+	 * @param r The ray.
+	 * @param slot Index of the chunk in @c chunkIds .
+	 * @param[in,out] hit Index of the shape hit so far, or -1.
+	 * @param[in,out] t Time of that hit.
+	 * @param memo The memo of the calling thread.
+	 * @param i Index of the ray in @c memo .
+	 */
+	void traceChunk(const assembly<vec_T, color_T, time_T, 3> &a,
+			const ray<vec_T, time_T, 3> &r, int slot, int &hit, time_T &t,
+			typename chunkstore<vec_T, color_T, time_T>::hitmemo &memo,
+			int i) const {
+		time_T tc;
+		int idx = a.closestHitIndex(r, tc);
+		if (idx < 0 || (hit >= 0 && !(tc < t)))
+			return;
+		hit = chunkIds[slot];
+		t = tc;
+		hitrecord<vec_T, color_T, time_T, 3> &rec = memo.recs[i];
+		rec.t = tc;
+		a.getShapes()[idx]->completeHit(r, rec);
+		rec.obj = &store->getSurface(chunks[slot], idx);
+		memo.chunks[i] = chunks[slot];
+	}
+
+	/**
+	 * Gets the closest hit of a ray among the shapes of @c inner .
+	 */
+	int innerHit(const ray<vec_T, time_T, 3> &r, time_T &t) const {
+		t = RAY_MISS;
+		if (innerIds.empty())
+			return -1;
+		int idx = inner->closestHit(r, t);
+		return idx >= 0 ? innerIds[idx] : -1;
+	}
+
+	/**
+	 * Picks the queue to trace next: of those with rays, one whose chunk
+	 * the fewest rays will still come to later, since tracing it now would
+	 * have it loaded again for them; of those, one whose chunk is loaded,
+	 * and then the longest.
+	 *
+	 * @param queues The rays waiting at each chunk.
+	 * @param pending Number of rays that will come to each chunk after
+	 *   the ones waiting.
+	 * @param skip A queue to leave out, or -1.
+	 *
+	 * @return Index of the queue, or -1 if none has rays.
+	 */
+	int pickQueue(const std::vector<std::vector<int> > &queues,
+			const std::vector<int> &pending, int skip) const {
+		int best = -1;
+		bool bestLoaded = false;
+		for (size_t i = 0; i < queues.size(); i++) {
+			if (queues[i].empty() || (int) i == skip ||
+					(best >= 0 && pending[i] > pending[best]))
+				continue;
+			bool loaded = store->isLoaded(chunks[i]);
+			if (best < 0 || pending[i] < pending[best] ||
+					(loaded && !bestLoaded) || (loaded == bestLoaded &&
+					queues[i].size() > queues[best].size())) {
+				best = (int) i;
+				bestLoaded = loaded;
+			}
+		}
+		return best;
+	}
+
+public:
+
+	/**
+	 * Constructs an empty structure.
+	 *
+	 * @param theInner The accelerator of the shapes that aren't chunks.
+	 * @param theStore The store the chunks among the shapes are of.
+	 */
+	chunkaccel(const sp_accelerator &theInner, const sp_store &theStore) :
+			inner(theInner), store(theStore) {
+		assert(inner != 0);
+		assert(store != 0);
+	}
+
+	/**
+	 * Gets the store.
+	 *
+	 * @return The store of the chunks.
+	 */
+	const sp_store& getStore() const {
+		return store;
+	}
+
+	/**
+	 * Gets the accelerator of the shapes that aren't chunks.
+	 *
+	 * @return The inner accelerator.
+	 */
+	const sp_accelerator& getInner() const {
+		return inner;
+	}
+
+	/**
+	 * Builds the hierarchy over the chunks of @c store among the given
+	 * shapes, and @c inner over the others.
+	 *
+	 * @param shapes The shapes.
+	 */
+	void build(const std::vector<sp_shape> &shapes) {
+		std::vector<sp_shape> others;
+		innerIds.clear();
+		chunkIds.clear();
+		chunks.clear();
+		boxes.clear();
+		nodes.clear();
+		for (size_t i = 0; i < shapes.size(); i++) {
+			const geometrychunk<vec_T, color_T, time_T> *c =
+					dynamic_cast<const geometrychunk<vec_T, color_T, time_T> *>(
+					shapes[i].get());
+			if (c != 0 && c->getStore() == store) {
+				chunkIds.push_back((int) i);
+				chunks.push_back(c->getChunk());
+				boxes.push_back(store->getBox(c->getChunk()));
+			}
+			else {
+				innerIds.push_back((int) i);
+				others.push_back(shapes[i]);
+			}
+		}
+		inner->build(others);
+		if (chunks.empty())
+			return;
+		std::vector<int> order(chunks.size());
+		for (size_t i = 0; i < order.size(); i++)
+			order[i] = (int) i;
+		buildNodes(order, 0, (int) order.size());
+	}
+
+	/**
+	 * Refits @c inner ; chunks don't move.
+	 *
+	 * @return @c true if @c inner was refit.
+	 */
+	bool refit() {
+		return inner->refit();
+	}
+
+	/**
+	 * Finds the closest shape hit by the given ray, tracing the chunks it
+	 * enters nearest first.
+	 *
+	 * @param r The ray.
+	 * @param[out] tIntersect The time of the hit or @c RAY_MISS .
+	 *
+	 * @return Index of the shape that was hit or -1 if there was no hit.
+	 */
+	int closestHit(const ray<vec_T, time_T, 3> &r, time_T &tIntersect) const {
+		int hit = innerHit(r, tIntersect);
+		if (nodes.empty())
+			return hit;
+		rayquery<vec_T, time_T, 3> q(r);
+		std::vector<entry> entered;
+		enterChunks(q, hit >= 0 ? tIntersect :
+				std::numeric_limits<time_T>::max(), entered);
+		if (entered.empty())
+			return hit;
+		typename chunkstore<vec_T, color_T, time_T>::hitmemo &memo =
+				store->remember(&r, 1);
+		for (size_t i = 0; i < entered.size(); i++) {
+			if (hit >= 0 && entered[i].first > tIntersect)
+				break;
+			traceChunk(*store->acquire(chunks[entered[i].second]), r,
+					entered[i].second, hit, tIntersect, memo, 0);
+		}
+		return hit;
+	}
+
+	/**
+	 * Checks if the given ray hits any shape before @c tmax , trying the
+	 * other shapes first and the chunks after.
+	 *
+	 * @param r The ray.
+	 * @param tmax Hits at or beyond this time are ignored.
+	 *
+	 * @return Index of some shape that blocks the ray, or -1.
+	 */
+	int anyHit(const ray<vec_T, time_T, 3> &r, time_T tmax) const {
+		if (!innerIds.empty()) {
+			int idx = inner->anyHit(r, tmax);
+			if (idx >= 0)
+				return innerIds[idx];
+		}
+		rayquery<vec_T, time_T, 3> q(r);
+		std::vector<entry> entered;
+		enterChunks(q, tmax, entered);
+		for (size_t i = 0; i < entered.size(); i++) {
+			time_T t;
+			if (store->acquire(chunks[entered[i].second])->closestHit(r, t) !=
+					0 && t < tmax)
+				return chunkIds[entered[i].second];
+		}
+		return -1;
+	}
+
+	/**
+	 * Finds the closest hits of a batch of rays, as @c closestHit would,
+	 * with the rays queued by chunk so each chunk is traced for all the
+	 * rays waiting at it at once.
+	 *
+	 * @param rays The rays.
+	 * @param count Number of rays.
+	 * @param[out] hits Receives the index of the shape each ray hit or -1.
+	 * @param[out] tIntersect Receives the time of each hit or @c RAY_MISS .
+	 */
+	void closestHits(const ray<vec_T, time_T, 3> *rays, int count, int *hits,
+			time_T *tIntersect) const {
+		if (innerIds.empty()) {
+			for (int i = 0; i < count; i++) {
+				hits[i] = -1;
+				tIntersect[i] = RAY_MISS;
+			}
+		}
+		else {
+			inner->closestHits(rays, count, hits, tIntersect);
+			for (int i = 0; i < count; i++)
+				if (hits[i] >= 0)
+					hits[i] = innerIds[hits[i]];
+		}
+		if (nodes.empty())
+			return;
+
+		// The chunks each ray enters, nearest first, and the next one it
+		// waits at.
+		std::vector<entry> entered, visits;
+		std::vector<int> next(count), end(count);
+		std::vector<std::vector<int> > queues(chunks.size());
+		std::vector<int> pending(chunks.size(), 0);
+		for (int i = 0; i < count; i++) {
+			rayquery<vec_T, time_T, 3> q(rays[i]);
+			enterChunks(q, hits[i] >= 0 ? tIntersect[i] :
+					std::numeric_limits<time_T>::max(), entered);
+			next[i] = (int) visits.size();
+			visits.insert(visits.end(), entered.begin(), entered.end());
+			end[i] = (int) visits.size();
+			if (next[i] < end[i])
+				queues[visits[next[i]].second].push_back(i);
+			for (int v = next[i] + 1; v < end[i]; v++)
+				pending[visits[v].second]++;
+		}
+
+		typename chunkstore<vec_T, color_T, time_T>::hitmemo &memo =
+				store->remember(rays, count);
+		std::vector<int> batch;
+		int slot = pickQueue(queues, pending, -1);
+		while (slot >= 0) {
+			batch.swap(queues[slot]);
+			queues[slot].clear();
+			typename chunkstore<vec_T, color_T, time_T>::sp_assembly a =
+					store->acquire(chunks[slot]);
+			int after = pickQueue(queues, pending, slot);
+			if (after >= 0)
+				store->prefetch(chunks[after]);
+			for (size_t k = 0; k < batch.size(); k++) {
+				int i = batch[k];
+				traceChunk(*a, rays[i], slot, hits[i], tIntersect[i], memo,
+						i);
+				// Wait at the next chunk, unless it starts past the hit,
+				// in which case the ray won't come to the ones after.
+				if (++next[i] >= end[i])
+					continue;
+				if (hits[i] >= 0 && visits[next[i]].first > tIntersect[i]) {
+					for (int v = next[i]; v < end[i]; v++)
+						pending[visits[v].second]--;
+					next[i] = end[i];
+					continue;
+				}
+				pending[visits[next[i]].second]--;
+				queues[visits[next[i]].second].push_back(i);
+			}
+			a.reset();
+			slot = pickQueue(queues, pending, -1);
+		}
+	}
+
+	/**
+	 * Gets the number of bytes of this structure, @c inner and the chunks
+	 * that are loaded.
+	 *
+	 * @return Memory footprint in bytes.
+	 */
+	size_t getMemoryUsage() const {
+		return inner->getMemoryUsage() + nodes.size() * sizeof(cnode) +
+				(innerIds.size() + 2 * chunks.size()) * sizeof(int) +
+				boxes.size() * sizeof(boxes[0]) +
+				store->getResidentBytes() + store->getSurfaceBytes();
+	}
+
+	/**
+	 * Prints the chunks and how they were loaded.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printHelper(std::ostream &os) const {
+		os << "[chunks: " << chunks.size() << ", loaded: " <<
+				store->getResidentBytes() << " of " << store->getBudget() <<
+				" bytes, peak: " << store->getPeakBytes() << ", loads: " <<
+				store->getLoadCount() << ", evictions: " <<
+				store->getEvictionCount() << ", colors: " <<
+				store->getSurfaceBytes() << " bytes, others: " << *inner <<
+				"]";
+	}
+};
+
+/**
+ * Adds the objects of a compiled scene with chunks to a scene without
+ * loading the chunks: the records before the chunks are added with
+ * @c addSceneRecords , a @c geometrychunk for each chunk, and the scene's
+ * accelerator is wrapped in a @c chunkaccel over a new @c chunkstore . The
+ * scene still has to be finalized, without the compiled tree.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ *
+ * @param sc The scene, with its accelerator set; a BVH is used for the
+ *   shapes that aren't chunks if it has none.
+ * @param compiled The open compiled scene, with chunks, whose bytes must
+ *   outlive the scene or be handed to @c chunkstore::keep .
+ * @param budget Most bytes the loaded chunks may take.
+ * @param[out] cam Receives the last camera.
+ * @param[out] error Receives what's wrong with the scene, if anything.
+ * @param[out] cameras If not null, receives every camera in order.
+ * @param[out] anim If not null, receives the keys of the objects.
+ *
+ * @return @c false if a record is invalid.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+bool addOutOfCoreScene(scene<vec_T, color_T, time_T, 3> &sc,
+		const scenefile &compiled, size_t budget,
+		boost::shared_ptr<camera<vec_T, time_T, 3> > &cam,
+		std::string &error,
+		std::vector<scenecamera<vec_T, time_T> > *cameras = 0,
+		animation<vec_T, color_T, time_T> *anim = 0) {
+	typedef chunkstore<vec_T, color_T, time_T> store_t;
+	typedef chunkaccel<vec_T, color_T, time_T> accel_t;
+	assert(compiled.getChunkCount() > 0);
+	std::vector<std::string> paths;
+	compiled.getPaths(paths);
+	if (!store_t::checkChunks(compiled, error) || !addSceneRecords(sc,
+			compiled.getRecords(), (size_t) compiled.getChunks()[0].first,
+			paths, cam, error, cameras, anim))
+		return false;
+	typename accel_t::sp_store store(new store_t(compiled, budget));
+	for (int c = 0; c < store->getChunkCount(); c++)
+		sc.addShape(boost::shared_ptr<shape<vec_T, color_T, time_T, 3> >(
+				new geometrychunk<vec_T, color_T, time_T>(store, c)));
+	typename accel_t::sp_accelerator inner = sc.getAccelerator();
+	if (inner == 0)
+		inner.reset(new bvh<vec_T, color_T, time_T, 3>());
+	sc.setAccelerator(typename accel_t::sp_accelerator(
+			new accel_t(inner, store)));
+	return true;
+}
+
+typedef chunkstore<double, double, double> chunkstore3d;
+typedef chunkstore<double, double, float> chunkstore3ddf;
+typedef chunkstore<float, float, float> chunkstore3f;
+typedef boost::shared_ptr<chunkstore3d> sp_chunkstore3d;
+typedef boost::shared_ptr<chunkstore3ddf> sp_chunkstore3ddf;
+typedef boost::shared_ptr<chunkstore3f> sp_chunkstore3f;
+typedef chunksurface<double, double, double> chunksurface3d;
+typedef chunksurface<double, double, float> chunksurface3ddf;
+typedef chunksurface<float, float, float> chunksurface3f;
+typedef geometrychunk<double, double, double> geometrychunk3d;
+typedef geometrychunk<double, double, float> geometrychunk3ddf;
+typedef geometrychunk<float, float, float> geometrychunk3f;
+typedef chunkaccel<double, double, double> chunkaccel3d;
+typedef chunkaccel<double, double, float> chunkaccel3ddf;
+typedef chunkaccel<float, float, float> chunkaccel3f;
+typedef boost::shared_ptr<chunkaccel3d> sp_chunkaccel3d;
+typedef boost::shared_ptr<chunkaccel3ddf> sp_chunkaccel3ddf;
+typedef boost::shared_ptr<chunkaccel3f> sp_chunkaccel3f;
+
+#endif // OUTOFCORE_HH
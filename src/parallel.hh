@@ -0,0 +1,436 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "boost/thread.hpp"
+#include "boost/scoped_array.hpp"
+#include "boost/noncopyable.hpp"
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#ifndef PARALLEL_HH
+#define PARALLEL_HH
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/**
+ * Gets the number of hardware threads, or 1 if that can't be determined.
+ *
+ * @return Number of hardware threads.
+ */
+inline int hardwareThreads() {
+	int n = (int) boost::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
+
+/**
+ * Pins the thread that makes it to one hardware thread for as long as it
+ * lives and then lets it run anywhere it could before. Besides keeping a
+ * thread's caches warm, this tends to put the pages it writes first, like
+ * those of its scratch buffers, on its own NUMA node, since Linux places
+ * pages on the node of the thread that first writes them; nothing is
+ * allocated on a node explicitly, and memory written before, like the
+ * scene, stays where it is. Threads are only pinned to
+ * the hardware threads the process was allowed to run on when it first
+ * pinned one, e.g. by @c taskset or a container's CPU set. Pinning is only
+ * supported on Linux; elsewhere it fails.
+ */
+class threadpin : private boost::noncopyable {
+private:
+
+#ifdef __linux__
+	/**
+	 * The hardware threads the thread could run on before.
+	 */
+	cpu_set_t saved;
+#endif
+
+	/**
+	 * Whether the thread was pinned.
+	 */
+	bool pinned;
+
+	/**
+	 * Reads the hardware threads the calling thread may run on.
+	 *
+	 * @return Their numbers in order, or none if they can't be read.
+	 */
+	static std::vector<int> readAllowedCpus() {
+		std::vector<int> cpus;
+#ifdef __linux__
+		cpu_set_t mask;
+		CPU_ZERO(&mask);
+		if (sched_getaffinity(0, sizeof(mask), &mask) == 0)
+			for (int c = 0; c < CPU_SETSIZE; c++)
+				if (CPU_ISSET(c, &mask))
+					cpus.push_back(c);
+#endif
+		return cpus;
+	}
+
+	/**
+	 * Gets the lock that guards @c getCounts .
+	 */
+	static boost::mutex& countLock() {
+		static boost::mutex lock;
+		return lock;
+	}
+
+	/**
+	 * Gets the numbers of threads pinned and of those that failed to be.
+	 */
+	static std::pair<int, int>& getCounts() {
+		static std::pair<int, int> counts(0, 0);
+		return counts;
+	}
+
+public:
+
+	/**
+	 * Gets the hardware threads the process may run on, read the first
+	 * time it's asked.
+	 *
+	 * @return Their numbers in order, or none if they can't be read.
+	 */
+	static const std::vector<int>& allowedCpus() {
+		static std::vector<int> cpus = readAllowedCpus();
+		return cpus;
+	}
+
+	/**
+	 * Pins the calling thread.
+	 *
+	 * @param cpu Index into @c allowedCpus of the hardware thread, taken
+	 *   modulo their number, or -1 to leave the thread alone.
+	 */
+	explicit threadpin(int cpu) : pinned(false) {
+		if (cpu < 0)
+			return;
+#ifdef __linux__
+		const std::vector<int> &cpus = allowedCpus();
+		if (!cpus.empty() && pthread_getaffinity_np(pthread_self(),
+				sizeof(saved), &saved) == 0) {
+			cpu_set_t one;
+			CPU_ZERO(&one);
+			CPU_SET(cpus[cpu % cpus.size()], &one);
+			pinned = pthread_setaffinity_np(pthread_self(), sizeof(one),
+					&one) == 0;
+		}
+#endif
+		boost::mutex::scoped_lock guard(countLock());
+		if (pinned)
+			getCounts().first++;
+		else
+			getCounts().second++;
+	}
+
+	/**
+	 * Lets the thread run where it could before.
+	 */
+	~threadpin() {
+#ifdef __linux__
+		if (pinned)
+			pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+#endif
+	}
+
+	/**
+	 * Tells if the thread was pinned.
+	 *
+	 * @return @c false if pinning wasn't asked for, failed or isn't
+	 *   supported.
+	 */
+	bool isPinned() const {
+		return pinned;
+	}
+
+	/**
+	 * Prints how many threads were pinned and how many failed to be, of
+	 * how many hardware threads they could be pinned to.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	static void printStats(std::ostream &os) {
+		boost::mutex::scoped_lock guard(countLock());
+		os << "pinning: " << getCounts().first << " threads pinned, " <<
+				getCounts().second << " failed, to " <<
+				allowedCpus().size() << " allowed hardware threads" <<
+				std::endl;
+	}
+};
+
+/**
+ * Runs one chunk of a @c parallelFor on a worker thread.
+ *
+ * @tparam func Functor type with an @c operator()(int, int) .
+ */
+template<typename func>
+struct parallelForChunk {
+	/** The functor shared by all chunks. */
+	const func *f;
+	/** First index of the chunk. */
+	int lo;
+	/** One past the last index of the chunk. */
+	int hi;
+
+	void operator()() const {
+		(*f)(lo, hi);
+	}
+};
+
+/**
+ * Splits @c [begin, end) into one contiguous chunk per thread and calls
+ * @c f(lo, hi) for each chunk concurrently. The calling thread runs the
+ * first chunk itself and returns once all chunks are done. With one thread,
+ * or a range too small to split, everything runs on the calling thread.
+ *
+ * @param begin First index.
+ * @param end One past the last index.
+ * @param numThreads Number of threads to use, at least 1.
+ * @param f Functor with an @c operator()(int lo, int hi) const that is safe
+ *   to call concurrently on disjoint ranges.
+ */
+template<typename func>
+void parallelFor(int begin, int end, int numThreads, const func &f) {
+	assert(numThreads > 0);
+	int n = end - begin;
+	if (n <= 0)
+		return;
+	if (numThreads > n)
+		numThreads = n;
+	if (numThreads == 1) {
+		f(begin, end);
+		return;
+	}
+	boost::thread_group workers;
+	for (int i = 1; i < numThreads; i++) {
+		parallelForChunk<func> chunk;
+		chunk.f = &f;
+		chunk.lo = begin + (int) ((long long) n * i / numThreads);
+		chunk.hi = begin + (int) ((long long) n * (i + 1) / numThreads);
+		workers.create_thread(chunk);
+	}
+	f(begin, begin + n / numThreads);
+	workers.join_all();
+}
+
+/**
+ * The tasks of one thread of a @c parallelTasks . The thread takes them
+ * from the front; other threads that ran out of tasks steal from the back.
+ */
+struct taskdeque {
+	/** Guards @c tasks . */
+	boost::mutex lock;
+	/** The tasks nobody started yet. */
+	std::deque<int> tasks;
+};
+
+/**
+ * Runs the tasks of a @c parallelTasks on one thread: first its own, in
+ * order, then ones stolen from the others until there are none left.
+ *
+ * @tparam func Functor type with an @c operator()(int, int) .
+ */
+template<typename func>
+struct parallelTaskWorker {
+	/** The functor shared by all threads. */
+	const func *f;
+	/** The deque of every thread. */
+	taskdeque *deques;
+	/** Number of threads. */
+	int numThreads;
+	/** Index of the thread this runs on. */
+	int thread;
+	/** Whether to pin the thread to the hardware thread of its index. */
+	bool pin;
+
+	/**
+	 * Takes the next task of this thread's deque.
+	 *
+	 * @param[out] i Receives the task.
+	 *
+	 * @return @c false if the deque is empty.
+	 */
+	bool pop(int &i) const {
+		taskdeque &own = deques[thread];
+		boost::mutex::scoped_lock guard(own.lock);
+		if (own.tasks.empty())
+			return false;
+		i = own.tasks.front();
+		own.tasks.pop_front();
+		return true;
+	}
+
+	/**
+	 * Moves the back half of the first other deque that isn't empty, in
+	 * order, to this thread's deque. Taking a run of neighboring tasks
+	 * instead of one keeps the thief busy on tasks close to each other.
+	 *
+	 * @return @c false if every other deque is empty.
+	 */
+	bool steal() const {
+		std::vector<int> loot;
+		for (int k = 1; k < numThreads && loot.empty(); k++) {
+			taskdeque &victim = deques[(thread + k) % numThreads];
+			boost::mutex::scoped_lock guard(victim.lock);
+			size_t n = (victim.tasks.size() + 1) / 2;
+			loot.assign(victim.tasks.end() - n, victim.tasks.end());
+			victim.tasks.erase(victim.tasks.end() - n, victim.tasks.end());
+		}
+		if (loot.empty())
+			return false;
+		taskdeque &own = deques[thread];
+		boost::mutex::scoped_lock guard(own.lock);
+		own.tasks.insert(own.tasks.end(), loot.begin(), loot.end());
+		return true;
+	}
+
+	void operator()() const {
+		threadpin p(pin ? thread : -1);
+		int i;
+		for (;;) {
+			while (pop(i))
+				(*f)(i, thread);
+			if (!steal())
+				return;
+		}
+	}
+};
+
+/**
+ * Calls @c f(i, thread) for every task @c i in the given list on up to
+ * @c numThreads threads, for tasks whose costs differ a lot. Each thread
+ * starts with a contiguous run of the list and works through it in order;
+ * a thread that runs out steals the back half of another thread's remaining
+ * tasks. So list neighboring tasks next to each other, e.g. in
+ * @c mortonOrder , and each thread mostly runs tasks that are close to each
+ * other. @c thread is the index, below @c numThreads , of the thread running
+ * the task, e.g. to pick its scratch state. The calling thread is thread 0
+ * and returns once all tasks are done. With one thread the tasks run in list
+ * order on the calling thread.
+ *
+ * @param tasks The tasks.
+ * @param numThreads Number of threads to use, at least 1.
+ * @param f Functor with an @c operator()(int i, int thread) const that is
+ *   safe to call concurrently for different tasks and threads.
+ * @param pin Whether to keep each thread on the hardware thread of its
+ *   index while it runs tasks; see @c threadpin .
+ */
+template<typename func>
+void parallelTasks(const std::vector<int> &tasks, int numThreads,
+		const func &f, bool pin = false) {
+	assert(numThreads > 0);
+	int n = (int) tasks.size();
+	if (numThreads > n)
+		numThreads = n;
+	if (numThreads <= 1) {
+		threadpin p(pin ? 0 : -1);
+		for (int i = 0; i < n; i++)
+			f(tasks[i], 0);
+		return;
+	}
+	boost::scoped_array<taskdeque> deques(new taskdeque[numThreads]);
+	for (int t = 0; t < numThreads; t++)
+		deques[t].tasks.assign(
+				tasks.begin() + (int) ((long long) n * t / numThreads),
+				tasks.begin() + (int) ((long long) n * (t + 1) / numThreads));
+	parallelTaskWorker<func> worker;
+	worker.f = &f;
+	worker.deques = deques.get();
+	worker.numThreads = numThreads;
+	worker.pin = pin;
+	boost::thread_group workers;
+	for (int t = 1; t < numThreads; t++) {
+		worker.thread = t;
+		workers.create_thread(worker);
+	}
+	worker.thread = 0;
+	worker();
+	workers.join_all();
+}
+
+/**
+ * Lists the cells of a grid along a Morton curve, which visits them in
+ * ever larger square blocks, so that cells close in the list are close in
+ * the grid. Cells are numbered row by row.
+ *
+ * @param w Width of the grid in cells.
+ * @param h Height of the grid in cells.
+ * @param[out] order Receives the @c w * @c h cell numbers.
+ */
+inline void mortonOrder(int w, int h, std::vector<int> &order) {
+	std::vector<std::pair<unsigned long long, int> > keys;
+	keys.reserve((size_t) w * h);
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			unsigned long long code = 0;
+			for (int b = 0; b < 32; b++)
+				code |= (((unsigned long long) (x >> b) & 1) << (2 * b)) |
+						(((unsigned long long) (y >> b) & 1) << (2 * b + 1));
+			keys.push_back(std::make_pair(code, y * w + x));
+		}
+	}
+	std::sort(keys.begin(), keys.end());
+	order.resize(keys.size());
+	for (size_t i = 0; i < keys.size(); i++)
+		order[i] = keys[i].second;
+}
+
+/**
+ * Sorts chunks of a vector for @c parallelSort .
+ */
+template<typename T>
+struct parallelSortChunk {
+	/** The vector being sorted. */
+	std::vector<T> *v;
+
+	void operator()(int lo, int hi) const {
+		std::sort(v->begin() + lo, v->begin() + hi);
+	}
+};
+
+/**
+ * Sorts the given vector with @c operator< on up to @c numThreads threads.
+ * Each thread sorts a contiguous chunk, then neighboring chunks are merged
+ * pairwise.
+ *
+ * @param v The vector to sort.
+ * @param numThreads Number of threads to use, at least 1.
+ */
+template<typename T>
+void parallelSort(std::vector<T> &v, int numThreads) {
+	int n = (int) v.size();
+	if (numThreads > n)
+		numThreads = n > 0 ? n : 1;
+	if (numThreads <= 1) {
+		std::sort(v.begin(), v.end());
+		return;
+	}
+
+	// Chunk boundaries must match the ones parallelFor uses.
+	std::vector<int> bounds;
+	for (int i = 0; i <= numThreads; i++)
+		bounds.push_back((int) ((long long) n * i / numThreads));
+
+	parallelSortChunk<T> sorter;
+	sorter.v = &v;
+	parallelFor(0, n, numThreads, sorter);
+
+	for (int width = 1; width < numThreads; width *= 2) {
+		for (int i = 0; i + width < numThreads; i += 2 * width) {
+			int hi = std::min(i + 2 * width, numThreads);
+			std::inplace_merge(v.begin() + bounds[i],
+					v.begin() + bounds[i + width], v.begin() + bounds[hi]);
+		}
+	}
+}
+
+#endif // PARALLEL_HH
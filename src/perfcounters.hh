@@ -0,0 +1,236 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "boost/noncopyable.hpp"
+#include <cassert>
+#include <cstring>
+#include <ostream>
+
+#ifndef PERFCOUNTERS_HH
+#define PERFCOUNTERS_HH
+
+/**
+ * Defined when hardware performance counters are read with Linux
+ * @c perf_event_open .
+ */
+#ifdef __linux__
+#define PERFCOUNTERS_LINUX 1
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * The hardware events @c perfcounters counts.
+ */
+enum perfCounter {
+	/** Core cycles. */
+	PERF_CYCLES,
+	/** Instructions retired. */
+	PERF_INSTRUCTIONS,
+	/** Reads that miss the L1 data cache. */
+	PERF_L1D_MISSES,
+	/** Accesses that miss the last level cache. */
+	PERF_LLC_MISSES,
+	/** Mispredicted branches. */
+	PERF_BRANCH_MISSES,
+	/** Number of counters. */
+	PERF_COUNTER_COUNT
+};
+
+/**
+ * Gets the name of a counter in the JSON output.
+ *
+ * @param c The counter.
+ *
+ * @return The name.
+ */
+inline const char* perfCounterName(perfCounter c) {
+	static const char *names[PERF_COUNTER_COUNT] = { "cycles",
+			"instructions", "l1d_misses", "llc_misses", "branch_misses" };
+	assert(c >= 0 && c < PERF_COUNTER_COUNT);
+	return names[c];
+}
+
+/**
+ * Counts of the events of @c perfcounters , each -1 if it isn't counted.
+ */
+struct perfsample {
+	/** The count of each counter. */
+	long long counts[PERF_COUNTER_COUNT];
+
+	/**
+	 * Makes a sample of nothing counted.
+	 */
+	perfsample() {
+		for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+			counts[i] = -1;
+	}
+
+	/**
+	 * Adds the counts between two samples to this one; a counter that
+	 * either doesn't count is left alone.
+	 *
+	 * @param start The first sample.
+	 * @param end The later one.
+	 */
+	void addDifference(const perfsample &start, const perfsample &end) {
+		for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+			if (start.counts[i] < 0 || end.counts[i] < 0)
+				continue;
+			counts[i] = (counts[i] < 0 ? 0 : counts[i]) + end.counts[i] -
+					start.counts[i];
+		}
+	}
+
+	/**
+	 * Adds the counts of another sample to this one; a counter that doesn't
+	 * count there is left alone.
+	 *
+	 * @param other The other sample.
+	 */
+	void add(const perfsample &other) {
+		for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+			if (other.counts[i] >= 0)
+				counts[i] = (counts[i] < 0 ? 0 : counts[i]) + other.counts[i];
+	}
+
+	/**
+	 * Writes the counts as the members of a JSON object, e.g.
+	 * @code "cycles": 91203, "instructions": 120551, ... @endcode , with
+	 * @c null for counters that don't count.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void writeJsonMembers(std::ostream &os) const {
+		for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+			os << (i > 0 ? ", " : "") << "\"" <<
+					perfCounterName((perfCounter) i) << "\": ";
+			if (counts[i] < 0)
+				os << "null";
+			else
+				os << counts[i];
+		}
+	}
+};
+
+/**
+ * The hardware performance counters of Linux @c perf_event_open for
+ * cycles, instructions, cache misses and branch mispredictions in user
+ * space, which tell e.g. whether a render waits on memory while it
+ * traverses an acceleration structure or computes while it shades. Many
+ * machines, such as most virtual ones, have only some of the counters or
+ * none, and the kernel may not let unprivileged processes use them; those
+ * that can't be opened don't count. When more counters are open than the
+ * hardware has, the kernel takes turns with them and the counts are scaled
+ * up from the time each ran. Nothing counts on other systems.
+ */
+class perfcounters : private boost::noncopyable {
+private:
+
+	/**
+	 * The file descriptor of each counter, or -1 if it isn't open.
+	 */
+	int fds[PERF_COUNTER_COUNT];
+
+public:
+
+	/**
+	 * Opens and starts the counters for the calling thread.
+	 *
+	 * @param inherit Whether to also count the threads the calling thread
+	 *   starts from now on, which add to the counts once they end.
+	 */
+	explicit perfcounters(bool inherit) {
+		for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+			fds[i] = -1;
+#ifdef PERFCOUNTERS_LINUX
+		static const unsigned long long cache =
+				PERF_COUNT_HW_CACHE_OP_READ << 8 |
+				PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+		static const unsigned types[PERF_COUNTER_COUNT] = {
+				PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+				PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE };
+		static const unsigned long long configs[PERF_COUNTER_COUNT] = {
+				PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+				PERF_COUNT_HW_CACHE_L1D | cache, PERF_COUNT_HW_CACHE_MISSES,
+				PERF_COUNT_HW_BRANCH_MISSES };
+		for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = types[i];
+			attr.config = configs[i];
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.inherit = inherit ? 1 : 0;
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+					PERF_FORMAT_TOTAL_TIME_RUNNING;
+			fds[i] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		}
+#else
+		(void) inherit;
+#endif
+	}
+
+	/**
+	 * Stops and closes the counters.
+	 */
+	~perfcounters() {
+#ifdef PERFCOUNTERS_LINUX
+		for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+			if (fds[i] >= 0)
+				close(fds[i]);
+#endif
+	}
+
+	/**
+	 * Tells if a counter counts.
+	 *
+	 * @param c The counter.
+	 *
+	 * @return @c false if it couldn't be opened.
+	 */
+	bool isCounting(perfCounter c) const {
+		return fds[c] >= 0;
+	}
+
+	/**
+	 * Tells if any counter counts.
+	 *
+	 * @return @c false if none could be opened.
+	 */
+	bool anyCounting() const {
+		for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+			if (fds[i] >= 0)
+				return true;
+		return false;
+	}
+
+	/**
+	 * Reads the counts so far.
+	 *
+	 * @param[out] s Receives the counts, -1 for counters that don't count.
+	 */
+	void read(perfsample &s) const {
+		for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+			s.counts[i] = -1;
+#ifdef PERFCOUNTERS_LINUX
+			// The count, the time enabled and the time running.
+			unsigned long long v[3];
+			if (fds[i] < 0 || ::read(fds[i], v, sizeof(v)) != sizeof(v))
+				continue;
+			if (v[2] == 0)
+				s.counts[i] = 0;
+			else if (v[2] < v[1])
+				s.counts[i] = (long long) ((double) v[0] * v[1] / v[2]);
+			else
+				s.counts[i] = (long long) v[0];
+#endif
+		}
+	}
+};
+
+#endif // PERFCOUNTERS_HH
@@ -0,0 +1,320 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "raystats.hh"
+#include "perfcounters.hh"
+#include "tracelog.hh"
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include <cassert>
+#include <ctime>
+#include <ostream>
+#include <string>
+
+#ifndef PHASETIMES_HH
+#define PHASETIMES_HH
+
+/**
+ * Defined when CPU time and the memory high-water mark are read with
+ * POSIX @c getrusage .
+ */
+#if defined(__unix__) || defined(__APPLE__)
+#define PHASETIMES_POSIX 1
+#include <sys/resource.h>
+#include <sys/time.h>
+#endif
+
+/**
+ * The phases of a render that @c phasetimes times, in the order they run.
+ */
+enum renderPhase {
+	/** Reading and parsing the scene and adding its objects. */
+	PHASE_PARSE,
+	/** Finalizing the scene, which builds its acceleration structure. */
+	PHASE_BUILD,
+	/** Tracing the image. */
+	PHASE_RENDER,
+	/** Quantizing, encoding and writing the image. */
+	PHASE_WRITE,
+	/** Number of phases. */
+	PHASE_COUNT
+};
+
+/**
+ * Gets the name of a phase in the @c --stats-json output.
+ *
+ * @param phase The phase.
+ *
+ * @return The name.
+ */
+inline const char* phaseName(renderPhase phase) {
+	static const char *names[PHASE_COUNT] = { "parse", "build", "render",
+			"write" };
+	assert(phase >= 0 && phase < PHASE_COUNT);
+	return names[phase];
+}
+
+/**
+ * Gets the CPU time the process has taken so far on all its threads.
+ *
+ * @return Seconds of user and system time.
+ */
+inline double processCpuSeconds() {
+#ifdef PHASETIMES_POSIX
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+			(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#else
+	return (double) std::clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/**
+ * Gets the most memory the process has held at once so far.
+ *
+ * @return The high-water mark of its resident set in bytes, or 0 if it
+ *   can't be read here.
+ */
+inline long long peakMemoryBytes() {
+#ifdef PHASETIMES_POSIX
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return (long long) usage.ru_maxrss;
+#else
+	return (long long) usage.ru_maxrss * 1024;
+#endif
+#else
+	return 0;
+#endif
+}
+
+/**
+ * The wall and CPU time spent in each phase of a render, for
+ * @c --stats-json . One phase runs at a time: starting one ends the one
+ * before, and time outside every phase isn't counted. The CPU time is that
+ * of the whole process, so on many threads a phase can take more CPU than
+ * wall time.
+ */
+class phasetimes {
+private:
+
+	/**
+	 * Wall seconds of each phase.
+	 */
+	double wall[PHASE_COUNT];
+
+	/**
+	 * CPU seconds of each phase.
+	 */
+	double cpu[PHASE_COUNT];
+
+	/**
+	 * The running phase, or -1 for none.
+	 */
+	int current;
+
+	/**
+	 * When the running phase started.
+	 */
+	boost::posix_time::ptime wallStart;
+
+	/**
+	 * The process CPU time when the running phase started.
+	 */
+	double cpuStart;
+
+	/**
+	 * Receives a span for every run of a phase, or 0.
+	 */
+	tracelog *trace;
+
+	/**
+	 * When the running phase started in the time of @c trace .
+	 */
+	long long traceStart;
+
+	/**
+	 * The hardware counters to read at every start and stop, or 0.
+	 */
+	const perfcounters *counters;
+
+	/**
+	 * The counts when the running phase started.
+	 */
+	perfsample counterStart;
+
+	/**
+	 * The counts of each phase.
+	 */
+	perfsample counts[PHASE_COUNT];
+
+public:
+
+	/**
+	 * Makes times that are all 0, with no phase running.
+	 */
+	phasetimes() : current(-1), cpuStart(0), trace(0), traceStart(0),
+			counters(0) {
+		for (int i = 0; i < PHASE_COUNT; i++)
+			wall[i] = cpu[i] = 0;
+	}
+
+	/**
+	 * Ends the running phase, if any, and starts one. A phase may be
+	 * started again, e.g. per frame; its times add up.
+	 *
+	 * @param phase The phase.
+	 */
+	void start(renderPhase phase) {
+		stop();
+		current = phase;
+		wallStart = boost::posix_time::microsec_clock::universal_time();
+		cpuStart = processCpuSeconds();
+		if (trace != 0)
+			traceStart = trace->now();
+		if (counters != 0)
+			counters->read(counterStart);
+	}
+
+	/**
+	 * Ends the running phase, if any.
+	 */
+	void stop() {
+		if (current < 0)
+			return;
+		wall[current] += (boost::posix_time::microsec_clock::universal_time()
+				- wallStart).total_microseconds() * 1e-6;
+		cpu[current] += processCpuSeconds() - cpuStart;
+		if (counters != 0) {
+			perfsample end;
+			counters->read(end);
+			counts[current].addDifference(counterStart, end);
+		}
+		if (trace != 0)
+			trace->add(phaseName((renderPhase) current), TRACE_PHASE_LANE, -1,
+					traceStart, trace->now());
+		current = -1;
+	}
+
+	/**
+	 * Makes every run of a phase from now on add a span to a log, on
+	 * @c TRACE_PHASE_LANE .
+	 *
+	 * @param log The log, or 0 to stop.
+	 */
+	void setTraceLog(tracelog *log) {
+		trace = log;
+	}
+
+	/**
+	 * Makes every run of a phase from now on add what the hardware counters
+	 * count meanwhile to the counts of the phase.
+	 *
+	 * @param c The counters, which should count the threads of the phases,
+	 *   or 0 to stop.
+	 */
+	void setCounters(const perfcounters *c) {
+		counters = c;
+	}
+
+	/**
+	 * Gets the hardware counts of a phase.
+	 *
+	 * @param phase The phase.
+	 *
+	 * @return The counts, -1 for counters that didn't count.
+	 */
+	const perfsample& getCounts(renderPhase phase) const {
+		return counts[phase];
+	}
+
+	/**
+	 * Gets the wall time of a phase.
+	 *
+	 * @param phase The phase.
+	 *
+	 * @return Seconds, not counting the run of it that's still going on.
+	 */
+	double getWallSeconds(renderPhase phase) const {
+		return wall[phase];
+	}
+
+	/**
+	 * Gets the CPU time of a phase.
+	 *
+	 * @param phase The phase.
+	 *
+	 * @return Seconds, not counting the run of it that's still going on.
+	 */
+	double getCpuSeconds(renderPhase phase) const {
+		return cpu[phase];
+	}
+
+	/**
+	 * Writes the times as a JSON object, with the memory high-water mark
+	 * and, if given, the ray counts, e.g. @code
+	 * {"width": 640, "phases": {"parse": {"wall_s": 0.01, "cpu_s": 0.01},
+	 *  ...}, "total": {"wall_s": 1.5, "cpu_s": 5.9},
+	 *  "peak_memory_bytes": 9437184, "rays": {"primary": 256000, ...}}
+	 * @endcode The rays are @c null unless counts are given. With
+	 * @c setCounters , every phase and the total also have
+	 * @c "counters": @c {"cycles": @c 91203, @c ...} .
+	 *
+	 * @param os The output stream to which to write.
+	 * @param fields Members to write first, such as @c "width": @c 640 ,
+	 *   separated by commas, or empty for none.
+	 * @param rays The ray counts, or 0 if they weren't counted.
+	 */
+	void writeJson(std::ostream &os, const std::string &fields,
+			const raystats *rays) const {
+		double wallTotal = 0, cpuTotal = 0;
+		perfsample countTotal;
+		os << "{\n";
+		if (!fields.empty())
+			os << "  " << fields << ",\n";
+		os << "  \"phases\": {";
+		for (int i = 0; i < PHASE_COUNT; i++) {
+			os << (i > 0 ? "," : "") << "\n    \"" <<
+					phaseName((renderPhase) i) << "\": {\"wall_s\": " <<
+					wall[i] << ", \"cpu_s\": " << cpu[i];
+			if (counters != 0) {
+				os << ", \"counters\": {";
+				counts[i].writeJsonMembers(os);
+				os << "}";
+			}
+			os << "}";
+			wallTotal += wall[i];
+			cpuTotal += cpu[i];
+			countTotal.add(counts[i]);
+		}
+		os << "\n  },\n  \"total\": {\"wall_s\": " << wallTotal <<
+				", \"cpu_s\": " << cpuTotal;
+		if (counters != 0) {
+			os << ", \"counters\": {";
+			countTotal.writeJsonMembers(os);
+			os << "}";
+		}
+		os << "},\n"
+				"  \"peak_memory_bytes\": " << peakMemoryBytes() << ",\n"
+				"  \"rays\": ";
+		if (rays == 0) {
+			os << "null";
+		}
+		else {
+			unsigned long long tests = 0;
+			for (int i = 0; i < RAYSTATS_SHAPE_KINDS; i++)
+				tests += rays->tests[i];
+			os << "{\"primary\": " << rays->getPrimaryRays() <<
+					", \"shadow\": " << rays->shadowRays <<
+					", \"reflection\": " << rays->reflectionRays <<
+					", \"hits\": " << rays->hits <<
+					", \"intersection_tests\": " << tests << "}";
+		}
+		os << "\n}\n";
+	}
+};
+
+#endif // PHASETIMES_HH
@@ -0,0 +1,262 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "parallel.hh"
+#include <zlib.h>
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifndef PNG_HH
+#define PNG_HH
+
+/**
+ * Number of image rows in each strip @c encodePNG compresses on its own.
+ * Strips are units of work for the compressing threads; the output doesn't
+ * depend on how many threads there are.
+ */
+#define PNG_STRIP_ROWS 32
+
+/**
+ * Size of the window of earlier data deflate may refer back to, which
+ * is also how much of the previous strip each strip is primed with.
+ */
+#define PNG_WINDOW 32768
+
+/**
+ * Filters one row of an RGB image for PNG, trying every filter type and
+ * keeping the one whose output has the smallest sum of absolute values,
+ * the usual heuristic for what deflate compresses best.
+ *
+ * @param row The row, 3 bytes per pixel.
+ * @param prev The row above, or 0 for the first row.
+ * @param width Width of the image in pixels.
+ * @param[out] out Receives the filter type byte followed by the filtered
+ *   row, @c 3 * @c width + 1 bytes.
+ */
+inline void filterPNGRow(const unsigned char *row, const unsigned char *prev,
+		int width, unsigned char *out) {
+	const int n = 3 * width, bpp = 3;
+	std::vector<unsigned char> tmp(n);
+	long best = -1;
+	for (int type = 0; type < 5; type++) {
+		long cost = 0;
+		for (int i = 0; i < n; i++) {
+			int a = i >= bpp ? row[i - bpp] : 0;
+			int b = prev != 0 ? prev[i] : 0;
+			int c = i >= bpp && prev != 0 ? prev[i - bpp] : 0;
+			int pred = 0;
+			switch (type) {
+			case 1:
+				pred = a;
+				break;
+			case 2:
+				pred = b;
+				break;
+			case 3:
+				pred = (a + b) / 2;
+				break;
+			case 4: {
+				// Paeth: whichever neighbor is closest to a + b - c.
+				int p = a + b - c;
+				int pa = std::abs(p - a), pb = std::abs(p - b),
+						pc = std::abs(p - c);
+				pred = pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+				break;
+			}
+			default:
+				break;
+			}
+			tmp[i] = (unsigned char) (row[i] - pred);
+			cost += tmp[i] < 128 ? tmp[i] : 256 - tmp[i];
+		}
+		if (best < 0 || cost < best) {
+			best = cost;
+			out[0] = (unsigned char) type;
+			std::copy(tmp.begin(), tmp.end(), out + 1);
+		}
+	}
+}
+
+/**
+ * Filters rows of a PNG on one thread of a @c parallelFor .
+ */
+struct pngRowFilter {
+	/** The pixels, 3 bytes each. */
+	const std::vector<unsigned char> *rgb;
+	/** Width of the image in pixels. */
+	int width;
+	/** Receives the filtered rows. */
+	std::vector<unsigned char> *filtered;
+
+	void operator()(int lo, int hi) const {
+		size_t rowBytes = (size_t) width * 3 + 1;
+		for (int y = lo; y < hi; y++)
+			filterPNGRow(&(*rgb)[(size_t) y * width * 3],
+					y > 0 ? &(*rgb)[(size_t) (y - 1) * width * 3] : 0, width,
+					&(*filtered)[y * rowBytes]);
+	}
+};
+
+/**
+ * Compresses strips of the filtered data of a PNG on one thread of a
+ * @c parallelFor . Each strip becomes raw deflate data that ends on a byte
+ * boundary, so the strips can simply be concatenated; all but the last end
+ * with an empty stored block instead of a final one. A strip is primed with
+ * the end of the one before it, which keeps the compression almost as good
+ * as compressing everything in one go.
+ */
+struct pngStripCompressor {
+	/** Filtered rows of the whole image. */
+	const std::vector<unsigned char> *filtered;
+	/** Bytes per filtered row. */
+	size_t rowBytes;
+	/** Number of rows. */
+	int height;
+	/** Receives the compressed data of every strip. */
+	std::vector<std::string> *strips;
+	/** Receives the Adler-32 checksum of the data of every strip. */
+	std::vector<uLong> *checksums;
+
+	void operator()(int lo, int hi) const {
+		int numStrips = (int) strips->size();
+		for (int s = lo; s < hi; s++) {
+			size_t begin = (size_t) s * PNG_STRIP_ROWS * rowBytes;
+			size_t end = std::min((size_t) (s + 1) * PNG_STRIP_ROWS,
+					(size_t) height) * rowBytes;
+			const Bytef *data = &(*filtered)[0];
+
+			z_stream z;
+			z.zalloc = Z_NULL;
+			z.zfree = Z_NULL;
+			z.opaque = Z_NULL;
+			int ok = deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15,
+					8, Z_DEFAULT_STRATEGY);
+			assert(ok == Z_OK);
+			if (begin > 0) {
+				size_t dict = std::min(begin, (size_t) PNG_WINDOW);
+				deflateSetDictionary(&z, data + begin - dict, (uInt) dict);
+			}
+			std::string &out = (*strips)[s];
+			out.resize(deflateBound(&z, (uLong) (end - begin)) + 16);
+			z.next_in = const_cast<Bytef *>(data + begin);
+			z.avail_in = (uInt) (end - begin);
+			z.next_out = reinterpret_cast<Bytef *>(&out[0]);
+			z.avail_out = (uInt) out.size();
+			ok = deflate(&z, s == numStrips - 1 ? Z_FINISH : Z_SYNC_FLUSH);
+			assert(ok == (s == numStrips - 1 ? Z_STREAM_END : Z_OK));
+			(void) ok;
+			out.resize(out.size() - z.avail_out);
+			deflateEnd(&z);
+			(*checksums)[s] = adler32(adler32(0L, Z_NULL, 0), data + begin,
+					(uInt) (end - begin));
+		}
+	}
+};
+
+/**
+ * Writes a 4 byte number in network byte order.
+ *
+ * @param out The string to which to append.
+ * @param v The number.
+ */
+inline void appendPNGInt(std::string &out, unsigned long v) {
+	out += (char) ((v >> 24) & 0xff);
+	out += (char) ((v >> 16) & 0xff);
+	out += (char) ((v >> 8) & 0xff);
+	out += (char) (v & 0xff);
+}
+
+/**
+ * Writes a PNG chunk: its length, type, data and CRC.
+ *
+ * @param os The output stream.
+ * @param type The 4 letter chunk type.
+ * @param data The chunk data.
+ */
+inline void writePNGChunk(std::ostream &os, const char *type,
+		const std::string &data) {
+	std::string head;
+	appendPNGInt(head, (unsigned long) data.size());
+	head.append(type, 4);
+	uLong crc = crc32(0L, Z_NULL, 0);
+	crc = crc32(crc, reinterpret_cast<const Bytef *>(type), 4);
+	crc = crc32(crc, reinterpret_cast<const Bytef *>(data.data()),
+			(uInt) data.size());
+	std::string tail;
+	appendPNGInt(tail, crc);
+	os.write(head.data(), head.size());
+	os.write(data.data(), data.size());
+	os.write(tail.data(), tail.size());
+}
+
+/**
+ * Writes an 8 bit RGB image as PNG. Rows are filtered and strips of
+ * @c PNG_STRIP_ROWS rows deflated on up to @c numThreads threads, then the
+ * strips are joined into one zlib stream so the file is an ordinary PNG.
+ *
+ * @param rgb The pixels, row by row, 3 bytes each.
+ * @param width Width of the image in pixels.
+ * @param height Height of the image in pixels.
+ * @param os The output stream, which should be in binary mode.
+ * @param numThreads Number of threads to filter and compress on.
+ */
+inline void encodePNG(const std::vector<unsigned char> &rgb, int width,
+		int height, std::ostream &os, int numThreads = 1) {
+	assert(width > 0 && height > 0);
+	assert(rgb.size() == (size_t) width * height * 3);
+	static const char signature[] = "\x89PNG\r\n\x1a\n";
+	os.write(signature, 8);
+
+	std::string ihdr;
+	appendPNGInt(ihdr, width);
+	appendPNGInt(ihdr, height);
+	ihdr += (char) 8; // bits per channel
+	ihdr += (char) 2; // RGB
+	ihdr += (char) 0; // deflate
+	ihdr += (char) 0; // adaptive filtering
+	ihdr += (char) 0; // no interlacing
+	writePNGChunk(os, "IHDR", ihdr);
+
+	size_t rowBytes = (size_t) width * 3 + 1;
+	std::vector<unsigned char> filtered(rowBytes * height);
+	numThreads = std::max(1, numThreads);
+	pngRowFilter filter;
+	filter.rgb = &rgb;
+	filter.width = width;
+	filter.filtered = &filtered;
+	parallelFor(0, height, numThreads, filter);
+
+	int numStrips = (height + PNG_STRIP_ROWS - 1) / PNG_STRIP_ROWS;
+	std::vector<std::string> strips(numStrips);
+	std::vector<uLong> checksums(numStrips);
+	pngStripCompressor compress;
+	compress.filtered = &filtered;
+	compress.rowBytes = rowBytes;
+	compress.height = height;
+	compress.strips = &strips;
+	compress.checksums = &checksums;
+	parallelFor(0, numStrips, numThreads, compress);
+
+	// A zlib header for the default compression level, the strips and the
+	// checksum of all the data.
+	std::string idat("\x78\x9c", 2);
+	uLong adler = adler32(0L, Z_NULL, 0);
+	for (int s = 0; s < numStrips; s++) {
+		idat += strips[s];
+		size_t rows = std::min(PNG_STRIP_ROWS, height - s * PNG_STRIP_ROWS);
+		adler = adler32_combine(adler, checksums[s],
+				(z_off_t) (rows * rowBytes));
+	}
+	appendPNGInt(idat, adler);
+	writePNGChunk(os, "IDAT", idat);
+	writePNGChunk(os, "IEND", std::string());
+	os.flush();
+}
+
+#endif // PNG_HH
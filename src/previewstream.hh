@@ -0,0 +1,208 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "framebuffer.hh"
+#include "netchannel.hh"
+#include "png.hh"
+#include "rgbcolor.hh"
+#include "tilequeue.hh"
+#include "websocket.hh"
+#include <cassert>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef PREVIEWSTREAM_HH
+#define PREVIEWSTREAM_HH
+
+/**
+ * Kind of a preview message holding a block of the image.
+ */
+#define PREVIEW_TILE 1
+
+/**
+ * Kind of the preview message sent once the image is done.
+ */
+#define PREVIEW_DONE 2
+
+/**
+ * Size of the header of a preview message in bytes.
+ */
+#define PREVIEW_HEADER_SIZE 32
+
+/**
+ * Pushes the parts of an image to a WebSocket client, such as a browser
+ * preview, as they're rendered, so it can show them at once instead of
+ * waiting for the whole image. Every message is one binary frame: eight
+ * 32 bit numbers in network byte order, the kind, the width and height of
+ * the image, the x, y, width and height of the block in image pixels and
+ * how many image pixels across a pixel of the block covers; then, for
+ * @c PREVIEW_TILE , the block as a PNG of its pixels quantized to 8 bits.
+ * A block of a coarse progressive pass is sent at its own resolution, so
+ * the client scales it up. Once the client goes away nothing more is
+ * sent, and the render carries on.
+ *
+ * @tparam color_T The type of the @c rgbcolor.
+ */
+template<typename color_T>
+class previewstream {
+private:
+
+	/**
+	 * The client's connection, after @c acceptWebSocket .
+	 */
+	netchannel *channel;
+
+	/**
+	 * Size of the image in pixels.
+	 */
+	int width, height;
+
+	/**
+	 * What to multiply the colors by before quantizing.
+	 */
+	color_T exposure;
+
+public:
+
+	/**
+	 * Makes a stream to a client.
+	 *
+	 * @param channel The connection, after @c acceptWebSocket .
+	 * @param width Width of the image in pixels.
+	 * @param height Height of the image in pixels.
+	 * @param exposure What to multiply the colors by before quantizing.
+	 */
+	previewstream(netchannel *channel, int width, int height,
+			color_T exposure = 1) : channel(channel), width(width),
+			height(height), exposure(exposure) { }
+
+	/**
+	 * Tells if the client is still there to send to.
+	 *
+	 * @return Whether the connection is open.
+	 */
+	bool isOpen() const {
+		return channel->isOpen();
+	}
+
+	/**
+	 * Makes the header of a preview message.
+	 *
+	 * @param kind @c PREVIEW_TILE or @c PREVIEW_DONE .
+	 * @param imageWidth Width of the image in pixels.
+	 * @param imageHeight Height of the image in pixels.
+	 * @param x0 x of the top left pixel of the block.
+	 * @param y0 y of the top left pixel of the block.
+	 * @param w Width of the block in image pixels.
+	 * @param h Height of the block in image pixels.
+	 * @param block Image pixels across a pixel of the block.
+	 *
+	 * @return The @c PREVIEW_HEADER_SIZE bytes.
+	 */
+	static std::string header(int kind, int imageWidth, int imageHeight,
+			int x0, int y0, int w, int h, int block) {
+		netwriter out;
+		const int fields[] = { kind, imageWidth, imageHeight, x0, y0, w, h,
+				block };
+		for (int i = 0; i < 8; i++)
+			out.putInt((boost::uint32_t) fields[i]);
+		return std::string(out.getBytes().begin(), out.getBytes().end());
+	}
+
+	/**
+	 * Makes the @c PREVIEW_TILE message of a block of the image.
+	 *
+	 * @param pixels The colors of the block, row by row.
+	 * @param stride Colors from one row of @c pixels to the next.
+	 * @param x0 x of the top left pixel of the block in the image.
+	 * @param y0 y of the top left pixel of the block in the image.
+	 * @param w Width of the block in image pixels.
+	 * @param h Height of the block in image pixels.
+	 * @param block Image pixels across a pixel of the PNG: every
+	 *   @c block th pixel of every @c block th row is sent.
+	 *
+	 * @return The message.
+	 */
+	std::string tileMessage(const rgbcolor<color_T> *pixels, int stride,
+			int x0, int y0, int w, int h, int block) const {
+		assert(w > 0 && h > 0 && block > 0);
+		int pw = (w + block - 1) / block, ph = (h + block - 1) / block;
+		std::vector<rgbcolor<color_T> > sampled((size_t) pw * ph);
+		for (int y = 0; y < ph; y++)
+			for (int x = 0; x < pw; x++)
+				sampled[(size_t) y * pw + x] =
+						pixels[(size_t) y * block * stride + x * block];
+		std::vector<unsigned char> rgb;
+		framebuffer<color_T>::quantize(sampled, rgb, exposure);
+		std::ostringstream png;
+		encodePNG(rgb, pw, ph, png);
+		return header(PREVIEW_TILE, width, height, x0, y0, w, h, block) +
+				png.str();
+	}
+
+	/**
+	 * Sends a finished tile or band.
+	 *
+	 * @param tile The tile.
+	 *
+	 * @return @c false if the client went away, now or before.
+	 */
+	bool sendTile(const tilebuffer<color_T> &tile) {
+		if (!isOpen() || tile.width == 0 || tile.height == 0)
+			return isOpen();
+		return send(tileMessage(&tile.pixels[0], tile.width, tile.x0,
+				tile.y0, tile.width, tile.height, 1));
+	}
+
+	/**
+	 * Sends a pass of a progressive render, at its own resolution.
+	 *
+	 * @param image The colors of the pass, the size of the image, made of
+	 *   squares of @c block pixels of one color.
+	 * @param block Side of the squares in pixels.
+	 *
+	 * @return @c false if the client went away, now or before.
+	 */
+	bool sendPass(const std::vector<rgbcolor<color_T> > &image, int block) {
+		assert(image.size() == (size_t) width * height);
+		if (!isOpen() || image.empty())
+			return isOpen();
+		return send(tileMessage(&image[0], width, 0, 0, width, height,
+				block));
+	}
+
+	/**
+	 * Tells the client the image is done and closes the connection.
+	 *
+	 * @return @c false if the client went away, now or before.
+	 */
+	bool sendDone() {
+		if (!isOpen())
+			return false;
+		bool sent = send(header(PREVIEW_DONE, width, height, 0, 0, width,
+				height, 1)) && sendWebSocket(*channel, "", WEBSOCKET_CLOSE);
+		channel->close();
+		return sent;
+	}
+
+private:
+
+	/**
+	 * Sends a message, closing the connection if that fails.
+	 *
+	 * @param message The message.
+	 *
+	 * @return @c false if it couldn't be sent.
+	 */
+	bool send(const std::string &message) {
+		if (sendWebSocket(*channel, message))
+			return true;
+		channel->close();
+		return false;
+	}
+};
+
+#endif // PREVIEWSTREAM_HH
@@ -0,0 +1,336 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "aabb.hh"
+#include "camera.hh"
+#include "dirtyregion.hh"
+#include "mvector.hh"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#ifndef PRIMARYBINS_HH
+#define PRIMARYBINS_HH
+
+/**
+ * Side of the square screen tiles the shapes are binned in, in pixels.
+ */
+#define PRIMARY_BIN_SIZE 8
+
+/**
+ * Pixels of margin around the projection of a box, for rounding: camera
+ * rays and @c camera::projectPoint don't round the same way.
+ */
+#define PRIMARY_BIN_MARGIN 1
+
+/**
+ * The shapes that may be seen through each pixel of an image, for working
+ * out primary visibility by rasterizing instead of tracing: the bounding
+ * box of every shape is projected to the screen, and the rectangle around
+ * its corners is binned in square tiles of @c PRIMARY_BIN_SIZE pixels. A
+ * camera ray can only hit a shape whose rectangle holds its pixel, since a
+ * box in front of the camera projects inside the rectangle around its
+ * corners, so the closest hit among those candidates, and among the shapes
+ * that couldn't be binned, is the closest hit of the ray. Shapes without a
+ * box, like infinite planes, and boxes reaching behind the camera are
+ * candidates of every pixel, and boxes wholly behind it of none.
+ *
+ * The bins may cover just a strip of the rows of the image, for rendering
+ * it a strip at a time; shapes that can't show up in the strip aren't
+ * binned at all, so the bins take memory for the strip, not the image.
+ *
+ * With @c cullByFrustum , each tile a box may fall in is also checked
+ * against the pyramid the camera rays of the tile sweep, which rules out
+ * the tiles the corners of the rectangle of a round or slanted shape
+ * reach, and boxes reaching behind the camera are binned in just the tiles
+ * whose pyramids they meet, instead of everywhere.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam time_T The type of the time.
+ * @tparam dim The number of dimensions.
+ */
+template<typename vec_T, typename time_T, int dim>
+class primarybins {
+private:
+
+	/**
+	 * Size of the image in pixels.
+	 */
+	int width, height;
+
+	/**
+	 * The rows that are binned: @c top through @c bottom - 1.
+	 */
+	int top, bottom;
+
+	/**
+	 * Number of tiles across the image.
+	 */
+	int tilesX;
+
+	/**
+	 * The shapes whose rectangles overlap each tile, row by row, each in
+	 * the order they were added.
+	 */
+	std::vector<std::vector<int> > tiles;
+
+	/**
+	 * Smallest and largest x and y of the pixels in the rectangle of each
+	 * binned shape, four per shape, indexed by the shape's number.
+	 */
+	std::vector<int> rects;
+
+	/**
+	 * The shapes that are candidates of every pixel, in the order they
+	 * were added.
+	 */
+	std::vector<int> everywhere;
+
+	/**
+	 * The four planes through the camera that bound the camera rays of
+	 * each tile, row by row, as a normal pointing into the tile's pyramid
+	 * and the normal times the camera's position, 16 numbers per tile; or
+	 * empty without @c cullByFrustum .
+	 */
+	std::vector<double> frustums;
+
+	/**
+	 * Checks if a box may meet the pyramid of a tile.
+	 *
+	 * @param tile Number of the tile.
+	 * @param box The box, in @c double and padded for rounding.
+	 *
+	 * @return @c false if the box is wholly outside one of the planes.
+	 */
+	bool meetsFrustum(int tile, const aabb<double, dim> &box) const {
+		const double *f = &frustums[16 * tile];
+		for (int p = 0; p < 4; p++, f += 4) {
+			double reach = 0;
+			for (int a = 0; a < 3; a++)
+				reach += f[a] * (f[a] > 0 ? box.getMax()[a] : box.getMin()[a]);
+			if (reach < f[3])
+				return false;
+		}
+		return true;
+	}
+
+	/**
+	 * Bins a box in the tiles of a rectangle whose pyramids it meets, or
+	 * in all of them without @c cullByFrustum , and records the rectangle.
+	 *
+	 * @param id Number of the shape.
+	 * @param box The box, in @c double and padded for rounding.
+	 * @param px0 Smallest x of the rectangle.
+	 * @param py0 Smallest y of the rectangle.
+	 * @param px1 Largest x of the rectangle.
+	 * @param py1 Largest y of the rectangle.
+	 */
+	void binRect(int id, const aabb<double, dim> &box, int px0, int py0,
+			int px1, int py1) {
+		if ((int) rects.size() < 4 * (id + 1))
+			rects.resize(4 * (id + 1), -1);
+		rects[4 * id] = px0;
+		rects[4 * id + 1] = py0;
+		rects[4 * id + 2] = px1;
+		rects[4 * id + 3] = py1;
+		for (int ty = py0 / PRIMARY_BIN_SIZE; ty <= py1 / PRIMARY_BIN_SIZE;
+				ty++) {
+			for (int tx = px0 / PRIMARY_BIN_SIZE;
+					tx <= px1 / PRIMARY_BIN_SIZE; tx++) {
+				int tile = (ty - top / PRIMARY_BIN_SIZE) * tilesX + tx;
+				if (frustums.empty() || meetsFrustum(tile, box))
+					tiles[tile].push_back(id);
+			}
+		}
+	}
+
+public:
+
+	/**
+	 * Constructs bins for an empty image.
+	 */
+	primarybins() : width(0), height(0), top(0), bottom(0), tilesX(0) { }
+
+	/**
+	 * Empties the bins and sizes them for an image, or for a strip of its
+	 * rows.
+	 *
+	 * @param w Width of the image in pixels.
+	 * @param h Height of the image in pixels.
+	 * @param y0 First row of the strip, a multiple of
+	 *   @c PRIMARY_BIN_SIZE .
+	 * @param rows Number of rows of the strip, or -1 for all the rows from
+	 *   @c y0 down.
+	 */
+	void reset(int w, int h, int y0 = 0, int rows = -1) {
+		assert(w >= 0 && h >= 0 && y0 % PRIMARY_BIN_SIZE == 0);
+		width = w;
+		height = h;
+		top = std::min(y0, h);
+		bottom = rows < 0 ? h : std::min(h, top + rows);
+		tilesX = (w + PRIMARY_BIN_SIZE - 1) / PRIMARY_BIN_SIZE;
+		int tilesY = (bottom - top + PRIMARY_BIN_SIZE - 1) /
+				PRIMARY_BIN_SIZE;
+		tiles.assign((size_t) tilesX * tilesY, std::vector<int>());
+		rects.clear();
+		everywhere.clear();
+		frustums.clear();
+	}
+
+	/**
+	 * Makes the shapes added from now on be checked against the pyramid
+	 * of camera rays of every tile they may fall in, for an image of the
+	 * size and the strip given to @c reset . Only for three dimensions.
+	 *
+	 * @param cam The camera of the image.
+	 */
+	void cullByFrustum(const camera<vec_T, time_T, dim> &cam) {
+		assert(dim == 3);
+		frustums.assign(tiles.size() * 16, 0);
+		mvector<double, dim> P;
+		for (int a = 0; a < dim; a++)
+			P[a] = (double) cam.getPosition()[a];
+		for (size_t t = 0; t < tiles.size(); t++) {
+			// The corners of the tile, out past the pixels at its edges
+			// by half a pixel plus the margin, clockwise on the screen.
+			double pad = 0.5 + PRIMARY_BIN_MARGIN;
+			int tx = (int) t % tilesX;
+			int ty = (int) t / tilesX + top / PRIMARY_BIN_SIZE;
+			double x0 = tx * PRIMARY_BIN_SIZE - pad;
+			double y0 = ty * PRIMARY_BIN_SIZE - pad;
+			double x1 = std::min((tx + 1) * PRIMARY_BIN_SIZE, width) - 1 + pad;
+			double y1 = std::min((ty + 1) * PRIMARY_BIN_SIZE, bottom) - 1 +
+					pad;
+			double xs[4] = { x0, x1, x1, x0 }, ys[4] = { y0, y0, y1, y1 };
+			mvector<double, dim> d[4], c;
+			for (int i = 0; i < 4; i++) {
+				mvector<vec_T, dim> dir = cam.getRayForPoint((vec_T) xs[i],
+						(vec_T) ys[i], width, height).getDir();
+				for (int a = 0; a < dim; a++)
+					d[i][a] = (double) dir[a];
+				c = c + d[i];
+			}
+			double *f = &frustums[16 * t];
+			for (int i = 0; i < 4; i++, f += 4) {
+				mvector<double, dim> n = d[i] % d[(i + 1) % 4];
+				if (n * c < 0)
+					n = -n;
+				for (int a = 0; a < dim; a++)
+					f[a] = n[a];
+				f[3] = n * P;
+			}
+		}
+	}
+
+	/**
+	 * Bins a shape with the given bounding box. Shapes must be added in
+	 * increasing order of their numbers for the candidates to come in that
+	 * order.
+	 *
+	 * @param cam The camera of the image.
+	 * @param id Number of the shape, at least 0.
+	 * @param box The shape's bounding box.
+	 */
+	void add(const camera<vec_T, time_T, dim> &cam, int id,
+			const aabb<vec_T, dim> &box) {
+		assert(id >= 0);
+		if (box.isEmpty())
+			return;
+		aabb<double, dim> padded = paddedBox(box);
+		double x0 = std::numeric_limits<double>::max(), y0 = x0;
+		double x1 = -x0, y1 = -x0;
+		int behind = 0;
+		for (int i = 0; i < 1 << dim; i++) {
+			double x, y;
+			if (!cam.projectPoint(boxCorner(padded, i), width, height,
+					x, y)) {
+				behind++;
+				continue;
+			}
+			x0 = std::min(x0, x);
+			y0 = std::min(y0, y);
+			x1 = std::max(x1, x);
+			y1 = std::max(y1, y);
+		}
+		// Camera rays only go forward, so a box wholly behind the camera
+		// can't be hit; one partly behind projects to no rectangle.
+		if (behind == 1 << dim)
+			return;
+		if (behind > 0) {
+			if (frustums.empty())
+				addEverywhere(id);
+			else if (width > 0 && bottom > top)
+				binRect(id, padded, 0, top, width - 1, bottom - 1);
+			return;
+		}
+		if (x1 < -PRIMARY_BIN_MARGIN || y1 < top - PRIMARY_BIN_MARGIN ||
+				x0 > width + PRIMARY_BIN_MARGIN ||
+				y0 > bottom + PRIMARY_BIN_MARGIN)
+			return;
+		// Clamped first so that huge coordinates don't overflow an int.
+		int px0 = std::max(0, (int) std::floor(std::max(x0, -1.0)) -
+				PRIMARY_BIN_MARGIN);
+		int py0 = std::max(top, (int) std::floor(std::max(y0, top - 1.0)) -
+				PRIMARY_BIN_MARGIN);
+		int px1 = std::min(width - 1, (int) std::ceil(
+				std::min(x1, (double) width)) + PRIMARY_BIN_MARGIN);
+		int py1 = std::min(bottom - 1, (int) std::ceil(
+				std::min(y1, (double) bottom)) + PRIMARY_BIN_MARGIN);
+		if (px0 > px1 || py0 > py1)
+			return;
+		binRect(id, padded, px0, py0, px1, py1);
+	}
+
+	/**
+	 * Makes a shape a candidate of every pixel.
+	 *
+	 * @param id Number of the shape.
+	 */
+	void addEverywhere(int id) {
+		everywhere.push_back(id);
+	}
+
+	/**
+	 * Gets the binned shapes whose rectangles overlap the tile of a pixel,
+	 * which must be in the strip. Those whose rectangles hold the pixel
+	 * itself are told apart by @c covers .
+	 *
+	 * @param x x coordinate of the pixel.
+	 * @param y y coordinate of the pixel.
+	 *
+	 * @return Numbers of the shapes, in the order they were added.
+	 */
+	const std::vector<int>& getTile(int x, int y) const {
+		return tiles[((y - top) / PRIMARY_BIN_SIZE) * tilesX +
+				x / PRIMARY_BIN_SIZE];
+	}
+
+	/**
+	 * Checks if the rectangle of a binned shape holds a pixel.
+	 *
+	 * @param id Number of the shape, which must have been binned.
+	 * @param x x coordinate of the pixel.
+	 * @param y y coordinate of the pixel.
+	 *
+	 * @return @c true if the shape is a candidate of the pixel.
+	 */
+	bool covers(int id, int x, int y) const {
+		const int *r = &rects[4 * id];
+		return x >= r[0] && y >= r[1] && x <= r[2] && y <= r[3];
+	}
+
+	/**
+	 * Gets the shapes that are candidates of every pixel.
+	 *
+	 * @return Numbers of the shapes, in the order they were added.
+	 */
+	const std::vector<int>& getEverywhere() const {
+		return everywhere;
+	}
+};
+
+#endif // PRIMARYBINS_HH
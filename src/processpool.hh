@@ -0,0 +1,258 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "boost/noncopyable.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef PROCESSPOOL_HH
+#define PROCESSPOOL_HH
+
+/**
+ * Defined when workers can be forked and share a mapping with POSIX
+ * @c fork and @c mmap .
+ */
+#if defined(__unix__) || defined(__APPLE__)
+#define PROCESSPOOL_FORK 1
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Most rounds of workers @c processpool::run forks. Rounds after the first
+ * only take the items that workers which died left unfinished.
+ */
+#define PROCESSPOOL_ROUNDS 3
+
+/**
+ * Works through numbered items, like the bands of an image, in worker
+ * processes forked from this one. The workers share all that was made
+ * before, like a loaded and built scene, copy-on-write, so it's in memory
+ * once however many there are, and each has its own memory limits and
+ * crashes on its own. They claim items one at a time from a mapping they
+ * all share and put what they make of them into the rest of it, where
+ * this process reads it once they're done. Items a worker claimed but
+ * didn't finish before it died are handed to a fresh round of workers.
+ * Without @c fork , opening always fails.
+ */
+class processpool : private boost::noncopyable {
+private:
+
+	/**
+	 * What became of an item, kept at the start of the mapping. A fresh
+	 * mapping is zeros, so all items start out free.
+	 */
+	enum itemState {
+		/** Nobody has it. */
+		ITEM_FREE,
+		/** A worker is on it, or died on it. */
+		ITEM_CLAIMED,
+		/** Its results are in. */
+		ITEM_DONE
+	};
+
+	/**
+	 * The mapping, or 0 if none is open.
+	 */
+	char *mapping;
+
+	/**
+	 * Size of the mapping in bytes.
+	 */
+	size_t length;
+
+	/**
+	 * Number of items.
+	 */
+	int items;
+
+	/**
+	 * Offset of the results in the mapping, past the states of the items.
+	 */
+	size_t resultOffset;
+
+public:
+
+	/**
+	 * Constructs a pool with no mapping open.
+	 */
+	processpool() : mapping(0), length(0), items(0), resultOffset(0) { }
+
+	/**
+	 * Unmaps the mapping.
+	 */
+	~processpool() {
+		close();
+	}
+
+	/**
+	 * Maps the memory the workers share, with all items free and the
+	 * results zeros.
+	 *
+	 * @param items Number of items.
+	 * @param resultBytes Bytes of results.
+	 *
+	 * @return @c false if it couldn't be mapped.
+	 */
+	bool open(int items, size_t resultBytes) {
+		assert(items >= 0);
+		close();
+		size_t offset = ((size_t) items * sizeof(int) + 63) / 64 * 64;
+#ifdef PROCESSPOOL_FORK
+		void *p = mmap(0, offset + resultBytes, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			return false;
+		mapping = static_cast<char *>(p);
+		length = offset + resultBytes;
+		this->items = items;
+		resultOffset = offset;
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	/**
+	 * Unmaps the mapping, if one is open.
+	 */
+	void close() {
+#ifdef PROCESSPOOL_FORK
+		if (mapping != 0)
+			munmap(mapping, length);
+#endif
+		mapping = 0;
+		length = 0;
+		items = 0;
+	}
+
+	/**
+	 * Gets the results the workers fill in.
+	 *
+	 * @return The first byte of them.
+	 */
+	char* getResults() const {
+		assert(mapping != 0);
+		return mapping + resultOffset;
+	}
+
+	/**
+	 * Tells whether the results of an item are in.
+	 *
+	 * @param item The item.
+	 *
+	 * @return @c true if they are.
+	 */
+	bool isDone(int item) const {
+		assert(0 <= item && item < items);
+		return state(item) == ITEM_DONE;
+	}
+
+	/**
+	 * Forks workers that run a job over the items not done yet, and waits
+	 * for them. If workers die with items unfinished, up to
+	 * @c PROCESSPOOL_ROUNDS rounds are forked in all.
+	 *
+	 * @tparam job_T Type of the job: called in a worker as
+	 *   @c job(item, results) for each item it claims, it puts the
+	 *   item's results into its part of @c getResults .
+	 *
+	 * @param procs Most workers to run at once.
+	 * @param job The job.
+	 * @param[out] deaths Receives a line for each worker that died, and one
+	 *   if workers couldn't be forked.
+	 *
+	 * @return @c true if all items are done.
+	 */
+	template<typename job_T>
+	bool run(int procs, const job_T &job, std::vector<std::string> &deaths) {
+		assert(mapping != 0 && procs > 0);
+#ifdef PROCESSPOOL_FORK
+		for (int round = 0; round < PROCESSPOOL_ROUNDS; round++) {
+			int left = 0;
+			for (int i = 0; i < items; i++) {
+				if (state(i) == ITEM_CLAIMED)
+					state(i) = ITEM_FREE;
+				if (state(i) != ITEM_DONE)
+					left++;
+			}
+			if (left == 0)
+				return true;
+			std::vector<pid_t> workers;
+			for (int w = 0; w < std::min(procs, left); w++) {
+				pid_t pid = fork();
+				if (pid == 0) {
+					work(job);
+					// Skip the destructors and buffers of the parent's
+					// objects, which the parent still owns.
+					_exit(0);
+				}
+				if (pid < 0)
+					break;
+				workers.push_back(pid);
+			}
+			if (workers.empty()) {
+				deaths.push_back("can't fork workers");
+				return false;
+			}
+			for (size_t w = 0; w < workers.size(); w++) {
+				int status = 0;
+				while (waitpid(workers[w], &status, 0) < 0 && errno == EINTR)
+					;
+				if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+					continue;
+				std::ostringstream line;
+				line << "worker " << workers[w];
+				if (WIFSIGNALED(status))
+					line << " was killed by signal " << WTERMSIG(status);
+				else
+					line << " exited with status " << WEXITSTATUS(status);
+				deaths.push_back(line.str());
+			}
+		}
+#endif
+		for (int i = 0; i < items; i++)
+			if (state(i) != ITEM_DONE)
+				return false;
+		return true;
+	}
+
+private:
+
+	/**
+	 * Gets the state of an item in the mapping.
+	 */
+	volatile int& state(int item) const {
+		return reinterpret_cast<volatile int *>(mapping)[item];
+	}
+
+	/**
+	 * Claims free items one at a time and runs the job on them, in a
+	 * worker, until none are left.
+	 */
+	template<typename job_T>
+	void work(const job_T &job) {
+		int *states = reinterpret_cast<int *>(mapping);
+		for (int i = 0; i < items; i++) {
+			if (!__sync_bool_compare_and_swap(states + i, ITEM_FREE,
+					ITEM_CLAIMED))
+				continue;
+			job(i, getResults());
+			// The results must be in before anyone sees the item done.
+			__sync_synchronize();
+			state(i) = ITEM_DONE;
+		}
+	}
+};
+
+#endif // PROCESSPOOL_HH
@@ -0,0 +1,586 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "accelerator.hh"
+#include "bvh.hh"
+#include "spherepack.hh"
+#include "hugepages.hh"
+#include "aabb.hh"
+#include "shape.hh"
+#include "ray.hh"
+#include "mvector.hh"
+#include "boost/shared_ptr.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include <ostream>
+
+#ifndef QBVH_HH
+#define QBVH_HH
+
+/**
+ * Number of children of a @c qbvh node.
+ */
+#define QBVH_WIDTH 4
+
+/**
+ * Most shapes a @c qbvh leaf can hold, which is what its count field can
+ * store. Bigger leaves of the binary tree are split up.
+ */
+#define QBVH_MAX_LEAF 65535
+
+/**
+ * Deepest tree the @c qbvh traversal stack can handle. Collapsing never makes
+ * a tree deeper and splitting big leaves adds only a few levels.
+ */
+#define QBVH_MAX_DEPTH (BVH_MAX_DEPTH + 8)
+
+/**
+ * A compressed wide bounding volume hierarchy for scenes whose binary @c bvh
+ * no longer fits in cache. It's built as a binary @c bvh , which is then
+ * collapsed so that every node has up to @c QBVH_WIDTH children. A node
+ * stores the box around its children as a float corner plus a power of two
+ * step per axis, and each child box as integer multiples of that step,
+ * rounded outwards so that boxes can only grow. With 8 bit steps a 3D node
+ * takes 64 bytes, one cache line, for what a binary tree spends about three
+ * 32 byte nodes on. Note that there are some convenient typedefs in this file.
+ *
+ * Quantized boxes are looser, so more boxes and shapes get tested than in a
+ * @c bvh ; the answers are the same. The tree can't be refit.
+ *
+ * @tparam vec_T The type of the vector components. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double,
+ *   float, or int.
+ * @tparam time_T The type of the time. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double or
+ *   float, but int would likely work.
+ * @tparam color_T The type of the @c rgbcolor. Many arithmetic
+ *   and relational operators must be supported, including real number ones.
+ *   The type will likely be double or float.
+ * @tparam dim The number of dimensions, which is likely 3.
+ * @tparam quant_T Unsigned integer type of the quantized child bounds,
+ *   @c unsigned @c char or @c unsigned @c short .
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim,
+		typename quant_T = unsigned char>
+class qbvh : public accelerator<vec_T, color_T, time_T, dim> {
+public:
+
+	/**
+	 * Boost shared pointer typedef for shapes.
+	 */
+	typedef typename accelerator<vec_T, color_T, time_T, dim>::sp_shape
+		sp_shape;
+
+private:
+
+	/**
+	 * The binary tree that gets collapsed.
+	 */
+	typedef bvh<vec_T, color_T, time_T, dim> binarytree;
+
+	/**
+	 * A node of the tree. Children are packed into the first @c numChildren
+	 * slots. Child @c k spans from @c origin + @c qlo[k] * step to
+	 * @c origin + @c qhi[k] * step on each axis, where the step is two to the
+	 * power of @c exponent .
+	 */
+	struct widenode {
+		/** Lower corner of the box around all children. */
+		float origin[dim];
+		/** Exponent of the quantization step on each axis. */
+		signed char exponent[dim];
+		/** Number of children in use. */
+		unsigned char numChildren;
+		/** Quantized lower corners of the child boxes. */
+		quant_T qlo[QBVH_WIDTH][dim];
+		/** Quantized upper corners of the child boxes. */
+		quant_T qhi[QBVH_WIDTH][dim];
+		/**
+		 * Index of the child node for interior children; first entry of
+		 * @c leafPrims for leaves.
+		 */
+		int child[QBVH_WIDTH];
+		/** Number of shapes in a leaf child, 0 for interior children. */
+		unsigned short count[QBVH_WIDTH];
+	};
+
+	/**
+	 * Child box in world coordinates while collapsing.
+	 */
+	struct childbox {
+		float lo[dim];
+		float hi[dim];
+	};
+
+	/**
+	 * Entry of the traversal stack: a child and the time its box is entered.
+	 */
+	struct stackentry {
+		int child;
+		int count;
+		time_T tnear;
+	};
+
+	/**
+	 * Indices into the shapes passed to @c build in the order of the leaves.
+	 */
+	std::vector<int> primIndices;
+
+	/**
+	 * The shapes of @c primIndices .
+	 */
+	std::vector<const shape<vec_T, color_T, time_T, dim> *> leafPrims;
+
+	/**
+	 * @c leafPrims again with the spheres packed for batch tests. Its slots
+	 * are the positions in @c leafPrims .
+	 */
+	spherepack<vec_T, color_T, time_T, dim> leafPack;
+
+	/**
+	 * The tree. Element 0 is the root.
+	 */
+	std::vector<widenode> nodes;
+
+	/**
+	 * Which algorithm builds the binary tree.
+	 */
+	bvhBuilder builder;
+
+	/**
+	 * Number of threads the binary build may use.
+	 */
+	int numThreads;
+
+	/**
+	 * Largest quantized coordinate.
+	 */
+	static int qmax() {
+		return (int) std::numeric_limits<quant_T>::max();
+	}
+
+	/**
+	 * Two to the power of the given exponent, which must be a normal float
+	 * exponent.
+	 */
+	static float stepOf(int e) {
+		unsigned int bits = (unsigned int) (e + 127) << 23;
+		float f;
+		memcpy(&f, &bits, sizeof(f));
+		return f;
+	}
+
+	/**
+	 * Converts a quantized coordinate back to a float. The build and the
+	 * traversal both go through here so they round the same way.
+	 */
+	static float dequantize(float origin, float step, int q) {
+		return origin + q * step;
+	}
+
+	/**
+	 * Fills in the boxes of the children of the given node.
+	 */
+	void quantize(widenode &n, const childbox *boxes, int count) const {
+		n.numChildren = (unsigned char) count;
+		for (int i = 0; i < dim; i++) {
+			float lo = boxes[0].lo[i], hi = boxes[0].hi[i];
+			for (int k = 1; k < count; k++) {
+				lo = std::min(lo, boxes[k].lo[i]);
+				hi = std::max(hi, boxes[k].hi[i]);
+			}
+
+			// Smallest step that spans the box in qmax steps.
+			int e = -126;
+			double extent = (double) hi - lo;
+			if (extent > 0) {
+				int exp2;
+				frexp(extent / qmax(), &exp2);
+				e = std::max(exp2, -126);
+			}
+			while (e < 127 && e > -126 &&
+					dequantize(lo, stepOf(e - 1), qmax()) >= hi)
+				e--;
+			while (dequantize(lo, stepOf(e), qmax()) < hi) {
+				assert(e < 127);
+				e++;
+			}
+			float step = stepOf(e);
+			n.origin[i] = lo;
+			n.exponent[i] = (signed char) e;
+
+			for (int k = 0; k < count; k++) {
+				int qlo = (int) floor((boxes[k].lo[i] - (double) lo) / step);
+				int qhi = (int) ceil((boxes[k].hi[i] - (double) lo) / step);
+				qlo = std::max(0, std::min(qlo, qmax()));
+				qhi = std::max(0, std::min(qhi, qmax()));
+				while (qlo > 0 && dequantize(lo, step, qlo) > boxes[k].lo[i])
+					qlo--;
+				while (qhi < qmax() &&
+						dequantize(lo, step, qhi) < boxes[k].hi[i])
+					qhi++;
+				n.qlo[k][i] = (quant_T) qlo;
+				n.qhi[k][i] = (quant_T) qhi;
+			}
+		}
+	}
+
+	/**
+	 * Gets the box of a node of the binary tree.
+	 */
+	static childbox boxOf(const typename binarytree::flatnode &b) {
+		childbox c;
+		for (int i = 0; i < dim; i++) {
+			c.lo[i] = b.lo[i];
+			c.hi[i] = b.hi[i];
+		}
+		return c;
+	}
+
+	/**
+	 * Gets the box around the shapes in @c leafPrims[start, start + count) .
+	 */
+	childbox boxOf(int start, int count) const {
+		aabb<vec_T, dim> box, b;
+		for (int i = start; i < start + count; i++) {
+			bool bounded = leafPrims[i]->getBounds(b);
+			assert(bounded);
+			box.extend(b);
+		}
+		childbox c;
+		for (int i = 0; i < dim; i++) {
+			c.lo[i] = binarytree::roundDown(box.getMin()[i]);
+			c.hi[i] = binarytree::roundUp(box.getMax()[i]);
+		}
+		return c;
+	}
+
+	/**
+	 * Stores a leaf of the binary tree in slot @c k of node @c n , splitting
+	 * it into a subtree if it's too big for one slot.
+	 */
+	void setLeaf(int n, int k, int start, int count) {
+		if (count <= QBVH_MAX_LEAF) {
+			nodes[n].child[k] = start;
+			nodes[n].count[k] = (unsigned short) count;
+			return;
+		}
+		nodes[n].child[k] = splitLeaf(start, count);
+		nodes[n].count[k] = 0;
+	}
+
+	/**
+	 * Makes a node whose children share the shapes in
+	 * @c leafPrims[start, start + count) evenly.
+	 *
+	 * @return Index of the node.
+	 */
+	int splitLeaf(int start, int count) {
+		int idx = (int) nodes.size();
+		nodes.push_back(widenode());
+		childbox boxes[QBVH_WIDTH];
+		int begin[QBVH_WIDTH + 1];
+		for (int k = 0; k <= QBVH_WIDTH; k++)
+			begin[k] = start + (int) ((long long) count * k / QBVH_WIDTH);
+		for (int k = 0; k < QBVH_WIDTH; k++)
+			boxes[k] = boxOf(begin[k], begin[k + 1] - begin[k]);
+		quantize(nodes[idx], boxes, QBVH_WIDTH);
+		for (int k = 0; k < QBVH_WIDTH; k++)
+			setLeaf(idx, k, begin[k], begin[k + 1] - begin[k]);
+		return idx;
+	}
+
+	/**
+	 * Appends the collapsed subtree of interior node @c b of the binary tree
+	 * to @c nodes . The children of @c b are opened up, largest surface area
+	 * first, until there are @c QBVH_WIDTH of them or only leaves are left.
+	 *
+	 * @return Index of the subtree's root in @c nodes .
+	 */
+	int collapse(const binarytree &tree, int b) {
+		const std::vector<typename binarytree::flatnode> &fn = tree.flatNodes;
+		int kids[QBVH_WIDTH];
+		int count = 2;
+		kids[0] = b + 1;
+		kids[1] = fn[b].offset;
+		while (count < QBVH_WIDTH) {
+			int best = -1;
+			double bestArea = -1;
+			for (int k = 0; k < count; k++) {
+				const typename binarytree::flatnode &c = fn[kids[k]];
+				if (c.count > 0)
+					continue;
+				double d[dim], area = 0;
+				for (int i = 0; i < dim; i++)
+					d[i] = (double) c.hi[i] - c.lo[i];
+				for (int i = 0; i < dim; i++)
+					for (int j = i + 1; j < dim; j++)
+						area += d[i] * d[j];
+				if (area > bestArea) {
+					bestArea = area;
+					best = k;
+				}
+			}
+			if (best < 0)
+				break;
+			int open = kids[best];
+			kids[best] = open + 1;
+			kids[count++] = fn[open].offset;
+		}
+
+		int idx = (int) nodes.size();
+		nodes.push_back(widenode());
+		childbox boxes[QBVH_WIDTH];
+		for (int k = 0; k < count; k++)
+			boxes[k] = boxOf(fn[kids[k]]);
+		quantize(nodes[idx], boxes, count);
+		for (int k = 0; k < count; k++) {
+			const typename binarytree::flatnode &c = fn[kids[k]];
+			if (c.count > 0) {
+				setLeaf(idx, k, c.offset, c.count);
+			}
+			else {
+				int child = collapse(tree, kids[k]);
+				nodes[idx].child[k] = child;
+				nodes[idx].count[k] = 0;
+			}
+		}
+		return idx;
+	}
+
+	/**
+	 * Intersects the given ray with the box of child @c k of node @c n with
+	 * @c rayquery::slabs , like @c bvh::hitBox .
+	 */
+	static bool hitChild(const widenode &n, int k,
+			const rayquery<vec_T, time_T, dim> &q, time_T tmax,
+			time_T &tnear) {
+		float lo[dim], hi[dim];
+		for (int i = 0; i < dim; i++) {
+			float step = stepOf(n.exponent[i]);
+			lo[i] = dequantize(n.origin[i], step, n.qlo[k][i]);
+			hi[i] = dequantize(n.origin[i], step, n.qhi[k][i]);
+		}
+		return q.slabs(lo, hi, tmax, tnear);
+	}
+
+	/**
+	 * Makes this hierarchy from a built binary one.
+	 *
+	 * @param tree The binary tree.
+	 */
+	void collapseFrom(const binarytree &tree) {
+		nodes.clear();
+		primIndices = tree.primIndices;
+		leafPrims = tree.leafPrims;
+		leafPack = tree.leafPack;
+		if (tree.flatNodes.empty())
+			return;
+		// No more wide nodes than inner binary ones, but for a lone leaf.
+		hugepages::reserve(nodes, tree.flatNodes.size() / 2 + 1);
+
+		if (tree.flatNodes[0].count > 0) {
+			// A single leaf becomes a root with one child.
+			nodes.push_back(widenode());
+			childbox box = boxOf(tree.flatNodes[0]);
+			quantize(nodes[0], &box, 1);
+			setLeaf(0, 0, tree.flatNodes[0].offset, tree.flatNodes[0].count);
+			return;
+		}
+		collapse(tree, 0);
+	}
+
+public:
+
+	/**
+	 * Constructs an empty hierarchy. Call @c build before querying it.
+	 *
+	 * @param builder The algorithm that builds the binary tree that gets
+	 *   collapsed.
+	 * @param numThreads Number of threads that build may use.
+	 */
+	qbvh(bvhBuilder builder = BVH_BUILD_SAH, int numThreads = 1) :
+			builder(builder), numThreads(numThreads) {
+		assert(numThreads > 0);
+	}
+
+	/**
+	 * Builds the hierarchy over the given shapes. The binary tree it's
+	 * collapsed from is freed before this returns.
+	 *
+	 * @param shapes The shapes, which must outlive this hierarchy.
+	 */
+	void build(const std::vector<sp_shape> &shapes) {
+		binarytree tree(builder, numThreads);
+		tree.build(shapes);
+		collapseFrom(tree);
+	}
+
+	/**
+	 * Builds the hierarchy like @c build , but from bounds already
+	 * gathered instead of asking the shapes.
+	 *
+	 * @param shapes The shapes, which must outlive this hierarchy.
+	 * @param boxes The bounds of each of @c shapes .
+	 */
+	void buildFromBounds(const std::vector<sp_shape> &shapes,
+			const std::vector<aabb<vec_T, dim> > &boxes) {
+		binarytree tree(builder, numThreads);
+		tree.buildFromBounds(shapes, boxes);
+		collapseFrom(tree);
+	}
+
+	/**
+	 * Finds the closest shape hit by the given ray. The children of a node
+	 * are pushed farthest first so the nearest is visited next, and entries
+	 * that start beyond the closest hit so far are skipped.
+	 *
+	 * @param r The ray.
+	 * @param[out] tIntersect The time of the hit or @c RAY_MISS .
+	 *
+	 * @return Index of the shape that was hit or -1 if there was no hit.
+	 */
+	int closestHit(const ray<vec_T, time_T, dim> &r,
+			time_T &tIntersect) const {
+		int best = -1;
+		time_T tBest = RAY_MISS;
+
+		if (!nodes.empty()) {
+			rayquery<vec_T, time_T, dim> q(r);
+			const time_T tmax = q.getTMax();
+			stackentry stack[QBVH_MAX_DEPTH * (QBVH_WIDTH - 1) + 1];
+			int sp = 0;
+			stack[sp].child = 0;
+			stack[sp].count = 0;
+			stack[sp++].tnear = 0;
+			while (sp > 0) {
+				const stackentry e = stack[--sp];
+				time_T limit = best < 0 ? tmax : tBest;
+				if (e.tnear > limit)
+					continue;
+				if (e.count > 0) {
+					int i = leafPack.closestHit(r, e.child, e.child + e.count,
+							tBest);
+					if (i >= 0)
+						best = primIndices[i];
+					continue;
+				}
+
+				const widenode &n = nodes[e.child];
+				stackentry hits[QBVH_WIDTH];
+				int numHits = 0;
+				for (int k = 0; k < n.numChildren; k++) {
+					time_T tnear;
+					if (!hitChild(n, k, q, limit, tnear))
+						continue;
+					// Keep the hits sorted farthest first.
+					int j = numHits++;
+					while (j > 0 && hits[j - 1].tnear < tnear) {
+						hits[j] = hits[j - 1];
+						j--;
+					}
+					hits[j].child = n.child[k];
+					hits[j].count = n.count[k];
+					hits[j].tnear = tnear;
+				}
+				assert(sp + numHits <= QBVH_MAX_DEPTH * (QBVH_WIDTH - 1) + 1);
+				for (int j = 0; j < numHits; j++)
+					stack[sp++] = hits[j];
+			}
+		}
+
+		tIntersect = tBest;
+		return best;
+	}
+
+	/**
+	 * Checks if any shape blocks the given ray before @c tmax . Children are
+	 * visited in no particular order and the walk stops at the first hit.
+	 *
+	 * @param r The ray.
+	 * @param tmax Hits at or beyond this time are ignored.
+	 *
+	 * @return Index of a shape that blocks the ray before @c tmax or -1.
+	 */
+	int anyHit(const ray<vec_T, time_T, dim> &r, time_T tmax) const {
+		if (nodes.empty())
+			return -1;
+
+		rayquery<vec_T, time_T, dim> q(r, 0, tmax);
+
+		int stack[QBVH_MAX_DEPTH * (QBVH_WIDTH - 1) + 1];
+		int sp = 0;
+		stack[sp++] = 0;
+		while (sp > 0) {
+			const widenode &n = nodes[stack[--sp]];
+			for (int k = 0; k < n.numChildren; k++) {
+				time_T tnear;
+				if (!hitChild(n, k, q, tmax, tnear))
+					continue;
+				if (n.count[k] == 0) {
+					assert(sp < QBVH_MAX_DEPTH * (QBVH_WIDTH - 1) + 1);
+					stack[sp++] = n.child[k];
+					continue;
+				}
+				int i = leafPack.anyHit(r, n.child[k], n.child[k] + n.count[k],
+						tmax);
+				if (i >= 0)
+					return primIndices[i];
+			}
+		}
+		return -1;
+	}
+
+	/**
+	 * Gets the number of nodes in the tree.
+	 *
+	 * @return Node count.
+	 */
+	int getNodeCount() const {
+		return (int) nodes.size();
+	}
+
+	/**
+	 * Gets the number of bytes taken by the nodes and the leaf shape lists.
+	 *
+	 * @return Memory footprint in bytes.
+	 */
+	size_t getMemoryUsage() const {
+		return nodes.size() * sizeof(widenode) + primIndices.size() *
+				(sizeof(int) + sizeof(leafPrims[0])) +
+				leafPack.getMemoryUsage();
+	}
+
+	/**
+	 * Prints the size of this hierarchy.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printHelper(std::ostream &os) const {
+		os << "[qbvh. bits: " << 8 * sizeof(quant_T) << ", width: " <<
+				QBVH_WIDTH << ", builder: " <<
+				(builder == BVH_BUILD_LBVH ? "lbvh" : "sah") << ", nodes: " <<
+				nodes.size() << ", shapes: " << primIndices.size() << "]";
+	}
+};
+
+typedef qbvh<double, double, double, 3> qbvh3d;
+typedef qbvh<double, double, float, 3> qbvh3ddf;
+typedef qbvh<float, float, float, 3> qbvh3f;
+typedef qbvh<double, double, double, 3, unsigned short> qbvh16_3d;
+typedef qbvh<double, double, float, 3, unsigned short> qbvh16_3ddf;
+typedef qbvh<float, float, float, 3, unsigned short> qbvh16_3f;
+typedef boost::shared_ptr<qbvh3d> sp_qbvh3d;
+typedef boost::shared_ptr<qbvh3ddf> sp_qbvh3ddf;
+typedef boost::shared_ptr<qbvh3f> sp_qbvh3f;
+typedef boost::shared_ptr<qbvh16_3d> sp_qbvh16_3d;
+typedef boost::shared_ptr<qbvh16_3ddf> sp_qbvh16_3ddf;
+typedef boost::shared_ptr<qbvh16_3f> sp_qbvh16_3f;
+
+#endif // QBVH_HH
@@ -0,0 +1,282 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "framebuffer.hh"
+#include "png.hh"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef RASTERIMAGE_HH
+#define RASTERIMAGE_HH
+
+/**
+ * An image as the raytracer writes it, read back from a PPM or PFM file so
+ * crops rendered apart can be put together with @c pasteRasterImage . PPM
+ * pixels keep their 8 bit channels and PFM pixels their floats, so the
+ * merged image has the same values as the crops.
+ */
+struct rasterimage {
+	/** Width in pixels. */
+	int width;
+	/** Height in pixels. */
+	int height;
+	/** Whether the pixels are the floats of a PFM file. */
+	bool isFloat;
+	/** For PPM, whether it's raw P6 rather than plain P3. */
+	bool raw;
+	/** The 8 bit channels, row by row from the top, unless @c isFloat . */
+	std::vector<unsigned char> rgb;
+	/** The float channels, row by row from the top, if @c isFloat . */
+	std::vector<float> rgbf;
+
+	/**
+	 * Makes an empty image.
+	 */
+	rasterimage() : width(0), height(0), isFloat(false), raw(false) { }
+
+	/**
+	 * Makes a black image.
+	 *
+	 * @param width Width in pixels.
+	 * @param height Height in pixels.
+	 * @param isFloat Whether to keep floats rather than 8 bit channels.
+	 * @param raw For 8 bits, whether to write raw P6 rather than plain P3.
+	 */
+	rasterimage(int width, int height, bool isFloat, bool raw) :
+			width(width), height(height), isFloat(isFloat), raw(raw),
+			rgb(isFloat ? 0 : (size_t) width * height * 3, 0),
+			rgbf(isFloat ? (size_t) width * height * 3 : 0, 0.0f) { }
+};
+
+/**
+ * Reads the next number of a PPM or PFM header, skipping white space and
+ * the comments of PPM headers.
+ *
+ * @param is The stream.
+ * @param[out] word Receives the number as it's written.
+ *
+ * @return @c false if the header ends first.
+ */
+inline bool readHeaderWord(std::istream &is, std::string &word) {
+	word.clear();
+	int c = is.get();
+	while (c != EOF && (isspace(c) || c == '#')) {
+		if (c == '#')
+			while (c != EOF && c != '\n')
+				c = is.get();
+		c = is.get();
+	}
+	while (c != EOF && !isspace(c)) {
+		word += (char) c;
+		c = is.get();
+	}
+	return !word.empty();
+}
+
+/**
+ * Reads a plain P3 or raw P6 PPM image with channels up to
+ * @c QUANTIZE_MAX , or a PFM image, as @c scene::writePPM and
+ * @c framebuffer::writePFM write them.
+ *
+ * @param is The stream, which should be in binary mode.
+ * @param[out] image Receives the image.
+ * @param[out] error Receives what's wrong if it can't be read.
+ *
+ * @return @c false if the stream doesn't hold such an image.
+ */
+inline bool readRasterImage(std::istream &is, rasterimage &image,
+		std::string &error) {
+	std::string magic, w, h, max;
+	if (!readHeaderWord(is, magic) || (magic != "P3" && magic != "P6" &&
+			magic != "PF")) {
+		error = "not a PPM or PFM image.";
+		return false;
+	}
+	char *end = 0;
+	if (!readHeaderWord(is, w) || !readHeaderWord(is, h) ||
+			!readHeaderWord(is, max) || atoi(w.c_str()) <= 0 ||
+			atoi(h.c_str()) <= 0 || (strtod(max.c_str(), &end) == 0 ||
+					*end != '\0')) {
+		error = "the image header is malformed.";
+		return false;
+	}
+	int width = atoi(w.c_str()), height = atoi(h.c_str());
+	size_t channels = (size_t) width * height * 3;
+	if (magic == "PF") {
+		image = rasterimage(width, height, true, false);
+		unsigned int one = 1;
+		bool little = *reinterpret_cast<unsigned char *>(&one) == 1;
+		bool swap = (atof(max.c_str()) < 0) != little;
+		std::vector<float> row((size_t) width * 3);
+		// PFM rows go from the bottom up.
+		for (int y = height - 1; y >= 0; y--) {
+			char *bytes = reinterpret_cast<char *>(&row[0]);
+			if (!is.read(bytes, row.size() * sizeof(float))) {
+				error = "the image ends early.";
+				return false;
+			}
+			for (size_t i = 0; swap && i < row.size(); i++)
+				std::reverse(bytes + i * 4, bytes + i * 4 + 4);
+			std::copy(row.begin(), row.end(),
+					image.rgbf.begin() + (size_t) y * width * 3);
+		}
+		return true;
+	}
+	if (atoi(max.c_str()) != QUANTIZE_MAX) {
+		error = "the image doesn't have 8 bit channels.";
+		return false;
+	}
+	image = rasterimage(width, height, false, magic == "P6");
+	if (image.raw) {
+		if (!is.read(reinterpret_cast<char *>(&image.rgb[0]), channels)) {
+			error = "the image ends early.";
+			return false;
+		}
+		return true;
+	}
+	for (size_t i = 0; i < channels; i++) {
+		std::string v;
+		if (!readHeaderWord(is, v)) {
+			error = "the image ends early.";
+			return false;
+		}
+		image.rgb[i] = (unsigned char) std::min(atoi(v.c_str()),
+				QUANTIZE_MAX);
+	}
+	return true;
+}
+
+/**
+ * Copies an image into a larger one.
+ *
+ * @param[in,out] dest The larger image.
+ * @param src The image to copy.
+ * @param x0 Column of @c dest for the left column of @c src .
+ * @param y0 Row of @c dest for the top row of @c src .
+ * @param[out] error Receives what's wrong if it can't be copied.
+ *
+ * @return @c false, changing nothing, if @c src doesn't fit there or the
+ *   images don't both keep floats or both 8 bit channels.
+ */
+inline bool pasteRasterImage(rasterimage &dest, const rasterimage &src,
+		int x0, int y0, std::string &error) {
+	if (src.isFloat != dest.isFloat) {
+		error = "PPM and PFM images can't be merged.";
+		return false;
+	}
+	if (x0 < 0 || y0 < 0 || x0 + src.width > dest.width ||
+			y0 + src.height > dest.height) {
+		std::ostringstream os;
+		os << "a " << src.width << "x" << src.height << " image at (" << x0
+				<< ", " << y0 << ") doesn't fit in " << dest.width << "x" <<
+				dest.height << ".";
+		error = os.str();
+		return false;
+	}
+	for (int y = 0; y < src.height; y++) {
+		size_t from = (size_t) y * src.width * 3;
+		size_t to = ((size_t) (y0 + y) * dest.width + x0) * 3;
+		if (src.isFloat)
+			std::copy(src.rgbf.begin() + from, src.rgbf.begin() + from +
+					src.width * 3, dest.rgbf.begin() + to);
+		else
+			std::copy(src.rgb.begin() + from, src.rgb.begin() + from +
+					src.width * 3, dest.rgb.begin() + to);
+	}
+	return true;
+}
+
+/**
+ * Compares two images channel by channel, e.g. a render with a golden
+ * image of it. 8 bit channels differ by whole levels, floats by their
+ * difference times @c QUANTIZE_MAX , so a tolerance is in the same units
+ * for both.
+ *
+ * @param a One image.
+ * @param b The other.
+ * @param tolerance How much a channel may differ.
+ * @param[out] maxDiff Receives the largest difference of a channel.
+ * @param[out] differing Receives the number of pixels with a channel that
+ *   differs by more than the tolerance.
+ * @param[out] error Receives what's wrong if they can't be compared.
+ *
+ * @return @c false if the images differ in size or kind of channel.
+ */
+inline bool compareRasterImages(const rasterimage &a, const rasterimage &b,
+		double tolerance, double &maxDiff, size_t &differing,
+		std::string &error) {
+	if (a.width != b.width || a.height != b.height ||
+			a.isFloat != b.isFloat) {
+		std::ostringstream os;
+		os << "a " << a.width << "x" << a.height << (a.isFloat ? " PFM" :
+				" PPM") << " image can't be compared with a " << b.width <<
+				"x" << b.height << (b.isFloat ? " PFM" : " PPM") << " one.";
+		error = os.str();
+		return false;
+	}
+	maxDiff = 0;
+	differing = 0;
+	size_t pixels = (size_t) a.width * a.height;
+	for (size_t i = 0; i < pixels; i++) {
+		bool differs = false;
+		for (size_t k = i * 3; k < i * 3 + 3; k++) {
+			double d = a.isFloat ? std::fabs((double) a.rgbf[k] - b.rgbf[k]) *
+					QUANTIZE_MAX : std::abs((int) a.rgb[k] - (int) b.rgb[k]);
+			maxDiff = std::max(maxDiff, d);
+			differs = differs || d > tolerance;
+		}
+		if (differs)
+			differing++;
+	}
+	return true;
+}
+
+/**
+ * Writes an image as it was read: PPM in its own format for 8 bit
+ * channels, PFM for floats, or PNG for 8 bit channels if asked.
+ *
+ * @param image The image.
+ * @param os The output stream, which should be in binary mode.
+ * @param png Whether to write PNG.
+ * @param numThreads Number of threads to compress PNG on.
+ */
+inline void writeRasterImage(const rasterimage &image, std::ostream &os,
+		bool png = false, int numThreads = 1) {
+	if (image.isFloat) {
+		os << framebuffer<float>::pfmHeader(image.width, image.height);
+		for (int y = image.height - 1; y >= 0; y--)
+			os.write(reinterpret_cast<const char *>(
+					&image.rgbf[(size_t) y * image.width * 3]),
+					(size_t) image.width * 3 * sizeof(float));
+	}
+	else if (png) {
+		encodePNG(image.rgb, image.width, image.height, os, numThreads);
+	}
+	else if (image.raw) {
+		os << "P6\n" << image.width << " " << image.height << "\n" <<
+				QUANTIZE_MAX << "\n";
+		os.write(reinterpret_cast<const char *>(&image.rgb[0]),
+				image.rgb.size());
+	}
+	else {
+		os << "P3 " << image.width << " " << image.height << " " <<
+				QUANTIZE_MAX << "\n";
+		for (size_t i = 0; i < image.rgb.size(); i += 3)
+			os << (int) image.rgb[i] << " " << (int) image.rgb[i + 1] << " "
+					<< (int) image.rgb[i + 2] << "\n";
+	}
+	os.flush();
+}
+
+#endif // RASTERIMAGE_HH
@@ -6,6 +6,8 @@
 #include <cassert>
 #include "mvector.hh"
 #include <ostream>
+#include <limits>
+#include <algorithm>
 
 #ifndef RAY_HH
 #define RAY_HH
@@ -36,6 +38,26 @@ private:
 	 */
 	mvector<vec_T, dim> D;
 
+	/**
+	 * True if @c D was normalized when this ray was made, which lets
+	 * intersection code skip terms that are 1 for unit directions.
+	 */
+	bool unitDir;
+
+	/**
+	 * When in the shutter interval this ray is traced, from 0 when the
+	 * shutter opens to 1 when it closes. Moving shapes are where they are
+	 * at this time. A float so that it fits in the padding after
+	 * @c unitDir .
+	 */
+	float shutter;
+
+	/**
+	 * Address of the shape this ray leaves and can't hit again, or 0; see
+	 * @c setExcluded .
+	 */
+	const void *excluded;
+
 public:
 
 	/**
@@ -48,6 +70,9 @@ public:
 			D[i] = 0;
 		}
 		D[0] = 1;
+		unitDir = true;
+		shutter = 0;
+		excluded = 0;
 	}
 
 	/**
@@ -63,6 +88,61 @@ public:
 			bool normalizeDir = true) {
 		this->P = start; // copy origination point to orig
 		this->D = normalizeDir ? direction.norm() : direction;
+		this->unitDir = normalizeDir;
+		this->shutter = 0;
+		this->excluded = 0;
+	}
+
+	/**
+	 * Checks if the direction of this ray was normalized by the constructor.
+	 * Rays made with @c normalizeDir off report @c false even if their
+	 * direction happens to have unit length.
+	 *
+	 * @return @c true if the direction has unit length.
+	 */
+	bool isNormalized() const {
+		return unitDir;
+	}
+
+	/**
+	 * Gets when in the shutter interval this ray is traced.
+	 *
+	 * @return The time, from 0 to 1.
+	 */
+	float getShutter() const {
+		return shutter;
+	}
+
+	/**
+	 * Setter for when in the shutter interval this ray is traced. Rays
+	 * made from this one, like reflections, keep it.
+	 *
+	 * @param s The time, from 0 to 1.
+	 */
+	void setShutter(float s) {
+		shutter = s;
+	}
+
+	/**
+	 * Gets the shape this ray leaves.
+	 *
+	 * @return Address of the shape, or 0.
+	 */
+	const void * getExcluded() const {
+		return excluded;
+	}
+
+	/**
+	 * Says which shape this ray leaves, for a shadow or reflection ray that
+	 * starts on a convex shape and points out of it and so can't hit it
+	 * again. Spheres and planes then miss this ray without a test, however
+	 * far rounding put its origin from their surfaces. Other shapes ignore
+	 * it. Moved copies of this ray keep it; reflections don't.
+	 *
+	 * @param s Address of the shape, or 0 for none.
+	 */
+	void setExcluded(const void *s) {
+		excluded = s;
 	}
 
 	/**
@@ -87,6 +167,9 @@ public:
 			return *this;
 		P = rhs.getOrig();
 		D = rhs.getDir();
+		unitDir = rhs.isNormalized();
+		shutter = rhs.getShutter();
+		excluded = rhs.getExcluded();
 		return *this;
 	}
 
@@ -99,6 +182,22 @@ public:
 		return P;
 	}
 
+	/**
+	 * Gets this ray with its origin moved by the given offset. The direction,
+	 * whether it was normalized and the time in the shutter interval stay
+	 * the same.
+	 *
+	 * @param offset What to add to the origin.
+	 *
+	 * @return The moved ray.
+	 */
+	ray<vec_T, time_T, dim> translated(
+			const mvector<vec_T, dim> &offset) const {
+		ray<vec_T, time_T, dim> moved(*this);
+		moved.P += offset;
+		return moved;
+	}
+
 	/**
 	 * Computes the ray's position at time t, which must be at least 0. The
 	 * position is computed as @f$ \mathbf{v} = \mathbf{p} + \mathbf{d} t @f$
@@ -109,7 +208,7 @@ public:
 	 */
 	mvector<vec_T, dim> getPointAtT(time_T t) const {
 		assert(t >= 0);
-		return P + t * D;
+		return P + ((vec_T) t) * D;
 	}
 
 	/**
@@ -129,14 +228,15 @@ public:
 	 * @param epsilon A small positive time value used in the reflected ray
 	 *        computation.
 	 *
-	 * @return The reflected ray.
+	 * @return The reflected ray, at the same time in the shutter interval.
 	 */
 	ray<vec_T, time_T, dim> reflect(
 			const mvector<vec_T, dim> &X,
 			const mvector<vec_T, dim> &N,
 			time_T epsilon = 0.0001) const {
 		mvector<vec_T, dim> D_r = D + ((vec_T) 2) * (-D).proj(N);
-		ray<vec_T, time_T, dim> R_r(X + D_r * epsilon, D_r);
+		ray<vec_T, time_T, dim> R_r(X + D_r * (vec_T) epsilon, D_r);
+		R_r.shutter = shutter;
 		return R_r;
 	}
 
@@ -165,11 +265,224 @@ std::ostream & operator<<(std::ostream& os,
 	return os;
 }
 
+/**
+ * A ray prepared for many box tests: along with the ray, it carries the
+ * componentwise reciprocal of the direction, the sign of each component of
+ * the direction and the interval of times [tmin, tmax] a query cares about.
+ * Made once per query, before the walk of an acceleration structure, it
+ * lets every slab test pick the near and far planes of a box by the signs
+ * and compute their times with a subtraction and a multiplication each,
+ * with no division and no swap. Occlusion queries put the distance to the
+ * light in @c tmax .
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam time_T The type of the time.
+ * @tparam dim The number of dimensions, which is likely 2 or 3.
+ */
+template<typename vec_T, typename time_T, int dim>
+class rayquery {
+private:
+
+	/**
+	 * The ray, which must outlive this object.
+	 */
+	const ray<vec_T, time_T, dim> *r;
+
+	/**
+	 * Componentwise reciprocal of the ray direction. Zero components give
+	 * infinities of the component's sign.
+	 */
+	mvector<vec_T, dim> invDir;
+
+	/**
+	 * 1 for the axes along which the direction is negative, where the far
+	 * side of a box is its low side, and 0 for the others.
+	 */
+	int sign[dim];
+
+	/**
+	 * Start of the time interval.
+	 */
+	time_T tmin;
+
+	/**
+	 * End of the time interval.
+	 */
+	time_T tmax;
+
+public:
+
+	/**
+	 * Constructs a query without a ray, e.g. for arrays that are filled in
+	 * later.
+	 */
+	rayquery() : r(0), tmin(0), tmax(0) {
+		for (int i = 0; i < dim; i++)
+			sign[i] = 0;
+	}
+
+	/**
+	 * Prepares the given ray for box tests over the given interval.
+	 *
+	 * @param theRay The ray, which must outlive this object.
+	 * @param tmin Start of the interval.
+	 * @param tmax End of the interval; unbounded by default.
+	 */
+	explicit rayquery(const ray<vec_T, time_T, dim> &theRay, time_T tmin = 0,
+			time_T tmax = std::numeric_limits<time_T>::max()) :
+			r(&theRay), tmin(tmin), tmax(tmax) {
+		for (int i = 0; i < dim; i++) {
+			invDir[i] = 1 / theRay.getDir()[i];
+			sign[i] = invDir[i] < 0;
+		}
+	}
+
+	/**
+	 * Gets the ray.
+	 *
+	 * @return The ray.
+	 */
+	const ray<vec_T, time_T, dim>& getRay() const {
+		return *r;
+	}
+
+	/**
+	 * Gets the origin of the ray.
+	 *
+	 * @return Origin point.
+	 */
+	const mvector<vec_T, dim>& getOrig() const {
+		return r->getOrig();
+	}
+
+	/**
+	 * Gets the componentwise reciprocal of the ray direction.
+	 *
+	 * @return The reciprocal direction.
+	 */
+	const mvector<vec_T, dim>& getInvDir() const {
+		return invDir;
+	}
+
+	/**
+	 * Gets the sign of a component of the direction.
+	 *
+	 * @param i The axis.
+	 *
+	 * @return 1 if the direction is negative along the axis, else 0.
+	 */
+	int getSign(int i) const {
+		return sign[i];
+	}
+
+	/**
+	 * Gets the start of the time interval.
+	 *
+	 * @return The start time.
+	 */
+	time_T getTMin() const {
+		return tmin;
+	}
+
+	/**
+	 * Gets the end of the time interval.
+	 *
+	 * @return The end time.
+	 */
+	time_T getTMax() const {
+		return tmax;
+	}
+
+	/**
+	 * Setter for the end of the time interval, e.g. to shrink it to the
+	 * closest hit found so far.
+	 *
+	 * @param t The end time.
+	 */
+	void setTMax(time_T t) {
+		tmax = t;
+	}
+
+	/**
+	 * Intersects the ray with the box with the given corners over the
+	 * interval [tmin, t] , where @c t is at most @c tmax . NaNs from
+	 * 0 * inf leave the interval alone.
+	 *
+	 * @param lo The low corner.
+	 * @param hi The high corner.
+	 * @param t End of the interval for this test.
+	 * @param[out] tnear Time at which the ray enters the box, if it does.
+	 *
+	 * @return @c true if the interval overlaps the box.
+	 */
+	template<typename box_T>
+	bool slabs(const box_T *lo, const box_T *hi, time_T t,
+			time_T &tnear) const {
+		const mvector<vec_T, dim> &P = r->getOrig();
+		time_T t0 = tmin, t1 = t;
+		for (int i = 0; i < dim; i++) {
+			time_T tn = (time_T) (((sign[i] ? hi[i] : lo[i]) - P[i]) *
+					invDir[i]);
+			time_T tf = (time_T) (((sign[i] ? lo[i] : hi[i]) - P[i]) *
+					invDir[i]);
+			if (tn > t0)
+				t0 = tn;
+			if (tf < t1)
+				t1 = tf;
+			if (t0 > t1)
+				return false;
+		}
+		tnear = t0;
+		return true;
+	}
+
+	/**
+	 * Like @c slabs , but with the exit times scaled up by a bound on their
+	 * rounding error, so that a ray is never found to pass by a box it
+	 * touches, such as the flat box around triangles in a plane. Walks that
+	 * lead to watertight primitive tests use this so they don't leak
+	 * between boxes either.
+	 *
+	 * @param lo The low corner.
+	 * @param hi The high corner.
+	 * @param t End of the interval for this test.
+	 * @param[out] tnear Time at which the ray enters the box, if it does.
+	 *
+	 * @return @c true if the interval overlaps the box.
+	 */
+	template<typename box_T>
+	bool slabsConservative(const box_T *lo, const box_T *hi, time_T t,
+			time_T &tnear) const {
+		const time_T grow = 1 + 8 * (time_T) std::max(
+				(double) std::numeric_limits<vec_T>::epsilon(),
+				(double) std::numeric_limits<time_T>::epsilon());
+		const mvector<vec_T, dim> &P = r->getOrig();
+		time_T t0 = tmin, t1 = t;
+		for (int i = 0; i < dim; i++) {
+			time_T tn = (time_T) (((sign[i] ? hi[i] : lo[i]) - P[i]) *
+					invDir[i]);
+			time_T tf = (time_T) (((sign[i] ? lo[i] : hi[i]) - P[i]) *
+					invDir[i]) * grow;
+			if (tn > t0)
+				t0 = tn;
+			if (tf < t1)
+				t1 = tf;
+			if (t0 > t1)
+				return false;
+		}
+		tnear = t0;
+		return true;
+	}
+};
+
 typedef ray<double, double, 3> ray3d;
 typedef ray<double, float, 3> ray3df;
 typedef ray<float, float, 3> ray3f;
 typedef ray<double, double, 2> ray2d;
 typedef ray<double, float, 2> ray2df;
 typedef ray<float, float, 2> ray2f;
+typedef rayquery<double, double, 3> rayquery3d;
+typedef rayquery<double, float, 3> rayquery3df;
+typedef rayquery<float, float, 3> rayquery3f;
 
 #endif // RAY_HH
@@ -0,0 +1,302 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/locks.hpp"
+#include "boost/thread/tss.hpp"
+#include <algorithm>
+#include <ostream>
+#include <vector>
+
+#ifndef RAYSTATS_HH
+#define RAYSTATS_HH
+
+/**
+ * Number of shape classes @c raystats counts intersection tests for: one
+ * per @c shapeKind , in its order.
+ */
+#define RAYSTATS_SHAPE_KINDS 4
+
+/**
+ * Adds @c n to a counter of the calling thread's @c raystats , e.g.
+ * @code RAYSTATS_ADD(hits, 1); @endcode Expands to nothing unless the
+ * program is built with @c RT_STATS defined, so that counting costs the
+ * hot loops nothing in a normal build.
+ */
+#ifdef RT_STATS
+#define RAYSTATS_ADD(counter, n) (raystats::local().counter += (n))
+#else
+#define RAYSTATS_ADD(counter, n) ((void) 0)
+#endif
+
+/**
+ * Counts of the work a render does: rays of each kind, intersection tests
+ * of each shape class and hits. Every thread counts into its own, so
+ * counting takes no locks and shares no cache lines; @c total adds up
+ * those of all threads, including those of ended threads, which are
+ * folded into one sum as each ends. The hot loops only count through
+ * @c RAYSTATS_ADD , so unless @c RT_STATS is defined everything stays 0.
+ */
+struct raystats {
+
+	/**
+	 * Rays whose closest hit was looked for: camera rays and reflections.
+	 */
+	unsigned long long closestRays;
+
+	/**
+	 * Shadow rays.
+	 */
+	unsigned long long shadowRays;
+
+	/**
+	 * Shadows looked up in a shadow map instead of traced.
+	 */
+	unsigned long long shadowMapLookups;
+
+	/**
+	 * Closest hit queries made to build shadow maps.
+	 */
+	unsigned long long shadowMapRays;
+
+	/**
+	 * Reflected rays that were followed.
+	 */
+	unsigned long long reflectionRays;
+
+	/**
+	 * Closest hit queries that hit something.
+	 */
+	unsigned long long hits;
+
+	/**
+	 * Light samples dropped without a shadow ray because they're behind the
+	 * surface.
+	 */
+	unsigned long long culledBackFacing;
+
+	/**
+	 * Light samples dropped because the shading point is outside the light's
+	 * reach, like the cone of a spotlight.
+	 */
+	unsigned long long culledOutside;
+
+	/**
+	 * Light samples dropped without a shadow ray because they could add
+	 * less than the light cutoff of the scene.
+	 */
+	unsigned long long culledDim;
+
+	/**
+	 * Light samples whose shadow ray wasn't traced because the first samples
+	 * of their area light agreed; see @c scene::setAdaptiveShadows .
+	 */
+	unsigned long long culledAdaptive;
+
+	/**
+	 * Ray-shape intersection tests by @c shapeKind .
+	 */
+	unsigned long long tests[RAYSTATS_SHAPE_KINDS];
+
+	/**
+	 * Makes counts that are all 0.
+	 */
+	raystats() {
+		clear();
+	}
+
+	/**
+	 * Sets every count to 0.
+	 */
+	void clear() {
+		closestRays = shadowRays = reflectionRays = hits = 0;
+		shadowMapLookups = shadowMapRays = 0;
+		culledBackFacing = culledOutside = culledDim = culledAdaptive = 0;
+		for (int i = 0; i < RAYSTATS_SHAPE_KINDS; i++)
+			tests[i] = 0;
+	}
+
+	/**
+	 * Adds other counts to these.
+	 *
+	 * @param other The counts to add.
+	 */
+	void merge(const raystats &other) {
+		closestRays += other.closestRays;
+		shadowRays += other.shadowRays;
+		shadowMapLookups += other.shadowMapLookups;
+		shadowMapRays += other.shadowMapRays;
+		reflectionRays += other.reflectionRays;
+		hits += other.hits;
+		culledBackFacing += other.culledBackFacing;
+		culledOutside += other.culledOutside;
+		culledDim += other.culledDim;
+		culledAdaptive += other.culledAdaptive;
+		for (int i = 0; i < RAYSTATS_SHAPE_KINDS; i++)
+			tests[i] += other.tests[i];
+	}
+
+	/**
+	 * Gets the number of camera rays, which are the closest hit queries
+	 * that aren't reflections or made for shadow maps.
+	 *
+	 * @return Camera ray count.
+	 */
+	unsigned long long getPrimaryRays() const {
+		return closestRays - reflectionRays - shadowMapRays;
+	}
+
+	/**
+	 * Prints the counts, one kind per line.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void print(std::ostream &os) const {
+		static const char *kinds[RAYSTATS_SHAPE_KINDS] = { "sphere", "plane",
+				"cylinder", "other" };
+		unsigned long long primary = getPrimaryRays();
+		os << "rays: " << primary << " primary, " << shadowRays <<
+				" shadow, " << reflectionRays << " reflection" << std::endl;
+		if (shadowMapRays > 0)
+			os << "shadow maps: " << shadowMapRays << " rays to build, " <<
+					shadowMapLookups << " lookups" << std::endl;
+		os << "hits: " << hits << " of " << closestRays << " closest hit"
+				" queries" << std::endl;
+		os << "culled light samples: " << culledBackFacing << " back-facing, "
+				<< culledOutside << " outside reach, " << culledDim <<
+				" too dim, " << culledAdaptive << " settled adaptively" <<
+				std::endl;
+		os << "intersection tests:";
+		for (int i = 0; i < RAYSTATS_SHAPE_KINDS; i++)
+			os << (i > 0 ? "," : "") << " " << tests[i] << " " << kinds[i];
+		os << std::endl;
+		os << "mean reflection depth: " <<
+				(primary > 0 ? (double) reflectionRays / primary : 0.0) <<
+				std::endl;
+	}
+
+	/**
+	 * Gets the counts of the calling thread, made the first time it asks.
+	 * When the thread ends they're added to those of the threads that
+	 * ended before it, for @c total , and freed.
+	 *
+	 * @return The thread's counts.
+	 */
+	static raystats& local() {
+		raystats *&mine = cached();
+		if (mine == 0) {
+			mine = new raystats();
+			{
+				boost::lock_guard<boost::mutex> guard(registryLock());
+				registry().push_back(mine);
+			}
+			owner().reset(mine);
+		}
+		return *mine;
+	}
+
+	/**
+	 * Adds up the counts of every thread, ended or not. Threads that are
+	 * still counting may or may not have their latest counts in the sum.
+	 *
+	 * @return The sums.
+	 */
+	static raystats total() {
+		boost::lock_guard<boost::mutex> guard(registryLock());
+		raystats sum = retired();
+		for (size_t i = 0; i < registry().size(); i++)
+			sum.merge(*registry()[i]);
+		return sum;
+	}
+
+	/**
+	 * Sets the counts of every thread to 0, e.g. between frames. No thread
+	 * may be counting.
+	 */
+	static void reset() {
+		boost::lock_guard<boost::mutex> guard(registryLock());
+		retired().clear();
+		for (size_t i = 0; i < registry().size(); i++)
+			registry()[i]->clear();
+	}
+
+	/**
+	 * Gets the number of threads whose counts are kept apart, which are
+	 * those that counted and haven't ended.
+	 *
+	 * @return The thread count.
+	 */
+	static size_t getLiveThreads() {
+		boost::lock_guard<boost::mutex> guard(registryLock());
+		return registry().size();
+	}
+
+private:
+
+	/**
+	 * Gets the calling thread's counts without a lookup, or null if it
+	 * hasn't counted.
+	 */
+	static raystats *&cached() {
+		static __thread raystats *mine = 0;
+		return mine;
+	}
+
+	/**
+	 * Gets the counts of the threads that counted and haven't ended.
+	 */
+	static std::vector<raystats *>& registry() {
+		static std::vector<raystats *> all;
+		return all;
+	}
+
+	/**
+	 * Gets the sums of the counts of the threads that ended.
+	 */
+	static raystats& retired() {
+		static raystats sum;
+		return sum;
+	}
+
+	/**
+	 * Folds the counts of a thread that's ending into @c retired and frees
+	 * them.
+	 *
+	 * @param mine The thread's counts.
+	 */
+	static void retire(raystats *mine) {
+		{
+			boost::lock_guard<boost::mutex> guard(registryLock());
+			retired().merge(*mine);
+			std::vector<raystats *> &all = registry();
+			all.erase(std::remove(all.begin(), all.end(), mine), all.end());
+		}
+		if (cached() == mine)
+			cached() = 0;
+		delete mine;
+	}
+
+	/**
+	 * Gets what calls @c retire on each thread's counts when it ends. The
+	 * statics it uses are made first so they outlive it.
+	 */
+	static boost::thread_specific_ptr<raystats>& owner() {
+		registryLock();
+		registry();
+		retired();
+		static boost::thread_specific_ptr<raystats> counts(retire);
+		return counts;
+	}
+
+	/**
+	 * Gets the lock that guards @c registry .
+	 */
+	static boost::mutex& registryLock() {
+		static boost::mutex lock;
+		return lock;
+	}
+};
+
+#endif // RAYSTATS_HH
@@ -0,0 +1,172 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "sceneparser.hh"
+#include "mvector.hh"
+#include <string>
+
+#ifndef RENDERCOMMAND_HH
+#define RENDERCOMMAND_HH
+
+/**
+ * What a line sent to a render server asks for.
+ */
+enum renderCommandKind {
+	/** Nothing: a blank line or a comment. */
+	COMMAND_NONE,
+	/** Render an image of the loaded scene. */
+	COMMAND_RENDER,
+	/** Stop serving. */
+	COMMAND_QUIT
+};
+
+/**
+ * A command of the line protocol the driver's @c --serve mode reads, one
+ * per line:
+ *
+ * render width height file [samples n] [camera position look_at up]
+ * [priority p] [deadline ms]
+ *
+ * quit
+ *
+ * The file name has no white space in it, and its extension picks the
+ * image format as for @c -o . Vectors are written as in scene
+ * descriptions, and a line starting with # is a comment. Renders of a
+ * higher priority, a whole number that may be negative, go before those
+ * under way, and of renders of the same priority the one due soonest, ms
+ * milliseconds after its line came in, goes first.
+ */
+struct rendercommand {
+	/** The kind of command. */
+	renderCommandKind kind;
+	/** The width of the image in pixels. */
+	int width;
+	/** The height of the image in pixels. */
+	int height;
+	/** Where to write the image. */
+	std::string file;
+	/** Samples per pixel along each axis, or 0 for the server's. */
+	int samples;
+	/** Whether the command has its own camera. */
+	bool hasCamera;
+	/** Position of the camera. */
+	mvector<double, 3> position;
+	/** Point the camera looks at. */
+	mvector<double, 3> lookat;
+	/** Up direction of the camera. */
+	mvector<double, 3> up;
+	/** Renders of higher priorities go first; 0 by default. */
+	int priority;
+	/** Milliseconds after the command comes in that the render is due, or
+	 * 0 if it has no deadline. */
+	int deadline;
+};
+
+/**
+ * Reads a positive whole number of a command.
+ *
+ * @param in The tokenizer.
+ * @param[out] n Receives the number.
+ *
+ * @return @c false if the next token isn't one.
+ */
+inline bool readCommandCount(scenetokenizer &in, int &n) {
+	double v;
+	if (!in.number(v) || !(v >= 1 && v <= 1 << 30) || v != (double) (int) v)
+		return false;
+	n = (int) v;
+	return true;
+}
+
+/**
+ * Reads a whole number of a command, which may be negative.
+ *
+ * @param in The tokenizer.
+ * @param[out] n Receives the number.
+ *
+ * @return @c false if the next token isn't one.
+ */
+inline bool readCommandInteger(scenetokenizer &in, int &n) {
+	double v;
+	if (!in.number(v) || !(v >= -(1 << 30) && v <= 1 << 30) ||
+			v != (double) (int) v)
+		return false;
+	n = (int) v;
+	return true;
+}
+
+/**
+ * Reads one line of the @c rendercommand protocol.
+ *
+ * @param line The line, without its newline.
+ * @param[out] cmd Receives the command.
+ * @param[out] error Receives what's wrong with the line, if anything.
+ *
+ * @return @c false if the line isn't a valid command.
+ */
+inline bool parseRenderCommand(const std::string &line, rendercommand &cmd,
+		std::string &error) {
+	cmd.kind = COMMAND_NONE;
+	cmd.width = cmd.height = cmd.samples = 0;
+	cmd.file.clear();
+	cmd.hasCamera = false;
+	cmd.priority = cmd.deadline = 0;
+	bool hasPriority = false;
+	scenetokenizer in(line.data(), line.data() + line.size());
+	std::string word;
+	if (!in.word(word) || word[0] == '#')
+		return true;
+	if (word == "quit") {
+		cmd.kind = COMMAND_QUIT;
+		return true;
+	}
+	if (word != "render") {
+		error = "unknown command \"" + word + "\".";
+		return false;
+	}
+	if (!readCommandCount(in, cmd.width) ||
+			!readCommandCount(in, cmd.height) || !in.word(cmd.file)) {
+		error = "render needs a width, a height and a file.";
+		return false;
+	}
+	while (in.word(word)) {
+		if (word == "samples" && !cmd.samples) {
+			if (!readCommandCount(in, cmd.samples)) {
+				error = "samples needs a positive count.";
+				return false;
+			}
+		}
+		else if (word == "camera" && !cmd.hasCamera) {
+			if (!in.vector(cmd.position) || !in.vector(cmd.lookat) ||
+					!in.vector(cmd.up)) {
+				error = "camera needs a position, a point to look at and an "
+						"up direction.";
+				return false;
+			}
+			cmd.hasCamera = true;
+		}
+		else if (word == "priority" && !hasPriority) {
+			if (!readCommandInteger(in, cmd.priority)) {
+				error = "priority needs a whole number.";
+				return false;
+			}
+			hasPriority = true;
+		}
+		else if (word == "deadline" && !cmd.deadline) {
+			if (!readCommandCount(in, cmd.deadline)) {
+				error = "deadline needs a positive count of milliseconds.";
+				return false;
+			}
+		}
+		else {
+			error = "unexpected \"" + word + "\" in render.";
+			return false;
+		}
+	}
+	cmd.kind = COMMAND_RENDER;
+	return true;
+}
+
+#endif // RENDERCOMMAND_HH
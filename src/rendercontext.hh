@@ -0,0 +1,540 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "shape.hh"
+#include "light.hh"
+#include "boost/noncopyable.hpp"
+#include <cassert>
+#include <vector>
+#include <ostream>
+#include <utility>
+
+#ifndef RENDERCONTEXT_HH
+#define RENDERCONTEXT_HH
+
+/**
+ * Mutable state that one rendering thread carries through @c scene::traceRay
+ * so that the scene itself can stay const and shared. Every thread needs its
+ * own context. It holds the shadow cache, which remembers for each light the
+ * shape that last blocked a shadow ray towards it, the pixel sample being
+ * shaded, whose random numbers shading draws, what the shadow rays of the
+ * samples of a pixel found for reuse by its other samples, and the
+ * counters that go into the stats output.
+ *
+ * @tparam vec_T The type of the vector components. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double,
+ *   float, or int.
+ * @tparam time_T The type of the time. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double or
+ *   float, but int would likely work.
+ * @tparam color_T The type of the @c rgbcolor. Many arithmetic
+ *   and relational operators must be supported, including real number ones.
+ *   The type will likely be double or float.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class rendercontext {
+private:
+
+	/**
+	 * For each light, the shape that blocked the last shadow ray towards it,
+	 * or 0.
+	 */
+	std::vector<const shape<vec_T, color_T, time_T, dim> *> lastOccluder;
+
+	/**
+	 * Number of shadow rays tested against a cached shape.
+	 */
+	unsigned long shadowCacheTests;
+
+	/**
+	 * Number of those tests where the cached shape blocked the ray.
+	 */
+	unsigned long shadowCacheHits;
+
+	/**
+	 * Scratch list of the lights that may light a shading point.
+	 */
+	std::vector<int> candidateLights;
+
+	/**
+	 * Scratch list of the light clusters that may light a shading point.
+	 */
+	std::vector<int> candidateClusters;
+
+	/**
+	 * Scratch list of the light samples light picking chooses from.
+	 */
+	std::vector<lightcandidate<vec_T, color_T, dim> > lightCandidates;
+
+	/**
+	 * Scratch list of the lights that may light the current screen tile.
+	 */
+	std::vector<int> tileLights;
+
+	/**
+	 * Scratch list of the shape id and index of every pixel of the current
+	 * screen tile.
+	 */
+	std::vector<std::pair<int, int> > tileBatch;
+
+	/**
+	 * Sum over screen tiles of the number of lights kept for the tile.
+	 */
+	unsigned long tileLightsKept;
+
+	/**
+	 * Sum over screen tiles of the number of lights in the scene.
+	 */
+	unsigned long tileLightsTotal;
+
+	/**
+	 * Number of pixels anti-aliased with more than one sample.
+	 */
+	unsigned long supersampledPixels;
+
+	/**
+	 * The pixel and index of the sample being shaded, whose random numbers
+	 * shading draws, if @c hasPixelSample .
+	 */
+	int sampleX, sampleY;
+	unsigned int sampleIndex;
+	bool hasPixelSample;
+
+	/**
+	 * For each light, whether the shadow rays of the current pixel towards
+	 * it were all blocked, 1, all clear, 0, or both, -1; only entries whose
+	 * @c visibilityStamp is @c visibilityPixel are of the current pixel.
+	 */
+	std::vector<signed char> visibility;
+
+	/**
+	 * For each light, the @c visibilityPixel its entry was set in.
+	 */
+	std::vector<unsigned int> visibilityStamp;
+
+	/**
+	 * Count of the pixels begun with @c beginPixelVisibility .
+	 */
+	unsigned int visibilityPixel;
+
+	/**
+	 * The hit whose shadow rays record or reuse the visibility, or 0.
+	 */
+	const void *visibilityHit;
+
+	/**
+	 * Whether the shadow rays of @c visibilityHit record the visibility
+	 * rather than reuse it.
+	 */
+	bool recordingVisibility;
+
+	/**
+	 * Number of shadow rays not traced since the visibility was known.
+	 */
+	unsigned long visibilityReused;
+
+public:
+
+	/**
+	 * Constructs a context with an empty shadow cache and zeroed counters.
+	 */
+	rendercontext() : shadowCacheTests(0), shadowCacheHits(0),
+			tileLightsKept(0), tileLightsTotal(0), supersampledPixels(0),
+			sampleX(0), sampleY(0), sampleIndex(0), hasPixelSample(false),
+			visibilityPixel(0), visibilityHit(0), recordingVisibility(false),
+			visibilityReused(0) { }
+
+	/**
+	 * Says which sample of which pixel is being shaded, so that the random
+	 * numbers shading draws are that sample's. Renders set it before every
+	 * sample they shade.
+	 *
+	 * @param x Column of the pixel.
+	 * @param y Row of the pixel.
+	 * @param k Index of the sample within the pixel.
+	 */
+	void setPixelSample(int x, int y, unsigned int k) {
+		sampleX = x;
+		sampleY = y;
+		sampleIndex = k;
+		hasPixelSample = true;
+	}
+
+	/**
+	 * Forgets the sample being shaded, so shading draws numbers of the hit
+	 * points as for a context-free @c scene::traceRay .
+	 */
+	void clearPixelSample() {
+		hasPixelSample = false;
+	}
+
+	/**
+	 * Gets the sample being shaded.
+	 *
+	 * @param[out] x Receives the column of the pixel.
+	 * @param[out] y Receives the row of the pixel.
+	 * @param[out] k Receives the index of the sample within the pixel.
+	 *
+	 * @return @c false if no sample is set, in which case nothing is
+	 *   received.
+	 */
+	bool getPixelSample(int &x, int &y, unsigned int &k) const {
+		if (!hasPixelSample)
+			return false;
+		x = sampleX;
+		y = sampleY;
+		k = sampleIndex;
+		return true;
+	}
+
+	/**
+	 * Starts a pixel whose samples share what their shadow rays find, with
+	 * nothing known yet about any light.
+	 */
+	void beginPixelVisibility() {
+		visibilityPixel++;
+		if (visibilityPixel == 0) {
+			// The stamps wrapped around; none of them may match.
+			visibilityStamp.assign(visibilityStamp.size(), 0);
+			visibilityPixel = 1;
+		}
+	}
+
+	/**
+	 * Says which hit of the current pixel is being shaded: the shadow rays
+	 * of that hit, and not those of the reflections it leads to, either
+	 * record what they find or skip the lights where it's known.
+	 *
+	 * @param hit The hit, or 0 to neither record nor reuse.
+	 * @param record Whether to record rather than reuse.
+	 */
+	void setVisibilityHit(const void *hit, bool record) {
+		visibilityHit = hit;
+		recordingVisibility = record;
+	}
+
+	/**
+	 * Gets what the recorded shadow rays of the current pixel found
+	 * towards a light, for a hit whose shadow rays reuse it.
+	 *
+	 * @param hit The hit being shaded.
+	 * @param slot Index of the light.
+	 *
+	 * @return 1 if they were all blocked, 0 if all were clear, or -1 if
+	 *   they disagree, there were none, or the hit doesn't reuse them.
+	 */
+	int getVisibility(const void *hit, int slot) const {
+		assert(slot >= 0);
+		if (hit != visibilityHit || recordingVisibility ||
+				slot >= (int) visibility.size() ||
+				visibilityStamp[slot] != visibilityPixel)
+			return -1;
+		return visibility[slot];
+	}
+
+	/**
+	 * Records what a shadow ray of a hit found towards a light, if the hit
+	 * records them.
+	 *
+	 * @param hit The hit being shaded.
+	 * @param slot Index of the light.
+	 * @param blocked Whether the ray was blocked.
+	 */
+	void recordVisibility(const void *hit, int slot, bool blocked) {
+		assert(slot >= 0);
+		if (hit != visibilityHit || !recordingVisibility)
+			return;
+		if (slot >= (int) visibility.size()) {
+			visibility.resize(slot + 1, -1);
+			visibilityStamp.resize(slot + 1, 0);
+		}
+		if (visibilityStamp[slot] != visibilityPixel) {
+			visibilityStamp[slot] = visibilityPixel;
+			visibility[slot] = blocked ? 1 : 0;
+		}
+		else if (visibility[slot] != (blocked ? 1 : 0)) {
+			visibility[slot] = -1;
+		}
+	}
+
+	/**
+	 * Counts a shadow ray not traced since its light's visibility was
+	 * known.
+	 */
+	void countVisibilityReused() {
+		visibilityReused++;
+	}
+
+	/**
+	 * Gets the number of shadow rays not traced since their light's
+	 * visibility was known.
+	 *
+	 * @return Ray count.
+	 */
+	unsigned long getVisibilityReused() const {
+		return visibilityReused;
+	}
+
+	/**
+	 * Gets the shape that blocked the last shadow ray towards the given
+	 * light.
+	 *
+	 * @param slot Index of the light.
+	 *
+	 * @return The shape or 0.
+	 */
+	const shape<vec_T, color_T, time_T, dim> * getLastOccluder(
+			int slot) const {
+		assert(slot >= 0);
+		return slot < (int) lastOccluder.size() ? lastOccluder[slot] : 0;
+	}
+
+	/**
+	 * Remembers the shape that blocked a shadow ray towards the given light.
+	 *
+	 * @param slot Index of the light.
+	 * @param s The shape, or 0 if nothing blocked the ray.
+	 */
+	void setLastOccluder(int slot,
+			const shape<vec_T, color_T, time_T, dim> *s) {
+		assert(slot >= 0);
+		if (slot >= (int) lastOccluder.size())
+			lastOccluder.resize(slot + 1, 0);
+		lastOccluder[slot] = s;
+	}
+
+	/**
+	 * Gets the scratch list of lights that may light the current shading
+	 * point, reused so that shading doesn't allocate.
+	 *
+	 * @return The list.
+	 */
+	std::vector<int>& getCandidateLights() {
+		return candidateLights;
+	}
+
+	/**
+	 * Gets the scratch list of light clusters that may light the current
+	 * shading point.
+	 *
+	 * @return The list.
+	 */
+	std::vector<int>& getCandidateClusters() {
+		return candidateClusters;
+	}
+
+	/**
+	 * Gets the scratch list of light samples that light picking chooses
+	 * from for the current shading point.
+	 *
+	 * @return The list.
+	 */
+	std::vector<lightcandidate<vec_T, color_T, dim> >& getLightCandidates() {
+		return lightCandidates;
+	}
+
+	/**
+	 * Gets the scratch list of lights that may light the current screen tile.
+	 *
+	 * @return The list.
+	 */
+	std::vector<int>& getTileLights() {
+		return tileLights;
+	}
+
+	/**
+	 * Gets the scratch list of shape ids and pixel indices of the current
+	 * screen tile.
+	 *
+	 * @return The list.
+	 */
+	std::vector<std::pair<int, int> >& getTileBatch() {
+		return tileBatch;
+	}
+
+	/**
+	 * Counts the lights kept for one screen tile.
+	 *
+	 * @param kept Number of lights that may light the tile.
+	 * @param total Number of lights in the scene.
+	 */
+	void countTileLights(int kept, int total) {
+		tileLightsKept += kept;
+		tileLightsTotal += total;
+	}
+
+	/**
+	 * Gets the number of lights kept, summed over all screen tiles.
+	 *
+	 * @return Light count.
+	 */
+	unsigned long getTileLightsKept() const {
+		return tileLightsKept;
+	}
+
+	/**
+	 * Gets the number of lights in the scene, summed over all screen tiles.
+	 *
+	 * @return Light count.
+	 */
+	unsigned long getTileLightsTotal() const {
+		return tileLightsTotal;
+	}
+
+	/**
+	 * Counts a pixel that was anti-aliased with more than one sample.
+	 */
+	void countSupersampled() {
+		supersampledPixels++;
+	}
+
+	/**
+	 * Gets the number of pixels anti-aliased with more than one sample.
+	 *
+	 * @return Pixel count.
+	 */
+	unsigned long getSupersampledPixels() const {
+		return supersampledPixels;
+	}
+
+	/**
+	 * Counts a test of a shadow ray against a cached shape.
+	 *
+	 * @param hit Whether the cached shape blocked the ray.
+	 */
+	void countShadowCacheTest(bool hit) {
+		shadowCacheTests++;
+		if (hit)
+			shadowCacheHits++;
+	}
+
+	/**
+	 * Gets the number of shadow rays tested against a cached shape.
+	 *
+	 * @return Test count.
+	 */
+	unsigned long getShadowCacheTests() const {
+		return shadowCacheTests;
+	}
+
+	/**
+	 * Gets the number of shadow rays that a cached shape blocked.
+	 *
+	 * @return Hit count.
+	 */
+	unsigned long getShadowCacheHits() const {
+		return shadowCacheHits;
+	}
+
+	/**
+	 * Adds the counters of another context, e.g. of another thread, to this
+	 * one. The cache contents are left alone.
+	 *
+	 * @param other The other context.
+	 */
+	void mergeStats(const rendercontext<vec_T, color_T, time_T, dim> &other) {
+		shadowCacheTests += other.shadowCacheTests;
+		shadowCacheHits += other.shadowCacheHits;
+		tileLightsKept += other.tileLightsKept;
+		tileLightsTotal += other.tileLightsTotal;
+		supersampledPixels += other.supersampledPixels;
+		visibilityReused += other.visibilityReused;
+	}
+
+	/**
+	 * Prints the counters, one per line.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printStats(std::ostream &os) const {
+		os << "shadow cache: " << shadowCacheHits << " hits / " <<
+				shadowCacheTests << " tests";
+		if (shadowCacheTests > 0)
+			os << " (" << 100.0 * shadowCacheHits / shadowCacheTests << "%)";
+		os << std::endl;
+		os << "tile lights: " << tileLightsKept << " kept / " <<
+				tileLightsTotal;
+		if (tileLightsTotal > 0)
+			os << " (" << 100.0 * tileLightsKept / tileLightsTotal << "%)";
+		os << std::endl;
+		os << "supersampled pixels: " << supersampledPixels << std::endl;
+		if (visibilityReused > 0)
+			os << "pixel visibility: " << visibilityReused <<
+					" shadow rays reused" << std::endl;
+	}
+};
+
+/**
+ * The render contexts of a pool of threads working on one render pass. The
+ * first thread uses the caller's context; the others get fresh ones, whose
+ * counters are added to the caller's by @c mergeStats once the pass is done.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class threadcontexts : private boost::noncopyable {
+private:
+
+	/**
+	 * The contexts of all threads but the first.
+	 */
+	std::vector<rendercontext<vec_T, color_T, time_T, dim> > others;
+
+	/**
+	 * The context of every thread.
+	 */
+	std::vector<rendercontext<vec_T, color_T, time_T, dim> *> ctxs;
+
+public:
+
+	/**
+	 * Makes the contexts.
+	 *
+	 * @param first The caller's context, for the first thread.
+	 * @param n Number of threads, at least 1.
+	 */
+	threadcontexts(rendercontext<vec_T, color_T, time_T, dim> *first, int n) :
+			others(n - 1), ctxs(n) {
+		assert(first != 0 && n > 0);
+		ctxs[0] = first;
+		for (int i = 1; i < n; i++)
+			ctxs[i] = &others[i - 1];
+	}
+
+	/**
+	 * Leaves the caller's context without a pixel sample, whichever its
+	 * thread shaded last.
+	 */
+	~threadcontexts() {
+		ctxs[0]->clearPixelSample();
+	}
+
+	/**
+	 * Gets the contexts, indexed by thread.
+	 *
+	 * @return Array of pointers to the contexts.
+	 */
+	rendercontext<vec_T, color_T, time_T, dim> ** get() {
+		return &ctxs[0];
+	}
+
+	/**
+	 * Adds the counters of the other threads to the first thread's context.
+	 */
+	void mergeStats() {
+		for (size_t i = 0; i < others.size(); i++)
+			ctxs[0]->mergeStats(others[i]);
+	}
+};
+
+typedef rendercontext<double, double, double, 3> rendercontext3d;
+typedef rendercontext<double, double, float, 3> rendercontext3ddf;
+typedef rendercontext<float, float, float, 3> rendercontext3f;
+
+#endif // RENDERCONTEXT_HH
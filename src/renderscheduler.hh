@@ -0,0 +1,456 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "scene.hh"
+#include "camera.hh"
+#include "rendercontext.hh"
+#include "rgbcolor.hh"
+#include "boost/bind.hpp"
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include "boost/noncopyable.hpp"
+#include "boost/thread.hpp"
+#include <cassert>
+#include <map>
+#include <vector>
+
+#ifndef RENDERSCHEDULER_HH
+#define RENDERSCHEDULER_HH
+
+/**
+ * One pool of threads that renders the images of several scenes at once,
+ * e.g. for a daemon rendering the scenes of several customers. Every
+ * render is split into tiles of @c RENDER_TILE_SIZE pixels, and a thread
+ * that's free takes the next tile of the job of the highest priority, and
+ * of those, of the one due soonest; jobs of the same priority and deadline
+ * take turns a tile at a time, so none of them waits for the others to
+ * finish. A job that comes in with a higher priority thus takes over the
+ * threads as soon as they finish the tiles they're on, without the others
+ * starting over, and there are never more renders under way than threads.
+ * Each image comes out exactly as @c scene::renderImage renders it with
+ * the job's samples per pixel.
+ *
+ * Scenes and cameras are only read, so one scene can be in several jobs at
+ * once, but they must outlive their jobs and not change while they run.
+ * Every job has a render context per thread, since contexts remember
+ * shapes of the scene they were used with.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+class renderscheduler : private boost::noncopyable {
+public:
+
+	/**
+	 * The scenes it renders.
+	 */
+	typedef scene<vec_T, color_T, time_T, 3> scene_t;
+
+	/**
+	 * The cameras of the scenes.
+	 */
+	typedef camera<vec_T, time_T, 3> camera_t;
+
+	/**
+	 * The render contexts of the threads.
+	 */
+	typedef rendercontext<vec_T, color_T, time_T, 3> context_t;
+
+	/**
+	 * What a job asks for besides its scene and image.
+	 */
+	struct settings {
+		/** Jobs of higher priorities go first. */
+		int priority;
+		/** Of jobs of the same priority, the one due soonest goes first,
+		 * and those with no deadline, @c not_a_date_time , go last. */
+		boost::posix_time::ptime deadline;
+		/** Samples per pixel along each axis, or 0 for those of
+		 * @c scene::setPixelSamples . */
+		int samples;
+		/** If not null, receives the counters of the render once it's
+		 * done. */
+		context_t *ctx;
+		/** If not null, receives the seconds each tile took once the job
+		 * is done. */
+		std::vector<double> *tileSeconds;
+
+		settings() : priority(0), samples(0), ctx(0), tileSeconds(0) { }
+	};
+
+private:
+
+	/**
+	 * A render and how far along it is.
+	 */
+	struct job {
+		/** The scene. */
+		const scene_t *sc;
+		/** The camera. */
+		const camera_t *cam;
+		/** Width of the image in pixels. */
+		int width;
+		/** Height of the image in pixels. */
+		int height;
+		/** What it asks for. */
+		settings asked;
+		/** The image, row by row. */
+		std::vector<rgbcolor<color_T> > *image;
+		/** The render context of each thread, then one that gathers the
+		 * counters of the tiles of @c runTile . */
+		std::vector<context_t> ctxs;
+		/** Number of tiles of the image. */
+		int tileCount;
+		/** Next tile to hand out. */
+		int nextTile;
+		/** Tiles rendered so far. */
+		int tilesDone;
+		/** When a tile of it was last handed out, for taking turns. */
+		unsigned long long lastTurn;
+	};
+
+	/**
+	 * The jobs that aren't waited for yet, by number.
+	 */
+	std::map<int, job> jobs;
+
+	/**
+	 * Guards everything but the threads.
+	 */
+	boost::mutex lock;
+
+	/**
+	 * Signaled when a job comes in or the scheduler stops.
+	 */
+	boost::condition_variable workReady;
+
+	/**
+	 * Signaled when a job is done.
+	 */
+	boost::condition_variable jobDone;
+
+	/**
+	 * Number the next job gets.
+	 */
+	int nextJob;
+
+	/**
+	 * Tiles handed out so far, which orders the turns.
+	 */
+	unsigned long long turns;
+
+	/**
+	 * Whether the threads should stop.
+	 */
+	bool stopping;
+
+	/**
+	 * Whether @c close was called.
+	 */
+	bool closed;
+
+	/**
+	 * Number of threads of the pool.
+	 */
+	int threadCount;
+
+	/**
+	 * The threads.
+	 */
+	boost::thread_group threads;
+
+	/**
+	 * Tells whether a tile of one job goes before one of another: the one
+	 * of the higher priority does, then the one due sooner, then the one
+	 * whose turn was longer ago.
+	 */
+	static bool goesFirst(const job &a, const job &b) {
+		if (a.asked.priority != b.asked.priority)
+			return a.asked.priority > b.asked.priority;
+		bool aDue = !a.asked.deadline.is_not_a_date_time();
+		bool bDue = !b.asked.deadline.is_not_a_date_time();
+		if (aDue != bDue)
+			return aDue;
+		if (aDue && a.asked.deadline != b.asked.deadline)
+			return a.asked.deadline < b.asked.deadline;
+		return a.lastTurn < b.lastTurn;
+	}
+
+	/**
+	 * Picks the job the next tile comes from: of those with tiles left, the
+	 * one that goes first by @c goesFirst . The lock must be held.
+	 *
+	 * @param[out] id Receives the number of the job.
+	 *
+	 * @return The job, or 0 if no job has tiles left.
+	 */
+	job* pickJob(int &id) {
+		job *best = 0;
+		typename std::map<int, job>::iterator it;
+		for (it = jobs.begin(); it != jobs.end(); ++it) {
+			job &j = it->second;
+			if (j.nextTile >= j.tileCount)
+				continue;
+			if (best == 0 || goesFirst(j, *best)) {
+				best = &j;
+				id = it->first;
+			}
+		}
+		return best;
+	}
+
+	/**
+	 * Renders a tile of a job and counts it done. The lock must be held,
+	 * and is let go while the tile renders.
+	 *
+	 * @param guard The held lock.
+	 * @param j The job.
+	 * @param slot Index of the thread of the pool, or -1 for a caller of
+	 *   @c runTile , which renders with a context of its own.
+	 */
+	void renderTile(boost::unique_lock<boost::mutex> &guard, job &j,
+			int slot) {
+		int tile = j.nextTile++;
+		j.lastTurn = turns++;
+		context_t local;
+		context_t *ctx = slot >= 0 ? &j.ctxs[slot] : &local;
+		guard.unlock();
+		boost::posix_time::ptime start =
+				boost::posix_time::microsec_clock::universal_time();
+		j.sc->renderTile(*j.cam, j.width, j.height, tile, *j.image, ctx,
+				RENDER_TILE_SIZE, j.asked.samples);
+		boost::posix_time::time_duration took =
+				boost::posix_time::microsec_clock::universal_time() - start;
+		guard.lock();
+		if (slot < 0)
+			j.ctxs[threadCount].mergeStats(local);
+		if (j.asked.tileSeconds != 0)
+			j.asked.tileSeconds->push_back(took.total_microseconds() * 1e-6);
+		if (++j.tilesDone == j.tileCount) {
+			if (j.asked.ctx != 0)
+				for (size_t i = 0; i < j.ctxs.size(); i++)
+					j.asked.ctx->mergeStats(j.ctxs[i]);
+			jobDone.notify_all();
+		}
+	}
+
+	/**
+	 * Body of the threads of the pool.
+	 *
+	 * @param slot Index of the thread.
+	 */
+	void work(int slot) {
+		boost::unique_lock<boost::mutex> guard(lock);
+		while (true) {
+			int id;
+			job *j = pickJob(id);
+			if (j != 0) {
+				renderTile(guard, *j, slot);
+				continue;
+			}
+			if (stopping)
+				return;
+			workReady.wait(guard);
+		}
+	}
+
+	/**
+	 * Finds a job that isn't waited for yet.
+	 */
+	job& getJob(int id) {
+		typename std::map<int, job>::iterator it = jobs.find(id);
+		assert(it != jobs.end());
+		return it->second;
+	}
+
+public:
+
+	/**
+	 * Starts the threads.
+	 *
+	 * @param numThreads Number of threads of the pool. With 0, tiles are
+	 *   only rendered by callers of @c runTile .
+	 */
+	explicit renderscheduler(int numThreads) : nextJob(0), turns(0),
+			stopping(false), closed(false), threadCount(numThreads) {
+		assert(numThreads >= 0);
+		for (int i = 0; i < numThreads; i++)
+			threads.create_thread(boost::bind(&renderscheduler::work, this,
+					i));
+	}
+
+	/**
+	 * Lets the threads finish the jobs there are and stops them.
+	 */
+	~renderscheduler() {
+		{
+			boost::lock_guard<boost::mutex> guard(lock);
+			stopping = true;
+		}
+		workReady.notify_all();
+		threads.join_all();
+	}
+
+	/**
+	 * Adds a render.
+	 *
+	 * @param sc The scene, which is finalized.
+	 * @param cam The camera in the scene.
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param[out] image Receives the color of every pixel, row by row; it's
+	 *   sized here and must not be touched until the job is done.
+	 * @param priority Jobs of higher priorities go first.
+	 * @param ctx If not null, receives the counters of the render once
+	 *   it's done.
+	 *
+	 * @return The number of the job, for @c wait .
+	 */
+	int submit(const scene_t &sc, const camera_t &cam, int width, int height,
+			std::vector<rgbcolor<color_T> > &image, int priority = 0,
+			context_t *ctx = 0) {
+		settings asked;
+		asked.priority = priority;
+		asked.ctx = ctx;
+		return submit(sc, cam, width, height, image, asked);
+	}
+
+	/**
+	 * Adds a render with a deadline, samples per pixel of its own or the
+	 * times of its tiles.
+	 *
+	 * @param sc The scene, which is finalized.
+	 * @param cam The camera in the scene.
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param[out] image Receives the color of every pixel, row by row; it's
+	 *   sized here and must not be touched until the job is done.
+	 * @param asked What the job asks for; what its pointers point to must
+	 *   not be touched until the job is done either.
+	 *
+	 * @return The number of the job, for @c wait .
+	 */
+	int submit(const scene_t &sc, const camera_t &cam, int width, int height,
+			std::vector<rgbcolor<color_T> > &image, const settings &asked) {
+		assert(width > 0 && height > 1 && asked.samples >= 0);
+		const int T = RENDER_TILE_SIZE;
+		image.assign((size_t) width * height, rgbcolor<color_T>());
+		int id;
+		{
+			boost::lock_guard<boost::mutex> guard(lock);
+			assert(!closed);
+			id = nextJob++;
+			job &j = jobs[id];
+			j.sc = &sc;
+			j.cam = &cam;
+			j.width = width;
+			j.height = height;
+			j.asked = asked;
+			j.image = &image;
+			j.ctxs.resize(threadCount + 1);
+			j.tileCount = ((width + T - 1) / T) * ((height + T - 1) / T);
+			j.nextTile = 0;
+			j.tilesDone = 0;
+			j.lastTurn = 0;
+		}
+		workReady.notify_all();
+		return id;
+	}
+
+	/**
+	 * Renders the next tile on the calling thread, as a thread of the pool
+	 * would, e.g. to lend the pool a thread that would otherwise wait.
+	 *
+	 * @return The number of the job the tile was of, or -1 if no job has
+	 *         tiles left.
+	 */
+	int runTile() {
+		boost::unique_lock<boost::mutex> guard(lock);
+		int id;
+		job *j = pickJob(id);
+		if (j == 0)
+			return -1;
+		renderTile(guard, *j, -1);
+		return id;
+	}
+
+	/**
+	 * Checks if a job is done.
+	 *
+	 * @param id The number of the job, which isn't waited for yet.
+	 *
+	 * @return @c true once every tile of its image is rendered.
+	 */
+	bool isDone(int id) {
+		boost::lock_guard<boost::mutex> guard(lock);
+		job &j = getJob(id);
+		return j.tilesDone == j.tileCount;
+	}
+
+	/**
+	 * Waits for a job to be done and forgets it.
+	 *
+	 * @param id The number of the job, which isn't waited for yet.
+	 */
+	void wait(int id) {
+		boost::unique_lock<boost::mutex> guard(lock);
+		job &j = getJob(id);
+		while (j.tilesDone < j.tileCount)
+			jobDone.wait(guard);
+		jobs.erase(id);
+	}
+
+	/**
+	 * Waits for any job to be done and forgets it, e.g. for a thread that
+	 * hands out images as they're done while others submit. Jobs waited
+	 * for this way mustn't be waited for with @c wait as well.
+	 *
+	 * @return The number of the job, or -1 once @c close was called and
+	 *         every job is waited for.
+	 */
+	int waitAny() {
+		boost::unique_lock<boost::mutex> guard(lock);
+		while (true) {
+			typename std::map<int, job>::iterator it;
+			for (it = jobs.begin(); it != jobs.end(); ++it) {
+				if (it->second.tilesDone == it->second.tileCount) {
+					int id = it->first;
+					jobs.erase(it);
+					return id;
+				}
+			}
+			if (closed && jobs.empty())
+				return -1;
+			jobDone.wait(guard);
+		}
+	}
+
+	/**
+	 * Says no more jobs will be submitted, so @c waitAny returns -1 once
+	 * the ones there are are done.
+	 */
+	void close() {
+		{
+			boost::lock_guard<boost::mutex> guard(lock);
+			closed = true;
+		}
+		jobDone.notify_all();
+	}
+
+	/**
+	 * Getter for the number of threads.
+	 *
+	 * @return Number of threads of the pool.
+	 */
+	int getThreadCount() const {
+		return threadCount;
+	}
+};
+
+typedef renderscheduler<double, double, double> renderscheduler3d;
+typedef renderscheduler<float, float, float> renderscheduler3f;
+
+#endif // RENDERSCHEDULER_HH
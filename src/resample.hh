@@ -0,0 +1,262 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "rgbcolor.hh"
+#include "parallel.hh"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#ifndef RESAMPLE_HH
+#define RESAMPLE_HH
+
+/**
+ * The filters a @c resampler weighs the pixels of an image with.
+ */
+enum resampleFilter {
+	/**
+	 * Averages the pixels each new one covers, weighing those it covers
+	 * only in part by how much; halving the size averages 2 by 2 blocks.
+	 */
+	RESAMPLE_BOX,
+	/**
+	 * The Lanczos filter of three lobes stretched over the pixels each new
+	 * one covers, which is sharper than the box but may ring at edges.
+	 */
+	RESAMPLE_LANCZOS
+};
+
+/**
+ * The weights of the pixels of a row or column of an image that make up
+ * each pixel of the row or column it's resampled to.
+ *
+ * @tparam color_T The type of the weights.
+ */
+template<typename color_T>
+struct resampleTaps {
+	/** Index in @c pixel and @c weight of the first tap of each pixel. */
+	std::vector<int> first;
+	/** The pixel of the old row or column of each tap. */
+	std::vector<int> pixel;
+	/** The weight of each tap; those of a pixel add up to 1. */
+	std::vector<color_T> weight;
+
+	/**
+	 * Gets the taps that resample a row or column.
+	 *
+	 * @param from Number of pixels before.
+	 * @param to Number of pixels after.
+	 * @param filter The filter.
+	 */
+	void compute(int from, int to, resampleFilter filter) {
+		assert(from > 0 && to > 0);
+		first.assign(1, 0);
+		pixel.clear();
+		weight.clear();
+		double scale = (double) from / to;
+		for (int i = 0; i < to; i++) {
+			size_t begin = pixel.size();
+			if (filter == RESAMPLE_BOX)
+				boxTaps(from, i * scale, (i + 1) * scale);
+			else
+				lanczosTaps(from, (i + 0.5) * scale, std::max(scale, 1.0));
+			double sum = 0;
+			for (size_t t = begin; t < pixel.size(); t++)
+				sum += weight[t];
+			for (size_t t = begin; t < pixel.size(); t++)
+				weight[t] = (color_T) (weight[t] / sum);
+			first.push_back((int) pixel.size());
+		}
+	}
+
+private:
+
+	/*
+	 * Weighs the pixels of [lo, hi) by how much of each it covers.
+	 */
+	void boxTaps(int from, double lo, double hi) {
+		int p0 = std::min((int) lo, from - 1);
+		int p1 = std::max(p0 + 1, std::min((int) std::ceil(hi), from));
+		for (int p = p0; p < p1; p++) {
+			double w = std::min(hi, p + 1.0) - std::max(lo, (double) p);
+			pixel.push_back(p);
+			weight.push_back((color_T) (w > 0 ? w : 1));
+		}
+	}
+
+	/*
+	 * Weighs the pixels around a center by the Lanczos filter of three
+	 * lobes stretched by the given width, folding those past the edges
+	 * onto the pixels at the edges.
+	 */
+	void lanczosTaps(int from, double center, double width) {
+		int p0 = (int) std::floor(center - 3 * width);
+		int p1 = (int) std::ceil(center + 3 * width);
+		for (int p = p0; p <= p1; p++) {
+			double x = (p + 0.5 - center) / width;
+			if (std::abs(x) >= 3)
+				continue;
+			double w = 1;
+			if (x != 0) {
+				double px = M_PI * x;
+				w = 3 * std::sin(px) * std::sin(px / 3) / (px * px);
+			}
+			pixel.push_back(std::min(std::max(p, 0), from - 1));
+			weight.push_back((color_T) w);
+		}
+	}
+};
+
+/**
+ * Resamples the rows of an image to a new width for @c resampler .
+ */
+template<typename color_T>
+struct resampleRowFilter {
+	/** The image. */
+	const std::vector<rgbcolor<color_T> > *in;
+	/** Its width in pixels. */
+	int inWidth;
+	/** The taps of a row. */
+	const resampleTaps<color_T> *taps;
+	/** Receives the rows at the new width. */
+	std::vector<rgbcolor<color_T> > *out;
+
+	void operator()(int lo, int hi) const {
+		int outWidth = (int) taps->first.size() - 1;
+		for (int y = lo; y < hi; y++) {
+			const rgbcolor<color_T> *row = &(*in)[(size_t) y * inWidth];
+			for (int x = 0; x < outWidth; x++) {
+				color_T r = 0, g = 0, b = 0;
+				for (int t = taps->first[x]; t < taps->first[x + 1]; t++) {
+					const rgbcolor<color_T> &c = row[taps->pixel[t]];
+					color_T w = taps->weight[t];
+					r += w * c.getR();
+					g += w * c.getG();
+					b += w * c.getB();
+				}
+				(*out)[(size_t) y * outWidth + x] =
+						rgbcolor<color_T>::unchecked(r, g, b);
+			}
+		}
+	}
+};
+
+/**
+ * Resamples the columns of an image to a new height for @c resampler ,
+ * one row of the result at a time. Negative channels, which the lobes of
+ * the Lanczos filter leave next to bright edges, are clamped to 0.
+ */
+template<typename color_T>
+struct resampleColumnFilter {
+	/** The image. */
+	const std::vector<rgbcolor<color_T> > *in;
+	/** Its width in pixels, which doesn't change. */
+	int width;
+	/** The taps of a column. */
+	const resampleTaps<color_T> *taps;
+	/** Receives the image at the new height. */
+	std::vector<rgbcolor<color_T> > *out;
+
+	void operator()(int lo, int hi) const {
+		for (int y = lo; y < hi; y++) {
+			for (int x = 0; x < width; x++) {
+				color_T r = 0, g = 0, b = 0;
+				for (int t = taps->first[y]; t < taps->first[y + 1]; t++) {
+					const rgbcolor<color_T> &c =
+							(*in)[(size_t) taps->pixel[t] * width + x];
+					color_T w = taps->weight[t];
+					r += w * c.getR();
+					g += w * c.getG();
+					b += w * c.getB();
+				}
+				(*out)[(size_t) y * width + x] =
+						rgbcolor<color_T>::unchecked(std::max(r, (color_T) 0),
+						std::max(g, (color_T) 0), std::max(b, (color_T) 0));
+			}
+		}
+	}
+};
+
+/**
+ * Scales images to other sizes, as for thumbnails or the levels of a mip
+ * map made from a render. The rows are resampled first and then the
+ * columns, each with the weights of the filter worked out once for the
+ * whole row or column.
+ *
+ * @tparam color_T The type of the @c rgbcolor.
+ */
+template<typename color_T>
+class resampler {
+private:
+
+	/**
+	 * The filter.
+	 */
+	resampleFilter filter;
+
+public:
+
+	/**
+	 * Constructs a resampler.
+	 *
+	 * @param filter The filter to weigh pixels with.
+	 */
+	explicit resampler(resampleFilter filter = RESAMPLE_BOX) :
+			filter(filter) {
+	}
+
+	/**
+	 * Getter for the filter.
+	 *
+	 * @return The filter.
+	 */
+	resampleFilter getFilter() const {
+		return filter;
+	}
+
+	/**
+	 * Resamples an image.
+	 *
+	 * @param in The image, row by row.
+	 * @param width Its width in pixels.
+	 * @param height Its height in pixels.
+	 * @param[out] out Receives the image at the new size, row by row.
+	 * @param outWidth The new width in pixels.
+	 * @param outHeight The new height in pixels.
+	 * @param numThreads Number of threads to resample on.
+	 */
+	void resample(const std::vector<rgbcolor<color_T> > &in, int width,
+			int height, std::vector<rgbcolor<color_T> > &out, int outWidth,
+			int outHeight, int numThreads = 1) const {
+		assert(in.size() == (size_t) width * height);
+		assert(outWidth > 0 && outHeight > 0);
+		numThreads = std::max(1, numThreads);
+		resampleTaps<color_T> rowTaps, columnTaps;
+		rowTaps.compute(width, outWidth, filter);
+		columnTaps.compute(height, outHeight, filter);
+
+		std::vector<rgbcolor<color_T> > rows((size_t) outWidth * height);
+		resampleRowFilter<color_T> rowFilter;
+		rowFilter.in = &in;
+		rowFilter.inWidth = width;
+		rowFilter.taps = &rowTaps;
+		rowFilter.out = &rows;
+		parallelFor(0, height, numThreads, rowFilter);
+
+		out.resize((size_t) outWidth * outHeight);
+		resampleColumnFilter<color_T> columnFilter;
+		columnFilter.in = &rows;
+		columnFilter.width = outWidth;
+		columnFilter.taps = &columnTaps;
+		columnFilter.out = &out;
+		parallelFor(0, outHeight, numThreads, columnFilter);
+	}
+};
+
+typedef resampler<double> resamplerd;
+typedef resampler<float> resamplerf;
+
+#endif // RESAMPLE_HH
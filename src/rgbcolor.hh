@@ -5,6 +5,12 @@
 
 #include <cassert>
 #include <iostream>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
 
 #ifndef RGBCOLOR_HH
 #define RGBCOLOR_HH
@@ -59,6 +65,27 @@ public:
 		this->b = b;
 	}
 
+	/**
+	 * Makes a color from any component values, with none of the checks of
+	 * the constructor and the setters. This is for colors worked out while
+	 * rendering, such as sums of lights, which may well be above 1, and for
+	 * values that were checked where they were read, so intermediate
+	 * results cost the same with and without @c NDEBUG .
+	 *
+	 * @param r Red value.
+	 * @param g Green value.
+	 * @param b Blue value.
+	 *
+	 * @return The color.
+	 */
+	static rgbcolor unchecked(T r, T g, T b) {
+		rgbcolor c;
+		c.r = r;
+		c.g = g;
+		c.b = b;
+		return c;
+	}
+
 	/**
 	 * Gets blue component.
 	 *
@@ -321,14 +348,16 @@ std::ostream & operator<<(std::ostream &os, const rgbcolor<T> &color) {
 /**
  * Makes the input operator compatible with input formatted like
  * (r, g, b), where r, g, and b are colors and where
- * whitespace doesn't matter.
+ * whitespace doesn't matter. This is where colors are checked: a component
+ * outside of [0, 1] is a format error, in release builds too.
  *
  * @param is The input stream from which to read.
  * @param col The rgbcolor into which we'll read.
  *
  * @return The same input stream for operator chaining.
  *
- * @throw ios_base::failure If input doesn't conform to (r, g, b) format.
+ * @throw ios_base::failure If input doesn't conform to (r, g, b) format or
+ *   a component is outside of [0, 1].
  */
 template<typename T>
 std::istream & operator>>(std::istream& is, rgbcolor<T> &col) {
@@ -345,27 +374,18 @@ std::istream & operator>>(std::istream& is, rgbcolor<T> &col) {
 	is >> c;
 	if (c == '(') { // If it's the start of a color, then...
 
-		// Set red component.
-		T tmpcol;
-		is >> tmpcol >> c;
-		if (c != ',') { // If wasn't a comma after color, bad format.
-			is.clear(std::ios_base::failbit);
-		}
-		col.setR(tmpcol);
-
-		// Set green component.
-		is >> tmpcol >> c;
-		if (c != ',') { // If wasn't a comma after color, bad format.
-			is.clear(std::ios_base::failbit);
-		}
-		col.setG(tmpcol);
-
-		// Set red component.
-		is >> tmpcol >> c;
-		if (c != ')') { // If wasn't a comma after color, bad format.
-			is.clear(std::ios_base::failbit);
+		// Read the components, each followed by a comma or the ).
+		T rgb[3];
+		for (int i = 0; i < 3; i++) {
+			is >> rgb[i] >> c;
+			if (c != (i < 2 ? ',' : ')')) { // If not, bad format.
+				is.clear(std::ios_base::failbit);
+			}
+			if (!(rgb[i] >= 0 && rgb[i] <= 1)) { // Out of range.
+				is.clear(std::ios_base::failbit);
+			}
 		}
-		col.setB(tmpcol);
+		col = rgbcolor<T>::unchecked(rgb[0], rgb[1], rgb[2]);
 	}
 	else { // If first char wasn't (, put it back into the stream and return.
 		is.putback(c);
@@ -375,6 +395,197 @@ std::istream & operator>>(std::istream& is, rgbcolor<T> &col) {
 	return is;
 }
 
+/**
+ * A color being summed while shading, such as the light reaching a hit,
+ * which @c get turns back into an @c rgbcolor once it's done. This is the
+ * generic version, which works one component at a time; the ones for
+ * floats and doubles below hold the color in 4 lanes of SSE or AVX
+ * registers, with a padding lane that holds nothing meaningful. All of them
+ * do the same operations in the same order as the operators of
+ * @c rgbcolor , so sums come out bit for bit the same.
+ *
+ * @tparam T The type of the components.
+ */
+template<typename T>
+class rgbsum {
+private:
+	/** The components. */
+	T c[3];
+
+public:
+
+	/**
+	 * Makes a sum of nothing, which is black.
+	 */
+	rgbsum() {
+		c[0] = c[1] = c[2] = 0;
+	}
+
+	/**
+	 * Adds a color, like @c rgbcolor::operator+= .
+	 *
+	 * @param a The color.
+	 */
+	void add(const rgbcolor<T> &a) {
+		c[0] += a.getR();
+		c[1] += a.getG();
+		c[2] += a.getB();
+	}
+
+	/**
+	 * Adds the product of two colors and a scalar, like @c += @c a @c * @c b
+	 * @c * @c s on colors, e.g. a light shining on a surface.
+	 *
+	 * @param a The first color.
+	 * @param b The second color.
+	 * @param s The scalar.
+	 */
+	void addProduct(const rgbcolor<T> &a, const rgbcolor<T> &b, T s) {
+		c[0] += a.getR() * b.getR() * s;
+		c[1] += a.getG() * b.getG() * s;
+		c[2] += a.getB() * b.getB() * s;
+	}
+
+	/**
+	 * Adds another sum times a scalar, like @c += @c a @c * @c s on colors.
+	 *
+	 * @param a The other sum.
+	 * @param s The scalar.
+	 */
+	void addScaled(const rgbsum &a, T s) {
+		for (int i = 0; i < 3; i++)
+			c[i] += a.c[i] * s;
+	}
+
+	/**
+	 * Gets the sum.
+	 *
+	 * @return The color, which may have components above 1.
+	 */
+	rgbcolor<T> get() const {
+		return rgbcolor<T>::unchecked(c[0], c[1], c[2]);
+	}
+};
+
+#ifdef __SSE2__
+
+/**
+ * @c rgbsum for floats, in one SSE register.
+ */
+template<>
+class rgbsum<float> {
+private:
+	/** The components and the padding lane. */
+	__m128 v;
+
+	/** Loads a color into the lanes. */
+	static __m128 load(const rgbcolor<float> &a) {
+		return _mm_setr_ps(a.getR(), a.getG(), a.getB(), 0);
+	}
+
+public:
+	rgbsum() : v(_mm_setzero_ps()) { }
+
+	void add(const rgbcolor<float> &a) {
+		v = _mm_add_ps(v, load(a));
+	}
+
+	void addProduct(const rgbcolor<float> &a, const rgbcolor<float> &b,
+			float s) {
+		v = _mm_add_ps(v, _mm_mul_ps(_mm_mul_ps(load(a), load(b)),
+				_mm_set1_ps(s)));
+	}
+
+	void addScaled(const rgbsum &a, float s) {
+		v = _mm_add_ps(v, _mm_mul_ps(a.v, _mm_set1_ps(s)));
+	}
+
+	rgbcolor<float> get() const {
+		alignas(16) float c[4];
+		_mm_store_ps(c, v);
+		return rgbcolor<float>::unchecked(c[0], c[1], c[2]);
+	}
+};
+
+/**
+ * @c rgbsum for doubles, in one AVX register or two SSE2 ones.
+ */
+template<>
+class rgbsum<double> {
+private:
+#ifdef __AVX__
+	/** The components and the padding lane. */
+	__m256d v;
+
+	/** Loads a color into the lanes. */
+	static __m256d load(const rgbcolor<double> &a) {
+		return _mm256_setr_pd(a.getR(), a.getG(), a.getB(), 0);
+	}
+
+public:
+	rgbsum() : v(_mm256_setzero_pd()) { }
+
+	void add(const rgbcolor<double> &a) {
+		v = _mm256_add_pd(v, load(a));
+	}
+
+	void addProduct(const rgbcolor<double> &a, const rgbcolor<double> &b,
+			double s) {
+		v = _mm256_add_pd(v, _mm256_mul_pd(_mm256_mul_pd(load(a), load(b)),
+				_mm256_set1_pd(s)));
+	}
+
+	void addScaled(const rgbsum &a, double s) {
+		v = _mm256_add_pd(v, _mm256_mul_pd(a.v, _mm256_set1_pd(s)));
+	}
+
+	rgbcolor<double> get() const {
+		alignas(32) double c[4];
+		_mm256_store_pd(c, v);
+		return rgbcolor<double>::unchecked(c[0], c[1], c[2]);
+	}
+#else
+	/** Red and green. */
+	__m128d rg;
+
+	/** Blue and the padding lane. */
+	__m128d b;
+
+public:
+	rgbsum() : rg(_mm_setzero_pd()), b(_mm_setzero_pd()) { }
+
+	void add(const rgbcolor<double> &a) {
+		rg = _mm_add_pd(rg, _mm_setr_pd(a.getR(), a.getG()));
+		b = _mm_add_pd(b, _mm_set_sd(a.getB()));
+	}
+
+	void addProduct(const rgbcolor<double> &a, const rgbcolor<double> &c,
+			double s) {
+		__m128d vs = _mm_set1_pd(s);
+		rg = _mm_add_pd(rg, _mm_mul_pd(_mm_mul_pd(
+				_mm_setr_pd(a.getR(), a.getG()),
+				_mm_setr_pd(c.getR(), c.getG())), vs));
+		b = _mm_add_pd(b, _mm_mul_pd(_mm_mul_pd(_mm_set_sd(a.getB()),
+				_mm_set_sd(c.getB())), vs));
+	}
+
+	void addScaled(const rgbsum &a, double s) {
+		__m128d vs = _mm_set1_pd(s);
+		rg = _mm_add_pd(rg, _mm_mul_pd(a.rg, vs));
+		b = _mm_add_pd(b, _mm_mul_pd(a.b, vs));
+	}
+
+	rgbcolor<double> get() const {
+		alignas(16) double c[4];
+		_mm_store_pd(c, rg);
+		_mm_store_pd(c + 2, b);
+		return rgbcolor<double>::unchecked(c[0], c[1], c[2]);
+	}
+#endif
+};
+
+#endif // __SSE2__
+
 typedef rgbcolor<float> rgbcolorf;
 typedef rgbcolor<double> rgbcolord;
 
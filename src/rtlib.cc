@@ -0,0 +1,145 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "rtlib.hh"
+#include "scene.hh"
+#include "camera.hh"
+#include "accelfactory.hh"
+#include "framebuffer.hh"
+#include "parallel.hh"
+#include "rendercontext.hh"
+#include "sceneparser.hh"
+#include "scenefile.hh"
+#include "boost/shared_ptr.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+rtsettings::rtsettings() : shadows(false), accel("bvh"),
+		threads(hardwareThreads()), maxReflect(MAX_REFLECT), aaSamples(1),
+		aaThreshold(0.1), pixelSamples(1), exposure(1) { }
+
+/**
+ * The scene of an @c rtrenderer , with the camera it renders and the
+ * buffers its renders reuse.
+ */
+struct rtrendererstate {
+	/** The scene. */
+	scene3d sc;
+	/** The camera in the scene that's rendered. */
+	sp_camerad cam;
+	/** Render context every render traces with. */
+	rendercontext<double, double, double, 3> ctx;
+	/** The colors of the last render, row by row. */
+	std::vector<rgbcolord> image;
+
+	rtrendererstate(bool shadows) : sc(shadows) { }
+};
+
+rtrenderer::rtrenderer(const rtsettings &settings) : settings(settings) { }
+
+rtrenderer::~rtrenderer() { }
+
+bool rtrenderer::load(const char *bytes, size_t size, std::string &error) {
+	state.reset();
+	boost::scoped_ptr<rtrendererstate> s(
+			new rtrendererstate(settings.shadows));
+	scene3d &sc = s->sc;
+	sc.setRenderThreads(settings.threads);
+	sc.setSupersampling(settings.aaSamples, settings.aaThreshold);
+	sc.setPixelSamples(settings.pixelSamples);
+	sc.setReflectionLimits(settings.maxReflect, 0);
+	sc.setAccelerator(makeNamedAccelerator<double, double, double>(
+			settings.accel, BVH_BUILD_SAH, settings.threads));
+	std::vector<scenecamera<double, double> > cameras;
+	if (scenefile::isSceneFile(bytes, size)) {
+		scenefile compiled;
+		std::vector<std::string> paths;
+		if (!compiled.open<double, double, double>(bytes, size, error))
+			return false;
+		compiled.getPaths(paths);
+		if (!addSceneRecords(sc, compiled.getRecords(),
+				compiled.getRecordCount(), paths, s->cam, error, &cameras))
+			return false;
+		bool sameTree = settings.accel == "bvh" &&
+				compiled.getTreeBuilder() == (int) BVH_BUILD_SAH;
+		sc.finalize(sameTree ? compiled.getTree() : 0,
+				sameTree ? compiled.getTreeSize() : 0);
+	}
+	else {
+		scenedescription desc;
+		if (!parseSceneParallel<double, double>(bytes, bytes + size,
+				settings.directory, std::max(1, settings.threads), desc,
+				error) || !addSceneRecords(sc, desc.records.empty() ? 0 :
+				&desc.records[0], desc.records.size(), desc.paths, s->cam,
+				error, &cameras))
+			return false;
+		sc.finalize();
+	}
+	if (!settings.camera.empty()) {
+		s->cam.reset();
+		for (size_t i = 0; i < cameras.size(); i++)
+			if (cameras[i].name == settings.camera)
+				s->cam = cameras[i].cam;
+		if (!s->cam) {
+			error = "the scene description has no camera named \"" +
+					settings.camera + "\".";
+			return false;
+		}
+	}
+	if (!s->cam) {
+		error = "the scene description has no camera.";
+		return false;
+	}
+	state.swap(s);
+	return true;
+}
+
+bool rtrenderer::isLoaded() const {
+	return state.get() != 0;
+}
+
+/**
+ * Checks the arguments of a render and renders the scene of a renderer
+ * into its image.
+ *
+ * @return @c false if there's no scene or the sizes are wrong.
+ */
+static bool renderState(rtrendererstate *state, int width, int height,
+		size_t stride, std::string &error) {
+	if (!state) {
+		error = "no scene is loaded.";
+		return false;
+	}
+	if (width < 1 || height < 2 || stride < 3 * (size_t) width) {
+		error = "the image must be at least 1 by 2 pixels, with rows of at "
+				"least 3 values per pixel.";
+		return false;
+	}
+	state->image.assign((size_t) width * height, rgbcolord());
+	state->sc.renderImage(*state->cam, width, height, state->image,
+			&state->ctx);
+	return true;
+}
+
+bool rtrenderer::render(int width, int height, unsigned char *rgb,
+		size_t stride, std::string &error) {
+	if (!renderState(state.get(), width, height, stride, error))
+		return false;
+	for (int y = 0; y < height; y++)
+		framebuffer<double>::quantize(&state->image[(size_t) y * width],
+				width, rgb + y * stride, settings.exposure);
+	return true;
+}
+
+bool rtrenderer::render(int width, int height, float *rgb, size_t stride,
+		std::string &error) {
+	if (!renderState(state.get(), width, height, stride, error))
+		return false;
+	for (int y = 0; y < height; y++)
+		framebuffer<double>::toPFMRow(&state->image[(size_t) y * width],
+				width, rgb + y * stride);
+	return true;
+}
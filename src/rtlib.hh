@@ -0,0 +1,145 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "boost/scoped_ptr.hpp"
+#include "boost/utility.hpp"
+#include <cstddef>
+#include <string>
+
+#ifndef RTLIB_HH
+#define RTLIB_HH
+
+/**
+ * The settings of an @c rtrenderer , the library counterparts of the
+ * driver's options of the same names. The defaults are the driver's.
+ */
+struct rtsettings {
+	/** Whether shadow rays are traced, like @c -s . */
+	bool shadows;
+	/** The acceleration structure, like @c --accel : bvh, qbvh8, qbvh16,
+	 * grid, lazy, dynamic, motion or none. */
+	std::string accel;
+	/** Number of threads to parse and render with, like @c -j . */
+	int threads;
+	/** Reflections followed per path, like @c --max-reflect . */
+	int maxReflect;
+	/** Anti-aliasing samples per axis and the color difference that calls
+	 * for them, like @c --aa and @c --aa-threshold . */
+	int aaSamples;
+	double aaThreshold;
+	/** Samples per pixel, like @c --samples . */
+	int pixelSamples;
+	/** What colors are multiplied by before they're made 8 bit, like
+	 * @c --exposure . */
+	double exposure;
+	/** The camera to render, like @c --camera ; the last one if empty. */
+	std::string camera;
+	/** The directory mesh files of the scene are relative to. */
+	std::string directory;
+
+	/**
+	 * Sets the defaults.
+	 */
+	rtsettings();
+};
+
+/**
+ * Everything an @c rtrenderer keeps of its scene, which only @c rtlib.cc
+ * knows.
+ */
+struct rtrendererstate;
+
+/**
+ * The raytracer as a library, @c librt , for programs that render in
+ * process: a scene is loaded from bytes in memory and rendered into pixels
+ * of the caller's, with no files, pipes or image formats in between. The
+ * scene is at double precision, and the images are the same ones the
+ * driver makes of it with the same settings.
+ *
+ * A renderer renders one image at a time, on @c rtsettings::threads
+ * threads of its own; separate renderers can be used at once.
+ */
+class rtrenderer : private boost::noncopyable {
+private:
+
+	/**
+	 * The scene and camera, or null before a scene is loaded.
+	 */
+	boost::scoped_ptr<rtrendererstate> state;
+
+	/**
+	 * The settings scenes are loaded and rendered with.
+	 */
+	rtsettings settings;
+
+public:
+
+	/**
+	 * Makes a renderer with no scene.
+	 *
+	 * @param settings What later scenes are loaded and rendered with.
+	 */
+	explicit rtrenderer(const rtsettings &settings = rtsettings());
+
+	~rtrenderer();
+
+	/**
+	 * Loads a scene in place of the one there was, if any. The bytes are a
+	 * scene description, which is parsed and not needed after, or a
+	 * compiled scene, which is used in place as the driver uses a mapped
+	 * one, so it must be aligned to @c SCENE_FILE_ALIGN bytes and stay
+	 * valid as long as the scene.
+	 *
+	 * @param bytes The first byte.
+	 * @param size Number of bytes.
+	 * @param[out] error Receives what's wrong with the scene, if anything.
+	 *
+	 * @return @c false if the scene can't be used, which leaves the
+	 *         renderer with no scene.
+	 */
+	bool load(const char *bytes, size_t size, std::string &error);
+
+	/**
+	 * Checks if a scene is loaded.
+	 *
+	 * @return @c true after a @c load that worked.
+	 */
+	bool isLoaded() const;
+
+	/**
+	 * Renders the scene into 8 bit pixels, red, green and blue, as the
+	 * driver writes them to PPM and PNG files.
+	 *
+	 * @param width The width of the image in pixels, at least 1.
+	 * @param height The height of the image in pixels, at least 2.
+	 * @param[out] rgb Receives the pixels, row by row from the top.
+	 * @param stride Bytes from the start of a row to the next, at least
+	 *   @c 3 * @c width .
+	 * @param[out] error Receives what's wrong, if anything.
+	 *
+	 * @return @c false if no scene is loaded or the sizes are wrong.
+	 */
+	bool render(int width, int height, unsigned char *rgb, size_t stride,
+			std::string &error);
+
+	/**
+	 * Like the 8 bit version, but into floats that keep the unclamped
+	 * colors as the driver writes them to PFM files, without the
+	 * exposure.
+	 *
+	 * @param width The width of the image in pixels, at least 1.
+	 * @param height The height of the image in pixels, at least 2.
+	 * @param[out] rgb Receives the pixels, row by row from the top.
+	 * @param stride Floats from the start of a row to the next, at least
+	 *   @c 3 * @c width .
+	 * @param[out] error Receives what's wrong, if anything.
+	 *
+	 * @return @c false if no scene is loaded or the sizes are wrong.
+	 */
+	bool render(int width, int height, float *rgb, size_t stride,
+			std::string &error);
+};
+
+#endif // RTLIB_HH
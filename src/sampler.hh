@@ -0,0 +1,502 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#ifndef SAMPLER_HH
+#define SAMPLER_HH
+
+/**
+ * Side of the tile of blue noise that @c SAMPLER_BLUE_NOISE shifts the
+ * samples of neighboring pixels by; the tile repeats across the image.
+ */
+#define BLUE_NOISE_SIZE 64
+
+/**
+ * Where the samples of the stochastic parts of a render, like the jittered
+ * samples of a pixel, come from. All are fixed functions of the pixel, the
+ * index of the sample and the dimension, so renders don't depend on the
+ * number of threads or the order tiles are rendered in.
+ */
+enum samplerKind {
+	/**
+	 * Independent numbers of a @c samplerandom : white noise, which
+	 * converges the slowest. Mostly a baseline to compare the others with.
+	 */
+	SAMPLER_RANDOM,
+
+	/**
+	 * A Sobol sequence, Owen scrambled and shuffled by a hash of the pixel
+	 * and the dimension, so the first 2^k samples of any pixel are
+	 * stratified in every way a (0, k, 2)-net is while pixels and
+	 * dimensions are uncorrelated.
+	 */
+	SAMPLER_SOBOL,
+
+	/**
+	 * The same scrambled Sobol sequence for every pixel, shifted per pixel
+	 * by a tile of blue noise, so what error is left is spread out evenly
+	 * over the image as fine grain instead of clumps.
+	 */
+	SAMPLER_BLUE_NOISE
+};
+
+/**
+ * Mixes the bits of a number, for hashes of the pixel, the sample and the
+ * dimension (the lowbias32 finalizer of Chris Wellons).
+ *
+ * @param x The number.
+ *
+ * @return Its hash.
+ */
+inline unsigned int mixSampleBits(unsigned int x) {
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+/**
+ * What a random number of a render is for, so that the numbers drawn at
+ * the same pixel, sample and bounce for different purposes are unrelated.
+ */
+enum randomPurpose {
+	/**
+	 * The two numbers of a dimension of a sample of @c SAMPLER_RANDOM .
+	 */
+	RANDOM_PIXEL_SAMPLE,
+
+	/**
+	 * Whether Russian roulette ends a path at a reflection.
+	 */
+	RANDOM_ROULETTE,
+
+	/**
+	 * Where light picking starts along the lights of a hit.
+	 */
+	RANDOM_LIGHT_PICKS
+};
+
+/**
+ * Turns a 128 bit counter into 128 random bits under a 64 bit key with
+ * the ten rounds of Philox4x32-10 (Salmon et al., "Parallel Random
+ * Numbers: As Easy as 1, 2, 3", 2011). For each key it's a bijection of
+ * the counter, so no two counters give the same bits, and nothing is kept
+ * from one call to the next.
+ *
+ * @param[in,out] ctr The counter, which receives the bits.
+ * @param key0 First half of the key.
+ * @param key1 Second half.
+ */
+inline void philox4x32(unsigned int ctr[4], unsigned int key0,
+		unsigned int key1) {
+	for (int round = 0; round < 10; round++) {
+		unsigned long long p0 = 0xd2511f53ULL * ctr[0];
+		unsigned long long p1 = 0xcd9e8d57ULL * ctr[2];
+		unsigned int c0 = (unsigned int) (p1 >> 32) ^ ctr[1] ^ key0;
+		unsigned int c2 = (unsigned int) (p0 >> 32) ^ ctr[3] ^ key1;
+		ctr[1] = (unsigned int) p1;
+		ctr[3] = (unsigned int) p0;
+		ctr[0] = c0;
+		ctr[2] = c2;
+		key0 += 0x9e3779b9u;
+		key1 += 0xbb67ae85u;
+	}
+}
+
+/**
+ * The random numbers of one sample of a pixel: @c philox4x32 keyed by the
+ * pixel, of a counter made of the index of the sample, the bounce, the
+ * purpose and a seed. They're a fixed function of those alone, so a
+ * render comes out the same on any number of threads and in any order of
+ * its tiles, and threads share no state to draw them.
+ */
+class samplerandom {
+private:
+
+	/**
+	 * The pixel; the row may be -1 for a number that isn't a pixel's.
+	 */
+	int x, y;
+
+	/**
+	 * Index of the sample within the pixel.
+	 */
+	unsigned int sample;
+
+	/**
+	 * Mixed into every counter, for a different set of numbers.
+	 */
+	unsigned int seed;
+
+public:
+
+	/**
+	 * Constructs the numbers of a sample.
+	 *
+	 * @param x Column of the pixel.
+	 * @param y Row of the pixel.
+	 * @param sample Index of the sample within the pixel.
+	 * @param seed Mixed into every counter.
+	 */
+	samplerandom(int x, int y, unsigned int sample, unsigned int seed = 0) :
+			x(x), y(y), sample(sample), seed(seed) { }
+
+	/**
+	 * Gets four random numbers.
+	 *
+	 * @param bounce Number of reflections followed before the numbers are
+	 *   used, or another index that tells apart numbers of one purpose.
+	 * @param purpose What the numbers are for.
+	 * @param[out] bits Receives the numbers, each 32 random bits.
+	 */
+	void get(unsigned int bounce, randomPurpose purpose,
+			unsigned int bits[4]) const {
+		bits[0] = sample;
+		bits[1] = bounce;
+		bits[2] = (unsigned int) purpose;
+		bits[3] = seed;
+		philox4x32(bits, (unsigned int) x, (unsigned int) y);
+	}
+
+	/**
+	 * Gets a random number in [0, 1).
+	 *
+	 * @param bounce As for @c get .
+	 * @param purpose What the number is for.
+	 *
+	 * @return The number.
+	 */
+	double get1D(unsigned int bounce, randomPurpose purpose) const {
+		unsigned int bits[4];
+		get(bounce, purpose, bits);
+		return bits[0] / 4294967296.0;
+	}
+};
+
+/**
+ * Reverses the bits of a number.
+ *
+ * @param x The number.
+ *
+ * @return The number with its first bit last.
+ */
+inline unsigned int reverseSampleBits(unsigned int x) {
+	x = (x << 16) | (x >> 16);
+	x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+	x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+	x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+	x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+	return x;
+}
+
+/**
+ * Owen scrambles the bits of a fixed point number in [0, 1): each bit is
+ * flipped or not by a hash of the seed and the bits before it, so numbers
+ * in the same binary interval stay in one (Burley, "Practical Hash-based
+ * Owen Scrambling", 2020).
+ *
+ * @param x The number, 32 bits after the point.
+ * @param seed The scramble.
+ *
+ * @return The scrambled number.
+ */
+inline unsigned int owenScramble(unsigned int x, unsigned int seed) {
+	x = reverseSampleBits(x);
+	x ^= x * 0x3d20adeau;
+	x += seed;
+	x *= (seed >> 16) | 1;
+	x ^= x * 0x05526c56u;
+	x ^= x * 0x53a22864u;
+	return reverseSampleBits(x);
+}
+
+/**
+ * Gets a point of the first two dimensions of the Sobol sequence, the
+ * van der Corput sequence and its companion, which together are a
+ * (0, 2)-sequence in base 2.
+ *
+ * @param index Index of the point.
+ * @param[out] u Receives the first coordinate, 32 bits after the point.
+ * @param[out] v Receives the second.
+ */
+inline void sobol2D(unsigned int index, unsigned int &u, unsigned int &v) {
+	u = reverseSampleBits(index);
+	v = 0;
+	for (unsigned int d = 1u << 31; index != 0; index >>= 1, d ^= d >> 1)
+		if (index & 1)
+			v ^= d;
+}
+
+/**
+ * Gets a point of a shuffled, Owen scrambled two dimensional Sobol
+ * sequence. Indices are shuffled by an Owen scramble too, which maps
+ * aligned blocks of 2^k indices to aligned blocks, so any such block of
+ * points is still a (0, k, 2)-net.
+ *
+ * @param index Index of the point.
+ * @param seed The scramble; different seeds give uncorrelated sequences.
+ * @param[out] u Receives the first coordinate, in [0, 1).
+ * @param[out] v Receives the second.
+ */
+inline void scrambledSobol2D(unsigned int index, unsigned int seed,
+		double &u, double &v) {
+	unsigned int a, b;
+	sobol2D(owenScramble(index, seed), a, b);
+	a = owenScramble(a, mixSampleBits(seed ^ 0xa511e9b3u));
+	b = owenScramble(b, mixSampleBits(seed ^ 0x63d83595u));
+	u = a / 4294967296.0;
+	v = b / 4294967296.0;
+}
+
+/**
+ * A square tile of blue noise: a value in [0, 1) per texel, each of
+ * @c BLUE_NOISE_SIZE squared evenly spaced values once, placed so that
+ * texels below any threshold are spread out evenly, with no low
+ * frequencies. It's made once by void and cluster (Ulichney, 1993) with a
+ * Gaussian filter that wraps around, so the tile repeats seamlessly.
+ */
+class bluenoisetable {
+private:
+
+	/**
+	 * The values of the texels, row by row.
+	 */
+	std::vector<float> values;
+
+	/*
+	 * Adds or takes away a point's share of the energy of every texel.
+	 */
+	static void spread(std::vector<float> &energy,
+			const std::vector<float> &kernel, int p, float sign) {
+		const int n = BLUE_NOISE_SIZE;
+		int px = p % n, py = p / n;
+		for (int y = 0; y < n; y++) {
+			int dy = (y - py + n) % n;
+			for (int x = 0; x < n; x++)
+				energy[y * n + x] += sign * kernel[dy * n + (x - px + n) % n];
+		}
+	}
+
+	/*
+	 * Finds the point with the most energy, the middle of the tightest
+	 * cluster, or the empty texel with the least, the middle of the largest
+	 * void.
+	 */
+	static int extreme(const std::vector<float> &energy,
+			const std::vector<char> &set, bool cluster) {
+		int best = -1;
+		for (size_t i = 0; i < energy.size(); i++) {
+			if (set[i] != cluster)
+				continue;
+			if (best < 0 || (cluster ? energy[i] > energy[best] :
+					energy[i] < energy[best]))
+				best = (int) i;
+		}
+		return best;
+	}
+
+	/**
+	 * Makes the tile.
+	 */
+	bluenoisetable() {
+		const int n = BLUE_NOISE_SIZE, total = n * n;
+		const float sigma = 1.5f;
+		std::vector<float> kernel(total);
+		for (int y = 0; y < n; y++) {
+			for (int x = 0; x < n; x++) {
+				int dx = std::min(x, n - x), dy = std::min(y, n - y);
+				kernel[y * n + x] = std::exp(-(dx * dx + dy * dy) /
+						(2 * sigma * sigma));
+			}
+		}
+		// A tenth of the texels, picked by a hash, moved from the tightest
+		// cluster to the largest void until that's where they came from.
+		std::vector<char> set(total, 0);
+		std::vector<float> energy(total, 0);
+		int ones = 0;
+		for (unsigned int k = 0; ones < total / 10; k++) {
+			int p = (int) (mixSampleBits(k) % (unsigned int) total);
+			if (set[p])
+				continue;
+			set[p] = 1;
+			spread(energy, kernel, p, 1);
+			ones++;
+		}
+		for (int moves = 0; moves < total; moves++) {
+			int c = extreme(energy, set, true);
+			set[c] = 0;
+			spread(energy, kernel, c, -1);
+			int v = extreme(energy, set, false);
+			set[v] = 1;
+			spread(energy, kernel, v, 1);
+			if (v == c)
+				break;
+		}
+
+		// The points of the pattern are ranked from the tightest cluster
+		// down, and the rest from the largest void up.
+		std::vector<int> rank(total);
+		std::vector<char> prototype(set);
+		std::vector<float> prototypeEnergy(energy);
+		for (int r = ones - 1; r >= 0; r--) {
+			int c = extreme(energy, set, true);
+			set[c] = 0;
+			spread(energy, kernel, c, -1);
+			rank[c] = r;
+		}
+		set.swap(prototype);
+		energy.swap(prototypeEnergy);
+		for (int r = ones; r < total; r++) {
+			int v = extreme(energy, set, false);
+			set[v] = 1;
+			spread(energy, kernel, v, 1);
+			rank[v] = r;
+		}
+		values.resize(total);
+		for (int i = 0; i < total; i++)
+			values[i] = (rank[i] + 0.5f) / total;
+	}
+
+public:
+
+	/**
+	 * Gets the tile, which is made on first use.
+	 *
+	 * @return The tile.
+	 */
+	static const bluenoisetable& get() {
+		static const bluenoisetable table;
+		return table;
+	}
+
+	/**
+	 * Gets the value of a texel; the tile repeats in both directions.
+	 *
+	 * @param x Column, any integer.
+	 * @param y Row, any integer.
+	 *
+	 * @return The value, in (0, 1).
+	 */
+	float at(int x, int y) const {
+		const int n = BLUE_NOISE_SIZE;
+		x = ((x % n) + n) % n;
+		y = ((y % n) + n) % n;
+		return values[y * n + x];
+	}
+};
+
+/**
+ * Draws the samples of the pixels of an image, as pairs of numbers in
+ * [0, 1) for a pixel, the index of its sample and a dimension, such as
+ * where in the pixel the sample is or when in the shutter interval. Each
+ * dimension is a separately scrambled sequence, so the first samples of a
+ * pixel are well spread out in each pair of numbers on its own (this is
+ * padding, as in PBRT's samplers). Everything is a fixed function of its
+ * arguments.
+ */
+class pixelsampler {
+private:
+
+	/**
+	 * Where the samples come from.
+	 */
+	samplerKind kind;
+
+	/**
+	 * Mixed into every hash, for a different set of samples.
+	 */
+	unsigned int seed;
+
+	/*
+	 * Hashes a pixel, or the whole image for y = -1, and a dimension.
+	 */
+	unsigned int hashPixel(int x, int y, unsigned int dimension) const {
+		unsigned int h = mixSampleBits(seed ^ 0x9e3779b9u);
+		h = mixSampleBits(h ^ (unsigned int) x);
+		h = mixSampleBits(h ^ (unsigned int) y);
+		return mixSampleBits(h ^ dimension);
+	}
+
+public:
+
+	/**
+	 * Constructs a sampler.
+	 *
+	 * @param kind Where the samples come from.
+	 * @param seed Mixed into every hash.
+	 */
+	pixelsampler(samplerKind kind = SAMPLER_SOBOL, unsigned int seed = 0) :
+			kind(kind), seed(seed) {
+		if (kind == SAMPLER_BLUE_NOISE)
+			bluenoisetable::get();
+	}
+
+	/**
+	 * Getter for the kind.
+	 *
+	 * @return Where the samples come from.
+	 */
+	samplerKind getKind() const {
+		return kind;
+	}
+
+	/**
+	 * Getter for the seed.
+	 *
+	 * @return What's mixed into every hash.
+	 */
+	unsigned int getSeed() const {
+		return seed;
+	}
+
+	/**
+	 * Gets two numbers of a sample of a pixel.
+	 *
+	 * @param x Column of the pixel.
+	 * @param y Row of the pixel.
+	 * @param index Index of the sample within the pixel.
+	 * @param dimension Which pair of numbers of the sample, like 0 for the
+	 *   position in the pixel and 1 for the time.
+	 * @param[out] u Receives the first number, in [0, 1).
+	 * @param[out] v Receives the second.
+	 */
+	void get2D(int x, int y, unsigned int index, unsigned int dimension,
+			double &u, double &v) const {
+		switch (kind) {
+		case SAMPLER_RANDOM: {
+			unsigned int bits[4];
+			samplerandom(x, y, index, seed).get(dimension,
+					RANDOM_PIXEL_SAMPLE, bits);
+			u = bits[0] / 4294967296.0;
+			v = bits[1] / 4294967296.0;
+			break;
+		}
+		case SAMPLER_SOBOL:
+			scrambledSobol2D(index, hashPixel(x, y, dimension), u, v);
+			break;
+		default: {
+			scrambledSobol2D(index, hashPixel(0, -1, dimension), u, v);
+			// Every dimension reads the tile at its own offset.
+			unsigned int h = mixSampleBits(dimension ^ seed);
+			const bluenoisetable &table = bluenoisetable::get();
+			u += table.at(x + (int) (h % BLUE_NOISE_SIZE),
+					y + (int) ((h >> 8) % BLUE_NOISE_SIZE));
+			v += table.at(x + (int) ((h >> 16) % BLUE_NOISE_SIZE),
+					y + (int) ((h >> 24) % BLUE_NOISE_SIZE));
+			u -= std::floor(u);
+			v -= std::floor(v);
+			break;
+		}
+		}
+	}
+};
+
+#endif // SAMPLER_HH
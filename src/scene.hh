@@ -9,13 +9,46 @@
 #include "spotlight.hh"
 #include "arealight.hh"
 #include "shape.hh"
+#include "materialtable.hh"
 #include "camera.hh"
+#include "accelerator.hh"
+#include "buildpipeline.hh"
+#include "rendercontext.hh"
+#include "hitrecord.hh"
+#include "lighttree.hh"
+#include "lightpack.hh"
+#include "shadowmap.hh"
+#include "spherepack.hh"
+#include "shapekind.hh"
+#include "gbuffer.hh"
+#include "denoiser.hh"
+#include "sampler.hh"
+#include "wavefront.hh"
+#include "arena.hh"
+#include "parallel.hh"
+#include "tilequeue.hh"
+#include "png.hh"
+#include "framebuffer.hh"
+#include "tiledframebuffer.hh"
+#include "dirtyregion.hh"
+#include "primarybins.hh"
+#include "raystats.hh"
+#include "costmap.hh"
+#include "shapeprofile.hh"
+#include "tracelog.hh"
 #include "boost/shared_ptr.hpp"
+#include "boost/atomic.hpp"
+#include "boost/scoped_array.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdio>
 #include <vector>
 #include <iostream>
 #include <ostream>
+#include <sstream>
 #include <iterator>
+#include <utility>
 
 #ifndef SCENE_HH
 #define SCENE_HH
@@ -29,10 +62,26 @@
 /**
  * Colors are 0 through 255, inclusive, as ints.
  */
-#define COLORMAX 255
+#define COLORMAX QUANTIZE_MAX
 
 /**
- * Maximum number of reflections to track.
+ * Size in bytes of the blocks @c scene::writePPM hands to the output stream.
+ */
+#define PPM_WRITE_BLOCK 65536
+
+/**
+ * The flavors of PPM @c scene::writePPM can write.
+ */
+enum ppmFormat {
+	/** Plain PPM: one line of decimal numbers per pixel. */
+	PPM_P3,
+	/** Raw PPM: three bytes per pixel, a third of the size of P3. */
+	PPM_P6
+};
+
+/**
+ * Default maximum number of reflections to track; see
+ * @c scene::setReflectionLimits .
  */
 #define MAX_REFLECT 10
 
@@ -41,10 +90,85 @@
  */
 #define DELTA 0.00001
 
+/**
+ * Number of neighboring pixels in a row whose camera rays are traced through
+ * the acceleration structure together.
+ */
+#define RENDER_PACKET_WIDTH 8
+
+/**
+ * Width and height in pixels of the screen tiles @c shadeGBuffer culls
+ * lights for.
+ */
+#define RENDER_TILE_SIZE 16
+
+/**
+ * The settings a shading kernel of @c scene::shade is compiled for. The
+ * scene picks the kernel of its settings once per shaded ray, so the tests
+ * of these settings are folded away in the loops over lights and their
+ * samples, and in the kernels without shadows or reflections so is all the
+ * code that traces them.
+ *
+ * @tparam shadows_V Whether shadow rays are traced.
+ * @tparam reflections_V Whether reflections may be followed at all.
+ * @tparam sampledLights_V Whether some light, like a sampled area light,
+ *   takes more than one sample.
+ */
+template<bool shadows_V, bool reflections_V, bool sampledLights_V>
+struct shadekernel {
+	/** Whether shadow rays are traced. */
+	static const bool shadows = shadows_V;
+	/** Whether reflections may be followed at all. */
+	static const bool reflections = reflections_V;
+	/** Whether some light takes more than one sample. */
+	static const bool sampledLights = sampledLights_V;
+};
+
+/**
+ * Default size in pixels of the blocks the first pass of
+ * @c scene::renderProgressive traces one ray for.
+ */
+#define RENDER_PROGRESSIVE_BLOCK 8
+
+/**
+ * Smallest number of lights for which @c finalize builds a light tree.
+ * Below that, looping over every light is as fast.
+ */
+#define LIGHT_TREE_MIN_LIGHTS 16
+
+/**
+ * How a @c scene lights with its area lights.
+ */
+enum areaLightMode {
+	/**
+	 * Each area light is replaced by its grid of point lights when it's
+	 * added, and every shading point gets a shadow ray to each of them. The
+	 * result is deterministic and doesn't depend on any sample count. It's
+	 * the reference the sampled mode converges to, except that the grid
+	 * divides the light's color by a count of (int) (width / spacing) per
+	 * axis, which is usually less than the number of lights the grid has,
+	 * so it comes out brighter.
+	 */
+	AREA_LIGHT_GRID,
+
+	/**
+	 * Each shading point samples a fixed number of positions on every area
+	 * light, so the work and memory don't depend on the size of the light.
+	 */
+	AREA_LIGHT_SAMPLED
+};
+
 /**
  * Represents a 3D scene as a collection of shape pointers and light
  * pointers.
  *
+ * Once it's finalized, a scene and its camera, shapes and lights are only
+ * read while rendering, so several renders of one scene, or of different
+ * ones, can run at the same time on different threads, each with its own
+ * render contexts; see @c renderscheduler . The exceptions are
+ * @c shadeWavefront , which reuses queues kept in the scene, and renders
+ * with a cost map set, which write to it.
+ *
  * @tparam vec_T The type of the vector components. Many arithmetic and
  *   relational operators must be supported. The type will likely be double,
  *   float, or int.
@@ -88,279 +212,5130 @@ private:
 		sp_arealight;
 
 	/**
-	 * An STL vector of Boost shared pointers to the point lights in the scene.
+	 * Boost shared pointer typedef for acceleration structures.
+	 */
+	typedef boost::shared_ptr<accelerator<vec_T, color_T, time_T, dim> >
+		sp_accelerator;
+
+	/**
+	 * An STL vector of Boost shared pointers to all the lights in the scene,
+	 * of every kind, in the order they were added. A light's index in it is
+	 * also its shadow cache slot.
+	 */
+	std::vector<sp_light> lights;
+
+	/**
+	 * The lights as they were added, with each area light once even when
+	 * its grid of point lights is in @c lights .
+	 */
+	std::vector<sp_light> sourceLights;
+
+	/**
+	 * Index in @c sourceLights of the light each of @c lights came from.
+	 */
+	std::vector<int> lightSources;
+
+	/**
+	 * Whether @c lights has a sampled area light, which may take more than
+	 * one sample; this picks the @c shadekernel of @c shade .
+	 */
+	bool sampledLights;
+
+	/**
+	 * How area lights added from now on light the scene.
+	 */
+	areaLightMode areaMode;
+
+	/**
+	 * Samples per shading point for sampled area lights that don't set their
+	 * own count.
 	 */
-	std::vector<sp_light> pointlights;
+	int areaLightSamples;
 
 	/**
-	 * An STL vector of Boost shared pointers to the spotlights in this scene.
+	 * Number of samples of a sampled area light whose shadow rays are
+	 * traced first, to decide if the rest need theirs, or 0 to trace them
+	 * all; see @c setAdaptiveShadows .
 	 */
-	std::vector<sp_spotlight> spotlights;
+	int adaptiveShadowProbes;
+
+	/**
+	 * Whether the samples of a pixel that all see one shape reuse what the
+	 * shadow rays of its corner samples found; see @c setPixelVisibility .
+	 */
+	bool pixelVisibility;
 
 	/**
 	 * An STL vector of Boost shared pointers to all the shapes in the scene.
 	 */
 	std::vector<sp_shape> shapes;
 
+	/**
+	 * The @c shapeKind of each of @c shapes , so the scans over them can
+	 * call the shapes' own intersection code without virtual calls.
+	 */
+	std::vector<shapeKind> shapeKinds;
+
+	/**
+	 * The distinct colors and reflectivities of @c shapes , which hold
+	 * their indices; see @c getMaterials .
+	 */
+	materialtable<color_T> materials;
+
+	/**
+	 * Gets the bounds of shapes as they're added, from
+	 * @c beginPipelinedBuild until @c finalize , or null. Copies of the
+	 * scene share it, so only one of them may add shapes until then.
+	 */
+	boost::shared_ptr<buildpipeline<vec_T, color_T, time_T, dim> > pipeline;
+
+	/**
+	 * True if shapes have been recolored or removed since @c materials was
+	 * last rebuilt, so it may hold materials no shape uses.
+	 */
+	bool materialsStale;
+
 	/**
 	 * Controls if shadows are used in the raytracer or not.
 	 */
 	bool useShadows;
 
-public:
+	/**
+	 * Controls if shadow rays first try the shape that blocked the previous
+	 * shadow ray to the same light. Only takes effect when tracing with a
+	 * @c rendercontext , which holds the cache.
+	 */
+	bool useShadowCache;
 
 	/**
-	 * Constructs an empty scene with or without shadows.
-	 *
-	 * @param useShadows If true, renders if shadows, if false, not
+	 * The shapes in @c shapes that have bounding boxes. This is what the
+	 * acceleration structure is built over. Filled in by @c finalize .
 	 */
-	scene(bool useShadows) : useShadows(useShadows) { }
+	std::vector<sp_shape> boundedShapes;
 
 	/**
-	 * Adds a shape to the scene.
-	 *
-	 * @param obj Boost shared pointer to a shape to add to this scene.
+	 * The shapes in @c shapes that can't be bounded, like infinite planes.
+	 * They would make the root of any spatial structure infinitely large, so
+	 * they're kept out of it and tested one by one. Filled in by
+	 * @c finalize .
 	 */
-	void addShape(sp_shape obj) {
-		assert(obj != 0);
-		shapes.push_back(obj);
-	}
+	std::vector<sp_shape> unboundedShapes;
 
 	/**
-	 * Adds a point light to the scene.
-	 *
-	 * @param theLight Boost shared pointer to the point light to add to this
-	 *        scene.
+	 * Index in @c shapes of each of @c boundedShapes .
 	 */
-	void addPointLight(sp_light theLight) {
-		assert(theLight != 0);
-		pointlights.push_back(theLight);
-	}
+	std::vector<int> boundedIds;
 
 	/**
-	 * Adds a spot light to the scene.
-	 *
-	 * @param theLight Boost shared pointer to the point light to add to this
-	 *        scene.
+	 * Index in @c shapes of each of @c unboundedShapes .
 	 */
-	void addSpotLight(sp_spotlight theLight) {
-		assert(theLight != 0);
-		spotlights.push_back(theLight);
-	}
+	std::vector<int> unboundedIds;
 
 	/**
-	 * Adds an area light to the scene by dumping all the point lights in
-	 * area light approximation into this scene's point light collection.
-	 *
-	 * @param theLight Boost shared pointer to the point light to add to this
-	 *        scene.
+	 * The @c shapeKind of each of @c unboundedShapes .
 	 */
-	void addAreaLight(sp_arealight theLight) {
-		assert(theLight != 0);
-		typename std::vector<boost::shared_ptr<
-			light<vec_T, color_T, time_T, dim> > >::const_iterator iter;
-		for(iter = theLight->getLights().begin();
-				iter < theLight->getLights().end(); iter++) {
-			addPointLight(*iter);
+	std::vector<shapeKind> unboundedKinds;
+
+	/**
+	 * Acceleration structure over @c boundedShapes . If it's null, or if
+	 * shapes were added since it was last built, closest-hit queries fall back
+	 * to testing every shape.
+	 */
+	sp_accelerator accel;
+
+	/**
+	 * True if @c accel has been built over the current @c shapes .
+	 */
+	bool accelBuilt;
+
+	/**
+	 * @c shapes with the spheres packed for batch tests, which replaces the
+	 * linear scan when there's no acceleration structure. Its slots are the
+	 * indices in @c shapes .
+	 */
+	spherepack<vec_T, color_T, time_T, dim> shapePack;
+
+	/**
+	 * True if @c shapePack has been built over the current @c shapes .
+	 */
+	bool packBuilt;
+
+	/**
+	 * Hierarchy over @c lights , so light indices in it are the same as
+	 * shadow cache slots.
+	 */
+	lighttree<vec_T, color_T, time_T, dim> lightTree;
+
+	/**
+	 * True if @c lightTree has been built over the current lights.
+	 */
+	bool lightTreeBuilt;
+
+	/**
+	 * Gives every shape that has no material index one. If shapes have
+	 * been recolored or removed, @c materials is first rebuilt from the
+	 * shapes as they are now, dropping materials no shape uses any more.
+	 */
+	void buildMaterials() {
+		if (materialsStale) {
+			materials.clear();
+			for (size_t i = 0; i < shapes.size(); i++)
+				shapes[i]->setMaterial(-1);
+			materialsStale = false;
 		}
+		for (size_t i = 0; i < shapes.size(); i++)
+			if (shapes[i]->getMaterial() < 0)
+				shapes[i]->setMaterial(materials.add(shapes[i]->getColor(),
+						shapes[i]->getReflectivity()));
 	}
 
 	/**
-	 * Finds the closest object that intersects the given ray and the time
-	 * at which that intersection occurs, which is returned through the
-	 * @c tIntersect out-parameter. Returns 0 and sets the out-parameter
-	 * to RAY_MISS if there is no such object.
+	 * Gets the color of a hit shape from @c materials , or from the shape
+	 * if it has no material, like a shape within an instance.
 	 *
-	 * @param r The ray.
-	 * @param[out] tIntersect The time at which the intersection with @c r
-	 *   occurs or @c RAY_MISS if there's no intersection.
+	 * @param s The shape of a hit record.
 	 *
-	 * @return The nearest object that intersects the ray @c r.
+	 * @return The color.
 	 */
-	sp_shape findClosestShape(
-			const ray<vec_T, time_T, dim> &r, time_T &tIntersect) const {
-		time_T t = RAY_MISS;
-		tIntersect = RAY_MISS;
-		sp_shape intersectedObjPtr, tmpPtr;
-		typename std::vector<sp_shape>::const_iterator iter;
-		for (iter = shapes.begin(); iter < shapes.end(); iter++) {
-			tmpPtr = *iter;
-			t = tmpPtr->intersection(r);
-			if (t != RAY_MISS && t > 0) {
-				if (tIntersect == RAY_MISS) { // tIntersect starts at RAY_MISS
-					tIntersect = t;
-					intersectedObjPtr = tmpPtr;
-				}
-				else if (t < tIntersect) {
-					intersectedObjPtr = tmpPtr;
-					tIntersect = t;
-				}
-			}
-		}
-		return intersectedObjPtr;
+	const rgbcolor<color_T>& surfaceColor(
+			const shape<vec_T, color_T, time_T, dim> *s) const {
+		int m = s->getMaterial();
+		return m >= 0 ? materials[m].color : s->getColor();
 	}
 
 	/**
-	 * Determines the color of the given ray. Determines its color by finding
-	 * the nearest intersecting object and by combining its color with the
-	 * colors of lights in the scene.
+	 * Gets the reflectivity of a hit shape like @c surfaceColor gets its
+	 * color.
 	 *
-	 * TODO: there is probably a better way to process the non-point lights.
-	 * One way would be to write a virtual function called "bool useLight()"
-	 * in the light class so that we can have just one light vector in this
-	 * class, not one vector for each type of light and one loop for each
-	 * vector. That would be a great improvement!
+	 * @param s The shape of a hit record.
 	 *
-	 * @param r The ray whose color will be determined.
-	 * @param depth The current reflection depth. The recursion
-	 *
-	 * @return The color of the given ray or @c DEFAULT_BKCOLOR if there is no
-	 * intersection.
+	 * @return The reflectivity.
 	 */
-	rgbcolor<color_T> traceRay(
-			const ray<vec_T, time_T, dim> &r, int depth = 0) const {
-		time_T tIntersect; // out parameter
-		sp_shape intersectedObjPtr =
-				findClosestShape(r, tIntersect);
-		if(intersectedObjPtr == 0) {
-			return DEFAULT_BKCOLOR;
+	float surfaceReflectivity(
+			const shape<vec_T, color_T, time_T, dim> *s) const {
+		int m = s->getMaterial();
+		return m >= 0 ? materials[m].reflectivity : s->getReflectivity();
+	}
+
+	/**
+	 * Builds @c lightTree over the lights as they are now if there are at
+	 * least @c LIGHT_TREE_MIN_LIGHTS of them.
+	 */
+	void buildLightTree() {
+		lightTreeBuilt = false;
+		if (lights.size() < LIGHT_TREE_MIN_LIGHTS)
+			return;
+		std::vector<aabb<vec_T, dim> > boxes(lights.size());
+		std::vector<rgbcolor<color_T> > colors;
+		std::vector<bool> canCluster;
+		for (size_t i = 0; i < lights.size(); i++) {
+			lights[i]->getBounds(boxes[i]);
+			colors.push_back(lights[i]->getColor());
+			canCluster.push_back(lights[i]->canCluster());
 		}
+		lightTree.build(boxes, colors, canCluster);
+		lightTreeBuilt = true;
+	}
 
-		mvector<vec_T, dim> intersectionPt = r.getPointAtT(tIntersect);
-		mvector<vec_T, dim> N = intersectedObjPtr->surfaceNorm(intersectionPt);
+	/**
+	 * @c lights with the point lights packed for working out which face a
+	 * shading point several at a time. Its slots are the indices in
+	 * @c lights .
+	 */
+	lightpack<vec_T, color_T, time_T, dim> lightPack;
 
-		// Loop over all the point lights, summing the color contributions from
-		// each one
-		rgbcolor<color_T> finalColor;
-		typename std::vector<sp_light>::const_iterator iter;
-		for (iter = pointlights.begin(); iter < pointlights.end(); iter++) {
-			sp_light currLightPtr = *iter;
-			mvector<vec_T, dim> L = currLightPtr->getPos() - intersectionPt;
-			L = L.norm();
-			vec_T LdotN = L * N;
-
-			// A hack to make sure an object doesn't intersect itself...
-			// make the "to light" ray start a little outside an object itself
-			// by adding a tiny scalar multiple of a normal line to the
-			// starting point
-			mvector<vec_T, dim> intersectionPtWithDelta =
-					intersectionPt + N * DELTA;
-
-			// shoot a ray to this light. if it hits anything on the way,
-			// skip the light (if shadows are on)
-			ray<vec_T, time_T, dim> rayToLight(
-					intersectionPtWithDelta, L);
-			time_T t;
-			if (useShadows && findClosestShape(rayToLight, t) != 0) {
-				continue;
-			}
+	/**
+	 * True if @c lightPack has been built over the current lights.
+	 */
+	bool lightPackBuilt;
 
-			// add in the color contribution of the light
-			if(LdotN > 0) {
-				finalColor += (currLightPtr->getColor() *
-						intersectedObjPtr->getColor() * LdotN);
-			}
-		}
+	/**
+	 * Builds @c lightPack over the lights as they are now.
+	 */
+	void buildLightPack() {
+		lightPack.clear();
+		for (size_t i = 0; i < lights.size(); i++)
+			lightPack.add(lights[i].get());
+		lightPackBuilt = true;
+	}
 
-		// Loop over all the spotlights, summing the color contributions from
-		// each one. Skip the spotlight if the angle between the ray and the
-		// spotlight's direction vector is > the cone angle.
-		typename std::vector<sp_spotlight>::const_iterator iter2;
-		for (iter2 = spotlights.begin(); iter2 < spotlights.end(); iter2++) {
-			sp_spotlight currLightPtr = *iter2;
-			mvector<vec_T, dim> L = currLightPtr->getPos() - intersectionPt;
-			L = L.norm();
+	/**
+	 * Cube shadow maps of the point lights and spotlights, by index in
+	 * @c lights , while @c shadowMapRes is positive. Other lights have
+	 * empty maps.
+	 */
+	std::vector<shadowmap<vec_T, time_T, dim> > shadowMaps;
 
-			// skip this light if it's outside the spotlight cone
-			float ray_spotlight_angle =
-					acos(currLightPtr->getDir().norm() * -L);
-			if (ray_spotlight_angle > currLightPtr->getAngle()) {
-				continue;
-			}
+	/**
+	 * Texels along each side of a face of the shadow maps, or 0 to trace
+	 * shadow rays.
+	 */
+	int shadowMapRes;
 
-			vec_T LdotN = L * N;
+	/**
+	 * The bias of @c shadowmap::isOccluded .
+	 */
+	vec_T shadowMapBias;
 
-			// A hack to make sure an object doesn't intersect itself...
-			// make the "to light" ray start a little outside an object itself
-			// by adding a tiny scalar multiple of a normal line to the
-			// starting point
-			mvector<vec_T, dim> intersectionPtWithDelta =
-					intersectionPt + N * DELTA;
+	/**
+	 * The @c light::getEditCount of the lights the shadow maps were built
+	 * for. Once a light moves the maps are ignored until they're built
+	 * again.
+	 */
+	unsigned shadowMapEdits;
 
-			// shoot a ray to this light. if it hits anything on the way,
-			// skip the light (if shadows are on)
-			ray<vec_T, time_T, dim> rayToLight(
-					intersectionPtWithDelta, L);
-			time_T t;
-			if (useShadows && findClosestShape(rayToLight, t) != 0) {
-				continue;
-			}
+	/**
+	 * Tracer of @c shadowmap::build that finds closest hits in this scene.
+	 */
+	struct shadowMapTracer {
+		const scene *sc;
 
-			// add in the color contribution of the light
-			if(LdotN > 0) {
-				finalColor += (currLightPtr->getColor() *
-						intersectedObjPtr->getColor() * LdotN);
-			}
+		bool operator()(const ray<vec_T, time_T, dim> &r, time_T &t) const {
+			RAYSTATS_ADD(shadowMapRays, 1);
+			return sc->findClosestId(r, t) >= 0;
 		}
+	};
 
-		// handle reflections
-		if (intersectedObjPtr->getReflectivity() > 0 && depth < MAX_REFLECT) {
-			// R_r is the direction of the reflected vector
-			ray<vec_T, time_T, dim> R_r = r.reflect(intersectionPt, N);
-			// col_r is the reflection color
-			rgbcolor<color_T> col_r = traceRay(R_r, depth + 1);
-			finalColor +=
-					((color_T) intersectedObjPtr->getReflectivity()) * col_r;
+	/**
+	 * Builds @c shadowMaps for the lights as they are now, if they're on.
+	 * A light gets a map if it lights from a single point.
+	 */
+	void buildShadowMaps() {
+		shadowMaps.clear();
+		if (shadowMapRes <= 0)
+			return;
+		shadowMaps.resize(lights.size());
+		shadowMapTracer trace;
+		trace.sc = this;
+		aabb<vec_T, dim> box;
+		for (size_t i = 0; i < lights.size(); i++) {
+			lights[i]->getBounds(box);
+			if (box.diagonal().magsq() == 0)
+				shadowMaps[i].build(lights[i]->getPos(), shadowMapRes,
+						renderThreads, trace);
 		}
-
-		return finalColor;
+		shadowMapEdits = light<vec_T, color_T, time_T, dim>::getEditCount();
 	}
 
 	/**
-	 * Renders this scene for the given camera and image size as a PPM
-	 * formatted image to the given output stream.
-	 *
-	 * @param cam The camera in this scene.
-	 * @param width The width of the image in pixels.
-	 * @param height The height of the image in pixels.
-	 * @param os The output stream to which the PPM image will be written.
+	 * Clustering threshold passed to @c lighttree::collect . 0 shades every
+	 * light that may contribute on its own.
 	 */
-	void renderPPM(const camera<vec_T, time_T, dim> &cam,
-			int width, int height,
-			std::ostream &os) const {
-		os << "P3 " << width << " " << height << " "
-				<< COLORMAX << std::endl;
-		for (int y = 0; y < height; y++) {
-			for (int x = 0; x < width; x++) {
-				ray<vec_T, time_T, dim> pixelRay = cam.getRayForPixel(
-						x, y, width, height);
-				rgbcolor<color_T> c = traceRay(pixelRay);
-				c *= COLORMAX;
-				c.clamp(0, COLORMAX);
-				os << (int)c.getR() << " " << (int)c.getG() << " " <<
-						(int)c.getB() << std::endl;
-			}
-		}
-	}
+	vec_T lightClusterRatio;
 
 	/**
-	 * Prints scene contents to the given output stream.
-	 *
-	 * @param os The output stream to which the scene attributes will be
-	 *   written.
+	 * Relative error bound of the lightcuts of @c lighttree::cut , or 0 to
+	 * cluster by @c lightClusterRatio instead.
 	 */
-	void printHelper(std::ostream &os) const {
-		os << "scene: shadows " << (useShadows ? "ON" : "OFF") << std::endl;
-		os << "  point lights:" << std::endl;
-		typename std::vector<sp_light>::const_iterator iter;
-		for (iter = pointlights.begin(); iter < pointlights.end(); iter++) {
-			os << "    " << **iter << std::endl;
-		}
+	vec_T lightCutError;
+
+	/**
+	 * Number of light samples shaded per shading point by light picking, or
+	 * 0 to shade all of them; see @c setLightPicks .
+	 */
+	int lightPicks;
+
+	/**
+	 * Largest number of reflections followed from a camera ray.
+	 */
+	int maxReflectDepth;
+
+	/**
+	 * Reflections whose light would be scaled by less than this, the product
+	 * of the reflectivities along the way, aren't followed.
+	 */
+	color_T minThroughput;
+
+	/**
+	 * With shadows on, light samples that could add less than this to any
+	 * channel of a pixel are dropped before their shadow ray is traced.
+	 */
+	color_T lightCutoff;
+
+	/**
+	 * Number of reflections after which paths are terminated by Russian
+	 * roulette, or -1 to never do so.
+	 */
+	int rouletteDepth;
+
+	/**
+	 * Controls if @c shadeWavefront sorts its shadow and reflection queues
+	 * with @c coherentOrder before tracing them.
+	 */
+	bool sortSecondaryRays;
+
+	/**
+	 * Controls if @c shadeWavefront traces its shadow queue in packets of
+	 * rays toward one light.
+	 */
+	bool shadowPackets;
+
+	/**
+	 * The queues of each thread of @c shadeWavefront , kept from pass to
+	 * pass.
+	 */
+	mutable std::vector<wavefrontpool<vec_T, color_T, time_T, dim> >
+			wavefrontPools;
+
+	/**
+	 * Number of threads the render passes use; see @c setRenderThreads .
+	 */
+	int renderThreads;
+
+	/**
+	 * Whether @c renderGBuffer rasterizes the shapes instead of tracing
+	 * the camera rays; see @c setRasterPrimary .
+	 */
+	bool rasterPrimary;
+
+	/**
+	 * Whether the bins of @c rasterPrimary are culled by the pyramid of
+	 * camera rays of each tile; see @c setTileFrustums .
+	 */
+	bool tileFrustums;
+
+	/**
+	 * Whether the render passes pin their threads; see @c setPinThreads .
+	 */
+	bool pinThreads;
+
+	/**
+	 * Receives the cost of every pixel of @c renderImage , or 0; see
+	 * @c setCostMap .
+	 */
+	std::vector<double> *costMap;
+
+	/**
+	 * What @c costMap counts.
+	 */
+	costMeasure costKind;
+
+	/**
+	 * @c costMap while @c renderImage runs and 0 otherwise, so that the
+	 * other renders, which share its passes, don't add to it.
+	 */
+	mutable std::vector<double> *costTarget;
+
+	/**
+	 * Receives a span for every task of the render passes, or 0; see
+	 * @c setTraceLog .
+	 */
+	tracelog *trace;
+
+	/**
+	 * Samples per axis of the pixels @c supersample refines, or 1 to
+	 * leave every pixel at one sample.
+	 */
+	int aaSamples;
+
+	/**
+	 * Largest difference of a color channel between neighboring pixels that
+	 * @c supersample leaves alone.
+	 */
+	color_T aaThreshold;
 
-		os << "  spotlights:" << std::endl;
-		typename std::vector<sp_spotlight>::const_iterator iter3;
-		for (iter3 = spotlights.begin(); iter3 < spotlights.end(); iter3++) {
-			os << "    " << **iter3 << std::endl;
+	/**
+	 * Jittered samples per axis of every pixel of @c renderMultisampled .
+	 */
+	int pixelSamples;
+
+	/**
+	 * Passes of the @c denoiser that @c renderImage runs over its images,
+	 * or 0 for none.
+	 */
+	int denoisePasses;
+
+	/**
+	 * Where the jittered samples of @c samplePixel come from.
+	 */
+	pixelsampler pixelSampler;
+
+	/**
+	 * Memory for the shapes and lights of this scene; see @c getArena .
+	 */
+	sp_arena objectArena;
+
+	/**
+	 * Boxes around what the edits since the last @c clearEdits changed,
+	 * each with whether the edit moved something, so that shadows may have
+	 * changed as well as what the camera sees.
+	 */
+	std::vector<std::pair<aabb<vec_T, dim>, bool> > edits;
+
+	/**
+	 * Whether an edit since the last @c clearEdits may have changed any
+	 * pixel, like one to a light or an unbounded shape.
+	 */
+	bool editAll;
+
+	/**
+	 * Notes that an edit changed a shape where it is now.
+	 *
+	 * @param id Index of the shape in @c shapes .
+	 * @param moved Whether the edit changed its shadows too.
+	 */
+	void recordEdit(int id, bool moved) {
+		aabb<vec_T, dim> box;
+		if (shapes[id]->getBounds(box))
+			edits.push_back(std::make_pair(box, moved));
+		else
+			editAll = true;
+	}
+
+	/**
+	 * Finds a shape among the bounded ones.
+	 *
+	 * @param id Index of the shape in @c shapes .
+	 *
+	 * @return Its index in @c boundedShapes , or -1 if it's unbounded.
+	 */
+	int boundedIndex(int id) const {
+		std::vector<int>::const_iterator it = std::lower_bound(
+				boundedIds.begin(), boundedIds.end(), id);
+		return it != boundedIds.end() && *it == id ?
+				(int) (it - boundedIds.begin()) : -1;
+	}
+
+	/**
+	 * Takes a shape about to be removed out of the acceleration structure
+	 * and the bounded or unbounded shapes, and moves the indices of the
+	 * shapes after it down one.
+	 *
+	 * @param id Index of the shape in @c shapes .
+	 *
+	 * @return @c false , changing nothing, if the structure can't remove
+	 *   shapes.
+	 */
+	bool detachShape(int id) {
+		int k = boundedIndex(id);
+		if (k >= 0) {
+			if (!accel->removeShape(k))
+				return false;
+			boundedShapes.erase(boundedShapes.begin() + k);
+			boundedIds.erase(boundedIds.begin() + k);
+		}
+		else {
+			k = (int) (std::lower_bound(unboundedIds.begin(),
+					unboundedIds.end(), id) - unboundedIds.begin());
+			unboundedShapes.erase(unboundedShapes.begin() + k);
+			unboundedIds.erase(unboundedIds.begin() + k);
+			unboundedKinds.erase(unboundedKinds.begin() + k);
+		}
+		for (size_t i = 0; i < boundedIds.size(); i++)
+			if (boundedIds[i] > id)
+				boundedIds[i]--;
+		for (size_t i = 0; i < unboundedIds.size(); i++)
+			if (unboundedIds[i] > id)
+				unboundedIds[i]--;
+		return true;
+	}
+
+	/**
+	 * Gets an unbounded shape that's an infinite plane.
+	 *
+	 * @param k Index of the shape in @c unboundedShapes , whose kind must
+	 *   be @c SHAPE_INFPLANE .
+	 *
+	 * @return The plane.
+	 */
+	const infplane<vec_T, color_T, time_T, dim> &planeAt(size_t k) const {
+		assert(unboundedKinds[k] == SHAPE_INFPLANE);
+		return *static_cast<const infplane<vec_T, color_T, time_T, dim> *>(
+				unboundedShapes[k].get());
+	}
+
+	/**
+	 * Gets the normal of an infinite plane in @c double , for the bounds of
+	 * @c findDirtyTiles .
+	 *
+	 * @param k Index of the plane in @c unboundedShapes .
+	 *
+	 * @return The unit normal.
+	 */
+	mvector<double, dim> planeNormal(size_t k) const {
+		mvector<double, dim> n;
+		for (int a = 0; a < dim; a++)
+			n[a] = (double) planeAt(k).getSurfNorm()[a];
+		return n;
+	}
+
+	/**
+	 * Finds the closest shape in the given collection by testing every one
+	 * of them. This is used for the unbounded shapes and as the fallback when
+	 * there's no up-to-date acceleration structure.
+	 *
+	 * @param list The shapes to test.
+	 * @param kinds The @c shapeKind of each of the shapes.
+	 * @param r The ray.
+	 * @param[out] tIntersect The time of the hit or @c RAY_MISS .
+	 *
+	 * @return Index of the nearest shape in @c list or -1.
+	 */
+	static int findClosestLinear(const std::vector<sp_shape> &list,
+			const std::vector<shapeKind> &kinds,
+			const ray<vec_T, time_T, dim> &r, time_T &tIntersect) {
+		time_T t = RAY_MISS;
+		tIntersect = RAY_MISS;
+		int closest = -1;
+		for (int i = 0; i < (int) list.size(); i++) {
+			t = shapedispatch<vec_T, color_T, time_T, dim>::intersection(
+					kinds[i], list[i].get(), r);
+			if (t != RAY_MISS && t > 0) {
+				if (tIntersect == RAY_MISS) { // tIntersect starts at RAY_MISS
+					tIntersect = t;
+					closest = i;
+				}
+				else if (t < tIntersect) {
+					closest = i;
+					tIntersect = t;
+				}
+			}
+		}
+		return closest;
+	}
+
+	/**
+	 * Finds the closest shape hit by the given ray, using the acceleration
+	 * structure if it's up to date and testing every shape otherwise.
+	 *
+	 * @param r The ray.
+	 * @param[out] tIntersect The time of the hit or @c RAY_MISS .
+	 *
+	 * @return Index of the nearest shape in @c shapes or -1.
+	 */
+	int findClosestId(const ray<vec_T, time_T, dim> &r,
+			time_T &tIntersect) const {
+		RAYSTATS_ADD(closestRays, 1);
+		if (!accelBuilt) {
+			int id;
+			if (!packBuilt)
+				id = findClosestLinear(shapes, shapeKinds, r, tIntersect);
+			else {
+				tIntersect = RAY_MISS;
+				id = shapePack.closestHit(r, 0, shapePack.size(), tIntersect);
+			}
+			RAYSTATS_ADD(hits, id >= 0);
+			return id;
+		}
+		int idx = findClosestLinear(unboundedShapes, unboundedKinds, r,
+				tIntersect);
+		int closest = idx >= 0 ? unboundedIds[idx] : -1;
+		time_T t;
+		idx = accel->closestHit(r, t);
+		if (idx >= 0 && (closest < 0 || t < tIntersect)) {
+			tIntersect = t;
+			closest = boundedIds[idx];
+		}
+		RAYSTATS_ADD(hits, closest >= 0);
+		return closest;
+	}
+
+	/**
+	 * Checks if any shape in the given collection blocks the ray before
+	 * @c tmax by testing them one by one, stopping at the first hit.
+	 *
+	 * @param list The shapes to test.
+	 * @param kinds The @c shapeKind of each of the shapes.
+	 * @param r The ray.
+	 * @param tmax Hits at or beyond this time are ignored.
+	 *
+	 * @return The first shape found that blocks the ray or 0.
+	 */
+	static const shape<vec_T, color_T, time_T, dim> * findOccluderLinear(
+			const std::vector<sp_shape> &list,
+			const std::vector<shapeKind> &kinds,
+			const ray<vec_T, time_T, dim> &r, time_T tmax) {
+		for (size_t i = 0; i < list.size(); i++) {
+			time_T t = shapedispatch<vec_T, color_T, time_T, dim>::
+					intersection(kinds[i], list[i].get(), r);
+			if (t != RAY_MISS && t > 0 && t < tmax)
+				return list[i].get();
+		}
+		return 0;
+	}
+
+	/**
+	 * Tells if the shadows of a light are looked up in its shadow map
+	 * instead of traced.
+	 *
+	 * @param slot Index of the light in @c lights .
+	 *
+	 * @return @c true if they are.
+	 */
+	bool usesShadowMap(int slot) const {
+		return !shadowMaps.empty() && shadowMaps[slot].getResolution() > 0 &&
+				shadowMapEdits ==
+					light<vec_T, color_T, time_T, dim>::getEditCount();
+	}
+
+	/**
+	 * Tries the shape that last blocked a shadow ray towards a light, in
+	 * the shadow cache of a render context, on another one.
+	 *
+	 * @param rayToLight The shadow ray.
+	 * @param tmax Time at which the ray reaches the light.
+	 * @param slot Index of the light in @c lights .
+	 * @param ctx The calling thread's render context.
+	 *
+	 * @return @c true if that shape blocks the ray.
+	 */
+	bool blockedByLastOccluder(const ray<vec_T, time_T, dim> &rayToLight,
+			time_T tmax, int slot,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx) const {
+		const shape<vec_T, color_T, time_T, dim> *last =
+				ctx->getLastOccluder(slot);
+		if (last == 0)
+			return false;
+		time_T t = last->intersection(rayToLight);
+		bool hit = t != RAY_MISS && t > 0 && t < tmax;
+		ctx->countShadowCacheTest(hit);
+		if (hit)
+			RAYSTATS_ADD(shadowRays, 1);
+		return hit;
+	}
+
+	/**
+	 * Checks if the shadow ray towards a light is blocked. With a render
+	 * context and the shadow cache turned on, the shape that blocked the
+	 * previous shadow ray to the same light is tried first, since it very
+	 * often blocks this one too.
+	 *
+	 * @param rayToLight The shadow ray.
+	 * @param tmax Time at which the ray reaches the light.
+	 * @param slot Index of the light in @c lights .
+	 * @param ctx The calling thread's render context or 0.
+	 *
+	 * @return @c true if the light is blocked.
+	 */
+	bool inShadow(const ray<vec_T, time_T, dim> &rayToLight, time_T tmax,
+			int slot, rendercontext<vec_T, color_T, time_T, dim> *ctx) const {
+		if (usesShadowMap(slot)) {
+			RAYSTATS_ADD(shadowMapLookups, 1);
+			return shadowMaps[slot].isOccluded(rayToLight.getOrig(),
+					shadowMapBias);
+		}
+		if (ctx == 0 || !useShadowCache)
+			return isOccluded(rayToLight, tmax);
+		if (blockedByLastOccluder(rayToLight, tmax, slot, ctx))
+			return true;
+		const shape<vec_T, color_T, time_T, dim> *blocker =
+				findOccluder(rayToLight, tmax);
+		ctx->setLastOccluder(slot, blocker);
+		return blocker != 0;
+	}
+
+	/**
+	 * Tells if a shadow ray of a hit is blocked with @c inShadow , unless
+	 * the context knows from the other samples of the pixel, as
+	 * @c setPixelVisibility says; a hit that records what its pixel's rays
+	 * find records it.
+	 *
+	 * @param rayToLight The shadow ray.
+	 * @param tmax Time at which the ray reaches the light.
+	 * @param slot Index of the light in @c lights .
+	 * @param rec The hit being shaded.
+	 * @param ctx The calling thread's render context or 0.
+	 *
+	 * @return @c true if the light is blocked.
+	 */
+	bool pixelInShadow(const ray<vec_T, time_T, dim> &rayToLight,
+			time_T tmax, int slot,
+			const hitrecord<vec_T, color_T, time_T, dim> &rec,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx) const {
+		if (ctx == 0 || !pixelVisibility)
+			return inShadow(rayToLight, tmax, slot, ctx);
+		int known = ctx->getVisibility(&rec, slot);
+		if (known >= 0) {
+			ctx->countVisibilityReused();
+			return known == 1;
+		}
+		bool blocked = inShadow(rayToLight, tmax, slot, ctx);
+		ctx->recordVisibility(&rec, slot, blocked);
+		return blocked;
+	}
+
+	/**
+	 * Draws a random number for shading a hit, a @c samplerandom of the
+	 * pixel sample the context says is being shaded, the reflection depth
+	 * and the purpose, with the sampler's seed. Without one, as for
+	 * @c traceRay without a context, a hash of the hit point stands in for
+	 * the pixel.
+	 *
+	 * @param rec The hit.
+	 * @param depth Number of reflections followed up to the hit.
+	 * @param purpose What the number is for.
+	 * @param ctx The calling thread's render context or 0.
+	 *
+	 * @return The number, in [0, 1).
+	 */
+	double drawRandom(const hitrecord<vec_T, color_T, time_T, dim> &rec,
+			int depth, randomPurpose purpose,
+			const rendercontext<vec_T, color_T, time_T, dim> *ctx) const {
+		int x, y;
+		unsigned int k;
+		if (ctx == 0 || !ctx->getPixelSample(x, y, k)) {
+			x = (int) hashVector(rec.point);
+			y = -1;
+			k = 0;
+		}
+		return samplerandom(x, y, k, pixelSampler.getSeed()).get1D(
+				(unsigned int) depth, purpose);
+	}
+
+	/**
+	 * Decides if the reflection off a hit is followed; see
+	 * @c setReflectionLimits and @c setRussianRoulette .
+	 *
+	 * @param rec The hit.
+	 * @param weight The weight of the path up to the hit.
+	 * @param depth Number of reflections followed up to the hit.
+	 * @param ctx The calling thread's render context or 0, for
+	 *   @c drawRandom .
+	 * @param[out] nextWeight Receives the weight of the reflection.
+	 *
+	 * @return @c true if the reflection is followed.
+	 */
+	bool followReflection(const hitrecord<vec_T, color_T, time_T, dim> &rec,
+			color_T weight, int depth,
+			const rendercontext<vec_T, color_T, time_T, dim> *ctx,
+			color_T &nextWeight) const {
+		color_T refl = (color_T) surfaceReflectivity(rec.obj);
+		if (!(refl > 0) || depth >= maxReflectDepth)
+			return false;
+		nextWeight = weight * refl;
+		if (nextWeight < minThroughput)
+			return false;
+		if (rouletteDepth < 0 || depth < rouletteDepth || refl >= 1) {
+			RAYSTATS_ADD(reflectionRays, 1);
+			return true;
+		}
+		// Survive with probability refl and divide by it.
+		if (drawRandom(rec, depth, RANDOM_ROULETTE, ctx) >= refl)
+			return false;
+		nextWeight = weight;
+		RAYSTATS_ADD(reflectionRays, 1);
+		return true;
+	}
+
+	/**
+	 * Gets the shape a secondary ray leaving a hit can't hit again, for
+	 * @c ray::setExcluded : the sphere or plane hit, if the ray points out
+	 * of its surface.
+	 *
+	 * @param rec The hit.
+	 * @param dir Direction of the ray.
+	 *
+	 * @return The shape, or 0 if the ray has to be tested against it.
+	 */
+	const shape<vec_T, color_T, time_T, dim> * leftShape(
+			const hitrecord<vec_T, color_T, time_T, dim> &rec,
+			const mvector<vec_T, dim> &dir) const {
+		if (rec.id < 0 || rec.id >= (int) shapes.size() ||
+				(shapeKinds[rec.id] != SHAPE_SPHERE &&
+				shapeKinds[rec.id] != SHAPE_INFPLANE) ||
+				shapes[rec.id].get() != rec.obj || !(dir * rec.normal > 0))
+			return 0;
+		return shapes[rec.id].get();
+	}
+
+	/**
+	 * Works out the shadow ray of one light sample of a hit and how
+	 * squarely the light falls on the surface.
+	 *
+	 * @param s The sample, taken for @c rec.point .
+	 * @param rec The hit being shaded.
+	 * @param[out] rayToLight Receives the shadow ray, at the hit's time in
+	 *   the shutter interval.
+	 * @param[out] tmax Receives the time at which the shadow ray reaches the
+	 *   light.
+	 * @param[out] LdotN Receives the cosine of the angle between the light
+	 *   and the normal, which scales the color the sample adds.
+	 *
+	 * @return @c false if the sample is behind the surface, in which case it
+	 *   adds nothing.
+	 */
+	bool prepareShadowRay(const lightsample<vec_T, color_T, dim> &s,
+			const hitrecord<vec_T, color_T, time_T, dim> &rec,
+			ray<vec_T, time_T, dim> &rayToLight, time_T &tmax,
+			vec_T &LdotN) const {
+		const mvector<vec_T, dim> &N = rec.normal;
+		LdotN = s.dir * N;
+
+		// A light behind the surface adds nothing, so don't bother with its
+		// shadow ray.
+		if (LdotN <= 0) {
+			RAYSTATS_ADD(culledBackFacing, 1);
+			return false;
+		}
+
+		// A hack to make sure an object doesn't intersect itself...
+		// make the "to light" ray start a little outside an object itself
+		// by adding a tiny scalar multiple of a normal line to the
+		// starting point
+		mvector<vec_T, dim> intersectionPtWithDelta =
+				rec.point + N * (vec_T) DELTA;
+
+		// the ray to this light. if it hits anything before it reaches the
+		// light, the light is skipped (if shadows are on)
+		rayToLight = ray<vec_T, time_T, dim>(intersectionPtWithDelta, s.dir);
+		rayToLight.setShutter(rec.shutter);
+		rayToLight.setExcluded(leftShape(rec, s.dir));
+		tmax = (time_T) (s.pos - intersectionPtWithDelta).mag();
+		return true;
+	}
+
+	/**
+	 * Checks if a light sample could add less than a cutoff to every channel
+	 * of the color of a hit, even unblocked, so that its shadow ray isn't
+	 * worth tracing.
+	 *
+	 * @param s The sample, taken for @c rec.point .
+	 * @param rec The hit being shaded.
+	 * @param LdotN The cosine worked out by @c prepareShadowRay .
+	 * @param cutoff The smallest contribution worth a shadow ray.
+	 *
+	 * @return @c true if the sample should be dropped.
+	 */
+	bool belowCutoff(const lightsample<vec_T, color_T, dim> &s,
+			const hitrecord<vec_T, color_T, time_T, dim> &rec, vec_T LdotN,
+			color_T cutoff) const {
+		const rgbcolor<color_T> &c = surfaceColor(rec.obj);
+		color_T bound = std::max(s.color.getR() * c.getR(),
+				std::max(s.color.getG() * c.getG(), s.color.getB() * c.getB()))
+				* (color_T) LdotN;
+		if (!(bound < cutoff))
+			return false;
+		RAYSTATS_ADD(culledDim, 1);
+		return true;
+	}
+
+	/**
+	 * Adds the contribution of one light sample to the color of a hit, unless
+	 * the sample is behind the surface or, with shadows on, blocked or below
+	 * the cutoff.
+	 *
+	 * @param s The sample, taken for @c rec.point .
+	 * @param slot Shadow cache slot of the light.
+	 * @param rec The hit being shaded.
+	 * @param cutoff The light cutoff scaled for the weight of the path; see
+	 *   @c setLightCutoff .
+	 * @param ctx The calling thread's render context or 0.
+	 * @param[in,out] finalColor The color of the hit so far.
+	 * @param assume -1 to trace the shadow ray, or 0 or 1 to take the
+	 *   sample as blocked or not without it, as @c sampleAdaptive does.
+	 *
+	 * @tparam kernel_T The @c shadekernel shading.
+	 *
+	 * @return -1 if the sample was dropped before its shadow ray, 0 if it
+	 *   was blocked and 1 if it was added.
+	 */
+	template<typename kernel_T>
+	int addSample(const lightsample<vec_T, color_T, dim> &s, int slot,
+			const hitrecord<vec_T, color_T, time_T, dim> &rec,
+			color_T cutoff, rendercontext<vec_T, color_T, time_T, dim> *ctx,
+			rgbsum<color_T> &finalColor, int assume = -1) const {
+		if (!shapeprofile::isEnabled())
+			return addSampleTo<kernel_T>(s, slot, rec, cutoff, ctx,
+					finalColor, assume);
+		unsigned long long c0 = readCost(COST_CYCLES);
+		int v = addSampleTo<kernel_T>(s, slot, rec, cutoff, ctx, finalColor,
+				assume);
+		shapeprofile::local().countSample(slot, v,
+				readCost(COST_CYCLES) - c0);
+		return v;
+	}
+
+	/**
+	 * The work of @c addSample , which times it for @c shapeprofile .
+	 */
+	template<typename kernel_T>
+	int addSampleTo(const lightsample<vec_T, color_T, dim> &s, int slot,
+			const hitrecord<vec_T, color_T, time_T, dim> &rec,
+			color_T cutoff, rendercontext<vec_T, color_T, time_T, dim> *ctx,
+			rgbsum<color_T> &finalColor, int assume) const {
+		if (kernel_T::shadows && assume == 0) {
+			RAYSTATS_ADD(culledAdaptive, 1);
+			return 0;
+		}
+		ray<vec_T, time_T, dim> rayToLight;
+		time_T tmax;
+		vec_T LdotN;
+		if (!prepareShadowRay(s, rec, rayToLight, tmax, LdotN))
+			return -1;
+		if (kernel_T::shadows) {
+			if (belowCutoff(s, rec, LdotN, cutoff))
+				return -1;
+			if (assume == 1)
+				RAYSTATS_ADD(culledAdaptive, 1);
+			else if (pixelInShadow(rayToLight, tmax, slot, rec, ctx))
+				return 0;
+		}
+
+		// add in the color contribution of the light
+		finalColor.addProduct(s.color, surfaceColor(rec.obj), LdotN);
+		return 1;
+	}
+
+	/**
+	 * Sink for @c gatherLight that adds every sample to a color right away
+	 * with @c addSample .
+	 *
+	 * @tparam kernel_T The @c shadekernel shading.
+	 */
+	template<typename kernel_T>
+	struct directSink {
+		/** The kernel, for @c sampleLight . */
+		typedef kernel_T kernel;
+		/** The scene. */
+		const scene *sc;
+		/** The hit being shaded. */
+		const hitrecord<vec_T, color_T, time_T, dim> *rec;
+		/** The light cutoff divided by the weight of the path. */
+		color_T cutoff;
+		/** The calling thread's render context or 0. */
+		rendercontext<vec_T, color_T, time_T, dim> *ctx;
+		/** The color of the hit so far. */
+		rgbsum<color_T> *finalColor;
+
+		void operator()(const lightsample<vec_T, color_T, dim> &s,
+				int slot) const {
+			sc->template addSample<kernel_T>(s, slot, *rec, cutoff, ctx,
+					*finalColor);
+		}
+
+		/** Like @c operator() , with the @c assume of @c addSample . */
+		int shade(const lightsample<vec_T, color_T, dim> &s, int slot,
+				int assume) const {
+			return sc->template addSample<kernel_T>(s, slot, *rec, cutoff,
+					ctx, *finalColor, assume);
+		}
+	};
+
+	/**
+	 * Passes the samples of a sampled light to a sink that can only take
+	 * them one after the other, which is all but @c directSink .
+	 *
+	 * @return @c false , so that @c sampleLight does it.
+	 */
+	template<typename sink_T>
+	bool sampleAdaptive(const light<vec_T, color_T, time_T, dim> &l, int i,
+			int n, const hitrecord<vec_T, color_T, time_T, dim> &rec,
+			sink_T &sink) const {
+		return false;
+	}
+
+	/**
+	 * Picks the samples of @c sampleAdaptive whose shadow rays are traced
+	 * first. The samples of an area light are a scrambled Sobol sequence,
+	 * whose first @c m points are spread over the light as evenly as any
+	 * @c m of them, so those are the probes.
+	 *
+	 * @param j Index of the probe, less than @c m .
+	 * @param n Number of samples.
+	 * @param m Number of probes, less than @c n .
+	 *
+	 * @return Index of the sample, increasing with @c j .
+	 */
+	static int probeSample(int j, int n, int m) {
+		assert(j < m && m < n);
+		(void) n;
+		(void) m;
+		return j;
+	}
+
+	/**
+	 * Shades the @c n samples of a light, tracing the shadow rays of only
+	 * @c adaptiveShadowProbes of them, picked by @c probeSample , if they
+	 * agree. If all of those that face the surface are lit,
+	 * or all are blocked, the other samples are taken to be the same without
+	 * their shadow rays; otherwise the point is in a penumbra and all the
+	 * other shadow rays are traced too. Only the shadow rays are skipped:
+	 * lit samples still add their own color and cosine factor.
+	 *
+	 * @param l The light.
+	 * @param i Index of the light in @c lights , its shadow cache slot.
+	 * @param n Number of samples.
+	 * @param rec The hit being shaded.
+	 * @param sink The sink.
+	 *
+	 * @return @c false if adaptive sampling is off or @c n is too small
+	 *   for it, in which case nothing was done.
+	 */
+	template<typename kernel_T>
+	bool sampleAdaptive(const light<vec_T, color_T, time_T, dim> &l, int i,
+			int n, const hitrecord<vec_T, color_T, time_T, dim> &rec,
+			directSink<kernel_T> &sink) const {
+		int m = adaptiveShadowProbes;
+		if (!kernel_T::shadows || m <= 0 || n <= m)
+			return false;
+		lightsample<vec_T, color_T, dim> s;
+		int lit = 0, blocked = 0;
+		for (int j = 0; j < m; j++) {
+			if (!l.sample(rec.point, probeSample(j, n, m), n, s)) {
+				RAYSTATS_ADD(culledOutside, 1);
+				continue;
+			}
+			int v = sink.shade(s, i, -1);
+			lit += v == 1;
+			blocked += v == 0;
+		}
+		int assume = lit > 0 && blocked > 0 ? -1 : lit > 0 ? 1 :
+				blocked > 0 ? 0 : -1;
+		for (int k = 0, j = 0; k < n; k++) {
+			if (j < m && k == probeSample(j, n, m)) {
+				j++;
+				continue;
+			}
+			if (l.sample(rec.point, k, n, s))
+				sink.shade(s, i, assume);
+			else
+				RAYSTATS_ADD(culledOutside, 1);
+		}
+		return true;
+	}
+
+	/**
+	 * Passes every sample of the given light to a sink, or shades them with
+	 * @c sampleAdaptive if it can. All samples of a light share its shadow
+	 * cache slot.
+	 *
+	 * @param i Index of the light in @c lights .
+	 * @param rec The hit being shaded.
+	 * @param sink Functor called with each sample and its slot, whose
+	 *   @c kernel type is the @c shadekernel shading.
+	 */
+	template<typename sink_T>
+	void sampleLight(int i, const hitrecord<vec_T, color_T, time_T, dim> &rec,
+			sink_T &sink) const {
+		const light<vec_T, color_T, time_T, dim> &l = *lights[i];
+		int n = sink_T::kernel::sampledLights ?
+				l.getSampleCount(areaLightSamples) : 1;
+		if (n > 1 && sampleAdaptive(l, i, n, rec, sink))
+			return;
+		lightsample<vec_T, color_T, dim> s;
+		for (int k = 0; k < n; k++) {
+			if (l.sample(rec.point, k, n, s))
+				sink(s, i);
+			else
+				RAYSTATS_ADD(culledOutside, 1);
+		}
+	}
+
+	/**
+	 * Passes the samples of a run of lights to a sink, as @c sampleLight
+	 * does for each in turn. The point lights among them are worked out
+	 * from @c lightPack a lane group at a time, and those behind the surface
+	 * are dropped there, before any of their samples are made. If a light
+	 * has been edited since the pack was built, as between the passes of a
+	 * G-buffer, the lights are sampled one by one until @c finalize or
+	 * @c refit builds it again.
+	 *
+	 * @param begin Index of the first light in @c lights .
+	 * @param end One past the index of the last one.
+	 * @param rec The hit being shaded.
+	 * @param sink Functor called with each sample and its slot, as for
+	 *   @c sampleLight .
+	 */
+	template<typename sink_T>
+	void sampleLights(int begin, int end,
+			const hitrecord<vec_T, color_T, time_T, dim> &rec,
+			sink_T &sink) const {
+		if (!lightPackBuilt || lightPack.getPackedCount() == 0 ||
+				!lightPack.isCurrent()) {
+			for (int i = begin; i < end; i++)
+				sampleLight(i, rec, sink);
+			return;
+		}
+		typename lightpack<vec_T, color_T, time_T, dim>::group g;
+		lightsample<vec_T, color_T, dim> s;
+		simdLevel level = activeSimdLevel();
+		int width;
+		for (int i = begin; i < end; i += width) {
+			int mask = lightPack.facing(level, i, rec.point, rec.normal, g,
+					width);
+			for (int k = 0; k < width && i + k < end; k++, mask >>= 1) {
+				if (!lightPack.isPacked(i + k)) {
+					sampleLight(i + k, rec, sink);
+				}
+				else if (mask & 1) {
+					lightPack.getSample(i + k, g, k, s);
+					sink(s, i + k);
+				}
+				else {
+					RAYSTATS_ADD(culledBackFacing, 1);
+				}
+			}
+		}
+	}
+
+	/**
+	 * Passes the samples of the given lights to a sink with
+	 * @c sampleLights , a run of consecutive indices at a time.
+	 *
+	 * @param indices Sorted indices of the lights in @c lights .
+	 * @param rec The hit being shaded.
+	 * @param sink Functor called with each sample and its slot.
+	 */
+	template<typename sink_T>
+	void sampleLightList(const std::vector<int> &indices,
+			const hitrecord<vec_T, color_T, time_T, dim> &rec,
+			sink_T &sink) const {
+		for (size_t i = 0; i < indices.size(); ) {
+			size_t j = i + 1;
+			while (j < indices.size() && indices[j] == indices[j - 1] + 1)
+				j++;
+			sampleLights(indices[i], indices[j - 1] + 1, rec, sink);
+			i = j;
+		}
+	}
+
+	/**
+	 * Sink for @c gatherLight that keeps the samples in front of the surface
+	 * that could add something, with an estimate of how much, for
+	 * @c pickLights .
+	 *
+	 * @tparam sink_T The sink the picked samples go to.
+	 */
+	template<typename sink_T>
+	struct candidateSink {
+		/** The kernel of @c sink_T , for @c sampleLight . */
+		typedef typename sink_T::kernel kernel;
+		/** The scene. */
+		const scene *sc;
+		/** The hit being shaded. */
+		const hitrecord<vec_T, color_T, time_T, dim> *rec;
+		/** The candidates so far. */
+		std::vector<lightcandidate<vec_T, color_T, dim> > *candidates;
+
+		void operator()(const lightsample<vec_T, color_T, dim> &s,
+				int slot) {
+			vec_T LdotN = s.dir * rec->normal;
+			if (LdotN <= 0) {
+				RAYSTATS_ADD(culledBackFacing, 1);
+				return;
+			}
+			const rgbcolor<color_T> &c = sc->surfaceColor(rec->obj);
+			lightcandidate<vec_T, color_T, dim> k;
+			k.estimate = (s.color.getR() * c.getR() +
+					s.color.getG() * c.getG() + s.color.getB() * c.getB()) *
+					(color_T) LdotN;
+			if (!(k.estimate > 0))
+				return;
+			k.sample = s;
+			k.slot = slot;
+			candidates->push_back(k);
+		}
+	};
+
+	/**
+	 * Passes @c lightPicks of the given light samples to a sink, each picked
+	 * with a probability in proportion to its estimate, and scaled by one
+	 * over that probability so that the expected sum is the sum over all of
+	 * them. The picks are made by systematic sampling: @c lightPicks evenly
+	 * spaced points, shifted by a number of @c drawRandom , on the line the
+	 * estimates are laid out along. A sample picked more than once is passed
+	 * once with the weight of all its picks, and one whose estimate is at
+	 * least the spacing is always picked. With no more samples than picks,
+	 * all are passed unscaled.
+	 *
+	 * @param rec The hit being shaded.
+	 * @param depth Number of reflections followed up to the hit.
+	 * @param ctx The calling thread's render context or 0.
+	 * @param candidates The samples, as made by @c candidateSink .
+	 * @param sink The sink.
+	 */
+	template<typename sink_T>
+	void pickLights(const hitrecord<vec_T, color_T, time_T, dim> &rec,
+			int depth, const rendercontext<vec_T, color_T, time_T, dim> *ctx,
+			const std::vector<lightcandidate<vec_T, color_T, dim> >
+				&candidates, sink_T &sink) const {
+		if ((int) candidates.size() <= lightPicks) {
+			for (size_t i = 0; i < candidates.size(); i++)
+				sink(candidates[i].sample, candidates[i].slot);
+			return;
+		}
+		color_T total = 0;
+		for (size_t i = 0; i < candidates.size(); i++)
+			total += candidates[i].estimate;
+		color_T spacing = total / lightPicks;
+		color_T next = spacing * (color_T) drawRandom(rec, depth,
+				RANDOM_LIGHT_PICKS, ctx);
+		color_T end = 0;
+		lightsample<vec_T, color_T, dim> s;
+		for (size_t i = 0; i < candidates.size(); i++) {
+			end += candidates[i].estimate;
+			int picks = 0;
+			for (; next < end; next += spacing)
+				picks++;
+			if (picks == 0)
+				continue;
+			s = candidates[i].sample;
+			s.color *= picks * spacing / candidates[i].estimate;
+			sink(s, candidates[i].slot);
+		}
+	}
+
+	/**
+	 * Passes the samples of all lights that may light a hit to a sink, in
+	 * the order the lights were added so that sums over them come out the
+	 * same whichever lights are ruled out, or with @c setLightPicks only a
+	 * few of them picked by @c pickLights . With a light tree only the lights
+	 * it doesn't rule out are visited, followed by its clusters, which come
+	 * from its lightcut if @c setLightCutError asked for one.
+	 *
+	 * @param rec The hit being shaded.
+	 * @param depth Number of reflections followed up to the hit.
+	 * @param ctx The calling thread's render context or 0.
+	 * @param tileLights Sorted indices of the only lights to consider, or 0
+	 *   for all of them.
+	 * @param sink Functor called with each sample and its shadow cache slot.
+	 */
+	template<typename sink_T>
+	void gatherLight(const hitrecord<vec_T, color_T, time_T, dim> &rec,
+			int depth, rendercontext<vec_T, color_T, time_T, dim> *ctx,
+			const std::vector<int> *tileLights, sink_T &sink) const {
+		if (lightPicks > 0) {
+			std::vector<lightcandidate<vec_T, color_T, dim> > local;
+			candidateSink<sink_T> candidates;
+			candidates.sc = this;
+			candidates.rec = &rec;
+			candidates.candidates = ctx != 0 ? &ctx->getLightCandidates() :
+					&local;
+			candidates.candidates->clear();
+			gatherAllLight(rec, ctx, tileLights, candidates);
+			pickLights(rec, depth, ctx, *candidates.candidates, sink);
+		}
+		else {
+			gatherAllLight(rec, ctx, tileLights, sink);
+		}
+	}
+
+	/**
+	 * Passes the samples of all lights that may light a hit to a sink; see
+	 * @c gatherLight .
+	 *
+	 * @param rec The hit being shaded.
+	 * @param ctx The calling thread's render context or 0.
+	 * @param tileLights Sorted indices of the only lights to consider, or 0
+	 *   for all of them.
+	 * @param sink Functor called with each sample and its shadow cache slot.
+	 */
+	template<typename sink_T>
+	void gatherAllLight(const hitrecord<vec_T, color_T, time_T, dim> &rec,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx,
+			const std::vector<int> *tileLights, sink_T &sink) const {
+		if (lightTreeBuilt) {
+			std::vector<int> localLights, localClusters;
+			std::vector<int> &candidates = ctx != 0 ?
+					ctx->getCandidateLights() : localLights;
+			std::vector<int> &clusters = ctx != 0 ?
+					ctx->getCandidateClusters() : localClusters;
+			if (lightCutError > 0)
+				lightTree.cut(rec.point, rec.normal, lightCutError,
+						candidates, clusters);
+			else
+				lightTree.collect(rec.point, rec.normal, lightClusterRatio,
+						candidates, clusters);
+			bool all = (int) candidates.size() == lightTree.getLightCount();
+			if (all && tileLights != 0) {
+				candidates = *tileLights;
+				all = false;
+			}
+			else if (!all) {
+				std::sort(candidates.begin(), candidates.end());
+				if (tileLights != 0)
+					candidates.erase(std::set_intersection(
+							candidates.begin(), candidates.end(),
+							tileLights->begin(), tileLights->end(),
+							candidates.begin()), candidates.end());
+			}
+			if (all)
+				sampleLights(0, (int) candidates.size(), rec, sink);
+			else
+				sampleLightList(candidates, rec, sink);
+			lightsample<vec_T, color_T, dim> s;
+			for (size_t i = 0; i < clusters.size(); i++) {
+				s.pos = lightTree.getClusterPos(clusters[i]);
+				s.dir = s.pos - rec.point;
+				s.dist = s.dir.mag();
+				s.dir = s.dir.norm();
+				s.color = lightTree.getClusterColor(clusters[i]);
+				sink(s, lightTree.getClusterRep(clusters[i]));
+			}
+		}
+		else if (tileLights != 0) {
+			sampleLightList(*tileLights, rec, sink);
+		}
+		else {
+			sampleLights(0, (int) lights.size(), rec, sink);
+		}
+	}
+
+	/**
+	 * Sink for @c gatherLight that queues a shadow ray for every sample in
+	 * front of the surface and, with shadows on, not below the light cutoff,
+	 * for @c shadeWavefront .
+	 */
+	struct queueSink {
+		/** The kernel, for @c sampleLight ; shadows are tested later. */
+		typedef shadekernel<true, true, true> kernel;
+		/** The scene. */
+		const scene *sc;
+		/** The hit being shaded. */
+		const hitrecord<vec_T, color_T, time_T, dim> *rec;
+		/** Pixel of the path. */
+		int pixel;
+		/** Weight of the path. */
+		color_T weight;
+		/** The shadow queue. */
+		std::vector<shadowquery<vec_T, color_T, time_T, dim> > *queue;
+
+		void operator()(const lightsample<vec_T, color_T, dim> &s,
+				int slot) {
+			shadowquery<vec_T, color_T, time_T, dim> q;
+			vec_T LdotN;
+			if (!sc->prepareShadowRay(s, *rec, q.r, q.tmax, LdotN))
+				return;
+			if (sc->useShadows && sc->belowCutoff(s, *rec, LdotN,
+					sc->lightCutoff / weight))
+				return;
+			q.color = s.color * sc->surfaceColor(rec->obj) * LdotN;
+			q.color *= weight;
+			q.slot = slot;
+			q.pixel = pixel;
+			queue->push_back(q);
+		}
+	};
+
+	/**
+	 * Traces the queued shadow rays of a wavefront render and adds the color
+	 * of every one that isn't blocked to its pixel, then empties the queue.
+	 * With @c sortSecondaryRays the rays are traced in @c coherentOrder , and
+	 * with @c shadowPackets in packets by @c traceShadowPackets , but colors
+	 * are still added in queue order so that the sums don't change.
+	 *
+	 * @param[in,out] pool The calling thread's pool, whose shadow queue is
+	 *   traced.
+	 * @param[in,out] image The colors of the pixels.
+	 * @param ctx The calling thread's render context.
+	 */
+	void traceShadowQueue(wavefrontpool<vec_T, color_T, time_T, dim> &pool,
+			std::vector<rgbcolor<color_T> > &image,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx) const {
+		std::vector<shadowquery<vec_T, color_T, time_T, dim> > &queue =
+				pool.shadows;
+		pool.noteQueues();
+		if ((sortSecondaryRays || shadowPackets) && useShadows) {
+			std::vector<int> &order = pool.order;
+			std::vector<char> &blocked = pool.blocked;
+			blocked.assign(queue.size(), 0);
+			if (shadowPackets) {
+				traceShadowPackets(pool, ctx);
+			}
+			else {
+				coherentOrder(queue, order, pool.keys);
+				for (size_t i = 0; i < order.size(); i++) {
+					const shadowquery<vec_T, color_T, time_T, dim> &q =
+							queue[order[i]];
+					blocked[order[i]] = inShadow(q.r, q.tmax, q.slot, ctx);
+				}
+			}
+			for (size_t i = 0; i < queue.size(); i++)
+				if (!blocked[i])
+					image[queue[i].pixel] += queue[i].color;
+			queue.clear();
+			return;
+		}
+		for (size_t i = 0; i < queue.size(); i++) {
+			const shadowquery<vec_T, color_T, time_T, dim> &q = queue[i];
+			if (!useShadows || !inShadow(q.r, q.tmax, q.slot, ctx))
+				image[q.pixel] += q.color;
+		}
+		queue.clear();
+	}
+
+	/**
+	 * Finds which rays of the shadow queue of a wavefront render are
+	 * blocked, for @c traceShadowQueue , in packets. The rays are grouped
+	 * by light, keeping the queue order or with @c sortSecondaryRays the
+	 * @c coherentOrder within each light, and each light's rays are traced
+	 * @c RENDER_PACKET_WIDTH at a time with @c findOccluders . Shadow rays
+	 * of neighboring pixels toward a point light all end at the light, so
+	 * a packet of them stays together through the acceleration structure
+	 * far better than their origins suggest. Shadow maps and the shadow
+	 * cache are used ray by ray first, as by @c inShadow .
+	 *
+	 * @param[in,out] pool The calling thread's pool, whose @c blocked
+	 *   receives whether each queued ray is blocked.
+	 * @param ctx The calling thread's render context.
+	 */
+	void traceShadowPackets(wavefrontpool<vec_T, color_T, time_T, dim> &pool,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx) const {
+		const std::vector<shadowquery<vec_T, color_T, time_T, dim> > &queue =
+				pool.shadows;
+		std::vector<int> &order = pool.order;
+		std::vector<std::pair<unsigned long long, int> > &keys = pool.keys;
+		if (sortSecondaryRays) {
+			coherentOrder(queue, order, keys);
+		}
+		else {
+			order.resize(queue.size());
+			for (size_t i = 0; i < order.size(); i++)
+				order[i] = (int) i;
+		}
+		// Group by light with a counting sort, which keeps the order within
+		// each light and costs next to nothing next to a comparison sort
+		// of a full queue.
+		std::vector<int> &starts = pool.starts;
+		int slots = 0;
+		for (size_t i = 0; i < queue.size(); i++) {
+			assert(queue[i].slot >= 0);
+			slots = std::max(slots, queue[i].slot + 1);
+		}
+		starts.assign(slots + 1, 0);
+		for (size_t i = 0; i < queue.size(); i++)
+			starts[queue[i].slot + 1]++;
+		for (int s = 0; s < slots; s++)
+			starts[s + 1] += starts[s];
+		keys.resize(order.size());
+		for (size_t i = 0; i < order.size(); i++)
+			keys[starts[queue[order[i]].slot]++].second = order[i];
+
+		ray<vec_T, time_T, dim> rays[RENDER_PACKET_WIDTH];
+		time_T tmax[RENDER_PACKET_WIDTH];
+		int items[RENDER_PACKET_WIDTH];
+		int n = 0;
+		for (size_t i = 0; i < keys.size(); i++) {
+			int item = keys[i].second;
+			const shadowquery<vec_T, color_T, time_T, dim> &q = queue[item];
+			if (usesShadowMap(q.slot)) {
+				pool.blocked[item] = inShadow(q.r, q.tmax, q.slot, ctx);
+				continue;
+			}
+			if (ctx != 0 && useShadowCache &&
+					blockedByLastOccluder(q.r, q.tmax, q.slot, ctx)) {
+				pool.blocked[item] = 1;
+				continue;
+			}
+			if (n > 0 && queue[items[0]].slot != q.slot) {
+				traceShadowPacket(pool, rays, tmax, items, n, ctx);
+				n = 0;
+			}
+			rays[n] = q.r;
+			tmax[n] = q.tmax;
+			items[n++] = item;
+			if (n == RENDER_PACKET_WIDTH) {
+				traceShadowPacket(pool, rays, tmax, items, n, ctx);
+				n = 0;
+			}
+		}
+		if (n > 0)
+			traceShadowPacket(pool, rays, tmax, items, n, ctx);
+	}
+
+	/**
+	 * Traces a packet of shadow rays toward one light for
+	 * @c traceShadowPackets , and with the shadow cache on leaves the last
+	 * ray's blocker in it, as @c inShadow would.
+	 *
+	 * @param[in,out] pool The calling thread's pool, whose @c blocked
+	 *   receives whether each ray is blocked.
+	 * @param rays The rays.
+	 * @param tmax Time at which each ray reaches the light.
+	 * @param items Index of each ray in the shadow queue.
+	 * @param n Number of rays.
+	 * @param ctx The calling thread's render context.
+	 */
+	void traceShadowPacket(wavefrontpool<vec_T, color_T, time_T, dim> &pool,
+			const ray<vec_T, time_T, dim> *rays, const time_T *tmax,
+			const int *items, int n,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx) const {
+		const shape<vec_T, color_T, time_T, dim> *blockers[
+				RENDER_PACKET_WIDTH];
+		findOccluders(rays, n, tmax, blockers);
+		for (int k = 0; k < n; k++)
+			pool.blocked[items[k]] = blockers[k] != 0;
+		if (ctx != 0 && useShadowCache)
+			ctx->setLastOccluder(pool.shadows[items[0]].slot,
+					blockers[n - 1]);
+	}
+
+	/**
+	 * Shades one hit of a wavefront render: queues the shadow rays of its
+	 * lights and, if it's reflective, its reflection ray.
+	 *
+	 * @param r The ray that made the hit.
+	 * @param rec The hit, which may be a miss.
+	 * @param pixel Pixel of the path.
+	 * @param weight Weight of the path.
+	 * @param depth Reflection depth of @c r .
+	 * @param ctx The calling thread's render context.
+	 * @param tileLights Lights to consider as for @c shade , or 0.
+	 * @param[in,out] image The colors of the pixels.
+	 * @param[in,out] pool The calling thread's pool, whose shadow queue is
+	 *   traced when it gets full.
+	 * @param[in,out] reflections The queue of the next reflection depth, in
+	 *   @c pool .
+	 */
+	void shadeWavefrontHit(const ray<vec_T, time_T, dim> &r,
+			const hitrecord<vec_T, color_T, time_T, dim> &rec, int pixel,
+			color_T weight, int depth,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx,
+			const std::vector<int> *tileLights,
+			std::vector<rgbcolor<color_T> > &image,
+			wavefrontpool<vec_T, color_T, time_T, dim> &pool,
+			std::vector<wavefrontpath<vec_T, color_T, time_T, dim> >
+				&reflections) const {
+		std::vector<shadowquery<vec_T, color_T, time_T, dim> > &shadows =
+				pool.shadows;
+		if (rec.obj == 0) {
+			image[pixel] += DEFAULT_BKCOLOR * weight;
+			return;
+		}
+		queueSink sink;
+		sink.sc = this;
+		sink.rec = &rec;
+		sink.pixel = pixel;
+		sink.weight = weight;
+		sink.queue = &shadows;
+		if (shapeprofile::isEnabled()) {
+			unsigned long long c0 = readCost(COST_CYCLES);
+			gatherLight(rec, depth, ctx, tileLights, sink);
+			shapeprofile::local().countHit(rec.id,
+					readCost(COST_CYCLES) - c0);
+		}
+		else {
+			gatherLight(rec, depth, ctx, tileLights, sink);
+		}
+		if (shadows.size() >= WAVEFRONT_MAX_SHADOW_RAYS)
+			traceShadowQueue(pool, image, ctx);
+
+		wavefrontpath<vec_T, color_T, time_T, dim> p;
+		if (followReflection(rec, weight, depth, ctx, p.weight)) {
+			p.r = r.reflect(rec.point, rec.normal);
+			p.r.setExcluded(leftShape(rec, p.r.getDir()));
+			p.pixel = pixel;
+			p.depth = depth + 1;
+			reflections.push_back(p);
+		}
+	}
+
+	/**
+	 * Traces the camera rays of a band of @c RENDER_TILE_SIZE rows for
+	 * @c renderGBuffer .
+	 *
+	 * @param cam The camera.
+	 * @param band Index of the band, counting from the top.
+	 * @param gb The G-buffer, already sized for the image.
+	 */
+	void traceBand(const camera<vec_T, time_T, dim> &cam, int band,
+			gbuffer<vec_T, color_T, time_T, dim> &gb) const {
+		int width = gb.getWidth(), height = gb.getHeight();
+		int y0 = band * RENDER_TILE_SIZE;
+		int h = std::min(height - y0, RENDER_TILE_SIZE);
+		cam.getRaysForTile(0, y0, width, h, width, height,
+				&gb.getRay(y0 * width));
+		for (int y = y0; y < y0 + h; y++) {
+			for (int x0 = 0; x0 < width; x0 += RENDER_PACKET_WIDTH) {
+				int n = std::min(width - x0, RENDER_PACKET_WIDTH);
+				int k = y * width + x0;
+				unsigned long long c0 =
+						costTarget != 0 ? readCost(costKind) : 0;
+				findClosestHits(&gb.getRay(k), n, &gb.getHit(k));
+				if (costTarget != 0) {
+					double share = (double) (readCost(costKind) - c0) / n;
+					for (int i = 0; i < n; i++)
+						(*costTarget)[k + i] += share;
+				}
+			}
+		}
+	}
+
+	/**
+	 * Finds the closest hit of the camera ray of a pixel by testing it
+	 * against the candidates of the pixel in the given bins, for
+	 * @c rasterBand and @c renderBand .
+	 *
+	 * @param bins The shapes of this scene binned for the image.
+	 * @param x x coordinate of the pixel.
+	 * @param y y coordinate of the pixel.
+	 * @param r The camera ray of the pixel.
+	 * @param[out] rec Receives the closest hit.
+	 */
+	void rasterPixel(const primarybins<vec_T, time_T, dim> &bins, int x,
+			int y, const ray<vec_T, time_T, dim> &r,
+			hitrecord<vec_T, color_T, time_T, dim> &rec) const {
+		const std::vector<int> &everywhere = bins.getEverywhere();
+		const std::vector<int> &tile = bins.getTile(x, y);
+		time_T best = RAY_MISS;
+		int id = -1;
+		for (size_t i = 0; i < tile.size() + everywhere.size(); i++) {
+			int s = i < tile.size() ? tile[i] : everywhere[i - tile.size()];
+			if (i < tile.size() && !bins.covers(s, x, y))
+				continue;
+			time_T t = shapedispatch<vec_T, color_T, time_T, dim>::
+					intersection(shapeKinds[s], shapes[s].get(), r);
+			if (t != RAY_MISS && t > 0 && (id < 0 || t < best ||
+					(t == best && s < id))) {
+				best = t;
+				id = s;
+			}
+		}
+		RAYSTATS_ADD(closestRays, 1);
+		rec = hitrecord<vec_T, color_T, time_T, dim>();
+		if (id >= 0) {
+			RAYSTATS_ADD(hits, 1);
+			rec.t = best;
+			rec.id = id;
+			rec.shutter = r.getShutter();
+			shapes[id]->completeHit(r, rec);
+		}
+	}
+
+	/**
+	 * Finds the closest hits of the camera rays of one band of
+	 * @c RENDER_TILE_SIZE rows for @c renderGBuffer , like @c traceBand ,
+	 * but testing each ray only against the candidates of its pixel in the
+	 * given bins.
+	 *
+	 * @param cam The camera.
+	 * @param band Index of the band, counting from the top.
+	 * @param bins The shapes of this scene binned for the image.
+	 * @param[out] gb The G-buffer of the whole image, which receives the
+	 *   rays and hits of the band.
+	 */
+	void rasterBand(const camera<vec_T, time_T, dim> &cam, int band,
+			const primarybins<vec_T, time_T, dim> &bins,
+			gbuffer<vec_T, color_T, time_T, dim> &gb) const {
+		int width = gb.getWidth(), height = gb.getHeight();
+		int y0 = band * RENDER_TILE_SIZE;
+		int h = std::min(height - y0, RENDER_TILE_SIZE);
+		cam.getRaysForTile(0, y0, width, h, width, height,
+				&gb.getRay(y0 * width));
+		for (int y = y0; y < y0 + h; y++) {
+			for (int x = 0; x < width; x++) {
+				int k = y * width + x;
+				unsigned long long c0 =
+						costTarget != 0 ? readCost(costKind) : 0;
+				rasterPixel(bins, x, y, gb.getRay(k), gb.getHit(k));
+				if (costTarget != 0)
+					(*costTarget)[k] += (double) (readCost(costKind) - c0);
+			}
+		}
+	}
+
+	/**
+	 * Finds the closest hits of the camera rays of one band of
+	 * @c RENDER_TILE_SIZE rows for @c reprojectGBuffer : a pixel whose own
+	 * and four neighbors' candidates are the same shape is only intersected
+	 * with it, and the rest are traced like @c traceBand does.
+	 *
+	 * @param cam The camera.
+	 * @param band Index of the band, counting from the top.
+	 * @param candidates The shape projected into each pixel, or -1.
+	 * @param[out] gb The G-buffer of the whole image, which receives the
+	 *   rays and hits of the band.
+	 *
+	 * @return The number of pixels that weren't traced.
+	 */
+	int reprojectBand(const camera<vec_T, time_T, dim> &cam, int band,
+			const std::vector<int> &candidates,
+			gbuffer<vec_T, color_T, time_T, dim> &gb) const {
+		int width = gb.getWidth(), height = gb.getHeight();
+		int y0 = band * RENDER_TILE_SIZE;
+		int h = std::min(height - y0, RENDER_TILE_SIZE);
+		cam.getRaysForTile(0, y0, width, h, width, height,
+				&gb.getRay(y0 * width));
+		std::vector<int> traced;
+		int reused = 0;
+		for (int y = y0; y < y0 + h; y++) {
+			for (int x = 0; x < width; x++) {
+				int k = y * width + x;
+				int s = candidates[k];
+				if (s < 0 || x == 0 || y == 0 || x == width - 1 ||
+						y == height - 1 || candidates[k - 1] != s ||
+						candidates[k + 1] != s ||
+						candidates[k - width] != s ||
+						candidates[k + width] != s) {
+					traced.push_back(k);
+					continue;
+				}
+				const ray<vec_T, time_T, dim> &r = gb.getRay(k);
+				time_T t = shapedispatch<vec_T, color_T, time_T, dim>::
+						intersection(shapeKinds[s], shapes[s].get(), r);
+				if (t == RAY_MISS || !(t > 0)) {
+					traced.push_back(k);
+					continue;
+				}
+				RAYSTATS_ADD(closestRays, 1);
+				RAYSTATS_ADD(hits, 1);
+				hitrecord<vec_T, color_T, time_T, dim> &rec = gb.getHit(k);
+				rec = hitrecord<vec_T, color_T, time_T, dim>();
+				rec.t = t;
+				rec.id = s;
+				rec.shutter = r.getShutter();
+				shapes[s]->completeHit(r, rec);
+				reused++;
+			}
+		}
+		ray<vec_T, time_T, dim> rays[RENDER_PACKET_WIDTH];
+		hitrecord<vec_T, color_T, time_T, dim> recs[RENDER_PACKET_WIDTH];
+		for (size_t i = 0; i < traced.size(); i += RENDER_PACKET_WIDTH) {
+			int n = (int) std::min(traced.size() - i,
+					(size_t) RENDER_PACKET_WIDTH);
+			for (int j = 0; j < n; j++)
+				rays[j] = gb.getRay(traced[i + j]);
+			findClosestHits(rays, n, recs);
+			for (int j = 0; j < n; j++)
+				gb.getHit(traced[i + j]) = recs[j];
+		}
+		return reused;
+	}
+
+	/**
+	 * Shades one screen tile for @c shadeTiles .
+	 *
+	 * @param gb The G-buffer.
+	 * @param x0 x coordinate of the top left pixel of the tile.
+	 * @param y0 y coordinate of the top left pixel of the tile.
+	 * @param[out] tile Receives the place and colors of the tile.
+	 * @param ctx The calling thread's render context.
+	 * @param firstRow Row of the image the G-buffer's first row is, so
+	 *   pixel samples, and the random choices keyed by them, are those of
+	 *   the whole image.
+	 */
+	void shadeTile(const gbuffer<vec_T, color_T, time_T, dim> &gb,
+			int x0, int y0, tilebuffer<color_T> &tile,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx,
+			int firstRow = 0) const {
+		int width = gb.getWidth();
+		int tw = std::min(width - x0, RENDER_TILE_SIZE);
+		int th = std::min(gb.getHeight() - y0, RENDER_TILE_SIZE);
+		tile.place(x0, y0, tw, th);
+		std::vector<int> &tileLights = ctx->getTileLights();
+		std::vector<std::pair<int, int> > &batch = ctx->getTileBatch();
+
+		// Bound what the tile sees and sort its pixels by shape.
+		aabb<vec_T, dim> box;
+		batch.clear();
+		for (int ty = 0; ty < th; ty++) {
+			for (int tx = 0; tx < tw; tx++) {
+				int k = (y0 + ty) * width + x0 + tx;
+				const hitrecord<vec_T, color_T, time_T, dim> &rec =
+						gb.getHit(k);
+				if (rec.obj != 0)
+					box.extend(rec.point);
+				batch.push_back(std::make_pair(rec.id, k));
+			}
+		}
+		std::sort(batch.begin(), batch.end());
+		findTileLights(box, tileLights);
+		ctx->countTileLights((int) tileLights.size(), (int) lights.size());
+
+		for (size_t i = 0; i < batch.size(); i++) {
+			int k = batch[i].second;
+			unsigned long long c0 = costTarget != 0 ? readCost(costKind) : 0;
+			ctx->setPixelSample(k % width, firstRow + k / width, 0);
+			tile.pixels[(k / width - y0) * tw + k % width - x0] =
+					shade(gb.getRay(k), gb.getHit(k), 0, ctx, &tileLights);
+			if (costTarget != 0)
+				(*costTarget)[firstRow * width + k] +=
+						(double) (readCost(costKind) - c0);
+		}
+	}
+
+	/**
+	 * Traces and shades a band of @c RENDER_TILE_SIZE rows on its own for
+	 * @c renderStreaming , with a G-buffer of just the band. Tiles are
+	 * shaded as by @c shadeTiles , so the colors are the same.
+	 *
+	 * @param cam The camera.
+	 * @param band Index of the band, counting from the top.
+	 * @param width Width of the image in pixels.
+	 * @param height Height of the image in pixels.
+	 * @param gb Scratch G-buffer of the calling thread.
+	 * @param tile Scratch tile of the calling thread.
+	 * @param[out] out Receives the place and colors of the band.
+	 * @param ctx The calling thread's render context.
+	 * @param bins The shapes binned for the rows of the band, to rasterize
+	 *   its camera rays with as @c rasterBand does; 0 to trace them.
+	 */
+	void renderBand(const camera<vec_T, time_T, dim> &cam, int band,
+			int width, int height, gbuffer<vec_T, color_T, time_T, dim> &gb,
+			tilebuffer<color_T> &tile, tilebuffer<color_T> &out,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx,
+			const primarybins<vec_T, time_T, dim> *bins = 0) const {
+		int y0 = band * RENDER_TILE_SIZE;
+		int h = std::min(height - y0, RENDER_TILE_SIZE);
+		if (gb.getWidth() != width || gb.getHeight() != h)
+			gb.resize(width, h);
+		cam.getRaysForTile(0, y0, width, h, width, height, &gb.getRay(0));
+		if (bins != 0) {
+			for (int k = 0; k < width * h; k++)
+				rasterPixel(*bins, k % width, y0 + k / width, gb.getRay(k),
+						gb.getHit(k));
+		}
+		else {
+			for (int k = 0; k < width * h; k += RENDER_PACKET_WIDTH)
+				findClosestHits(&gb.getRay(k), std::min(width * h - k,
+						RENDER_PACKET_WIDTH), &gb.getHit(k));
+		}
+		out.place(0, 0, width, h);
+		for (int x0 = 0; x0 < width; x0 += RENDER_TILE_SIZE) {
+			shadeTile(gb, x0, 0, tile, ctx, y0);
+			tile.copyTo(out.pixels, width);
+		}
+		out.y0 = y0;
+	}
+
+	/**
+	 * Shades a band of @c RENDER_TILE_SIZE rows for @c shadeWavefront ,
+	 * camera hits first and then one reflection depth at a time.
+	 *
+	 * @param gb The G-buffer.
+	 * @param band Index of the band, counting from the top.
+	 * @param[out] image Receives the colors of the band's pixels, which
+	 *   must start out black.
+	 * @param ctx The calling thread's render context.
+	 * @param pool The calling thread's queues, which must be empty.
+	 */
+	void shadeWavefrontBand(const gbuffer<vec_T, color_T, time_T, dim> &gb,
+			int band, std::vector<rgbcolor<color_T> > &image,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx,
+			wavefrontpool<vec_T, color_T, time_T, dim> &pool) const {
+		const int T = RENDER_TILE_SIZE;
+		int width = gb.getWidth();
+		int y0 = band * T;
+		int th = std::min(gb.getHeight() - y0, T);
+		std::vector<int> &tileLights = ctx->getTileLights();
+		std::vector<wavefrontpath<vec_T, color_T, time_T, dim> > &paths =
+				pool.paths, &next = pool.next;
+		std::vector<ray<vec_T, time_T, dim> > &rays = pool.rays;
+		std::vector<hitrecord<vec_T, color_T, time_T, dim> > &recs =
+				pool.recs;
+		std::vector<int> &order = pool.order;
+		pool.beginBand();
+
+		// Camera hits, tile by tile.
+		for (int x0 = 0; x0 < width; x0 += T) {
+			int tw = std::min(width - x0, T);
+			aabb<vec_T, dim> box;
+			for (int ty = 0; ty < th; ty++) {
+				for (int tx = 0; tx < tw; tx++) {
+					const hitrecord<vec_T, color_T, time_T, dim> &rec =
+							gb.getHit((y0 + ty) * width + x0 + tx);
+					if (rec.obj != 0)
+						box.extend(rec.point);
+				}
+			}
+			findTileLights(box, tileLights);
+			ctx->countTileLights((int) tileLights.size(),
+					(int) lights.size());
+			for (int ty = 0; ty < th; ty++) {
+				for (int tx = 0; tx < tw; tx++) {
+					int k = (y0 + ty) * width + x0 + tx;
+					ctx->setPixelSample(x0 + tx, y0 + ty, 0);
+					shadeWavefrontHit(gb.getRay(k), gb.getHit(k), k, 1, 0,
+							ctx, &tileLights, image, pool, paths);
+				}
+			}
+		}
+		traceShadowQueue(pool, image, ctx);
+
+		// Reflections, one depth at a time. Every pixel has at most one
+		// path per depth, so sorting them doesn't change any sums.
+		while (!paths.empty()) {
+			pool.noteQueues();
+			if (sortSecondaryRays) {
+				coherentOrder(paths, order, pool.keys);
+				next.resize(paths.size());
+				for (size_t i = 0; i < order.size(); i++)
+					next[i] = paths[order[i]];
+				paths.swap(next);
+			}
+			int n = (int) paths.size();
+			rays.resize(n);
+			recs.resize(n);
+			for (int i = 0; i < n; i++)
+				rays[i] = paths[i].r;
+			findClosestHits(&rays[0], n, &recs[0], pool.ids, pool.times);
+			next.clear();
+			for (int i = 0; i < n; i++) {
+				ctx->setPixelSample(paths[i].pixel % width,
+						paths[i].pixel / width, 0);
+				shadeWavefrontHit(paths[i].r, recs[i], paths[i].pixel,
+						paths[i].weight, paths[i].depth, ctx, 0, image,
+						pool, next);
+			}
+			traceShadowQueue(pool, image, ctx);
+			paths.swap(next);
+		}
+		pool.endBand();
+	}
+
+	/**
+	 * Task of @c renderGBuffer for @c parallelTasks : traces one band.
+	 */
+	struct bandTracer {
+		/** The scene. */
+		const scene *sc;
+		/** The camera. */
+		const camera<vec_T, time_T, dim> *cam;
+		/** The G-buffer. */
+		gbuffer<vec_T, color_T, time_T, dim> *gb;
+
+		void operator()(int band, int thread) const {
+			sc->traceBand(*cam, band, *gb);
+		}
+	};
+
+	/**
+	 * Task of @c renderGBuffer for @c parallelTasks : rasterizes one band.
+	 */
+	struct bandRasterizer {
+		/** The scene. */
+		const scene *sc;
+		/** The camera. */
+		const camera<vec_T, time_T, dim> *cam;
+		/** The shapes binned for the image. */
+		const primarybins<vec_T, time_T, dim> *bins;
+		/** The G-buffer. */
+		gbuffer<vec_T, color_T, time_T, dim> *gb;
+
+		void operator()(int band, int thread) const {
+			sc->rasterBand(*cam, band, *bins, *gb);
+		}
+	};
+
+	/**
+	 * Task of @c reprojectGBuffer for @c parallelTasks : finds the hits of
+	 * one band.
+	 */
+	struct bandReprojector {
+		/** The scene. */
+		const scene *sc;
+		/** The camera. */
+		const camera<vec_T, time_T, dim> *cam;
+		/** The shape projected into each pixel, or -1. */
+		const std::vector<int> *candidates;
+		/** The G-buffer. */
+		gbuffer<vec_T, color_T, time_T, dim> *gb;
+		/** Receives the number of pixels of each band that weren't traced. */
+		std::vector<int> *reused;
+
+		void operator()(int band, int thread) const {
+			(*reused)[band] = sc->reprojectBand(*cam, band, *candidates, *gb);
+		}
+	};
+
+	/**
+	 * Task of @c shadeTiles and @c shadeWavefront for @c parallelTasks :
+	 * shades one tile and publishes it, or with @c wavefront shades one
+	 * band right into the image.
+	 */
+	struct tileShader {
+		/** The scene. */
+		const scene *sc;
+		/** The G-buffer. */
+		const gbuffer<vec_T, color_T, time_T, dim> *gb;
+		/** The image, for bands. */
+		std::vector<rgbcolor<color_T> > *image;
+		/** The queue finished tiles go to. */
+		tilequeue<color_T> *queue;
+		/** The render context of each thread. */
+		rendercontext<vec_T, color_T, time_T, dim> **ctxs;
+		/** Number of tiles per row of the image. */
+		int tilesPerRow;
+		/** Whether to shade bands with @c shadeWavefrontBand . */
+		bool wavefront;
+		/** The wavefront pool of each thread, for bands. */
+		wavefrontpool<vec_T, color_T, time_T, dim> *pools;
+
+		void operator()(int i, int thread) const {
+			if (wavefront) {
+				sc->shadeWavefrontBand(*gb, i, *image, ctxs[thread],
+						pools[thread]);
+				return;
+			}
+			sc->shadeTile(*gb, i % tilesPerRow * RENDER_TILE_SIZE,
+					i / tilesPerRow * RENDER_TILE_SIZE, queue->getTile(i),
+					ctxs[thread]);
+			queue->publish(i);
+		}
+	};
+
+	/**
+	 * Traces one row of samples of a pass of @c renderProgressive : one
+	 * camera ray for the top left pixel of each block of the row, except
+	 * for those a coarser pass traced already, whose color is kept. Every
+	 * block is then filled with the color of its top left pixel.
+	 *
+	 * @param cam The camera.
+	 * @param y Row of the samples.
+	 * @param block Size of the blocks of this pass in pixels.
+	 * @param first Whether this is the first pass.
+	 * @param[in,out] image The image, row by row, which is already sized.
+	 * @param width Width of the image in pixels.
+	 * @param height Height of the image in pixels.
+	 * @param ctx The calling thread's render context.
+	 */
+	void traceProgressiveRow(const camera<vec_T, time_T, dim> &cam, int y,
+			int block, bool first, std::vector<rgbcolor<color_T> > &image,
+			int width, int height,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx) const {
+		std::vector<ray<vec_T, time_T, dim> > rays;
+		std::vector<hitrecord<vec_T, color_T, time_T, dim> > recs;
+		std::vector<int> xs;
+		for (int x = 0; x < width; x += block) {
+			if (first || x % (2 * block) != 0 || y % (2 * block) != 0) {
+				xs.push_back(x);
+				rays.push_back(cam.getRayForPixel(x, y, width, height));
+			}
+		}
+		int n = (int) rays.size();
+		recs.resize(n);
+		for (int i = 0; i < n; i += RENDER_PACKET_WIDTH)
+			findClosestHits(&rays[i], std::min(n - i, RENDER_PACKET_WIDTH),
+					&recs[i]);
+		for (int i = 0; i < n; i++) {
+			ctx->setPixelSample(xs[i], y, 0);
+			image[y * width + xs[i]] = shade(rays[i], recs[i], 0, ctx);
+		}
+
+		int h = std::min(block, height - y);
+		for (int x = 0; x < width; x += block) {
+			rgbcolor<color_T> c = image[y * width + x];
+			int w = std::min(block, width - x);
+			for (int dy = 0; dy < h; dy++)
+				for (int dx = 0; dx < w; dx++)
+					image[(y + dy) * width + x + dx] = c;
+		}
+	}
+
+	/**
+	 * Task of @c renderProgressive for @c parallelTasks : traces one row of
+	 * samples of a pass.
+	 */
+	struct progressiveRow {
+		/** The scene. */
+		const scene *sc;
+		/** The camera. */
+		const camera<vec_T, time_T, dim> *cam;
+		/** The image. */
+		std::vector<rgbcolor<color_T> > *image;
+		/** Width of the image in pixels. */
+		int width;
+		/** Height of the image in pixels. */
+		int height;
+		/** Size of the blocks of the pass in pixels. */
+		int block;
+		/** Whether this is the first pass. */
+		bool first;
+		/** The render context of each thread. */
+		rendercontext<vec_T, color_T, time_T, dim> **ctxs;
+		/** Set to skip the rows left, or 0. */
+		const boost::atomic<bool> *cancel;
+
+		void operator()(int row, int thread) const {
+			if (cancel != 0 && cancel->load(boost::memory_order_relaxed))
+				return;
+			sc->traceProgressiveRow(*cam, row * block, block, first, *image,
+					width, height, ctxs[thread]);
+		}
+	};
+
+	/**
+	 * Tells if a pixel of a one sample per pixel render needs more samples
+	 * for @c supersample : if one of its four neighbors sees another shape
+	 * or differs in a color channel by more than @c aaThreshold .
+	 *
+	 * @param gb The G-buffer of the render.
+	 * @param image The colors of the render.
+	 * @param x x coordinate of the pixel.
+	 * @param y y coordinate of the pixel.
+	 *
+	 * @return Whether the pixel is on an edge.
+	 */
+	bool isEdgePixel(const gbuffer<vec_T, color_T, time_T, dim> &gb,
+			const std::vector<rgbcolor<color_T> > &image, int x, int y) const {
+		static const int dx[] = { -1, 1, 0, 0 }, dy[] = { 0, 0, -1, 1 };
+		int width = gb.getWidth(), height = gb.getHeight();
+		int k = y * width + x;
+		for (int i = 0; i < 4; i++) {
+			int nx = x + dx[i], ny = y + dy[i];
+			if (nx < 0 || ny < 0 || nx >= width || ny >= height)
+				continue;
+			int kn = ny * width + nx;
+			if (gb.getHit(k).id != gb.getHit(kn).id)
+				return true;
+			rgbcolor<color_T> d = image[k] - image[kn];
+			if (std::abs(d.getR()) > aaThreshold ||
+					std::abs(d.getG()) > aaThreshold ||
+					std::abs(d.getB()) > aaThreshold)
+				return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Refines the edge pixels of a band of @c RENDER_TILE_SIZE rows for
+	 * @c supersample .
+	 *
+	 * @param cam The camera of the render.
+	 * @param gb The G-buffer of the render.
+	 * @param base The colors of the render at one sample per pixel.
+	 * @param band Index of the band, counting from the top.
+	 * @param[out] image Receives the refined colors of the band.
+	 * @param ctx The calling thread's render context.
+	 */
+	void supersampleBand(const camera<vec_T, time_T, dim> &cam,
+			const gbuffer<vec_T, color_T, time_T, dim> &gb,
+			const std::vector<rgbcolor<color_T> > &base, int band,
+			std::vector<rgbcolor<color_T> > &image,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx) const {
+		int width = gb.getWidth(), height = gb.getHeight();
+		int y0 = band * RENDER_TILE_SIZE;
+		int y1 = std::min(height, y0 + RENDER_TILE_SIZE);
+		std::vector<ray<vec_T, time_T, dim> > rays;
+		std::vector<hitrecord<vec_T, color_T, time_T, dim> > recs;
+		for (int y = y0; y < y1; y++) {
+			for (int x = 0; x < width; x++) {
+				if (!isEdgePixel(gb, base, x, y))
+					continue;
+				unsigned long long c0 =
+						costTarget != 0 ? readCost(costKind) : 0;
+				image[y * width + x] = samplePixel(cam, x, y, width, height,
+						aaSamples, false, rays, recs, ctx);
+				if (costTarget != 0)
+					(*costTarget)[y * width + x] +=
+							(double) (readCost(costKind) - c0);
+				ctx->countSupersampled();
+			}
+		}
+	}
+
+	/**
+	 * Works out the color of a pixel as the average of @c n * @c n samples
+	 * over it. The samples are at the centers of the cells of an @c n by
+	 * @c n grid, or with @c jitter where @c setSampler 's sampler puts them
+	 * for the pixel and the index of the sample, so renders are repeatable.
+	 * They're traced through the acceleration structure together, since no
+	 * rays of an image are closer to each other. Jittered samples are also
+	 * spread over the shutter interval by the sampler's next dimension, so
+	 * shapes that move while the shutter is open are blurred along their
+	 * paths; without @c jitter every sample is at the start of the
+	 * interval, as the rays of the G-buffer are. With
+	 * @c setPixelVisibility , the samples of a pixel that all hit one
+	 * shape reuse the shadow rays of its corner samples.
+	 *
+	 * @param cam The camera.
+	 * @param x x coordinate of the pixel.
+	 * @param y y coordinate of the pixel.
+	 * @param width Width of the image in pixels.
+	 * @param height Height of the image in pixels.
+	 * @param n Samples per axis.
+	 * @param jitter Whether to jitter the samples within their cells.
+	 * @param rays Scratch space for the rays.
+	 * @param recs Scratch space for their hits.
+	 * @param ctx The calling thread's render context.
+	 *
+	 * @return The color.
+	 */
+	rgbcolor<color_T> samplePixel(const camera<vec_T, time_T, dim> &cam,
+			int x, int y, int width, int height, int n, bool jitter,
+			std::vector<ray<vec_T, time_T, dim> > &rays,
+			std::vector<hitrecord<vec_T, color_T, time_T, dim> > &recs,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx) const {
+		rays.resize(n * n);
+		recs.resize(n * n);
+		for (int j = 0; j < n; j++) {
+			for (int i = 0; i < n; i++) {
+				unsigned int k = (unsigned int) (j * n + i);
+				double u = ((double) i + 0.5) / n, v = ((double) j + 0.5) / n;
+				float shutter = 0;
+				if (jitter) {
+					double t, unused;
+					pixelSampler.get2D(x, y, k, 0, u, v);
+					pixelSampler.get2D(x, y, k, 1, t, unused);
+					shutter = (float) t;
+				}
+				ray<vec_T, time_T, dim> &r = rays[k];
+				r = cam.getRayForPoint(x + (vec_T) u - (vec_T) 0.5,
+						y + (vec_T) v - (vec_T) 0.5, width, height);
+				r.setShutter(shutter);
+			}
+		}
+		findClosestHits(&rays[0], n * n, &recs[0]);
+		rgbcolor<color_T> sum;
+		bool reuse = pixelVisibility && useShadows && n > 2;
+		for (int i = 1; reuse && i < n * n; i++)
+			reuse = recs[i].obj != 0 && recs[i].id == recs[0].id;
+		if (!reuse) {
+			for (int i = 0; i < n * n; i++) {
+				ctx->setPixelSample(x, y, (unsigned int) i);
+				sum += shade(rays[i], recs[i], 0, ctx);
+			}
+			sum /= (color_T) (n * n);
+			return sum;
+		}
+
+		// The corners first, whose shadow rays the others reuse.
+		ctx->beginPixelVisibility();
+		for (int pass = 0; pass < 2; pass++) {
+			for (int i = 0; i < n * n; i++) {
+				int col = i % n, row = i / n;
+				bool corner = (col == 0 || col == n - 1) &&
+						(row == 0 || row == n - 1);
+				if (corner != (pass == 0))
+					continue;
+				ctx->setVisibilityHit(&recs[i], corner);
+				ctx->setPixelSample(x, y, (unsigned int) i);
+				sum += shade(rays[i], recs[i], 0, ctx);
+			}
+		}
+		ctx->setVisibilityHit(0, false);
+		sum /= (color_T) (n * n);
+		return sum;
+	}
+
+	/**
+	 * Renders a band of @c RENDER_TILE_SIZE rows for
+	 * @c renderMultisampled .
+	 *
+	 * @param cam The camera.
+	 * @param band Index of the band, counting from the top.
+	 * @param[out] image Receives the colors of the band, in an image of
+	 *   the right size.
+	 * @param width Width of the image in pixels.
+	 * @param height Height of the image in pixels.
+	 * @param ctx The calling thread's render context.
+	 */
+	void multisampleBand(const camera<vec_T, time_T, dim> &cam, int band,
+			std::vector<rgbcolor<color_T> > &image, int width, int height,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx) const {
+		int y0 = band * RENDER_TILE_SIZE;
+		int y1 = std::min(height, y0 + RENDER_TILE_SIZE);
+		std::vector<ray<vec_T, time_T, dim> > rays;
+		std::vector<hitrecord<vec_T, color_T, time_T, dim> > recs;
+		for (int y = y0; y < y1; y++) {
+			for (int x = 0; x < width; x++) {
+				unsigned long long c0 =
+						costTarget != 0 ? readCost(costKind) : 0;
+				image[y * width + x] = samplePixel(cam, x, y, width, height,
+						pixelSamples, true, rays, recs, ctx);
+				if (costTarget != 0)
+					(*costTarget)[y * width + x] +=
+							(double) (readCost(costKind) - c0);
+			}
+		}
+	}
+
+	/**
+	 * Renders a rectangle of an image for @c renderTiles and
+	 * @c renderCrop , the same way @c renderImage renders it as part of the
+	 * whole image. With anti-aliasing the camera rays of a one pixel border
+	 * around the rectangle are traced and shaded as well, so edges are
+	 * found against the same neighbors.
+	 *
+	 * @param cam The camera.
+	 * @param x0 Left column of the rectangle.
+	 * @param y0 Top row of the rectangle.
+	 * @param x1 Column just right of the rectangle.
+	 * @param y1 Row just below the rectangle.
+	 * @param width Width of the image in pixels.
+	 * @param height Height of the image in pixels.
+	 * @param[out] out Receives the colors of the rectangle, starting with
+	 *   pixel @c (x0, y0) .
+	 * @param stride Distance between the rows of @c out .
+	 * @param ctx The calling thread's render context.
+	 * @param samples Samples per pixel along each axis, or 0 for those of
+	 *   @c setPixelSamples .
+	 */
+	void renderRect(const camera<vec_T, time_T, dim> &cam, int x0, int y0,
+			int x1, int y1, int width, int height, rgbcolor<color_T> *out,
+			int stride, rendercontext<vec_T, color_T, time_T, dim> *ctx,
+			int samples = 0) const {
+		std::vector<ray<vec_T, time_T, dim> > rays;
+		std::vector<hitrecord<vec_T, color_T, time_T, dim> > recs;
+		if (samples <= 0)
+			samples = pixelSamples;
+		if (samples > 1) {
+			for (int y = y0; y < y1; y++)
+				for (int x = x0; x < x1; x++)
+					out[(y - y0) * stride + x - x0] = samplePixel(cam, x, y,
+							width, height, samples, true, rays, recs, ctx);
+			return;
+		}
+
+		int border = aaSamples > 1 ? 1 : 0;
+		int gx0 = std::max(0, x0 - border), gy0 = std::max(0, y0 - border);
+		int gw = std::min(width, x1 + border) - gx0;
+		int gh = std::min(height, y1 + border) - gy0;
+		gbuffer<vec_T, color_T, time_T, dim> gb;
+		gb.resize(gw, gh);
+		cam.getRaysForTile(gx0, gy0, gw, gh, width, height, &gb.getRay(0));
+		for (int y = 0; y < gh; y++) {
+			for (int x = 0; x < gw; x += RENDER_PACKET_WIDTH) {
+				int k = y * gw + x;
+				findClosestHits(&gb.getRay(k),
+						std::min(gw - x, RENDER_PACKET_WIDTH), &gb.getHit(k));
+			}
+		}
+		std::vector<rgbcolor<color_T> > base((size_t) gw * gh);
+		for (int k = 0; k < gw * gh; k++) {
+			ctx->setPixelSample(gx0 + k % gw, gy0 + k / gw, 0);
+			base[k] = shade(gb.getRay(k), gb.getHit(k), 0, ctx);
+		}
+		for (int y = y0; y < y1; y++) {
+			for (int x = x0; x < x1; x++) {
+				rgbcolor<color_T> &pixel = out[(y - y0) * stride + x - x0];
+				pixel = base[(y - gy0) * gw + x - gx0];
+				if (border == 0 || !isEdgePixel(gb, base, x - gx0, y - gy0))
+					continue;
+				pixel = samplePixel(cam, x, y, width, height, aaSamples, false,
+						rays, recs, ctx);
+				ctx->countSupersampled();
+			}
+		}
+	}
+
+	/**
+	 * Task of @c renderMultisampled for @c parallelTasks : renders one
+	 * band.
+	 */
+	struct bandMultisampler {
+		/** The scene. */
+		const scene *sc;
+		/** The camera. */
+		const camera<vec_T, time_T, dim> *cam;
+		/** The image. */
+		std::vector<rgbcolor<color_T> > *image;
+		/** Width of the image in pixels. */
+		int width;
+		/** Height of the image in pixels. */
+		int height;
+		/** The render context of each thread. */
+		rendercontext<vec_T, color_T, time_T, dim> **ctxs;
+
+		void operator()(int band, int thread) const {
+			sc->multisampleBand(*cam, band, *image, width, height,
+					ctxs[thread]);
+		}
+	};
+
+	/**
+	 * Task of @c renderTiles and @c renderCrop for @c parallelTasks :
+	 * renders one square tile of a window of the image, counting from the
+	 * window's top left corner row by row.
+	 */
+	struct tileRenderer {
+		/** The scene. */
+		const scene *sc;
+		/** The camera. */
+		const camera<vec_T, time_T, dim> *cam;
+		/** The colors of the window, row by row. */
+		std::vector<rgbcolor<color_T> > *image;
+		/** Width of the image in pixels. */
+		int width;
+		/** Height of the image in pixels. */
+		int height;
+		/** Left column of the window. */
+		int x0;
+		/** Top row of the window. */
+		int y0;
+		/** Column just right of the window. */
+		int x1;
+		/** Row just below the window. */
+		int y1;
+		/** Side of the tiles in pixels. */
+		int size;
+		/** The render context of each thread. */
+		rendercontext<vec_T, color_T, time_T, dim> **ctxs;
+
+		void operator()(int tile, int thread) const {
+			const int T = size;
+			int tilesPerRow = (x1 - x0 + T - 1) / T;
+			int tx = x0 + tile % tilesPerRow * T;
+			int ty = y0 + tile / tilesPerRow * T;
+			sc->renderRect(*cam, tx, ty, std::min(x1, tx + T),
+					std::min(y1, ty + T), width, height,
+					&(*image)[(size_t) (ty - y0) * (x1 - x0) + tx - x0],
+					x1 - x0, ctxs[thread]);
+		}
+	};
+
+	/**
+	 * Runs tasks with @c parallelTasks on threads pinned as set by
+	 * @c setPinThreads , each in a span of the trace log if there is one.
+	 *
+	 * @param tasks The tasks.
+	 * @param n Number of threads to use, at least 1.
+	 * @param f The task functor.
+	 * @param name Name of the spans of the tasks.
+	 */
+	template<typename func>
+	void runTasks(const std::vector<int> &tasks, int n, const func &f,
+			const char *name) const {
+		if (trace == 0) {
+			parallelTasks(tasks, n, f, pinThreads);
+			return;
+		}
+		tracedTask<func> traced;
+		traced.f = &f;
+		traced.log = trace;
+		traced.name = name;
+		parallelTasks(tasks, n, traced, pinThreads);
+	}
+
+	/**
+	 * Runs the writer of a render on a tile or band for the calling thread,
+	 * in a span of the trace log if there is one.
+	 *
+	 * @param writer The writer.
+	 * @param tile The tile or band.
+	 * @param name Name of the span.
+	 */
+	template<typename writer_T>
+	void runWriter(writer_T &writer, const tilebuffer<color_T> &tile,
+			const char *name) const {
+		long long begin = trace != 0 ? trace->now() : 0;
+		writer(tile);
+		if (trace != 0)
+			trace->add(name, TRACE_WRITER_LANE, -1, begin, trace->now());
+	}
+
+	/**
+	 * Renders tiles of a window of an image on @c renderThreads threads
+	 * with @c tileRenderer .
+	 *
+	 * @param task The task, whose @c ctxs is filled in here.
+	 * @param tiles Numbers of the tiles of the window.
+	 * @param ctx The calling thread's render context, or 0 for a fresh one.
+	 */
+	void runTileRenderer(tileRenderer &task, const std::vector<int> &tiles,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx) const {
+		if (tiles.empty())
+			return;
+		rendercontext<vec_T, color_T, time_T, dim> local;
+		if (ctx == 0)
+			ctx = &local;
+		int n = std::max(1, std::min(renderThreads, (int) tiles.size()));
+		threadcontexts<vec_T, color_T, time_T, dim> ctxs(ctx, n);
+		task.sc = this;
+		task.ctxs = ctxs.get();
+		runTasks(tiles, n, task, "render tile");
+		ctxs.mergeStats();
+	}
+
+	/**
+	 * Task of @c supersample for @c parallelTasks : refines one band.
+	 */
+	struct bandSupersampler {
+		/** The scene. */
+		const scene *sc;
+		/** The camera. */
+		const camera<vec_T, time_T, dim> *cam;
+		/** The G-buffer. */
+		const gbuffer<vec_T, color_T, time_T, dim> *gb;
+		/** The colors at one sample per pixel. */
+		const std::vector<rgbcolor<color_T> > *base;
+		/** The image. */
+		std::vector<rgbcolor<color_T> > *image;
+		/** The render context of each thread. */
+		rendercontext<vec_T, color_T, time_T, dim> **ctxs;
+
+		void operator()(int band, int thread) const {
+			sc->supersampleBand(*cam, *gb, *base, band, *image, ctxs[thread]);
+		}
+	};
+
+	/**
+	 * Runs the tasks of a @c tileShader on a thread of its own, so that
+	 * the calling thread is free to write out the tiles.
+	 */
+	struct shaderThread {
+		/** The task. */
+		const tileShader *shader;
+		/** The tiles, in the order to hand them out. */
+		const std::vector<int> *tasks;
+		/** Number of threads to shade on. */
+		int numThreads;
+
+		void operator()() const {
+			shader->sc->runTasks(*tasks, numThreads, *shader,
+					shader->wavefront ? "shade band" : "shade tile");
+		}
+	};
+
+	/**
+	 * A render thread of @c renderStreaming : takes bands in order from a
+	 * shared counter until there are none left, renders each into its slot
+	 * of the reorder buffer and publishes it.
+	 */
+	struct bandStreamer {
+		/** The scene. */
+		const scene *sc;
+		/** The camera. */
+		const camera<vec_T, time_T, dim> *cam;
+		/** Width of the image in pixels. */
+		int width;
+		/** Height of the image in pixels. */
+		int height;
+		/** The bands in flight. */
+		reorderbuffer<color_T> *window;
+		/** Number of the next band to render. */
+		boost::atomic<int> *next;
+		/** This thread's render context. */
+		rendercontext<vec_T, color_T, time_T, dim> *ctx;
+		/** Number of this thread. */
+		int thread;
+
+		void operator()() const {
+			threadpin pin(sc->pinThreads ? thread : -1);
+			gbuffer<vec_T, color_T, time_T, dim> gb;
+			tilebuffer<color_T> tile;
+			for (;;) {
+				int band = next->fetch_add(1);
+				if (band >= window->size())
+					break;
+				tilebuffer<color_T> &out = window->acquire(band);
+				long long begin = sc->trace != 0 ? sc->trace->now() : 0;
+				sc->renderBand(*cam, band, width, height, gb, tile, out, ctx);
+				if (sc->trace != 0)
+					sc->trace->add("render band", TRACE_WORKER_LANE + thread,
+							band, begin, sc->trace->now());
+				window->publish(band);
+			}
+		}
+	};
+
+	/**
+	 * Task of @c renderBands for @c parallelTasks : renders one band into
+	 * the calling thread's scratch buffers and hands it to the sink.
+	 */
+	template<typename sink_T>
+	struct bandRenderer {
+		/** The scene. */
+		const scene *sc;
+		/** The camera. */
+		const camera<vec_T, time_T, dim> *cam;
+		/** Width of the image in pixels. */
+		int width;
+		/** Height of the image in pixels. */
+		int height;
+		/** The G-buffer of each thread. */
+		gbuffer<vec_T, color_T, time_T, dim> *gbs;
+		/** The scratch tile of each thread. */
+		tilebuffer<color_T> *tiles;
+		/** The band of each thread. */
+		tilebuffer<color_T> *bands;
+		/** The sink. */
+		const sink_T *sink;
+		/** The render context of each thread. */
+		rendercontext<vec_T, color_T, time_T, dim> **ctxs;
+
+		void operator()(int band, int thread) const {
+			sc->renderBand(*cam, band, width, height, gbs[thread],
+					tiles[thread], bands[thread], ctxs[thread]);
+			(*sink)(bands[thread]);
+		}
+	};
+
+	/**
+	 * Task of @c renderStrips for @c parallelTasks : renders one band of
+	 * the current strip, rasterizing its camera rays with the strip's
+	 * bins, and copies it into the strip.
+	 */
+	struct stripRenderer {
+		/** The scene. */
+		const scene *sc;
+		/** The camera. */
+		const camera<vec_T, time_T, dim> *cam;
+		/** Width of the image in pixels. */
+		int width;
+		/** Height of the image in pixels. */
+		int height;
+		/** The shapes binned for the strip. */
+		const primarybins<vec_T, time_T, dim> *bins;
+		/** The G-buffer of each thread. */
+		gbuffer<vec_T, color_T, time_T, dim> *gbs;
+		/** The scratch tile of each thread. */
+		tilebuffer<color_T> *tiles;
+		/** The band of each thread. */
+		tilebuffer<color_T> *bands;
+		/** The strip. */
+		tilebuffer<color_T> *strip;
+		/** The render context of each thread. */
+		rendercontext<vec_T, color_T, time_T, dim> **ctxs;
+
+		void operator()(int band, int thread) const {
+			tilebuffer<color_T> &out = bands[thread];
+			sc->renderBand(*cam, band, width, height, gbs[thread],
+					tiles[thread], out, ctxs[thread], bins);
+			std::copy(out.pixels.begin(), out.pixels.end(),
+					strip->pixels.begin() +
+					(size_t) (out.y0 - strip->y0) * width);
+		}
+	};
+
+	/**
+	 * Writer for @c shadeTiles that puts every tile into a framebuffer
+	 * stored tile by tile.
+	 */
+	struct tiledWriter {
+		/** The framebuffer. */
+		tiledframebuffer<color_T> *fb;
+
+		void operator()(const tilebuffer<color_T> &tile) const {
+			fb->put(tile);
+		}
+	};
+
+	/**
+	 * Writer for @c shadeTiles that copies every tile into an image.
+	 */
+	struct imageWriter {
+		/** The image. */
+		std::vector<rgbcolor<color_T> > *image;
+		/** Width of the image in pixels. */
+		int width;
+
+		void operator()(const tilebuffer<color_T> &tile) const {
+			tile.copyTo(*image, width);
+		}
+	};
+
+	/**
+	 * Runs the tasks of a shading pass on @c renderThreads threads. The
+	 * first thread shades with the given context; the others get fresh ones
+	 * whose counters are added to it at the end.
+	 *
+	 * With a queue in the task and more than one thread, the shading
+	 * threads are started next to the calling thread, which passes every
+	 * tile to the writer as soon as it's finished. Otherwise the writer
+	 * gets the tiles once they're all done.
+	 *
+	 * @param shader The task, whose @c ctxs is filled in here.
+	 * @param tasks The tiles or bands, in the order to hand them out.
+	 * @param ctx The calling thread's render context.
+	 * @param writer Functor called on the calling thread with every tile
+	 *   of the task's queue, if it has one.
+	 */
+	template<typename writer_T>
+	void runShaders(tileShader &shader, const std::vector<int> &tasks,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx,
+			writer_T &writer) const {
+		int n = std::max(1, std::min(renderThreads, (int) tasks.size()));
+		threadcontexts<vec_T, color_T, time_T, dim> ctxs(ctx, n);
+		shader.ctxs = ctxs.get();
+		const tilebuffer<color_T> *tile;
+		if (shader.queue != 0 && n > 1) {
+			shaderThread st;
+			st.shader = &shader;
+			st.tasks = &tasks;
+			st.numThreads = n;
+			boost::thread shading(st);
+			while (!shader.queue->done()) {
+				if (shader.queue->take(tile))
+					runWriter(writer, *tile, "write tile");
+				else
+					boost::this_thread::yield();
+			}
+			shading.join();
+		}
+		else {
+			runTasks(tasks, n, shader,
+					shader.wavefront ? "shade band" : "shade tile");
+			while (shader.queue != 0 && shader.queue->take(tile))
+				runWriter(writer, *tile, "write tile");
+		}
+		ctxs.mergeStats();
+	}
+
+public:
+
+	/**
+	 * Constructs an empty scene with or without shadows.
+	 *
+	 * @param useShadows If true, renders if shadows, if false, not
+	 */
+	scene(bool useShadows) : sampledLights(false),
+			areaMode(AREA_LIGHT_GRID), areaLightSamples(16),
+			adaptiveShadowProbes(0), pixelVisibility(false),
+			materialsStale(false), useShadows(useShadows),
+			useShadowCache(false), accelBuilt(false),
+			packBuilt(false), lightTreeBuilt(false), lightPackBuilt(false),
+			shadowMapRes(0), shadowMapBias(0), shadowMapEdits(0),
+			lightClusterRatio(0), lightCutError(0), lightPicks(0),
+			maxReflectDepth(MAX_REFLECT), minThroughput(0), lightCutoff(0),
+			rouletteDepth(-1),
+			sortSecondaryRays(false), shadowPackets(false), renderThreads(1),
+			rasterPrimary(false),
+			tileFrustums(false),
+			pinThreads(false), costMap(0), costKind(COST_CYCLES),
+			costTarget(0), trace(0), aaSamples(1), aaThreshold(0),
+			pixelSamples(1), denoisePasses(0), objectArena(new arena()), editAll(false) { }
+
+	/**
+	 * Turns the shadow cache on or off. See @c rendercontext .
+	 *
+	 * @param on Whether to use the cache.
+	 */
+	void setShadowCache(bool on) {
+		useShadowCache = on;
+	}
+
+	/**
+	 * Sets how aggressively the light tree merges far away groups of point
+	 * lights into single cluster lights; see @c lighttree::collect . This
+	 * only matters for scenes with enough lights for @c finalize to build a
+	 * light tree.
+	 *
+	 * @param ratio Largest ratio of a group's size to its distance at which
+	 *   it's merged, or 0, the default, to shade every light exactly.
+	 */
+	void setLightClusterRatio(vec_T ratio) {
+		assert(ratio >= 0);
+		lightClusterRatio = ratio;
+	}
+
+	/**
+	 * Turns lightcuts on or off. With them, each shading point shades a cut
+	 * through the light tree, chosen by @c lighttree::cut , instead of every
+	 * light, so scenes with thousands of point lights trace far fewer
+	 * shadow rays. Like @c setLightClusterRatio , which it takes the place
+	 * of, this only matters for scenes with enough lights for @c finalize to
+	 * build a light tree.
+	 *
+	 * @param relError Largest error bound of a cluster relative to the
+	 *   estimate of the whole cut, e.g. 0.02, or 0, the default, for no
+	 *   lightcuts.
+	 */
+	void setLightCutError(vec_T relError) {
+		assert(relError >= 0);
+		lightCutError = relError;
+	}
+
+	/**
+	 * Turns light picking on or off. With it, each shading point traces the
+	 * shadow rays of at most @c count light samples, picked with
+	 * probabilities in proportion to what they would add if they weren't
+	 * blocked, their color times the surface's and the cosine factor, and
+	 * weighted so the expected color is unchanged. Lights here don't fade
+	 * with distance, so neither does the estimate. Scenes with many lights
+	 * then trace a fixed number of shadow rays per point, at the price of
+	 * noise where lights are blocked; @c setAdaptiveShadows doesn't apply
+	 * while it's on.
+	 *
+	 * @param count Largest number of light samples shaded per point, or 0,
+	 *   the default, to shade all of them.
+	 */
+	void setLightPicks(int count) {
+		assert(count >= 0);
+		lightPicks = count;
+	}
+
+	/**
+	 * Sets when reflections stop being followed. A reflection is followed
+	 * only if the surface is reflective, fewer than @c maxDepth reflections
+	 * were followed so far, and the product of the reflectivities including
+	 * this one is at least @c minThroughput . An 8 bit image can't show
+	 * light scaled by much less than 1 / 255.
+	 *
+	 * @param maxDepth Largest number of reflections, @c MAX_REFLECT by
+	 *   default.
+	 * @param minThroughput Smallest product of reflectivities worth
+	 *   following, 0 by default.
+	 */
+	void setReflectionLimits(int maxDepth, color_T minThroughput) {
+		assert(maxDepth >= 0 && minThroughput >= 0);
+		maxReflectDepth = maxDepth;
+		this->minThroughput = minThroughput;
+	}
+
+	/**
+	 * Sets the light cutoff. With shadows on, a light sample whose color
+	 * times the color of the surface and the cosine factor, scaled by the
+	 * product of the reflectivities up to the hit, is below the cutoff in
+	 * every channel is dropped without a shadow ray. One step of an 8 bit
+	 * image is 1 / 255, though many lights each below it can still add up
+	 * to a visible amount.
+	 *
+	 * @param cutoff Smallest contribution worth a shadow ray, 0 by default
+	 *   so that every light is traced.
+	 */
+	void setLightCutoff(color_T cutoff) {
+		assert(cutoff >= 0);
+		lightCutoff = cutoff;
+	}
+
+	/**
+	 * Turns Russian roulette for reflections on or off. Once a path has been
+	 * reflected @c minDepth times, each further reflection is only followed
+	 * with a probability equal to the surface's reflectivity, and followed
+	 * reflections aren't scaled by it, which keeps the expected color the
+	 * same. Deep reflections then cost little on average, so the depth cap
+	 * can be raised a lot, at the price of noise that multiple samples per
+	 * pixel average out. The random choice is a @c drawRandom of the pixel
+	 * sample and the depth, so renders are repeatable. The depth cap and
+	 * throughput threshold of @c setReflectionLimits still apply.
+	 *
+	 * @param minDepth Reflections that are always followed, or -1 to turn
+	 *   roulette off, the default.
+	 */
+	void setRussianRoulette(int minDepth) {
+		assert(minDepth >= -1);
+		rouletteDepth = minDepth;
+	}
+
+	/**
+	 * Sets the number of threads @c renderGBuffer , @c shadeGBuffer and
+	 * @c shadeWavefront split their work over. The image is cut into bands
+	 * and tiles of @c RENDER_TILE_SIZE pixels. Each thread starts on a run
+	 * of neighboring ones and steals from the others once it's done, see
+	 * @c parallelTasks , since a tile of sky costs next to nothing and a
+	 * tile of mirrors a lot. Every pixel comes out exactly as with one
+	 * thread.
+	 *
+	 * @param n Number of threads, 1 by default.
+	 */
+	void setRenderThreads(int n) {
+		assert(n > 0);
+		renderThreads = n;
+	}
+
+	/**
+	 * Makes the render passes keep each of their threads on one hardware
+	 * thread, the first on the first one and so on; see @c threadpin . A
+	 * thread's render context and tile buffers are then first written on
+	 * the NUMA node it runs on, which Linux's first-touch placement
+	 * usually puts their pages on; the scene and its acceleration
+	 * structure are shared, not replicated per node. Pinning changes no
+	 * pixels.
+	 *
+	 * @param on Whether to pin the threads, which is off by default.
+	 */
+	void setPinThreads(bool on) {
+		pinThreads = on;
+	}
+
+	/**
+	 * Makes @c renderImage add up what every pixel costs in a second
+	 * buffer: the cost of tracing its camera ray, a share of that of its
+	 * packet, of shading it with its reflections and shadow rays, and of
+	 * supersampling it. @c heatmapImage shows it in false colors. Measuring
+	 * changes no pixels.
+	 *
+	 * @param map The buffer, which is sized to the image and zeroed by each
+	 *   render, or 0 to stop measuring.
+	 * @param measure What to count.
+	 */
+	void setCostMap(std::vector<double> *map, costMeasure measure) {
+		costMap = map;
+		costKind = measure;
+	}
+
+	/**
+	 * Makes the render passes add a span to a log for every task they run,
+	 * such as a band they trace or a tile they shade, on the lane of the
+	 * thread that runs it, and one for every tile or band the calling
+	 * thread writes out. Tracing changes no pixels.
+	 *
+	 * @param log The log, or 0 to stop tracing.
+	 */
+	void setTraceLog(tracelog *log) {
+		trace = log;
+	}
+
+	/**
+	 * Sets up adaptive anti-aliasing for @c supersample , which
+	 * @c renderPPM runs after shading. Pixels whose neighbors see other
+	 * shapes or differ enough in color get a grid of @c samples by
+	 * @c samples rays, whose colors are averaged; flat regions keep their
+	 * single sample.
+	 *
+	 * @param samples Samples per axis of a refined pixel, or 1, the
+	 *   default, to turn anti-aliasing off.
+	 * @param threshold Largest difference of a color channel between
+	 *   neighbors that doesn't call for more samples.
+	 */
+	void setSupersampling(int samples, color_T threshold) {
+		assert(samples > 0 && threshold >= 0);
+		aaSamples = samples;
+		aaThreshold = threshold;
+	}
+
+	/**
+	 * Sets the number of samples per pixel of @c renderMultisampled , which
+	 * @c renderPPM uses instead of the G-buffer passes when there's more
+	 * than one. Each pixel is split into a grid of @c samples by
+	 * @c samples cells with one jittered sample each.
+	 *
+	 * @param samples Samples per axis, 1 by default.
+	 */
+	void setPixelSamples(int samples) {
+		assert(samples > 0);
+		pixelSamples = samples;
+	}
+
+	/**
+	 * Sets where the positions and times of the jittered samples of
+	 * @c renderMultisampled come from. Scrambled Sobol points by default.
+	 *
+	 * @param kind Where the samples come from.
+	 * @param seed Mixed into every hash, for a different set of samples.
+	 */
+	void setSampler(samplerKind kind, unsigned int seed = 0) {
+		pixelSampler = pixelsampler(kind, seed);
+	}
+
+	/**
+	 * Makes @c renderImage filter its images with a @c denoiser guided by
+	 * their G-buffers, so that few samples per pixel, whether of
+	 * @c setPixelSamples or of sampled area lights, look like many. With
+	 * more than one sample per pixel, the G-buffer of the pixel centers is
+	 * traced for it. The passes that render only parts of an image, like
+	 * @c renderTiles , don't filter.
+	 *
+	 * @param passes Passes of the filter, e.g. 5, or 0 for none, the
+	 *   default.
+	 */
+	void setDenoisePasses(int passes) {
+		assert(passes >= 0);
+		denoisePasses = passes;
+	}
+
+	/**
+	 * Gets the number of threads the render passes use.
+	 *
+	 * @return Thread count.
+	 */
+	int getRenderThreads() const {
+		return renderThreads;
+	}
+
+	/**
+	 * Turns sorting of the secondary rays of @c shadeWavefront on or off.
+	 * Sorting doesn't change any colors.
+	 *
+	 * @param on Whether to sort the shadow and reflection queues.
+	 */
+	void setSortSecondaryRays(bool on) {
+		sortSecondaryRays = on;
+	}
+
+	/**
+	 * Turns tracing the shadow queue of @c shadeWavefront in packets on or
+	 * off; see @c traceShadowPackets . Packets don't change any colors.
+	 *
+	 * @param on Whether to trace shadow rays in packets.
+	 */
+	void setShadowPackets(bool on) {
+		shadowPackets = on;
+	}
+
+	/**
+	 * Gets the queues @c shadeWavefront keeps for its threads, with their
+	 * peaks and growth counts so far.
+	 *
+	 * @return One pool per thread, or none before the first wavefront
+	 *   pass.
+	 */
+	const std::vector<wavefrontpool<vec_T, color_T, time_T, dim> >&
+			getWavefrontPools() const {
+		return wavefrontPools;
+	}
+
+	/**
+	 * Prints the peaks of the queues of @c shadeWavefront over all passes
+	 * and threads so far, and how many bands had to grow them, on one
+	 * line. Nothing is printed before the first wavefront pass.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printWavefrontPools(std::ostream &os) const {
+		if (wavefrontPools.empty())
+			return;
+		wavefrontpool<vec_T, color_T, time_T, dim> total;
+		size_t bytes = 0;
+		for (size_t i = 0; i < wavefrontPools.size(); i++) {
+			total.mergeStats(wavefrontPools[i]);
+			bytes += wavefrontPools[i].getMemoryUsage();
+		}
+		total.printStats(os);
+		os << ", " << bytes << " bytes" << std::endl;
+	}
+
+	/**
+	 * Makes the rows of a profile report from the counts of a
+	 * @c shapeprofile of renders of this scene: one per shape, by id, and
+	 * one per light as it was added, which adds up the grid of point lights
+	 * of an area light.
+	 *
+	 * @param p The counts, e.g. @c shapeprofile::total() .
+	 * @param[out] shapeRows Receives the rows of the shapes.
+	 * @param[out] lightRows Receives the rows of the lights.
+	 */
+	void getProfileRows(const shapeprofile &p,
+			std::vector<profilerow> &shapeRows,
+			std::vector<profilerow> &lightRows) const {
+		shapeRows.clear();
+		for (int i = 0; i < (int) shapes.size(); i++) {
+			profilerow row(i);
+			row.cycles = shapeprofile::at(p.shadeCycles, i);
+			row.hits = shapeprofile::at(p.hits, i);
+			row.tests = p.testsOf(shapes[i].get());
+			std::ostringstream what;
+			what << *shapes[i];
+			row.what = what.str();
+			shapeRows.push_back(row);
+		}
+		lightRows.clear();
+		for (int i = 0; i < (int) sourceLights.size(); i++) {
+			profilerow row(i);
+			std::ostringstream what;
+			typedef arealight<vec_T, color_T, time_T, dim> arealight_t;
+			const arealight_t *area = dynamic_cast<const arealight_t *>(
+					sourceLights[i].get());
+			if (area != 0)
+				what << "[area light. color: " << area->getColor() <<
+						", position: " << area->getPos() << ", lights: " <<
+						area->getLights().size() << "]";
+			else
+				what << *sourceLights[i];
+			row.what = what.str();
+			lightRows.push_back(row);
+		}
+		for (int i = 0; i < (int) lights.size(); i++) {
+			profilerow &row = lightRows[lightSources[i]];
+			row.cycles += shapeprofile::at(p.lightCycles, i);
+			row.samples += shapeprofile::at(p.samples, i);
+			row.blocked += shapeprofile::at(p.blocked, i);
+		}
+	}
+
+	/**
+	 * Sets how area lights added after this call light the scene.
+	 *
+	 * @param mode Grid expansion, the default, or sampling.
+	 * @param samples Samples per shading point in sampled mode for area
+	 *   lights that don't set their own count with
+	 *   @c arealight::setSampleCount .
+	 */
+	void setAreaLightMode(areaLightMode mode, int samples = 16) {
+		assert(samples > 0);
+		areaMode = mode;
+		areaLightSamples = samples;
+	}
+
+	/**
+	 * Turns approximate shadows from cube shadow maps on or off, e.g. for
+	 * fast previews. With them, @c finalize and @c refit render a
+	 * @c shadowmap around every point light and spotlight, and shading
+	 * looks its shadows up there instead of tracing shadow rays, so their
+	 * cost doesn't depend on the shapes. Sampled area lights still trace
+	 * theirs. Off by default; turn it off for final frames.
+	 *
+	 * @param resolution Texels along each side of a cube face, e.g. 512, or
+	 *   0 to trace shadow rays.
+	 * @param bias How much farther than the closest surface a point must be
+	 *   to be in shadow, in scene units.
+	 */
+	void setShadowMaps(int resolution, vec_T bias) {
+		assert(resolution >= 0 && bias >= 0);
+		shadowMapRes = resolution;
+		shadowMapBias = bias;
+		if (accelBuilt || packBuilt)
+			buildShadowMaps();
+		else
+			shadowMaps.clear();
+	}
+
+	/**
+	 * Turns adaptive shadow sampling of sampled area lights on or off. With
+	 * it, only the shadow rays of the first few samples of a light are
+	 * traced at each shading point, and the rest only in penumbrae, where
+	 * those disagree; see @c sampleAdaptive . Points that are fully lit or
+	 * fully shadowed then cost a few shadow rays per light instead of one
+	 * per sample, but a shadow smaller than the gaps between the first
+	 * samples can be missed. @c shadeWavefront traces every sample.
+	 *
+	 * @param probes Samples whose shadow rays decide, e.g. 4, or 0, the
+	 *   default, to trace them all.
+	 */
+	void setAdaptiveShadows(int probes) {
+		assert(probes >= 0);
+		adaptiveShadowProbes = probes;
+	}
+
+	/**
+	 * Turns the reuse of light visibility across the samples of a pixel on
+	 * or off. With it, when every camera ray of a pixel @c samplePixel
+	 * shades hits the same shape, only the four corner samples of its grid
+	 * trace their shadow rays; the others take a light to be blocked or
+	 * clear if all of the corners' rays towards it were, and trace their
+	 * own only where the corners disagree. Pixels on the edges of shapes
+	 * and the hits of reflections trace every ray. A shadow that falls
+	 * between the corners of a pixel can be missed.
+	 *
+	 * @param on Whether to reuse visibility.
+	 */
+	void setPixelVisibility(bool on) {
+		pixelVisibility = on;
+	}
+
+	/**
+	 * Adds a shape to the scene. If there is an acceleration structure it
+	 * needs to be rebuilt with @c finalize before it's used again.
+	 *
+	 * @param obj Boost shared pointer to a shape to add to this scene.
+	 */
+	void addShape(const sp_shape &obj) {
+		assert(obj != 0);
+		shapes.push_back(obj);
+		shapeKinds.push_back(
+				shapedispatch<vec_T, color_T, time_T, dim>::kindOf(obj.get()));
+		obj->setMaterial(materials.add(obj->getColor(),
+				obj->getReflectivity()));
+		if (pipeline)
+			pipeline->push(obj.get());
+		accelBuilt = false;
+		packBuilt = false;
+	}
+
+	/**
+	 * Starts gathering the bounds of shapes on worker threads as they're
+	 * added, so that @c finalize has them at hand instead of asking every
+	 * shape, once to split the bounded ones from the others and again to
+	 * build the acceleration structure. Meant for loading big scenes, where
+	 * shapes are made one at a time as their records are read. Does
+	 * nothing once shapes have been added. The shapes mustn't change until
+	 * @c finalize .
+	 *
+	 * @param numThreads Number of worker threads, at least 1.
+	 */
+	void beginPipelinedBuild(int numThreads) {
+		pipeline.reset();
+		if (shapes.empty())
+			pipeline.reset(
+					new buildpipeline<vec_T, color_T, time_T, dim>(numThreads));
+	}
+
+	/**
+	 * Sets the acceleration structure used for closest-hit queries. Passing
+	 * a null pointer selects the linear scan over all shapes. The structure
+	 * isn't used until @c finalize builds it.
+	 *
+	 * @param acc The acceleration structure or a null pointer.
+	 */
+	void setAccelerator(sp_accelerator acc) {
+		accel = acc;
+		accelBuilt = false;
+	}
+
+	/**
+	 * Gets the arena owned by this scene, for making its shapes and lights
+	 * with @c arenaallocator and @c boost::allocate_shared so they share a
+	 * few contiguous blocks, e.g. @code
+	 * sc.addShape(boost::allocate_shared<sphere3d>(
+	 *         arenaallocator<sphere3d>(sc.getArena()), color, 1, center));
+	 * @endcode
+	 * The memory is freed at once when the scene and the last of the objects
+	 * are gone.
+	 *
+	 * @return The arena.
+	 */
+	const sp_arena& getArena() const {
+		return objectArena;
+	}
+
+	/**
+	 * Gets the acceleration structure, which may be null.
+	 *
+	 * @return The acceleration structure.
+	 */
+	sp_accelerator getAccelerator() const {
+		return accel;
+	}
+
+	/**
+	 * Prepares the scene for rendering once all shapes and lights have been
+	 * added. Splits the shapes into bounded and unbounded ones and builds the
+	 * acceleration structure, if there is one, over the bounded ones;
+	 * otherwise packs the spheres so the scan over all shapes tests several
+	 * at a time. Builds the light tree if there are at least @c LIGHT_TREE_MIN_LIGHTS lights.
+	 * Ends a @c beginPipelinedBuild , using the bounds it gathered.
+	 */
+	void finalize() {
+		finalize(0, 0);
+	}
+
+	/**
+	 * Like the other @c finalize , but first tries to read the acceleration
+	 * structure from bytes written by @c writeAccelerator for the same
+	 * shapes, and only builds it if they don't hold one it can use.
+	 *
+	 * @param tree The first byte of the structure, or 0 to build it.
+	 * @param size Number of bytes from @c tree that may be read.
+	 *
+	 * @return @c true if the structure was read instead of built.
+	 */
+	bool finalize(const char *tree, size_t size) {
+		boundedShapes.clear();
+		unboundedShapes.clear();
+		boundedIds.clear();
+		unboundedIds.clear();
+		unboundedKinds.clear();
+		std::vector<aabb<vec_T, dim> > boxes, boundedBoxes;
+		std::vector<char> bounded;
+		if (pipeline) {
+			pipeline->finish(boxes, bounded);
+			pipeline.reset();
+		}
+		bool known = boxes.size() == shapes.size() && !shapes.empty();
+		aabb<vec_T, dim> box;
+		for (int i = 0; i < (int) shapes.size(); i++) {
+			if (known ? bounded[i] != 0 : shapes[i]->getBounds(box)) {
+				boundedShapes.push_back(shapes[i]);
+				boundedIds.push_back(i);
+				if (known)
+					boundedBoxes.push_back(boxes[i]);
+			}
+			else {
+				unboundedShapes.push_back(shapes[i]);
+				unboundedIds.push_back(i);
+				unboundedKinds.push_back(shapeKinds[i]);
+			}
+		}
+		bool read = false;
+		if (accel != 0) {
+			read = tree != 0 && accel->read(tree, size, boundedShapes);
+			if (!read && known)
+				accel->buildFromBounds(boundedShapes, boundedBoxes);
+			else if (!read)
+				accel->build(boundedShapes);
+			accelBuilt = true;
+		}
+		else {
+			shapePack.clear();
+			for (size_t i = 0; i < shapes.size(); i++)
+				shapePack.add(shapes[i].get());
+			packBuilt = true;
+		}
+
+		buildMaterials();
+		buildLightTree();
+		buildLightPack();
+		buildShadowMaps();
+		return read;
+	}
+
+	/**
+	 * Writes the acceleration structure built by @c finalize so a later
+	 * @c finalize over the same shapes can read it instead of building it.
+	 *
+	 * @param os The output stream, which should be opened in binary mode.
+	 *
+	 * @return @c false, writing nothing, if there's no built structure or
+	 *   it can't be written.
+	 */
+	bool writeAccelerator(std::ostream &os) const {
+		return accel != 0 && accelBuilt && accel->write(os);
+	}
+
+	/**
+	 * Brings the acceleration structure up to date after shapes have moved,
+	 * for example between the frames of an @c animation . Structures that
+	 * support it keep their topology and only update their bounds, which is
+	 * much cheaper than a rebuild; others are rebuilt. The light tree is
+	 * rebuilt too, since lights may have moved. No shapes may have been
+	 * added since the last @c finalize , and bounded shapes must stay
+	 * bounded. If the structure hasn't been built yet this just calls
+	 * @c finalize .
+	 */
+	void refit() {
+		if (!accelBuilt) {
+			finalize();
+			return;
+		}
+		if (!accel->refit())
+			accel->build(boundedShapes);
+		buildLightTree();
+		buildLightPack();
+		buildShadowMaps();
+	}
+
+	/**
+	 * Moves a sphere or cylinder of a finalized scene so it's centered on
+	 * the given point and refits the acceleration structure, or just moves
+	 * the shape in it if it can, like a @c dynamicbvh . The places it moved
+	 * from and to are noted for @c findDirtyTiles .
+	 *
+	 * @param id Index of the shape in @c getShapes .
+	 * @param center The new center.
+	 *
+	 * @return @c false, changing nothing, if the shape can't be moved.
+	 */
+	bool moveShape(int id, const mvector<vec_T, dim> &center) {
+		assert(id >= 0 && id < (int) shapes.size());
+		pipeline.reset();
+		aabb<vec_T, dim> before;
+		bool bounded = shapes[id]->getBounds(before);
+		if (!shapedispatch<vec_T, color_T, time_T, dim>::moveTo(shapeKinds[id],
+				shapes[id].get(), center))
+			return false;
+		if (bounded)
+			edits.push_back(std::make_pair(before, true));
+		recordEdit(id, true);
+		int k = bounded && accelBuilt ? boundedIndex(id) : -1;
+		if (k >= 0 && accel->updateShape(k))
+			buildShadowMaps();
+		else
+			refit();
+		return true;
+	}
+
+	/**
+	 * Changes the color of a shape of a finalized scene, noting it for
+	 * @c findDirtyTiles . Shadows don't depend on colors, so only what
+	 * sees the shape, directly or reflected, changes.
+	 *
+	 * @param id Index of the shape in @c getShapes .
+	 * @param color The new color.
+	 */
+	void recolorShape(int id, const rgbcolor<color_T> &color) {
+		assert(id >= 0 && id < (int) shapes.size());
+		shapes[id]->setColor(color);
+		shapes[id]->setMaterial(materials.add(color,
+				shapes[id]->getReflectivity()));
+		materialsStale = true;
+		recordEdit(id, false);
+	}
+
+	/**
+	 * Removes a shape from a finalized scene, noting where the shape was
+	 * for @c findDirtyTiles . The shapes after it move down one index. An
+	 * acceleration structure that can, like a @c dynamicbvh , just drops
+	 * the shape; otherwise the scene is finalized again.
+	 *
+	 * @param id Index of the shape in @c getShapes .
+	 */
+	void removeShape(int id) {
+		assert(id >= 0 && id < (int) shapes.size());
+		pipeline.reset();
+		recordEdit(id, true);
+		bool removed = accelBuilt && detachShape(id);
+		shapes.erase(shapes.begin() + id);
+		shapeKinds.erase(shapeKinds.begin() + id);
+		materialsStale = true;
+		if (removed)
+			buildShadowMaps();
+		else
+			finalize();
+	}
+
+	/**
+	 * Adds a shape to a finalized scene, noting it for @c findDirtyTiles .
+	 * An acceleration structure that can, like a @c dynamicbvh , takes the
+	 * shape in as it is; otherwise the scene is finalized again. Unlike
+	 * @c addShape , the scene can be rendered right after.
+	 *
+	 * @param obj Boost shared pointer to a shape to add to this scene.
+	 */
+	void insertShape(const sp_shape &obj) {
+		bool built = accelBuilt;
+		int id = (int) shapes.size();
+		addShape(obj);
+		aabb<vec_T, dim> box;
+		if (built && !obj->getBounds(box)) {
+			unboundedShapes.push_back(obj);
+			unboundedIds.push_back(id);
+			unboundedKinds.push_back(shapeKinds[id]);
+			accelBuilt = true;
+		}
+		else if (built && accel->insertShape(obj)) {
+			boundedShapes.push_back(obj);
+			boundedIds.push_back(id);
+			accelBuilt = true;
+		}
+		if (accelBuilt)
+			buildShadowMaps();
+		else
+			finalize();
+		recordEdit(id, true);
+	}
+
+	/**
+	 * Moves a light of a finalized scene and changes its color. A light
+	 * may light anything, so this marks every tile dirty.
+	 *
+	 * @param i Index of the light, in the order lights were added.
+	 * @param pos The new position.
+	 * @param color The new color.
+	 */
+	void editLight(int i, const mvector<vec_T, dim> &pos,
+			const rgbcolor<color_T> &color) {
+		assert(i >= 0 && i < (int) lights.size());
+		lights[i]->setPos(pos);
+		lights[i]->setColor(color);
+		editAll = true;
+		buildLightTree();
+		buildLightPack();
+	}
+
+	/**
+	 * Notes for @c findDirtyTiles that a shape of a finalized scene was
+	 * moved by something other than @c moveShape , like an @c animation .
+	 * The caller moves it and refits the scene itself.
+	 *
+	 * @param before Bounding box of the shape where it was.
+	 * @param after Bounding box of the shape where it is now.
+	 */
+	void noteShapeMoved(const aabb<vec_T, dim> &before,
+			const aabb<vec_T, dim> &after) {
+		edits.push_back(std::make_pair(before, true));
+		edits.push_back(std::make_pair(after, true));
+	}
+
+	/**
+	 * Notes for @c findDirtyTiles that something changed that may change
+	 * any pixel, like a light or camera moved by an @c animation .
+	 */
+	void noteEditAll() {
+		editAll = true;
+	}
+
+	/**
+	 * Tells if there have been edits since the last @c clearEdits .
+	 *
+	 * @return @c true if some tile may be dirty.
+	 */
+	bool hasEdits() const {
+		return editAll || !edits.empty();
+	}
+
+	/**
+	 * Forgets the edits, once the image they apply to is up to date.
+	 */
+	void clearEdits() {
+		edits.clear();
+		editAll = false;
+	}
+
+	/**
+	 * Marks the tiles of an image that the edits since the last
+	 * @c clearEdits may have changed. What was edited is marked where the
+	 * camera sees it; for edits that moved something, so are the shadows
+	 * it cast or casts from every light, bounded by @c boundShadow for the
+	 * bounded shapes and @c boundPlaneShadow for infinite planes, and with
+	 * clustered lights from the box around all of them. With reflections
+	 * every reflective shape that's bounded is marked, and the mirror
+	 * images of everything marked in the reflective infinite planes, as
+	 * many times over as reflections go deep. This is conservative: a
+	 * tile that isn't marked comes out the same as before. Every tile is
+	 * marked when that can't be worked out, like when something marked is
+	 * behind the camera, a shadow falls on an unbounded shape that isn't a
+	 * plane or there'd be more than @c DIRTY_MAX_BOXES boxes.
+	 *
+	 * @param cam The camera of the image, which hasn't moved.
+	 * @param width Width of the image in pixels.
+	 * @param height Height of the image in pixels.
+	 * @param[in,out] tiles The tiles of the image, in which the dirty ones
+	 *   are marked.
+	 */
+	void findDirtyTiles(const camera<vec_T, time_T, dim> &cam, int width,
+			int height, dirtytiles &tiles) const {
+		typedef aabb<double, dim> dbox;
+		if (editAll) {
+			tiles.markAll();
+			return;
+		}
+		if (edits.empty())
+			return;
+		assert(accelBuilt || packBuilt);
+		aabb<vec_T, dim> b;
+		dbox world;
+		for (size_t i = 0; i < boundedShapes.size(); i++)
+			if (boundedShapes[i]->getBounds(b))
+				world.extend(paddedBox(b));
+		for (size_t i = 0; i < edits.size(); i++)
+			world.extend(paddedBox(edits[i].first));
+		std::vector<dbox> lightBoxes;
+		if (useShadows) {
+			dbox all;
+			for (size_t i = 0; i < lights.size(); i++) {
+				lights[i]->getBounds(b);
+				lightBoxes.push_back(paddedBox(b));
+				all.extend(lightBoxes.back());
+			}
+			if (lightTreeBuilt && (lightClusterRatio > 0 ||
+					lightCutError > 0))
+				lightBoxes.push_back(all);
+		}
+
+		std::vector<dbox> boxes;
+		dbox shadow;
+		for (size_t i = 0; i < edits.size(); i++) {
+			dbox box = paddedBox(edits[i].first);
+			boxes.push_back(box);
+			for (size_t j = 0; edits[i].second && j < lightBoxes.size(); j++) {
+				if (!boundShadow(lightBoxes[j], box, world, shadow)) {
+					tiles.markAll();
+					return;
+				}
+				boxes.push_back(shadow);
+				for (size_t k = 0; k < unboundedShapes.size(); k++) {
+					if (unboundedKinds[k] != SHAPE_INFPLANE ||
+							!boundPlaneShadow(lightBoxes[j], box,
+							planeNormal(k), (double) planeAt(k).getDist(),
+							shadow)) {
+						tiles.markAll();
+						return;
+					}
+					if (!shadow.isEmpty())
+						boxes.push_back(shadow);
+				}
+			}
+		}
+
+		if (maxReflectDepth > 0) {
+			for (size_t i = 0; i < boundedShapes.size(); i++)
+				if (boundedShapes[i]->getReflectivity() > 0 &&
+						boundedShapes[i]->getBounds(b))
+					boxes.push_back(paddedBox(b));
+			std::vector<int> mirrors;
+			for (size_t k = 0; k < unboundedShapes.size(); k++) {
+				if (!(unboundedShapes[k]->getReflectivity() > 0))
+					continue;
+				if (unboundedKinds[k] != SHAPE_INFPLANE) {
+					tiles.markAll();
+					return;
+				}
+				mirrors.push_back((int) k);
+			}
+			size_t begin = 0;
+			for (int depth = 0; depth < maxReflectDepth && !mirrors.empty();
+					depth++) {
+				size_t end = boxes.size();
+				if (end + (end - begin) * mirrors.size() > DIRTY_MAX_BOXES) {
+					tiles.markAll();
+					return;
+				}
+				for (size_t m = 0; m < mirrors.size(); m++)
+					for (size_t i = begin; i < end; i++)
+						boxes.push_back(mirrorBox(boxes[i],
+								planeNormal(mirrors[m]),
+								(double) planeAt(mirrors[m]).getDist()));
+				begin = end;
+			}
+		}
+		if (boxes.size() > DIRTY_MAX_BOXES) {
+			tiles.markAll();
+			return;
+		}
+		for (size_t i = 0; i < boxes.size(); i++)
+			tiles.markBox(cam, boxes[i], DIRTY_MARGIN);
+	}
+
+	/**
+	 * Gets all shapes in the order they were added. Hit record ids index
+	 * into this.
+	 *
+	 * @return The shapes.
+	 */
+	const std::vector<sp_shape>& getShapes() const {
+		return shapes;
+	}
+
+	/**
+	 * Gets all lights, of every kind, in the order they were added.
+	 *
+	 * @return The lights.
+	 */
+	const std::vector<sp_light>& getLights() const {
+		return lights;
+	}
+
+	/**
+	 * Gets the lights as they were added, with each area light once.
+	 *
+	 * @return The lights.
+	 */
+	const std::vector<sp_light>& getSourceLights() const {
+		return sourceLights;
+	}
+
+	/**
+	 * Gets the distinct colors and reflectivities of the shapes, which
+	 * each shape's @c shape::getMaterial indexes. Deferred shading can
+	 * group hits by it.
+	 *
+	 * @return The material table.
+	 */
+	const materialtable<color_T>& getMaterials() const {
+		return materials;
+	}
+
+	/**
+	 * Gets the number of bytes the scene's lists of its shapes take,
+	 * including the sphere pack, but not the shapes or the accelerator.
+	 *
+	 * @return Memory footprint in bytes.
+	 */
+	size_t getShapeListMemoryUsage() const {
+		return (shapes.capacity() + boundedShapes.capacity() +
+				unboundedShapes.capacity()) * sizeof(sp_shape) +
+				(shapeKinds.capacity() + unboundedKinds.capacity()) *
+				sizeof(shapeKind) + (boundedIds.capacity() +
+				unboundedIds.capacity()) * sizeof(int) +
+				shapePack.getMemoryUsage();
+	}
+
+	/**
+	 * Gets the number of bytes the scene's lists of its lights take, with
+	 * the light tree, the light pack and the shadow maps, but not the
+	 * lights.
+	 *
+	 * @return Memory footprint in bytes.
+	 */
+	size_t getLightListMemoryUsage() const {
+		size_t bytes = (lights.capacity() + sourceLights.capacity()) *
+				sizeof(sp_light) + lightSources.capacity() * sizeof(int) +
+				lightTree.getMemoryUsage() + lightPack.getMemoryUsage();
+		for (size_t i = 0; i < shadowMaps.size(); i++)
+			bytes += shadowMaps[i].getMemoryUsage();
+		return bytes;
+	}
+
+	/**
+	 * Gets the shapes that have bounding boxes as of the last @c finalize .
+	 *
+	 * @return Bounded shapes.
+	 */
+	const std::vector<sp_shape>& getBoundedShapes() const {
+		return boundedShapes;
+	}
+
+	/**
+	 * Gets the shapes that have no bounding boxes as of the last
+	 * @c finalize .
+	 *
+	 * @return Unbounded shapes.
+	 */
+	const std::vector<sp_shape>& getUnboundedShapes() const {
+		return unboundedShapes;
+	}
+
+	/**
+	 * Adds a point light to the scene.
+	 *
+	 * @param theLight Boost shared pointer to the point light to add to this
+	 *        scene.
+	 */
+	void addPointLight(const sp_light &theLight) {
+		assert(theLight != 0);
+		lightSources.push_back((int) sourceLights.size());
+		sourceLights.push_back(theLight);
+		lights.push_back(theLight);
+		lightTreeBuilt = false;
+		lightPackBuilt = false;
+	}
+
+	/**
+	 * Adds a spot light to the scene.
+	 *
+	 * @param theLight Boost shared pointer to the point light to add to this
+	 *        scene.
+	 */
+	void addSpotLight(const sp_spotlight &theLight) {
+		assert(theLight != 0);
+		lightSources.push_back((int) sourceLights.size());
+		sourceLights.push_back(theLight);
+		lights.push_back(theLight);
+		lightTreeBuilt = false;
+		lightPackBuilt = false;
+	}
+
+	/**
+	 * Adds an area light to the scene. In @c AREA_LIGHT_GRID mode all the
+	 * point lights in the area light approximation are added to this
+	 * scene's lights; in @c AREA_LIGHT_SAMPLED mode the area light itself is
+	 * added and sampled while shading.
+	 *
+	 * @param theLight Boost shared pointer to the point light to add to this
+	 *        scene.
+	 */
+	void addAreaLight(const sp_arealight &theLight) {
+		assert(theLight != 0);
+		int source = (int) sourceLights.size();
+		sourceLights.push_back(theLight);
+		if (areaMode == AREA_LIGHT_SAMPLED) {
+			lightSources.push_back(source);
+			lights.push_back(theLight);
+			sampledLights = true;
+			lightTreeBuilt = false;
+			lightPackBuilt = false;
+			return;
+		}
+		typename std::vector<boost::shared_ptr<
+			light<vec_T, color_T, time_T, dim> > >::const_iterator iter;
+		for(iter = theLight->getLights().begin();
+				iter < theLight->getLights().end(); iter++) {
+			lightSources.push_back(source);
+			lights.push_back(*iter);
+		}
+		lightTreeBuilt = false;
+		lightPackBuilt = false;
+	}
+
+	/**
+	 * Finds the closest object that intersects the given ray and the time
+	 * at which that intersection occurs, which is returned through the
+	 * @c tIntersect out-parameter. Returns 0 and sets the out-parameter
+	 * to RAY_MISS if there is no such object. Uses the acceleration structure
+	 * if it's up to date and tests every shape otherwise.
+	 *
+	 * @param r The ray.
+	 * @param[out] tIntersect The time at which the intersection with @c r
+	 *   occurs or @c RAY_MISS if there's no intersection.
+	 *
+	 * @return Reference to the scene's pointer to the nearest object that
+	 *   intersects the ray @c r , or to a null pointer. Nothing is copied, so
+	 *   no reference counts change.
+	 */
+	const sp_shape& findClosestShape(
+			const ray<vec_T, time_T, dim> &r, time_T &tIntersect) const {
+		static const sp_shape none;
+		int id = findClosestId(r, tIntersect);
+		return id >= 0 ? shapes[id] : none;
+	}
+
+	/**
+	 * Finds the closest hit of the given ray like @c findClosestShape and
+	 * fills in a hit record for it, so the point and normal are worked out
+	 * once by the shape that was hit.
+	 *
+	 * @param r The ray.
+	 * @param[out] rec Receives the hit, or a miss record with @c obj set to
+	 *   0.
+	 *
+	 * @return @c true if the ray hit something.
+	 */
+	bool findClosestHit(const ray<vec_T, time_T, dim> &r,
+			hitrecord<vec_T, color_T, time_T, dim> &rec) const {
+		rec = hitrecord<vec_T, color_T, time_T, dim>();
+		time_T t;
+		int id = findClosestId(r, t);
+		if (id < 0)
+			return false;
+		rec.t = t;
+		rec.id = id;
+		rec.shutter = r.getShutter();
+		shapes[id]->completeHit(r, rec);
+		return true;
+	}
+
+	/**
+	 * Finds the closest hits of a batch of rays, as if by calling
+	 * @c findClosestHit on each one, but lets the acceleration structure
+	 * trace coherent rays together.
+	 *
+	 * @param rays The rays.
+	 * @param count Number of rays.
+	 * @param[out] recs Receives the hit record of each ray.
+	 */
+	void findClosestHits(const ray<vec_T, time_T, dim> *rays, int count,
+			hitrecord<vec_T, color_T, time_T, dim> *recs) const {
+		std::vector<int> idx;
+		std::vector<time_T> t;
+		findClosestHits(rays, count, recs, idx, t);
+	}
+
+	/**
+	 * Like the other @c findClosestHits , with scratch arrays that are
+	 * reused between calls so that batches don't allocate.
+	 *
+	 * @param rays The rays.
+	 * @param count Number of rays.
+	 * @param[out] recs Receives the hit record of each ray.
+	 * @param idx Scratch array for the indices of the bounded shapes hit.
+	 * @param t Scratch array for the times of those hits.
+	 */
+	void findClosestHits(const ray<vec_T, time_T, dim> *rays, int count,
+			hitrecord<vec_T, color_T, time_T, dim> *recs,
+			std::vector<int> &idx, std::vector<time_T> &t) const {
+		if (!accelBuilt) {
+			for (int i = 0; i < count; i++)
+				findClosestHit(rays[i], recs[i]);
+			return;
+		}
+		idx.resize(count);
+		t.resize(count);
+		accel->closestHits(rays, count, &idx[0], &t[0]);
+		RAYSTATS_ADD(closestRays, count);
+		for (int i = 0; i < count; i++) {
+			hitrecord<vec_T, color_T, time_T, dim> &rec = recs[i];
+			rec = hitrecord<vec_T, color_T, time_T, dim>();
+			time_T tu;
+			int u = findClosestLinear(unboundedShapes, unboundedKinds, rays[i],
+					tu);
+			int id = u >= 0 ? unboundedIds[u] : -1;
+			if (idx[i] >= 0 && (id < 0 || t[i] < tu)) {
+				id = boundedIds[idx[i]];
+				tu = t[i];
+			}
+			if (id < 0)
+				continue;
+			RAYSTATS_ADD(hits, 1);
+			rec.t = tu;
+			rec.id = id;
+			rec.shutter = rays[i].getShutter();
+			shapes[id]->completeHit(rays[i], rec);
+		}
+	}
+
+	/**
+	 * Checks if anything blocks the given ray before time @c tmax . This is
+	 * the query used for shadow rays, where any blocker will do, so it doesn't
+	 * look for the closest one and stops as soon as it finds a hit. It uses
+	 * the acceleration structure under the same conditions as
+	 * @c findClosestShape .
+	 *
+	 * @param r The ray.
+	 * @param tmax Hits at or beyond this time, e.g. behind the light the
+	 *   ray is aimed at, are ignored.
+	 *
+	 * @return @c true if some shape blocks the ray before @c tmax .
+	 */
+	bool isOccluded(const ray<vec_T, time_T, dim> &r, time_T tmax) const {
+		return findOccluder(r, tmax) != 0;
+	}
+
+	/**
+	 * Like @c isOccluded but also says which shape blocks the ray.
+	 *
+	 * @param r The ray.
+	 * @param tmax Hits at or beyond this time are ignored.
+	 *
+	 * @return Some shape that blocks the ray before @c tmax , not
+	 *   necessarily the closest, or 0.
+	 */
+	const shape<vec_T, color_T, time_T, dim> * findOccluder(
+			const ray<vec_T, time_T, dim> &r, time_T tmax) const {
+		RAYSTATS_ADD(shadowRays, 1);
+		if (!accelBuilt) {
+			if (!packBuilt)
+				return findOccluderLinear(shapes, shapeKinds, r, tmax);
+			int i = shapePack.anyHit(r, 0, shapePack.size(), tmax);
+			return i >= 0 ? shapes[i].get() : 0;
+		}
+		const shape<vec_T, color_T, time_T, dim> *blocker =
+				findOccluderLinear(unboundedShapes, unboundedKinds, r, tmax);
+		if (blocker != 0)
+			return blocker;
+		int idx = accel->anyHit(r, tmax);
+		return idx >= 0 ? boundedShapes[idx].get() : 0;
+	}
+
+	/**
+	 * Like @c findOccluder for each of a batch of rays. The rays the
+	 * unbounded shapes don't block are traced through the acceleration
+	 * structure together with @c accelerator::anyHits .
+	 *
+	 * @param rays The rays.
+	 * @param count Number of rays, at most @c RENDER_PACKET_WIDTH .
+	 * @param tmax Hits of each ray at or beyond its time are ignored.
+	 * @param[out] blockers Receives some shape that blocks each ray, not
+	 *   necessarily the closest, or 0.
+	 */
+	void findOccluders(const ray<vec_T, time_T, dim> *rays, int count,
+			const time_T *tmax,
+			const shape<vec_T, color_T, time_T, dim> **blockers) const {
+		assert(count <= RENDER_PACKET_WIDTH);
+		if (!accelBuilt) {
+			for (int i = 0; i < count; i++)
+				blockers[i] = findOccluder(rays[i], tmax[i]);
+			return;
+		}
+		RAYSTATS_ADD(shadowRays, count);
+		int hits[RENDER_PACKET_WIDTH];
+		int n = 0;
+		for (int i = 0; i < count; i++) {
+			blockers[i] = findOccluderLinear(unboundedShapes, unboundedKinds,
+					rays[i], tmax[i]);
+			if (blockers[i] == 0)
+				n++;
+		}
+		if (n == count) {
+			// Nothing unbounded blocks any of them, so trace them in place.
+			accel->anyHits(rays, count, tmax, hits);
+			for (int i = 0; i < count; i++)
+				if (hits[i] >= 0)
+					blockers[i] = boundedShapes[hits[i]].get();
+			return;
+		}
+		ray<vec_T, time_T, dim> traced[RENDER_PACKET_WIDTH];
+		time_T tTraced[RENDER_PACKET_WIDTH];
+		int from[RENDER_PACKET_WIDTH];
+		n = 0;
+		for (int i = 0; i < count; i++) {
+			if (blockers[i] != 0)
+				continue;
+			traced[n] = rays[i];
+			tTraced[n] = tmax[i];
+			from[n++] = i;
+		}
+		if (n == 0)
+			return;
+		accel->anyHits(traced, n, tTraced, hits);
+		for (int k = 0; k < n; k++)
+			if (hits[k] >= 0)
+				blockers[from[k]] = boundedShapes[hits[k]].get();
+	}
+
+	/**
+	 * Determines the color of the given ray. Determines its color by finding
+	 * the nearest intersecting object and by combining its color with the
+	 * colors of lights in the scene.
+	 *
+	 * @param r The ray whose color will be determined.
+	 * @param depth The current reflection depth.
+	 * @param ctx The calling thread's render context, or 0 to trace without
+	 *   one. The pixel sample it's set to, if any, keys the random numbers
+	 *   of @c drawRandom .
+	 *
+	 * @return The color of the given ray or @c DEFAULT_BKCOLOR if there is no
+	 * intersection.
+	 */
+	rgbcolor<color_T> traceRay(
+			const ray<vec_T, time_T, dim> &r, int depth = 0,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx = 0) const {
+		hitrecord<vec_T, color_T, time_T, dim> rec; // out parameter
+		findClosestHit(r, rec);
+		return shade(r, rec, depth, ctx);
+	}
+
+	/**
+	 * Determines the color of the given ray once its closest hit is known.
+	 * This is the part of @c traceRay after @c findClosestHit . Reflections
+	 * are followed in a loop that carries the product of the reflectivities
+	 * so far, until @c followReflection says to stop, and the light seen
+	 * after each reflection is added scaled by that product. The work is
+	 * done by the @c shadekernel compiled for the shadows, reflection depth
+	 * and lights of this scene, and the light is summed in the SIMD lanes of
+	 * an @c rgbsum .
+	 *
+	 * @param r The ray.
+	 * @param rec The closest hit of @c r .
+	 * @param depth The current reflection depth.
+	 * @param ctx The calling thread's render context or 0.
+	 * @param tileLights Sorted indices of the only lights that may light
+	 *   @c rec , as found by @c findTileLights , or 0 to consider all of
+	 *   them. Reflections always consider all of them.
+	 *
+	 * @return The color of the given ray or @c DEFAULT_BKCOLOR if there is no
+	 * intersection.
+	 */
+	rgbcolor<color_T> shade(const ray<vec_T, time_T, dim> &r,
+			const hitrecord<vec_T, color_T, time_T, dim> &rec, int depth = 0,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx = 0,
+			const std::vector<int> *tileLights = 0) const {
+		if(rec.obj == 0) {
+			return DEFAULT_BKCOLOR;
+		}
+		bool reflections = maxReflectDepth > 0;
+		switch ((useShadows ? 4 : 0) | (reflections ? 2 : 0) |
+				(sampledLights ? 1 : 0)) {
+		case 0:
+			return shadeWith<shadekernel<false, false, false> >(r, rec, depth,
+					ctx, tileLights);
+		case 1:
+			return shadeWith<shadekernel<false, false, true> >(r, rec, depth,
+					ctx, tileLights);
+		case 2:
+			return shadeWith<shadekernel<false, true, false> >(r, rec, depth,
+					ctx, tileLights);
+		case 3:
+			return shadeWith<shadekernel<false, true, true> >(r, rec, depth,
+					ctx, tileLights);
+		case 4:
+			return shadeWith<shadekernel<true, false, false> >(r, rec, depth,
+					ctx, tileLights);
+		case 5:
+			return shadeWith<shadekernel<true, false, true> >(r, rec, depth,
+					ctx, tileLights);
+		case 6:
+			return shadeWith<shadekernel<true, true, false> >(r, rec, depth,
+					ctx, tileLights);
+		default:
+			return shadeWith<shadekernel<true, true, true> >(r, rec, depth,
+					ctx, tileLights);
+		}
+	}
+
+	/**
+	 * The kernel of @c shade for its settings, for a hit that isn't a miss.
+	 *
+	 * @param r The ray.
+	 * @param rec The closest hit of @c r .
+	 * @param depth The current reflection depth.
+	 * @param ctx The calling thread's render context or 0.
+	 * @param tileLights The lights to consider, as for @c shade .
+	 *
+	 * @tparam kernel_T The @c shadekernel of the settings of this scene.
+	 *
+	 * @return The color of the given ray.
+	 */
+	template<typename kernel_T>
+	rgbcolor<color_T> shadeWith(const ray<vec_T, time_T, dim> &r,
+			const hitrecord<vec_T, color_T, time_T, dim> &rec, int depth,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx,
+			const std::vector<int> *tileLights) const {
+		rgbsum<color_T> finalColor, local;
+		directSink<kernel_T> sink;
+		sink.sc = this;
+		sink.ctx = ctx;
+		sink.finalColor = &local;
+		color_T weight = 1;
+		ray<vec_T, time_T, dim> R_r = r;
+		hitrecord<vec_T, color_T, time_T, dim> next;
+		const hitrecord<vec_T, color_T, time_T, dim> *hit = &rec;
+		for (;;) {
+			// Sum the color contributions from the lights.
+			local = rgbsum<color_T>();
+			sink.rec = hit;
+			sink.cutoff = lightCutoff / weight;
+			if (shapeprofile::isEnabled()) {
+				unsigned long long c0 = readCost(COST_CYCLES);
+				gatherLight(*hit, depth, ctx, hit == &rec ? tileLights : 0,
+						sink);
+				shapeprofile::local().countHit(hit->id,
+						readCost(COST_CYCLES) - c0);
+			}
+			else {
+				gatherLight(*hit, depth, ctx, hit == &rec ? tileLights : 0,
+						sink);
+			}
+			finalColor.addScaled(local, weight);
+
+			// handle reflections
+			color_T nextWeight;
+			if (!kernel_T::reflections ||
+					!followReflection(*hit, weight, depth, ctx, nextWeight))
+				break;
+			// R_r is the reflected ray
+			R_r = R_r.reflect(hit->point, hit->normal);
+			R_r.setExcluded(leftShape(*hit, R_r.getDir()));
+			findClosestHit(R_r, next);
+			hit = &next;
+			weight = nextWeight;
+			depth++;
+			if (hit->obj == 0) {
+				finalColor.add(DEFAULT_BKCOLOR * weight);
+				break;
+			}
+		}
+		return finalColor.get();
+	}
+
+	/**
+	 * Finds the lights that may light some point in the given box, like the
+	 * visible points of a screen tile, according to @c light::mayLight .
+	 *
+	 * @param box Box around the shading points.
+	 * @param[out] out Receives the indices of the lights in increasing order.
+	 *   Anything in it is discarded.
+	 */
+	void findTileLights(const aabb<vec_T, dim> &box,
+			std::vector<int> &out) const {
+		out.clear();
+		for (int i = 0; i < (int) lights.size(); i++)
+			if (lights[i]->mayLight(box))
+				out.push_back(i);
+	}
+
+	/**
+	 * The visibility pass of a render: traces the camera ray of every pixel
+	 * and stores it with its closest hit in a G-buffer. Rays are traced in
+	 * packets of @c RENDER_PACKET_WIDTH neighboring pixels, a band of
+	 * @c RENDER_TILE_SIZE rows at a time on each of @c setRenderThreads
+	 * threads. With @c setRasterPrimary or @c setTileFrustums , the shapes
+	 * are binned by the screen tiles their boxes may show up in first and
+	 * each ray is only tested against the candidates of its pixel, with the
+	 * same hits.
+	 *
+	 * @param cam The camera in this scene.
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param[out] gb Receives the camera rays and their hits.
+	 */
+	void renderGBuffer(const camera<vec_T, time_T, dim> &cam,
+			int width, int height,
+			gbuffer<vec_T, color_T, time_T, dim> &gb) const {
+		gb.resize(width, height);
+		if (width == 0 || height == 0)
+			return;
+		std::vector<int> bands((height + RENDER_TILE_SIZE - 1) /
+				RENDER_TILE_SIZE);
+		for (size_t i = 0; i < bands.size(); i++)
+			bands[i] = (int) i;
+		if (rasterPrimary || tileFrustums) {
+			primarybins<vec_T, time_T, dim> bins;
+			binShapes(cam, width, height, bins);
+			bandRasterizer rasterizer;
+			rasterizer.sc = this;
+			rasterizer.cam = &cam;
+			rasterizer.bins = &bins;
+			rasterizer.gb = &gb;
+			runTasks(bands, renderThreads, rasterizer, "raster band");
+			return;
+		}
+		bandTracer tracer;
+		tracer.sc = this;
+		tracer.cam = &cam;
+		tracer.gb = &gb;
+		runTasks(bands, renderThreads, tracer, "trace band");
+	}
+
+	/**
+	 * Like @c renderGBuffer , but takes most of the closest hits from the
+	 * G-buffer of an earlier frame of the same shapes seen by another
+	 * camera, like the frame before in a camera fly-through. The hit points
+	 * of the earlier frame are projected into the new image, the nearest
+	 * one kept in each pixel, and a pixel whose own and four neighbors'
+	 * points are all on the same shape is only intersected with that shape.
+	 * The rest, where something was uncovered or the image moved past the
+	 * earlier one, are traced. This is an approximation: a shape the
+	 * earlier frame didn't see, coming out from behind another where the
+	 * shape around it was seen, is missed where it's surrounded by that
+	 * shape's points, so the caller should trace a whole frame with
+	 * @c renderGBuffer now and then.
+	 *
+	 * @param cam The camera in this scene.
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param previous The G-buffer of the earlier frame, of any size.
+	 * @param[out] gb Receives the camera rays and their hits; not
+	 *   @c previous .
+	 *
+	 * @return The number of pixels whose hits were reprojected instead of
+	 *   traced.
+	 */
+	int reprojectGBuffer(const camera<vec_T, time_T, dim> &cam,
+			int width, int height,
+			const gbuffer<vec_T, color_T, time_T, dim> &previous,
+			gbuffer<vec_T, color_T, time_T, dim> &gb) const {
+		assert(&previous != &gb);
+		gb.resize(width, height);
+		if (width == 0 || height == 0)
+			return 0;
+		std::vector<int> candidates((size_t) width * height, -1);
+		std::vector<double> depths((size_t) width * height);
+		mvector<double, dim> eye, p;
+		for (int a = 0; a < dim; a++)
+			eye[a] = (double) cam.getPosition()[a];
+		int n = previous.getWidth() * previous.getHeight();
+		for (int i = 0; i < n; i++) {
+			const hitrecord<vec_T, color_T, time_T, dim> &rec =
+					previous.getHit(i);
+			if (rec.obj == 0)
+				continue;
+			for (int a = 0; a < dim; a++)
+				p[a] = (double) rec.point[a];
+			double x, y;
+			if (!cam.projectPoint(p, width, height, x, y) ||
+					!(x > -0.5 && x < width - 0.5 && y > -0.5 &&
+					y < height - 0.5))
+				continue;
+			int k = (int) (y + 0.5) * width + (int) (x + 0.5);
+			double d = (p - eye).magsq();
+			if (candidates[k] < 0 || d < depths[k]) {
+				candidates[k] = rec.id;
+				depths[k] = d;
+			}
+		}
+
+		std::vector<int> bands((height + RENDER_TILE_SIZE - 1) /
+				RENDER_TILE_SIZE);
+		for (size_t i = 0; i < bands.size(); i++)
+			bands[i] = (int) i;
+		std::vector<int> reused(bands.size());
+		bandReprojector reprojector;
+		reprojector.sc = this;
+		reprojector.cam = &cam;
+		reprojector.candidates = &candidates;
+		reprojector.gb = &gb;
+		reprojector.reused = &reused;
+		runTasks(bands, renderThreads, reprojector, "reproject band");
+		int total = 0;
+		for (size_t i = 0; i < reused.size(); i++)
+			total += reused[i];
+		return total;
+	}
+
+	/**
+	 * Bins every shape of this scene by the screen rectangle of its box,
+	 * for rasterizing the camera rays of an image; see @c primarybins .
+	 *
+	 * @param cam The camera in this scene.
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param[out] bins Receives the shapes.
+	 */
+	void binShapes(const camera<vec_T, time_T, dim> &cam, int width,
+			int height, primarybins<vec_T, time_T, dim> &bins) const {
+		bins.reset(width, height);
+		if (tileFrustums)
+			bins.cullByFrustum(cam);
+		addShapes(cam, bins);
+	}
+
+	/**
+	 * Bins every shape of this scene in bins already sized for an image,
+	 * or a strip of it, for @c binShapes and @c renderStrips .
+	 *
+	 * @param cam The camera in this scene.
+	 * @param bins The bins.
+	 */
+	void addShapes(const camera<vec_T, time_T, dim> &cam,
+			primarybins<vec_T, time_T, dim> &bins) const {
+		for (int i = 0; i < (int) shapes.size(); i++) {
+			aabb<vec_T, dim> box;
+			if (shapes[i]->getBounds(box))
+				bins.add(cam, i, box);
+			else
+				bins.addEverywhere(i);
+		}
+	}
+
+	/**
+	 * Makes @c renderGBuffer find the closest hits of camera rays by
+	 * binning the shapes by the screen rectangles of their boxes and
+	 * testing each ray against the candidates of its pixel, instead of
+	 * tracing it through the acceleration structure. The hits are the
+	 * same; this pays off for scenes of a few big shapes, like spheres,
+	 * cylinders and planes, where it saves walking the structure. Bands
+	 * rendered on their own, like by @c renderStreaming , are still traced.
+	 *
+	 * @param on Whether to rasterize.
+	 */
+	void setRasterPrimary(bool on) {
+		rasterPrimary = on;
+	}
+
+	/**
+	 * Like @c setRasterPrimary , but also checks the box of each shape
+	 * against the pyramid the camera rays of every screen tile it may show
+	 * up in sweep, so each tile gets a shorter list of candidates: the
+	 * corners of the screen rectangle of a sphere or a slanted cylinder
+	 * are dropped, and shapes reaching behind the camera are only tested
+	 * in the tiles they reach instead of in all of them. The hits are
+	 * still the same as tracing.
+	 *
+	 * @param on Whether to cull by tile.
+	 */
+	void setTileFrustums(bool on) {
+		tileFrustums = on;
+	}
+
+	/**
+	 * The shading pass of a render: works out the color of every pixel of a
+	 * G-buffer, including its lights and reflections. The buffer must have
+	 * been filled in by @c renderGBuffer for this scene, but the lights may
+	 * have changed since. Pixels are shaded in square tiles of
+	 * @c RENDER_TILE_SIZE pixels. The box around the hit points of a tile is
+	 * used to cull the lights that can't reach any of them, and the pixels of
+	 * a tile are shaded grouped by the shape they hit. The result is the same
+	 * as shading every pixel with all lights. Tiles are shaded in
+	 * @c mortonOrder , shared out among @c setRenderThreads threads, each
+	 * with a render context and tile buffers of its own; see
+	 * @c shadeTiles .
+	 *
+	 * @param gb The G-buffer.
+	 * @param[out] image Receives the color of every pixel, row by row.
+	 * @param ctx Render context to shade with, which receives the counters
+	 *   of all threads. A fresh one is used if this is 0.
+	 */
+	void shadeGBuffer(const gbuffer<vec_T, color_T, time_T, dim> &gb,
+			std::vector<rgbcolor<color_T> > &image,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx = 0) const {
+		image.resize((size_t) gb.getWidth() * gb.getHeight());
+		imageWriter writer;
+		writer.image = &image;
+		writer.width = gb.getWidth();
+		shadeTiles(gb, writer, ctx);
+	}
+
+	/**
+	 * @c shadeGBuffer into a framebuffer stored tile by tile, with tiles of
+	 * @c RENDER_TILE_SIZE pixels so every shaded tile is one block of
+	 * memory. The colors are the same.
+	 *
+	 * @param gb The G-buffer.
+	 * @param[out] fb Receives the color of every pixel.
+	 * @param ctx Render context to shade with, which receives the counters
+	 *   of all threads. A fresh one is used if this is 0.
+	 */
+	void shadeGBuffer(const gbuffer<vec_T, color_T, time_T, dim> &gb,
+			tiledframebuffer<color_T> &fb,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx = 0) const {
+		fb.resize(gb.getWidth(), gb.getHeight(), RENDER_TILE_SIZE);
+		tiledWriter writer;
+		writer.fb = &fb;
+		shadeTiles(gb, writer, ctx);
+	}
+
+	/**
+	 * The tile loop of @c shadeGBuffer , for writers that want each tile as
+	 * soon as it's shaded, e.g. to stream the image out. Every thread
+	 * shades into buffers of its own and publishes them to a
+	 * @c tilequeue ; with more than one thread the calling thread does no
+	 * shading and only passes the tiles from the queue to the writer, in
+	 * the order they were finished, so a slow writer never holds up the
+	 * shading.
+	 *
+	 * @param gb The G-buffer.
+	 * @param writer Functor with an @c operator()(const tilebuffer<color_T>&)
+	 *   called on the calling thread once per tile.
+	 * @param ctx Render context to shade with, which receives the counters
+	 *   of all threads. A fresh one is used if this is 0.
+	 */
+	template<typename writer_T>
+	void shadeTiles(const gbuffer<vec_T, color_T, time_T, dim> &gb,
+			writer_T &writer,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx = 0) const {
+		rendercontext<vec_T, color_T, time_T, dim> local;
+		if (ctx == 0)
+			ctx = &local;
+		const int T = RENDER_TILE_SIZE;
+		int width = gb.getWidth(), height = gb.getHeight();
+		std::vector<int> tiles;
+		mortonOrder((width + T - 1) / T, (height + T - 1) / T, tiles);
+		tilequeue<color_T> queue((int) tiles.size());
+		tileShader shader;
+		shader.sc = this;
+		shader.gb = &gb;
+		shader.image = 0;
+		shader.queue = &queue;
+		shader.tilesPerRow = (width + T - 1) / T;
+		shader.wavefront = false;
+		shader.pools = 0;
+		runShaders(shader, tiles, ctx, writer);
+	}
+
+	/**
+	 * Renders this scene a band of @c RENDER_TILE_SIZE rows at a time and
+	 * hands the bands to a writer strictly from the top down, each as soon
+	 * as it and all the ones above it are done, so output can start long
+	 * before the image is finished. Bands are rendered on
+	 * @c setRenderThreads threads, each with a G-buffer of one band, and
+	 * wait in a @c reorderbuffer of twice as many bands for the writer, so
+	 * memory is a few bands however tall the image is. The colors are the
+	 * same as those of @c shadeGBuffer ; anti-aliasing and multiple
+	 * samples per pixel aren't applied.
+	 *
+	 * @param cam The camera in this scene.
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param writer Functor with an @c operator()(const tilebuffer<color_T>&)
+	 *   called on the calling thread with every band in order. A band is
+	 *   a tile the width of the image.
+	 * @param ctx Render context to trace with, which receives the counters
+	 *   of all threads. A fresh one is used if this is 0.
+	 */
+	template<typename writer_T>
+	void renderStreaming(const camera<vec_T, time_T, dim> &cam,
+			int width, int height, writer_T &writer,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx = 0) const {
+		rendercontext<vec_T, color_T, time_T, dim> local;
+		if (ctx == 0)
+			ctx = &local;
+		int bands = (height + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+		int n = std::max(1, std::min(renderThreads, bands));
+		reorderbuffer<color_T> window(bands, 2 * n);
+		boost::atomic<int> next(0);
+		threadcontexts<vec_T, color_T, time_T, dim> ctxs(ctx, n);
+		boost::thread_group threads;
+		for (int i = 0; i < n; i++) {
+			bandStreamer task;
+			task.sc = this;
+			task.cam = &cam;
+			task.width = width;
+			task.height = height;
+			task.window = &window;
+			task.next = &next;
+			task.ctx = ctxs.get()[i];
+			task.thread = i;
+			threads.create_thread(task);
+		}
+		const tilebuffer<color_T> *band;
+		while (window.take(band)) {
+			runWriter(writer, *band, "write band");
+			window.release();
+		}
+		threads.join_all();
+		ctxs.mergeStats();
+	}
+
+	/**
+	 * Renders this scene a band of @c RENDER_TILE_SIZE rows at a time, like
+	 * @c renderStreaming , but hands every band to the sink on the thread
+	 * that rendered it, as soon as it's done and in no particular order.
+	 * This is for sinks that put each band in its own place, like a mapped
+	 * output file, so no thread waits for a writer. Each thread keeps one
+	 * band of its own. The colors are the same as those of
+	 * @c shadeGBuffer ; anti-aliasing and multiple samples per pixel aren't
+	 * applied.
+	 *
+	 * @param cam The camera in this scene.
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param sink Functor with an
+	 *   @c operator()(const tilebuffer<color_T>&) @c const called with every
+	 *   band, from all the render threads at once.
+	 * @param ctx Render context to trace with, which receives the counters
+	 *   of all threads. A fresh one is used if this is 0.
+	 */
+	template<typename sink_T>
+	void renderBands(const camera<vec_T, time_T, dim> &cam,
+			int width, int height, const sink_T &sink,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx = 0) const {
+		rendercontext<vec_T, color_T, time_T, dim> local;
+		if (ctx == 0)
+			ctx = &local;
+		std::vector<int> bands((height + RENDER_TILE_SIZE - 1) /
+				RENDER_TILE_SIZE);
+		for (size_t i = 0; i < bands.size(); i++)
+			bands[i] = (int) i;
+		int n = std::max(1, std::min(renderThreads, (int) bands.size()));
+		threadcontexts<vec_T, color_T, time_T, dim> ctxs(ctx, n);
+		boost::scoped_array<gbuffer<vec_T, color_T, time_T, dim> > gbs(
+				new gbuffer<vec_T, color_T, time_T, dim>[n]);
+		boost::scoped_array<tilebuffer<color_T> > tiles(
+				new tilebuffer<color_T>[n]), out(new tilebuffer<color_T>[n]);
+		bandRenderer<sink_T> task;
+		task.sc = this;
+		task.cam = &cam;
+		task.width = width;
+		task.height = height;
+		task.gbs = gbs.get();
+		task.tiles = tiles.get();
+		task.bands = out.get();
+		task.sink = &sink;
+		task.ctxs = ctxs.get();
+		runTasks(bands, n, task, "render band");
+		ctxs.mergeStats();
+	}
+
+	/**
+	 * Renders this scene a strip of rows at a time, from the top down, for
+	 * images too big to keep whole. Before each strip is rendered, the
+	 * shapes are culled to the pyramids of the strip's screen tiles and
+	 * binned as by @c setTileFrustums , and its camera rays are rasterized
+	 * against just those; the strip's bands are then rendered on
+	 * @c setRenderThreads threads and the whole strip handed to the writer
+	 * on the calling thread. Memory is the strip, its bins and a band per
+	 * thread, however tall the image is; shadow and reflection rays still
+	 * go through the acceleration structure of the whole scene, since they
+	 * may reach anything. The colors are the same as those of
+	 * @c shadeGBuffer ; anti-aliasing and multiple samples per pixel aren't
+	 * applied. Only for three dimensions.
+	 *
+	 * @param cam The camera in this scene.
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param stripRows Rows per strip, rounded up to a multiple of
+	 *   @c RENDER_TILE_SIZE .
+	 * @param writer Functor with an @c operator()(const tilebuffer<color_T>&)
+	 *   called on the calling thread with every strip in order. A strip is
+	 *   a tile the width of the image.
+	 * @param ctx Render context to trace with, which receives the counters
+	 *   of all threads. A fresh one is used if this is 0.
+	 */
+	template<typename writer_T>
+	void renderStrips(const camera<vec_T, time_T, dim> &cam,
+			int width, int height, int stripRows, writer_T &writer,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx = 0) const {
+		rendercontext<vec_T, color_T, time_T, dim> local;
+		if (ctx == 0)
+			ctx = &local;
+		const int T = RENDER_TILE_SIZE;
+		int rows = std::max(T, (stripRows + T - 1) / T * T);
+		int n = std::max(1, std::min(renderThreads, rows / T));
+		threadcontexts<vec_T, color_T, time_T, dim> ctxs(ctx, n);
+		boost::scoped_array<gbuffer<vec_T, color_T, time_T, dim> > gbs(
+				new gbuffer<vec_T, color_T, time_T, dim>[n]);
+		boost::scoped_array<tilebuffer<color_T> > tiles(
+				new tilebuffer<color_T>[n]), out(new tilebuffer<color_T>[n]);
+		primarybins<vec_T, time_T, dim> bins;
+		tilebuffer<color_T> strip;
+		stripRenderer task;
+		task.sc = this;
+		task.cam = &cam;
+		task.width = width;
+		task.height = height;
+		task.bins = &bins;
+		task.gbs = gbs.get();
+		task.tiles = tiles.get();
+		task.bands = out.get();
+		task.strip = &strip;
+		task.ctxs = ctxs.get();
+		std::vector<int> bands;
+		for (int y0 = 0; y0 < height; y0 += rows) {
+			int h = std::min(rows, height - y0);
+			bins.reset(width, height, y0, h);
+			bins.cullByFrustum(cam);
+			addShapes(cam, bins);
+			strip.place(0, y0, width, h);
+			bands.clear();
+			for (int b = y0 / T; b < (y0 + h + T - 1) / T; b++)
+				bands.push_back(b);
+			runTasks(bands, n, task, "render strip band");
+			runWriter(writer, strip, "write strip");
+		}
+		ctxs.mergeStats();
+	}
+
+	/**
+	 * A wavefront version of @c shadeGBuffer . Instead of following each
+	 * pixel's reflections recursively, rays are processed a band of
+	 * @c RENDER_TILE_SIZE rows at a time in stages: the band's camera hits
+	 * are shaded, which queues shadow rays and reflection rays; the shadow
+	 * queue is traced as a whole; then the reflection queue is traced with
+	 * the batch query of the acceleration structure and its hits are shaded
+	 * the same way, once per reflection depth. Every stage runs over its
+	 * whole queue before the next one, and the queues only ever hold one
+	 * band's rays, whatever @c MAX_REFLECT is. Bands are shared out among
+	 * @c setRenderThreads threads, each with queues of its own, which are
+	 * kept in this scene for the next pass; see @c wavefrontpool and
+	 * @c printWavefrontPools . Wavefront passes of one scene must not run
+	 * at the same time.
+	 *
+	 * Lights are culled per tile for camera hits as in @c shadeGBuffer . The
+	 * colors of scenes without reflections come out exactly the same as with
+	 * @c shadeGBuffer . Reflected light is added to a pixel scaled by the
+	 * product of the reflectivities instead of being summed from the
+	 * deepest reflection up, so it can differ in the last bits. See
+	 * @c setSortSecondaryRays for tracing the queues in a coherent order.
+	 *
+	 * @param gb The G-buffer.
+	 * @param[out] image Receives the color of every pixel, row by row.
+	 * @param ctx Render context to shade with, which receives the counters.
+	 *   A fresh one is used if this is 0.
+	 */
+	void shadeWavefront(const gbuffer<vec_T, color_T, time_T, dim> &gb,
+			std::vector<rgbcolor<color_T> > &image,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx = 0) const {
+		rendercontext<vec_T, color_T, time_T, dim> local;
+		if (ctx == 0)
+			ctx = &local;
+		const int T = RENDER_TILE_SIZE;
+		int width = gb.getWidth(), height = gb.getHeight();
+		image.assign((size_t) width * height, rgbcolor<color_T>());
+		tileShader shader;
+		shader.sc = this;
+		shader.gb = &gb;
+		shader.image = &image;
+		shader.queue = 0;
+		shader.tilesPerRow = 0;
+		shader.wavefront = true;
+		if ((int) wavefrontPools.size() < renderThreads)
+			wavefrontPools.resize(renderThreads);
+		for (size_t i = 0; i < wavefrontPools.size(); i++)
+			for (size_t j = 0; j < wavefrontPools.size(); j++)
+				wavefrontPools[i].reserveLike(wavefrontPools[j]);
+		shader.pools = &wavefrontPools[0];
+		std::vector<int> bands((height + T - 1) / T);
+		for (size_t i = 0; i < bands.size(); i++)
+			bands[i] = (int) i;
+		imageWriter none;
+		runShaders(shader, bands, ctx, none);
+	}
+
+	/**
+	 * Writes the header of a PPM image, for writing the pixels after it
+	 * with @c writePPMPixels as they become available.
+	 *
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param os The output stream to which the PPM image will be written.
+	 * @param format Plain P3, the default, or raw P6.
+	 */
+	static void writePPMHeader(int width, int height, std::ostream &os,
+			ppmFormat format = PPM_P3) {
+		if (format == PPM_P6)
+			os << "P6\n" << width << " " << height << "\n" << COLORMAX << "\n";
+		else
+			os << "P3 " << width << " " << height << " " << COLORMAX << "\n";
+	}
+
+	/**
+	 * Writes pixels of a PPM image, which continue the ones written
+	 * before. They're quantized in one pass by @c framebuffer::quantize ;
+	 * P6 writes the result as it is, and P3 formats it into a buffer that
+	 * goes to the stream in blocks of @c PPM_WRITE_BLOCK bytes. The stream
+	 * isn't flushed.
+	 *
+	 * @param pixels The colors of the pixels, row by row.
+	 * @param os The output stream to which the PPM image is written.
+	 * @param format Plain P3, the default, or raw P6.
+	 * @param exposure What to multiply the colors by before quantizing.
+	 */
+	static void writePPMPixels(const std::vector<rgbcolor<color_T> > &pixels,
+			std::ostream &os, ppmFormat format = PPM_P3,
+			color_T exposure = 1) {
+		std::vector<unsigned char> rgb;
+		framebuffer<color_T>::quantize(pixels, rgb, exposure);
+		writePPMBytes(rgb, os, format);
+	}
+
+	/**
+	 * Writes quantized pixels of a PPM image, as @c writePPMPixels does
+	 * after quantizing them.
+	 *
+	 * @param rgb The red, green and blue of every pixel.
+	 * @param os The output stream to which the PPM image is written.
+	 * @param format Plain P3, the default, or raw P6.
+	 */
+	static void writePPMBytes(const std::vector<unsigned char> &rgb,
+			std::ostream &os, ppmFormat format = PPM_P3) {
+		if (format == PPM_P6) {
+			if (!rgb.empty())
+				os.write(reinterpret_cast<const char *>(&rgb[0]), rgb.size());
+			return;
+		}
+		std::vector<char> buf;
+		buf.reserve(PPM_WRITE_BLOCK + 64);
+		for (size_t i = 0; i < rgb.size(); i += 3) {
+			char line[64];
+			int n = snprintf(line, sizeof(line), "%d %d %d\n", rgb[i],
+					rgb[i + 1], rgb[i + 2]);
+			buf.insert(buf.end(), line, line + n);
+			if (buf.size() >= PPM_WRITE_BLOCK) {
+				os.write(&buf[0], buf.size());
+				buf.clear();
+			}
+		}
+		if (!buf.empty())
+			os.write(&buf[0], buf.size());
+	}
+
+	/**
+	 * Writes an image as PPM to the given output stream: the header from
+	 * @c writePPMHeader , then the pixels by @c writePPMPixels . The stream
+	 * is flushed once at the end.
+	 *
+	 * @param image The colors of the pixels, row by row.
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param os The output stream to which the PPM image will be written.
+	 * @param format Plain P3, the default, or raw P6.
+	 * @param exposure What to multiply the colors by before quantizing.
+	 */
+	static void writePPM(const std::vector<rgbcolor<color_T> > &image,
+			int width, int height, std::ostream &os,
+			ppmFormat format = PPM_P3, color_T exposure = 1) {
+		assert(image.size() == (size_t) width * height);
+		writePPMHeader(width, height, os, format);
+		writePPMPixels(image, os, format, exposure);
+		os.flush();
+	}
+
+	/**
+	 * Writes an image as PNG to the given output stream, 8 bits per channel
+	 * quantized as by @c writePPM . Filtering and compression are shared
+	 * out among threads by strips of rows; see @c encodePNG .
+	 *
+	 * @param image The colors of the pixels, row by row.
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param os The output stream to which the PNG image will be written,
+	 *   which should be in binary mode.
+	 * @param numThreads Number of threads to compress on. The file is the
+	 *   same for any number.
+	 * @param exposure What to multiply the colors by before quantizing.
+	 */
+	static void writePNG(const std::vector<rgbcolor<color_T> > &image,
+			int width, int height, std::ostream &os, int numThreads = 1,
+			color_T exposure = 1) {
+		assert(image.size() == (size_t) width * height);
+		std::vector<unsigned char> rgb;
+		framebuffer<color_T>::quantize(image, rgb, exposure);
+		encodePNG(rgb, width, height, os, numThreads);
+	}
+
+	/**
+	 * Anti-aliases an image rendered at one sample per pixel as set up by
+	 * @c setSupersampling , by tracing more rays for the pixels on edges.
+	 * Edges are found in the image as it was passed in, so refining a pixel
+	 * doesn't change which others are refined. Does nothing if
+	 * anti-aliasing is off.
+	 *
+	 * @param cam The camera the G-buffer was rendered with.
+	 * @param gb The G-buffer.
+	 * @param[in,out] image The colors shaded from the G-buffer, which
+	 *   receives the refined ones.
+	 * @param ctx Render context to trace with, which receives the counters
+	 *   of all threads. A fresh one is used if this is 0.
+	 */
+	void supersample(const camera<vec_T, time_T, dim> &cam,
+			const gbuffer<vec_T, color_T, time_T, dim> &gb,
+			std::vector<rgbcolor<color_T> > &image,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx = 0) const {
+		if (aaSamples <= 1)
+			return;
+		rendercontext<vec_T, color_T, time_T, dim> local;
+		if (ctx == 0)
+			ctx = &local;
+		const std::vector<rgbcolor<color_T> > base(image);
+		std::vector<int> bands((gb.getHeight() + RENDER_TILE_SIZE - 1) /
+				RENDER_TILE_SIZE);
+		for (size_t i = 0; i < bands.size(); i++)
+			bands[i] = (int) i;
+		int n = std::max(1, std::min(renderThreads, (int) bands.size()));
+		threadcontexts<vec_T, color_T, time_T, dim> ctxs(ctx, n);
+		bandSupersampler task;
+		task.sc = this;
+		task.cam = &cam;
+		task.gb = &gb;
+		task.base = &base;
+		task.image = &image;
+		task.ctxs = ctxs.get();
+		runTasks(bands, n, task, "supersample band");
+		ctxs.mergeStats();
+	}
+
+	/**
+	 * Renders this scene with several stratified, jittered samples per pixel
+	 * as set by @c setPixelSamples . The samples of a pixel are traced as
+	 * one batch and their colors averaged before they're quantized. Bands of
+	 * rows are shared out among @c setRenderThreads threads.
+	 *
+	 * @param cam The camera in this scene.
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param[out] image Receives the color of every pixel, row by row.
+	 * @param ctx Render context to trace with, which receives the counters
+	 *   of all threads. A fresh one is used if this is 0.
+	 */
+	void renderMultisampled(const camera<vec_T, time_T, dim> &cam,
+			int width, int height, std::vector<rgbcolor<color_T> > &image,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx = 0) const {
+		rendercontext<vec_T, color_T, time_T, dim> local;
+		if (ctx == 0)
+			ctx = &local;
+		image.resize((size_t) width * height);
+		std::vector<int> bands((height + RENDER_TILE_SIZE - 1) /
+				RENDER_TILE_SIZE);
+		for (size_t i = 0; i < bands.size(); i++)
+			bands[i] = (int) i;
+		int n = std::max(1, std::min(renderThreads, (int) bands.size()));
+		threadcontexts<vec_T, color_T, time_T, dim> ctxs(ctx, n);
+		bandMultisampler task;
+		task.sc = this;
+		task.cam = &cam;
+		task.image = &image;
+		task.width = width;
+		task.height = height;
+		task.ctxs = ctxs.get();
+		runTasks(bands, n, task, "multisample band");
+		ctxs.mergeStats();
+	}
+
+	/**
+	 * Renders this scene for the given camera and image size. This is
+	 * @c renderGBuffer followed by @c shadeGBuffer and @c supersample , or
+	 * @c renderMultisampled with more than one sample per pixel, and then
+	 * the @c denoiser if @c setDenoisePasses turned it on.
+	 *
+	 * @param cam The camera in this scene.
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param[out] image Receives the color of every pixel, row by row.
+	 * @param ctx Render context to trace with, which receives the counters
+	 *   of the render. A fresh one is used if this is 0.
+	 * @param[out] guides If not 0, receives the G-buffer of the render,
+	 *   e.g. for the depth or normals of the pixels. With more than one
+	 *   sample per pixel that's a visibility pass of its own.
+	 */
+	void renderImage(const camera<vec_T, time_T, dim> &cam,
+			int width, int height, std::vector<rgbcolor<color_T> > &image,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx = 0,
+			gbuffer<vec_T, color_T, time_T, dim> *guides = 0) const {
+		// Without a cost map nothing of the scene is written, so renders
+		// can run at the same time.
+		if (costMap != 0) {
+			costMap->assign((size_t) width * height, 0);
+			costTarget = costMap;
+		}
+		gbuffer<vec_T, color_T, time_T, dim> own;
+		gbuffer<vec_T, color_T, time_T, dim> &gb = guides ? *guides : own;
+		if (pixelSamples > 1) {
+			renderMultisampled(cam, width, height, image, ctx);
+			if (denoisePasses > 0 || guides)
+				renderGBuffer(cam, width, height, gb);
+		}
+		else {
+			renderGBuffer(cam, width, height, gb);
+			shadeGBuffer(gb, image, ctx);
+			supersample(cam, gb, image, ctx);
+		}
+		if (denoisePasses > 0)
+			denoiser<vec_T, color_T, time_T, dim>(denoisePasses).filter(gb,
+					image, renderThreads);
+		if (costMap != 0)
+			costTarget = 0;
+	}
+
+	/**
+	 * Renders one square tile of an image on the calling thread, exactly
+	 * as @c renderTiles renders it, for schedulers that share out the
+	 * tiles of several renders themselves; see @c renderscheduler .
+	 *
+	 * @param cam The camera in this scene.
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param tile Number of the tile, counting row by row.
+	 * @param[in,out] image The image, row by row, which is already sized
+	 *   and receives the colors of the tile.
+	 * @param ctx The calling thread's render context, which must only be
+	 *   used with this scene.
+	 * @param tileSize Side of the tiles in pixels.
+	 * @param samples Samples per pixel along each axis, or 0 for those of
+	 *   @c setPixelSamples , so renders of different quality can share the
+	 *   scene at once.
+	 */
+	void renderTile(const camera<vec_T, time_T, dim> &cam, int width,
+			int height, int tile, std::vector<rgbcolor<color_T> > &image,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx,
+			int tileSize = RENDER_TILE_SIZE, int samples = 0) const {
+		assert(image.size() == (size_t) width * height && tileSize > 0);
+		assert(ctx != 0);
+		int tilesPerRow = (width + tileSize - 1) / tileSize;
+		int tx = tile % tilesPerRow * tileSize;
+		int ty = tile / tilesPerRow * tileSize;
+		assert(ty < height);
+		renderRect(cam, tx, ty, std::min(width, tx + tileSize),
+				std::min(height, ty + tileSize), width, height,
+				&image[(size_t) ty * width + tx], width, ctx, samples);
+	}
+
+	/**
+	 * Renders some of the square tiles of an image and leaves the rest of
+	 * it alone. Each tile comes out exactly as @c renderImage renders it,
+	 * with anti-aliasing or several samples per pixel as they're set; with
+	 * anti-aliasing a one pixel border around each tile is traced too, so
+	 * bigger tiles waste less. Tiles are shared out among
+	 * @c setRenderThreads threads.
+	 *
+	 * @param cam The camera in this scene.
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param tiles Numbers of the tiles, counting row by row, as from
+	 *   @c dirtytiles::getTiles .
+	 * @param[in,out] image The image, row by row, which is already sized
+	 *   and receives the colors of the tiles.
+	 * @param ctx Render context to trace with, which receives the counters
+	 *   of all threads. A fresh one is used if this is 0.
+	 * @param tileSize Side of the tiles in pixels.
+	 */
+	void renderTiles(const camera<vec_T, time_T, dim> &cam, int width,
+			int height, const std::vector<int> &tiles,
+			std::vector<rgbcolor<color_T> > &image,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx = 0,
+			int tileSize = RENDER_TILE_SIZE) const {
+		assert(image.size() == (size_t) width * height && tileSize > 0);
+		tileRenderer task;
+		task.size = tileSize;
+		task.cam = &cam;
+		task.image = &image;
+		task.width = width;
+		task.height = height;
+		task.x0 = 0;
+		task.y0 = 0;
+		task.x1 = width;
+		task.y1 = height;
+		runTileRenderer(task, tiles, ctx);
+	}
+
+	/**
+	 * Renders a window of an image, with the camera rays of the whole
+	 * image, so that images of windows that cover it can be put together
+	 * into exactly the image @c renderImage renders, e.g. after rendering
+	 * them on different machines. The window is rendered in tiles of
+	 * @c RENDER_TILE_SIZE pixels as by @c renderTiles .
+	 *
+	 * @param cam The camera in this scene.
+	 * @param width The width of the whole image in pixels.
+	 * @param height The height of the whole image in pixels.
+	 * @param x0 Left column of the window.
+	 * @param y0 Top row of the window.
+	 * @param x1 Column just right of the window.
+	 * @param y1 Row just below the window.
+	 * @param[out] image Receives the colors of the window, row by row.
+	 * @param ctx Render context to trace with, which receives the counters
+	 *   of all threads. A fresh one is used if this is 0.
+	 */
+	void renderCrop(const camera<vec_T, time_T, dim> &cam, int width,
+			int height, int x0, int y0, int x1, int y1,
+			std::vector<rgbcolor<color_T> > &image,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx = 0) const {
+		assert(0 <= x0 && x0 < x1 && x1 <= width);
+		assert(0 <= y0 && y0 < y1 && y1 <= height);
+		const int T = RENDER_TILE_SIZE;
+		image.resize((size_t) (x1 - x0) * (y1 - y0));
+		std::vector<int> tiles(((x1 - x0 + T - 1) / T) *
+				((y1 - y0 + T - 1) / T));
+		for (size_t i = 0; i < tiles.size(); i++)
+			tiles[i] = (int) i;
+		tileRenderer task;
+		task.size = T;
+		task.cam = &cam;
+		task.image = &image;
+		task.width = width;
+		task.height = height;
+		task.x0 = x0;
+		task.y0 = y0;
+		task.x1 = x1;
+		task.y1 = y1;
+		runTileRenderer(task, tiles, ctx);
+	}
+
+	/**
+	 * Brings an image up to date with the edits since the last
+	 * @c clearEdits by rendering only the tiles @c findDirtyTiles marks,
+	 * with @c renderTiles , and then clears the edits. The image must be
+	 * one @c renderImage made before the edits, with the same camera and
+	 * size, or one this brought up to date since; it comes out the same as
+	 * a new @c renderImage .
+	 *
+	 * @param cam The camera of the image.
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param[in,out] image The image, row by row.
+	 * @param ctx Render context to trace with, which receives the counters
+	 *   of all threads. A fresh one is used if this is 0.
+	 *
+	 * @return The number of tiles rendered.
+	 */
+	int renderEdits(const camera<vec_T, time_T, dim> &cam, int width,
+			int height, std::vector<rgbcolor<color_T> > &image,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx = 0) {
+		dirtytiles dirty(width, height, RENDER_TILE_SIZE);
+		findDirtyTiles(cam, width, height, dirty);
+		std::vector<int> tiles;
+		dirty.getTiles(tiles);
+		renderTiles(cam, width, height, tiles, image, ctx);
+		clearEdits();
+		return (int) tiles.size();
+	}
+
+	/**
+	 * Renders this scene for the given camera and image size as a PPM
+	 * formatted image to the given output stream. This is
+	 * @c renderImage followed by @c writePPM .
+	 *
+	 * @param cam The camera in this scene.
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param os The output stream to which the PPM image will be written.
+	 * @param ctx Render context to trace with, which receives the counters
+	 *   of the render. A fresh one is used if this is 0.
+	 * @param format Plain P3, the default, or raw P6.
+	 */
+	void renderPPM(const camera<vec_T, time_T, dim> &cam,
+			int width, int height,
+			std::ostream &os,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx = 0,
+			ppmFormat format = PPM_P3) const {
+		std::vector<rgbcolor<color_T> > image;
+		renderImage(cam, width, height, image, ctx);
+		writePPM(image, width, height, os, format);
+	}
+
+	/**
+	 * Renders this scene in passes that each double the resolution of the
+	 * last, for previews that show up right away. The first pass traces one
+	 * ray per block of @c coarsest pixels and fills the block with its
+	 * color; every following pass halves the blocks and only traces the
+	 * pixels that are new, so the whole render traces each camera ray once.
+	 * The last pass, with blocks of one pixel, is exactly the image
+	 * @c shadeGBuffer makes. Rows of a pass are shared out among
+	 * @c setRenderThreads threads.
+	 *
+	 * @param cam The camera in this scene.
+	 * @param width The width of the image in pixels.
+	 * @param height The height of the image in pixels.
+	 * @param sink Functor with an
+	 *   @c operator()(const std::vector<rgbcolor<color_T> >&, int width,
+	 *   int height, int block) called after each pass with the image so far,
+	 *   row by row, and the block size of the pass.
+	 * @param ctx Render context to trace with, which receives the counters
+	 *   of the render. A fresh one is used if this is 0.
+	 * @param coarsest Size of the blocks of the first pass in pixels, a
+	 *   power of 2.
+	 * @param cancel Flag that stops the render when set, from any thread:
+	 *   the rows of the pass under way that haven't started are skipped, and
+	 *   neither that pass nor any after it goes to the sink. Never set if
+	 *   this is 0.
+	 *
+	 * @return @c false if the render was stopped before its last pass.
+	 */
+	template<typename sink_T>
+	bool renderProgressive(const camera<vec_T, time_T, dim> &cam,
+			int width, int height, sink_T &sink,
+			rendercontext<vec_T, color_T, time_T, dim> *ctx = 0,
+			int coarsest = RENDER_PROGRESSIVE_BLOCK,
+			const boost::atomic<bool> *cancel = 0) const {
+		assert(coarsest > 0 && (coarsest & (coarsest - 1)) == 0);
+		rendercontext<vec_T, color_T, time_T, dim> local;
+		if (ctx == 0)
+			ctx = &local;
+		std::vector<rgbcolor<color_T> > image((size_t) width * height);
+		progressiveRow pass;
+		pass.sc = this;
+		pass.cam = &cam;
+		pass.image = &image;
+		pass.width = width;
+		pass.height = height;
+		pass.cancel = cancel;
+		for (int block = coarsest; block > 0; block /= 2) {
+			std::vector<int> rows((height + block - 1) / block);
+			for (size_t i = 0; i < rows.size(); i++)
+				rows[i] = (int) i;
+			int n = std::max(1, std::min(renderThreads, (int) rows.size()));
+			threadcontexts<vec_T, color_T, time_T, dim> ctxs(ctx, n);
+			pass.block = block;
+			pass.first = block == coarsest;
+			pass.ctxs = ctxs.get();
+			runTasks(rows, n, pass, "progressive row");
+			ctxs.mergeStats();
+			if (cancel != 0 && cancel->load())
+				return false;
+			sink(image, width, height, block);
+		}
+		return true;
+	}
+
+	/**
+	 * Prints scene contents to the given output stream.
+	 *
+	 * @param os The output stream to which the scene attributes will be
+	 *   written.
+	 */
+	void printHelper(std::ostream &os) const {
+		os << "scene: shadows " << (useShadows ? "ON" : "OFF") << std::endl;
+		os << "  accelerator: ";
+		if (accel != 0)
+			os << *accel << (accelBuilt ? "" : " (not built)") << std::endl;
+		else
+			os << "linear scan" << std::endl;
+		os << "  bounded shapes: " << boundedShapes.size() <<
+				", unbounded shapes: " << unboundedShapes.size() << std::endl;
+		os << "  lights:" << std::endl;
+		typename std::vector<sp_light>::const_iterator iter;
+		for (iter = lights.begin(); iter < lights.end(); iter++) {
+			os << "    " << **iter << std::endl;
 		}
 
 		os << "  shapes:" << std::endl;
@@ -0,0 +1,400 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "scenerecord.hh"
+#include "sceneparser.hh"
+#include "scene.hh"
+#include "motion.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "arena.hh"
+#include "boost/shared_ptr.hpp"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef SCENEDIFF_HH
+#define SCENEDIFF_HH
+
+/**
+ * One shape of a scene description: the record that makes it and the move
+ * after it, if there is one.
+ */
+struct sceneshaperecord {
+	/** Index of the record of the shape. */
+	int record;
+	/** Index of the move after it, or -1. */
+	int move;
+};
+
+/**
+ * What changed from one scene description to the next, in terms of the
+ * edits a finalized scene can take in place: shapes moved, recolored,
+ * removed or inserted, and lights moved or recolored. Cameras and keys
+ * are left out, since they don't change the scene.
+ */
+struct scenediff {
+	/**
+	 * For every shape of the new description, the index of the shape of
+	 * the old one it's an edit of, or -1 if it's new.
+	 */
+	std::vector<int> shapeFrom;
+
+	/** For every shape of the new description, its records. */
+	std::vector<sceneshaperecord> shapes;
+
+	/** For every shape of the new description, whether it moved. */
+	std::vector<char> moved;
+
+	/** For every shape of the new description, whether it was recolored. */
+	std::vector<char> recolored;
+
+	/** Indices of the shapes of the old description that are gone. */
+	std::vector<int> removed;
+
+	/** Indices among the lights of the lights that changed. */
+	std::vector<int> lights;
+
+	/** For every light in @c lights , its record in the new description. */
+	std::vector<int> lightRecords;
+
+	/**
+	 * Counts the edits.
+	 *
+	 * @return The number of shapes moved, recolored, removed or inserted
+	 *   and of lights changed.
+	 */
+	int count() const {
+		int n = (int) (removed.size() + lights.size());
+		for (size_t i = 0; i < shapeFrom.size(); i++)
+			n += shapeFrom[i] < 0 || moved[i] || recolored[i];
+		return n;
+	}
+};
+
+/**
+ * Tells if a record makes a shape.
+ *
+ * @param kind The @c sceneRecordKind .
+ *
+ * @return @c true for spheres, planes, cylinders, geometry and meshes.
+ */
+inline bool isSceneShapeRecord(int kind) {
+	return kind == RECORD_SPHERE || kind == RECORD_PLANE ||
+			kind == RECORD_CYLINDER || kind == RECORD_GEOMETRY ||
+			kind == RECORD_MESH;
+}
+
+/**
+ * Tells if a record makes a light.
+ *
+ * @param kind The @c sceneRecordKind .
+ *
+ * @return @c true for lights, spotlights and area lights.
+ */
+inline bool isSceneLightRecord(int kind) {
+	return kind == RECORD_LIGHT || kind == RECORD_SPOTLIGHT ||
+			kind == RECORD_AREALIGHT;
+}
+
+/**
+ * Finds the shapes of a description, in the order they're added to a scene.
+ *
+ * @param desc The description.
+ * @param[out] shapes Receives the shapes.
+ */
+inline void findSceneShapes(const scenedescription &desc,
+		std::vector<sceneshaperecord> &shapes) {
+	shapes.clear();
+	for (size_t i = 0; i < desc.records.size(); i++) {
+		if (!isSceneShapeRecord(desc.records[i].kind))
+			continue;
+		sceneshaperecord s;
+		s.record = (int) i;
+		s.move = i + 1 < desc.records.size() &&
+				desc.records[i + 1].kind == RECORD_MOVE ? (int) i + 1 : -1;
+		shapes.push_back(s);
+	}
+}
+
+/**
+ * Finds the lights of a description, in the order they're added to a scene.
+ *
+ * @param desc The description.
+ * @param[out] lights Receives the indices of their records.
+ */
+inline void findSceneLights(const scenedescription &desc,
+		std::vector<int> &lights) {
+	lights.clear();
+	for (size_t i = 0; i < desc.records.size(); i++)
+		if (isSceneLightRecord(desc.records[i].kind))
+			lights.push_back((int) i);
+}
+
+/**
+ * Compares some fields of two records of the same kind, with the files
+ * they name compared by name rather than by index.
+ *
+ * @param a A record of @c da .
+ * @param da Its description.
+ * @param b A record of @c db of the same kind.
+ * @param db Its description.
+ * @param first Index of the first field, a letter of
+ *   @c sceneRecordLayout .
+ * @param last One past the last field.
+ *
+ * @return @c true if the fields are the same.
+ */
+inline bool sameSceneFields(const scenerecord &a, const scenedescription &da,
+		const scenerecord &b, const scenedescription &db, int first,
+		int last) {
+	assert(a.kind == b.kind);
+	const char *layout = sceneRecordLayout(a.kind);
+	int v = 0;
+	for (int f = 0; layout[f] && f < last; f++) {
+		int size = layout[f] == 'C' || layout[f] == 'V' ? 3 : 1;
+		if (f >= first) {
+			if (layout[f] == 'P' || layout[f] == 'N') {
+				double x = a.values[v], y = b.values[v];
+				if ((x < 0) != (y < 0) || (x >= 0 &&
+						da.paths[(size_t) x] != db.paths[(size_t) y]))
+					return false;
+			}
+			else if (memcmp(a.values + v, b.values + v,
+					size * sizeof(double)) != 0) {
+				return false;
+			}
+		}
+		v += size;
+	}
+	return true;
+}
+
+/**
+ * Compares two records in full, as @c sameSceneFields does.
+ *
+ * @return @c true if they make the same object.
+ */
+inline bool sameSceneRecord(const scenerecord &a, const scenedescription &da,
+		const scenerecord &b, const scenedescription &db) {
+	return a.kind == b.kind && sameSceneFields(a, da, b, db, 0,
+			SCENE_RECORD_VALUES);
+}
+
+/**
+ * Compares two shapes, with their moves.
+ *
+ * @return @c true if they make the same shape.
+ */
+inline bool sameSceneShape(const sceneshaperecord &a,
+		const scenedescription &da, const sceneshaperecord &b,
+		const scenedescription &db) {
+	if (!sameSceneRecord(da.records[a.record], da, db.records[b.record], db))
+		return false;
+	if ((a.move < 0) != (b.move < 0))
+		return false;
+	return a.move < 0 || sameSceneRecord(da.records[a.move], da,
+			db.records[b.move], db);
+}
+
+/**
+ * Works out how to edit a scene made from one description into the scene
+ * of another. Shapes the same in both are kept. Between the first and the
+ * last that differ, shapes are paired up in order: a sphere or cylinder
+ * that only moved is moved, a shape that only changed color is
+ * recolored, and any other pair is a removal and an insertion, as are
+ * shapes left over on either side. Adding or removing a light, changing
+ * its kind, or changing anything about it but the position of a point
+ * light or the color of a point light or spotlight can't be done in place.
+ *
+ * @param before The description the scene was made from.
+ * @param after The new description.
+ * @param[out] diff Receives the edits.
+ *
+ * @return @c false if the scene has to be made again from @c after .
+ */
+inline bool diffSceneDescriptions(const scenedescription &before,
+		const scenedescription &after, scenediff &diff) {
+	std::vector<int> oldLights, newLights;
+	findSceneLights(before, oldLights);
+	findSceneLights(after, newLights);
+	if (oldLights.size() != newLights.size())
+		return false;
+	diff.lights.clear();
+	diff.lightRecords.clear();
+	for (size_t i = 0; i < oldLights.size(); i++) {
+		const scenerecord &a = before.records[oldLights[i]];
+		const scenerecord &b = after.records[newLights[i]];
+		if (a.kind != b.kind)
+			return false;
+		if (sameSceneRecord(a, before, b, after))
+			continue;
+		// Only the color of a spotlight can change, since its direction
+		// depends on where it is.
+		if (a.kind == RECORD_AREALIGHT || (a.kind == RECORD_SPOTLIGHT &&
+				!sameSceneFields(a, before, b, after, 1,
+				SCENE_RECORD_VALUES)))
+			return false;
+		diff.lights.push_back((int) i);
+		diff.lightRecords.push_back(newLights[i]);
+	}
+
+	std::vector<sceneshaperecord> old;
+	findSceneShapes(before, old);
+	findSceneShapes(after, diff.shapes);
+	const std::vector<sceneshaperecord> &shapes = diff.shapes;
+	size_t n = shapes.size(), m = old.size(), first = 0, tail = 0;
+	while (first < n && first < m &&
+			sameSceneShape(old[first], before, shapes[first], after))
+		first++;
+	while (tail < n - first && tail < m - first &&
+			sameSceneShape(old[m - 1 - tail], before, shapes[n - 1 - tail],
+			after))
+		tail++;
+	diff.shapeFrom.assign(n, -1);
+	diff.moved.assign(n, 0);
+	diff.recolored.assign(n, 0);
+	diff.removed.clear();
+	for (size_t i = 0; i < first; i++)
+		diff.shapeFrom[i] = (int) i;
+	for (size_t i = 0; i < tail; i++)
+		diff.shapeFrom[n - 1 - i] = (int) (m - 1 - i);
+	for (size_t i = first; i < m - tail; i++) {
+		if (i < n - tail) {
+			const scenerecord &a = before.records[old[i].record];
+			const scenerecord &b = after.records[shapes[i].record];
+			bool plain = a.kind == b.kind && old[i].move < 0 &&
+					shapes[i].move < 0 && a.kind != RECORD_GEOMETRY;
+			// The color is field 0 and the center of what can move is 2.
+			bool sameColor = plain && sameSceneFields(a, before, b, after, 0,
+					1);
+			bool movable = a.kind == RECORD_SPHERE ||
+					a.kind == RECORD_CYLINDER;
+			bool sameRest = plain && (movable ?
+					sameSceneFields(a, before, b, after, 1, 2) &&
+					sameSceneFields(a, before, b, after, 3,
+					SCENE_RECORD_VALUES) :
+					sameSceneFields(a, before, b, after, 1,
+					SCENE_RECORD_VALUES));
+			bool sameCenter = plain && (!movable ||
+					sameSceneFields(a, before, b, after, 2, 3));
+			if (sameRest) {
+				diff.shapeFrom[i] = (int) i;
+				diff.moved[i] = !sameCenter;
+				diff.recolored[i] = !sameColor;
+				continue;
+			}
+		}
+		diff.removed.push_back((int) i);
+	}
+	return true;
+}
+
+/**
+ * Applies the edits of @c diffSceneDescriptions to a finalized scene with
+ * its edit methods, so an accelerator that can take edits in place, like
+ * a @c dynamicbvh , isn't rebuilt. New shapes are added after the others
+ * with @c scene::insertShape , so the shapes of the scene are no longer in
+ * the order of the description; @c ids keeps track of where each is.
+ * Point lights and spotlights are edited in place only if every light of
+ * the description is one light of the scene, which area lights in
+ * @c AREA_LIGHT_GRID mode aren't.
+ *
+ * @param sc The scene.
+ * @param after The new description.
+ * @param diff The edits from the description the scene was made from.
+ * @param[in,out] ids The index in @c scene::getShapes of every shape of
+ *   the old description, which receives those of the new one.
+ * @param[out] error Receives what's wrong, if anything.
+ *
+ * @return @c false if a shape can't be made or the edits can't be done in
+ *   place, in which case the scene may be half edited and should be made
+ *   again.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+bool applySceneDiff(scene<vec_T, color_T, time_T, 3> &sc,
+		const scenedescription &after, const scenediff &diff,
+		std::vector<int> &ids, std::string &error) {
+	typedef motionshape<vec_T, color_T, time_T, 3> motion_t;
+	std::vector<int> lights;
+	findSceneLights(after, lights);
+	if (!diff.lights.empty() && sc.getLights().size() != lights.size()) {
+		error = "area lights are split into point lights.";
+		return false;
+	}
+	// Removals go first, from the last shape of the scene down, and every
+	// shape after one removed moves down an index.
+	std::vector<int> removed;
+	for (size_t i = 0; i < diff.removed.size(); i++)
+		removed.push_back(ids[diff.removed[i]]);
+	std::sort(removed.begin(), removed.end());
+	for (size_t i = removed.size(); i-- > 0; ) {
+		sc.removeShape(removed[i]);
+		for (size_t k = 0; k < ids.size(); k++)
+			if (ids[k] > removed[i])
+				ids[k]--;
+	}
+
+	std::vector<int> next(diff.shapes.size());
+	const sp_arena &pool = sc.getArena();
+	for (size_t k = 0; k < diff.shapes.size(); k++) {
+		const scenerecord &rec = after.records[diff.shapes[k].record];
+		if (!isValidSceneRecord(rec, after.paths.size())) {
+			error = invalidSceneRecordError(rec, diff.shapes[k].record);
+			return false;
+		}
+		scenerecordfields f = { rec.values };
+		int from = diff.shapeFrom[k];
+		if (from >= 0) {
+			int id = ids[from];
+			next[k] = id;
+			if (diff.recolored[k])
+				sc.recolorShape(id, f.color<color_T>());
+			if (diff.moved[k]) {
+				// Past the color and the radius.
+				scenerecordfields c = { rec.values + 4 };
+				if (!sc.moveShape(id, c.vector<vec_T>())) {
+					error = "a shape can't be moved.";
+					return false;
+				}
+			}
+			continue;
+		}
+		boost::shared_ptr<shape<vec_T, color_T, time_T, 3> > obj;
+		if (!makeSceneShape(rec, after.paths, pool, obj, error))
+			return false;
+		int move = diff.shapes[k].move;
+		if (move >= 0) {
+			if (!isValidSceneRecord(after.records[move],
+					after.paths.size())) {
+				error = invalidSceneRecordError(after.records[move], move);
+				return false;
+			}
+			scenerecordfields m = { after.records[move].values };
+			obj = boost::allocate_shared<motion_t>(
+					arenaallocator<motion_t>(pool), obj, m.vector<vec_T>());
+		}
+		next[k] = (int) sc.getShapes().size();
+		sc.insertShape(obj);
+	}
+	ids.swap(next);
+
+	for (size_t i = 0; i < diff.lights.size(); i++) {
+		const scenerecord &rec = after.records[diff.lightRecords[i]];
+		if (!isValidSceneRecord(rec, after.paths.size())) {
+			error = invalidSceneRecordError(rec, diff.lightRecords[i]);
+			return false;
+		}
+		scenerecordfields f = { rec.values };
+		rgbcolor<color_T> color = f.color<color_T>();
+		mvector<vec_T, 3> pos = rec.kind == RECORD_LIGHT ?
+				f.vector<vec_T>() : sc.getLights()[diff.lights[i]]->getPos();
+		sc.editLight(diff.lights[i], pos, color);
+	}
+	return true;
+}
+
+#endif // SCENEDIFF_HH
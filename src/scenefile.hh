@@ -0,0 +1,391 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "scenerecord.hh"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifndef SCENEFILE_HH
+#define SCENEFILE_HH
+
+/**
+ * First word of a compiled scene, "RTB3" in ASCII.
+ */
+#define SCENE_FILE_MAGIC 0x33425452
+
+/**
+ * Alignment in bytes of the sections of a compiled scene, a cache line.
+ */
+#define SCENE_FILE_ALIGN 64
+
+/**
+ * The start of a compiled scene, which says where its sections are.
+ * Offsets are from the start of the file.
+ */
+struct scenefileheader {
+	/** @c SCENE_FILE_MAGIC . */
+	int magic;
+	/** Size of a @c scenerecord in bytes. */
+	int recordSize;
+	/** Size of the vector components the scene was read as. */
+	int vecSize;
+	/** Size of the color channels the scene was read as. */
+	int colorSize;
+	/** Size of the times of the scene the tree was built for. */
+	int timeSize;
+	/** The @c bvhBuilder that built the tree, or -1 if there's none. */
+	int treeBuilder;
+	/** Number of records. */
+	long long recordCount;
+	/** Offset of the first record. */
+	long long recordOffset;
+	/** Offset of the tree written by @c scene::writeAccelerator . */
+	long long treeOffset;
+	/** Size of the tree in bytes, 0 if there's none. */
+	long long treeSize;
+	/** Number of files the records name. */
+	long long pathCount;
+	/** Offset of the file names, each followed by a NUL. */
+	long long pathOffset;
+	/** Size of the file names in bytes. */
+	long long pathSize;
+	/** Number of @c scenechunk entries, 0 if the records aren't chunked.
+	 * Files written before there were chunks have 0 here, since the
+	 * header is padded with zeros. */
+	long long chunkCount;
+	/** Offset of the chunks. */
+	long long chunkOffset;
+};
+
+/**
+ * A run of records of a compiled scene whose shapes are close together,
+ * which can be loaded on its own when a ray reaches its box; see
+ * @c outofcore.hh . The chunks of a file follow each other and end with the
+ * last record.
+ */
+struct scenechunk {
+	/** Low corner of the box around the shapes of the records. */
+	double lo[3];
+	/** High corner of the box. */
+	double hi[3];
+	/** Index of the first record. */
+	long long first;
+	/** Number of records, more than 0. */
+	long long count;
+};
+
+/**
+ * Writes padding up to the next multiple of @c SCENE_FILE_ALIGN .
+ *
+ * @param os The output stream.
+ * @param offset Number of bytes written so far.
+ *
+ * @return The offset after the padding.
+ */
+inline long long padSceneFile(std::ostream &os, long long offset) {
+	static const char zeros[SCENE_FILE_ALIGN] = { 0 };
+	long long padded = (offset + SCENE_FILE_ALIGN - 1) / SCENE_FILE_ALIGN *
+			SCENE_FILE_ALIGN;
+	os.write(zeros, padded - offset);
+	return padded;
+}
+
+/**
+ * Writes a compiled scene: a @c scenefileheader , then the records as one
+ * array, the names of the files they refer to, the chunks and the tree,
+ * each starting on a multiple of @c SCENE_FILE_ALIGN . The names are kept
+ * as they were
+ * resolved when the scene was read. Like the trees of @c bvh::write , the
+ * format uses native byte order and sizes and is meant for the machine that wrote it;
+ * the records are valid only at the precision they were read at, which the
+ * header records.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ *
+ * @param os The output stream, which should be opened in binary mode.
+ * @param desc The objects.
+ * @param treeBuilder The @c bvhBuilder that built @c tree , or -1 for no
+ *   tree.
+ * @param tree The bytes written by @c scene::writeAccelerator after the
+ *   scene of @c desc was finalized, or an empty string.
+ * @param chunks The chunks of the records, which follow each other and end
+ *   with the last record, e.g. from @c chunkSceneRecords ; none by
+ *   default.
+ *
+ * @return @c true if everything was written.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+bool writeSceneFile(std::ostream &os, const scenedescription &desc,
+		int treeBuilder, const std::string &tree,
+		const std::vector<scenechunk> &chunks = std::vector<scenechunk>()) {
+	const std::vector<scenerecord> &records = desc.records;
+	std::string names;
+	for (size_t i = 0; i < desc.paths.size(); i++)
+		names.append(desc.paths[i].c_str(), desc.paths[i].size() + 1);
+	scenefileheader h;
+	memset(&h, 0, sizeof(h));
+	h.magic = SCENE_FILE_MAGIC;
+	h.recordSize = (int) sizeof(scenerecord);
+	h.vecSize = (int) sizeof(vec_T);
+	h.colorSize = (int) sizeof(color_T);
+	h.timeSize = (int) sizeof(time_T);
+	h.treeBuilder = tree.empty() ? -1 : treeBuilder;
+	h.recordCount = (long long) records.size();
+	long long align = SCENE_FILE_ALIGN;
+	h.recordOffset = (sizeof(h) + align - 1) / align * align;
+	long long recordEnd = h.recordOffset + h.recordCount *
+			(long long) sizeof(scenerecord);
+	h.pathCount = (long long) desc.paths.size();
+	h.pathOffset = (recordEnd + align - 1) / align * align;
+	h.pathSize = (long long) names.size();
+	long long pathEnd = h.pathOffset + h.pathSize;
+	h.chunkCount = (long long) chunks.size();
+	h.chunkOffset = (pathEnd + align - 1) / align * align;
+	long long chunkEnd = h.chunkOffset + h.chunkCount *
+			(long long) sizeof(scenechunk);
+	h.treeOffset = (chunkEnd + align - 1) / align * align;
+	h.treeSize = (long long) tree.size();
+
+	os.write((const char *) &h, sizeof(h));
+	padSceneFile(os, sizeof(h));
+	if (!records.empty())
+		os.write((const char *) &records[0],
+				records.size() * sizeof(scenerecord));
+	padSceneFile(os, recordEnd);
+	os.write(names.data(), names.size());
+	padSceneFile(os, pathEnd);
+	if (!chunks.empty())
+		os.write((const char *) &chunks[0],
+				chunks.size() * sizeof(scenechunk));
+	padSceneFile(os, chunkEnd);
+	os.write(tree.data(), tree.size());
+	return os.good();
+}
+
+/**
+ * A compiled scene written by @c writeSceneFile , used in place from
+ * memory such as a @c mappedfile : the records are read where they are and
+ * the tree is handed to @c scene::finalize , so nothing is parsed. The
+ * memory must outlive this view.
+ */
+class scenefile {
+private:
+
+	/**
+	 * The header, or 0 if nothing is open.
+	 */
+	const scenefileheader *header;
+
+	/**
+	 * The first byte of the compiled scene.
+	 */
+	const char *bytes;
+
+	/**
+	 * Checks that the chunks are inside the file and follow each other up
+	 * to the last record.
+	 *
+	 * @param h The header, whose records are checked already.
+	 * @param bytes The first byte.
+	 * @param n Number of bytes.
+	 *
+	 * @return @c true if the chunks can be used.
+	 */
+	static bool checkChunks(const scenefileheader *h, const char *bytes,
+			long long n) {
+		if (h->chunkCount == 0)
+			return true;
+		if (h->chunkCount < 0 || h->chunkOffset < 0 ||
+				h->chunkOffset % SCENE_FILE_ALIGN != 0 || h->chunkOffset > n ||
+				h->chunkCount > (n - h->chunkOffset) /
+				(long long) sizeof(scenechunk))
+			return false;
+		const scenechunk *chunks = (const scenechunk *) (bytes +
+				h->chunkOffset);
+		long long next = chunks[0].first;
+		if (next < 0 || next > h->recordCount)
+			return false;
+		for (long long i = 0; i < h->chunkCount; i++) {
+			if (chunks[i].first != next || chunks[i].count <= 0 ||
+					chunks[i].count > h->recordCount - next)
+				return false;
+			next += chunks[i].count;
+		}
+		return next == h->recordCount;
+	}
+
+public:
+
+	/**
+	 * Constructs a view of nothing.
+	 */
+	scenefile() : header(0), bytes(0) { }
+
+	/**
+	 * Tells if the given bytes start like a compiled scene, as opposed to a
+	 * scene description.
+	 *
+	 * @param bytes The first byte.
+	 * @param size Number of bytes.
+	 *
+	 * @return @c true if they start with @c SCENE_FILE_MAGIC .
+	 */
+	static bool isSceneFile(const char *bytes, size_t size) {
+		int magic;
+		if (size < sizeof(magic))
+			return false;
+		memcpy(&magic, bytes, sizeof(magic));
+		return magic == SCENE_FILE_MAGIC;
+	}
+
+	/**
+	 * Views a compiled scene after checking that it was written at this
+	 * precision and that its sections are inside it.
+	 *
+	 * @tparam vec_T The type of the vector components.
+	 * @tparam color_T The type of the @c rgbcolor.
+	 * @tparam time_T The type of the time.
+	 *
+	 * @param bytes The first byte, aligned to @c SCENE_FILE_ALIGN as
+	 *   mappings are.
+	 * @param size Number of bytes.
+	 * @param[out] error Receives what's wrong with the bytes, if anything.
+	 *
+	 * @return @c false if the bytes can't be used.
+	 */
+	template<typename vec_T, typename color_T, typename time_T>
+	bool open(const char *bytes, size_t size, std::string &error) {
+		header = 0;
+		this->bytes = 0;
+		const scenefileheader *h = (const scenefileheader *) bytes;
+		if (size < sizeof(*h) || !isSceneFile(bytes, size) ||
+				h->recordSize != (int) sizeof(scenerecord)) {
+			error = "not a compiled scene for this program.";
+			return false;
+		}
+		if (h->vecSize != (int) sizeof(vec_T) ||
+				h->colorSize != (int) sizeof(color_T) ||
+				h->timeSize != (int) sizeof(time_T)) {
+			error = "the scene was compiled with another --precision.";
+			return false;
+		}
+		long long n = (long long) size;
+		if (h->recordCount < 0 || h->recordOffset < (long long) sizeof(*h) ||
+				h->recordOffset % SCENE_FILE_ALIGN != 0 ||
+				h->recordOffset > n || h->recordCount > (n - h->recordOffset) /
+				(long long) sizeof(scenerecord) || h->treeSize < 0 ||
+				h->treeOffset < 0 || h->treeOffset % SCENE_FILE_ALIGN != 0 ||
+				h->treeOffset > n || h->treeSize > n - h->treeOffset ||
+				h->pathOffset < 0 || h->pathOffset > n || h->pathSize < 0 ||
+				h->pathSize > n - h->pathOffset || h->pathCount != std::count(
+				bytes + h->pathOffset, bytes + h->pathOffset + h->pathSize,
+				'\0') || (h->pathSize > 0 &&
+				bytes[h->pathOffset + h->pathSize - 1] != 0) ||
+				!checkChunks(h, bytes, n)) {
+			error = "the compiled scene is truncated or corrupt.";
+			return false;
+		}
+		header = h;
+		this->bytes = bytes;
+		return true;
+	}
+
+	/**
+	 * Gets the records.
+	 *
+	 * @return The first record.
+	 */
+	const scenerecord* getRecords() const {
+		assert(header != 0);
+		return (const scenerecord *) (bytes + header->recordOffset);
+	}
+
+	/**
+	 * Gets the number of records.
+	 *
+	 * @return Record count.
+	 */
+	size_t getRecordCount() const {
+		assert(header != 0);
+		return (size_t) header->recordCount;
+	}
+
+	/**
+	 * Gets the names of the files the records refer to.
+	 *
+	 * @param[out] paths Receives the names, in the order of their indices.
+	 */
+	void getPaths(std::vector<std::string> &paths) const {
+		assert(header != 0);
+		paths.clear();
+		const char *p = bytes + header->pathOffset;
+		const char *end = p + header->pathSize;
+		while (p < end) {
+			paths.push_back(std::string(p));
+			p += paths.back().size() + 1;
+		}
+	}
+
+	/**
+	 * Gets the tree written by @c scene::writeAccelerator .
+	 *
+	 * @return The first byte, or 0 if there's no tree.
+	 */
+	const char* getTree() const {
+		assert(header != 0);
+		return header->treeSize > 0 ? bytes + header->treeOffset : 0;
+	}
+
+	/**
+	 * Gets the size of the tree.
+	 *
+	 * @return Size in bytes.
+	 */
+	size_t getTreeSize() const {
+		assert(header != 0);
+		return (size_t) header->treeSize;
+	}
+
+	/**
+	 * Gets the chunks, which follow each other and end with the last
+	 * record.
+	 *
+	 * @return The first chunk, or 0 if the records aren't chunked.
+	 */
+	const scenechunk* getChunks() const {
+		assert(header != 0);
+		return header->chunkCount > 0 ?
+				(const scenechunk *) (bytes + header->chunkOffset) : 0;
+	}
+
+	/**
+	 * Gets the number of chunks.
+	 *
+	 * @return Chunk count, 0 if the records aren't chunked.
+	 */
+	size_t getChunkCount() const {
+		assert(header != 0);
+		return (size_t) header->chunkCount;
+	}
+
+	/**
+	 * Gets the builder of the tree, which is only worth reading into a
+	 * @c bvh that would build the same one.
+	 *
+	 * @return The @c bvhBuilder , or -1 if there's no tree.
+	 */
+	int getTreeBuilder() const {
+		assert(header != 0);
+		return header->treeBuilder;
+	}
+};
+
+#endif // SCENEFILE_HH
@@ -0,0 +1,1239 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "cylinder.hh"
+#include "infplane.hh"
+#include "light.hh"
+#include "spotlight.hh"
+#include "arealight.hh"
+#include "camera.hh"
+#include "arena.hh"
+#include "instance.hh"
+#include "lazygeometry.hh"
+#include "trianglemesh.hh"
+#include "compactspheres.hh"
+#include "meshloader.hh"
+#include "animation.hh"
+#include "motion.hh"
+#include "mappedfile.hh"
+#include "scenerecord.hh"
+#include "scenefile.hh"
+#include "boost/shared_ptr.hpp"
+#include "boost/make_shared.hpp"
+#include "parallel.hh"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef SCENEPARSER_HH
+#define SCENEPARSER_HH
+
+/**
+ * How @c scenetokenizer turns numbers into a type. Decimal numbers with
+ * few enough digits and a small enough power of ten are converted with one
+ * exact multiplication or division, which rounds correctly; everything
+ * else goes to @c convert . This is the version for types without a fast
+ * path, which converts with a string stream.
+ *
+ * @tparam T The type of the number.
+ */
+template<typename T>
+struct numbertraits {
+	/** Largest mantissa the fast path takes. */
+	static unsigned long long maxMantissa() {
+		return 0;
+	}
+
+	/** Largest power of ten the fast path takes. */
+	static int maxPower() {
+		return -1;
+	}
+
+	/** Converts a number the fast path doesn't take. */
+	static T convert(const std::string &s) {
+		std::istringstream is(s);
+		T v = T();
+		is >> v;
+		return v;
+	}
+};
+
+/**
+ * @c numbertraits for doubles, whose powers of ten are exact up to 1e22.
+ */
+template<>
+struct numbertraits<double> {
+	static unsigned long long maxMantissa() {
+		return 1ull << 53;
+	}
+
+	static int maxPower() {
+		return 22;
+	}
+
+	static double convert(const std::string &s) {
+		return strtod(s.c_str(), 0);
+	}
+};
+
+/**
+ * @c numbertraits for floats, whose powers of ten are exact up to 1e10.
+ */
+template<>
+struct numbertraits<float> {
+	static unsigned long long maxMantissa() {
+		return 1ull << 24;
+	}
+
+	static int maxPower() {
+		return 10;
+	}
+
+	static float convert(const std::string &s) {
+		return strtof(s.c_str(), 0);
+	}
+};
+
+/**
+ * Splits the text of a scene description into words, numbers, colors and
+ * vectors, straight from a buffer holding the whole text. It reads exactly
+ * what the stream operators of @c rgbcolor and @c mvector read, and gives
+ * numbers the same values as @c strtod and @c strtof, which the stream
+ * operators use, but without locales or a stream's per-character work.
+ * Lines are counted for error messages.
+ */
+class scenetokenizer {
+private:
+
+	/**
+	 * The next character to read.
+	 */
+	const char *pos;
+
+	/**
+	 * One past the last character.
+	 */
+	const char *end;
+
+	/**
+	 * Number of the line of @c pos , from 1.
+	 */
+	int line;
+
+	/**
+	 * Tells if a character is white space as the C locale has it.
+	 */
+	static bool isSpace(char c) {
+		return c == ' ' || c == '\n' || c == '\t' || c == '\r' ||
+				c == '\v' || c == '\f';
+	}
+
+	/**
+	 * Tells if a character is a decimal digit.
+	 */
+	static bool isDigit(char c) {
+		return c >= '0' && c <= '9';
+	}
+
+public:
+
+	/**
+	 * Constructs a tokenizer over the given text, which must outlive it.
+	 *
+	 * @param begin The first character.
+	 * @param end One past the last character.
+	 * @param line Number of the line @c begin is on, for text that's part
+	 *   of a larger one.
+	 */
+	scenetokenizer(const char *begin, const char *end, int line = 1) :
+			pos(begin), end(end), line(line) { }
+
+	/**
+	 * Skips white space.
+	 */
+	void skipSpace() {
+		for (; pos < end && isSpace(*pos); pos++)
+			if (*pos == '\n')
+				line++;
+	}
+
+	/**
+	 * Skips the rest of the line, for comments.
+	 */
+	void skipLine() {
+		while (pos < end && *pos != '\n')
+			pos++;
+	}
+
+	/**
+	 * Gets the number of the line the next token is on or, if white space
+	 * comes first, starts on.
+	 *
+	 * @return Line number, from 1.
+	 */
+	int getLine() const {
+		return line;
+	}
+
+	/**
+	 * Gets the next character to read.
+	 *
+	 * @return The character's position.
+	 */
+	const char* position() const {
+		return pos;
+	}
+
+	/**
+	 * Tells if the given character comes next after any white space,
+	 * without reading it.
+	 *
+	 * @param c The character.
+	 *
+	 * @return @c true if it does.
+	 */
+	bool peek(char c) {
+		skipSpace();
+		return pos < end && *pos == c;
+	}
+
+	/**
+	 * Reads a word: everything up to the next white space.
+	 *
+	 * @param[out] w Receives the word.
+	 *
+	 * @return @c false at the end of the text.
+	 */
+	bool word(std::string &w) {
+		skipSpace();
+		const char *s = pos;
+		while (pos < end && !isSpace(*pos))
+			pos++;
+		w.assign(s, pos);
+		return pos > s;
+	}
+
+	/**
+	 * Reads the given character after any white space.
+	 *
+	 * @param c The character.
+	 *
+	 * @return @c false, reading nothing but the white space, if the next
+	 *   character is another one.
+	 */
+	bool expect(char c) {
+		skipSpace();
+		if (pos == end || *pos != c)
+			return false;
+		pos++;
+		return true;
+	}
+
+	/**
+	 * Reads a decimal number after any white space: an optional sign,
+	 * digits with an optional decimal point, and an optional exponent.
+	 *
+	 * @param[out] v Receives the number.
+	 *
+	 * @return @c false, reading nothing but the white space, if there's no
+	 *   number.
+	 */
+	template<typename T>
+	bool number(T &v) {
+		skipSpace();
+		const char *s = pos, *p = pos;
+		bool neg = false;
+		if (p < end && (*p == '+' || *p == '-'))
+			neg = *p++ == '-';
+		unsigned long long mant = 0;
+		int digits = 0, power = 0;
+		bool any = false, dropped = false;
+		for (; p < end && isDigit(*p); p++) {
+			any = true;
+			if (digits < 19) {
+				mant = mant * 10 + (*p - '0');
+				digits += mant != 0;
+			}
+			else {
+				power++;
+				dropped = dropped || *p != '0';
+			}
+		}
+		if (p < end && *p == '.') {
+			for (p++; p < end && isDigit(*p); p++) {
+				any = true;
+				if (digits < 19) {
+					mant = mant * 10 + (*p - '0');
+					digits += mant != 0;
+					power--;
+				}
+				else {
+					dropped = dropped || *p != '0';
+				}
+			}
+		}
+		if (!any)
+			return false;
+		if (p < end && (*p == 'e' || *p == 'E')) {
+			const char *q = p + 1;
+			bool eneg = false;
+			if (q < end && (*q == '+' || *q == '-'))
+				eneg = *q++ == '-';
+			if (q < end && isDigit(*q)) {
+				int e = 0;
+				for (; q < end && isDigit(*q); q++)
+					e = e < 10000 ? e * 10 + (*q - '0') : e;
+				power += eneg ? -e : e;
+				p = q;
+			}
+		}
+		pos = p;
+		int maxPower = numbertraits<T>::maxPower();
+		if (!dropped && mant <= numbertraits<T>::maxMantissa() &&
+				power >= -maxPower && power <= maxPower) {
+			// Both the mantissa and the power of ten are exact, so one
+			// operation rounds correctly, as strtod does.
+			T scale = 1;
+			for (int i = 0; i < (power < 0 ? -power : power); i++)
+				scale *= 10;
+			v = power < 0 ? (T) mant / scale : (T) mant * scale;
+			if (neg)
+				v = -v;
+			return true;
+		}
+		v = numbertraits<T>::convert(std::string(s, p));
+		return true;
+	}
+
+	/**
+	 * Reads numbers separated by commas between the given brackets, the
+	 * format of both colors and vectors.
+	 *
+	 * @param open The opening bracket.
+	 * @param[out] values Receives the numbers.
+	 * @param count The number of numbers, more than 0.
+	 * @param close The closing bracket.
+	 *
+	 * @return @c false if the text doesn't have that format.
+	 */
+	template<typename T>
+	bool tuple(char open, T *values, int count, char close) {
+		if (!expect(open))
+			return false;
+		for (int i = 0; i < count; i++)
+			if (!number(values[i]) || !expect(i < count - 1 ? ',' : close))
+				return false;
+		return true;
+	}
+
+	/**
+	 * Reads a color in the format (r, g, b).
+	 *
+	 * @param[out] c Receives the color.
+	 *
+	 * @return @c false if the text doesn't have that format.
+	 */
+	template<typename T>
+	bool color(rgbcolor<T> &c) {
+		T rgb[3];
+		if (!tuple('(', rgb, 3, ')'))
+			return false;
+		c.setR(rgb[0]);
+		c.setG(rgb[1]);
+		c.setB(rgb[2]);
+		return true;
+	}
+
+	/**
+	 * Reads a vector in the format <x_1, ..., x_n>.
+	 *
+	 * @param[out] v Receives the vector.
+	 *
+	 * @return @c false if the text doesn't have that format.
+	 */
+	template<typename T, int size>
+	bool vector(mvector<T, size> &v) {
+		T x[size];
+		if (!tuple('<', x, size, '>'))
+			return false;
+		for (int i = 0; i < size; i++)
+			v[i] = x[i];
+		return true;
+	}
+};
+
+/**
+ * Deepest nesting of included files @c parseScene follows, which stops a
+ * file that includes itself.
+ */
+#define SCENE_INCLUDE_DEPTH 16
+
+/**
+ * Reads the fields of an object whose word has just been read.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ *
+ * @param in The tokenizer.
+ * @param kind The @c sceneRecordKind of the object.
+ * @param dir The directory file names are relative to.
+ * @param[out] rec Receives the object.
+ * @param[in,out] paths Receives the files and names the object has.
+ *
+ * @return @c false if the fields are malformed.
+ */
+template<typename vec_T, typename color_T>
+bool readSceneRecord(scenetokenizer &in, int kind, const std::string &dir,
+		scenerecord &rec, std::vector<std::string> &paths) {
+	rec.kind = kind;
+	rec.line = in.getLine();
+	double *v = rec.values;
+	for (const char *f = sceneRecordLayout(kind); *f != 0; f++) {
+		if (*f == 'C') {
+			color_T c[3];
+			if (!in.tuple('(', c, 3, ')'))
+				return false;
+			v = std::copy(c, c + 3, v);
+		}
+		else if (*f == 'V') {
+			vec_T x[3];
+			if (!in.tuple('<', x, 3, '>'))
+				return false;
+			v = std::copy(x, x + 3, v);
+		}
+		else if (*f == 'S') {
+			vec_T x;
+			if (!in.number(x))
+				return false;
+			*v++ = x;
+		}
+		else if (*f == 'P') {
+			std::string name;
+			if (!in.word(name))
+				return false;
+			*v++ = (double) paths.size();
+			paths.push_back(joinScenePath(dir, name));
+		}
+		else if (*f == 'N') {
+			std::string name;
+			if (in.peek('<') || in.peek('(')) {
+				*v++ = -1;
+			}
+			else {
+				if (!in.word(name))
+					return false;
+				*v++ = (double) paths.size();
+				paths.push_back(name);
+			}
+		}
+		else {
+			float x;
+			if (!in.number(x))
+				return false;
+			*v++ = x;
+		}
+	}
+	std::fill(v, rec.values + SCENE_RECORD_VALUES, 0.0);
+	return true;
+}
+
+template<typename vec_T, typename color_T>
+bool parseSceneFile(const std::string &path, scenedescription &desc,
+		std::string &error, int depth = 0);
+
+/**
+ * Reads a scene description up to its "end" line or the end of the text.
+ * Comments must begin with a # AND a space, like "# ", and the "# " must
+ * be at the beginning of the line. A line
+ * @code
+ * include file
+ * @endcode
+ * reads the objects of another description in its place, up to that
+ * one's own "end"; the names of files, here and in geometry objects, go on
+ * the line of the word before them.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ *
+ * @param in The tokenizer.
+ * @param dir The directory file names are relative to, from
+ *   @c sceneDirectory .
+ * @param[out] desc Receives the objects in the order they appear.
+ * @param[out] error Receives what's wrong with the text, if anything.
+ * @param[out] ended If not 0, receives whether the "end" line was read.
+ * @param depth Number of includes that led to this text.
+ *
+ * @return @c false if the text is malformed.
+ */
+template<typename vec_T, typename color_T>
+bool parseScene(scenetokenizer &in, const std::string &dir,
+		scenedescription &desc, std::string &error, bool *ended = 0,
+		int depth = 0) {
+	std::string type;
+	if (ended != 0)
+		*ended = false;
+	while (in.word(type)) {
+		int line = in.getLine();
+		if (type == "end") {
+			if (ended != 0)
+				*ended = true;
+			break;
+		}
+		if (type == "#") {
+			in.skipLine();
+			continue;
+		}
+		if (type == "include") {
+			std::string name;
+			std::ostringstream os;
+			if (!in.word(name))
+				os << "the include on line " << line << " has no file.";
+			else if (depth >= SCENE_INCLUDE_DEPTH)
+				os << "the include on line " << line << " nests more than " <<
+						SCENE_INCLUDE_DEPTH << " deep.";
+			else if (parseSceneFile<vec_T, color_T>(joinScenePath(dir,
+					name), desc, error, depth + 1))
+				continue;
+			else
+				return false;
+			error = os.str();
+			return false;
+		}
+		int kind = findSceneRecordKind(type);
+		if (kind < 0) {
+			std::ostringstream os;
+			os << "\"" << type << "\" on line " << line <<
+					" is not a recognized scene description type.";
+			error = os.str();
+			return false;
+		}
+		desc.records.push_back(scenerecord());
+		if (!readSceneRecord<vec_T, color_T>(in, kind, dir,
+				desc.records.back(), desc.paths)) {
+			std::ostringstream os;
+			os << "the " << type << " on line " << line <<
+					" is malformed near line " << in.getLine() << ".";
+			error = os.str();
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Reads a scene description from a file with @c parseScene . Names in it
+ * are relative to its directory, and its errors say which file they're in.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ *
+ * @param path The file.
+ * @param[out] desc Receives the objects in the order they appear.
+ * @param[out] error Receives what's wrong with the file, if anything.
+ * @param depth Number of includes that led to this file.
+ *
+ * @return @c false if the file can't be read or is malformed.
+ */
+template<typename vec_T, typename color_T>
+bool parseSceneFile(const std::string &path, scenedescription &desc,
+		std::string &error, int depth) {
+	mappedfile file;
+	if (!file.openRead(path)) {
+		error = "could not read " + path + ".";
+		return false;
+	}
+	if (scenefile::isSceneFile(file.data(), file.size())) {
+		error = path + " is a compiled scene, not a scene description.";
+		return false;
+	}
+	scenetokenizer in(file.data(), file.data() + file.size());
+	if (!parseScene<vec_T, color_T>(in, sceneDirectory(path), desc, error,
+			0, depth)) {
+		error = "in " + path + ": " + error;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Smallest number of bytes of a scene description @c parseSceneParallel
+ * gives a thread.
+ */
+#define SCENE_PARSE_CHUNK (1 << 20)
+
+/**
+ * Finds the first line at or after a position that looks like it starts
+ * an object, an include, a comment or the "end": one whose first word is
+ * the name of one or starts with #. Objects can go on over several lines,
+ * and the lines they go on with start with numbers, brackets or file
+ * names; a file name that's also the name of an object can still fool
+ * this, which @c parseSceneParallel catches.
+ *
+ * @param p The position, which is the start of a line or inside one.
+ * @param end One past the last character of the text.
+ *
+ * @return The start of the line, or @c end if there's none.
+ */
+inline const char* findSceneLine(const char *p, const char *end) {
+	for (;;) {
+		while (p < end && *p != '\n')
+			p++;
+		if (p == end)
+			return end;
+		const char *line = ++p;
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			p++;
+		if (p == end)
+			return end;
+		const char *word = p;
+		while (p < end && *p != ' ' && *p != '\t' && *p != '\r' &&
+				*p != '\n')
+			p++;
+		std::string first(word, p);
+		if (first[0] == '#' || first == "end" || first == "include" ||
+				findSceneRecordKind(first) >= 0)
+			return line;
+	}
+}
+
+/**
+ * Counts the lines of the chunks of a @c parseSceneParallel .
+ */
+struct scenelinecounter {
+	/** The chunks: chunk i is [bounds[i], bounds[i + 1]). */
+	const std::vector<const char *> *bounds;
+	/** Receives the number of line breaks in each chunk. */
+	std::vector<int> *lines;
+
+	void operator()(int lo, int hi) const {
+		for (int i = lo; i < hi; i++)
+			(*lines)[i] = (int) std::count((*bounds)[i], (*bounds)[i + 1],
+					'\n');
+	}
+};
+
+/**
+ * Parses the chunks of a @c parseSceneParallel with @c parseScene .
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ */
+template<typename vec_T, typename color_T>
+struct scenechunkparser {
+	/** The chunks: chunk i is [bounds[i], bounds[i + 1]). */
+	const std::vector<const char *> *bounds;
+	/** Number of the line each chunk starts on. */
+	const std::vector<int> *firstLines;
+	/** The directory file names are relative to. */
+	const std::string *dir;
+	/** Receives the objects of each chunk. */
+	std::vector<scenedescription> *descs;
+	/** Receives whether each chunk parsed. */
+	std::vector<char> *parsed;
+	/** Receives whether each chunk read the "end" line. */
+	std::vector<char> *ended;
+	/** Receives what's wrong with each chunk that didn't parse. */
+	std::vector<std::string> *errors;
+
+	void operator()(int lo, int hi) const {
+		for (int i = lo; i < hi; i++) {
+			scenetokenizer in((*bounds)[i], (*bounds)[i + 1],
+					(*firstLines)[i]);
+			bool e;
+			(*parsed)[i] = parseScene<vec_T, color_T>(in, *dir, (*descs)[i],
+					(*errors)[i], &e);
+			(*ended)[i] = e;
+		}
+	}
+};
+
+/**
+ * Reads a scene description like @c parseScene , but splits it into
+ * chunks at lines that start objects and parses them on several threads,
+ * then joins their objects in order. Everything after the "end" line is
+ * ignored, even if it's malformed. If a chunk doesn't parse, which is
+ * also what happens when a split cut an object in two, the text is parsed
+ * again serially, so errors and objects are exactly those of
+ * @c parseScene .
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ *
+ * @param begin The first character.
+ * @param end One past the last character.
+ * @param dir The directory file names are relative to.
+ * @param numThreads Number of threads to use, at least 1. Descriptions of
+ *   less than @c SCENE_PARSE_CHUNK bytes per thread use fewer.
+ * @param[out] desc Receives the objects in the order they appear.
+ * @param[out] error Receives what's wrong with the text, if anything.
+ *
+ * @return @c false if the text is malformed.
+ */
+template<typename vec_T, typename color_T>
+bool parseSceneParallel(const char *begin, const char *end,
+		const std::string &dir, int numThreads, scenedescription &desc,
+		std::string &error) {
+	assert(numThreads > 0);
+	long long size = end - begin;
+	int chunks = (int) std::min((long long) numThreads,
+			size / SCENE_PARSE_CHUNK + 1);
+	if (chunks == 1) {
+		scenetokenizer in(begin, end);
+		return parseScene<vec_T, color_T>(in, dir, desc, error);
+	}
+
+	std::vector<const char *> bounds(1, begin);
+	for (int i = 1; i < chunks; i++) {
+		const char *p = std::max(bounds.back(), begin + size * i / chunks);
+		if (p > begin && p[-1] == '\n')
+			p--;
+		bounds.push_back(findSceneLine(p, end));
+	}
+	bounds.push_back(end);
+
+	std::vector<int> firstLines(chunks, 1);
+	scenelinecounter counter;
+	counter.bounds = &bounds;
+	counter.lines = &firstLines;
+	parallelFor(0, chunks, numThreads, counter);
+	int line = 1;
+	for (int i = 0; i < chunks; i++) {
+		int breaks = firstLines[i];
+		firstLines[i] = line;
+		line += breaks;
+	}
+
+	std::vector<scenedescription> descs(chunks);
+	std::vector<char> parsed(chunks), ended(chunks);
+	std::vector<std::string> errors(chunks);
+	scenechunkparser<vec_T, color_T> parser;
+	parser.bounds = &bounds;
+	parser.firstLines = &firstLines;
+	parser.dir = &dir;
+	parser.descs = &descs;
+	parser.parsed = &parsed;
+	parser.ended = &ended;
+	parser.errors = &errors;
+	parallelFor(0, chunks, numThreads, parser);
+
+	scenedescription joined;
+	for (int i = 0; i < chunks; i++) {
+		if (!parsed[i]) {
+			scenetokenizer in(begin, end);
+			return parseScene<vec_T, color_T>(in, dir, desc, error);
+		}
+		joined.append(descs[i]);
+		if (ended[i])
+			break;
+	}
+	desc.append(joined);
+	return true;
+}
+
+/**
+ * Reads the fields of a @c scenerecord in order as the types they were
+ * read as.
+ */
+struct scenerecordfields {
+	/** The next field. */
+	const double *v;
+
+	/** Reads a color. */
+	template<typename color_T>
+	rgbcolor<color_T> color() {
+		// isValidSceneRecord checked the range.
+		rgbcolor<color_T> c = rgbcolor<color_T>::unchecked((color_T) v[0],
+				(color_T) v[1], (color_T) v[2]);
+		v += 3;
+		return c;
+	}
+
+	/** Reads a vector. */
+	template<typename vec_T>
+	mvector<vec_T, 3> vector() {
+		mvector<vec_T, 3> x;
+		for (int i = 0; i < 3; i++)
+			x[i] = (vec_T) *v++;
+		return x;
+	}
+
+	/** Reads a number. */
+	template<typename T>
+	T number() {
+		return (T) *v++;
+	}
+};
+
+/**
+ * Checks that a field of a record names one of the files of its
+ * description.
+ *
+ * @param v The field.
+ * @param pathCount Number of files.
+ *
+ * @return @c true if the field is the index of a file.
+ */
+inline bool isScenePath(double v, size_t pathCount) {
+	return v >= 0 && v < (double) pathCount && v == (double) (size_t) v;
+}
+
+/**
+ * Checks that the fields of a record make a valid object, as the
+ * constructors of the objects assert: colors between 0 and 1, positive
+ * sizes and so on. Records from a file can hold anything.
+ *
+ * @param rec The record.
+ * @param pathCount Number of files records may name.
+ *
+ * @return @c true if the object can be made.
+ */
+inline bool isValidSceneRecord(const scenerecord &rec, size_t pathCount) {
+	if (rec.kind < 0 || rec.kind >= RECORD_KINDS)
+		return false;
+	const double *v = rec.values;
+	if (rec.kind != RECORD_CAMERA && rec.kind != RECORD_GEOMETRY &&
+			rec.kind != RECORD_KEY && rec.kind != RECORD_MOVE)
+		for (int i = 0; i < 3; i++)
+			if (!(v[i] >= 0 && v[i] <= 1))
+				return false;
+	switch (rec.kind) {
+	case RECORD_SPHERE:
+		return v[3] > 0;
+	case RECORD_PLANE:
+		return v[3] >= 0;
+	case RECORD_CYLINDER:
+		return v[3] > 0 && v[10] > 0;
+	case RECORD_SPOTLIGHT:
+		return (v[3] != v[6] || v[4] != v[7] || v[5] != v[8]) &&
+				v[9] > 0 && v[9] <= M_PI;
+	case RECORD_AREALIGHT:
+		return v[12] > 0 && v[13] > 0 && v[12] < v[14] && v[13] < v[15];
+	case RECORD_GEOMETRY:
+		return isScenePath(v[0], pathCount) && v[1] <= v[4] &&
+				v[2] <= v[5] && v[3] <= v[6];
+	case RECORD_MESH:
+		return isScenePath(v[3], pathCount) && v[4] >= 0 && v[4] <= 1;
+	case RECORD_CAMERA:
+		return v[0] == -1 || isScenePath(v[0], pathCount);
+	case RECORD_KEY:
+		return v[0] > 0;
+	case RECORD_MOVE:
+		for (int i = 0; i < 3; i++)
+			if (!(fabs(v[i]) <= DBL_MAX))
+				return false;
+		return true;
+	}
+	return true;
+}
+
+/**
+ * Describes a record @c isValidSceneRecord rejects.
+ *
+ * @param rec The record.
+ * @param index Index of the record among those it came with.
+ *
+ * @return The message.
+ */
+inline std::string invalidSceneRecordError(const scenerecord &rec,
+		size_t index) {
+	std::ostringstream os;
+	if (rec.kind >= 0 && rec.kind < RECORD_KINDS)
+		os << "the " << sceneRecordName(rec.kind) << " on line " << rec.line <<
+				" is invalid.";
+	else
+		os << "object " << index << " has an unknown kind.";
+	return os.str();
+}
+
+template<typename vec_T, typename color_T, typename time_T>
+class scenegeometrysource;
+
+/**
+ * Makes the shape of a valid record of a sphere, plane, cylinder, geometry
+ * file or mesh with an arena. Meshes are read from their files here.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ *
+ * @param rec The record.
+ * @param paths The files records name.
+ * @param pool The arena.
+ * @param[out] obj Receives the shape, or 0 if the record is of another
+ *   kind.
+ * @param[out] error Receives what's wrong with a mesh file, if anything.
+ *
+ * @return @c false if the file of a mesh can't be read.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+bool makeSceneShape(const scenerecord &rec,
+		const std::vector<std::string> &paths, const sp_arena &pool,
+		boost::shared_ptr<shape<vec_T, color_T, time_T, 3> > &obj,
+		std::string &error) {
+	typedef sphere<vec_T, color_T, time_T, 3> sphere_t;
+	typedef infplane<vec_T, color_T, time_T, 3> infplane_t;
+	typedef cylinder<vec_T, color_T, time_T> cylinder_t;
+	typedef lazygeometry<vec_T, color_T, time_T, 3> lazygeometry_t;
+	typedef trianglemesh<vec_T, color_T, time_T> trianglemesh_t;
+	scenerecordfields f = { rec.values };
+	obj.reset();
+	if (rec.kind == RECORD_SPHERE) {
+		rgbcolor<color_T> color = f.color<color_T>();
+		vec_T rad = f.number<vec_T>();
+		mvector<vec_T, 3> center = f.vector<vec_T>();
+		obj = boost::allocate_shared<sphere_t>(arenaallocator<sphere_t>(pool),
+				color, rad, center, f.number<float>());
+	}
+	else if (rec.kind == RECORD_PLANE) {
+		rgbcolor<color_T> color = f.color<color_T>();
+		vec_T dist = f.number<vec_T>();
+		mvector<vec_T, 3> normal = f.vector<vec_T>();
+		obj = boost::allocate_shared<infplane_t>(
+				arenaallocator<infplane_t>(pool), color, dist, normal,
+				f.number<float>());
+	}
+	else if (rec.kind == RECORD_CYLINDER) {
+		rgbcolor<color_T> color = f.color<color_T>();
+		vec_T radius = f.number<vec_T>();
+		mvector<vec_T, 3> center = f.vector<vec_T>();
+		mvector<vec_T, 3> axis = f.vector<vec_T>();
+		vec_T height = f.number<vec_T>();
+		obj = boost::allocate_shared<cylinder_t>(
+				arenaallocator<cylinder_t>(pool), color, radius, center,
+				height, axis, f.number<float>());
+	}
+	else if (rec.kind == RECORD_GEOMETRY) {
+		const std::string &path = paths[(size_t) f.number<double>()];
+		mvector<vec_T, 3> lower = f.vector<vec_T>();
+		mvector<vec_T, 3> upper = f.vector<vec_T>();
+		typename lazygeometry_t::sp_source source(
+				new scenegeometrysource<vec_T, color_T, time_T>(path));
+		obj = boost::allocate_shared<lazygeometry_t>(
+				arenaallocator<lazygeometry_t>(pool), source,
+				aabb<vec_T, 3>(lower, upper));
+	}
+	else if (rec.kind == RECORD_MESH) {
+		rgbcolor<color_T> color = f.color<color_T>();
+		const std::string &path = paths[(size_t) f.number<double>()];
+		typename trianglemesh_t::sp_buffers buffers;
+		if (!loadMesh(path, buffers, error))
+			return false;
+		obj = boost::allocate_shared<trianglemesh_t>(
+				arenaallocator<trianglemesh_t>(pool), color, buffers,
+				f.number<float>());
+	}
+	return true;
+}
+
+/**
+ * The shapes of a geometry object: a scene description or compiled scene
+ * holding only spheres, cylinders and meshes, which is read when a ray first gets
+ * into the object's box. Text files are read with @c parseScene and may
+ * include others; compiled ones must be of this precision. The shapes go
+ * in an arena of their own.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+class scenegeometrysource : public geometrysource<vec_T, color_T, time_T, 3> {
+private:
+
+	/**
+	 * The file.
+	 */
+	std::string path;
+
+public:
+
+	/**
+	 * Constructs a source without reading anything.
+	 *
+	 * @param path The file.
+	 */
+	explicit scenegeometrysource(const std::string &path) : path(path) { }
+
+	/**
+	 * Gets the file.
+	 *
+	 * @return The file name.
+	 */
+	const std::string& getPath() const {
+		return path;
+	}
+
+	/**
+	 * Reads the file and adds its shapes to an assembly.
+	 *
+	 * @param assem The assembly.
+	 * @param[out] error Receives what's wrong with the file, if anything.
+	 *
+	 * @return @c false if the file can't be read, is malformed or holds
+	 *   anything but spheres, cylinders and meshes.
+	 */
+	bool load(assembly<vec_T, color_T, time_T, 3> &assem,
+			std::string &error) const {
+		mappedfile file;
+		if (!file.openRead(path)) {
+			error = "could not read geometry file " + path + ".";
+			return false;
+		}
+		scenedescription desc;
+		const scenerecord *records;
+		size_t count;
+		if (scenefile::isSceneFile(file.data(), file.size())) {
+			scenefile compiled;
+			if (!compiled.open<vec_T, color_T, time_T>(file.data(),
+					file.size(), error)) {
+				error = "in " + path + ": " + error;
+				return false;
+			}
+			records = compiled.getRecords();
+			count = compiled.getRecordCount();
+			compiled.getPaths(desc.paths);
+		}
+		else {
+			scenetokenizer in(file.data(), file.data() + file.size());
+			if (!parseScene<vec_T, color_T>(in, sceneDirectory(path), desc,
+					error)) {
+				error = "in " + path + ": " + error;
+				return false;
+			}
+			records = desc.records.empty() ? 0 : &desc.records[0];
+			count = desc.records.size();
+		}
+
+		sp_arena pool(new arena());
+		for (size_t i = 0; i < count; i++) {
+			const scenerecord &rec = records[i];
+			if (!isValidSceneRecord(rec, desc.paths.size())) {
+				error = "in " + path + ": " + invalidSceneRecordError(rec, i);
+				return false;
+			}
+			if (rec.kind != RECORD_SPHERE && rec.kind != RECORD_CYLINDER &&
+					rec.kind != RECORD_MESH) {
+				std::ostringstream os;
+				os << "in " << path << ": the " << sceneRecordName(rec.kind) <<
+						" on line " << rec.line <<
+						" can't be in a geometry file.";
+				error = os.str();
+				return false;
+			}
+			typename assembly<vec_T, color_T, time_T, 3>::sp_shape obj;
+			if (!makeSceneShape(rec, desc.paths, pool, obj, error))
+				return false;
+			assem.addShape(obj);
+		}
+		return true;
+	}
+
+	/**
+	 * Print helper function.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printHelper(std::ostream &os) const {
+		os << path;
+	}
+};
+
+/**
+ * A camera of a scene description and its name.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam time_T The type of the time.
+ */
+template<typename vec_T, typename time_T>
+struct scenecamera {
+	/** The name, or empty if the camera has none. */
+	std::string name;
+	/** The camera. */
+	boost::shared_ptr<camera<vec_T, time_T, 3> > cam;
+};
+
+/**
+ * Makes the objects of records and adds them to a scene, in order, with
+ * the scene's arena. The last camera is kept, and all of them can be, as
+ * can the keys of the objects. Nothing after an invalid record is added.
+ * Meshes are read from their files, but geometry objects are made without
+ * reading theirs. A shape followed by a move is made a @c motionshape .
+ * Spheres can be gathered into one @c compactspheres , added after the
+ * other shapes, except those that are moved or keyed.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ *
+ * @param sc The scene.
+ * @param records The first record.
+ * @param count Number of records.
+ * @param paths The files and names the records have.
+ * @param[out] cam Receives the last camera, if there is one.
+ * @param[out] error Receives what's wrong with the records, if anything.
+ * @param[out] cameras If not null, receives every camera in order.
+ * @param[out] anim If not null, receives the keys of the objects, which
+ *   are checked but dropped otherwise.
+ * @param compact Whether to gather the spheres into a @c compactspheres .
+ *
+ * @return @c false if a record is invalid, a mesh can't be read, two
+ *         cameras have the same name, a key doesn't follow an object
+ *         that can be keyed or its earlier keys or a move doesn't follow
+ *         a shape.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+bool addSceneRecords(scene<vec_T, color_T, time_T, 3> &sc,
+		const scenerecord *records, size_t count,
+		const std::vector<std::string> &paths,
+		boost::shared_ptr<camera<vec_T, time_T, 3> > &cam,
+		std::string &error,
+		std::vector<scenecamera<vec_T, time_T> > *cameras = 0,
+		animation<vec_T, color_T, time_T> *anim = 0, bool compact = false) {
+	typedef light<vec_T, color_T, time_T, 3> light_t;
+	typedef spotlight<vec_T, color_T, time_T, 3> spotlight_t;
+	typedef arealight<vec_T, color_T, time_T, 3> arealight_t;
+	typedef motionshape<vec_T, color_T, time_T, 3> motion_t;
+	typedef compactspheres<vec_T, color_T, time_T> compact_t;
+	const sp_arena &pool = sc.getArena();
+	boost::shared_ptr<compact_t> spheres;
+	if (compact)
+		spheres = boost::allocate_shared<compact_t>(
+				arenaallocator<compact_t>(pool));
+	std::set<std::string> names;
+	animation<vec_T, color_T, time_T> dropped;
+	animation<vec_T, color_T, time_T> &keys = anim ? *anim : dropped;
+	// The object a key would move, and the view of the camera if it's one.
+	int lastKind = -1;
+	boost::shared_ptr<sceneobj<vec_T, color_T, time_T, 3> > last;
+	mvector<vec_T, 3> lastLookAt, lastUp;
+	for (size_t i = 0; i < count; i++) {
+		const scenerecord &rec = records[i];
+		if (!isValidSceneRecord(rec, paths.size())) {
+			error = invalidSceneRecordError(rec, i);
+			return false;
+		}
+		scenerecordfields f = { rec.values };
+		if (rec.kind == RECORD_KEY) {
+			vec_T frame = f.number<vec_T>();
+			mvector<vec_T, 3> pos = f.vector<vec_T>();
+			std::ostringstream os;
+			os << "the key on line " << rec.line;
+			if (!animation<vec_T, color_T, time_T>::canAnimate(lastKind)) {
+				os << " doesn't follow a sphere, cylinder, light, spotlight "
+						"or camera.";
+				error = os.str();
+				return false;
+			}
+			if (!(lastKind == RECORD_CAMERA ? keys.addCameraKey(cam,
+					lastLookAt, lastUp, frame, pos) :
+					keys.addKey(lastKind, last, frame, pos))) {
+				os << " isn't after the keys before it.";
+				error = os.str();
+				return false;
+			}
+			continue;
+		}
+		if (rec.kind == RECORD_MOVE) {
+			std::ostringstream os;
+			os << "the move on line " << rec.line << " doesn't follow a "
+					"sphere, plane, cylinder, geometry or mesh.";
+			error = os.str();
+			return false;
+		}
+		lastKind = rec.kind;
+		last.reset();
+		if (rec.kind == RECORD_LIGHT) {
+			rgbcolor<color_T> color = f.color<color_T>();
+			boost::shared_ptr<light_t> l = boost::allocate_shared<light_t>(
+					arenaallocator<light_t>(pool), color, f.vector<vec_T>());
+			sc.addPointLight(l);
+			last = l;
+		}
+		else if (rec.kind == RECORD_SPOTLIGHT) {
+			rgbcolor<color_T> color = f.color<color_T>();
+			mvector<vec_T, 3> pos = f.vector<vec_T>();
+			mvector<vec_T, 3> lookat = f.vector<vec_T>();
+			boost::shared_ptr<spotlight_t> l =
+					boost::allocate_shared<spotlight_t>(
+					arenaallocator<spotlight_t>(pool), color, pos,
+					(lookat - pos).norm(), f.number<float>());
+			sc.addSpotLight(l);
+			last = l;
+		}
+		else if (rec.kind == RECORD_AREALIGHT) {
+			rgbcolor<color_T> color = f.color<color_T>();
+			mvector<vec_T, 3> center = f.vector<vec_T>();
+			mvector<vec_T, 3> normal = f.vector<vec_T>();
+			mvector<vec_T, 3> upDir = f.vector<vec_T>();
+			vec_T hspace = f.number<vec_T>();
+			vec_T vspace = f.number<vec_T>();
+			vec_T width = f.number<vec_T>();
+			sc.addAreaLight(boost::allocate_shared<arealight_t>(
+					arenaallocator<arealight_t>(pool), color, center, normal,
+					upDir, hspace, vspace, width, f.number<vec_T>()));
+		}
+		else if (rec.kind == RECORD_CAMERA) {
+			double nameIndex = f.number<double>();
+			std::string name = nameIndex < 0 ? "" : paths[(size_t) nameIndex];
+			if (!name.empty() && !names.insert(name).second) {
+				std::ostringstream os;
+				os << "the camera on line " << rec.line << " is named \"" <<
+						name << "\" like an earlier one.";
+				error = os.str();
+				return false;
+			}
+			mvector<vec_T, 3> pos = f.vector<vec_T>();
+			lastLookAt = f.vector<vec_T>();
+			lastUp = f.vector<vec_T>();
+			cam.reset(new camera<vec_T, time_T, 3>(pos, lastLookAt, lastUp));
+			if (cameras) {
+				scenecamera<vec_T, time_T> named;
+				named.name = name;
+				named.cam = cam;
+				cameras->push_back(named);
+			}
+		}
+		else if (spheres && rec.kind == RECORD_SPHERE && (i + 1 == count ||
+				(records[i + 1].kind != RECORD_MOVE &&
+				records[i + 1].kind != RECORD_KEY))) {
+			rgbcolor<color_T> color = f.color<color_T>();
+			vec_T rad = f.number<vec_T>();
+			mvector<vec_T, 3> center = f.vector<vec_T>();
+			spheres->add(color, rad, center, f.number<float>());
+		}
+		else {
+			boost::shared_ptr<shape<vec_T, color_T, time_T, 3> > obj;
+			if (!makeSceneShape(rec, paths, pool, obj, error))
+				return false;
+			// A shape that moves while the shutter is open can't be keyed.
+			if (i + 1 < count && records[i + 1].kind == RECORD_MOVE &&
+					isValidSceneRecord(records[i + 1], paths.size())) {
+				scenerecordfields m = { records[++i].values };
+				obj = boost::allocate_shared<motion_t>(
+						arenaallocator<motion_t>(pool), obj,
+						m.vector<vec_T>());
+				lastKind = RECORD_MOVE;
+			}
+			sc.addShape(obj);
+			last = obj;
+		}
+	}
+	if (spheres && spheres->getSphereCount() > 0) {
+		spheres->build();
+		sc.addShape(spheres);
+	}
+	return true;
+}
+
+#endif // SCENEPARSER_HH
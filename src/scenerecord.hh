@@ -0,0 +1,191 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include <cassert>
+#include <string>
+#include <vector>
+
+#ifndef SCENERECORD_HH
+#define SCENERECORD_HH
+
+/**
+ * Number of fields of a @c scenerecord , enough for the largest object.
+ */
+#define SCENE_RECORD_VALUES 16
+
+/**
+ * The kinds of object in a scene description, named by the word that
+ * starts them.
+ */
+enum sceneRecordKind {
+	RECORD_SPHERE,
+	RECORD_PLANE,
+	RECORD_CYLINDER,
+	RECORD_LIGHT,
+	RECORD_SPOTLIGHT,
+	RECORD_AREALIGHT,
+	RECORD_CAMERA,
+	/** A @c lazygeometry : shapes in another file, loaded when needed. */
+	RECORD_GEOMETRY,
+	/** A @c trianglemesh read from a PLY or OBJ file. */
+	RECORD_MESH,
+	/** A key of the @c animation of the object before it. */
+	RECORD_KEY,
+	/** How far the shape before it moves while the shutter is open; see
+	 * @c motionshape . */
+	RECORD_MOVE,
+	/** Number of kinds. */
+	RECORD_KINDS
+};
+
+/**
+ * One object of a scene description as it was read, before it's made.
+ * The fields are kept as doubles, which hold the floats and doubles they
+ * were read as exactly, so making the object from the record gives the
+ * same object as reading it straight from the text. Records are of a
+ * fixed size and hold no pointers, so arrays of them can be written to a
+ * file and used in place from a mapping of it.
+ */
+struct scenerecord {
+	/** The @c sceneRecordKind . */
+	int kind;
+	/** Line of the scene description the object starts on, for errors. */
+	int line;
+	/** The fields in the order of @c sceneRecordLayout , then zeros. */
+	double values[SCENE_RECORD_VALUES];
+};
+
+/**
+ * Gets the word that starts an object of the given kind.
+ *
+ * @param kind The @c sceneRecordKind .
+ *
+ * @return The word.
+ */
+inline const char* sceneRecordName(int kind) {
+	static const char *names[RECORD_KINDS] = { "sphere", "plane",
+			"cylinder", "light", "spotlight", "arealight", "camera",
+			"geometry", "mesh", "key", "move" };
+	assert(kind >= 0 && kind < RECORD_KINDS);
+	return names[kind];
+}
+
+/**
+ * Gets the fields of an object of the given kind, one letter each: C for a
+ * color (r, g, b) of @c color_T , V for a vector <x, y, z> of @c vec_T , S
+ * for a number of @c vec_T , F for a float, P for a file name, which is
+ * kept as its index in @c scenedescription::paths , and N for an optional
+ * name, a word that doesn't start with a bracket, kept there too or as -1
+ * if it's left out. The formats are
+ * @code
+ * sphere color radius center reflectivity
+ * plane color distance_from_origin surface_normal reflectivity
+ * cylinder color radius center axis height reflectivity
+ * light color position
+ * spotlight color position look_at_position angle
+ * arealight color center surface_normal up_direction horizontal_spacing
+ *     vertical_spacing width height
+ * camera [name] position look_at_position up_direction
+ * geometry file lower_corner upper_corner
+ * mesh color file reflectivity
+ * key frame position
+ * move offset
+ * @endcode
+ * where the corners are those of a box around all the shapes of the
+ * geometry file, the file of a mesh is a binary PLY or an OBJ file,
+ * cameras are picked by their names, a key puts the sphere, cylinder,
+ * light, spotlight or camera before it at the position at a frame after 0
+ * and its other keys, as @c animation does, and a move right after a shape
+ * moves it by the offset while the shutter is open, as @c motionshape
+ * does.
+ *
+ * @param kind The @c sceneRecordKind .
+ *
+ * @return The letters.
+ */
+inline const char* sceneRecordLayout(int kind) {
+	static const char *layouts[RECORD_KINDS] = { "CSVF", "CSVF", "CSVVSF",
+			"CV", "CVVF", "CVVVSSSS", "NVVV", "PVV", "CPF", "SV", "V" };
+	assert(kind >= 0 && kind < RECORD_KINDS);
+	return layouts[kind];
+}
+
+/**
+ * Finds the kind of object a word starts.
+ *
+ * @param name The word.
+ *
+ * @return The @c sceneRecordKind , or -1 if the word isn't one.
+ */
+inline int findSceneRecordKind(const std::string &name) {
+	for (int kind = 0; kind < RECORD_KINDS; kind++)
+		if (name == sceneRecordName(kind))
+			return kind;
+	return -1;
+}
+
+/**
+ * The objects of a scene description and the files and names they refer
+ * to.
+ */
+struct scenedescription {
+	/** The objects in the order they appear. */
+	std::vector<scenerecord> records;
+	/**
+	 * The files named by P fields, after @c joinScenePath , and the names
+	 * of N fields.
+	 */
+	std::vector<std::string> paths;
+
+	/**
+	 * Appends the objects of another description, renumbering the files
+	 * and names they refer to.
+	 *
+	 * @param other The description.
+	 */
+	void append(const scenedescription &other) {
+		size_t first = records.size();
+		records.insert(records.end(), other.records.begin(),
+				other.records.end());
+		for (size_t i = first; i < records.size(); i++)
+			if (records[i].kind == RECORD_GEOMETRY)
+				records[i].values[0] += (double) paths.size();
+			else if (records[i].kind == RECORD_MESH)
+				records[i].values[3] += (double) paths.size();
+			else if (records[i].kind == RECORD_CAMERA &&
+					records[i].values[0] >= 0)
+				records[i].values[0] += (double) paths.size();
+		paths.insert(paths.end(), other.paths.begin(), other.paths.end());
+	}
+};
+
+/**
+ * Gets the directory of a file, for the files it names.
+ *
+ * @param path The file name.
+ *
+ * @return Everything up to and including the last slash, or an empty
+ *   string for the current directory.
+ */
+inline std::string sceneDirectory(const std::string &path) {
+	size_t slash = path.rfind('/');
+	return slash == std::string::npos ? std::string() :
+			path.substr(0, slash + 1);
+}
+
+/**
+ * Resolves a file named in a scene description.
+ *
+ * @param dir The directory of the description, from @c sceneDirectory .
+ * @param name The name, which is relative to @c dir unless it's absolute.
+ *
+ * @return The file name.
+ */
+inline std::string joinScenePath(const std::string &dir,
+		const std::string &name) {
+	return name.empty() || name[0] == '/' ? name : dir + name;
+}
+
+#endif // SCENERECORD_HH
@@ -0,0 +1,184 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "mvector.hh"
+#include "ray.hh"
+#include "parallel.hh"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#ifndef SHADOWMAP_HH
+#define SHADOWMAP_HH
+
+/**
+ * A cube shadow map around a light: the distance from the light to the
+ * closest surface in every direction, on six square faces, one per axis
+ * and sign. Once built, whether a point is lit is one lookup instead of a
+ * shadow ray, whatever the scene holds, which is what interactive previews
+ * want. The answer is approximate: it's only as fine as the faces, and a
+ * bias keeps surfaces from shadowing themselves, at the price of letting
+ * light leak under blockers that are closer than it to a surface.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam time_T The type of the time.
+ * @tparam dim The number of dimensions, which must be 3.
+ */
+template<typename vec_T, typename time_T, int dim>
+class shadowmap {
+private:
+
+	/**
+	 * Functor that fills in the texels of a range of rows of all faces for
+	 * @c build .
+	 */
+	template<typename tracer_T>
+	struct rowFiller {
+		shadowmap *map;
+		const tracer_T *trace;
+
+		void operator()(int lo, int hi) const {
+			for (int row = lo; row < hi; row++)
+				map->fillRow(row, *trace);
+		}
+	};
+
+	/**
+	 * Position of the light.
+	 */
+	mvector<vec_T, dim> pos;
+
+	/**
+	 * Texels along each side of a face.
+	 */
+	int res;
+
+	/**
+	 * Distance to the closest surface of every texel, face after face and
+	 * row after row, or the largest @c vec_T where nothing was hit.
+	 */
+	std::vector<vec_T> depths;
+
+	/**
+	 * Works out the face and texel a direction from the light falls in.
+	 *
+	 * @param d The direction, which need not be normalized.
+	 *
+	 * @return Index of the texel in @c depths .
+	 */
+	int texel(const mvector<vec_T, dim> &d) const {
+		int axis = 0;
+		for (int a = 1; a < 3; a++)
+			if (fabs(d[a]) > fabs(d[axis]))
+				axis = a;
+		vec_T m = fabs(d[axis]);
+		int face = 2 * axis + (d[axis] < 0 ? 1 : 0);
+		int x = (int) ((d[(axis + 1) % 3] / m + 1) / 2 * res);
+		int y = (int) ((d[(axis + 2) % 3] / m + 1) / 2 * res);
+		x = std::max(0, std::min(res - 1, x));
+		y = std::max(0, std::min(res - 1, y));
+		return (face * res + y) * res + x;
+	}
+
+	/**
+	 * Traces the rays through the centers of one row of texels.
+	 *
+	 * @param row Index of the row counting across faces, less than six
+	 *   times @c res .
+	 * @param trace The tracer passed to @c build .
+	 */
+	template<typename tracer_T>
+	void fillRow(int row, const tracer_T &trace) {
+		int face = row / res, y = row % res;
+		int axis = face / 2;
+		for (int x = 0; x < res; x++) {
+			mvector<vec_T, dim> d;
+			d[axis] = face % 2 == 0 ? 1 : -1;
+			d[(axis + 1) % 3] = (vec_T) (2 * (x + 0.5) / res - 1);
+			d[(axis + 2) % 3] = (vec_T) (2 * (y + 0.5) / res - 1);
+			time_T t;
+			depths[row * res + x] = trace(ray<vec_T, time_T, dim>(pos, d), t) ?
+					(vec_T) t : std::numeric_limits<vec_T>::max();
+		}
+	}
+
+public:
+
+	/**
+	 * Constructs an empty map, which shadows nothing.
+	 */
+	shadowmap() : res(0) {
+		assert(dim == 3);
+	}
+
+	/**
+	 * Builds the map for a light at the given position, discarding whatever
+	 * was built before.
+	 *
+	 * @param light Position of the light.
+	 * @param resolution Texels along each side of a face.
+	 * @param threads Number of threads to trace with.
+	 * @param trace Functor with a
+	 *   @code bool operator()(const ray<vec_T, time_T, dim> &r, time_T &t)
+	 *   const @endcode that finds the closest hit of a ray with a unit
+	 *   direction, safely from several threads.
+	 */
+	template<typename tracer_T>
+	void build(const mvector<vec_T, dim> &light, int resolution, int threads,
+			const tracer_T &trace) {
+		assert(resolution > 0 && threads > 0);
+		pos = light;
+		res = resolution;
+		depths.assign(6 * res * res, 0);
+		rowFiller<tracer_T> filler;
+		filler.map = this;
+		filler.trace = &trace;
+		parallelFor(0, 6 * res, threads, filler);
+	}
+
+	/**
+	 * Checks if the light of this map is blocked from the given point.
+	 *
+	 * @param X The point.
+	 * @param bias How much farther than the closest surface in its
+	 *   direction the point must be to be in shadow.
+	 *
+	 * @return @c true if the map has the point in shadow.
+	 */
+	bool isOccluded(const mvector<vec_T, dim> &X, vec_T bias) const {
+		if (res == 0)
+			return false;
+		mvector<vec_T, dim> d = X - pos;
+		vec_T depth = depths[texel(d)];
+		return depth < std::numeric_limits<vec_T>::max() &&
+				d.mag() > depth + bias;
+	}
+
+	/**
+	 * Gets the texels along each side of a face.
+	 *
+	 * @return Resolution, or 0 if the map hasn't been built.
+	 */
+	int getResolution() const {
+		return res;
+	}
+
+	/**
+	 * Gets the number of bytes taken by the depths.
+	 *
+	 * @return Memory footprint in bytes.
+	 */
+	size_t getMemoryUsage() const {
+		return depths.size() * sizeof(vec_T);
+	}
+};
+
+typedef shadowmap<double, double, 3> shadowmap3d;
+typedef shadowmap<double, float, 3> shadowmap3ddf;
+typedef shadowmap<float, float, 3> shadowmap3f;
+
+#endif // SHADOWMAP_HH
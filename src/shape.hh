@@ -7,6 +7,8 @@
 #include "rgbcolor.hh"
 #include "mvector.hh"
 #include "ray.hh"
+#include "aabb.hh"
+#include "hitrecord.hh"
 #include "boost/shared_ptr.hpp"
 #include <ostream>
 
@@ -42,13 +44,21 @@ private:
 	 */
 	float reflectivity;
 
+	/**
+	 * Index of this shape's color and reflectivity in the @c materialtable
+	 * of the scene it was added to, or -1 if it has none. Changing either
+	 * resets it, so a set index always matches.
+	 */
+	int material;
+
 public:
 
 	/**
 	 * Initializes the color of this object to gray via the @c sceneobj
 	 * default constructor and the reflectivity of this object to 0.
 	 */
-	shape() : sceneobj<vec_T, color_T, time_T, dim>(), reflectivity(0) { }
+	shape() : sceneobj<vec_T, color_T, time_T, dim>(), reflectivity(0),
+			material(-1) { }
 
 	/**
 	 * Initializes the color of this object to the specified value via a
@@ -60,18 +70,19 @@ public:
 	 * 0.
 	 */
 	shape(rgbcolor<color_T> color, float reflectivity = 0) :
-			sceneobj<vec_T, color_T, time_T, dim>(color) {
+			sceneobj<vec_T, color_T, time_T, dim>(color), material(-1) {
 		assert(reflectivity >= 0 && reflectivity <= 1);
 		this->reflectivity = reflectivity;
 	}
 
 	/**
-	 * Copy constructor. Uses the @c sceneobj copy constructor.
+	 * Copy constructor. Uses the @c sceneobj copy constructor. The copy
+	 * has no material index until it's added to a scene.
 	 *
 	 * @param other The other @c shape object to copy into this one.
 	 */
 	shape(const shape& other) :
-		sceneobj<vec_T, color_T, time_T, dim>(other) {
+		sceneobj<vec_T, color_T, time_T, dim>(other), material(-1) {
 		this->reflectivity = other.reflectivity;
 	}
 
@@ -92,6 +103,27 @@ public:
 	 */
 	virtual time_T intersection(const ray<vec_T, time_T, dim> &r) const = 0;
 
+	/**
+	 * Intersects a packet of rays with this shape, as if by calling
+	 * @c intersection on each ray whose bit is set in @c mask , so a
+	 * packet costs one virtual call instead of one per ray. This base class
+	 * version loops over @c intersection ; spheres, cylinders and planes
+	 * override it with loops over their own, which the compiler inlines.
+	 *
+	 * @param rays The rays of the packet.
+	 * @param count Number of rays, at most 32.
+	 * @param mask Bit @c k is set if ray @c k is to be tested.
+	 * @param[out] t Receives the time of intersection of each ray tested,
+	 *   or @c RAY_MISS . The others are left alone.
+	 */
+	virtual void intersections(const ray<vec_T, time_T, dim> *rays,
+			int count, unsigned int mask, time_T *t) const {
+		assert(count >= 0 && count <= 32);
+		for (int k = 0; k < count; k++)
+			if (mask >> k & 1)
+				t[k] = intersection(rays[k]);
+	}
+
 	/**
 	 * Gets the surface normal to this scene object at the specified point.
 	 * The argument is assumed to be on the surface of this object. This
@@ -104,6 +136,79 @@ public:
 	virtual mvector<vec_T, dim> surfaceNorm(
 			const mvector<vec_T, dim> &surfacePt) const = 0;
 
+	/**
+	 * Gets an axis-aligned box that encloses this shape. Shapes that extend
+	 * infinitely, like planes, can't be bounded and leave this base class
+	 * version in place, which reports that there is no box.
+	 *
+	 * @param[out] box Receives the bounding box if there is one.
+	 *
+	 * @return @c true if this shape is bounded and @c box was set.
+	 */
+	virtual bool getBounds(aabb<vec_T, dim> &box) const {
+		return false;
+	}
+
+	/**
+	 * Gets the boxes that enclose this shape when the shutter opens and
+	 * when it closes, for shapes that move while it's open. Between the two
+	 * the shape must stay within the box whose corners are interpolated
+	 * between theirs, which is what lets an accelerator interpolate the
+	 * boxes of its nodes rather than bound whole paths. The base class
+	 * version is for shapes that stay still and returns @c getBounds
+	 * twice.
+	 *
+	 * @param[out] open Receives the box when the shutter opens.
+	 * @param[out] close Receives the box when it closes.
+	 *
+	 * @return @c true if this shape is bounded and the boxes were set.
+	 */
+	virtual bool getMotionBounds(aabb<vec_T, dim> &open,
+			aabb<vec_T, dim> &close) const {
+		if (!getBounds(open))
+			return false;
+		close = open;
+		return true;
+	}
+
+	/**
+	 * Fills in the point, normal and shape of a hit record whose time has
+	 * been set to a hit of the given ray on this shape. The base class
+	 * version uses @c surfaceNorm ; shapes that can get the normal more
+	 * cheaply from the ray override it. Shapes made of other shapes, like
+	 * instances, record the shape within them that was hit, whose color and
+	 * reflectivity should be used for shading. The record's @c id is left
+	 * alone.
+	 *
+	 * @param r The ray.
+	 * @param[in,out] rec The record, whose @c t is the time of the hit as
+	 *   returned by @c intersection .
+	 */
+	virtual void completeHit(const ray<vec_T, time_T, dim> &r,
+			hitrecord<vec_T, color_T, time_T, dim> &rec) const {
+		rec.point = r.getPointAtT(rec.t);
+		rec.normal = surfaceNorm(rec.point);
+		rec.obj = this;
+	}
+
+	/**
+	 * Intersects the given ray with this shape and fills in a hit record if
+	 * there is a hit at a time greater than zero.
+	 *
+	 * @param r The ray.
+	 * @param[out] rec Receives the hit. Left alone on a miss.
+	 *
+	 * @return @c true if the ray hits this shape.
+	 */
+	bool intersect(const ray<vec_T, time_T, dim> &r,
+			hitrecord<vec_T, color_T, time_T, dim> &rec) const {
+		time_T t = intersection(r);
+		if (t == RAY_MISS || t <= 0)
+			return false;
+		rec.t = t;
+		completeHit(r, rec);
+		return true;
+	}
 
 	/**
 	 * Getter for reflectivity.
@@ -122,6 +227,38 @@ public:
 	void setReflectivity(float reflectivity) {
 		assert(reflectivity >= 0 && reflectivity <= 1);
 		this->reflectivity = reflectivity;
+		material = -1;
+	}
+
+	/**
+	 * Sets the color of this shape, like @c sceneobj::setColor , and drops
+	 * its material index, which no longer matches.
+	 *
+	 * @param color Color.
+	 */
+	void setColor(const rgbcolor<color_T> &color) {
+		sceneobj<vec_T, color_T, time_T, dim>::setColor(color);
+		material = -1;
+	}
+
+	/**
+	 * Gets the index of this shape's material in the @c materialtable of
+	 * its scene.
+	 *
+	 * @return The index, or -1 if it has none.
+	 */
+	int getMaterial() const {
+		return material;
+	}
+
+	/**
+	 * Sets the index of this shape's material, which the caller has made
+	 * sure holds the shape's color and reflectivity.
+	 *
+	 * @param material The index, or -1 for none.
+	 */
+	void setMaterial(int material) {
+		this->material = material;
 	}
 
 	/**
@@ -0,0 +1,217 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "shape.hh"
+#include "sphere.hh"
+#include "infplane.hh"
+#include "cylinder.hh"
+#include "ray.hh"
+#include "raystats.hh"
+#include "shapeprofile.hh"
+#include <typeinfo>
+
+#ifndef SHAPEKIND_HH
+#define SHAPEKIND_HH
+
+/**
+ * Tags for the shape classes the hot loops know about. Storing the tag next
+ * to a shape lets a loop switch on it and call the class's own
+ * @c intersection directly, which the compiler can inline, instead of going
+ * through the virtual one. Other shapes, like instances and subclasses of
+ * these, are @c SHAPE_OTHER and keep using the virtual call.
+ */
+enum shapeKind {
+	/** Exactly a @c sphere . */
+	SHAPE_SPHERE,
+	/** Exactly an @c infplane . */
+	SHAPE_INFPLANE,
+	/** Exactly a @c cylinder . */
+	SHAPE_CYLINDER,
+	/** Anything else. */
+	SHAPE_OTHER
+};
+
+/**
+ * The part of @c shapedispatch for cylinders, which only exist in 3D. In
+ * other dimensions no shape is a cylinder.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+struct cylinderdispatch {
+	static bool is(const shape<vec_T, color_T, time_T, dim> *s) {
+		return false;
+	}
+
+	static time_T intersection(const shape<vec_T, color_T, time_T, dim> *s,
+			const ray<vec_T, time_T, dim> &r) {
+		return s->intersection(r);
+	}
+
+	static void intersections(const shape<vec_T, color_T, time_T, dim> *s,
+			const ray<vec_T, time_T, dim> *rays, int count, unsigned int mask,
+			time_T *t) {
+		s->intersections(rays, count, mask, t);
+	}
+
+	static void setCenter(shape<vec_T, color_T, time_T, dim> *s,
+			const mvector<vec_T, dim> &center) { }
+};
+
+/**
+ * The 3D version of @c cylinderdispatch .
+ */
+template<typename vec_T, typename color_T, typename time_T>
+struct cylinderdispatch<vec_T, color_T, time_T, CDIM> {
+	static bool is(const shape<vec_T, color_T, time_T, CDIM> *s) {
+		return typeid(*s) == typeid(cylinder<vec_T, color_T, time_T>);
+	}
+
+	static time_T intersection(const shape<vec_T, color_T, time_T, CDIM> *s,
+			const ray<vec_T, time_T, CDIM> &r) {
+		const cylinder<vec_T, color_T, time_T> *c =
+				static_cast<const cylinder<vec_T, color_T, time_T> *>(s);
+		return c->cylinder<vec_T, color_T, time_T>::intersection(r);
+	}
+
+	static void intersections(const shape<vec_T, color_T, time_T, CDIM> *s,
+			const ray<vec_T, time_T, CDIM> *rays, int count, unsigned int mask,
+			time_T *t) {
+		const cylinder<vec_T, color_T, time_T> *c =
+				static_cast<const cylinder<vec_T, color_T, time_T> *>(s);
+		c->cylinder<vec_T, color_T, time_T>::intersections(rays, count, mask,
+				t);
+	}
+
+	static void setCenter(shape<vec_T, color_T, time_T, CDIM> *s,
+			const mvector<vec_T, CDIM> &center) {
+		static_cast<cylinder<vec_T, color_T, time_T> *>(s)->setCenter(center);
+	}
+};
+
+/**
+ * Tags shapes with their @c shapeKind and intersects rays with them by the
+ * tag.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+struct shapedispatch {
+
+	/**
+	 * Finds the tag of the given shape. Only the exact classes get their own
+	 * tags, since subclasses might intersect differently.
+	 *
+	 * @param s The shape.
+	 *
+	 * @return The tag.
+	 */
+	static shapeKind kindOf(const shape<vec_T, color_T, time_T, dim> *s) {
+		if (typeid(*s) == typeid(sphere<vec_T, color_T, time_T, dim>))
+			return SHAPE_SPHERE;
+		if (typeid(*s) == typeid(infplane<vec_T, color_T, time_T, dim>))
+			return SHAPE_INFPLANE;
+		if (cylinderdispatch<vec_T, color_T, time_T, dim>::is(s))
+			return SHAPE_CYLINDER;
+		return SHAPE_OTHER;
+	}
+
+	/**
+	 * Intersects the ray with the shape, which must have the given tag. The
+	 * result is that of the shape's @c intersection .
+	 *
+	 * @param kind The tag of the shape, from @c kindOf .
+	 * @param s The shape.
+	 * @param r The ray.
+	 *
+	 * @return The intersection time or @c RAY_MISS .
+	 */
+	static time_T intersection(shapeKind kind,
+			const shape<vec_T, color_T, time_T, dim> *s,
+			const ray<vec_T, time_T, dim> &r) {
+		RAYSTATS_ADD(tests[kind], 1);
+		SHAPEPROFILE_TESTS(s, 1);
+		switch (kind) {
+		case SHAPE_SPHERE:
+			return static_cast<const sphere<vec_T, color_T, time_T, dim> *>(
+					s)->sphere<vec_T, color_T, time_T, dim>::intersection(r);
+		case SHAPE_INFPLANE:
+			return static_cast<const infplane<vec_T, color_T, time_T, dim> *>(
+					s)->infplane<vec_T, color_T, time_T, dim>::intersection(r);
+		case SHAPE_CYLINDER:
+			return cylinderdispatch<vec_T, color_T, time_T, dim>::intersection(
+					s, r);
+		default:
+			return s->intersection(r);
+		}
+	}
+
+	/**
+	 * Intersects a packet of rays with the shape, which must have the given
+	 * tag, switching on the tag once for the packet. The results are those
+	 * of the shape's @c intersections .
+	 *
+	 * @param kind The tag of the shape, from @c kindOf .
+	 * @param s The shape.
+	 * @param rays The rays of the packet.
+	 * @param count Number of rays, at most 32.
+	 * @param mask Bit @c k is set if ray @c k is to be tested.
+	 * @param[out] t Receives the time of intersection of each ray tested,
+	 *   or @c RAY_MISS .
+	 */
+	static void intersections(shapeKind kind,
+			const shape<vec_T, color_T, time_T, dim> *s,
+			const ray<vec_T, time_T, dim> *rays, int count, unsigned int mask,
+			time_T *t) {
+		RAYSTATS_ADD(tests[kind], __builtin_popcount(mask));
+		SHAPEPROFILE_TESTS(s, __builtin_popcount(mask));
+		switch (kind) {
+		case SHAPE_SPHERE:
+			static_cast<const sphere<vec_T, color_T, time_T, dim> *>(s)->
+					sphere<vec_T, color_T, time_T, dim>::intersections(rays,
+					count, mask, t);
+			return;
+		case SHAPE_INFPLANE:
+			static_cast<const infplane<vec_T, color_T, time_T, dim> *>(s)->
+					infplane<vec_T, color_T, time_T, dim>::intersections(rays,
+					count, mask, t);
+			return;
+		case SHAPE_CYLINDER:
+			cylinderdispatch<vec_T, color_T, time_T, dim>::intersections(s,
+					rays, count, mask, t);
+			return;
+		default:
+			s->intersections(rays, count, mask, t);
+		}
+	}
+
+	/**
+	 * Moves the shape, which must have the given tag, so it's centered on
+	 * the given point. Only spheres and cylinders have centers.
+	 *
+	 * @param kind The tag of the shape, from @c kindOf .
+	 * @param s The shape.
+	 * @param center The new center.
+	 *
+	 * @return @c false, leaving the shape alone, if it can't be moved.
+	 */
+	static bool moveTo(shapeKind kind, shape<vec_T, color_T, time_T, dim> *s,
+			const mvector<vec_T, dim> &center) {
+		switch (kind) {
+		case SHAPE_SPHERE:
+			static_cast<sphere<vec_T, color_T, time_T, dim> *>(s)->setCenter(
+					center);
+			return true;
+		case SHAPE_CYLINDER:
+			cylinderdispatch<vec_T, color_T, time_T, dim>::setCenter(s, center);
+			return true;
+		default:
+			return false;
+		}
+	}
+};
+
+#endif // SHAPEKIND_HH
@@ -0,0 +1,435 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/locks.hpp"
+#include <algorithm>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifndef SHAPEPROFILE_HH
+#define SHAPEPROFILE_HH
+
+/**
+ * Adds @c n intersection tests of a shape to the calling thread's
+ * @c shapeprofile while profiling is on, e.g.
+ * @code SHAPEPROFILE_TESTS(s, 1); @endcode Like @c RAYSTATS_ADD it expands
+ * to nothing unless the program is built with @c RT_STATS defined, since
+ * the tests are counted in the innermost loops.
+ */
+#ifdef RT_STATS
+#define SHAPEPROFILE_TESTS(s, n) (shapeprofile::isEnabled() ? \
+		shapeprofile::local().countTests((s), (n)) : (void) 0)
+#else
+#define SHAPEPROFILE_TESTS(s, n) ((void) 0)
+#endif
+
+/**
+ * What a render cost each shape and light of a scene, to tell which of
+ * them makes it slow: the hits of each shape that were shaded and the
+ * cycles spent shading them, light samples and shadow rays included, and
+ * the samples of each light, how many of them were blocked and the cycles
+ * they took. With @c RT_STATS the intersection tests of each shape are
+ * counted too, by its address, since the accelerators don't know the ids
+ * of the shapes they test. Like @c raystats every thread counts into its
+ * own and @c total adds them up; nothing is counted unless
+ * @c setEnabled turned profiling on.
+ */
+struct shapeprofile {
+
+	/**
+	 * Hits shaded, by id of the shape in the scene.
+	 */
+	std::vector<unsigned long long> hits;
+
+	/**
+	 * Cycles spent shading the hits, by id of the shape.
+	 */
+	std::vector<unsigned long long> shadeCycles;
+
+	/**
+	 * Intersection tests by address of the shape, with @c RT_STATS .
+	 */
+	std::map<const void *, unsigned long long> tests;
+
+	/**
+	 * Light samples shaded, by index of the light in the scene's lights.
+	 */
+	std::vector<unsigned long long> samples;
+
+	/**
+	 * Light samples whose shadow rays were blocked, by index of the light.
+	 */
+	std::vector<unsigned long long> blocked;
+
+	/**
+	 * Cycles spent on the samples, shadow rays included, by index of the
+	 * light.
+	 */
+	std::vector<unsigned long long> lightCycles;
+
+	/**
+	 * Counts a hit of a shape that was shaded.
+	 *
+	 * @param id Id of the shape.
+	 * @param cycles Cycles spent shading it.
+	 */
+	void countHit(int id, unsigned long long cycles) {
+		if ((size_t) id >= hits.size()) {
+			hits.resize(id + 1, 0);
+			shadeCycles.resize(id + 1, 0);
+		}
+		hits[id]++;
+		shadeCycles[id] += cycles;
+	}
+
+	/**
+	 * Counts a light sample.
+	 *
+	 * @param slot Index of the light.
+	 * @param result That of @c scene::addSample : 0 if the sample was
+	 *   blocked.
+	 * @param cycles Cycles spent on it.
+	 */
+	void countSample(int slot, int result, unsigned long long cycles) {
+		if ((size_t) slot >= samples.size()) {
+			samples.resize(slot + 1, 0);
+			blocked.resize(slot + 1, 0);
+			lightCycles.resize(slot + 1, 0);
+		}
+		samples[slot]++;
+		blocked[slot] += result == 0;
+		lightCycles[slot] += cycles;
+	}
+
+	/**
+	 * Counts intersection tests of a shape.
+	 *
+	 * @param s The shape.
+	 * @param n Number of tests.
+	 */
+	void countTests(const void *s, unsigned long long n) {
+		tests[s] += n;
+	}
+
+	/**
+	 * Drops every count.
+	 */
+	void clear() {
+		hits.clear();
+		shadeCycles.clear();
+		tests.clear();
+		samples.clear();
+		blocked.clear();
+		lightCycles.clear();
+	}
+
+	/**
+	 * Adds other counts to these.
+	 *
+	 * @param other The counts to add.
+	 */
+	void merge(const shapeprofile &other) {
+		add(hits, other.hits);
+		add(shadeCycles, other.shadeCycles);
+		add(samples, other.samples);
+		add(blocked, other.blocked);
+		add(lightCycles, other.lightCycles);
+		std::map<const void *, unsigned long long>::const_iterator it;
+		for (it = other.tests.begin(); it != other.tests.end(); ++it)
+			tests[it->first] += it->second;
+	}
+
+	/**
+	 * Gets a count of a vector of counts, 0 past its end.
+	 *
+	 * @param counts The counts.
+	 * @param i Index of the count.
+	 *
+	 * @return The count.
+	 */
+	static unsigned long long at(const std::vector<unsigned long long> &counts,
+			int i) {
+		return (size_t) i < counts.size() ? counts[i] : 0;
+	}
+
+	/**
+	 * Gets the intersection tests of a shape.
+	 *
+	 * @param s The shape.
+	 *
+	 * @return The tests, 0 without @c RT_STATS .
+	 */
+	unsigned long long testsOf(const void *s) const {
+		std::map<const void *, unsigned long long>::const_iterator it =
+				tests.find(s);
+		return it != tests.end() ? it->second : 0;
+	}
+
+	/**
+	 * Tells if profiling is on.
+	 *
+	 * @return @c true if renders count into the profiles of their threads.
+	 */
+	static bool isEnabled() {
+		return enabled();
+	}
+
+	/**
+	 * Turns profiling on or off for every render that starts from now on.
+	 * It costs two reads of the cycle counter per hit and per light
+	 * sample, and with @c RT_STATS a lookup per intersection test.
+	 *
+	 * @param on Whether to profile.
+	 */
+	static void setEnabled(bool on) {
+		enabled() = on;
+	}
+
+	/**
+	 * Gets the profile of the calling thread, made the first time it asks
+	 * and kept until @c reset , as @c raystats::local does.
+	 *
+	 * @return The thread's profile.
+	 */
+	static shapeprofile& local() {
+		static __thread shapeprofile *mine = 0;
+		if (mine == 0) {
+			mine = new shapeprofile();
+			boost::lock_guard<boost::mutex> guard(registryLock());
+			registry().push_back(mine);
+		}
+		return *mine;
+	}
+
+	/**
+	 * Adds up the profiles of every thread. No thread may be counting.
+	 *
+	 * @return The sums.
+	 */
+	static shapeprofile total() {
+		shapeprofile sum;
+		boost::lock_guard<boost::mutex> guard(registryLock());
+		for (size_t i = 0; i < registry().size(); i++)
+			sum.merge(*registry()[i]);
+		return sum;
+	}
+
+	/**
+	 * Drops the counts of every thread. No thread may be counting.
+	 */
+	static void reset() {
+		boost::lock_guard<boost::mutex> guard(registryLock());
+		for (size_t i = 0; i < registry().size(); i++)
+			registry()[i]->clear();
+	}
+
+private:
+
+	/*
+	 * Adds counts to counts, element by element.
+	 */
+	static void add(std::vector<unsigned long long> &to,
+			const std::vector<unsigned long long> &from) {
+		if (to.size() < from.size())
+			to.resize(from.size(), 0);
+		for (size_t i = 0; i < from.size(); i++)
+			to[i] += from[i];
+	}
+
+	/**
+	 * Gets the flag behind @c isEnabled .
+	 */
+	static bool& enabled() {
+		static bool on = false;
+		return on;
+	}
+
+	/**
+	 * Gets the profiles of all threads that ever counted.
+	 */
+	static std::vector<shapeprofile *>& registry() {
+		static std::vector<shapeprofile *> all;
+		return all;
+	}
+
+	/**
+	 * Gets the lock that guards @c registry .
+	 */
+	static boost::mutex& registryLock() {
+		static boost::mutex lock;
+		return lock;
+	}
+};
+
+/**
+ * A row of a profile report: a shape or a light and what it cost. Shapes
+ * have no samples and lights have no hits or tests.
+ */
+struct profilerow {
+	/** Id of the shape, or index of the light as it was added. */
+	int index;
+	/** What it is, as its @c printHelper says. */
+	std::string what;
+	/** Cycles spent shading its hits, or on its samples. */
+	unsigned long long cycles;
+	/** Hits shaded. */
+	unsigned long long hits;
+	/** Intersection tests. */
+	unsigned long long tests;
+	/** Light samples. */
+	unsigned long long samples;
+	/** Light samples that were blocked. */
+	unsigned long long blocked;
+
+	/**
+	 * Makes a row of nothing.
+	 *
+	 * @param index Id of the shape or index of the light.
+	 */
+	explicit profilerow(int index = 0) : index(index), cycles(0), hits(0),
+			tests(0), samples(0), blocked(0) { }
+};
+
+/**
+ * Orders rows from the costliest: by cycles, then by tests, then by
+ * index.
+ *
+ * @param a A row.
+ * @param b Another row.
+ *
+ * @return @c true if @c a goes first.
+ */
+inline bool costlierRow(const profilerow &a, const profilerow &b) {
+	if (a.cycles != b.cycles)
+		return a.cycles > b.cycles;
+	if (a.tests != b.tests)
+		return a.tests > b.tests;
+	return a.index < b.index;
+}
+
+/**
+ * Sorts rows from the costliest and keeps the first ones.
+ *
+ * @param[in,out] rows The rows.
+ * @param top How many to keep.
+ *
+ * @return The cycles of all the rows before any were dropped.
+ */
+inline unsigned long long rankProfileRows(std::vector<profilerow> &rows,
+		int top) {
+	unsigned long long sum = 0;
+	for (size_t i = 0; i < rows.size(); i++)
+		sum += rows[i].cycles;
+	std::sort(rows.begin(), rows.end(), costlierRow);
+	if (top >= 0 && rows.size() > (size_t) top)
+		rows.resize(top);
+	return sum;
+}
+
+/**
+ * Prints the costliest shapes or lights as a table, one per line with its
+ * share of the cycles, e.g.
+ * @code
+ * costliest 2 of 6 shapes:
+ *     share      cycles    hits     tests  shape
+ *     71.3%    91820334    4410    583301  2 [scene object. ...
+ * @endcode
+ *
+ * @param os The output stream to which to write.
+ * @param rows The rows.
+ * @param top How many to print.
+ * @param lights Whether the rows are of lights.
+ */
+inline void printProfileRows(std::ostream &os, std::vector<profilerow> rows,
+		int top, bool lights) {
+	size_t all = rows.size();
+	unsigned long long sum = rankProfileRows(rows, top);
+	const char *kind = lights ? "light" : "shape";
+	os << "costliest " << rows.size() << " of " << all << " " << kind <<
+			"s:" << std::endl;
+	std::ios::fmtflags flags = os.flags();
+	std::streamsize precision = os.precision();
+	os.setf(std::ios::fixed);
+	os.precision(1);
+	os.width(10);
+	os << "share";
+	os.width(14);
+	os << "cycles";
+	os.width(10);
+	os << (lights ? "samples" : "hits");
+	os.width(10);
+	os << (lights ? "blocked" : "tests");
+	os << "  " << kind << std::endl;
+	for (size_t i = 0; i < rows.size(); i++) {
+		const profilerow &r = rows[i];
+		os.width(9);
+		os << (sum > 0 ? 100.0 * r.cycles / sum : 0.0) << "%";
+		os.width(14);
+		os << r.cycles;
+		os.width(10);
+		os << (lights ? r.samples : r.hits);
+		os.width(10);
+		os << (lights ? r.blocked : r.tests);
+		os << "  " << r.index << " " << r.what << std::endl;
+	}
+	os.flags(flags);
+	os.precision(precision);
+}
+
+/**
+ * Writes a string as a JSON string.
+ *
+ * @param os The output stream to which to write.
+ * @param s The string.
+ */
+inline void writeJsonString(std::ostream &os, const std::string &s) {
+	os << "\"";
+	for (size_t i = 0; i < s.size(); i++) {
+		if (s[i] == '"' || s[i] == '\\')
+			os << "\\" << s[i];
+		else if (s[i] == '\n')
+			os << "\\n";
+		else if ((unsigned char) s[i] >= 0x20)
+			os << s[i];
+	}
+	os << "\"";
+}
+
+/**
+ * Writes the costliest shapes or lights as a JSON array of objects, e.g.
+ * @code [{"index": 2, "share": 0.713, "cycles": 91820334, "hits": 4410,
+ * "tests": 583301, "what": "[scene object. ..."}] @endcode , with
+ * @c samples and @c blocked in place of @c hits and @c tests for lights.
+ *
+ * @param os The output stream to which to write.
+ * @param rows The rows.
+ * @param top How many to write.
+ * @param lights Whether the rows are of lights.
+ */
+inline void writeProfileJson(std::ostream &os, std::vector<profilerow> rows,
+		int top, bool lights) {
+	unsigned long long sum = rankProfileRows(rows, top);
+	os << "[";
+	for (size_t i = 0; i < rows.size(); i++) {
+		const profilerow &r = rows[i];
+		os << (i > 0 ? ", " : "") << "{\"index\": " << r.index <<
+				", \"share\": " << (sum > 0 ? (double) r.cycles / sum : 0.0)
+				<< ", \"cycles\": " << r.cycles;
+		if (lights)
+			os << ", \"samples\": " << r.samples << ", \"blocked\": " <<
+					r.blocked;
+		else
+			os << ", \"hits\": " << r.hits << ", \"tests\": " << r.tests;
+		os << ", \"what\": ";
+		writeJsonString(os, r.what);
+		os << "}";
+	}
+	os << "]";
+}
+
+#endif // SHAPEPROFILE_HH
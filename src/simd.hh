@@ -0,0 +1,120 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include <string>
+
+#ifndef SIMD_HH
+#define SIMD_HH
+
+/**
+ * Defined when kernels for instruction sets beyond the ones the build
+ * targets can be compiled with GCC's @c target attribute and picked at run
+ * time. This needs GCC or Clang on x86.
+ */
+#if defined(__GNUC__) && defined(__SSE2__) && \
+		(defined(__x86_64__) || defined(__i386__))
+#define SIMD_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+/**
+ * The instruction sets the batch intersection kernels, like those of
+ * @c spherepack , come in, in increasing order of width.
+ */
+enum simdLevel {
+	/** One shape at a time. */
+	SIMD_SCALAR,
+	/** 128 bit vectors. */
+	SIMD_SSE2,
+	/** 256 bit vectors. */
+	SIMD_AVX2,
+	/** 512 bit vectors. */
+	SIMD_AVX512
+};
+
+/**
+ * Finds the widest instruction set the processor this runs on supports,
+ * with CPUID.
+ *
+ * @return The level.
+ */
+inline simdLevel detectSimdLevel() {
+#ifdef SIMD_DISPATCH
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return SIMD_AVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return SIMD_AVX2;
+	return SIMD_SSE2;
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+/**
+ * Gets the instruction set the kernels use, which is the one found by
+ * @c detectSimdLevel unless @c setSimdLevel picked another.
+ *
+ * @return Reference to the process-wide level.
+ */
+inline simdLevel& activeSimdLevel() {
+	static simdLevel level = detectSimdLevel();
+	return level;
+}
+
+/**
+ * Makes the kernels use the given instruction set, or the widest one the
+ * processor supports if that's narrower. Call this before rendering starts.
+ *
+ * @param level The level.
+ *
+ * @return The level now in use.
+ */
+inline simdLevel setSimdLevel(simdLevel level) {
+	simdLevel best = detectSimdLevel();
+	activeSimdLevel() = level < best ? level : best;
+	return activeSimdLevel();
+}
+
+/**
+ * Gets the name of an instruction set as used by the driver's @c --simd
+ * option.
+ *
+ * @param level The level.
+ *
+ * @return The name.
+ */
+inline const char* simdLevelName(simdLevel level) {
+	switch (level) {
+	case SIMD_SSE2:
+		return "sse2";
+	case SIMD_AVX2:
+		return "avx2";
+	case SIMD_AVX512:
+		return "avx512";
+	default:
+		return "scalar";
+	}
+}
+
+/**
+ * Looks up an instruction set by the name @c simdLevelName gives it.
+ *
+ * @param name The name.
+ * @param[out] level Receives the level.
+ *
+ * @return @c false if the name isn't known.
+ */
+inline bool parseSimdLevel(const std::string &name, simdLevel &level) {
+	for (int l = SIMD_SCALAR; l <= SIMD_AVX512; l++) {
+		if (name == simdLevelName((simdLevel) l)) {
+			level = (simdLevel) l;
+			return true;
+		}
+	}
+	return false;
+}
+
+#endif // SIMD_HH
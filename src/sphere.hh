@@ -41,6 +41,56 @@ private:
 	 */
 	mvector<vec_T, dim> center;
 
+	/**
+	 * Square of @c rad , cached for the intersection tests.
+	 */
+	vec_T radSq;
+
+	/**
+	 * Version of @c getIntersections for rays with unit-length directions,
+	 * where @f$ a = 1 @f$. With @f$ \mathbf{w} = \mathbf{p} - \mathbf{c} @f$,
+	 * @f$ b' = \mathbf{w} \cdot \mathbf{d} @f$ and @f$ c = \mathbf{w} \cdot
+	 * \mathbf{w} - r^2 @f$ the roots are @f$ -b' \pm \sqrt{b'^2 - c} @f$.
+	 */
+	int getIntersectionsUnit(const ray<vec_T, time_T, dim> &r,
+			time_T &t1, time_T &t2) const {
+		const mvector<vec_T, dim> &P = r.getOrig();
+		const mvector<vec_T, dim> &D = r.getDir();
+		vec_T b = 0, c = -radSq;
+		for (int i = 0; i < dim; i++) {
+			vec_T w = P[i] - center[i];
+			b += w * D[i];
+			c += w * w;
+		}
+		vec_T disc = b * b - c;
+		if (disc < 0) {
+			t1 = RAY_MISS;
+			t2 = RAY_MISS;
+			return 0;
+		}
+		if (disc == 0) {
+			t1 = (time_T) -b;
+			if (t1 < 0) {
+				t1 = RAY_MISS;
+				return 0;
+			}
+			return 1;
+		}
+		vec_T sq = sqrt(disc);
+		t1 = (time_T) (-b - sq);
+		t2 = (time_T) (-b + sq);
+		if (t2 < 0) {
+			t1 = RAY_MISS;
+			t2 = RAY_MISS;
+			return 0;
+		}
+		if (t1 < 0) {
+			t1 = RAY_MISS;
+			return 1;
+		}
+		return 2;
+	}
+
 public:
 
 	/**
@@ -52,6 +102,7 @@ public:
 		mvector<vec_T, dim> v;
 		center = v;
 		rad = 1;
+		radSq = 1;
 	}
 
 	/**
@@ -69,7 +120,8 @@ public:
 		  float reflectivity = 0) :
 			  shape<vec_T, color_T, time_T, dim>(color, reflectivity),
 			  rad(radius),
-			  center(theCenter) {
+			  center(theCenter),
+			  radSq(radius * radius) {
 		assert(radius > 0);
 	}
 
@@ -84,6 +136,7 @@ public:
 					other.getColor(), other.getReflectivity()) {
 		rad = other.getRadius();
 		center = other.getCenter();
+		radSq = rad * rad;
 	}
 
 	/**
@@ -99,6 +152,7 @@ public:
 		this->setReflectivity(rhs.getReflectivity());
 		rad = rhs.getRadius();
 		center = rhs.getCenter();
+		radSq = rad * rad;
 		return *this;
 	}
 
@@ -111,6 +165,17 @@ public:
 		return rad;
 	}
 
+	/**
+	 * Sets the radius of this sphere.
+	 *
+	 * @param radius The new radius.
+	 */
+	void setRadius(vec_T radius) {
+		assert(radius > 0);
+		rad = radius;
+		radSq = radius * radius;
+	}
+
 	/**
 	 * Gets a reference to the center of this sphere.
 	 *
@@ -120,6 +185,15 @@ public:
 		return center;
 	}
 
+	/**
+	 * Sets the center of this sphere.
+	 *
+	 * @param theCenter The new center.
+	 */
+	void setCenter(const mvector<vec_T, dim> &theCenter) {
+		center = theCenter;
+	}
+
 	/**
 	 * Gets all intersection points of the given ray @c r with the this sphere.
 	 * Note that a ray can intersect a sphere
@@ -135,7 +209,8 @@ public:
 	 * sphere, @f$ a = \mathbf{d} \cdot \mathbf{d} @f$, @f$ b =
 	 * 2 (\mathbf{p} \cdot \mathbf{d} - \mathbf{d} \cdot \mathbf{c}) @f$, and
 	 * @f$ c = \mathbf{p} \cdot \mathbf{p} + \mathbf{c} \cdot \mathbf{c} -
-	 * 2 \mathbf{p} \cdot \mathbf{c} - r^2 @f$.
+	 * 2 \mathbf{p} \cdot \mathbf{c} - r^2 @f$. Rays whose direction was
+	 * normalized take a shorter path where @f$ a = 1 @f$.
      *
      * @param r The ray.
      * @param[out] t1 The first intersection time.
@@ -145,10 +220,12 @@ public:
 	 */
 	int getIntersections(const ray<vec_T, time_T, dim> &r,
 			time_T &t1, time_T &t2) const {
+		if (r.isNormalized())
+			return getIntersectionsUnit(r, t1, t2);
 		vec_T a = r.getDir() * r.getDir();
 		vec_T b = 2 * (r.getOrig() * r.getDir() - r.getDir() * center);
 		vec_T c = r.getOrig() * r.getOrig() + center * center -
-				2 * (r.getOrig() * center) - rad * rad;
+				2 * (r.getOrig() * center) - radSq;
 		vec_T tmpsqrt;
 		tmpsqrt = b * b - 4 * a * c;
 		if (tmpsqrt < 0) {
@@ -190,13 +267,17 @@ public:
 
 	/**
 	 * Gets the earliest time at which at intersection happens between
-	 * the given ray and this sphere. Returns @c RAY_MISS if there's no hit.
+	 * the given ray and this sphere. Returns @c RAY_MISS if there's no hit,
+	 * or without a test if the ray leaves this sphere; see
+	 * @c ray::setExcluded .
 	 *
 	 * @param r The ray.
 	 *
 	 * @return The earliest time at which the ray @c r intersects this sphere.
 	 */
 	time_T intersection(const ray<vec_T, time_T, dim> &r) const {
+		if (r.getExcluded() == this)
+			return RAY_MISS;
 
 		// t1 and t2 will receive the first and second intersection points
 		// on the sphere
@@ -208,6 +289,31 @@ public:
 		return t1;
 	}
 
+	/**
+	 * Intersects a packet of rays with this sphere; see
+	 * @c shape::intersections .
+	 */
+	void intersections(const ray<vec_T, time_T, dim> *rays, int count,
+			unsigned int mask, time_T *t) const {
+		for (int k = 0; k < count; k++)
+			if (mask >> k & 1)
+				t[k] = sphere::intersection(rays[k]);
+	}
+
+	/**
+	 * Fills in a hit record. The normal is the vector from the center to the
+	 * hit point over the radius, which saves normalizing it.
+	 *
+	 * @param r The ray.
+	 * @param[in,out] rec The record, whose @c t is the time of the hit.
+	 */
+	void completeHit(const ray<vec_T, time_T, dim> &r,
+			hitrecord<vec_T, color_T, time_T, dim> &rec) const {
+		rec.point = r.getPointAtT(rec.t);
+		rec.normal = (rec.point - center) / rad;
+		rec.obj = this;
+	}
+
 	/**
 	 * Returns the surface normal to this sphere at the point @c surfacePt.
 	 *
@@ -221,6 +327,21 @@ public:
 		return tmp.norm();
 	}
 
+	/**
+	 * Gets the cube that encloses this sphere.
+	 *
+	 * @param[out] box Receives the bounding box.
+	 *
+	 * @return Always @c true since spheres are bounded.
+	 */
+	bool getBounds(aabb<vec_T, dim> &box) const {
+		mvector<vec_T, dim> extent;
+		for (int i = 0; i < dim; i++)
+			extent[i] = rad;
+		box = aabb<vec_T, dim>(center - extent, center + extent);
+		return true;
+	}
+
 	// colorAt doesn't have an override yet.
 
 	/**
@@ -0,0 +1,827 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "shape.hh"
+#include "sphere.hh"
+#include "shapekind.hh"
+#include "shapeprofile.hh"
+#include "ray.hh"
+#include "sceneobj.hh"
+#include "simd.hh"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <vector>
+
+#ifndef SPHEREPACK_HH
+#define SPHEREPACK_HH
+
+/**
+ * Tests a ray with a unit-length direction against the spheres of a
+ * @c spherepack one at a time, with the arithmetic of
+ * @c sphere::getIntersectionsUnit , until one of them is entered at a
+ * positive time. This is the kernel of @c SIMD_SCALAR and of types without
+ * SIMD kernels; see @c spherelanes .
+ *
+ * @param center The arrays of the center coordinates, one per axis.
+ * @param radSq The squared radii. NaN makes a sphere always miss.
+ * @param i Index of the first sphere to test.
+ * @param end One past the last sphere to test.
+ * @param P The ray origin.
+ * @param D The ray direction, which must have unit length.
+ * @param[out] t Receives the entry time of the sphere that was hit.
+ * @param[out] mask Receives 1 if a sphere was hit.
+ *
+ * @return Index of the sphere that was hit, or @c end .
+ */
+template<typename vec_T, int dim>
+int findScalar(const vec_T *const *center, const vec_T *radSq, int i,
+		int end, const vec_T *P, const vec_T *D, vec_T *t, int &mask) {
+	for (; i < end; i++) {
+		vec_T b = 0, c = -radSq[i];
+		for (int a = 0; a < dim; a++) {
+			vec_T w = P[a] - center[a][i];
+			b += w * D[a];
+			c += w * w;
+		}
+		vec_T disc = b * b - c;
+		if (!(disc >= 0))
+			continue;
+		t[0] = -b - sqrt(disc);
+		if (t[0] > 0) {
+			mask = 1;
+			return i;
+		}
+	}
+	return end;
+}
+
+/**
+ * Batch ray-sphere tests for @c spherepack , in the instruction set picked
+ * at run time by @c activeSimdLevel . Each kernel tests a group of
+ * consecutive spheres at once and does exactly the arithmetic of
+ * @c sphere::getIntersectionsUnit in every lane. This generic version only
+ * has the scalar kernel; there are specializations for doubles and floats.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam dim The number of dimensions.
+ */
+template<typename vec_T, int dim>
+struct spherelanes {
+
+	/**
+	 * Largest group any kernel tests at once. The arrays of a pack need
+	 * this many slots minus one of padding.
+	 */
+	static const int maxWidth = 1;
+
+	/**
+	 * Finds the first group of spheres, stepping from @c i by the width of
+	 * the kernel, in which the ray enters some sphere at a positive time.
+	 * Lanes past @c end may be reported too and must be ignored.
+	 *
+	 * @param level The instruction set to use.
+	 * @param center The arrays of the center coordinates, one per axis.
+	 * @param radSq The squared radii. NaN makes a lane always miss.
+	 * @param i Index of the first sphere to test.
+	 * @param end One past the last sphere to test.
+	 * @param P The ray origin.
+	 * @param D The ray direction, which must have unit length.
+	 * @param[out] t Receives the entry times of the group; only those of
+	 *   hit lanes are meaningful.
+	 * @param[out] mask Receives the bit mask of the hit lanes.
+	 * @param[out] width Receives the width of the kernel.
+	 *
+	 * @return Index of the first sphere of the group, or at least @c end if
+	 *   no sphere was hit.
+	 */
+	static int find(simdLevel level, const vec_T *const *center,
+			const vec_T *radSq, int i, int end, const vec_T *P,
+			const vec_T *D, vec_T *t, int &mask, int &width) {
+		width = 1;
+		return findScalar<vec_T, dim>(center, radSq, i, end, P, D, t, mask);
+	}
+};
+
+#ifdef SIMD_DISPATCH
+
+/**
+ * @c spherelanes for doubles, 2, 4 or 8 spheres at a time with SSE2,
+ * AVX2 or AVX-512.
+ */
+template<int dim>
+struct spherelanes<double, dim> {
+	static const int maxWidth = 8;
+
+	/** The SSE2 kernel of @c find . */
+	static int find128(const double *const *center, const double *radSq, int i,
+			int end, const double *P, const double *D, double *t, int &mask) {
+		const __m128d sign = _mm_set1_pd(-0.0), zero = _mm_setzero_pd();
+		__m128d p[dim], d[dim];
+		for (int a = 0; a < dim; a++) {
+			p[a] = _mm_set1_pd(P[a]);
+			d[a] = _mm_set1_pd(D[a]);
+		}
+		for (; i < end; i += 2) {
+			__m128d b = zero;
+			__m128d c = _mm_xor_pd(_mm_loadu_pd(radSq + i), sign);
+			for (int a = 0; a < dim; a++) {
+				__m128d w = _mm_sub_pd(p[a], _mm_loadu_pd(center[a] + i));
+				b = _mm_add_pd(b, _mm_mul_pd(w, d[a]));
+				c = _mm_add_pd(c, _mm_mul_pd(w, w));
+			}
+			__m128d disc = _mm_sub_pd(_mm_mul_pd(b, b), c);
+			__m128d front = _mm_cmpge_pd(disc, zero);
+			if (_mm_movemask_pd(front) == 0)
+				continue;
+			__m128d tt = _mm_sub_pd(_mm_xor_pd(b, sign), _mm_sqrt_pd(disc));
+			int hit = _mm_movemask_pd(_mm_and_pd(front,
+					_mm_cmpgt_pd(tt, zero)));
+			if (hit != 0) {
+				_mm_storeu_pd(t, tt);
+				mask = hit;
+				return i;
+			}
+		}
+		return end;
+	}
+
+	/** The AVX2 kernel of @c find . */
+	__attribute__((target("avx2")))
+	static int find256(const double *const *center, const double *radSq, int i,
+			int end, const double *P, const double *D, double *t, int &mask) {
+		const __m256d sign = _mm256_set1_pd(-0.0), zero = _mm256_setzero_pd();
+		__m256d p[dim], d[dim];
+		for (int a = 0; a < dim; a++) {
+			p[a] = _mm256_set1_pd(P[a]);
+			d[a] = _mm256_set1_pd(D[a]);
+		}
+		for (; i < end; i += 4) {
+			__m256d b = zero;
+			__m256d c = _mm256_xor_pd(_mm256_loadu_pd(radSq + i), sign);
+			for (int a = 0; a < dim; a++) {
+				__m256d w = _mm256_sub_pd(p[a], _mm256_loadu_pd(center[a] + i));
+				b = _mm256_add_pd(b, _mm256_mul_pd(w, d[a]));
+				c = _mm256_add_pd(c, _mm256_mul_pd(w, w));
+			}
+			__m256d disc = _mm256_sub_pd(_mm256_mul_pd(b, b), c);
+			__m256d front = _mm256_cmp_pd(disc, zero, _CMP_GE_OQ);
+			if (_mm256_movemask_pd(front) == 0)
+				continue;
+			__m256d tt = _mm256_sub_pd(_mm256_xor_pd(b, sign),
+					_mm256_sqrt_pd(disc));
+			int hit = _mm256_movemask_pd(_mm256_and_pd(front,
+					_mm256_cmp_pd(tt, zero, _CMP_GT_OQ)));
+			if (hit != 0) {
+				_mm256_storeu_pd(t, tt);
+				mask = hit;
+				return i;
+			}
+		}
+		return end;
+	}
+
+	/** Flips the sign bits, which needs only AVX-512F. */
+	__attribute__((target("avx512f")))
+	static __m512d neg512(__m512d x) {
+		return _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(x),
+				_mm512_set1_epi64((long long) 0x8000000000000000ull)));
+	}
+
+	/** The AVX-512 kernel of @c find . */
+	__attribute__((target("avx512f")))
+	static int find512(const double *const *center, const double *radSq, int i,
+			int end, const double *P, const double *D, double *t, int &mask) {
+		const __m512d zero = _mm512_setzero_pd();
+		__m512d p[dim], d[dim];
+		for (int a = 0; a < dim; a++) {
+			p[a] = _mm512_set1_pd(P[a]);
+			d[a] = _mm512_set1_pd(D[a]);
+		}
+		for (; i < end; i += 8) {
+			__m512d b = zero;
+			__m512d c = neg512(_mm512_loadu_pd(radSq + i));
+			for (int a = 0; a < dim; a++) {
+				__m512d w = _mm512_sub_pd(p[a], _mm512_loadu_pd(center[a] + i));
+				b = _mm512_add_pd(b, _mm512_mul_pd(w, d[a]));
+				c = _mm512_add_pd(c, _mm512_mul_pd(w, w));
+			}
+			__m512d disc = _mm512_sub_pd(_mm512_mul_pd(b, b), c);
+			int front = _mm512_cmp_pd_mask(disc, zero, _CMP_GE_OQ);
+			if (front == 0)
+				continue;
+			__m512d tt = _mm512_sub_pd(neg512(b), _mm512_sqrt_pd(disc));
+			int hit = front & _mm512_cmp_pd_mask(tt, zero, _CMP_GT_OQ);
+			if (hit != 0) {
+				_mm512_storeu_pd(t, tt);
+				mask = hit;
+				return i;
+			}
+		}
+		return end;
+	}
+
+	/** Runs the kernel of the given level; see @c spherelanes::find . */
+	static int find(simdLevel level, const double *const *center,
+			const double *radSq, int i, int end, const double *P,
+			const double *D, double *t, int &mask, int &width) {
+		switch (level) {
+		case SIMD_AVX512:
+			width = 8;
+			return find512(center, radSq, i, end, P, D, t, mask);
+		case SIMD_AVX2:
+			width = 4;
+			return find256(center, radSq, i, end, P, D, t, mask);
+		case SIMD_SSE2:
+			width = 2;
+			return find128(center, radSq, i, end, P, D, t, mask);
+		default:
+			width = 1;
+			return findScalar<double, dim>(center, radSq, i, end, P, D, t,
+					mask);
+		}
+	}
+};
+
+/**
+ * @c spherelanes for floats, 4, 8 or 16 spheres at a time with SSE2,
+ * AVX2 or AVX-512.
+ */
+template<int dim>
+struct spherelanes<float, dim> {
+	static const int maxWidth = 16;
+
+	/** The SSE2 kernel of @c find . */
+	static int find128(const float *const *center, const float *radSq, int i,
+			int end, const float *P, const float *D, float *t, int &mask) {
+		const __m128 sign = _mm_set1_ps(-0.0f), zero = _mm_setzero_ps();
+		__m128 p[dim], d[dim];
+		for (int a = 0; a < dim; a++) {
+			p[a] = _mm_set1_ps(P[a]);
+			d[a] = _mm_set1_ps(D[a]);
+		}
+		for (; i < end; i += 4) {
+			__m128 b = zero;
+			__m128 c = _mm_xor_ps(_mm_loadu_ps(radSq + i), sign);
+			for (int a = 0; a < dim; a++) {
+				__m128 w = _mm_sub_ps(p[a], _mm_loadu_ps(center[a] + i));
+				b = _mm_add_ps(b, _mm_mul_ps(w, d[a]));
+				c = _mm_add_ps(c, _mm_mul_ps(w, w));
+			}
+			__m128 disc = _mm_sub_ps(_mm_mul_ps(b, b), c);
+			__m128 front = _mm_cmpge_ps(disc, zero);
+			if (_mm_movemask_ps(front) == 0)
+				continue;
+			__m128 tt = _mm_sub_ps(_mm_xor_ps(b, sign), _mm_sqrt_ps(disc));
+			int hit = _mm_movemask_ps(_mm_and_ps(front,
+					_mm_cmpgt_ps(tt, zero)));
+			if (hit != 0) {
+				_mm_storeu_ps(t, tt);
+				mask = hit;
+				return i;
+			}
+		}
+		return end;
+	}
+
+	/** The AVX2 kernel of @c find . */
+	__attribute__((target("avx2")))
+	static int find256(const float *const *center, const float *radSq, int i,
+			int end, const float *P, const float *D, float *t, int &mask) {
+		const __m256 sign = _mm256_set1_ps(-0.0f), zero = _mm256_setzero_ps();
+		__m256 p[dim], d[dim];
+		for (int a = 0; a < dim; a++) {
+			p[a] = _mm256_set1_ps(P[a]);
+			d[a] = _mm256_set1_ps(D[a]);
+		}
+		for (; i < end; i += 8) {
+			__m256 b = zero;
+			__m256 c = _mm256_xor_ps(_mm256_loadu_ps(radSq + i), sign);
+			for (int a = 0; a < dim; a++) {
+				__m256 w = _mm256_sub_ps(p[a], _mm256_loadu_ps(center[a] + i));
+				b = _mm256_add_ps(b, _mm256_mul_ps(w, d[a]));
+				c = _mm256_add_ps(c, _mm256_mul_ps(w, w));
+			}
+			__m256 disc = _mm256_sub_ps(_mm256_mul_ps(b, b), c);
+			__m256 front = _mm256_cmp_ps(disc, zero, _CMP_GE_OQ);
+			if (_mm256_movemask_ps(front) == 0)
+				continue;
+			__m256 tt = _mm256_sub_ps(_mm256_xor_ps(b, sign),
+					_mm256_sqrt_ps(disc));
+			int hit = _mm256_movemask_ps(_mm256_and_ps(front,
+					_mm256_cmp_ps(tt, zero, _CMP_GT_OQ)));
+			if (hit != 0) {
+				_mm256_storeu_ps(t, tt);
+				mask = hit;
+				return i;
+			}
+		}
+		return end;
+	}
+
+	/** Flips the sign bits, which needs only AVX-512F. */
+	__attribute__((target("avx512f")))
+	static __m512 neg512(__m512 x) {
+		return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(x),
+				_mm512_set1_epi32((int) 0x80000000u)));
+	}
+
+	/** The AVX-512 kernel of @c find . */
+	__attribute__((target("avx512f")))
+	static int find512(const float *const *center, const float *radSq, int i,
+			int end, const float *P, const float *D, float *t, int &mask) {
+		const __m512 zero = _mm512_setzero_ps();
+		__m512 p[dim], d[dim];
+		for (int a = 0; a < dim; a++) {
+			p[a] = _mm512_set1_ps(P[a]);
+			d[a] = _mm512_set1_ps(D[a]);
+		}
+		for (; i < end; i += 16) {
+			__m512 b = zero;
+			__m512 c = neg512(_mm512_loadu_ps(radSq + i));
+			for (int a = 0; a < dim; a++) {
+				__m512 w = _mm512_sub_ps(p[a], _mm512_loadu_ps(center[a] + i));
+				b = _mm512_add_ps(b, _mm512_mul_ps(w, d[a]));
+				c = _mm512_add_ps(c, _mm512_mul_ps(w, w));
+			}
+			__m512 disc = _mm512_sub_ps(_mm512_mul_ps(b, b), c);
+			int front = _mm512_cmp_ps_mask(disc, zero, _CMP_GE_OQ);
+			if (front == 0)
+				continue;
+			__m512 tt = _mm512_sub_ps(neg512(b), _mm512_sqrt_ps(disc));
+			int hit = front & _mm512_cmp_ps_mask(tt, zero, _CMP_GT_OQ);
+			if (hit != 0) {
+				_mm512_storeu_ps(t, tt);
+				mask = hit;
+				return i;
+			}
+		}
+		return end;
+	}
+
+	/** Runs the kernel of the given level; see @c spherelanes::find . */
+	static int find(simdLevel level, const float *const *center,
+			const float *radSq, int i, int end, const float *P,
+			const float *D, float *t, int &mask, int &width) {
+		switch (level) {
+		case SIMD_AVX512:
+			width = 16;
+			return find512(center, radSq, i, end, P, D, t, mask);
+		case SIMD_AVX2:
+			width = 8;
+			return find256(center, radSq, i, end, P, D, t, mask);
+		case SIMD_SSE2:
+			width = 4;
+			return find128(center, radSq, i, end, P, D, t, mask);
+		default:
+			width = 1;
+			return findScalar<float, dim>(center, radSq, i, end, P, D, t,
+					mask);
+		}
+	}
+};
+
+#endif // SIMD_DISPATCH
+
+/**
+ * A run of shapes with the spheres among them stored as a structure of
+ * arrays: one array per axis of center coordinates and one of squared
+ * radii, so that a ray can be tested against several spheres at once with
+ * @c spherelanes . Every shape gets a slot, in the order it was added;
+ * callers keep their own maps from slots back to shapes and materials.
+ * Slots of shapes that aren't spheres have a NaN radius, so the SIMD lanes
+ * always miss them, and are tested one by one, dispatched on their
+ * @c shapeKind . Rays that weren't normalized are tested one shape at a
+ * time too. The hits are exactly those
+ * of the shapes' own @c intersection . Note that there are some convenient
+ * typedefs in this file.
+ *
+ * @tparam vec_T The type of the vector components. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double,
+ *   float, or int.
+ * @tparam time_T The type of the time. Many arithmetic and
+ *   relational operators must be supported. The type will likely be double or
+ *   float, but int would likely work.
+ * @tparam color_T The type of the @c rgbcolor. Many arithmetic
+ *   and relational operators must be supported, including real number ones.
+ *   The type will likely be double or float.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+class spherepack {
+private:
+
+	typedef spherelanes<vec_T, dim> lanes;
+
+	/**
+	 * Center coordinates of the slots, one array per axis. The arrays have
+	 * @c lanes::maxWidth - 1 slots of padding at the end so the last slots
+	 * can be loaded a whole lane group at a time.
+	 */
+	std::vector<vec_T> center[dim];
+
+	/**
+	 * Squared radii of the slots, NaN for shapes that aren't spheres and for
+	 * the padding.
+	 */
+	std::vector<vec_T> radSq;
+
+	/**
+	 * The shape of every slot.
+	 */
+	std::vector<const shape<vec_T, color_T, time_T, dim> *> shapes;
+
+	/**
+	 * The @c shapeKind of every slot.
+	 */
+	std::vector<shapeKind> kinds;
+
+	/**
+	 * The slots that don't hold spheres, in ascending order.
+	 */
+	std::vector<int> unpacked;
+
+	/**
+	 * Gets the value that makes a lane miss.
+	 */
+	static vec_T missRadSq() {
+		return std::numeric_limits<vec_T>::has_quiet_NaN ?
+				std::numeric_limits<vec_T>::quiet_NaN() : (vec_T) -1;
+	}
+
+	/**
+	 * Gets the number of spheres in slots [begin, end), which the lanes
+	 * test.
+	 */
+	int packedIn(int begin, int end) const {
+		return (end - begin) - (int) (
+				std::lower_bound(unpacked.begin(), unpacked.end(), end) -
+				std::lower_bound(unpacked.begin(), unpacked.end(), begin));
+	}
+
+	/**
+	 * Counts the tests of the spheres in slots [begin, end), which the lanes
+	 * test all at once, for @c raystats and @c shapeprofile .
+	 */
+	void countPacked(int begin, int end) const {
+		RAYSTATS_ADD(tests[SHAPE_SPHERE], packedIn(begin, end));
+#ifdef RT_STATS
+		if (!shapeprofile::isEnabled())
+			return;
+		for (int i = begin; i < end; i++)
+			if (!std::binary_search(unpacked.begin(), unpacked.end(), i))
+				SHAPEPROFILE_TESTS(shapes[i], 1);
+#endif
+	}
+
+	/**
+	 * Intersects the ray with the shape in slot @c i .
+	 */
+	time_T intersectSlot(int i, const ray<vec_T, time_T, dim> &r) const {
+		return shapedispatch<vec_T, color_T, time_T, dim>::intersection(
+				kinds[i], shapes[i], r);
+	}
+
+	/**
+	 * Finds the closest hit among the spheres in slots [begin, end) that is
+	 * closer than @c tBest , with the lanes, leaving out the one the ray
+	 * leaves. The ray must be normalized.
+	 *
+	 * @return Slot of the closer hit or -1 if there was none.
+	 */
+	int closestSphere(const ray<vec_T, time_T, dim> &r, int begin, int end,
+			time_T &tBest) const {
+		vec_T P[dim], D[dim], t[lanes::maxWidth];
+		const vec_T *c[dim];
+		for (int a = 0; a < dim; a++) {
+			P[a] = r.getOrig()[a];
+			D[a] = r.getDir()[a];
+			c[a] = &center[a][0];
+		}
+		int best = -1;
+		countPacked(begin, end);
+		simdLevel level = activeSimdLevel();
+		int mask, width;
+		for (int i = begin; ; i += width) {
+			i = lanes::find(level, c, &radSq[0], i, end, P, D, t, mask, width);
+			if (i >= end)
+				break;
+			for (int k = 0; mask != 0 && k < width && i + k < end;
+					k++, mask >>= 1) {
+				if (!(mask & 1))
+					continue;
+				time_T tt = (time_T) t[k];
+				if (tt > 0 && (tBest == RAY_MISS || tt < tBest) &&
+						shapes[i + k] != r.getExcluded()) {
+					tBest = tt;
+					best = i + k;
+				}
+			}
+		}
+		return best;
+	}
+
+	/**
+	 * Tests the shape in slot @c i and records it if it's closer than
+	 * @c tBest .
+	 */
+	void testSlot(int i, const ray<vec_T, time_T, dim> &r, time_T &tBest,
+			int &best) const {
+		time_T t = intersectSlot(i, r);
+		if (t != RAY_MISS && t > 0 && (tBest == RAY_MISS || t < tBest)) {
+			tBest = t;
+			best = i;
+		}
+	}
+
+public:
+
+	/**
+	 * Constructs an empty pack.
+	 */
+	spherepack() {
+		for (int i = 0; i < lanes::maxWidth - 1; i++) {
+			for (int a = 0; a < dim; a++)
+				center[a].push_back(0);
+			radSq.push_back(missRadSq());
+		}
+	}
+
+	/**
+	 * Removes all slots.
+	 */
+	void clear() {
+		*this = spherepack<vec_T, color_T, time_T, dim>();
+	}
+
+	/**
+	 * Adds a slot for the given shape. Only shapes that are exactly
+	 * @c sphere s are packed; subclasses might intersect differently.
+	 *
+	 * @param s The shape, which must outlive this pack.
+	 */
+	void add(const shape<vec_T, color_T, time_T, dim> *s) {
+		shapeKind kind =
+				shapedispatch<vec_T, color_T, time_T, dim>::kindOf(s);
+		const sphere<vec_T, color_T, time_T, dim> *sp = kind == SHAPE_SPHERE ?
+				static_cast<const sphere<vec_T, color_T, time_T, dim> *>(s) :
+				0;
+		// Move the padding out of the way.
+		for (int a = 0; a < dim; a++) {
+			center[a].resize(size());
+			center[a].push_back(sp != 0 ? sp->getCenter()[a] : 0);
+			center[a].resize(size() + lanes::maxWidth, 0);
+		}
+		vec_T rad = sp != 0 ? sp->getRadius() : 0;
+		radSq.resize(size());
+		radSq.push_back(sp != 0 ? rad * rad : missRadSq());
+		radSq.resize(size() + lanes::maxWidth, missRadSq());
+		if (sp == 0)
+			unpacked.push_back(size());
+		shapes.push_back(s);
+		kinds.push_back(kind);
+	}
+
+	/**
+	 * Refreshes the centers and radii from the shapes, for example after
+	 * they moved.
+	 */
+	void update() {
+		for (int i = 0; i < size(); i++) {
+			if (!isPacked(i))
+				continue;
+			const sphere<vec_T, color_T, time_T, dim> *sp =
+					static_cast<const sphere<vec_T, color_T, time_T, dim> *>(
+							shapes[i]);
+			for (int a = 0; a < dim; a++)
+				center[a][i] = sp->getCenter()[a];
+			vec_T rad = sp->getRadius();
+			radSq[i] = rad * rad;
+		}
+	}
+
+	/**
+	 * Gets the number of slots.
+	 *
+	 * @return Slot count.
+	 */
+	int size() const {
+		return (int) shapes.size();
+	}
+
+	/**
+	 * Gets the number of slots that hold spheres.
+	 *
+	 * @return Sphere count.
+	 */
+	int getSphereCount() const {
+		return size() - (int) unpacked.size();
+	}
+
+	/**
+	 * Checks whether the given slot holds a packed sphere.
+	 *
+	 * @param i The slot.
+	 *
+	 * @return @c true for spheres.
+	 */
+	bool isPacked(int i) const {
+		return !std::binary_search(unpacked.begin(), unpacked.end(), i);
+	}
+
+	/**
+	 * Finds the closest hit among the shapes in slots [begin, end) that is
+	 * closer than @c tBest .
+	 *
+	 * @param r The ray.
+	 * @param begin First slot.
+	 * @param end One past the last slot.
+	 * @param[in,out] tBest The time of the closest hit so far, or
+	 *   @c RAY_MISS if there's none, which is replaced by the time of a
+	 *   closer hit.
+	 *
+	 * @return Slot of the closer hit or -1 if there was none. Of hits at the
+	 *   same time, the one in the lowest slot is reported.
+	 */
+	int closestHit(const ray<vec_T, time_T, dim> &r, int begin, int end,
+			time_T &tBest) const {
+		assert(begin >= 0 && begin <= end && end <= size());
+		int best = -1;
+		if (!r.isNormalized() || unpacked.size() == shapes.size()) {
+			for (int i = begin; i < end; i++)
+				testSlot(i, r, tBest, best);
+			return best;
+		}
+
+		time_T tSpheres = tBest;
+		best = closestSphere(r, begin, end, tSpheres);
+		std::vector<int>::const_iterator it =
+				std::lower_bound(unpacked.begin(), unpacked.end(), begin);
+		if (it != unpacked.end() && *it < end) {
+			time_T tOther = tBest;
+			int other = -1;
+			for (; it != unpacked.end() && *it < end; ++it)
+				testSlot(*it, r, tOther, other);
+			if (other >= 0 && (best < 0 || tOther < tSpheres ||
+					(tOther == tSpheres && other < best))) {
+				best = other;
+				tSpheres = tOther;
+			}
+		}
+		if (best >= 0)
+			tBest = tSpheres;
+		return best;
+	}
+
+	/**
+	 * Like @c closestHit for each ray of a packet whose bit is set in
+	 * @c mask , with the same hits, but the shapes other than spheres are
+	 * tested a shape at a time against all the rays with
+	 * @c shapedispatch::intersections , so each costs one dispatch per
+	 * packet instead of one per ray. Spheres are still tested a ray at a
+	 * time against the lanes.
+	 *
+	 * @param rays The rays of the packet.
+	 * @param count Number of rays, at most 32.
+	 * @param mask Bit @c k is set if ray @c k is to be tested.
+	 * @param begin First slot.
+	 * @param end One past the last slot.
+	 * @param[in,out] tBest The time of the closest hit so far of each ray,
+	 *   like @c closestHit takes it.
+	 * @param[out] best Receives the slot of each ray's closer hit or -1.
+	 */
+	void closestHits(const ray<vec_T, time_T, dim> *rays, int count,
+			unsigned int mask, int begin, int end, time_T *tBest,
+			int *best) const {
+		assert(begin >= 0 && begin <= end && end <= size());
+		assert(count > 0 && count <= 32);
+		time_T tOther[32], t[32];
+		int other[32];
+		// The rays whose spheres are tested in the lanes, which only takes
+		// their other shapes a shape at a time.
+		unsigned int laned = 0;
+		bool spheres = unpacked.size() != shapes.size();
+		for (int k = 0; k < count; k++) {
+			if (!(mask >> k & 1))
+				continue;
+			best[k] = -1;
+			tOther[k] = tBest[k];
+			other[k] = -1;
+			if (spheres && rays[k].isNormalized()) {
+				laned |= 1u << k;
+				best[k] = closestSphere(rays[k], begin, end, tBest[k]);
+			}
+		}
+
+		std::vector<int>::const_iterator it =
+				std::lower_bound(unpacked.begin(), unpacked.end(), begin);
+		for (int i = laned == mask ? (it != unpacked.end() ? *it : end) :
+				begin; i < end; ) {
+			unsigned int m = isPacked(i) ? mask & ~laned : mask;
+			if (m != 0) {
+				shapedispatch<vec_T, color_T, time_T, dim>::intersections(
+						kinds[i], shapes[i], rays, count, m, t);
+				for (int k = 0; k < count; k++) {
+					if ((m >> k & 1) && t[k] != RAY_MISS && t[k] > 0 &&
+							(tOther[k] == RAY_MISS || t[k] < tOther[k])) {
+						tOther[k] = t[k];
+						other[k] = i;
+					}
+				}
+			}
+			if (laned != mask) {
+				i++;
+				continue;
+			}
+			++it;
+			i = it != unpacked.end() ? *it : end;
+		}
+
+		for (int k = 0; k < count; k++) {
+			if (!(mask >> k & 1) || other[k] < 0)
+				continue;
+			if (!(laned >> k & 1) || best[k] < 0 || tOther[k] < tBest[k] ||
+					(tOther[k] == tBest[k] && other[k] < best[k])) {
+				best[k] = other[k];
+				tBest[k] = tOther[k];
+			}
+		}
+	}
+
+	/**
+	 * Checks if any shape in slots [begin, end) blocks the ray before
+	 * @c tmax .
+	 *
+	 * @param r The ray.
+	 * @param begin First slot.
+	 * @param end One past the last slot.
+	 * @param tmax Hits at or beyond this time are ignored.
+	 *
+	 * @return Slot of a shape that blocks the ray or -1.
+	 */
+	int anyHit(const ray<vec_T, time_T, dim> &r, int begin, int end,
+			time_T tmax) const {
+		assert(begin >= 0 && begin <= end && end <= size());
+		if (!r.isNormalized() || unpacked.size() == shapes.size()) {
+			for (int i = begin; i < end; i++) {
+				time_T t = intersectSlot(i, r);
+				if (t != RAY_MISS && t > 0 && t < tmax)
+					return i;
+			}
+			return -1;
+		}
+
+		vec_T P[dim], D[dim], t[lanes::maxWidth];
+		const vec_T *c[dim];
+		for (int a = 0; a < dim; a++) {
+			P[a] = r.getOrig()[a];
+			D[a] = r.getDir()[a];
+			c[a] = &center[a][0];
+		}
+		simdLevel level = activeSimdLevel();
+		int mask, width;
+		for (int i = begin; ; i += width) {
+			i = lanes::find(level, c, &radSq[0], i, end, P, D, t, mask, width);
+			if (i >= end)
+				break;
+			for (int k = 0; mask != 0 && k < width && i + k < end;
+					k++, mask >>= 1) {
+				time_T tt = (time_T) t[k];
+				if ((mask & 1) && tt > 0 && tt < tmax &&
+						shapes[i + k] != r.getExcluded()) {
+					countPacked(begin, std::min(i + width, end));
+					return i + k;
+				}
+			}
+		}
+		countPacked(begin, end);
+		std::vector<int>::const_iterator it =
+				std::lower_bound(unpacked.begin(), unpacked.end(), begin);
+		for (; it != unpacked.end() && *it < end; ++it) {
+			time_T tt = intersectSlot(*it, r);
+			if (tt != RAY_MISS && tt > 0 && tt < tmax)
+				return *it;
+		}
+		return -1;
+	}
+
+	/**
+	 * Gets the number of bytes taken by the slots, not counting the few of
+	 * padding.
+	 *
+	 * @return Memory footprint in bytes.
+	 */
+	size_t getMemoryUsage() const {
+		return shapes.size() * ((dim + 1) * sizeof(vec_T) +
+				sizeof(shapes[0]) + sizeof(kinds[0])) +
+				unpacked.size() * sizeof(int);
+	}
+};
+
+typedef spherepack<double, double, double, 3> spherepack3d;
+typedef spherepack<double, double, float, 3> spherepack3ddf;
+typedef spherepack<float, float, float, 3> spherepack3f;
+
+#endif // SPHEREPACK_HH
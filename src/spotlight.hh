@@ -9,7 +9,9 @@
 #include "boost/shared_ptr.hpp"
 #include "rgbcolor.hh"
 #include "light.hh"
+#include "fastmath.hh"
 #include <math.h>
+#include <algorithm>
 #include <ostream>
 
 #ifndef SPOTLIGHT_HH
@@ -17,7 +19,9 @@
 
 /**
  * Represents a spotlight as a color, position, direction vector, and cone
- * angle.
+ * angle. By default the cone has a hard edge; with a falloff angle the light
+ * fades out smoothly over the outermost part of the cone instead. The cosines
+ * of the angles are kept so that the cone test is a dot product.
  *
  * @tparam vec_T The type of the vector components. Many arithmetic and
  *   relational operators must be supported. The type will likely be double,
@@ -35,7 +39,7 @@ class spotlight : public light<vec_T, color_T, time_T, dim> {
 private:
 
 	/**
-	 * Direction vector, should be normalized.
+	 * Direction vector, always normalized.
 	 */
 	mvector<vec_T, dim> dir;
 
@@ -44,6 +48,31 @@ private:
 	 */
 	float angle;
 
+	/**
+	 * Width in radians of the band at the edge of the cone over which the
+	 * light fades out, or 0 for a hard edge.
+	 */
+	float falloff;
+
+	/**
+	 * Cosine of @c angle .
+	 */
+	vec_T cosAngle;
+
+	/**
+	 * Cosine of @c angle minus @c falloff , inside of which the light is at
+	 * full strength.
+	 */
+	vec_T cosInner;
+
+	/**
+	 * Recomputes the cached cosines after the angles changed.
+	 */
+	void updateCosines() {
+		cosAngle = (vec_T) cos(angle);
+		cosInner = (vec_T) cos(std::max(0.0f, angle - falloff));
+	}
+
 public:
 
 	/**
@@ -53,13 +82,15 @@ public:
 	spotlight() : light<vec_T, color_T, time_T, dim>() {
 
 		// set direction to +x axis
-		dir[0] = 1;
 		for(int i = 0; i < dim; i++) {
 			dir[i] = 0;
 		}
+		dir[0] = 1;
 
 		// set angle to 30 degrees
 		angle = M_PI / 6;
+		falloff = 0;
+		updateCosines();
 	}
 
 	/**
@@ -70,13 +101,19 @@ public:
 	 * @param position The position.
 	 * @param direction The direction (will be automatically normalized).
 	 * @param coneAngle The cone angle in radians. Must be in @f$(0, \pi]@f$.
+	 * @param falloffAngle Width in radians of the soft edge of the cone, 0
+	 *   for a hard edge. Must be in @f$[0, coneAngle]@f$.
 	 */
 	spotlight(const rgbcolor<color_T> &color, const mvector<vec_T, dim> &pos,
-			const mvector<vec_T, dim> &direction, float coneAngle) :
+			const mvector<vec_T, dim> &direction, float coneAngle,
+			float falloffAngle = 0) :
 				light<vec_T, color_T, time_T, dim>(color, pos),
-				dir(direction), angle(coneAngle) {
+				dir(direction.norm()), angle(coneAngle),
+				falloff(falloffAngle) {
 		assert(dim > 0);
 		assert(coneAngle > 0 && coneAngle <= M_PI);
+		assert(falloffAngle >= 0 && falloffAngle <= coneAngle);
+		updateCosines();
 	}
 
 	/**
@@ -90,6 +127,8 @@ public:
 		this->setPos(rhs.getPos());
 		this->dir = rhs.getDir();
 		this->angle = rhs.getAngle();
+		this->falloff = rhs.getFalloff();
+		updateCosines();
 		return *this;
 	}
 
@@ -110,6 +149,28 @@ public:
 	void setAngle(float angle) {
 		assert(angle > 0 && angle <= M_PI);
 		this->angle = angle;
+		updateCosines();
+	}
+
+	/**
+	 * Getter for the falloff angle.
+	 *
+	 * @return Width of the soft edge of the cone in radians.
+	 */
+	float getFalloff() const {
+		return falloff;
+	}
+
+	/**
+	 * Setter for the falloff angle.
+	 *
+	 * @param falloff Width of the soft edge of the cone in radians, or 0 for
+	 *   a hard edge.
+	 */
+	void setFalloff(float falloff) {
+		assert(falloff >= 0);
+		this->falloff = falloff;
+		updateCosines();
 	}
 
 	/**
@@ -124,10 +185,71 @@ public:
 	/**
 	 * Setter for the direction of this spotlight.
 	 *
-	 * @param New direction.
+	 * @param New direction (will be automatically normalized).
 	 */
 	void setDir(const mvector<vec_T, dim>& dir) {
-		this->dir = dir;
+		this->dir = dir.norm();
+	}
+
+	/**
+	 * Samples this spotlight like a point light if the shading point is
+	 * inside its cone. In the falloff band the color is scaled down with a
+	 * smoothstep of the cosine, from full strength at the inner edge to 0 at
+	 * the cone.
+	 *
+	 * @param X The shading point.
+	 * @param i Index of the sample.
+	 * @param n Number of samples.
+	 * @param[out] s Receives the sample.
+	 *
+	 * @return @c false if @c X is outside the cone.
+	 */
+	bool sample(const mvector<vec_T, dim> &X, int i, int n,
+			lightsample<vec_T, color_T, dim> &s) const {
+		light<vec_T, color_T, time_T, dim>::sample(X, i, n, s);
+		vec_T cosTheta = -(dir * s.dir);
+		if (cosTheta < cosAngle)
+			return false;
+		if (cosTheta < cosInner) {
+			vec_T f = (cosTheta - cosAngle) / (cosInner - cosAngle);
+			s.color *= (color_T) (f * f * (3 - 2 * f));
+		}
+		return true;
+	}
+
+	/**
+	 * Checks if the cone of this spotlight reaches the sphere around the
+	 * given box. The test is padded slightly so that it never rejects a box
+	 * that @c sample would accept a point of, which also covers the error of
+	 * @c approxAcos in builds with @c RT_FAST_MATH defined.
+	 *
+	 * @param box Box around the shading points.
+	 *
+	 * @return @c false if the box is entirely outside the cone.
+	 */
+	bool mayLight(const aabb<vec_T, dim> &box) const {
+		if (box.isEmpty())
+			return false;
+		mvector<vec_T, dim> v = box.centroid() - this->getPos();
+		double d = v.mag();
+		double r = box.diagonal().mag() / 2;
+		if (d <= r)
+			return true;
+		double c = std::max(-1.0, std::min(1.0, (double) (v * dir) / d));
+#ifdef RT_FAST_MATH
+		return approxAcos(c) - approxAsin(r / d) <= angle + 1e-4;
+#else
+		return acos(c) - asin(r / d) <= angle + 1e-4;
+#endif
+	}
+
+	/**
+	 * Spotlights also depend on their direction, so they can't be clustered.
+	 *
+	 * @return @c false .
+	 */
+	bool canCluster() const {
+		return false;
 	}
 
 	/**
@@ -138,7 +260,10 @@ public:
 	void printHelper(std::ostream& os) const {
 		light<vec_T, color_T, time_T, dim>::printHelper(os);
 		os << " ---> [spotlight. direction: " << dir << ", cone angle: " <<
-				angle << "]";
+				angle;
+		if (falloff > 0)
+			os << ", falloff: " << falloff;
+		os << "]";
 	}
 };
 
@@ -0,0 +1,256 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "rgbcolor.hh"
+#include "tilequeue.hh"
+#include "hugepages.hh"
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#ifndef TILEDFRAMEBUFFER_HH
+#define TILEDFRAMEBUFFER_HH
+
+/**
+ * Default width and height in pixels of the tiles of a
+ * @c tiledframebuffer , the same as the tiles the renderer shades.
+ */
+#define FRAMEBUFFER_TILE_SIZE 16
+
+/**
+ * The colors of an image stored tile by tile instead of row by row: the
+ * pixels of each square tile are contiguous, row by row within the tile,
+ * and the tiles follow each other row by row. A renderer filling in a
+ * tile, or a pass filtering one, then touches a few cache lines instead of
+ * one per row of the tile, and tiles can be filled from any thread without
+ * sharing lines. Tiles on the right and bottom edges take up the room of
+ * full tiles, so every tile starts at a multiple of the tile area.
+ * Writers, which need scanline order, get it from @c toScanline .
+ *
+ * @tparam color_T The type of the @c rgbcolor.
+ */
+template<typename color_T>
+class tiledframebuffer {
+private:
+
+	/**
+	 * Width in pixels.
+	 */
+	int width;
+
+	/**
+	 * Height in pixels.
+	 */
+	int height;
+
+	/**
+	 * Width and height of the tiles in pixels.
+	 */
+	int tileSize;
+
+	/**
+	 * Number of tiles in a row of tiles.
+	 */
+	int tilesPerRow;
+
+	/**
+	 * The colors of the tiles, one tile after the other.
+	 */
+	std::vector<rgbcolor<color_T> > pixels;
+
+public:
+
+	/**
+	 * Constructs a black image of the given size.
+	 *
+	 * @param width Width in pixels.
+	 * @param height Height in pixels.
+	 * @param tileSize Width and height of the tiles in pixels.
+	 */
+	tiledframebuffer(int width = 0, int height = 0,
+			int tileSize = FRAMEBUFFER_TILE_SIZE) {
+		resize(width, height, tileSize);
+	}
+
+	/**
+	 * Resizes the image and makes it black.
+	 *
+	 * @param width Width in pixels.
+	 * @param height Height in pixels.
+	 * @param tileSize Width and height of the tiles in pixels.
+	 */
+	void resize(int width, int height, int tileSize = FRAMEBUFFER_TILE_SIZE) {
+		assert(width >= 0 && height >= 0 && tileSize > 0);
+		this->width = width;
+		this->height = height;
+		this->tileSize = tileSize;
+		tilesPerRow = (width + tileSize - 1) / tileSize;
+		int tilesPerColumn = (height + tileSize - 1) / tileSize;
+		size_t n = (size_t) tilesPerRow * tilesPerColumn * tileSize * tileSize;
+		hugepages::reserve(pixels, n);
+		pixels.assign(n, rgbcolor<color_T>());
+	}
+
+	/**
+	 * Gets the width.
+	 *
+	 * @return Width in pixels.
+	 */
+	int getWidth() const {
+		return width;
+	}
+
+	/**
+	 * Gets the height.
+	 *
+	 * @return Height in pixels.
+	 */
+	int getHeight() const {
+		return height;
+	}
+
+	/**
+	 * Gets the size of the tiles.
+	 *
+	 * @return Width and height of the tiles in pixels.
+	 */
+	int getTileSize() const {
+		return tileSize;
+	}
+
+	/**
+	 * Gets the number of tiles in a row of tiles.
+	 *
+	 * @return Tile count.
+	 */
+	int getTilesPerRow() const {
+		return tilesPerRow;
+	}
+
+	/**
+	 * Gets the number of tiles.
+	 *
+	 * @return Tile count.
+	 */
+	int getTileCount() const {
+		return (int) (pixels.size() / ((size_t) tileSize * tileSize));
+	}
+
+	/**
+	 * Finds where a pixel is stored.
+	 *
+	 * @param x x coordinate of the pixel.
+	 * @param y y coordinate of the pixel.
+	 *
+	 * @return Index of the pixel in the storage.
+	 */
+	size_t index(int x, int y) const {
+		assert(x >= 0 && x < width && y >= 0 && y < height);
+		size_t tile = (size_t) (y / tileSize) * tilesPerRow + x / tileSize;
+		return (tile * tileSize + y % tileSize) * tileSize + x % tileSize;
+	}
+
+	/**
+	 * Gets the color of a pixel.
+	 *
+	 * @param x x coordinate of the pixel.
+	 * @param y y coordinate of the pixel.
+	 *
+	 * @return The color.
+	 */
+	rgbcolor<color_T>& at(int x, int y) {
+		return pixels[index(x, y)];
+	}
+
+	/**
+	 * Gets the color of a pixel.
+	 *
+	 * @param x x coordinate of the pixel.
+	 * @param y y coordinate of the pixel.
+	 *
+	 * @return The color.
+	 */
+	const rgbcolor<color_T>& at(int x, int y) const {
+		return pixels[index(x, y)];
+	}
+
+	/**
+	 * Gets the colors of a tile, @c getTileSize squared of them row by
+	 * row; those of pixels past the edges of the image are unused.
+	 *
+	 * @param tile Number of the tile, row by row.
+	 *
+	 * @return The first color.
+	 */
+	rgbcolor<color_T>* getTile(int tile) {
+		assert(tile >= 0 && tile < getTileCount());
+		return &pixels[(size_t) tile * tileSize * tileSize];
+	}
+
+	/**
+	 * Gets the colors of a tile; see the other @c getTile .
+	 *
+	 * @param tile Number of the tile, row by row.
+	 *
+	 * @return The first color.
+	 */
+	const rgbcolor<color_T>* getTile(int tile) const {
+		assert(tile >= 0 && tile < getTileCount());
+		return &pixels[(size_t) tile * tileSize * tileSize];
+	}
+
+	/**
+	 * Copies a tile rendered into a @c tilebuffer into its place. The tile
+	 * must be one of the grid of this framebuffer's tiles; tiles with
+	 * different numbers can be put from different threads at once.
+	 *
+	 * @param tile The tile.
+	 */
+	void put(const tilebuffer<color_T> &tile) {
+		assert(tile.x0 % tileSize == 0 && tile.y0 % tileSize == 0);
+		assert(tile.width <= tileSize && tile.height <= tileSize);
+		rgbcolor<color_T> *out = getTile((tile.y0 / tileSize) * tilesPerRow +
+				tile.x0 / tileSize);
+		for (int y = 0; y < tile.height; y++)
+			std::copy(tile.pixels.begin() + (size_t) y * tile.width,
+					tile.pixels.begin() + (size_t) (y + 1) * tile.width,
+					out + (size_t) y * tileSize);
+	}
+
+	/**
+	 * Converts the image to scanline order for writers.
+	 *
+	 * @param[out] image Receives the colors of the pixels, row by row.
+	 */
+	void toScanline(std::vector<rgbcolor<color_T> > &image) const {
+		image.resize((size_t) width * height);
+		for (int y = 0; y < height; y++)
+			for (int x0 = 0; x0 < width; x0 += tileSize) {
+				const rgbcolor<color_T> *row = &pixels[index(x0, y)];
+				std::copy(row, row + std::min(tileSize, width - x0),
+						image.begin() + (size_t) y * width + x0);
+			}
+	}
+
+	/**
+	 * Fills the image from colors in scanline order, the reverse of
+	 * @c toScanline .
+	 *
+	 * @param image The colors of the pixels, row by row, which must be as
+	 *   many as this framebuffer has.
+	 */
+	void fromScanline(const std::vector<rgbcolor<color_T> > &image) {
+		assert(image.size() == (size_t) width * height);
+		for (int y = 0; y < height; y++)
+			for (int x0 = 0; x0 < width; x0 += tileSize) {
+				int n = std::min(tileSize, width - x0);
+				std::copy(image.begin() + (size_t) y * width + x0,
+						image.begin() + (size_t) y * width + x0 + n,
+						&pixels[index(x0, y)]);
+			}
+	}
+};
+
+#endif // TILEDFRAMEBUFFER_HH
@@ -0,0 +1,249 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "boost/noncopyable.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/thread/thread_time.hpp"
+#include <cassert>
+#include <deque>
+#include <vector>
+
+#ifndef TILELEASE_HH
+#define TILELEASE_HH
+
+/**
+ * Owner of a tile that nobody is rendering and that isn't finished.
+ */
+#define LEASE_FREE -1
+
+/**
+ * Owner of a finished tile.
+ */
+#define LEASE_DONE -2
+
+/**
+ * Hands the tiles of an image out to workers that render them elsewhere,
+ * one at a time as each asks for more, so fast workers take more tiles
+ * than slow ones. A tile is leased to one worker until it's finished; if
+ * the worker goes away its tiles go back to be leased again, and if it
+ * holds a tile longer than the timeout, the tile is also leased to the
+ * next worker that asks, whichever of them finishes first. Safe to use
+ * from one thread per worker at the same time.
+ */
+class tileleases : private boost::noncopyable {
+private:
+
+	/**
+	 * Number of tiles.
+	 */
+	int count;
+
+	/**
+	 * How long a worker may hold a tile before others get it too, in
+	 * milliseconds, or 0 to never lease a held tile again.
+	 */
+	long timeoutMs;
+
+	/**
+	 * The worker holding each tile, @c LEASE_FREE or @c LEASE_DONE .
+	 */
+	std::vector<int> owner;
+
+	/**
+	 * When the lease of each held tile runs out.
+	 */
+	std::vector<boost::system_time> expiry;
+
+	/**
+	 * Tiles to lease before any held one, in order; some may have been
+	 * leased or finished since they were put here.
+	 */
+	std::deque<int> pending;
+
+	/**
+	 * Number of finished tiles.
+	 */
+	int doneCount;
+
+	/**
+	 * Whether @c cancel was called.
+	 */
+	bool cancelled;
+
+	/**
+	 * Guards everything above.
+	 */
+	mutable boost::mutex lock;
+
+	/**
+	 * Signaled when a tile is finished or goes back to be leased again.
+	 */
+	boost::condition_variable changed;
+
+public:
+
+	/**
+	 * Constructs the leases of the given number of tiles, all free.
+	 *
+	 * @param count Number of tiles.
+	 * @param timeoutSeconds How long a worker may hold a tile before it's
+	 *   leased to others too, or 0 for as long as the worker is there.
+	 */
+	tileleases(int count, double timeoutSeconds) : count(count),
+			timeoutMs((long) (timeoutSeconds * 1000)),
+			owner(count, LEASE_FREE), expiry(count), doneCount(0),
+			cancelled(false) {
+		assert(count >= 0 && timeoutSeconds >= 0);
+		for (int i = 0; i < count; i++)
+			pending.push_back(i);
+	}
+
+	/**
+	 * Gets the number of tiles.
+	 *
+	 * @return Tile count.
+	 */
+	int size() const {
+		return count;
+	}
+
+	/**
+	 * Leases the next tile to a worker: the first free one, else the one
+	 * whose lease ran out first. Waits while every unfinished tile is held
+	 * by a worker within its lease.
+	 *
+	 * @param worker Number of the worker, at least 0.
+	 *
+	 * @return Number of the tile, or -1 once every tile is finished or
+	 *   the leases are cancelled.
+	 */
+	int lease(int worker) {
+		assert(worker >= 0);
+		boost::unique_lock<boost::mutex> guard(lock);
+		for (;;) {
+			if (doneCount == count || cancelled)
+				return -1;
+			while (!pending.empty()) {
+				int t = pending.front();
+				pending.pop_front();
+				if (owner[t] == LEASE_FREE)
+					return grant(t, worker);
+			}
+			int oldest = -1;
+			for (int t = 0; t < count; t++)
+				if (owner[t] >= 0 && owner[t] != worker && (oldest < 0 ||
+						expiry[t] < expiry[oldest]))
+					oldest = t;
+			if (oldest >= 0 && timeoutMs > 0 &&
+					expiry[oldest] <= boost::get_system_time())
+				return grant(oldest, worker);
+			if (oldest >= 0 && timeoutMs > 0)
+				changed.timed_wait(guard, expiry[oldest]);
+			else
+				changed.wait(guard);
+		}
+	}
+
+	/**
+	 * Marks a tile finished, by whichever worker it was leased to.
+	 *
+	 * @param tile Number of the tile.
+	 *
+	 * @return @c false if it was already finished.
+	 */
+	bool complete(int tile) {
+		assert(tile >= 0 && tile < count);
+		{
+			boost::lock_guard<boost::mutex> guard(lock);
+			if (owner[tile] == LEASE_DONE)
+				return false;
+			owner[tile] = LEASE_DONE;
+			doneCount++;
+		}
+		changed.notify_all();
+		return true;
+	}
+
+	/**
+	 * Tells if a tile is finished.
+	 *
+	 * @param tile Number of the tile.
+	 *
+	 * @return Whether it's finished.
+	 */
+	bool isDone(int tile) const {
+		assert(tile >= 0 && tile < count);
+		boost::lock_guard<boost::mutex> guard(lock);
+		return owner[tile] == LEASE_DONE;
+	}
+
+	/**
+	 * Puts the unfinished tiles a worker holds back to be leased before
+	 * any other, for when it goes away.
+	 *
+	 * @param worker Number of the worker.
+	 */
+	void release(int worker) {
+		{
+			boost::lock_guard<boost::mutex> guard(lock);
+			for (int t = count - 1; t >= 0; t--)
+				if (owner[t] == worker) {
+					owner[t] = LEASE_FREE;
+					pending.push_front(t);
+				}
+		}
+		changed.notify_all();
+	}
+
+	/**
+	 * Stops leasing tiles, waking every worker waiting for one.
+	 */
+	void cancel() {
+		{
+			boost::lock_guard<boost::mutex> guard(lock);
+			cancelled = true;
+		}
+		changed.notify_all();
+	}
+
+	/**
+	 * Gets the number of finished tiles.
+	 *
+	 * @return Finished tile count.
+	 */
+	int getDoneCount() const {
+		boost::lock_guard<boost::mutex> guard(lock);
+		return doneCount;
+	}
+
+	/**
+	 * Tells if every tile is finished.
+	 *
+	 * @return Whether all tiles are finished.
+	 */
+	bool finished() const {
+		return getDoneCount() == count;
+	}
+
+private:
+
+	/**
+	 * Leases a tile to a worker. The lock must be held.
+	 *
+	 * @param tile Number of the tile.
+	 * @param worker Number of the worker.
+	 *
+	 * @return @c tile .
+	 */
+	int grant(int tile, int worker) {
+		owner[tile] = worker;
+		expiry[tile] = boost::get_system_time() +
+				boost::posix_time::milliseconds(timeoutMs);
+		return tile;
+	}
+};
+
+#endif // TILELEASE_HH
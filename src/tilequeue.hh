@@ -0,0 +1,336 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "rgbcolor.hh"
+#include "boost/lockfree/queue.hpp"
+#include "boost/noncopyable.hpp"
+#include "boost/scoped_array.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#ifndef TILEQUEUE_HH
+#define TILEQUEUE_HH
+
+/**
+ * The colors of one rectangular tile of an image, row by row, as a
+ * rendering thread fills them in before handing the tile to a writer.
+ *
+ * @tparam color_T The type of the @c rgbcolor.
+ */
+template<typename color_T>
+struct tilebuffer {
+	/** x coordinate of the top left pixel of the tile in the image. */
+	int x0;
+	/** y coordinate of the top left pixel of the tile in the image. */
+	int y0;
+	/** Width of the tile in pixels. */
+	int width;
+	/** Height of the tile in pixels. */
+	int height;
+	/** The colors of the pixels, row by row. */
+	std::vector<rgbcolor<color_T> > pixels;
+
+	/**
+	 * Constructs an empty tile.
+	 */
+	tilebuffer() : x0(0), y0(0), width(0), height(0) { }
+
+	/**
+	 * Places the tile in the image and sizes it. The colors are left as
+	 * they were, so reusing a tile of the same size doesn't allocate.
+	 *
+	 * @param x0 x coordinate of the top left pixel.
+	 * @param y0 y coordinate of the top left pixel.
+	 * @param width Width in pixels.
+	 * @param height Height in pixels.
+	 */
+	void place(int x0, int y0, int width, int height) {
+		assert(width >= 0 && height >= 0);
+		this->x0 = x0;
+		this->y0 = y0;
+		this->width = width;
+		this->height = height;
+		pixels.resize((size_t) width * height);
+	}
+
+	/**
+	 * Copies the tile into its place in an image.
+	 *
+	 * @param image The colors of the image's pixels, row by row.
+	 * @param imageWidth Width of the image in pixels.
+	 */
+	void copyTo(std::vector<rgbcolor<color_T> > &image, int imageWidth) const {
+		for (int y = 0; y < height; y++)
+			std::copy(pixels.begin() + (size_t) y * width,
+					pixels.begin() + (size_t) (y + 1) * width,
+					image.begin() + (size_t) (y0 + y) * imageWidth + x0);
+	}
+};
+
+/**
+ * Hands finished tiles from the rendering threads to the one thread that
+ * writes them out. Every tile of the image has a buffer of its own, which
+ * only the thread rendering the tile touches until it calls @c publish ;
+ * the tile's number then goes through a lock-free queue, so neither
+ * renderers nor the writer ever wait for a lock. Tiles come out in the
+ * order they were finished.
+ *
+ * @tparam color_T The type of the @c rgbcolor.
+ */
+template<typename color_T>
+class tilequeue : private boost::noncopyable {
+private:
+
+	/**
+	 * Number of tiles.
+	 */
+	int count;
+
+	/**
+	 * The buffer of every tile.
+	 */
+	boost::scoped_array<tilebuffer<color_T> > tiles;
+
+	/**
+	 * Numbers of the published tiles the writer hasn't taken yet.
+	 */
+	boost::lockfree::queue<int> finished;
+
+	/**
+	 * Number of tiles the writer took.
+	 */
+	int taken;
+
+public:
+
+	/**
+	 * Constructs a queue for the given number of tiles, none of them
+	 * published. All the memory the queue itself needs is taken here.
+	 *
+	 * @param count Number of tiles.
+	 */
+	explicit tilequeue(int count) : count(count),
+			tiles(new tilebuffer<color_T>[std::max(count, 1)]),
+			finished(std::max(count, 1)), taken(0) {
+		assert(count >= 0);
+	}
+
+	/**
+	 * Gets the number of tiles.
+	 *
+	 * @return Tile count.
+	 */
+	int size() const {
+		return count;
+	}
+
+	/**
+	 * Gets the buffer of a tile to render into. Only the thread rendering
+	 * the tile may use it, and only until it publishes the tile.
+	 *
+	 * @param i Number of the tile.
+	 *
+	 * @return The buffer.
+	 */
+	tilebuffer<color_T>& getTile(int i) {
+		assert(i >= 0 && i < count);
+		return tiles[i];
+	}
+
+	/**
+	 * Hands a finished tile to the writer. Each tile is published once.
+	 * Safe to call from any number of threads at the same time.
+	 *
+	 * @param i Number of the tile.
+	 */
+	void publish(int i) {
+		assert(i >= 0 && i < count);
+		bool pushed = finished.bounded_push(i);
+		assert(pushed);
+		(void) pushed;
+	}
+
+	/**
+	 * Takes the next published tile, if there is one. Only the writer
+	 * thread may call this.
+	 *
+	 * @param[out] tile Receives the tile, which stays valid as long as the
+	 *   queue.
+	 *
+	 * @return @c false if no tile is waiting.
+	 */
+	bool take(const tilebuffer<color_T> *&tile) {
+		int i;
+		if (!finished.pop(i))
+			return false;
+		tile = &tiles[i];
+		taken++;
+		return true;
+	}
+
+	/**
+	 * Tells if the writer took every tile.
+	 *
+	 * @return Whether all tiles were taken.
+	 */
+	bool done() const {
+		return taken == count;
+	}
+};
+
+/**
+ * A bounded window of bands of rows, for writing an image out in order
+ * while its bands are rendered in parallel. A renderer takes the buffer of
+ * a band with @c acquire , which waits until the band is within
+ * @c slots bands of the first one the writer hasn't written yet, fills it
+ * and publishes it. The writer takes the bands strictly in order, waiting
+ * for each to be published, and releases them when written, which makes
+ * room for later bands. Only @c slots bands are ever held, so memory
+ * doesn't grow with the height of the image.
+ *
+ * Renderers must acquire bands in increasing order between them, e.g. by
+ * taking their numbers from a shared counter, and there must be more slots
+ * than renderers; then the first unwritten band is never waiting and the
+ * window always moves.
+ *
+ * @tparam color_T The type of the @c rgbcolor.
+ */
+template<typename color_T>
+class reorderbuffer : private boost::noncopyable {
+private:
+
+	/**
+	 * Number of bands in the image.
+	 */
+	int count;
+
+	/**
+	 * Number of bands held at once.
+	 */
+	int slots;
+
+	/**
+	 * The buffer of each slot; band @c i goes in slot @c i % @c slots .
+	 */
+	boost::scoped_array<tilebuffer<color_T> > buffers;
+
+	/**
+	 * Whether the band in each slot has been published.
+	 */
+	boost::scoped_array<bool> ready;
+
+	/**
+	 * The first band the writer hasn't released.
+	 */
+	int next;
+
+	/**
+	 * Guards @c ready and @c next .
+	 */
+	boost::mutex lock;
+
+	/**
+	 * Signaled when @c next moves.
+	 */
+	boost::condition_variable released;
+
+	/**
+	 * Signaled when a band is published.
+	 */
+	boost::condition_variable published;
+
+public:
+
+	/**
+	 * Constructs a window over the given number of bands. All the memory
+	 * the window needs besides the bands' pixels is taken here.
+	 *
+	 * @param count Number of bands.
+	 * @param slots Number of bands to hold at once, at least 2.
+	 */
+	reorderbuffer(int count, int slots) : count(count), slots(slots),
+			buffers(new tilebuffer<color_T>[slots]), ready(new bool[slots]),
+			next(0) {
+		assert(count >= 0 && slots >= 2);
+		std::fill(ready.get(), ready.get() + slots, false);
+	}
+
+	/**
+	 * Gets the number of bands.
+	 *
+	 * @return Band count.
+	 */
+	int size() const {
+		return count;
+	}
+
+	/**
+	 * Gets the buffer of a band to render into, waiting until it fits in
+	 * the window. Only the thread rendering the band may use it, and only
+	 * until it publishes the band.
+	 *
+	 * @param i Number of the band.
+	 *
+	 * @return The buffer.
+	 */
+	tilebuffer<color_T>& acquire(int i) {
+		assert(i >= 0 && i < count);
+		boost::unique_lock<boost::mutex> guard(lock);
+		while (i >= next + slots)
+			released.wait(guard);
+		return buffers[i % slots];
+	}
+
+	/**
+	 * Hands a finished band to the writer.
+	 *
+	 * @param i Number of the band.
+	 */
+	void publish(int i) {
+		{
+			boost::lock_guard<boost::mutex> guard(lock);
+			assert(i >= next && i < next + slots);
+			ready[i % slots] = true;
+		}
+		published.notify_all();
+	}
+
+	/**
+	 * Waits for the next band in order. Only the writer thread may call
+	 * this, and it must @c release the band before taking another.
+	 *
+	 * @param[out] band Receives the band, which stays valid until it's
+	 *   released.
+	 *
+	 * @return @c false if every band was written.
+	 */
+	bool take(const tilebuffer<color_T> *&band) {
+		boost::unique_lock<boost::mutex> guard(lock);
+		if (next == count)
+			return false;
+		while (!ready[next % slots])
+			published.wait(guard);
+		band = &buffers[next % slots];
+		return true;
+	}
+
+	/**
+	 * Frees the slot of the band @c take returned for a later band.
+	 */
+	void release() {
+		{
+			boost::lock_guard<boost::mutex> guard(lock);
+			assert(next < count && ready[next % slots]);
+			ready[next % slots] = false;
+			next++;
+		}
+		released.notify_all();
+	}
+};
+
+#endif // TILEQUEUE_HH
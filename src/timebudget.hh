@@ -0,0 +1,250 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include <algorithm>
+#include <cassert>
+#include <ostream>
+#include <vector>
+
+#ifndef TIMEBUDGET_HH
+#define TIMEBUDGET_HH
+
+/**
+ * How much smaller the probe of a @c timebudget is along each axis than the
+ * image.
+ */
+#define TIMEBUDGET_PROBE_SCALE 4
+
+/**
+ * What the estimated time of a pass is multiplied by before checking that
+ * it fits in the time left, to leave room for estimates that come out low
+ * and for writing the image.
+ */
+#define TIMEBUDGET_MARGIN 1.25
+
+/**
+ * The settings of one quality level of a render with a time budget.
+ */
+struct qualitylevel {
+	/** Jittered samples per axis of every pixel. */
+	int pixelSamples;
+	/** Samples per axis of pixels refined by adaptive anti-aliasing. */
+	int aaSamples;
+	/** Largest number of reflections. */
+	int maxReflect;
+	/** Samples per sampled area light, or 0 if they're not sampled. */
+	int areaSamples;
+
+	bool operator==(const qualitylevel &rhs) const {
+		return pixelSamples == rhs.pixelSamples &&
+				aaSamples == rhs.aaSamples && maxReflect == rhs.maxReflect &&
+				areaSamples == rhs.areaSamples;
+	}
+};
+
+/**
+ * Picks how well to render an image that's due within a given time. The
+ * levels run from the cheapest settings up to the best ones asked for, and
+ * each is given a rough relative cost. A pass of a level, at full size or
+ * at a fraction of it as a probe, gives its seconds per pixel; levels not
+ * measured yet are estimated from the closest one below that is, scaled by
+ * their costs. The level rendered is the best one whose estimate fits in
+ * the time left, once measured, and after each pass a better one is
+ * rendered if one still fits, so the image that's written is the best that
+ * could be finished in time.
+ */
+class timebudget {
+private:
+
+	/**
+	 * When the clock started.
+	 */
+	boost::posix_time::ptime start;
+
+	/**
+	 * Seconds allowed from @c start .
+	 */
+	double budget;
+
+	/**
+	 * The levels, cheapest first.
+	 */
+	std::vector<qualitylevel> levels;
+
+	/**
+	 * Seconds per pixel of each level measured by its last pass, or 0 if
+	 * it has had none.
+	 */
+	std::vector<double> perPixel;
+
+	/**
+	 * Appends a level unless it's the same as the last one.
+	 */
+	void addLevel(const qualitylevel &q) {
+		if (levels.empty() || !(levels.back() == q))
+			levels.push_back(q);
+	}
+
+public:
+
+	/**
+	 * Starts the clock and lays out the levels up to the given settings:
+	 * first one reflection, single samples and one sample per area light;
+	 * then all the reflections and a quarter of the area light samples;
+	 * then all of those with anti-aliasing; then doubling numbers of samples
+	 * per pixel up to the best settings.
+	 *
+	 * @param seconds Seconds allowed from now.
+	 * @param best The best settings.
+	 */
+	timebudget(double seconds, const qualitylevel &best) :
+			start(boost::posix_time::microsec_clock::universal_time()),
+			budget(seconds) {
+		assert(seconds > 0 && best.pixelSamples > 0 && best.aaSamples > 0 &&
+				best.maxReflect >= 0 && best.areaSamples >= 0);
+		qualitylevel q;
+		q.pixelSamples = 1;
+		q.aaSamples = 1;
+		q.maxReflect = std::min(best.maxReflect, 1);
+		q.areaSamples = std::min(best.areaSamples, 1);
+		addLevel(q);
+		q.maxReflect = best.maxReflect;
+		q.areaSamples = best.areaSamples > 0 ?
+				std::max(1, best.areaSamples / 4) : 0;
+		addLevel(q);
+		q.aaSamples = best.aaSamples;
+		q.areaSamples = best.areaSamples;
+		addLevel(q);
+		for (int s = 2; s < best.pixelSamples; s *= 2) {
+			q.pixelSamples = s;
+			addLevel(q);
+		}
+		addLevel(best);
+		perPixel.assign(levels.size(), 0);
+	}
+
+	/**
+	 * Gets the rough cost of a level relative to one sample per pixel with
+	 * no reflections or area light samples.
+	 *
+	 * @param q The level.
+	 *
+	 * @return The cost.
+	 */
+	static double weight(const qualitylevel &q) {
+		return (double) q.pixelSamples * q.pixelSamples *
+				(1 + 0.1 * q.aaSamples * q.aaSamples) *
+				(1 + 0.1 * q.maxReflect) * (1 + 0.25 * q.areaSamples);
+	}
+
+	/**
+	 * Gets the levels.
+	 *
+	 * @return The levels, cheapest first.
+	 */
+	const std::vector<qualitylevel>& getLevels() const {
+		return levels;
+	}
+
+	/**
+	 * Gets the seconds since the clock started.
+	 *
+	 * @return Elapsed seconds.
+	 */
+	double getElapsed() const {
+		return (boost::posix_time::microsec_clock::universal_time() -
+				start).total_microseconds() * 1e-6;
+	}
+
+	/**
+	 * Gets the seconds allowed.
+	 *
+	 * @return The budget.
+	 */
+	double getBudget() const {
+		return budget;
+	}
+
+	/**
+	 * Records how long a pass took, for the estimates of the next ones.
+	 *
+	 * @param level Index of the level of the pass.
+	 * @param pixels Pixels it rendered.
+	 * @param seconds Seconds it took.
+	 */
+	void measure(int level, long pixels, double seconds) {
+		assert(level >= 0 && level < (int) levels.size() && pixels > 0);
+		perPixel[level] = std::max(seconds, 1e-9) / pixels;
+	}
+
+	/**
+	 * Checks if a level has had a pass.
+	 *
+	 * @param level Index of the level.
+	 *
+	 * @return @c true if its estimates are measured.
+	 */
+	bool isMeasured(int level) const {
+		assert(level >= 0 && level < (int) levels.size());
+		return perPixel[level] > 0;
+	}
+
+	/**
+	 * Estimates how long a pass would take: from the last pass of the
+	 * level, or else from that of the closest level below it scaled by
+	 * their @c weight .
+	 *
+	 * @param level Index of the level.
+	 * @param pixels Pixels it would render.
+	 *
+	 * @return Seconds, or 0 if no level at or below it was measured.
+	 */
+	double estimate(int level, long pixels) const {
+		assert(level >= 0 && level < (int) levels.size());
+		for (int m = level; m >= 0; m--)
+			if (perPixel[m] > 0)
+				return perPixel[m] * weight(levels[level]) /
+						weight(levels[m]) * pixels;
+		return 0;
+	}
+
+	/**
+	 * Picks the best level at least as good as the given one whose pass
+	 * would end in time, with @c TIMEBUDGET_MARGIN to spare. Level 0 must
+	 * have been measured.
+	 *
+	 * @param from Index of the worst level to consider.
+	 * @param pixels Pixels the pass would render.
+	 * @param elapsed Seconds since the clock started.
+	 *
+	 * @return Index of the level, or -1 if none fits.
+	 */
+	int pickLevel(int from, long pixels, double elapsed) const {
+		assert(isMeasured(0));
+		for (int i = (int) levels.size() - 1; i >= from; i--)
+			if (elapsed + TIMEBUDGET_MARGIN * estimate(i, pixels) <= budget)
+				return i;
+		return -1;
+	}
+};
+
+/**
+ * Prints the settings of a level.
+ *
+ * @param os The output stream.
+ * @param q The level.
+ *
+ * @return The output stream.
+ */
+inline std::ostream& operator<<(std::ostream &os, const qualitylevel &q) {
+	os << "samples " << q.pixelSamples << ", aa " << q.aaSamples <<
+			", reflections " << q.maxReflect;
+	if (q.areaSamples > 0)
+		os << ", area light samples " << q.areaSamples;
+	return os;
+}
+
+#endif // TIMEBUDGET_HH
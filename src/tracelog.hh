@@ -0,0 +1,264 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "perfcounters.hh"
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/tss.hpp"
+#include <algorithm>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifndef TRACELOG_HH
+#define TRACELOG_HH
+
+/**
+ * Lane of a @c tracelog for the phases of a render.
+ */
+#define TRACE_PHASE_LANE 0
+
+/**
+ * Lane of a @c tracelog for the thread that writes out finished tiles or
+ * bands.
+ */
+#define TRACE_WRITER_LANE 1
+
+/**
+ * Lane of a @c tracelog for the render thread of index 0; thread @c t is on
+ * lane @c TRACE_WORKER_LANE + @c t .
+ */
+#define TRACE_WORKER_LANE 2
+
+/**
+ * A span of time of a @c tracelog .
+ */
+struct traceevent {
+	/** What ran, e.g. the pass of a task; a string that outlives the log. */
+	const char *name;
+	/** The lane it ran on. */
+	int lane;
+	/** The task, e.g. the number of the tile, or -1 for none. */
+	int task;
+	/** When it started, in microseconds since the log was made. */
+	long long begin;
+	/** When it ended, in microseconds since the log was made. */
+	long long end;
+	/** What the hardware counters of its thread counted meanwhile. */
+	perfsample counts;
+};
+
+/**
+ * A timeline of what the threads of a render did, for @c --trace : a span
+ * for every task, such as a tile or a band, on a lane per render thread,
+ * for every write of a tile, and for every phase. @c writeJson writes it in
+ * the Chrome tracing format that @c chrome://tracing and Perfetto show, so
+ * threads that run out of work early, tiles that take much longer than
+ * others and a writer that can't keep up stand out. Spans may be added from
+ * any thread.
+ */
+class tracelog {
+private:
+
+	/**
+	 * When the log was made.
+	 */
+	boost::posix_time::ptime epoch;
+
+	/**
+	 * Guards @c events .
+	 */
+	mutable boost::mutex lock;
+
+	/**
+	 * The spans, in the order they ended.
+	 */
+	std::vector<traceevent> events;
+
+	/**
+	 * Whether the spans of tasks get hardware counts; see
+	 * @c setCountTasks .
+	 */
+	bool countTasks;
+
+	/**
+	 * The hardware counters of each thread that ran a task.
+	 */
+	boost::thread_specific_ptr<perfcounters> threadCounters;
+
+public:
+
+	/**
+	 * Makes an empty log whose times count from now.
+	 */
+	tracelog() :
+			epoch(boost::posix_time::microsec_clock::universal_time()),
+			countTasks(false) { }
+
+	/**
+	 * Makes the spans of the tasks of @c tracedTask from now on also get
+	 * what the hardware counters of the thread that ran each one counted
+	 * meanwhile, e.g. to find the tiles that miss the caches; see
+	 * @c perfcounters .
+	 *
+	 * @param on Whether to count.
+	 */
+	void setCountTasks(bool on) {
+		countTasks = on;
+	}
+
+	/**
+	 * Tells if the spans of tasks get hardware counts.
+	 *
+	 * @return Whether @c setCountTasks turned it on.
+	 */
+	bool countsTasks() const {
+		return countTasks;
+	}
+
+	/**
+	 * Gets the hardware counters of the calling thread, which are opened
+	 * the first time and closed when it ends.
+	 *
+	 * @return The counters.
+	 */
+	const perfcounters& getThreadCounters() {
+		if (threadCounters.get() == 0)
+			threadCounters.reset(new perfcounters(false));
+		return *threadCounters;
+	}
+
+	/**
+	 * Gets the time for a span.
+	 *
+	 * @return Microseconds since the log was made.
+	 */
+	long long now() const {
+		return (boost::posix_time::microsec_clock::universal_time() -
+				epoch).total_microseconds();
+	}
+
+	/**
+	 * Adds a span.
+	 *
+	 * @param name What ran; a string that outlives the log, e.g. a literal.
+	 * @param lane The lane it ran on, e.g. @c TRACE_WORKER_LANE plus the
+	 *   index of a render thread.
+	 * @param task The task, or -1 for none.
+	 * @param begin When it started, from @c now .
+	 * @param end When it ended, from @c now .
+	 * @param counts What the hardware counters counted meanwhile, or 0.
+	 */
+	void add(const char *name, int lane, int task, long long begin,
+			long long end, const perfsample *counts = 0) {
+		traceevent e;
+		e.name = name;
+		e.lane = lane;
+		e.task = task;
+		e.begin = begin;
+		e.end = end;
+		if (counts != 0)
+			e.counts = *counts;
+		boost::mutex::scoped_lock guard(lock);
+		events.push_back(e);
+	}
+
+	/**
+	 * Gets the spans.
+	 *
+	 * @return The spans in the order they ended; they shouldn't be added
+	 *   to meanwhile.
+	 */
+	const std::vector<traceevent>& getEvents() const {
+		return events;
+	}
+
+	/**
+	 * Writes the spans as a JSON trace in the Chrome tracing format, each
+	 * lane as a thread named for what runs on it, with the hardware counts
+	 * of tasks if they were counted, e.g. @code
+	 * {"traceEvents": [
+	 *  {"name": "thread_name", "ph": "M", "pid": 1, "tid": 2,
+	 *   "args": {"name": "worker 0"}},
+	 *  {"name": "shade", "ph": "X", "pid": 1, "tid": 2, "ts": 1520,
+	 *   "dur": 87, "args": {"task": 12}}, ...],
+	 *  "displayTimeUnit": "ms"}
+	 * @endcode
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void writeJson(std::ostream &os) const {
+		boost::mutex::scoped_lock guard(lock);
+		int lanes = TRACE_WORKER_LANE;
+		for (size_t i = 0; i < events.size(); i++)
+			lanes = std::max(lanes, events[i].lane + 1);
+		os << "{\"traceEvents\": [";
+		for (int l = 0; l < lanes; l++) {
+			os << (l > 0 ? "," : "") << "\n {\"name\": \"thread_name\", "
+					"\"ph\": \"M\", \"pid\": 1, \"tid\": " << l <<
+					", \"args\": {\"name\": \"";
+			if (l == TRACE_PHASE_LANE)
+				os << "phases";
+			else if (l == TRACE_WRITER_LANE)
+				os << "writer";
+			else
+				os << "worker " << l - TRACE_WORKER_LANE;
+			os << "\"}}";
+		}
+		for (size_t i = 0; i < events.size(); i++) {
+			const traceevent &e = events[i];
+			os << ",\n {\"name\": \"" << e.name << "\", \"ph\": \"X\", "
+					"\"pid\": 1, \"tid\": " << e.lane << ", \"ts\": " <<
+					e.begin << ", \"dur\": " << e.end - e.begin;
+			if (e.task >= 0) {
+				os << ", \"args\": {\"task\": " << e.task;
+				if (countTasks) {
+					os << ", ";
+					e.counts.writeJsonMembers(os);
+				}
+				os << "}";
+			}
+			os << "}";
+		}
+		os << "\n],\n\"displayTimeUnit\": \"ms\"}\n";
+		os.flush();
+	}
+};
+
+/**
+ * Wraps a task of @c parallelTasks so that every call of it adds a span to
+ * a @c tracelog on the lane of the thread it runs on.
+ *
+ * @tparam func Functor type with an @c operator()(int, int) .
+ */
+template<typename func>
+struct tracedTask {
+	/** The task. */
+	const func *f;
+	/** The log. */
+	tracelog *log;
+	/** Name of the spans. */
+	const char *name;
+
+	void operator()(int i, int thread) const {
+		if (!log->countsTasks()) {
+			long long begin = log->now();
+			(*f)(i, thread);
+			log->add(name, TRACE_WORKER_LANE + thread, i, begin, log->now());
+			return;
+		}
+		const perfcounters &counters = log->getThreadCounters();
+		perfsample start, end, counts;
+		long long begin = log->now();
+		counters.read(start);
+		(*f)(i, thread);
+		counters.read(end);
+		counts.addDifference(start, end);
+		log->add(name, TRACE_WORKER_LANE + thread, i, begin, log->now(),
+				&counts);
+	}
+};
+
+#endif // TRACELOG_HH
@@ -0,0 +1,408 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "mvector.hh"
+#include "simd.hh"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#ifndef TRIANGLELANES_HH
+#define TRIANGLELANES_HH
+
+/**
+ * A ray set up for the watertight ray-triangle test of Woop, Benthin and
+ * Wald: the axis along which the direction is largest becomes z, and a
+ * shear maps the direction to +z, so triangles are tested in 2D after
+ * their vertices are moved to the ray origin and sheared. Edges shared by
+ * two triangles are then computed with the same arithmetic from both
+ * sides, so rays can't slip through between them.
+ *
+ * @tparam vec_T The type of the vector components.
+ */
+template<typename vec_T>
+struct watertightray {
+	/** The axes that become x, y and z. */
+	int kx, ky, kz;
+	/** The ray origin. */
+	vec_T org[3];
+	/** The shear constants. */
+	vec_T Sx, Sy, Sz;
+
+	/**
+	 * Sets up the given ray. Rays with no direction miss everything.
+	 *
+	 * @param P The ray origin.
+	 * @param D The ray direction, which needn't have unit length.
+	 */
+	watertightray(const mvector<vec_T, 3> &P, const mvector<vec_T, 3> &D) {
+		kz = 0;
+		for (int a = 1; a < 3; a++)
+			if (std::abs(D[a]) > std::abs(D[kz]))
+				kz = a;
+		kx = (kz + 1) % 3;
+		ky = (kx + 1) % 3;
+		// Keep the winding so the sign tests below agree for every ray.
+		if (D[kz] < 0)
+			std::swap(kx, ky);
+		Sx = D[kx] / D[kz];
+		Sy = D[ky] / D[kz];
+		Sz = 1 / D[kz];
+		for (int a = 0; a < 3; a++)
+			org[a] = P[a];
+	}
+};
+
+/**
+ * A group of triangles laid out for @c trianglelanes : the coordinates of
+ * each vertex, axis by axis, lane by lane, so a kernel loads one axis of
+ * one vertex of every triangle with one instruction. Lanes without a
+ * triangle hold NaNs, which always miss.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam width Number of triangles in the group.
+ */
+template<typename vec_T, int width>
+struct trianglepacket {
+	/** Coordinate @c a of vertex @c k of the triangle in lane @c i is
+	 *  @c v[k][a][i] . */
+	vec_T v[3][3][width];
+
+	/**
+	 * Makes every lane empty.
+	 */
+	void clear() {
+		std::fill(&v[0][0][0], &v[0][0][0] + 9 * width,
+				std::numeric_limits<vec_T>::quiet_NaN());
+	}
+
+	/**
+	 * Puts a triangle into a lane.
+	 *
+	 * @param lane The lane.
+	 * @param v0 The first vertex.
+	 * @param v1 The second vertex.
+	 * @param v2 The third vertex.
+	 */
+	void set(int lane, const mvector<vec_T, 3> &v0,
+			const mvector<vec_T, 3> &v1, const mvector<vec_T, 3> &v2) {
+		for (int a = 0; a < 3; a++) {
+			v[0][a][lane] = v0[a];
+			v[1][a][lane] = v1[a];
+			v[2][a][lane] = v2[a];
+		}
+	}
+};
+
+/**
+ * Tests lanes [i, end) of a packet one at a time with the watertight test.
+ * This is the kernel of @c SIMD_SCALAR and of types without SIMD kernels;
+ * the others do exactly this arithmetic in every lane, without fused
+ * multiply-adds, so every level finds the same hits at the same times.
+ *
+ * @param p The packet.
+ * @param r The ray.
+ * @param tmax Hits at or beyond this time are ignored.
+ * @param i First lane.
+ * @param end One past the last lane.
+ * @param[out] t Receives the time of every lane; only those of hit lanes
+ *   are meaningful.
+ *
+ * @return The bit mask of the lanes hit at a time in (0, tmax).
+ */
+template<typename vec_T, int width>
+int hitTrianglesScalar(const trianglepacket<vec_T, width> &p,
+		const watertightray<vec_T> &r, vec_T tmax, int i, int end, vec_T *t) {
+	int mask = 0;
+	for (; i < end; i++) {
+		vec_T Az = p.v[0][r.kz][i] - r.org[r.kz];
+		vec_T Bz = p.v[1][r.kz][i] - r.org[r.kz];
+		vec_T Cz = p.v[2][r.kz][i] - r.org[r.kz];
+		vec_T Ax = (p.v[0][r.kx][i] - r.org[r.kx]) - r.Sx * Az;
+		vec_T Ay = (p.v[0][r.ky][i] - r.org[r.ky]) - r.Sy * Az;
+		vec_T Bx = (p.v[1][r.kx][i] - r.org[r.kx]) - r.Sx * Bz;
+		vec_T By = (p.v[1][r.ky][i] - r.org[r.ky]) - r.Sy * Bz;
+		vec_T Cx = (p.v[2][r.kx][i] - r.org[r.kx]) - r.Sx * Cz;
+		vec_T Cy = (p.v[2][r.ky][i] - r.org[r.ky]) - r.Sy * Cz;
+		vec_T U = Cx * By - Cy * Bx;
+		vec_T V = Ax * Cy - Ay * Cx;
+		vec_T W = Bx * Ay - By * Ax;
+		vec_T det = U + V + W;
+		vec_T T = (U * Az + V * Bz + W * Cz) * r.Sz;
+		t[i] = T / det;
+		bool inside = (U >= 0 && V >= 0 && W >= 0) ||
+				(U <= 0 && V <= 0 && W <= 0);
+		if (inside && det != 0 && t[i] > 0 && t[i] < tmax)
+			mask |= 1 << i;
+	}
+	return mask;
+}
+
+/**
+ * Batch watertight ray-triangle tests over a @c trianglepacket , in the
+ * instruction set picked at run time by @c activeSimdLevel , like
+ * @c spherelanes for spheres. This generic version only has the scalar
+ * kernel; there are specializations for doubles and floats.
+ *
+ * @tparam vec_T The type of the vector components.
+ */
+template<typename vec_T>
+struct trianglelanes {
+
+	/**
+	 * Number of triangles in a packet.
+	 */
+	static const int width = 4;
+
+	/**
+	 * The packet type.
+	 */
+	typedef trianglepacket<vec_T, width> packet;
+
+	/**
+	 * Tests a ray against every triangle of a packet.
+	 *
+	 * @param level The instruction set to use.
+	 * @param p The packet.
+	 * @param r The ray.
+	 * @param tmax Hits at or beyond this time are ignored.
+	 * @param[out] t Receives the time of every lane; only those of hit
+	 *   lanes are meaningful.
+	 *
+	 * @return The bit mask of the lanes hit at a time in (0, tmax).
+	 */
+	static int hit(simdLevel level, const packet &p,
+			const watertightray<vec_T> &r, vec_T tmax, vec_T *t) {
+		return hitTrianglesScalar(p, r, tmax, 0, width, t);
+	}
+};
+
+#ifdef SIMD_DISPATCH
+
+/**
+ * @c trianglelanes for doubles, 4 triangles per packet tested 2 at a time
+ * with SSE2 or all at once with AVX2. AVX-512 runs the AVX2 kernel, since a
+ * packet has only 4 lanes.
+ */
+template<>
+struct trianglelanes<double> {
+	static const int width = 4;
+	typedef trianglepacket<double, width> packet;
+
+	/** The SSE2 kernel of @c hit . */
+	static int hit128(const packet &p, const watertightray<double> &r,
+			double tmax, double *t) {
+		const __m128d zero = _mm_setzero_pd(), limit = _mm_set1_pd(tmax);
+		const __m128d sx = _mm_set1_pd(r.Sx), sy = _mm_set1_pd(r.Sy),
+				sz = _mm_set1_pd(r.Sz);
+		const __m128d ox = _mm_set1_pd(r.org[r.kx]),
+				oy = _mm_set1_pd(r.org[r.ky]), oz = _mm_set1_pd(r.org[r.kz]);
+		int mask = 0;
+		for (int i = 0; i < width; i += 2) {
+			__m128d x[3], y[3], z[3];
+			for (int k = 0; k < 3; k++) {
+				z[k] = _mm_sub_pd(_mm_loadu_pd(p.v[k][r.kz] + i), oz);
+				x[k] = _mm_sub_pd(_mm_sub_pd(_mm_loadu_pd(p.v[k][r.kx] + i),
+						ox), _mm_mul_pd(sx, z[k]));
+				y[k] = _mm_sub_pd(_mm_sub_pd(_mm_loadu_pd(p.v[k][r.ky] + i),
+						oy), _mm_mul_pd(sy, z[k]));
+			}
+			__m128d U = _mm_sub_pd(_mm_mul_pd(x[2], y[1]),
+					_mm_mul_pd(y[2], x[1]));
+			__m128d V = _mm_sub_pd(_mm_mul_pd(x[0], y[2]),
+					_mm_mul_pd(y[0], x[2]));
+			__m128d W = _mm_sub_pd(_mm_mul_pd(x[1], y[0]),
+					_mm_mul_pd(y[1], x[0]));
+			__m128d det = _mm_add_pd(_mm_add_pd(U, V), W);
+			__m128d T = _mm_mul_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(U, z[0]),
+					_mm_mul_pd(V, z[1])), _mm_mul_pd(W, z[2])), sz);
+			__m128d tt = _mm_div_pd(T, det);
+			_mm_storeu_pd(t + i, tt);
+			__m128d pos = _mm_and_pd(_mm_and_pd(_mm_cmpge_pd(U, zero),
+					_mm_cmpge_pd(V, zero)), _mm_cmpge_pd(W, zero));
+			__m128d neg = _mm_and_pd(_mm_and_pd(_mm_cmple_pd(U, zero),
+					_mm_cmple_pd(V, zero)), _mm_cmple_pd(W, zero));
+			__m128d ok = _mm_and_pd(_mm_and_pd(_mm_or_pd(pos, neg),
+					_mm_cmpneq_pd(det, zero)), _mm_and_pd(
+					_mm_cmpgt_pd(tt, zero), _mm_cmplt_pd(tt, limit)));
+			mask |= _mm_movemask_pd(ok) << i;
+		}
+		return mask;
+	}
+
+	/** The AVX2 kernel of @c hit . */
+	__attribute__((target("avx2")))
+	static int hit256(const packet &p, const watertightray<double> &r,
+			double tmax, double *t) {
+		const __m256d zero = _mm256_setzero_pd(), limit = _mm256_set1_pd(tmax);
+		const __m256d sx = _mm256_set1_pd(r.Sx), sy = _mm256_set1_pd(r.Sy),
+				sz = _mm256_set1_pd(r.Sz);
+		const __m256d ox = _mm256_set1_pd(r.org[r.kx]),
+				oy = _mm256_set1_pd(r.org[r.ky]),
+				oz = _mm256_set1_pd(r.org[r.kz]);
+		__m256d x[3], y[3], z[3];
+		for (int k = 0; k < 3; k++) {
+			z[k] = _mm256_sub_pd(_mm256_loadu_pd(p.v[k][r.kz]), oz);
+			x[k] = _mm256_sub_pd(_mm256_sub_pd(_mm256_loadu_pd(p.v[k][r.kx]),
+					ox), _mm256_mul_pd(sx, z[k]));
+			y[k] = _mm256_sub_pd(_mm256_sub_pd(_mm256_loadu_pd(p.v[k][r.ky]),
+					oy), _mm256_mul_pd(sy, z[k]));
+		}
+		__m256d U = _mm256_sub_pd(_mm256_mul_pd(x[2], y[1]),
+				_mm256_mul_pd(y[2], x[1]));
+		__m256d V = _mm256_sub_pd(_mm256_mul_pd(x[0], y[2]),
+				_mm256_mul_pd(y[0], x[2]));
+		__m256d W = _mm256_sub_pd(_mm256_mul_pd(x[1], y[0]),
+				_mm256_mul_pd(y[1], x[0]));
+		__m256d det = _mm256_add_pd(_mm256_add_pd(U, V), W);
+		__m256d T = _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(
+				_mm256_mul_pd(U, z[0]), _mm256_mul_pd(V, z[1])),
+				_mm256_mul_pd(W, z[2])), sz);
+		__m256d tt = _mm256_div_pd(T, det);
+		_mm256_storeu_pd(t, tt);
+		__m256d pos = _mm256_and_pd(_mm256_and_pd(
+				_mm256_cmp_pd(U, zero, _CMP_GE_OQ),
+				_mm256_cmp_pd(V, zero, _CMP_GE_OQ)),
+				_mm256_cmp_pd(W, zero, _CMP_GE_OQ));
+		__m256d neg = _mm256_and_pd(_mm256_and_pd(
+				_mm256_cmp_pd(U, zero, _CMP_LE_OQ),
+				_mm256_cmp_pd(V, zero, _CMP_LE_OQ)),
+				_mm256_cmp_pd(W, zero, _CMP_LE_OQ));
+		__m256d ok = _mm256_and_pd(_mm256_and_pd(_mm256_or_pd(pos, neg),
+				_mm256_cmp_pd(det, zero, _CMP_NEQ_UQ)), _mm256_and_pd(
+				_mm256_cmp_pd(tt, zero, _CMP_GT_OQ),
+				_mm256_cmp_pd(tt, limit, _CMP_LT_OQ)));
+		return _mm256_movemask_pd(ok);
+	}
+
+	/** Runs the kernel of the given level; see @c trianglelanes::hit . */
+	static int hit(simdLevel level, const packet &p,
+			const watertightray<double> &r, double tmax, double *t) {
+		switch (level) {
+		case SIMD_AVX512:
+		case SIMD_AVX2:
+			return hit256(p, r, tmax, t);
+		case SIMD_SSE2:
+			return hit128(p, r, tmax, t);
+		default:
+			return hitTrianglesScalar(p, r, tmax, 0, width, t);
+		}
+	}
+};
+
+/**
+ * @c trianglelanes for floats, 8 triangles per packet tested 4 at a time
+ * with SSE2 or all at once with AVX2. AVX-512 runs the AVX2 kernel, since a
+ * packet has only 8 lanes.
+ */
+template<>
+struct trianglelanes<float> {
+	static const int width = 8;
+	typedef trianglepacket<float, width> packet;
+
+	/** The SSE2 kernel of @c hit . */
+	static int hit128(const packet &p, const watertightray<float> &r,
+			float tmax, float *t) {
+		const __m128 zero = _mm_setzero_ps(), limit = _mm_set1_ps(tmax);
+		const __m128 sx = _mm_set1_ps(r.Sx), sy = _mm_set1_ps(r.Sy),
+				sz = _mm_set1_ps(r.Sz);
+		const __m128 ox = _mm_set1_ps(r.org[r.kx]),
+				oy = _mm_set1_ps(r.org[r.ky]), oz = _mm_set1_ps(r.org[r.kz]);
+		int mask = 0;
+		for (int i = 0; i < width; i += 4) {
+			__m128 x[3], y[3], z[3];
+			for (int k = 0; k < 3; k++) {
+				z[k] = _mm_sub_ps(_mm_loadu_ps(p.v[k][r.kz] + i), oz);
+				x[k] = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(p.v[k][r.kx] + i),
+						ox), _mm_mul_ps(sx, z[k]));
+				y[k] = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(p.v[k][r.ky] + i),
+						oy), _mm_mul_ps(sy, z[k]));
+			}
+			__m128 U = _mm_sub_ps(_mm_mul_ps(x[2], y[1]),
+					_mm_mul_ps(y[2], x[1]));
+			__m128 V = _mm_sub_ps(_mm_mul_ps(x[0], y[2]),
+					_mm_mul_ps(y[0], x[2]));
+			__m128 W = _mm_sub_ps(_mm_mul_ps(x[1], y[0]),
+					_mm_mul_ps(y[1], x[0]));
+			__m128 det = _mm_add_ps(_mm_add_ps(U, V), W);
+			__m128 T = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(U, z[0]),
+					_mm_mul_ps(V, z[1])), _mm_mul_ps(W, z[2])), sz);
+			__m128 tt = _mm_div_ps(T, det);
+			_mm_storeu_ps(t + i, tt);
+			__m128 pos = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(U, zero),
+					_mm_cmpge_ps(V, zero)), _mm_cmpge_ps(W, zero));
+			__m128 neg = _mm_and_ps(_mm_and_ps(_mm_cmple_ps(U, zero),
+					_mm_cmple_ps(V, zero)), _mm_cmple_ps(W, zero));
+			__m128 ok = _mm_and_ps(_mm_and_ps(_mm_or_ps(pos, neg),
+					_mm_cmpneq_ps(det, zero)), _mm_and_ps(
+					_mm_cmpgt_ps(tt, zero), _mm_cmplt_ps(tt, limit)));
+			mask |= _mm_movemask_ps(ok) << i;
+		}
+		return mask;
+	}
+
+	/** The AVX2 kernel of @c hit . */
+	__attribute__((target("avx2")))
+	static int hit256(const packet &p, const watertightray<float> &r,
+			float tmax, float *t) {
+		const __m256 zero = _mm256_setzero_ps(), limit = _mm256_set1_ps(tmax);
+		const __m256 sx = _mm256_set1_ps(r.Sx), sy = _mm256_set1_ps(r.Sy),
+				sz = _mm256_set1_ps(r.Sz);
+		const __m256 ox = _mm256_set1_ps(r.org[r.kx]),
+				oy = _mm256_set1_ps(r.org[r.ky]),
+				oz = _mm256_set1_ps(r.org[r.kz]);
+		__m256 x[3], y[3], z[3];
+		for (int k = 0; k < 3; k++) {
+			z[k] = _mm256_sub_ps(_mm256_loadu_ps(p.v[k][r.kz]), oz);
+			x[k] = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(p.v[k][r.kx]),
+					ox), _mm256_mul_ps(sx, z[k]));
+			y[k] = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(p.v[k][r.ky]),
+					oy), _mm256_mul_ps(sy, z[k]));
+		}
+		__m256 U = _mm256_sub_ps(_mm256_mul_ps(x[2], y[1]),
+				_mm256_mul_ps(y[2], x[1]));
+		__m256 V = _mm256_sub_ps(_mm256_mul_ps(x[0], y[2]),
+				_mm256_mul_ps(y[0], x[2]));
+		__m256 W = _mm256_sub_ps(_mm256_mul_ps(x[1], y[0]),
+				_mm256_mul_ps(y[1], x[0]));
+		__m256 det = _mm256_add_ps(_mm256_add_ps(U, V), W);
+		__m256 T = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(U, z[0]), _mm256_mul_ps(V, z[1])),
+				_mm256_mul_ps(W, z[2])), sz);
+		__m256 tt = _mm256_div_ps(T, det);
+		_mm256_storeu_ps(t, tt);
+		__m256 pos = _mm256_and_ps(_mm256_and_ps(
+				_mm256_cmp_ps(U, zero, _CMP_GE_OQ),
+				_mm256_cmp_ps(V, zero, _CMP_GE_OQ)),
+				_mm256_cmp_ps(W, zero, _CMP_GE_OQ));
+		__m256 neg = _mm256_and_ps(_mm256_and_ps(
+				_mm256_cmp_ps(U, zero, _CMP_LE_OQ),
+				_mm256_cmp_ps(V, zero, _CMP_LE_OQ)),
+				_mm256_cmp_ps(W, zero, _CMP_LE_OQ));
+		__m256 ok = _mm256_and_ps(_mm256_and_ps(_mm256_or_ps(pos, neg),
+				_mm256_cmp_ps(det, zero, _CMP_NEQ_UQ)), _mm256_and_ps(
+				_mm256_cmp_ps(tt, zero, _CMP_GT_OQ),
+				_mm256_cmp_ps(tt, limit, _CMP_LT_OQ)));
+		return _mm256_movemask_ps(ok);
+	}
+
+	/** Runs the kernel of the given level; see @c trianglelanes::hit . */
+	static int hit(simdLevel level, const packet &p,
+			const watertightray<float> &r, float tmax, float *t) {
+		switch (level) {
+		case SIMD_AVX512:
+		case SIMD_AVX2:
+			return hit256(p, r, tmax, t);
+		case SIMD_SSE2:
+			return hit128(p, r, tmax, t);
+		default:
+			return hitTrianglesScalar(p, r, tmax, 0, width, t);
+		}
+	}
+};
+
+#endif // SIMD_DISPATCH
+
+#endif // TRIANGLELANES_HH
@@ -0,0 +1,731 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "shape.hh"
+#include "mappedfile.hh"
+#include "aabb.hh"
+#include "ray.hh"
+#include "hitrecord.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "trianglelanes.hh"
+#include "simd.hh"
+#include "boost/shared_ptr.hpp"
+#include "boost/noncopyable.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <ostream>
+
+#ifndef TRIANGLEMESH_HH
+#define TRIANGLEMESH_HH
+
+/**
+ * Number of candidate split planes per axis in the binned SAH build of a
+ * mesh's hierarchy.
+ */
+#define MESH_SAH_BINS 12
+
+/**
+ * Largest number of triangles the build will put into one leaf, which
+ * holds them in one or two @c trianglepacket s.
+ */
+#define MESH_MAX_LEAF 8
+
+/**
+ * Deepest mesh hierarchy the traversal stack can handle.
+ */
+#define MESH_MAX_DEPTH 64
+
+/**
+ * The vertices and triangles of an indexed triangle mesh: three
+ * coordinates per vertex and three vertex indices per triangle, so
+ * triangles that share a vertex share its coordinates too. The arrays
+ * either live in vectors owned by the buffers or are used in place from a
+ * @c mappedfile the buffers keep open, which is how binary PLY files whose
+ * vertices are already of @c vec_T are read without a copy. Any number of
+ * meshes can share one set of buffers.
+ *
+ * @tparam vec_T The type of the vector components.
+ */
+template<typename vec_T>
+class meshbuffers : private boost::noncopyable {
+private:
+
+	/**
+	 * The coordinates of @c ownVertices or of the mapping.
+	 */
+	const vec_T *vertices;
+
+	/**
+	 * Number of vertices.
+	 */
+	size_t vertexCount;
+
+	/**
+	 * The vertex indices of @c ownIndices or of the mapping.
+	 */
+	const int *indices;
+
+	/**
+	 * Number of triangles.
+	 */
+	size_t triangleCount;
+
+	/**
+	 * Vertices read into memory.
+	 */
+	std::vector<vec_T> ownVertices;
+
+	/**
+	 * Indices read into memory.
+	 */
+	std::vector<int> ownIndices;
+
+	/**
+	 * The mapping arrays are used from, kept open as long as the buffers.
+	 */
+	boost::shared_ptr<mappedfile> file;
+
+public:
+
+	/**
+	 * Constructs empty buffers.
+	 */
+	meshbuffers() : vertices(0), vertexCount(0), indices(0),
+			triangleCount(0) { }
+
+	/**
+	 * Takes over vertex coordinates, three per vertex.
+	 *
+	 * @param coords The coordinates, which are left empty.
+	 */
+	void setVertices(std::vector<vec_T> &coords) {
+		assert(coords.size() % 3 == 0);
+		ownVertices.swap(coords);
+		coords.clear();
+		vertices = ownVertices.empty() ? 0 : &ownVertices[0];
+		vertexCount = ownVertices.size() / 3;
+	}
+
+	/**
+	 * Uses vertex coordinates in place from a mapping.
+	 *
+	 * @param mapping The mapping, which is kept open.
+	 * @param coords The first coordinate, inside the mapping and aligned for
+	 *   @c vec_T .
+	 * @param count Number of vertices.
+	 */
+	void mapVertices(const boost::shared_ptr<mappedfile> &mapping,
+			const vec_T *coords, size_t count) {
+		file = mapping;
+		ownVertices.clear();
+		vertices = coords;
+		vertexCount = count;
+	}
+
+	/**
+	 * Takes over triangles, three vertex indices each.
+	 *
+	 * @param tris The indices, which are left empty.
+	 */
+	void setIndices(std::vector<int> &tris) {
+		assert(tris.size() % 3 == 0);
+		ownIndices.swap(tris);
+		tris.clear();
+		indices = ownIndices.empty() ? 0 : &ownIndices[0];
+		triangleCount = ownIndices.size() / 3;
+	}
+
+	/**
+	 * Gets the number of vertices.
+	 *
+	 * @return Vertex count.
+	 */
+	size_t getVertexCount() const {
+		return vertexCount;
+	}
+
+	/**
+	 * Gets the number of triangles.
+	 *
+	 * @return Triangle count.
+	 */
+	size_t getTriangleCount() const {
+		return triangleCount;
+	}
+
+	/**
+	 * Gets a vertex.
+	 *
+	 * @param i Index of the vertex.
+	 *
+	 * @return The vertex.
+	 */
+	mvector<vec_T, 3> getVertex(size_t i) const {
+		assert(i < vertexCount);
+		const vec_T *p = vertices + 3 * i;
+		mvector<vec_T, 3> v;
+		v[0] = p[0];
+		v[1] = p[1];
+		v[2] = p[2];
+		return v;
+	}
+
+	/**
+	 * Gets the vertex indices of a triangle.
+	 *
+	 * @param tri Index of the triangle.
+	 *
+	 * @return The three indices.
+	 */
+	const int* getTriangle(size_t tri) const {
+		assert(tri < triangleCount);
+		return indices + 3 * tri;
+	}
+
+	/**
+	 * Tells if the vertices are used in place from a mapping.
+	 *
+	 * @return @c true if nothing was copied.
+	 */
+	bool isMapped() const {
+		return file != 0 && vertexCount > 0;
+	}
+
+	/**
+	 * Checks that every triangle refers to existing vertices.
+	 *
+	 * @return @c true if the indices are in range.
+	 */
+	bool isValid() const {
+		for (size_t i = 0; i < 3 * triangleCount; i++)
+			if (indices[i] < 0 || (size_t) indices[i] >= vertexCount)
+				return false;
+		return true;
+	}
+
+	/**
+	 * Gets the memory the buffers hold, not counting a mapping.
+	 *
+	 * @return Size in bytes.
+	 */
+	size_t getMemoryUsage() const {
+		return ownVertices.capacity() * sizeof(vec_T) +
+				ownIndices.capacity() * sizeof(int);
+	}
+};
+
+/**
+ * A mesh of triangles sharing @c meshbuffers , with one color and
+ * reflectivity. The mesh keeps its own bounding volume hierarchy over its
+ * triangles, built with a binned surface area heuristic like @c bvh , so
+ * the scene's hierarchy holds the whole mesh as one shape and rays that
+ * reach its box are traced through the mesh's own tree. The leaves keep
+ * copies of their triangles' vertices in @c trianglepacket s, tested a
+ * packet at a time with the watertight kernels of @c trianglelanes , so
+ * rays don't slip through shared edges. Triangles are two-sided: the normal
+ * of a hit faces the ray. There is no dimension
+ * template argument because the triangles are in 3D.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+class trianglemesh : public shape<vec_T, color_T, time_T, 3> {
+public:
+
+	/**
+	 * Boost shared pointer typedef for the buffers.
+	 */
+	typedef boost::shared_ptr<const meshbuffers<vec_T> > sp_buffers;
+
+private:
+
+	typedef trianglelanes<vec_T> lanes;
+
+	/**
+	 * A node of the hierarchy, laid out like those of @c bvh : depth first,
+	 * with bounds rounded outwards to floats.
+	 */
+	struct meshnode {
+		/** Lower corner of the box around everything below this node. */
+		float lo[3];
+		/** Upper corner of the box around everything below this node. */
+		float hi[3];
+		/**
+		 * Index of the right child for interior nodes; first entry of
+		 * @c packets for leaves.
+		 */
+		int offset;
+		/** Number of packets in this leaf, 0 for interior nodes. */
+		int count;
+	};
+
+	/**
+	 * Per-triangle data only needed while building.
+	 */
+	struct buildtri {
+		/** Bounds of the triangle. */
+		aabb<vec_T, 3> box;
+		/** Center of @c box . */
+		mvector<vec_T, 3> centroid;
+	};
+
+	/**
+	 * Partition predicate for the binned split.
+	 */
+	struct binPredicate {
+		const std::vector<buildtri> *bt;
+		int axis;
+		int splitBin;
+		vec_T cmin;
+		vec_T scale;
+
+		bool operator()(int i) const {
+			return binOf((*bt)[i].centroid[axis], cmin, scale) < splitBin;
+		}
+	};
+
+	/**
+	 * The vertices and triangles.
+	 */
+	sp_buffers buffers;
+
+	/**
+	 * The hierarchy. Element 0 is the root.
+	 */
+	std::vector<meshnode> nodes;
+
+	/**
+	 * The triangles of the leaves, in the order of the leaves.
+	 */
+	std::vector<typename lanes::packet> packets;
+
+	/**
+	 * The triangle in every lane of @c packets , or -1 for empty lanes.
+	 */
+	std::vector<int> laneTriangles;
+
+	/**
+	 * Box around all triangles.
+	 */
+	aabb<vec_T, 3> bounds;
+
+	/**
+	 * Maps a centroid coordinate to its bin.
+	 */
+	static int binOf(vec_T c, vec_T cmin, vec_T scale) {
+		int b = (int) ((c - cmin) * scale);
+		if (b < 0)
+			b = 0;
+		if (b >= MESH_SAH_BINS)
+			b = MESH_SAH_BINS - 1;
+		return b;
+	}
+
+	/**
+	 * Rounds towards negative infinity to a float.
+	 */
+	static float roundDown(vec_T v) {
+		float f = (float) v;
+		if ((vec_T) f > v)
+			f = nextafterf(f, -std::numeric_limits<float>::max());
+		return f;
+	}
+
+	/**
+	 * Rounds towards positive infinity to a float.
+	 */
+	static float roundUp(vec_T v) {
+		float f = (float) v;
+		if ((vec_T) f < v)
+			f = nextafterf(f, std::numeric_limits<float>::max());
+		return f;
+	}
+
+	/**
+	 * Gets the number of packets a leaf of the given triangles needs, which
+	 * the surface area heuristic counts as the cost of the leaf.
+	 */
+	static int packetsOf(int n) {
+		return (n + lanes::width - 1) / lanes::width;
+	}
+
+	/**
+	 * Appends packets for the triangles in @c order[start, end) .
+	 */
+	void pack(const std::vector<int> &order, int start, int end) {
+		for (int i = start; i < end; i += lanes::width) {
+			packets.push_back(typename lanes::packet());
+			packets.back().clear();
+			for (int k = 0; k < lanes::width; k++) {
+				int tri = i + k < end ? order[i + k] : -1;
+				laneTriangles.push_back(tri);
+				if (tri < 0)
+					continue;
+				const int *v = buffers->getTriangle(tri);
+				packets.back().set(k, buffers->getVertex(v[0]),
+						buffers->getVertex(v[1]), buffers->getVertex(v[2]));
+			}
+		}
+	}
+
+	/**
+	 * Appends the subtree for the triangles in @c order[start, end) to
+	 * @c nodes in depth-first order, and their packets to @c packets .
+	 *
+	 * @param bt The build data of the triangles.
+	 * @param order Triangle indices, which are partitioned in place.
+	 * @param depth Depth of the new node; the root is at depth 0.
+	 */
+	void build(const std::vector<buildtri> &bt, std::vector<int> &order,
+			int start, int end, int depth) {
+		int nodeIdx = (int) nodes.size();
+		nodes.push_back(meshnode());
+
+		aabb<vec_T, 3> box, cbox;
+		for (int i = start; i < end; i++) {
+			box.extend(bt[order[i]].box);
+			cbox.extend(bt[order[i]].centroid);
+		}
+		for (int i = 0; i < 3; i++) {
+			nodes[nodeIdx].lo[i] = roundDown(box.getMin()[i]);
+			nodes[nodeIdx].hi[i] = roundUp(box.getMax()[i]);
+		}
+
+		int n = end - start;
+		double bestCost = std::numeric_limits<double>::max();
+		int bestAxis = -1, bestSplit = -1;
+		if (n > 1 && depth < MESH_MAX_DEPTH - 2) {
+			vec_T parentArea = box.surfaceArea();
+			for (int axis = 0; axis < 3; axis++) {
+				vec_T cmin = cbox.getMin()[axis];
+				vec_T extent = cbox.getMax()[axis] - cmin;
+				if (extent <= 0)
+					continue;
+				vec_T scale = MESH_SAH_BINS / extent;
+
+				aabb<vec_T, 3> binBoxes[MESH_SAH_BINS];
+				int binCounts[MESH_SAH_BINS] = { 0 };
+				for (int i = start; i < end; i++) {
+					int b = binOf(bt[order[i]].centroid[axis], cmin, scale);
+					binCounts[b]++;
+					binBoxes[b].extend(bt[order[i]].box);
+				}
+
+				vec_T rightArea[MESH_SAH_BINS];
+				int rightCount[MESH_SAH_BINS];
+				aabb<vec_T, 3> acc;
+				int cnt = 0;
+				for (int b = MESH_SAH_BINS - 1; b > 0; b--) {
+					acc.extend(binBoxes[b]);
+					cnt += binCounts[b];
+					rightArea[b] = acc.surfaceArea();
+					rightCount[b] = cnt;
+				}
+				acc = aabb<vec_T, 3>();
+				cnt = 0;
+				for (int b = 1; b < MESH_SAH_BINS; b++) {
+					acc.extend(binBoxes[b - 1]);
+					cnt += binCounts[b - 1];
+					if (cnt == 0 || rightCount[b] == 0)
+						continue;
+					double cost = 0.5 + (acc.surfaceArea() * packetsOf(cnt) +
+							rightArea[b] * packetsOf(rightCount[b])) /
+							(parentArea > 0 ? parentArea : 1);
+					if (cost < bestCost) {
+						bestCost = cost;
+						bestAxis = axis;
+						bestSplit = b;
+					}
+				}
+			}
+		}
+
+		// Small ranges become leaves unless splitting is cheaper; ranges
+		// that can't be split by their centroids are halved if too big.
+		int mid;
+		if (n == 1 || depth >= MESH_MAX_DEPTH - 2 || (n <= MESH_MAX_LEAF &&
+				(bestAxis < 0 || bestCost >= packetsOf(n)))) {
+			nodes[nodeIdx].offset = (int) packets.size();
+			nodes[nodeIdx].count = packetsOf(n);
+			pack(order, start, end);
+			return;
+		}
+		if (bestAxis < 0) {
+			mid = start + n / 2;
+		}
+		else {
+			binPredicate pred;
+			pred.bt = &bt;
+			pred.axis = bestAxis;
+			pred.splitBin = bestSplit;
+			pred.cmin = cbox.getMin()[bestAxis];
+			pred.scale = MESH_SAH_BINS /
+					(cbox.getMax()[bestAxis] - cbox.getMin()[bestAxis]);
+			mid = (int) (std::partition(order.begin() + start,
+					order.begin() + end, pred) - order.begin());
+			if (mid == start || mid == end)
+				mid = start + n / 2;
+		}
+		build(bt, order, start, mid, depth + 1);
+		int right = (int) nodes.size();
+		build(bt, order, mid, end, depth + 1);
+		nodes[nodeIdx].offset = right;
+		nodes[nodeIdx].count = 0;
+	}
+
+	/**
+	 * Finds the closest triangle hit by a ray, walking the hierarchy near
+	 * child first like @c bvh::closestHit but with conservative box tests.
+	 *
+	 * @param r The ray.
+	 * @param[out] tBest Receives the time of the hit or @c RAY_MISS .
+	 *
+	 * @return Index of the triangle or -1.
+	 */
+	int closestTriangle(const ray<vec_T, time_T, 3> &r,
+			time_T &tBest) const {
+		int best = -1;
+		tBest = RAY_MISS;
+		if (nodes.empty())
+			return -1;
+		rayquery<vec_T, time_T, 3> q(r);
+		watertightray<vec_T> wr(r.getOrig(), r.getDir());
+		simdLevel level = activeSimdLevel();
+		vec_T t[lanes::width];
+		time_T tmax = q.getTMax(), tnear;
+		int stack[MESH_MAX_DEPTH];
+		int sp = 0;
+		if (q.slabsConservative(nodes[0].lo, nodes[0].hi, tmax, tnear))
+			stack[sp++] = 0;
+		while (sp > 0) {
+			int idx = stack[--sp];
+			const meshnode &n = nodes[idx];
+			time_T limit = best < 0 ? tmax : tBest;
+			if (n.count > 0) {
+				for (int p = n.offset; p < n.offset + n.count; p++) {
+					int mask = lanes::hit(level, packets[p], wr, (vec_T) limit,
+							t);
+					for (int k = 0; mask != 0; k++, mask >>= 1) {
+						time_T tt = (time_T) t[k];
+						if ((mask & 1) && tt > 0 && tt < limit) {
+							best = laneTriangles[p * lanes::width + k];
+							tBest = limit = tt;
+						}
+					}
+				}
+				continue;
+			}
+			int left = idx + 1, right = n.offset;
+			time_T tl, tr;
+			bool hitl = q.slabsConservative(nodes[left].lo, nodes[left].hi,
+					limit, tl);
+			bool hitr = q.slabsConservative(nodes[right].lo, nodes[right].hi,
+					limit, tr);
+			assert(sp + 2 <= MESH_MAX_DEPTH);
+			if (hitl && hitr) {
+				if (tl < tr) {
+					stack[sp++] = right;
+					stack[sp++] = left;
+				}
+				else {
+					stack[sp++] = left;
+					stack[sp++] = right;
+				}
+			}
+			else if (hitl) {
+				stack[sp++] = left;
+			}
+			else if (hitr) {
+				stack[sp++] = right;
+			}
+		}
+		return best;
+	}
+
+	/**
+	 * Gets the unit normal of a triangle by the winding of its vertices.
+	 *
+	 * @param tri Index of the triangle.
+	 *
+	 * @return The normal.
+	 */
+	mvector<vec_T, 3> triangleNorm(int tri) const {
+		const int *v = buffers->getTriangle(tri);
+		mvector<vec_T, 3> v0 = buffers->getVertex(v[0]);
+		return ((buffers->getVertex(v[1]) - v0) %
+				(buffers->getVertex(v[2]) - v0)).norm();
+	}
+
+public:
+
+	/**
+	 * Constructs a mesh over the given buffers and builds its hierarchy.
+	 * Degenerate triangles are kept; rays never hit them.
+	 *
+	 * @param color The color.
+	 * @param theBuffers The vertices and triangles, which must be valid and
+	 *   hold at least one triangle.
+	 * @param reflectivity Reflectivity between 0 and 1.
+	 */
+	trianglemesh(const rgbcolor<color_T> &color,
+			const sp_buffers &theBuffers, float reflectivity = 0) :
+			shape<vec_T, color_T, time_T, 3>(color, reflectivity),
+			buffers(theBuffers) {
+		assert(buffers != 0 && buffers->getTriangleCount() > 0);
+		assert(buffers->isValid());
+		int n = (int) buffers->getTriangleCount();
+		std::vector<buildtri> bt(n);
+		for (int i = 0; i < n; i++) {
+			const int *v = buffers->getTriangle(i);
+			for (int k = 0; k < 3; k++)
+				bt[i].box.extend(buffers->getVertex(v[k]));
+			bt[i].centroid = (bt[i].box.getMin() + bt[i].box.getMax()) /
+					(vec_T) 2;
+			bounds.extend(bt[i].box);
+		}
+		std::vector<int> order(n);
+		for (int i = 0; i < n; i++)
+			order[i] = i;
+		nodes.reserve(2 * n / MESH_MAX_LEAF + 1);
+		build(bt, order, 0, n, 0);
+	}
+
+	/**
+	 * Gets the buffers.
+	 *
+	 * @return The vertices and triangles.
+	 */
+	const sp_buffers& getBuffers() const {
+		return buffers;
+	}
+
+	/**
+	 * Gets the number of nodes of the hierarchy.
+	 *
+	 * @return Node count.
+	 */
+	int getNodeCount() const {
+		return (int) nodes.size();
+	}
+
+	/**
+	 * Gets the number of packets the leaves hold.
+	 *
+	 * @return Packet count.
+	 */
+	int getPacketCount() const {
+		return (int) packets.size();
+	}
+
+	/**
+	 * Gets the memory taken by the hierarchy and its packets, not counting
+	 * the buffers.
+	 *
+	 * @return Size in bytes.
+	 */
+	size_t getMemoryUsage() const {
+		return nodes.capacity() * sizeof(meshnode) +
+				packets.capacity() * sizeof(typename lanes::packet) +
+				laneTriangles.capacity() * sizeof(int);
+	}
+
+	/**
+	 * Gets the earliest time at which the given ray hits a triangle.
+	 *
+	 * @param r The ray.
+	 *
+	 * @return The time of the closest hit or @c RAY_MISS .
+	 */
+	time_T intersection(const ray<vec_T, time_T, 3> &r) const {
+		time_T t;
+		closestTriangle(r, t);
+		return t;
+	}
+
+	/**
+	 * Fills in a hit record for a hit found by @c intersection with the
+	 * normal of the triangle that was hit, turned to face the ray.
+	 *
+	 * @param r The ray.
+	 * @param[in,out] rec The record, whose @c t is the time of the hit.
+	 */
+	void completeHit(const ray<vec_T, time_T, 3> &r,
+			hitrecord<vec_T, color_T, time_T, 3> &rec) const {
+		time_T t;
+		int tri = closestTriangle(r, t);
+		rec.point = r.getPointAtT(rec.t);
+		rec.obj = this;
+		if (tri < 0) {
+			rec.normal = surfaceNorm(rec.point);
+			return;
+		}
+		rec.normal = triangleNorm(tri);
+		if (rec.normal * r.getDir() > 0)
+			rec.normal = -rec.normal;
+	}
+
+	/**
+	 * Gets the normal of the triangle whose plane passes nearest the given
+	 * point, by winding. This looks at every triangle; shading goes through
+	 * @c completeHit , which knows the ray.
+	 *
+	 * @param surfacePt The point at which to get a surface normal.
+	 *
+	 * @return The surface normal.
+	 */
+	mvector<vec_T, 3> surfaceNorm(const mvector<vec_T, 3> &surfacePt) const {
+		int best = 0;
+		vec_T bestDist = std::numeric_limits<vec_T>::max();
+		for (int i = 0; i < (int) buffers->getTriangleCount(); i++) {
+			mvector<vec_T, 3> N = triangleNorm(i);
+			vec_T d = std::abs((surfacePt - buffers->getVertex(
+					buffers->getTriangle(i)[0])) * N);
+			if (d < bestDist) {
+				bestDist = d;
+				best = i;
+			}
+		}
+		return triangleNorm(best);
+	}
+
+	/**
+	 * Gets the box around all triangles.
+	 *
+	 * @param[out] box Receives the bounding box.
+	 *
+	 * @return @c true .
+	 */
+	bool getBounds(aabb<vec_T, 3> &box) const {
+		box = bounds;
+		return true;
+	}
+
+	/**
+	 * Partially overrides the @c shape @c printHelper. Calls the base
+	 * class's @c printHelper then prints the numbers of triangles and
+	 * vertices.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printHelper(std::ostream &os) const {
+		shape<vec_T, color_T, time_T, 3>::printHelper(os);
+		os << " ---> [mesh. triangles: " << buffers->getTriangleCount() <<
+				", vertices: " << buffers->getVertexCount() << "]";
+	}
+};
+
+typedef meshbuffers<double> meshbuffersd;
+typedef meshbuffers<float> meshbuffersf;
+typedef trianglemesh<double, double, double> trianglemeshd;
+typedef trianglemesh<double, double, float> trianglemeshddf;
+typedef trianglemesh<float, float, float> trianglemeshf;
+
+#endif // TRIANGLEMESH_HH
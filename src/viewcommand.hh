@@ -0,0 +1,297 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "sceneparser.hh"
+#include "mvector.hh"
+#include <cmath>
+#include <string>
+
+#ifndef VIEWCOMMAND_HH
+#define VIEWCOMMAND_HH
+
+/**
+ * Degrees short of straight up or down that turning and orbiting stop at,
+ * so the camera's direction never lines up with its up direction.
+ */
+#define VIEW_PITCH_LIMIT 1.0
+
+/**
+ * What a line sent to a viewer asks for.
+ */
+enum viewCommandKind {
+	/** Nothing: a blank line or a comment. */
+	VIEW_NONE,
+	/** Move the camera along its own axes. */
+	VIEW_MOVE,
+	/** Turn the camera in place. */
+	VIEW_TURN,
+	/** Swing the camera around the point it looks at. */
+	VIEW_ORBIT,
+	/** Move the camera toward the point it looks at. */
+	VIEW_ZOOM,
+	/** Put the camera somewhere. */
+	VIEW_CAMERA,
+	/** Put the camera back where it started. */
+	VIEW_RESET,
+	/** Stop viewing. */
+	VIEW_QUIT
+};
+
+/**
+ * A command of the line protocol the driver's @c --view mode reads, one
+ * per line:
+ *
+ * move right up forward
+ *
+ * turn yaw pitch
+ *
+ * orbit yaw pitch
+ *
+ * zoom factor
+ *
+ * camera position look_at up
+ *
+ * reset
+ *
+ * quit
+ *
+ * Moves are in scene units along the camera's right, up and forward
+ * directions; turns and orbits are in degrees, yaw to the right and pitch
+ * up; zooming by a factor greater than 1 divides the distance to the point
+ * looked at by it. Vectors are written as in scene descriptions, and a line
+ * starting with # is a comment.
+ */
+struct viewcommand {
+	/** The kind of command. */
+	viewCommandKind kind;
+	/**
+	 * The numbers of a move, turn, orbit or zoom, in order, or the
+	 * position, point looked at and up direction of a camera command.
+	 */
+	mvector<double, 3> args[3];
+};
+
+/**
+ * Reads one line of the @c viewcommand protocol.
+ *
+ * @param line The line, without its newline.
+ * @param[out] cmd Receives the command.
+ * @param[out] error Receives what's wrong with the line, if anything.
+ *
+ * @return @c false if the line isn't a valid command.
+ */
+inline bool parseViewCommand(const std::string &line, viewcommand &cmd,
+		std::string &error) {
+	cmd.kind = VIEW_NONE;
+	for (int i = 0; i < 3; i++)
+		cmd.args[i] = mvector<double, 3>();
+	scenetokenizer in(line.data(), line.data() + line.size());
+	std::string word;
+	if (!in.word(word) || word[0] == '#')
+		return true;
+	int numbers = 0;
+	viewCommandKind kind;
+	if (word == "move") {
+		kind = VIEW_MOVE;
+		numbers = 3;
+	}
+	else if (word == "turn" || word == "orbit") {
+		kind = word == "turn" ? VIEW_TURN : VIEW_ORBIT;
+		numbers = 2;
+	}
+	else if (word == "zoom") {
+		kind = VIEW_ZOOM;
+		numbers = 1;
+	}
+	else if (word == "camera") {
+		if (!in.vector(cmd.args[0]) || !in.vector(cmd.args[1]) ||
+				!in.vector(cmd.args[2])) {
+			error = "camera needs a position, a point to look at and an up "
+					"direction.";
+			return false;
+		}
+		kind = VIEW_CAMERA;
+	}
+	else if (word == "reset")
+		kind = VIEW_RESET;
+	else if (word == "quit")
+		kind = VIEW_QUIT;
+	else {
+		error = "unknown command \"" + word + "\".";
+		return false;
+	}
+	for (int i = 0; i < numbers; i++) {
+		double v;
+		if (!in.number(v) || !(std::abs(v) < 1e300)) {
+			error = word + " needs " + (numbers == 1 ? "a number." :
+					numbers == 2 ? "two numbers." : "three numbers.");
+			return false;
+		}
+		cmd.args[0][i] = v;
+	}
+	if (kind == VIEW_ZOOM && !(cmd.args[0][0] > 0)) {
+		error = "zoom needs a positive factor.";
+		return false;
+	}
+	if (in.word(word)) {
+		error = "unexpected \"" + word + "\" after the command.";
+		return false;
+	}
+	cmd.kind = kind;
+	return true;
+}
+
+/**
+ * Where a viewer's camera is, as it's moved around by @c viewcommand s. The
+ * up direction given to it stays fixed, as the axis yaw turns around, so
+ * the camera never rolls.
+ */
+class viewstate {
+private:
+
+	/**
+	 * The camera it started with.
+	 */
+	mvector<double, 3> homePosition, homeLookat, homeUp;
+
+	/**
+	 * The camera now.
+	 */
+	mvector<double, 3> position, lookat, up;
+
+	/**
+	 * Rotates a vector around a unit axis.
+	 *
+	 * @param v The vector.
+	 * @param axis The axis, of length 1.
+	 * @param degrees The angle, counterclockwise looking down the axis.
+	 *
+	 * @return The rotated vector.
+	 */
+	static mvector<double, 3> rotate(const mvector<double, 3> &v,
+			const mvector<double, 3> &axis, double degrees) {
+		double a = degrees * M_PI / 180, c = std::cos(a), s = std::sin(a);
+		return c * v + s * (axis % v) + ((1 - c) * (axis * v)) * axis;
+	}
+
+	/**
+	 * Pitches and then yaws an offset from a pivot, stopping the pitch
+	 * @c VIEW_PITCH_LIMIT degrees short of the up direction.
+	 *
+	 * @param offset The offset, which isn't along the up direction.
+	 * @param yaw Degrees clockwise looking down from above.
+	 * @param pitch Degrees toward the up direction.
+	 *
+	 * @return The turned offset.
+	 */
+	mvector<double, 3> swing(const mvector<double, 3> &offset, double yaw,
+			double pitch) const {
+		mvector<double, 3> u = up.norm();
+		double now = std::asin(std::max(-1.0, std::min(1.0,
+				offset * u / offset.mag()))) * 180 / M_PI;
+		double limit = 90 - VIEW_PITCH_LIMIT;
+		pitch = std::max(-limit - now, std::min(limit - now, pitch));
+		mvector<double, 3> turned = rotate(offset, (offset % u).norm(),
+				pitch);
+		return rotate(turned, u, -yaw);
+	}
+
+public:
+
+	/**
+	 * Starts the camera somewhere.
+	 *
+	 * @param position Center of the camera.
+	 * @param lookat Point it looks at, which is also the point it orbits
+	 *   and zooms toward.
+	 * @param up Up direction, which isn't along the direction looked in.
+	 */
+	viewstate(const mvector<double, 3> &position,
+			const mvector<double, 3> &lookat, const mvector<double, 3> &up) :
+			homePosition(position), homeLookat(lookat), homeUp(up),
+			position(position), lookat(lookat), up(up) { }
+
+	/**
+	 * Applies a command to the camera.
+	 *
+	 * @param cmd The command.
+	 *
+	 * @return @c true if the camera moved.
+	 */
+	bool apply(const viewcommand &cmd) {
+		mvector<double, 3> forward = lookat - position;
+		mvector<double, 3> right = (forward % up).norm();
+		mvector<double, 3> camUp = (right % forward).norm();
+		const mvector<double, 3> &a = cmd.args[0];
+		switch (cmd.kind) {
+		case VIEW_MOVE: {
+			mvector<double, 3> d = a[0] * right + a[1] * camUp +
+					a[2] * forward.norm();
+			position += d;
+			lookat += d;
+			return a.magsq() > 0;
+		}
+		case VIEW_TURN:
+			if (a[0] == 0 && a[1] == 0)
+				return false;
+			lookat = position + swing(forward, a[0], a[1]);
+			return true;
+		case VIEW_ORBIT:
+			if (a[0] == 0 && a[1] == 0)
+				return false;
+			// Turning the camera's offset from the point counterclockwise
+			// from above moves it to its right.
+			position = lookat + swing(-forward, -a[0], a[1]);
+			return true;
+		case VIEW_ZOOM:
+			position = lookat - forward / a[0];
+			return a[0] != 1;
+		case VIEW_CAMERA:
+			if ((cmd.args[1] - cmd.args[0]).magsq() == 0 ||
+					((cmd.args[1] - cmd.args[0]) % cmd.args[2]).magsq() == 0)
+				return false;
+			position = cmd.args[0];
+			lookat = cmd.args[1];
+			up = cmd.args[2];
+			return true;
+		case VIEW_RESET:
+			position = homePosition;
+			lookat = homeLookat;
+			up = homeUp;
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	/**
+	 * Getter for the position.
+	 *
+	 * @return Center of the camera.
+	 */
+	const mvector<double, 3>& getPosition() const {
+		return position;
+	}
+
+	/**
+	 * Getter for the point looked at.
+	 *
+	 * @return The point the camera is aimed at.
+	 */
+	const mvector<double, 3>& getLookat() const {
+		return lookat;
+	}
+
+	/**
+	 * Getter for the up direction.
+	 *
+	 * @return The up direction given to the camera.
+	 */
+	const mvector<double, 3>& getUp() const {
+		return up;
+	}
+};
+
+#endif // VIEWCOMMAND_HH
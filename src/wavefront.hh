@@ -0,0 +1,323 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "ray.hh"
+#include "rgbcolor.hh"
+#include "aabb.hh"
+#include "hitrecord.hh"
+#include <algorithm>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#ifndef WAVEFRONT_HH
+#define WAVEFRONT_HH
+
+/**
+ * Largest number of queued shadow rays @c scene::shadeWavefront holds before
+ * it traces them, which bounds the memory the shadow queue takes no matter
+ * how many lights there are.
+ */
+#define WAVEFRONT_MAX_SHADOW_RAYS 65536
+
+/**
+ * Bits of the Morton code of a ray's origin used by @c coherentOrder . They
+ * are split evenly between the dimensions.
+ */
+#define WAVEFRONT_MORTON_BITS 30
+
+/**
+ * A ray of the reflection queue of a wavefront render, which still has to
+ * be traced and shaded.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+struct wavefrontpath {
+
+	/**
+	 * The ray.
+	 */
+	ray<vec_T, time_T, dim> r;
+
+	/**
+	 * Product of the reflectivities along the way from the camera, by which
+	 * everything this ray sees is scaled.
+	 */
+	color_T weight;
+
+	/**
+	 * Index of the pixel the ray belongs to.
+	 */
+	int pixel;
+
+	/**
+	 * Reflection depth of the ray, 1 for the first reflection.
+	 */
+	int depth;
+};
+
+/**
+ * A ray of the shadow queue of a wavefront render. If nothing blocks it,
+ * its color is added to its pixel.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+struct shadowquery {
+
+	/**
+	 * The ray towards the light.
+	 */
+	ray<vec_T, time_T, dim> r;
+
+	/**
+	 * Time at which the ray reaches the light.
+	 */
+	time_T tmax;
+
+	/**
+	 * Shadow cache slot of the light.
+	 */
+	int slot;
+
+	/**
+	 * Index of the pixel the ray belongs to.
+	 */
+	int pixel;
+
+	/**
+	 * What the light adds to the pixel, already scaled by the weight of the
+	 * path.
+	 */
+	rgbcolor<color_T> color;
+};
+
+/**
+ * Finds an order of a queue of rays in which neighboring rays start close to
+ * each other and point into the same octant, so that tracing them in that
+ * order touches the same parts of the acceleration structure one after the
+ * other. Rays are sorted by their direction's octant, then by the Morton
+ * code of their origin within the box around all the origins.
+ *
+ * @tparam item_T Queue entry template with a ray member @c r , like
+ *   @c wavefrontpath and @c shadowquery .
+ *
+ * @param items The queue.
+ * @param[out] order Receives the indices into @c items in the new order.
+ * @param keys Scratch array for the sort keys, reused between calls.
+ */
+template<template<typename, typename, typename, int> class item_T,
+		typename vec_T, typename color_T, typename time_T, int dim>
+void coherentOrder(
+		const std::vector<item_T<vec_T, color_T, time_T, dim> > &items,
+		std::vector<int> &order,
+		std::vector<std::pair<unsigned long long, int> > &keys) {
+	const int bits = WAVEFRONT_MORTON_BITS / dim;
+	const double scale = (double) ((1u << bits) - 1);
+
+	aabb<vec_T, dim> box;
+	for (size_t i = 0; i < items.size(); i++)
+		box.extend(items[i].r.getOrig());
+	mvector<vec_T, dim> d = box.diagonal();
+
+	keys.resize(items.size());
+	for (size_t i = 0; i < items.size(); i++) {
+		const ray<vec_T, time_T, dim> &r = items[i].r;
+		unsigned long long octant = 0, code = 0;
+		for (int a = 0; a < dim; a++) {
+			if (r.getDir()[a] < 0)
+				octant |= 1ull << a;
+			double x = d[a] > 0 ?
+					(r.getOrig()[a] - box.getMin()[a]) / d[a] : 0;
+			unsigned long long q = (unsigned long long) (x * scale);
+			for (int b = 0; b < bits; b++)
+				code |= ((q >> b) & 1ull) << (b * dim + a);
+		}
+		keys[i] = std::make_pair((octant << WAVEFRONT_MORTON_BITS) | code,
+				(int) i);
+	}
+	std::sort(keys.begin(), keys.end());
+	order.resize(items.size());
+	for (size_t i = 0; i < keys.size(); i++)
+		order[i] = keys[i].second;
+}
+
+/**
+ * Like the other @c coherentOrder , with a scratch array of its own.
+ *
+ * @param items The queue.
+ * @param[out] order Receives the indices into @c items in the new order.
+ */
+template<template<typename, typename, typename, int> class item_T,
+		typename vec_T, typename color_T, typename time_T, int dim>
+void coherentOrder(
+		const std::vector<item_T<vec_T, color_T, time_T, dim> > &items,
+		std::vector<int> &order) {
+	std::vector<std::pair<unsigned long long, int> > keys;
+	coherentOrder(items, order, keys);
+}
+
+/**
+ * The queues and scratch arrays one thread of a wavefront render works
+ * with, kept from band to band and from pass to pass so that, once they
+ * have grown to what the scene needs, rendering doesn't allocate. Nothing
+ * is ever shrunk; emptying a queue keeps its memory. The most each queue
+ * held is recorded, along with how many bands had to grow one, which is 0
+ * in the steady state.
+ *
+ * @tparam vec_T The type of the vector components.
+ * @tparam color_T The type of the @c rgbcolor.
+ * @tparam time_T The type of the time.
+ * @tparam dim The number of dimensions, which is likely 3.
+ */
+template<typename vec_T, typename color_T, typename time_T, int dim>
+struct wavefrontpool {
+
+	/**
+	 * The shadow queue.
+	 */
+	std::vector<shadowquery<vec_T, color_T, time_T, dim> > shadows;
+
+	/**
+	 * The reflection queue of the current depth and of the next one.
+	 */
+	std::vector<wavefrontpath<vec_T, color_T, time_T, dim> > paths, next;
+
+	/**
+	 * The rays of the reflection queue and their hits.
+	 */
+	std::vector<ray<vec_T, time_T, dim> > rays;
+	std::vector<hitrecord<vec_T, color_T, time_T, dim> > recs;
+
+	/**
+	 * Scratch arrays of @c coherentOrder and the shadow queue.
+	 */
+	std::vector<int> order;
+	std::vector<std::pair<unsigned long long, int> > keys;
+	std::vector<char> blocked;
+	std::vector<int> starts;
+
+	/**
+	 * Scratch arrays of the batch query of the acceleration structure.
+	 */
+	std::vector<int> ids;
+	std::vector<time_T> times;
+
+	/**
+	 * Most shadow rays and reflection rays queued at once.
+	 */
+	size_t shadowPeak, pathPeak;
+
+	/**
+	 * Number of bands shaded with this pool, and of those during which a
+	 * queue or array had to grow.
+	 */
+	unsigned long bands, grownBands;
+
+	/**
+	 * Bytes held by the queues and arrays when the current band began.
+	 */
+	size_t heldAtBegin;
+
+	/**
+	 * Constructs an empty pool.
+	 */
+	wavefrontpool() : shadowPeak(0), pathPeak(0), bands(0), grownBands(0),
+			heldAtBegin(0) { }
+
+	/**
+	 * Gets the bytes held by the queues and arrays, used or not.
+	 *
+	 * @return Memory footprint in bytes.
+	 */
+	size_t getMemoryUsage() const {
+		return shadows.capacity() * sizeof(shadows[0]) +
+				(paths.capacity() + next.capacity()) * sizeof(paths[0]) +
+				rays.capacity() * sizeof(rays[0]) +
+				recs.capacity() * sizeof(recs[0]) +
+				(order.capacity() + ids.capacity() + starts.capacity()) *
+				sizeof(int) +
+				keys.capacity() * sizeof(keys[0]) + blocked.capacity() +
+				times.capacity() * sizeof(time_T);
+	}
+
+	/**
+	 * Makes every queue and array of this pool hold at least as much as
+	 * the same one of another pool without growing, e.g. before a pass,
+	 * so that whichever thread gets the biggest band next is ready for it.
+	 *
+	 * @param other The other pool.
+	 */
+	void reserveLike(const wavefrontpool &other) {
+		shadows.reserve(other.shadows.capacity());
+		paths.reserve(other.paths.capacity());
+		next.reserve(other.next.capacity());
+		rays.reserve(other.rays.capacity());
+		recs.reserve(other.recs.capacity());
+		order.reserve(other.order.capacity());
+		keys.reserve(other.keys.capacity());
+		blocked.reserve(other.blocked.capacity());
+		starts.reserve(other.starts.capacity());
+		ids.reserve(other.ids.capacity());
+		times.reserve(other.times.capacity());
+	}
+
+	/**
+	 * Starts a band.
+	 */
+	void beginBand() {
+		heldAtBegin = getMemoryUsage();
+	}
+
+	/**
+	 * Notes the sizes of the queues, after anything is added to them.
+	 */
+	void noteQueues() {
+		shadowPeak = std::max(shadowPeak, shadows.size());
+		pathPeak = std::max(pathPeak, std::max(paths.size(), next.size()));
+	}
+
+	/**
+	 * Ends a band, counting it as grown if anything was allocated.
+	 */
+	void endBand() {
+		bands++;
+		if (getMemoryUsage() != heldAtBegin)
+			grownBands++;
+	}
+
+	/**
+	 * Adds the counts of another pool to this one, keeping the larger
+	 * peaks.
+	 *
+	 * @param other The other pool.
+	 */
+	void mergeStats(const wavefrontpool &other) {
+		shadowPeak = std::max(shadowPeak, other.shadowPeak);
+		pathPeak = std::max(pathPeak, other.pathPeak);
+		bands += other.bands;
+		grownBands += other.grownBands;
+	}
+
+	/**
+	 * Prints the peaks and the growth count on one line.
+	 *
+	 * @param os The output stream to which to write.
+	 */
+	void printStats(std::ostream &os) const {
+		os << "wavefront pools: at most " << shadowPeak <<
+				" shadow rays and " << pathPeak << " reflection rays queued, "
+				<< grownBands << " of " << bands << " bands grew a pool";
+	}
+};
+
+#endif // WAVEFRONT_HH
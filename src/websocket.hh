@@ -0,0 +1,262 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "netchannel.hh"
+#include "boost/cstdint.hpp"
+#include <algorithm>
+#include <cctype>
+#include <string>
+
+#ifndef WEBSOCKET_HH
+#define WEBSOCKET_HH
+
+/**
+ * The string a server appends to a client's key to answer a WebSocket
+ * handshake, from RFC 6455.
+ */
+#define WEBSOCKET_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+/**
+ * Longest handshake request read before giving up on the client.
+ */
+#define WEBSOCKET_MAX_REQUEST 8192
+
+/**
+ * Opcode of a WebSocket frame of binary data.
+ */
+#define WEBSOCKET_BINARY 0x2
+
+/**
+ * Opcode of a WebSocket frame that closes the connection.
+ */
+#define WEBSOCKET_CLOSE 0x8
+
+/**
+ * Rotates a 32 bit number left.
+ *
+ * @param v The number.
+ * @param n Bits to rotate by, 1 through 31.
+ *
+ * @return The rotated number.
+ */
+inline boost::uint32_t rotateLeft(boost::uint32_t v, int n) {
+	return v << n | v >> (32 - n);
+}
+
+/**
+ * Hashes bytes with SHA-1, which the WebSocket handshake needs; it's not
+ * used for anything that has to be secure.
+ *
+ * @param message The bytes.
+ *
+ * @return The 20 bytes of the digest.
+ */
+inline std::string sha1(const std::string &message) {
+	boost::uint32_t h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe,
+			0x10325476, 0xc3d2e1f0 };
+	std::string m = message;
+	boost::uint64_t bits = (boost::uint64_t) message.size() * 8;
+	m += (char) 0x80;
+	while (m.size() % 64 != 56)
+		m += '\0';
+	for (int s = 56; s >= 0; s -= 8)
+		m += (char) ((bits >> s) & 0xff);
+	for (size_t c = 0; c < m.size(); c += 64) {
+		boost::uint32_t w[80];
+		for (int i = 0; i < 16; i++) {
+			w[i] = 0;
+			for (int b = 0; b < 4; b++)
+				w[i] = w[i] << 8 | (unsigned char) m[c + 4 * i + b];
+		}
+		for (int i = 16; i < 80; i++)
+			w[i] = rotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+		boost::uint32_t a = h[0], b = h[1], d = h[3], e = h[4], x = h[2];
+		for (int i = 0; i < 80; i++) {
+			boost::uint32_t f, k;
+			if (i < 20) {
+				f = (b & x) | (~b & d);
+				k = 0x5a827999;
+			}
+			else if (i < 40) {
+				f = b ^ x ^ d;
+				k = 0x6ed9eba1;
+			}
+			else if (i < 60) {
+				f = (b & x) | (b & d) | (x & d);
+				k = 0x8f1bbcdc;
+			}
+			else {
+				f = b ^ x ^ d;
+				k = 0xca62c1d6;
+			}
+			boost::uint32_t t = rotateLeft(a, 5) + f + e + k + w[i];
+			e = d;
+			d = x;
+			x = rotateLeft(b, 30);
+			b = a;
+			a = t;
+		}
+		h[0] += a;
+		h[1] += b;
+		h[2] += x;
+		h[3] += d;
+		h[4] += e;
+	}
+	std::string digest;
+	for (int i = 0; i < 5; i++)
+		for (int s = 24; s >= 0; s -= 8)
+			digest += (char) ((h[i] >> s) & 0xff);
+	return digest;
+}
+
+/**
+ * Encodes bytes in base64 with padding.
+ *
+ * @param bytes The bytes.
+ *
+ * @return The text.
+ */
+inline std::string base64(const std::string &bytes) {
+	static const char digits[] =
+			"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string out;
+	for (size_t i = 0; i < bytes.size(); i += 3) {
+		boost::uint32_t v = 0;
+		int n = (int) std::min((size_t) 3, bytes.size() - i);
+		for (int j = 0; j < 3; j++)
+			v = v << 8 | (j < n ? (unsigned char) bytes[i + j] : 0);
+		for (int j = 0; j < 4; j++)
+			out += j <= n ? digits[(v >> (18 - 6 * j)) & 0x3f] : '=';
+	}
+	return out;
+}
+
+/**
+ * Works out the @c Sec-WebSocket-Accept answer to a client's key.
+ *
+ * @param key The @c Sec-WebSocket-Key of the request.
+ *
+ * @return The answer.
+ */
+inline std::string webSocketAccept(const std::string &key) {
+	return base64(sha1(key + WEBSOCKET_GUID));
+}
+
+/**
+ * Makes a WebSocket frame from the server, which isn't masked, holding a
+ * whole message.
+ *
+ * @param payload The message.
+ * @param opcode @c WEBSOCKET_BINARY or @c WEBSOCKET_CLOSE .
+ *
+ * @return The bytes of the frame.
+ */
+inline std::string webSocketFrame(const std::string &payload,
+		int opcode = WEBSOCKET_BINARY) {
+	std::string frame;
+	frame += (char) (0x80 | opcode); // the final frame of the message
+	boost::uint64_t size = payload.size();
+	if (size < 126)
+		frame += (char) size;
+	else if (size < 0x10000) {
+		frame += (char) 126;
+		frame += (char) (size >> 8);
+		frame += (char) (size & 0xff);
+	}
+	else {
+		frame += (char) 127;
+		for (int s = 56; s >= 0; s -= 8)
+			frame += (char) ((size >> s) & 0xff);
+	}
+	return frame + payload;
+}
+
+/**
+ * Finds a header field of an HTTP request, whose name is matched without
+ * regard to case.
+ *
+ * @param request The request, lines ending in CR LF.
+ * @param name The name of the field.
+ * @param[out] value Receives the value, without the spaces around it.
+ *
+ * @return @c false if there's no such field.
+ */
+inline bool findHttpHeader(const std::string &request,
+		const std::string &name, std::string &value) {
+	for (size_t at = request.find("\r\n"); at != std::string::npos;
+			at = request.find("\r\n", at + 2)) {
+		size_t begin = at + 2, colon = request.find(':', begin);
+		size_t end = request.find("\r\n", begin);
+		if (colon == std::string::npos || colon > end ||
+				colon - begin != name.size())
+			continue;
+		bool same = true;
+		for (size_t i = 0; i < name.size() && same; i++)
+			same = std::tolower((unsigned char) request[begin + i]) ==
+					std::tolower((unsigned char) name[i]);
+		if (!same)
+			continue;
+		size_t v0 = request.find_first_not_of(' ', colon + 1);
+		size_t v1 = request.find_last_not_of(' ', end - 1);
+		value = v0 > v1 ? "" : request.substr(v0, v1 - v0 + 1);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Reads the HTTP request a client opens a WebSocket with and answers it,
+ * so frames can be sent with @c sendWebSocket from then on.
+ *
+ * @param channel The accepted connection.
+ * @param[out] error Receives what went wrong.
+ *
+ * @return @c false if the request wasn't a WebSocket handshake.
+ */
+inline bool acceptWebSocket(netchannel &channel, std::string &error) {
+	std::string request;
+	char c;
+	while (request.size() < 4 ||
+			request.compare(request.size() - 4, 4, "\r\n\r\n") != 0) {
+		if (request.size() >= WEBSOCKET_MAX_REQUEST ||
+				!channel.receiveAll(&c, 1)) {
+			error = "no complete WebSocket request";
+			return false;
+		}
+		request += c;
+	}
+	std::string key;
+	if (!findHttpHeader(request, "Sec-WebSocket-Key", key) || key.empty()) {
+		std::string refusal("HTTP/1.1 400 Bad Request\r\n\r\n");
+		channel.sendAll(refusal.data(), refusal.size());
+		error = "not a WebSocket request";
+		return false;
+	}
+	std::string answer = "HTTP/1.1 101 Switching Protocols\r\n"
+			"Upgrade: websocket\r\nConnection: Upgrade\r\n"
+			"Sec-WebSocket-Accept: " + webSocketAccept(key) + "\r\n\r\n";
+	if (!channel.sendAll(answer.data(), answer.size())) {
+		error = "the client went away";
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Sends a message to a WebSocket client as one frame.
+ *
+ * @param channel The connection, after @c acceptWebSocket .
+ * @param payload The message.
+ * @param opcode @c WEBSOCKET_BINARY or @c WEBSOCKET_CLOSE .
+ *
+ * @return @c false if the connection is closed or broken.
+ */
+inline bool sendWebSocket(netchannel &channel, const std::string &payload,
+		int opcode = WEBSOCKET_BINARY) {
+	std::string frame = webSocketFrame(payload, opcode);
+	return channel.sendAll(frame.data(), frame.size());
+}
+
+#endif // WEBSOCKET_HH
@@ -0,0 +1,210 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "boost/noncopyable.hpp"
+#include "boost/thread/thread.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include <cassert>
+#include <deque>
+
+#ifndef WRITEQUEUE_HH
+#define WRITEQUEUE_HH
+
+/**
+ * Runs jobs that write finished images, in the order they're pushed, on a
+ * thread of its own, so the next image can render while the last ones are
+ * encoded and written. At most a given number of jobs are waiting or
+ * running at once; @c push waits for the writer past that, which bounds
+ * the images held for it. A job that fails doesn't stop the ones after
+ * it, but makes @c push and @c finish return @c false .
+ *
+ * @tparam job_T Copyable functor with a @code bool operator()() @endcode
+ *   that writes one image and returns @c false if it couldn't. It runs on
+ *   the writer thread and must report its own errors.
+ */
+template<typename job_T>
+class writequeue : private boost::noncopyable {
+private:
+
+	/**
+	 * Functor of the writer thread.
+	 */
+	struct runner {
+		writequeue *queue;
+
+		void operator()() const {
+			queue->run();
+		}
+	};
+
+	/**
+	 * Jobs pushed and not yet started, oldest first.
+	 */
+	std::deque<job_T> jobs;
+
+	/**
+	 * Most jobs waiting or running at once.
+	 */
+	int depth;
+
+	/**
+	 * Jobs waiting or running.
+	 */
+	int pending;
+
+	/**
+	 * Whether @c finish has been called, so the writer quits once the jobs
+	 * run out.
+	 */
+	bool closing;
+
+	/**
+	 * Whether a job has failed.
+	 */
+	bool failed;
+
+	/**
+	 * Number of jobs that have run.
+	 */
+	unsigned long written;
+
+	/**
+	 * Number of calls to @c push that had to wait for the writer.
+	 */
+	unsigned long stalls;
+
+	/**
+	 * Guards everything above.
+	 */
+	boost::mutex lock;
+
+	/**
+	 * Signaled when a job is pushed or finishes, or when closing.
+	 */
+	boost::condition_variable changed;
+
+	/**
+	 * The writer thread.
+	 */
+	boost::thread writer;
+
+	/**
+	 * Body of the writer thread: runs jobs until closing and out of jobs.
+	 */
+	void run() {
+		boost::unique_lock<boost::mutex> guard(lock);
+		for (;;) {
+			while (jobs.empty() && !closing)
+				changed.wait(guard);
+			if (jobs.empty())
+				return;
+			job_T job = jobs.front();
+			jobs.pop_front();
+			guard.unlock();
+			bool ok = job();
+			guard.lock();
+			failed = failed || !ok;
+			written++;
+			pending--;
+			changed.notify_all();
+		}
+	}
+
+public:
+
+	/**
+	 * Starts the writer thread.
+	 *
+	 * @param depth Most jobs waiting or running at once, at least 1. With
+	 *   1, one image is written while the next renders.
+	 */
+	explicit writequeue(int depth) : depth(depth), pending(0),
+			closing(false), failed(false), written(0), stalls(0) {
+		assert(depth > 0);
+		runner r;
+		r.queue = this;
+		writer = boost::thread(r);
+	}
+
+	/**
+	 * Waits for the jobs left, like @c finish .
+	 */
+	~writequeue() {
+		finish();
+	}
+
+	/**
+	 * Queues a job, first waiting for the writer if as many jobs as the
+	 * depth are waiting or running.
+	 *
+	 * @param job The job.
+	 *
+	 * @return @c false if a job has failed so far; the job is queued
+	 *   anyway.
+	 */
+	bool push(const job_T &job) {
+		boost::unique_lock<boost::mutex> guard(lock);
+		assert(!closing);
+		if (pending >= depth)
+			stalls++;
+		while (pending >= depth)
+			changed.wait(guard);
+		jobs.push_back(job);
+		pending++;
+		changed.notify_all();
+		return !failed;
+	}
+
+	/**
+	 * Waits for every job pushed to run, then stops the writer thread.
+	 * Nothing can be pushed afterwards.
+	 *
+	 * @return @c false if a job failed.
+	 */
+	bool finish() {
+		{
+			boost::lock_guard<boost::mutex> guard(lock);
+			closing = true;
+			changed.notify_all();
+		}
+		if (writer.joinable())
+			writer.join();
+		return !failed;
+	}
+
+	/**
+	 * Gets the most jobs waiting or running at once.
+	 *
+	 * @return The depth.
+	 */
+	int getDepth() const {
+		return depth;
+	}
+
+	/**
+	 * Gets the number of jobs that have run.
+	 *
+	 * @return The count so far.
+	 */
+	unsigned long getWritten() {
+		boost::lock_guard<boost::mutex> guard(lock);
+		return written;
+	}
+
+	/**
+	 * Gets the number of calls to @c push that had to wait for the writer,
+	 * i.e. how often rendering got ahead of writing by more than the
+	 * depth.
+	 *
+	 * @return The count so far.
+	 */
+	unsigned long getStalls() {
+		boost::lock_guard<boost::mutex> guard(lock);
+		return stalls;
+	}
+};
+
+#endif // WRITEQUEUE_HH
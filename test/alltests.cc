@@ -12,6 +12,30 @@
 #include "test_sphere.cc"
 #include "test_scene.cc"
 #include "test_arealight.cc"
+#include "test_bvh.cc"
+#include "test_aabb.cc"
+#include "test_cylinder.cc"
+#include "test_grid.cc"
+#include "test_lazybvh.cc"
+#include "test_instance.cc"
+#include "test_qbvh.cc"
+#include "test_lighttree.cc"
+#include "test_lightpack.cc"
+#include "test_shadowmap.cc"
+#include "test_spherepack.cc"
+#include "test_shapekind.cc"
+#include "test_arena.cc"
+#include "test_camera.cc"
+#include "test_parallel.cc"
+#include "test_tilequeue.cc"
+#include "test_png.cc"
+#include "test_framebuffer.cc"
+#include "test_mappedfile.cc"
+#include "test_tiledframebuffer.cc"
+#include "test_dynamicbvh.cc"
+#include "test_motion.cc"
+#include "test_resample.cc"
+#include "test_aov.cc"
 
 using namespace testing;
 
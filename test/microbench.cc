@@ -0,0 +1,287 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "ray.hh"
+#include "sphere.hh"
+#include "cylinder.hh"
+#include "infplane.hh"
+#include "camera.hh"
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Number of different inputs each kernel cycles through, so that the
+ * compiler can't fold the work away and the inputs stay in L1.
+ */
+#define MICRO_INPUTS 1024
+
+/**
+ * Seconds each kernel runs before it's timed, to warm up caches, branch
+ * predictors and the clock of the core.
+ */
+#define MICRO_WARMUP_SECONDS 0.05
+
+/**
+ * Seconds each timed sample should take at least, far above the resolution
+ * of the clock.
+ */
+#define MICRO_SAMPLE_SECONDS 0.01
+
+/**
+ * Number of timed samples of each kernel.
+ */
+#define MICRO_SAMPLES 15
+
+/**
+ * Receives a result of every call of a kernel so that it isn't optimized
+ * away.
+ */
+volatile double microSink;
+
+/**
+ * Gets the seconds since a time.
+ *
+ * @param start The time.
+ *
+ * @return The seconds.
+ */
+double secondsSince(const boost::posix_time::ptime &start) {
+	return (boost::posix_time::microsec_clock::universal_time() -
+			start).total_microseconds() * 1e-6;
+}
+
+/**
+ * Calls a kernel on the given number of inputs, cycling through them.
+ *
+ * @param kernel The kernel, with an @c operator()(int) that takes the
+ *   index of an input and returns something to sink.
+ * @param calls Number of calls.
+ *
+ * @return Seconds the calls took.
+ */
+template<typename kernel_T>
+double timeCalls(const kernel_T &kernel, long calls) {
+	double sum = 0;
+	boost::posix_time::ptime start =
+			boost::posix_time::microsec_clock::universal_time();
+	for (long i = 0; i < calls; i++)
+		sum += kernel((int) (i & (MICRO_INPUTS - 1)));
+	double seconds = secondsSince(start);
+	microSink = sum;
+	return seconds;
+}
+
+/**
+ * Times a kernel and prints a line of its nanoseconds per call: the
+ * median, the fastest, the mean and the standard deviation of
+ * @c MICRO_SAMPLES samples, after @c MICRO_WARMUP_SECONDS of warmup. The
+ * number of calls per sample is picked during the warmup so each takes
+ * about @c MICRO_SAMPLE_SECONDS .
+ *
+ * @param name Name of the kernel.
+ * @param precisionName Name of the scalar type.
+ * @param kernel The kernel; see @c timeCalls .
+ */
+template<typename kernel_T>
+void benchKernel(const string &name, const char *precisionName,
+		const kernel_T &kernel) {
+	long calls = MICRO_INPUTS;
+	double warm = 0;
+	while (warm < MICRO_WARMUP_SECONDS) {
+		double seconds = timeCalls(kernel, calls);
+		warm += seconds;
+		if (seconds < MICRO_SAMPLE_SECONDS)
+			calls *= 2;
+	}
+	vector<double> ns(MICRO_SAMPLES);
+	for (int i = 0; i < MICRO_SAMPLES; i++)
+		ns[i] = timeCalls(kernel, calls) * 1e9 / calls;
+	double mean = 0, var = 0;
+	for (int i = 0; i < MICRO_SAMPLES; i++)
+		mean += ns[i] / MICRO_SAMPLES;
+	for (int i = 0; i < MICRO_SAMPLES; i++)
+		var += (ns[i] - mean) * (ns[i] - mean) / (MICRO_SAMPLES - 1);
+	sort(ns.begin(), ns.end());
+	cout << left << setw(28) << name << setw(8) << precisionName << right <<
+			fixed << setprecision(3) << setw(10) << ns[MICRO_SAMPLES / 2] <<
+			setw(10) << ns[0] << setw(10) << mean << setw(10) << sqrt(var) <<
+			endl;
+}
+
+/**
+ * Random inputs of the kernels of one scalar type.
+ */
+template<typename T>
+struct microinputs {
+	vector<mvector<T, 3> > a, b;
+	vector<rgbcolor<T> > c, d;
+	vector<ray<T, T, 3> > rays;
+
+	microinputs() {
+		srand(7);
+		for (int i = 0; i < MICRO_INPUTS; i++) {
+			a.push_back(randomVector());
+			b.push_back(randomVector());
+			c.push_back(rgbcolor<T>(unit(), unit(), unit()));
+			d.push_back(rgbcolor<T>(unit(), unit(), unit()));
+			// Rays from around (0, 0, 5) toward the shapes, most of which hit.
+			mvector<T, 3> orig((T) 0, (T) 0, (T) 5);
+			rays.push_back(ray<T, T, 3>(orig + randomVector() * (T) 0.5,
+					mvector<T, 3>((T) 0, (T) 0, (T) -1) +
+					randomVector() * (T) 0.3));
+		}
+	}
+
+	static T unit() {
+		return (T) rand() / RAND_MAX;
+	}
+
+	static mvector<T, 3> randomVector() {
+		return mvector<T, 3>(2 * unit() - 1, 2 * unit() - 1, 2 * unit() - 1);
+	}
+};
+
+/*
+ * The kernels. Each takes the index of an input and returns something
+ * that depends on the whole result.
+ */
+
+template<typename T>
+struct dotKernel {
+	const microinputs<T> *in;
+	double operator()(int i) const {
+		return in->a[i] * in->b[i];
+	}
+};
+
+template<typename T>
+struct crossKernel {
+	const microinputs<T> *in;
+	double operator()(int i) const {
+		mvector<T, 3> v = in->a[i] % in->b[i];
+		return v[0] + v[1] + v[2];
+	}
+};
+
+template<typename T>
+struct normKernel {
+	const microinputs<T> *in;
+	double operator()(int i) const {
+		mvector<T, 3> v = in->a[i].norm();
+		return v[0] + v[1] + v[2];
+	}
+};
+
+template<typename T>
+struct projKernel {
+	const microinputs<T> *in;
+	double operator()(int i) const {
+		mvector<T, 3> v = in->a[i].proj(in->b[i]);
+		return v[0] + v[1] + v[2];
+	}
+};
+
+template<typename T>
+struct colorKernel {
+	const microinputs<T> *in;
+	double operator()(int i) const {
+		rgbcolor<T> c = in->c[i] * in->d[i] + in->c[i] * (T) 0.5 -
+				in->d[i] / (T) 3;
+		return c.getR() + c.getG() + c.getB();
+	}
+};
+
+template<typename T, typename shape_T>
+struct intersectionKernel {
+	const microinputs<T> *in;
+	const shape_T *shape;
+	double operator()(int i) const {
+		return shape->intersection(in->rays[i]);
+	}
+};
+
+template<typename T>
+struct sphereIntersectionsKernel {
+	const microinputs<T> *in;
+	const sphere<T, T, T, 3> *shape;
+	double operator()(int i) const {
+		T t1 = 0, t2 = 0;
+		int n = shape->getIntersections(in->rays[i], t1, t2);
+		return n + t1 + t2;
+	}
+};
+
+template<typename T>
+struct cameraKernel {
+	const camera<T, T, 3> *cam;
+	double operator()(int i) const {
+		ray<T, T, 3> r = cam->getRayForPixel(i & 31, i >> 5, 32, 32);
+		return r.getDir()[0] + r.getDir()[1];
+	}
+};
+
+/**
+ * Times every kernel with the given scalar type.
+ *
+ * @param precisionName Name of the type.
+ */
+template<typename T>
+void benchPrecision(const char *precisionName) {
+	microinputs<T> in;
+	rgbcolor<T> white((T) 1, (T) 1, (T) 1);
+	sphere<T, T, T, 3> ball(white, (T) 1, mvector<T, 3>((T) 0, (T) 0,
+			(T) 0));
+	cylinder<T, T, T> can(white, (T) 0.8, mvector<T, 3>((T) 0, (T) 0,
+			(T) 0), (T) 2, mvector<T, 3>((T) 0, (T) 1, (T) 0));
+	infplane<T, T, T, 3> floor(white, (T) 1, mvector<T, 3>((T) 0, (T) 0.2,
+			(T) 1));
+	camera<T, T, 3> cam(mvector<T, 3>((T) -3, (T) 2, (T) 5), mvector<T, 3>(),
+			mvector<T, 3>((T) 0, (T) 1, (T) 0));
+
+	dotKernel<T> dot = { &in };
+	benchKernel("mvector dot", precisionName, dot);
+	crossKernel<T> cross = { &in };
+	benchKernel("mvector cross", precisionName, cross);
+	normKernel<T> norm = { &in };
+	benchKernel("mvector norm", precisionName, norm);
+	projKernel<T> proj = { &in };
+	benchKernel("mvector proj", precisionName, proj);
+	colorKernel<T> color = { &in };
+	benchKernel("rgbcolor arithmetic", precisionName, color);
+	sphereIntersectionsKernel<T> sphereHits = { &in, &ball };
+	benchKernel("sphere getIntersections", precisionName, sphereHits);
+	intersectionKernel<T, cylinder<T, T, T> > canHit = { &in, &can };
+	benchKernel("cylinder intersection", precisionName, canHit);
+	intersectionKernel<T, infplane<T, T, T, 3> > floorHit = { &in, &floor };
+	benchKernel("infplane intersection", precisionName, floorHit);
+	cameraKernel<T> rays = { &cam };
+	benchKernel("camera getRayForPixel", precisionName, rays);
+}
+
+/**
+ * Times the math and intersection kernels the renderer is built of, each in
+ * isolation and in double and float, and prints a table of nanoseconds per
+ * call. It's built with the same flags as @c rt , so that its numbers are
+ * those of the kernels @c rt runs, e.g. with @code make microbench
+ * CPP_FLAGS=-O2 && ./microbench @endcode
+ */
+int main() {
+	cout << left << setw(28) << "kernel" << setw(8) << "type" << right <<
+			setw(10) << "median" << setw(10) << "min" << setw(10) << "mean" <<
+			setw(10) << "stddev" << "   (ns per call)" << endl;
+	benchPrecision<double>("double");
+	benchPrecision<float>("float");
+	return 0;
+}
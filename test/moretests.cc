@@ -0,0 +1,46 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ *
+ * The test suites of scene loading and of everything built on it. They're
+ * compiled apart from those in @c alltests.cc because the two together
+ * take more memory to compile than many machines have.
+ */
+
+#include "gtest/gtest.h"
+#include "test_sceneparser.cc"
+#include "test_scenefile.cc"
+#include "test_lazygeometry.cc"
+#include "test_trianglemesh.cc"
+#include "test_rendercommand.cc"
+#include "test_animation.cc"
+#include "test_sceneedit.cc"
+#include "test_rasterimage.cc"
+#include "test_tilelease.cc"
+#include "test_netchannel.cc"
+#include "test_framecache.cc"
+#include "test_raystats.cc"
+#include "test_costmap.cc"
+#include "test_benchscenes.cc"
+#include "test_phasetimes.cc"
+#include "test_tracelog.cc"
+#include "test_perfcounters.cc"
+#include "test_writequeue.cc"
+#include "test_timebudget.cc"
+#include "test_viewcommand.cc"
+#include "test_checkpoint.cc"
+#include "test_fastmath.cc"
+#include "test_rtlib.cc"
+#include "test_renderscheduler.cc"
+#include "test_outofcore.cc"
+#include "test_denoiser.cc"
+#include "test_sampler.cc"
+#include "test_scenediff.cc"
+#include "test_shapeprofile.cc"
+#include "test_previewstream.cc"
+#include "test_compactspheres.cc"
+#include "test_autotune.cc"
+#include "test_materialtable.cc"
+#include "test_buildpipeline.cc"
+#include "test_processpool.cc"
+#include "test_metrics.cc"
@@ -0,0 +1,129 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "aabb.hh"
+#include "ray.hh"
+#include "mvector.hh"
+#include "gtest/gtest.h"
+#include <cstdlib>
+#include <iostream>
+
+#ifndef TEST_AABB_CC
+#define TEST_AABB_CC
+
+/**
+ * This test fixture class sets up a persistent box that we use below for
+ * testing. Note that an object of this class is created before each test case
+ * begins and is torn down when each test case ends.
+ */
+class aabbTest : public ::testing::Test {
+protected:
+
+	aabb3d a;
+
+	virtual void SetUp() {
+		a = aabb3d(vector3d(-1.0, 0.0, 2.0), vector3d(1.0, 3.0, 6.0));
+	}
+
+	virtual void TearDown() { }
+};
+
+/*
+ * A default constructed box is empty until something is added to it.
+ */
+TEST_F(aabbTest, EmptyAndExtend) {
+	aabb3d b;
+	ASSERT_TRUE(b.isEmpty());
+	ASSERT_DOUBLE_EQ(0, b.surfaceArea());
+	b.extend(vector3d(1.0, 2.0, 3.0));
+	ASSERT_FALSE(b.isEmpty());
+	ASSERT_DOUBLE_EQ(0, b.surfaceArea());
+	b.extend(a);
+	ASSERT_DOUBLE_EQ(-1, b.getMin()[0]);
+	ASSERT_DOUBLE_EQ(3, b.getMax()[1]);
+	ASSERT_DOUBLE_EQ(6, b.getMax()[2]);
+
+	// Extending with an empty box changes nothing.
+	b.extend(aabb3d());
+	ASSERT_DOUBLE_EQ(-1, b.getMin()[0]);
+	ASSERT_DOUBLE_EQ(2, b.getMin()[2]);
+}
+
+/*
+ * Exercises centroid, diagonal, longestAxis, and surfaceArea.
+ */
+TEST_F(aabbTest, Measurements) {
+	ASSERT_DOUBLE_EQ(0, a.centroid()[0]);
+	ASSERT_DOUBLE_EQ(1.5, a.centroid()[1]);
+	ASSERT_DOUBLE_EQ(4, a.centroid()[2]);
+	ASSERT_EQ(2, a.longestAxis());
+	ASSERT_DOUBLE_EQ(2 * (2 * 3 + 2 * 4 + 3 * 4), a.surfaceArea());
+}
+
+/*
+ * Exercises the slab test for hits, misses, and rays parallel to a face.
+ */
+TEST_F(aabbTest, Intersect) {
+	ray3d r(vector3d(0.0, 1.0, 0.0), vector3d(0.0, 0.0, 1.0));
+	vector3d inv(1 / r.getDir()[0], 1 / r.getDir()[1], 1 / r.getDir()[2]);
+	double tnear;
+	ASSERT_TRUE(a.intersect(r, inv, 0.0, 100.0, tnear));
+	ASSERT_DOUBLE_EQ(2, tnear);
+	// The box starts after the end of the interval.
+	ASSERT_FALSE(a.intersect(r, inv, 0.0, 1.5, tnear));
+
+	ray3d s(vector3d(0.0, 5.0, 0.0), vector3d(0.0, 0.0, 1.0));
+	ASSERT_FALSE(a.intersect(s, inv, 0.0, 100.0, tnear));
+
+	// Starting inside the box gives an entry time of tmin.
+	ray3d u(vector3d(0.0, 1.0, 3.0), vector3d(1.0, 1.0, 1.0));
+	vector3d invu(1 / u.getDir()[0], 1 / u.getDir()[1], 1 / u.getDir()[2]);
+	ASSERT_TRUE(a.intersect(u, invu, 0.0, 100.0, tnear));
+	ASSERT_DOUBLE_EQ(0, tnear);
+}
+
+/*
+ * The prepared ray picks the sides of the box by the signs of the
+ * direction and agrees with the slab test that swaps them.
+ */
+TEST_F(aabbTest, IntersectQuery) {
+	ray3d r(vector3d(0.0, 1.0, 10.0), vector3d(0.0, 0.0, -1.0));
+	rayquery3d q(r);
+	ASSERT_EQ(0, q.getSign(0));
+	ASSERT_EQ(0, q.getSign(1));
+	ASSERT_EQ(1, q.getSign(2));
+	ASSERT_DOUBLE_EQ(-1, q.getInvDir()[2]);
+	double tnear;
+	ASSERT_TRUE(a.intersect(q, tnear));
+	ASSERT_DOUBLE_EQ(4, tnear);
+	// The interval of an occlusion query ends before the box.
+	ASSERT_FALSE(a.intersect(rayquery3d(r, 0, 3.5), tnear));
+
+	srand(3);
+	for (int i = 0; i < 2000; i++) {
+		vector3d P(rand() % 13 - 6.0, rand() % 13 - 6.0, rand() % 13 - 3.0);
+		vector3d D(rand() % 5 - 2.0, rand() % 5 - 2.0, rand() % 5 - 2.0);
+		if (D.mag() == 0)
+			continue;
+		ray3d s(P, D);
+		vector3d inv(1 / s.getDir()[0], 1 / s.getDir()[1],
+				1 / s.getDir()[2]);
+		double t1 = -1, t2 = -1;
+		bool hit = a.intersect(s, inv, 0.0, 20.0, t1);
+		ASSERT_EQ(hit, a.intersect(rayquery3d(s, 0, 20), t2));
+		if (hit) {
+			ASSERT_EQ(t1, t2);
+		}
+	}
+}
+
+/*
+ * Exercises the << operator.
+ */
+TEST_F(aabbTest, Print) {
+	std::cout << std::endl << a << std::endl << std::endl;
+}
+
+#endif // TEST_AABB_CC
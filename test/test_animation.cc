@@ -0,0 +1,149 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "animation.hh"
+#include "sceneparser.hh"
+#include "scene.hh"
+#include "bvh.hh"
+#include "sphere.hh"
+#include "light.hh"
+#include "camera.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include "boost/shared_ptr.hpp"
+#include <string>
+#include <vector>
+
+#ifndef TEST_ANIMATION_CC
+#define TEST_ANIMATION_CC
+
+/*
+ * Objects start where they were made, move in straight lines between their
+ * keys and stay at their last ones.
+ */
+TEST(animation, Interpolates) {
+	boost::shared_ptr<sphere3d> ball(new sphere3d(rgbcolord(1, 0, 0), 1.0,
+			vector3d(0.0, 0.0, 0.0)));
+	sp_lightd lamp(new lightd(rgbcolord(1, 1, 1), vector3d(0.0, 5.0, 0.0)));
+	boost::shared_ptr<camera<double, double, 3> > cam(
+			new camera<double, double, 3>(vector3d(0.0, 0.0, 5.0),
+			vector3d(0.0, 0.0, 0.0), vector3d(0.0, 1.0, 0.0)));
+	animation3d anim;
+	ASSERT_TRUE(anim.empty());
+	ASSERT_TRUE(anim.addKey(RECORD_SPHERE, ball, 2, vector3d(2.0, 0.0, 0.0)));
+	ASSERT_TRUE(anim.addKey(RECORD_SPHERE, ball, 4, vector3d(2.0, 4.0, 0.0)));
+	ASSERT_FALSE(anim.addKey(RECORD_SPHERE, ball, 4,
+			vector3d(0.0, 0.0, 0.0)));
+	ASSERT_TRUE(anim.addKey(RECORD_LIGHT, lamp, 1, vector3d(0.0, 7.0, 0.0)));
+	ASSERT_TRUE(anim.addCameraKey(cam, vector3d(0.0, 0.0, 0.0),
+			vector3d(0.0, 1.0, 0.0), 2, vector3d(5.0, 0.0, 0.0)));
+	ASSERT_EQ(3, anim.getTrackCount());
+	ASSERT_TRUE(anim.movesShapes());
+	ASSERT_EQ(4, anim.getLastFrame());
+
+	anim.setFrame(1);
+	ASSERT_EQ(1, ball->getCenter()[0]);
+	ASSERT_EQ(0, ball->getCenter()[1]);
+	ASSERT_EQ(7, lamp->getPos()[1]);
+	ASSERT_EQ(2.5, cam->getPosition()[0]);
+	anim.setFrame(3);
+	ASSERT_EQ(2, ball->getCenter()[0]);
+	ASSERT_EQ(2, ball->getCenter()[1]);
+	anim.setFrame(9);
+	ASSERT_EQ(4, ball->getCenter()[1]);
+	ASSERT_EQ(7, lamp->getPos()[1]);
+	ASSERT_EQ(5, cam->getPosition()[0]);
+	anim.setFrame(0);
+	ASSERT_EQ(0, ball->getCenter()[0]);
+	ASSERT_EQ(0, ball->getCenter()[1]);
+	ASSERT_EQ(5, lamp->getPos()[1]);
+	ASSERT_EQ(5, cam->getPosition()[2]);
+}
+
+/*
+ * Renders the first camera of a scene description, with its objects moved
+ * to the given frame after the tree is built.
+ */
+static std::vector<rgbcolor<double> > renderAnimationFrame(
+		const std::string &text, double frame) {
+	scenetokenizer in(text.data(), text.data() + text.size());
+	scenedescription desc;
+	std::string error;
+	EXPECT_TRUE((parseScene<double, double>(in, "", desc, error))) << error;
+	scene3d sc(true);
+	sc.setAccelerator(sp_bvh3d(new bvh3d()));
+	boost::shared_ptr<camera<double, double, 3> > cam;
+	std::vector<scenecamera<double, double> > cameras;
+	animation3d anim;
+	EXPECT_TRUE(addSceneRecords(sc, &desc.records[0], desc.records.size(),
+			desc.paths, cam, error, &cameras, &anim)) << error;
+	sc.finalize();
+	anim.setFrame(frame);
+	sc.refit();
+	std::vector<rgbcolor<double> > image;
+	sc.renderImage(*cam, 24, 16, image);
+	return image;
+}
+
+/*
+ * A frame of keyed objects refit into the tree renders like a scene that
+ * has the objects there to begin with.
+ */
+TEST(animation, RefitMatchesRebuild) {
+	std::string keyed = "camera <0, 2, 8> <0, 0, 0> <0, 1, 0>\n"
+			"key 4 <2, 2, 8>\n"
+			"light (1, 1, 1) <0, 6, 4>\nkey 2 <-4, 6, 4>\n"
+			"sphere (1, 0, 0) 1 <-2, 1, 0> 0.25\nkey 4 <2, 1, 0>\n"
+			"sphere (0, 0, 1) 1 <0, 1, -2> 0\n"
+			"plane (1, 1, 1) 0 <0, 1, 0> 0\n";
+	std::string moved = "camera <1.5, 2, 8> <0, 0, 0> <0, 1, 0>\n"
+			"light (1, 1, 1) <-4, 6, 4>\n"
+			"sphere (1, 0, 0) 1 <1, 1, 0> 0.25\n"
+			"sphere (0, 0, 1) 1 <0, 1, -2> 0\n"
+			"plane (1, 1, 1) 0 <0, 1, 0> 0\n";
+	std::vector<rgbcolor<double> > a = renderAnimationFrame(keyed, 3);
+	std::vector<rgbcolor<double> > b = renderAnimationFrame(moved, 0);
+	ASSERT_EQ(a.size(), b.size());
+	for (size_t i = 0; i < a.size(); i++) {
+		ASSERT_EQ(b[i].getR(), a[i].getR()) << "pixel " << i;
+		ASSERT_EQ(b[i].getG(), a[i].getG()) << "pixel " << i;
+		ASSERT_EQ(b[i].getB(), a[i].getB()) << "pixel " << i;
+	}
+	std::vector<rgbcolor<double> > first = renderAnimationFrame(keyed, 0);
+	size_t differ = 0;
+	for (size_t i = 0; i < a.size(); i++)
+		differ += first[i].getR() != a[i].getR();
+	ASSERT_GT(differ, 0u);
+}
+
+/*
+ * Keys must follow an object that can move and come after its earlier
+ * keys.
+ */
+TEST(animation, ReportsKeyErrors) {
+	const char *cases[] = { "plane (1, 1, 1) 0 <0, 1, 0> 0\nkey 1 <0, 0, 0>\n",
+			"key 1 <0, 0, 0>\n",
+			"light (1, 1, 1) <0, 0, 0>\nkey 2 <1, 0, 0>\nkey 1 <2, 0, 0>\n" };
+	const char *errors[] = { "the key on line 2 doesn't follow a sphere, "
+			"cylinder, light, spotlight or camera.",
+			"the key on line 1 doesn't follow a sphere, cylinder, light, "
+			"spotlight or camera.",
+			"the key on line 3 isn't after the keys before it." };
+	for (int i = 0; i < 3; i++) {
+		std::string text = cases[i];
+		scenetokenizer in(text.data(), text.data() + text.size());
+		scenedescription desc;
+		std::string error;
+		ASSERT_TRUE((parseScene<double, double>(in, "", desc, error)));
+		scene3d sc(false);
+		boost::shared_ptr<camera<double, double, 3> > cam;
+		ASSERT_FALSE(addSceneRecords(sc, &desc.records[0],
+				desc.records.size(), desc.paths, cam, error));
+		ASSERT_EQ(errors[i], error);
+	}
+}
+
+#endif // TEST_ANIMATION_CC
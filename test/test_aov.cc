@@ -0,0 +1,108 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "aov.hh"
+#include "scene.hh"
+#include "camera.hh"
+#include "sphere.hh"
+#include "infplane.hh"
+#include "gtest/gtest.h"
+#include <vector>
+
+#ifndef TEST_AOV_CC
+#define TEST_AOV_CC
+
+/*
+ * Rendering an image can leave its G-buffer behind without changing the
+ * colors, and the raw variables made from it are the distances, normals
+ * and shape indices plus 1 of the hits, with misses black.
+ */
+TEST(aovTest, RawFromRender) {
+	scene3d sc(true);
+	rgbcolord col(0.5, 0.5, 0.5);
+	sc.addShape(sp_shape3d(new sphere3d(col, 0.8, vector3d(0.0, 1.0, 0.0))));
+	sc.addShape(sp_shape3d(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0))));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(1, 1, 1),
+			vector3d(2.0, 6.0, 3.0))));
+	sc.finalize();
+	camerad cam(vector3d(0.0, 3.0, 6.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	int width = 40, height = 30;
+
+	std::vector<rgbcolord> plain, image;
+	gbuffer3d gb;
+	sc.renderImage(cam, width, height, plain);
+	sc.renderImage(cam, width, height, image, 0, &gb);
+	ASSERT_EQ(width, gb.getWidth());
+	ASSERT_EQ(height, gb.getHeight());
+	for (size_t i = 0; i < image.size(); i++) {
+		ASSERT_EQ(plain[i].getR(), image[i].getR());
+		ASSERT_EQ(plain[i].getB(), image[i].getB());
+	}
+
+	std::vector<rgbcolord> depth, normal, id;
+	makeAOV(gb, AOV_DEPTH, false, depth);
+	makeAOV(gb, AOV_NORMAL, false, normal);
+	makeAOV(gb, AOV_ID, false, id);
+	int spheres = 0, misses = 0;
+	for (int i = 0; i < width * height; i++) {
+		const hitrecord3d &hit = gb.getHit(i);
+		if (hit.obj == 0) {
+			ASSERT_EQ(0, depth[i].getR());
+			ASSERT_EQ(0, normal[i].getG());
+			ASSERT_EQ(0, id[i].getB());
+			misses++;
+			continue;
+		}
+		ASSERT_NEAR((hit.point - vector3d(0.0, 3.0, 6.0)).mag(),
+				depth[i].getR(), 1e-9);
+		ASSERT_DOUBLE_EQ(hit.normal[1], normal[i].getG());
+		ASSERT_EQ(hit.id + 1, (int) id[i].getB());
+		if (hit.id == 0)
+			spheres++;
+	}
+	ASSERT_GT(spheres, 0);
+	ASSERT_EQ(1, (int) id[height / 2 * width + width / 2].getR());
+	ASSERT_GT(misses, 0);
+}
+
+/*
+ * The displayable variables fit in [0, 1]: the farthest depth is 1, and
+ * the sphere and plane get different colors.
+ */
+TEST(aovTest, Displayable) {
+	scene3d sc(true);
+	rgbcolord col(0.5, 0.5, 0.5);
+	sc.addShape(sp_shape3d(new sphere3d(col, 0.8, vector3d(0.0, 1.0, 0.0))));
+	sc.addShape(sp_shape3d(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0))));
+	sc.finalize();
+	camerad cam(vector3d(0.0, 3.0, 6.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	gbuffer3d gb;
+	sc.renderGBuffer(cam, 32, 24, gb);
+
+	for (int k = AOV_DEPTH; k <= AOV_ID; k++) {
+		std::vector<rgbcolord> image;
+		makeAOV(gb, (aovKind) k, true, image);
+		double most = 0;
+		for (size_t i = 0; i < image.size(); i++) {
+			ASSERT_GE(image[i].getR(), 0);
+			ASSERT_LE(image[i].getR(), 1);
+			ASSERT_GE(image[i].getG(), 0);
+			ASSERT_LE(image[i].getG(), 1);
+			most = std::max(most, image[i].getR());
+		}
+		if (k == AOV_DEPTH) {
+			ASSERT_DOUBLE_EQ(1, most);
+		}
+	}
+	std::vector<rgbcolord> id;
+	makeAOV(gb, AOV_ID, true, id);
+	const rgbcolord &sphere = id[12 * 32 + 16], &plane = id[23 * 32 + 16];
+	ASSERT_TRUE(sphere.getR() != plane.getR() ||
+			sphere.getG() != plane.getG() || sphere.getB() != plane.getB());
+}
+
+#endif // TEST_AOV_CC
@@ -48,4 +48,53 @@ TEST_F(arealightTest, Print) {
 	std::cout << *a << std::endl;
 }
 
+/*
+ * Samples must lie on the light's rectangle, be the same every time for the
+ * same shading point and spread out over the whole rectangle.
+ */
+TEST_F(arealightTest, SamplePos) {
+	vector3d p(0.3, 0.0, -0.2), q(0.3, 0.0, -0.21);
+	vector3d sum;
+	double umax = 0, vmax = 0;
+	for (int i = 0; i < 64; i++) {
+		vector3d s = a->getSamplePos(i, 64, p);
+		vector3d d = s - a->getPos();
+		ASSERT_NEAR(0, d * a->getNorm(), 1e-12);
+		ASSERT_LE(fabs(d * a->getUhat()), 0.3);
+		ASSERT_LE(fabs(d * a->getVhat()), 0.3);
+		umax = std::max(umax, fabs(d * a->getUhat()));
+		vmax = std::max(vmax, fabs(d * a->getVhat()));
+		sum += d;
+		vector3d again = a->getSamplePos(i, 64, p);
+		for (int j = 0; j < 3; j++)
+			ASSERT_EQ(s[j], again[j]);
+	}
+	ASSERT_GT(umax, 0.25);
+	ASSERT_GT(vmax, 0.25);
+	ASSERT_LT((sum / 64).mag(), 0.05);
+	ASSERT_GT((a->getSamplePos(0, 64, p) - a->getSamplePos(0, 64, q)).mag(),
+			1e-6);
+}
+
+/*
+ * The grid of point lights has as many lights, of the same color, in float
+ * as in double, whatever the rounding of the size over the spacing.
+ */
+TEST(arealight, FloatGridMatchesDouble) {
+	arealightd d(rgbcolord(0.9, 0.9, 0.9), vector3d(0.0, 2.0, 1.0),
+			vector3d(0.0, -1.0, 0.0), vector3d(1.0, 0.0, 0.0),
+			0.05, 0.05, 0.7, 0.7);
+	arealightf f(rgbcolorf(0.9f, 0.9f, 0.9f), vector3f(0.0f, 2.0f, 1.0f),
+			vector3f(0.0f, -1.0f, 0.0f), vector3f(1.0f, 0.0f, 0.0f),
+			0.05f, 0.05f, 0.7f, 0.7f);
+	ASSERT_EQ(225u, d.getLights().size());
+	ASSERT_EQ(d.getLights().size(), f.getLights().size());
+	ASSERT_NEAR(d.getLights()[0]->getColor().getR(),
+			f.getLights()[0]->getColor().getR(), 1e-6);
+	for (size_t i = 0; i < d.getLights().size(); i++)
+		for (int j = 0; j < 3; j++)
+			ASSERT_NEAR(d.getLights()[i]->getPos()[j],
+					f.getLights()[i]->getPos()[j], 1e-5);
+}
+
 #endif // TEST_AREALIGHT_CC
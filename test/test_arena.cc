@@ -0,0 +1,116 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "arena.hh"
+#include "hugepages.hh"
+#include "sphere.hh"
+#include "light.hh"
+#include "arealight.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include "boost/make_shared.hpp"
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#ifndef TEST_ARENA_CC
+#define TEST_ARENA_CC
+
+/*
+ * Allocations are aligned, packed into the blocks one after the other and
+ * too large ones get a block of their own.
+ */
+TEST(arena, Allocate) {
+	arena a(1024);
+	ASSERT_EQ(0, a.getBlockCount());
+	char *prev = 0;
+	for (int i = 0; i < 20; i++) {
+		size_t align = (size_t) 1 << (i % 6);
+		char *p = static_cast<char *>(a.allocate(24, align));
+		ASSERT_EQ(0u, (size_t) p % align);
+		if (prev != 0 && a.getBlockCount() == 1) {
+			ASSERT_GE(p, prev + 24);
+		}
+		prev = p;
+	}
+	ASSERT_EQ(1, a.getBlockCount());
+	ASSERT_EQ(20u * 24, a.getBytesAllocated());
+	char *big = static_cast<char *>(a.allocate(5000, 8));
+	ASSERT_EQ(2, a.getBlockCount());
+	char *next = static_cast<char *>(a.allocate(8, 8));
+	ASSERT_EQ(2, a.getBlockCount());
+	ASSERT_TRUE(next < big || next >= big + 5000);
+	a.allocate(800, 8);
+	ASSERT_EQ(3, a.getBlockCount());
+}
+
+/*
+ * Objects made with the allocator work like any others and keep the arena
+ * alive after its owner lets go of it.
+ */
+TEST(arena, SharedObjectsOutliveOwner) {
+	std::vector<sp_shape3d> shapes;
+	boost::weak_ptr<arena> weak;
+	{
+		sp_arena pool(new arena());
+		weak = pool;
+		for (int i = 0; i < 100; i++)
+			shapes.push_back(boost::allocate_shared<sphere3d>(
+					arenaallocator<sphere3d>(pool), rgbcolord(1, 0, 0), 1,
+					vector3d((double) i, 0.0, 0.0)));
+		ASSERT_EQ(1, pool->getBlockCount());
+		ASSERT_GE(pool->getBytesAllocated(), 100 * sizeof(sphere3d));
+	}
+	ASSERT_FALSE(weak.expired());
+	ray3d r(vector3d(50.0, 5.0, 0.0), vector3d(0.0, -1.0, 0.0));
+	ASSERT_DOUBLE_EQ(4, shapes[50]->intersection(r));
+	shapes.clear();
+	ASSERT_TRUE(weak.expired());
+}
+
+/*
+ * The point lights of an area light are made in an arena of theirs and have
+ * the colors that share out the area light's color.
+ */
+TEST(arena, AreaLightExpansion) {
+	arealightd al(rgbcolord(1, 1, 1), vector3d(0.0, 2.0, 0.0),
+			vector3d(0.0, -1.0, 0.0), vector3d(1.0, 0.0, 0.0), 0.25, 0.25, 1,
+			1);
+	const std::vector<sp_lightd> &lights = al.getLights();
+	ASSERT_EQ(25u, lights.size());
+	for (size_t i = 0; i < lights.size(); i++)
+		ASSERT_DOUBLE_EQ(1.0 / 16, lights[i]->getColor().getR());
+}
+
+/*
+ * With huge pages on, arenas take blocks of at least a huge page, which
+ * hold what they're given like any others whether the system had huge
+ * pages or not, and arrays get the room asked for.
+ */
+TEST(arena, HugePages) {
+	hugepages::setEnabled(true);
+	{
+		arena a(1024);
+		char *p = static_cast<char *>(a.allocate(3000, 64));
+		ASSERT_EQ(0u, (size_t) p % 64);
+		memset(p, 1, 3000);
+		ASSERT_EQ(1, a.getBlockCount());
+		char *big = static_cast<char *>(a.allocate(5 << 20, 16));
+		ASSERT_EQ(0u, (size_t) big % 16);
+		memset(big, 2, 5 << 20);
+		ASSERT_EQ(2, a.getBlockCount());
+		ASSERT_EQ(1, p[2999]);
+		ASSERT_EQ(2, big[(5 << 20) - 1]);
+	}
+	std::vector<int> v;
+	hugepages::reserve(v, 1 << 20);
+	ASSERT_GE(v.capacity(), (size_t) 1 << 20);
+	v.assign(1 << 20, 3);
+	ASSERT_EQ(3, v.back());
+	hugepages::setEnabled(false);
+}
+
+#endif // TEST_ARENA_CC
@@ -0,0 +1,199 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "autotune.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "infplane.hh"
+#include "light.hh"
+#include "arealight.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef TEST_AUTOTUNE_CC
+#define TEST_AUTOTUNE_CC
+
+/*
+ * A grid of spheres fills every cell it could, a clump of them in a corner
+ * of a big box only a few, and the reflectivities, lights and sizes are
+ * counted.
+ */
+TEST(autotune, SceneStats) {
+	scene3d even(true), clumped(true);
+	for (int i = 0; i < 64; i++) {
+		double x = i % 4, y = i / 4 % 4, z = i / 16;
+		even.addShape(sp_shape3d(new sphere3d(rgbcolord(1, 1, 1), 0.25,
+				vector3d(x, y, z), i % 2 ? 0.9f : 0.0f)));
+		clumped.addShape(sp_shape3d(new sphere3d(rgbcolord(1, 1, 1), 0.25,
+				vector3d(i % 4 * 0.01, 0.0, 0.0), 0.3f)));
+	}
+	clumped.addShape(sp_shape3d(new sphere3d(rgbcolord(1, 1, 1), 0.5,
+			vector3d(100.0, 100.0, 100.0), 0)));
+	even.addShape(sp_shape3d(new infplaned(rgbcolord(1, 1, 1), 1,
+			vector3d(0.0, 1.0, 0.0), 0)));
+	even.addPointLight(sp_lightd(new lightd(rgbcolord(1, 1, 1),
+			vector3d(0.0, 10.0, 0.0))));
+	sp_arealightd area(new arealightd(rgbcolord(1, 1, 1),
+			vector3d(0.0, 10.0, 0.0), vector3d(0.0, -1.0, 0.0),
+			vector3d(0.0, 0.0, 1.0), 1, 1, 2.5, 2.5));
+	even.addAreaLight(area);
+	even.finalize();
+	clumped.finalize();
+
+	scenestats stats;
+	gatherSceneStats(even, stats);
+	ASSERT_EQ(65u, stats.shapes);
+	ASSERT_EQ(64u, stats.bounded);
+	ASSERT_EQ(0u, stats.moving);
+	ASSERT_EQ(2u, stats.sourceLights);
+	ASSERT_EQ(1 + area->getLights().size(), stats.lights);
+	ASSERT_LT(2u, stats.lights);
+	ASSERT_EQ(33u, stats.reflectivity[0]);
+	ASSERT_EQ(32u, stats.reflectivity[AUTOTUNE_REFLECT_BINS - 1]);
+	ASSERT_EQ(32u, stats.getReflective());
+	ASSERT_DOUBLE_EQ(0.5, stats.smallest);
+	ASSERT_DOUBLE_EQ(3.25, stats.magnitude);
+	ASSERT_DOUBLE_EQ(1.0, stats.occupancy);
+
+	scenestats clump;
+	gatherSceneStats(clumped, clump);
+	ASSERT_EQ(65u, clump.bounded);
+	ASSERT_EQ(65u, clump.reflectivity[0] + clump.reflectivity[1] +
+			clump.reflectivity[2]);
+	ASSERT_LT(clump.occupancy, 0.1);
+
+	std::ostringstream os;
+	stats.print(os);
+	std::ostringstream expected;
+	expected << "auto: 65 shapes, 64 bounded, 0 moving, occupancy 1, " <<
+			stats.lights << " lights of 2, reflectivity 33 0 0 32\n";
+	ASSERT_EQ(expected.str(), os.str());
+}
+
+/*
+ * The statistics pick which accelerators and precisions are worth a probe
+ * and how to sample the lights.
+ */
+TEST(autotune, Choices) {
+	scenestats few;
+	few.shapes = few.bounded = 3;
+	few.lights = 2;
+	few.magnitude = 10;
+	few.smallest = 0.5;
+	few.occupancy = 1;
+	autotuner small(few);
+	std::vector<std::string> accels;
+	small.getAccelerators(accels);
+	ASSERT_EQ(3u, accels.size());
+	ASSERT_EQ("linear", accels[0]);
+	ASSERT_EQ("bvh", accels[1]);
+	ASSERT_EQ("qbvh8", accels[2]);
+	ASSERT_TRUE(small.isFloatSafe());
+	int picks;
+	double cutError;
+	small.getLightSampling(picks, cutError);
+	ASSERT_EQ(0, picks);
+	ASSERT_EQ(0, cutError);
+	ASSERT_EQ(0, small.getMinThroughput());
+
+	scenestats many = few;
+	many.shapes = many.bounded = 5000;
+	many.moving = 10;
+	many.lights = AUTOTUNE_PICK_LIGHTS;
+	many.magnitude = 1e6;
+	many.reflectivity[AUTOTUNE_REFLECT_BINS - 1] = 1;
+	autotuner big(many);
+	big.getAccelerators(accels);
+	ASSERT_EQ(4u, accels.size());
+	ASSERT_EQ("bvh", accels[0]);
+	ASSERT_EQ("grid", accels[2]);
+	ASSERT_EQ("motion", accels[3]);
+	ASSERT_FALSE(big.isFloatSafe());
+	big.getLightSampling(picks, cutError);
+	ASSERT_EQ(AUTOTUNE_LIGHT_PICKS, picks);
+	ASSERT_EQ(0, cutError);
+	ASSERT_DOUBLE_EQ(AUTOTUNE_MIN_THROUGHPUT, big.getMinThroughput());
+
+	many.lights = AUTOTUNE_CUT_LIGHTS;
+	many.occupancy = 0.1;
+	autotuner lit(many);
+	lit.getAccelerators(accels);
+	ASSERT_EQ(3u, accels.size());
+	lit.getLightSampling(picks, cutError);
+	ASSERT_EQ(0, picks);
+	ASSERT_DOUBLE_EQ(AUTOTUNE_CUT_ERROR, cutError);
+}
+
+/*
+ * The fastest setting for the image counts the build once and the render
+ * per pixel, and later settings must be clearly faster to win.
+ */
+TEST(autotune, Trials) {
+	int w, h;
+	autotuner::getProbeSize(32, 20, w, h);
+	ASSERT_EQ(32, w);
+	ASSERT_EQ(20, h);
+	autotuner::getProbeSize(1280, 720, w, h);
+	ASSERT_EQ(85, w);
+	ASSERT_EQ(48, h);
+	autotuner::getProbeSize(100000, 1, w, h);
+	ASSERT_EQ(1, h);
+
+	autotuner tuner((scenestats()));
+	ASSERT_EQ("", tuner.getFastest(100));
+	// A quick build that renders slowly, and a slow one that renders fast.
+	tuner.addTrial("bvh", 0.01, 1.0, 1000);
+	tuner.addTrial("qbvh8", 0.5, 0.5, 1000);
+	ASSERT_DOUBLE_EQ(0.01 + 0.1, tuner.estimate(0, 100));
+	ASSERT_EQ("bvh", tuner.getFastest(100));
+	ASSERT_EQ("qbvh8", tuner.getFastest(1000000));
+	// Within the margin the first one stays.
+	tuner.addTrial("grid", 0.01, 0.99, 1000);
+	ASSERT_EQ("bvh", tuner.getFastest(100));
+	std::ostringstream os;
+	tuner.printTrials(os, 1000);
+	ASSERT_EQ("auto: bvh 1.01 s qbvh8 1 s grid 1 s\n", os.str());
+	tuner.clearTrials();
+	ASSERT_EQ("", tuner.getFastest(100));
+}
+
+/*
+ * A setting whose probe is more than the tolerance off the exact one is
+ * never picked, however fast, and is printed with how far off it was.
+ */
+TEST(autotune, HeldToReference) {
+	autotuner tuner((scenestats()));
+	std::vector<unsigned char> exact(12, 100), close = exact, far = exact;
+	ASSERT_TRUE(tuner.isFaithful(far));
+	close[3] += AUTOTUNE_TOLERANCE;
+	far[5] -= AUTOTUNE_TOLERANCE + 20;
+	tuner.setReference(exact);
+	ASSERT_EQ(0, tuner.getDifference(exact));
+	ASSERT_EQ(AUTOTUNE_TOLERANCE, tuner.getDifference(close));
+	ASSERT_TRUE(tuner.isFaithful(close));
+	ASSERT_FALSE(tuner.isFaithful(far));
+	ASSERT_EQ(QUANTIZE_MAX, tuner.getDifference(
+			std::vector<unsigned char>(3, 100)));
+
+	tuner.addTrial("double", 0, 1.0, 1000, exact);
+	tuner.addTrial("float", 0, 0.1, 1000, far);
+	ASSERT_EQ("double", tuner.getFastest(100));
+	tuner.addTrial("grid", 0, 0.5, 1000, close);
+	ASSERT_EQ("grid", tuner.getFastest(100));
+	std::ostringstream os;
+	tuner.printTrials(os, 1000);
+	ASSERT_EQ("auto: double 1 s float 0.1 s (21 levels off) grid 0.5 s\n",
+			os.str());
+
+	tuner.clearTrials();
+	tuner.addTrial("float", 0, 0.1, 1000, far);
+	ASSERT_EQ("", tuner.getFastest(100));
+}
+
+#endif // TEST_AUTOTUNE_CC
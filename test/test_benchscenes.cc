@@ -0,0 +1,98 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "benchscenes.hh"
+#include "sceneparser.hh"
+#include "scene.hh"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+#ifndef TEST_BENCHSCENES_CC
+#define TEST_BENCHSCENES_CC
+
+/*
+ * Parses a scene description into a scene, returning how many shapes it
+ * added or -1 if it isn't valid or has no camera.
+ */
+int addBenchScene(const std::string &text, scene3d &sc) {
+	scenedescription desc;
+	std::string error;
+	boost::shared_ptr<camera<double, double, 3> > cam;
+	if (!parseSceneParallel<double, double>(text.data(),
+			text.data() + text.size(), "", 1, desc, error) ||
+			!addSceneRecords(sc, desc.records.empty() ? 0 : &desc.records[0],
+			desc.records.size(), desc.paths, cam, error) || !cam) {
+		ADD_FAILURE() << error;
+		return -1;
+	}
+	sc.finalize();
+	return (int) sc.getShapes().size();
+}
+
+/*
+ * The made scenes of the suite are valid descriptions of the sizes asked
+ * for, and the example scenes come first by file.
+ */
+TEST(benchscenes, MakesValidScenes) {
+	scene3d spheres(true), lights(true), hall(true), area(true);
+	EXPECT_EQ(10 * 10 + 1, addBenchScene(manySpheresScene(10), spheres));
+	EXPECT_EQ(4, addBenchScene(manyLightsScene(16), lights));
+	EXPECT_EQ(16u, lights.getLights().size());
+	EXPECT_EQ(6, addBenchScene(mirrorHallScene(), hall));
+	EXPECT_EQ(4, addBenchScene(areaLightScene(0.1), area));
+
+	std::vector<benchscene> scenes;
+	getBenchScenes("scenes/", scenes);
+	ASSERT_EQ(7u, scenes.size());
+	EXPECT_EQ("scenes/example.dat", scenes[0].file);
+	EXPECT_EQ("example3", scenes[2].name);
+	EXPECT_TRUE(scenes[3].file.empty());
+	EXPECT_FALSE(scenes[3].text.empty());
+}
+
+/*
+ * Thread counts double up to the largest, which is always last.
+ */
+TEST(benchscenes, ScalesThreadCounts) {
+	std::vector<int> counts;
+	getBenchThreadCounts(1, counts);
+	ASSERT_EQ(1u, counts.size());
+	EXPECT_EQ(1, counts[0]);
+	getBenchThreadCounts(6, counts);
+	ASSERT_EQ(4u, counts.size());
+	EXPECT_EQ(1, counts[0]);
+	EXPECT_EQ(4, counts[2]);
+	EXPECT_EQ(6, counts[3]);
+	getBenchThreadCounts(8, counts);
+	ASSERT_EQ(4u, counts.size());
+	EXPECT_EQ(8, counts[3]);
+}
+
+/*
+ * Generated scenes have the shapes and lights asked for, and a seed always
+ * makes the same scene while another seed makes another.
+ */
+TEST(benchscenes, GeneratesSeededScenes) {
+	sceneparams p;
+	p.spheres = 50;
+	p.cylinders = 10;
+	p.lights = 3;
+	p.clusters = 4;
+	p.seed = 9;
+	scene3d sc(true);
+	EXPECT_EQ(50 + 10 + 1, addBenchScene(generateScene(p), sc));
+	EXPECT_EQ(3u, sc.getLights().size());
+	EXPECT_EQ(generateScene(p), generateScene(p));
+	sceneparams q = p;
+	q.seed = 10;
+	EXPECT_NE(generateScene(p), generateScene(q));
+
+	p.areaLights = 2;
+	scene3d area(true);
+	EXPECT_EQ(61, addBenchScene(generateScene(p), area));
+}
+
+#endif
@@ -0,0 +1,142 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "buildpipeline.hh"
+#include "bvh.hh"
+#include "qbvh.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "cylinder.hh"
+#include "infplane.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include <cstdlib>
+#include <vector>
+
+#ifndef TEST_BUILDPIPELINE_CC
+#define TEST_BUILDPIPELINE_CC
+
+/**
+ * Random spheres and cylinders, more than a few batches of them, with
+ * planes among them.
+ *
+ * @param[out] shapes Receives the shapes.
+ */
+static void pipelineShapes(std::vector<sp_shape3d> &shapes) {
+	srand(99);
+	rgbcolord col(0.5, 0.5, 0.5);
+	for (int i = 0; i < 3 * BUILD_PIPELINE_BATCH + 17; i++) {
+		vector3d c(rand() % 2000 / 100.0 - 10, rand() % 2000 / 100.0 - 10,
+				rand() % 2000 / 100.0 - 10);
+		if (i % 1000 == 500)
+			shapes.push_back(sp_shape3d(new infplaned(col, 12 + i % 3,
+					vector3d(0.0, 1.0, 0.0))));
+		else if (i % 7 == 0)
+			shapes.push_back(sp_shape3d(new cylinderd(col, 0.1, c, 0.5,
+					vector3d(0.0, 0.0, 1.0))));
+		else
+			shapes.push_back(sp_shape3d(new sphere3d(col, 0.05, c)));
+	}
+}
+
+/*
+ * The bounds gathered by the workers are those of the shapes, in the order
+ * they were pushed.
+ */
+TEST(buildpipeline, GathersBounds) {
+	std::vector<sp_shape3d> shapes;
+	pipelineShapes(shapes);
+	buildpipeline3d pipe(3);
+	for (size_t i = 0; i < shapes.size(); i++)
+		pipe.push(shapes[i].get());
+	ASSERT_EQ((int) shapes.size(), pipe.getCount());
+	std::vector<aabb<double, 3> > boxes;
+	std::vector<char> bounded;
+	pipe.finish(boxes, bounded);
+	ASSERT_EQ(shapes.size(), boxes.size());
+	ASSERT_EQ(shapes.size(), bounded.size());
+	int unbounded = 0;
+	for (size_t i = 0; i < shapes.size(); i++) {
+		aabb<double, 3> box;
+		ASSERT_EQ(shapes[i]->getBounds(box), bounded[i] != 0);
+		if (!bounded[i]) {
+			unbounded++;
+			continue;
+		}
+		for (int a = 0; a < 3; a++) {
+			ASSERT_EQ(box.getMin()[a], boxes[i].getMin()[a]);
+			ASSERT_EQ(box.getMax()[a], boxes[i].getMax()[a]);
+		}
+	}
+	ASSERT_EQ(12, unbounded);
+}
+
+/*
+ * A scene whose bounds were gathered while its shapes were added finds the
+ * same hits as one that gathered them when finalized, with either builder
+ * and with the wide hierarchy.
+ */
+TEST(buildpipeline, SceneMatches) {
+	std::vector<sp_shape3d> shapes;
+	pipelineShapes(shapes);
+	std::vector<ray3d> rays;
+	for (int i = 0; i < 500; i++)
+		rays.push_back(ray3d(vector3d(rand() % 300 / 10.0 - 15, 20.0,
+				rand() % 300 / 10.0 - 15), vector3d(rand() % 100 / 100.0 - 0.5,
+				-1.0, rand() % 100 / 100.0 - 0.5)));
+	for (int k = 0; k < 3; k++) {
+		scene3d plain(false), pipelined(false);
+		if (k < 2) {
+			bvhBuilder b = k == 0 ? BVH_BUILD_SAH : BVH_BUILD_LBVH;
+			plain.setAccelerator(sp_bvh3d(new bvh3d(b, 2)));
+			pipelined.setAccelerator(sp_bvh3d(new bvh3d(b, 2)));
+		}
+		else {
+			plain.setAccelerator(sp_qbvh3d(new qbvh3d()));
+			pipelined.setAccelerator(sp_qbvh3d(new qbvh3d()));
+		}
+		pipelined.beginPipelinedBuild(2);
+		for (size_t i = 0; i < shapes.size(); i++) {
+			plain.addShape(shapes[i]);
+			pipelined.addShape(shapes[i]);
+		}
+		plain.finalize();
+		pipelined.finalize();
+		int hits = 0;
+		for (size_t i = 0; i < rays.size(); i++) {
+			double t1, t2;
+			sp_shape3d s1 = plain.findClosestShape(rays[i], t1);
+			sp_shape3d s2 = pipelined.findClosestShape(rays[i], t2);
+			ASSERT_EQ(s1, s2);
+			ASSERT_DOUBLE_EQ(t1, t2);
+			if (s1 != 0)
+				hits++;
+		}
+		ASSERT_GT(hits, 50);
+	}
+}
+
+/*
+ * Removing a shape before finalizing drops the gathered bounds, which no
+ * longer line up with the shapes.
+ */
+TEST(buildpipeline, RemovedShape) {
+	scene3d sc(false);
+	sc.setAccelerator(sp_bvh3d(new bvh3d()));
+	sc.beginPipelinedBuild(1);
+	rgbcolord col(0.5, 0.5, 0.5);
+	sc.addShape(sp_shape3d(new sphere3d(col, 1, vector3d(0.0, 0.0, 0.0))));
+	sc.addShape(sp_shape3d(new sphere3d(col, 1, vector3d(5.0, 0.0, 0.0))));
+	sc.removeShape(0);
+	sc.addShape(sp_shape3d(new sphere3d(col, 1, vector3d(9.0, 0.0, 0.0))));
+	sc.finalize();
+	double t;
+	ray3d r(vector3d(9.0, 0.0, -5.0), vector3d(0.0, 0.0, 1.0));
+	ASSERT_TRUE(sc.findClosestShape(r, t) != 0);
+	ASSERT_DOUBLE_EQ(4, t);
+}
+
+#endif // TEST_BUILDPIPELINE_CC
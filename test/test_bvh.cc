@@ -0,0 +1,379 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "bvh.hh"
+#include "grid.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "cylinder.hh"
+#include "infplane.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include "boost/shared_ptr.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef TEST_BVH_CC
+#define TEST_BVH_CC
+
+/**
+ * This test fixture class sets up a scene full of randomly placed spheres and
+ * cylinders plus a ground plane, along with a batch of random rays. Note that
+ * an object of this class is created before each test case begins and is torn
+ * down when each test case ends.
+ */
+class bvhTest : public ::testing::Test {
+protected:
+
+	std::vector<sp_shape3d> shapes;
+	std::vector<ray3d> rays;
+
+	static double rnd(double lo, double hi) {
+		return lo + (hi - lo) * (rand() / (double) RAND_MAX);
+	}
+
+	static vector3d rndvec(double lo, double hi) {
+		return vector3d(rnd(lo, hi), rnd(lo, hi), rnd(lo, hi));
+	}
+
+	virtual void SetUp() {
+		srand(1234);
+		rgbcolord col(0.5, 0.5, 0.5);
+		for (int i = 0; i < 300; i++) {
+			shapes.push_back(sp_shape3d(
+					new sphere3d(col, rnd(0.05, 0.5), rndvec(-10, 10))));
+		}
+		for (int i = 0; i < 100; i++) {
+			shapes.push_back(sp_shape3d(new cylinderd(col, rnd(0.05, 0.3),
+					rndvec(-10, 10), rnd(0.2, 2), rndvec(-1, 1))));
+		}
+		shapes.push_back(sp_shape3d(
+				new infplaned(col, 12, vector3d(0.0, 1.0, 0.0))));
+		for (int i = 0; i < 2000; i++) {
+			rays.push_back(ray3d(rndvec(-15, 15), rndvec(-1, 1)));
+		}
+	}
+
+	virtual void TearDown() { }
+};
+
+/*
+ * Every ray must hit the same shape at the same time whether the scene uses
+ * the hierarchy or tests every shape.
+ */
+TEST_F(bvhTest, MatchesLinearScan) {
+	scene3d linear(false), accelerated(false);
+	accelerated.setAccelerator(sp_bvh3d(new bvh3d()));
+	for (size_t i = 0; i < shapes.size(); i++) {
+		linear.addShape(shapes[i]);
+		accelerated.addShape(shapes[i]);
+	}
+	accelerated.finalize();
+
+	int hits = 0;
+	for (size_t i = 0; i < rays.size(); i++) {
+		double t1, t2;
+		sp_shape3d s1 = linear.findClosestShape(rays[i], t1);
+		sp_shape3d s2 = accelerated.findClosestShape(rays[i], t2);
+		ASSERT_EQ(s1, s2);
+		ASSERT_DOUBLE_EQ(t1, t2);
+		if (s1 != 0)
+			hits++;
+	}
+	// Make sure the test actually exercised hits as well as misses.
+	ASSERT_GT(hits, 100);
+	ASSERT_LT(hits, (int) rays.size());
+}
+
+/*
+ * The linear BVH, built on several threads, must give the same answers as
+ * the linear scan, for closest hits as well as occlusion.
+ */
+TEST_F(bvhTest, LinearBuildMatchesLinearScan) {
+	scene3d linear(false), accelerated(false);
+	sp_bvh3d tree(new bvh3d(BVH_BUILD_LBVH, 4));
+	accelerated.setAccelerator(tree);
+	for (size_t i = 0; i < shapes.size(); i++) {
+		linear.addShape(shapes[i]);
+		accelerated.addShape(shapes[i]);
+	}
+	accelerated.finalize();
+	// A binary tree with one shape per leaf.
+	ASSERT_EQ(2 * (int) (shapes.size() - 1) - 1, tree->getNodeCount());
+
+	for (size_t i = 0; i < rays.size(); i++) {
+		double t1, t2;
+		sp_shape3d s1 = linear.findClosestShape(rays[i], t1);
+		sp_shape3d s2 = accelerated.findClosestShape(rays[i], t2);
+		ASSERT_EQ(s1, s2);
+		ASSERT_DOUBLE_EQ(t1, t2);
+		ASSERT_EQ(linear.isOccluded(rays[i], 7), accelerated.isOccluded(
+				rays[i], 7));
+	}
+}
+
+/*
+ * Shapes with identical centroids have identical Morton codes, which the
+ * linear build has to handle as well.
+ */
+TEST_F(bvhTest, LinearBuildDuplicateCodes) {
+	std::vector<sp_shape3d> same;
+	rgbcolord col(0.5, 0.5, 0.5);
+	for (int i = 0; i < 50; i++)
+		same.push_back(sp_shape3d(new sphere3d(col, 1 + i * 0.01,
+				vector3d(1.0, 2.0, 3.0))));
+	bvh3d tree(BVH_BUILD_LBVH, 3);
+	tree.build(same);
+	ray3d r(vector3d(1.0, 2.0, 10.0), vector3d(0.0, 0.0, -1.0));
+	double t;
+	ASSERT_EQ(49, tree.closestHit(r, t));
+	ASSERT_NEAR(7 - 1.49, t, 1e-9);
+}
+
+/*
+ * Occlusion queries must agree with the closest hit: a ray is blocked before
+ * tmax exactly when its closest hit comes earlier than tmax.
+ */
+TEST_F(bvhTest, AnyHitMatchesClosestHit) {
+	scene3d linear(false), accelerated(false);
+	accelerated.setAccelerator(sp_bvh3d(new bvh3d()));
+	for (size_t i = 0; i < shapes.size(); i++) {
+		linear.addShape(shapes[i]);
+		accelerated.addShape(shapes[i]);
+	}
+	accelerated.finalize();
+
+	for (size_t i = 0; i < rays.size(); i++) {
+		double t;
+		bool hit = linear.findClosestShape(rays[i], t) != 0;
+		double tmax = 5 + (i % 10);
+		bool expected = hit && t < tmax;
+		ASSERT_EQ(expected, linear.isOccluded(rays[i], tmax));
+		ASSERT_EQ(expected, accelerated.isOccluded(rays[i], tmax));
+	}
+}
+
+/*
+ * The plane has no bounds so the scene has to keep it out of the tree, yet
+ * rays must still hit it.
+ */
+TEST_F(bvhTest, UnboundedShapesStayOutOfTree) {
+	scene3d sc(false);
+	sp_bvh3d tree(new bvh3d());
+	sc.setAccelerator(tree);
+	for (size_t i = 0; i < shapes.size(); i++)
+		sc.addShape(shapes[i]);
+	sc.finalize();
+	ASSERT_EQ(1u, sc.getUnboundedShapes().size());
+	ASSERT_EQ(shapes.size() - 1, sc.getBoundedShapes().size());
+	ASSERT_GT(tree->getNodeCount(), 1);
+
+	ray3d down(vector3d(100.0, 0.0, 0.0), vector3d(0.0, -1.0, 0.0));
+	double t;
+	ASSERT_EQ(shapes.back(), sc.findClosestShape(down, t));
+	ASSERT_DOUBLE_EQ(12, t);
+
+	ray3d up(vector3d(100.0, 0.0, 0.0), vector3d(0.0, 1.0, 0.0));
+	ASSERT_TRUE(sc.findClosestShape(up, t) == 0);
+	ASSERT_DOUBLE_EQ(RAY_MISS, t);
+}
+
+/*
+ * Tracing rays in packets must give the same answers as tracing them one at
+ * a time, including for batches that don't fill the last packet.
+ */
+TEST_F(bvhTest, PacketsMatchSingleRays) {
+	std::vector<sp_shape3d> bounded(shapes.begin(), shapes.end() - 1);
+	bvh3d sah, lbvh(BVH_BUILD_LBVH);
+	sah.build(bounded);
+	lbvh.build(bounded);
+
+	// An odd count leaves the last packet partly empty.
+	int count = (int) rays.size() - 3;
+	std::vector<int> hits(count);
+	std::vector<double> t(count);
+	for (int pass = 0; pass < 2; pass++) {
+		const bvh3d &tree = pass == 0 ? sah : lbvh;
+		tree.closestHits(&rays[0], count, &hits[0], &t[0]);
+		for (int i = 0; i < count; i++) {
+			double t1;
+			ASSERT_EQ(tree.closestHit(rays[i], t1), hits[i]);
+			ASSERT_DOUBLE_EQ(t1, t[i]);
+		}
+	}
+
+	scene3d linear(false), accelerated(false);
+	accelerated.setAccelerator(sp_bvh3d(new bvh3d()));
+	for (size_t i = 0; i < shapes.size(); i++) {
+		linear.addShape(shapes[i]);
+		accelerated.addShape(shapes[i]);
+	}
+	accelerated.finalize();
+	std::vector<hitrecord3d> recs(count);
+	accelerated.findClosestHits(&rays[0], count, &recs[0]);
+	for (int i = 0; i < count; i++) {
+		double t1;
+		sp_shape3d s1 = linear.findClosestShape(rays[i], t1);
+		ASSERT_EQ(s1.get(), recs[i].obj);
+		if (s1 != 0) {
+			ASSERT_DOUBLE_EQ(t1, recs[i].t);
+			ASSERT_EQ(s1, shapes[recs[i].id]);
+		}
+	}
+}
+
+/*
+ * Shadow rays traced in packets toward a shared light must be blocked
+ * exactly when they are traced one at a time, as must packets of rays that
+ * don't end and so can't be bounded by the box around them.
+ */
+TEST_F(bvhTest, ShadowPacketsMatchSingleRays) {
+	std::vector<sp_shape3d> bounded(shapes.begin(), shapes.end() - 1);
+	bvh3d tree;
+	tree.build(bounded);
+	vector3d light(1.0, 14.0, -2.0);
+	int count = (int) rays.size() - 3;
+	std::vector<ray3d> shadows;
+	std::vector<double> tmax;
+	for (int i = 0; i < count; i++) {
+		vector3d toLight = light - rays[i].getOrig();
+		shadows.push_back(ray3d(rays[i].getOrig(), toLight));
+		tmax.push_back(toLight.mag());
+	}
+	std::vector<int> hits(count);
+	tree.anyHits(&shadows[0], count, &tmax[0], &hits[0]);
+	int blocked = 0;
+	for (int i = 0; i < count; i++) {
+		ASSERT_EQ(tree.anyHit(shadows[i], tmax[i]) >= 0, hits[i] >= 0);
+		if (hits[i] >= 0)
+			blocked++;
+	}
+	ASSERT_GT(blocked, 0);
+	ASSERT_LT(blocked, count);
+
+	std::vector<double> endless(count, std::numeric_limits<double>::max());
+	tree.anyHits(&rays[0], count, &endless[0], &hits[0]);
+	for (int i = 0; i < count; i++)
+		ASSERT_EQ(tree.anyHit(rays[i], endless[i]) >= 0, hits[i] >= 0);
+}
+
+/*
+ * After the shapes move, a refit tree must keep its shape and still agree
+ * with the linear scan. Accelerators that can't refit get rebuilt instead.
+ */
+TEST_F(bvhTest, Refit) {
+	scene3d linear(false), refitted(false), rebuilt(false);
+	sp_bvh3d tree(new bvh3d());
+	refitted.setAccelerator(tree);
+	rebuilt.setAccelerator(sp_grid3d(new grid3d()));
+	for (size_t i = 0; i < shapes.size(); i++) {
+		linear.addShape(shapes[i]);
+		refitted.addShape(shapes[i]);
+		rebuilt.addShape(shapes[i]);
+	}
+	refitted.finalize();
+	rebuilt.finalize();
+	int nodeCount = tree->getNodeCount();
+
+	for (int frame = 1; frame <= 3; frame++) {
+		for (size_t i = 0; i < shapes.size(); i++) {
+			boost::shared_ptr<sphere3d> sph =
+					boost::dynamic_pointer_cast<sphere3d>(shapes[i]);
+			if (sph != 0) {
+				sph->setCenter(sph->getCenter() + rndvec(-1, 1));
+				sph->setRadius(sph->getRadius() * rnd(0.8, 1.25));
+			}
+		}
+		refitted.refit();
+		rebuilt.refit();
+		ASSERT_EQ(nodeCount, tree->getNodeCount());
+
+		for (size_t i = 0; i < rays.size(); i++) {
+			double t1, t2, t3;
+			sp_shape3d s1 = linear.findClosestShape(rays[i], t1);
+			ASSERT_EQ(s1, refitted.findClosestShape(rays[i], t2));
+			ASSERT_DOUBLE_EQ(t1, t2);
+			ASSERT_EQ(s1, rebuilt.findClosestShape(rays[i], t3));
+			ASSERT_DOUBLE_EQ(t1, t3);
+			ASSERT_EQ(linear.isOccluded(rays[i], 7), refitted.isOccluded(
+					rays[i], 7));
+		}
+	}
+}
+
+/*
+ * A tree written to a stream and read back must answer every query the same
+ * way as the original, and streams that don't hold a matching tree must be
+ * rejected without touching the tree.
+ */
+TEST_F(bvhTest, WriteRead) {
+	std::vector<sp_shape3d> bounded(shapes.begin(), shapes.end() - 1);
+	bvh3d original;
+	original.build(bounded);
+	std::stringstream ss;
+	ASSERT_TRUE(original.write(ss));
+	std::string bytes = ss.str();
+
+	bvh3d copy(BVH_BUILD_LBVH);
+	std::istringstream is(bytes);
+	ASSERT_TRUE(copy.read(is, bounded));
+	ASSERT_EQ(original.getNodeCount(), copy.getNodeCount());
+	for (size_t i = 0; i < rays.size(); i++) {
+		double t1, t2;
+		ASSERT_EQ(original.closestHit(rays[i], t1),
+				copy.closestHit(rays[i], t2));
+		ASSERT_DOUBLE_EQ(t1, t2);
+		ASSERT_EQ(original.anyHit(rays[i], 6), copy.anyHit(rays[i], 6));
+	}
+
+	// Wrong number of shapes.
+	bvh3d other;
+	std::istringstream is2(bytes);
+	std::vector<sp_shape3d> fewer(bounded.begin(), bounded.end() - 1);
+	ASSERT_FALSE(other.read(is2, fewer));
+	// Truncated.
+	std::istringstream is3(bytes.substr(0, bytes.size() - 1));
+	ASSERT_FALSE(other.read(is3, bounded));
+	// Bad magic.
+	std::string bad = bytes;
+	bad[0] = 'X';
+	std::istringstream is4(bad);
+	ASSERT_FALSE(other.read(is4, bounded));
+	ASSERT_EQ(0, other.getNodeCount());
+
+	// The same bytes in memory, as from a mapped file.
+	std::vector<int> words(bytes.size() / sizeof(int));
+	memcpy(&words[0], bytes.data(), bytes.size());
+	const char *p = (const char *) &words[0];
+	bvh3d mapped;
+	ASSERT_TRUE(mapped.read(p, bytes.size(), bounded));
+	ASSERT_EQ(original.getNodeCount(), mapped.getNodeCount());
+	for (size_t i = 0; i < rays.size(); i++) {
+		double t1, t2;
+		ASSERT_EQ(original.closestHit(rays[i], t1),
+				mapped.closestHit(rays[i], t2));
+	}
+	ASSERT_FALSE(other.read(p, bytes.size() - 1, bounded));
+	ASSERT_FALSE(other.read(p, bytes.size(), fewer));
+	ASSERT_EQ(0, other.getNodeCount());
+}
+
+/*
+ * An empty hierarchy never reports hits.
+ */
+TEST_F(bvhTest, Empty) {
+	bvh3d tree;
+	tree.build(std::vector<sp_shape3d>());
+	double t;
+	ASSERT_EQ(-1, tree.closestHit(rays[0], t));
+	ASSERT_EQ(0, tree.getNodeCount());
+}
+
+#endif // TEST_BVH_CC
@@ -0,0 +1,44 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "camera.hh"
+#include "ray.hh"
+#include "mvector.hh"
+#include "gtest/gtest.h"
+#include <vector>
+
+#ifndef TEST_CAMERA_CC
+#define TEST_CAMERA_CC
+
+/*
+ * The rays of a tile, whether as rays or as arrays of directions, are
+ * exactly the ones made pixel by pixel.
+ */
+TEST(camera, TileMatchesPixels) {
+	camerad cam(vector3d(1.0, 3.0, 6.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	int width = 37, height = 23;
+	int x0 = 5, y0 = 3, w = 17, h = 11;
+	std::vector<ray3d> rays(w * h);
+	cam.getRaysForTile(x0, y0, w, h, width, height, &rays[0]);
+	std::vector<double> dx(w * h), dy(w * h), dz(w * h);
+	double *dirs[] = { &dx[0], &dy[0], &dz[0] };
+	cam.getDirsForTile(x0, y0, w, h, width, height, dirs);
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			int k = y * w + x;
+			ray3d r = cam.getRayForPixel(x0 + x, y0 + y, width, height);
+			ASSERT_TRUE(rays[k].isNormalized());
+			for (int a = 0; a < 3; a++) {
+				ASSERT_EQ(r.getOrig()[a], rays[k].getOrig()[a]);
+				ASSERT_EQ(r.getDir()[a], rays[k].getDir()[a]);
+				ASSERT_EQ(r.getDir()[a], dirs[a][k]);
+				ASSERT_EQ(r.getOrig()[a], cam.getPosition()[a]);
+			}
+		}
+	}
+}
+
+#endif // TEST_CAMERA_CC
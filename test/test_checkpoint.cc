@@ -0,0 +1,93 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "checkpoint.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+#ifndef TEST_CHECKPOINT_CC
+#define TEST_CHECKPOINT_CC
+
+/*
+ * Makes an image whose pixels all differ, some of them brighter than
+ * white.
+ */
+static std::vector<rgbcolord> checkpointImage(int width, int height) {
+	std::vector<rgbcolord> image((size_t) width * height);
+	for (int i = 0; i < width * height; i++)
+		image[i] = rgbcolord::unchecked(i / 7.0, 0.25, 1.0 / (i + 1));
+	return image;
+}
+
+/*
+ * The tiles done come back with their exact pixels, and the rest of the
+ * image is left alone.
+ */
+TEST(checkpoint, RoundTrips) {
+	int width = 37, height = 21;
+	std::vector<rgbcolord> image = checkpointImage(width, height);
+	checkpoint<double> saved(42, width, height, 16);
+	ASSERT_EQ(6, saved.getTileCount());
+	saved.markDone(1);
+	saved.markDone(5);
+	saved.markDone(5);
+	ASSERT_EQ(2, saved.getDoneCount());
+	std::string bytes = saved.encode(image);
+
+	checkpoint<double> resumed(42, width, height, 16);
+	std::vector<rgbcolord> blank((size_t) width * height);
+	std::string error;
+	ASSERT_TRUE(resumed.decode(bytes.data(), bytes.size(), blank, error))
+			<< error;
+	ASSERT_EQ(2, resumed.getDoneCount());
+	ASSERT_TRUE(resumed.isDone(5));
+	ASSERT_FALSE(resumed.isDone(0));
+	std::vector<int> left;
+	resumed.getTilesLeft(left);
+	ASSERT_EQ(4u, left.size());
+	ASSERT_EQ(4, left[3]);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			int tile = y / 16 * 3 + x / 16;
+			int k = y * width + x;
+			bool kept = tile == 1 || tile == 5;
+			ASSERT_EQ(kept ? image[k].getR() : 0, blank[k].getR());
+			ASSERT_EQ(kept ? image[k].getB() : 0, blank[k].getB());
+		}
+	}
+}
+
+/*
+ * Checkpoints of another key or size, and ones cut short, are turned down
+ * without changing anything.
+ */
+TEST(checkpoint, RejectsOthers) {
+	int width = 20, height = 20;
+	std::vector<rgbcolord> image = checkpointImage(width, height);
+	checkpoint<double> saved(7, width, height, 16);
+	saved.markDone(0);
+	saved.markDone(3);
+	std::string bytes = saved.encode(image);
+
+	std::vector<rgbcolord> blank((size_t) width * height);
+	std::string error;
+	checkpoint<double> otherKey(8, width, height, 16);
+	ASSERT_FALSE(otherKey.decode(bytes.data(), bytes.size(), blank, error));
+	checkpoint<double> otherSize(7, width, height + 1, 16);
+	std::vector<rgbcolord> taller((size_t) width * (height + 1));
+	ASSERT_FALSE(otherSize.decode(bytes.data(), bytes.size(), taller,
+			error));
+	checkpoint<double> resumed(7, width, height, 16);
+	ASSERT_FALSE(resumed.decode(bytes.data(), bytes.size() - 1, blank,
+			error));
+	ASSERT_FALSE(resumed.decode("P6\n", 3, blank, error));
+	ASSERT_EQ(0, resumed.getDoneCount());
+	for (size_t i = 0; i < blank.size(); i++)
+		ASSERT_EQ(0, blank[i].getR());
+}
+
+#endif // TEST_CHECKPOINT_CC
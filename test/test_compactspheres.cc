@@ -0,0 +1,167 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "compactspheres.hh"
+#include "memoryreport.hh"
+#include "sceneparser.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "infplane.hh"
+#include "light.hh"
+#include "camera.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef TEST_COMPACTSPHERES_CC
+#define TEST_COMPACTSPHERES_CC
+
+/*
+ * Spheres whose centers and radii are floats render exactly as the
+ * spheres they stand for, normals, colors and reflections included, and
+ * rays that aren't normalized hit them at the same times.
+ */
+TEST(compactspheres, MatchesSpheres) {
+	scene3d full(true), compact(true);
+	boost::shared_ptr<compactspheresd> spheres(new compactspheresd());
+	std::vector<sphere3d> each;
+	srand(3);
+	for (int i = 0; i < 200; i++) {
+		vector3d center((rand() % 64 - 32) / 8.0, (rand() % 24) / 8.0,
+				(rand() % 64) / 8.0);
+		double rad = (1 + rand() % 4) / 16.0;
+		rgbcolord color((rand() % 4) / 4.0, 0.5, (rand() % 2) / 2.0);
+		float refl = (rand() % 3) / 4.0f;
+		full.addShape(sp_shape3d(new sphere3d(color, rad, center, refl)));
+		each.push_back(sphere3d(color, rad, center, refl));
+		spheres->add(color, rad, center, refl);
+	}
+	spheres->build();
+	ASSERT_EQ(200, spheres->getSphereCount());
+	ASSERT_GE(24, spheres->getMaterialCount());
+	ASSERT_EQ(2, spheres->getIndexBytes());
+	compact.addShape(spheres);
+	scene3d *both[] = { &full, &compact };
+	for (int k = 0; k < 2; k++) {
+		both[k]->addShape(sp_shape3d(new infplaned(rgbcolord(0.6, 0.6, 0.6),
+				0, vector3d(0.0, 1.0, 0.0), 0.3f)));
+		both[k]->addPointLight(sp_lightd(new lightd(rgbcolord(0.8, 0.8, 0.8),
+				vector3d(-6.0, 9.0, -5.0))));
+		both[k]->finalize();
+	}
+	camera<double, double, 3> cam(vector3d(0.0, 4.0, -9.0),
+			vector3d(0.0, 1.0, 3.0), vector3d(0.0, 1.0, 0.0));
+	std::vector<rgbcolord> expected, image;
+	full.renderImage(cam, 48, 36, expected);
+	compact.renderImage(cam, 48, 36, image);
+	ASSERT_EQ(expected.size(), image.size());
+	for (size_t i = 0; i < image.size(); i++) {
+		ASSERT_EQ(expected[i].getR(), image[i].getR()) << i;
+		ASSERT_EQ(expected[i].getG(), image[i].getG()) << i;
+		ASSERT_EQ(expected[i].getB(), image[i].getB()) << i;
+	}
+
+	for (int i = 0; i < 500; i++) {
+		vector3d orig((rand() % 80 - 40) / 8.0, (rand() % 40) / 8.0, -6.0);
+		vector3d dir((rand() % 21 - 10) / 10.0, (rand() % 21 - 10) / 20.0,
+				1.0 + rand() % 3);
+		ray<double, double, 3> r(orig, dir);
+		double t = RAY_MISS;
+		for (size_t k = 0; k < each.size(); k++) {
+			double tk = each[k].intersection(r);
+			if (tk >= 0 && (t < 0 || tk < t))
+				t = tk;
+		}
+		ASSERT_EQ(t, spheres->intersection(r));
+	}
+}
+
+/*
+ * Sixteen bit indices hold up to 65536 materials; more take 32 bits.
+ */
+TEST(compactspheres, IndexWidth) {
+	compactspheresf few, many;
+	for (int i = 0; i < 70000; i++) {
+		vector3f center((float) (i % 100), (float) (i / 100), 0.0f);
+		few.add(rgbcolorf(0.5f, 0.5f, 0.5f), 0.25f, center);
+		many.add(rgbcolorf(i / 70000.0f, 0.5f, 0.5f), 0.25f, center);
+	}
+	few.build();
+	many.build();
+	ASSERT_EQ(1, few.getMaterialCount());
+	ASSERT_EQ(2, few.getIndexBytes());
+	ASSERT_EQ(70000, many.getMaterialCount());
+	ASSERT_EQ(4, many.getIndexBytes());
+	ASSERT_GT(many.getMemoryUsage(), few.getMemoryUsage());
+
+	// A ray down onto a sphere gets its normal and its material.
+	ray<float, float, 3> r(vector3f(42.0f, 17.0f, 5.0f),
+			vector3f(0.0f, 0.0f, -1.0f));
+	hitrecord<float, float, float, 3> rec;
+	rec.t = many.intersection(r);
+	ASSERT_FLOAT_EQ(4.75f, rec.t);
+	many.completeHit(r, rec);
+	ASSERT_FLOAT_EQ(1.0f, rec.normal[2]);
+	ASSERT_FLOAT_EQ(1742 / 70000.0f, rec.obj->getColor().getR());
+}
+
+/*
+ * Records gather the spheres nothing moves into one shape after the
+ * others, and the report counts them there.
+ */
+TEST(compactspheres, FromRecords) {
+	std::string text = "light (1, 1, 1) <0, 5, 0>\n"
+			"sphere (1, 0, 0) 1 <0, 0, 0> 0\n"
+			"sphere (0, 1, 0) 1 <3, 0, 0> 0.5\n"
+			"move <1, 0, 0>\n"
+			"plane (0.5, 0.5, 0.5) 1 <0, 1, 0> 0\n"
+			"sphere (1, 0, 0) 0.5 <-3, 0, 0> 0\n"
+			"camera <0, 0, -5> <0, 0, 0> <0, 1, 0>\n";
+	scenetokenizer in(text.data(), text.data() + text.size());
+	scenedescription desc;
+	std::string error;
+	ASSERT_TRUE((parseScene<double, double>(in, "", desc, error))) << error;
+	scene3d sc(true);
+	boost::shared_ptr<camera<double, double, 3> > cam;
+	std::vector<scenecamera<double, double> > cameras;
+	animation<double, double, double> anim;
+	ASSERT_TRUE(addSceneRecords(sc, &desc.records[0], desc.records.size(),
+			desc.paths, cam, error, &cameras, &anim, true)) << error;
+	sc.finalize();
+	ASSERT_EQ(3u, sc.getShapes().size());
+	const compactspheresd *spheres = dynamic_cast<const compactspheresd *>(
+			sc.getShapes()[2].get());
+	ASSERT_TRUE(spheres != 0);
+	ASSERT_EQ(2, spheres->getSphereCount());
+	ASSERT_EQ(1, spheres->getMaterialCount());
+
+	memoryreport report;
+	scenememory<double, double, double>().addScene(report, sc);
+	const std::vector<memoryrow> &rows = report.getRows();
+	ASSERT_EQ("moving shapes", rows[0].what);
+	ASSERT_EQ("spheres", rows[1].what);
+	ASSERT_EQ(1u, rows[1].count);
+	ASSERT_GT(rows[1].bytes, sizeof(sphere3d));
+	ASSERT_EQ("planes", rows[2].what);
+	ASSERT_EQ("compact spheres", rows[3].what);
+	ASSERT_EQ(2u, rows[3].count);
+	ASSERT_EQ("shape lists", rows[4].what);
+	ASSERT_EQ("point lights", rows[5].what);
+	ASSERT_EQ("light lists", rows[6].what);
+	report.add("framebuffer", 1, 1000);
+	report.add("framebuffer", 1, 24);
+	ASSERT_EQ(2u, report.getRows().back().count);
+	std::ostringstream os;
+	report.print(os);
+	ASSERT_NE(std::string::npos, os.str().find(
+			"memory: framebuffer: 2, 1024 bytes (512 each)\n"));
+	ASSERT_NE(std::string::npos, os.str().find("memory: total: "));
+}
+
+#endif // TEST_COMPACTSPHERES_CC
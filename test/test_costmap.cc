@@ -0,0 +1,81 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "costmap.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "infplane.hh"
+#include "camera.hh"
+#include "gtest/gtest.h"
+#include <vector>
+
+#ifndef TEST_COSTMAP_CC
+#define TEST_COSTMAP_CC
+
+/*
+ * The false colors run from black to red, and the share of the costliest
+ * pixels is added up from the top.
+ */
+TEST(costmap, ColorsAndShares) {
+	ASSERT_DOUBLE_EQ(0, heatColor(0).getB());
+	ASSERT_DOUBLE_EQ(1, heatColor(0.2).getB());
+	ASSERT_DOUBLE_EQ(1, heatColor(1).getR());
+	ASSERT_DOUBLE_EQ(0, heatColor(1).getG());
+	ASSERT_DOUBLE_EQ(1, heatColor(2).getR());
+
+	std::vector<double> cost(10, 1);
+	cost[3] = 91;
+	ASSERT_DOUBLE_EQ(0.91, costliestShare(cost, 0.1));
+	std::vector<rgbcolord> image;
+	heatmapImage(cost, image);
+	ASSERT_EQ(10u, image.size());
+	ASSERT_DOUBLE_EQ(1, image[3].getR());
+	ASSERT_DOUBLE_EQ(0, costliestShare(std::vector<double>(4, 0), 0.5));
+}
+
+/*
+ * Measuring the cost of a render fills in every pixel and changes none of
+ * the colors; other renders leave the map alone.
+ */
+TEST(costmap, MeasuresRenderImage) {
+	scene3d sc(true);
+	sc.addShape(sp_shape3d(new sphere3d(rgbcolord(1, 0.5, 0.5), 1,
+			vector3d(0.0, 0.0, -4.0), 0.5f)));
+	sc.addShape(sp_shape3d(new infplaned(rgbcolord(0.5, 0.5, 0.5), 1,
+			vector3d(0.0, 1.0, 0.0), 0.5f)));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(1, 1, 1),
+			vector3d(0.0, 5.0, 0.0))));
+	sc.setRenderThreads(2);
+	sc.finalize();
+	camerad cam(vector3d(0.0, 0.0, 0.0), vector3d(0.0, 0.0, -1.0),
+			vector3d(0.0, 1.0, 0.0));
+	int width = 40, height = 30;
+	std::vector<rgbcolord> plain, measured;
+	sc.renderImage(cam, width, height, plain);
+
+	std::vector<double> cost;
+	sc.setCostMap(&cost, COST_CYCLES);
+	sc.renderImage(cam, width, height, measured);
+	ASSERT_EQ((size_t) width * height, cost.size());
+	for (size_t k = 0; k < plain.size(); k++) {
+		ASSERT_EQ(plain[k].getR(), measured[k].getR());
+		ASSERT_EQ(plain[k].getG(), measured[k].getG());
+		ASSERT_EQ(plain[k].getB(), measured[k].getB());
+		ASSERT_GE(cost[k], 0);
+	}
+	double total = 0;
+	for (size_t k = 0; k < cost.size(); k++)
+		total += cost[k];
+	ASSERT_GT(total, 0);
+
+	std::vector<rgbcolord> tiles(plain.size());
+	std::vector<int> all(1, 0);
+	std::vector<double> before(cost);
+	sc.renderTiles(cam, width, height, all, tiles);
+	ASSERT_TRUE(before == cost);
+	sc.setCostMap(0, COST_CYCLES);
+}
+
+#endif // TEST_COSTMAP_CC
@@ -0,0 +1,129 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "cylinder.hh"
+#include "mvector.hh"
+#include "gtest/gtest.h"
+#include <cmath>
+#include <iostream>
+
+#ifndef TEST_CYLINDER_CC
+#define TEST_CYLINDER_CC
+
+/**
+ * This test fixture class sets up a couple of persistent cylinders that we
+ * use below for testing. Note that an object of this class is created before
+ * each test case begins and is torn down when each test case ends.
+ */
+class cylinderTest : public ::testing::Test {
+protected:
+
+	cylinderd *a, *b;
+
+	virtual void SetUp() {
+		a = new cylinderd; // unit radius and height along y at the origin
+
+		// Tilted 45 degrees in the xy plane.
+		b = new cylinderd(rgbcolord(0.4, 0.5, 0.6), 0.5,
+				vector3d(1.0, 2.0, 3.0), 2, vector3d(1.0, 1.0, 0.0));
+	}
+
+	virtual void TearDown() {
+		delete a;
+		delete b;
+	}
+};
+
+/*
+ * Exercises the getBounds function for an axis-aligned and a tilted
+ * cylinder.
+ */
+TEST_F(cylinderTest, Bounds) {
+	aabb3d box;
+	ASSERT_TRUE(a->getBounds(box));
+	ASSERT_DOUBLE_EQ(-1, box.getMin()[0]);
+	ASSERT_DOUBLE_EQ(-0.5, box.getMin()[1]);
+	ASSERT_DOUBLE_EQ(-1, box.getMin()[2]);
+	ASSERT_DOUBLE_EQ(1, box.getMax()[0]);
+	ASSERT_DOUBLE_EQ(0.5, box.getMax()[1]);
+	ASSERT_DOUBLE_EQ(1, box.getMax()[2]);
+
+	ASSERT_TRUE(b->getBounds(box));
+	double e = 1 / sqrt(2) + 0.5 / sqrt(2);
+	ASSERT_NEAR(1 - e, box.getMin()[0], 1e-12);
+	ASSERT_NEAR(2 + e, box.getMax()[1], 1e-12);
+	ASSERT_NEAR(2.5, box.getMin()[2], 1e-12);
+	ASSERT_NEAR(3.5, box.getMax()[2], 1e-12);
+}
+
+/*
+ * Exercises the intersection function from the side of the default
+ * cylinder.
+ */
+TEST_F(cylinderTest, Intersection) {
+	ray3d r(vector3d(-5.0, 0.0, 0.0), vector3d(1.0, 0.0, 0.0));
+	ASSERT_DOUBLE_EQ(4, a->intersection(r));
+
+	ray3d s(vector3d(-5.0, 2.0, 0.0), vector3d(1.0, 0.0, 0.0));
+	ASSERT_DOUBLE_EQ(RAY_MISS, a->intersection(s));
+
+	// Rays along the axis pass through the open ends.
+	ray3d u(vector3d(0.0, -5.0, 0.0), vector3d(0.0, 1.0, 0.0));
+	ASSERT_DOUBLE_EQ(RAY_MISS, a->intersection(u));
+
+	// From inside the tube the far wall is hit.
+	ray3d v(vector3d(0.0, 0.0, 0.0), vector3d(0.0, 0.0, 1.0));
+	ASSERT_DOUBLE_EQ(1, a->intersection(v));
+}
+
+/*
+ * A ray that enters through an open end and misses the outside of the wall
+ * hits the inside of it instead.
+ */
+TEST_F(cylinderTest, InnerWall) {
+	// Passes x = 1 above the top, then reaches the wall at x = -1 and
+	// y = -0.4.
+	ray3d r(vector3d(2.0, 2.0, 0.0), vector3d(-1.0, -0.8, 0.0));
+	ASSERT_NEAR(3 * sqrt(1.64), a->intersection(r), 1e-12);
+}
+
+/*
+ * The hit record must agree with intersection and surfaceNorm.
+ */
+TEST_F(cylinderTest, HitRecord) {
+	ray3d r(vector3d(-3.0, 2.5, 3.2), vector3d(1.0, -0.1, 0.05));
+	hitrecord3d rec;
+	ASSERT_TRUE(b->intersect(r, rec));
+	ASSERT_DOUBLE_EQ(b->intersection(r), rec.t);
+	vector3d N = b->surfaceNorm(r.getPointAtT(rec.t));
+	for (int i = 0; i < 3; i++)
+		ASSERT_NEAR(N[i], rec.normal[i], 1e-12);
+	ASSERT_EQ(b, rec.obj);
+}
+
+/*
+ * The setters must keep the intersection up to date.
+ */
+TEST_F(cylinderTest, Setters) {
+	ray3d r(vector3d(-5.0, 0.0, 0.0), vector3d(1.0, 0.0, 0.0));
+	a->setRadius(2);
+	ASSERT_DOUBLE_EQ(3, a->intersection(r));
+	a->setCenter(vector3d(0.0, 3.0, 0.0));
+	ASSERT_DOUBLE_EQ(RAY_MISS, a->intersection(r));
+	a->setHeight(8);
+	ASSERT_DOUBLE_EQ(3, a->intersection(r));
+	a->setAxis(vector3d(0.0, 0.0, 2.0));
+	ASSERT_DOUBLE_EQ(RAY_MISS, a->intersection(r));
+	ASSERT_DOUBLE_EQ(1, a->getAxis().mag());
+}
+
+/*
+ * Exercises the << operator.
+ */
+TEST_F(cylinderTest, Print) {
+	std::cout << std::endl << *b << std::endl << std::endl;
+}
+
+#endif // TEST_CYLINDER_CC
@@ -0,0 +1,137 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "denoiser.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "infplane.hh"
+#include "arealight.hh"
+#include "camera.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#ifndef TEST_DENOISER_CC
+#define TEST_DENOISER_CC
+
+/**
+ * A sphere on a floor under a large area light, which casts a soft shadow
+ * that's noisy with few samples per shading point.
+ */
+class denoiserTest : public ::testing::Test {
+protected:
+
+	/** The camera looking at the sphere. */
+	camera<double, double, 3> cam;
+
+	denoiserTest() : cam(vector3d(0.0, 4.0, -8.0), vector3d(0.0, 0.5, 0.0),
+			vector3d(0.0, 1.0, 0.0)) { }
+
+	/*
+	 * Makes the scene with the given area light samples.
+	 */
+	static void makeScene(scene3d &sc, int samples) {
+		sc.setAreaLightMode(AREA_LIGHT_SAMPLED, samples);
+		rgbcolord grey(0.6, 0.6, 0.6);
+		sc.addShape(sp_shape3d(new sphere3d(rgbcolord(0.8, 0.3, 0.3), 1,
+				vector3d(0.0, 1.0, 0.0))));
+		sc.addShape(sp_shape3d(new infplaned(grey, 0,
+				vector3d(0.0, 1.0, 0.0))));
+		sc.addAreaLight(sp_arealightd(new arealightd(rgbcolord(1, 1, 1),
+				vector3d(1.0, 5.0, 1.0), vector3d(0.0, -1.0, 0.0),
+				vector3d(1.0, 0.0, 0.0), 0.5, 0.5, 3, 3)));
+		sc.finalize();
+	}
+
+	/*
+	 * Root mean square difference of two images over all channels.
+	 */
+	static double rms(const std::vector<rgbcolord> &a,
+			const std::vector<rgbcolord> &b) {
+		double sum = 0;
+		for (size_t i = 0; i < a.size(); i++) {
+			rgbcolord d = a[i] - b[i];
+			sum += d.getR() * d.getR() + d.getG() * d.getG() +
+					d.getB() * d.getB();
+		}
+		return std::sqrt(sum / (3 * a.size()));
+	}
+};
+
+/*
+ * Noise within a shape is smoothed away but nothing crosses into the pixels
+ * of another shape, and the result doesn't depend on the thread count.
+ */
+TEST_F(denoiserTest, KeepsShapesApart) {
+	sphere3d left(rgbcolord(1, 1, 1), 1, vector3d(0.0, 0.0, 0.0));
+	sphere3d right(rgbcolord(1, 1, 1), 1, vector3d(0.0, 0.0, 0.0));
+	gbuffer3d gb;
+	gb.resize(40, 30);
+	std::vector<rgbcolord> image(40 * 30);
+	srand(3);
+	for (int y = 0; y < 30; y++) {
+		for (int x = 0; x < 40; x++) {
+			hitrecord3d &h = gb.getHit(y * 40 + x);
+			h.obj = x < 20 ? &left : &right;
+			h.id = x < 20 ? 0 : 1;
+			h.t = 10;
+			h.normal = vector3d(0.0, 0.0, -1.0);
+			double base = x < 20 ? 0.2 : 0.8;
+			double v = base + 0.1 * (rand() / (double) RAND_MAX - 0.5);
+			image[y * 40 + x] = rgbcolord(v, v, v);
+		}
+	}
+	std::vector<rgbcolord> one(image), three(image);
+	denoiser3d().filter(gb, one, 1);
+	denoiser3d().filter(gb, three, 3);
+	for (size_t i = 0; i < image.size(); i++) {
+		ASSERT_EQ(one[i].getR(), three[i].getR()) << "pixel " << i;
+		double base = i % 40 < 20 ? 0.2 : 0.8;
+		ASSERT_NEAR(base, one[i].getR(), 0.02) << "pixel " << i;
+	}
+
+	// No passes leave the image alone.
+	std::vector<rgbcolord> none(image);
+	denoiser3d(0).filter(gb, none);
+	ASSERT_EQ(image[5].getR(), none[5].getR());
+}
+
+/*
+ * A soft shadow filtered from a quarter of the samples per pixel is closer
+ * to one with many samples than the unfiltered shadow with all of them, and
+ * with one sample per pixel, filtering brings few area light samples
+ * closer.
+ */
+TEST_F(denoiserTest, QuarterOfTheSamples) {
+	scene3d reference(true), few(true), more(true);
+	makeScene(reference, 1);
+	makeScene(few, 1);
+	makeScene(more, 1);
+	reference.setPixelSamples(12);
+	few.setPixelSamples(2);
+	more.setPixelSamples(4);
+	std::vector<rgbcolord> ref, noisy, raw, denoised;
+	reference.renderImage(cam, 128, 96, ref);
+	few.renderImage(cam, 128, 96, noisy);
+	more.renderImage(cam, 128, 96, raw);
+	few.setDenoisePasses(5);
+	few.renderImage(cam, 128, 96, denoised);
+	ASSERT_LT(rms(ref, raw), rms(ref, noisy));
+	ASSERT_LT(rms(ref, denoised), rms(ref, raw));
+
+	scene3d manyLight(true), fewLight(true);
+	makeScene(manyLight, 64);
+	makeScene(fewLight, 4);
+	manyLight.renderImage(cam, 128, 96, ref);
+	fewLight.renderImage(cam, 128, 96, noisy);
+	fewLight.setDenoisePasses(5);
+	fewLight.renderImage(cam, 128, 96, denoised);
+	ASSERT_LT(rms(ref, denoised) * 1.5, rms(ref, noisy));
+}
+
+#endif // TEST_DENOISER_CC
@@ -0,0 +1,212 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "dynamicbvh.hh"
+#include "accelfactory.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "camera.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include "boost/shared_ptr.hpp"
+#include <cstdlib>
+#include <vector>
+
+#ifndef TEST_DYNAMICBVH_CC
+#define TEST_DYNAMICBVH_CC
+
+/**
+ * Reuses the random shapes and rays from the BVH tests.
+ */
+class dynamicbvhTest : public bvhTest {
+protected:
+
+	/*
+	 * Checks that every ray hits the same shape at the same time in the
+	 * scene as in a linear scan over its shapes as they are now, and that
+	 * occlusion queries agree too.
+	 */
+	void expectMatchesLinear(const scene3d &sc) {
+		scene3d linear(false);
+		for (size_t i = 0; i < sc.getShapes().size(); i++)
+			linear.addShape(sc.getShapes()[i]);
+		for (size_t i = 0; i < rays.size(); i += 4) {
+			double t1, t2;
+			sp_shape3d s1 = linear.findClosestShape(rays[i], t1);
+			sp_shape3d s2 = sc.findClosestShape(rays[i], t2);
+			ASSERT_EQ(s1, s2) << "ray " << i;
+			ASSERT_DOUBLE_EQ(t1, t2);
+			double tmax = 5 + (i % 10);
+			ASSERT_EQ(linear.isOccluded(rays[i], tmax),
+					sc.isOccluded(rays[i], tmax));
+		}
+	}
+
+	/*
+	 * Makes a small random sphere.
+	 */
+	static sp_shape3d randomSphere() {
+		return sp_shape3d(new sphere3d(rgbcolord(0.5, 0.5, 0.5),
+				rnd(0.05, 0.5), rndvec(-10, 10)));
+	}
+
+	/*
+	 * Adds, moves and removes random shapes of a finalized scene, and
+	 * checks that the tree's cost stays under the given ratio if there's
+	 * one.
+	 */
+	void randomEdits(scene3d &sc, const dynamicbvh3d &tree, int count,
+			double maxRatio) {
+		for (int e = 0; e < count; e++) {
+			int n = (int) sc.getShapes().size();
+			int id = rand() % n;
+			switch (e % 3) {
+			case 0:
+				sc.insertShape(randomSphere());
+				break;
+			case 1:
+				sc.moveShape(id, rndvec(-10, 10));
+				break;
+			default:
+				sc.removeShape(id);
+				break;
+			}
+			if (maxRatio > 0) {
+				ASSERT_LT(tree.getCostRatio(), maxRatio) << "edit " << e;
+			}
+		}
+	}
+};
+
+/*
+ * Every ray must hit the same shape at the same time whether the scene uses
+ * the dynamic hierarchy or tests every shape.
+ */
+TEST_F(dynamicbvhTest, MatchesLinearScan) {
+	scene3d sc(false);
+	sc.setAccelerator(sp_dynamicbvh3d(new dynamicbvh3d()));
+	for (size_t i = 0; i < shapes.size(); i++)
+		sc.addShape(shapes[i]);
+	sc.finalize();
+	expectMatchesLinear(sc);
+}
+
+/*
+ * Adding, moving and removing shapes one at a time keeps the answers of a
+ * linear scan, and the tree is rebuilt whenever it costs more than the
+ * ratio allows.
+ */
+TEST_F(dynamicbvhTest, EditsMatchLinearScan) {
+	sp_dynamicbvh3d tree(new dynamicbvh3d(1.05));
+	scene3d sc(false);
+	sc.setAccelerator(tree);
+	for (size_t i = 0; i < shapes.size(); i++)
+		sc.addShape(shapes[i]);
+	sc.finalize();
+	ASSERT_EQ(1, tree->getRebuildCount());
+	ASSERT_DOUBLE_EQ(1, tree->getCostRatio());
+
+	randomEdits(sc, *tree, 600, 1.05);
+	expectMatchesLinear(sc);
+	ASSERT_LT(tree->getHeight(), 40);
+
+	// Scattering the shapes and refitting keeps the tree's topology, which
+	// then costs too much and is rebuilt.
+	int builds = tree->getRebuildCount();
+	for (size_t i = 0; i < sc.getShapes().size(); i++) {
+		shape3d *s = sc.getShapes()[i].get();
+		shapedispatch<double, double, double, 3>::moveTo(
+				shapedispatch<double, double, double, 3>::kindOf(s), s,
+				rndvec(-10, 10));
+	}
+	sc.refit();
+	ASSERT_EQ(builds + 1, tree->getRebuildCount());
+	ASSERT_LT(tree->getCostRatio(), 1.05);
+	expectMatchesLinear(sc);
+
+	// With rebuilds turned off the tree degrades but stays correct.
+	sp_dynamicbvh3d never(new dynamicbvh3d(0));
+	sc.setAccelerator(never);
+	sc.finalize();
+	randomEdits(sc, *never, 600, 0);
+	expectMatchesLinear(sc);
+	ASSERT_EQ(1, never->getRebuildCount());
+}
+
+/*
+ * A rebuild on a thread of its own lets queries go on with the old tree,
+ * and is caught up with the edits made while it ran when it's swapped in.
+ */
+TEST_F(dynamicbvhTest, RebuildsInBackground) {
+	sp_dynamicbvh3d tree(new dynamicbvh3d(1.05, 0));
+	scene3d sc(false);
+	sc.setAccelerator(tree);
+	for (size_t i = 0; i < shapes.size(); i++)
+		sc.addShape(shapes[i]);
+	sc.finalize();
+
+	int e = 0;
+	while (!tree->isRebuilding()) {
+		ASSERT_LT(e++, 1000);
+		sc.moveShape(rand() % 300, rndvec(-10, 10));
+	}
+	// Edits that come while it runs, including to shapes it copied.
+	randomEdits(sc, *tree, 30, 0);
+	expectMatchesLinear(sc);
+	tree->waitForRebuild();
+	ASSERT_FALSE(tree->isRebuilding());
+	ASSERT_EQ(2, tree->getRebuildCount());
+	expectMatchesLinear(sc);
+
+	// A refit while a rebuild runs moves every leaf of the new tree.
+	while (!tree->isRebuilding())
+		sc.moveShape(rand() % 300, rndvec(-10, 10));
+	sc.refit();
+	tree->waitForRebuild();
+	expectMatchesLinear(sc);
+}
+
+/*
+ * Edits through the scene render to exactly what a scene built from
+ * scratch renders, and a dynamic tree renders what a SAH bvh does.
+ */
+TEST_F(dynamicbvhTest, RendersLikeRebuiltScene) {
+	scene3d edited(true);
+	edited.setAccelerator(makeNamedAccelerator<double, double, double>(
+			"dynamic", BVH_BUILD_SAH, 1));
+	edited.addPointLight(sp_lightd(new lightd(rgbcolord(1, 1, 1),
+			vector3d(0.0, 20.0, 20.0))));
+	for (size_t i = 0; i < shapes.size(); i++)
+		edited.addShape(shapes[i]);
+	edited.finalize();
+	for (int e = 0; e < 40; e++) {
+		edited.insertShape(randomSphere());
+		edited.moveShape(rand() % 300, rndvec(-10, 10));
+		edited.removeShape(rand() % 300);
+	}
+
+	scene3d fresh(true);
+	fresh.setAccelerator(sp_bvh3d(new bvh3d()));
+	fresh.addPointLight(sp_lightd(new lightd(rgbcolord(1, 1, 1),
+			vector3d(0.0, 20.0, 20.0))));
+	for (size_t i = 0; i < edited.getShapes().size(); i++)
+		fresh.addShape(edited.getShapes()[i]);
+	fresh.finalize();
+
+	camera<double, double, 3> cam(vector3d(0.0, 5.0, 30.0),
+			vector3d(0.0, 0.0, 0.0), vector3d(0.0, 1.0, 0.0));
+	std::vector<rgbcolord> a, b;
+	edited.renderImage(cam, 64, 48, a);
+	fresh.renderImage(cam, 64, 48, b);
+	ASSERT_EQ(a.size(), b.size());
+	for (size_t i = 0; i < a.size(); i++) {
+		ASSERT_EQ(a[i].getR(), b[i].getR()) << "pixel " << i;
+		ASSERT_EQ(a[i].getG(), b[i].getG()) << "pixel " << i;
+		ASSERT_EQ(a[i].getB(), b[i].getB()) << "pixel " << i;
+	}
+}
+
+#endif // TEST_DYNAMICBVH_CC
@@ -0,0 +1,42 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "fastmath.hh"
+#include "gtest/gtest.h"
+#include <cmath>
+
+#ifndef TEST_FASTMATH_CC
+#define TEST_FASTMATH_CC
+
+/*
+ * The reciprocal square roots stay within their documented relative error
+ * over many octaves, in both floats and doubles.
+ */
+TEST(fastmath, RsqrtWithinBound) {
+	for (int e = -40; e <= 40; e++) {
+		for (int i = 0; i < 256; i++) {
+			double x = std::ldexp(1 + i / 256.0, e);
+			ASSERT_NEAR(1, approxRsqrt(x) * std::sqrt(x), FASTMATH_RSQRT_ERROR)
+					<< x;
+			float xf = (float) x;
+			ASSERT_NEAR(1, approxRsqrt(xf) * std::sqrt((double) xf),
+					FASTMATH_RSQRT_ERROR) << x;
+		}
+	}
+}
+
+/*
+ * The arc cosines and sines stay within their documented absolute error
+ * over all of [-1, 1], ends included.
+ */
+TEST(fastmath, AcosWithinBound) {
+	for (int i = 0; i <= 20000; i++) {
+		double x = -1 + i / 10000.0;
+		ASSERT_NEAR(std::acos(x), approxAcos(x), FASTMATH_ACOS_ERROR) << x;
+		ASSERT_NEAR(std::asin(x), approxAsin(x), FASTMATH_ACOS_ERROR) << x;
+	}
+}
+
+#endif // TEST_FASTMATH_CC
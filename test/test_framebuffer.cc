@@ -0,0 +1,237 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "framebuffer.hh"
+#include "rgbcolor.hh"
+#include "simd.hh"
+#include "gtest/gtest.h"
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef TEST_FRAMEBUFFER_CC
+#define TEST_FRAMEBUFFER_CC
+
+/*
+ * Fills an image with colors from black to twice as bright as white, some
+ * of them negative, so quantizing has to clamp both ways.
+ */
+template<typename T>
+framebuffer<T> makeHDRImage(int width, int height) {
+	framebuffer<T> fb(width, height);
+	std::vector<rgbcolor<T> > &px = fb.getPixels();
+	for (size_t i = 0; i < px.size(); i++) {
+		px[i] = rgbcolor<T>((i % 101) / (T) 100, (i % 37) / (T) 36, 1);
+		px[i] *= (T) (i % 5) / 2;
+		if (i % 11 == 0)
+			px[i] -= rgbcolor<T>(1, 1, 1);
+	}
+	return fb;
+}
+
+/*
+ * Every kernel quantizes to the same values as scaling, clamping and
+ * truncating one channel at a time.
+ */
+template<typename T>
+void checkQuantize() {
+	framebuffer<T> fb = makeHDRImage<T>(13, 7);
+	simdLevel old = activeSimdLevel();
+	for (int level = SIMD_SCALAR; level <= SIMD_AVX512; level++) {
+		setSimdLevel((simdLevel) level);
+		std::vector<unsigned char> rgb;
+		fb.quantize(rgb, (T) 0.75);
+		ASSERT_EQ(fb.getPixels().size() * 3, rgb.size());
+		for (size_t i = 0; i < fb.getPixels().size(); i++) {
+			rgbcolor<T> c = fb.getPixels()[i];
+			c *= (T) 0.75 * QUANTIZE_MAX;
+			c.clamp(0, QUANTIZE_MAX);
+			ASSERT_EQ((int) c.getR(), rgb[3 * i]);
+			ASSERT_EQ((int) c.getG(), rgb[3 * i + 1]);
+			ASSERT_EQ((int) c.getB(), rgb[3 * i + 2]);
+		}
+	}
+	setSimdLevel(old);
+}
+
+TEST(framebuffer, QuantizeMatchesScalar) {
+	checkQuantize<float>();
+	checkQuantize<double>();
+}
+
+TEST(framebuffer, FloatToHalf) {
+	ASSERT_EQ(0x0000, floatToHalf(0.0f));
+	ASSERT_EQ(0x8000, floatToHalf(-0.0f));
+	ASSERT_EQ(0x3c00, floatToHalf(1.0f));
+	ASSERT_EQ(0x3800, floatToHalf(0.5f));
+	ASSERT_EQ(0xc000, floatToHalf(-2.0f));
+	ASSERT_EQ(0x3555, floatToHalf(1 / 3.0f));
+	ASSERT_EQ(0x7bff, floatToHalf(65504.0f));
+	ASSERT_EQ(0x7c00, floatToHalf(1e6f));
+	ASSERT_EQ(0x0400, floatToHalf(6.103515625e-05f)); // smallest normal
+	ASSERT_EQ(0x0001, floatToHalf(5.9604645e-08f)); // smallest subnormal
+	ASSERT_EQ(0x0000, floatToHalf(2e-8f));
+	// Halfway between 1 and the half after it rounds to even.
+	ASSERT_EQ(0x3c00, floatToHalf(1.00048828125f));
+	ASSERT_EQ(0x3c02, floatToHalf(1.00146484375f));
+}
+
+/*
+ * PFM keeps the colors as floats, bottom row first.
+ */
+TEST(framebuffer, PFMKeepsColors) {
+	framebuffer<double> fb = makeHDRImage<double>(5, 3);
+	std::stringstream ss;
+	fb.writePFM(ss);
+	std::string magic, scale;
+	int w, h;
+	ss >> magic >> w >> h >> scale;
+	ss.get();
+	ASSERT_EQ("PF", magic);
+	ASSERT_EQ(5, w);
+	ASSERT_EQ(3, h);
+	ASSERT_EQ("-1.0", scale); // little-endian
+	std::vector<float> data(5 * 3 * 3);
+	ss.read(reinterpret_cast<char *>(&data[0]), data.size() * sizeof(float));
+	ASSERT_EQ((std::streamsize) (data.size() * sizeof(float)), ss.gcount());
+	ASSERT_EQ(EOF, ss.peek());
+	for (int y = 0; y < 3; y++)
+		for (int x = 0; x < 5; x++) {
+			const rgbcolor<double> &c = fb.getPixels()[y * 5 + x];
+			const float *f = &data[((2 - y) * 5 + x) * 3];
+			ASSERT_EQ((float) c.getR(), f[0]);
+			ASSERT_EQ((float) c.getG(), f[1]);
+			ASSERT_EQ((float) c.getB(), f[2]);
+		}
+	ASSERT_TRUE(data[3 * 5 * 3 - 1] > 1 || data[2] > 1);
+}
+
+/*
+ * The EXR file has the magic number, an offset per row that points at the
+ * row, and half float channels in B, G, R order.
+ */
+TEST(framebuffer, EXRLayout) {
+	framebuffer<float> fb = makeHDRImage<float>(4, 3);
+	std::stringstream ss;
+	fb.writeEXR(ss);
+	std::string exr = ss.str();
+	const unsigned char *u =
+			reinterpret_cast<const unsigned char *>(exr.data());
+	ASSERT_EQ(0x76, u[0]);
+	ASSERT_EQ(0x2f, u[1]);
+	ASSERT_EQ(0x31, u[2]);
+	ASSERT_EQ(0x01, u[3]);
+	ASSERT_EQ(2, u[4]);
+	size_t headerEnd = exr.find(std::string("screenWindowWidth\0float\0", 24));
+	ASSERT_NE(std::string::npos, headerEnd);
+	headerEnd += 24 + 4 + 4 + 1;
+	size_t rowBytes = 8 + 4 * 3 * 2;
+	ASSERT_EQ(headerEnd + 3 * 8 + 3 * rowBytes, exr.size());
+	for (int y = 0; y < 3; y++) {
+		unsigned long long offset = 0;
+		for (int i = 7; i >= 0; i--)
+			offset = offset << 8 | u[headerEnd + y * 8 + i];
+		ASSERT_EQ(headerEnd + 3 * 8 + y * rowBytes, offset);
+		ASSERT_EQ(y, u[offset]);
+		ASSERT_EQ(4 * 3 * 2, u[offset + 4]);
+		for (int x = 0; x < 4; x++) {
+			const rgbcolor<float> &c = fb.getPixels()[y * 4 + x];
+			const unsigned char *p = u + offset + 8 + 2 * x;
+			ASSERT_EQ(floatToHalf(c.getB()), p[0] | p[1] << 8);
+			ASSERT_EQ(floatToHalf(c.getG()), p[8] | p[9] << 8);
+			ASSERT_EQ(floatToHalf(c.getR()), p[16] | p[17] << 8);
+		}
+	}
+}
+
+/*
+ * Every half converts to a float that converts back to it, and the
+ * fixed point values to their multiples of 1 / FIXED16_ONE.
+ */
+TEST(framebuffer, CompactConversions) {
+	for (unsigned int h = 0; h < 0x10000; h++) {
+		float f = halfToFloat((unsigned short) h);
+		if ((h & 0x7c00) == 0x7c00 && (h & 0x3ff))
+			ASSERT_NE(f, f) << h;
+		else
+			ASSERT_EQ(h, floatToHalf(f)) << h;
+	}
+	ASSERT_EQ(1.0f, halfToFloat(0x3c00));
+	ASSERT_EQ(5.9604645e-08f, halfToFloat(0x0001));
+	ASSERT_EQ(0, floatToFixed16(-1.0f));
+	ASSERT_EQ(FIXED16_ONE, floatToFixed16(1.0f));
+	ASSERT_EQ(65535, floatToFixed16(100.0f));
+	ASSERT_EQ(0, floatToFixed16(0.0f / 0.0f));
+	ASSERT_EQ(0.25f, fixed16ToFloat(floatToFixed16(0.25f)));
+}
+
+/*
+ * Compact images quantize the same with every kernel, to within a level
+ * of the full image, and keep colors to the precision of their storage
+ * in a quarter of the memory of doubles.
+ */
+TEST(framebuffer, CompactMatchesFull) {
+	framebuffer<double> fb = makeHDRImage<double>(13, 7);
+	const std::vector<rgbcolor<double> > &px = fb.getPixels();
+	std::vector<unsigned char> full;
+	fb.quantize(full, 0.75);
+	pixelStorage storages[] = { PIXELS_HALF, PIXELS_FIXED16 };
+	for (int s = 0; s < 2; s++) {
+		compactframebuffer<double> cfb(13, 7, storages[s]);
+		cfb.putRows(0, &px[0], 3);
+		cfb.putRows(3, &px[3 * 13], 4);
+		ASSERT_EQ(px.size() * sizeof(px[0]) / 4, cfb.getMemoryUsage());
+
+		std::vector<rgbcolor<double> > row(13);
+		for (int y = 0; y < 7; y++) {
+			cfb.getRow(y, &row[0]);
+			for (int x = 0; x < 13; x++) {
+				rgbcolor<double> c = px[y * 13 + x];
+				if (storages[s] == PIXELS_FIXED16)
+					c.clamp(0, 16);
+				ASSERT_NEAR(c.getR(), row[x].getR(), 1.0 / 1024);
+				ASSERT_NEAR(c.getB(), row[x].getB(), 1.0 / 1024);
+			}
+		}
+
+		simdLevel old = activeSimdLevel();
+		std::vector<unsigned char> scalar;
+		for (int level = SIMD_SCALAR; level <= SIMD_AVX512; level++) {
+			setSimdLevel((simdLevel) level);
+			std::vector<unsigned char> rgb;
+			cfb.quantize(rgb, 0.75);
+			ASSERT_EQ(full.size(), rgb.size());
+			if (level == SIMD_SCALAR)
+				scalar = rgb;
+			for (size_t i = 0; i < rgb.size(); i++) {
+				ASSERT_EQ(scalar[i], rgb[i]) << level << " " << i;
+				ASSERT_NEAR(full[i], rgb[i], 1) << i;
+			}
+		}
+		setSimdLevel(old);
+	}
+}
+
+/*
+ * A compact image of halves writes the same OpenEXR file as the full
+ * image, straight from its channels.
+ */
+TEST(framebuffer, CompactEXR) {
+	framebuffer<float> fb = makeHDRImage<float>(4, 3);
+	compactframebuffer<float> cfb(4, 3, PIXELS_HALF);
+	cfb.putRows(0, &fb.getPixels()[0], 3);
+	std::stringstream full, compact;
+	fb.writeEXR(full);
+	cfb.writeEXR(compact);
+	ASSERT_EQ(full.str(), compact.str());
+
+	std::stringstream pfm;
+	cfb.writePFM(pfm);
+	ASSERT_EQ(framebuffer<float>::pfmHeader(4, 3).size() + 4 * 3 * 12,
+			pfm.str().size());
+}
+
+#endif // TEST_FRAMEBUFFER_CC
@@ -0,0 +1,133 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "framecache.hh"
+#include "sceneparser.hh"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <utime.h>
+
+#ifndef TEST_FRAMECACHE_CC
+#define TEST_FRAMECACHE_CC
+
+/*
+ * Hashes the objects of a scene description, or only its shapes.
+ */
+static boost::uint64_t hashSceneText(const std::string &text,
+		bool shapes = false) {
+	scenetokenizer in(text.data(), text.data() + text.size());
+	scenedescription desc;
+	std::string error;
+	EXPECT_TRUE((parseScene<double, double>(in, "", desc, error))) << error;
+	scenehash hash;
+	if (shapes)
+		hashSceneShapes(hash, desc.records.empty() ? 0 : &desc.records[0],
+				desc.records.size(), desc.paths);
+	else
+		hashSceneRecords(hash, desc.records.empty() ? 0 : &desc.records[0],
+				desc.records.size(), desc.paths);
+	return hash.get();
+}
+
+/*
+ * Strings one after the other hash apart however they're split, and the
+ * hash is written as 16 hex digits.
+ */
+TEST(framecache, HashesStrings) {
+	scenehash a, b, c;
+	a.add(std::string("ab"));
+	a.add(std::string("c"));
+	b.add(std::string("a"));
+	b.add(std::string("bc"));
+	c.add(std::string("ab"));
+	c.add(std::string("c"));
+	ASSERT_NE(a.get(), b.get());
+	ASSERT_EQ(a.get(), c.get());
+	ASSERT_EQ(16u, a.toString().size());
+}
+
+/*
+ * Keys and where keyed objects start don't change the hash of a scene,
+ * but everything else about its objects does.
+ */
+TEST(framecache, HashesSceneWithoutKeys) {
+	std::string base = "camera <0, 3, 10> <0, 1, 0> <0, 1, 0>\n"
+			"sphere (1, 0, 0) 1 <-2, 1, 0> 0.25\nkey 4 <2, 1, 0>\n"
+			"light (1, 1, 1) <3, 8, 6>\n";
+	boost::uint64_t h = hashSceneText(base);
+	ASSERT_EQ(h, hashSceneText("camera <0, 3, 10> <0, 1, 0> <0, 1, 0>\n"
+			"sphere (1, 0, 0) 1 <0, 0, 0> 0.25\nkey 5 <2, 2, 0>\n"
+			"light (1, 1, 1) <3, 8, 6>\n"));
+	ASSERT_NE(h, hashSceneText("camera <0, 3, 10> <0, 1, 0> <0, 1, 0>\n"
+			"sphere (0, 1, 0) 1 <-2, 1, 0> 0.25\nkey 4 <2, 1, 0>\n"
+			"light (1, 1, 1) <3, 8, 6>\n"));
+	ASSERT_NE(h, hashSceneText("camera <0, 3, 10> <0, 1, 0> <0, 1, 0>\n"
+			"sphere (1, 0, 0) 1 <-2, 1, 0> 0.25\nkey 4 <2, 1, 0>\n"
+			"light (1, 1, 1) <3, 8, 7>\n"));
+	ASSERT_EQ(4, animatedField(RECORD_SPHERE));
+	ASSERT_EQ(1, animatedField(RECORD_CAMERA));
+	ASSERT_EQ(-1, animatedField(RECORD_MESH));
+}
+
+/*
+ * Lights, cameras and keys don't change the hash of the shapes of a scene,
+ * but where keyed shapes start does.
+ */
+TEST(framecache, HashesSceneShapes) {
+	std::string sphere = "sphere (1, 0, 0) 1 <-2, 1, 0> 0.25\n";
+	boost::uint64_t h = hashSceneText("camera <0, 3, 10> <0, 1, 0> <0, 1, 0>\n"
+			+ sphere + "key 4 <2, 1, 0>\nlight (1, 1, 1) <3, 8, 6>\n", true);
+	ASSERT_EQ(h, hashSceneText("camera <0, 2, 10> <0, 1, 0> <0, 1, 0>\n" +
+			sphere + "light (1, 1, 1) <3, 8, 7>\n", true));
+	ASSERT_NE(h, hashSceneText("camera <0, 3, 10> <0, 1, 0> <0, 1, 0>\n"
+			"sphere (1, 0, 0) 1 <0, 0, 0> 0.25\n", true));
+	ASSERT_NE(h, hashSceneText("camera <0, 3, 10> <0, 1, 0> <0, 1, 0>\n" +
+			sphere + "sphere (1, 0, 0) 1 <2, 1, 0> 0.25\n", true));
+}
+
+/*
+ * Only one node at a time holds the claim on a frame, until it's given up
+ * or goes stale, and copied files have the bytes of the original.
+ */
+TEST(framecache, ClaimsFrames) {
+	std::string lock = "/tmp/rt_test_framecache.lock";
+	std::string file = "/tmp/rt_test_framecache.ppm";
+	std::string copy = "/tmp/rt_test_framecache_copy.ppm";
+	std::remove(lock.c_str());
+	{
+		frameclaims one(0), other(1);
+		ASSERT_TRUE(one.claim(lock));
+		ASSERT_TRUE(fileExists(lock));
+		ASSERT_FALSE(other.claim(lock));
+		one.release(lock);
+		ASSERT_FALSE(fileExists(lock));
+		ASSERT_TRUE(other.claim(lock));
+		ASSERT_FALSE(one.claim(lock));
+
+		utimbuf old;
+		old.actime = old.modtime = time(0) - 10;
+		ASSERT_EQ(0, utime(lock.c_str(), &old));
+		frameclaims third(5);
+		ASSERT_TRUE(third.claim(lock));
+	}
+	ASSERT_FALSE(fileExists(lock));
+
+	{
+		std::ofstream out(file.c_str(), std::ios::out | std::ios::binary);
+		out << "P3 1 1 255\n1 2 3\n";
+	}
+	ASSERT_TRUE(copyFile(file, copy));
+	std::ifstream in(copy.c_str(), std::ios::in | std::ios::binary);
+	std::string line;
+	std::getline(in, line);
+	ASSERT_EQ("P3 1 1 255", line);
+	ASSERT_FALSE(copyFile("/tmp/rt_test_framecache_none.ppm", copy));
+	std::remove(file.c_str());
+	std::remove(copy.c_str());
+}
+
+#endif // TEST_FRAMECACHE_CC
@@ -0,0 +1,74 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "grid.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include "boost/shared_ptr.hpp"
+#include <vector>
+
+#ifndef TEST_GRID_CC
+#define TEST_GRID_CC
+
+/**
+ * Reuses the random shapes and rays from the BVH tests so that the two
+ * accelerators are checked against exactly the same data.
+ */
+class gridTest : public bvhTest { };
+
+/*
+ * Every ray must hit the same shape at the same time whether the scene uses
+ * the grid or tests every shape, and occlusion queries must agree too.
+ */
+TEST_F(gridTest, MatchesLinearScan) {
+	scene3d linear(false), accelerated(false);
+	accelerated.setAccelerator(sp_grid3d(new grid3d()));
+	for (size_t i = 0; i < shapes.size(); i++) {
+		linear.addShape(shapes[i]);
+		accelerated.addShape(shapes[i]);
+	}
+	accelerated.finalize();
+
+	for (size_t i = 0; i < rays.size(); i++) {
+		double t1, t2;
+		sp_shape3d s1 = linear.findClosestShape(rays[i], t1);
+		sp_shape3d s2 = accelerated.findClosestShape(rays[i], t2);
+		ASSERT_EQ(s1, s2);
+		ASSERT_DOUBLE_EQ(t1, t2);
+
+		double tmax = 5 + (i % 10);
+		ASSERT_EQ(linear.isOccluded(rays[i], tmax),
+				accelerated.isOccluded(rays[i], tmax));
+	}
+}
+
+/*
+ * A flat layer of spheres still gets a usable grid, with one cell across the
+ * flat axis.
+ */
+TEST_F(gridTest, FlatScene) {
+	std::vector<sp_shape3d> flat;
+	rgbcolord col(0.5, 0.5, 0.5);
+	for (int x = 0; x < 10; x++)
+		for (int z = 0; z < 10; z++)
+			flat.push_back(sp_shape3d(new sphere3d(col, 0.25,
+					vector3d((double) x, 0.0, (double) z))));
+	grid3d g;
+	g.build(flat);
+	ASSERT_GT(g.getResolution(0), 1);
+	ASSERT_GT(g.getResolution(2), 1);
+
+	ray3d r(vector3d(3.0, 10.0, 4.0), vector3d(0.0, -1.0, 0.0));
+	double t;
+	ASSERT_EQ(34, g.closestHit(r, t));
+	ASSERT_DOUBLE_EQ(9.75, t);
+	ASSERT_EQ(34, g.anyHit(r, 10));
+	ASSERT_EQ(-1, g.anyHit(r, 9.5));
+}
+
+#endif // TEST_GRID_CC
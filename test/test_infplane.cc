@@ -122,6 +122,47 @@ TEST_F(infplaneTest, Intersection) {
 	ASSERT_DOUBLE_EQ(sqrt(2), c->intersection(s));
 }
 
+/*
+ * Planes perpendicular to an axis, whatever the length and sign of their
+ * normals, hit rays at exactly the times of the dot product formula, and
+ * miss rays parallel to them or pointing away.
+ */
+TEST_F(infplaneTest, AxisAlignedMatchesDotProducts) {
+	const double normals[][3] = { { 0, 0.1, 0 }, { -2, 0, 0 },
+			{ 0, 0, -1 } };
+	for (int n = 0; n < 3; n++) {
+		vector3d normal(normals[n][0], normals[n][1], normals[n][2]);
+		infplaned p(rgbcolord(0.4, 0.5, 0.6), 1.5, normal);
+		infplaned copy(p);
+		for (int i = 0; i < 200; i++) {
+			vector3d orig(i % 7 - 3.0, i % 5 - 2.5, i % 3 * 1.25);
+			vector3d dir(i % 4 - 1.5, (i % 9 - 4) * 0.3, i % 2 - 0.25 * n);
+			if (i % 10 == 0)
+				dir[n == 0 ? 1 : n == 1 ? 0 : 2] = 0;
+			ray3d r(orig, dir);
+			double denom = r.getDir() * p.getSurfNorm();
+			double t = RAY_MISS;
+			if (denom != 0) {
+				t = -(r.getOrig() * p.getSurfNorm() + p.getDist()) / denom;
+				if (t < 0)
+					t = RAY_MISS;
+			}
+			ASSERT_EQ(t, p.intersection(r)) << "ray " << i;
+			ASSERT_EQ(t, copy.intersection(r)) << "ray " << i;
+		}
+	}
+}
+
+/*
+ * Planes are infinite so they must not report a bounding box.
+ */
+TEST_F(infplaneTest, NoBounds) {
+	aabb3d box;
+	ASSERT_FALSE(a->getBounds(box));
+	ASSERT_FALSE(b->getBounds(box));
+	ASSERT_TRUE(box.isEmpty());
+}
+
 /*
  * Exercises the << operator.
  */
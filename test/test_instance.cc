@@ -0,0 +1,133 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "instance.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "cylinder.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include "boost/shared_ptr.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#ifndef TEST_INSTANCE_CC
+#define TEST_INSTANCE_CC
+
+/**
+ * This test fixture class sets up an assembly of two spheres and a cylinder,
+ * several transformed instances of it, and the same scene built from
+ * explicitly transformed copies of the shapes. Note that an object of this
+ * class is created before each test case begins and is torn down when each
+ * test case ends.
+ */
+class instanceTest : public ::testing::Test {
+protected:
+
+	sp_assembly3d assem;
+	scene3d instanced, flat;
+
+	instanceTest() : instanced(false), flat(false) { }
+
+	virtual void SetUp() {
+		rgbcolord red(1, 0, 0), green(0, 1, 0), blue(0, 0, 1);
+		assem = sp_assembly3d(new assembly3d());
+		assem->addShape(sp_shape3d(new sphere3d(red, 1,
+				vector3d(0.0, 0.0, 0.0))));
+		assem->addShape(sp_shape3d(new sphere3d(green, 0.5,
+				vector3d(2.0, 0.0, 0.0))));
+		assem->addShape(sp_shape3d(new cylinderd(blue, 0.25,
+				vector3d(0.0, 2.0, 0.0), 1.5, vector3d(0.0, 1.0, 0.0))));
+		assem->finalize();
+
+		instanced.setAccelerator(sp_bvh3d(new bvh3d()));
+		flat.setAccelerator(sp_bvh3d(new bvh3d()));
+		for (int i = 0; i < 5; i++) {
+			vector3d offset(i * 6.0 - 12, i * 0.5, -i * 1.0);
+			double scale = 0.5 + 0.25 * i;
+			double angle = 0.7 * i;
+			vector3d axis(0.0, 0.0, 1.0);
+			boost::shared_ptr<instance3d> inst(new instance3d(assem, offset,
+					scale));
+			inst->setRotation(axis, angle);
+			instanced.addShape(inst);
+
+			// Rotating by angle around z.
+			double c = cos(angle), s = sin(angle);
+			vector3d ex(c, s, 0.0), ey(-s, c, 0.0);
+			flat.addShape(sp_shape3d(new sphere3d(red, scale, offset)));
+			flat.addShape(sp_shape3d(new sphere3d(green, 0.5 * scale,
+					offset + ex * (2 * scale))));
+			flat.addShape(sp_shape3d(new cylinderd(blue, 0.25 * scale,
+					offset + ey * (2 * scale), 1.5 * scale, ey)));
+		}
+		instanced.finalize();
+		flat.finalize();
+	}
+
+	virtual void TearDown() { }
+};
+
+/*
+ * Rays must hit an instance at the same time, with the same normal and the
+ * same shape color as the equivalent explicit shapes.
+ */
+TEST_F(instanceTest, MatchesFlatScene) {
+	srand(99);
+	int hits = 0;
+	for (int i = 0; i < 3000; i++) {
+		vector3d orig(-15 + 30 * (rand() / (double) RAND_MAX),
+				-5 + 10 * (rand() / (double) RAND_MAX), 20.0);
+		vector3d target(-15 + 30 * (rand() / (double) RAND_MAX),
+				-3 + 6 * (rand() / (double) RAND_MAX), -4.0);
+		ray3d r(orig, target - orig);
+		double t1, t2;
+		sp_shape3d s1 = instanced.findClosestShape(r, t1);
+		sp_shape3d s2 = flat.findClosestShape(r, t2);
+		ASSERT_EQ(s1 == 0, s2 == 0);
+		if (s1 == 0)
+			continue;
+		hits++;
+		ASSERT_NEAR(t2, t1, 1e-9);
+
+		hitrecord3d rec1, rec2;
+		ASSERT_TRUE(instanced.findClosestHit(r, rec1));
+		ASSERT_TRUE(flat.findClosestHit(r, rec2));
+		ASSERT_EQ(s1, instanced.getShapes()[rec1.id]);
+		const shape3d *h1 = rec1.obj, *h2 = rec2.obj;
+		ASSERT_TRUE(h1 != s1.get());
+		vector3d N1 = rec1.normal, N2 = rec2.normal;
+		ASSERT_EQ(h2->getColor().getR(), h1->getColor().getR());
+		ASSERT_EQ(h2->getColor().getG(), h1->getColor().getG());
+		ASSERT_EQ(h2->getColor().getB(), h1->getColor().getB());
+		for (int j = 0; j < 3; j++)
+			ASSERT_NEAR(N2[j], N1[j], 1e-9);
+		ASSERT_TRUE(instanced.isOccluded(r, t1 + 1e-6));
+		ASSERT_FALSE(instanced.isOccluded(r, t1 - 1e-6));
+	}
+	ASSERT_GT(hits, 100);
+}
+
+/*
+ * The instance's box must enclose its transformed shapes.
+ */
+TEST_F(instanceTest, Bounds) {
+	instance3d inst(assem, vector3d(10.0, 0.0, 0.0), 2);
+	inst.setRotation(vector3d(0.0, 0.0, 1.0), M_PI / 2);
+	aabb3d box;
+	ASSERT_TRUE(inst.getBounds(box));
+	// The green sphere ends up at (10, 4, 0) with radius 1.
+	ASSERT_LE(box.getMin()[0], 8 + 1e-9);
+	ASSERT_GE(box.getMax()[1], 5 - 1e-9);
+	ASSERT_NEAR(-2, box.getMin()[2], 1e-9);
+	ASSERT_NEAR(2, box.getMax()[2], 1e-9);
+
+	instance3d none(sp_assembly3d(new assembly3d()), vector3d(0.0, 0.0, 0.0));
+	ASSERT_FALSE(none.getBounds(box));
+}
+
+#endif // TEST_INSTANCE_CC
@@ -0,0 +1,117 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "lazybvh.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "mvector.hh"
+#include "parallel.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include "boost/shared_ptr.hpp"
+#include <vector>
+
+#ifndef TEST_LAZYBVH_CC
+#define TEST_LAZYBVH_CC
+
+/**
+ * Reuses the random shapes and rays from the BVH tests.
+ */
+class lazybvhTest : public bvhTest { };
+
+/*
+ * Finds the closest hits of a range of rays, for tracing from several
+ * threads at once.
+ */
+struct lazybvhTracer {
+	const scene3d *sc;
+	const std::vector<ray3d> *rays;
+	std::vector<sp_shape3d> *hits;
+
+	void operator()(int lo, int hi) const {
+		double t;
+		for (int i = lo; i < hi; i++)
+			(*hits)[i] = sc->findClosestShape((*rays)[i], t);
+	}
+};
+
+/*
+ * Every ray must hit the same shape at the same time whether the scene
+ * builds its tree as rays need it or tests every shape, and occlusion
+ * queries must agree too, however much is built up front.
+ */
+TEST_F(lazybvhTest, MatchesLinearScan) {
+	for (int depth = 0; depth <= 4; depth += 2) {
+		scene3d linear(false), accelerated(false);
+		accelerated.setAccelerator(sp_lazybvh3d(new lazybvh3d(depth)));
+		for (size_t i = 0; i < shapes.size(); i++) {
+			linear.addShape(shapes[i]);
+			accelerated.addShape(shapes[i]);
+		}
+		accelerated.finalize();
+
+		for (size_t i = 0; i < rays.size(); i++) {
+			double t1, t2;
+			sp_shape3d s1 = linear.findClosestShape(rays[i], t1);
+			sp_shape3d s2 = accelerated.findClosestShape(rays[i], t2);
+			ASSERT_EQ(s1, s2);
+			ASSERT_DOUBLE_EQ(t1, t2);
+
+			double tmax = 5 + (i % 10);
+			ASSERT_EQ(linear.isOccluded(rays[i], tmax),
+					accelerated.isOccluded(rays[i], tmax));
+		}
+	}
+}
+
+/*
+ * Only the subtrees that rays enter are built, and threads racing into the
+ * same subtrees build each one once and agree with one thread.
+ */
+TEST_F(lazybvhTest, BuildsOnDemand) {
+	std::vector<sp_shape3d> bounded(shapes.begin(), shapes.end() - 1);
+	lazybvh3d tree(3);
+	tree.build(bounded);
+	ASSERT_EQ(8, tree.getSubtreeCount());
+	ASSERT_EQ(0, tree.getBuiltCount());
+	int topNodes = tree.getNodeCount();
+	ASSERT_EQ(15, topNodes);
+
+	// A ray that misses everything builds nothing.
+	double t;
+	ASSERT_EQ(-1, tree.closestHit(ray3d(vector3d(0.0, 100.0, 0.0),
+			vector3d(0.0, 1.0, 0.0)), t));
+	ASSERT_EQ(0, tree.getBuiltCount());
+
+	// One that hits something builds at least the subtree it hits in.
+	int i = 0;
+	while (tree.closestHit(rays[i], t) < 0)
+		i++;
+	int built = tree.getBuiltCount();
+	ASSERT_GT(built, 0);
+	ASSERT_LT(built, tree.getSubtreeCount());
+	ASSERT_GT(tree.getNodeCount(), topNodes);
+
+	scene3d eager(false), lazy(false);
+	eager.setAccelerator(sp_lazybvh3d(new lazybvh3d(BVH_MAX_DEPTH)));
+	sp_lazybvh3d shared(new lazybvh3d(2));
+	lazy.setAccelerator(shared);
+	for (size_t i = 0; i < shapes.size(); i++) {
+		eager.addShape(shapes[i]);
+		lazy.addShape(shapes[i]);
+	}
+	eager.finalize();
+	lazy.finalize();
+	std::vector<sp_shape3d> expected(rays.size()), hits(rays.size());
+	lazybvhTracer tracer = { &eager, &rays, &expected };
+	tracer(0, (int) rays.size());
+	tracer.sc = &lazy;
+	tracer.hits = &hits;
+	parallelFor(0, (int) rays.size(), 8, tracer);
+	ASSERT_TRUE(expected == hits);
+	ASSERT_EQ(shared->getSubtreeCount(), shared->getBuiltCount());
+}
+
+#endif // TEST_LAZYBVH_CC
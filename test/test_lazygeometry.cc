@@ -0,0 +1,122 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "lazygeometry.hh"
+#include "instance.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "light.hh"
+#include "camera.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include "boost/shared_ptr.hpp"
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifndef TEST_LAZYGEOMETRY_CC
+#define TEST_LAZYGEOMETRY_CC
+
+/*
+ * A source of one sphere that counts how often it's asked, or that fails.
+ */
+class countingsource : public geometrysource<double, double, double, 3> {
+public:
+	mutable int loads;
+	bool fails;
+	vector3d center;
+
+	countingsource(const vector3d &center, bool fails = false) : loads(0),
+			fails(fails), center(center) { }
+
+	bool load(assembly3d &assem, std::string &error) const {
+		loads++;
+		if (fails) {
+			error = "no shapes here.";
+			return false;
+		}
+		assem.addShape(sp_shape3d(new sphere3d(rgbcolord(0, 1, 0), 1,
+				center)));
+		return true;
+	}
+
+	void printHelper(std::ostream &os) const {
+		os << "counting";
+	}
+};
+
+/*
+ * Makes a lazy sphere around the given center.
+ */
+static boost::shared_ptr<lazygeometry3d> makeLazySphere(
+		const boost::shared_ptr<countingsource> &source) {
+	vector3d half(1.0, 1.0, 1.0);
+	return boost::shared_ptr<lazygeometry3d>(new lazygeometry3d(source,
+			aabb3d(source->center - half, source->center + half)));
+}
+
+/*
+ * Only the geometry rays reach is loaded, once, and it renders like the
+ * shapes it stands for.
+ */
+TEST(lazygeometry, LoadsWhenReached) {
+	boost::shared_ptr<countingsource> seen(new countingsource(
+			vector3d(0.0, 0.0, 0.0)));
+	boost::shared_ptr<countingsource> behind(new countingsource(
+			vector3d(0.0, 0.0, -20.0)));
+	boost::shared_ptr<lazygeometry3d> a = makeLazySphere(seen);
+	boost::shared_ptr<lazygeometry3d> b = makeLazySphere(behind);
+	ASSERT_EQ(lazygeometry3d::GEOMETRY_UNLOADED, a->getState());
+
+	scene3d lazy(false), flat(false);
+	lazy.setAccelerator(sp_bvh3d(new bvh3d()));
+	flat.setAccelerator(sp_bvh3d(new bvh3d()));
+	lazy.addShape(a);
+	lazy.addShape(b);
+	flat.addShape(sp_shape3d(new sphere3d(rgbcolord(0, 1, 0), 1,
+			vector3d(0.0, 0.0, 0.0))));
+	lazy.addPointLight(sp_lightd(new lightd(
+			rgbcolord(1, 1, 1), vector3d(0.0, 5.0, 5.0))));
+	flat.addPointLight(sp_lightd(new lightd(
+			rgbcolord(1, 1, 1), vector3d(0.0, 5.0, 5.0))));
+	lazy.finalize();
+	flat.finalize();
+	ASSERT_EQ(0, seen->loads);
+
+	camera<double, double, 3> cam(vector3d(0.0, 0.0, 5.0),
+			vector3d(0.0, 0.0, 0.0), vector3d(0.0, 1.0, 0.0));
+	std::vector<rgbcolor<double> > x, y;
+	lazy.renderImage(cam, 24, 16, x);
+	flat.renderImage(cam, 24, 16, y);
+	ASSERT_EQ(1, seen->loads);
+	ASSERT_EQ(0, behind->loads);
+	ASSERT_EQ(lazygeometry3d::GEOMETRY_LOADED, a->getState());
+	ASSERT_EQ(lazygeometry3d::GEOMETRY_UNLOADED, b->getState());
+	ASSERT_EQ(x.size(), y.size());
+	for (size_t i = 0; i < x.size(); i++) {
+		ASSERT_EQ(y[i].getR(), x[i].getR());
+		ASSERT_EQ(y[i].getG(), x[i].getG());
+		ASSERT_EQ(y[i].getB(), x[i].getB());
+	}
+}
+
+/*
+ * A failed source is asked once, leaves nothing to hit and says why.
+ */
+TEST(lazygeometry, ReportsFailure) {
+	boost::shared_ptr<countingsource> source(new countingsource(
+			vector3d(0.0, 0.0, 0.0), true));
+	boost::shared_ptr<lazygeometry3d> g = makeLazySphere(source);
+	ASSERT_EQ("", g->getError());
+	ray3d r(vector3d(0.0, 0.0, 5.0), vector3d(0.0, 0.0, -1.0));
+	ASSERT_EQ(RAY_MISS, g->intersection(r));
+	ASSERT_EQ(RAY_MISS, g->intersection(r));
+	ASSERT_EQ(1, source->loads);
+	ASSERT_EQ(lazygeometry3d::GEOMETRY_FAILED, g->getState());
+	ASSERT_EQ("no shapes here.", g->getError());
+}
+
+#endif // TEST_LAZYGEOMETRY_CC
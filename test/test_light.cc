@@ -4,6 +4,7 @@
  */
 
 #include "light.hh"
+#include "spotlight.hh"
 #include "mvector.hh"
 #include "rgbcolor.hh"
 #include "gtest/gtest.h"
@@ -113,4 +114,48 @@ TEST_F(lightTest, Print) {
 			"[light. position: <1, 2, 3>]", cstring);
 }
 
+/*
+ * Point lights give one sample from their position, and spotlights only
+ * sample points inside their cones, all through the light interface.
+ */
+TEST_F(lightTest, Sample) {
+	lightsample<double, double, 3> s;
+	vector3d X(1.0, 2.0, 0.0);
+	const lightd &l = *a;
+	ASSERT_EQ(1, l.getSampleCount(16));
+	ASSERT_TRUE(l.sample(X, 0, 1, s));
+	ASSERT_DOUBLE_EQ(3, s.dist);
+	ASSERT_DOUBLE_EQ(1, s.dir[2]);
+	ASSERT_DOUBLE_EQ(0.3, s.color.getG());
+
+	spotlightd spot(rgbcolord(1, 1, 1), vector3d(0.0, 0.0, 5.0),
+			vector3d(0.0, 0.0, -1.0), 0.5);
+	const lightd &sl = spot;
+	ASSERT_TRUE(sl.sample(vector3d(0.5, 0.0, 0.0), 0, 1, s));
+	ASSERT_FALSE(sl.sample(vector3d(5.0, 0.0, 0.0), 0, 1, s));
+	ASSERT_TRUE(l.canCluster());
+	ASSERT_FALSE(sl.canCluster());
+}
+
+/*
+ * A spotlight with a falloff angle is at full strength inside the inner cone
+ * and fades out towards the edge of its cone.
+ */
+TEST_F(lightTest, SpotlightFalloff) {
+	lightsample<double, double, 3> s;
+	spotlightd spot(rgbcolord(1, 1, 1), vector3d(0.0, 0.0, 1.0),
+			vector3d(0.0, 0.0, -2.0), 0.5, 0.2);
+	ASSERT_DOUBLE_EQ(-1, spot.getDir()[2]);
+	ASSERT_TRUE(spot.sample(vector3d(tan(0.2), 0.0, 0.0), 0, 1, s));
+	ASSERT_DOUBLE_EQ(1, s.color.getR());
+	ASSERT_TRUE(spot.sample(vector3d(tan(0.45), 0.0, 0.0), 0, 1, s));
+	ASSERT_GT(s.color.getR(), 0);
+	ASSERT_LT(s.color.getR(), 0.5);
+	ASSERT_FALSE(spot.sample(vector3d(tan(0.55), 0.0, 0.0), 0, 1, s));
+
+	spot.setFalloff(0);
+	ASSERT_TRUE(spot.sample(vector3d(tan(0.45), 0.0, 0.0), 0, 1, s));
+	ASSERT_DOUBLE_EQ(1, s.color.getR());
+}
+
 #endif // TEST_LIGHT_CC
@@ -0,0 +1,139 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "lightpack.hh"
+#include "light.hh"
+#include "spotlight.hh"
+#include "simd.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include <cstdlib>
+#include <vector>
+
+#ifndef TEST_LIGHTPACK_CC
+#define TEST_LIGHTPACK_CC
+
+/**
+ * This test fixture class sets up a few hundred random point lights with
+ * some spotlights mixed in, packed in the order they were made, and a batch
+ * of random shading points with unit normals. Note that an object of this
+ * class is created before each test case begins and is torn down when each
+ * test case ends.
+ */
+class lightpackTest : public ::testing::Test {
+protected:
+
+	std::vector<sp_lightd> lights;
+	std::vector<vector3d> points, normals;
+	lightpack3d pack;
+
+	static double rnd(double lo, double hi) {
+		return lo + (hi - lo) * (rand() / (double) RAND_MAX);
+	}
+
+	static vector3d rndvec(double lo, double hi) {
+		return vector3d(rnd(lo, hi), rnd(lo, hi), rnd(lo, hi));
+	}
+
+	virtual void SetUp() {
+		srand(2468);
+		for (int i = 0; i < 301; i++) {
+			rgbcolord col(rnd(0, 1), rnd(0, 1), rnd(0, 1));
+			if (i % 23 == 4)
+				lights.push_back(sp_lightd(new spotlightd(col,
+						rndvec(-10, 10), vector3d(0.0, -1.0, 0.0), 0.5f)));
+			else
+				lights.push_back(sp_lightd(new lightd(col, rndvec(-10, 10))));
+			pack.add(lights.back().get());
+		}
+		for (int i = 0; i < 200; i++) {
+			points.push_back(rndvec(-3, 3));
+			normals.push_back(rndvec(-1, 1).norm());
+		}
+	}
+
+	/*
+	 * Over every lane group, the pack must drop exactly the point lights
+	 * behind the surface and make the samples of the others bit for bit as
+	 * the lights' own sample does.
+	 */
+	void checkMatchesSample() {
+		lightpack3d::group g;
+		lightsample<double, double, 3> s, t;
+		int facing = 0, behind = 0;
+		for (size_t p = 0; p < points.size(); p++) {
+			int width;
+			for (int i = 0; i < pack.size(); i += width) {
+				int mask = pack.facing(activeSimdLevel(), i, points[p],
+						normals[p], g, width);
+				ASSERT_GE(width, 1);
+				for (int k = 0; k < width && i + k < pack.size(); k++) {
+					if (!pack.isPacked(i + k))
+						continue;
+					ASSERT_TRUE(lights[i + k]->sample(points[p], 0, 1, t));
+					bool front = !(t.dir * normals[p] <= 0);
+					ASSERT_EQ(front, ((mask >> k) & 1) != 0);
+					if (!front) {
+						behind++;
+						continue;
+					}
+					facing++;
+					pack.getSample(i + k, g, k, s);
+					for (int a = 0; a < 3; a++) {
+						ASSERT_EQ(t.pos[a], s.pos[a]);
+						ASSERT_EQ(t.dir[a], s.dir[a]);
+					}
+					ASSERT_EQ(t.dist, s.dist);
+					ASSERT_EQ(t.color.getR(), s.color.getR());
+					ASSERT_EQ(t.color.getG(), s.color.getG());
+					ASSERT_EQ(t.color.getB(), s.color.getB());
+				}
+			}
+		}
+		ASSERT_GT(facing, 1000);
+		ASSERT_GT(behind, 1000);
+	}
+
+	virtual void TearDown() { }
+};
+
+/*
+ * The pack must match the lights' own samples with every instruction set
+ * this machine has.
+ */
+TEST_F(lightpackTest, MatchesSample) {
+	ASSERT_EQ((int) lights.size(), pack.size());
+	ASSERT_EQ(288, pack.getPackedCount());
+	ASSERT_TRUE(pack.isPacked(0));
+	ASSERT_FALSE(pack.isPacked(4));
+
+	simdLevel saved = activeSimdLevel();
+	for (int level = SIMD_SCALAR; level <= detectSimdLevel(); level++) {
+		ASSERT_EQ(level, setSimdLevel((simdLevel) level));
+		checkMatchesSample();
+	}
+	setSimdLevel(saved);
+}
+
+/*
+ * Moving or recoloring any light must make the pack out of date until it's
+ * made again.
+ */
+TEST_F(lightpackTest, NoticesEdits) {
+	ASSERT_TRUE(pack.isCurrent());
+	lights[7]->setPos(vector3d(1.0, 2.0, 3.0));
+	ASSERT_FALSE(pack.isCurrent());
+
+	pack.clear();
+	ASSERT_EQ(0, pack.size());
+	for (size_t i = 0; i < lights.size(); i++)
+		pack.add(lights[i].get());
+	ASSERT_TRUE(pack.isCurrent());
+	lights[9]->setColor(rgbcolord(0.1, 0.2, 0.3));
+	ASSERT_FALSE(pack.isCurrent());
+}
+
+#endif // TEST_LIGHTPACK_CC
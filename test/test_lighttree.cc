@@ -0,0 +1,213 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "lighttree.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "infplane.hh"
+#include "light.hh"
+#include "spotlight.hh"
+#include "arealight.hh"
+#include "rendercontext.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#ifndef TEST_LIGHTTREE_CC
+#define TEST_LIGHTTREE_CC
+
+/**
+ * This test fixture class sets up a cloud of random point lights. Note that
+ * an object of this class is created before each test case begins and is
+ * torn down when each test case ends.
+ */
+class lighttreeTest : public ::testing::Test {
+protected:
+
+	std::vector<vector3d> pos;
+	std::vector<aabb3d> boxes;
+	std::vector<rgbcolord> colors;
+	std::vector<bool> canCluster;
+	lighttree3d tree;
+
+	static double rnd(double lo, double hi) {
+		return lo + (hi - lo) * (rand() / (double) RAND_MAX);
+	}
+
+	virtual void SetUp() {
+		srand(99);
+		for (int i = 0; i < 500; i++) {
+			pos.push_back(vector3d(rnd(-10, 10), rnd(-10, 10), rnd(-10, 10)));
+			colors.push_back(rgbcolord(rnd(0, 1), rnd(0, 1), rnd(0, 1)));
+			canCluster.push_back(true);
+			boxes.push_back(aabb3d());
+			boxes.back().extend(pos.back());
+		}
+		tree.build(boxes, colors, canCluster);
+	}
+
+	virtual void TearDown() { }
+};
+
+/*
+ * Every light in front of the tangent plane must be kept, and nothing
+ * gets clustered unless asked to.
+ */
+TEST_F(lighttreeTest, Culling) {
+	vector3d X(0.5, -1.0, 2.0), N = vector3d(0.3, 1.0, -0.2).norm();
+	std::vector<int> lights, clusters;
+	tree.collect(X, N, 0, lights, clusters);
+	ASSERT_TRUE(clusters.empty());
+	std::sort(lights.begin(), lights.end());
+	int front = 0;
+	for (int i = 0; i < (int) pos.size(); i++) {
+		if ((pos[i] - X) * N > 0) {
+			front++;
+			ASSERT_TRUE(std::binary_search(lights.begin(), lights.end(), i));
+		}
+	}
+	ASSERT_GT(front, 100);
+	ASSERT_LT((int) lights.size(), (int) pos.size());
+	// Boxes that straddle the plane let a few lights behind it through.
+	ASSERT_LT((int) lights.size(), front + 50);
+}
+
+/*
+ * With clustering, every light in front of the plane must be accounted for
+ * exactly once, either on its own or by a cluster whose color is the sum of
+ * its lights.
+ */
+TEST_F(lighttreeTest, Clustering) {
+	vector3d X(0.0, -40.0, 0.0), N(0.0, 1.0, 0.0);
+	std::vector<int> lights, clusters;
+	tree.collect(X, N, 0.5, lights, clusters);
+	ASSERT_FALSE(clusters.empty());
+	rgbcolord total;
+	for (size_t i = 0; i < lights.size(); i++)
+		total += colors[lights[i]];
+	for (size_t i = 0; i < clusters.size(); i++) {
+		total += tree.getClusterColor(clusters[i]);
+		int rep = tree.getClusterRep(clusters[i]);
+		for (int a = 0; a < 3; a++)
+			ASSERT_EQ(pos[rep][a], tree.getClusterPos(clusters[i])[a]);
+	}
+	rgbcolord expected;
+	for (size_t i = 0; i < colors.size(); i++)
+		expected += colors[i];
+	ASSERT_NEAR(expected.getR(), total.getR(), 1e-9);
+	ASSERT_NEAR(expected.getG(), total.getG(), 1e-9);
+	ASSERT_NEAR(expected.getB(), total.getB(), 1e-9);
+	ASSERT_LT((int) (lights.size() + clusters.size()), (int) pos.size() / 4);
+
+	// Spotlights and the like are never merged.
+	std::vector<bool> none(pos.size(), false);
+	tree.build(boxes, colors, none);
+	tree.collect(X, N, 0.5, lights, clusters);
+	ASSERT_TRUE(clusters.empty());
+	ASSERT_EQ(pos.size(), lights.size());
+}
+
+/*
+ * A lightcut must account for every light in front of the plane exactly
+ * once, and be small for a point far from the lights. With no error allowed
+ * it holds only lights, and spotlights and the like are never merged.
+ */
+TEST_F(lighttreeTest, Lightcut) {
+	vector3d X(0.0, -40.0, 0.0), N(0.0, 1.0, 0.0);
+	std::vector<int> lights, clusters;
+	tree.cut(X, N, 0.02, lights, clusters);
+	ASSERT_FALSE(clusters.empty());
+	ASSERT_LT((int) (lights.size() + clusters.size()), (int) pos.size() / 4);
+	rgbcolord total;
+	for (size_t i = 0; i < lights.size(); i++)
+		total += colors[lights[i]];
+	for (size_t i = 0; i < clusters.size(); i++)
+		total += tree.getClusterColor(clusters[i]);
+	rgbcolord expected;
+	for (size_t i = 0; i < colors.size(); i++)
+		expected += colors[i];
+	ASSERT_NEAR(expected.getR(), total.getR(), 1e-9);
+	ASSERT_NEAR(expected.getG(), total.getG(), 1e-9);
+	ASSERT_NEAR(expected.getB(), total.getB(), 1e-9);
+
+	// Close to the lights, every one in front must be in the exact cut.
+	X = vector3d(0.5, -1.0, 2.0);
+	N = vector3d(0.3, 1.0, -0.2).norm();
+	tree.cut(X, N, 0, lights, clusters);
+	ASSERT_TRUE(clusters.empty());
+	std::sort(lights.begin(), lights.end());
+	for (int i = 0; i < (int) pos.size(); i++)
+		if ((pos[i] - X) * N > 0) {
+			ASSERT_TRUE(std::binary_search(lights.begin(), lights.end(), i));
+		}
+
+	std::vector<bool> none(pos.size(), false);
+	tree.build(boxes, colors, none);
+	tree.cut(X, N, 0.02, lights, clusters);
+	ASSERT_TRUE(clusters.empty());
+}
+
+/*
+ * A scene with enough lights for a light tree must shade exactly like it
+ * does looping over all of them, which it does before it's finalized.
+ */
+TEST(lighttreeScene, MatchesAllLights) {
+	scene3d sc(true);
+	rgbcolord col(0.5, 0.5, 0.5);
+	sc.addShape(sp_shape3d(new sphere3d(col, 1, vector3d(0.0, 1.0, 0.0),
+			0.3)));
+	sc.addShape(sp_shape3d(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0))));
+	sc.addAreaLight(sp_arealightd(new arealightd(rgbcolord(1, 1, 1),
+			vector3d(0.0, 4.0, 0.0), vector3d(0.0, -1.0, 0.0),
+			vector3d(1.0, 0.0, 0.0), 0.2, 0.2, 2, 2)));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.3, 0.3, 0.3),
+			vector3d(0.0, -3.0, 0.0))));
+	sc.addSpotLight(sp_spotlightd(new spotlightd(rgbcolord(0.5, 0.2, 0.2),
+			vector3d(3.0, 3.0, 0.0), vector3d(-1.0, -1.0, 0.0).norm(), 0.5)));
+
+	std::vector<ray3d> rays;
+	for (int z = -10; z <= 10; z++)
+		for (int x = -10; x <= 10; x++)
+			rays.push_back(ray3d(vector3d(0.0, 8.0, 6.0),
+					vector3d(x * 0.2, -8.0, z * 0.2 - 6.0)));
+	std::vector<rgbcolord> before;
+	for (size_t i = 0; i < rays.size(); i++)
+		before.push_back(sc.traceRay(rays[i]));
+
+	sc.finalize();
+	rendercontext3d ctx;
+	for (size_t i = 0; i < rays.size(); i++) {
+		rgbcolord c1 = sc.traceRay(rays[i]);
+		rgbcolord c2 = sc.traceRay(rays[i], 0, &ctx);
+		ASSERT_EQ(before[i].getR(), c1.getR());
+		ASSERT_EQ(before[i].getG(), c1.getG());
+		ASSERT_EQ(before[i].getB(), c1.getB());
+		ASSERT_EQ(c1.getR(), c2.getR());
+		ASSERT_EQ(c1.getG(), c2.getG());
+		ASSERT_EQ(c1.getB(), c2.getB());
+	}
+
+	// Clustering only approximates.
+	sc.setLightClusterRatio(0.5);
+	double err = 0;
+	for (size_t i = 0; i < rays.size(); i++)
+		err = std::max(err, fabs(sc.traceRay(rays[i]).getR() -
+				before[i].getR()));
+	ASSERT_LT(err, 0.2);
+
+	// So do lightcuts.
+	sc.setLightClusterRatio(0);
+	sc.setLightCutError(0.02);
+	err = 0;
+	for (size_t i = 0; i < rays.size(); i++)
+		err = std::max(err, fabs(sc.traceRay(rays[i]).getR() -
+				before[i].getR()));
+	ASSERT_LT(err, 0.2);
+}
+
+#endif // TEST_LIGHTTREE_CC
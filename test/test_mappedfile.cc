@@ -0,0 +1,66 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "mappedfile.hh"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#ifndef TEST_MAPPEDFILE_CC
+#define TEST_MAPPEDFILE_CC
+
+#ifdef MAPPEDFILE_MMAP
+
+/*
+ * What's written into the mapping is in the file, which has the size it
+ * was opened with.
+ */
+TEST(mappedfile, WritesThrough) {
+	std::string path = "/tmp/rt_test_mappedfile.bin";
+	{
+		mappedfile f;
+		ASSERT_EQ((char *) 0, f.data());
+		ASSERT_TRUE(f.open(path, 10000));
+		ASSERT_EQ(10000u, f.size());
+		for (int i = 0; i < 10000; i++)
+			f.data()[i] = (char) (i % 251);
+	}
+	std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+	std::string bytes((std::istreambuf_iterator<char>(in)),
+			std::istreambuf_iterator<char>());
+	ASSERT_EQ(10000u, bytes.size());
+	for (int i = 0; i < 10000; i++)
+		ASSERT_EQ((char) (i % 251), bytes[i]);
+	std::remove(path.c_str());
+
+	mappedfile bad;
+	ASSERT_FALSE(bad.open("/nonexistent/dir/file", 10));
+	ASSERT_EQ(0u, bad.size());
+}
+
+/*
+ * A file mapped for reading has its contents and size.
+ */
+TEST(mappedfile, ReadsBack) {
+	std::string path = "/tmp/rt_test_mappedfile_read.bin";
+	{
+		std::ofstream out(path.c_str(), std::ios::out | std::ios::binary);
+		out << "scene bytes";
+	}
+	mappedfile f;
+	ASSERT_TRUE(f.openRead(path));
+	const mappedfile &cf = f;
+	ASSERT_EQ(std::string("scene bytes"), std::string(cf.data(), cf.size()));
+	f.close();
+	ASSERT_EQ(0u, f.size());
+	std::remove(path.c_str());
+	ASSERT_FALSE(f.openRead(path));
+}
+
+#endif // MAPPEDFILE_MMAP
+
+#endif // TEST_MAPPEDFILE_CC
@@ -0,0 +1,75 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "materialtable.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "infplane.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+
+#ifndef TEST_MATERIALTABLE_CC
+#define TEST_MATERIALTABLE_CC
+
+/*
+ * A color and reflectivity seen before gets its old index; a different
+ * color or reflectivity gets a new one.
+ */
+TEST(materialtable, Deduplicates) {
+	materialtable<double> table;
+	ASSERT_EQ(0, table.add(rgbcolord(1, 0, 0), 0));
+	ASSERT_EQ(1, table.add(rgbcolord(1, 0, 0), 0.5f));
+	ASSERT_EQ(2, table.add(rgbcolord(0, 1, 0), 0));
+	ASSERT_EQ(0, table.add(rgbcolord(1, 0, 0), 0));
+	ASSERT_EQ(3, table.size());
+	ASSERT_DOUBLE_EQ(1, table[1].color.getR());
+	ASSERT_FLOAT_EQ(0.5f, table[1].reflectivity);
+	table.clear();
+	ASSERT_EQ(0, table.size());
+	ASSERT_EQ(0, table.add(rgbcolord(0, 1, 0), 0));
+}
+
+/*
+ * Shapes of one color share a material, recoloring a shape moves it to
+ * another, and finalizing drops materials no shape uses.
+ */
+TEST(materialtable, SceneShapes) {
+	scene3d sc(true);
+	sp_shape3d shapes[4];
+	for (int i = 0; i < 3; i++) {
+		shapes[i] = sp_shape3d(new sphere3d(rgbcolord(0.5, 0.5, 0.5), 1,
+				vector3d(3.0 * i, 0.0, 0.0), 0.25f));
+		sc.addShape(shapes[i]);
+	}
+	shapes[3] = sp_shape3d(new infplaned(rgbcolord(1, 1, 1), 1,
+			vector3d(0.0, 1.0, 0.0), 0));
+	sc.addShape(shapes[3]);
+	sc.finalize();
+	ASSERT_EQ(2, sc.getMaterials().size());
+	ASSERT_EQ(shapes[0]->getMaterial(), shapes[1]->getMaterial());
+	ASSERT_EQ(shapes[0]->getMaterial(), shapes[2]->getMaterial());
+	ASSERT_NE(shapes[0]->getMaterial(), shapes[3]->getMaterial());
+	const material<double> &m = sc.getMaterials()[shapes[0]->getMaterial()];
+	ASSERT_DOUBLE_EQ(0.5, m.color.getG());
+	ASSERT_FLOAT_EQ(0.25f, m.reflectivity);
+
+	// A shape changed behind the scene's back reads its own color.
+	shapes[2]->setReflectivity(0.5f);
+	ASSERT_EQ(-1, shapes[2]->getMaterial());
+
+	sc.recolorShape(1, rgbcolord(1, 1, 1));
+	ASSERT_EQ(3, sc.getMaterials().size());
+	ASSERT_DOUBLE_EQ(1,
+			sc.getMaterials()[shapes[1]->getMaterial()].color.getR());
+	sc.recolorShape(0, rgbcolord(1, 1, 1));
+	ASSERT_EQ(shapes[0]->getMaterial(), shapes[1]->getMaterial());
+	sc.finalize();
+	ASSERT_EQ(3, sc.getMaterials().size());
+	ASSERT_FLOAT_EQ(0.5f,
+			sc.getMaterials()[shapes[2]->getMaterial()].reflectivity);
+}
+
+#endif // TEST_MATERIALTABLE_CC
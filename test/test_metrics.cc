@@ -0,0 +1,124 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "metrics.hh"
+#include "netchannel.hh"
+#include "gtest/gtest.h"
+#include <sstream>
+#include <string>
+
+#ifndef TEST_METRICS_CC
+#define TEST_METRICS_CC
+
+/**
+ * Sends an HTTP request for a path and reads the whole reply.
+ *
+ * @param port The port of the server.
+ * @param path The path.
+ *
+ * @return The reply, or "" if the server couldn't be reached.
+ */
+static std::string httpGet(int port, const std::string &path) {
+	netchannel channel;
+	if (!channel.connect("127.0.0.1", port))
+		return "";
+	std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n"
+			"\r\n";
+	channel.sendAll(request.data(), request.size());
+	std::string reply;
+	char c;
+	while (channel.receiveAll(&c, 1))
+		reply += c;
+	return reply;
+}
+
+/*
+ * Histogram buckets count every duration up to their bound, and the last
+ * one counts them all.
+ */
+TEST(metrics, HistogramIsCumulative) {
+	const double bounds[] = { 0.01, 0.1, 1 };
+	metricshistogram h(bounds, 3);
+	h.add(0.005);
+	h.add(0.05);
+	h.add(0.05);
+	h.add(5);
+	std::ostringstream os;
+	h.write(os, "t", "Times.");
+	std::string text = os.str();
+	ASSERT_NE(std::string::npos, text.find("# TYPE t histogram\n"));
+	ASSERT_NE(std::string::npos, text.find("t_bucket{le=\"0.01\"} 1\n"));
+	ASSERT_NE(std::string::npos, text.find("t_bucket{le=\"0.1\"} 3\n"));
+	ASSERT_NE(std::string::npos, text.find("t_bucket{le=\"1\"} 3\n"));
+	ASSERT_NE(std::string::npos, text.find("t_bucket{le=\"+Inf\"} 4\n"));
+	ASSERT_NE(std::string::npos, text.find("t_count 4\n"));
+}
+
+/*
+ * Jobs, phases and caches show up in the text format, and the server
+ * answers /metrics with them and other paths with 404.
+ */
+TEST(metrics, ServesCounts) {
+	rendermetrics m;
+	m.setQueued(2);
+	m.startJob();
+	m.startJob();
+	m.finishJob(true, 0.5, 640 * 480);
+	m.addPhase(PHASE_RENDER, 0.25);
+	m.addTile(0.003);
+	m.addShadowCache(10, 4);
+	m.addBvhCache(true);
+	std::ostringstream os;
+	m.write(os);
+	std::string text = os.str();
+	ASSERT_NE(std::string::npos, text.find("\nrt_jobs_total 1\n"));
+	ASSERT_NE(std::string::npos, text.find("\nrt_jobs_active 1\n"));
+	ASSERT_NE(std::string::npos, text.find("\nrt_jobs_queued 2\n"));
+	ASSERT_NE(std::string::npos, text.find("\nrt_samples_total 307200\n"));
+	ASSERT_NE(std::string::npos,
+			text.find("rt_phase_seconds_total{phase=\"render\"} 0.25\n"));
+	ASSERT_NE(std::string::npos, text.find("rt_tile_seconds_count 1\n"));
+	ASSERT_NE(std::string::npos,
+			text.find("\nrt_shadow_cache_hits_total 4\n"));
+	ASSERT_NE(std::string::npos, text.find("\nrt_bvh_cache_hits_total 1\n"));
+
+	metricsserver server;
+	ASSERT_TRUE(server.start(0, m));
+	int port = server.getPort();
+	ASSERT_GT(port, 0);
+	std::string reply = httpGet(port, "/metrics");
+	ASSERT_EQ(0u, reply.find("HTTP/1.1 200 OK\r\n"));
+	ASSERT_NE(std::string::npos, reply.find("\nrt_jobs_total 1\n"));
+	ASSERT_EQ(0u, httpGet(port, "/").find("HTTP/1.1 404"));
+	server.stop();
+	ASSERT_EQ("", httpGet(port, "/metrics"));
+}
+
+/*
+ * A client that connects and sends nothing is dropped after the timeout,
+ * so the scrapes after it are answered, and stopping cuts off one being
+ * waited for at once.
+ */
+TEST(metrics, DropsIdleClients) {
+	rendermetrics m;
+	metricsserver server;
+	ASSERT_TRUE(server.start(0, m, 200));
+	int port = server.getPort();
+	netchannel idle;
+	ASSERT_TRUE(idle.connect("127.0.0.1", port));
+	ASSERT_EQ(0u, httpGet(port, "/metrics").find("HTTP/1.1 200 OK\r\n"));
+
+	ASSERT_TRUE(server.start(0, m));
+	ASSERT_TRUE(idle.connect("127.0.0.1", server.getPort()));
+	boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+	boost::posix_time::ptime before =
+			boost::posix_time::microsec_clock::universal_time();
+	server.stop();
+	boost::posix_time::time_duration took =
+			boost::posix_time::microsec_clock::universal_time() - before;
+	ASSERT_LT(took.total_milliseconds(), METRICS_TIMEOUT_MS / 2);
+}
+
+#endif // TEST_METRICS_CC
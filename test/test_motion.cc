@@ -0,0 +1,249 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "motion.hh"
+#include "accelfactory.hh"
+#include "sceneparser.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "camera.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include "boost/shared_ptr.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef TEST_MOTION_CC
+#define TEST_MOTION_CC
+
+/**
+ * Reuses the random shapes and rays from the BVH tests, with every other
+ * bounded shape moving while the shutter is open and every ray at a random
+ * time of the shutter interval.
+ */
+class motionTest : public bvhTest {
+protected:
+
+	typedef boost::shared_ptr<accelerator<double, double, double, 3> >
+		sp_accel;
+
+	virtual void SetUp() {
+		bvhTest::SetUp();
+		for (size_t i = 0; i + 1 < shapes.size(); i += 2)
+			shapes[i] = sp_shape3d(new motionshape3d(shapes[i],
+					rndvec(-4, 4)));
+		for (size_t i = 0; i < rays.size(); i++)
+			rays[i].setShutter((float) rnd(0, 1));
+	}
+
+	/*
+	 * Makes a scene of the shapes with the given accelerator, or none.
+	 */
+	void makeScene(scene3d &sc, const sp_accel &accel) {
+		if (accel)
+			sc.setAccelerator(accel);
+		for (size_t i = 0; i < shapes.size(); i++)
+			sc.addShape(shapes[i]);
+		sc.finalize();
+	}
+};
+
+/*
+ * A moving sphere is hit where it is at the ray's time, and its boxes are
+ * those at the ends of the interval and around its whole path.
+ */
+TEST_F(motionTest, MovesWithTheShutter) {
+	sp_shape3d ball(new sphere3d(rgbcolord(1, 0, 0), 1, vector3d(0.0, 0.0,
+			0.0)));
+	motionshape3d moving(ball, vector3d(4.0, 0.0, 0.0));
+
+	ray3d atStart(vector3d(0.0, 0.0, -10.0), vector3d(0.0, 0.0, 1.0));
+	ray3d atMiddle = atStart;
+	atMiddle.setShutter(0.5f);
+	ASSERT_DOUBLE_EQ(9, moving.intersection(atStart));
+	ASSERT_EQ(RAY_MISS, moving.intersection(atMiddle));
+
+	ray3d through(vector3d(2.0, 0.0, -10.0), vector3d(0.0, 0.0, 1.0));
+	through.setShutter(0.5f);
+	hitrecord3d rec;
+	ASSERT_TRUE(moving.intersect(through, rec));
+	ASSERT_DOUBLE_EQ(9, rec.t);
+	ASSERT_DOUBLE_EQ(2, rec.point[0]);
+	ASSERT_DOUBLE_EQ(-1, rec.point[2]);
+	ASSERT_DOUBLE_EQ(-1, rec.normal[2]);
+	ASSERT_EQ(ball.get(), rec.obj);
+
+	// Reflections and shadow rays are traced at the same time.
+	ASSERT_EQ(0.5f, through.reflect(rec.point, rec.normal).getShutter());
+
+	aabb<double, 3> open, close, path;
+	ASSERT_TRUE(moving.getMotionBounds(open, close));
+	ASSERT_TRUE(moving.getBounds(path));
+	ASSERT_EQ(-1, open.getMin()[0]);
+	ASSERT_EQ(1, open.getMax()[0]);
+	ASSERT_EQ(3, close.getMin()[0]);
+	ASSERT_EQ(5, close.getMax()[0]);
+	ASSERT_EQ(-1, path.getMin()[0]);
+	ASSERT_EQ(5, path.getMax()[0]);
+}
+
+/*
+ * Rays at random times hit the same shapes at the same times through the
+ * motion hierarchy, a bvh over whole paths and a linear scan, before and
+ * after the shapes are moved and the trees refit.
+ */
+TEST_F(motionTest, MatchesLinearScan) {
+	scene3d linear(false), paths(false), motion(false);
+	sp_motionbvh3d tree(new motionbvh3d());
+	makeScene(linear, sp_accel());
+	makeScene(paths, sp_bvh3d(new bvh3d()));
+	makeScene(motion, tree);
+	ASSERT_EQ(200, tree->getMovingCount());
+
+	for (int pass = 0; pass < 2; pass++) {
+		for (size_t i = 0; i < rays.size(); i++) {
+			double t1, t2, t3;
+			sp_shape3d s1 = linear.findClosestShape(rays[i], t1);
+			sp_shape3d s2 = paths.findClosestShape(rays[i], t2);
+			sp_shape3d s3 = motion.findClosestShape(rays[i], t3);
+			ASSERT_EQ(s1, s2) << "ray " << i;
+			ASSERT_EQ(s1, s3) << "ray " << i;
+			ASSERT_DOUBLE_EQ(t1, t3);
+			double tmax = 5 + (i % 10);
+			ASSERT_EQ(linear.isOccluded(rays[i], tmax),
+					motion.isOccluded(rays[i], tmax)) << "ray " << i;
+		}
+		// Move the spheres within the moving shapes and refit.
+		for (size_t i = 0; i + 1 < shapes.size(); i += 2) {
+			const sp_shape3d &inner =
+					static_cast<motionshape3d *>(shapes[i].get())->getInner();
+			sphere3d *s = dynamic_cast<sphere3d *>(inner.get());
+			if (s)
+				s->setCenter(rndvec(-10, 10));
+		}
+		paths.refit();
+		motion.refit();
+	}
+}
+
+/*
+ * Shapes that all move far give a bvh a root around their whole paths,
+ * but the motion hierarchy's root at any one time is as small as the
+ * shapes are then.
+ */
+TEST_F(motionTest, BoxesFollowTheShapes) {
+	std::vector<sp_shape3d> swept;
+	aabb<double, 3> path;
+	for (int i = 0; i < 100; i++) {
+		sp_shape3d s(new motionshape3d(sp_shape3d(new sphere3d(
+				rgbcolord(1, 1, 1), 0.2, rndvec(-1, 1))),
+				vector3d(40.0, 0.0, 0.0)));
+		aabb<double, 3> box;
+		s->getBounds(box);
+		path.extend(box);
+		swept.push_back(s);
+	}
+	motionbvh3d tree;
+	tree.build(swept);
+	ASSERT_EQ(100, tree.getMovingCount());
+	for (int k = 0; k <= 4; k++)
+		ASSERT_LT(tree.getRootAreaAt(k / 4.0) * 5, path.surfaceArea());
+
+	ray3d r(vector3d(40.0, 0.0, -10.0), vector3d(0.0, 0.0, 1.0));
+	double t;
+	ASSERT_EQ(-1, tree.closestHit(r, t));
+	r.setShutter(1);
+	ASSERT_GE(tree.closestHit(r, t), 0);
+}
+
+/*
+ * A move after a shape makes it a moving shape, and a move anywhere else
+ * or a key after a move is an error.
+ */
+TEST_F(motionTest, ParsesMoves) {
+	const char *good = "sphere (1, 0, 0) 1 <0, 0, 0> 0\nmove <4, 0, 0>\n"
+			"plane (1, 1, 1) 0 <0, 1, 0> 0\nmove <0, 1, 0>\n";
+	scenedescription desc;
+	std::string error;
+	scenetokenizer in(good, good + strlen(good));
+	ASSERT_TRUE((parseScene<double, double>(in, "", desc, error))) << error;
+	ASSERT_EQ(4u, desc.records.size());
+	ASSERT_EQ(RECORD_MOVE, desc.records[1].kind);
+	scene3d sc(false);
+	boost::shared_ptr<camera<double, double, 3> > cam;
+	ASSERT_TRUE(addSceneRecords(sc, &desc.records[0], desc.records.size(),
+			desc.paths, cam, error)) << error;
+	ASSERT_EQ(2u, sc.getShapes().size());
+	const motionshape3d *m =
+			dynamic_cast<const motionshape3d *>(sc.getShapes()[0].get());
+	ASSERT_TRUE(m != 0);
+	ASSERT_EQ(4, m->getMotion()[0]);
+	ASSERT_TRUE(dynamic_cast<const motionshape3d *>(
+			sc.getShapes()[1].get()) != 0);
+
+	const char *bad[] = { "light (1, 1, 1) <0, 0, 0>\nmove <1, 0, 0>\n",
+			"sphere (1, 0, 0) 1 <0, 0, 0> 0\nmove <1, 0, 0>\nkey 2 <1, 1, 1>\n"
+			};
+	const char *errors[] = { "the move on line 2 doesn't follow",
+			"the key on line 3 doesn't follow" };
+	for (int i = 0; i < 2; i++) {
+		scenedescription d;
+		scenetokenizer t(bad[i], bad[i] + strlen(bad[i]));
+		ASSERT_TRUE((parseScene<double, double>(t, "", d, error))) << error;
+		scene3d s(false);
+		ASSERT_FALSE(addSceneRecords(s, &d.records[0], d.records.size(),
+				d.paths, cam, error));
+		ASSERT_EQ(0u, error.find(errors[i])) << error;
+	}
+}
+
+/*
+ * Samples spread over the shutter interval blur a moving sphere along its
+ * path, the same with either tree, while one sample per pixel shows it
+ * where it starts.
+ */
+TEST_F(motionTest, BlursAlongThePath) {
+	scene3d motion(true), paths(true);
+	motion.setAccelerator(makeNamedAccelerator<double, double, double>(
+			"motion", BVH_BUILD_SAH, 1));
+	paths.setAccelerator(sp_bvh3d(new bvh3d()));
+	scene3d *scenes[] = { &motion, &paths };
+	for (int i = 0; i < 2; i++) {
+		scenes[i]->addPointLight(sp_lightd(new lightd(rgbcolord(1, 1, 1),
+				vector3d(0.0, 0.0, -20.0))));
+		scenes[i]->addShape(sp_shape3d(new motionshape3d(sp_shape3d(
+				new sphere3d(rgbcolord(1, 1, 1), 1, vector3d(-3.0, 0.0, 0.0))),
+				vector3d(6.0, 0.0, 0.0))));
+		scenes[i]->addShape(sp_shape3d(new sphere3d(rgbcolord(0, 1, 0), 1,
+				vector3d(0.0, 3.0, 0.0))));
+		scenes[i]->finalize();
+		scenes[i]->setPixelSamples(4);
+	}
+	camera<double, double, 3> cam(vector3d(0.0, 0.0, -10.0),
+			vector3d(0.0, 0.0, 0.0), vector3d(0.0, 1.0, 0.0));
+	std::vector<rgbcolord> a, b;
+	motion.renderImage(cam, 64, 48, a);
+	paths.renderImage(cam, 64, 48, b);
+	ASSERT_EQ(a.size(), b.size());
+	for (size_t i = 0; i < a.size(); i++) {
+		ASSERT_EQ(a[i].getR(), b[i].getR()) << "pixel " << i;
+		ASSERT_EQ(a[i].getG(), b[i].getG()) << "pixel " << i;
+		ASSERT_EQ(a[i].getB(), b[i].getB()) << "pixel " << i;
+	}
+	// The middle of the path is covered some of the time, dimly.
+	const rgbcolord &middle = a[24 * 64 + 32];
+	ASSERT_GT(middle.getR(), 0);
+	ASSERT_LT(middle.getR(), 0.5);
+
+	std::vector<rgbcolord> still;
+	motion.setPixelSamples(1);
+	motion.renderImage(cam, 64, 48, still);
+	ASSERT_EQ(0, still[24 * 64 + 32].getR());
+}
+
+#endif // TEST_MOTION_CC
@@ -6,6 +6,7 @@
 #include "mvector.hh"
 #include "gtest/gtest.h"
 #include <cmath>
+#include <cstdlib>
 #include <sstream>
 #include <string>
 
@@ -433,4 +434,48 @@ TEST_F(mvectorTest, Input) {
 	ASSERT_EQ('f', c);
 }
 
+/*
+ * The SIMD versions of the 3D operators must give exactly what the generic
+ * component-by-component code gives, which is spelled out here.
+ */
+template<typename T>
+static void checkSimdMatchesScalar() {
+	srand(5);
+	for (int n = 0; n < 1000; n++) {
+		T x[3], y[3];
+		for (int i = 0; i < 3; i++) {
+			x[i] = (T) (rand() / (double) RAND_MAX * 20 - 10);
+			y[i] = (T) (rand() / (double) RAND_MAX * 20 - 10);
+		}
+		mvector<T, 3> a(x), b(y);
+		T s = (T) (rand() / (double) RAND_MAX + 0.5);
+		mvector<T, 3> sum = a + b, diff = a - b, prod = a * s, quot = a / s,
+				neg = -a, cross = a % b, unit = a.norm();
+		T dot = 0;
+		for (int i = 0; i < 3; i++)
+			dot += y[i] * x[i];
+		ASSERT_EQ(dot, a * b);
+		T mag = sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+		for (int i = 0; i < 3; i++) {
+			ASSERT_EQ(x[i] + y[i], sum[i]);
+			ASSERT_EQ(x[i] - y[i], diff[i]);
+			ASSERT_EQ(x[i] * s, prod[i]);
+			ASSERT_EQ(x[i] / s, quot[i]);
+			ASSERT_EQ(-x[i], neg[i]);
+			ASSERT_EQ(x[i] / mag, unit[i]);
+		}
+		ASSERT_EQ(x[1] * y[2] - x[2] * y[1], cross[0]);
+		ASSERT_EQ(-x[0] * y[2] + x[2] * y[0], cross[1]);
+		ASSERT_EQ(x[0] * y[1] - x[1] * y[0], cross[2]);
+	}
+}
+
+TEST(mvectorSimd, MatchesScalar) {
+	checkSimdMatchesScalar<double>();
+	checkSimdMatchesScalar<float>();
+	// Products that are all -0 still sum to +0.
+	vector3d z(-0.0, 0.0, -0.0), o(1.0, -1.0, 1.0);
+	ASSERT_FALSE(std::signbit(z * o));
+}
+
 #endif // TEST_MVECTOR_CC
@@ -0,0 +1,79 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "netchannel.hh"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+#ifndef TEST_NETCHANNEL_CC
+#define TEST_NETCHANNEL_CC
+
+/*
+ * Numbers and strings are read back as they were written, and reads past
+ * the end of a payload fail.
+ */
+TEST(netchannel, ReadsBackPayloads) {
+	netwriter out;
+	out.putInt(0xdeadbeef);
+	out.putLong((boost::uint64_t) 1 << 40);
+	out.putDouble(-0.1);
+	out.putString("scene");
+	netreader in(out.getBytes());
+	ASSERT_EQ(0xdeadbeef, in.getInt());
+	ASSERT_EQ((boost::uint64_t) 1 << 40, in.getLong());
+	ASSERT_EQ(-0.1, in.getDouble());
+	ASSERT_EQ("scene", in.getString());
+	ASSERT_TRUE(in.ok());
+	ASSERT_EQ(0u, in.getInt());
+	ASSERT_FALSE(in.ok());
+
+	std::vector<char> shortString = out.getBytes();
+	shortString.resize(shortString.size() - 1);
+	netreader cut(shortString);
+	cut.getInt();
+	cut.getLong();
+	cut.getDouble();
+	ASSERT_EQ("", cut.getString());
+	ASSERT_FALSE(cut.ok());
+}
+
+/*
+ * Messages go both ways over a connection on the loopback address, and
+ * a shut down connection can't be received from.
+ */
+TEST(netchannel, SendsMessages) {
+	netlistener listener;
+	ASSERT_TRUE(listener.listen(0));
+	int port = listener.getPort();
+	ASSERT_GT(port, 0);
+	netchannel client, server;
+	ASSERT_FALSE(listener.accept(server, 0));
+	ASSERT_TRUE(client.connect("127.0.0.1", port));
+	ASSERT_TRUE(listener.accept(server, 1000));
+
+	netwriter out;
+	out.putString("tile");
+	ASSERT_TRUE(client.send(7, out.getBytes()));
+	ASSERT_TRUE(client.send(8));
+	boost::uint32_t type;
+	std::vector<char> payload;
+	ASSERT_TRUE(server.receive(type, payload));
+	ASSERT_EQ(7u, type);
+	ASSERT_TRUE(out.getBytes() == payload);
+	ASSERT_TRUE(server.receive(type, payload));
+	ASSERT_EQ(8u, type);
+	ASSERT_TRUE(payload.empty());
+
+	ASSERT_TRUE(server.send(9, out.getBytes()));
+	ASSERT_FALSE(client.receive(type, payload, 4));
+	server.shutdown();
+	ASSERT_FALSE(server.receive(type, payload));
+	client.close();
+	ASSERT_FALSE(client.isOpen());
+	ASSERT_FALSE(client.connect("127.0.0.1", 0));
+}
+
+#endif // TEST_NETCHANNEL_CC
@@ -0,0 +1,236 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "outofcore.hh"
+#include "scenefile.hh"
+#include "sceneparser.hh"
+#include "bvh.hh"
+#include "gtest/gtest.h"
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef TEST_OUTOFCORE_CC
+#define TEST_OUTOFCORE_CC
+
+/**
+ * A compiled scene of random spheres and cylinders in chunks, and rays
+ * through it.
+ */
+class outofcoreTest : public ::testing::Test {
+protected:
+
+	/** The records, chunked. */
+	scenedescription desc;
+
+	/** The chunks of the records. */
+	std::vector<scenechunk> chunks;
+
+	/** The compiled scene, aligned as in a mapping. */
+	std::vector<double> aligned;
+
+	/** The view of the compiled scene. */
+	scenefile compiled;
+
+	/** Rays from in front of the scene into it. */
+	std::vector<ray3d> rays;
+
+	static double rnd(double lo, double hi) {
+		return lo + (hi - lo) * (rand() / (double) RAND_MAX);
+	}
+
+	virtual void SetUp() {
+		srand(7);
+		std::ostringstream text;
+		text << "camera <0, 4, -30> <0, 0, 0> <0, 1, 0>\n"
+				"light (1, 1, 1) <10, 20, -20>\n"
+				"plane (0.8, 0.8, 0.8) 11 <0, 1, 0> 0\n";
+		for (int i = 0; i < 400; i++) {
+			text << "sphere (0.5, 0.2, 0.2) " << rnd(0.1, 0.6) << " <" <<
+					rnd(-10, 10) << ", " << rnd(-10, 10) << ", " <<
+					rnd(-10, 10) << "> " << (i % 5 == 0 ? 0.3 : 0) << "\n";
+			if (i % 4 == 0)
+				text << "cylinder (0.2, 0.2, 0.5) " << rnd(0.05, 0.3) <<
+						" <" << rnd(-10, 10) << ", " << rnd(-10, 10) << ", " <<
+						rnd(-10, 10) << "> <0, 1, 0> " << rnd(0.2, 2) <<
+						" 0\n";
+		}
+		text << "end\n";
+		std::string s = text.str();
+		scenetokenizer in(s.data(), s.data() + s.size());
+		std::string error;
+		ASSERT_TRUE((parseScene<double, double>(in, "", desc, error))) <<
+				error;
+		chunkSceneRecords<double, double, double>(desc, 16, chunks);
+
+		std::ostringstream os;
+		ASSERT_TRUE((writeSceneFile<double, double, double>(os, desc, -1, "",
+				chunks)));
+		std::string bytes = os.str();
+		aligned.assign(bytes.size() / sizeof(double) + 1, 0);
+		memcpy(&aligned[0], bytes.data(), bytes.size());
+		ASSERT_TRUE((compiled.open<double, double, double>(
+				(const char *) &aligned[0], bytes.size(), error))) << error;
+
+		for (int i = 0; i < 2000; i++) {
+			vector3d from(rnd(-12, 12), rnd(-12, 12), -30);
+			vector3d to(rnd(-12, 12), rnd(-12, 12), rnd(-12, 12));
+			rays.push_back(ray3d(from, to - from));
+		}
+	}
+
+	/**
+	 * Loads the compiled scene as a whole.
+	 */
+	void loadInCore(scene3d &sc) {
+		sc.setAccelerator(sp_bvh3d(new bvh3d()));
+		std::vector<std::string> paths;
+		compiled.getPaths(paths);
+		boost::shared_ptr<camera<double, double, 3> > cam;
+		std::string error;
+		ASSERT_TRUE(addSceneRecords(sc, compiled.getRecords(),
+				compiled.getRecordCount(), paths, cam, error)) << error;
+		sc.finalize();
+	}
+
+	/**
+	 * Loads the compiled scene with its chunks in a store of the given
+	 * budget.
+	 */
+	sp_chunkaccel3d loadOutOfCore(scene3d &sc, size_t budget) {
+		sc.setAccelerator(sp_bvh3d(new bvh3d()));
+		boost::shared_ptr<camera<double, double, 3> > cam;
+		std::string error;
+		EXPECT_TRUE((addOutOfCoreScene<double, double, double>(sc, compiled,
+				budget, cam, error))) << error;
+		sc.finalize();
+		return boost::dynamic_pointer_cast<chunkaccel3d>(
+				sc.getAccelerator());
+	}
+};
+
+/**
+ * The spheres and cylinders are grouped into small chunks after the other
+ * records, each chunk's box holds its shapes, and the chunks survive a
+ * round trip through a compiled scene.
+ */
+TEST_F(outofcoreTest, ChunksFollowEachOther) {
+	ASSERT_EQ(503u, desc.records.size());
+	ASSERT_GT(chunks.size(), 503u / 16);
+	ASSERT_EQ(3, chunks[0].first);
+	ASSERT_EQ(RECORD_CAMERA, desc.records[0].kind);
+	ASSERT_EQ(RECORD_PLANE, desc.records[2].kind);
+	long long next = chunks[0].first;
+	sp_arena pool(new arena());
+	std::string error;
+	for (size_t c = 0; c < chunks.size(); c++) {
+		ASSERT_EQ(next, chunks[c].first);
+		ASSERT_GT(chunks[c].count, 0);
+		ASSERT_LE(chunks[c].count, 16);
+		for (long long i = 0; i < chunks[c].count; i++) {
+			sp_shape3d obj;
+			ASSERT_TRUE(makeSceneShape(desc.records[next + i], desc.paths,
+					pool, obj, error));
+			aabb<double, 3> box;
+			obj->getBounds(box);
+			for (int a = 0; a < 3; a++) {
+				ASSERT_GE(box.getMin()[a], chunks[c].lo[a]);
+				ASSERT_LE(box.getMax()[a], chunks[c].hi[a]);
+			}
+		}
+		next += chunks[c].count;
+	}
+	ASSERT_EQ((long long) desc.records.size(), next);
+
+	ASSERT_EQ(chunks.size(), compiled.getChunkCount());
+	ASSERT_EQ(0, memcmp(&chunks[0], compiled.getChunks(),
+			chunks.size() * sizeof(scenechunk)));
+
+	// Without chunks there are none to read.
+	std::ostringstream os;
+	ASSERT_TRUE((writeSceneFile<double, double, double>(os, desc, -1, "")));
+	std::string bytes = os.str();
+	std::vector<double> plain(bytes.size() / sizeof(double) + 1);
+	memcpy(&plain[0], bytes.data(), bytes.size());
+	scenefile unchunked;
+	ASSERT_TRUE((unchunked.open<double, double, double>(
+			(const char *) &plain[0], bytes.size(), error))) << error;
+	ASSERT_EQ(0u, unchunked.getChunkCount());
+	ASSERT_TRUE(unchunked.getChunks() == 0);
+}
+
+/**
+ * A scene whose chunks are loaded as rays reach them renders what the
+ * whole scene does, though only one chunk at a time fits the budget.
+ */
+TEST_F(outofcoreTest, RendersLikeInCoreScene) {
+	scene3d whole(true), chunked(true);
+	loadInCore(whole);
+	sp_chunkaccel3d accel = loadOutOfCore(chunked, 1);
+	ASSERT_TRUE(accel != 0);
+	const sp_chunkstore3d &store = accel->getStore();
+	ASSERT_EQ(0u, store->getLoadCount());
+
+	for (size_t i = 0; i < rays.size(); i++) {
+		double t1, t2;
+		sp_shape3d s1 = whole.findClosestShape(rays[i], t1);
+		sp_shape3d s2 = chunked.findClosestShape(rays[i], t2);
+		ASSERT_EQ(s1 == 0, s2 == 0) << "ray " << i;
+		ASSERT_DOUBLE_EQ(t1, t2) << "ray " << i;
+		ASSERT_EQ(whole.isOccluded(rays[i], 15), chunked.isOccluded(rays[i],
+				15)) << "ray " << i;
+	}
+
+	camera<double, double, 3> cam(vector3d(0.0, 4.0, -30.0),
+			vector3d(0.0, 0.0, 0.0), vector3d(0.0, 1.0, 0.0));
+	std::vector<rgbcolord> a, b;
+	whole.renderImage(cam, 48, 32, a);
+	chunked.renderImage(cam, 48, 32, b);
+	ASSERT_EQ(a.size(), b.size());
+	for (size_t i = 0; i < a.size(); i++) {
+		ASSERT_EQ(a[i].getR(), b[i].getR()) << "pixel " << i;
+		ASSERT_EQ(a[i].getG(), b[i].getG()) << "pixel " << i;
+		ASSERT_EQ(a[i].getB(), b[i].getB()) << "pixel " << i;
+	}
+	ASSERT_GT(store->getEvictionCount(), 0u);
+	ASSERT_EQ(1u, store->getLoadCount() - store->getEvictionCount());
+}
+
+/**
+ * A batch of rays queued by chunk finds the hits the rays find one at a
+ * time, and loads the chunks far fewer times when they don't all fit.
+ */
+TEST_F(outofcoreTest, BatchesRaysByChunk) {
+	scene3d single(false), batched(false);
+	sp_chunkaccel3d one = loadOutOfCore(single, 1);
+	sp_chunkaccel3d many = loadOutOfCore(batched, 1);
+	int count = (int) rays.size();
+	std::vector<int> hits(count), batchHits(count);
+	std::vector<double> t(count), batchT(count);
+	for (int i = 0; i < count; i++)
+		hits[i] = one->closestHit(rays[i], t[i]);
+	many->closestHits(&rays[0], count, &batchHits[0], &batchT[0]);
+	for (int i = 0; i < count; i++) {
+		ASSERT_EQ(hits[i], batchHits[i]) << "ray " << i;
+		ASSERT_EQ(t[i], batchT[i]) << "ray " << i;
+	}
+	unsigned long long singleLoads = one->getStore()->getLoadCount();
+	unsigned long long batchLoads = many->getStore()->getLoadCount();
+	ASSERT_LT(batchLoads * 20, singleLoads);
+	ASSERT_LE(batchLoads, 4 * compiled.getChunkCount());
+
+	// With room for every chunk, each is loaded once.
+	scene3d roomy(false);
+	sp_chunkaccel3d all = loadOutOfCore(roomy, 1 << 30);
+	all->closestHits(&rays[0], count, &batchHits[0], &batchT[0]);
+	ASSERT_EQ(0u, all->getStore()->getEvictionCount());
+	ASSERT_LE(all->getStore()->getLoadCount(), compiled.getChunkCount());
+	ASSERT_EQ(all->getStore()->getPeakBytes(),
+			all->getStore()->getResidentBytes());
+}
+
+#endif // TEST_OUTOFCORE_CC
@@ -0,0 +1,126 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "parallel.hh"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+#ifndef TEST_PARALLEL_CC
+#define TEST_PARALLEL_CC
+
+/**
+ * Task for the @c parallelTasks test: counts the runs of each task and
+ * spins for a time that differs a lot between tasks.
+ */
+struct countingTask {
+	std::vector<int> *runs;
+	std::vector<int> *threads;
+
+	void operator()(int i, int thread) const {
+		volatile double x = 0;
+		for (int k = 0; k < (i % 7 == 0 ? 200000 : 100); k++)
+			x += k;
+		(*runs)[i]++;
+		(*threads)[i] = thread;
+	}
+};
+
+/*
+ * Whatever the thread count, every task runs exactly once on a thread with
+ * a valid index, and one thread runs the tasks in list order.
+ */
+TEST(parallel, TasksRunOnce) {
+	std::vector<int> tasks;
+	for (int i = 0; i < 101; i++)
+		tasks.push_back((i * 37) % 101);
+	for (int n = 1; n <= 8; n *= 2) {
+		std::vector<int> runs(101, 0), threads(101, -1);
+		countingTask task;
+		task.runs = &runs;
+		task.threads = &threads;
+		parallelTasks(tasks, n, task);
+		for (int i = 0; i < 101; i++) {
+			ASSERT_EQ(1, runs[i]);
+			ASSERT_GE(threads[i], 0);
+			ASSERT_LT(threads[i], n);
+		}
+	}
+	std::vector<int> none;
+	std::vector<int> runs, threads;
+	countingTask task;
+	task.runs = &runs;
+	task.threads = &threads;
+	parallelTasks(none, 4, task);
+}
+
+/*
+ * Pinned threads run every task once too, and a pinned thread can run
+ * anywhere it could before once it's let go.
+ */
+TEST(parallel, PinnedTasks) {
+	std::vector<int> tasks;
+	for (int i = 0; i < 40; i++)
+		tasks.push_back(i);
+	std::vector<int> runs(40, 0), threads(40, -1);
+	countingTask task;
+	task.runs = &runs;
+	task.threads = &threads;
+	parallelTasks(tasks, 3, task, true);
+	for (int i = 0; i < 40; i++)
+		ASSERT_EQ(1, runs[i]);
+#ifdef __linux__
+	cpu_set_t before, after;
+	pthread_getaffinity_np(pthread_self(), sizeof(before), &before);
+	{
+		threadpin p(0);
+		if (p.isPinned()) {
+			cpu_set_t now;
+			pthread_getaffinity_np(pthread_self(), sizeof(now), &now);
+			ASSERT_EQ(1, CPU_COUNT(&now));
+		}
+	}
+	pthread_getaffinity_np(pthread_self(), sizeof(after), &after);
+	ASSERT_TRUE(CPU_EQUAL(&before, &after));
+	// Indices go round the hardware threads the process may run on.
+	const std::vector<int> &cpus = threadpin::allowedCpus();
+	ASSERT_EQ(CPU_COUNT(&before), (int) cpus.size());
+	for (int k = 0; k < 2 * (int) cpus.size(); k++) {
+		threadpin p(k);
+		cpu_set_t now;
+		pthread_getaffinity_np(pthread_self(), sizeof(now), &now);
+		if (p.isPinned()) {
+			ASSERT_TRUE(CPU_ISSET(cpus[k % cpus.size()], &now));
+		}
+	}
+	std::ostringstream os;
+	threadpin::printStats(os);
+	ASSERT_EQ(0u, os.str().find("pinning: "));
+#endif
+	threadpin none(-1);
+	ASSERT_FALSE(none.isPinned());
+}
+
+/*
+ * The Morton order lists every cell once and visits the 2 x 2 blocks of a
+ * grid one after the other.
+ */
+TEST(parallel, MortonOrder) {
+	std::vector<int> order;
+	mortonOrder(4, 4, order);
+	int blocks[] = { 0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15 };
+	ASSERT_EQ(16u, order.size());
+	for (int i = 0; i < 16; i++)
+		ASSERT_EQ(blocks[i], order[i]);
+
+	mortonOrder(5, 3, order);
+	ASSERT_EQ(15u, order.size());
+	std::sort(order.begin(), order.end());
+	for (int i = 0; i < 15; i++)
+		ASSERT_EQ(i, order[i]);
+}
+
+#endif // TEST_PARALLEL_CC
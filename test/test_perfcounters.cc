@@ -0,0 +1,77 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "perfcounters.hh"
+#include "phasetimes.hh"
+#include "gtest/gtest.h"
+#include <sstream>
+#include <string>
+
+#ifndef TEST_PERFCOUNTERS_CC
+#define TEST_PERFCOUNTERS_CC
+
+/*
+ * Differences and sums only count counters that count in every sample,
+ * and counters that don't count are null in the JSON.
+ */
+TEST(perfcounters, AddsSamples) {
+	perfsample start, end, diff, total;
+	start.counts[PERF_CYCLES] = 100;
+	end.counts[PERF_CYCLES] = 250;
+	end.counts[PERF_INSTRUCTIONS] = 40;
+	diff.addDifference(start, end);
+	EXPECT_EQ(150, diff.counts[PERF_CYCLES]);
+	EXPECT_EQ(-1, diff.counts[PERF_INSTRUCTIONS]);
+	diff.addDifference(start, end);
+	EXPECT_EQ(300, diff.counts[PERF_CYCLES]);
+	total.add(diff);
+	total.add(end);
+	EXPECT_EQ(550, total.counts[PERF_CYCLES]);
+	EXPECT_EQ(40, total.counts[PERF_INSTRUCTIONS]);
+	EXPECT_EQ(-1, total.counts[PERF_BRANCH_MISSES]);
+
+	std::ostringstream os;
+	diff.writeJsonMembers(os);
+	EXPECT_EQ("\"cycles\": 300, \"instructions\": null, \"l1d_misses\": "
+			"null, \"llc_misses\": null, \"branch_misses\": null", os.str());
+}
+
+/*
+ * The counters that can be opened here only go up, and the others read as
+ * not counting; timed phases then add their counts to the JSON.
+ */
+TEST(perfcounters, CountsPhases) {
+	perfcounters counters(true);
+	perfsample a, b;
+	counters.read(a);
+	volatile double sum = 0;
+	for (int i = 0; i < 1000000; i++)
+		sum = sum + i;
+	counters.read(b);
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+		if (counters.isCounting((perfCounter) i))
+			EXPECT_GE(b.counts[i], a.counts[i]);
+		else
+			EXPECT_EQ(-1, b.counts[i]);
+	}
+
+	phasetimes times;
+	times.setCounters(&counters);
+	times.start(PHASE_RENDER);
+	times.stop();
+	EXPECT_EQ(counters.isCounting(PERF_CYCLES),
+			times.getCounts(PHASE_RENDER).counts[PERF_CYCLES] >= 0);
+	EXPECT_EQ(-1, times.getCounts(PHASE_PARSE).counts[PERF_CYCLES]);
+	std::ostringstream os;
+	times.writeJson(os, "", 0);
+	std::string json = os.str();
+	EXPECT_NE(std::string::npos, json.find("\"parse\": {\"wall_s\": 0, "
+			"\"cpu_s\": 0, \"counters\": {\"cycles\": null, "));
+	EXPECT_NE(std::string::npos, json.find("\"total\": {\"wall_s\": "));
+	EXPECT_NE(std::string::npos, json.find("\"counters\": {\"cycles\": ",
+			json.find("\"total\"")));
+}
+
+#endif
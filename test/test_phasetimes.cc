@@ -0,0 +1,77 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "phasetimes.hh"
+#include "gtest/gtest.h"
+#include "boost/thread.hpp"
+#include <sstream>
+#include <string>
+
+#ifndef TEST_PHASETIMES_CC
+#define TEST_PHASETIMES_CC
+
+/*
+ * Each phase gets the time until the next one starts, runs of a phase add
+ * up, and time after stop isn't counted.
+ */
+TEST(phasetimes, SplitsTimeByPhase) {
+	phasetimes times;
+	times.start(PHASE_PARSE);
+	boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+	times.start(PHASE_RENDER);
+	volatile double sum = 0;
+	for (int i = 0; i < 20000000; i++)
+		sum = sum + i;
+	times.start(PHASE_PARSE);
+	boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+	times.stop();
+	boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+	times.stop();
+
+	EXPECT_GE(times.getWallSeconds(PHASE_PARSE), 0.038);
+	EXPECT_LT(times.getWallSeconds(PHASE_PARSE), 0.5);
+	EXPECT_LT(times.getCpuSeconds(PHASE_PARSE), 0.02);
+	EXPECT_GT(times.getWallSeconds(PHASE_RENDER), 0);
+	EXPECT_GT(times.getCpuSeconds(PHASE_RENDER), 0);
+	EXPECT_EQ(0, times.getWallSeconds(PHASE_BUILD));
+	EXPECT_EQ(0, times.getWallSeconds(PHASE_WRITE));
+}
+
+/*
+ * The JSON has the given fields first, every phase, the totals and the
+ * peak memory, and rays only when counts are given.
+ */
+TEST(phasetimes, WritesJson) {
+	phasetimes times;
+	std::ostringstream plain, counted;
+	times.writeJson(plain, "\"width\": 4", 0);
+	std::string json = plain.str();
+	EXPECT_EQ(0u, json.find("{\n  \"width\": 4,\n  \"phases\": {"));
+	for (int i = 0; i < PHASE_COUNT; i++)
+		EXPECT_NE(std::string::npos, json.find(std::string("\"") +
+				phaseName((renderPhase) i) + "\": {\"wall_s\": 0, "
+				"\"cpu_s\": 0}"));
+	EXPECT_NE(std::string::npos, json.find("\"total\": {\"wall_s\": 0"));
+	EXPECT_NE(std::string::npos, json.find("\"peak_memory_bytes\": "));
+	EXPECT_NE(std::string::npos, json.find("\"rays\": null\n}\n"));
+#if defined(__unix__) || defined(__APPLE__)
+	EXPECT_GT(peakMemoryBytes(), 0);
+#endif
+
+	raystats rays;
+	rays.closestRays = 10;
+	rays.reflectionRays = 4;
+	rays.shadowRays = 7;
+	rays.tests[0] = 3;
+	rays.tests[2] = 2;
+	times.writeJson(counted, "", &rays);
+	json = counted.str();
+	EXPECT_EQ(0u, json.find("{\n  \"phases\": {"));
+	EXPECT_NE(std::string::npos, json.find("\"rays\": {\"primary\": 6, "
+			"\"shadow\": 7, \"reflection\": 4, \"hits\": 0, "
+			"\"intersection_tests\": 5}"));
+}
+
+#endif
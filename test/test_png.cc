@@ -0,0 +1,109 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "png.hh"
+#include "gtest/gtest.h"
+#include <zlib.h>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef TEST_PNG_CC
+#define TEST_PNG_CC
+
+/*
+ * Reads the 4 byte big-endian number at the given offset.
+ */
+unsigned long readPNGInt(const std::string &s, size_t at) {
+	return (unsigned long) (unsigned char) s[at] << 24 |
+			(unsigned long) (unsigned char) s[at + 1] << 16 |
+			(unsigned long) (unsigned char) s[at + 2] << 8 |
+			(unsigned long) (unsigned char) s[at + 3];
+}
+
+/*
+ * Decodes an image encodePNG wrote, checking the chunk CRCs and the zlib
+ * stream on the way, and undoes the row filters.
+ */
+std::vector<unsigned char> decodePNG(const std::string &png, int &width,
+		int &height) {
+	std::vector<unsigned char> rgb;
+	EXPECT_EQ(std::string("\x89PNG\r\n\x1a\n", 8), png.substr(0, 8));
+	std::string idat;
+	size_t at = 8;
+	while (at < png.size()) {
+		unsigned long len = readPNGInt(png, at);
+		std::string type = png.substr(at + 4, 4);
+		std::string data = png.substr(at + 8, len);
+		uLong crc = crc32(0L, Z_NULL, 0);
+		crc = crc32(crc, (const Bytef *) png.data() + at + 4, len + 4);
+		EXPECT_EQ(crc, readPNGInt(png, at + 8 + len));
+		if (type == "IHDR") {
+			width = (int) readPNGInt(data, 0);
+			height = (int) readPNGInt(data, 4);
+			EXPECT_EQ(8, data[8]);
+			EXPECT_EQ(2, data[9]);
+		}
+		else if (type == "IDAT") {
+			idat += data;
+		}
+		at += 12 + len;
+	}
+	size_t rowBytes = (size_t) width * 3 + 1;
+	std::vector<unsigned char> filtered(rowBytes * height);
+	uLongf size = filtered.size();
+	EXPECT_EQ(Z_OK, uncompress(&filtered[0], &size,
+			(const Bytef *) idat.data(), idat.size()));
+	EXPECT_EQ(filtered.size(), size);
+	rgb.resize((size_t) width * height * 3);
+	for (int y = 0; y < height; y++) {
+		int type = filtered[y * rowBytes];
+		for (int i = 0; i < width * 3; i++) {
+			int a = i >= 3 ? rgb[(size_t) y * width * 3 + i - 3] : 0;
+			int b = y > 0 ? rgb[(size_t) (y - 1) * width * 3 + i] : 0;
+			int c = i >= 3 && y > 0 ?
+					rgb[(size_t) (y - 1) * width * 3 + i - 3] : 0;
+			int pred = 0;
+			if (type == 1)
+				pred = a;
+			else if (type == 2)
+				pred = b;
+			else if (type == 3)
+				pred = (a + b) / 2;
+			else if (type == 4) {
+				int p = a + b - c;
+				int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+				pred = pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+			}
+			rgb[(size_t) y * width * 3 + i] = (unsigned char) (
+					filtered[y * rowBytes + 1 + i] + pred);
+		}
+	}
+	return rgb;
+}
+
+/*
+ * The PNG decodes to the pixels that went in, across several strips, and
+ * is the same file however many threads compress it.
+ */
+TEST(png, RoundTrips) {
+	int width = 37, height = 3 * PNG_STRIP_ROWS + 5;
+	std::vector<unsigned char> rgb((size_t) width * height * 3);
+	for (size_t i = 0; i < rgb.size(); i++)
+		rgb[i] = (unsigned char) (i / 3 % width < 20 ? i * 7 / 3 :
+				(i * 2654435761u) >> 13);
+	std::stringstream one, three;
+	encodePNG(rgb, width, height, one, 1);
+	encodePNG(rgb, width, height, three, 3);
+	ASSERT_EQ(one.str(), three.str());
+	int w = 0, h = 0;
+	std::vector<unsigned char> decoded = decodePNG(one.str(), w, h);
+	ASSERT_EQ(width, w);
+	ASSERT_EQ(height, h);
+	ASSERT_TRUE(decoded == rgb);
+}
+
+#endif // TEST_PNG_CC
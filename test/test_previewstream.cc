@@ -0,0 +1,149 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "previewstream.hh"
+#include "websocket.hh"
+#include "netchannel.hh"
+#include "tilequeue.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+#ifndef TEST_PREVIEWSTREAM_CC
+#define TEST_PREVIEWSTREAM_CC
+
+/*
+ * The hash, the encoding and the handshake answer are those of the
+ * standards' examples, and frames carry their length in as few bytes as
+ * fit.
+ */
+TEST(previewstream, WebSocketPieces) {
+	ASSERT_EQ("qZk+NkcGgWq6PiVxeFDCbJzQ2J0=", base64(sha1("abc")));
+	ASSERT_EQ("2jmj7l5rSw0yVb/vlWAYkK/YBwk=", base64(sha1("")));
+	ASSERT_EQ("Zm9vYg==", base64("foob"));
+	ASSERT_EQ("Zm9vYmE=", base64("fooba"));
+	ASSERT_EQ("Zm9vYmFy", base64("foobar"));
+	ASSERT_EQ("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=",
+			webSocketAccept("dGhlIHNhbXBsZSBub25jZQ=="));
+
+	ASSERT_EQ(std::string("\x82\x03" "abc", 5), webSocketFrame("abc"));
+	std::string frame = webSocketFrame(std::string(300, 'x'));
+	ASSERT_EQ(4u + 300, frame.size());
+	ASSERT_EQ(126, (unsigned char) frame[1]);
+	ASSERT_EQ(300, (unsigned char) frame[2] << 8 | (unsigned char) frame[3]);
+	frame = webSocketFrame(std::string(70000, 'x'));
+	ASSERT_EQ(10u + 70000, frame.size());
+	ASSERT_EQ(127, (unsigned char) frame[1]);
+
+	std::string value;
+	std::string request = "GET / HTTP/1.1\r\nHost: x\r\n"
+			"sec-websocket-key:  abc== \r\n\r\n";
+	ASSERT_TRUE(findHttpHeader(request, "Sec-WebSocket-Key", value));
+	ASSERT_EQ("abc==", value);
+	ASSERT_FALSE(findHttpHeader(request, "Upgrade", value));
+}
+
+/*
+ * Reads a frame the server sent.
+ */
+static bool readFrame(netchannel &client, int &opcode,
+		std::string &payload) {
+	unsigned char head[2];
+	if (!client.receiveAll(reinterpret_cast<char *>(head), 2))
+		return false;
+	opcode = head[0] & 0x0f;
+	unsigned long long size = head[1] & 0x7f;
+	int extra = size == 126 ? 2 : size == 127 ? 8 : 0;
+	if (extra > 0) {
+		unsigned char ext[8];
+		if (!client.receiveAll(reinterpret_cast<char *>(ext), extra))
+			return false;
+		size = 0;
+		for (int i = 0; i < extra; i++)
+			size = size << 8 | ext[i];
+	}
+	payload.resize(size);
+	return size == 0 || client.receiveAll(&payload[0], size);
+}
+
+/*
+ * Reads the header fields of a preview message.
+ */
+static std::vector<int> previewFields(const std::string &message) {
+	std::vector<char> bytes(message.begin(),
+			message.begin() + PREVIEW_HEADER_SIZE);
+	netreader in(bytes);
+	std::vector<int> fields;
+	for (int i = 0; i < 8; i++)
+		fields.push_back((int) in.getInt());
+	return fields;
+}
+
+/*
+ * A client that opens a WebSocket gets a tile with its place, a coarse
+ * pass at its own resolution and the end of the image.
+ */
+TEST(previewstream, PushesTiles) {
+	netlistener listener;
+	ASSERT_TRUE(listener.listen(0));
+	netchannel client, server;
+	ASSERT_TRUE(client.connect("127.0.0.1", listener.getPort()));
+	ASSERT_TRUE(listener.accept(server, 1000));
+	std::string request = "GET /preview HTTP/1.1\r\nHost: localhost\r\n"
+			"Upgrade: websocket\r\nConnection: Upgrade\r\n"
+			"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+			"Sec-WebSocket-Version: 13\r\n\r\n";
+	ASSERT_TRUE(client.sendAll(request.data(), request.size()));
+	std::string error;
+	ASSERT_TRUE(acceptWebSocket(server, error)) << error;
+	std::string answer;
+	char c;
+	while (answer.find("\r\n\r\n") == std::string::npos &&
+			client.receiveAll(&c, 1))
+		answer += c;
+	ASSERT_EQ(0u, answer.find("HTTP/1.1 101"));
+	ASSERT_NE(std::string::npos, answer.find(
+			"Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n"));
+
+	previewstream<double> preview(&server, 10, 6);
+	tilebuffer<double> tile;
+	tile.place(4, 2, 3, 2);
+	for (size_t i = 0; i < tile.pixels.size(); i++)
+		tile.pixels[i] = rgbcolord(0.5, 0.25, 1);
+	ASSERT_TRUE(preview.sendTile(tile));
+	std::vector<rgbcolord> pass(60, rgbcolord(1, 1, 1));
+	ASSERT_TRUE(preview.sendPass(pass, 4));
+	ASSERT_TRUE(preview.sendDone());
+	ASSERT_FALSE(preview.isOpen());
+
+	int opcode;
+	std::string message;
+	ASSERT_TRUE(readFrame(client, opcode, message));
+	ASSERT_EQ(WEBSOCKET_BINARY, opcode);
+	int tileFields[] = { PREVIEW_TILE, 10, 6, 4, 2, 3, 2, 1 };
+	ASSERT_TRUE(std::vector<int>(tileFields, tileFields + 8) ==
+			previewFields(message));
+	ASSERT_EQ("\x89PNG", message.substr(PREVIEW_HEADER_SIZE, 4));
+
+	// The pass's PNG is 3 x 2 pixels, one per 4 x 4 block.
+	ASSERT_TRUE(readFrame(client, opcode, message));
+	int passFields[] = { PREVIEW_TILE, 10, 6, 0, 0, 10, 6, 4 };
+	ASSERT_TRUE(std::vector<int>(passFields, passFields + 8) ==
+			previewFields(message));
+	const unsigned char *ihdr = reinterpret_cast<const unsigned char *>(
+			message.data()) + PREVIEW_HEADER_SIZE + 16;
+	ASSERT_EQ(3, ihdr[3]);
+	ASSERT_EQ(2, ihdr[7]);
+
+	ASSERT_TRUE(readFrame(client, opcode, message));
+	ASSERT_EQ(PREVIEW_HEADER_SIZE, (int) message.size());
+	ASSERT_EQ(PREVIEW_DONE, previewFields(message)[0]);
+	ASSERT_TRUE(readFrame(client, opcode, message));
+	ASSERT_EQ(WEBSOCKET_CLOSE, opcode);
+	ASSERT_FALSE(readFrame(client, opcode, message));
+}
+
+#endif // TEST_PREVIEWSTREAM_CC
@@ -0,0 +1,74 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "processpool.hh"
+#include "gtest/gtest.h"
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#ifndef TEST_PROCESSPOOL_CC
+#define TEST_PROCESSPOOL_CC
+
+/**
+ * Job of the tests: writes the square of each item into the results, and
+ * with @c crashOn set, dies the first time it gets that item.
+ */
+struct squareJob {
+	/** Item to die on the first time, or -1. */
+	int crashOn;
+
+	void operator()(int item, char *results) const {
+		int *squares = reinterpret_cast<int *>(results);
+		// The last slot, shared by all workers, says whether one died yet.
+		if (item == crashOn && squares[100] == 0) {
+			squares[100] = 1;
+			abort();
+		}
+		squares[item] = item * item;
+	}
+};
+
+/*
+ * Workers do every item once into the shared results, however many there
+ * are.
+ */
+TEST(processpool, RunsAllItems) {
+	int procs[] = { 1, 3, 200 };
+	for (int p = 0; p < 3; p++) {
+		processpool pool;
+		ASSERT_TRUE(pool.open(100, 101 * sizeof(int)));
+		squareJob job;
+		job.crashOn = -1;
+		std::vector<std::string> deaths;
+		ASSERT_TRUE(pool.run(procs[p], job, deaths));
+		ASSERT_TRUE(deaths.empty());
+		const int *squares = reinterpret_cast<const int *>(pool.getResults());
+		for (int i = 0; i < 100; i++) {
+			ASSERT_TRUE(pool.isDone(i));
+			ASSERT_EQ(i * i, squares[i]);
+		}
+	}
+}
+
+/*
+ * The item a worker died on is done by the next round, and the death is
+ * told.
+ */
+TEST(processpool, RedoesItemsOfDeadWorkers) {
+	processpool pool;
+	ASSERT_TRUE(pool.open(100, 101 * sizeof(int)));
+	squareJob job;
+	job.crashOn = 37;
+	std::vector<std::string> deaths;
+	ASSERT_TRUE(pool.run(2, job, deaths));
+	ASSERT_EQ(1u, deaths.size());
+	ASSERT_NE(std::string::npos, deaths[0].find("signal"));
+	const int *squares = reinterpret_cast<const int *>(pool.getResults());
+	for (int i = 0; i < 100; i++)
+		ASSERT_EQ(i * i, squares[i]);
+}
+
+#endif // TEST_PROCESSPOOL_CC
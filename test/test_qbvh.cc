@@ -0,0 +1,147 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "qbvh.hh"
+#include "bvh.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "cylinder.hh"
+#include "infplane.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include "boost/shared_ptr.hpp"
+#include <cstdlib>
+#include <vector>
+
+#ifndef TEST_QBVH_CC
+#define TEST_QBVH_CC
+
+/**
+ * This test fixture class sets up a scene full of randomly placed spheres and
+ * cylinders of very different sizes plus a ground plane, along with a batch
+ * of random rays. Note that an object of this class is created before each
+ * test case begins and is torn down when each test case ends.
+ */
+class qbvhTest : public ::testing::Test {
+protected:
+
+	std::vector<sp_shape3d> shapes;
+	std::vector<ray3d> rays;
+
+	static double rnd(double lo, double hi) {
+		return lo + (hi - lo) * (rand() / (double) RAND_MAX);
+	}
+
+	static vector3d rndvec(double lo, double hi) {
+		return vector3d(rnd(lo, hi), rnd(lo, hi), rnd(lo, hi));
+	}
+
+	virtual void SetUp() {
+		srand(4321);
+		rgbcolord col(0.5, 0.5, 0.5);
+		for (int i = 0; i < 400; i++) {
+			shapes.push_back(sp_shape3d(
+					new sphere3d(col, rnd(0.001, 0.5), rndvec(-10, 10))));
+		}
+		// A big one off to the side stretches the root's box.
+		shapes.push_back(sp_shape3d(
+				new sphere3d(col, 5, vector3d(200.0, 0.0, 0.0))));
+		for (int i = 0; i < 100; i++) {
+			shapes.push_back(sp_shape3d(new cylinderd(col, rnd(0.05, 0.3),
+					rndvec(-10, 10), rnd(0.2, 2), rndvec(-1, 1))));
+		}
+		shapes.push_back(sp_shape3d(
+				new infplaned(col, 12, vector3d(0.0, 1.0, 0.0))));
+		for (int i = 0; i < 2000; i++) {
+			rays.push_back(ray3d(rndvec(-15, 15), rndvec(-1, 1)));
+		}
+	}
+
+	virtual void TearDown() { }
+
+	/**
+	 * Checks that a scene using the given hierarchy answers every ray like a
+	 * scene that tests every shape.
+	 */
+	void matchesLinearScan(
+			boost::shared_ptr<accelerator<double, double, double, 3> > accel) {
+		scene3d linear(false), accelerated(false);
+		accelerated.setAccelerator(accel);
+		for (size_t i = 0; i < shapes.size(); i++) {
+			linear.addShape(shapes[i]);
+			accelerated.addShape(shapes[i]);
+		}
+		accelerated.finalize();
+
+		int hits = 0;
+		for (size_t i = 0; i < rays.size(); i++) {
+			double t1, t2;
+			sp_shape3d s1 = linear.findClosestShape(rays[i], t1);
+			sp_shape3d s2 = accelerated.findClosestShape(rays[i], t2);
+			ASSERT_EQ(s1, s2);
+			ASSERT_DOUBLE_EQ(t1, t2);
+			ASSERT_EQ(linear.isOccluded(rays[i], 7),
+					accelerated.isOccluded(rays[i], 7));
+			if (s1 != 0)
+				hits++;
+		}
+		ASSERT_GT(hits, 100);
+	}
+};
+
+/*
+ * Quantized boxes may only grow, so no hit can be lost with either size of
+ * bounds.
+ */
+TEST_F(qbvhTest, MatchesLinearScan) {
+	matchesLinearScan(sp_qbvh3d(new qbvh3d()));
+	matchesLinearScan(sp_qbvh16_3d(new qbvh16_3d()));
+	matchesLinearScan(sp_qbvh3d(new qbvh3d(BVH_BUILD_LBVH, 4)));
+}
+
+/*
+ * The collapsed tree needs fewer nodes and less memory than the binary one,
+ * and 8 bit bounds take less than 16 bit ones.
+ */
+TEST_F(qbvhTest, MemoryUsage) {
+	std::vector<sp_shape3d> bounded(shapes.begin(), shapes.end() - 1);
+	bvh3d binary;
+	qbvh3d q8;
+	qbvh16_3d q16;
+	binary.build(bounded);
+	q8.build(bounded);
+	q16.build(bounded);
+	ASSERT_LT(3 * q8.getNodeCount(), 2 * binary.getNodeCount());
+	ASSERT_EQ(q8.getNodeCount(), q16.getNodeCount());
+	ASSERT_LT(q8.getMemoryUsage(), binary.getMemoryUsage());
+	ASSERT_LT(q8.getMemoryUsage(), q16.getMemoryUsage());
+}
+
+/*
+ * Trees over no shapes or a single shape.
+ */
+TEST_F(qbvhTest, Small) {
+	qbvh3d tree;
+	std::vector<sp_shape3d> none, one(1, shapes[0]);
+	tree.build(none);
+	double t;
+	ASSERT_EQ(-1, tree.closestHit(rays[0], t));
+	ASSERT_EQ(RAY_MISS, t);
+	ASSERT_EQ(-1, tree.anyHit(rays[0], 100));
+	ASSERT_EQ(0, (int) tree.getMemoryUsage());
+
+	tree.build(one);
+	ASSERT_EQ(1, tree.getNodeCount());
+	sphere3d *s = (sphere3d *) shapes[0].get();
+	vector3d from = s->getCenter() + vector3d(0.0, 0.0, 20.0);
+	ray3d r(from, vector3d(0.0, 0.0, -1.0));
+	ASSERT_EQ(0, tree.closestHit(r, t));
+	ASSERT_DOUBLE_EQ(s->intersection(r), t);
+	ASSERT_EQ(0, tree.anyHit(r, 100));
+	ASSERT_EQ(-1, tree.anyHit(r, t));
+}
+
+#endif // TEST_QBVH_CC
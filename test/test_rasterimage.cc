@@ -0,0 +1,136 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "rasterimage.hh"
+#include "framebuffer.hh"
+#include "scene.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef TEST_RASTERIMAGE_CC
+#define TEST_RASTERIMAGE_CC
+
+/*
+ * Makes an image whose pixels all differ.
+ */
+static std::vector<rgbcolord> rasterTestImage(int width, int height) {
+	std::vector<rgbcolord> image;
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+			image.push_back(rgbcolord(x / (double) width, y / (double) height,
+					(x * y % 7) / 6.0));
+	return image;
+}
+
+/*
+ * Splits an image into crops, writes each as the raytracer would and
+ * checks that the merged crops are written as the same bytes as the image.
+ */
+static void expectMergeMatches(ppmFormat format, bool pfm) {
+	int width = 13, height = 9;
+	std::vector<rgbcolord> image = rasterTestImage(width, height);
+	std::ostringstream whole;
+	if (pfm)
+		framebuffer<double>::writePFM(image, width, height, whole);
+	else
+		scene3d::writePPM(image, width, height, whole, format);
+
+	const int crops[][4] = { { 0, 0, 5, 9 }, { 5, 0, 13, 4 },
+			{ 5, 4, 13, 9 } };
+	rasterimage merged(width, height, pfm, format == PPM_P6);
+	for (int c = 0; c < 3; c++) {
+		std::vector<rgbcolord> part;
+		for (int y = crops[c][1]; y < crops[c][3]; y++)
+			for (int x = crops[c][0]; x < crops[c][2]; x++)
+				part.push_back(image[y * width + x]);
+		int w = crops[c][2] - crops[c][0], h = crops[c][3] - crops[c][1];
+		std::ostringstream os;
+		if (pfm)
+			framebuffer<double>::writePFM(part, w, h, os);
+		else
+			scene3d::writePPM(part, w, h, os, format);
+		std::istringstream is(os.str());
+		rasterimage crop;
+		std::string error;
+		ASSERT_TRUE(readRasterImage(is, crop, error)) << error;
+		ASSERT_EQ(w, crop.width);
+		ASSERT_EQ(h, crop.height);
+		ASSERT_TRUE(pasteRasterImage(merged, crop, crops[c][0], crops[c][1],
+				error)) << error;
+	}
+	std::ostringstream out;
+	writeRasterImage(merged, out);
+	ASSERT_EQ(whole.str(), out.str());
+}
+
+/*
+ * Crops of plain and raw PPM and of PFM images merge into the bytes of the
+ * whole image.
+ */
+TEST(rasterimage, MergesCrops) {
+	expectMergeMatches(PPM_P3, false);
+	expectMergeMatches(PPM_P6, false);
+	expectMergeMatches(PPM_P3, true);
+}
+
+/*
+ * Malformed images and crops that don't fit are rejected with a reason.
+ */
+TEST(rasterimage, RejectsBadInput) {
+	const char *files[] = { "P5 1 1 255\n", "P3 1 1\n", "P3 2 1 255\n1 2 3\n",
+			"P3 1 1 65535\n1 2 3\n" };
+	const char *errors[] = { "not a PPM or PFM image.",
+			"the image header is malformed.", "the image ends early.",
+			"the image doesn't have 8 bit channels." };
+	for (int i = 0; i < 4; i++) {
+		std::istringstream is(files[i]);
+		rasterimage image;
+		std::string error;
+		ASSERT_FALSE(readRasterImage(is, image, error)) << files[i];
+		ASSERT_EQ(errors[i], error);
+	}
+	rasterimage dest(4, 4, false, false), src(2, 3, false, false);
+	rasterimage floats(1, 1, true, false);
+	std::string error;
+	ASSERT_TRUE(pasteRasterImage(dest, src, 2, 1, error));
+	ASSERT_FALSE(pasteRasterImage(dest, src, 3, 0, error));
+	ASSERT_EQ("a 2x3 image at (3, 0) doesn't fit in 4x4.", error);
+	ASSERT_FALSE(pasteRasterImage(dest, floats, 0, 0, error));
+	ASSERT_EQ("PPM and PFM images can't be merged.", error);
+}
+
+/*
+ * Images compare by their largest channel difference, with pixels beyond
+ * the tolerance counted, in 8 bit levels for PPM and PFM alike.
+ */
+TEST(rasterimage, ComparesImages) {
+	rasterimage a(2, 2, false, true), b(2, 2, false, true);
+	a.rgb[0] = 10;
+	b.rgb[0] = 12;
+	a.rgb[7] = 200;
+	b.rgb[7] = 199;
+	double maxDiff = -1;
+	size_t differing = 9;
+	std::string error;
+	ASSERT_TRUE(compareRasterImages(a, b, 1, maxDiff, differing, error));
+	EXPECT_EQ(2, maxDiff);
+	EXPECT_EQ(1u, differing);
+	ASSERT_TRUE(compareRasterImages(a, b, 2, maxDiff, differing, error));
+	EXPECT_EQ(0u, differing);
+
+	rasterimage f(2, 2, true, false), g(2, 2, true, false);
+	g.rgbf[11] = 3.0f / QUANTIZE_MAX;
+	ASSERT_TRUE(compareRasterImages(f, g, 1, maxDiff, differing, error));
+	EXPECT_NEAR(3, maxDiff, 1e-4);
+	EXPECT_EQ(1u, differing);
+
+	ASSERT_FALSE(compareRasterImages(a, f, 1, maxDiff, differing, error));
+	EXPECT_EQ("a 2x2 PPM image can't be compared with a 2x2 PFM one.", error);
+}
+
+#endif // TEST_RASTERIMAGE_CC
@@ -0,0 +1,96 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "raystats.hh"
+#include "parallel.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "gtest/gtest.h"
+#include <sstream>
+#include <string>
+
+#ifndef TEST_RAYSTATS_CC
+#define TEST_RAYSTATS_CC
+
+/*
+ * Counts a test of every shape class per index into the calling thread's
+ * counts.
+ */
+struct raystatsCounter {
+	void operator()(int lo, int hi) const {
+		for (int i = lo; i < hi; i++) {
+			raystats &s = raystats::local();
+			s.closestRays++;
+			s.hits += i % 2;
+			for (int k = 0; k < RAYSTATS_SHAPE_KINDS; k++)
+				s.tests[k]++;
+		}
+	}
+};
+
+/*
+ * Counts made on several threads add up in the total, and reset clears
+ * them.
+ */
+TEST(raystats, AddsUpThreads) {
+	raystats::reset();
+	raystatsCounter counter;
+	parallelFor(0, 1000, 4, counter);
+	raystats sum = raystats::total();
+	ASSERT_EQ(1000u, sum.closestRays);
+	ASSERT_EQ(500u, sum.hits);
+	for (int k = 0; k < RAYSTATS_SHAPE_KINDS; k++)
+		ASSERT_EQ(1000u, sum.tests[k]);
+	raystats::reset();
+	ASSERT_EQ(0u, raystats::total().closestRays);
+}
+
+/*
+ * The counts of threads that end are kept in the total but not apart, so
+ * rendering with new threads again and again doesn't pile them up.
+ */
+TEST(raystats, FoldsEndedThreads) {
+	raystats::reset();
+	raystats::local();
+	size_t live = raystats::getLiveThreads();
+	raystatsCounter counter;
+	for (int k = 0; k < 5; k++)
+		parallelFor(0, 100, 4, counter);
+	ASSERT_EQ(live, raystats::getLiveThreads());
+	ASSERT_EQ(500u, raystats::total().closestRays);
+	raystats::reset();
+	ASSERT_EQ(0u, raystats::total().closestRays);
+}
+
+/*
+ * Without RT_STATS the renderer counts nothing; with it, tracing a ray
+ * counts the query, its hit and its tests.
+ */
+TEST(raystats, CountsOnlyWhenEnabled) {
+	raystats::reset();
+	scene3d sc(true);
+	sc.addShape(sp_shape3d(new sphere3d(rgbcolord(1, 1, 1), 1,
+			vector3d(0.0, 0.0, -5.0))));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(1, 1, 1),
+			vector3d(0.0, 5.0, 0.0))));
+	sc.finalize();
+	sc.traceRay(ray3d(vector3d(0.0, 0.0, 0.0), vector3d(0.0, 0.0, -1.0)));
+	raystats sum = raystats::total();
+#ifdef RT_STATS
+	ASSERT_EQ(1u, sum.closestRays);
+	ASSERT_EQ(1u, sum.hits);
+	ASSERT_EQ(1u, sum.shadowRays);
+	ASSERT_GT(sum.tests[SHAPE_SPHERE], 0u);
+#else
+	ASSERT_EQ(0u, sum.closestRays);
+	ASSERT_EQ(0u, sum.shadowRays);
+	ASSERT_EQ(0u, sum.tests[SHAPE_SPHERE]);
+#endif
+	std::ostringstream os;
+	sum.print(os);
+	ASSERT_NE(std::string::npos, os.str().find("mean reflection depth: "));
+}
+
+#endif // TEST_RAYSTATS_CC
@@ -0,0 +1,78 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "rendercommand.hh"
+#include "gtest/gtest.h"
+#include <string>
+
+#ifndef TEST_RENDERCOMMAND_CC
+#define TEST_RENDERCOMMAND_CC
+
+/*
+ * Render commands have a size and a file, then optional samples and a
+ * camera in any order; blank lines and comments are nothing.
+ */
+TEST(rendercommand, ParsesCommands) {
+	rendercommand cmd;
+	std::string error;
+	ASSERT_TRUE(parseRenderCommand("render 640 480 out.png", cmd, error));
+	ASSERT_EQ(COMMAND_RENDER, cmd.kind);
+	ASSERT_EQ(640, cmd.width);
+	ASSERT_EQ(480, cmd.height);
+	ASSERT_EQ("out.png", cmd.file);
+	ASSERT_EQ(0, cmd.samples);
+	ASSERT_FALSE(cmd.hasCamera);
+	ASSERT_EQ(0, cmd.priority);
+	ASSERT_EQ(0, cmd.deadline);
+
+	ASSERT_TRUE(parseRenderCommand("  render 8 4 a.ppm camera <1, 2, 3> "
+			"<0, 0, 0> <0, 1, 0> samples 3\r", cmd, error)) << error;
+	ASSERT_EQ(3, cmd.samples);
+	ASSERT_TRUE(cmd.hasCamera);
+	ASSERT_EQ(2, cmd.position[1]);
+	ASSERT_EQ(1, cmd.up[1]);
+
+	ASSERT_TRUE(parseRenderCommand("render 8 4 a.ppm deadline 250 "
+			"priority -2", cmd, error)) << error;
+	ASSERT_EQ(-2, cmd.priority);
+	ASSERT_EQ(250, cmd.deadline);
+
+	ASSERT_TRUE(parseRenderCommand("quit", cmd, error));
+	ASSERT_EQ(COMMAND_QUIT, cmd.kind);
+	ASSERT_TRUE(parseRenderCommand("", cmd, error));
+	ASSERT_EQ(COMMAND_NONE, cmd.kind);
+	ASSERT_TRUE(parseRenderCommand("# render 1 1 x", cmd, error));
+	ASSERT_EQ(COMMAND_NONE, cmd.kind);
+}
+
+/*
+ * Malformed commands say what's wrong with them.
+ */
+TEST(rendercommand, RejectsMalformed) {
+	const char *lines[] = { "draw 1 1 a.ppm", "render 0 10 a.ppm",
+			"render 1.5 10 a.ppm", "render 10 10", "render 1 1 a samples",
+			"render 1 1 a camera <0, 0, 0> <1, 1>", "render 1 1 a b",
+			"render 1 1 a samples 2 samples 3", "render 1 1 a priority 0.5",
+			"render 1 1 a priority 1 priority 2", "render 1 1 a deadline -5" };
+	const char *errors[] = { "unknown command \"draw\".",
+			"render needs a width, a height and a file.",
+			"render needs a width, a height and a file.",
+			"render needs a width, a height and a file.",
+			"samples needs a positive count.",
+			"camera needs a position, a point to look at and an up "
+			"direction.", "unexpected \"b\" in render.",
+			"unexpected \"samples\" in render.",
+			"priority needs a whole number.",
+			"unexpected \"priority\" in render.",
+			"deadline needs a positive count of milliseconds." };
+	for (int i = 0; i < 11; i++) {
+		rendercommand cmd;
+		std::string error;
+		ASSERT_FALSE(parseRenderCommand(lines[i], cmd, error)) << lines[i];
+		ASSERT_EQ(errors[i], error);
+	}
+}
+
+#endif // TEST_RENDERCOMMAND_CC
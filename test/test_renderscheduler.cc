@@ -0,0 +1,217 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "renderscheduler.hh"
+#include "benchscenes.hh"
+#include "sceneparser.hh"
+#include "scene.hh"
+#include "bvh.hh"
+#include "gtest/gtest.h"
+#include "boost/make_shared.hpp"
+#include "boost/thread.hpp"
+#include <string>
+#include <vector>
+
+#ifndef TEST_RENDERSCHEDULER_CC
+#define TEST_RENDERSCHEDULER_CC
+
+/*
+ * Parses a scene description into a finalized scene with a BVH and
+ * anti-aliasing, returning its camera.
+ */
+static sp_camerad scheduledScene(const std::string &text, scene3d &sc) {
+	scenedescription desc;
+	std::string error;
+	sp_camerad cam;
+	sc.setSupersampling(2, 0.1);
+	sc.setAccelerator(boost::make_shared<bvh<double, double, double, 3> >());
+	bool ok = parseSceneParallel<double, double>(text.data(),
+			text.data() + text.size(), "", 1, desc, error) &&
+			addSceneRecords(sc, &desc.records[0], desc.records.size(),
+			desc.paths, cam, error);
+	EXPECT_TRUE(ok) << error;
+	sc.finalize();
+	return cam;
+}
+
+/*
+ * Checks that two images are the same to the bit.
+ */
+static void expectSameImage(const std::vector<rgbcolord> &a,
+		const std::vector<rgbcolord> &b) {
+	ASSERT_EQ(a.size(), b.size());
+	for (size_t i = 0; i < a.size(); i++) {
+		ASSERT_EQ(a[i].getR(), b[i].getR()) << i;
+		ASSERT_EQ(a[i].getG(), b[i].getG()) << i;
+		ASSERT_EQ(a[i].getB(), b[i].getB()) << i;
+	}
+}
+
+/*
+ * Renders of two scenes, one of them twice at once, come out of one pool
+ * of threads exactly as renderImage renders them alone.
+ */
+TEST(renderscheduler, MatchesRenderImage) {
+	scene3d spheres(true), hall(true);
+	sp_camerad spheresCam = scheduledScene(manySpheresScene(6), spheres);
+	sp_camerad hallCam = scheduledScene(mirrorHallScene(), hall);
+	std::vector<rgbcolord> a, b, c, expectA, expectB, expectC;
+	spheres.renderImage(*spheresCam, 53, 37, expectA);
+	hall.renderImage(*hallCam, 40, 30, expectB);
+	spheres.renderImage(*spheresCam, 20, 64, expectC);
+
+	rendercontext3d ctx;
+	{
+		renderscheduler3d pool(4);
+		int jobA = pool.submit(spheres, *spheresCam, 53, 37, a);
+		int jobB = pool.submit(hall, *hallCam, 40, 30, b, 1, &ctx);
+		int jobC = pool.submit(spheres, *spheresCam, 20, 64, c);
+		pool.wait(jobB);
+		pool.wait(jobC);
+		pool.wait(jobA);
+	}
+	expectSameImage(expectA, a);
+	expectSameImage(expectB, b);
+	expectSameImage(expectC, c);
+	ASSERT_GT(ctx.getSupersampledPixels(), 0u);
+}
+
+/*
+ * Tiles of the job of the highest priority go first, and jobs of the same
+ * priority take turns.
+ */
+TEST(renderscheduler, InterleavesByPriority) {
+	scene3d sc(false);
+	sp_camerad cam = scheduledScene(manySpheresScene(3), sc);
+	std::vector<rgbcolord> low0, low1, high;
+	renderscheduler3d pool(0);
+	int first = pool.submit(sc, *cam, 32, 32, low0);
+	int second = pool.submit(sc, *cam, 48, 16, low1);
+	int urgent = pool.submit(sc, *cam, 32, 16, high, 5);
+	ASSERT_EQ(urgent, pool.runTile());
+	ASSERT_EQ(urgent, pool.runTile());
+	ASSERT_TRUE(pool.isDone(urgent));
+	ASSERT_EQ(first, pool.runTile());
+	ASSERT_EQ(second, pool.runTile());
+	ASSERT_EQ(first, pool.runTile());
+	ASSERT_EQ(second, pool.runTile());
+	ASSERT_EQ(first, pool.runTile());
+	ASSERT_EQ(second, pool.runTile());
+	ASSERT_EQ(first, pool.runTile());
+	ASSERT_TRUE(pool.isDone(first));
+	ASSERT_TRUE(pool.isDone(second));
+	ASSERT_EQ(-1, pool.runTile());
+	pool.wait(urgent);
+	pool.wait(first);
+	pool.wait(second);
+	std::vector<rgbcolord> expect;
+	sc.renderImage(*cam, 48, 16, expect);
+	expectSameImage(expect, low1);
+}
+
+/*
+ * Of jobs of the same priority, the one due soonest goes first and those
+ * with no deadline last, a job of a higher priority still goes before
+ * them all, and each job renders with samples per pixel of its own.
+ */
+TEST(renderscheduler, OrdersByDeadline) {
+	scene3d sc(false);
+	sp_camerad cam = scheduledScene(manySpheresScene(3), sc);
+	std::vector<rgbcolord> none, late, soon, urgent;
+	std::vector<double> tileSeconds;
+	boost::posix_time::ptime now =
+			boost::posix_time::microsec_clock::universal_time();
+	renderscheduler3d pool(0);
+	int noDeadline = pool.submit(sc, *cam, 16, 16, none);
+	renderscheduler3d::settings asked;
+	asked.deadline = now + boost::posix_time::seconds(20);
+	int lateJob = pool.submit(sc, *cam, 16, 16, late, asked);
+	asked.deadline = now + boost::posix_time::seconds(10);
+	asked.samples = 2;
+	asked.tileSeconds = &tileSeconds;
+	int soonJob = pool.submit(sc, *cam, 32, 16, soon, asked);
+	ASSERT_EQ(soonJob, pool.runTile());
+	asked = renderscheduler3d::settings();
+	asked.priority = 1;
+	int urgentJob = pool.submit(sc, *cam, 16, 16, urgent, asked);
+	ASSERT_EQ(urgentJob, pool.runTile());
+	ASSERT_EQ(soonJob, pool.runTile());
+	ASSERT_EQ(lateJob, pool.runTile());
+	ASSERT_EQ(noDeadline, pool.runTile());
+	ASSERT_EQ(-1, pool.runTile());
+	pool.wait(urgentJob);
+	pool.wait(lateJob);
+	pool.wait(noDeadline);
+	pool.wait(soonJob);
+	ASSERT_EQ(2u, tileSeconds.size());
+
+	std::vector<rgbcolord> expect;
+	sc.setPixelSamples(2);
+	sc.renderImage(*cam, 32, 16, expect);
+	expectSameImage(expect, soon);
+	sc.setPixelSamples(1);
+	sc.renderImage(*cam, 16, 16, expect);
+	expectSameImage(expect, none);
+}
+
+/*
+ * Jobs are waited for in the order they're done in until the scheduler is
+ * closed and none are left.
+ */
+TEST(renderscheduler, WaitsForAnyUntilClosed) {
+	scene3d sc(true);
+	sp_camerad cam = scheduledScene(manySpheresScene(4), sc);
+	std::vector<rgbcolord> a, b;
+	renderscheduler3d pool(2);
+	int jobA = pool.submit(sc, *cam, 40, 40, a);
+	int jobB = pool.submit(sc, *cam, 20, 20, b, 3);
+	pool.close();
+	int first = pool.waitAny();
+	int second = pool.waitAny();
+	ASSERT_TRUE((first == jobA && second == jobB) ||
+			(first == jobB && second == jobA));
+	ASSERT_EQ(-1, pool.waitAny());
+	std::vector<rgbcolord> expect;
+	sc.renderImage(*cam, 20, 20, expect);
+	expectSameImage(expect, b);
+}
+
+/*
+ * Renders the image of a scene for a thread of the test below.
+ */
+struct concurrentRender {
+	const scene3d *sc;
+	const camerad *cam;
+	std::vector<rgbcolord> *image;
+
+	void operator()() const {
+		rendercontext3d ctx;
+		for (int i = 0; i < 3; i++)
+			sc->renderImage(*cam, 45, 33, *image, &ctx);
+	}
+};
+
+/*
+ * One scene rendered by several threads at once, each on threads of its
+ * own, gives every one of them the image it gives alone.
+ */
+TEST(renderscheduler, ScenesRenderConcurrently) {
+	scene3d sc(true);
+	sp_camerad cam = scheduledScene(mirrorHallScene(), sc);
+	sc.setRenderThreads(2);
+	std::vector<rgbcolord> expect;
+	sc.renderImage(*cam, 45, 33, expect);
+	std::vector<std::vector<rgbcolord> > images(4);
+	boost::thread_group threads;
+	for (int i = 0; i < 4; i++) {
+		concurrentRender task = { &sc, cam.get(), &images[i] };
+		threads.create_thread(task);
+	}
+	threads.join_all();
+	for (int i = 0; i < 4; i++)
+		expectSameImage(expect, images[i]);
+}
+
+#endif // TEST_RENDERSCHEDULER_CC
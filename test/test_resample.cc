@@ -0,0 +1,94 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "resample.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include <cstdlib>
+#include <vector>
+
+#ifndef TEST_RESAMPLE_CC
+#define TEST_RESAMPLE_CC
+
+/**
+ * Random colors.
+ *
+ * @param width Width of the image.
+ * @param height Height of the image.
+ * @param[out] image Receives the colors.
+ */
+static void randomImage(int width, int height,
+		std::vector<rgbcolord> &image) {
+	srand(7);
+	image.resize((size_t) width * height);
+	for (size_t i = 0; i < image.size(); i++)
+		image[i] = rgbcolord(rand() % 256 / 255.0, rand() % 256 / 255.0,
+				rand() % 256 / 255.0);
+}
+
+/*
+ * Halving with the box filter averages 2 by 2 blocks.
+ */
+TEST(resampler, BoxHalves) {
+	std::vector<rgbcolord> image, half;
+	randomImage(8, 6, image);
+	resamplerd(RESAMPLE_BOX).resample(image, 8, 6, half, 4, 3);
+	ASSERT_EQ(12u, half.size());
+	for (int y = 0; y < 3; y++)
+		for (int x = 0; x < 4; x++) {
+			int p = 2 * y * 8 + 2 * x;
+			double r = (image[p].getR() + image[p + 1].getR() +
+					image[p + 8].getR() + image[p + 9].getR()) / 4;
+			double b = (image[p].getB() + image[p + 1].getB() +
+					image[p + 8].getB() + image[p + 9].getB()) / 4;
+			ASSERT_NEAR(r, half[y * 4 + x].getR(), 1e-12);
+			ASSERT_NEAR(b, half[y * 4 + x].getB(), 1e-12);
+		}
+}
+
+/*
+ * Both filters leave an image of one color that color at any size, and an
+ * image at its own size as it was.
+ */
+TEST(resampler, KeepsFlatAndSameSize) {
+	resampleFilter filters[] = { RESAMPLE_BOX, RESAMPLE_LANCZOS };
+	for (int f = 0; f < 2; f++) {
+		resamplerd r(filters[f]);
+		std::vector<rgbcolord> flat(37 * 23, rgbcolord(0.25, 0.5, 1)), out;
+		r.resample(flat, 37, 23, out, 10, 7);
+		for (size_t i = 0; i < out.size(); i++) {
+			ASSERT_NEAR(0.25, out[i].getR(), 1e-9);
+			ASSERT_NEAR(0.5, out[i].getG(), 1e-9);
+			ASSERT_NEAR(1, out[i].getB(), 1e-9);
+		}
+		std::vector<rgbcolord> image;
+		randomImage(13, 9, image);
+		r.resample(image, 13, 9, out, 13, 9);
+		for (size_t i = 0; i < image.size(); i++)
+			ASSERT_NEAR(image[i].getG(), out[i].getG(), 1e-9);
+	}
+}
+
+/*
+ * The Lanczos filter doesn't leave negative colors next to edges, and
+ * resampling on several threads gives what one does.
+ */
+TEST(resampler, LanczosEdgesAndThreads) {
+	std::vector<rgbcolord> image(64 * 64), one, many;
+	for (int y = 0; y < 64; y++)
+		for (int x = 32; x < 64; x++)
+			image[y * 64 + x] = rgbcolord(1, 1, 1);
+	resamplerd r(RESAMPLE_LANCZOS);
+	r.resample(image, 64, 64, one, 9, 5);
+	r.resample(image, 64, 64, many, 9, 5, 3);
+	for (size_t i = 0; i < one.size(); i++) {
+		ASSERT_GE(one[i].getR(), 0);
+		ASSERT_EQ(one[i].getR(), many[i].getR());
+	}
+	ASSERT_LT(one[0].getR(), 0.01);
+	ASSERT_GT(one[8].getR(), 0.99);
+}
+
+#endif // TEST_RESAMPLE_CC
@@ -325,4 +325,52 @@ TEST_F(rgbcolorTest, Input) {
 	ASSERT_EQ('f', c);
 }
 
+/*
+ * Colors read from a stream must be in [0, 1], and colors made unchecked,
+ * like sums of lights, may be anything.
+ */
+TEST_F(rgbcolorTest, ChecksOnlyInput) {
+	std::stringstream iss("(0.2, 1.5, 0.2)");
+	rgbcolord c_d;
+	ASSERT_THROW(iss >> c_d, std::ios_base::failure);
+	iss.clear();
+	iss.str("(-0.1, 0.2, 0.2)");
+	ASSERT_THROW(iss >> c_d, std::ios_base::failure);
+
+	rgbcolorf sum = rgbcolorf::unchecked(1.5f, -0.25f, 3.0f);
+	ASSERT_FLOAT_EQ(1.5f, sum.getR());
+	ASSERT_FLOAT_EQ(-0.25f, sum.getG());
+	ASSERT_FLOAT_EQ(3.0f, sum.getB());
+	sum += rgbcolorf::unchecked(0.5f, 0.25f, 0);
+	ASSERT_FLOAT_EQ(2.0f, sum.getR());
+	ASSERT_FLOAT_EQ(0, sum.getG());
+}
+
+/*
+ * Sums in SIMD lanes come out bit for bit as sums with the operators do.
+ */
+TEST_F(rgbcolorTest, SumsMatchOperators) {
+	rgbcolord a(0.3, 0.7, 0.1), b(0.9, 0.25, 0.6);
+	rgbcolord expected = a * b * 0.37;
+	expected += a * 0.8;
+	rgbsum<double> sum, other;
+	sum.addProduct(a, b, 0.37);
+	other.add(a);
+	sum.addScaled(other, 0.8);
+	ASSERT_EQ(expected.getR(), sum.get().getR());
+	ASSERT_EQ(expected.getG(), sum.get().getG());
+	ASSERT_EQ(expected.getB(), sum.get().getB());
+
+	rgbcolorf af(0.3f, 0.7f, 0.1f), bf(0.9f, 0.25f, 0.6f);
+	rgbcolorf expectedf = af * bf * 3.7f;
+	expectedf += af;
+	rgbsum<float> sumf;
+	sumf.addProduct(af, bf, 3.7f);
+	sumf.add(af);
+	ASSERT_EQ(expectedf.getR(), sumf.get().getR());
+	ASSERT_EQ(expectedf.getG(), sumf.get().getG());
+	ASSERT_EQ(expectedf.getB(), sumf.get().getB());
+	ASSERT_GT(sumf.get().getG(), 1);
+}
+
 #endif // TEST_RGBCOLOR_CC
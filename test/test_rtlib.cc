@@ -0,0 +1,85 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "rtlib.hh"
+#include "rasterimage.hh"
+#include "gtest/gtest.h"
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#ifndef TEST_RTLIB_CC
+#define TEST_RTLIB_CC
+
+/*
+ * A scene loaded from memory renders into the caller's pixels exactly as
+ * make check's golden image of it, in rows wider than the image, and the
+ * float pixels are the same colors before they're made 8 bit.
+ */
+TEST(rtlib, RendersLikeTheDriver) {
+	std::ifstream in("example.dat", std::ios::in | std::ios::binary);
+	ASSERT_TRUE(in.good());
+	std::string text((std::istreambuf_iterator<char>(in)),
+			std::istreambuf_iterator<char>());
+	std::ifstream goldenFile("test/golden/example.ppm",
+			std::ios::in | std::ios::binary);
+	rasterimage golden;
+	std::string error;
+	ASSERT_TRUE(readRasterImage(goldenFile, golden, error)) << error;
+
+	rtsettings settings;
+	settings.shadows = true;
+	rtrenderer renderer(settings);
+	ASSERT_TRUE(renderer.load(text.data(), text.size(), error)) << error;
+	ASSERT_TRUE(renderer.isLoaded());
+	int w = golden.width, h = golden.height;
+	size_t stride = 3 * w + 5;
+	std::vector<unsigned char> rgb(stride * h, 7);
+	ASSERT_TRUE(renderer.render(w, h, &rgb[0], stride, error)) << error;
+	std::vector<float> colors(3 * w * h);
+	ASSERT_TRUE(renderer.render(w, h, &colors[0], 3 * w, error)) << error;
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < 3 * w; x++) {
+			ASSERT_EQ(golden.rgb[y * 3 * w + x], rgb[y * stride + x]);
+			float v = colors[y * 3 * w + x] * 255;
+			ASSERT_EQ(rgb[y * stride + x], v < 0 ? 0 : v > 255 ? 255 :
+					(int) v);
+		}
+		ASSERT_EQ(7, rgb[y * stride + 3 * w]);
+	}
+}
+
+/*
+ * Renders need a scene and a usable size, and scenes that can't be read
+ * or lack the camera asked for leave no scene.
+ */
+TEST(rtlib, RejectsBadInput) {
+	std::string error;
+	std::vector<unsigned char> rgb(3 * 4 * 4);
+	rtrenderer empty;
+	ASSERT_FALSE(empty.render(4, 4, &rgb[0], 12, error));
+	ASSERT_FALSE(error.empty());
+
+	std::string text = "light (1, 1, 1) <0, 5, 5>\n"
+			"sphere (1, 0, 0) 1 <0, 0, 0> 0\n"
+			"camera <0, 0, 5> <0, 0, 0> <0, 1, 0>\n";
+	rtrenderer renderer;
+	ASSERT_TRUE(renderer.load(text.data(), text.size(), error)) << error;
+	ASSERT_FALSE(renderer.render(4, 1, &rgb[0], 12, error));
+	ASSERT_FALSE(renderer.render(4, 4, &rgb[0], 11, error));
+	ASSERT_TRUE(renderer.render(4, 4, &rgb[0], 12, error)) << error;
+	std::string bad = "sphere (1, 0, 0) 1 <0, 0>";
+	ASSERT_FALSE(renderer.load(bad.data(), bad.size(), error));
+	ASSERT_FALSE(renderer.isLoaded());
+
+	rtsettings settings;
+	settings.camera = "top";
+	rtrenderer named(settings);
+	ASSERT_FALSE(named.load(text.data(), text.size(), error));
+	ASSERT_FALSE(named.isLoaded());
+}
+
+#endif // TEST_RTLIB_CC
@@ -0,0 +1,234 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "sampler.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "infplane.hh"
+#include "arealight.hh"
+#include "camera.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifndef TEST_SAMPLER_CC
+#define TEST_SAMPLER_CC
+
+/*
+ * The first 2^k Sobol samples of any pixel and dimension have one sample in
+ * every box of every grid of 2^k boxes of equal shape.
+ */
+TEST(samplerTest, StratifiesEveryPixel) {
+	pixelsampler sobol(SAMPLER_SOBOL, 7);
+	for (int count = 16; count <= 64; count *= 4) {
+		for (int pixel = 0; pixel < 20; pixel++) {
+			for (unsigned int d = 0; d < 3; d++) {
+				std::vector<double> us(count), vs(count);
+				for (int k = 0; k < count; k++)
+					sobol.get2D(pixel * 13, pixel * 7 - 40, k, d, us[k],
+							vs[k]);
+				for (int cols = 1; cols <= count; cols *= 2) {
+					int rows = count / cols;
+					std::vector<int> boxes(count, 0);
+					for (int k = 0; k < count; k++)
+						boxes[(int) (vs[k] * rows) * cols +
+								(int) (us[k] * cols)]++;
+					for (int b = 0; b < count; b++)
+						ASSERT_EQ(1, boxes[b]) << count << " samples, " <<
+								cols << " columns, pixel " << pixel;
+				}
+			}
+		}
+	}
+
+	// Pixels, dimensions and seeds get different points.
+	double u0, v0, u1, v1, u2, v2, u3, v3;
+	sobol.get2D(0, 0, 0, 0, u0, v0);
+	sobol.get2D(1, 0, 0, 0, u1, v1);
+	sobol.get2D(0, 0, 0, 1, u2, v2);
+	pixelsampler(SAMPLER_SOBOL, 8).get2D(0, 0, 0, 0, u3, v3);
+	ASSERT_NE(u0, u1);
+	ASSERT_NE(u0, u2);
+	ASSERT_NE(u0, u3);
+	double again, unused;
+	sobol.get2D(0, 0, 0, 0, again, unused);
+	ASSERT_EQ(u0, again);
+}
+
+/*
+ * The tile of blue noise has every value once, and the texels below a
+ * threshold keep their distance from each other.
+ */
+TEST(samplerTest, BlueNoiseTable) {
+	const bluenoisetable &table = bluenoisetable::get();
+	const int n = BLUE_NOISE_SIZE;
+	std::vector<float> values;
+	for (int y = 0; y < n; y++)
+		for (int x = 0; x < n; x++)
+			values.push_back(table.at(x, y));
+	std::sort(values.begin(), values.end());
+	for (int i = 0; i < n * n; i++)
+		ASSERT_FLOAT_EQ((i + 0.5f) / (n * n), values[i]);
+	ASSERT_EQ(table.at(3, 5), table.at(3 + n, 5 - n));
+
+	int touching = 0;
+	for (int y = 0; y < n; y++)
+		for (int x = 0; x < n; x++)
+			if (table.at(x, y) < 0.1f)
+				for (int dy = -1; dy <= 1; dy++)
+					for (int dx = -1; dx <= 1; dx++)
+						touching += (dx != 0 || dy != 0) &&
+								table.at(x + dx, y + dy) < 0.1f;
+	ASSERT_EQ(0, touching);
+}
+
+/*
+ * Estimating how much of a pixel a slanted edge covers from 16 samples is
+ * much closer with scrambled Sobol points, plain or shifted by blue noise,
+ * than with independent ones.
+ */
+TEST(samplerTest, ConvergesFaster) {
+	pixelsampler kinds[] = { pixelsampler(SAMPLER_RANDOM),
+			pixelsampler(SAMPLER_SOBOL), pixelsampler(SAMPLER_BLUE_NOISE) };
+	double error[3];
+	for (int s = 0; s < 3; s++) {
+		double sum = 0;
+		for (int y = 0; y < 32; y++) {
+			for (int x = 0; x < 32; x++) {
+				// An edge through the pixel at an angle that depends on it.
+				double a = (x * 32 + y) * 0.01, c = std::cos(a),
+						sn = std::sin(a);
+				double inside = 0;
+				for (int k = 0; k < 16; k++) {
+					double u, v;
+					kinds[s].get2D(x, y, k, 0, u, v);
+					inside += (u - 0.5) * c + (v - 0.5) * sn < 0.1;
+				}
+				double exact = 0;
+				for (int j = 0; j < 64; j++)
+					for (int i = 0; i < 64; i++)
+						exact += ((i + 0.5) / 64 - 0.5) * c +
+								((j + 0.5) / 64 - 0.5) * sn < 0.1;
+				double d = inside / 16 - exact / 4096;
+				sum += d * d;
+			}
+		}
+		error[s] = sum / 1024;
+	}
+	ASSERT_LT(error[1] * 3, error[0]);
+	ASSERT_LT(error[2] * 3, error[0]);
+}
+
+/*
+ * Multisampled images with soft shadows come out the same on any number of
+ * threads, whatever the sampler.
+ */
+TEST(samplerTest, SameForAnyThreadCount) {
+	camera<double, double, 3> cam(vector3d(0.0, 4.0, -8.0),
+			vector3d(0.0, 0.5, 0.0), vector3d(0.0, 1.0, 0.0));
+	samplerKind kinds[] = { SAMPLER_RANDOM, SAMPLER_SOBOL,
+			SAMPLER_BLUE_NOISE };
+	for (int s = 0; s < 3; s++) {
+		scene3d sc(true);
+		sc.setAreaLightMode(AREA_LIGHT_SAMPLED, 4);
+		sc.addShape(sp_shape3d(new sphere3d(rgbcolord(0.8, 0.3, 0.3), 1,
+				vector3d(0.0, 1.0, 0.0))));
+		sc.addShape(sp_shape3d(new infplaned(rgbcolord(0.6, 0.6, 0.6), 0,
+				vector3d(0.0, 1.0, 0.0))));
+		sc.addAreaLight(sp_arealightd(new arealightd(rgbcolord(1, 1, 1),
+				vector3d(1.0, 5.0, 1.0), vector3d(0.0, -1.0, 0.0),
+				vector3d(1.0, 0.0, 0.0), 0.5, 0.5, 3, 3)));
+		sc.finalize();
+		sc.setPixelSamples(2);
+		sc.setSampler(kinds[s], 5);
+		std::vector<rgbcolord> one, three;
+		sc.renderImage(cam, 40, 30, one);
+		sc.setRenderThreads(3);
+		sc.renderImage(cam, 40, 30, three);
+		for (size_t i = 0; i < one.size(); i++) {
+			ASSERT_EQ(one[i].getR(), three[i].getR()) << "pixel " << i;
+			ASSERT_EQ(one[i].getG(), three[i].getG()) << "pixel " << i;
+		}
+	}
+}
+
+/*
+ * Philox gives the known answers of its authors' test vectors, and the
+ * numbers of a sample change with each part of their counter.
+ */
+TEST(samplerTest, PhiloxKnownAnswers) {
+	unsigned int zero[4] = { 0, 0, 0, 0 };
+	philox4x32(zero, 0, 0);
+	unsigned int zeroOut[4] = { 0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu,
+			0x9b00dbd8u };
+	unsigned int pi[4] = { 0x243f6a88u, 0x85a308d3u, 0x13198a2eu,
+			0x03707344u };
+	philox4x32(pi, 0xa4093822u, 0x299f31d0u);
+	unsigned int piOut[4] = { 0xd16cfe09u, 0x94fdccebu, 0x5001e420u,
+			0x24126ea1u };
+	for (int i = 0; i < 4; i++) {
+		ASSERT_EQ(zeroOut[i], zero[i]);
+		ASSERT_EQ(piOut[i], pi[i]);
+	}
+
+	double u = samplerandom(3, 4, 5, 6).get1D(1, RANDOM_ROULETTE);
+	ASSERT_EQ(u, samplerandom(3, 4, 5, 6).get1D(1, RANDOM_ROULETTE));
+	ASSERT_NE(u, samplerandom(3, 4, 5, 6).get1D(1, RANDOM_LIGHT_PICKS));
+	ASSERT_NE(u, samplerandom(3, 4, 5, 6).get1D(2, RANDOM_ROULETTE));
+	ASSERT_NE(u, samplerandom(3, 4, 6, 6).get1D(1, RANDOM_ROULETTE));
+	ASSERT_NE(u, samplerandom(3, 5, 5, 6).get1D(1, RANDOM_ROULETTE));
+	ASSERT_NE(u, samplerandom(3, 4, 5, 7).get1D(1, RANDOM_ROULETTE));
+}
+
+/*
+ * Russian roulette and light picks draw the numbers of the pixel sample
+ * being shaded, so images come out the same on any number of threads and
+ * in wavefronts, while the samples of one pixel don't all make the same
+ * choices.
+ */
+TEST(samplerTest, RandomOfPixelSample) {
+	scene3d sc(true);
+	rgbcolord col(0.5, 0.5, 0.5);
+	sc.addShape(sp_shape3d(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0),
+			0.7)));
+	sc.addShape(sp_shape3d(new sphere3d(rgbcolord(0.8, 0.3, 0.3), 1,
+			vector3d(0.0, 1.0, 0.0), 0.8)));
+	for (int i = 0; i < 12; i++)
+		sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.1, 0.1, 0.1),
+				vector3d(i % 4 * 2.0 - 3, 4.0 + i / 4, 2.0))));
+	sc.finalize();
+	sc.setReflectionLimits(20, 0);
+	sc.setRussianRoulette(0);
+	sc.setLightPicks(2);
+	camera<double, double, 3> cam(vector3d(0.0, 4.0, -8.0),
+			vector3d(0.0, 0.5, 0.0), vector3d(0.0, 1.0, 0.0));
+
+	gbuffer3d gb;
+	std::vector<rgbcolord> tiles, wave, one, three;
+	sc.renderGBuffer(cam, 40, 30, gb);
+	sc.shadeGBuffer(gb, tiles);
+	sc.setRenderThreads(3);
+	sc.shadeWavefront(gb, wave);
+	for (size_t i = 0; i < tiles.size(); i++)
+		ASSERT_EQ(tiles[i].getR(), wave[i].getR()) << "pixel " << i;
+
+	sc.setRenderThreads(1);
+	sc.setPixelSamples(3);
+	sc.renderImage(cam, 40, 30, one);
+	sc.setRenderThreads(3);
+	sc.renderImage(cam, 40, 30, three);
+	int differ = 0;
+	for (size_t i = 0; i < one.size(); i++) {
+		ASSERT_EQ(one[i].getR(), three[i].getR()) << "pixel " << i;
+		ASSERT_EQ(one[i].getG(), three[i].getG()) << "pixel " << i;
+		differ += one[i].getR() != tiles[i].getR();
+	}
+	ASSERT_GT(differ, (int) one.size() / 2);
+}
+
+#endif // TEST_SAMPLER_CC
@@ -11,9 +11,20 @@
 #include "light.hh"
 #include "shape.hh"
 #include "arealight.hh"
+#include "spotlight.hh"
+#include "camera.hh"
+#include "gbuffer.hh"
 #include "infplane.hh"
+#include "cylinder.hh"
+#include "rendercontext.hh"
 #include "gtest/gtest.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <sstream>
+#include <iterator>
+#include <set>
+#include <string>
 #include "boost/make_shared.hpp"
 #include "boost/pointer_cast.hpp"
 
@@ -87,6 +98,20 @@ TEST_F(sceneTest, FindClosestShape) {
 	ASSERT_DOUBLE_EQ(1, intersectionTime);
 }
 
+/*
+ * Only blockers before the given time count.
+ */
+TEST_F(sceneTest, IsOccluded) {
+	ray3d r1(vector3d(1.0, 3.0, 10.0), vector3d(0.0, 0.0, -1.0));
+	ASSERT_TRUE(s->isOccluded(r1, 100));
+	ASSERT_TRUE(s->isOccluded(r1, 3.5));
+	ASSERT_FALSE(s->isOccluded(r1, 3));
+	ASSERT_FALSE(s->isOccluded(r1, 1));
+
+	ray3d r2(vector3d(1.0, 3.0, 10.0), vector3d(0.0, 0.0, 1.0));
+	ASSERT_FALSE(s->isOccluded(r2, 100));
+}
+
 TEST_F(sceneTest, TraceRay) {
 	ray3d r1(vector3d(1.0, 3.0, 10.0), vector3d(0.0, 0.0, 1.0));
 	rgbcolord c1 = s->traceRay(r1);
@@ -106,4 +131,1442 @@ TEST_F(sceneTest, Print) {
 	std::cout << std::endl << *s << std::endl << std::endl;
 }
 
+/*
+ * The shadow cache must not change any colors, and in a scene where one big
+ * sphere shadows a patch of the floor it should get hits.
+ */
+TEST(sceneShadowCache, MatchesUncached) {
+	scene3d sc(true);
+	rgbcolord col(0.5, 0.5, 0.5);
+	sc.addShape(sp_shape3d(new sphere3d(col, 2, vector3d(0.0, 3.0, 0.0))));
+	sc.addShape(sp_shape3d(new sphere3d(col, 0.5, vector3d(3.0, 1.0, 1.0))));
+	sc.addShape(sp_shape3d(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0))));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(1, 1, 1),
+			vector3d(0.0, 10.0, 0.0))));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.5, 0.5, 0.5),
+			vector3d(6.0, 8.0, 2.0))));
+	sc.finalize();
+
+	rendercontext3d ctx;
+	sc.setShadowCache(true);
+	for (int z = -20; z <= 20; z++) {
+		for (int x = -20; x <= 20; x++) {
+			ray3d r(vector3d(0.0, 20.0, 0.0),
+					vector3d(x * 0.2, -20.0, z * 0.2));
+			rgbcolord c1 = sc.traceRay(r);
+			rgbcolord c2 = sc.traceRay(r, 0, &ctx);
+			ASSERT_DOUBLE_EQ(c1.getR(), c2.getR());
+			ASSERT_DOUBLE_EQ(c1.getG(), c2.getG());
+			ASSERT_DOUBLE_EQ(c1.getB(), c2.getB());
+		}
+	}
+	ASSERT_GT(ctx.getShadowCacheHits(), 0u);
+	ASSERT_GT(ctx.getShadowCacheTests(), ctx.getShadowCacheHits());
+
+	// Without the cache turned on the context isn't consulted.
+	rendercontext3d unused;
+	sc.setShadowCache(false);
+	sc.traceRay(ray3d(vector3d(0.0, 20.0, 0.0), vector3d(0.0, -1.0, 0.0)),
+			0, &unused);
+	ASSERT_EQ(0u, unused.getShadowCacheTests());
+}
+
+/*
+ * A sampled area light that's tiny compared to its distance lights the scene
+ * like a point light with its color.
+ */
+TEST(sceneAreaLight, SampledMatchesPointLight) {
+	scene3d sampled(true), point(true);
+	sampled.setAreaLightMode(AREA_LIGHT_SAMPLED, 8);
+	rgbcolord col(0.5, 0.5, 0.5), white(1, 1, 1);
+	vector3d center(0.0, 6.0, 1.0);
+	sp_shape3d ball(new sphere3d(col, 1, vector3d(0.0, 2.0, 0.0)));
+	sp_shape3d floor(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0)));
+	sp_arealightd area(new arealightd(white, center, vector3d(0.0, -1.0, 0.0),
+			vector3d(1.0, 0.0, 0.0), 0.001, 0.001, 0.01, 0.01));
+	sampled.addShape(ball);
+	sampled.addShape(floor);
+	sampled.addAreaLight(area);
+	point.addShape(ball);
+	point.addShape(floor);
+	point.addPointLight(sp_lightd(new lightd(white, center)));
+	sampled.finalize();
+	point.finalize();
+	for (int x = -10; x <= 10; x++) {
+		ray3d r(vector3d(x * 0.5, 10.0, 0.0), vector3d(0.0, -1.0, 0.0));
+		rgbcolord c1 = sampled.traceRay(r), c2 = point.traceRay(r);
+		ASSERT_NEAR(c2.getR(), c1.getR(), 1e-2);
+	}
+
+	// A light with its own sample count ignores the scene's.
+	area->setSampleCount(3);
+	rgbcolord c = sampled.traceRay(ray3d(vector3d(4.0, 10.0, 0.0),
+			vector3d(0.0, -1.0, 0.0)));
+	ASSERT_GT(c.getR(), 0);
+}
+
+/*
+ * Adaptive shadow sampling shades points that are fully lit or fully in the
+ * shadow of a soft shadow like sampling every shadow ray does, and only
+ * differs a little in penumbrae, where the first samples can miss a few
+ * blocked ones.
+ */
+TEST(sceneAreaLight, AdaptiveShadows) {
+	scene3d sc(true), unshadowed(false);
+	sc.setAreaLightMode(AREA_LIGHT_SAMPLED, 16);
+	unshadowed.setAreaLightMode(AREA_LIGHT_SAMPLED, 16);
+	rgbcolord col(0.5, 0.5, 0.5);
+	sp_shape3d ball(new sphere3d(col, 1, vector3d(0.0, 2.0, 0.0)));
+	sp_shape3d floor(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0)));
+	sp_arealightd area(new arealightd(rgbcolord(1, 1, 1),
+			vector3d(0.0, 5.0, 0.0), vector3d(0.0, -1.0, 0.0),
+			vector3d(1.0, 0.0, 0.0), 0.25, 0.25, 1, 1));
+	sc.addShape(ball);
+	sc.addShape(floor);
+	sc.addAreaLight(area);
+	unshadowed.addShape(ball);
+	unshadowed.addShape(floor);
+	unshadowed.addAreaLight(area);
+	sc.finalize();
+	unshadowed.finalize();
+
+	// Rays from under the ball straight down to the floor.
+	std::vector<ray3d> rays;
+	for (int z = -20; z <= 20; z++)
+		for (int x = -20; x <= 20; x++)
+			rays.push_back(ray3d(vector3d(x * 0.15, 0.5, z * 0.15),
+					vector3d(0.0, -1.0, 0.0)));
+	std::vector<rgbcolord> all;
+	for (size_t i = 0; i < rays.size(); i++)
+		all.push_back(sc.traceRay(rays[i]));
+	sc.setAdaptiveShadows(4);
+	int lit = 0, dark = 0;
+	double err = 0;
+	for (size_t i = 0; i < rays.size(); i++) {
+		rgbcolord c = sc.traceRay(rays[i]);
+		double full = unshadowed.traceRay(rays[i]).getR();
+		if (all[i].getR() == 0) {
+			dark++;
+			ASSERT_EQ(0, c.getR());
+		}
+		else if (fabs(all[i].getR() - full) < 1e-12) {
+			lit++;
+			ASSERT_NEAR(all[i].getR(), c.getR(), 1e-12);
+		}
+		err += fabs(c.getR() - all[i].getR());
+	}
+	ASSERT_GT(dark, 10);
+	ASSERT_GT(lit, 100);
+	ASSERT_LT(err / rays.size(), 0.01);
+}
+
+/*
+ * The shading kernel picked for a scene honors its settings: shadows block
+ * only with shadows on, reflections add only with a reflection depth, and
+ * a sampled area light casts soft shadows.
+ */
+TEST(sceneShadeKernel, FollowsSettings) {
+	rgbcolord col(0.5, 0.5, 0.5), white(1, 1, 1);
+	sp_shape3d ball(new sphere3d(col, 1, vector3d(0.0, 2.0, 0.0)));
+	sp_shape3d floor(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0), 0.5f));
+	sp_lightd above(new lightd(white, vector3d(0.0, 6.0, 0.0)));
+	sp_lightd side(new lightd(white, vector3d(-6.0, 1.0, 0.0)));
+	scene3d shadows(true), plain(false);
+	shadows.addShape(ball);
+	shadows.addShape(floor);
+	shadows.addPointLight(above);
+	shadows.finalize();
+	plain.addShape(ball);
+	plain.addShape(floor);
+	plain.addPointLight(above);
+	plain.addPointLight(side);
+	plain.finalize();
+
+	// The floor right under the ball.
+	ray3d under(vector3d(0.0, 1.0, 5.0), vector3d(0.0, -1.0, -5.0));
+	shadows.setReflectionLimits(0, 0);
+	ASSERT_DOUBLE_EQ(0, shadows.traceRay(under).getR());
+	ASSERT_GT(plain.traceRay(under).getR(), 0);
+
+	// The floor, which reflects the lit side of the ball.
+	ray3d mirror(vector3d(-3.0, 2.0, 0.0), vector3d(1.5, -2.0, 0.0));
+	double reflected = plain.traceRay(mirror).getR();
+	plain.setReflectionLimits(0, 0);
+	ASSERT_GT(reflected, plain.traceRay(mirror).getR());
+
+	scene3d soft(true);
+	soft.setAreaLightMode(AREA_LIGHT_SAMPLED, 16);
+	soft.addShape(ball);
+	soft.addShape(floor);
+	soft.addAreaLight(sp_arealightd(new arealightd(white,
+			vector3d(0.0, 6.0, 0.0), vector3d(0.0, -1.0, 0.0),
+			vector3d(1.0, 0.0, 0.0), 0.5, 0.5, 2, 2)));
+	soft.setReflectionLimits(0, 0);
+	soft.finalize();
+	bool penumbra = false;
+	for (int x = 0; x <= 30 && !penumbra; x++) {
+		ray3d down(vector3d(x * 0.1, 0.5, 3.0), vector3d(0.0, -0.5, -3.0));
+		double c = soft.traceRay(down).getR();
+		ray3d away(vector3d(x * 0.1 + 3, 0.5, 3.0),
+				vector3d(0.0, -0.5, -3.0));
+		penumbra = c > 0 && c < 0.9 * soft.traceRay(away).getR();
+	}
+	ASSERT_TRUE(penumbra);
+}
+
+/*
+ * Shadow and reflection rays leave the sphere or plane they start on, so
+ * far from the origin, where a float can't tell the hit point from the
+ * offset one, nothing shadows or reflects itself.
+ */
+TEST(sceneShadeKernel, NoSelfHitsFarOut) {
+	rgbcolorf col(0.5f, 0.5f, 0.5f);
+	vector3f n = vector3f(0.1f, 1.0f, 0.05f).norm();
+	vector3f q = n * -5000.0f, side(1.0f, -0.1f, 0.0f);
+	sp_shape3f floor(new infplanef(col, 5000, n, 0.5f));
+	sp_shape3f ball(new sphere3f(col, 40, q + n * 20.0f - side * 30.0f));
+	sp_lightf above(new lightf(rgbcolorf(1, 1, 1),
+			q + n * 400.0f + side * 100.0f));
+	scene3f shadows(true), plain(false), mirror(false);
+	scene3f *both[] = { &shadows, &plain };
+	for (int k = 0; k < 2; k++) {
+		both[k]->addShape(floor);
+		both[k]->addShape(ball);
+		both[k]->addPointLight(above);
+		both[k]->finalize();
+		both[k]->setReflectionLimits(0, 0);
+	}
+	// The floor alone, which only reflects black sky.
+	mirror.addShape(floor);
+	mirror.addPointLight(above);
+	mirror.finalize();
+
+	int lit = 0;
+	for (int i = 0; i < 400; i++) {
+		vector3f dir = n * -1.0f + side * (-0.4f + (i % 20) * 0.04f) +
+				vector3f(0.0f, 0.0f, -0.4f + (i / 20) * 0.04f);
+		ray3f r(q + n * 100.0f + side * 30.0f, dir);
+		float c = shadows.traceRay(r).getR();
+		ASSERT_EQ(plain.traceRay(r).getR(), c) << i;
+		lit += c > 0;
+		mirror.setReflectionLimits(0, 0);
+		c = mirror.traceRay(r).getR();
+		mirror.setReflectionLimits(1, 0);
+		ASSERT_EQ(c, mirror.traceRay(r).getR()) << i;
+	}
+	ASSERT_GT(lit, 300);
+}
+
+/*
+ * Rendering with lights culled per screen tile must give the same image as
+ * shading every pixel with every light, and narrow spotlights must be culled
+ * from most tiles.
+ */
+TEST(sceneTileLights, MatchesAllLights) {
+	scene3d sc(true);
+	rgbcolord col(0.5, 0.5, 0.5);
+	sc.addShape(sp_shape3d(new sphere3d(col, 1, vector3d(0.0, 1.0, 0.0))));
+	sc.addShape(sp_shape3d(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0))));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.2, 0.2, 0.2),
+			vector3d(0.0, 10.0, 5.0))));
+	for (int i = 0; i < 8; i++) {
+		vector3d pos(i * 2.0 - 7.0, 6.0, 0.0);
+		sc.addSpotLight(sp_spotlightd(new spotlightd(rgbcolord(0.3, 0.3, 0.3),
+				pos, vector3d(0.0, -1.0, 0.0), 0.2, 0.05)));
+	}
+	sc.finalize();
+	camerad cam(vector3d(0.0, 8.0, 8.0), vector3d(0.0, 0.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	int width = 70, height = 45;
+
+	std::stringstream expected, tiled;
+	expected << "P3 " << width << " " << height << " " << COLORMAX <<
+			std::endl;
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			rgbcolord c = sc.traceRay(cam.getRayForPixel(x, y, width, height));
+			c *= COLORMAX;
+			c.clamp(0, COLORMAX);
+			expected << (int)c.getR() << " " << (int)c.getG() << " " <<
+					(int)c.getB() << std::endl;
+		}
+	}
+	rendercontext3d ctx;
+	sc.renderPPM(cam, width, height, tiled, &ctx);
+	ASSERT_EQ(expected.str(), tiled.str());
+	ASSERT_EQ(15u * 9, ctx.getTileLightsTotal());
+	ASSERT_LT(2 * ctx.getTileLightsKept(), ctx.getTileLightsTotal());
+
+	std::vector<int> kept;
+	sc.findTileLights(aabb3d(vector3d(-1.5, 0.0, -0.5),
+			vector3d(-0.5, 0.0, 0.5)), kept);
+	ASSERT_EQ(2, (int) kept.size());
+	ASSERT_EQ(0, kept[0]);
+	ASSERT_EQ(4, kept[1]);
+}
+
+/*
+ * A G-buffer can be shaded again after a light changed, giving the same
+ * colors as tracing the camera rays from scratch.
+ */
+TEST(sceneGBuffer, ReshadeAfterLightChange) {
+	scene3d sc(true);
+	rgbcolord col(0.5, 0.5, 0.5);
+	sc.addShape(sp_shape3d(new sphere3d(col, 1, vector3d(0.0, 1.0, 0.0),
+			0.4)));
+	sc.addShape(sp_shape3d(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0))));
+	sp_lightd key(new lightd(rgbcolord(1, 1, 1), vector3d(2.0, 6.0, 3.0)));
+	sc.addPointLight(key);
+	sc.finalize();
+	camerad cam(vector3d(0.0, 3.0, 6.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	int width = 40, height = 30;
+
+	gbuffer3d gb;
+	sc.renderGBuffer(cam, width, height, gb);
+	ASSERT_EQ(width, gb.getWidth());
+	ASSERT_EQ(height, gb.getHeight());
+	std::vector<rgbcolord> first, second;
+	sc.shadeGBuffer(gb, first);
+	key->setColor(rgbcolord(0.2, 0.9, 0.4));
+	sc.shadeGBuffer(gb, second);
+	int changed = 0;
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			int k = y * width + x;
+			rgbcolord c = sc.traceRay(cam.getRayForPixel(x, y, width, height));
+			ASSERT_EQ(c.getR(), second[k].getR());
+			ASSERT_EQ(c.getG(), second[k].getG());
+			ASSERT_EQ(c.getB(), second[k].getB());
+			if (first[k].getG() != second[k].getG())
+				changed++;
+		}
+	}
+	ASSERT_GT(changed, width * height / 2);
+}
+
+/*
+ * The wavefront renderer shades scenes without reflections exactly like the
+ * recursive one and reflective ones up to rounding. Sorting its queues or
+ * tracing its shadow rays in packets changes nothing.
+ */
+TEST(sceneWavefront, MatchesRecursive) {
+	for (int reflective = 0; reflective < 2; reflective++) {
+		scene3d sc(true);
+		rgbcolord col(0.5, 0.6, 0.7);
+		double refl = reflective ? 0.5 : 0;
+		sc.addShape(sp_shape3d(new sphere3d(col, 1, vector3d(-1.0, 1.0, 0.0),
+				refl)));
+		sc.addShape(sp_shape3d(new sphere3d(col, 1, vector3d(1.2, 1.0, 0.0),
+				refl)));
+		sc.addShape(sp_shape3d(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0),
+				refl)));
+		sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.8, 0.8, 0.8),
+				vector3d(2.0, 6.0, 3.0))));
+		sc.addSpotLight(sp_spotlightd(new spotlightd(rgbcolord(0.5, 0.5, 0.5),
+				vector3d(-3.0, 5.0, 2.0), vector3d(0.5, -1.0, -0.3), 0.4)));
+		sc.finalize();
+		camerad cam(vector3d(0.0, 3.0, 6.0), vector3d(0.0, 1.0, 0.0),
+				vector3d(0.0, 1.0, 0.0));
+		gbuffer3d gb;
+		sc.renderGBuffer(cam, 37, 29, gb);
+		std::vector<rgbcolord> recursive, wavefront, sorted, packed;
+		sc.shadeGBuffer(gb, recursive);
+		sc.shadeWavefront(gb, wavefront);
+		sc.setSortSecondaryRays(true);
+		sc.shadeWavefront(gb, sorted);
+		sc.setSortSecondaryRays(false);
+		sc.setShadowPackets(true);
+		sc.shadeWavefront(gb, packed);
+		ASSERT_EQ(recursive.size(), wavefront.size());
+		for (size_t i = 0; i < recursive.size(); i++) {
+			ASSERT_EQ(wavefront[i].getR(), sorted[i].getR());
+			ASSERT_EQ(wavefront[i].getG(), sorted[i].getG());
+			ASSERT_EQ(wavefront[i].getR(), packed[i].getR());
+			ASSERT_EQ(wavefront[i].getB(), packed[i].getB());
+			if (reflective) {
+				ASSERT_NEAR(recursive[i].getR(), wavefront[i].getR(), 1e-12);
+				ASSERT_NEAR(recursive[i].getB(), wavefront[i].getB(), 1e-12);
+			}
+			else {
+				ASSERT_EQ(recursive[i].getR(), wavefront[i].getR());
+				ASSERT_EQ(recursive[i].getB(), wavefront[i].getB());
+			}
+		}
+	}
+}
+
+/*
+ * The wavefront renderer keeps its queues from pass to pass: a second pass
+ * over the same G-buffer grows none of them, whichever thread gets which
+ * band, and shades the same colors.
+ */
+TEST(sceneWavefront, ReusesPools) {
+	scene3d sc(true);
+	rgbcolord col(0.5, 0.6, 0.7);
+	for (int i = 0; i < 6; i++)
+		sc.addShape(sp_shape3d(new sphere3d(col, 0.6, vector3d(i - 2.5, 1.0,
+				-0.5 * i), 0.4)));
+	sc.addShape(sp_shape3d(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0),
+			0.3)));
+	for (int i = 0; i < 3; i++)
+		sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.4, 0.4, 0.4),
+				vector3d(i * 2.0 - 2, 6.0, 3.0))));
+	sc.finalize();
+	camerad cam(vector3d(0.0, 3.0, 6.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	gbuffer3d gb;
+	sc.renderGBuffer(cam, 45, 37, gb);
+	sc.setSortSecondaryRays(true);
+	sc.setRenderThreads(2);
+	ASSERT_TRUE(sc.getWavefrontPools().empty());
+
+	std::vector<rgbcolord> first, second;
+	sc.shadeWavefront(gb, first);
+	wavefrontpool<double, double, double, 3> before, after;
+	for (size_t i = 0; i < sc.getWavefrontPools().size(); i++)
+		before.mergeStats(sc.getWavefrontPools()[i]);
+	ASSERT_EQ(2u, sc.getWavefrontPools().size());
+	ASSERT_EQ(3ul, before.bands);
+	ASSERT_GT(before.grownBands, 0ul);
+	ASSERT_GT(before.shadowPeak, 0u);
+	ASSERT_GT(before.pathPeak, 0u);
+
+	sc.shadeWavefront(gb, second);
+	for (size_t i = 0; i < sc.getWavefrontPools().size(); i++)
+		after.mergeStats(sc.getWavefrontPools()[i]);
+	ASSERT_EQ(6ul, after.bands);
+	ASSERT_EQ(before.grownBands, after.grownBands);
+	for (size_t i = 0; i < first.size(); i++) {
+		ASSERT_EQ(first[i].getR(), second[i].getR());
+		ASSERT_EQ(first[i].getB(), second[i].getB());
+	}
+
+	std::ostringstream os;
+	sc.printWavefrontPools(os);
+	ASSERT_NE(std::string::npos, os.str().find("wavefront pools: at most"));
+}
+
+/*
+ * Between two parallel mirrors the reflections go on until the depth cap.
+ * Cutting them off at a small throughput changes the colors by at most
+ * about that much light, and a depth cap of 0 leaves only direct light.
+ */
+TEST(sceneReflection, Limits) {
+	scene3d sc(false);
+	rgbcolord col(0.5, 0.5, 0.5);
+	sc.addShape(sp_shape3d(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0),
+			0.6)));
+	sc.addShape(sp_shape3d(new infplaned(col, 4, vector3d(0.0, -1.0, 0.0),
+			0.6)));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(1, 1, 1),
+			vector3d(0.0, 2.0, 0.0))));
+	sc.finalize();
+
+	std::vector<ray3d> rays;
+	for (int i = 1; i <= 10; i++)
+		rays.push_back(ray3d(vector3d(0.0, 2.0, 0.0),
+				vector3d(i * 0.1, -1.0, 0.3)));
+	std::vector<rgbcolord> full, cut, direct, wave;
+	for (size_t i = 0; i < rays.size(); i++)
+		full.push_back(sc.traceRay(rays[i]));
+	sc.setReflectionLimits(MAX_REFLECT, 0.01);
+	for (size_t i = 0; i < rays.size(); i++)
+		cut.push_back(sc.traceRay(rays[i]));
+	sc.setReflectionLimits(0, 0);
+	for (size_t i = 0; i < rays.size(); i++)
+		direct.push_back(sc.traceRay(rays[i]));
+	for (size_t i = 0; i < rays.size(); i++) {
+		ASSERT_GT(full[i].getR(), cut[i].getR());
+		ASSERT_NEAR(full[i].getR(), cut[i].getR(), 0.03);
+		ASSERT_GT(cut[i].getR(), direct[i].getR() + 0.1);
+	}
+
+	// The wavefront renderer follows the same limits.
+	sc.setReflectionLimits(3, 0);
+	camerad cam(vector3d(0.0, 2.0, 0.0), vector3d(1.0, 0.0, 0.5),
+			vector3d(0.0, 1.0, 0.0));
+	gbuffer3d gb;
+	sc.renderGBuffer(cam, 9, 7, gb);
+	sc.shadeGBuffer(gb, full);
+	sc.shadeWavefront(gb, wave);
+	for (size_t i = 0; i < full.size(); i++)
+		ASSERT_NEAR(full[i].getR(), wave[i].getR(), 1e-12);
+}
+
+/*
+ * With shadows on, a light cutoff drops a light too dim to matter, and only
+ * that one, from both the recursive and the wavefront renderer. Without
+ * shadows there's no shadow ray to save, so nothing is dropped.
+ */
+TEST(sceneLightCutoff, DropsDimLights) {
+	for (int shadows = 0; shadows < 2; shadows++) {
+		scene3d sc(shadows != 0);
+		sc.addShape(sp_shape3d(new infplaned(rgbcolord(0.5, 0.5, 0.5), 0,
+				vector3d(0.0, 1.0, 0.0))));
+		sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.8, 0.8, 0.8),
+				vector3d(0.0, 5.0, 0.0))));
+		sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.002, 0.002, 0.002),
+				vector3d(3.0, 5.0, 0.0))));
+		sc.finalize();
+		camerad cam(vector3d(0.0, 3.0, 4.0), vector3d(0.0, 0.0, 0.0),
+				vector3d(0.0, 1.0, 0.0));
+		gbuffer3d gb;
+		sc.renderGBuffer(cam, 11, 9, gb);
+		std::vector<rgbcolord> all, cut, wave;
+		sc.shadeGBuffer(gb, all);
+		sc.setLightCutoff(1 / 255.0);
+		sc.shadeGBuffer(gb, cut);
+		sc.shadeWavefront(gb, wave);
+		for (size_t i = 0; i < all.size(); i++) {
+			ASSERT_EQ(cut[i].getR(), wave[i].getR());
+			if (shadows) {
+				ASSERT_LT(cut[i].getR(), all[i].getR());
+				ASSERT_NEAR(all[i].getR(), cut[i].getR(), 0.001);
+			}
+			else {
+				ASSERT_EQ(all[i].getR(), cut[i].getR());
+			}
+		}
+	}
+}
+
+/*
+ * Russian roulette leaves the first reflections alone and keeps the average
+ * color of the deeper ones about the same.
+ */
+TEST(sceneReflection, RussianRoulette) {
+	scene3d sc(false);
+	rgbcolord col(0.5, 0.5, 0.5);
+	sc.addShape(sp_shape3d(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0),
+			0.7)));
+	sc.addShape(sp_shape3d(new infplaned(col, 4, vector3d(0.0, -1.0, 0.0),
+			0.7)));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(1, 1, 1),
+			vector3d(0.0, 2.0, 0.0))));
+	sc.finalize();
+	sc.setReflectionLimits(30, 0);
+
+	std::vector<ray3d> rays;
+	for (int i = 0; i < 2000; i++)
+		rays.push_back(ray3d(vector3d(0.0, 2.0, 0.0),
+				vector3d(0.01 + i * 0.0002, -1.0, 0.3)));
+	double exact = 0, rr = 0, shallow = 0;
+	int differ = 0;
+	for (size_t i = 0; i < rays.size(); i++) {
+		sc.setRussianRoulette(-1);
+		double a = sc.traceRay(rays[i]).getR();
+		sc.setRussianRoulette(30);
+		double b = sc.traceRay(rays[i]).getR();
+		sc.setRussianRoulette(2);
+		double c = sc.traceRay(rays[i]).getR();
+		ASSERT_EQ(a, b);
+		exact += a;
+		rr += c;
+		if (a != c)
+			differ++;
+		sc.setReflectionLimits(2, 0);
+		shallow += sc.traceRay(rays[i]).getR();
+		sc.setReflectionLimits(30, 0);
+	}
+	ASSERT_GT(differ, 1000);
+	ASSERT_NEAR(exact / rays.size(), rr / rays.size(),
+			0.05 * (exact - shallow) / rays.size());
+}
+
+/*
+ * Picking a few of many lights per point keeps the average color about the
+ * same, changes nothing when there are no more lights than picks, and
+ * shades the same traced or in wavefronts.
+ */
+TEST(sceneLightPicks, KeepsAverage) {
+	scene3d sc(true);
+	rgbcolord col(0.8, 0.6, 0.4);
+	sc.addShape(sp_shape3d(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0))));
+	sc.addShape(sp_shape3d(new sphere3d(col, 1, vector3d(0.0, 1.0, 0.0))));
+	for (int i = 0; i < 40; i++) {
+		double a = i * 0.7, r = 1 + (i % 7);
+		sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.01 * (1 + i % 3),
+				0.02, 0.01 * (1 + i % 5)),
+				vector3d(r * std::cos(a), 2.0 + i % 4, r * std::sin(a)))));
+	}
+	sc.finalize();
+	camerad cam(vector3d(0.0, 5.0, 6.0), vector3d(0.0, 0.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	gbuffer3d gb;
+	sc.renderGBuffer(cam, 48, 36, gb);
+	std::vector<rgbcolord> all, picked, wave;
+	sc.shadeGBuffer(gb, all);
+	sc.setLightPicks(40);
+	sc.shadeGBuffer(gb, picked);
+	for (size_t i = 0; i < all.size(); i++)
+		ASSERT_EQ(all[i].getR(), picked[i].getR()) << "pixel " << i;
+
+	sc.setLightPicks(4);
+	sc.shadeGBuffer(gb, picked);
+	sc.shadeWavefront(gb, wave);
+	double exact = 0, sum = 0;
+	int differ = 0;
+	for (size_t i = 0; i < all.size(); i++) {
+		ASSERT_EQ(picked[i].getR(), wave[i].getR()) << "pixel " << i;
+		exact += all[i].getR() + all[i].getG() + all[i].getB();
+		sum += picked[i].getR() + picked[i].getG() + picked[i].getB();
+		differ += all[i].getR() != picked[i].getR();
+	}
+	ASSERT_GT(differ, (int) all.size() / 2);
+	ASSERT_NEAR(exact, sum, 0.02 * exact);
+}
+
+/*
+ * Splitting a render over threads changes neither the G-buffer nor any
+ * pixel, and the counters of all threads end up in the caller's context.
+ */
+TEST(sceneThreads, MatchesSerial) {
+	scene3d sc(true);
+	sc.setShadowCache(true);
+	rgbcolord col(0.5, 0.6, 0.7);
+	for (int i = 0; i < 12; i++)
+		sc.addShape(sp_shape3d(new sphere3d(col, 0.4, vector3d(i % 4 - 1.5,
+				0.5 + i / 4, -0.3 * i), 0.2 * (i % 3))));
+	sc.addShape(sp_shape3d(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0),
+			0.3)));
+	for (int i = 0; i < 3; i++)
+		sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.4, 0.4, 0.4),
+				vector3d(i * 2.0 - 2, 6.0, 3.0))));
+	sc.finalize();
+	camerad cam(vector3d(0.0, 3.0, 6.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+
+	// An image size that isn't a multiple of the tile size.
+	gbuffer3d serialGb, parallelGb;
+	std::vector<rgbcolord> serial, parallel, serialWave, parallelWave;
+	rendercontext3d serialCtx, parallelCtx;
+	sc.renderGBuffer(cam, 53, 37, serialGb);
+	sc.shadeGBuffer(serialGb, serial, &serialCtx);
+	sc.shadeWavefront(serialGb, serialWave);
+	sc.setRenderThreads(3);
+	ASSERT_EQ(3, sc.getRenderThreads());
+	sc.renderGBuffer(cam, 53, 37, parallelGb);
+	sc.shadeGBuffer(parallelGb, parallel, &parallelCtx);
+	sc.shadeWavefront(parallelGb, parallelWave);
+
+	ASSERT_EQ(serial.size(), parallel.size());
+	for (size_t i = 0; i < serial.size(); i++) {
+		ASSERT_EQ(serialGb.getHit((int) i).id, parallelGb.getHit((int) i).id);
+		ASSERT_EQ(serialGb.getHit((int) i).t, parallelGb.getHit((int) i).t);
+		ASSERT_EQ(serial[i].getR(), parallel[i].getR());
+		ASSERT_EQ(serial[i].getG(), parallel[i].getG());
+		ASSERT_EQ(serial[i].getB(), parallel[i].getB());
+		ASSERT_EQ(serialWave[i].getR(), parallelWave[i].getR());
+		ASSERT_EQ(serialWave[i].getB(), parallelWave[i].getB());
+	}
+	ASSERT_EQ(serialCtx.getTileLightsTotal(),
+			parallelCtx.getTileLightsTotal());
+	ASSERT_EQ(serialCtx.getTileLightsKept(), parallelCtx.getTileLightsKept());
+}
+
+/*
+ * Fills a scene for the rasterized primary visibility tests: shapes beside
+ * the image, behind the camera, around its plane and off the screen, and a
+ * plane. The camera is at (0, 3, 6), looking at (0, 1, 0).
+ */
+static void addRasterScene(scene3d &sc) {
+	rgbcolord col(0.5, 0.6, 0.7);
+	for (int i = 0; i < 40; i++)
+		sc.addShape(sp_shape3d(new sphere3d(col, 0.1 + 0.05 * (i % 5),
+				vector3d(i % 8 - 3.5, 0.4 + i / 8, -0.7 * (i % 7)))));
+	sc.addShape(sp_shape3d(new cylinderd(col, 0.3, vector3d(1.0, 1.0, 1.0),
+			2.0, vector3d(1.0, 1.0, 0.0))));
+	sc.addShape(sp_shape3d(new sphere3d(col, 1, vector3d(0.0, 3.0, 9.0))));
+	sc.addShape(sp_shape3d(new sphere3d(col, 1, vector3d(2.0, 3.0, 6.0))));
+	sc.addShape(sp_shape3d(new sphere3d(col, 0.5, vector3d(40.0, 3.0, 0.0))));
+	sc.addShape(sp_shape3d(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0))));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.8, 0.8, 0.8),
+			vector3d(0.0, 6.0, 3.0))));
+	sc.finalize();
+}
+
+/*
+ * Checks that two G-buffers have the same rays and hits.
+ */
+static void expectSameHits(const gbuffer3d &a, const gbuffer3d &b) {
+	ASSERT_EQ(a.getWidth(), b.getWidth());
+	ASSERT_EQ(a.getHeight(), b.getHeight());
+	for (int i = 0; i < a.getWidth() * a.getHeight(); i++) {
+		ASSERT_EQ(a.getHit(i).id, b.getHit(i).id);
+		ASSERT_EQ(a.getHit(i).t, b.getHit(i).t);
+		ASSERT_EQ(a.getHit(i).obj, b.getHit(i).obj);
+		for (int k = 0; k < 3; k++)
+			ASSERT_EQ(a.getRay(i).getDir()[k], b.getRay(i).getDir()[k]);
+	}
+}
+
+/*
+ * Rasterizing the camera rays finds the same hits as tracing them, with
+ * shapes beside the image, behind the camera and around it, and the shapes
+ * off the screen are never tested.
+ */
+TEST(sceneRasterPrimary, MatchesTraced) {
+	scene3d sc(true);
+	addRasterScene(sc);
+	camerad cam(vector3d(0.0, 3.0, 6.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+
+	primarybins<double, double, 3> bins;
+	sc.binShapes(cam, 61, 43, bins);
+	ASSERT_EQ(2u, bins.getEverywhere().size());
+	for (int y = 0; y < 43; y++)
+		for (int x = 0; x < 61; x++) {
+			const std::vector<int> &tile = bins.getTile(x, y);
+			ASSERT_TRUE(std::find(tile.begin(), tile.end(), 43) == tile.end());
+		}
+
+	// An image size that isn't a multiple of the tile size.
+	gbuffer3d traced, rastered;
+	sc.renderGBuffer(cam, 61, 43, traced);
+	sc.setRasterPrimary(true);
+	sc.setRenderThreads(2);
+	sc.renderGBuffer(cam, 61, 43, rastered);
+	expectSameHits(traced, rastered);
+	int hits = 0;
+	for (int i = 0; i < 61 * 43; i++)
+		hits += traced.getHit(i).id >= 0 && traced.getHit(i).id < 41;
+	ASSERT_GT(hits, 100);
+}
+
+/*
+ * Culling the bins by the frustum of each tile keeps the hits the same
+ * while testing fewer shapes, and bins the sphere reaching behind the
+ * camera instead of testing it everywhere.
+ */
+TEST(sceneTileFrustums, MatchesTraced) {
+	scene3d sc(true);
+	addRasterScene(sc);
+	camerad cam(vector3d(0.0, 3.0, 6.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+
+	primarybins<double, double, 3> rects, culled;
+	sc.binShapes(cam, 61, 43, rects);
+	sc.setTileFrustums(true);
+	sc.binShapes(cam, 61, 43, culled);
+	ASSERT_EQ(1u, culled.getEverywhere().size());
+	size_t rectCandidates = 0, culledCandidates = 0;
+	for (int y = 0; y < 43; y++)
+		for (int x = 0; x < 61; x++) {
+			const std::vector<int> &a = rects.getTile(x, y);
+			const std::vector<int> &b = culled.getTile(x, y);
+			rectCandidates += rects.getEverywhere().size();
+			culledCandidates += culled.getEverywhere().size();
+			for (size_t i = 0; i < a.size(); i++)
+				rectCandidates += rects.covers(a[i], x, y);
+			for (size_t i = 0; i < b.size(); i++)
+				culledCandidates += culled.covers(b[i], x, y);
+		}
+	ASSERT_LT(culledCandidates, rectCandidates);
+
+	gbuffer3d traced, culledGb;
+	sc.setTileFrustums(false);
+	sc.renderGBuffer(cam, 61, 43, traced);
+	sc.setTileFrustums(true);
+	sc.renderGBuffer(cam, 61, 43, culledGb);
+	expectSameHits(traced, culledGb);
+
+	// A camera looking along an axis, where tile planes are axis aligned.
+	camerad side(vector3d(-8.0, 2.0, -2.0), vector3d(0.0, 2.0, -2.0),
+			vector3d(0.0, 1.0, 0.0));
+	sc.setTileFrustums(false);
+	sc.renderGBuffer(side, 40, 40, traced);
+	sc.setTileFrustums(true);
+	sc.renderGBuffer(side, 40, 40, culledGb);
+	expectSameHits(traced, culledGb);
+}
+
+/*
+ * Reprojecting the hits of a camera into itself traces only the border and
+ * the edges of shapes and finds the same hits, and after a small move
+ * nearly all the hits are still the ones tracing finds.
+ */
+TEST(sceneReproject, MatchesTraced) {
+	scene3d sc(true);
+	addRasterScene(sc);
+	camerad cam(vector3d(0.0, 3.0, 6.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	gbuffer3d before, traced, reprojected;
+	sc.renderGBuffer(cam, 61, 43, before);
+	sc.setRenderThreads(2);
+	int reused = sc.reprojectGBuffer(cam, 61, 43, before, reprojected);
+	ASSERT_GT(reused, 61 * 43 / 2);
+	expectSameHits(before, reprojected);
+
+	camerad moved(vector3d(0.1, 3.0, 6.0), vector3d(0.0, 1.05, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	sc.renderGBuffer(moved, 61, 43, traced);
+	reused = sc.reprojectGBuffer(moved, 61, 43, before, reprojected);
+	ASSERT_GT(reused, 61 * 43 / 2);
+	int differ = 0;
+	for (int i = 0; i < 61 * 43; i++) {
+		if (traced.getHit(i).id != reprojected.getHit(i).id) {
+			differ++;
+			continue;
+		}
+		ASSERT_EQ(traced.getHit(i).t, reprojected.getHit(i).t);
+	}
+	ASSERT_LE(differ, 61 * 43 / 100);
+}
+
+/**
+ * Sink for @c scene::renderProgressive that keeps every pass.
+ */
+struct passRecorder {
+	std::vector<std::vector<rgbcolord> > passes;
+	std::vector<int> blocks;
+
+	void operator()(const std::vector<rgbcolord> &image, int width,
+			int height, int block) {
+		passes.push_back(image);
+		blocks.push_back(block);
+	}
+};
+
+/*
+ * Records the bands a streaming render writes.
+ */
+struct bandRecorder {
+	std::vector<int> starts;
+	std::vector<rgbcolord> image;
+
+	void operator()(const tilebuffer<double> &band) {
+		starts.push_back(band.y0);
+		image.insert(image.end(), band.pixels.begin(), band.pixels.end());
+	}
+};
+
+/*
+ * A streaming render writes its bands top down and they make up exactly
+ * the image of a full render, on one thread or several.
+ */
+TEST(sceneStreaming, MatchesFullRender) {
+	scene3d sc(true);
+	rgbcolord col(0.5, 0.6, 0.7);
+	for (int i = 0; i < 6; i++)
+		sc.addShape(sp_shape3d(new sphere3d(col, 0.5, vector3d(i - 2.5,
+				1.0, -0.4 * i), 0.3)));
+	sc.addShape(sp_shape3d(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0),
+			0.3)));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.8, 0.8, 0.8),
+			vector3d(1.0, 6.0, 3.0))));
+	sc.finalize();
+	camerad cam(vector3d(0.0, 3.0, 6.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	int width = 37, height = 3 * RENDER_TILE_SIZE + 5;
+	gbuffer3d gb;
+	std::vector<rgbcolord> full;
+	sc.renderGBuffer(cam, width, height, gb);
+	sc.shadeGBuffer(gb, full);
+
+	for (int threads = 1; threads <= 3; threads += 2) {
+		sc.setRenderThreads(threads);
+		bandRecorder rec;
+		sc.renderStreaming(cam, width, height, rec);
+		ASSERT_EQ(4u, rec.starts.size());
+		for (int b = 0; b < 4; b++)
+			ASSERT_EQ(b * RENDER_TILE_SIZE, rec.starts[b]);
+		ASSERT_EQ(full.size(), rec.image.size());
+		for (size_t i = 0; i < full.size(); i++) {
+			ASSERT_EQ(full[i].getR(), rec.image[i].getR());
+			ASSERT_EQ(full[i].getG(), rec.image[i].getG());
+			ASSERT_EQ(full[i].getB(), rec.image[i].getB());
+		}
+	}
+}
+
+/*
+ * Puts the bands of renderBands into an image, from any thread.
+ */
+struct bandPlacer {
+	std::vector<rgbcolord> *image;
+	int width;
+
+	void operator()(const tilebuffer<double> &band) const {
+		std::copy(band.pixels.begin(), band.pixels.end(),
+				image->begin() + (size_t) band.y0 * width);
+	}
+};
+
+/*
+ * Bands handed out on the render threads make up exactly the image of a
+ * full render.
+ */
+TEST(sceneStreaming, BandsMatchFullRender) {
+	scene3d sc(true);
+	rgbcolord col(0.5, 0.6, 0.7);
+	for (int i = 0; i < 4; i++)
+		sc.addShape(sp_shape3d(new sphere3d(col, 0.5, vector3d(i - 1.5,
+				1.0, -0.4 * i), 0.3)));
+	sc.addShape(sp_shape3d(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0),
+			0.3)));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.8, 0.8, 0.8),
+			vector3d(1.0, 6.0, 3.0))));
+	sc.finalize();
+	camerad cam(vector3d(0.0, 3.0, 6.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	int width = 29, height = 2 * RENDER_TILE_SIZE + 3;
+	gbuffer3d gb;
+	std::vector<rgbcolord> full;
+	sc.renderGBuffer(cam, width, height, gb);
+	sc.shadeGBuffer(gb, full);
+
+	sc.setRenderThreads(3);
+	std::vector<rgbcolord> image((size_t) width * height,
+			rgbcolord(1, 1, 1));
+	bandPlacer placer;
+	placer.image = &image;
+	placer.width = width;
+	sc.renderBands(cam, width, height, placer);
+	for (size_t i = 0; i < full.size(); i++) {
+		ASSERT_EQ(full[i].getR(), image[i].getR());
+		ASSERT_EQ(full[i].getG(), image[i].getG());
+		ASSERT_EQ(full[i].getB(), image[i].getB());
+	}
+}
+
+/*
+ * Collects the distinct shapes binned in the tiles of some rows.
+ */
+static std::set<int> binnedShapes(const primarybins<double, double, 3> &bins,
+		int width, int y0, int y1) {
+	std::set<int> found;
+	for (int y = y0; y < y1; y++)
+		for (int x = 0; x < width; x++) {
+			const std::vector<int> &tile = bins.getTile(x, y);
+			found.insert(tile.begin(), tile.end());
+		}
+	return found;
+}
+
+/*
+ * A render a strip at a time writes its strips top down, each binned with
+ * just the shapes that may show up in it, and they make up exactly the
+ * image of a full render, on one thread or several.
+ */
+TEST(sceneStrips, MatchesFullRender) {
+	scene3d sc(true);
+	addRasterScene(sc);
+	camerad cam(vector3d(0.0, 3.0, 6.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	int width = 61, height = 4 * RENDER_TILE_SIZE + 5;
+
+	primarybins<double, double, 3> whole, top;
+	sc.binShapes(cam, width, height, whole);
+	top.reset(width, height, 0, RENDER_TILE_SIZE);
+	top.cullByFrustum(cam);
+	for (int i = 0; i < (int) sc.getShapes().size(); i++) {
+		aabb3d box;
+		if (sc.getShapes()[i]->getBounds(box))
+			top.add(cam, i, box);
+	}
+	std::set<int> inTop = binnedShapes(top, width, 0, RENDER_TILE_SIZE);
+	std::set<int> inWhole = binnedShapes(whole, width, 0, height);
+	ASSERT_LT(inTop.size(), inWhole.size());
+	ASSERT_GT(inTop.size(), 0u);
+
+	gbuffer3d gb;
+	std::vector<rgbcolord> full;
+	sc.renderGBuffer(cam, width, height, gb);
+	sc.shadeGBuffer(gb, full);
+	for (int threads = 1; threads <= 3; threads += 2) {
+		sc.setRenderThreads(threads);
+		bandRecorder rec;
+		sc.renderStrips(cam, width, height, 2 * RENDER_TILE_SIZE - 3, rec);
+		ASSERT_EQ(3u, rec.starts.size());
+		for (int s = 0; s < 3; s++)
+			ASSERT_EQ(2 * s * RENDER_TILE_SIZE, rec.starts[s]);
+		ASSERT_EQ(full.size(), rec.image.size());
+		for (size_t i = 0; i < full.size(); i++) {
+			ASSERT_EQ(full[i].getR(), rec.image[i].getR());
+			ASSERT_EQ(full[i].getG(), rec.image[i].getG());
+			ASSERT_EQ(full[i].getB(), rec.image[i].getB());
+		}
+	}
+}
+
+/*
+ * Random choices are keyed by the pixel in the image, not in the band, so
+ * streamed, band and strip renders with Russian roulette and light picks
+ * make exactly the image of a full render.
+ */
+TEST(sceneStrips, RandomChoicesMatchFullRender) {
+	scene3d sc(true);
+	rgbcolord col(0.5, 0.6, 0.7);
+	for (int i = 0; i < 6; i++)
+		sc.addShape(sp_shape3d(new sphere3d(col, 0.5, vector3d(i - 2.5,
+				1.0, -0.4 * i), 0.6)));
+	sc.addShape(sp_shape3d(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0),
+			0.5)));
+	for (int i = 0; i < 8; i++)
+		sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.2, 0.2, 0.2),
+				vector3d(i - 3.5, 6.0, 3.0 - i))));
+	sc.setRussianRoulette(0);
+	sc.setLightPicks(1);
+	sc.finalize();
+	camerad cam(vector3d(0.0, 3.0, 6.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	int width = 33, height = 3 * RENDER_TILE_SIZE + 5;
+	gbuffer3d gb;
+	std::vector<rgbcolord> full;
+	sc.renderGBuffer(cam, width, height, gb);
+	sc.shadeGBuffer(gb, full);
+
+	sc.setRenderThreads(2);
+	bandRecorder streamed, strips;
+	sc.renderStreaming(cam, width, height, streamed);
+	sc.renderStrips(cam, width, height, 2 * RENDER_TILE_SIZE, strips);
+	std::vector<rgbcolord> bands((size_t) width * height);
+	bandPlacer placer;
+	placer.image = &bands;
+	placer.width = width;
+	sc.renderBands(cam, width, height, placer);
+	const std::vector<rgbcolord> *images[] = { &streamed.image,
+			&strips.image, &bands };
+	for (int m = 0; m < 3; m++) {
+		const std::vector<rgbcolord> &image = *images[m];
+		ASSERT_EQ(full.size(), image.size()) << m;
+		for (size_t i = 0; i < full.size(); i++) {
+			ASSERT_EQ(full[i].getR(), image[i].getR()) << m << " " << i;
+			ASSERT_EQ(full[i].getG(), image[i].getG()) << m << " " << i;
+			ASSERT_EQ(full[i].getB(), image[i].getB()) << m << " " << i;
+		}
+	}
+}
+
+/*
+ * Shading into a tiled framebuffer gives the colors of shading in
+ * scanline order.
+ */
+TEST(sceneTiled, MatchesScanline) {
+	scene3d sc(true);
+	rgbcolord col(0.5, 0.6, 0.7);
+	for (int i = 0; i < 4; i++)
+		sc.addShape(sp_shape3d(new sphere3d(col, 0.5, vector3d(i - 1.5,
+				1.0, -0.4 * i), 0.3)));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.8, 0.8, 0.8),
+			vector3d(1.0, 6.0, 3.0))));
+	sc.finalize();
+	camerad cam(vector3d(0.0, 3.0, 6.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	int width = 37, height = 21;
+	gbuffer3d gb;
+	std::vector<rgbcolord> full, converted;
+	sc.renderGBuffer(cam, width, height, gb);
+	sc.shadeGBuffer(gb, full);
+	tiledframebuffer<double> fb;
+	sc.setRenderThreads(2);
+	sc.shadeGBuffer(gb, fb);
+	ASSERT_EQ(RENDER_TILE_SIZE, fb.getTileSize());
+	fb.toScanline(converted);
+	ASSERT_EQ(full.size(), converted.size());
+	for (size_t i = 0; i < full.size(); i++) {
+		ASSERT_EQ(full[i].getR(), converted[i].getR());
+		ASSERT_EQ(full[i].getB(), converted[i].getB());
+	}
+}
+
+/*
+ * Progressive passes go from coarse blocks down to the exact image of a
+ * full render, on one thread or several.
+ */
+TEST(sceneProgressive, EndsWithFullImage) {
+	scene3d sc(true);
+	rgbcolord col(0.5, 0.6, 0.7);
+	for (int i = 0; i < 6; i++)
+		sc.addShape(sp_shape3d(new sphere3d(col, 0.5, vector3d(i - 2.5,
+				1.0, -0.4 * i), 0.3)));
+	sc.addShape(sp_shape3d(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0),
+			0.3)));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.8, 0.8, 0.8),
+			vector3d(1.0, 6.0, 3.0))));
+	sc.finalize();
+	camerad cam(vector3d(0.0, 3.0, 6.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	int width = 45, height = 29;
+	gbuffer3d gb;
+	std::vector<rgbcolord> full;
+	sc.renderGBuffer(cam, width, height, gb);
+	sc.shadeGBuffer(gb, full);
+
+	for (int threads = 1; threads <= 3; threads += 2) {
+		sc.setRenderThreads(threads);
+		passRecorder rec;
+		sc.renderProgressive(cam, width, height, rec);
+		ASSERT_EQ(4u, rec.passes.size());
+		for (int p = 0; p < 4; p++)
+			ASSERT_EQ(8 >> p, rec.blocks[p]);
+
+		// The first pass is flat over each block and exact at its corner.
+		const std::vector<rgbcolord> &coarse = rec.passes[0];
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				int corner = y / 8 * 8 * width + x / 8 * 8;
+				ASSERT_EQ(coarse[corner].getR(), coarse[y * width + x].getR());
+				ASSERT_EQ(full[corner].getR(), coarse[corner].getR());
+			}
+		}
+		const std::vector<rgbcolord> &last = rec.passes[3];
+		for (size_t i = 0; i < full.size(); i++) {
+			ASSERT_EQ(full[i].getR(), last[i].getR());
+			ASSERT_EQ(full[i].getG(), last[i].getG());
+			ASSERT_EQ(full[i].getB(), last[i].getB());
+		}
+	}
+}
+
+/*
+ * Sink for @c scene::renderProgressive that stops the render after a given
+ * number of passes.
+ */
+struct passCanceler {
+	boost::atomic<bool> *cancel;
+	int passes;
+	int stopAfter;
+
+	void operator()(const std::vector<rgbcolord>&, int, int, int) {
+		if (++passes == stopAfter)
+			cancel->store(true);
+	}
+};
+
+/*
+ * A canceled progressive render sends no pass after the one it was
+ * canceled in and says it didn't finish; one never canceled finishes.
+ */
+TEST(sceneProgressive, StopsWhenCanceled) {
+	scene3d sc(true);
+	sc.addShape(sp_shape3d(new sphere3d(rgbcolord(0.9, 0.2, 0.2), 1,
+			vector3d(0.0, 1.0, 0.0))));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.8, 0.8, 0.8),
+			vector3d(1.0, 6.0, 3.0))));
+	sc.finalize();
+	camerad cam(vector3d(0.0, 3.0, 6.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	boost::atomic<bool> cancel(false);
+	passCanceler stop;
+	stop.cancel = &cancel;
+	stop.passes = 0;
+	stop.stopAfter = 2;
+	ASSERT_FALSE(sc.renderProgressive(cam, 30, 20, stop, 0,
+			RENDER_PROGRESSIVE_BLOCK, &cancel));
+	ASSERT_EQ(2, stop.passes);
+
+	cancel.store(false);
+	stop.passes = 0;
+	stop.stopAfter = 0;
+	ASSERT_TRUE(sc.renderProgressive(cam, 30, 20, stop, 0,
+			RENDER_PROGRESSIVE_BLOCK, &cancel));
+	ASSERT_EQ(4, stop.passes);
+}
+
+/*
+ * Anti-aliasing only touches pixels next to another shape or a different
+ * color, and softens edges by mixing the colors of both sides.
+ */
+TEST(sceneSupersample, RefinesEdgesOnly) {
+	scene3d sc(true);
+	sc.addShape(sp_shape3d(new sphere3d(rgbcolord(0.9, 0.2, 0.2), 1,
+			vector3d(0.0, 1.0, 0.0))));
+	sc.addShape(sp_shape3d(new infplaned(rgbcolord(0.3, 0.3, 0.8), 0,
+			vector3d(0.0, 1.0, 0.0))));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.8, 0.8, 0.8),
+			vector3d(1.0, 6.0, 3.0))));
+	sc.finalize();
+	camerad cam(vector3d(0.0, 2.0, 5.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	int width = 40, height = 30;
+	gbuffer3d gb;
+	std::vector<rgbcolord> plain, refined;
+	sc.renderGBuffer(cam, width, height, gb);
+	sc.shadeGBuffer(gb, plain);
+	refined = plain;
+	sc.supersample(cam, gb, refined);
+	for (size_t i = 0; i < plain.size(); i++)
+		ASSERT_EQ(plain[i].getR(), refined[i].getR());
+
+	sc.setSupersampling(4, 0.1);
+	sc.setRenderThreads(2);
+	rendercontext3d ctx;
+	sc.supersample(cam, gb, refined, &ctx);
+	int edges = 0, changed = 0;
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			int k = y * width + x;
+			bool edge = false;
+			int nx[] = { x - 1, x + 1, x, x }, ny[] = { y, y, y - 1, y + 1 };
+			for (int i = 0; i < 4; i++) {
+				if (nx[i] < 0 || ny[i] < 0 || nx[i] >= width ||
+						ny[i] >= height)
+					continue;
+				int kn = ny[i] * width + nx[i];
+				rgbcolord d = plain[k] - plain[kn];
+				if (gb.getHit(k).id != gb.getHit(kn).id ||
+						fabs(d.getR()) > 0.1 || fabs(d.getG()) > 0.1 ||
+						fabs(d.getB()) > 0.1)
+					edge = true;
+			}
+			if (edge)
+				edges++;
+			else
+				ASSERT_EQ(plain[k].getR(), refined[k].getR());
+			if (plain[k].getR() != refined[k].getR())
+				changed++;
+		}
+	}
+	ASSERT_EQ((unsigned long) edges, ctx.getSupersampledPixels());
+	ASSERT_GT(changed, 20);
+	ASSERT_LT(edges, width * height / 3);
+}
+
+/*
+ * Jittered samples per pixel are repeatable whatever the thread count,
+ * stay close to the one sample color in flat regions and blend on edges.
+ */
+TEST(sceneMultisample, StratifiedAverage) {
+	scene3d sc(true);
+	sc.addShape(sp_shape3d(new sphere3d(rgbcolord(0.9, 0.2, 0.2), 1,
+			vector3d(0.0, 1.0, 0.0))));
+	sc.addShape(sp_shape3d(new infplaned(rgbcolord(0.3, 0.3, 0.8), 0,
+			vector3d(0.0, 1.0, 0.0))));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.8, 0.8, 0.8),
+			vector3d(1.0, 6.0, 3.0))));
+	sc.finalize();
+	camerad cam(vector3d(0.0, 2.0, 5.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	int width = 40, height = 30;
+	gbuffer3d gb;
+	std::vector<rgbcolord> plain, serial, parallel;
+	sc.renderGBuffer(cam, width, height, gb);
+	sc.shadeGBuffer(gb, plain);
+	sc.setPixelSamples(3);
+	sc.renderMultisampled(cam, width, height, serial);
+	sc.setRenderThreads(3);
+	sc.renderMultisampled(cam, width, height, parallel);
+	ASSERT_EQ(plain.size(), serial.size());
+	int blended = 0;
+	for (int y = 1; y < height - 1; y++) {
+		for (int x = 1; x < width - 1; x++) {
+			int k = y * width + x;
+			ASSERT_EQ(serial[k].getR(), parallel[k].getR());
+			ASSERT_EQ(serial[k].getB(), parallel[k].getB());
+			bool flat = true;
+			int nk[] = { k - 1, k + 1, k - width, k + width };
+			for (int i = 0; i < 4; i++)
+				if (gb.getHit(nk[i]).id != gb.getHit(k).id ||
+						fabs(plain[nk[i]].getB() - plain[k].getB()) > 0.05)
+					flat = false;
+			if (flat)
+				ASSERT_NEAR(plain[k].getB(), serial[k].getB(), 0.05);
+			else if (serial[k].getR() != plain[k].getR())
+				blended++;
+		}
+	}
+	ASSERT_GT(blended, 20);
+}
+
+/*
+ * With pixel visibility, the samples of pixels that see one shape skip
+ * the shadow rays their corners agree on, and the image stays all but the
+ * same; what the corners record is only reused within the pixel, by the
+ * hit it's set for.
+ */
+TEST(sceneMultisample, PixelVisibility) {
+	rendercontext3d ctx;
+	int a = 0, b = 0;
+	ctx.beginPixelVisibility();
+	ctx.setVisibilityHit(&a, true);
+	ctx.recordVisibility(&a, 0, true);
+	ctx.recordVisibility(&a, 0, false);
+	ctx.recordVisibility(&a, 2, true);
+	ctx.recordVisibility(&b, 1, false);
+	ASSERT_EQ(-1, ctx.getVisibility(&a, 2));
+	ctx.setVisibilityHit(&a, true);
+	ctx.recordVisibility(&a, 2, true);
+	ctx.setVisibilityHit(&b, false);
+	ASSERT_EQ(-1, ctx.getVisibility(&b, 0));
+	ASSERT_EQ(-1, ctx.getVisibility(&b, 1));
+	ASSERT_EQ(1, ctx.getVisibility(&b, 2));
+	ASSERT_EQ(-1, ctx.getVisibility(&a, 2));
+	ctx.beginPixelVisibility();
+	ASSERT_EQ(-1, ctx.getVisibility(&b, 2));
+
+	scene3d sc(true);
+	sc.addShape(sp_shape3d(new sphere3d(rgbcolord(0.9, 0.2, 0.2), 1,
+			vector3d(0.0, 1.0, 0.0))));
+	sc.addShape(sp_shape3d(new infplaned(rgbcolord(0.3, 0.3, 0.8), 0,
+			vector3d(0.0, 1.0, 0.0))));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.8, 0.8, 0.8),
+			vector3d(1.0, 6.0, 3.0))));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.3, 0.3, 0.3),
+			vector3d(-4.0, 3.0, 1.0))));
+	sc.finalize();
+	camerad cam(vector3d(0.0, 2.0, 5.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	int width = 40, height = 30;
+	std::vector<rgbcolord> traced, reused;
+	sc.setPixelSamples(4);
+	rendercontext3d all, some;
+	sc.renderMultisampled(cam, width, height, traced, &all);
+	sc.setPixelVisibility(true);
+	sc.setRenderThreads(2);
+	sc.renderMultisampled(cam, width, height, reused, &some);
+	ASSERT_EQ(0u, all.getVisibilityReused());
+	// Most pixels see one shape, and skip 12 of 16 rays for both lights.
+	ASSERT_GT(some.getVisibilityReused(), 12u * width * height);
+	int same = 0, off = 0;
+	for (size_t k = 0; k < traced.size(); k++) {
+		double d = std::max(fabs(traced[k].getR() - reused[k].getR()),
+				fabs(traced[k].getB() - reused[k].getB()));
+		same += d < 1e-12;
+		off += d > 1.0 / 255;
+	}
+	ASSERT_GT(same, width * height * 9 / 10);
+	ASSERT_LT(off, width * height / 50);
+}
+
+/*
+ * A crop window holds exactly the pixels of the whole image there, with
+ * and without anti-aliasing and several samples per pixel.
+ */
+TEST(sceneCrop, MatchesWholeImage) {
+	scene3d sc(true);
+	sc.addShape(sp_shape3d(new sphere3d(rgbcolord(0.9, 0.2, 0.2), 1,
+			vector3d(0.0, 1.0, 0.0), 0.3)));
+	sc.addShape(sp_shape3d(new infplaned(rgbcolord(0.3, 0.3, 0.8), 0,
+			vector3d(0.0, 1.0, 0.0), 0.2)));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.8, 0.8, 0.8),
+			vector3d(1.0, 6.0, 3.0))));
+	sc.finalize();
+	camerad cam(vector3d(0.0, 2.0, 5.0), vector3d(0.0, 1.0, 0.0),
+			vector3d(0.0, 1.0, 0.0));
+	int width = 40, height = 30;
+	const int windows[][4] = { { 0, 0, 40, 30 }, { 5, 7, 33, 22 },
+			{ 39, 0, 40, 30 }, { 17, 29, 40, 30 } };
+	for (int mode = 0; mode < 3; mode++) {
+		sc.setSupersampling(mode == 1 ? 3 : 1, 0.1);
+		sc.setPixelSamples(mode == 2 ? 2 : 1);
+		sc.setRenderThreads(mode + 1);
+		std::vector<rgbcolord> whole, crop;
+		sc.renderImage(cam, width, height, whole);
+		for (int w = 0; w < 4; w++) {
+			const int *c = windows[w];
+			sc.renderCrop(cam, width, height, c[0], c[1], c[2], c[3], crop);
+			ASSERT_EQ((size_t) (c[2] - c[0]) * (c[3] - c[1]), crop.size());
+			for (int y = c[1]; y < c[3]; y++) {
+				for (int x = c[0]; x < c[2]; x++) {
+					const rgbcolord &a = whole[y * width + x];
+					const rgbcolord &b = crop[(y - c[1]) * (c[2] - c[0]) +
+							x - c[0]];
+					ASSERT_EQ(a.getR(), b.getR()) << x << ", " << y;
+					ASSERT_EQ(a.getG(), b.getG()) << x << ", " << y;
+					ASSERT_EQ(a.getB(), b.getB()) << x << ", " << y;
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Raw PPM holds the same pixel values as plain PPM, also for images larger
+ * than a write block, with out of range colors clamped.
+ */
+TEST(scenePPM, RawMatchesPlain) {
+	int width = 200, height = 150;
+	std::vector<rgbcolord> image;
+	for (int i = 0; i < width * height; i++)
+		image.push_back(rgbcolord((i % 256) / 255.0, (i / 7 % 256) / 255.0,
+				(i % 3) / 2.0));
+	image[5] = rgbcolord(1, 0.5, 0);
+	image[5] *= 3.0;
+	std::stringstream plain, raw;
+	scene3d::writePPM(image, width, height, plain);
+	scene3d::writePPM(image, width, height, raw, PPM_P6);
+
+	std::string magic;
+	int w, h, maxval;
+	plain >> magic >> w >> h >> maxval;
+	ASSERT_EQ("P3", magic);
+	ASSERT_EQ(width, w);
+	ASSERT_EQ(height, h);
+	ASSERT_EQ(COLORMAX, maxval);
+	std::string header;
+	std::getline(raw, header);
+	ASSERT_EQ("P6", header);
+	std::getline(raw, header);
+	ASSERT_EQ("200 150", header);
+	std::getline(raw, header);
+	ASSERT_EQ("255", header);
+	std::string bytes((std::istreambuf_iterator<char>(raw)),
+			std::istreambuf_iterator<char>());
+	ASSERT_EQ((size_t) width * height * 3, bytes.size());
+	for (size_t i = 0; i < bytes.size(); i++) {
+		int v;
+		plain >> v;
+		ASSERT_EQ(v, (int) (unsigned char) bytes[i]);
+	}
+	ASSERT_EQ(255, (int) (unsigned char) bytes[15]);
+}
+
+/*
+ * Renders a small scene with shadows and reflections with the given scalar
+ * types, like the driver does for each --precision.
+ */
+template<typename vec_T, typename color_T, typename time_T>
+void renderAtPrecision(std::vector<rgbcolor<color_T> > &image) {
+	typedef mvector<vec_T, 3> vec;
+	typedef boost::shared_ptr<shape<vec_T, color_T, time_T, 3> > sp_shape;
+	scene<vec_T, color_T, time_T, 3> sc(true);
+	rgbcolor<color_T> col(0.5, 0.6, 0.7);
+	sc.addShape(sp_shape(new sphere<vec_T, color_T, time_T, 3>(col, 1,
+			vec(-1.0, 1.0, 0.0), 0.3)));
+	sc.addShape(sp_shape(new sphere<vec_T, color_T, time_T, 3>(col, 0.7,
+			vec(1.2, 0.7, 0.5), 0.3)));
+	sc.addShape(sp_shape(new infplane<vec_T, color_T, time_T, 3>(col, 0,
+			vec(0.0, 1.0, 0.0), 0.3)));
+	sc.addPointLight(boost::shared_ptr<light<vec_T, color_T, time_T, 3> >(
+			new light<vec_T, color_T, time_T, 3>(rgbcolor<color_T>(0.8, 0.8,
+					0.8), vec(2.0, 6.0, 3.0))));
+	sc.addSpotLight(boost::shared_ptr<spotlight<vec_T, color_T, time_T, 3> >(
+			new spotlight<vec_T, color_T, time_T, 3>(rgbcolor<color_T>(0.5,
+					0.5, 0.5), vec(-3.0, 5.0, 2.0),
+					vec(0.5, -1.0, -0.3).norm(), 0.4)));
+	sc.finalize();
+	camera<vec_T, time_T, 3> cam(vec(0.0, 3.0, 6.0), vec(0.0, 1.0, 0.0),
+			vec(0.0, 1.0, 0.0));
+	gbuffer<vec_T, color_T, time_T, 3> gb;
+	sc.renderGBuffer(cam, 48, 32, gb);
+	sc.shadeGBuffer(gb, image);
+}
+
+/*
+ * Float and float-time precision scenes render what double ones do up to
+ * rounding, apart from the odd pixel on an edge of a shape or a shadow.
+ */
+TEST(scenePrecision, MatchesDouble) {
+	std::vector<rgbcolord> d, floatTime;
+	std::vector<rgbcolorf> f;
+	renderAtPrecision<double, double, double>(d);
+	renderAtPrecision<float, float, float>(f);
+	renderAtPrecision<double, double, float>(floatTime);
+	ASSERT_EQ(d.size(), f.size());
+	ASSERT_EQ(d.size(), floatTime.size());
+	int floatOff = 0, timeOff = 0;
+	for (size_t i = 0; i < d.size(); i++) {
+		if (fabs(d[i].getR() - f[i].getR()) > 0.01 ||
+				fabs(d[i].getB() - f[i].getB()) > 0.01)
+			floatOff++;
+		if (fabs(d[i].getR() - floatTime[i].getR()) > 0.01 ||
+				fabs(d[i].getB() - floatTime[i].getB()) > 0.01)
+			timeOff++;
+	}
+	ASSERT_LE(floatOff, (int) d.size() / 100);
+	ASSERT_LE(timeOff, (int) d.size() / 100);
+}
+
 #endif // TEST_SCENE_CC
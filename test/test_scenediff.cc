@@ -0,0 +1,171 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "scenediff.hh"
+#include "sceneparser.hh"
+#include "scene.hh"
+#include "accelfactory.hh"
+#include "camera.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include "boost/shared_ptr.hpp"
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef TEST_SCENEDIFF_CC
+#define TEST_SCENEDIFF_CC
+
+/**
+ * Parses scene descriptions and makes scenes of them.
+ */
+class scenediffTest : public ::testing::Test {
+protected:
+
+	/** Two lights, a plane and three spheres. */
+	static const char *base() {
+		return "light (0.7, 0.7, 0.7) <-10, 10, 5>\n"
+				"spotlight (0.5, 0.5, 0.5) <5, 5, 3> <0, 0, 0> 0.4\n"
+				"sphere (1, 0, 0) 0.8 <-1.7, 0.8, 1> 0.5\n"
+				"sphere (0, 0, 1) 0.8 <1.7, 0.8, 1.5> 0.5\n"
+				"plane (0, 1, 0) 0 <0, 1, 0> 0\n"
+				"sphere (0, 1, 1) 0.5 <0, 0.5, -1> 0\n"
+				"camera <0, 3, -8> <0, 0.5, 0> <0, 1, 0>\n";
+	}
+
+	/*
+	 * Parses a description.
+	 */
+	static scenedescription parse(const std::string &text) {
+		scenedescription desc;
+		std::string error;
+		scenetokenizer in(text.data(), text.data() + text.size());
+		EXPECT_TRUE((parseScene<double, double>(in, "", desc, error))) <<
+				error;
+		return desc;
+	}
+
+	/*
+	 * Makes and finalizes the scene of a description with the given
+	 * accelerator.
+	 */
+	static void make(const scenedescription &desc, const std::string &accel,
+			scene3d &sc, boost::shared_ptr<camerad> &cam) {
+		std::string error;
+		sc.setAccelerator(makeNamedAccelerator<double, double, double>(
+				accel, BVH_BUILD_SAH, 1));
+		ASSERT_TRUE(addSceneRecords(sc, &desc.records[0],
+				desc.records.size(), desc.paths, cam, error)) << error;
+		sc.finalize();
+	}
+
+	/*
+	 * Replaces the first occurrence of a line.
+	 */
+	static std::string replace(std::string text, const std::string &from,
+			const std::string &to) {
+		size_t at = text.find(from);
+		EXPECT_NE(std::string::npos, at);
+		return text.replace(at, from.size(), to);
+	}
+};
+
+/*
+ * Each kind of change comes out as the edit it takes.
+ */
+TEST_F(scenediffTest, FindsEdits) {
+	scenedescription before = parse(base());
+	scenediff diff;
+	ASSERT_TRUE(diffSceneDescriptions(before, before, diff));
+	ASSERT_EQ(0, diff.count());
+	ASSERT_EQ(4u, diff.shapes.size());
+	for (int i = 0; i < 4; i++)
+		ASSERT_EQ(i, diff.shapeFrom[i]);
+
+	// A sphere moved and another recolored.
+	std::string text = replace(base(), "<1.7, 0.8, 1.5>", "<1.2, 0.8, 1.5>");
+	text = replace(text, "sphere (0, 1, 1)", "sphere (1, 1, 0)");
+	ASSERT_TRUE(diffSceneDescriptions(before, parse(text), diff));
+	ASSERT_EQ(2, diff.count());
+	ASSERT_TRUE(diff.moved[1] && !diff.recolored[1]);
+	ASSERT_TRUE(!diff.moved[3] && diff.recolored[3]);
+
+	// A sphere that grew is made again; one added in the middle is new.
+	text = replace(base(), "0.8 <-1.7", "0.9 <-1.7");
+	text = replace(text, "plane", "sphere (1, 1, 1) 0.2 <0, 3, 0> 0\nplane");
+	ASSERT_TRUE(diffSceneDescriptions(before, parse(text), diff));
+	ASSERT_EQ(5u, diff.shapes.size());
+	ASSERT_EQ(1u, diff.removed.size());
+	ASSERT_EQ(0, diff.removed[0]);
+	ASSERT_EQ(-1, diff.shapeFrom[0]);
+	ASSERT_EQ(1, diff.shapeFrom[1]);
+	ASSERT_EQ(-1, diff.shapeFrom[2]);
+	ASSERT_EQ(2, diff.shapeFrom[3]);
+
+	// A point light moves and a spotlight changes color in place.
+	text = replace(base(), "<-10, 10, 5>", "<-8, 10, 5>");
+	text = replace(text, "(0.5, 0.5, 0.5) <5", "(0.2, 0.5, 0.5) <5");
+	ASSERT_TRUE(diffSceneDescriptions(before, parse(text), diff));
+	ASSERT_EQ(2u, diff.lights.size());
+	ASSERT_EQ(2, diff.count());
+
+	// Aiming a spotlight or adding a light takes a new scene.
+	ASSERT_FALSE(diffSceneDescriptions(before, parse(replace(base(),
+			"0.4\n", "0.3\n")), diff));
+	ASSERT_FALSE(diffSceneDescriptions(before, parse(std::string(base()) +
+			"light (0.1, 0.1, 0.1) <0, 9, 0>\n"), diff));
+}
+
+/*
+ * Edits applied in place give the image of a scene made from the edited
+ * description, with a dynamic BVH or one built again.
+ */
+TEST_F(scenediffTest, AppliesLikeNewScene) {
+	const char *accels[] = { "dynamic", "bvh" };
+	for (int a = 0; a < 2; a++) {
+		scenedescription desc = parse(base());
+		scene3d sc(true);
+		boost::shared_ptr<camerad> cam;
+		make(desc, accels[a], sc, cam);
+		std::vector<int> ids;
+		for (int i = 0; i < 4; i++)
+			ids.push_back(i);
+
+		const char *steps[][2] = {
+			{ "<1.7, 0.8, 1.5>", "<1.2, 0.9, 1.5>" },
+			{ "sphere (0, 1, 1)", "sphere (1, 1, 0)" },
+			{ "sphere (1, 0, 0) 0.8 <-1.7, 0.8, 1> 0.5\n", "" },
+			{ "plane", "sphere (1, 1, 1) 0.2 <0, 3, 0> 0\nplane" },
+			{ "<-10, 10, 5>", "<-6, 8, 5>" } };
+		std::string text = base();
+		for (int s = 0; s < 5; s++) {
+			text = replace(text, steps[s][0], steps[s][1]);
+			scenedescription next = parse(text);
+			scenediff diff;
+			std::string error;
+			ASSERT_TRUE(diffSceneDescriptions(desc, next, diff));
+			ASSERT_TRUE(applySceneDiff(sc, next, diff, ids, error)) <<
+					error;
+			desc = next;
+
+			scene3d fresh(true);
+			boost::shared_ptr<camerad> freshCam;
+			make(next, "bvh", fresh, freshCam);
+			ASSERT_EQ(fresh.getShapes().size(), sc.getShapes().size());
+			std::vector<rgbcolord> edited, made;
+			sc.renderImage(*cam, 40, 30, edited);
+			fresh.renderImage(*freshCam, 40, 30, made);
+			for (size_t i = 0; i < made.size(); i++) {
+				ASSERT_EQ(made[i].getR(), edited[i].getR()) << accels[a] <<
+						" step " << s << " pixel " << i;
+				ASSERT_EQ(made[i].getB(), edited[i].getB()) << accels[a] <<
+						" step " << s << " pixel " << i;
+			}
+		}
+	}
+}
+
+#endif // TEST_SCENEDIFF_CC
@@ -0,0 +1,206 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "sceneparser.hh"
+#include "animation.hh"
+#include "scene.hh"
+#include "dirtyregion.hh"
+#include "bvh.hh"
+#include "camera.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include "boost/shared_ptr.hpp"
+#include <string>
+#include <vector>
+
+#ifndef TEST_SCENEEDIT_CC
+#define TEST_SCENEEDIT_CC
+
+/*
+ * Loads a scene description into a finalized scene with shadows.
+ */
+static void loadEditScene(const std::string &text, scene3d &sc,
+		boost::shared_ptr<camera<double, double, 3> > &cam, bool useBVH) {
+	scenetokenizer in(text.data(), text.data() + text.size());
+	scenedescription desc;
+	std::string error;
+	ASSERT_TRUE((parseScene<double, double>(in, "", desc, error))) << error;
+	if (useBVH)
+		sc.setAccelerator(sp_bvh3d(new bvh3d()));
+	ASSERT_TRUE(addSceneRecords(sc, &desc.records[0], desc.records.size(),
+			desc.paths, cam, error)) << error;
+	sc.finalize();
+}
+
+/*
+ * Brings an image up to date with the edits and checks that it's exactly a
+ * new render of the scene.
+ */
+static int expectEditsRendered(scene3d &sc,
+		const camera<double, double, 3> &cam, int width, int height,
+		std::vector<rgbcolor<double> > &image) {
+	int tiles = sc.renderEdits(cam, width, height, image);
+	EXPECT_FALSE(sc.hasEdits());
+	std::vector<rgbcolor<double> > full;
+	sc.renderImage(cam, width, height, full);
+	EXPECT_EQ(full.size(), image.size());
+	for (size_t i = 0; i < full.size() && i < image.size(); i++) {
+		EXPECT_EQ(full[i].getR(), image[i].getR()) << "pixel " << i;
+		EXPECT_EQ(full[i].getG(), image[i].getG()) << "pixel " << i;
+		EXPECT_EQ(full[i].getB(), image[i].getB()) << "pixel " << i;
+		if (::testing::Test::HasFailure())
+			break;
+	}
+	return tiles;
+}
+
+/*
+ * Moving, recoloring and removing shapes in front of a reflective floor
+ * and changing a light re-render to exactly the image a full render makes,
+ * with and without anti-aliasing.
+ */
+TEST(sceneedit, MatchesFullRender) {
+	std::string text = "camera <0, 3, 10> <0, 1, 0> <0, 1, 0>\n"
+			"light (1, 1, 1) <3, 8, 6>\nlight (0.4, 0.4, 0.6) <-6, 5, 2>\n"
+			"sphere (1, 0, 0) 1 <-2, 1, 0> 0.25\n"
+			"sphere (0, 0, 1) 1 <1.5, 1, -1> 0\n"
+			"cylinder (0, 1, 0) 0.5 <0, 0.5, 1> <0, 1, 0> 1 0\n"
+			"plane (1, 1, 1) 0 <0, 1, 0> 0.3\n";
+	for (int aa = 1; aa <= 3; aa += 2) {
+		scene3d sc(true);
+		boost::shared_ptr<camera<double, double, 3> > cam;
+		loadEditScene(text, sc, cam, aa == 1);
+		sc.setSupersampling(aa, 0.05);
+		std::vector<rgbcolor<double> > image;
+		sc.renderImage(*cam, 48, 32, image);
+
+		ASSERT_TRUE(sc.moveShape(0, vector3d(-1.0, 1.5, 0.5)));
+		ASSERT_TRUE(sc.hasEdits());
+		expectEditsRendered(sc, *cam, 48, 32, image);
+		ASSERT_TRUE(sc.moveShape(2, vector3d(0.5, 0.5, 2.0)));
+		expectEditsRendered(sc, *cam, 48, 32, image);
+		ASSERT_FALSE(sc.moveShape(3, vector3d(0.0, 1.0, 0.0)));
+		sc.recolorShape(1, rgbcolor<double>(1, 1, 0));
+		expectEditsRendered(sc, *cam, 48, 32, image);
+		sc.removeShape(0);
+		ASSERT_EQ(3u, sc.getShapes().size());
+		expectEditsRendered(sc, *cam, 48, 32, image);
+		sc.editLight(1, vector3d(-4.0, 6.0, 4.0), rgbcolor<double>(1, 0, 0));
+		ASSERT_EQ(6, expectEditsRendered(sc, *cam, 48, 32, image));
+		ASSERT_EQ(0, sc.renderEdits(*cam, 48, 32, image));
+	}
+}
+
+/*
+ * Without reflections a small move only re-renders the tiles around the
+ * shape and its shadow.
+ */
+TEST(sceneedit, DirtiesFewTiles) {
+	std::string text = "camera <0, 6, 12> <0, 0, 0> <0, 1, 0>\n"
+			"light (1, 1, 1) <0, 10, 0>\n"
+			"sphere (1, 0, 0) 0.5 <-4, 0.5, 0> 0\n"
+			"sphere (0, 0, 1) 0.5 <4, 0.5, 0> 0\n"
+			"plane (1, 1, 1) 0 <0, 1, 0> 0\n";
+	scene3d sc(true);
+	boost::shared_ptr<camera<double, double, 3> > cam;
+	loadEditScene(text, sc, cam, true);
+	std::vector<rgbcolor<double> > image;
+	sc.renderImage(*cam, 128, 96, image);
+	ASSERT_TRUE(sc.moveShape(0, vector3d(-3.5, 0.5, 0.0)));
+	dirtytiles dirty(128, 96, RENDER_TILE_SIZE);
+	sc.findDirtyTiles(*cam, 128, 96, dirty);
+	std::vector<int> tiles;
+	dirty.getTiles(tiles);
+	ASSERT_GT(tiles.size(), 0u);
+	ASSERT_LE(tiles.size(), 12u);
+	ASSERT_EQ((int) tiles.size(), expectEditsRendered(sc, *cam, 128, 96,
+			image));
+}
+
+/*
+ * A shape an animation moves, noted by the boxes it left and entered,
+ * re-renders to exactly the next frame, and a moved light to all of it.
+ */
+TEST(sceneedit, FollowsAnimation) {
+	std::string text = "camera <0, 6, 12> <0, 0, 0> <0, 1, 0>\n"
+			"light (1, 1, 1) <0, 10, 0>\nkey 2 <2, 10, 0>\n"
+			"sphere (1, 0, 0) 0.5 <-4, 0.5, 0> 0.25\nkey 4 <-2, 0.5, 0>\n"
+			"sphere (0, 0, 1) 0.5 <4, 0.5, 0> 0\n"
+			"plane (1, 1, 1) 0 <0, 1, 0> 0\n";
+	scenetokenizer in(text.data(), text.data() + text.size());
+	scenedescription desc;
+	std::string error;
+	ASSERT_TRUE((parseScene<double, double>(in, "", desc, error))) << error;
+	scene3d sc(true);
+	sc.setAccelerator(sp_bvh3d(new bvh3d()));
+	boost::shared_ptr<camera<double, double, 3> > cam;
+	std::vector<scenecamera<double, double> > cameras;
+	animation3d anim;
+	ASSERT_TRUE(addSceneRecords(sc, &desc.records[0], desc.records.size(),
+			desc.paths, cam, error, &cameras, &anim)) << error;
+	sc.finalize();
+	ASSERT_EQ(2, anim.getTrackCount());
+	ASSERT_EQ(RECORD_SPHERE, anim.getTrackKind(1));
+	const shape3d &ball = static_cast<const shape3d &>(
+			*anim.getTrackObject(1));
+	std::vector<rgbcolor<double> > image;
+	sc.renderImage(*cam, 128, 96, image);
+
+	// Past the light's last key only the sphere moves.
+	anim.setFrame(4);
+	sc.refit();
+	sc.renderImage(*cam, 128, 96, image);
+	aabb<double, 3> before, after;
+	ASSERT_TRUE(ball.getBounds(before));
+	anim.setFrame(3);
+	ASSERT_TRUE(ball.getBounds(after));
+	sc.noteShapeMoved(before, after);
+	sc.refit();
+	int tiles = expectEditsRendered(sc, *cam, 128, 96, image);
+	ASSERT_GT(tiles, 0);
+	ASSERT_LT(tiles, 48);
+
+	anim.setFrame(1);
+	sc.noteEditAll();
+	sc.refit();
+	ASSERT_EQ(48, expectEditsRendered(sc, *cam, 128, 96, image));
+}
+
+/*
+ * Shadows are bounded by where the light sees past the box, and mirror
+ * images are reflected through the plane.
+ */
+TEST(sceneedit, BoundsShadowsAndMirrors) {
+	aabb<double, 3> light(vector3d(0.0, 10.0, 0.0), vector3d(0.0, 10.0, 0.0));
+	aabb<double, 3> box(vector3d(-1.0, 4.0, -1.0), vector3d(1.0, 6.0, 1.0));
+	aabb<double, 3> shadow;
+	ASSERT_TRUE(boundPlaneShadow(light, box, vector3d(0.0, 1.0, 0.0), 0.0,
+			shadow));
+	ASSERT_DOUBLE_EQ(-2.5, shadow.getMin()[0]);
+	ASSERT_DOUBLE_EQ(2.5, shadow.getMax()[2]);
+	ASSERT_DOUBLE_EQ(6.0, shadow.getMax()[1]);
+	ASSERT_TRUE(boundPlaneShadow(light, box, vector3d(0.0, 1.0, 0.0), -8.0,
+			shadow));
+	ASSERT_TRUE(shadow.isEmpty());
+	aabb<double, 3> tall(vector3d(-1.0, 4.0, -1.0), vector3d(1.0, 12.0, 1.0));
+	ASSERT_FALSE(boundPlaneShadow(light, tall, vector3d(0.0, 1.0, 0.0), 0.0,
+			shadow));
+
+	aabb<double, 3> world(vector3d(-20.0, 0.0, -20.0),
+			vector3d(20.0, 20.0, 20.0));
+	ASSERT_TRUE(boundShadow(light, box, world, shadow));
+	ASSERT_DOUBLE_EQ(0.0, shadow.getMin()[1]);
+	ASSERT_DOUBLE_EQ(6.0, shadow.getMax()[1]);
+	ASSERT_DOUBLE_EQ(-7.5, shadow.getMin()[0]);
+	ASSERT_FALSE(boundShadow(box, box, world, shadow));
+
+	aabb<double, 3> image = mirrorBox(box, vector3d(0.0, 1.0, 0.0), 0.0);
+	ASSERT_DOUBLE_EQ(-6.0, image.getMin()[1]);
+	ASSERT_DOUBLE_EQ(-4.0, image.getMax()[1]);
+	ASSERT_DOUBLE_EQ(-1.0, image.getMin()[0]);
+}
+
+#endif // TEST_SCENEEDIT_CC
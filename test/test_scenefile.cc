@@ -0,0 +1,181 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "scenefile.hh"
+#include "bvh.hh"
+#include "gtest/gtest.h"
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef TEST_SCENEFILE_CC
+#define TEST_SCENEFILE_CC
+
+/*
+ * A small scene description with every kind of object.
+ */
+static const char *sceneFileText =
+		"camera <0, 1, -8> <0, 0, 0> <0, 1, 0>\n"
+		"light (1, 1, 1) <5, 5, -5>\n"
+		"spotlight (0.5, 0.5, 0.5) <-3, 4, -2> <0, 0, 0> 0.4\n"
+		"arealight (0.3, 0.3, 0.3) <0, 4, 0> <0, -1, 0> <1, 0, 0> 0.5 0.5 2 2\n"
+		"sphere (0.9, 0.1, 0.1) 1 <0, 0.5, 0> 0.2\n"
+		"sphere (0.1, 0.9, 0.1) 0.5 <1.5, 0.25, 1> 0\n"
+		"cylinder (0.1, 0.1, 0.9) 0.3 <-1.5, 0, 0> <0, 1, 0> 1.5 0.5\n"
+		"plane (0.8, 0.8, 0.8) 0 <0, 1, 0> 0.1\n"
+		"end\n";
+
+/*
+ * Parses a scene description into records.
+ */
+static scenedescription parseSceneFileText(const char *text = sceneFileText) {
+	scenetokenizer in(text, text + strlen(text));
+	scenedescription desc;
+	std::string error;
+	EXPECT_TRUE((parseScene<double, double>(in, "", desc, error))) << error;
+	return desc;
+}
+
+/*
+ * Copies the bytes of a compiled scene into doubles so the records are
+ * aligned as in a mapping.
+ */
+static const char* alignSceneFile(const std::string &bytes,
+		std::vector<double> &aligned) {
+	aligned.assign(bytes.size() / sizeof(double) + 1, 0);
+	memcpy(&aligned[0], bytes.data(), bytes.size());
+	return (const char *) &aligned[0];
+}
+
+/*
+ * Renders a scene small enough to compare pixel by pixel.
+ */
+static std::vector<rgbcolor<double> > renderSceneFile(scene3d &sc,
+		const camera<double, double, 3> &cam) {
+	std::vector<rgbcolor<double> > image;
+	sc.renderImage(cam, 24, 16, image);
+	return image;
+}
+
+/*
+ * A compiled scene holds the records as they were parsed and a tree that
+ * the scene reads instead of building, and renders the same image as the
+ * scene description.
+ */
+TEST(scenefile, RoundTrips) {
+	scenedescription desc = parseSceneFileText();
+	const std::vector<scenerecord> &records = desc.records;
+	ASSERT_EQ(8u, records.size());
+
+	scene3d original(true);
+	original.setAccelerator(sp_bvh3d(new bvh3d()));
+	boost::shared_ptr<camera<double, double, 3> > cam;
+	std::string error;
+	ASSERT_TRUE(addSceneRecords(original, &records[0], records.size(),
+			desc.paths, cam, error));
+	original.finalize();
+	std::ostringstream tree;
+	ASSERT_TRUE(original.writeAccelerator(tree));
+	std::ostringstream os;
+	ASSERT_TRUE((writeSceneFile<double, double, double>(os, desc,
+			BVH_BUILD_SAH, tree.str())));
+	std::string bytes = os.str();
+	std::vector<double> aligned;
+	const char *p = alignSceneFile(bytes, aligned);
+
+	ASSERT_TRUE(scenefile::isSceneFile(p, bytes.size()));
+	scenefile compiled;
+	ASSERT_TRUE((compiled.open<double, double, double>(p, bytes.size(),
+			error))) << error;
+	ASSERT_EQ(records.size(), compiled.getRecordCount());
+	ASSERT_EQ(0, memcmp(&records[0], compiled.getRecords(),
+			records.size() * sizeof(scenerecord)));
+	ASSERT_EQ(BVH_BUILD_SAH, compiled.getTreeBuilder());
+	ASSERT_EQ(tree.str().size(), compiled.getTreeSize());
+
+	scene3d copy(true);
+	copy.setAccelerator(sp_bvh3d(new bvh3d()));
+	boost::shared_ptr<camera<double, double, 3> > copyCam;
+	ASSERT_TRUE(addSceneRecords(copy, compiled.getRecords(),
+			compiled.getRecordCount(), desc.paths, copyCam, error));
+	ASSERT_TRUE(copy.finalize(compiled.getTree(), compiled.getTreeSize()));
+	std::vector<rgbcolor<double> > a = renderSceneFile(original, *cam);
+	std::vector<rgbcolor<double> > b = renderSceneFile(copy, *copyCam);
+	ASSERT_EQ(a.size(), b.size());
+	for (size_t i = 0; i < a.size(); i++) {
+		ASSERT_EQ(a[i].getR(), b[i].getR());
+		ASSERT_EQ(a[i].getG(), b[i].getG());
+		ASSERT_EQ(a[i].getB(), b[i].getB());
+	}
+
+	// A tree for other shapes is built instead of read. The last two
+	// records are the cylinder and the unbounded plane.
+	scene3d fewer(true);
+	fewer.setAccelerator(sp_bvh3d(new bvh3d()));
+	ASSERT_TRUE(addSceneRecords(fewer, compiled.getRecords(),
+			compiled.getRecordCount() - 2, desc.paths, copyCam, error));
+	ASSERT_FALSE(fewer.finalize(compiled.getTree(), compiled.getTreeSize()));
+}
+
+/*
+ * Compiled scenes of another precision, truncated ones and text are
+ * rejected.
+ */
+TEST(scenefile, RejectsBadFiles) {
+	scenedescription desc = parseSceneFileText();
+	std::ostringstream os;
+	ASSERT_TRUE((writeSceneFile<double, double, double>(os, desc, -1, "")));
+	std::string bytes = os.str();
+	std::vector<double> aligned;
+	const char *p = alignSceneFile(bytes, aligned);
+
+	scenefile compiled;
+	std::string error;
+	ASSERT_TRUE((compiled.open<double, double, double>(p, bytes.size(),
+			error)));
+	ASSERT_EQ(-1, compiled.getTreeBuilder());
+	ASSERT_EQ((const char *) 0, compiled.getTree());
+	ASSERT_FALSE((compiled.open<float, float, float>(p, bytes.size(),
+			error)));
+	ASSERT_FALSE((compiled.open<double, double, double>(p, bytes.size() - 1,
+			error)));
+	ASSERT_FALSE(scenefile::isSceneFile(sceneFileText,
+			strlen(sceneFileText)));
+}
+
+/*
+ * The files geometry objects name are kept, in order, and a scene whose
+ * names don't match its header is rejected.
+ */
+TEST(scenefile, KeepsPaths) {
+	scenedescription desc = parseSceneFileText(
+			"geometry parts/a.dat <0, 0, 0> <1, 1, 1>\n"
+			"geometry /abs/b.rtb <-1, -1, -1> <0, 0, 0>\n");
+	ASSERT_EQ(2u, desc.paths.size());
+	std::ostringstream os;
+	ASSERT_TRUE((writeSceneFile<double, double, double>(os, desc, -1, "")));
+	std::string bytes = os.str();
+	std::vector<double> aligned;
+	const char *p = alignSceneFile(bytes, aligned);
+
+	scenefile compiled;
+	std::string error;
+	ASSERT_TRUE((compiled.open<double, double, double>(p, bytes.size(),
+			error))) << error;
+	std::vector<std::string> paths;
+	compiled.getPaths(paths);
+	ASSERT_TRUE(desc.paths == paths);
+	ASSERT_EQ(1, compiled.getRecords()[1].values[0]);
+
+	scenefileheader h;
+	memcpy(&h, p, sizeof(h));
+	h.pathCount++;
+	memcpy(&aligned[0], &h, sizeof(h));
+	ASSERT_FALSE((compiled.open<double, double, double>(p, bytes.size(),
+			error)));
+}
+
+#endif // TEST_SCENEFILE_CC
@@ -0,0 +1,448 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "sceneparser.hh"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef TEST_SCENEPARSER_CC
+#define TEST_SCENEPARSER_CC
+
+/*
+ * Parses a number with a tokenizer over the given text.
+ */
+template<typename T>
+T parseNumber(const std::string &text) {
+	scenetokenizer in(text.data(), text.data() + text.size());
+	T v = 0;
+	EXPECT_TRUE(in.number(v)) << text;
+	return v;
+}
+
+/*
+ * Numbers on and off the fast path get exactly the values of strtod and
+ * strtof, which the stream operators use.
+ */
+TEST(scenetokenizer, NumbersMatchStrtod) {
+	const char *cases[] = { "0", "-0", "1", "0.1", "-2.5", "1e10", "1E-3",
+			"3.14159265358979323846", "123456789012345678901234", "1e-310",
+			"0.30000000000000004", ".5", "5.", "+7.25", "1e300", "2e-45",
+			"16777217", "9007199254740993", "0.000001", "1234.5678e-2" };
+	for (size_t i = 0; i < sizeof cases / sizeof cases[0]; i++) {
+		double d = parseNumber<double>(cases[i]);
+		float f = parseNumber<float>(cases[i]);
+		double ed = strtod(cases[i], 0);
+		float ef = strtof(cases[i], 0);
+		ASSERT_EQ(0, memcmp(&ed, &d, sizeof d)) << cases[i];
+		ASSERT_EQ(0, memcmp(&ef, &f, sizeof f)) << cases[i];
+	}
+	srand(7);
+	for (int i = 0; i < 20000; i++) {
+		char buf[64];
+		sprintf(buf, "%.*f", rand() % 9, (rand() - RAND_MAX / 2) / 1000.0);
+		ASSERT_EQ(strtod(buf, 0), parseNumber<double>(buf)) << buf;
+		ASSERT_EQ(strtof(buf, 0), parseNumber<float>(buf)) << buf;
+	}
+}
+
+/*
+ * Colors, vectors and words read the scene description grammar, with any
+ * white space between the parts, and lines are counted.
+ */
+TEST(scenetokenizer, ReadsGrammar) {
+	std::string text = "sphere (1, 0.5,0)\n  2.5 < -1 ,2, 3.5>\n# note\nend";
+	scenetokenizer in(text.data(), text.data() + text.size());
+	std::string w;
+	ASSERT_TRUE(in.word(w));
+	ASSERT_EQ("sphere", w);
+	rgbcolor<float> c;
+	ASSERT_TRUE(in.color(c));
+	ASSERT_EQ(1, c.getR());
+	ASSERT_EQ(0.5f, c.getG());
+	ASSERT_EQ(0, c.getB());
+	double r;
+	ASSERT_TRUE(in.number(r));
+	ASSERT_EQ(2.5, r);
+	mvector<double, 3> v;
+	ASSERT_TRUE(in.vector(v));
+	ASSERT_EQ(-1, v[0]);
+	ASSERT_EQ(2, v[1]);
+	ASSERT_EQ(3.5, v[2]);
+	ASSERT_TRUE(in.word(w));
+	ASSERT_EQ("#", w);
+	ASSERT_EQ(3, in.getLine());
+	in.skipLine();
+	ASSERT_TRUE(in.word(w));
+	ASSERT_EQ("end", w);
+	ASSERT_EQ(4, in.getLine());
+	ASSERT_FALSE(in.word(w));
+}
+
+/*
+ * Malformed text is reported instead of read.
+ */
+TEST(scenetokenizer, RejectsMalformed) {
+	const char *cases[] = { "(1, 2 3)", "(1, 2, x)", "(1, 2, 3", "1, 2, 3)",
+			"" };
+	for (size_t i = 0; i < sizeof cases / sizeof cases[0]; i++) {
+		scenetokenizer in(cases[i], cases[i] + strlen(cases[i]));
+		rgbcolor<double> c;
+		ASSERT_FALSE(in.color(c)) << cases[i];
+	}
+	std::string text = "<1, 2>";
+	scenetokenizer in(text.data(), text.data() + text.size());
+	mvector<double, 3> v;
+	ASSERT_FALSE(in.vector(v));
+	double d;
+	std::string word = "abc";
+	scenetokenizer win(word.data(), word.data() + word.size());
+	ASSERT_FALSE(win.number(d));
+}
+
+/*
+ * A scene description becomes one record per object, in order, with
+ * comments and everything after "end" skipped, and the records make the
+ * objects.
+ */
+TEST(sceneparser, ParsesScene) {
+	std::string text = "# a comment\ncamera <0, 0, -5> <0, 0, 0> <0, 1, 0>\n"
+			"sphere (1, 0.5, 0) 2 <1, 2, 3> 0.25\nlight (1, 1, 1) <0, 5, 0>\n"
+			"end\nnot parsed\n";
+	scenetokenizer in(text.data(), text.data() + text.size());
+	scenedescription desc;
+	std::string error;
+	ASSERT_TRUE((parseScene<double, double>(in, "", desc, error))) << error;
+	const std::vector<scenerecord> &records = desc.records;
+	ASSERT_EQ(3u, records.size());
+	ASSERT_EQ(RECORD_CAMERA, records[0].kind);
+	ASSERT_EQ(2, records[0].line);
+	ASSERT_EQ(RECORD_SPHERE, records[1].kind);
+	double sphere[] = { 1, 0.5, 0, 2, 1, 2, 3, 0.25 };
+	for (int i = 0; i < 8; i++)
+		ASSERT_EQ(sphere[i], records[1].values[i]);
+	ASSERT_EQ(0, records[1].values[8]);
+	ASSERT_EQ(RECORD_LIGHT, records[2].kind);
+
+	scene3d sc(false);
+	boost::shared_ptr<camera<double, double, 3> > cam;
+	ASSERT_TRUE(addSceneRecords(sc, &records[0], records.size(), desc.paths,
+			cam, error));
+	ASSERT_TRUE(cam.get() != 0);
+	ASSERT_EQ(1u, sc.getShapes().size());
+}
+
+/*
+ * Unknown words, malformed fields and invalid objects are reported with
+ * their lines.
+ */
+TEST(sceneparser, ReportsErrors) {
+	const char *cases[] = { "cube (1, 1, 1)", "\nsphere (1, 1, 1) x",
+			"sphere (1, 1, 1) 1 <0, 0, 0>" };
+	const char *lines[] = { "line 1", "line 2", "line 1" };
+	for (int i = 0; i < 3; i++) {
+		scenetokenizer in(cases[i], cases[i] + strlen(cases[i]));
+		scenedescription desc;
+		std::string error;
+		ASSERT_FALSE((parseScene<double, double>(in, "", desc, error)));
+		ASSERT_NE(std::string::npos, error.find(lines[i])) << error;
+	}
+
+	std::string text = "sphere (1, 2, 1) 1 <0, 0, 0> 0\n";
+	scenetokenizer in(text.data(), text.data() + text.size());
+	scenedescription desc;
+	std::string error;
+	ASSERT_TRUE((parseScene<double, double>(in, "", desc, error)));
+	scene3d sc(false);
+	boost::shared_ptr<camera<double, double, 3> > cam;
+	ASSERT_FALSE(addSceneRecords(sc, &desc.records[0], desc.records.size(),
+			desc.paths, cam, error));
+	ASSERT_EQ("the sphere on line 1 is invalid.", error);
+	ASSERT_EQ(0u, sc.getShapes().size());
+}
+
+/*
+ * Cameras can have names, which are kept with them in order, and two
+ * cameras can't have the same one.
+ */
+TEST(sceneparser, NamesCameras) {
+	std::string text = "camera front <0, 0, -5> <0, 0, 0> <0, 1, 0>\n"
+			"camera <5, 0, 0> <0, 0, 0> <0, 1, 0>\n"
+			"camera top <0, 5, 0> <0, 0, 0> <0, 0, 1>\n";
+	scenetokenizer in(text.data(), text.data() + text.size());
+	scenedescription desc;
+	std::string error;
+	ASSERT_TRUE((parseScene<double, double>(in, "", desc, error))) << error;
+	ASSERT_EQ(3u, desc.records.size());
+	ASSERT_EQ(-1, desc.records[1].values[0]);
+	ASSERT_EQ(5, desc.records[1].values[1]);
+
+	scene3d sc(false);
+	boost::shared_ptr<camera<double, double, 3> > cam;
+	std::vector<scenecamera<double, double> > cameras;
+	ASSERT_TRUE(addSceneRecords(sc, &desc.records[0], desc.records.size(),
+			desc.paths, cam, error, &cameras)) << error;
+	ASSERT_EQ(3u, cameras.size());
+	ASSERT_EQ("front", cameras[0].name);
+	ASSERT_EQ("", cameras[1].name);
+	ASSERT_EQ("top", cameras[2].name);
+	ASSERT_TRUE(cam == cameras[2].cam);
+
+	text += "camera front <1, 0, 0> <0, 0, 0> <0, 1, 0>\n";
+	scenetokenizer again(text.data(), text.data() + text.size());
+	scenedescription twice;
+	ASSERT_TRUE((parseScene<double, double>(again, "", twice, error)));
+	scene3d other(false);
+	ASSERT_FALSE(addSceneRecords(other, &twice.records[0],
+			twice.records.size(), twice.paths, cam, error));
+	ASSERT_EQ("the camera on line 4 is named \"front\" like an earlier one.",
+			error);
+}
+
+/*
+ * Makes a scene description of several parse chunks, with objects that go
+ * on over several lines and comments.
+ */
+static std::string makeLongScene(int spheres) {
+	std::ostringstream os;
+	os << "camera <0, 0, -5> <0, 0, 0> <0, 1, 0>\n";
+	for (int i = 0; i < spheres; i++) {
+		os << "sphere (0." << i % 10 << ", 0.5, 0.25) 0." << i % 7 + 1;
+		if (i % 3 == 0)
+			os << "\n   ";
+		os << " <" << i % 13 << ".125, -" << i % 17 << ", " << i << ">";
+		if (i % 5 == 0)
+			os << "\n";
+		os << " 0.2\n";
+		if (i % 11 == 0)
+			os << "# comment " << i << "\n";
+	}
+	return os.str();
+}
+
+/*
+ * Parsing in chunks on several threads gives the records, and errors, of
+ * parsing serially; text after "end" is ignored even when a later chunk
+ * can't parse it.
+ */
+TEST(sceneparser, ParallelMatchesSerial) {
+	std::string text = makeLongScene(60000);
+	ASSERT_GT(text.size(), 3u * SCENE_PARSE_CHUNK);
+	std::vector<std::string> texts;
+	texts.push_back(text);
+	texts.push_back(text.substr(0, text.size() / 2) + "end\n" +
+			text.substr(text.size() / 2) + "cube\n");
+	texts.push_back(text + "sphere (1, 1, 1) 1\n<0, 0, 0>\n" + text +
+			"cube\n");
+	texts.push_back(text.substr(0, text.size() * 3 / 4) + "cube\n" + text);
+	for (size_t t = 0; t < texts.size(); t++) {
+		const char *b = texts[t].data(), *e = b + texts[t].size();
+		scenetokenizer in(b, e);
+		scenedescription serialDesc, parallelDesc;
+		std::string serialError, parallelError;
+		bool ok = parseScene<double, double>(in, "", serialDesc,
+				serialError);
+		ASSERT_EQ(ok, (parseSceneParallel<double, double>(b, e, "", 4,
+				parallelDesc, parallelError))) << t;
+		const std::vector<scenerecord> &serial = serialDesc.records;
+		const std::vector<scenerecord> &parallel = parallelDesc.records;
+		ASSERT_EQ(serialError, parallelError) << t;
+		if (!ok)
+			continue;
+		ASSERT_EQ(serial.size(), parallel.size()) << t;
+		ASSERT_EQ(0, memcmp(&serial[0], &parallel[0],
+				serial.size() * sizeof(scenerecord))) << t;
+	}
+}
+
+/*
+ * Objects that go on over several lines, with file names on lines of
+ * their own, are never split, even when a file name is also the name of
+ * an object.
+ */
+TEST(sceneparser, ParallelKeepsMultiLineObjects) {
+	std::ostringstream os;
+	for (int i = 0; i < 120000; i++)
+		os << "mesh (0, 1, 0)\n" << (i % 2 ? "sphere" : "part.obj") <<
+				"\n0.5\n";
+	std::string text = os.str();
+	ASSERT_GT(text.size(), 3u * SCENE_PARSE_CHUNK);
+	const char *b = text.data(), *e = b + text.size();
+	scenetokenizer in(b, e);
+	scenedescription serial, parallel;
+	std::string serialError, parallelError;
+	ASSERT_TRUE((parseScene<double, double>(in, "", serial, serialError))) <<
+			serialError;
+	ASSERT_TRUE((parseSceneParallel<double, double>(b, e, "", 4, parallel,
+			parallelError))) << parallelError;
+	ASSERT_EQ(120000u, parallel.records.size());
+	ASSERT_EQ(0, memcmp(&serial.records[0], &parallel.records[0],
+			serial.records.size() * sizeof(scenerecord)));
+	ASSERT_TRUE(serial.paths == parallel.paths);
+}
+
+/*
+ * Writes a file for the include and geometry tests.
+ */
+static void writeSceneTestFile(const std::string &path,
+		const std::string &text) {
+	std::ofstream out(path.c_str());
+	out << text;
+}
+
+/*
+ * Included files are read in place, relative to the file that includes
+ * them and up to their own "end", and their errors name them.
+ */
+TEST(sceneparser, IncludesFiles) {
+	writeSceneTestFile("/tmp/rt_test_include_a.dat",
+			"sphere (1, 0, 0) 1 <0, 0, 0> 0\ninclude rt_test_include_b.dat\n"
+			"end\ncube\n");
+	writeSceneTestFile("/tmp/rt_test_include_b.dat",
+			"light (1, 1, 1) <0, 5, 0>\n");
+	writeSceneTestFile("/tmp/rt_test_include_bad.dat", "\n\ncube\n");
+	writeSceneTestFile("/tmp/rt_test_include_self.dat",
+			"include rt_test_include_self.dat\n");
+
+	std::string text = "camera <0, 0, -5> <0, 0, 0> <0, 1, 0>\n"
+			"include rt_test_include_a.dat\nsphere (0, 1, 0) 1 <2, 0, 0> 0\n";
+	scenetokenizer in(text.data(), text.data() + text.size());
+	scenedescription desc;
+	std::string error;
+	ASSERT_TRUE((parseScene<double, double>(in, "/tmp/", desc, error))) <<
+			error;
+	ASSERT_EQ(4u, desc.records.size());
+	ASSERT_EQ(RECORD_CAMERA, desc.records[0].kind);
+	ASSERT_EQ(RECORD_SPHERE, desc.records[1].kind);
+	ASSERT_EQ(RECORD_LIGHT, desc.records[2].kind);
+	ASSERT_EQ(RECORD_SPHERE, desc.records[3].kind);
+	ASSERT_EQ(2, desc.records[3].values[4]);
+
+	const char *cases[] = { "include rt_test_include_bad.dat",
+			"include rt_test_include_self.dat", "include missing.dat",
+			"include" };
+	const char *errors[] = {
+			"in /tmp/rt_test_include_bad.dat: \"cube\" on line 3",
+			"nests more than", "could not read /tmp/missing.dat",
+			"has no file" };
+	for (int i = 0; i < 4; i++) {
+		scenetokenizer bad(cases[i], cases[i] + strlen(cases[i]));
+		scenedescription d;
+		ASSERT_FALSE((parseScene<double, double>(bad, "/tmp/", d, error)));
+		ASSERT_NE(std::string::npos, error.find(errors[i])) << error;
+	}
+	std::remove("/tmp/rt_test_include_a.dat");
+	std::remove("/tmp/rt_test_include_b.dat");
+	std::remove("/tmp/rt_test_include_bad.dat");
+	std::remove("/tmp/rt_test_include_self.dat");
+}
+
+/*
+ * Geometry objects name files relative to their description and stand for
+ * the file's shapes, which are read only once a ray reaches the box and
+ * render like the same shapes given inline. Files with anything but
+ * spheres and cylinders fail when they're read.
+ */
+TEST(sceneparser, LoadsGeometryFiles) {
+	std::string shapes = "sphere (1, 0, 0) 1 <0, 0, 0> 0.3\n"
+			"cylinder (0, 0, 1) 0.25 <1.5, -1, 0> <0, 1, 0> 2 0\n";
+	writeSceneTestFile("/tmp/rt_test_geometry.dat", shapes);
+	writeSceneTestFile("/tmp/rt_test_geometry_bad.dat",
+			"light (1, 1, 1) <0, 5, 0>\n");
+	std::string common = "camera <0, 0, 6> <0, 0, 0> <0, 1, 0>\n"
+			"light (1, 1, 1) <3, 5, 5>\nplane (0.8, 0.8, 0.8) 1 <0, 1, 0> 0\n";
+	std::string lazyText = common +
+			"geometry rt_test_geometry.dat <-1, -1, -1> <2, 1, 1>\n"
+			"geometry rt_test_geometry_bad.dat <-1, -1, 20> <1, 1, 22>\n";
+	std::string flatText = common + shapes;
+
+	std::vector<rgbcolor<double> > images[2];
+	for (int i = 0; i < 2; i++) {
+		const std::string &text = i == 0 ? lazyText : flatText;
+		scenedescription desc;
+		std::string error;
+		ASSERT_TRUE((parseSceneParallel<double, double>(text.data(),
+				text.data() + text.size(), "/tmp/", 2, desc, error))) <<
+				error;
+		scene3d sc(true);
+		sc.setAccelerator(sp_bvh3d(new bvh3d()));
+		boost::shared_ptr<camera<double, double, 3> > cam;
+		ASSERT_TRUE(addSceneRecords(sc, &desc.records[0],
+				desc.records.size(), desc.paths, cam, error)) << error;
+		sc.finalize();
+		sc.renderImage(*cam, 24, 16, images[i]);
+		if (i == 1)
+			continue;
+		ASSERT_EQ(2u, desc.paths.size());
+		ASSERT_EQ("/tmp/rt_test_geometry.dat", desc.paths[0]);
+		const lazygeometry3d *seen = dynamic_cast<const lazygeometry3d *>(
+				sc.getShapes()[1].get());
+		const lazygeometry3d *behind = dynamic_cast<const lazygeometry3d *>(
+				sc.getShapes()[2].get());
+		ASSERT_TRUE(seen != 0 && behind != 0);
+		ASSERT_EQ(lazygeometry3d::GEOMETRY_LOADED, seen->getState());
+		ASSERT_EQ(lazygeometry3d::GEOMETRY_UNLOADED, behind->getState());
+
+		ray3d r(vector3d(0.0, 0.0, 30.0), vector3d(0.0, 0.0, -1.0));
+		ASSERT_EQ(RAY_MISS, behind->intersection(r));
+		ASSERT_EQ("in /tmp/rt_test_geometry_bad.dat: the light on line 1 "
+				"can't be in a geometry file.", behind->getError());
+	}
+	ASSERT_EQ(images[0].size(), images[1].size());
+	for (size_t i = 0; i < images[0].size(); i++) {
+		ASSERT_EQ(images[1][i].getR(), images[0][i].getR());
+		ASSERT_EQ(images[1][i].getG(), images[0][i].getG());
+		ASSERT_EQ(images[1][i].getB(), images[0][i].getB());
+	}
+	std::remove("/tmp/rt_test_geometry.dat");
+	std::remove("/tmp/rt_test_geometry_bad.dat");
+}
+
+/*
+ * Mesh objects name files relative to their description, which are read
+ * when the objects are added to a scene.
+ */
+TEST(sceneparser, LoadsMeshes) {
+	writeSceneTestFile("/tmp/rt_test_mesh_scene.obj",
+			"v -1 -1 0\nv 1 -1 0\nv 1 1 0\nv -1 1 0\nf 1 2 3 4\n");
+	std::string text = "camera <0, 0, 5> <0, 0, 0> <0, 1, 0>\n"
+			"mesh (0, 1, 0) rt_test_mesh_scene.obj 0.5\n"
+			"mesh (0, 1, 0) rt_test_mesh_missing.obj 0\n";
+	scenetokenizer in(text.data(), text.data() + text.size());
+	scenedescription desc;
+	std::string error;
+	ASSERT_TRUE((parseScene<double, double>(in, "/tmp/", desc, error))) <<
+			error;
+	ASSERT_EQ(3u, desc.records.size());
+	ASSERT_EQ(RECORD_MESH, desc.records[1].kind);
+	ASSERT_EQ("/tmp/rt_test_mesh_scene.obj", desc.paths[0]);
+
+	scene3d sc(false);
+	boost::shared_ptr<camera<double, double, 3> > cam;
+	ASSERT_TRUE(addSceneRecords(sc, &desc.records[0], 2, desc.paths, cam,
+			error)) << error;
+	ASSERT_EQ(1u, sc.getShapes().size());
+	const trianglemeshd *mesh = dynamic_cast<const trianglemeshd *>(
+			sc.getShapes()[0].get());
+	ASSERT_TRUE(mesh != 0);
+	ASSERT_EQ(2u, mesh->getBuffers()->getTriangleCount());
+	ASSERT_FLOAT_EQ(0.5, mesh->getReflectivity());
+	ASSERT_FALSE(addSceneRecords(sc, &desc.records[2], 1, desc.paths, cam,
+			error));
+	ASSERT_EQ("could not read mesh /tmp/rt_test_mesh_missing.obj.", error);
+
+	desc.records[1].values[4] = 2;
+	ASSERT_FALSE(isValidSceneRecord(desc.records[1], desc.paths.size()));
+	desc.records[1].values[4] = 0.5;
+	ASSERT_FALSE(isValidSceneRecord(desc.records[1], 0));
+	std::remove("/tmp/rt_test_mesh_scene.obj");
+}
+
+#endif // TEST_SCENEPARSER_CC
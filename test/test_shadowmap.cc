@@ -0,0 +1,105 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "shadowmap.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "infplane.hh"
+#include "light.hh"
+#include "spotlight.hh"
+#include "mvector.hh"
+#include "ray.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include <cmath>
+#include <vector>
+
+#ifndef TEST_SHADOWMAP_CC
+#define TEST_SHADOWMAP_CC
+
+/*
+ * Tracer that hits a sphere of radius 1 around the origin, from outside.
+ */
+struct shadowmapSphereTracer {
+	bool operator()(const ray3d &r, double &t) const {
+		vector3d P = r.getOrig(), D = r.getDir();
+		double b = P * D, c = P * P - 1, disc = b * b - c;
+		if (disc < 0 || -b - sqrt(disc) <= 0)
+			return false;
+		t = -b - sqrt(disc);
+		return true;
+	}
+};
+
+/*
+ * A map around a light above a ball shadows the points behind the ball,
+ * and not those beside it or in front of it. An empty map shadows nothing.
+ */
+TEST(shadowmap, ShadowsBehindBlocker) {
+	shadowmap3d map;
+	ASSERT_FALSE(map.isOccluded(vector3d(0.0, -5.0, 0.0), 0.01));
+	map.build(vector3d(0.0, 5.0, 0.0), 64, 2, shadowmapSphereTracer());
+	ASSERT_EQ(64, map.getResolution());
+	ASSERT_EQ(6 * 64 * 64 * sizeof(double), map.getMemoryUsage());
+	ASSERT_TRUE(map.isOccluded(vector3d(0.0, -5.0, 0.0), 0.01));
+	ASSERT_TRUE(map.isOccluded(vector3d(0.2, -3.0, -0.1), 0.01));
+	ASSERT_FALSE(map.isOccluded(vector3d(3.0, -5.0, 0.0), 0.01));
+	ASSERT_FALSE(map.isOccluded(vector3d(0.0, 2.0, 0.0), 0.01));
+	// The top of the ball itself is lit thanks to the bias.
+	ASSERT_FALSE(map.isOccluded(vector3d(0.0, 1.0, 0.0), 0.01));
+}
+
+/*
+ * Shadow maps shade a scene with a point light and a spotlight almost like
+ * shadow rays do, and are ignored once a light moves until the scene is
+ * refit.
+ */
+TEST(shadowmap, MatchesShadowRays) {
+	scene3d sc(true);
+	rgbcolord col(0.5, 0.5, 0.5);
+	sc.addShape(sp_shape3d(new sphere3d(col, 1, vector3d(0.0, 2.0, 0.0))));
+	sc.addShape(sp_shape3d(new sphere3d(col, 0.5, vector3d(2.0, 1.0, 1.0))));
+	sc.addShape(sp_shape3d(new infplaned(col, 0, vector3d(0.0, 1.0, 0.0))));
+	sp_lightd lamp(new lightd(rgbcolord(0.6, 0.6, 0.6),
+			vector3d(1.0, 6.0, 0.5)));
+	sc.addPointLight(lamp);
+	sc.addSpotLight(sp_spotlightd(new spotlightd(rgbcolord(0.4, 0.4, 0.4),
+			vector3d(-3.0, 5.0, 2.0), vector3d(0.5, -1.0, -0.3).norm(), 0.6)));
+	sc.finalize();
+
+	std::vector<ray3d> rays;
+	for (int z = -20; z <= 20; z++)
+		for (int x = -20; x <= 20; x++)
+			rays.push_back(ray3d(vector3d(0.0, 8.0, 8.0),
+					vector3d(x * 0.2, -8.0, z * 0.2 - 8.0)));
+	std::vector<rgbcolord> traced;
+	for (size_t i = 0; i < rays.size(); i++)
+		traced.push_back(sc.traceRay(rays[i]));
+
+	sc.setShadowMaps(512, 0.02);
+	int differ = 0;
+	for (size_t i = 0; i < rays.size(); i++)
+		if (fabs(sc.traceRay(rays[i]).getR() - traced[i].getR()) > 1e-9)
+			differ++;
+	ASSERT_LT(differ, (int) rays.size() / 50);
+
+	// A moved light traces shadow rays until the maps are built again.
+	lamp->setPos(vector3d(-1.0, 6.0, 0.5));
+	sc.setShadowMaps(0, 0);
+	for (size_t i = 0; i < rays.size(); i++)
+		traced[i] = sc.traceRay(rays[i]);
+	sc.setShadowMaps(512, 0.02);
+	lamp->setPos(vector3d(-1.0, 6.0, 0.5));
+	for (size_t i = 0; i < rays.size(); i++)
+		ASSERT_EQ(traced[i].getR(), sc.traceRay(rays[i]).getR());
+	sc.refit();
+	differ = 0;
+	for (size_t i = 0; i < rays.size(); i++)
+		if (fabs(sc.traceRay(rays[i]).getR() - traced[i].getR()) > 1e-9)
+			differ++;
+	ASSERT_LT(differ, (int) rays.size() / 50);
+}
+
+#endif // TEST_SHADOWMAP_CC
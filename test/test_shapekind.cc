@@ -0,0 +1,61 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "shapekind.hh"
+#include "instance.hh"
+#include "sphere.hh"
+#include "infplane.hh"
+#include "cylinder.hh"
+#include "ray.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include <cstdlib>
+#include <vector>
+
+#ifndef TEST_SHAPEKIND_CC
+#define TEST_SHAPEKIND_CC
+
+/*
+ * Every shape gets the tag of its exact class, and intersecting by the tag
+ * gives exactly what the virtual call does.
+ */
+TEST(shapeKind, DispatchMatchesVirtual) {
+	typedef shapedispatch<double, double, double, 3> dispatch;
+	rgbcolord col(0.5, 0.5, 0.5);
+	sp_assembly3d assem(new assembly3d());
+	assem->addShape(sp_shape3d(new sphere3d(col, 1, vector3d(0.0, 0.0, 0.0))));
+	assem->finalize();
+	std::vector<sp_shape3d> shapes;
+	shapes.push_back(sp_shape3d(new sphere3d(col, 1.5,
+			vector3d(1.0, 0.5, -1.0))));
+	shapes.push_back(sp_shape3d(new infplaned(col, 2,
+			vector3d(0.0, 1.0, 0.0))));
+	shapes.push_back(sp_shape3d(new cylinderd(col, 0.7,
+			vector3d(-1.0, 0.0, 0.5), 2, vector3d(0.0, 1.0, 1.0))));
+	shapes.push_back(sp_shape3d(new instance3d(assem,
+			vector3d(0.5, -0.5, 0.0), 2)));
+	shapeKind expected[] = { SHAPE_SPHERE, SHAPE_INFPLANE, SHAPE_CYLINDER,
+			SHAPE_OTHER };
+	for (size_t j = 0; j < shapes.size(); j++)
+		ASSERT_EQ(expected[j], dispatch::kindOf(shapes[j].get()));
+
+	srand(99);
+	int hits = 0;
+	for (int i = 0; i < 1000; i++) {
+		vector3d P(rand() % 9 - 4.0, rand() % 9 - 4.0, 6.0);
+		vector3d D(rand() % 7 - 3.0, rand() % 7 - 3.0, -4.0);
+		ray3d r(P, D, i % 2 == 0);
+		for (size_t j = 0; j < shapes.size(); j++) {
+			double t = dispatch::intersection(expected[j], shapes[j].get(), r);
+			ASSERT_EQ(shapes[j]->intersection(r), t);
+			if (t != RAY_MISS && t > 0)
+				hits++;
+		}
+	}
+	ASSERT_GT(hits, 500);
+}
+
+#endif // TEST_SHAPEKIND_CC
@@ -0,0 +1,136 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "shapeprofile.hh"
+#include "scene.hh"
+#include "sphere.hh"
+#include "infplane.hh"
+#include "light.hh"
+#include "arealight.hh"
+#include "camera.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef TEST_SHAPEPROFILE_CC
+#define TEST_SHAPEPROFILE_CC
+
+/**
+ * A large mirror sphere next to a small one on a floor, under a point
+ * light and a grid of point lights from an area light.
+ */
+class shapeprofileTest : public ::testing::Test {
+protected:
+
+	/** The scene. */
+	scene3d sc;
+
+	/** The camera looking at the spheres. */
+	camera<double, double, 3> cam;
+
+	shapeprofileTest() : sc(true), cam(vector3d(0.0, 3.0, -8.0),
+			vector3d(0.0, 1.0, 0.0), vector3d(0.0, 1.0, 0.0)) {
+		sc.addShape(sp_shape3d(new sphere3d(rgbcolord(0.8, 0.8, 0.8), 2,
+				vector3d(-1.0, 2.0, 0.0), 0.9)));
+		sc.addShape(sp_shape3d(new sphere3d(rgbcolord(0.2, 0.8, 0.2), 0.3,
+				vector3d(2.5, 0.3, -1.0))));
+		sc.addShape(sp_shape3d(new infplaned(rgbcolord(0.6, 0.6, 0.6), 0,
+				vector3d(0.0, 1.0, 0.0))));
+		sc.addPointLight(sp_lightd(new lightd(rgbcolord(0.3, 0.3, 0.3),
+				vector3d(-6.0, 8.0, -4.0))));
+		sc.addAreaLight(sp_arealightd(new arealightd(rgbcolord(0.5, 0.5,
+				0.5), vector3d(1.0, 6.0, 1.0), vector3d(0.0, -1.0, 0.0),
+				vector3d(1.0, 0.0, 0.0), 0.5, 0.5, 3, 3)));
+		sc.finalize();
+	}
+
+	virtual void TearDown() {
+		shapeprofile::setEnabled(false);
+		shapeprofile::reset();
+	}
+};
+
+/*
+ * The mirror sphere takes most of the hits and cycles, the area light's
+ * grid is one light, and nothing is counted with profiling off.
+ */
+TEST_F(shapeprofileTest, AttributesCost) {
+	std::vector<rgbcolord> image;
+	shapeprofile::reset();
+	sc.renderImage(cam, 40, 30, image);
+	std::vector<profilerow> shapes, lights;
+	sc.getProfileRows(shapeprofile::total(), shapes, lights);
+	ASSERT_EQ(3u, shapes.size());
+	for (size_t i = 0; i < shapes.size(); i++)
+		ASSERT_EQ(0u, shapes[i].hits);
+
+	shapeprofile::setEnabled(true);
+	sc.setRenderThreads(3);
+	sc.renderImage(cam, 40, 30, image);
+	shapeprofile::setEnabled(false);
+	sc.getProfileRows(shapeprofile::total(), shapes, lights);
+	ASSERT_GT(shapes[0].hits, shapes[1].hits);
+	ASSERT_GT(shapes[1].hits, 0u);
+	ASSERT_GT(shapes[0].cycles, shapes[1].cycles);
+	ASSERT_NE(std::string::npos, shapes[0].what.find("sphere"));
+
+	// Every hit takes a sample of the point light unless that's behind
+	// it, and up to one of each point light of the area light's grid.
+	unsigned long long grid = sc.getLights().size() - 1;
+	ASSERT_LT(1u, grid);
+	ASSERT_EQ(2u, lights.size());
+	std::ostringstream count;
+	count << "lights: " << grid << "]";
+	ASSERT_NE(std::string::npos, lights[1].what.find(count.str()));
+	ASSERT_GT(lights[1].samples, lights[0].samples);
+	ASSERT_GT(lights[1].cycles, 0u);
+	ASSERT_GT(lights[1].blocked, 0u);
+	unsigned long long hits = 0;
+	for (size_t i = 0; i < shapes.size(); i++)
+		hits += shapes[i].hits;
+	ASSERT_LE(lights[0].samples, hits);
+	ASSERT_LE(lights[1].samples, grid * hits);
+}
+
+/*
+ * Rows are ranked by cycles, then tests, then index, and the reports keep
+ * the costliest.
+ */
+TEST_F(shapeprofileTest, Reports) {
+	std::vector<profilerow> rows;
+	for (int i = 0; i < 4; i++)
+		rows.push_back(profilerow(i));
+	rows[0].cycles = 10;
+	rows[1].cycles = 70;
+	rows[2].cycles = 10;
+	rows[2].tests = 5;
+	rows[3].cycles = 10;
+	rows[3].what = "a \"quoted\"\nname";
+	std::vector<profilerow> ranked(rows);
+	ASSERT_EQ(100u, rankProfileRows(ranked, 3));
+	ASSERT_EQ(3u, ranked.size());
+	ASSERT_EQ(1, ranked[0].index);
+	ASSERT_EQ(2, ranked[1].index);
+	ASSERT_EQ(0, ranked[2].index);
+
+	std::ostringstream table;
+	printProfileRows(table, rows, 2, false);
+	std::string text = table.str();
+	ASSERT_EQ(0u, text.find("costliest 2 of 4 shapes:\n"));
+	ASSERT_NE(std::string::npos, text.find("70.0%"));
+	ASSERT_EQ(std::string::npos, text.find("quoted"));
+
+	std::ostringstream json;
+	writeProfileJson(json, rows, 4, true);
+	ASSERT_EQ(0u, json.str().find("[{\"index\": 1, \"share\": 0.7, "
+			"\"cycles\": 70, \"samples\": 0, \"blocked\": 0"));
+	ASSERT_NE(std::string::npos, json.str().find(
+			"\"what\": \"a \\\"quoted\\\"\\nname\"}]"));
+}
+
+#endif // TEST_SHAPEPROFILE_CC
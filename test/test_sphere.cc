@@ -148,6 +148,73 @@ TEST_F(sphereTest, SurfNorm) {
 	ASSERT_DOUBLE_EQ(0, a->surfaceNorm(top)[2]);
 }
 
+/*
+ * The hit record must agree with intersection and surfaceNorm.
+ */
+TEST_F(sphereTest, HitRecord) {
+	ray3d r(vector3d(1.0, 1.0, 5.0), vector3d(0.2, -0.1, -1.0));
+	hitrecord3d rec;
+	ASSERT_TRUE(c->intersect(r, rec));
+	ASSERT_DOUBLE_EQ(c->intersection(r), rec.t);
+	vector3d N = c->surfaceNorm(r.getPointAtT(rec.t));
+	for (int i = 0; i < 3; i++)
+		ASSERT_NEAR(N[i], rec.normal[i], 1e-12);
+	ASSERT_EQ(c, rec.obj);
+
+	ray3d away(vector3d(1.0, 1.0, 5.0), vector3d(0.0, 0.0, 1.0));
+	hitrecord3d miss;
+	ASSERT_FALSE(c->intersect(away, miss));
+	ASSERT_TRUE(miss.obj == 0);
+}
+
+/*
+ * Rays with normalized directions take their own path through
+ * getIntersections, which must agree with the general one once times are
+ * scaled by the direction's length.
+ */
+TEST_F(sphereTest, UnitFastPath) {
+	vector3d starts[] = {vector3d(1.0, 1.0, 5.0), vector3d(1.0, 1.0, 0.5),
+			vector3d(1.0, 1.0 + sqrt(2), 5.0), vector3d(-4.0, 3.0, 2.0)};
+	vector3d dirs[] = {vector3d(0.2, -0.1, -1.0), vector3d(0.0, 0.0, 1.0),
+			vector3d(0.0, 0.0, -1.0), vector3d(1.0, -0.5, -0.3)};
+	for (int i = 0; i < 4; i++) {
+		ray3d unit(starts[i], dirs[i]);
+		ray3d raw(starts[i], dirs[i] * 3.0, false);
+		ASSERT_TRUE(unit.isNormalized());
+		ASSERT_FALSE(raw.isNormalized());
+		double u1, u2, w1, w2;
+		int n = c->getIntersections(unit, u1, u2);
+		ASSERT_EQ(n, c->getIntersections(raw, w1, w2));
+		double len = (dirs[i] * 3.0).mag();
+		if (n >= 1) {
+			ASSERT_NEAR(u1 == RAY_MISS ? u2 : u1,
+					(w1 == RAY_MISS ? w2 : w1) * len, 1e-9);
+		}
+		if (n == 2) {
+			ASSERT_NEAR(u2, w2 * len, 1e-9);
+		}
+	}
+}
+
+/*
+ * Exercises the getBounds function.
+ */
+TEST_F(sphereTest, Bounds) {
+	aabb3d box;
+	ASSERT_TRUE(c->getBounds(box));
+	ASSERT_DOUBLE_EQ(1 - sqrt(2), box.getMin()[0]);
+	ASSERT_DOUBLE_EQ(1 - sqrt(2), box.getMin()[1]);
+	ASSERT_DOUBLE_EQ(-sqrt(2), box.getMin()[2]);
+	ASSERT_DOUBLE_EQ(1 + sqrt(2), box.getMax()[0]);
+	ASSERT_DOUBLE_EQ(1 + sqrt(2), box.getMax()[1]);
+	ASSERT_DOUBLE_EQ(sqrt(2), box.getMax()[2]);
+
+	aabb2d box2;
+	ASSERT_TRUE(b->getBounds(box2));
+	ASSERT_DOUBLE_EQ(-1, box2.getMin()[0]);
+	ASSERT_DOUBLE_EQ(4, box2.getMax()[1]);
+}
+
 /*
  * Exercises the << operator.
  */
@@ -0,0 +1,200 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "spherepack.hh"
+#include "simd.hh"
+#include "sphere.hh"
+#include "cylinder.hh"
+#include "infplane.hh"
+#include "ray.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include <cstdlib>
+#include <vector>
+
+#ifndef TEST_SPHEREPACK_CC
+#define TEST_SPHEREPACK_CC
+
+/**
+ * This test fixture class sets up a row of random spheres with a few other
+ * shapes mixed in, packed in the order they were made, and a batch of random
+ * rays, some of them not normalized. Note that an object of this class is
+ * created before each test case begins and is torn down when each test case
+ * ends.
+ */
+class spherepackTest : public ::testing::Test {
+protected:
+
+	std::vector<sp_shape3d> shapes;
+	std::vector<ray3d> rays;
+	spherepack3d pack;
+
+	static double rnd(double lo, double hi) {
+		return lo + (hi - lo) * (rand() / (double) RAND_MAX);
+	}
+
+	static vector3d rndvec(double lo, double hi) {
+		return vector3d(rnd(lo, hi), rnd(lo, hi), rnd(lo, hi));
+	}
+
+	virtual void SetUp() {
+		srand(4321);
+		rgbcolord col(0.5, 0.5, 0.5);
+		for (int i = 0; i < 203; i++) {
+			if (i % 17 == 5)
+				shapes.push_back(sp_shape3d(new cylinderd(col, 0.3,
+						rndvec(-5, 5), 1, rndvec(-1, 1))));
+			else
+				shapes.push_back(sp_shape3d(
+						new sphere3d(col, rnd(0.1, 1), rndvec(-5, 5))));
+			pack.add(shapes.back().get());
+		}
+		shapes.push_back(sp_shape3d(
+				new infplaned(col, 6, vector3d(0.0, 1.0, 0.0))));
+		pack.add(shapes.back().get());
+		for (int i = 0; i < 500; i++)
+			rays.push_back(ray3d(rndvec(-8, 8), rndvec(-1, 1), i % 5 != 0));
+	}
+
+	/*
+	 * Over every range of slots, the pack must report the first of the
+	 * closest hits at exactly the time a scan with the shapes' own
+	 * intersection finds.
+	 */
+	void checkMatchesScan() {
+		int hits = 0;
+		int ranges[][2] = { { 0, 204 }, { 3, 4 }, { 1, 8 }, { 5, 6 },
+				{ 7, 30 }, { 190, 204 }, { 10, 10 } };
+		for (size_t i = 0; i < rays.size(); i++) {
+			for (int k = 0; k < 7; k++) {
+				int begin = ranges[k][0], end = ranges[k][1];
+				double tScan = RAY_MISS;
+				int scan = -1;
+				for (int j = begin; j < end; j++) {
+					double t = shapes[j]->intersection(rays[i]);
+					if (t != RAY_MISS && t > 0 && (scan < 0 || t < tScan)) {
+						tScan = t;
+						scan = j;
+					}
+				}
+				double tPack = RAY_MISS;
+				ASSERT_EQ(scan, pack.closestHit(rays[i], begin, end, tPack));
+				ASSERT_EQ(tScan, tPack);
+				int any = pack.anyHit(rays[i], begin, end, 1e30);
+				ASSERT_EQ(scan < 0, any < 0);
+				if (any >= 0) {
+					ASSERT_GE(any, begin);
+					ASSERT_LT(any, end);
+					ASSERT_GT(shapes[any]->intersection(rays[i]), 0);
+				}
+				if (scan >= 0) {
+					hits++;
+					// Nothing is closer than the closest hit.
+					double tCloser = tScan;
+					ASSERT_EQ(-1, pack.closestHit(rays[i], begin, end,
+							tCloser));
+					ASSERT_EQ(tScan, tCloser);
+					ASSERT_EQ(-1, pack.anyHit(rays[i], begin, end, tScan));
+				}
+			}
+		}
+		ASSERT_GT(hits, 500);
+	}
+
+	virtual void TearDown() { }
+};
+
+/*
+ * The pack must match the scan with every instruction set this machine has.
+ */
+TEST_F(spherepackTest, MatchesScan) {
+	ASSERT_EQ((int) shapes.size(), pack.size());
+	ASSERT_EQ(191, pack.getSphereCount());
+	ASSERT_TRUE(pack.isPacked(0));
+	ASSERT_FALSE(pack.isPacked(5));
+
+	simdLevel saved = activeSimdLevel();
+	for (int level = SIMD_SCALAR; level <= detectSimdLevel(); level++) {
+		ASSERT_EQ(level, setSimdLevel((simdLevel) level));
+		checkMatchesScan();
+	}
+	setSimdLevel(saved);
+}
+
+
+/*
+ * Packets of rays, with some of them masked off and some with hits already,
+ * get the same hits as testing the rays one at a time, whether or not
+ * their spheres go through the lanes.
+ */
+TEST_F(spherepackTest, PacketsMatchRays) {
+	int ranges[][2] = { { 0, 204 }, { 3, 4 }, { 1, 8 }, { 5, 6 },
+			{ 190, 204 }, { 10, 10 } };
+	int hits = 0;
+	for (size_t i = 0; i + 32 <= rays.size(); i += 32) {
+		for (int k = 0; k < 6; k++) {
+			int begin = ranges[k][0], end = ranges[k][1];
+			unsigned int mask = i % 64 == 0 ? ~0u : 0x5a5a5a5au >> (i % 7);
+			double tBest[32], tRay[32];
+			int best[32];
+			for (int j = 0; j < 32; j++)
+				tBest[j] = tRay[j] = j % 3 == 0 ? RAY_MISS : 0.5 * j;
+			pack.closestHits(&rays[i], 32, mask, begin, end, tBest, best);
+			for (int j = 0; j < 32; j++) {
+				if (!(mask >> j & 1))
+					continue;
+				ASSERT_EQ(pack.closestHit(rays[i + j], begin, end, tRay[j]),
+						best[j]) << "ray " << i + j;
+				ASSERT_EQ(tRay[j], tBest[j]) << "ray " << i + j;
+				hits += best[j] >= 0;
+			}
+		}
+	}
+	ASSERT_GT(hits, 100);
+}
+
+/*
+ * The float kernels must agree with float spheres too, and the pack must
+ * follow spheres that moved once it's updated.
+ */
+TEST(spherepackFloat, MatchesAndUpdates) {
+	srand(77);
+	std::vector<boost::shared_ptr<sphere3f> > spheres;
+	spherepack3f pack;
+	for (int i = 0; i < 37; i++) {
+		float x = rand() / (float) RAND_MAX * 10 - 5;
+		spheres.push_back(boost::shared_ptr<sphere3f>(new sphere3f(
+				rgbcolorf(), 0.5f, vector3f(x, 0.0f, (float) (i % 7)))));
+		pack.add(spheres.back().get());
+	}
+	simdLevel saved = activeSimdLevel();
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < 200 * (detectSimdLevel() + 1); i++) {
+			setSimdLevel((simdLevel) (i / 200));
+			ray3f r(vector3f(0.0f, 10.0f, 3.0f), vector3f(i % 200 * 0.05f - 5,
+					-10.0f, (i % 9) * 0.5f - 2));
+			float tScan = RAY_MISS;
+			int scan = -1;
+			for (int j = 0; j < 37; j++) {
+				float t = spheres[j]->intersection(r);
+				if (t != RAY_MISS && t > 0 && (scan < 0 || t < tScan)) {
+					tScan = t;
+					scan = j;
+				}
+			}
+			float tPack = RAY_MISS;
+			ASSERT_EQ(scan, pack.closestHit(r, 0, 37, tPack));
+			ASSERT_EQ(tScan, tPack);
+		}
+		for (int j = 0; j < 37; j++)
+			spheres[j]->setCenter(spheres[j]->getCenter() +
+					vector3f(0.3f, -0.5f, 0.0f));
+		pack.update();
+	}
+	setSimdLevel(saved);
+}
+
+#endif // TEST_SPHEREPACK_CC
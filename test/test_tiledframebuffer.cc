@@ -0,0 +1,59 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "tiledframebuffer.hh"
+#include "tilequeue.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include <vector>
+
+#ifndef TEST_TILEDFRAMEBUFFER_CC
+#define TEST_TILEDFRAMEBUFFER_CC
+
+/*
+ * The pixels of a tile are contiguous, edge tiles take the room of full
+ * ones, and converting to scanline order and back keeps every color.
+ */
+TEST(tiledframebuffer, Layout) {
+	tiledframebuffer<double> fb(10, 7, 4);
+	ASSERT_EQ(3, fb.getTilesPerRow());
+	ASSERT_EQ(6, fb.getTileCount());
+	ASSERT_EQ(0u, fb.index(0, 0));
+	ASSERT_EQ(5u, fb.index(1, 1));
+	ASSERT_EQ(16u, fb.index(4, 0));
+	ASSERT_EQ(3u * 16 + 4 + 2, fb.index(2, 5));
+	ASSERT_EQ(&fb.at(9, 6), fb.getTile(5) + 2 * 4 + 1);
+
+	std::vector<rgbcolord> image(70);
+	for (int i = 0; i < 70; i++)
+		image[i] = rgbcolord(i / 100.0, 0, 0);
+	fb.fromScanline(image);
+	for (int y = 0; y < 7; y++)
+		for (int x = 0; x < 10; x++)
+			ASSERT_EQ((y * 10 + x) / 100.0, fb.at(x, y).getR());
+	std::vector<rgbcolord> back;
+	fb.toScanline(back);
+	ASSERT_EQ(70u, back.size());
+	for (int i = 0; i < 70; i++)
+		ASSERT_EQ(image[i].getR(), back[i].getR());
+}
+
+/*
+ * A rendered tile lands on its place in the grid, edge tiles included.
+ */
+TEST(tiledframebuffer, PutsTiles) {
+	tiledframebuffer<double> fb(10, 7, 4);
+	tilebuffer<double> tile;
+	tile.place(8, 4, 2, 3);
+	for (int i = 0; i < 6; i++)
+		tile.pixels[i] = rgbcolord(0, (i + 1) / 10.0, 0);
+	fb.put(tile);
+	for (int y = 0; y < 3; y++)
+		for (int x = 0; x < 2; x++)
+			ASSERT_EQ((y * 2 + x + 1) / 10.0, fb.at(8 + x, 4 + y).getG());
+	ASSERT_EQ(0, fb.at(7, 4).getG());
+}
+
+#endif // TEST_TILEDFRAMEBUFFER_CC
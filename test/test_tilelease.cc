@@ -0,0 +1,82 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "tilelease.hh"
+#include "gtest/gtest.h"
+#include "boost/thread.hpp"
+
+#ifndef TEST_TILELEASE_CC
+#define TEST_TILELEASE_CC
+
+/*
+ * Leases a tile on its own thread, for leases that have to wait.
+ */
+struct leaseTaker {
+	tileleases *leases;
+	int worker;
+	int *tile;
+
+	void operator()() {
+		*tile = leases->lease(worker);
+	}
+};
+
+/*
+ * Tiles are leased in order, each to one worker, and only the first
+ * completion of a tile counts.
+ */
+TEST(tileleases, LeasesEveryTileOnce) {
+	tileleases leases(3, 60);
+	ASSERT_EQ(3, leases.size());
+	ASSERT_EQ(0, leases.lease(0));
+	ASSERT_EQ(1, leases.lease(1));
+	ASSERT_EQ(2, leases.lease(0));
+	ASSERT_TRUE(leases.complete(1));
+	ASSERT_FALSE(leases.complete(1));
+	ASSERT_TRUE(leases.isDone(1));
+	ASSERT_FALSE(leases.isDone(0));
+	ASSERT_TRUE(leases.complete(0));
+	ASSERT_TRUE(leases.complete(2));
+	ASSERT_TRUE(leases.finished());
+	ASSERT_EQ(-1, leases.lease(1));
+}
+
+/*
+ * The tiles of a worker that went away are leased again before the others,
+ * and a worker waiting for one gets it.
+ */
+TEST(tileleases, ReleasesWorkersTiles) {
+	tileleases leases(4, 0);
+	ASSERT_EQ(0, leases.lease(0));
+	ASSERT_EQ(1, leases.lease(1));
+	leases.release(0);
+	ASSERT_EQ(0, leases.lease(1));
+	ASSERT_EQ(2, leases.lease(2));
+	ASSERT_EQ(3, leases.lease(2));
+
+	int tile = -2;
+	leaseTaker taker = { &leases, 2, &tile };
+	boost::thread waiting(taker);
+	leases.release(1);
+	waiting.join();
+	ASSERT_TRUE(tile == 0 || tile == 1);
+	leases.cancel();
+	ASSERT_EQ(-1, leases.lease(3));
+}
+
+/*
+ * A tile held past its lease is leased to the next worker too, and either
+ * worker may finish it.
+ */
+TEST(tileleases, LeasesExpiredTilesAgain) {
+	tileleases leases(1, 0.05);
+	ASSERT_EQ(0, leases.lease(0));
+	ASSERT_EQ(0, leases.lease(1));
+	ASSERT_TRUE(leases.complete(0));
+	ASSERT_FALSE(leases.complete(0));
+	ASSERT_EQ(-1, leases.lease(0));
+}
+
+#endif // TEST_TILELEASE_CC
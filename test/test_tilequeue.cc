@@ -0,0 +1,136 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "tilequeue.hh"
+#include "rgbcolor.hh"
+#include "boost/thread.hpp"
+#include "boost/atomic.hpp"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <vector>
+
+#ifndef TEST_TILEQUEUE_CC
+#define TEST_TILEQUEUE_CC
+
+/**
+ * Fills in and publishes every @c step th tile of a 6 x 4 tile image, the
+ * red of each pixel being its index in the image over 1000.
+ */
+struct tileProducer {
+	tilequeue<double> *queue;
+	int first;
+	int step;
+
+	void operator()() const {
+		for (int i = first; i < queue->size(); i += step) {
+			tilebuffer<double> &tile = queue->getTile(i);
+			int x0 = i % 6 * 4, y0 = i / 6 * 4;
+			tile.place(x0, y0, 4, i / 6 == 3 ? 2 : 4);
+			for (int y = 0; y < tile.height; y++)
+				for (int x = 0; x < 4; x++)
+					tile.pixels[y * 4 + x] = rgbcolord(
+							((y0 + y) * 24 + x0 + x) / 1000.0, 0, 0);
+			queue->publish(i);
+		}
+	}
+};
+
+/*
+ * Tiles published by several threads at once all reach the writer, which
+ * puts the image back together while they're being made.
+ */
+TEST(tilequeue, WriterGetsEveryTile) {
+	tilequeue<double> queue(24);
+	ASSERT_EQ(24, queue.size());
+	ASSERT_FALSE(queue.done());
+	boost::thread_group producers;
+	for (int t = 0; t < 3; t++) {
+		tileProducer p;
+		p.queue = &queue;
+		p.first = t;
+		p.step = 3;
+		producers.create_thread(p);
+	}
+	std::vector<rgbcolord> image(24 * 14, rgbcolord(1, 1, 1));
+	const tilebuffer<double> *tile;
+	int tiles = 0;
+	while (!queue.done()) {
+		if (queue.take(tile)) {
+			tile->copyTo(image, 24);
+			tiles++;
+		}
+		else {
+			boost::this_thread::yield();
+		}
+	}
+	producers.join_all();
+	ASSERT_EQ(24, tiles);
+	ASSERT_FALSE(queue.take(tile));
+	for (int i = 0; i < 24 * 14; i++)
+		ASSERT_EQ(i / 1000.0, image[i].getR());
+}
+
+/*
+ * Renders bands of 2 rows of a 3 pixel wide image for a reorderbuffer,
+ * taking band numbers from a shared counter, the red of each pixel being
+ * its index in the image over 1000.
+ */
+struct bandProducer {
+	reorderbuffer<double> *window;
+	boost::atomic<int> *next;
+	int rows;
+
+	void operator()() const {
+		for (;;) {
+			int i = next->fetch_add(1);
+			if (i >= window->size())
+				break;
+			tilebuffer<double> &band = window->acquire(i);
+			int h = std::min(2, rows - 2 * i);
+			band.place(0, 2 * i, 3, h);
+			for (int k = 0; k < 3 * h; k++)
+				band.pixels[k] = rgbcolord((6 * i + k) / 1000.0, 0, 0);
+			if (i % 4 == 1)
+				boost::this_thread::yield();
+			window->publish(i);
+		}
+	}
+};
+
+/*
+ * The writer gets every band once and in order, while more threads than
+ * can fit in the window render them.
+ */
+TEST(reorderbuffer, WritesBandsInOrder) {
+	int rows = 41, bands = 21;
+	reorderbuffer<double> window(bands, 4);
+	ASSERT_EQ(bands, window.size());
+	boost::atomic<int> next(0);
+	boost::thread_group producers;
+	for (int t = 0; t < 3; t++) {
+		bandProducer p;
+		p.window = &window;
+		p.next = &next;
+		p.rows = rows;
+		producers.create_thread(p);
+	}
+	std::vector<double> reds;
+	const tilebuffer<double> *band;
+	int taken = 0;
+	while (window.take(band)) {
+		ASSERT_EQ(2 * taken, band->y0);
+		for (size_t k = 0; k < band->pixels.size(); k++)
+			reds.push_back(band->pixels[k].getR());
+		window.release();
+		taken++;
+	}
+	producers.join_all();
+	ASSERT_EQ(bands, taken);
+	ASSERT_EQ((size_t) rows * 3, reds.size());
+	for (size_t i = 0; i < reds.size(); i++)
+		ASSERT_EQ(i / 1000.0, reds[i]);
+}
+
+#endif // TEST_TILEQUEUE_CC
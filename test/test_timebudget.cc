@@ -0,0 +1,62 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "timebudget.hh"
+#include "gtest/gtest.h"
+#include <vector>
+
+#ifndef TEST_TIMEBUDGET_CC
+#define TEST_TIMEBUDGET_CC
+
+/*
+ * The levels climb from the cheapest settings to the best ones without
+ * repeating themselves, and get dearer all the way.
+ */
+TEST(timebudget, LaysOutLevels) {
+	qualitylevel best = { 4, 3, 10, 16 };
+	timebudget budget(1, best);
+	const std::vector<qualitylevel> &levels = budget.getLevels();
+	ASSERT_EQ(5u, levels.size());
+	qualitylevel first = { 1, 1, 1, 1 }, second = { 1, 1, 10, 4 };
+	ASSERT_TRUE(levels[0] == first);
+	ASSERT_TRUE(levels[1] == second);
+	ASSERT_EQ(3, levels[2].aaSamples);
+	ASSERT_EQ(2, levels[3].pixelSamples);
+	ASSERT_TRUE(levels[4] == best);
+	for (size_t i = 1; i < levels.size(); i++)
+		ASSERT_LT(timebudget::weight(levels[i - 1]),
+				timebudget::weight(levels[i]));
+
+	// Settings that are already the cheapest make a single level.
+	qualitylevel cheap = { 1, 1, 0, 0 };
+	ASSERT_EQ(1u, timebudget(1, cheap).getLevels().size());
+}
+
+/*
+ * Levels are estimated from the closest measured one below them, and the
+ * best one that fits in the time left with the margin is picked.
+ */
+TEST(timebudget, PicksWhatFits) {
+	qualitylevel best = { 2, 1, 2, 0 };
+	timebudget budget(10, best);
+	ASSERT_EQ(3u, budget.getLevels().size());
+	ASSERT_FALSE(budget.isMeasured(1));
+	budget.measure(0, 100, 0.5);
+	ASSERT_DOUBLE_EQ(0.5, budget.estimate(0, 100));
+	double w0 = timebudget::weight(budget.getLevels()[0]);
+	double w2 = timebudget::weight(budget.getLevels()[2]);
+	ASSERT_DOUBLE_EQ(0.5 * 2 * w2 / w0, budget.estimate(2, 200));
+	ASSERT_EQ(2, budget.pickLevel(0, 200, 0));
+	ASSERT_EQ(0, budget.pickLevel(0, 200, 8.7));
+	ASSERT_EQ(-1, budget.pickLevel(0, 200, 9));
+
+	// A measured level is estimated from its own pass.
+	budget.measure(2, 100, 50);
+	ASSERT_TRUE(budget.isMeasured(2));
+	ASSERT_DOUBLE_EQ(50, budget.estimate(2, 100));
+	ASSERT_EQ(1, budget.pickLevel(1, 100, 0));
+}
+
+#endif // TEST_TIMEBUDGET_CC
@@ -0,0 +1,110 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "tracelog.hh"
+#include "phasetimes.hh"
+#include "scene.hh"
+#include "gtest/gtest.h"
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef TEST_TRACELOG_CC
+#define TEST_TRACELOG_CC
+
+/*
+ * The trace names every lane up to the last one used and has a complete
+ * event for every span, with its task if it has one.
+ */
+TEST(tracelog, WritesChromeTrace) {
+	tracelog log;
+	EXPECT_GE(log.now(), 0);
+	log.add("shade tile", TRACE_WORKER_LANE + 1, 12, 1520, 1607);
+	log.add("write tile", TRACE_WRITER_LANE, -1, 1610, 1615);
+	phasetimes times;
+	times.setTraceLog(&log);
+	times.start(PHASE_RENDER);
+	times.stop();
+	ASSERT_EQ(3u, log.getEvents().size());
+	EXPECT_EQ(TRACE_PHASE_LANE, log.getEvents()[2].lane);
+	EXPECT_STREQ("render", log.getEvents()[2].name);
+
+	std::ostringstream os;
+	log.writeJson(os);
+	std::string json = os.str();
+	EXPECT_EQ(0u, json.find("{\"traceEvents\": ["));
+	EXPECT_NE(std::string::npos, json.find("\"tid\": 0, \"args\": "
+			"{\"name\": \"phases\"}"));
+	EXPECT_NE(std::string::npos, json.find("\"tid\": 1, \"args\": "
+			"{\"name\": \"writer\"}"));
+	EXPECT_NE(std::string::npos, json.find("\"tid\": 3, \"args\": "
+			"{\"name\": \"worker 1\"}"));
+	EXPECT_EQ(std::string::npos, json.find("worker 2"));
+	EXPECT_NE(std::string::npos, json.find("{\"name\": \"shade tile\", "
+			"\"ph\": \"X\", \"pid\": 1, \"tid\": 3, \"ts\": 1520, "
+			"\"dur\": 87, \"args\": {\"task\": 12}}"));
+	EXPECT_NE(std::string::npos, json.find("{\"name\": \"write tile\", "
+			"\"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": 1610, "
+			"\"dur\": 5}"));
+	EXPECT_NE(std::string::npos, json.find("\"displayTimeUnit\": \"ms\"}"));
+}
+
+/*
+ * A traced render has a span for every band it traces and every tile it
+ * shades, on the lanes of its threads, and the same colors as one that
+ * isn't traced.
+ */
+TEST(tracelog, TracesRenderTasks) {
+	scene3d sc(true);
+	sc.addShape(sp_shape3d(new sphere3d(rgbcolord(1, 0.5, 0.5), 1,
+			vector3d(0.0, 0.0, -4.0), 0.5f)));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(1, 1, 1),
+			vector3d(0.0, 5.0, 0.0))));
+	sc.setRenderThreads(2);
+	sc.finalize();
+	camerad cam(vector3d(0.0, 0.0, 0.0), vector3d(0.0, 0.0, -1.0),
+			vector3d(0.0, 1.0, 0.0));
+	int width = 40, height = 30;
+	std::vector<rgbcolord> plain, traced;
+	sc.renderImage(cam, width, height, plain);
+	tracelog log;
+	sc.setTraceLog(&log);
+	sc.renderImage(cam, width, height, traced);
+	sc.setTraceLog(0);
+	for (size_t k = 0; k < plain.size(); k++)
+		ASSERT_EQ(plain[k].getR(), traced[k].getR());
+
+	const int T = RENDER_TILE_SIZE;
+	int bands = (height + T - 1) / T;
+	int tiles = bands * ((width + T - 1) / T);
+	std::set<int> traceTasks, shadeTasks;
+	int writes = 0;
+	const std::vector<traceevent> &events = log.getEvents();
+	for (size_t i = 0; i < events.size(); i++) {
+		const traceevent &e = events[i];
+		ASSERT_LE(e.begin, e.end);
+		std::string name = e.name;
+		if (name == "write tile") {
+			ASSERT_EQ(TRACE_WRITER_LANE, e.lane);
+			writes++;
+			continue;
+		}
+		ASSERT_GE(e.lane, TRACE_WORKER_LANE);
+		ASSERT_LT(e.lane, TRACE_WORKER_LANE + 2);
+		if (name == "trace band")
+			traceTasks.insert(e.task);
+		else if (name == "shade tile")
+			shadeTasks.insert(e.task);
+	}
+	EXPECT_EQ((size_t) bands, traceTasks.size());
+	EXPECT_EQ((size_t) tiles, shadeTasks.size());
+	EXPECT_TRUE(writes == 0 || writes == tiles);
+	size_t before = events.size();
+	sc.renderImage(cam, width, height, traced);
+	EXPECT_EQ(before, events.size());
+}
+
+#endif
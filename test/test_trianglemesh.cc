@@ -0,0 +1,324 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "trianglemesh.hh"
+#include "meshloader.hh"
+#include "scene.hh"
+#include "light.hh"
+#include "camera.hh"
+#include "mvector.hh"
+#include "rgbcolor.hh"
+#include "gtest/gtest.h"
+#include "boost/shared_ptr.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifndef TEST_TRIANGLEMESH_CC
+#define TEST_TRIANGLEMESH_CC
+
+/*
+ * Makes buffers of the given coordinates and triangles.
+ */
+static boost::shared_ptr<const meshbuffersd> makeMeshBuffers(
+		std::vector<double> coords, std::vector<int> tris) {
+	boost::shared_ptr<meshbuffersd> buffers(new meshbuffersd());
+	buffers->setVertices(coords);
+	buffers->setIndices(tris);
+	return buffers;
+}
+
+/*
+ * Makes the unit square in the z = 0 plane out of two triangles.
+ */
+static boost::shared_ptr<const meshbuffersd> makeQuadBuffers() {
+	double coords[] = { -1, -1, 0, 1, -1, 0, 1, 1, 0, -1, 1, 0 };
+	int tris[] = { 0, 1, 2, 0, 2, 3 };
+	return makeMeshBuffers(std::vector<double>(coords, coords + 12),
+			std::vector<int>(tris, tris + 6));
+}
+
+/*
+ * Rays hit the quad where the plane it's in says, from either side, with
+ * the normal facing them, and miss past its edges.
+ */
+TEST(trianglemesh, HitsQuad) {
+	trianglemeshd quad(rgbcolord(1, 0, 0), makeQuadBuffers());
+	ASSERT_EQ(2u, quad.getBuffers()->getTriangleCount());
+
+	ray3d front(vector3d(0.5, 0.25, 5.0), vector3d(0.0, 0.0, -1.0));
+	ASSERT_DOUBLE_EQ(5, quad.intersection(front));
+	hitrecord<double, double, double, 3> rec;
+	rec.t = quad.intersection(front);
+	quad.completeHit(front, rec);
+	ASSERT_DOUBLE_EQ(1, rec.normal[2]);
+
+	ray3d back(vector3d(-0.5, 0.5, -2.0), vector3d(0.0, 0.0, 1.0));
+	ASSERT_DOUBLE_EQ(2, quad.intersection(back));
+	rec.t = quad.intersection(back);
+	quad.completeHit(back, rec);
+	ASSERT_DOUBLE_EQ(-1, rec.normal[2]);
+
+	ray3d outside(vector3d(1.5, 0.0, 5.0), vector3d(0.0, 0.0, -1.0));
+	ASSERT_EQ(RAY_MISS, quad.intersection(outside));
+	ray3d away(vector3d(0.0, 0.0, 5.0), vector3d(0.0, 0.0, 1.0));
+	ASSERT_EQ(RAY_MISS, quad.intersection(away));
+
+	aabb3d box;
+	ASSERT_TRUE(quad.getBounds(box));
+	ASSERT_DOUBLE_EQ(-1, box.getMin()[0]);
+	ASSERT_DOUBLE_EQ(1, box.getMax()[1]);
+}
+
+/*
+ * The mesh's tree finds the hits of testing every triangle on its own.
+ */
+TEST(trianglemesh, MatchesBruteForce) {
+	srand(7);
+	std::vector<double> coords;
+	std::vector<int> tris;
+	for (int i = 0; i < 300; i++) {
+		double cx = rand() % 2000 / 100.0 - 10;
+		double cy = rand() % 2000 / 100.0 - 10;
+		double cz = rand() % 2000 / 100.0 - 10;
+		for (int k = 0; k < 3; k++) {
+			coords.push_back(cx + rand() % 200 / 100.0);
+			coords.push_back(cy + rand() % 200 / 100.0);
+			coords.push_back(cz + rand() % 200 / 100.0);
+			tris.push_back(3 * i + k);
+		}
+	}
+	trianglemeshd mesh(rgbcolord(1, 1, 1), makeMeshBuffers(coords, tris));
+	ASSERT_GT(mesh.getNodeCount(), 1);
+	std::vector<boost::shared_ptr<trianglemeshd> > singles;
+	for (int i = 0; i < 300; i++) {
+		std::vector<double> c(coords.begin() + 9 * i,
+				coords.begin() + 9 * i + 9);
+		std::vector<int> t;
+		t.push_back(0);
+		t.push_back(1);
+		t.push_back(2);
+		singles.push_back(boost::shared_ptr<trianglemeshd>(new trianglemeshd(
+				rgbcolord(1, 1, 1), makeMeshBuffers(c, t))));
+	}
+
+	int hits = 0;
+	for (int j = 0; j < 500; j++) {
+		vector3d origin(rand() % 4000 / 100.0 - 20, rand() % 4000 / 100.0 - 20,
+				30.0);
+		vector3d target(rand() % 2000 / 100.0 - 10, rand() % 2000 / 100.0 - 10,
+				rand() % 2000 / 100.0 - 10);
+		ray3d r(origin, (target - origin).norm());
+		double best = RAY_MISS;
+		for (size_t i = 0; i < singles.size(); i++) {
+			double t = singles[i]->intersection(r);
+			if (t != RAY_MISS && (best == RAY_MISS || t < best))
+				best = t;
+		}
+		ASSERT_EQ(best, mesh.intersection(r)) << j;
+		hits += best != RAY_MISS;
+	}
+	ASSERT_GT(hits, 0);
+}
+
+/*
+ * Makes an n x n grid of unit quads in the z = 0 plane, each split into two
+ * triangles along a diagonal, with shared vertices.
+ */
+template<typename vec_T>
+static boost::shared_ptr<const meshbuffers<vec_T> > makeGridBuffers(int n) {
+	std::vector<vec_T> coords;
+	std::vector<int> tris;
+	for (int y = 0; y <= n; y++)
+		for (int x = 0; x <= n; x++) {
+			coords.push_back((vec_T) x);
+			coords.push_back((vec_T) y);
+			coords.push_back(0);
+		}
+	for (int y = 0; y < n; y++)
+		for (int x = 0; x < n; x++) {
+			int a = y * (n + 1) + x, b = a + 1, c = a + n + 2, d = a + n + 1;
+			int quad[] = { a, b, c, a, c, d };
+			tris.insert(tris.end(), quad, quad + 6);
+		}
+	boost::shared_ptr<meshbuffers<vec_T> > buffers(new meshbuffers<vec_T>());
+	buffers->setVertices(coords);
+	buffers->setIndices(tris);
+	return buffers;
+}
+
+/*
+ * Rays through the shared vertices and edges of a grid never slip between
+ * its triangles, and every instruction set finds the same hits at the same
+ * times.
+ */
+template<typename vec_T>
+static void checkWatertight() {
+	typedef trianglemesh<vec_T, vec_T, vec_T> mesh_t;
+	const int n = 12;
+	mesh_t grid(rgbcolor<vec_T>(1, 1, 1), makeGridBuffers<vec_T>(n));
+	ASSERT_EQ(2 * n * n, (int) grid.getBuffers()->getTriangleCount());
+	ASSERT_GE(grid.getPacketCount() * trianglelanes<vec_T>::width, 2 * n * n);
+
+	simdLevel saved = activeSimdLevel();
+	std::vector<vec_T> times;
+	for (int level = SIMD_SCALAR; level <= detectSimdLevel(); level++) {
+		setSimdLevel((simdLevel) level);
+		int i = 0;
+		for (int y = 2; y < 2 * n - 1; y++)
+			for (int x = 2; x < 2 * n - 1; x++, i++) {
+				mvector<vec_T, 3> target((vec_T) (x * 0.5), (vec_T) (y * 0.5),
+						0);
+				mvector<vec_T, 3> origin((vec_T) (0.37 * (i % 7) - 1),
+						(vec_T) (0.29 * (i % 5) - 0.6), (vec_T) (3 + i % 4));
+				ray<vec_T, vec_T, 3> r(origin, (target - origin).norm());
+				vec_T t = grid.intersection(r);
+				ASSERT_NE(RAY_MISS, t) << level << " " << x << " " << y;
+				if (level == SIMD_SCALAR)
+					times.push_back(t);
+				else
+					ASSERT_EQ(times[i], t) << level << " " << x << " " << y;
+			}
+	}
+	setSimdLevel(saved);
+}
+
+/*
+ * The double and float kernels are watertight and agree with the scalar
+ * one.
+ */
+TEST(trianglemesh, Watertight) {
+	checkWatertight<double>();
+	checkWatertight<float>();
+}
+
+/*
+ * A mesh in a scene renders like the flat rectangle it makes up.
+ */
+TEST(trianglemesh, RendersInScene) {
+	scene3d sc(false);
+	sc.setAccelerator(sp_bvh3d(new bvh3d()));
+	sc.addShape(sp_shape3d(new trianglemeshd(rgbcolord(0, 1, 0),
+			makeQuadBuffers())));
+	sc.addPointLight(sp_lightd(new lightd(rgbcolord(1, 1, 1),
+			vector3d(0.0, 0.0, 5.0))));
+	sc.finalize();
+	camera<double, double, 3> cam(vector3d(0.0, 0.0, 5.0),
+			vector3d(0.0, 0.0, 0.0), vector3d(0.0, 1.0, 0.0));
+	std::vector<rgbcolor<double> > image;
+	sc.renderImage(cam, 16, 16, image);
+	const rgbcolor<double> &center = image[8 * 16 + 8];
+	ASSERT_GT(center.getG(), 0.5);
+	ASSERT_EQ(0, center.getR());
+	ASSERT_EQ(0, image[0].getG());
+}
+
+/*
+ * Writes a file for the loader tests.
+ */
+static void writeMeshTestFile(const std::string &path,
+		const std::string &bytes) {
+	std::ofstream out(path.c_str(), std::ios::binary);
+	out << bytes;
+}
+
+/*
+ * Makes a binary little endian PLY file of the quad, padding its header so
+ * the vertices start aligned.
+ */
+static std::string makeQuadPly(bool doubles) {
+	const char *type = doubles ? "double" : "float";
+	std::string header = std::string("ply\nformat binary_little_endian 1.0\n"
+			"element vertex 4\nproperty ") + type + " x\nproperty " + type +
+			" y\nproperty " + type + " z\nelement face 1\n"
+			"property list uchar int vertex_indices\nend_header\n";
+	std::string comment = "comment ";
+	while ((header.size() + comment.size() + 1) % 8 != 0)
+		comment += "x";
+	header.insert(4, comment + "\n");
+	double coords[] = { -1, -1, 0, 1, -1, 0, 1, 1, 0, -1, 1, 0 };
+	std::string bytes = header;
+	for (int i = 0; i < 12; i++) {
+		float f = (float) coords[i];
+		if (doubles)
+			bytes.append((const char *) &coords[i], sizeof(double));
+		else
+			bytes.append((const char *) &f, sizeof(float));
+	}
+	int quad[] = { 0, 1, 2, 3 };
+	bytes += (char) 4;
+	bytes.append((const char *) quad, sizeof(quad));
+	return bytes;
+}
+
+/*
+ * PLY and OBJ meshes load with their polygons split into triangles. PLY
+ * vertices of the right precision are used in place from the mapping.
+ */
+TEST(trianglemesh, LoadsFiles) {
+	if (!isLittleEndian())
+		return;
+	writeMeshTestFile("/tmp/rt_test_mesh_f.ply", makeQuadPly(false));
+	writeMeshTestFile("/tmp/rt_test_mesh_d.ply", makeQuadPly(true));
+	writeMeshTestFile("/tmp/rt_test_mesh.obj", "# quad\nv -1 -1 0\n"
+			"v 1 -1 0\nv 1 1 0\nv -1 1 0\nvn 0 0 1\nf 1//1 2//1 3//1 -1//1\n");
+
+	boost::shared_ptr<const meshbuffersf> f;
+	std::string error;
+	ASSERT_TRUE(loadMesh("/tmp/rt_test_mesh_f.ply", f, error)) << error;
+	ASSERT_TRUE(f->isMapped());
+	ASSERT_LT(f->getMemoryUsage(), 12 * sizeof(float));
+
+	const char *paths[] = { "/tmp/rt_test_mesh_d.ply",
+			"/tmp/rt_test_mesh_f.ply", "/tmp/rt_test_mesh.obj" };
+	bool mapped[] = { true, false, false };
+	for (int i = 0; i < 3; i++) {
+		boost::shared_ptr<const meshbuffersd> d;
+		ASSERT_TRUE(loadMesh(paths[i], d, error)) << paths[i] << error;
+		ASSERT_EQ(mapped[i], d->isMapped()) << paths[i];
+		ASSERT_EQ(4u, d->getVertexCount());
+		ASSERT_EQ(2u, d->getTriangleCount());
+		ASSERT_DOUBLE_EQ(1, d->getVertex(2)[0]);
+		ASSERT_DOUBLE_EQ(1, d->getVertex(2)[1]);
+		const int *second = d->getTriangle(1);
+		ASSERT_EQ(0, second[0]);
+		ASSERT_EQ(2, second[1]);
+		ASSERT_EQ(3, second[2]);
+	}
+	std::remove("/tmp/rt_test_mesh_f.ply");
+	std::remove("/tmp/rt_test_mesh_d.ply");
+	std::remove("/tmp/rt_test_mesh.obj");
+}
+
+/*
+ * Broken meshes say what's wrong and where.
+ */
+TEST(trianglemesh, ReportsErrors) {
+	const char *files[] = { "v 0 0 0\nv 1 0 0\nf 1 2 3\n", "v 0 0\n",
+			"v 0 0 0\n", "ply\nformat ascii 1.0\nend_header\n",
+			"ply\nformat binary_little_endian 1.0\nelement vertex 9\n"
+			"property float x\nproperty float y\nproperty float z\n"
+			"end_header\n" };
+	const char *errors[] = { "the face on line 3 refers to a missing vertex",
+			"the vertex on line 1 is malformed", "has no triangles",
+			"only binary PLY", "truncated" };
+	for (int i = 0; i < 5; i++) {
+		writeMeshTestFile("/tmp/rt_test_mesh_bad", files[i]);
+		boost::shared_ptr<const meshbuffersd> d;
+		std::string error;
+		ASSERT_FALSE(loadMesh("/tmp/rt_test_mesh_bad", d, error)) << i;
+		ASSERT_NE(std::string::npos, error.find(errors[i])) << error;
+	}
+	std::string error;
+	boost::shared_ptr<const meshbuffersd> d;
+	ASSERT_FALSE(loadMesh("/tmp/rt_test_mesh_missing", d, error));
+	ASSERT_EQ("could not read mesh /tmp/rt_test_mesh_missing.", error);
+	std::remove("/tmp/rt_test_mesh_bad");
+}
+
+#endif // TEST_TRIANGLEMESH_CC
@@ -0,0 +1,102 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "viewcommand.hh"
+#include "gtest/gtest.h"
+#include <cmath>
+#include <string>
+
+#ifndef TEST_VIEWCOMMAND_CC
+#define TEST_VIEWCOMMAND_CC
+
+/*
+ * View commands take their numbers or vectors in order; blank lines and
+ * comments are nothing, and malformed lines say what's wrong with them.
+ */
+TEST(viewcommand, ParsesCommands) {
+	viewcommand cmd;
+	std::string error;
+	ASSERT_TRUE(parseViewCommand("move 1 -2 0.5", cmd, error)) << error;
+	ASSERT_EQ(VIEW_MOVE, cmd.kind);
+	ASSERT_EQ(-2, cmd.args[0][1]);
+	ASSERT_EQ(0.5, cmd.args[0][2]);
+	ASSERT_TRUE(parseViewCommand(" orbit 15 -5\r", cmd, error)) << error;
+	ASSERT_EQ(VIEW_ORBIT, cmd.kind);
+	ASSERT_EQ(15, cmd.args[0][0]);
+	ASSERT_TRUE(parseViewCommand("camera <1, 2, 3> <0, 0, 0> <0, 1, 0>", cmd,
+			error)) << error;
+	ASSERT_EQ(VIEW_CAMERA, cmd.kind);
+	ASSERT_EQ(3, cmd.args[0][2]);
+	ASSERT_EQ(1, cmd.args[2][1]);
+	ASSERT_TRUE(parseViewCommand("reset", cmd, error));
+	ASSERT_EQ(VIEW_RESET, cmd.kind);
+	ASSERT_TRUE(parseViewCommand("# quit", cmd, error));
+	ASSERT_EQ(VIEW_NONE, cmd.kind);
+
+	const char *bad[] = { "fly 1 2 3", "move 1 2", "turn 5", "zoom 0",
+			"zoom -2", "camera <0, 0, 0> <1, 1>", "reset now", "quit 1" };
+	for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		error.clear();
+		ASSERT_FALSE(parseViewCommand(bad[i], cmd, error)) << bad[i];
+		ASSERT_FALSE(error.empty()) << bad[i];
+	}
+}
+
+/*
+ * Applies one line to a view and checks that it moved.
+ */
+static void applyLine(viewstate &view, const std::string &line) {
+	viewcommand cmd;
+	std::string error;
+	ASSERT_TRUE(parseViewCommand(line, cmd, error)) << error;
+	ASSERT_TRUE(view.apply(cmd)) << line;
+}
+
+/*
+ * Moves follow the camera's axes, turns and orbits keep their distances
+ * and stop short of straight up, zooms close in on the point looked at,
+ * and a reset goes back to the start.
+ */
+TEST(viewstate, MovesCamera) {
+	typedef mvector<double, 3> vec;
+	viewstate view(vec(0.0, 0.0, 10.0), vec(0.0, 0.0, 0.0),
+			vec(0.0, 1.0, 0.0));
+	applyLine(view, "move 1 2 3");
+	ASSERT_NEAR(1, view.getPosition()[0], 1e-12);
+	ASSERT_NEAR(2, view.getPosition()[1], 1e-12);
+	ASSERT_NEAR(7, view.getPosition()[2], 1e-12);
+	ASSERT_NEAR(-3, view.getLookat()[2], 1e-12);
+
+	applyLine(view, "reset");
+	applyLine(view, "turn 90 0");
+	ASSERT_NEAR(10, view.getLookat()[0], 1e-9);
+	ASSERT_NEAR(10, view.getLookat()[2], 1e-9);
+	ASSERT_NEAR(10, view.getPosition()[2], 1e-12);
+
+	applyLine(view, "reset");
+	applyLine(view, "orbit 90 0");
+	ASSERT_NEAR(10, view.getPosition()[0], 1e-9);
+	ASSERT_NEAR(0, view.getPosition()[2], 1e-9);
+	applyLine(view, "orbit 0 200");
+	ASSERT_NEAR(10, view.getPosition().mag(), 1e-9);
+	ASSERT_NEAR(10 * std::sin((90 - VIEW_PITCH_LIMIT) * M_PI / 180),
+			view.getPosition()[1], 1e-9);
+
+	applyLine(view, "reset");
+	applyLine(view, "zoom 4");
+	ASSERT_NEAR(2.5, view.getPosition()[2], 1e-12);
+	applyLine(view, "camera <5, 0, 0> <0, 0, 0> <0, 0, 1>");
+	ASSERT_EQ(1, view.getUp()[2]);
+	applyLine(view, "reset");
+	ASSERT_EQ(10, view.getPosition()[2]);
+	ASSERT_EQ(1, view.getUp()[1]);
+
+	viewcommand still;
+	std::string error;
+	ASSERT_TRUE(parseViewCommand("turn 0 0", still, error));
+	ASSERT_FALSE(view.apply(still));
+}
+
+#endif // TEST_VIEWCOMMAND_CC
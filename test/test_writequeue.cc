@@ -0,0 +1,82 @@
+/**
+ * @file
+ * @author Hamik Mukelyan
+ */
+
+#include "writequeue.hh"
+#include "boost/thread.hpp"
+#include "boost/atomic.hpp"
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include "gtest/gtest.h"
+#include <vector>
+
+#ifndef TEST_WRITEQUEUE_CC
+#define TEST_WRITEQUEUE_CC
+
+/**
+ * Job that takes a little while, then records its number and how many
+ * jobs had finished before it, and fails if told to.
+ */
+struct slowJob {
+	int number;
+	bool fail;
+	std::vector<int> *order;
+	boost::atomic<int> *done;
+
+	bool operator()() const {
+		boost::this_thread::sleep(boost::posix_time::milliseconds(2));
+		order->push_back(number);
+		(*done)++;
+		return !fail;
+	}
+};
+
+/*
+ * Jobs run in the order they're pushed, and pushing waits so that no more
+ * than the depth are ever waiting or running.
+ */
+TEST(writequeue, RunsInOrderWithinDepth) {
+	std::vector<int> order;
+	boost::atomic<int> done(0);
+	writequeue<slowJob> queue(2);
+	ASSERT_EQ(2, queue.getDepth());
+	for (int i = 0; i < 12; i++) {
+		slowJob job;
+		job.number = i;
+		job.fail = false;
+		job.order = &order;
+		job.done = &done;
+		ASSERT_TRUE(queue.push(job));
+		ASSERT_LE(i + 1 - done.load(), 2);
+	}
+	ASSERT_TRUE(queue.finish());
+	ASSERT_EQ(12, done.load());
+	ASSERT_EQ(12ul, queue.getWritten());
+	ASSERT_GT(queue.getStalls(), 0ul);
+	for (int i = 0; i < 12; i++)
+		ASSERT_EQ(i, order[i]);
+}
+
+/*
+ * A failed job doesn't stop the ones after it, but the failure shows up
+ * in the next push and in finish.
+ */
+TEST(writequeue, ReportsFailures) {
+	std::vector<int> order;
+	boost::atomic<int> done(0);
+	writequeue<slowJob> queue(1);
+	slowJob job;
+	job.order = &order;
+	job.done = &done;
+	job.number = 0;
+	job.fail = true;
+	ASSERT_TRUE(queue.push(job));
+	job.number = 1;
+	job.fail = false;
+	// Waits for the failed job, since the depth is 1.
+	ASSERT_FALSE(queue.push(job));
+	ASSERT_FALSE(queue.finish());
+	ASSERT_EQ(2, done.load());
+}
+
+#endif // TEST_WRITEQUEUE_CC